@@ -0,0 +1,163 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Minimal benchmark harness
+ *
+ * Every benchmark is a callable which runs a given amount of iterations,
+ * the harness calibrates the iteration count until the minimum run time
+ * is reached and records the time per operation.
+ *
+ * Results are printed human-readable to stderr while running and as
+ * JSON to stdout (or a file) at the end.
+ *
+ */
+namespace Benchmark {
+
+// prevent the compiler from optimizing away the result
+template<typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result
+{
+    std::string name;
+    std::uint64_t iterations;
+    double nsPerOp;
+
+    // additional metrics like memory usage and file sizes
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+struct Options
+{
+    std::string filter;
+    std::string jsonFile;
+    double minTimeMs = 200.0;
+
+    // amount of tokens of the synthetic token databases
+    std::vector<std::size_t> databaseSizes = {1000U, 10000U, 100000U};
+
+    // amount of tokens of the generated import files
+    std::vector<std::size_t> corpusSizes = {10U, 1000U, 100000U};
+};
+
+inline Options &options()
+{
+    static Options options;
+    return options;
+}
+
+inline std::vector<Result> &results()
+{
+    static std::vector<Result> results;
+    return results;
+}
+
+inline std::vector<std::pair<std::string, std::string>> &context()
+{
+    static std::vector<std::pair<std::string, std::string>> context;
+    return context;
+}
+
+inline bool enabled(const std::string &name)
+{
+    return options().filter.empty() || name.find(options().filter) != std::string::npos;
+}
+
+// record a result which was measured outside of run(), like one-shot operations
+inline Result &record(const std::string &name, std::uint64_t iterations, double ns_per_op)
+{
+    std::fprintf(stderr, "%-60s %12.1f ns/op %12llu iterations\n",
+                 name.c_str(), ns_per_op, static_cast<unsigned long long>(iterations));
+    results().push_back({name, iterations, ns_per_op, {}});
+    return results().back();
+}
+
+// run the benchmark, fn(iterations) performs iterations * ops_per_iteration operations
+inline void run(const std::string &name, std::uint64_t ops_per_iteration,
+                const std::function<void(std::uint64_t)> &fn)
+{
+    if (!enabled(name))
+    {
+        return;
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    // warm up and calibrate
+    std::uint64_t iterations = 1U;
+    double elapsed_ns = 0.0;
+    for (;;)
+    {
+        const auto start = clock::now();
+        fn(iterations);
+        elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        if (elapsed_ns >= options().minTimeMs * 1e6 || iterations >= (1ULL << 40))
+        {
+            break;
+        }
+
+        // aim slightly above the minimum time
+        const auto factor = elapsed_ns > 0.0 ? (options().minTimeMs * 1.2e6) / elapsed_ns : 10.0;
+        iterations = static_cast<std::uint64_t>(iterations * std::min(std::max(factor, 1.5), 100.0)) + 1U;
+    }
+
+    const auto ops = iterations * ops_per_iteration;
+    record(name, ops, elapsed_ns / static_cast<double>(ops));
+}
+
+inline std::string escape(const std::string &str)
+{
+    std::string escaped;
+    for (auto&& c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+inline void writeJson(std::FILE *out)
+{
+    std::fprintf(out, "{\n  \"context\": {");
+    for (auto i = 0U; i < context().size(); ++i)
+    {
+        std::fprintf(out, "%s\n    \"%s\": \"%s\"", i ? "," : "",
+                     escape(context()[i].first).c_str(), escape(context()[i].second).c_str());
+    }
+    std::fprintf(out, "\n  },\n  \"benchmarks\": [");
+
+    for (auto i = 0U; i < results().size(); ++i)
+    {
+        const auto &r = results()[i];
+        std::fprintf(out, "%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f",
+                     i ? "," : "", escape(r.name).c_str(), static_cast<unsigned long long>(r.iterations),
+                     r.nsPerOp, r.nsPerOp > 0.0 ? 1e9 / r.nsPerOp : 0.0);
+        for (auto&& counter : r.counters)
+        {
+            std::fprintf(out, ", \"%s\": %.1f", escape(counter.first).c_str(), counter.second);
+        }
+        std::fprintf(out, "}");
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+}
+
+}
+
+#endif // BENCHMARK_HPP
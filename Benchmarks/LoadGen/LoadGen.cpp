@@ -0,0 +1,526 @@
+#include "LoadGen.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <thread>
+
+#include <Clock.hpp>
+#include <Codec.hpp>
+#include <OTPGen.hpp>
+#include <TokenDatabase.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace LoadGen {
+
+namespace {
+    using clock = std::chrono::steady_clock;
+
+    static const constexpr std::size_t SECRET_SIZE = 20U;
+    static const constexpr OTPToken::DigitType DIGITS = 6U;
+    static const constexpr OTPToken::PeriodType PERIOD = 30U;
+
+    // codes remembered per connection for replays
+    static const constexpr std::size_t REPLAY_HISTORY = 64U;
+    // time the server gets to answer the outstanding requests after the run
+    static const constexpr std::chrono::seconds DRAIN_TIMEOUT(2);
+
+    enum Kind : std::uint8_t {
+        Fresh,
+        Replay,
+        Generate,
+    };
+
+    static std::uint64_t splitmix(std::uint64_t &state)
+    {
+        auto z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static double uniform(std::uint64_t &state)
+    {
+        return static_cast<double>(splitmix(state) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    static void secretBytes(std::size_t position, unsigned char *bytes)
+    {
+        std::uint64_t state = position * 0x2545f4914f6cdd1dULL + 1U;
+        for (auto i = 0U; i < SECRET_SIZE; i += 8U)
+        {
+            const auto value = splitmix(state);
+            for (auto j = 0U; j < 8U && i + j < SECRET_SIZE; ++j)
+            {
+                bytes[i + j] = static_cast<unsigned char>(value >> (j * 8U));
+            }
+        }
+    }
+
+    struct Pending
+    {
+        clock::time_point start;
+        Kind kind;
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        std::deque<Pending> pending;
+        clock::time_point next;
+        std::vector<std::string> history;
+        std::size_t history_next = 0U;
+    };
+
+    struct Worker
+    {
+        std::vector<Connection> connections;
+        std::vector<std::uint64_t> latencies;
+        Report report;
+        std::uint64_t rng = 0U;
+        bool failed = false;
+    };
+
+    static int connectServer(const Options &options)
+    {
+        int fd = -1;
+        if (!options.socket.empty())
+        {
+            sockaddr_un address;
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if (options.socket.size() >= sizeof(address.sun_path))
+            {
+                return -1;
+            }
+            std::memcpy(address.sun_path, options.socket.c_str(), options.socket.size() + 1U);
+            fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+            {
+                ::close(fd);
+                return -1;
+            }
+        }
+        else
+        {
+            sockaddr_in address;
+            std::memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_port = htons(options.port);
+            if (::inet_pton(AF_INET, options.address.c_str(), &address.sin_addr) != 1)
+            {
+                return -1;
+            }
+            fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+            {
+                ::close(fd);
+                return -1;
+            }
+            const int enable = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        if (fd >= 0)
+        {
+            (void) ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+        return fd;
+    }
+
+    // picks the tokens, rank 1 is the most popular with a skew
+    class TokenPicker
+    {
+    public:
+        TokenPicker(std::size_t tokens, double skew)
+            : _tokens(std::max<std::size_t>(tokens, 1U))
+        {
+            if (skew <= 0.0)
+            {
+                return;
+            }
+            this->_cdf.resize(this->_tokens);
+            auto sum = 0.0;
+            for (auto i = 0U; i < this->_tokens; ++i)
+            {
+                sum += 1.0 / std::pow(static_cast<double>(i + 1U), skew);
+                this->_cdf[i] = sum;
+            }
+            for (auto&& value : this->_cdf)
+            {
+                value /= sum;
+            }
+        }
+
+        // id of the token
+        std::size_t pick(std::uint64_t &rng) const
+        {
+            if (this->_cdf.empty())
+            {
+                return static_cast<std::size_t>(splitmix(rng) % this->_tokens) + 1U;
+            }
+            const auto it = std::lower_bound(this->_cdf.begin(), this->_cdf.end(), uniform(rng));
+            return static_cast<std::size_t>(std::min<std::ptrdiff_t>(it - this->_cdf.begin(),
+                                                                     static_cast<std::ptrdiff_t>(this->_tokens - 1U))) + 1U;
+        }
+
+    private:
+        std::size_t _tokens;
+        std::vector<double> _cdf;
+    };
+
+    static void request(const Options &options, const TokenPicker &picker, Worker &worker,
+                        Connection &connection, const clock::time_point &start)
+    {
+        const auto choice = uniform(worker.rng);
+        if (choice < options.generate)
+        {
+            connection.out += "generate\t" + std::to_string(picker.pick(worker.rng)) + "\n";
+            connection.pending.push_back({start, Generate});
+            return;
+        }
+        if (choice < options.generate + options.replay && !connection.history.empty())
+        {
+            // a code sent before on the same connection, so the server saw the original first
+            connection.out += connection.history[static_cast<std::size_t>(splitmix(worker.rng) % connection.history.size())];
+            connection.pending.push_back({start, Replay});
+            return;
+        }
+
+        const auto id = picker.pick(worker.rng);
+        unsigned char bytes[SECRET_SIZE];
+        secretBytes(id - 1U, bytes);
+        const auto key = OTPGen::prepareRawKey(bytes, SECRET_SIZE, OTPToken::SHA1);
+        OTPGen::TokenBuffer code;
+        (void) OTPGen::computeTOTPInto(code, Clock::current(), key, DIGITS, PERIOD);
+
+        auto line = "verify\t" + std::to_string(id) + "\t" + code + "\n";
+        if (connection.history.size() < REPLAY_HISTORY)
+        {
+            connection.history.emplace_back(line);
+        }
+        else
+        {
+            connection.history[connection.history_next] = line;
+            connection.history_next = (connection.history_next + 1U) % REPLAY_HISTORY;
+        }
+        connection.out += line;
+        connection.pending.push_back({start, Fresh});
+    }
+
+    static bool flush(Connection &connection)
+    {
+        while (!connection.out.empty())
+        {
+            const auto size = ::send(connection.fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+            if (size <= 0)
+            {
+                return false;
+            }
+            connection.out.erase(0U, static_cast<std::size_t>(size));
+        }
+        return true;
+    }
+
+    static void answered(Worker &worker, const Pending &pending, const std::string &line,
+                         const clock::time_point &now, const clock::time_point &measure_begin,
+                         const clock::time_point &measure_end)
+    {
+        if (pending.start < measure_begin || pending.start >= measure_end)
+        {
+            return;
+        }
+
+        auto &report = worker.report;
+        ++report.requests;
+        worker.latencies.emplace_back(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - pending.start).count()));
+
+        if (line.compare(0U, 3U, "ok\t") != 0)
+        {
+            ++report.errors;
+        }
+        else if (pending.kind == Generate)
+        {
+            ++report.generated;
+        }
+        else if (line == "ok\tmatch")
+        {
+            ++report.matched;
+            report.replaysAccepted += pending.kind == Replay ? 1U : 0U;
+        }
+        else
+        {
+            ++report.mismatched;
+        }
+    }
+
+    static bool receive(Worker &worker, Connection &connection, const clock::time_point &measure_begin,
+                        const clock::time_point &measure_end)
+    {
+        char buffer[16384];
+        for (;;)
+        {
+            const auto size = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+            if (size <= 0)
+            {
+                return false;
+            }
+            connection.in.append(buffer, static_cast<std::size_t>(size));
+        }
+
+        const auto now = clock::now();
+        std::size_t begin = 0U;
+        for (auto end = connection.in.find('\n'); end != std::string::npos; end = connection.in.find('\n', begin))
+        {
+            if (connection.pending.empty())
+            {
+                return false;
+            }
+            answered(worker, connection.pending.front(), connection.in.substr(begin, end - begin),
+                     now, measure_begin, measure_end);
+            connection.pending.pop_front();
+            begin = end + 1U;
+        }
+        connection.in.erase(0U, begin);
+        return true;
+    }
+
+    static void run(const Options &options, const TokenPicker &picker, Worker &worker,
+                    const clock::time_point &begin, const clock::time_point &measure_begin,
+                    const clock::time_point &measure_end)
+    {
+        const auto open_loop = options.qps > 0.0;
+        const auto interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(
+            open_loop ? static_cast<double>(options.connections) / options.qps : 0.0));
+        const auto pipeline = std::max<std::size_t>(options.pipeline, 1U);
+
+        for (auto i = 0U; i < worker.connections.size(); ++i)
+        {
+            // the connections are spread over the interval
+            auto &connection = worker.connections[i];
+            connection.next = begin + interval * i / std::max<std::size_t>(worker.connections.size(), 1U);
+        }
+
+        std::vector<pollfd> fds(worker.connections.size());
+        for (;;)
+        {
+            const auto now = clock::now();
+            const auto sending = now < measure_end;
+            auto outstanding = false;
+            auto wake = now + std::chrono::milliseconds(sending ? 100 : 10);
+
+            for (auto i = 0U; i < worker.connections.size(); ++i)
+            {
+                auto &connection = worker.connections[i];
+                while (sending && connection.pending.size() < pipeline && (!open_loop || connection.next <= now))
+                {
+                    const auto start = open_loop ? connection.next : now;
+                    if (open_loop && now - start > std::chrono::milliseconds(1) && start >= measure_begin)
+                    {
+                        ++worker.report.late;
+                    }
+                    request(options, picker, worker, connection, start);
+                    connection.next += interval;
+                }
+                if (open_loop && sending)
+                {
+                    wake = std::min(wake, connection.next);
+                }
+                if (!flush(connection))
+                {
+                    worker.failed = true;
+                    return;
+                }
+
+                outstanding |= !connection.pending.empty();
+                fds[i].fd = connection.fd;
+                fds[i].events = static_cast<short>(POLLIN | (connection.out.empty() ? 0 : POLLOUT));
+                fds[i].revents = 0;
+            }
+
+            if (!sending && (!outstanding || now >= measure_end + DRAIN_TIMEOUT))
+            {
+                return;
+            }
+
+            const auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count();
+            if (::poll(fds.data(), fds.size(), static_cast<int>(std::max<std::int64_t>(timeout, 0))) < 0 && errno != EINTR)
+            {
+                worker.failed = true;
+                return;
+            }
+            for (auto i = 0U; i < worker.connections.size(); ++i)
+            {
+                if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0 &&
+                    !receive(worker, worker.connections[i], measure_begin, measure_end))
+                {
+                    worker.failed = true;
+                    return;
+                }
+            }
+        }
+    }
+
+    static double percentileUs(const std::vector<std::uint64_t> &sorted, double fraction)
+    {
+        if (sorted.empty())
+        {
+            return 0.0;
+        }
+        const auto rank = static_cast<std::size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+        return static_cast<double>(sorted[std::min(std::max<std::size_t>(rank, 1U), sorted.size()) - 1U]) / 1e3;
+    }
+}
+
+const std::string secret(std::size_t position)
+{
+    unsigned char bytes[SECRET_SIZE];
+    secretBytes(position, bytes);
+    return Codec::base32Encode(std::string(reinterpret_cast<const char*>(bytes), SECRET_SIZE));
+}
+
+bool createVault(const std::string &file, const std::string &password, std::size_t tokens)
+{
+    TokenDatabase::setPassword(password);
+    TokenDatabase::setTokenDatabase(file);
+    TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+    std::remove(file.c_str());
+
+    // a fresh database numbers the tokens in insertion order, starting with 1
+    auto status = TokenDatabase::initializeTokens();
+    if (status == TokenDatabase::Success)
+    {
+        status = TokenDatabase::insertTokens([&](const TokenDatabase::TokenCallback &insert) {
+            char label[32];
+            for (auto i = 0U; i < tokens; ++i)
+            {
+                std::snprintf(label, sizeof(label), "load-%07zu", static_cast<std::size_t>(i));
+                insert(OTPToken(OTPToken::TOTP, label, {}, secret(i), DIGITS, PERIOD, 0U, OTPToken::SHA1));
+            }
+            return TokenDatabase::Success;
+        });
+    }
+    if (status == TokenDatabase::Success)
+    {
+        status = TokenDatabase::saveTokens();
+    }
+    if (status != TokenDatabase::Success)
+    {
+        std::fprintf(stderr, "Unable to create the vault: %s\n", TokenDatabase::getErrorMessage(status).c_str());
+    }
+    TokenDatabase::closeDatabase();
+    return status == TokenDatabase::Success;
+}
+
+bool drive(const Options &options, Report &report)
+{
+    const TokenPicker picker(options.tokens, options.skew);
+
+    const auto connections = std::max<std::size_t>(options.connections, 1U);
+    const auto hardware = std::max(1U, std::thread::hardware_concurrency());
+    const auto threads = std::min(connections, options.threads != 0U ? options.threads : hardware);
+
+    std::vector<Worker> workers(threads);
+    for (auto i = 0U; i < connections; ++i)
+    {
+        Connection connection;
+        connection.fd = connectServer(options);
+        if (connection.fd < 0)
+        {
+            std::fprintf(stderr, "Unable to connect to the server: %s\n", std::strerror(errno));
+            for (auto&& worker : workers)
+            {
+                for (auto&& open : worker.connections)
+                {
+                    ::close(open.fd);
+                }
+            }
+            return false;
+        }
+        workers[i % threads].connections.emplace_back(std::move(connection));
+    }
+
+    const auto begin = clock::now();
+    const auto measure_begin = begin + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(options.warmupSeconds));
+    const auto measure_end = measure_begin + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(options.durationSeconds));
+
+    std::vector<std::thread> running;
+    for (auto i = 0U; i < threads; ++i)
+    {
+        auto seed = options.seed + i;
+        workers[i].rng = splitmix(seed);
+        running.emplace_back(run, std::cref(options), std::cref(picker), std::ref(workers[i]),
+                             begin, measure_begin, measure_end);
+    }
+    for (auto&& thread : running)
+    {
+        thread.join();
+    }
+
+    report = Report();
+    report.seconds = options.durationSeconds;
+    std::vector<std::uint64_t> latencies;
+    auto failed = false;
+    for (auto&& worker : workers)
+    {
+        for (auto&& connection : worker.connections)
+        {
+            ::close(connection.fd);
+        }
+        failed |= worker.failed;
+        report.requests += worker.report.requests;
+        report.matched += worker.report.matched;
+        report.mismatched += worker.report.mismatched;
+        report.generated += worker.report.generated;
+        report.errors += worker.report.errors;
+        report.replaysAccepted += worker.report.replaysAccepted;
+        report.late += worker.report.late;
+        latencies.insert(latencies.end(), worker.latencies.begin(), worker.latencies.end());
+    }
+    if (failed)
+    {
+        std::fprintf(stderr, "The server closed a connection or sent unexpected responses\n");
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    report.p50Us = percentileUs(latencies, 0.5);
+    report.p99Us = percentileUs(latencies, 0.99);
+    report.p999Us = percentileUs(latencies, 0.999);
+    report.maxUs = latencies.empty() ? 0.0 : static_cast<double>(latencies.back()) / 1e3;
+    return !failed;
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef LOADGEN_HPP
+#define LOADGEN_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Load generator of the verification server
+ *
+ * The synthetic vaults hold TOTP tokens with secrets derived from their
+ * position, the token with id n has the secret of position n - 1. The
+ * generator computes the correct codes itself, so the requests are the
+ * ones of real clients: fresh codes which match, replays of codes sent
+ * before (which the server must reject) and generate requests.
+ *
+ * Every driver thread serves a share of the connections with poll(). With
+ * a target rate the requests are sent on a fixed schedule (open loop) and
+ * the latency is measured from the scheduled time, a stalled server can't
+ * hide its stalls by slowing the generator down. Without a rate every
+ * connection keeps the pipeline depth in flight (closed loop).
+ *
+ */
+namespace LoadGen {
+
+struct Options
+{
+    // Unix domain socket or IPv4 address:port of the server
+    std::string socket;
+    std::string address;
+    std::uint16_t port = 0U;
+
+    // tokens of the vault, requests go to ids 1..tokens
+    std::size_t tokens = 1000U;
+
+    std::size_t connections = 16U;
+    // driver threads, 0 uses one per connection up to the hardware threads
+    std::size_t threads = 0U;
+    // requests in flight per connection
+    std::size_t pipeline = 8U;
+    // requests per second over all connections, 0 sends as fast as the server answers
+    double qps = 0.0;
+
+    double durationSeconds = 10.0;
+    // requests of the warm-up are not measured
+    double warmupSeconds = 1.0;
+
+    // Zipf exponent of the token popularity, 0 picks the tokens uniformly
+    double skew = 0.0;
+    // fractions of the requests which replay an earlier code or generate a code
+    double replay = 0.0;
+    double generate = 0.0;
+
+    std::uint64_t seed = 1U;
+};
+
+struct Report
+{
+    std::uint64_t requests = 0U;
+    std::uint64_t matched = 0U;
+    std::uint64_t mismatched = 0U;
+    std::uint64_t generated = 0U;
+    std::uint64_t errors = 0U;
+    // replays the server accepted, must stay 0
+    std::uint64_t replaysAccepted = 0U;
+    // requests which could not be sent on schedule because the pipeline was full
+    std::uint64_t late = 0U;
+
+    double seconds = 0.0;
+    double p50Us = 0.0;
+    double p99Us = 0.0;
+    double p999Us = 0.0;
+    double maxUs = 0.0;
+
+    inline double throughput() const
+    { return this->seconds > 0.0 ? static_cast<double>(this->requests) / this->seconds : 0.0; }
+};
+
+// secret of the token at the position, base32
+const std::string secret(std::size_t position);
+
+// creates the encrypted token database with the given amount of tokens
+bool createVault(const std::string &file, const std::string &password, std::size_t tokens);
+
+// drives the server with the options, returns false if it couldn't connect
+bool drive(const Options &options, Report &report);
+
+}
+
+#endif // LOADGEN_HPP
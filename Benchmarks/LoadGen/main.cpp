@@ -0,0 +1,430 @@
+#include "LoadGen.hpp"
+#include "../Benchmark.hpp"
+
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <AppConfig.hpp>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    static const char *const PASSWORD = "otpgen-loadgen";
+
+    // the servers of the scenarios need a while for the large vaults
+    static const constexpr std::chrono::seconds STARTUP_TIMEOUT(600);
+
+    static void usage()
+    {
+        std::cerr << "Usage: otpgen-loadgen vault --file <tokens.db> --tokens <count> [--password <password>]" << std::endl;
+        std::cerr << "       otpgen-loadgen run (--socket <path> | --connect <ipv4 address>:<port>) --tokens <count>" << std::endl;
+        std::cerr << "                      [--connections <count>] [--threads <count>] [--pipeline <depth>] [--qps <rate>]" << std::endl;
+        std::cerr << "                      [--duration <s>] [--warmup <s>] [--skew <zipf exponent>] [--replay <fraction>]" << std::endl;
+        std::cerr << "                      [--generate <fraction>] [--seed <n>] [--json <file>]" << std::endl;
+        std::cerr << "       otpgen-loadgen scenarios --server <otpgen-server> [--dir <directory>] [--sizes <n,n,...>]" << std::endl;
+        std::cerr << "                      [--cores <n,n,...>] [--connections-per-core <count>] [--pipeline <depth>]" << std::endl;
+        std::cerr << "                      [--duration <s>] [--warmup <s>] [--skew <zipf exponent>] [--replay <fraction>]" << std::endl;
+        std::cerr << "                      [--generate <fraction>] [--json <file>]" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "The vaults hold TOTP tokens whose secrets the generator derives itself, run needs a server" << std::endl;
+        std::cerr << "serving a vault of at least --tokens tokens. Popular tokens verified twice within their" << std::endl;
+        std::cerr << "period are replays and count as mismatches, replays accepted by the server are reported." << std::endl;
+        std::cerr << "The server refuses generate requests on --connect, they count as errors there." << std::endl;
+        std::cerr << "scenarios runs the server for every vault size and core count, the server is bound to" << std::endl;
+        std::cerr << "the first cores and the generator to the others (default 1k/100k/1M tokens at 1-64 cores)." << std::endl;
+    }
+
+    static bool parseList(const std::string &value, std::vector<std::size_t> &list)
+    {
+        list.clear();
+        std::size_t begin = 0U;
+        while (begin < value.size())
+        {
+            const auto end = std::min(value.find(',', begin), value.size());
+            const auto number = std::strtoul(value.substr(begin, end - begin).c_str(), nullptr, 10);
+            if (number == 0UL)
+            {
+                return false;
+            }
+            list.emplace_back(number);
+            begin = end + 1U;
+        }
+        return !list.empty();
+    }
+
+    static bool parseAddress(const std::string &value, std::string &address, std::uint16_t &port)
+    {
+        const auto separator = value.rfind(':');
+        const auto number = separator == std::string::npos ? 0UL : std::strtoul(value.c_str() + separator + 1U, nullptr, 10);
+        if (number == 0UL || number > 65535UL)
+        {
+            return false;
+        }
+        address = value.substr(0U, separator);
+        port = static_cast<std::uint16_t>(number);
+        return true;
+    }
+
+    static void print(const std::string &name, const LoadGen::Options &options, const LoadGen::Report &report)
+    {
+        std::fprintf(stderr, "%-32s %10.0f req/s  p50 %8.1f us  p99 %8.1f us  p999 %8.1f us  max %9.1f us\n",
+                     name.c_str(), report.throughput(), report.p50Us, report.p99Us, report.p999Us, report.maxUs);
+        std::fprintf(stderr, "%-32s matched %llu, mismatched %llu, generated %llu, errors %llu, late %llu\n", "",
+                     static_cast<unsigned long long>(report.matched), static_cast<unsigned long long>(report.mismatched),
+                     static_cast<unsigned long long>(report.generated), static_cast<unsigned long long>(report.errors),
+                     static_cast<unsigned long long>(report.late));
+        if (report.replaysAccepted != 0U)
+        {
+            std::fprintf(stderr, "%-32s WARNING: %llu replayed codes were accepted\n", "",
+                         static_cast<unsigned long long>(report.replaysAccepted));
+        }
+
+        auto &result = Benchmark::record(name, report.requests, report.throughput() > 0.0 ? 1e9 / report.throughput() : 0.0);
+        result.counters = {
+            {"tokens", static_cast<double>(options.tokens)},
+            {"connections", static_cast<double>(options.connections)},
+            {"target_qps", options.qps},
+            {"p50_us", report.p50Us},
+            {"p99_us", report.p99Us},
+            {"p999_us", report.p999Us},
+            {"max_us", report.maxUs},
+            {"matched", static_cast<double>(report.matched)},
+            {"mismatched", static_cast<double>(report.mismatched)},
+            {"generated", static_cast<double>(report.generated)},
+            {"errors", static_cast<double>(report.errors)},
+            {"replays_accepted", static_cast<double>(report.replaysAccepted)},
+            {"late", static_cast<double>(report.late)},
+        };
+    }
+
+    static bool writeResults(const std::string &file)
+    {
+        auto out = stdout;
+        if (!file.empty())
+        {
+            out = std::fopen(file.c_str(), "w");
+            if (!out)
+            {
+                std::cerr << "Unable to open " << file << std::endl;
+                return false;
+            }
+        }
+        Benchmark::writeJson(out);
+        if (out != stdout)
+        {
+            std::fclose(out);
+        }
+        return true;
+    }
+
+    // binds the calling process to the CPUs first..last-1
+    static void pin(std::size_t first, std::size_t last)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu = first; cpu < last && cpu < CPU_SETSIZE; ++cpu)
+        {
+            CPU_SET(static_cast<int>(cpu), &set);
+        }
+        (void) ::sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    static bool connectable(const std::string &path)
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1U);
+        const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        const auto connected = fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return connected;
+    }
+
+    // starts the server on the vault of the config directory, bound to the first cores
+    static pid_t startServer(const std::string &server, const std::string &config, const std::string &socket,
+                             const std::string &log, std::size_t cores)
+    {
+        int input[2];
+        if (::pipe(input) != 0)
+        {
+            return -1;
+        }
+
+        const auto pid = ::fork();
+        if (pid == 0)
+        {
+            pin(0U, cores);
+            ::setenv("XDG_CONFIG_HOME", config.c_str(), 1);
+            ::dup2(input[0], STDIN_FILENO);
+            const auto output = ::open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+            if (output >= 0)
+            {
+                ::dup2(output, STDOUT_FILENO);
+                ::dup2(output, STDERR_FILENO);
+            }
+            ::close(input[0]);
+            ::close(input[1]);
+
+            const auto workers = std::to_string(cores);
+            ::execl(server.c_str(), server.c_str(), "--socket", socket.c_str(), "--workers", workers.c_str(),
+                    static_cast<char*>(nullptr));
+            std::_Exit(127);
+        }
+
+        ::close(input[0]);
+        if (pid > 0)
+        {
+            const std::string password = std::string(PASSWORD) + "\n";
+            (void) ::write(input[1], password.data(), password.size());
+        }
+        ::close(input[1]);
+        if (pid < 0)
+        {
+            return -1;
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + STARTUP_TIMEOUT;
+        while (!connectable(socket))
+        {
+            int status;
+            if (::waitpid(pid, &status, WNOHANG) == pid || std::chrono::steady_clock::now() >= deadline)
+            {
+                ::kill(pid, SIGKILL);
+                ::waitpid(pid, &status, 0);
+                return -1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return pid;
+    }
+
+    static int scenarios(const std::string &server, const std::string &directory, const std::vector<std::size_t> &sizes,
+                         const std::vector<std::size_t> &cores, std::size_t connections_per_core,
+                         LoadGen::Options options, const std::string &json)
+    {
+        const auto hardware = static_cast<std::size_t>(std::max(1U, std::thread::hardware_concurrency()));
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        const auto log = directory + "/server.log";
+        options.socket = directory + "/server.sock";
+        Benchmark::context().emplace_back("hardware_threads", std::to_string(hardware));
+
+        for (auto&& size : sizes)
+        {
+            // the vaults are deterministic and kept for later runs
+            const auto config = directory + "/vault-" + std::to_string(size);
+            const auto app_cfg = config + "/" + AppConfig::Developer + "/" + AppConfig::Name;
+            const auto file = app_cfg + "/tokens.db";
+            std::filesystem::create_directories(app_cfg, ec);
+            if (!std::filesystem::exists(file, ec))
+            {
+                std::fprintf(stderr, "Creating a vault of %zu tokens...\n", size);
+                if (!LoadGen::createVault(file, PASSWORD, size))
+                {
+                    return 1;
+                }
+            }
+
+            for (auto&& count : cores)
+            {
+                const auto name = "server/" + std::to_string(size) + "/" + std::to_string(count) + "c";
+                if (count > hardware)
+                {
+                    std::fprintf(stderr, "%-32s skipped, only %zu hardware threads\n", name.c_str(), hardware);
+                    continue;
+                }
+
+                const auto pid = startServer(server, config, options.socket, log, count);
+                if (pid < 0)
+                {
+                    std::fprintf(stderr, "Unable to start %s, see %s\n", server.c_str(), log.c_str());
+                    return 1;
+                }
+
+                // the generator runs on the cores the server doesn't use, if there are any
+                pin(count < hardware ? count : 0U, hardware);
+                options.tokens = size;
+                options.connections = std::max<std::size_t>(count * connections_per_core, 1U);
+                options.threads = 0U;
+
+                LoadGen::Report report;
+                const auto driven = LoadGen::drive(options, report);
+                pin(0U, hardware);
+
+                int status;
+                ::kill(pid, SIGTERM);
+                ::waitpid(pid, &status, 0);
+                if (!driven)
+                {
+                    return 1;
+                }
+                print(name, options, report);
+            }
+        }
+
+        return writeResults(json) ? 0 : 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const std::vector<std::string> args(argv, argv + argc);
+    if (args.size() < 2U || args.at(1) == "--help")
+    {
+        usage();
+        return args.size() < 2U ? 2 : 0;
+    }
+
+    const auto &mode = args.at(1);
+    LoadGen::Options options;
+    std::string file, password = PASSWORD, json, server, directory;
+    std::vector<std::size_t> sizes = {1000U, 100000U, 1000000U};
+    std::vector<std::size_t> cores = {1U, 2U, 4U, 8U, 16U, 32U, 64U};
+    std::size_t connections_per_core = 4U;
+    options.skew = mode == "scenarios" ? 0.8 : 0.0;
+    options.replay = mode == "scenarios" ? 0.05 : 0.0;
+    options.generate = mode == "scenarios" ? 0.1 : 0.0;
+
+    for (auto i = 2U; i < args.size(); i += 2U)
+    {
+        const auto &option = args.at(i);
+        if (i + 1U >= args.size())
+        {
+            usage();
+            return 2;
+        }
+        const auto &value = args.at(i + 1U);
+        const auto number = std::strtod(value.c_str(), nullptr);
+
+        if (option == "--file")
+        {
+            file = value;
+        }
+        else if (option == "--password")
+        {
+            password = value;
+        }
+        else if (option == "--socket")
+        {
+            options.socket = value;
+        }
+        else if (option == "--connect" && parseAddress(value, options.address, options.port))
+        {
+        }
+        else if (option == "--tokens" && number >= 1.0)
+        {
+            options.tokens = static_cast<std::size_t>(number);
+        }
+        else if (option == "--connections" && number >= 1.0)
+        {
+            options.connections = static_cast<std::size_t>(number);
+        }
+        else if (option == "--threads" && number >= 1.0)
+        {
+            options.threads = static_cast<std::size_t>(number);
+        }
+        else if (option == "--pipeline" && number >= 1.0)
+        {
+            options.pipeline = static_cast<std::size_t>(number);
+        }
+        else if (option == "--qps" && number >= 0.0)
+        {
+            options.qps = number;
+        }
+        else if (option == "--duration" && number > 0.0)
+        {
+            options.durationSeconds = number;
+        }
+        else if (option == "--warmup" && number >= 0.0)
+        {
+            options.warmupSeconds = number;
+        }
+        else if (option == "--skew" && number >= 0.0)
+        {
+            options.skew = number;
+        }
+        else if (option == "--replay" && number >= 0.0 && number <= 1.0)
+        {
+            options.replay = number;
+        }
+        else if (option == "--generate" && number >= 0.0 && number <= 1.0)
+        {
+            options.generate = number;
+        }
+        else if (option == "--seed")
+        {
+            options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (option == "--json")
+        {
+            json = value;
+        }
+        else if (option == "--server")
+        {
+            server = value;
+        }
+        else if (option == "--dir")
+        {
+            directory = value;
+        }
+        else if (option == "--sizes" && parseList(value, sizes))
+        {
+        }
+        else if (option == "--cores" && parseList(value, cores))
+        {
+        }
+        else if (option == "--connections-per-core" && number >= 1.0)
+        {
+            connections_per_core = static_cast<std::size_t>(number);
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    if (mode == "vault" && !file.empty())
+    {
+        return LoadGen::createVault(file, password, options.tokens) ? 0 : 1;
+    }
+    else if (mode == "run" && (options.socket.empty() != options.address.empty()))
+    {
+        LoadGen::Report report;
+        if (!LoadGen::drive(options, report))
+        {
+            return 1;
+        }
+        print("server/run", options, report);
+        return writeResults(json) ? 0 : 1;
+    }
+    else if (mode == "scenarios" && !server.empty())
+    {
+        if (directory.empty())
+        {
+            directory = (std::filesystem::temp_directory_path() / "otpgen-loadgen").string();
+        }
+        return scenarios(server, directory, sizes, cores, connections_per_core, options, json);
+    }
+
+    usage();
+    return 2;
+}
@@ -0,0 +1,206 @@
+#ifndef IMPORTERSBENCH_HPP
+#define IMPORTERSBENCH_HPP
+
+#include "Benchmark.hpp"
+#include "tokendatabase-bench.hpp"
+
+#include <AppSupport.hpp>
+#include <otpauthURI.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+namespace Benchmark {
+
+namespace ImportersBench {
+    static const char *const PASSWORD = "otpgen-bench";
+
+    // counts the tokens without keeping them, the parsers are measured and not the vector
+    class CountingSink : public AppSupport::ImportSink
+    {
+    public:
+        void add(OTPToken &&token) override
+        {
+            doNotOptimize(token);
+            ++this->count;
+        }
+
+        std::size_t count = 0U;
+    };
+
+    inline const std::string path(const std::string &name)
+    {
+        return (std::filesystem::temp_directory_path() / ("otpgen-bench-" + name)).string();
+    }
+
+    inline bool write(const std::string &file, const std::string &contents)
+    {
+        std::ofstream stream(file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        return static_cast<bool>(stream.write(contents.data(), static_cast<std::streamsize>(contents.size())));
+    }
+
+    // the token array of an Authy export, native tokens have hex seeds instead of base-32 secrets
+    inline const std::string authyJson(std::size_t size, bool native)
+    {
+        std::string json = "[";
+        for (auto i = 0U; i < size; ++i)
+        {
+            const auto token = TokenDatabaseBench::token(i);
+            const std::string base32(token.secret().data(), token.secret().size());
+            const auto secret = native ? Codec::hexEncode(Codec::base32Decode(base32)) : base32;
+            json += std::string(i ? ", " : "") + "{\"" + (native ? "secretSeed" : "decryptedSecret") + "\": \"" + secret +
+                    "\", \"digits\": " + std::to_string(native ? 7 : 6) + ", \"name\": \"" + token.label() + "\"}";
+        }
+        return json + "]";
+    }
+
+    // shared preferences of the Authy app, the array is an escaped string
+    inline const std::string authyXml(const std::string &json, bool native)
+    {
+        std::string escaped;
+        escaped.reserve(json.size() * 2U);
+        for (auto&& c : json)
+        {
+            if (c == '"')
+            {
+                escaped += "&quot;";
+            }
+            else
+            {
+                escaped.push_back(c);
+            }
+        }
+        return std::string("<?xml version='1.0' encoding='utf-8' standalone='yes' ?>\n<map>\n") +
+               "    <boolean name=\"first_run\" value=\"false\" />\n" +
+               "    <string name=\"com.authy.storage.tokens." + (native ? "authy" : "authenticator") + ".key\">" +
+               escaped + "</string>\n</map>\n";
+    }
+
+    inline const std::string steamGuard()
+    {
+        return R"({"steamid": "76561198000000000", "shared_secret": "zvIayp3JPvtvX/QGHqsqKBk/44s=", )"
+               R"("serial_number": "1234567890", "revocation_code": "R12345", )"
+               R"("uri": "otpauth://totp/Steam:bench?secret=Z3ZCJSU5ZE7PW33P6QDB5KZKFAMT7Y4L&issuer=Steam", )"
+               R"("server_time": "1500000000", "account_name": "bench", "token_gid": "0", )"
+               R"("identity_secret": "", "secret_1": "", "status": 1, "steamguard_scheme": "2"})";
+    }
+
+    // the import of a file, once per iteration and token
+    inline void runImport(const std::string &name, std::size_t size, const std::function<bool(CountingSink&)> &import)
+    {
+        run(name, size, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                CountingSink sink;
+                if (!import(sink) || sink.count != size)
+                {
+                    std::fprintf(stderr, "%s imported %zu of %zu tokens\n", name.c_str(), sink.count, size);
+                }
+            }
+        });
+    }
+}
+
+inline void importerBenchmarks()
+{
+    using namespace ImportersBench;
+    using AppSupport::andOTP;
+    using AppSupport::Authy;
+
+    for (auto&& size : options().corpusSizes)
+    {
+        const auto suffix = "/" + std::to_string(size);
+
+        std::vector<OTPToken> tokens;
+        tokens.reserve(size);
+        for (auto i = 0U; i < size; ++i)
+        {
+            tokens.emplace_back(TokenDatabaseBench::token(i));
+        }
+
+        for (auto&& type : {andOTP::PlainText, andOTP::Encrypted})
+        {
+            const auto name = std::string("import/andotp/") + (type == andOTP::PlainText ? "plain" : "encrypted") + suffix;
+            if (!enabled(name))
+            {
+                continue;
+            }
+
+            std::vector<OTPToken*> pointers;
+            for (auto&& token : tokens)
+            {
+                pointers.emplace_back(&token);
+            }
+            const auto file = path("andotp.json");
+            if (!andOTP::exportTokens(file, pointers, type, PASSWORD))
+            {
+                std::fprintf(stderr, "Unable to write %s\n", file.c_str());
+                continue;
+            }
+            runImport(name, size, [&](CountingSink &sink) {
+                return andOTP::importTokens(file, sink, type, PASSWORD);
+            });
+            std::filesystem::remove(file);
+        }
+
+        for (auto&& native : {false, true})
+        {
+            for (auto&& format : {Authy::JSON, Authy::XML})
+            {
+                const auto name = std::string("import/authy/") + (native ? "native_" : "totp_") +
+                                  (format == Authy::JSON ? "json" : "xml") + suffix;
+                if (!enabled(name))
+                {
+                    continue;
+                }
+
+                const auto json = authyJson(size, native);
+                const auto file = path(format == Authy::JSON ? "authy.json" : "authy.xml");
+                write(file, format == Authy::JSON ? json : authyXml(json, native));
+                runImport(name, size, [&](CountingSink &sink) {
+                    return native ? Authy::importNative(file, sink, format) : Authy::importTOTP(file, sink, format);
+                });
+                std::filesystem::remove(file);
+            }
+        }
+
+        if (enabled("import/otpauth/parse" + suffix))
+        {
+            std::vector<std::string> uris;
+            uris.reserve(size);
+            for (auto&& token : tokens)
+            {
+                std::string uri;
+                otpauthURI::appendURI(token, uri);
+                uris.emplace_back(std::move(uri));
+            }
+            run("import/otpauth/parse" + suffix, size, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    for (auto&& uri : uris)
+                    {
+                        const otpauthURI parsed{std::string_view(uri)};
+                        doNotOptimize(parsed);
+                    }
+                }
+            });
+        }
+    }
+
+    // a SteamGuard file holds a single account
+    if (enabled("import/steam/guard"))
+    {
+        const auto file = path("steamguard.json");
+        write(file, steamGuard());
+        runImport("import/steam/guard", 1U, [&](CountingSink &sink) {
+            return AppSupport::Steam::importFromSteamGuard(file, sink);
+        });
+        std::filesystem::remove(file);
+    }
+}
+
+}
+
+#endif // IMPORTERSBENCH_HPP
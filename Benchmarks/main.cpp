@@ -0,0 +1,90 @@
+#include "Benchmark.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "otpgen-bench.hpp"
+#include "tokendatabase-bench.hpp"
+#include "importers-bench.hpp"
+#if !defined(OS_WINDOWS)
+#include "startup-bench.hpp"
+#endif
+#ifdef OTPGEN_WITH_QR_CODES
+#include "qrcode-bench.hpp"
+#endif
+
+static void usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [--filter <substring>] [--min-time <ms>] [--json <file>] [--db-sizes <n,n,...>]"
+              << " [--corpus-sizes <n,n,...>]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    auto &options = Benchmark::options();
+
+    for (auto i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            options.filter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+        {
+            options.minTimeMs = std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            options.jsonFile = argv[++i];
+        }
+        else if ((std::strcmp(argv[i], "--db-sizes") == 0 || std::strcmp(argv[i], "--corpus-sizes") == 0) && i + 1 < argc)
+        {
+            auto &sizes = std::strcmp(argv[i], "--db-sizes") == 0 ? options.databaseSizes : options.corpusSizes;
+            sizes.clear();
+            for (auto size = std::strtok(argv[++i], ","); size; size = std::strtok(nullptr, ","))
+            {
+                sizes.emplace_back(std::strtoul(size, nullptr, 10));
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    std::cerr << "OTPGen Benchmarks" << std::endl << std::endl;
+
+    // run all benchmark suites
+    Benchmark::otpgenBenchmarks();
+    Benchmark::tokenDatabaseBenchmarks();
+    Benchmark::importerBenchmarks();
+#if !defined(OS_WINDOWS)
+    Benchmark::startupBenchmarks();
+#endif
+#ifdef OTPGEN_WITH_QR_CODES
+    Benchmark::qrCodeBenchmarks();
+#endif
+
+    // results go to stdout unless a file was given
+    auto out = stdout;
+    if (!options.jsonFile.empty())
+    {
+        out = std::fopen(options.jsonFile.c_str(), "w");
+        if (!out)
+        {
+            std::cerr << "Unable to open " << options.jsonFile << std::endl;
+            return 1;
+        }
+    }
+
+    Benchmark::writeJson(out);
+
+    if (out != stdout)
+    {
+        std::fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,309 @@
+#ifndef OTPGENBENCH_HPP
+#define OTPGENBENCH_HPP
+
+#include "Benchmark.hpp"
+
+#include <OTPGen.hpp>
+#include <Clock.hpp>
+#include <ClockDrift.hpp>
+#include <CodeCoalescer.hpp>
+#include <Codec.hpp>
+#include <ThreadPool.hpp>
+#include <TokenCodeCache.hpp>
+#include <UsedCodeStore.hpp>
+
+#include <vector>
+
+namespace Benchmark {
+
+namespace OTPGenBench {
+    // RFC 6238 test seeds, the key size matches the digest size of the algorithm
+    inline const std::string secret(const OTPToken::ShaAlgorithm &algorithm)
+    {
+        switch (algorithm)
+        {
+            case OTPToken::SHA256: return Codec::base32Encode("12345678901234567890123456789012");
+            case OTPToken::SHA512: return Codec::base32Encode("1234567890123456789012345678901234567890123456789012345678901234");
+            default:               return Codec::base32Encode("12345678901234567890");
+        }
+    }
+
+    inline const char *algorithmName(const OTPToken::ShaAlgorithm &algorithm)
+    {
+        switch (algorithm)
+        {
+            case OTPToken::SHA256: return "sha256";
+            case OTPToken::SHA512: return "sha512";
+            default:               return "sha1";
+        }
+    }
+
+    // distinct keys so the batch benchmarks don't run on a single cached key
+    inline const std::vector<OTPKey> keys(const OTPToken::ShaAlgorithm &algorithm, std::size_t count)
+    {
+        std::vector<OTPKey> keys;
+        keys.reserve(count);
+        for (auto i = 0U; i < count; ++i)
+        {
+            auto seed = std::string(20U, '\0');
+            for (auto j = 0U; j < seed.size(); ++j)
+            {
+                seed[j] = static_cast<char>((i * 31U + j * 7U) & 0xff);
+            }
+            keys.emplace_back(OTPGen::prepareKey(Codec::base32Encode(seed), algorithm));
+        }
+        return keys;
+    }
+
+    static const constexpr std::time_t TIME = 1111111111;
+    static const constexpr std::size_t BATCH_SIZE = 4096U;
+}
+
+inline void otpgenBenchmarks()
+{
+    using namespace OTPGenBench;
+
+    ThreadPool pool;
+    context().emplace_back("threads", std::to_string(pool.concurrency()));
+    context().emplace_back("batch_size", std::to_string(BATCH_SIZE));
+
+    for (auto&& algorithm : {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512})
+    {
+        const auto name = std::string(algorithmName(algorithm));
+        const auto base32_secret = secret(algorithm);
+        const auto key = OTPGen::prepareKey(base32_secret, algorithm);
+
+        for (auto digits = OTPGen::minDigitLength(); digits <= OTPGen::maxDigitLength(); ++digits)
+        {
+            const auto suffix = name + "/" + std::to_string(digits);
+
+            run("totp/single/" + suffix, 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    doNotOptimize(OTPGen::computeTOTP(TIME + static_cast<std::time_t>(i), base32_secret, digits, 30U, algorithm));
+                }
+            });
+
+            run("totp/prepared/" + suffix, 1U, [&](std::uint64_t n) {
+                OTPGen::TokenBuffer out;
+                for (auto i = 0U; i < n; ++i)
+                {
+                    OTPGen::computeTOTPInto(out, TIME + static_cast<std::time_t>(i), key, digits, 30U);
+                    doNotOptimize(out);
+                }
+            });
+
+            run("hotp/single/" + suffix, 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    doNotOptimize(OTPGen::computeHOTP(base32_secret, i, digits, algorithm));
+                }
+            });
+
+            run("hotp/prepared/" + suffix, 1U, [&](std::uint64_t n) {
+                OTPGen::TokenBuffer out;
+                for (auto i = 0U; i < n; ++i)
+                {
+                    OTPGen::computeHOTPInto(out, key, i, digits);
+                    doNotOptimize(out);
+                }
+            });
+        }
+
+        const auto batch_keys = keys(algorithm, BATCH_SIZE);
+        std::vector<OTPToken::TokenString> out;
+
+        run("totp/batch/" + name + "/6", BATCH_SIZE, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                OTPGen::computeTOTPBatch(TIME + static_cast<std::time_t>(i) * 30, batch_keys, 6U, 30U, out);
+                doNotOptimize(out);
+            }
+        });
+
+        // 9 digits have no specialized kernel and run the generic generator
+        run("totp/batch/" + name + "/9", BATCH_SIZE, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                OTPGen::computeTOTPBatch(TIME + static_cast<std::time_t>(i) * 30, batch_keys, 9U, 30U, out);
+                doNotOptimize(out);
+            }
+        });
+
+        run("totp/threaded/" + name + "/6", BATCH_SIZE, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                OTPGen::computeTOTPBatch(TIME + static_cast<std::time_t>(i) * 30, batch_keys, 6U, 30U, out, nullptr, &pool);
+                doNotOptimize(out);
+            }
+        });
+    }
+
+    // batches mixing all algorithms, the keys of every algorithm are packed into their own lanes
+    std::vector<OTPKey> mixed_keys;
+    std::vector<OTPToken> mixed_tokens;
+    for (auto&& algorithm : {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512})
+    {
+        for (auto&& key : keys(algorithm, BATCH_SIZE / 3U))
+        {
+            OTPToken token(OTPToken::TOTP);
+            token.setSecret(Codec::base32Encode(std::string(key.key().data(), key.key().size())));
+            token.setAlgorithm(algorithm);
+            token.setDigitLength(6U);
+            token.setPeriod(30U);
+            mixed_tokens.emplace_back(std::move(token));
+            mixed_keys.emplace_back(key);
+        }
+    }
+
+    {
+        std::vector<OTPToken::TokenString> out;
+        run("totp/batch/mixed/6", mixed_keys.size(), [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                OTPGen::computeTOTPBatch(TIME + static_cast<std::time_t>(i) * 30, mixed_keys, 6U, 30U, out);
+                doNotOptimize(out);
+            }
+        });
+
+        run("totp/batch/tokens/mixed/6", mixed_tokens.size(), [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                OTPGen::computeTOTPBatch(TIME + static_cast<std::time_t>(i) * 30, mixed_tokens, out);
+                doNotOptimize(out);
+            }
+        });
+    }
+
+    // steam tokens are always SHA1 with 5 characters
+    const auto steam_secret = secret(OTPToken::SHA1);
+    const auto steam_key = OTPGen::prepareKey(steam_secret, OTPToken::SHA1);
+    const auto steam_keys = keys(OTPToken::SHA1, BATCH_SIZE);
+    std::vector<OTPToken::TokenString> out;
+
+    run("steam/single/sha1/5", 1U, [&](std::uint64_t n) {
+        for (auto i = 0U; i < n; ++i)
+        {
+            doNotOptimize(OTPGen::computeSteam(TIME + static_cast<std::time_t>(i) * 30, steam_secret));
+        }
+    });
+
+    run("steam/prepared/sha1/5", 1U, [&](std::uint64_t n) {
+        OTPGen::TokenBuffer buffer;
+        for (auto i = 0U; i < n; ++i)
+        {
+            OTPGen::computeSteamInto(buffer, TIME + static_cast<std::time_t>(i) * 30, steam_key);
+            doNotOptimize(buffer);
+        }
+    });
+
+    run("steam/batch/sha1/5", BATCH_SIZE, [&](std::uint64_t n) {
+        for (auto i = 0U; i < n; ++i)
+        {
+            OTPGen::computeSteamBatch(TIME + static_cast<std::time_t>(i) * 30, steam_keys, out);
+            doNotOptimize(out);
+        }
+    });
+
+    run("steam/threaded/sha1/5", BATCH_SIZE, [&](std::uint64_t n) {
+        for (auto i = 0U; i < n; ++i)
+        {
+            OTPGen::computeSteamBatch(TIME + static_cast<std::time_t>(i) * 30, steam_keys, out, nullptr, &pool);
+            doNotOptimize(out);
+        }
+    });
+
+    // verification of a token running one step late with a window of ±2 steps,
+    // the learned drift finds the step with the first computed code
+    {
+        const auto verify_key = OTPGen::prepareKey(secret(OTPToken::SHA1), OTPToken::SHA1);
+        const auto code = OTPGen::computeTOTP(TIME - 30, secret(OTPToken::SHA1), 6U, 30U, OTPToken::SHA1);
+
+        run("totp/verify/sha1/6/window2", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(OTPGen::verifyTOTP(verify_key, code, TIME, 2U, 6U, 30U));
+            }
+        });
+
+        run("totp/verify/drift/sha1/6/window2", 1U, [&](std::uint64_t n) {
+            ClockDrift drift;
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(OTPGen::verifyTOTP(verify_key, code, TIME, 2U, 6U, 30U, drift));
+            }
+        });
+
+        // repeated verifications of the token, as in a retry storm, take the codes from the coalescer
+        run("totp/verify/shared/sha1/6/window2", 1U, [&](std::uint64_t n) {
+            CodeCoalescer shared;
+            UsedCodeStore used;
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(OTPGen::verifyTOTP(verify_key, "000000", TIME, 2U, 6U, 30U, used, 1, nullptr, nullptr, nullptr, &shared));
+            }
+        });
+    }
+
+    // which token shows a code: the reverse index of the code cache against computing every code
+    {
+        FixedClock clock(TIME);
+        TokenCodeCache cache(mixed_tokens, &clock);
+        const auto code = OTPGen::computeTOTP(TIME, mixed_tokens.back().secret(), 6U, 30U, mixed_tokens.back().algorithm());
+
+        run("codecache/find/" + std::to_string(mixed_tokens.size()), 1U, [&](std::uint64_t n) {
+            std::vector<std::size_t> indices;
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(cache.findCode(code, TIME, indices));
+            }
+        });
+
+        run("codecache/scan/" + std::to_string(mixed_keys.size()), 1U, [&](std::uint64_t n) {
+            OTPGen::TokenBuffer buffer;
+            for (auto i = 0U; i < n; ++i)
+            {
+                std::size_t found = 0U;
+                for (auto&& key : mixed_keys)
+                {
+                    OTPGen::computeTOTPInto(buffer, TIME, key, 6U, 30U);
+                    found += code == buffer;
+                }
+                doNotOptimize(found);
+            }
+        });
+    }
+
+    // time sources, the APIs without a time read the default clock once per call
+    run("clock/time", 1U, [&](std::uint64_t n) {
+        for (auto i = 0U; i < n; ++i)
+        {
+            doNotOptimize(std::time(nullptr));
+        }
+    });
+
+    run("clock/system", 1U, [&](std::uint64_t n) {
+        const auto &clock = SystemClock::instance();
+        for (auto i = 0U; i < n; ++i)
+        {
+            doNotOptimize(clock.now());
+        }
+    });
+
+    // a fixed default clock keeps the runs deterministic
+    FixedClock fixed(TIME);
+    Clock::setDefaultClock(&fixed);
+    run("totp/default-clock/sha1/6", 1U, [&](std::uint64_t n) {
+        const auto base32_secret = secret(OTPToken::SHA1);
+        for (auto i = 0U; i < n; ++i)
+        {
+            doNotOptimize(OTPGen::computeTOTP(base32_secret, 6U, 30U, OTPToken::SHA1));
+            fixed.advance(30);
+        }
+    });
+    Clock::setDefaultClock(nullptr);
+}
+
+}
+
+#endif // OTPGENBENCH_HPP
@@ -0,0 +1,170 @@
+#ifndef QRCODEBENCH_HPP
+#define QRCODEBENCH_HPP
+
+#include "Benchmark.hpp"
+#include "tokendatabase-bench.hpp"
+
+#include <QRCode.hpp>
+#include <ThreadPool.hpp>
+#include <otpauthURI.hpp>
+#include <lodepng.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace Benchmark {
+
+namespace QRCodeBench {
+    // pixels per module, from small screenshots to photographed printouts
+    static const constexpr int SCALES[] = {2, 4, 8};
+
+    // the batch decodes whole images, larger corpora add nothing but run time
+    static const constexpr std::size_t MAX_BATCH = 1000U;
+
+    inline const char *effortName(const QRCode::Effort &effort)
+    {
+        switch (effort)
+        {
+            case QRCode::Fast:   return "fast";
+            case QRCode::Normal: return "normal";
+            default:             return "tryharder";
+        }
+    }
+
+    // otpauth URIs of the synthetic tokens, the payload of real exports
+    inline const std::string uri(std::size_t i)
+    {
+        std::string out;
+        otpauthURI::appendURI(TokenDatabaseBench::token(i), out);
+        return out;
+    }
+
+    struct Image
+    {
+        std::vector<std::uint8_t> pixels;
+        int size = 0;
+        std::vector<unsigned char> png;
+    };
+
+    inline const Image image(const std::string &text, int scale)
+    {
+        Image image;
+        QRCode::encodeRaster(text, image.pixels, image.size, scale);
+        lodepng::encode(image.png, image.pixels.data(), static_cast<unsigned>(image.size),
+                        static_cast<unsigned>(image.size), LCT_GREY, 8U);
+        return image;
+    }
+
+    // the share of the images which decoded is recorded with the result, failed
+    // decodes run through every escalation and are much slower
+    inline void decodedShare(const std::string &name, std::size_t decoded, std::size_t count)
+    {
+        if (results().empty() || results().back().name != name)
+        {
+            return;
+        }
+        if (decoded != count)
+        {
+            std::fprintf(stderr, "%s: %zu of %zu images failed to decode\n", name.c_str(), count - decoded, count);
+        }
+        results().back().counters.emplace_back("decoded", static_cast<double>(decoded) / static_cast<double>(count));
+    }
+}
+
+inline void qrCodeBenchmarks()
+{
+    using namespace QRCodeBench;
+
+    for (auto&& scale : SCALES)
+    {
+        const auto prefix = std::to_string(scale) + "x";
+        const auto generated = image(uri(0U), scale);
+        const auto resolution = static_cast<double>(generated.size);
+
+        for (auto&& effort : {QRCode::Fast, QRCode::TryHarder})
+        {
+            const auto name = "qrcode/raw/" + prefix + "/" + effortName(effort);
+            auto decoded = false;
+            run(name, 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    std::string data;
+                    decoded = QRCode::decode(generated.pixels.data(), generated.size, generated.size, generated.size,
+                                             QRCode::Gray8, data, effort);
+                }
+            });
+            decodedShare(name, decoded ? 1U : 0U, 1U);
+            if (!results().empty() && results().back().name == name)
+            {
+                results().back().counters.emplace_back("pixels", resolution * resolution);
+            }
+        }
+
+        const auto name = "qrcode/png/" + prefix;
+        auto decoded = false;
+        run(name, 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                std::string data;
+                decoded = QRCode::decode(generated.png.data(), generated.png.size(), data);
+            }
+        });
+        decodedShare(name, decoded ? 1U : 0U, 1U);
+        if (!results().empty() && results().back().name == name)
+        {
+            results().back().counters.emplace_back("png_bytes", static_cast<double>(generated.png.size()));
+        }
+    }
+
+    // photographed and scanned codes of the test suite
+#ifdef OTPGEN_BENCH_QRCODES
+    for (auto&& file : {"valid.png", "valid.jpg"})
+    {
+        const auto path = std::string(OTPGEN_BENCH_QRCODES) + "/" + file;
+        const auto name = std::string("qrcode/file/") + file;
+        auto decoded = false;
+        run(name, 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                std::string data;
+                decoded = QRCode::decode(path, data);
+            }
+        });
+        decodedShare(name, decoded ? 1U : 0U, 1U);
+    }
+#endif
+
+    // a folder of exported codes, decoded on all cores
+    ThreadPool pool;
+    for (auto&& size : options().corpusSizes)
+    {
+        const auto count = std::min(size, MAX_BATCH);
+        const auto name = "qrcode/batch/" + std::to_string(count);
+        if (!enabled(name) || (!results().empty() && results().back().name == name))
+        {
+            continue;
+        }
+
+        std::vector<Image> corpus;
+        std::vector<QRCode::ImageBuffer> images;
+        corpus.reserve(count);
+        for (auto i = 0U; i < count; ++i)
+        {
+            corpus.emplace_back(image(uri(i), SCALES[i % std::size(SCALES)]));
+            images.emplace_back(corpus.back().png.data(), corpus.back().png.size());
+        }
+
+        std::size_t decoded = 0U;
+        run(name, count, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                decoded = QRCode::decodeBatch(images, [](std::size_t, bool, const std::string &) {}, &pool);
+            }
+        });
+        decodedShare(name, decoded, count);
+    }
+}
+
+}
+
+#endif // QRCODEBENCH_HPP
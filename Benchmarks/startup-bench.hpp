@@ -0,0 +1,100 @@
+#ifndef STARTUPBENCH_HPP
+#define STARTUPBENCH_HPP
+
+#include "Benchmark.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace Benchmark {
+
+namespace StartupBench {
+    // the CLIs exit early when asked for a daemon which isn't running, before the password prompt,
+    // so a run is the process startup, the config lookup and the failed connect
+    static const char *const COMMAND = "stats";
+
+    // runs the program once, false if it can't be started
+    inline bool spawn(const std::string &program, char **environment)
+    {
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+        char *const argv[] = {const_cast<char*>(program.c_str()), const_cast<char*>(COMMAND), nullptr};
+        pid_t pid = 0;
+        const auto res = posix_spawn(&pid, program.c_str(), &actions, nullptr, argv, environment);
+        posix_spawn_file_actions_destroy(&actions);
+        if (res != 0)
+        {
+            return false;
+        }
+
+        int status = 0;
+        return ::waitpid(pid, &status, 0) == pid;
+    }
+
+    // exec to exit of the program, the config directory is an empty temporary one
+    inline void runStartup(const std::string &name, const std::string &program)
+    {
+        if (!enabled(name) || !std::filesystem::exists(program))
+        {
+            return;
+        }
+
+        const auto home = std::filesystem::temp_directory_path() / "otpgen-bench-startup";
+        std::filesystem::create_directories(home);
+        std::vector<std::string> variables = {"HOME=" + home.string(), "XDG_CONFIG_HOME=" + home.string()};
+        for (auto variable = environ; *variable; ++variable)
+        {
+            const std::string entry(*variable);
+            if (entry.rfind("HOME=", 0) != 0 && entry.rfind("XDG_CONFIG_HOME=", 0) != 0)
+            {
+                variables.emplace_back(entry);
+            }
+        }
+        std::vector<char*> environment;
+        for (auto&& variable : variables)
+        {
+            environment.emplace_back(&variable[0]);
+        }
+        environment.emplace_back(nullptr);
+
+        if (!spawn(program, environment.data()))
+        {
+            std::fprintf(stderr, "Unable to start %s\n", program.c_str());
+            return;
+        }
+        run(name, 1U, [&](std::uint64_t iterations) {
+            for (auto i = 0U; i < iterations; ++i)
+            {
+                spawn(program, environment.data());
+            }
+        });
+
+        std::error_code error;
+        std::filesystem::remove_all(home, error);
+    }
+}
+
+inline void startupBenchmarks()
+{
+#ifdef OTPGEN_BENCH_CLI
+    StartupBench::runStartup("startup/otpgen-cli", OTPGEN_BENCH_CLI);
+#endif
+#ifdef OTPGEN_BENCH_CLI_LITE
+    StartupBench::runStartup("startup/otpgen-cli-lite", OTPGEN_BENCH_CLI_LITE);
+#endif
+}
+
+}
+
+#endif // STARTUPBENCH_HPP
@@ -0,0 +1,674 @@
+#ifndef TOKENDATABASEBENCH_HPP
+#define TOKENDATABASEBENCH_HPP
+
+#include "Benchmark.hpp"
+
+#include <TokenDatabase.hpp>
+#include <TokenSetView.hpp>
+#include <Codec.hpp>
+#include <Internal/ChunkedContainer.hpp>
+
+#include <sqlite/sqlite3.h>
+
+#include <cryptopp/sha.h>
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace Benchmark {
+
+namespace TokenDatabaseBench {
+    // peak resident set size of the process in kilobytes, 0 if unknown
+    inline double peakRssKb()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+#if defined(__APPLE__)
+            return static_cast<double>(usage.ru_maxrss) / 1024.0;
+#else
+            return static_cast<double>(usage.ru_maxrss);
+#endif
+        }
+#endif
+        return 0.0;
+    }
+
+    inline const OTPToken::Label label(std::size_t i)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "token-%07zu", i);
+        return buffer;
+    }
+
+    // deterministic token with a mix of types and algorithms
+    inline const OTPToken token(std::size_t i)
+    {
+        static const OTPToken::TokenType TYPES[] = {OTPToken::TOTP, OTPToken::TOTP, OTPToken::HOTP, OTPToken::Steam};
+        static const OTPToken::ShaAlgorithm ALGORITHMS[] = {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512};
+
+        std::string seed(20U, '\0');
+        for (auto j = 0U; j < seed.size(); ++j)
+        {
+            seed[j] = static_cast<char>((i * 131U + j * 17U) & 0xff);
+        }
+
+        const auto type = TYPES[i % 4U];
+        return OTPToken(type, label(i), {}, Codec::base32Encode(seed),
+                        type == OTPToken::Steam ? 5U : 6U, 30U, static_cast<OTPToken::CounterType>(i),
+                        type == OTPToken::Steam ? OTPToken::SHA1 : ALGORITHMS[i % 3U]);
+    }
+
+    static const char *const NAMES[] = {
+        "insert", "insert_bulk", "save", "load",
+        "select_all", "select_type", "select_id", "select_label", "select_label_like", "select_page", "search",
+        "reader_select_id", "reader_threads", "vault_switch", "vault_codes",
+        "tokenset_write", "tokenset_open", "tokenset_code", "delta_write", "delta_apply",
+        "counter_increment",
+        "swap", "move", "move_below", "move_above", "apply_order", "swap_save_paged", "load_paged", "upgrade", "tuning",
+    };
+
+    // writes a database of version 0x0f000005 with the given amount of tokens, the display order
+    // is a blob in the config table, icons are stored in the tokens and digits, period and
+    // counter are vector BLOBs, every fourth token has an icon
+    inline bool writeLegacyDatabase(std::size_t size, const std::string &file, const std::string &password)
+    {
+        sqlite3 *legacy = nullptr;
+        if (sqlite3_open(":memory:", &legacy) != SQLITE_OK)
+        {
+            return false;
+        }
+
+        const auto bindVector = [](sqlite3_stmt *statement, int column, const auto &values) {
+            sqlite3_bind_blob(statement, column, values.data(), static_cast<int>(values.size() * sizeof(values[0])), SQLITE_TRANSIENT);
+        };
+
+        auto ok = sqlite3_exec(legacy,
+            "create table types (id int(1) PRIMARY KEY NOT NULL, name text UNIQUE);"
+            "create table algorithms (id int(1) PRIMARY KEY NOT NULL, name text UNIQUE);"
+            "insert into types values (1, 'TOTP'), (2, 'HOTP'), (3, 'Steam');"
+            "insert into algorithms values (1, 'SHA1'), (2, 'SHA256'), (3, 'SHA512');"
+            "create table config (id text PRIMARY KEY NOT NULL, data blob);"
+            "create table tokens (id INTEGER PRIMARY KEY NOT NULL, type int(1) NOT NULL, "
+            "label text NOT NULL UNIQUE COLLATE NOCASE, icon blob, secret text NOT NULL, "
+            "digits blob, period blob, counter blob, algorithm int(1) NOT NULL, "
+            "FOREIGN KEY(type) REFERENCES types(id), FOREIGN KEY(algorithm) REFERENCES algorithms(id));"
+            "begin;", nullptr, nullptr, nullptr) == SQLITE_OK;
+
+        sqlite3_stmt *insert = nullptr;
+        ok = ok && sqlite3_prepare_v2(legacy, "insert into tokens values (?, ?, ?, ?, ?, ?, ?, ?, ?);", -1, &insert, nullptr) == SQLITE_OK;
+        std::vector<OTPToken::sqliteSortOrder> order;
+        order.reserve(size);
+        for (auto i = 0U; ok && i < size; ++i)
+        {
+            const auto t = token(i);
+            const auto icon = i % 4U == 0U ? OTPToken::Icon(256U, static_cast<unsigned char>(i % 16U)) : OTPToken::Icon();
+            sqlite3_bind_int64(insert, 1, static_cast<sqlite3_int64>(i + 1U));
+            sqlite3_bind_int(insert, 2, t.type());
+            sqlite3_bind_text(insert, 3, t.label().c_str(), -1, SQLITE_TRANSIENT);
+            bindVector(insert, 4, icon);
+            sqlite3_bind_text(insert, 5, t.secret().c_str(), -1, SQLITE_TRANSIENT);
+            bindVector(insert, 6, std::vector<OTPToken::DigitType>{t.digitLength()});
+            bindVector(insert, 7, std::vector<OTPToken::PeriodType>{t.period()});
+            bindVector(insert, 8, std::vector<OTPToken::CounterType>{t.counter()});
+            sqlite3_bind_int(insert, 9, t.algorithm());
+            ok = sqlite3_step(insert) == SQLITE_DONE;
+            sqlite3_reset(insert);
+            order.emplace_back(static_cast<OTPToken::sqliteSortOrder>(size - i));
+        }
+        sqlite3_finalize(insert);
+
+        ok = ok && sqlite3_prepare_v2(legacy, "insert into config values (?, ?);", -1, &insert, nullptr) == SQLITE_OK;
+        if (ok)
+        {
+            sqlite3_bind_text(insert, 1, "database", -1, SQLITE_STATIC);
+            bindVector(insert, 2, std::vector<std::uint32_t>{0x0f000005});
+            ok = sqlite3_step(insert) == SQLITE_DONE;
+            sqlite3_reset(insert);
+            sqlite3_bind_text(insert, 1, "order", -1, SQLITE_STATIC);
+            bindVector(insert, 2, order);
+            ok = ok && sqlite3_step(insert) == SQLITE_DONE;
+            sqlite3_finalize(insert);
+        }
+        ok = ok && sqlite3_exec(legacy, "commit;", nullptr, nullptr, nullptr) == SQLITE_OK;
+
+        sqlite3_int64 image_size = 0;
+        auto image = ok ? sqlite3_serialize(legacy, "main", &image_size, 0) : nullptr;
+        sqlite3_close(legacy);
+        if (!image)
+        {
+            return false;
+        }
+
+        // same key as TokenDatabase::setPassword()
+        SecureString key;
+        CryptoPP::SHA256 hash;
+        CryptoPP::StringSource src(password, true,
+            new CryptoPP::HashFilter(hash,
+                new CryptoPP::Base64Encoder(
+                    new CryptoPP::StringSinkTemplate<SecureString>(key))));
+
+        std::string encrypted;
+        const auto status = Internal::encryptContainer(key, image, static_cast<std::size_t>(image_size), encrypted);
+        sqlite3_free(image);
+        if (status != Internal::ContainerStatus::Success)
+        {
+            return false;
+        }
+
+        std::ofstream stream(file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        return static_cast<bool>(stream.write(encrypted.data(), static_cast<std::streamsize>(encrypted.size())));
+    }
+
+    inline void check(const TokenDatabase::Error &status, const char *what)
+    {
+        if (status != TokenDatabase::Success)
+        {
+            std::fprintf(stderr, "%s failed: %s\n", what, TokenDatabase::getErrorMessage(status).c_str());
+        }
+    }
+}
+
+inline void tokenDatabaseBenchmarks()
+{
+    using namespace TokenDatabaseBench;
+    using clock = std::chrono::steady_clock;
+
+    const auto file = (std::filesystem::temp_directory_path() / "otpgen-bench.db").string();
+    TokenDatabase::setPassword("otpgen-bench");
+    TokenDatabase::setTokenDatabase(file);
+
+    for (auto&& size : options().databaseSizes)
+    {
+        const auto prefix = "db/" + std::to_string(size) + "/";
+
+        // building large databases is expensive, skip sizes without any enabled benchmark
+        if (std::none_of(std::begin(NAMES), std::end(NAMES), [&](const char *name) {
+            return enabled(prefix + name);
+        }))
+        {
+            continue;
+        }
+
+        check(TokenDatabase::initializeTokens(), "initializeTokens");
+
+        // populate the database
+        const auto start = clock::now();
+        for (auto i = 0U; i < size; ++i)
+        {
+            check(TokenDatabase::insertToken(token(i)), "insertToken");
+        }
+        const auto elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        if (enabled(prefix + "insert"))
+        {
+            record(prefix + "insert", size, elapsed_ns / static_cast<double>(size))
+                .counters.emplace_back("peak_rss_kb", peakRssKb());
+        }
+
+        // bulk import into an empty database, leaves the same tokens behind
+        if (enabled(prefix + "insert_bulk"))
+        {
+            TokenDatabase::OTPTokenList tokens;
+            tokens.reserve(size);
+            for (auto i = 0U; i < size; ++i)
+            {
+                tokens.emplace_back(token(i));
+            }
+
+            TokenDatabase::closeDatabase();
+            check(TokenDatabase::initializeTokens(), "initializeTokens");
+
+            const auto bulk_start = clock::now();
+            check(TokenDatabase::insertTokens(tokens), "insertTokens");
+            const auto bulk_ns = std::chrono::duration<double, std::nano>(clock::now() - bulk_start).count();
+            record(prefix + "insert_bulk", size, bulk_ns / static_cast<double>(size))
+                .counters.emplace_back("peak_rss_kb", peakRssKb());
+        }
+
+        run(prefix + "save", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::saveTokens(), "saveTokens");
+            }
+        });
+
+        std::error_code ec;
+        const auto file_size = static_cast<double>(std::filesystem::file_size(file, ec));
+        if (!results().empty() && results().back().name == prefix + "save")
+        {
+            results().back().counters.emplace_back("file_size_bytes", ec ? 0.0 : file_size);
+            results().back().counters.emplace_back("peak_rss_kb", peakRssKb());
+        }
+
+        run(prefix + "load", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::loadTokens(), "loadTokens");
+            }
+        });
+        if (!results().empty() && results().back().name == prefix + "load")
+        {
+            results().back().counters.emplace_back("file_size_bytes", ec ? 0.0 : file_size);
+            results().back().counters.emplace_back("peak_rss_kb", peakRssKb());
+        }
+
+        run(prefix + "select_all", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(TokenDatabase::selectTokens());
+            }
+        });
+
+        run(prefix + "select_type", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(TokenDatabase::selectTokens(OTPToken::TOTP));
+            }
+        });
+
+        run(prefix + "select_id", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(TokenDatabase::selectToken(static_cast<OTPToken::sqliteTokenID>(i % size + 1U)));
+            }
+        });
+
+        run(prefix + "select_label", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(TokenDatabase::selectToken(label((i * 7919U) % size)));
+            }
+        });
+
+        run(prefix + "select_label_like", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                doNotOptimize(TokenDatabase::selectTokens(OTPToken::Label("token-000001%")));
+            }
+        });
+
+        // prefix of the number of one token, which matches 10 tokens, the search equivalent of select_label_like
+        run(prefix + "search", 1U, [&](std::uint64_t n) {
+            TokenDatabase::OTPTokenList tokens;
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::searchTokens(label((i * 7919U) % size).substr(6, 6), 20U, tokens), "searchTokens");
+                doNotOptimize(tokens);
+            }
+        });
+
+        // pages of 100 labels walking through the whole database, ns/op of a page at any depth
+        run(prefix + "select_page", 1U, [&](std::uint64_t n) {
+            TokenDatabase::TokenPage page;
+            for (auto i = 0U; i < n; ++i)
+            {
+                const auto after = page.last ? TokenDatabase::FirstPage : page.next;
+                check(TokenDatabase::selectTokens({}, TokenDatabase::LabelColumn, after, 100U, page), "selectTokens");
+                doNotOptimize(page.tokens);
+            }
+        });
+
+        // a reader from the pool per lookup, the database is unchanged so the image is serialized once
+        run(prefix + "reader_select_id", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                auto reader = TokenDatabase::reader();
+                doNotOptimize(reader.selectToken(static_cast<OTPToken::sqliteTokenID>(i % size + 1U)));
+            }
+        });
+
+        // lookups of concurrent threads with a reader each, ns/op of the wall time
+        if (enabled(prefix + "reader_threads"))
+        {
+            const auto threads = std::max(2U, std::min(8U, std::thread::hardware_concurrency()));
+            const auto lookups = std::max<std::size_t>(size, 20000U);
+            const auto threads_start = clock::now();
+            std::vector<std::thread> workers;
+            for (auto t = 0U; t < threads; ++t)
+            {
+                workers.emplace_back([&, t]{
+                    auto reader = TokenDatabase::reader();
+                    for (auto i = static_cast<std::size_t>(t); i < lookups; i += threads)
+                    {
+                        doNotOptimize(reader.selectToken(label((i * 7919U) % size)));
+                    }
+                });
+            }
+            for (auto&& worker : workers)
+            {
+                worker.join();
+            }
+            const auto threads_ns = std::chrono::duration<double, std::nano>(clock::now() - threads_start).count();
+            record(prefix + "reader_threads", lookups, threads_ns / static_cast<double>(lookups))
+                .counters.emplace_back("threads", static_cast<double>(threads));
+        }
+
+        // a second vault of the same size, switching keeps both open instead of loading the other file
+        if (enabled(prefix + "vault_switch") || enabled(prefix + "vault_codes"))
+        {
+            const auto vault_file = file + "-vault";
+            TokenDatabase::OTPTokenList tokens;
+            tokens.reserve(size);
+            for (auto i = 0U; i < size; ++i)
+            {
+                tokens.emplace_back(token(i));
+            }
+
+            TokenDatabase::selectVault("bench", true);
+            TokenDatabase::setPassword("otpgen-bench-vault");
+            TokenDatabase::setTokenDatabase(vault_file);
+            check(TokenDatabase::initializeTokens(), "initializeTokens");
+            check(TokenDatabase::insertTokens(tokens), "insertTokens");
+            check(TokenDatabase::saveTokens(), "saveTokens");
+            TokenDatabase::selectVault("");
+
+            // one round trip through both vaults per op
+            run(prefix + "vault_switch", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    TokenDatabase::selectVault("bench");
+                    doNotOptimize(TokenDatabase::selectToken(static_cast<OTPToken::sqliteTokenID>(i % size + 1U)));
+                    TokenDatabase::selectVault("");
+                    doNotOptimize(TokenDatabase::selectToken(static_cast<OTPToken::sqliteTokenID>(i % size + 1U)));
+                }
+            });
+
+            // codes of both vaults, ns/op per code
+            run(prefix + "vault_codes", 2U * size, [&](std::uint64_t n) {
+                std::vector<TokenDatabase::VaultCode> codes;
+                for (auto i = 0U; i < n; ++i)
+                {
+                    check(TokenDatabase::computeVaultCodes(static_cast<std::time_t>(1536000000 + i), codes), "computeVaultCodes");
+                    doNotOptimize(codes);
+                }
+            });
+
+            TokenDatabase::closeVault("bench");
+            std::filesystem::remove(vault_file, ec);
+        }
+
+        // the read-only distribution format, opened without sqlite
+        if (enabled(prefix + "tokenset_write") || enabled(prefix + "tokenset_open") || enabled(prefix + "tokenset_code"))
+        {
+            const auto exported = file + "-tokens";
+            run(prefix + "tokenset_write", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    check(TokenDatabase::writeTokenSet(exported), "writeTokenSet");
+                }
+            });
+            check(TokenDatabase::writeTokenSet(exported), "writeTokenSet");
+
+            TokenSetView view;
+            run(prefix + "tokenset_open", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    check(TokenDatabase::readTokenSet(exported, view), "readTokenSet");
+                }
+            });
+            if (!results().empty() && results().back().name == prefix + "tokenset_open")
+            {
+                results().back().counters.emplace_back("file_size_bytes",
+                    static_cast<double>(std::filesystem::file_size(exported, ec)));
+            }
+
+            // label lookup and code of a random token
+            check(TokenDatabase::readTokenSet(exported, view), "readTokenSet");
+            run(prefix + "tokenset_code", 1U, [&](std::uint64_t n) {
+                OTPGen::TokenBuffer code;
+                for (auto i = 0U; i < n; ++i)
+                {
+                    doNotOptimize(view.computeCode(view.find(label((i * 7919U) % size)), 1536000000, code));
+                }
+            });
+
+            std::filesystem::remove(exported, ec);
+        }
+
+        // delta of ten written tokens, its size doesn't depend on the size of the database
+        if (enabled(prefix + "delta_write") || enabled(prefix + "delta_apply"))
+        {
+            const auto delta = file + "-delta";
+            const auto since = TokenDatabase::changeSequence();
+            for (auto i = 0U; i < 10U && i < size; ++i)
+            {
+                const auto id = static_cast<OTPToken::sqliteTokenID>((i * 7919U) % size + 1U);
+                check(TokenDatabase::updateToken(id, TokenDatabase::selectToken(id)), "updateToken");
+            }
+
+            run(prefix + "delta_write", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    check(TokenDatabase::writeDelta(delta, since), "writeDelta");
+                }
+            });
+            if (!results().empty() && results().back().name == prefix + "delta_write")
+            {
+                results().back().counters.emplace_back("file_size_bytes",
+                    static_cast<double>(std::filesystem::file_size(delta, ec)));
+            }
+
+            // applying the delta to the database it came from writes the same state again
+            check(TokenDatabase::writeDelta(delta, since), "writeDelta");
+            run(prefix + "delta_apply", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    check(TokenDatabase::applyDelta(delta), "applyDelta");
+                }
+            });
+
+            std::filesystem::remove(delta, ec);
+        }
+
+        // a journal record per counter instead of a save of the database
+        run(prefix + "counter_increment", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::incrementCounter(static_cast<OTPToken::sqliteTokenID>(i % size + 1U)), "incrementCounter");
+            }
+        });
+        check(TokenDatabase::saveTokens(), "saveTokens");
+
+        run(prefix + "swap", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::swapTokens(label(i % size), label((i * 7919U + 1U) % size)), "swapTokens");
+            }
+        });
+
+        run(prefix + "move", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::moveToken(label(i % size), (i * 7919U) % size), "moveToken");
+            }
+        });
+
+        run(prefix + "move_below", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::moveTokenBelow(label(i % size), label((i * 7919U + 1U) % size)), "moveTokenBelow");
+            }
+        });
+
+        run(prefix + "move_above", 1U, [&](std::uint64_t n) {
+            for (auto i = 0U; i < n; ++i)
+            {
+                check(TokenDatabase::moveTokenAbove(label(i % size), label((i * 7919U + 1U) % size)), "moveTokenAbove");
+            }
+        });
+
+        // a whole new order per op, the display order rotated by one
+        if (enabled(prefix + "apply_order"))
+        {
+            auto order = TokenDatabase::displayOrder();
+            run(prefix + "apply_order", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    std::rotate(order.begin(), order.begin() + 1, order.end());
+                    check(TokenDatabase::applyOrder(order), "applyOrder");
+                }
+            });
+        }
+
+        // the same tokens page encrypted, a save after a change only writes the changed pages
+        if (enabled(prefix + "swap_save_paged") || enabled(prefix + "load_paged"))
+        {
+            TokenDatabase::OTPTokenList tokens;
+            tokens.reserve(size);
+            for (auto i = 0U; i < size; ++i)
+            {
+                tokens.emplace_back(token(i));
+            }
+
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            check(TokenDatabase::initializeTokens(), "initializeTokens");
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedImage);
+            check(TokenDatabase::insertTokens(tokens), "insertTokens");
+            check(TokenDatabase::saveTokens(), "saveTokens");
+
+            run(prefix + "swap_save_paged", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    check(TokenDatabase::swapTokens(label(i % size), label((i * 7919U + 1U) % size)), "swapTokens");
+                    check(TokenDatabase::saveTokens(), "saveTokens");
+                }
+            });
+
+            const auto paged_size = static_cast<double>(std::filesystem::file_size(file, ec));
+            if (!results().empty() && results().back().name == prefix + "swap_save_paged")
+            {
+                results().back().counters.emplace_back("file_size_bytes", ec ? 0.0 : paged_size);
+            }
+
+            // opening only reads the schema, pages are decrypted on demand
+            run(prefix + "load_paged", 1U, [&](std::uint64_t n) {
+                for (auto i = 0U; i < n; ++i)
+                {
+                    check(TokenDatabase::loadTokens(), "loadTokens");
+                }
+            });
+            if (!results().empty() && results().back().name == prefix + "load_paged")
+            {
+                results().back().counters.emplace_back("file_size_bytes", ec ? 0.0 : paged_size);
+                results().back().counters.emplace_back("peak_rss_kb", peakRssKb());
+            }
+        }
+
+        // the tuning variants the defaults were chosen from, saves after a change and
+        // listings after a load for both storage formats
+        if (enabled(prefix + "tuning"))
+        {
+            TokenDatabase::OTPTokenList tokens;
+            tokens.reserve(size);
+            for (auto i = 0U; i < size; ++i)
+            {
+                tokens.emplace_back(token(i));
+            }
+
+            struct Profile
+            {
+                const char *name;
+                TokenDatabase::StorageFormat format;
+                TokenDatabase::Tuning tuning;
+            };
+            std::vector<Profile> profiles;
+            for (auto&& format : {TokenDatabase::EncryptedImage, TokenDatabase::EncryptedPages})
+            {
+                const auto paged = format == TokenDatabase::EncryptedPages;
+                const auto defaults = TokenDatabase::defaultTuning(format);
+                profiles.push_back({"default", format, defaults});
+                auto tuning = defaults;
+                tuning.cacheSizeKb = 512U;
+                profiles.push_back({"cache_512k", format, tuning});
+                tuning.cacheSizeKb = 8192U;
+                profiles.push_back({"cache_8m", format, tuning});
+                tuning = defaults;
+                tuning.tempStoreMemory = false;
+                profiles.push_back({"temp_store_file", format, tuning});
+                if (paged)
+                {
+                    tuning = defaults;
+                    tuning.journalMode = TokenDatabase::JournalDelete;
+                    profiles.push_back({"journal_delete", format, tuning});
+                    tuning.journalMode = TokenDatabase::JournalPersist;
+                    profiles.push_back({"journal_persist", format, tuning});
+                    tuning = defaults;
+                    tuning.synchronous = TokenDatabase::SyncNormal;
+                    profiles.push_back({"sync_normal", format, tuning});
+                }
+            }
+
+            for (auto&& profile : profiles)
+            {
+                const auto name = prefix + "tuning/" +
+                    (profile.format == TokenDatabase::EncryptedPages ? "paged/" : "image/") + profile.name;
+                TokenDatabase::setTuning(profile.format, profile.tuning);
+                TokenDatabase::setStorageFormat(profile.format);
+                check(TokenDatabase::initializeTokens(), "initializeTokens");
+                TokenDatabase::setStorageFormat(TokenDatabase::EncryptedImage);
+                check(TokenDatabase::insertTokens(tokens), "insertTokens");
+                check(TokenDatabase::saveTokens(), "saveTokens");
+
+                run(name + "/swap_save", 1U, [&](std::uint64_t n) {
+                    for (auto i = 0U; i < n; ++i)
+                    {
+                        check(TokenDatabase::swapTokens(label(i % size), label((i * 7919U + 1U) % size)), "swapTokens");
+                        check(TokenDatabase::saveTokens(), "saveTokens");
+                    }
+                });
+
+                run(name + "/load_select_all", 1U, [&](std::uint64_t n) {
+                    for (auto i = 0U; i < n; ++i)
+                    {
+                        check(TokenDatabase::loadTokens(), "loadTokens");
+                        doNotOptimize(TokenDatabase::selectTokens(OTPToken::None, false));
+                    }
+                });
+
+                TokenDatabase::setTuning(profile.format, TokenDatabase::defaultTuning(profile.format));
+            }
+        }
+
+        // all schema migrations of a database of the first SQLite release on load, one-shot
+        if (enabled(prefix + "upgrade"))
+        {
+            TokenDatabase::closeDatabase();
+            if (writeLegacyDatabase(size, file, "otpgen-bench"))
+            {
+                const auto upgrade_start = clock::now();
+                check(TokenDatabase::loadTokens(), "loadTokens");
+                const auto upgrade_ns = std::chrono::duration<double, std::nano>(clock::now() - upgrade_start).count();
+                record(prefix + "upgrade", size, upgrade_ns / static_cast<double>(size))
+                    .counters.emplace_back("total_ms", upgrade_ns / 1e6);
+            }
+            else
+            {
+                std::fprintf(stderr, "unable to write the legacy database\n");
+            }
+        }
+
+        TokenDatabase::closeDatabase();
+        std::filesystem::remove(file, ec);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(file, ec);
+}
+
+}
+
+#endif // TOKENDATABASEBENCH_HPP
@@ -0,0 +1,94 @@
+#
+# Module: FootprintReport
+#
+# Description:
+# Script mode (cmake -P) report of the memory a static library needs:
+# the text, data and bss sizes of its objects, the largest stack frames
+# (from the .su files of -fstack-usage) and its undefined symbols.
+# Fails when the library depends on the heap, exceptions or RTTI.
+#
+# Variables:
+# ARCHIVE, OBJECT_DIR, SIZE_TOOL, NM_TOOL, CAPACITY, MAX_SECRET, REPORT
+#
+
+set(report "Footprint of ${ARCHIVE}\n")
+string(APPEND report "capacity: ${CAPACITY} tokens, secrets up to ${MAX_SECRET} bytes\n\n")
+
+# sections
+execute_process(COMMAND "${SIZE_TOOL}" -t "${ARCHIVE}"
+                OUTPUT_VARIABLE sizes RESULT_VARIABLE res)
+if (NOT res EQUAL 0)
+    message(FATAL_ERROR "${SIZE_TOOL} failed on ${ARCHIVE}")
+endif()
+string(APPEND report "sections:\n${sizes}\n")
+
+# stack usage, the largest frames first
+file(GLOB_RECURSE su_files "${OBJECT_DIR}/*.su")
+set(frames "")
+set(deepest 0)
+foreach(su_file ${su_files})
+    # semicolons of the template arguments would split the lines
+    file(READ "${su_file}" content)
+    string(REPLACE ";" "," content "${content}")
+    string(REPLACE "\n" ";" lines "${content}")
+    foreach(line ${lines})
+        # file:line:column:function<TAB>bytes<TAB>qualifiers, the template arguments are left out
+        string(REGEX MATCH "^[^:]*:[0-9]+:[0-9]+:([^\t]+)\t([0-9]+)\t(.*)$" match "${line}")
+        if (match)
+            set(bytes "${CMAKE_MATCH_2}")
+            set(function "${CMAKE_MATCH_1}")
+            set(qualifiers "${CMAKE_MATCH_3}")
+            string(REGEX REPLACE " \\[with [^]]*\\]" "" function "${function}")
+            string(REGEX REPLACE "[][]" "" function "${function}")
+            string(LENGTH "${bytes}" digits)
+            # zero-padded for the sort
+            math(EXPR padding "10 - ${digits}")
+            string(REPEAT "0" ${padding} zeros)
+            list(APPEND frames "${zeros}${bytes}\t${function} (${qualifiers})")
+            if (bytes GREATER deepest)
+                set(deepest ${bytes})
+            endif()
+        endif()
+    endforeach()
+endforeach()
+list(SORT frames ORDER DESCENDING)
+string(APPEND report "stack frames (bytes):\n")
+set(count 0)
+foreach(frame ${frames})
+    if (count EQUAL 15)
+        break()
+    endif()
+    string(REGEX MATCH "^0*([0-9]+)\t(.*)$" match "${frame}")
+    string(APPEND report "  ${CMAKE_MATCH_1}\t${CMAKE_MATCH_2}\n")
+    math(EXPR count "${count} + 1")
+endforeach()
+if (NOT frames)
+    string(APPEND report "  (no stack usage files, the compiler doesn't support -fstack-usage)\n")
+endif()
+string(APPEND report "largest frame: ${deepest} bytes (a call chain needs the sum of its frames)\n\n")
+
+# undefined symbols, the library may only need the memory functions of the C library
+execute_process(COMMAND "${NM_TOOL}" -u -C "${ARCHIVE}"
+                OUTPUT_VARIABLE undefined RESULT_VARIABLE res)
+if (NOT res EQUAL 0)
+    message(FATAL_ERROR "${NM_TOOL} failed on ${ARCHIVE}")
+endif()
+string(REGEX MATCHALL "U [^\n]+" symbols "${undefined}")
+list(REMOVE_DUPLICATES symbols)
+string(APPEND report "undefined symbols:\n")
+set(forbidden "")
+foreach(symbol ${symbols})
+    string(REPLACE "U " "" symbol "${symbol}")
+    string(APPEND report "  ${symbol}\n")
+    if (symbol MATCHES "^(operator new|operator delete|malloc|calloc|realloc|free|__cxa_|_Unwind_|__gxx_personality|typeinfo|vtable for __cxxabiv1)")
+        list(APPEND forbidden "${symbol}")
+    endif()
+endforeach()
+
+file(WRITE "${REPORT}" "${report}")
+message(STATUS "Footprint report written to ${REPORT}")
+message("${report}")
+
+if (forbidden)
+    message(FATAL_ERROR "The freestanding profile references the C++ runtime or the heap: ${forbidden}")
+endif()
@@ -1,6 +1,12 @@
 // enable serialization and deserialization of databases
 #define SQLITE_ENABLE_DESERIALIZE
 
+// full text search of the token labels
+#define SQLITE_ENABLE_FTS5 1
+
+// page statistics of TokenDatabase::inspect()
+#define SQLITE_ENABLE_DBSTAT_VTAB 1
+
 // case sensitive matching
 // disabled by default, just for testing
 // #define SQLITE_CASE_SENSITIVE_LIKE
@@ -10,3 +16,17 @@
 //       no Unicode specific SQL operations are done
 // #define SQLITE_ENABLE_ICU
 // #define SQLITE_ENABLE_ICU_COLLATIONS
+
+// features libotpgen doesn't use are compiled out
+// connections are never shared between threads without TokenDatabase serializing them
+#define SQLITE_THREADSAFE 2
+#define SQLITE_DEFAULT_MEMSTATUS 0
+#define SQLITE_LIKE_DOESNT_MATCH_BLOBS 1
+#define SQLITE_MAX_EXPR_DEPTH 0
+#define SQLITE_OMIT_DECLTYPE 1
+#define SQLITE_OMIT_DEPRECATED 1
+#define SQLITE_OMIT_LOAD_EXTENSION 1
+#define SQLITE_OMIT_PROGRESS_CALLBACK 1
+#define SQLITE_OMIT_SHARED_CACHE 1
+#define SQLITE_OMIT_TCL_VARIABLE 1
+#define SQLITE_USE_ALLOCA 1
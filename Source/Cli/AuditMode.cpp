@@ -0,0 +1,116 @@
+#include "AuditMode.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <limits>
+
+#include <AuditLog.hpp>
+
+#include <StdinEchoMode.hpp>
+
+namespace {
+    static void print_usage()
+    {
+        std::cerr << "Usage: --audit <file>... [--token <id>] [--from <unix time>] [--to <unix time>]" << std::endl;
+    }
+
+    static bool parse_integer(const std::string &str, std::int64_t &value)
+    {
+        try {
+            std::size_t end = 0U;
+            value = std::stoll(str, &end);
+            return end == str.size();
+        } catch (...) {
+            return false;
+        }
+    }
+
+    static void print_record(const AuditLog::Record &record)
+    {
+        const auto seconds = static_cast<std::time_t>(record.time / 1000);
+        std::tm utc = {};
+#if defined(_WIN32)
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+        char time[32];
+        std::strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &utc);
+        std::printf("%s.%03dZ\t%lld\t%s\n", time, static_cast<int>(record.time % 1000),
+                    static_cast<long long>(record.token), AuditLog::actionName(record.action));
+    }
+}
+
+int run_audit_query(const std::vector<std::string> &args)
+{
+    std::vector<std::string> files;
+    std::int64_t token = 0;
+    std::int64_t from = std::numeric_limits<std::int64_t>::min();
+    std::int64_t to = std::numeric_limits<std::int64_t>::max();
+    for (auto i = 0U; i < args.size(); ++i)
+    {
+        const auto &arg = args.at(i);
+        if (arg == "--token" || arg == "--from" || arg == "--to")
+        {
+            std::int64_t value = 0;
+            if (i + 1U >= args.size() || !parse_integer(args.at(i + 1U), value))
+            {
+                print_usage();
+                return 2;
+            }
+            ++i;
+            if (arg == "--token")
+            {
+                token = value;
+            }
+            else
+            {
+                // seconds of the command line, milliseconds of the log
+                (arg == "--from" ? from : to) = value * 1000;
+            }
+        }
+        else
+        {
+            files.emplace_back(arg);
+        }
+    }
+    if (files.empty())
+    {
+        print_usage();
+        return 2;
+    }
+
+    std::cerr << "Enter your token database password: " << std::flush;
+    SetStdinEcho(false);
+    std::string input;
+    std::getline(std::cin, input);
+    SetStdinEcho(true);
+    std::cerr << std::endl;
+    const SecureString password(input.begin(), input.end());
+    std::fill(input.begin(), input.end(), '\0');
+
+    std::vector<AuditLog::Record> records;
+    for (auto&& file : files)
+    {
+        const auto status = AuditLog::scan(file, password, static_cast<OTPToken::sqliteTokenID>(token), from, to, records);
+        if (status != AuditLog::Success)
+        {
+            std::cerr << file << ": " << (status == AuditLog::AuthenticationFailed ? "wrong password or modified log" :
+                                          status == AuditLog::FileReadFailure ? "unable to read the file" :
+                                                                                "not an audit log") << std::endl;
+            return 3;
+        }
+    }
+
+    // the blocks of one log are in time order, the logs of the workers are interleaved
+    std::stable_sort(records.begin(), records.end(), [](const AuditLog::Record &lhs, const AuditLog::Record &rhs) {
+        return lhs.time < rhs.time;
+    });
+    for (auto&& record : records)
+    {
+        print_record(record);
+    }
+    return 0;
+}
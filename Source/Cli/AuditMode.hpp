@@ -0,0 +1,23 @@
+#ifndef AUDITMODE_HPP
+#define AUDITMODE_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * Query of the audit logs written by the verification server
+ *
+ * Reads the records of one or more logs (a server with worker processes
+ * writes one per worker) with the database password, filtered by token
+ * and time range, and writes them merged in time order to stdout, one
+ * record per line: time (UTC, milliseconds)<TAB>token id<TAB>action.
+ *
+ * Only the blocks of the logs which overlap the time range are decrypted.
+ *
+ */
+
+// arguments after --audit: <file>... [--token <id>] [--from <unix time>] [--to <unix time>],
+// returns the exit code
+int run_audit_query(const std::vector<std::string> &args);
+
+#endif // AUDITMODE_HPP
@@ -0,0 +1,826 @@
+#include "Daemon.hpp"
+#include "SessionKey.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <AutoTuner.hpp>
+#include <Clock.hpp>
+#include <CodeFeed.hpp>
+#include <MetricsEndpoint.hpp>
+#include <OTPGen.hpp>
+#include <PreparedKeyCache.hpp>
+#include <RotationScheduler.hpp>
+#include <TokenDatabase.hpp>
+
+#if !defined(OS_WINDOWS)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if !defined(OS_WINDOWS)
+namespace {
+    // longest request line
+    static const constexpr std::size_t MAX_REQUEST = 4096U;
+
+    // connections kept open for subscriptions, each one is a file descriptor
+    static const constexpr std::size_t MAX_SUBSCRIBERS = 512U;
+
+    // path of the socket to remove on termination, fixed size for the signal handler
+    static char active_socket[sizeof(sockaddr_un::sun_path)] = {};
+    static char active_feed[sizeof(sockaddr_un::sun_path) + 8U] = {};
+
+    static const std::vector<std::string> split(const std::string &line)
+    {
+        std::vector<std::string> words;
+        std::size_t begin = 0U;
+        while (begin <= line.size())
+        {
+            auto end = line.find('\t', begin);
+            if (end == std::string::npos)
+            {
+                end = line.size();
+            }
+            words.emplace_back(line.substr(begin, end - begin));
+            begin = end + 1U;
+        }
+        return words;
+    }
+
+    static const std::string format_ms(const std::uint64_t &ns)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(ns) / 1e6);
+        return buffer;
+    }
+
+    // timers, counters, memory and the slowest statements, one tab-separated line each
+    static const std::string format_stats()
+    {
+        const auto stats = TokenDatabase::stats();
+        std::string out;
+        for (auto t = 0U; t < PerfStats::TimerCount; ++t)
+        {
+            const auto &h = stats.perf.timers[t];
+            out += std::string("timer\t") + PerfStats::timerName(static_cast<PerfStats::Timer>(t)) +
+                   "\t" + std::to_string(h.count) + "\t" + format_ms(h.totalNs) +
+                   "\t" + std::to_string(h.percentileUs(0.5)) + "\t" + std::to_string(h.percentileUs(0.99)) +
+                   "\t" + std::to_string(h.maxNs / 1000U) + "\n";
+        }
+        for (auto c = 0U; c < PerfStats::CounterCount; ++c)
+        {
+            out += std::string("counter\t") + PerfStats::counterName(static_cast<PerfStats::Counter>(c)) +
+                   "\t" + std::to_string(stats.perf.counters[c]) + "\n";
+        }
+        for (auto m = 0U; m < PerfStats::MemoryCount; ++m)
+        {
+            const auto &usage = stats.perf.memory[m];
+            out += std::string("memory\t") + PerfStats::memoryName(static_cast<PerfStats::Memory>(m)) +
+                   "\t" + std::to_string(usage.currentBytes) + "\t" + std::to_string(usage.peakBytes) + "\n";
+        }
+        for (auto&& s : stats.statements)
+        {
+            auto sql = s.sql;
+            std::replace(sql.begin(), sql.end(), '\t', ' ');
+            std::replace(sql.begin(), sql.end(), '\n', ' ');
+            out += "statement\t" + std::to_string(s.count) + "\t" + format_ms(s.totalNs) +
+                   "\t" + std::to_string(s.maxNs / 1000U) + "\t" + sql + "\n";
+        }
+        const auto tuning = AutoTuner::current();
+        if (tuning.valid())
+        {
+            out += "tuning\tbackend\t" + tuning.shaBackend + "\t" + tuning.multiBufferBackend +
+                   "\t" + std::to_string(tuning.lanes) + "\n";
+            for (auto&& choice : tuning.choices)
+            {
+                out += "tuning\t" + std::string(OTPToken::algorithmName(choice.algorithm)) + "\t" +
+                       std::to_string(choice.grain) + "\t" + std::to_string(choice.threads) + "\t" +
+                       std::to_string(static_cast<std::uint64_t>(choice.codesPerSecond)) + "\n";
+            }
+        }
+        return out;
+    }
+
+    // the current codes of the feed tokens, called at every rotation
+    static void publish_feed(CodeFeed &feed, const std::vector<OTPToken> &tokens, const std::time_t &now)
+    {
+        std::vector<CodeFeed::Code> codes;
+        codes.reserve(tokens.size());
+        for (auto&& token : tokens)
+        {
+            auto error = OTPGenErrorCode::Valid;
+            CodeFeed::Code code;
+            code.code = TokenDatabase::preparedKeys()->generateToken(token, now, &error);
+            if (code.code.empty())
+            {
+                continue;
+            }
+            code.label = CodeFeed::labelHash(token.label());
+            code.expiry = token.nextRotationTime(now);
+            codes.emplace_back(std::move(code));
+        }
+        feed.publish(codes);
+    }
+
+    // connection which receives the codes of its tokens at every rotation
+    struct Subscriber
+    {
+        int fd = -1;
+        std::vector<OTPToken::sqliteTokenID> ids;
+        // positions of the tokens in Subscriptions::tokens, ascending
+        std::vector<std::size_t> indices;
+    };
+
+    // the subscribed tokens of all connections, every token is generated once per rotation
+    // no matter how many connections subscribed it, the scheduler groups them by period
+    struct Subscriptions
+    {
+        std::vector<Subscriber> subscribers;
+        std::vector<OTPToken> tokens;
+        RotationScheduler rotations;
+        RotationScheduler::Event next;
+    };
+
+    // id<TAB>label<TAB>code<TAB>expiry, empty when no code can be generated
+    static const std::string subscription_line(const OTPToken &token, const std::time_t &now)
+    {
+        auto error = OTPGenErrorCode::Valid;
+        const auto code = TokenDatabase::preparedKeys()->generateToken(token, now, &error);
+        if (code.empty())
+        {
+            return {};
+        }
+        return std::to_string(token.id()) + "\t" + token.label() + "\t" + code +
+               "\t" + std::to_string(token.nextRotationTime(now)) + "\n";
+    }
+
+    // a subscriber which can't take the whole update right away is too slow and dropped,
+    // the daemon never waits for a single connection
+    static bool write_nonblocking(int fd, const std::string &data)
+    {
+        ssize_t res;
+        do {
+            res = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        } while (res < 0 && errno == EINTR);
+        return res == static_cast<ssize_t>(data.size());
+    }
+
+    // the union of the subscribed tokens, called whenever a subscriber comes or goes
+    static void rebuild_subscriptions(Subscriptions &subscriptions, const std::time_t &now)
+    {
+        std::vector<OTPToken> tokens;
+        for (auto&& subscriber : subscriptions.subscribers)
+        {
+            for (auto&& id : subscriber.ids)
+            {
+                const auto known = std::find_if(tokens.begin(), tokens.end(), [&](const OTPToken &token) {
+                    return token.id() == id;
+                });
+                if (known != tokens.end())
+                {
+                    continue;
+                }
+                const auto existing = std::find_if(subscriptions.tokens.begin(), subscriptions.tokens.end(), [&](const OTPToken &token) {
+                    return token.id() == id;
+                });
+                tokens.emplace_back(existing != subscriptions.tokens.end() ? *existing : TokenDatabase::selectToken(id));
+            }
+        }
+
+        for (auto&& subscriber : subscriptions.subscribers)
+        {
+            subscriber.indices.clear();
+            for (auto i = 0U; i < tokens.size(); ++i)
+            {
+                if (std::find(subscriber.ids.begin(), subscriber.ids.end(), tokens[i].id()) != subscriber.ids.end())
+                {
+                    subscriber.indices.emplace_back(i);
+                }
+            }
+        }
+
+        subscriptions.tokens = std::move(tokens);
+        subscriptions.rotations.setTokens(subscriptions.tokens);
+        subscriptions.next = subscriptions.rotations.nextRotation(now);
+    }
+
+    static void remove_subscriber(Subscriptions &subscriptions, const std::size_t &index, const std::time_t &now)
+    {
+        ::close(subscriptions.subscribers[index].fd);
+        subscriptions.subscribers.erase(subscriptions.subscribers.begin() + static_cast<std::ptrdiff_t>(index));
+        rebuild_subscriptions(subscriptions, now);
+    }
+
+    // answers the subscribe request, the connection is kept when it succeeded
+    static bool add_subscriber(Subscriptions &subscriptions, int fd, const std::vector<std::string> &request)
+    {
+        if (request.size() < 2U)
+        {
+            write_nonblocking(fd, "error\tno labels to subscribe\n");
+            return false;
+        }
+        if (subscriptions.subscribers.size() >= MAX_SUBSCRIBERS)
+        {
+            write_nonblocking(fd, "error\ttoo many subscribers\n");
+            return false;
+        }
+
+        // counter-based codes don't rotate, handing them out would advance the counter
+        Subscriber subscriber;
+        subscriber.fd = fd;
+        std::vector<OTPToken> tokens;
+        for (auto i = 1U; i < request.size(); ++i)
+        {
+            auto token = TokenDatabase::selectToken(OTPToken::Label(request[i]));
+            if (token.id() == 0 || token.rotationPeriod() == 0U)
+            {
+                write_nonblocking(fd, "error\tno time-based token with the label " + request[i] + "\n");
+                return false;
+            }
+            if (std::find(subscriber.ids.begin(), subscriber.ids.end(), token.id()) == subscriber.ids.end())
+            {
+                subscriber.ids.emplace_back(token.id());
+                tokens.emplace_back(std::move(token));
+            }
+        }
+
+        // the current codes right away, the later updates only carry the rotated ones
+        const auto now = Clock::current();
+        std::string response = "ok\n";
+        for (auto&& token : tokens)
+        {
+            response += subscription_line(token, now);
+        }
+        if (!write_nonblocking(fd, response))
+        {
+            return false;
+        }
+
+        subscriptions.subscribers.emplace_back(std::move(subscriber));
+        rebuild_subscriptions(subscriptions, now);
+        return true;
+    }
+
+    // the codes which rotated at the pending event to every subscriber of them
+    static void publish_subscriptions(Subscriptions &subscriptions, const std::time_t &now)
+    {
+        OTPGEN_PERF_SCOPE("daemon rotation", Generate);
+        std::vector<std::string> lines(subscriptions.tokens.size());
+        for (auto&& index : subscriptions.next.indices)
+        {
+            lines[index] = subscription_line(subscriptions.tokens[index], now);
+        }
+
+        auto changed = false;
+        for (auto i = subscriptions.subscribers.size(); i-- > 0U;)
+        {
+            auto &subscriber = subscriptions.subscribers[i];
+            std::string update;
+            for (auto&& index : subscriber.indices)
+            {
+                update += lines[index];
+            }
+            if (!update.empty() && !write_nonblocking(subscriber.fd, update))
+            {
+                ::close(subscriber.fd);
+                subscriptions.subscribers.erase(subscriptions.subscribers.begin() + static_cast<std::ptrdiff_t>(i));
+                changed = true;
+            }
+        }
+
+        if (changed)
+        {
+            rebuild_subscriptions(subscriptions, now);
+        }
+        else
+        {
+            subscriptions.next = subscriptions.rotations.nextRotation(now);
+        }
+    }
+
+    // response to a single request, stop is set for requests which end the daemon
+    static const std::string handle_request(const std::string &line, bool &stop)
+    {
+        const auto request = split(line);
+        const auto &command = request.at(0);
+
+        if (command == "get" && request.size() == 2U)
+        {
+            const auto token = TokenDatabase::selectToken(OTPToken::Label(request.at(1)));
+            if (token.id() == 0)
+            {
+                return "error\tno token with this label\n";
+            }
+
+            OTPGEN_PERF_SCOPE("daemon get", Generate);
+            const auto now = Clock::current();
+            auto error = OTPGenErrorCode::Valid;
+            const auto code = TokenDatabase::preparedKeys()->generateToken(token, now, &error);
+            if (code.empty())
+            {
+                return "error\tunable to generate a code for this token\n";
+            }
+            return "ok\n" + code + "\t" + std::to_string(token.secondsUntilRotation(now)) + "\n";
+        }
+        else if (command == "list" && request.size() == 1U)
+        {
+            std::string response = "ok\n";
+            TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+                response += token.label() + "\n";
+            }, false);
+            return response;
+        }
+        else if (command == "stats" && request.size() == 1U)
+        {
+            return "ok\n" + format_stats();
+        }
+        else if (command == "lock" && request.size() == 1U)
+        {
+            // locking also ends the session
+            remove_session_key(session_key_path());
+            stop = true;
+            return "ok\n";
+        }
+
+        return "error\tunknown request\n";
+    }
+
+    static bool write_all(int fd, const std::string &data)
+    {
+        std::size_t written = 0U;
+        while (written < data.size())
+        {
+            const auto res = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+            if (res < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (res <= 0)
+            {
+                return false;
+            }
+            written += static_cast<std::size_t>(res);
+        }
+        return true;
+    }
+
+    // reads until the first newline or the end of the stream
+    static bool read_line(int fd, std::string &line)
+    {
+        line.clear();
+        char buffer[512];
+        while (line.size() <= MAX_REQUEST)
+        {
+            const auto res = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (res < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (res < 0)
+            {
+                return false;
+            }
+            if (res == 0)
+            {
+                return !line.empty();
+            }
+
+            line.append(buffer, static_cast<std::size_t>(res));
+            const auto newline = line.find('\n');
+            if (newline != std::string::npos)
+            {
+                line.resize(newline);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // only the user running the daemon may talk to it
+    static bool same_user(int fd)
+    {
+#if defined(OS_LINUX)
+        struct ucred cred;
+        socklen_t size = sizeof(cred);
+        if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) != 0)
+        {
+            return false;
+        }
+        return cred.uid == ::getuid();
+#else
+        uid_t uid;
+        gid_t gid;
+        if (::getpeereid(fd, &uid, &gid) != 0)
+        {
+            return false;
+        }
+        return uid == ::getuid();
+#endif
+    }
+
+    static bool make_address(const std::string &path, sockaddr_un &address)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1U);
+        return true;
+    }
+
+    static int connect_socket(const std::string &path)
+    {
+        sockaddr_un address;
+        if (!make_address(path, address))
+        {
+            return -1;
+        }
+
+        const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+#endif
+
+const std::string daemon_socket_path(const std::string &app_cfg)
+{
+    const auto runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && runtime[0] != '\0')
+    {
+        return std::string(runtime) + "/otpgen-cli.sock";
+    }
+    return app_cfg + "/daemon.sock";
+}
+
+const std::string daemon_feed_path(const std::string &socket_path)
+{
+    const auto extension = socket_path.rfind(".sock");
+    return (extension == std::string::npos ? socket_path : socket_path.substr(0, extension)) + ".feed";
+}
+
+bool is_daemon_request(const std::string &command)
+{
+    return command == "get" || command == "list" || command == "stats" || command == "lock" || command == "subscribe";
+}
+
+#if !defined(OS_WINDOWS)
+
+int run_daemon(const std::string &socket_path, const std::chrono::seconds &idle_timeout,
+               const std::string &metrics_address, const std::uint16_t &metrics_port,
+               const std::vector<std::string> &feed_labels)
+{
+    sockaddr_un address;
+    if (!make_address(socket_path, address))
+    {
+        std::fprintf(stderr, "Socket path is too long: %s\n", socket_path.c_str());
+        return 1;
+    }
+
+    // a socket which accepts connections belongs to a running daemon, others are stale
+    const auto running = connect_socket(socket_path);
+    if (running >= 0)
+    {
+        ::close(running);
+        std::fprintf(stderr, "A daemon is already running on %s\n", socket_path.c_str());
+        return 1;
+    }
+    ::unlink(socket_path.c_str());
+
+    const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "Unable to create the socket: %s\n", std::strerror(errno));
+        return 1;
+    }
+
+    // the socket must never be accessible by other users, not even briefly
+    const auto mask = ::umask(0077);
+    const auto bound = ::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    ::umask(mask);
+    if (bound != 0 || ::listen(fd, 16) != 0)
+    {
+        std::fprintf(stderr, "Unable to listen on %s: %s\n", socket_path.c_str(), std::strerror(errno));
+        ::close(fd);
+        return 1;
+    }
+    std::memcpy(active_socket, address.sun_path, sizeof(active_socket));
+
+    MetricsEndpoint metrics([](std::vector<PerfStats::Gauge> &gauges) {
+        gauges.push_back({"tokens", "Tokens in the database", static_cast<double>(TokenDatabase::tokenCount())});
+        AutoTuner::appendGauges(AutoTuner::current(), gauges);
+    });
+    if (!metrics_address.empty() && !metrics.listen(metrics_address, metrics_port))
+    {
+        ::close(fd);
+        daemon_cleanup();
+        return 1;
+    }
+
+    // counter-based codes don't rotate, handing them out would advance the counter
+    CodeFeed feed;
+    std::vector<OTPToken> feed_tokens;
+    RotationScheduler rotations;
+    for (auto&& label : feed_labels)
+    {
+        const auto token = TokenDatabase::selectToken(OTPToken::Label(label));
+        if (token.id() == 0 || token.rotationPeriod() == 0U)
+        {
+            std::fprintf(stderr, "Not publishing %s, there is no time-based token with this label.\n", label.c_str());
+            continue;
+        }
+        feed_tokens.emplace_back(token);
+    }
+    if (!feed_tokens.empty())
+    {
+        const auto feed_path = daemon_feed_path(socket_path);
+        if (feed_path.size() >= sizeof(active_feed) || !feed.create(feed_path, feed_tokens.size()))
+        {
+            std::fprintf(stderr, "Unable to create the code feed %s\n", feed_path.c_str());
+            ::close(fd);
+            daemon_cleanup();
+            return 1;
+        }
+        std::memcpy(active_feed, feed_path.c_str(), feed_path.size() + 1U);
+        rotations.setTokens(feed_tokens);
+    }
+    std::time_t next_rotation = 0;
+    Subscriptions subscriptions;
+
+    std::fprintf(stderr, "Serving on %s, locking after %llds without requests.\n",
+                 socket_path.c_str(), static_cast<long long>(idle_timeout.count()));
+
+    auto last_request = std::chrono::steady_clock::now();
+    auto stop = false;
+    std::vector<pollfd> pfds;
+    while (!stop)
+    {
+        // open subscriptions count as requests, the daemon locks once the last one is closed
+        if (!subscriptions.subscribers.empty())
+        {
+            last_request = std::chrono::steady_clock::now();
+        }
+        const auto idle = std::chrono::steady_clock::now() - last_request;
+        if (idle >= idle_timeout)
+        {
+            break;
+        }
+
+        // the feed is published at every rotation, the poll wakes up for it
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(idle_timeout - idle);
+        if (feed.isOpen())
+        {
+            const auto now = Clock::current();
+            if (now >= next_rotation)
+            {
+                publish_feed(feed, feed_tokens, now);
+                next_rotation = rotations.nextRotation(now).time;
+            }
+            wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::seconds(std::max<std::time_t>(next_rotation - now, 0))));
+        }
+
+        // the subscribers are updated at every rotation of their tokens
+        if (!subscriptions.subscribers.empty())
+        {
+            const auto now = Clock::current();
+            if (subscriptions.next.time != 0 && now >= subscriptions.next.time)
+            {
+                publish_subscriptions(subscriptions, now);
+            }
+            if (subscriptions.next.time != 0)
+            {
+                wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::seconds(std::max<std::time_t>(subscriptions.next.time - now, 0))));
+            }
+        }
+
+        // subscribers only send when they hang up, anything else they send is dropped
+        pfds.assign(1U, pollfd{fd, POLLIN, 0});
+        for (auto&& subscriber : subscriptions.subscribers)
+        {
+            pfds.emplace_back(pollfd{subscriber.fd, POLLIN, 0});
+        }
+        const auto res = ::poll(pfds.data(), static_cast<nfds_t>(pfds.size()),
+                                static_cast<int>(std::min<std::chrono::milliseconds::rep>(wait.count() + 1, 60000)));
+        if (res < 0 && errno != EINTR)
+        {
+            break;
+        }
+        if (res <= 0)
+        {
+            continue;
+        }
+
+        for (auto i = pfds.size(); i-- > 1U;)
+        {
+            if (pfds[i].revents == 0)
+            {
+                continue;
+            }
+            char buffer[256];
+            const auto read = ::recv(pfds[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (read == 0 || (read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) ||
+                (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+            {
+                remove_subscriber(subscriptions, i - 1U, Clock::current());
+            }
+        }
+        if ((pfds[0].revents & POLLIN) == 0)
+        {
+            continue;
+        }
+
+        const auto client = ::accept(fd, nullptr, nullptr);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // a stalled client must not block the daemon
+        timeval timeout = {1, 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        std::string line;
+        if (same_user(client) && read_line(client, line))
+        {
+            last_request = std::chrono::steady_clock::now();
+            const auto request = split(line);
+            if (request.at(0) != "subscribe")
+            {
+                write_all(client, handle_request(line, stop));
+            }
+            else if (add_subscriber(subscriptions, client, request))
+            {
+                continue;
+            }
+        }
+        ::close(client);
+    }
+
+    for (auto&& subscriber : subscriptions.subscribers)
+    {
+        ::close(subscriber.fd);
+    }
+    ::close(fd);
+    feed.close();
+    daemon_cleanup();
+
+    // lock the database, the password and the decrypted pages are wiped
+    TokenDatabase::closeDatabase();
+    return 0;
+}
+
+int run_daemon_client(const std::string &socket_path, const std::vector<std::string> &request)
+{
+    const auto fd = connect_socket(socket_path);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "No daemon is running on %s, start one with --daemon.\n", socket_path.c_str());
+        return 4;
+    }
+
+    std::string line;
+    for (auto&& word : request)
+    {
+        if (word.find_first_of("\t\n") != std::string::npos)
+        {
+            std::cerr << "Arguments must not contain tabs or newlines!" << std::endl;
+            ::close(fd);
+            return 2;
+        }
+        line += (line.empty() ? "" : "\t") + word;
+    }
+    line += "\n";
+
+    // the result is printed as it arrives, subscriptions stream until the daemon stops
+    std::string response;
+    auto status_end = std::string::npos;
+    if (write_all(fd, line))
+    {
+        char buffer[4096];
+        ssize_t res;
+        while ((res = ::recv(fd, buffer, sizeof(buffer), 0)) > 0 || (res < 0 && errno == EINTR))
+        {
+            if (res <= 0)
+            {
+                continue;
+            }
+            if (status_end != std::string::npos)
+            {
+                std::fwrite(buffer, 1U, static_cast<std::size_t>(res), stdout);
+                std::fflush(stdout);
+                continue;
+            }
+
+            response.append(buffer, static_cast<std::size_t>(res));
+            status_end = response.find('\n');
+            if (status_end != std::string::npos && response.compare(0U, status_end, "ok") == 0)
+            {
+                std::fwrite(response.data() + status_end + 1U, 1U, response.size() - status_end - 1U, stdout);
+                std::fflush(stdout);
+            }
+            else if (status_end != std::string::npos)
+            {
+                break;
+            }
+        }
+    }
+    ::close(fd);
+
+    if (status_end == std::string::npos)
+    {
+        std::cerr << "The daemon did not respond." << std::endl;
+        return 3;
+    }
+
+    const auto status = response.substr(0, status_end);
+    if (status != "ok")
+    {
+        const auto message = status.find('\t');
+        std::fprintf(stderr, "Error: %s\n", message == std::string::npos ? status.c_str() : status.c_str() + message + 1U);
+        return 3;
+    }
+    return 0;
+}
+
+int run_feed_client(const std::string &feed_path, const std::string &label)
+{
+    CodeFeed feed;
+    if (!feed.open(feed_path))
+    {
+        std::fprintf(stderr, "No code feed at %s, start a daemon with --feed <label>.\n", feed_path.c_str());
+        return 4;
+    }
+
+    CodeFeed::Code code;
+    const auto now = Clock::current();
+    if (!feed.find(label, code) || code.expiry <= now)
+    {
+        std::cerr << "The feed has no current code for this label." << std::endl;
+        return 3;
+    }
+
+    std::printf("%s\t%lld\n", code.code.c_str(), static_cast<long long>(code.expiry - now));
+    return 0;
+}
+
+void daemon_cleanup()
+{
+    if (active_socket[0] != '\0')
+    {
+        ::unlink(active_socket);
+        active_socket[0] = '\0';
+    }
+    if (active_feed[0] != '\0')
+    {
+        ::unlink(active_feed);
+        active_feed[0] = '\0';
+    }
+}
+
+#else
+
+int run_daemon(const std::string &, const std::chrono::seconds &, const std::string &, const std::uint16_t &,
+               const std::vector<std::string> &)
+{
+    std::cerr << "The daemon mode requires Unix domain sockets." << std::endl;
+    return 1;
+}
+
+int run_daemon_client(const std::string &, const std::vector<std::string> &)
+{
+    std::cerr << "The daemon mode requires Unix domain sockets." << std::endl;
+    return 1;
+}
+
+int run_feed_client(const std::string &, const std::string &)
+{
+    std::cerr << "The daemon mode requires Unix domain sockets." << std::endl;
+    return 1;
+}
+
+void daemon_cleanup()
+{
+}
+
+#endif
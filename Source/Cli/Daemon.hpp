@@ -0,0 +1,70 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Long-running CLI mode which keeps the token database unlocked
+ *
+ * The daemon serves requests on a Unix domain socket which only the owner
+ * can connect to, the client sends one request per connection and prints
+ * the response. The database is closed (locked) and the daemon exits when
+ * no request arrived within the idle timeout.
+ *
+ * Requests are a single line of tab-separated words, responses start with
+ * "ok" or "error<TAB>message" followed by the result lines:
+ *
+ *  -> get<TAB>label: code<TAB>remaining seconds
+ *  -> list: one label per line
+ *  -> stats: timer<TAB>name<TAB>count<TAB>total ms<TAB>p50 us<TAB>p99 us<TAB>max us,
+ *            counter<TAB>name<TAB>value and
+ *            statement<TAB>count<TAB>total ms<TAB>max us<TAB>sql lines and, when
+ *            calibrated (see AutoTuner), tuning<TAB>backend<TAB>sha<TAB>multi-buffer<TAB>lanes
+ *            and tuning<TAB>algorithm<TAB>grain<TAB>threads<TAB>codes per second
+ *  -> lock: closes the database, removes the session key and stops the daemon
+ *  -> subscribe<TAB>label...: id<TAB>label<TAB>code<TAB>expiry of the time-based
+ *            tokens, the connection stays open and the lines of the tokens whose
+ *            codes rotated follow at every rotation, until the client hangs up
+ *
+ * Each rotated code is generated once for all subscribers (see RotationScheduler),
+ * subscribers which can't take an update right away are disconnected. The daemon
+ * doesn't lock while subscriptions are open.
+ *
+ * With a metrics address the counters are also served for Prometheus, see
+ * MetricsEndpoint.
+ *
+ * Tokens given with --feed are published to a shared code feed next to the
+ * socket at every rotation (see CodeFeed), local programs read their codes
+ * from the mapping without a request. The feed is removed when the daemon
+ * stops. "otpgen-cli feed <label>" reads it the same way.
+ *
+ */
+
+// socket in the runtime directory, in the config directory as fallback
+const std::string daemon_socket_path(const std::string &app_cfg);
+
+// code feed next to the socket
+const std::string daemon_feed_path(const std::string &socket_path);
+
+// true for the commands which are answered by a running daemon
+bool is_daemon_request(const std::string &command);
+
+// serve the open token database until idle for idle_timeout, returns the exit code
+// the time-based tokens with the feed labels are published to the code feed
+int run_daemon(const std::string &socket_path, const std::chrono::seconds &idle_timeout,
+               const std::string &metrics_address = {}, const std::uint16_t &metrics_port = 0U,
+               const std::vector<std::string> &feed_labels = {});
+
+// send the request to a running daemon and print the result, returns the exit code
+int run_daemon_client(const std::string &socket_path, const std::vector<std::string> &request);
+
+// print the code of the label from the feed of a running daemon, returns the exit code
+int run_feed_client(const std::string &feed_path, const std::string &label);
+
+// removes the socket and the feed of a running daemon, safe to call from a signal handler
+void daemon_cleanup();
+
+#endif // DAEMON_HPP
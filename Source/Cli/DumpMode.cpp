@@ -0,0 +1,283 @@
+#include "DumpMode.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+#include <Clock.hpp>
+#include <CodeTable.hpp>
+#include <StartupProfile.hpp>
+#include <OTPGen.hpp>
+#include <ThreadPool.hpp>
+#include <TokenDatabase.hpp>
+
+#include <StdinEchoMode.hpp>
+
+namespace {
+    // output is written in blocks of this size
+    static const constexpr std::size_t BUFFER_SIZE = 64U * 1024U;
+
+    static void json_string(std::string &out, const std::string &str)
+    {
+        static const constexpr char HEX[] = "0123456789abcdef";
+
+        out += '"';
+        for (auto&& c : str)
+        {
+            const auto u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (u < 0x20U)
+            {
+                out += "\\u00";
+                out += HEX[u >> 4];
+                out += HEX[u & 0x0fU];
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+
+    template<typename T>
+    static void put(std::string &out, T value)
+    {
+        for (auto i = 0U; i < sizeof(T); ++i)
+        {
+            out += static_cast<char>(static_cast<std::uint64_t>(value) >> (i * 8U) & 0xffU);
+        }
+    }
+
+    // the password of a code table, independent of the database password
+    static SecureString table_password(const char *prompt)
+    {
+        std::cerr << prompt << std::flush;
+        SetStdinEcho(false);
+        std::string input;
+        std::cin >> input;
+        SetStdinEcho(true);
+        std::cerr << std::endl;
+
+        SecureString password(input.begin(), input.end());
+        std::fill(input.begin(), input.end(), '\0');
+        return password;
+    }
+
+    static void ndjson_record(std::string &out, const DumpKind &kind, const OTPToken &token,
+                              const std::time_t &now)
+    {
+        out += "{\"id\":" + std::to_string(token.id()) + ",\"label\":";
+        json_string(out, token.label());
+        out += ",\"type\":";
+        json_string(out, token.typeName());
+
+        if (kind == DumpKind::Codes)
+        {
+            out += ",\"code\":";
+            json_string(out, token.generateToken(now));
+            out += ",\"remaining\":" + std::to_string(token.secondsUntilRotation(now));
+        }
+        else
+        {
+            out += ",\"digits\":" + std::to_string(token.digitLength());
+            out += ",\"period\":" + std::to_string(token.period());
+            out += ",\"counter\":" + std::to_string(token.counter());
+            out += ",\"algorithm\":";
+            json_string(out, token.algorithmName());
+        }
+        out += "}\n";
+    }
+
+    static void binary_record(std::string &out, const DumpKind &kind, const OTPToken &token,
+                              const std::time_t &now)
+    {
+        // the payload length is filled in once the record is complete
+        const auto start = out.size();
+        put<std::uint32_t>(out, 0U);
+
+        const auto label_size = std::min<std::size_t>(token.label().size(), UINT16_MAX);
+        put<std::int64_t>(out, token.id());
+        put<std::uint8_t>(out, token.type());
+        put<std::uint16_t>(out, static_cast<std::uint16_t>(label_size));
+        out.append(token.label(), 0U, label_size);
+
+        if (kind == DumpKind::Codes)
+        {
+            const auto code = token.generateToken(now);
+            put<std::uint8_t>(out, static_cast<std::uint8_t>(code.size()));
+            out += code;
+            put<std::uint32_t>(out, static_cast<std::uint32_t>(token.secondsUntilRotation(now)));
+        }
+        else
+        {
+            put<std::uint8_t>(out, token.digitLength());
+            put<std::uint32_t>(out, token.period());
+            put<std::uint32_t>(out, token.counter());
+            put<std::uint8_t>(out, token.algorithm());
+        }
+
+        const auto size = static_cast<std::uint32_t>(out.size() - start - sizeof(std::uint32_t));
+        for (auto i = 0U; i < sizeof(size); ++i)
+        {
+            out[start + i] = static_cast<char>(size >> (i * 8U) & 0xffU);
+        }
+    }
+}
+
+bool parse_dump_format(const std::string &name, DumpFormat &format)
+{
+    if (name == "ndjson")
+    {
+        format = DumpFormat::NDJSON;
+        return true;
+    }
+    else if (name == "binary")
+    {
+        format = DumpFormat::Binary;
+        return true;
+    }
+    return false;
+}
+
+int run_dump(const DumpKind &kind, const DumpFormat &format)
+{
+    std::string output;
+    output.reserve(BUFFER_SIZE + 1024U);
+    const auto flush = [&]{
+        std::fwrite(output.data(), 1U, output.size(), stdout);
+        output.clear();
+        if (kind == DumpKind::Codes)
+        {
+            std::fflush(stdout);
+            StartupProfile::firstCode();
+        }
+    };
+
+    if (format == DumpFormat::Binary)
+    {
+        output += "OTPD";
+        put<std::uint8_t>(output, 1U);
+        put<std::uint8_t>(output, static_cast<std::uint8_t>(kind));
+    }
+
+    // all codes of a snapshot are generated for the same second
+    const auto now = Clock::current();
+    const auto status = TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+        if (format == DumpFormat::NDJSON)
+        {
+            ndjson_record(output, kind, token, now);
+        }
+        else
+        {
+            binary_record(output, kind, token, now);
+        }
+        if (output.size() >= BUFFER_SIZE)
+        {
+            flush();
+        }
+    }, false);
+    flush();
+    std::fflush(stdout);
+
+    if (status != TokenDatabase::Success)
+    {
+        std::fprintf(stderr, "Unable to list the tokens: %s\n", TokenDatabase::getErrorMessage(status).c_str());
+        return 3;
+    }
+    return 0;
+}
+
+int run_code_table_export(const std::string &file, const std::string &hours, const std::vector<std::string> &labels)
+{
+    unsigned long count = 0U;
+    try {
+        count = std::stoul(hours);
+    } catch (...) {
+    }
+    if (count == 0U || count > 24U * 366U * 10U)
+    {
+        std::fprintf(stderr, "The hours must be a number between 1 and %u!\n", 24U * 366U * 10U);
+        return 2;
+    }
+
+    std::vector<OTPToken> tokens;
+    if (labels.empty())
+    {
+        for (auto&& type : {OTPToken::TOTP, OTPToken::Steam})
+        {
+            const auto status = TokenDatabase::forEachToken(type, [&](const OTPToken &token) {
+                tokens.emplace_back(token);
+            }, false);
+            if (status != TokenDatabase::Success)
+            {
+                std::fprintf(stderr, "Unable to list the tokens: %s\n", TokenDatabase::getErrorMessage(status).c_str());
+                return 3;
+            }
+        }
+    }
+    for (auto&& label : labels)
+    {
+        auto token = TokenDatabase::selectToken(label);
+        if (token.type() != OTPToken::TOTP && token.type() != OTPToken::Steam)
+        {
+            std::fprintf(stderr, "No time-based token with the label \"%s\"!\n", label.c_str());
+            return 3;
+        }
+        tokens.emplace_back(std::move(token));
+    }
+
+    const auto password = table_password("Enter a password for the code table: ");
+    if (password.empty())
+    {
+        std::fprintf(stderr, "Password may not be empty!\n");
+        return 1;
+    }
+
+    ThreadPool pool;
+    const auto now = Clock::current();
+    std::size_t written = 0U;
+    const auto status = CodeTable::write(file, tokens, now, now + static_cast<std::time_t>(count * 3600U), password, &pool, &written);
+    if (status != CodeTable::Success)
+    {
+        std::fprintf(stderr, "Unable to write the code table (error %d)\n", static_cast<int>(status));
+        return 3;
+    }
+    std::fprintf(stderr, "Wrote the codes of %zu tokens for the next %lu hours\n", written, count);
+    return 0;
+}
+
+int run_code_table_check(const std::string &file, const std::string &label, const std::string &code)
+{
+    CodeTable table;
+    const auto status = table.open(file, table_password("Enter the password of the code table: "));
+    if (status != CodeTable::Success)
+    {
+        std::fprintf(stderr, status == CodeTable::AuthenticationFailed ?
+            "Wrong password or modified code table!\n" : "Unable to read the code table!\n");
+        return 3;
+    }
+
+    switch (table.verify(label, code, Clock::current(), 1U))
+    {
+        case CodeTable::Match:
+            std::printf("valid\n");
+            return 0;
+        case CodeTable::NoMatch:
+            std::printf("invalid\n");
+            return 1;
+        case CodeTable::UnknownToken:
+            std::fprintf(stderr, "The label isn't part of the code table!\n");
+            return 3;
+        case CodeTable::OutOfRange:
+            std::fprintf(stderr, "The code table doesn't cover the current time!\n");
+            return 3;
+    }
+    return 3;
+}
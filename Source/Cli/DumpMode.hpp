@@ -0,0 +1,47 @@
+#ifndef DUMPMODE_HPP
+#define DUMPMODE_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * Bulk export of the current codes or the token metadata
+ *
+ * The tokens are streamed from the database cursor in display order and
+ * written in blocks, the token list is never held in memory. Secrets and
+ * icons are never exported.
+ *
+ * NDJSON writes one object per token:
+ *  -> codes:  {"id","label","type","code","remaining"}
+ *  -> tokens: {"id","label","type","digits","period","counter","algorithm"}
+ *
+ * The binary format starts with the magic "OTPD", a version byte (1) and
+ * the kind (1 = codes, 2 = tokens), followed by length-prefixed records.
+ * All integers are little-endian, strings are prefixed with their length:
+ *  -> record: u32 payload length, i64 id, u8 type, u16 + label
+ *  -> codes:  u8 + code, u32 remaining seconds
+ *  -> tokens: u8 digits, u32 period, u32 counter, u8 algorithm
+ *
+ * The code table export writes the codes of the next hours of the TOTP
+ * and Steam tokens into an encrypted CodeTable with its own password, the
+ * check verifies a code against such a table without the token database.
+ *
+ */
+
+enum class DumpKind { Codes = 1, Tokens = 2 };
+enum class DumpFormat { NDJSON, Binary };
+
+// parses "ndjson" or "binary", returns false for unknown formats
+bool parse_dump_format(const std::string &name, DumpFormat &format);
+
+// writes all tokens to stdout, returns the exit code
+int run_dump(const DumpKind &kind, const DumpFormat &format);
+
+// writes the codes of the next hours into the file, all time-based tokens without labels,
+// returns the exit code
+int run_code_table_export(const std::string &file, const std::string &hours, const std::vector<std::string> &labels);
+
+// checks the code of the label at the current time (and one period around it), returns the exit code
+int run_code_table_check(const std::string &file, const std::string &label, const std::string &code);
+
+#endif // DUMPMODE_HPP
@@ -0,0 +1,88 @@
+#include "InspectMode.hpp"
+
+#include <cstdio>
+
+#include <TokenDatabase.hpp>
+
+namespace {
+    // tables beyond these are summed up in one line
+    static const constexpr std::size_t LISTED_TABLES = 8U;
+
+    static const std::string format_bytes(const std::uint64_t &bytes)
+    {
+        static const char *const UNITS[] = {"B", "KiB", "MiB", "GiB"};
+        auto value = static_cast<double>(bytes);
+        auto unit = 0U;
+        while (value >= 1024.0 && unit + 1U < sizeof(UNITS) / sizeof(UNITS[0]))
+        {
+            value /= 1024.0;
+            ++unit;
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), unit == 0U ? "%.0f %s" : "%.1f %s", value, UNITS[unit]);
+        return buffer;
+    }
+}
+
+int run_inspect()
+{
+    TokenDatabase::Inspection inspection;
+    const auto status = TokenDatabase::inspect(inspection);
+    if (status != TokenDatabase::Success)
+    {
+        std::fprintf(stderr, "Unable to inspect the database: %s\n", TokenDatabase::getErrorMessage(status).c_str());
+        return 3;
+    }
+
+    const auto &tokens = inspection.tokens;
+    std::printf("Tokens:         %llu (TOTP %llu, HOTP %llu, Steam %llu)\n",
+                static_cast<unsigned long long>(tokens[OTPToken::TOTP] + tokens[OTPToken::HOTP] + tokens[OTPToken::Steam]),
+                static_cast<unsigned long long>(tokens[OTPToken::TOTP]), static_cast<unsigned long long>(tokens[OTPToken::HOTP]),
+                static_cast<unsigned long long>(tokens[OTPToken::Steam]));
+    std::printf("File:           %s on disk, %s in %llu pages of %u bytes\n",
+                format_bytes(inspection.fileBytes).c_str(), format_bytes(inspection.pageCount * inspection.pageSize).c_str(),
+                static_cast<unsigned long long>(inspection.pageCount), inspection.pageSize);
+    std::printf("Free pages:     %llu (%.1f %%)\n",
+                static_cast<unsigned long long>(inspection.freePages), inspection.freePageRatio() * 100.0);
+    std::printf("Columns:        labels %s, issuers %s, secrets %s, secret hashes %s, icon references %s\n",
+                format_bytes(inspection.labelBytes).c_str(), format_bytes(inspection.issuerBytes).c_str(),
+                format_bytes(inspection.secretBytes).c_str(), format_bytes(inspection.secretHashBytes).c_str(),
+                format_bytes(inspection.iconReferenceBytes).c_str());
+    std::printf("Icons:          %llu (%s), %llu thumbnails (%s), %s not stored again for shared icons\n",
+                static_cast<unsigned long long>(inspection.icons), format_bytes(inspection.iconBytes).c_str(),
+                static_cast<unsigned long long>(inspection.thumbnails), format_bytes(inspection.thumbnailBytes).c_str(),
+                format_bytes(inspection.sharedIconBytes).c_str());
+    std::printf("Orphaned icons: %llu (%s with their thumbnails)\n",
+                static_cast<unsigned long long>(inspection.orphanedIcons), format_bytes(inspection.orphanedIconBytes).c_str());
+    std::printf("Display order:  %llu entries (%s), %llu of deleted tokens, %llu tokens without a position\n",
+                static_cast<unsigned long long>(inspection.orderEntries), format_bytes(inspection.orderBytes).c_str(),
+                static_cast<unsigned long long>(inspection.deadOrderEntries),
+                static_cast<unsigned long long>(inspection.unorderedTokens));
+    std::printf("Change log:     %llu entries\n", static_cast<unsigned long long>(inspection.changeLogEntries));
+
+    std::printf("\n%-28s %10s %12s %12s\n", "Table", "Pages", "Payload", "Unused");
+    TokenDatabase::Inspection::Table rest;
+    for (auto i = 0U; i < inspection.tables.size(); ++i)
+    {
+        const auto &table = inspection.tables[i];
+        if (i < LISTED_TABLES)
+        {
+            std::printf("%-28s %10llu %12s %12s\n", table.name.c_str(), static_cast<unsigned long long>(table.pages),
+                        format_bytes(table.payloadBytes).c_str(), format_bytes(table.unusedBytes).c_str());
+            continue;
+        }
+        rest.pages += table.pages;
+        rest.payloadBytes += table.payloadBytes;
+        rest.unusedBytes += table.unusedBytes;
+    }
+    if (inspection.tables.size() > LISTED_TABLES)
+    {
+        const auto others = std::to_string(inspection.tables.size() - LISTED_TABLES) + " others";
+        std::printf("%-28s %10llu %12s %12s\n", others.c_str(), static_cast<unsigned long long>(rest.pages),
+                    format_bytes(rest.payloadBytes).c_str(), format_bytes(rest.unusedBytes).c_str());
+    }
+
+    std::printf("\nA vacuum saves up to %s, removing the orphaned icons %s.\n",
+                format_bytes(inspection.compactionSavings()).c_str(), format_bytes(inspection.dedupSavings()).c_str());
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef INSPECTMODE_HPP
+#define INSPECTMODE_HPP
+
+/**
+ * Size breakdown of the token database
+ *
+ * Prints where the bytes of the database are (see TokenDatabase::inspect()):
+ * the tokens per type, the bytes of the token columns, the icons and their
+ * thumbnails, the display order, the change log and the largest tables,
+ * followed by what a vacuum and removing the orphaned icons would save.
+ * The database isn't changed.
+ *
+ */
+
+// prints the breakdown of the open database, returns the exit code
+int run_inspect();
+
+#endif // INSPECTMODE_HPP
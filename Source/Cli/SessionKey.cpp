@@ -0,0 +1,130 @@
+#include "SessionKey.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include <SessionKeyring.hpp>
+#include <TokenDatabase.hpp>
+
+#if !defined(OS_WINDOWS)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// name of the wrapping key in the keyring
+static const std::string wrapping_key_name = "cli-session";
+
+const std::string session_key_path()
+{
+#if !defined(OS_WINDOWS)
+    const auto runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && runtime[0] != '\0')
+    {
+        return std::string(runtime) + "/otpgen-cli.session";
+    }
+#endif
+    return {};
+}
+
+std::chrono::seconds session_key_lifetime()
+{
+    const auto lifetime = std::getenv("OTPGEN_SESSION_LIFETIME");
+    if (!lifetime || lifetime[0] == '\0')
+    {
+        return std::chrono::seconds(0);
+    }
+
+    char *end = nullptr;
+    const auto seconds = std::strtoll(lifetime, &end, 10);
+    if (*end != '\0' || seconds <= 0)
+    {
+        return std::chrono::seconds(0);
+    }
+    return std::chrono::seconds(seconds);
+}
+
+bool unlock_with_session_key(const std::string &path)
+{
+    if (path.empty())
+    {
+        return false;
+    }
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    SecureString key((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    // without the wrapping key the session key can't be opened anymore
+    SecureBuffer wrapping;
+    if (!SessionKeyring::load(wrapping_key_name, wrapping))
+    {
+        remove_session_key(path);
+        return false;
+    }
+
+    const auto status = TokenDatabase::unlockWithSessionKey(key, wrapping);
+    if (status == TokenDatabase::SessionKeyExpired || status == TokenDatabase::SessionKeyInvalid)
+    {
+        remove_session_key(path);
+    }
+    return status == TokenDatabase::Success;
+}
+
+bool store_session_key(const std::string &path, const std::chrono::seconds &lifetime)
+{
+#if !defined(OS_WINDOWS)
+    SecureString key;
+    const auto wrapping = TokenDatabase::sessionWrappingKey();
+    if (path.empty() || TokenDatabase::sessionKey(lifetime, wrapping, key) != TokenDatabase::Success)
+    {
+        return false;
+    }
+
+    // created for the owner only, an existing file and its wrapping key are replaced
+    remove_session_key(path);
+    if (!SessionKeyring::store(wrapping_key_name, wrapping, lifetime))
+    {
+        return false;
+    }
+    const auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        SessionKeyring::remove(wrapping_key_name);
+        return false;
+    }
+    std::size_t written = 0U;
+    while (written < key.size())
+    {
+        const auto n = ::write(fd, key.data() + written, key.size() - written);
+        if (n <= 0)
+        {
+            ::close(fd);
+            remove_session_key(path);
+            return false;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    ::close(fd);
+    return true;
+#else
+    (void) path;
+    (void) lifetime;
+    return false;
+#endif
+}
+
+void remove_session_key(const std::string &path)
+{
+    if (!path.empty())
+    {
+        (void) std::remove(path.c_str());
+    }
+    SessionKeyring::remove(wrapping_key_name);
+}
@@ -0,0 +1,37 @@
+#ifndef SESSIONKEY_HPP
+#define SESSIONKEY_HPP
+
+#include <chrono>
+#include <string>
+
+/**
+ * Session key of the token database in the runtime directory of the user
+ *
+ * With OTPGEN_SESSION_LIFETIME set to a number of seconds, a session key of
+ * the unlocked database is kept in $XDG_RUNTIME_DIR (readable by the owner
+ * only) after the password was entered. Further starts within the lifetime,
+ * the daemon included, unlock without the password and the key derivation.
+ * The session key is encrypted under a random wrapping key which is kept in
+ * the keyring only (see SessionKeyring.hpp), a copy of the file is of no use
+ * on its own. The runtime directory is removed on logout, without one or
+ * without a keyring no session key is kept. The lock request of the
+ * daemon removes the session key and its wrapping key.
+ *
+ */
+
+// file of the session key, empty if there is no runtime directory
+const std::string session_key_path();
+
+// lifetime from the environment, zero if session keys are disabled
+std::chrono::seconds session_key_lifetime();
+
+// replaces the password of the token database with the stored session key,
+// false if there is none, its wrapping key is gone or it was rejected
+bool unlock_with_session_key(const std::string &path);
+
+// stores a session key of the current password under a new wrapping key
+bool store_session_key(const std::string &path, const std::chrono::seconds &lifetime);
+
+void remove_session_key(const std::string &path);
+
+#endif // SESSIONKEY_HPP
@@ -0,0 +1,484 @@
+#include "ShellMode.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <replxx.hxx>
+
+#include <Clock.hpp>
+#include <TokenCodeCache.hpp>
+#include <TokenDatabase.hpp>
+#include <TokenSearchIndex.hpp>
+
+namespace {
+    static const char *const COMMANDS[] = {
+        "list", "codes", "get", "rename", "move", "delete", "save", "help", "exit",
+    };
+
+    static const char *const HELP =
+        "  list [pattern]           labels matching the regular expression\n"
+        "  codes [pattern]          label, code and remaining seconds\n"
+        "  get <label>              code and remaining seconds, increments HOTP counters\n"
+        "  rename <label> <label>   labels with spaces are quoted with \"\n"
+        "  move <label> <position>  new position in the display order, starts at 0\n"
+        "  delete <label>\n"
+        "  save                     writes the changes now, exit saves as well\n"
+        "  exit\n";
+
+    // commands whose first argument is a label
+    static bool takes_label(const std::string &command)
+    {
+        return command == "get" || command == "rename" || command == "move" || command == "delete";
+    }
+
+    // words separated by spaces, " quotes words with spaces and \ escapes the next character,
+    // open is set if the line ends in a word (which a completion would extend)
+    static std::vector<std::string> split(const std::string &line, bool *open = nullptr)
+    {
+        std::vector<std::string> words;
+        auto in_word = false, quoted = false, escaped = false;
+        for (auto&& c : line)
+        {
+            if (escaped)
+            {
+                words.back().push_back(c);
+                escaped = false;
+                continue;
+            }
+            if (!quoted && c == ' ')
+            {
+                in_word = false;
+                continue;
+            }
+            if (!in_word)
+            {
+                words.emplace_back();
+                in_word = true;
+            }
+            if (c == '\\')
+            {
+                escaped = true;
+            }
+            else if (c == '"')
+            {
+                quoted = !quoted;
+            }
+            else
+            {
+                words.back().push_back(c);
+            }
+        }
+        if (open)
+        {
+            *open = in_word;
+        }
+        return words;
+    }
+
+    static const std::string quote(const std::string &label)
+    {
+        if (!label.empty() && label.find_first_of(" \"\\") == std::string::npos)
+        {
+            return label;
+        }
+        std::string quoted = "\"";
+        for (auto&& c : label)
+        {
+            if (c == '"' || c == '\\')
+            {
+                quoted.push_back('\\');
+            }
+            quoted.push_back(c);
+        }
+        return quoted + "\"";
+    }
+
+    // regular expression which matches labels starting with the literal prefix
+    static const std::string prefix_pattern(const std::string &prefix)
+    {
+        std::string pattern = "^";
+        for (auto&& c : prefix)
+        {
+            if (std::string("\\^$.|?*+()[]{}").find(c) != std::string::npos)
+            {
+                pattern.push_back('\\');
+            }
+            pattern.push_back(c);
+        }
+        return pattern;
+    }
+
+    // the label index and the code cache follow the changes of the database
+    class Session
+    {
+    public:
+        Session()
+        {
+            this->reload();
+            this->_observer = TokenDatabase::addObserver([this](const std::string&, const TokenDatabase::ChangeEvents &events) {
+                this->changed(events);
+            });
+        }
+
+        ~Session()
+        {
+            TokenDatabase::removeObserver(this->_observer);
+        }
+
+        Session(const Session&) = delete;
+        Session &operator= (const Session&) = delete;
+
+        inline const TokenSearchIndex &labels() const
+        { return this->_labels; }
+
+        // code and remaining seconds of a time-based token, false for other tokens
+        bool code(const OTPToken::sqliteTokenID &id, const std::time_t &now, std::string &code, std::uint64_t &remaining)
+        {
+            if (!this->_cache)
+            {
+                this->build();
+            }
+
+            const auto it = this->_indices.find(id);
+            if (it == this->_indices.end())
+            {
+                return false;
+            }
+
+            OTPGen::TokenBuffer buffer;
+            if (this->_cache->code(it->second, now, buffer))
+            {
+                code = buffer;
+            }
+            else
+            {
+                // rotated before the worker got to it
+                code = TokenDatabase::selectToken(id).generateToken(now);
+            }
+            remaining = OTPToken::secondsUntilRotation(this->_periods.at(it->second), now);
+            return !code.empty();
+        }
+
+    private:
+        void reload()
+        {
+            this->_labels.clear();
+            this->_labels.setArena(TokenDatabase::labelArena());
+            TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+                this->_labels.insert(token.id(), token.label());
+            }, false);
+            this->_cache.reset();
+        }
+
+        // observers are called with the database locked, selecting the token is fine
+        void changed(const TokenDatabase::ChangeEvents &events)
+        {
+            for (auto&& event : events)
+            {
+                switch (event.kind)
+                {
+                    case TokenDatabase::ChangeEvent::Inserted:
+                    case TokenDatabase::ChangeEvent::Renamed:
+                        this->_labels.rename(event.id, TokenDatabase::selectToken(event.id).label());
+                        this->_cache.reset();
+                        break;
+                    case TokenDatabase::ChangeEvent::Updated:
+                        this->_cache.reset();
+                        break;
+                    case TokenDatabase::ChangeEvent::Deleted:
+                        this->_labels.remove(event.id);
+                        this->_cache.reset();
+                        break;
+                    case TokenDatabase::ChangeEvent::Reloaded:
+                        this->reload();
+                        break;
+                    default:
+                        // the order and the counters don't matter for labels and TOTP codes
+                        break;
+                }
+            }
+        }
+
+        // the worker of the cache computes the next codes before they rotate
+        void build()
+        {
+            std::vector<OTPToken> tokens;
+            this->_indices.clear();
+            this->_periods.clear();
+            TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+                if (token.type() == OTPToken::TOTP || token.type() == OTPToken::Steam)
+                {
+                    this->_indices.emplace(token.id(), tokens.size());
+                    this->_periods.emplace_back(token.rotationPeriod());
+                    tokens.emplace_back(token);
+                }
+            }, false);
+            this->_cache = std::make_unique<TokenCodeCache>(tokens);
+            this->_cache->start();
+        }
+
+        TokenDatabase::ObserverId _observer = 0;
+        TokenSearchIndex _labels;
+        std::unique_ptr<TokenCodeCache> _cache;
+        std::unordered_map<OTPToken::sqliteTokenID, std::size_t> _indices;
+        std::vector<OTPToken::PeriodType> _periods;
+    };
+
+    static void print_error(const std::string &message)
+    {
+        std::fflush(stdout);
+        std::fprintf(stderr, "error: %s\n", message.c_str());
+    }
+
+    static void print_status(const TokenDatabase::Error &status)
+    {
+        if (status != TokenDatabase::Success)
+        {
+            print_error(TokenDatabase::getErrorMessage(status));
+        }
+    }
+
+    // exactly the label, case insensitive
+    static OTPToken::sqliteTokenID find_label(const std::string &label)
+    {
+        const auto id = TokenDatabase::tokenId(label);
+        if (id == 0)
+        {
+            print_error("no token with the label " + quote(label));
+        }
+        return id;
+    }
+
+    static void print_tokens(Session &session, const std::string &pattern, bool codes)
+    {
+        std::vector<OTPToken::sqliteTokenID> ids;
+        if (!session.labels().search(pattern, ids))
+        {
+            print_error("invalid pattern");
+            return;
+        }
+        const std::unordered_set<OTPToken::sqliteTokenID> matches(ids.begin(), ids.end());
+
+        // in display order
+        const auto now = Clock::current();
+        TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+            if (matches.count(token.id()) == 0)
+            {
+                return;
+            }
+
+            std::string code;
+            std::uint64_t remaining = 0U;
+            if (!codes)
+            {
+                std::printf("%s\n", token.label().c_str());
+            }
+            else if (session.code(token.id(), now, code, remaining))
+            {
+                std::printf("%-32s %10s %3llus\n", token.label().c_str(), code.c_str(), static_cast<unsigned long long>(remaining));
+            }
+            else
+            {
+                std::printf("%-32s %10s\n", token.label().c_str(), token.typeName().c_str());
+            }
+        }, false);
+    }
+
+    static void get_code(Session &session, const std::string &label)
+    {
+        const auto id = find_label(label);
+        if (id == 0)
+        {
+            return;
+        }
+
+        const auto now = Clock::current();
+        std::string code;
+        std::uint64_t remaining = 0U;
+        if (session.code(id, now, code, remaining))
+        {
+            std::printf("%s %llus\n", code.c_str(), static_cast<unsigned long long>(remaining));
+            return;
+        }
+
+        // counter based tokens use up their code
+        const auto token = TokenDatabase::selectToken(id);
+        code = token.generateToken(now);
+        if (code.empty())
+        {
+            print_error("unable to generate a code for this token");
+            return;
+        }
+        std::printf("%s\n", code.c_str());
+        if (token.type() == OTPToken::HOTP)
+        {
+            print_status(TokenDatabase::incrementCounter(id));
+        }
+    }
+
+    // returns false to exit the shell
+    static bool execute(Session &session, const std::string &line)
+    {
+        const auto words = split(line);
+        if (words.empty())
+        {
+            return true;
+        }
+
+        const auto &command = words.at(0);
+        auto status = TokenDatabase::Success;
+        if (command == "exit" || command == "quit")
+        {
+            return false;
+        }
+        else if (command == "help")
+        {
+            std::printf("%s", HELP);
+        }
+        else if ((command == "list" || command == "codes") && words.size() <= 2U)
+        {
+            print_tokens(session, words.size() == 2U ? words.at(1) : std::string(), command == "codes");
+        }
+        else if (command == "get" && words.size() == 2U)
+        {
+            get_code(session, words.at(1));
+        }
+        else if (command == "rename" && words.size() == 3U)
+        {
+            const auto id = find_label(words.at(1));
+            if (id != 0)
+            {
+                status = TokenDatabase::renameToken(id, words.at(2));
+            }
+        }
+        else if (command == "move" && words.size() == 3U)
+        {
+            std::size_t position = 0U;
+            try {
+                position = std::stoul(words.at(2));
+            } catch (...) {
+                print_error("the position must be a number");
+                return true;
+            }
+            if (find_label(words.at(1)) != 0)
+            {
+                status = TokenDatabase::moveToken(words.at(1), position);
+            }
+        }
+        else if (command == "delete" && words.size() == 2U)
+        {
+            const auto id = find_label(words.at(1));
+            if (id != 0)
+            {
+                status = TokenDatabase::deleteToken(id);
+            }
+        }
+        else if (command == "save" && words.size() == 1U)
+        {
+            status = TokenDatabase::flushTokens();
+        }
+        else
+        {
+            print_error("unknown command, see help");
+        }
+
+        // with the durability of the shell this only marks the save as pending
+        const auto edit = command == "rename" || command == "move" || command == "delete";
+        if (edit && status == TokenDatabase::Success)
+        {
+            status = TokenDatabase::saveTokens();
+        }
+        print_status(status);
+        return true;
+    }
+}
+
+int run_shell()
+{
+    Session session;
+
+    // edits are collected until the shell exits or save is entered
+    TokenDatabase::setAutoSave(std::chrono::milliseconds(0));
+    TokenDatabase::setDurability(TokenDatabase::OnExit);
+
+    replxx::Replxx repl;
+    repl.set_max_history_size(1000);
+    // the whole line is completed, labels may contain spaces
+    repl.set_word_break_characters("\t");
+    repl.set_completion_callback([&](const std::string &input, int, void*) {
+        replxx::Replxx::completions_t completions;
+        auto open = false;
+        const auto words = split(input, &open);
+        const auto partial = open ? words.back() : std::string();
+        const auto complete = open ? words.size() - 1U : words.size();
+
+        if (complete == 0U)
+        {
+            for (auto&& command : COMMANDS)
+            {
+                if (std::string(command).compare(0, partial.size(), partial) == 0)
+                {
+                    completions.emplace_back(std::string(command) + " ");
+                }
+            }
+        }
+        else if (complete == 1U && takes_label(words.at(0)))
+        {
+            std::vector<OTPToken::sqliteTokenID> ids;
+            session.labels().search(prefix_pattern(TokenSearchIndex::fold(partial)), ids);
+            for (auto&& id : ids)
+            {
+                completions.emplace_back(words.at(0) + " " + quote(TokenDatabase::selectToken(id).label()) + " ");
+            }
+        }
+        return completions;
+    }, nullptr);
+    // the code of the label which was typed
+    repl.set_hint_callback([&](const std::string &input, int, replxx::Replxx::Color &color, void*) {
+        replxx::Replxx::hints_t hints;
+        auto open = false;
+        const auto words = split(input, &open);
+        if (words.size() == 2U && takes_label(words.at(0)))
+        {
+            const auto id = TokenDatabase::tokenId(words.at(1));
+            std::string code;
+            std::uint64_t remaining = 0U;
+            if (id != 0 && session.code(id, Clock::current(), code, remaining))
+            {
+                color = replxx::Replxx::Color::GRAY;
+                hints.emplace_back((open ? "  " : " ") + code + " (" + std::to_string(remaining) + "s)");
+            }
+        }
+        return hints;
+    }, nullptr);
+
+    std::printf("Type help for the commands, exit or Ctrl-D to leave the shell.\n");
+    for (;;)
+    {
+        const auto line = repl.input(TokenDatabase::hasUnsavedChanges() ? "otpgen*> " : "otpgen> ");
+        if (!line)
+        {
+            std::printf("\n");
+            break;
+        }
+
+        const std::string command(line);
+        if (command.find_first_not_of(' ') != std::string::npos)
+        {
+            repl.history_add(command);
+        }
+        if (!execute(session, command))
+        {
+            break;
+        }
+    }
+
+    // written by closeDatabase()
+    return 0;
+}
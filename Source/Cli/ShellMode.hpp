@@ -0,0 +1,30 @@
+#ifndef SHELLMODE_HPP
+#define SHELLMODE_HPP
+
+/**
+ * Interactive shell which keeps the token database unlocked
+ *
+ * The database is unlocked once and stays open until the shell exits,
+ * commands are read with replxx. Labels are completed with tab from a
+ * search index which observes the database, typing a label shows its
+ * current code as a hint. The codes of time-based tokens come from a code
+ * cache which computes the next period in the background.
+ *
+ * Edits are saved once on exit (or with save), the prompt shows a * while
+ * there are unsaved changes. The history is only kept in memory since it
+ * would reveal the labels.
+ *
+ *  -> list [pattern]:           labels matching the regular expression
+ *  -> codes [pattern]:          label, code and remaining seconds
+ *  -> get <label>:              code and remaining seconds, increments HOTP counters
+ *  -> rename <label> <label>:   labels with spaces are quoted with "
+ *  -> move <label> <position>:  new position in the display order, starts at 0
+ *  -> delete <label>
+ *  -> save, help, exit
+ *
+ */
+
+// runs the shell until exit or the end of the input, returns the exit code
+int run_shell();
+
+#endif // SHELLMODE_HPP
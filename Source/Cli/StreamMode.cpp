@@ -0,0 +1,189 @@
+#include "StreamMode.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Clock.hpp>
+#include <StartupProfile.hpp>
+#include <TokenDatabase.hpp>
+#include <TokenSet.hpp>
+
+namespace {
+    // output is written in blocks of this size
+    static const constexpr std::size_t BUFFER_SIZE = 64U * 1024U;
+
+    static inline char fold(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // SQL LIKE with '\' as escape character, ASCII case-insensitive
+    static bool like_match(const char *pattern, const char *pattern_end, const char *str, const char *str_end)
+    {
+        while (pattern != pattern_end)
+        {
+            if (*pattern == '%')
+            {
+                ++pattern;
+                for (auto s = str; ; ++s)
+                {
+                    if (like_match(pattern, pattern_end, s, str_end))
+                    {
+                        return true;
+                    }
+                    if (s == str_end)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            if (str == str_end)
+            {
+                return false;
+            }
+            if (*pattern == '_')
+            {
+                ++pattern;
+                ++str;
+                continue;
+            }
+            if (*pattern == '\\' && pattern + 1 != pattern_end)
+            {
+                ++pattern;
+            }
+            if (fold(*pattern) != fold(*str))
+            {
+                return false;
+            }
+            ++pattern;
+            ++str;
+        }
+        return str == str_end;
+    }
+
+    static bool is_id(const std::string &request)
+    {
+        return request.size() < 19U && request.find_first_not_of("0123456789") == std::string::npos;
+    }
+}
+
+int run_stdin_mode()
+{
+    TokenSet set;
+    const auto status = TokenDatabase::selectTokenSet(set);
+    if (status != TokenDatabase::Success)
+    {
+        std::fprintf(stderr, "Unable to list the tokens: %s\n", TokenDatabase::getErrorMessage(status).c_str());
+        return 3;
+    }
+
+    std::unordered_map<OTPToken::Label, std::size_t> labels;
+    std::unordered_map<OTPToken::sqliteTokenID, std::size_t> ids;
+    labels.reserve(set.size());
+    ids.reserve(set.size());
+    for (auto i = 0U; i < set.size(); ++i)
+    {
+        labels.emplace(set.label(i), i);
+        ids.emplace(set.id(i), i);
+    }
+
+    std::vector<OTPToken::TokenString> codes;
+    std::time_t computed = -1;
+    std::time_t now = 0;
+
+    std::string output;
+    output.reserve(BUFFER_SIZE + 1024U);
+    const auto flush = [&]{
+        std::fwrite(output.data(), 1U, output.size(), stdout);
+        std::fflush(stdout);
+        if (!output.empty())
+        {
+            output.clear();
+            StartupProfile::firstCode();
+        }
+    };
+    const auto write = [&](const std::size_t &index) {
+        output += set.label(index);
+        output += '\t';
+        output += codes[index];
+        output += '\t';
+        output += std::to_string(OTPToken::secondsUntilRotation(set.rotationPeriod(index), now));
+        output += '\n';
+    };
+
+    auto missing = false;
+    const auto handle = [&](std::string &request) {
+        if (!request.empty() && request.back() == '\r')
+        {
+            request.pop_back();
+        }
+        if (request.empty())
+        {
+            return;
+        }
+
+        // all codes are computed at once, again only after the time moved on
+        now = Clock::current();
+        if (now != computed)
+        {
+            set.computeCodes(now, codes);
+            computed = now;
+        }
+
+        const auto label = labels.find(request);
+        if (label != labels.end())
+        {
+            write(label->second);
+            return;
+        }
+        if (is_id(request))
+        {
+            const auto id = ids.find(std::stoll(request));
+            if (id != ids.end())
+            {
+                write(id->second);
+                return;
+            }
+        }
+
+        auto found = false;
+        if (request.find_first_of("%_") != std::string::npos)
+        {
+            const auto pattern_end = request.data() + request.size();
+            for (auto i = 0U; i < set.size(); ++i)
+            {
+                const auto &l = set.label(i);
+                if (like_match(request.data(), pattern_end, l.data(), l.data() + l.size()))
+                {
+                    write(i);
+                    found = true;
+                }
+            }
+        }
+        if (!found)
+        {
+            std::fprintf(stderr, "No token matches \"%s\".\n", request.c_str());
+            missing = true;
+        }
+    };
+
+    // output is written when the buffer is full and before waiting for more input,
+    // so interactive pipes get their answers, std::cin must not be synced with stdio
+    std::string request;
+    while (std::getline(std::cin, request))
+    {
+        handle(request);
+        if (output.size() >= BUFFER_SIZE || std::cin.rdbuf()->in_avail() <= 0)
+        {
+            flush();
+        }
+    }
+    flush();
+
+    return missing ? 3 : 0;
+}
@@ -0,0 +1,22 @@
+#ifndef STREAMMODE_HPP
+#define STREAMMODE_HPP
+
+/**
+ * Batch mode for scripts, labels in and codes out
+ *
+ * Reads one request per line from std::cin and writes one
+ * label<TAB>code<TAB>remaining seconds record per matching token to stdout.
+ * A request is an exact label, a token id or a LIKE pattern (% and _ with
+ * \ as escape character, case-insensitive for ASCII like SQLite).
+ *
+ * The token list is loaded once and the codes of all tokens are computed
+ * in one batch per second, output is flushed whenever no more input is
+ * buffered. Requests without matches are reported on stderr.
+ *
+ */
+
+// serves requests until the end of the input, returns the exit code
+// std::cin must not be synced with stdio, otherwise every record is flushed
+int run_stdin_mode();
+
+#endif // STREAMMODE_HPP
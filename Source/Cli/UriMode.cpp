@@ -0,0 +1,251 @@
+#include "UriMode.hpp"
+
+#include <cstdio>
+
+#include <AppSupport.hpp>
+#include <SecureMemory.hpp>
+#include <TokenDatabase.hpp>
+#include <otpauthURI.hpp>
+
+#ifdef OTPGEN_CLI_QR_CODES
+#include <QRCode.hpp>
+#include <QRCodeSheet.hpp>
+#include <ThreadPool.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#endif
+
+namespace {
+    // output is written in blocks of this size
+    static const constexpr std::size_t BUFFER_SIZE = 64U * 1024U;
+}
+
+int run_uri_export()
+{
+    // the URIs contain the secrets, the buffer is wiped when released
+    SecureString output;
+    output.reserve(BUFFER_SIZE + 1024U);
+    const auto flush = [&]{
+        std::fwrite(output.data(), 1U, output.size(), stdout);
+        SecureMemory::wipe(&output[0], output.size());
+        output.clear();
+    };
+
+    // streamed from a copy, a daemon or the GUI can keep editing the database meanwhile
+    auto reader = TokenDatabase::exportReader();
+    std::size_t skipped = 0U;
+    const auto status = reader.forEachToken(OTPToken::None, [&](const OTPToken &token) {
+        if (!otpauthURI::appendURI(token, output))
+        {
+            ++skipped;
+            return;
+        }
+        output.push_back('\n');
+        if (output.size() >= BUFFER_SIZE)
+        {
+            flush();
+        }
+    }, false);
+    flush();
+    std::fflush(stdout);
+
+    if (status != TokenDatabase::Success)
+    {
+        std::fprintf(stderr, "Unable to list the tokens: %s\n", TokenDatabase::getErrorMessage(status).c_str());
+        return 3;
+    }
+    if (skipped != 0U)
+    {
+        std::fprintf(stderr, "[warning] %zu tokens can't be written as otpauth URI\n", skipped);
+    }
+    return 0;
+}
+
+int run_uri_import(const std::string &file)
+{
+    AppSupport::ImportPipeline pipeline;
+    pipeline.addFile(file, AppSupport::ImportPipeline::OtpauthURIs);
+
+    std::size_t inserted = 0U;
+    if (!pipeline.run(&inserted))
+    {
+        std::fprintf(stderr, "Unable to insert the tokens into the database!\n");
+        return 3;
+    }
+
+    const auto &result = pipeline.results().at(0);
+    if (!result.success)
+    {
+        std::fprintf(stderr, "Unable to read the URIs from %s, every line must be a valid otpauth URI!\n", file.c_str());
+        return 4;
+    }
+
+    std::fprintf(stderr, "Imported %zu of %zu tokens, %zu duplicates skipped.\n",
+                 inserted, result.tokens, result.duplicates);
+    return 0;
+}
+
+#ifdef OTPGEN_CLI_QR_CODES
+int run_qr_import(const std::vector<std::string> &files)
+{
+    if (!QRCode::available())
+    {
+        std::fprintf(stderr, "Unable to load the QR code support library!\n");
+        return 4;
+    }
+
+    ThreadPool pool;
+    AppSupport::ImportPipeline pipeline(&pool);
+
+    // payloads are added as they are decoded, the pipeline parses them on the pool again,
+    // every code of an image is read so sheets of printed backup codes work too
+    const auto decoded = QRCode::decodeBatch(files, [&](std::size_t index, bool success, const std::string &data) {
+        if (!success)
+        {
+            std::fprintf(stderr, "[warning] no QR code found in %s\n", files[index].c_str());
+            return;
+        }
+        pipeline.addURIs(files[index], data);
+    }, &pool, QRCode::TryHarder, true);
+
+    if (decoded == 0U)
+    {
+        std::fprintf(stderr, "Unable to read a QR code from the images!\n");
+        return 4;
+    }
+
+    std::size_t inserted = 0U;
+    if (!pipeline.run(&inserted))
+    {
+        std::fprintf(stderr, "Unable to insert the tokens into the database!\n");
+        return 3;
+    }
+
+    std::size_t tokens = 0U;
+    std::size_t duplicates = 0U;
+    for (auto&& result : pipeline.results())
+    {
+        if (!result.success)
+        {
+            std::fprintf(stderr, "[warning] the QR code in %s is not an otpauth URI\n", result.file.c_str());
+        }
+        tokens += result.tokens;
+        duplicates += result.duplicates;
+    }
+
+    std::fprintf(stderr, "Imported %zu of %zu tokens from %zu of %zu images, %zu duplicates skipped.\n",
+                 inserted, tokens, decoded, files.size(), duplicates);
+    return 0;
+}
+
+namespace {
+    // the pages contain the secrets, only the owner may read them
+    static bool write_page(const std::filesystem::path &file, const std::vector<std::uint8_t> &png)
+    {
+        std::error_code error;
+        {
+            std::ofstream create(file, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!create)
+            {
+                return false;
+            }
+        }
+        std::filesystem::permissions(file, std::filesystem::perms::owner_read | std::filesystem::perms::owner_write,
+                                     std::filesystem::perm_options::replace, error);
+        if (error)
+        {
+            return false;
+        }
+
+        std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+        return static_cast<bool>(out);
+    }
+}
+
+int run_qr_export(const std::string &directory)
+{
+    if (!QRCode::available())
+    {
+        std::fprintf(stderr, "Unable to load the QR code support library!\n");
+        return 4;
+    }
+
+    std::error_code error;
+    if (!std::filesystem::is_directory(directory, error))
+    {
+        std::fprintf(stderr, "%s is not a directory!\n", directory.c_str());
+        return 4;
+    }
+
+    ThreadPool pool;
+    const QRCodeSheet sheet(&pool);
+
+    // one page of URIs at a time, wiped when released
+    std::vector<SecureString> uris(sheet.perPage());
+    std::vector<std::string_view> page;
+    page.reserve(sheet.perPage());
+    std::vector<std::uint8_t> png;
+
+    std::size_t pages = 0U;
+    std::size_t exported = 0U;
+    std::size_t skipped = 0U;
+    auto failed = false;
+    const auto flush = [&]{
+        if (page.empty() || failed)
+        {
+            return;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "otpgen-backup-%03zu.png", pages + 1U);
+        const auto file = std::filesystem::path(directory) / name;
+        if (!sheet.encodePage(page, png) || !write_page(file, png))
+        {
+            std::fprintf(stderr, "Unable to write %s!\n", file.string().c_str());
+            failed = true;
+        }
+        else
+        {
+            ++pages;
+            exported += page.size();
+        }
+        SecureMemory::wipe(png.data(), png.size());
+        page.clear();
+    };
+
+    auto reader = TokenDatabase::exportReader();
+    const auto status = reader.forEachToken(OTPToken::None, [&](const OTPToken &token) {
+        auto &uri = uris[page.size()];
+        uri.clear();
+        if (!otpauthURI::appendURI(token, uri))
+        {
+            ++skipped;
+            return;
+        }
+        page.emplace_back(uri);
+        if (page.size() == sheet.perPage())
+        {
+            flush();
+        }
+    }, false);
+    flush();
+
+    if (status != TokenDatabase::Success)
+    {
+        std::fprintf(stderr, "Unable to list the tokens: %s\n", TokenDatabase::getErrorMessage(status).c_str());
+        return 3;
+    }
+    if (failed)
+    {
+        return 4;
+    }
+    if (skipped != 0U)
+    {
+        std::fprintf(stderr, "[warning] %zu tokens can't be written as otpauth URI\n", skipped);
+    }
+    std::fprintf(stderr, "Exported %zu tokens on %zu pages.\n", exported, pages);
+    return 0;
+}
+#endif
@@ -0,0 +1,46 @@
+#ifndef URIMODE_HPP
+#define URIMODE_HPP
+
+#include <string>
+#include <vector>
+
+// the lean CLI is built without QR codes
+#if defined(OTPGEN_WITH_QR_CODES) && !defined(OTPGEN_CLI_LITE)
+#define OTPGEN_CLI_QR_CODES
+#endif
+
+/**
+ * Bulk otpauth URI export and import
+ *
+ * The export streams the tokens in display order from a consistent copy of
+ * the database (see TokenDatabase::exportReader()), edits of a daemon or
+ * the GUI don't wait for it. It writes one otpauth:// URI per line to
+ * stdout in blocks, the output contains the secrets and should be
+ * redirected into a protected file.
+ *
+ * The import reads a text file with one otpauth:// or otpauth-migration://
+ * URI per line (empty lines are skipped) and inserts all tokens in a single
+ * transaction, tokens with a label which already exists are skipped.
+ *
+ * The QR code import decodes all images on a thread pool and hands every
+ * decoded payload to the same import as soon as it is ready. The QR code
+ * export writes backup sheets with a grid of codes per PNG page, pages are
+ * encoded while the tokens are streamed from the database.
+ *
+ */
+
+// writes all tokens to stdout, returns the exit code
+int run_uri_export();
+
+// imports the URIs of the file, returns the exit code
+int run_uri_import(const std::string &file);
+
+#ifdef OTPGEN_CLI_QR_CODES
+// imports the otpauth URIs in the QR codes of the images, returns the exit code
+int run_qr_import(const std::vector<std::string> &files);
+
+// writes the tokens as pages of QR codes into the directory, returns the exit code
+int run_qr_export(const std::string &directory);
+#endif
+
+#endif // URIMODE_HPP
@@ -4,16 +4,30 @@
 #include <cstdio>
 
 #include <AppConfig.hpp>
+#include <AutoTuner.hpp>
 #include <Signals.hpp>
 #include <CommandLineOperation.hpp>
+#include <MetricsEndpoint.hpp>
+#include <StartupProfile.hpp>
 
 #include <TokenDatabase.hpp>
 
 #include <StdinEchoMode.hpp>
 
+#include "AuditMode.hpp"
+#include "Daemon.hpp"
+#include "SessionKey.hpp"
+#include "StreamMode.hpp"
+#include "DumpMode.hpp"
+#include "InspectMode.hpp"
+#ifndef OTPGEN_CLI_LITE
+#include "ShellMode.hpp"
+#endif
+#include "UriMode.hpp"
+
 #include <sago/platform_folders.h>
 
-#include <boost/filesystem.hpp>
+#include <filesystem>
 
 #if !defined(OS_WINDOWS)
 // gracefully terminate application
@@ -21,7 +35,8 @@ __attribute__((noreturn))
 static void graceful_terminate(int signal)
 {
     // close database connection handle and cleanup
-    TokenDatabase::closeDatabase();
+    TokenDatabase::discardDatabase();
+    daemon_cleanup();
 
     // restore original signal handler
     std::signal(signal, signals.at(signal));
@@ -49,51 +64,113 @@ int main(int argc, char **argv)
     }
 #endif
 
-    std::printf("%s CLI\n\n", cfg::Name.c_str());
+    // the flag is removed, the modes below don't see it
+    StartupProfile::enable(argc, argv);
+
+    const std::vector<std::string> args(argv, argv + argc);
+
+    // records go to stdout, everything else to stderr
+    const auto machine_output = args.size() > 1 &&
+        (args.at(1) == "--stdin" || args.at(1) == "--dump-codes" || args.at(1) == "--dump-tokens" ||
+         args.at(1) == "--export-uris" || args.at(1) == "--import-uris" || args.at(1) == "--import-qr" || args.at(1) == "--export-qr");
+    if (machine_output)
+    {
+        // gives std::cin its own buffer, so the stream mode knows when input is pending
+        std::ios::sync_with_stdio(false);
+    }
+    auto &info = machine_output ? std::cerr : std::cout;
 
     const auto config_home = sago::getConfigHome();
     const auto app_cfg = config_home + "/" + cfg::Developer + "/" + cfg::Name;
 
-    boost::system::error_code fs_error;
-    if (!boost::filesystem::exists(app_cfg, fs_error))
+    // requests for a running daemon don't need the password
+    if (args.size() > 1 && is_daemon_request(args.at(1)))
+    {
+        return run_daemon_client(daemon_socket_path(app_cfg), {args.begin() + 1, args.end()});
+    }
+    if (args.size() == 3 && args.at(1) == "feed")
+    {
+        return run_feed_client(daemon_feed_path(daemon_socket_path(app_cfg)), args.at(2));
+    }
+
+    // offline verification only needs the code table
+    if (args.size() > 1 && args.at(1) == "--check-code-table")
     {
-        std::cout << "[info] first start! creating config directory: " << app_cfg << std::endl << std::endl;
+        if (args.size() != 5U)
+        {
+            std::cerr << "Usage: --check-code-table <file> <label> <code>" << std::endl;
+            return 2;
+        }
+        return run_code_table_check(args.at(2), args.at(3), args.at(4));
+    }
+
+    // the audit logs of the server are read with the database password, the database isn't opened
+    if (args.size() > 1 && args.at(1) == "--audit")
+    {
+        return run_audit_query({args.begin() + 2, args.end()});
+    }
+
+    info << cfg::Name << " CLI" << std::endl << std::endl;
 
-        auto fs_res = boost::filesystem::create_directories(app_cfg, fs_error);
+    std::error_code fs_error;
+    if (!std::filesystem::exists(app_cfg, fs_error))
+    {
+        info << "[info] first start! creating config directory: " << app_cfg << std::endl << std::endl;
+
+        auto fs_res = std::filesystem::create_directories(app_cfg, fs_error);
         if (!fs_res)
         {
-            std::fprintf(stderr, "Failed to create directory: %s\n boost::filesystem: %s\n", app_cfg.c_str(), fs_error.message().c_str());
+            std::fprintf(stderr, "Failed to create directory: %s\n std::filesystem: %s\n", app_cfg.c_str(), fs_error.message().c_str());
             return 1;
         }
     }
+    StartupProfile::mark("config directory");
 
 #ifdef OTPGEN_DEBUG
-    TokenDatabase::setPassword("pwd123");
+    TokenDatabase::setTokenDatabase(app_cfg + "/tokens.db.debug");
 #else
-    std::string password;
-    std::cout << "Enter your token database password: ";
+    TokenDatabase::setTokenDatabase(app_cfg + "/tokens.db");
+#endif
 
-    SetStdinEcho(false);
-    std::cin >> password;
-    SetStdinEcho(true);
+    // a session key of an earlier start replaces the password
+    const auto session_lifetime = session_key_lifetime();
+    const auto session_unlocked = session_lifetime.count() > 0 && unlock_with_session_key(session_key_path());
 
-    if (!TokenDatabase::setPassword(password))
+#ifdef OTPGEN_DEBUG
+    TokenDatabase::setPassword("pwd123");
+#else
+    if (!session_unlocked)
     {
-        std::cerr << "Password may not be empty!" << std::endl;
-        return 1;
-    }
+        std::string password;
+        info << "Enter your token database password: " << std::flush;
 
-    password.clear();
+        SetStdinEcho(false);
+        std::cin >> password;
+        SetStdinEcho(true);
 
-    std::cout << std::endl;
-#endif
+        if (!TokenDatabase::setPassword(password))
+        {
+            std::cerr << "Password may not be empty!" << std::endl;
+            return 1;
+        }
 
-#ifdef OTPGEN_DEBUG
-    TokenDatabase::setTokenDatabase(app_cfg + "/tokens.db.debug");
-#else
-    TokenDatabase::setTokenDatabase(app_cfg + "/tokens.db");
+        password.clear();
+
+        info << std::endl;
+    }
 #endif
+    StartupProfile::mark(session_unlocked ? "session key" : "password");
+
+    // only write the changed pages on save, older databases are converted
+    TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+
+    // changes are saved in the background, closeDatabase() writes outstanding changes
+    TokenDatabase::setAutoSave(std::chrono::milliseconds(1000));
 
+    // sqlite settings shared by all frontends
+    cfg::applyDatabaseTuning();
+
+    // the phases of the library are nested into this one
     auto status = TokenDatabase::loadTokens();
     if (status == TokenDatabase::FileReadFailure)
     {
@@ -107,15 +184,197 @@ int main(int argc, char **argv)
     }
     if (status != TokenDatabase::Success)
     {
+        if (session_unlocked)
+        {
+            remove_session_key(session_key_path());
+        }
         std::cerr << "Unable to load the token database! Is the password correct?" << std::endl;
         std::cerr << "Detailed error: " << TokenDatabase::getErrorMessage(status) << std::endl;
         return 1;
     }
 
+    // the lifetime starts with the password, it isn't renewed by the session key itself
+    if (session_lifetime.count() > 0 && !session_unlocked)
+    {
+        (void) store_session_key(session_key_path(), session_lifetime);
+    }
+    StartupProfile::mark("load tokens");
+
+    // keep the database unlocked and serve requests until idle
+    if (args.size() > 1 && args.at(1) == "--daemon")
+    {
+        auto idle_timeout = std::chrono::seconds(300);
+        std::string metrics_address;
+        std::uint16_t metrics_port = 0U;
+        std::vector<std::string> feed_labels;
+        std::string tuning_mode = "cached";
+        for (auto i = 2U; i < args.size(); i += 2U)
+        {
+            if (i + 1U < args.size() && args.at(i) == "--idle-timeout")
+            {
+                try {
+                    idle_timeout = std::chrono::seconds(std::stoul(args.at(i + 1U)));
+                } catch (...) {
+                    std::cerr << "Idle timeout must be a number of seconds!" << std::endl;
+                    return 2;
+                }
+            }
+            else if (i + 1U < args.size() && args.at(i) == "--feed")
+            {
+                feed_labels.emplace_back(args.at(i + 1U));
+            }
+            else if (i + 1U < args.size() && args.at(i) == "--tuning" &&
+                     (args.at(i + 1U) == "cached" || args.at(i + 1U) == "calibrate" || args.at(i + 1U) == "off"))
+            {
+                tuning_mode = args.at(i + 1U);
+            }
+            else if (i + 1U >= args.size() || args.at(i) != "--metrics" ||
+                     !MetricsEndpoint::parseAddress(args.at(i + 1U), metrics_address, metrics_port))
+            {
+                std::cerr << "Usage: --daemon [--idle-timeout <seconds>] [--metrics <ipv4 address>:<port>] [--feed <label>]..." << std::endl;
+                std::cerr << "                [--tuning <cached|calibrate|off>]" << std::endl;
+                return 2;
+            }
+        }
+        // codes are requested by clients, the profile ends with the startup
+        StartupProfile::finish();
+        // the code generators are calibrated once per machine, calibrate measures again
+        if (tuning_mode != "off")
+        {
+            const auto tuning_path = app_cfg + "/tuning";
+            if (tuning_mode == "calibrate")
+            {
+                std::remove(tuning_path.c_str());
+            }
+            AutoTuner::load(tuning_path);
+        }
+        return run_daemon(daemon_socket_path(app_cfg), idle_timeout, metrics_address, metrics_port, feed_labels);
+    }
+
+#ifndef OTPGEN_CLI_LITE
+    // interactive shell, the database stays unlocked until it exits
+    if (args.size() > 1 && args.at(1) == "shell")
+    {
+        if (args.size() != 2)
+        {
+            std::cerr << "Usage: shell" << std::endl;
+            TokenDatabase::closeDatabase();
+            return 2;
+        }
+
+        // same for the shell, which waits for commands
+        StartupProfile::finish();
+        const auto res = run_shell();
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+#endif
+
+    // answer requests from stdin until the end of the input
+    if (args.size() > 1 && args.at(1) == "--stdin")
+    {
+        const auto res = run_stdin_mode();
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+
+    // stream the codes or the token metadata to stdout
+    if (args.size() > 1 && (args.at(1) == "--dump-codes" || args.at(1) == "--dump-tokens"))
+    {
+        auto format = DumpFormat::NDJSON;
+        if (args.size() > 3 || (args.size() == 3 && !parse_dump_format(args.at(2), format)))
+        {
+            std::cerr << "Usage: " << args.at(1) << " [ndjson|binary]" << std::endl;
+            TokenDatabase::closeDatabase();
+            return 2;
+        }
+
+        const auto res = run_dump(args.at(1) == "--dump-codes" ? DumpKind::Codes : DumpKind::Tokens, format);
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+
+    // where the bytes of the database are
+    if (args.size() > 1 && args.at(1) == "--inspect")
+    {
+        if (args.size() != 2)
+        {
+            std::cerr << "Usage: --inspect" << std::endl;
+            TokenDatabase::closeDatabase();
+            return 2;
+        }
+
+        const auto res = run_inspect();
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+
+    // pregenerated codes for offline verifiers
+    if (args.size() > 1 && args.at(1) == "--export-code-table")
+    {
+        if (args.size() < 4U)
+        {
+            std::cerr << "Usage: --export-code-table <file> <hours> [label...]" << std::endl;
+            TokenDatabase::closeDatabase();
+            return 2;
+        }
+
+        const auto res = run_code_table_export(args.at(2), args.at(3), std::vector<std::string>(args.begin() + 4, args.end()));
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+
+    // bulk otpauth URI export to stdout and import from a file
+    if (args.size() > 1 && (args.at(1) == "--export-uris" || args.at(1) == "--import-uris"))
+    {
+        const auto exporting = args.at(1) == "--export-uris";
+        if (args.size() != (exporting ? 2U : 3U))
+        {
+            std::cerr << "Usage: " << (exporting ? "--export-uris" : "--import-uris <file>") << std::endl;
+            TokenDatabase::closeDatabase();
+            return 2;
+        }
+
+        const auto res = exporting ? run_uri_export() : run_uri_import(args.at(2));
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+
+#ifdef OTPGEN_CLI_QR_CODES
+    // bulk import of otpauth QR code images
+    if (args.size() > 1 && args.at(1) == "--import-qr")
+    {
+        if (args.size() < 3U)
+        {
+            std::cerr << "Usage: --import-qr <image>..." << std::endl;
+            TokenDatabase::closeDatabase();
+            return 2;
+        }
+
+        const auto res = run_qr_import(std::vector<std::string>(args.begin() + 2, args.end()));
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+
+    // printable backup sheets
+    if (args.size() > 1 && args.at(1) == "--export-qr")
+    {
+        if (args.size() != 3U)
+        {
+            std::cerr << "Usage: --export-qr <directory>" << std::endl;
+            TokenDatabase::closeDatabase();
+            return 2;
+        }
+
+        const auto res = run_qr_export(args.at(2));
+        TokenDatabase::closeDatabase();
+        return res;
+    }
+#endif
+
     // run command line operation if any
     // FIXME: refactor how command line options are parsed and handled
     //        <remove this function>
-    const std::vector<std::string> args(argv, argv + argc);
     exec_commandline_operation(args);
 
     // TODO: cli application code goes here
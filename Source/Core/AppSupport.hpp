@@ -1,8 +1,17 @@
 #ifndef APPSUPPORT_HPP
 #define APPSUPPORT_HPP
 
+#include "AppSupport/ImportSink.hpp"
 #include "AppSupport/andOTP.hpp"
 #include "AppSupport/Authy.hpp"
 #include "AppSupport/Steam.hpp"
+#include "AppSupport/GoogleAuthenticator.hpp"
+#include "AppSupport/ImportPipeline.hpp"
+#include "AppSupport/IconTranscoder.hpp"
+#include "AppSupport/KeyCache.hpp"
+#include "AppSupport/FileFormat.hpp"
+#include "AppSupport/Aegis.hpp"
+#include "AppSupport/FreeOTPPlus.hpp"
+#include "AppSupport/TwoFAS.hpp"
 
 #endif // APPSUPPORT_HPP
@@ -0,0 +1,401 @@
+#include "Aegis.hpp"
+
+#include "KeyCache.hpp"
+
+#include <Codec.hpp>
+#include <TokenDatabase.hpp>
+#include "../Internal/BackupFile.hpp"
+#include "../Internal/JsonArena.hpp"
+#include "../Internal/JsonMembers.hpp"
+#include "../Internal/MappedFile.hpp"
+
+#include <cereal/external/rapidjson/document.h>
+#include <cereal/external/rapidjson/writer.h>
+
+// Aegis vault schema
+//
+// see also: https://github.com/beemdevelopment/Aegis/blob/master/docs/vault.md
+//
+// {
+//     "version": 1,
+//     "header": {
+//         "slots": [               <-- null for plain vaults
+//             {
+//                 "type": 1,       <-- password slot, others are raw or biometric keys
+//                 "uuid": "",
+//                 "key": "",       <-- master key encrypted with the derived key, hex
+//                 "key_params": {"nonce": "", "tag": ""},
+//                 "n": 32768, "r": 8, "p": 1,
+//                 "salt": ""       <-- hex
+//             }
+//         ],
+//         "params": {"nonce": "", "tag": ""}   <-- of the database, null for plain vaults
+//     },
+//     "db": ""                     <-- base-64 encrypted database or the database object
+// }
+//
+// database
+//
+// {
+//     "version": 2,
+//     "entries": [
+//         {
+//             "type": "totp",      <-- totp, hotp, steam, yandex, motp
+//             "uuid": "",
+//             "name": "",
+//             "issuer": "",
+//             "icon": null,        <-- base-64 encoded image, "icon_mime" tells the format
+//             "info": {"secret": "", "algo": "SHA1", "digits": 6, "period": 30, "counter": 0}
+//         }
+//     ]
+// }
+
+namespace {
+    static const constexpr int PASSWORD_SLOT = 1;
+    static const constexpr std::size_t KEY_SIZE = 32U;
+    static const constexpr std::size_t NONCE_SIZE = 12U;
+
+    // the parameters of new vaults of Aegis
+    static const AppSupport::KeyCache::Parameters SCRYPT = {AppSupport::KeyCache::Scrypt, 32768U, 8U, 1U, KEY_SIZE};
+
+    static const std::string hexMember(const rapidjson::Value &object, const char *name)
+    {
+        const auto value = Internal::stringMember(object, name);
+        return Codec::hexDecode(std::string(value));
+    }
+
+    static bool parseEntries(const rapidjson::Value &db, AppSupport::ImportSink &sink)
+    {
+        const auto entries = Internal::member(db, "entries");
+        if (!entries || !entries->IsArray())
+        {
+            return false;
+        }
+
+        sink.reserve(entries->Size());
+        for (auto&& entry : entries->GetArray())
+        {
+            const auto info = Internal::member(entry, "info");
+            const auto secret = info ? Internal::stringMember(*info, "secret") : std::string_view();
+            if (secret.empty())
+            {
+                return false;
+            }
+
+            const auto type = Internal::stringMember(entry, "type");
+            OTPToken token;
+            if (type == "totp")
+            {
+                token = OTPToken(OTPToken::TOTP);
+            }
+            else if (type == "hotp")
+            {
+                token = OTPToken(OTPToken::HOTP);
+                token.setCounter(static_cast<OTPToken::CounterType>(Internal::uintMember(*info, "counter")));
+            }
+            else if (type == "steam")
+            {
+                token = OTPToken(OTPToken::Steam);
+            }
+            else
+            {
+                // not supported by OTPGen
+                continue;
+            }
+
+            token.setLabel(std::string(Internal::stringMember(entry, "name")));
+            token.setIssuer(std::string(Internal::stringMember(entry, "issuer")));
+            token.setSecret(secret);
+            const auto icon = Internal::stringMember(entry, "icon");
+            if (!icon.empty())
+            {
+                OTPToken::Icon image(Codec::base64DecodedSize(icon.size()));
+                image.resize(Codec::base64Decode(icon.data(), icon.size(), image.data()));
+                token.setIcon(std::move(image));
+            }
+            if (token.type() != OTPToken::Steam)
+            {
+                token.setAlgorithm(std::string(Internal::stringMember(*info, "algo", "SHA1")));
+                token.setDigitLength(static_cast<OTPToken::DigitType>(Internal::uintMember(*info, "digits", 6U)));
+            }
+            if (token.type() != OTPToken::HOTP)
+            {
+                token.setPeriod(static_cast<OTPToken::PeriodType>(Internal::uintMember(*info, "period", 30U)));
+            }
+            sink.add(std::move(token));
+        }
+        return true;
+    }
+
+    template<typename Writer>
+    static void writeString(Writer &writer, std::string_view string)
+    {
+        writer.String(string.data(), static_cast<rapidjson::SizeType>(string.size()));
+    }
+
+    template<typename Writer>
+    static void writeEntry(Writer &writer, const OTPToken &token)
+    {
+        const auto steam = token.type() == OTPToken::Steam;
+        const auto hotp = token.type() == OTPToken::HOTP;
+
+        writer.StartObject();
+        writer.Key("type");
+        writer.String(hotp ? "hotp" : steam ? "steam" : "totp");
+        writer.Key("uuid");
+        writeString(writer, Internal::randomUuid());
+        writer.Key("name");
+        writeString(writer, token.label());
+        writer.Key("issuer");
+        writeString(writer, token.issuer());
+        writer.Key("icon");
+        writer.Null();
+
+        writer.Key("info");
+        writer.StartObject();
+        writer.Key("secret");
+        writeString(writer, token.secret());
+        writer.Key("algo");
+        writeString(writer, steam ? std::string("SHA1") : token.algorithmName());
+        writer.Key("digits");
+        writer.Uint(steam ? 5U : token.digitLength());
+        if (hotp)
+        {
+            writer.Key("counter");
+            writer.Uint64(token.counter());
+        }
+        else
+        {
+            writer.Key("period");
+            writer.Uint(token.period());
+        }
+        writer.EndObject();
+        writer.EndObject();
+    }
+
+    template<typename Writer>
+    static void writeParams(Writer &writer, const std::string &nonce, const std::string &tag)
+    {
+        writer.StartObject();
+        writer.Key("nonce");
+        writeString(writer, Codec::hexEncode(nonce));
+        writer.Key("tag");
+        writeString(writer, Codec::hexEncode(tag));
+        writer.EndObject();
+    }
+}
+
+namespace AppSupport {
+
+bool Aegis::importTokens(const std::string &file, ImportSink &sink, const std::string &password,
+                         KeyCache *keys, Executor *executor)
+{
+    Internal::MappedFile in;
+    if (TokenDatabase::readFile(file, in) != TokenDatabase::Success)
+    {
+        return false;
+    }
+    if (!read(in.view(), sink, password, keys, executor))
+    {
+        sink.abort();
+        return false;
+    }
+    return true;
+}
+
+bool Aegis::exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens,
+                         const std::string &password, KeyCache *keys)
+{
+    return write(target, [&](const FileFormat::TokenWriter &add) {
+        for (auto&& token : tokens)
+        {
+            add(*token);
+        }
+        return true;
+    }, password, keys);
+}
+
+bool Aegis::detect(std::string_view contents)
+{
+    return Internal::isJsonObjectWith(contents, {"header", "db"});
+}
+
+bool Aegis::read(std::string_view contents, ImportSink &sink, const std::string &password,
+                 KeyCache *keys, Executor *executor)
+{
+    try {
+        // both documents live in the arena, the decrypted one is parsed in place
+        Internal::JsonArena arena;
+        auto json = arena.document();
+        json.Parse(contents.data(), contents.size());
+        const auto header = Internal::member(json, "header");
+        const auto db = Internal::member(json, "db");
+        if (!header || !header->IsObject() || !db)
+        {
+            return false;
+        }
+
+        // plain vaults have the database as it is
+        if (db->IsObject())
+        {
+            return parseEntries(*db, sink);
+        }
+
+        const auto slots = Internal::member(*header, "slots");
+        const auto params = Internal::member(*header, "params");
+        if (!db->IsString() || !slots || !slots->IsArray() || !params || password.empty())
+        {
+            return false;
+        }
+
+        // the key of every password slot, the slots are tried in order
+        std::vector<const rapidjson::Value*> passwordSlots;
+        std::vector<KeyCache::Request> requests;
+        for (auto&& slot : slots->GetArray())
+        {
+            const auto type = Internal::member(slot, "type");
+            if (!type || !type->IsInt() || type->GetInt() != PASSWORD_SLOT || !Internal::member(slot, "key_params"))
+            {
+                continue;
+            }
+
+            KeyCache::Request request;
+            request.parameters = SCRYPT;
+            request.parameters.cost = Internal::uintMember(slot, "n");
+            request.parameters.blockSize = static_cast<std::uint32_t>(Internal::uintMember(slot, "r"));
+            request.parameters.parallelization = static_cast<std::uint32_t>(Internal::uintMember(slot, "p"));
+            request.salt = hexMember(slot, "salt");
+            passwordSlots.emplace_back(&slot);
+            requests.emplace_back(std::move(request));
+        }
+
+        KeyCache local;
+        const auto derived = (keys ? keys : &local)->keys(requests, password, executor);
+
+        SecureString master;
+        for (auto i = 0U; i < passwordSlots.size() && master.empty(); ++i)
+        {
+            const auto &slot = *passwordSlots[i];
+            const auto &keyParams = *Internal::member(slot, "key_params");
+            Internal::gcmDecrypt(derived[i], hexMember(keyParams, "nonce"), hexMember(slot, "key"),
+                                 hexMember(keyParams, "tag"), master);
+        }
+        if (master.empty())
+        {
+            return false;
+        }
+
+        SecureString decrypted;
+        const auto ciphertext = Codec::base64Decode(std::string(db->GetString(), db->GetStringLength()));
+        if (!Internal::gcmDecrypt(master, hexMember(*params, "nonce"), ciphertext, hexMember(*params, "tag"), decrypted))
+        {
+            return false;
+        }
+
+        auto database = arena.document();
+        Internal::JsonArena::parseInsitu(database, decrypted);
+        return parseEntries(database, sink);
+    } catch (...) {
+        // catch all rapidjson exceptions
+        return false;
+    }
+}
+
+bool Aegis::write(const std::string &target, const FileFormat::TokenSource &source,
+                  const std::string &password, KeyCache *keys)
+{
+    try {
+        SecureString db;
+        {
+            Internal::SecureStringStream stream(db);
+            rapidjson::Writer<Internal::SecureStringStream> writer(stream);
+            writer.StartObject();
+            writer.Key("version");
+            writer.Uint(2U);
+            writer.Key("entries");
+            writer.StartArray();
+            const auto res = source([&](const OTPToken &token) {
+                writeEntry(writer, token);
+            });
+            writer.EndArray();
+            writer.EndObject();
+            if (!res)
+            {
+                return false;
+            }
+        }
+
+        SecureString out;
+        Internal::SecureStringStream stream(out);
+        rapidjson::Writer<Internal::SecureStringStream> writer(stream);
+        writer.StartObject();
+        writer.Key("version");
+        writer.Uint(1U);
+        writer.Key("header");
+        writer.StartObject();
+
+        if (password.empty())
+        {
+            writer.Key("slots");
+            writer.Null();
+            writer.Key("params");
+            writer.Null();
+            writer.EndObject();
+            writer.Key("db");
+            writer.RawValue(db.data(), db.size(), rapidjson::kObjectType);
+        }
+        else
+        {
+            SecureString master(KEY_SIZE, '\0');
+            Internal::randomBytes(&master[0], master.size());
+            auto salt = Internal::randomBytes(KEY_SIZE);
+            const auto key = keys ? keys->encryptionKey(SCRYPT, password, KEY_SIZE, salt) : KeyCache::derive(SCRYPT, password, salt);
+
+            std::string encryptedKey, keyTag, ciphertext, tag;
+            const auto keyNonce = Internal::randomBytes(NONCE_SIZE);
+            const auto nonce = Internal::randomBytes(NONCE_SIZE);
+            if (key.empty() ||
+                !Internal::gcmEncrypt(key, keyNonce, master, encryptedKey, keyTag) ||
+                !Internal::gcmEncrypt(master, nonce, db, ciphertext, tag))
+            {
+                return false;
+            }
+
+            writer.Key("slots");
+            writer.StartArray();
+            writer.StartObject();
+            writer.Key("type");
+            writer.Int(PASSWORD_SLOT);
+            writer.Key("uuid");
+            writeString(writer, Internal::randomUuid());
+            writer.Key("key");
+            writeString(writer, Codec::hexEncode(encryptedKey));
+            writer.Key("key_params");
+            writeParams(writer, keyNonce, keyTag);
+            writer.Key("n");
+            writer.Uint64(SCRYPT.cost);
+            writer.Key("r");
+            writer.Uint(SCRYPT.blockSize);
+            writer.Key("p");
+            writer.Uint(SCRYPT.parallelization);
+            writer.Key("salt");
+            writeString(writer, Codec::hexEncode(salt));
+            writer.Key("repaired");
+            writer.Bool(true);
+            writer.EndObject();
+            writer.EndArray();
+            writer.Key("params");
+            writeParams(writer, nonce, tag);
+            writer.EndObject();
+            writer.Key("db");
+            writeString(writer, Codec::base64Encode(ciphertext));
+        }
+        writer.EndObject();
+
+        return Internal::writeFile(target, out);
+    } catch (...) {
+        return false;
+    }
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef AEGIS_HPP
+#define AEGIS_HPP
+
+#include <OTPToken.hpp>
+
+#include "FileFormat.hpp"
+#include "ImportSink.hpp"
+
+#include <string_view>
+#include <vector>
+
+class Executor;
+
+namespace AppSupport {
+
+class KeyCache;
+
+/**
+ * Aegis Authenticator vaults
+ *
+ * Vaults are plain JSON or encrypted with a random master key, which is
+ * stored once per password slot, encrypted with a key derived from the
+ * password with scrypt. The keys of all password slots are derived at once
+ * on the executor, the first slot which authenticates decrypts the vault.
+ * Entries of types OTPGen doesn't support (Yandex, mOTP) are skipped.
+ *
+ */
+class Aegis
+{
+    Aegis() = delete;
+
+public:
+    static bool importTokens(const std::string &file, ImportSink &sink, const std::string &password = std::string(),
+                             KeyCache *keys = nullptr, Executor *executor = nullptr);
+    // the vault is encrypted if a password is given
+    static bool exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens,
+                             const std::string &password = std::string(), KeyCache *keys = nullptr);
+
+    static bool detect(std::string_view contents);
+    static bool read(std::string_view contents, ImportSink &sink, const std::string &password,
+                     KeyCache *keys, Executor *executor);
+    static bool write(const std::string &target, const FileFormat::TokenSource &source,
+                      const std::string &password, KeyCache *keys);
+};
+
+}
+
+#endif // AEGIS_HPP
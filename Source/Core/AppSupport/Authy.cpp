@@ -1,18 +1,15 @@
 #include "Authy.hpp"
 
-#include <iostream>
+#include <cctype>
 
 #include <TokenDatabase.hpp>
+#include "../Internal/JsonArena.hpp"
+#include "../Internal/MappedFile.hpp"
 
-#include <cereal/external/rapidjson/document.h>
 #include <cereal/external/rapidjson/memorystream.h>
+#include <cereal/external/rapidjson/reader.h>
 
-#include <cereal/external/rapidxml/rapidxml.hpp>
-
-#include <cryptopp/algparam.h>
-#include <cryptopp/hex.h>
-#include <cryptopp/base32.h>
-#include <cryptopp/filters.h>
+#include <Codec.hpp>
 
 // Authy TOTP tokens
 // =================
@@ -70,185 +67,427 @@
 //  }
 //
 
-namespace AppSupport {
-
-bool Authy::importTOTP(const std::string &file, std::vector<OTPToken> &target, const Format &format)
-{
-    std::string json;
-    auto status = prepare(file, format, TOTP, json);
-    if (!status)
+namespace {
+    // SAX handler for the token array, a token is emitted when its object ends,
+    // values of unknown members and nested values are skipped
+    class TokenHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, TokenHandler>
     {
-        return status;
-    }
+    public:
+        // native tokens store a hex encoded seed which is re-encoded into base-32
+        TokenHandler(AppSupport::ImportSink &sink, std::string_view secretKey, bool hexSecret)
+            : _sink(sink), _secretKey(secretKey), _hexSecret(hexSecret)
+        {
+        }
 
-    // parse json
-    try {
-        rapidjson::StringStream s(json.c_str());
-        rapidjson::Document json;
-        json.ParseStream(s);
+        bool StartArray()
+        {
+            ++_depth;
+            return true;
+        }
 
-        // root element must be an array
-        if (!json.IsArray())
+        bool EndArray(rapidjson::SizeType)
         {
-            return false;
+            --_depth;
+            return true;
         }
 
-        auto array = json.GetArray();
-        for (auto&& elem : array)
+        bool StartObject()
         {
-            // check if object has all required members
-            if (!(elem.HasMember("decryptedSecret") &&
-                elem.HasMember("digits") &&
-                elem.HasMember("name")))
+            // root element must be an array
+            if (_depth == 0U)
             {
-                continue;
+                return false;
             }
+            if (_depth == 1U)
+            {
+                _entry = Entry();
+            }
+            ++_depth;
+            return true;
+        }
 
-            OTPToken token(OTPToken::TOTP);
-            token.setSecret(elem["decryptedSecret"].GetString());
-            token.setLabel(elem["name"].GetString());
-            token.setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-            target.push_back(token);
+        bool EndObject(rapidjson::SizeType)
+        {
+            --_depth;
+            if (_depth == 1U)
+            {
+                emit();
+            }
+            return true;
         }
-    } catch (...) {
-        // catch all rapidjson exceptions
-        return false;
-    }
 
-    return true;
-}
+        bool Key(const char *str, rapidjson::SizeType length, bool)
+        {
+            if (_depth == 2U)
+            {
+                _key.assign(str, length);
+            }
+            return true;
+        }
 
-bool Authy::importNative(const std::string &file, std::vector<OTPToken> &target, const Format &format)
-{
-    std::string json;
-    auto status = prepare(file, format, Native, json);
-    if (!status)
-    {
-        return status;
-    }
+        bool String(const char *str, rapidjson::SizeType length, bool)
+        {
+            if (_depth != 2U)
+            {
+                return _depth != 0U;
+            }
 
-    // parse json
-    try {
-        rapidjson::StringStream s(json.c_str());
-        rapidjson::Document json;
-        json.ParseStream(s);
+            if (_key == _secretKey)
+            {
+                _entry.secret.assign(str, length);
+                _entry.fields |= Secret;
+            }
+            else if (_key == "name")
+            {
+                _entry.name.assign(str, length);
+                _entry.fields |= Name;
+            }
+            return true;
+        }
 
-        // root element must be an array
-        if (!json.IsArray())
+        bool Uint(unsigned int value)
         {
-            return false;
+            if (_depth != 2U)
+            {
+                return _depth != 0U;
+            }
+
+            if (_key == "digits")
+            {
+                _entry.digits = value;
+                _entry.fields |= Digits;
+            }
+            return true;
         }
 
-        auto array = json.GetArray();
-        for (auto&& elem : array)
+        // all other values, scalar roots are rejected
+        bool Default()
         {
-            // check if object has all required members
-            if (!(elem.HasMember("secretSeed") &&
-                elem.HasMember("digits") &&
-                elem.HasMember("name")))
+            return _depth != 0U;
+        }
+
+        // converts the hex seeds of all native tokens in one pass and adds the tokens
+        void finish()
+        {
+            if (_pending.empty())
             {
-                continue;
+                return;
+            }
+
+            std::vector<std::size_t> lengths;
+            lengths.reserve(_pending.size());
+            for (auto&& pending : _pending)
+            {
+                lengths.emplace_back(pending.length);
+            }
+
+            SecureString secrets(Codec::base32EncodedSize(Codec::hexDecodedSize(_seeds.size())) + _pending.size(), '\0');
+            secrets.resize(Codec::hexToBase32(_seeds.data(), lengths.data(), lengths.size(), &secrets[0]));
+
+            _sink.reserve(_pending.size());
+            const std::string_view view(secrets);
+            std::size_t offset = 0U;
+            for (auto i = 0U; i < _pending.size(); ++i)
+            {
+                OTPToken token(OTPToken::TOTP);
+                token.setSecret(view.substr(offset, lengths[i]));
+                token.setLabel(std::move(_pending[i].name));
+                token.setDigitLength(static_cast<OTPToken::DigitType>(_pending[i].digits));
+                _sink.add(std::move(token));
+                offset += lengths[i];
+            }
+            _pending.clear();
+        }
+
+    private:
+        enum Field {
+            Secret = 1 << 0,
+            Name   = 1 << 1,
+            Digits = 1 << 2,
+        };
+
+        // native token waiting for the conversion of its seed
+        struct Pending
+        {
+            std::string name;
+            unsigned int digits = 0U;
+            std::size_t length = 0U;
+        };
+
+        struct Entry
+        {
+            SecureString secret;
+            std::string name;
+            unsigned int digits = 0U;
+            unsigned int fields = 0U;
+        };
+
+        void emit()
+        {
+            // entries without all required members are skipped
+            if (_entry.fields != (Secret | Name | Digits))
+            {
+                return;
+            }
+
+            // seeds are collected back to back in one buffer
+            if (_hexSecret)
+            {
+                _seeds.append(_entry.secret);
+                _pending.push_back({std::move(_entry.name), _entry.digits, _entry.secret.size()});
+                return;
             }
 
             OTPToken token(OTPToken::TOTP);
-            token.setSecret(hexToBase32Rfc4648(elem["secretSeed"].GetString()));
-            token.setLabel(elem["name"].GetString());
-            token.setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-            target.push_back(token);
+            token.setSecret(_entry.secret);
+            token.setLabel(std::move(_entry.name));
+            token.setDigitLength(static_cast<OTPToken::DigitType>(_entry.digits));
+            _sink.add(std::move(token));
         }
-    } catch (...) {
-        // catch all rapidjson exceptions
-        return false;
-    }
 
-    return true;
-}
+        AppSupport::ImportSink &_sink;
+        const std::string_view _secretKey;
+        const bool _hexSecret;
+        unsigned int _depth = 0U;
+        std::string _key;
+        Entry _entry;
 
-bool Authy::prepare(const std::string &file, const Format &format, const AuthyXMLType &type, std::string &json)
-{
-    // read file contents into memory
-    std::string out;
-    auto status = TokenDatabase::readFile(file, out);
-    if (status != TokenDatabase::Success)
-    {
-        out.clear();
-        return false;
-    }
+        SecureString _seeds;
+        std::vector<Pending> _pending;
+    };
 
-    if (out.empty())
+    // finds the contents of the <string> element with the given name attribute
+    static bool findStringValue(std::string_view xml, std::string_view name, std::string_view &value)
     {
+        std::size_t pos = 0U;
+        while ((pos = xml.find("<string", pos)) != std::string_view::npos)
+        {
+            const auto end = xml.find('>', pos);
+            if (end == std::string_view::npos)
+            {
+                return false;
+            }
+            const auto tag = xml.substr(pos, end - pos);
+            pos = end + 1U;
+
+            // <stringset> and others
+            if (tag.size() < 8U || !std::isspace(static_cast<unsigned char>(tag[7U])))
+            {
+                continue;
+            }
+
+            // name attribute, either quote is valid
+            auto attr = tag.find("name=");
+            while (attr != std::string_view::npos && !std::isspace(static_cast<unsigned char>(tag[attr - 1U])))
+            {
+                attr = tag.find("name=", attr + 1U);
+            }
+            if (attr == std::string_view::npos || attr + 6U > tag.size())
+            {
+                continue;
+            }
+            const auto quote = tag[attr + 5U];
+            const auto close = tag.find(quote, attr + 6U);
+            if ((quote != '"' && quote != '\'') || close == std::string_view::npos ||
+                tag.substr(attr + 6U, close - attr - 6U) != name)
+            {
+                continue;
+            }
+
+            // self-closing element
+            if (tag.back() == '/')
+            {
+                value = std::string_view();
+                return true;
+            }
+
+            const auto last = xml.find("</string>", pos);
+            if (last == std::string_view::npos)
+            {
+                return false;
+            }
+            value = xml.substr(pos, last - pos);
+            return true;
+        }
+
         return false;
     }
 
-    if (format == XML)
+    static std::size_t encodeUtf8(unsigned long code, char *out)
     {
-        auto status = extractJSON(out, type, json);
-        if (!status)
+        if (code < 0x80)
         {
-            out.clear();
-            return status;
+            out[0] = static_cast<char>(code);
+            return 1U;
         }
+        if (code < 0x800)
+        {
+            out[0] = static_cast<char>(0xC0 | (code >> 6));
+            out[1] = static_cast<char>(0x80 | (code & 0x3F));
+            return 2U;
+        }
+        if (code < 0x10000)
+        {
+            out[0] = static_cast<char>(0xE0 | (code >> 12));
+            out[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out[2] = static_cast<char>(0x80 | (code & 0x3F));
+            return 3U;
+        }
+        out[0] = static_cast<char>(0xF0 | (code >> 18));
+        out[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out[3] = static_cast<char>(0x80 | (code & 0x3F));
+        return 4U;
     }
-    else
+
+    // replaces the predefined and numeric entities in place,
+    // the result is never longer than the escaped text
+    static void unescapeXML(SecureString &value)
     {
-        json = out;
+        auto out = 0U;
+        auto in = 0U;
+        while (in < value.size())
+        {
+            if (value[in] == '&')
+            {
+                const auto semicolon = value.find(';', in);
+                const auto entity = semicolon == SecureString::npos ? std::string_view() :
+                                    std::string_view(value).substr(in + 1U, semicolon - in - 1U);
+
+                char decoded[4];
+                std::size_t size = 0U;
+                if (entity == "quot")      { decoded[0] = '"';  size = 1U; }
+                else if (entity == "apos") { decoded[0] = '\''; size = 1U; }
+                else if (entity == "amp")  { decoded[0] = '&';  size = 1U; }
+                else if (entity == "lt")   { decoded[0] = '<';  size = 1U; }
+                else if (entity == "gt")   { decoded[0] = '>';  size = 1U; }
+                else if (entity.size() > 1U && entity[0] == '#')
+                {
+                    const auto hex = entity[1] == 'x' || entity[1] == 'X';
+                    const auto digits = entity.substr(hex ? 2U : 1U);
+                    unsigned long code = 0U;
+                    auto valid = !digits.empty() && digits.size() <= 8U;
+                    for (auto&& c : digits)
+                    {
+                        const auto digit = hex ? std::isxdigit(static_cast<unsigned char>(c)) : std::isdigit(static_cast<unsigned char>(c));
+                        if (!digit)
+                        {
+                            valid = false;
+                            break;
+                        }
+                        code = code * (hex ? 16U : 10U) +
+                               static_cast<unsigned long>(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (std::tolower(c) - 'a' + 10));
+                    }
+                    if (valid && code <= 0x10FFFF)
+                    {
+                        size = encodeUtf8(code, decoded);
+                    }
+                }
+
+                if (size != 0U)
+                {
+                    for (auto i = 0U; i < size; ++i)
+                    {
+                        value[out++] = decoded[i];
+                    }
+                    in = static_cast<unsigned int>(semicolon) + 1U;
+                    continue;
+                }
+            }
+
+            value[out++] = value[in++];
+        }
+        value.resize(out);
     }
+}
 
-    out.clear();
-    return true;
+namespace AppSupport {
+
+bool Authy::importTOTP(const std::string &file, ImportSink &sink, const Format &format)
+{
+    return parse(file, format, TOTP, sink);
 }
 
-const std::string Authy::hexToBase32Rfc4648(const std::string &hex)
+bool Authy::importNative(const std::string &file, ImportSink &sink, const Format &format)
 {
-    // create an RFC 4648 base-32 encoder
-    // crypto++ uses DUDE by default which isn't TOTP compatible
-    auto encoder = new CryptoPP::Base32Encoder();
-    static const CryptoPP::byte ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-    static const CryptoPP::AlgorithmParameters params = CryptoPP::MakeParameters(
-                                                        CryptoPP::Name::EncodingLookupArray(),
-                                                        static_cast<const CryptoPP::byte*>(ALPHABET));
-    encoder->IsolatedInitialize(params);
-
-    // raw pointers are automatically deleted by crypto++
-    std::string base32;
-    encoder->Attach(new CryptoPP::StringSink(base32));
-    CryptoPP::StringSource src(hex, true,
-          new CryptoPP::HexDecoder(encoder));
-    return base32;
+    return parse(file, format, Native, sink);
 }
 
-bool Authy::extractJSON(const std::string &xml, const AuthyXMLType &type, std::string &json)
+bool Authy::importTOTP(const std::string &file, std::vector<OTPToken> &target, const Format &format)
 {
-    const std::string attr = type == TOTP ?
-        "com.authy.storage.tokens.authenticator.key" :
-        "com.authy.storage.tokens.authy.key";
+    VectorSink sink(target);
+    return importTOTP(file, sink, format);
+}
 
-    try {
-        cereal::rapidxml::xml_document<> doc;
-        auto buf = xml;
-        doc.parse<0>(const_cast<char*>(buf.data()));
+bool Authy::importNative(const std::string &file, std::vector<OTPToken> &target, const Format &format)
+{
+    VectorSink sink(target);
+    return importNative(file, sink, format);
+}
 
-        auto map = doc.first_node("map", 3, false);
-        if (!map) return false;
+bool Authy::parse(const std::string &file, const Format &format, const AuthyXMLType &type, ImportSink &sink)
+{
+    // map the file contents
+    Internal::MappedFile in;
+    auto status = TokenDatabase::readFile(file, in);
+    if (status != TokenDatabase::Success)
+    {
+        return false;
+    }
 
-        auto string = map->first_node("string", 6, false);
-        if (!string) return false;
+    // JSON files are parsed directly from the mapped file, the XML format only needs
+    // a copy of the unescaped value, which is parsed in place
+    SecureString unescaped;
+    if (format == XML && !extractJSON(in.view(), type, unescaped))
+    {
+        return false;
+    }
 
-        auto name = string->first_attribute("name", 4, false);
-        if (!name) return false;
+    TokenHandler handler(sink, type == TOTP ? "decryptedSecret" : "secretSeed", type == Native);
+    Internal::JsonArena arena;
+    auto reader = arena.reader();
 
-        const auto authy_type = std::string(name->value());
-        if (authy_type != attr)
+    auto res = false;
+    try {
+        if (format == XML)
         {
-            return false;
+            rapidjson::InsituStringStream stream(&unescaped[0]);
+            res = !reader.Parse<rapidjson::kParseInsituFlag>(stream, handler).IsError();
+        }
+        else
+        {
+            rapidjson::MemoryStream stream(in.data(), in.size());
+            res = !reader.Parse(stream, handler).IsError();
+        }
+        if (res)
+        {
+            handler.finish();
         }
-
-        const auto json_value = std::string(string->value());
-        json = json_value;
     } catch (...) {
+        res = false;
+    }
+
+    if (!res)
+    {
+        sink.abort();
+    }
+    return res;
+}
+
+bool Authy::extractJSON(std::string_view xml, const AuthyXMLType &type, SecureString &json)
+{
+    const auto attr = type == TOTP ?
+        "com.authy.storage.tokens.authenticator.key" :
+        "com.authy.storage.tokens.authy.key";
+
+    std::string_view value;
+    if (!findStringValue(xml, attr, value))
+    {
         return false;
     }
 
+    json.assign(value.data(), value.size());
+    unescapeXML(json);
     return true;
 }
 
@@ -3,6 +3,9 @@
 
 #include <OTPToken.hpp>
 
+#include "ImportSink.hpp"
+
+#include <string_view>
 #include <vector>
 
 namespace AppSupport {
@@ -17,6 +20,10 @@ public:
         JSON,
     };
 
+    static bool importTOTP(const std::string &file, ImportSink &sink, const Format &format);
+    static bool importNative(const std::string &file, ImportSink &sink, const Format &format);
+
+    // append to a vector
     static bool importTOTP(const std::string &file, std::vector<OTPToken> &target, const Format &format);
     static bool importNative(const std::string &file, std::vector<OTPToken> &target, const Format &format);
 
@@ -26,10 +33,10 @@ private:
         Native,
     };
 
-    static const std::string hexToBase32Rfc4648(const std::string &hex);
-
-    static bool prepare(const std::string &file, const Format &format, const AuthyXMLType &type, std::string &json);
-    static bool extractJSON(const std::string &xml, const AuthyXMLType &type, std::string &json);
+    // streams the token array through a SAX parser, XML files are scanned for the
+    // value of the token key which is unescaped into a single copy
+    static bool parse(const std::string &file, const Format &format, const AuthyXMLType &type, ImportSink &sink);
+    static bool extractJSON(std::string_view xml, const AuthyXMLType &type, SecureString &json);
 };
 
 }
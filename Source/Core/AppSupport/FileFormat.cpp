@@ -0,0 +1,312 @@
+#include "FileFormat.hpp"
+
+#include "Aegis.hpp"
+#include "andOTP.hpp"
+#include "Authy.hpp"
+#include "FreeOTPPlus.hpp"
+#include "ImportPipeline.hpp"
+#include "Steam.hpp"
+#include "TwoFAS.hpp"
+
+#include "../Internal/MappedFile.hpp"
+
+#include <TokenDatabase.hpp>
+
+#include <filesystem>
+#include <mutex>
+
+namespace {
+    using AppSupport::FileFormat;
+    using AppSupport::ImportPipeline;
+    using AppSupport::ImportSink;
+
+    class AegisFormat final : public FileFormat
+    {
+    public:
+        const char *name() const override
+        { return "aegis"; }
+        bool detect(std::string_view contents) const override
+        { return AppSupport::Aegis::detect(contents); }
+        bool read(const std::string&, std::string_view contents, ImportSink &sink, const Options &options) const override
+        { return AppSupport::Aegis::read(contents, sink, options.password, options.keys, options.executor); }
+        bool canWrite() const override
+        { return true; }
+        bool write(const std::string &file, const TokenSource &source, const Options &options) const override
+        { return AppSupport::Aegis::write(file, source, options.password, options.keys); }
+    };
+
+    class FreeOTPPlusFormat final : public FileFormat
+    {
+    public:
+        const char *name() const override
+        { return "freeotp+"; }
+        bool detect(std::string_view contents) const override
+        { return AppSupport::FreeOTPPlus::detect(contents); }
+        bool read(const std::string&, std::string_view contents, ImportSink &sink, const Options&) const override
+        { return AppSupport::FreeOTPPlus::read(contents, sink); }
+        bool canWrite() const override
+        { return true; }
+        bool write(const std::string &file, const TokenSource &source, const Options&) const override
+        { return AppSupport::FreeOTPPlus::write(file, source); }
+    };
+
+    class TwoFASFormat final : public FileFormat
+    {
+    public:
+        const char *name() const override
+        { return "2fas"; }
+        bool detect(std::string_view contents) const override
+        { return AppSupport::TwoFAS::detect(contents); }
+        bool read(const std::string&, std::string_view contents, ImportSink &sink, const Options &options) const override
+        { return AppSupport::TwoFAS::read(contents, sink, options.password, options.keys); }
+        bool canWrite() const override
+        { return true; }
+        bool write(const std::string &file, const TokenSource &source, const Options&) const override
+        { return AppSupport::TwoFAS::write(file, source); }
+    };
+
+    // the formats of the pipeline, detected by it and read from the file
+    class BuiltinFormat : public FileFormat
+    {
+    public:
+        bool detect(std::string_view contents) const override
+        { return this->format(ImportPipeline::detectFormat(contents, false)); }
+        bool builtin() const override
+        { return true; }
+
+    protected:
+        virtual bool format(const ImportPipeline::Format &format) const = 0;
+    };
+
+    class andOTPFormat final : public BuiltinFormat
+    {
+    public:
+        const char *name() const override
+        { return "andotp"; }
+        bool read(const std::string &file, std::string_view, ImportSink &sink, const Options &options) const override
+        {
+            if (options.password.empty())
+            {
+                return AppSupport::andOTP::importTokens(file, sink, AppSupport::andOTP::PlainText);
+            }
+            return AppSupport::andOTP::importEncrypted(file, sink, options.password, options.keys);
+        }
+        bool canWrite() const override
+        { return true; }
+        bool write(const std::string &file, const TokenSource &source, const Options &options) const override
+        {
+            // new backups use the PBKDF2 format of current andOTP versions
+            return AppSupport::andOTP::write(file, options.password.empty() ?
+                AppSupport::andOTP::PlainText : AppSupport::andOTP::EncryptedPBKDF2, options.password, source, options.keys);
+        }
+
+    protected:
+        bool format(const ImportPipeline::Format &format) const override
+        { return format == ImportPipeline::andOTPPlainText || format == ImportPipeline::andOTPEncrypted; }
+    };
+
+    class AuthyFormat final : public BuiltinFormat
+    {
+    public:
+        const char *name() const override
+        { return "authy"; }
+        bool read(const std::string &file, std::string_view contents, ImportSink &sink, const Options&) const override
+        {
+            using AppSupport::Authy;
+            switch (ImportPipeline::detectFormat(contents, false))
+            {
+                case ImportPipeline::AuthyTOTPXML:    return Authy::importTOTP(file, sink, Authy::XML);
+                case ImportPipeline::AuthyTOTPJSON:   return Authy::importTOTP(file, sink, Authy::JSON);
+                case ImportPipeline::AuthyNativeXML:  return Authy::importNative(file, sink, Authy::XML);
+                case ImportPipeline::AuthyNativeJSON: return Authy::importNative(file, sink, Authy::JSON);
+                default:                              return false;
+            }
+        }
+
+    protected:
+        bool format(const ImportPipeline::Format &format) const override
+        {
+            return format == ImportPipeline::AuthyTOTPXML || format == ImportPipeline::AuthyTOTPJSON ||
+                   format == ImportPipeline::AuthyNativeXML || format == ImportPipeline::AuthyNativeJSON;
+        }
+    };
+
+    class SteamGuardFormat final : public BuiltinFormat
+    {
+    public:
+        const char *name() const override
+        { return "steamguard"; }
+        bool read(const std::string &file, std::string_view, ImportSink &sink, const Options&) const override
+        { return AppSupport::Steam::importFromSteamGuard(file, sink); }
+
+    protected:
+        bool format(const ImportPipeline::Format &format) const override
+        { return format == ImportPipeline::SteamGuard; }
+    };
+
+    class SteamMaFilesFormat final : public BuiltinFormat
+    {
+    public:
+        const char *name() const override
+        { return "mafiles"; }
+        bool read(const std::string &file, std::string_view, ImportSink &sink, const Options &options) const override
+        { return AppSupport::Steam::importFromMaFiles(file, sink, options.password, options.executor); }
+
+    protected:
+        bool format(const ImportPipeline::Format &format) const override
+        { return format == ImportPipeline::SteamMaFiles; }
+    };
+
+    struct Registry
+    {
+        Registry()
+            : formats({std::make_shared<AegisFormat>(), std::make_shared<FreeOTPPlusFormat>(),
+                       std::make_shared<TwoFASFormat>(), std::make_shared<SteamMaFilesFormat>(),
+                       std::make_shared<SteamGuardFormat>(), std::make_shared<AuthyFormat>(),
+                       std::make_shared<andOTPFormat>()})
+        {
+        }
+
+        std::mutex mutex;
+        std::vector<std::shared_ptr<const FileFormat>> formats;
+    };
+
+    static Registry &registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+}
+
+namespace AppSupport {
+
+void FormatRegistry::add(std::shared_ptr<const FileFormat> format)
+{
+    if (!format)
+    {
+        return;
+    }
+
+    auto &formats = registry();
+    std::lock_guard<std::mutex> lock(formats.mutex);
+    for (auto&& existing : formats.formats)
+    {
+        if (std::string_view(existing->name()) == format->name())
+        {
+            existing = std::move(format);
+            return;
+        }
+    }
+    formats.formats.emplace_back(std::move(format));
+}
+
+const std::vector<std::shared_ptr<const FileFormat>> FormatRegistry::formats()
+{
+    auto &formats = registry();
+    std::lock_guard<std::mutex> lock(formats.mutex);
+    return formats.formats;
+}
+
+std::shared_ptr<const FileFormat> FormatRegistry::find(std::string_view name)
+{
+    auto &formats = registry();
+    std::lock_guard<std::mutex> lock(formats.mutex);
+    for (auto&& format : formats.formats)
+    {
+        if (name == format->name())
+        {
+            return format;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const FileFormat> FormatRegistry::detect(std::string_view contents, bool builtin)
+{
+    // the built-in formats go last, encrypted andOTP backups are recognized by their size only
+    const auto all = formats();
+    for (auto&& format : all)
+    {
+        if (!format->builtin() && format->detect(contents))
+        {
+            return format;
+        }
+    }
+    for (auto&& format : all)
+    {
+        if (builtin && format->builtin() && format->detect(contents))
+        {
+            return format;
+        }
+    }
+    return nullptr;
+}
+
+bool FormatRegistry::importFile(const std::string &file, ImportSink &sink, const FileFormat::Options &options,
+                                const FileFormat *format)
+{
+    std::shared_ptr<const FileFormat> detected;
+    std::error_code error;
+    Internal::MappedFile in;
+    if (std::filesystem::is_directory(file, error))
+    {
+        detected = find("mafiles");
+    }
+    else if (!in.open(file))
+    {
+        return false;
+    }
+    else if (!format)
+    {
+        detected = detect(in.view());
+    }
+
+    const auto reader = format ? format : detected.get();
+    if (!reader)
+    {
+        return false;
+    }
+    if (!reader->read(file, in.view(), sink, options))
+    {
+        sink.abort();
+        return false;
+    }
+    return true;
+}
+
+bool FormatRegistry::exportTokens(const std::string &file, const std::vector<OTPToken*> &tokens, const FileFormat &format,
+                                  const FileFormat::Options &options)
+{
+    if (!format.canWrite())
+    {
+        return false;
+    }
+    return format.write(file, [&](const FileFormat::TokenWriter &add) {
+        for (auto&& token : tokens)
+        {
+            add(*token);
+        }
+        return true;
+    }, options);
+}
+
+bool FormatRegistry::exportDatabase(const std::string &file, const FileFormat &format, const FileFormat::Options &options,
+                                    const OTPToken::sqliteTypesID &type)
+{
+    if (!format.canWrite())
+    {
+        return false;
+    }
+    auto reader = TokenDatabase::exportReader();
+    if (!reader.isValid())
+    {
+        return false;
+    }
+    return format.write(file, [&](const FileFormat::TokenWriter &add) {
+        return reader.forEachToken(type, [&](const OTPToken &token) {
+            add(token);
+        }) == TokenDatabase::Success;
+    }, options);
+}
+
+}
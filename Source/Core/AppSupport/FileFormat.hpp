@@ -0,0 +1,104 @@
+#ifndef FILEFORMAT_HPP
+#define FILEFORMAT_HPP
+
+#include <OTPToken.hpp>
+
+#include "ImportSink.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Executor;
+
+namespace AppSupport {
+
+class KeyCache;
+
+/**
+ * Import and export format of another app
+ *
+ * A format reads a file into an import sink and optionally writes the
+ * tokens of a source into a file. Readers get the mapped contents of the
+ * file and decrypt, parse and hand every token to the sink as it is
+ * parsed, writers serialize the tokens one by one as the source produces
+ * them. Encrypted formats derive their keys through the key cache and on
+ * the executor of the options, both may be null.
+ *
+ * Formats are found by name or detected from the file contents through the
+ * FormatRegistry, the ImportPipeline commits the tokens of registered
+ * formats like the ones of the built-in formats.
+ *
+ */
+class FileFormat
+{
+public:
+    struct Options
+    {
+        std::string password;           // empty for plain text files
+        Executor *executor = nullptr;   // key derivations run on it
+        KeyCache *keys = nullptr;       // keys of earlier files of the same backup
+    };
+
+    // hands the tokens to the writer, returns false to abort the export
+    using TokenWriter = std::function<void(const OTPToken &token)>;
+    using TokenSource = std::function<bool(const TokenWriter &add)>;
+
+    virtual ~FileFormat() = default;
+
+    // lowercase name, used on the command line
+    virtual const char *name() const = 0;
+    virtual bool detect(std::string_view contents) const = 0;
+
+    // tokens which were added before a failure must be discarded by the caller, see ImportSink::abort()
+    virtual bool read(const std::string &file, std::string_view contents, ImportSink &sink, const Options &options) const = 0;
+
+    virtual bool canWrite() const
+    { return false; }
+    // files are encrypted if a password is given and the format supports it
+    virtual bool write(const std::string &file, const TokenSource &source, const Options &options) const
+    { (void) file; (void) source; (void) options; return false; }
+
+    // formats which are dispatched by the ImportPipeline itself
+    virtual bool builtin() const
+    { return false; }
+};
+
+/**
+ * Registry of all import and export formats
+ *
+ * andOTP, Authy, SteamGuard, Aegis, FreeOTP+ and 2FAS are registered on
+ * first use, applications can add their own formats. Detection asks the
+ * formats in the order they were added.
+ *
+ */
+class FormatRegistry
+{
+    FormatRegistry() = delete;
+
+public:
+    // replaces a format with the same name
+    static void add(std::shared_ptr<const FileFormat> format);
+
+    static const std::vector<std::shared_ptr<const FileFormat>> formats();
+    static std::shared_ptr<const FileFormat> find(std::string_view name);
+    // formats which were added go before the built-in ones
+    static std::shared_ptr<const FileFormat> detect(std::string_view contents, bool builtin = true);
+
+    // maps the file and reads it with the given or the detected format,
+    // the tokens of a failed import are removed through ImportSink::abort()
+    static bool importFile(const std::string &file, ImportSink &sink, const FileFormat::Options &options = {},
+                           const FileFormat *format = nullptr);
+    static bool exportTokens(const std::string &file, const std::vector<OTPToken*> &tokens, const FileFormat &format,
+                             const FileFormat::Options &options = {});
+    // streams the tokens of the open database in display order from a copy (see TokenDatabase::exportReader()),
+    // edits made during the export neither wait for it nor show up in the file
+    static bool exportDatabase(const std::string &file, const FileFormat &format, const FileFormat::Options &options = {},
+                               const OTPToken::sqliteTypesID &type = OTPToken::None);
+};
+
+}
+
+#endif // FILEFORMAT_HPP
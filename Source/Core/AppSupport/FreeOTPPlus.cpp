@@ -0,0 +1,198 @@
+#include "FreeOTPPlus.hpp"
+
+#include <Codec.hpp>
+#include <TokenDatabase.hpp>
+#include "../Internal/BackupFile.hpp"
+#include "../Internal/JsonArena.hpp"
+#include "../Internal/JsonMembers.hpp"
+#include "../Internal/MappedFile.hpp"
+
+#include <cereal/external/rapidjson/document.h>
+#include <cereal/external/rapidjson/writer.h>
+
+// FreeOTP+ export schema
+//
+// {
+//     "tokenOrder": ["issuer:label"],
+//     "tokens": [
+//         {
+//             "algo": "SHA1",
+//             "counter": 0,
+//             "digits": 6,
+//             "issuerExt": "",
+//             "label": "",
+//             "period": 30,
+//             "secret": [-12, 34],     <-- signed bytes
+//             "type": "TOTP"           <-- TOTP or HOTP
+//         }
+//     ]
+// }
+
+namespace {
+    template<typename Writer>
+    static void writeString(Writer &writer, std::string_view string)
+    {
+        writer.String(string.data(), static_cast<rapidjson::SizeType>(string.size()));
+    }
+
+    static const std::string orderName(const OTPToken &token)
+    {
+        return token.issuer().empty() ? token.label() : token.issuer() + ":" + token.label();
+    }
+}
+
+namespace AppSupport {
+
+bool FreeOTPPlus::importTokens(const std::string &file, ImportSink &sink)
+{
+    Internal::MappedFile in;
+    if (TokenDatabase::readFile(file, in) != TokenDatabase::Success)
+    {
+        return false;
+    }
+    if (!read(in.view(), sink))
+    {
+        sink.abort();
+        return false;
+    }
+    return true;
+}
+
+bool FreeOTPPlus::exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens)
+{
+    return write(target, [&](const FileFormat::TokenWriter &add) {
+        for (auto&& token : tokens)
+        {
+            add(*token);
+        }
+        return true;
+    });
+}
+
+bool FreeOTPPlus::detect(std::string_view contents)
+{
+    return Internal::isJsonObjectWith(contents, {"tokenOrder", "tokens"});
+}
+
+bool FreeOTPPlus::read(std::string_view contents, ImportSink &sink)
+{
+    try {
+        Internal::JsonArena arena;
+        auto json = arena.document();
+        json.Parse(contents.data(), contents.size());
+        const auto tokens = Internal::member(json, "tokens");
+        if (!tokens || !tokens->IsArray())
+        {
+            return false;
+        }
+
+        SecureBuffer bytes;
+        SecureString secret;
+        sink.reserve(tokens->Size());
+        for (auto&& entry : tokens->GetArray())
+        {
+            const auto array = Internal::member(entry, "secret");
+            if (!array || !array->IsArray() || array->Empty())
+            {
+                return false;
+            }
+
+            bytes.clear();
+            for (auto&& byte : array->GetArray())
+            {
+                if (!byte.IsInt() || byte.GetInt() < -128 || byte.GetInt() > 255)
+                {
+                    return false;
+                }
+                bytes.push_back(static_cast<unsigned char>(byte.GetInt()));
+            }
+            secret.resize(Codec::base32EncodedSize(bytes.size()));
+            secret.resize(Codec::base32Encode(bytes.data(), bytes.size(), &secret[0]));
+
+            const auto hotp = Internal::stringMember(entry, "type") == "HOTP";
+            OTPToken token(hotp ? OTPToken::HOTP : OTPToken::TOTP);
+            token.setLabel(std::string(Internal::stringMember(entry, "label")));
+            token.setIssuer(std::string(Internal::stringMember(entry, "issuerExt")));
+            token.setSecret(std::string_view(secret));
+            token.setAlgorithm(std::string(Internal::stringMember(entry, "algo", "SHA1")));
+            token.setDigitLength(static_cast<OTPToken::DigitType>(Internal::uintMember(entry, "digits", 6U)));
+            if (hotp)
+            {
+                token.setCounter(static_cast<OTPToken::CounterType>(Internal::uintMember(entry, "counter")));
+            }
+            else
+            {
+                token.setPeriod(static_cast<OTPToken::PeriodType>(Internal::uintMember(entry, "period", 30U)));
+            }
+            sink.add(std::move(token));
+        }
+    } catch (...) {
+        // catch all rapidjson exceptions
+        return false;
+    }
+
+    return true;
+}
+
+bool FreeOTPPlus::write(const std::string &target, const FileFormat::TokenSource &source)
+{
+    try {
+        SecureString out;
+        Internal::SecureStringStream stream(out);
+        rapidjson::Writer<Internal::SecureStringStream> writer(stream);
+
+        // the order is written after the tokens, the keys of the object have no order
+        std::vector<std::string> order;
+        SecureString secret;
+        writer.StartObject();
+        writer.Key("tokens");
+        writer.StartArray();
+        const auto res = source([&](const OTPToken &token) {
+            if (token.type() == OTPToken::Steam || !Codec::base32Decode(token.secret(), secret))
+            {
+                return;
+            }
+
+            const auto hotp = token.type() == OTPToken::HOTP;
+            writer.StartObject();
+            writer.Key("algo");
+            writeString(writer, token.algorithmName());
+            writer.Key("counter");
+            writer.Uint64(hotp ? token.counter() : 0U);
+            writer.Key("digits");
+            writer.Uint(token.digitLength());
+            writer.Key("issuerExt");
+            writeString(writer, token.issuer());
+            writer.Key("label");
+            writeString(writer, token.label());
+            writer.Key("period");
+            writer.Uint(hotp ? 30U : token.period());
+            writer.Key("secret");
+            writer.StartArray();
+            for (auto&& byte : secret)
+            {
+                writer.Int(static_cast<signed char>(byte));
+            }
+            writer.EndArray();
+            writer.Key("type");
+            writer.String(hotp ? "HOTP" : "TOTP");
+            writer.EndObject();
+            order.emplace_back(orderName(token));
+        });
+        writer.EndArray();
+        writer.Key("tokenOrder");
+        writer.StartArray();
+        for (auto&& name : order)
+        {
+            writeString(writer, name);
+        }
+        writer.EndArray();
+        writer.EndObject();
+
+        return res && Internal::writeFile(target, out);
+    } catch (...) {
+        return false;
+    }
+}
+
+}
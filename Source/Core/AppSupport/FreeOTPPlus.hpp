@@ -0,0 +1,36 @@
+#ifndef FREEOTPPLUS_HPP
+#define FREEOTPPLUS_HPP
+
+#include <OTPToken.hpp>
+
+#include "FileFormat.hpp"
+#include "ImportSink.hpp"
+
+#include <string_view>
+#include <vector>
+
+namespace AppSupport {
+
+/**
+ * FreeOTP+ JSON exports
+ *
+ * The exports are never encrypted, secrets are stored as arrays of signed
+ * bytes. FreeOTP+ has no Steam tokens, they are left out of exports.
+ *
+ */
+class FreeOTPPlus
+{
+    FreeOTPPlus() = delete;
+
+public:
+    static bool importTokens(const std::string &file, ImportSink &sink);
+    static bool exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens);
+
+    static bool detect(std::string_view contents);
+    static bool read(std::string_view contents, ImportSink &sink);
+    static bool write(const std::string &target, const FileFormat::TokenSource &source);
+};
+
+}
+
+#endif // FREEOTPPLUS_HPP
@@ -0,0 +1,344 @@
+#include "GoogleAuthenticator.hpp"
+
+#include <TokenDatabase.hpp>
+#include <Codec.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+// Google Authenticator migration payload
+//
+// message MigrationPayload {
+//     repeated OtpParameters otp_parameters = 1;
+//     int32 version = 2;
+//     int32 batch_size = 3;
+//     int32 batch_index = 4;
+//     int32 batch_id = 5;
+// }
+//
+// message OtpParameters {
+//     bytes secret = 1;            <-- raw key bytes
+//     string name = 2;
+//     string issuer = 3;
+//     Algorithm algorithm = 4;     <-- 0 unspecified, 1 SHA1, 2 SHA256, 3 SHA512, 4 MD5
+//     DigitCount digits = 5;       <-- 0 unspecified, 1 six, 2 eight
+//     OtpType type = 6;            <-- 0 unspecified, 1 HOTP, 2 TOTP
+//     int64 counter = 7;
+// }
+//
+
+namespace {
+    // protobuf wire format reader, length delimited fields are views into the input
+    class WireReader
+    {
+    public:
+        enum WireType {
+            Varint = 0,
+            Fixed64 = 1,
+            LengthDelimited = 2,
+            Fixed32 = 5,
+        };
+
+        explicit WireReader(std::string_view data)
+            : _data(data)
+        {
+        }
+
+        inline bool atEnd() const
+        { return _pos == _data.size(); }
+
+        bool readVarint(std::uint64_t &value)
+        {
+            value = 0U;
+            for (auto shift = 0U; shift < 64U; shift += 7U)
+            {
+                if (_pos == _data.size())
+                {
+                    return false;
+                }
+                const auto byte = static_cast<unsigned char>(_data[_pos++]);
+                value |= static_cast<std::uint64_t>(byte & 0x7FU) << shift;
+                if (!(byte & 0x80U))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool readTag(std::uint32_t &field, WireType &type)
+        {
+            std::uint64_t tag = 0U;
+            if (!readVarint(tag) || (tag >> 3) == 0U)
+            {
+                return false;
+            }
+            field = static_cast<std::uint32_t>(tag >> 3);
+            type = static_cast<WireType>(tag & 0x07U);
+            return true;
+        }
+
+        bool readBytes(std::string_view &value)
+        {
+            std::uint64_t length = 0U;
+            if (!readVarint(length) || length > _data.size() - _pos)
+            {
+                return false;
+            }
+            value = _data.substr(_pos, static_cast<std::size_t>(length));
+            _pos += static_cast<std::size_t>(length);
+            return true;
+        }
+
+        // skips the value of a field which isn't used
+        bool skip(const WireType &type)
+        {
+            std::uint64_t varint = 0U;
+            std::string_view bytes;
+            switch (type)
+            {
+                case Varint:
+                    return readVarint(varint);
+                case LengthDelimited:
+                    return readBytes(bytes);
+                case Fixed64:
+                    return advance(8U);
+                case Fixed32:
+                    return advance(4U);
+            }
+            return false;
+        }
+
+    private:
+        bool advance(std::size_t size)
+        {
+            if (size > _data.size() - _pos)
+            {
+                return false;
+            }
+            _pos += size;
+            return true;
+        }
+
+        std::string_view _data;
+        std::size_t _pos = 0U;
+    };
+
+    static int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // percent decoded value of the data parameter, URL-safe base-64 is mapped to the standard alphabet
+    static bool extractData(std::string_view uri, std::string &base64)
+    {
+        const auto query = uri.find('?');
+        if (query == std::string_view::npos)
+        {
+            return false;
+        }
+
+        auto params = uri.substr(query + 1U);
+        while (!params.empty())
+        {
+            const auto end = params.find('&');
+            const auto param = params.substr(0, end);
+            params = end == std::string_view::npos ? std::string_view() : params.substr(end + 1U);
+            if (param.substr(0, 5U) != "data=")
+            {
+                continue;
+            }
+
+            const auto value = param.substr(5U);
+            base64.clear();
+            base64.reserve(value.size());
+            for (auto i = 0U; i < value.size(); ++i)
+            {
+                auto c = value[i];
+                if (c == '%' && i + 2U < value.size() && hexValue(value[i + 1U]) >= 0 && hexValue(value[i + 2U]) >= 0)
+                {
+                    c = static_cast<char>(hexValue(value[i + 1U]) * 16 + hexValue(value[i + 2U]));
+                    i += 2U;
+                }
+                else if (c == '-')
+                {
+                    c = '+';
+                }
+                else if (c == '_')
+                {
+                    c = '/';
+                }
+                base64.push_back(c);
+            }
+            return !base64.empty();
+        }
+
+        return false;
+    }
+
+    static bool parseParameters(std::string_view message, AppSupport::ImportSink &sink)
+    {
+        WireReader reader(message);
+
+        std::string_view secret, name, issuer;
+        std::uint64_t algorithm = 0U, digits = 0U, type = 0U, counter = 0U;
+        while (!reader.atEnd())
+        {
+            std::uint32_t field = 0U;
+            WireReader::WireType wire;
+            if (!reader.readTag(field, wire))
+            {
+                return false;
+            }
+
+            auto res = false;
+            if (field >= 1U && field <= 3U && wire == WireReader::LengthDelimited)
+            {
+                res = reader.readBytes(field == 1U ? secret : field == 2U ? name : issuer);
+            }
+            else if (field >= 4U && field <= 7U && wire == WireReader::Varint)
+            {
+                res = reader.readVarint(field == 4U ? algorithm : field == 5U ? digits : field == 6U ? type : counter);
+            }
+            else
+            {
+                res = reader.skip(wire);
+            }
+            if (!res)
+            {
+                return false;
+            }
+        }
+
+        // unsupported accounts are skipped, the rest of the payload is still valid
+        const OTPToken::ShaAlgorithm algorithms[] = {OTPToken::SHA1, OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512};
+        if (secret.empty() || algorithm > 3U || digits > 2U || type > 2U)
+        {
+            return true;
+        }
+
+        // the raw key bytes are encoded into the base-32 form of the token secret directly
+        OTPToken token(type == 1U ? OTPToken::HOTP : OTPToken::TOTP);
+        SecureString encoded(Codec::base32EncodedSize(secret.size()), '\0');
+        encoded.resize(Codec::base32Encode(reinterpret_cast<const unsigned char*>(secret.data()), secret.size(), &encoded[0]));
+        token.setSecret(encoded);
+
+        // the name usually contains the issuer already
+        if (issuer.empty() || name.substr(0, issuer.size()) == issuer)
+        {
+            token.setLabel(std::string(name));
+        }
+        else
+        {
+            token.setLabel(std::string(issuer) + ":" + std::string(name));
+        }
+
+        token.setAlgorithm(algorithms[algorithm]);
+        token.setDigitLength(digits == 2U ? 8U : 6U);
+        if (type == 1U)
+        {
+            token.setCounter(static_cast<OTPToken::CounterType>(std::min<std::uint64_t>(counter, UINT32_MAX)));
+        }
+
+        sink.add(std::move(token));
+        return true;
+    }
+}
+
+namespace AppSupport {
+
+const std::string_view GoogleAuthenticator::MIGRATION_PREFIX = "otpauth-migration://";
+
+bool GoogleAuthenticator::importMigration(std::string_view uri, ImportSink &sink)
+{
+    if (uri.substr(0, MIGRATION_PREFIX.size()) != MIGRATION_PREFIX)
+    {
+        return false;
+    }
+
+    std::string base64;
+    if (!extractData(uri, base64))
+    {
+        return false;
+    }
+
+    SecureString payload(Codec::base64DecodedSize(base64.size()), '\0');
+    payload.resize(Codec::base64Decode(base64.data(), base64.size(), reinterpret_cast<unsigned char*>(&payload[0])));
+    SecureMemory::wipe(&base64[0], base64.size());
+
+    const auto res = parsePayload(payload, sink);
+    if (!res)
+    {
+        sink.abort();
+    }
+    return res;
+}
+
+bool GoogleAuthenticator::importMigration(std::string_view uri, std::vector<OTPToken> &target)
+{
+    VectorSink sink(target);
+    return importMigration(uri, sink);
+}
+
+bool GoogleAuthenticator::importIntoDatabase(const std::vector<std::string> &uris, std::size_t *inserted)
+{
+    std::vector<TokenDatabase::Error> results;
+    const auto status = TokenDatabase::insertTokens([&](const TokenDatabase::TokenCallback &insert) {
+        CallbackSink sink([&](OTPToken &&token) {
+            insert(token);
+        });
+        for (auto&& uri : uris)
+        {
+            if (!importMigration(uri, sink))
+            {
+                return TokenDatabase::InvalidTokenFile;
+            }
+        }
+        return TokenDatabase::Success;
+    }, &results);
+
+    if (inserted)
+    {
+        *inserted = static_cast<std::size_t>(std::count(results.begin(), results.end(), TokenDatabase::Success));
+    }
+    return status == TokenDatabase::Success;
+}
+
+bool GoogleAuthenticator::parsePayload(std::string_view payload, ImportSink &sink)
+{
+    if (payload.empty())
+    {
+        return false;
+    }
+
+    WireReader reader(payload);
+    while (!reader.atEnd())
+    {
+        std::uint32_t field = 0U;
+        WireReader::WireType wire;
+        if (!reader.readTag(field, wire))
+        {
+            return false;
+        }
+
+        if (field == 1U && wire == WireReader::LengthDelimited)
+        {
+            std::string_view parameters;
+            if (!reader.readBytes(parameters) || !parseParameters(parameters, sink))
+            {
+                return false;
+            }
+        }
+        else if (!reader.skip(wire))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
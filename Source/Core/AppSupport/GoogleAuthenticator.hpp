@@ -0,0 +1,36 @@
+#ifndef GOOGLEAUTHENTICATOR_HPP
+#define GOOGLEAUTHENTICATOR_HPP
+
+#include <OTPToken.hpp>
+
+#include "ImportSink.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace AppSupport {
+
+class GoogleAuthenticator
+{
+    GoogleAuthenticator() = delete;
+
+public:
+    // otpauth-migration://offline?data=... from the QR codes of the account export,
+    // the data parameter is a base-64 encoded protobuf MigrationPayload
+    static bool importMigration(std::string_view uri, ImportSink &sink);
+    static bool importMigration(std::string_view uri, std::vector<OTPToken> &target);
+
+    // all QR codes of an export into the open token database in a single transaction,
+    // nothing is inserted unless every URI is valid
+    static bool importIntoDatabase(const std::vector<std::string> &uris, std::size_t *inserted = nullptr);
+
+    // the decoded MigrationPayload, unsupported accounts (MD5, unknown types) are skipped
+    static bool parsePayload(std::string_view payload, ImportSink &sink);
+
+    static const std::string_view MIGRATION_PREFIX;
+};
+
+}
+
+#endif // GOOGLEAUTHENTICATOR_HPP
@@ -0,0 +1,190 @@
+#include "IconTranscoder.hpp"
+
+#include <Executor.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+
+#include <zlib.h>
+
+namespace {
+    static std::mutex raster_mutex;
+    static AppSupport::IconTranscoder::RasterEncoder raster_encoder;
+
+    // the svg element is expected after the XML declaration, a doctype or comments
+    static const constexpr std::size_t SVG_PROBE_SIZE = 4096U;
+
+    static bool startsWith(const OTPToken::Icon &icon, std::string_view signature, std::size_t offset = 0U)
+    {
+        return icon.size() >= offset + signature.size() &&
+               std::memcmp(icon.data() + offset, signature.data(), signature.size()) == 0;
+    }
+
+    static bool isSvg(const OTPToken::Icon &icon)
+    {
+        std::string_view text(reinterpret_cast<const char*>(icon.data()), std::min(icon.size(), SVG_PROBE_SIZE));
+        if (text.substr(0, 3) == "\xEF\xBB\xBF")
+        {
+            text.remove_prefix(3);
+        }
+        const auto start = text.find_first_not_of(" \t\r\n");
+        return start != std::string_view::npos && text[start] == '<' && text.find("<svg", start) != std::string_view::npos;
+    }
+
+    // the smaller form of the icon, false if there is none
+    static bool normalize(const OTPToken::Icon &icon, const AppSupport::IconTranscoder::RasterEncoder &encoder, OTPToken::Icon &out)
+    {
+        out.clear();
+        switch (AppSupport::IconTranscoder::detect(icon))
+        {
+            case AppSupport::IconTranscoder::Svg:
+                if (!AppSupport::IconTranscoder::compressSvg(icon, out))
+                {
+                    return false;
+                }
+                break;
+            case AppSupport::IconTranscoder::Png:
+            case AppSupport::IconTranscoder::Jpeg:
+            case AppSupport::IconTranscoder::Gif:
+            case AppSupport::IconTranscoder::WebP:
+                if (!encoder || !encoder(icon, AppSupport::IconTranscoder::MAX_SIZE, out))
+                {
+                    return false;
+                }
+                break;
+            default:
+                // compressed vectors and unknown formats are kept
+                return false;
+        }
+        return !out.empty() && out.size() < icon.size();
+    }
+}
+
+namespace AppSupport {
+
+void IconTranscoder::setRasterEncoder(const RasterEncoder &encoder)
+{
+    std::lock_guard<std::mutex> lock(raster_mutex);
+    raster_encoder = encoder;
+}
+
+IconTranscoder::Kind IconTranscoder::detect(const OTPToken::Icon &icon)
+{
+    if (startsWith(icon, "\x89PNG\r\n\x1A\n"))
+    {
+        return Png;
+    }
+    if (startsWith(icon, "\xFF\xD8\xFF"))
+    {
+        return Jpeg;
+    }
+    if (startsWith(icon, "GIF8"))
+    {
+        return Gif;
+    }
+    if (startsWith(icon, "RIFF") && startsWith(icon, "WEBP", 8U))
+    {
+        return WebP;
+    }
+    // icons in gzip are compressed SVGs, other compressed images aren't supported by the frontends
+    if (startsWith(icon, "\x1F\x8B"))
+    {
+        return Svgz;
+    }
+    return isSvg(icon) ? Svg : Unknown;
+}
+
+bool IconTranscoder::compressSvg(const OTPToken::Icon &svg, OTPToken::Icon &out)
+{
+    out.clear();
+    z_stream stream{};
+    // 15 window bits + 16 for the gzip wrapper, which the SVG readers of the frontends expect
+    if (svg.empty() || deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return false;
+    }
+
+    out.resize(deflateBound(&stream, static_cast<uLong>(svg.size())));
+    stream.next_in = const_cast<Bytef*>(svg.data());
+    stream.avail_in = static_cast<uInt>(svg.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    const auto status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    if (status != Z_STREAM_END)
+    {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+bool IconTranscoder::transcode(OTPToken::Icon &icon)
+{
+    RasterEncoder encoder;
+    {
+        std::lock_guard<std::mutex> lock(raster_mutex);
+        encoder = raster_encoder;
+    }
+
+    OTPToken::Icon out;
+    if (!normalize(icon, encoder, out))
+    {
+        return false;
+    }
+    icon = std::move(out);
+    return true;
+}
+
+std::size_t IconTranscoder::transcode(std::vector<OTPToken> &tokens, Executor *executor)
+{
+    std::vector<std::size_t> indices;
+    for (auto i = 0U; i < tokens.size(); ++i)
+    {
+        if (!tokens[i].icon().empty())
+        {
+            indices.emplace_back(i);
+        }
+    }
+    if (indices.empty())
+    {
+        return 0U;
+    }
+
+    RasterEncoder encoder;
+    {
+        std::lock_guard<std::mutex> lock(raster_mutex);
+        encoder = raster_encoder;
+    }
+
+    // every token is touched by one task only
+    std::atomic<std::size_t> replaced{0U};
+    const Executor::Task task = [&](std::size_t begin, std::size_t end) {
+        OTPToken::Icon out;
+        for (auto i = begin; i < end; ++i)
+        {
+            auto &token = tokens[indices[i]];
+            if (normalize(token.icon(), encoder, out))
+            {
+                token.setIcon(std::move(out));
+                replaced.fetch_add(1U, std::memory_order_relaxed);
+            }
+        }
+    };
+    if (executor && indices.size() > 1U)
+    {
+        executor->parallelFor(indices.size(), 1U, task);
+    }
+    else
+    {
+        task(0U, indices.size());
+    }
+    return replaced.load();
+}
+
+}
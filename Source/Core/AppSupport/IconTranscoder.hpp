@@ -0,0 +1,70 @@
+#ifndef ICONTRANSCODER_HPP
+#define ICONTRANSCODER_HPP
+
+#include <OTPToken.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+class Executor;
+
+namespace AppSupport {
+
+/**
+ * Normalization of imported icons
+ *
+ * Backups carry the icons the apps were given, often large PNGs or plain
+ * SVGs. Every icon is stored in the database, encrypted and written with
+ * every save, so the import pipeline brings them into a compact form
+ * before they are inserted:
+ *
+ *  -> SVG: compressed with gzip (SVGZ), the image itself is unchanged
+ *  -> raster images: scaled down to fit MAX_SIZE pixels and encoded again
+ *     by the raster encoder, which needs an image library and is set by
+ *     the frontend (the GUI uses Qt, see IconCache::normalize)
+ *
+ * The normalized icon replaces the original only when it is smaller.
+ * Icons which can't be decoded are kept as they are.
+ *
+ */
+class IconTranscoder final
+{
+    IconTranscoder() = delete;
+
+public:
+    enum Kind {
+        Unknown,
+        Png,
+        Jpeg,
+        Gif,
+        WebP,
+        Svg,
+        Svgz,
+    };
+
+    // largest width and height of raster icons, twice the largest thumbnail
+    static const constexpr unsigned MAX_SIZE = 192U;
+
+    // decodes the icon, scales it to fit the size and encodes it compactly, false if it can't be decoded
+    using RasterEncoder = std::function<bool(const OTPToken::Icon &icon, unsigned maxSize, OTPToken::Icon &out)>;
+
+    // the encoder is used by all imports, nullptr disables the raster step
+    static void setRasterEncoder(const RasterEncoder &encoder);
+
+    // the format by its signature
+    static Kind detect(const OTPToken::Icon &icon);
+
+    // gzip of a plain SVG
+    static bool compressSvg(const OTPToken::Icon &svg, OTPToken::Icon &out);
+
+    // the normalized icon if it is smaller, returns true if the icon was replaced
+    static bool transcode(OTPToken::Icon &icon);
+
+    // the icons of all tokens, concurrently on the executor, returns the amount of replaced icons
+    static std::size_t transcode(std::vector<OTPToken> &tokens, Executor *executor = nullptr);
+};
+
+}
+
+#endif // ICONTRANSCODER_HPP
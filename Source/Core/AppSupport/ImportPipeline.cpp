@@ -0,0 +1,405 @@
+#include "ImportPipeline.hpp"
+
+#include "andOTP.hpp"
+#include "Authy.hpp"
+#include "FileFormat.hpp"
+#include "IconTranscoder.hpp"
+#include "KeyCache.hpp"
+#include "GoogleAuthenticator.hpp"
+#include "Steam.hpp"
+
+#include <Executor.hpp>
+#include <TokenDatabase.hpp>
+#include <otpauthURI.hpp>
+#include "../Internal/MappedFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <unordered_set>
+
+namespace {
+    // label and secret of a token, the views point into the imported tokens
+    struct TokenKey
+    {
+        std::string_view label;
+        std::string_view secret;
+
+        inline bool operator== (const TokenKey &other) const
+        { return label == other.label && secret == other.secret; }
+    };
+
+    struct TokenKeyHash
+    {
+        inline std::size_t operator() (const TokenKey &key) const
+        {
+            const auto hash = std::hash<std::string_view>();
+            return hash(key.label) ^ (hash(key.secret) * 31U);
+        }
+    };
+
+    static bool startsWith(std::string_view contents, std::string_view prefix)
+    {
+        return contents.size() >= prefix.size() && contents.substr(0, prefix.size()) == prefix;
+    }
+
+    static bool contains(std::string_view contents, std::string_view text)
+    {
+        return contents.find(text) != std::string_view::npos;
+    }
+
+    // the first character which isn't whitespace or a byte order mark
+    static std::string_view skipWhitespace(std::string_view contents)
+    {
+        if (startsWith(contents, "\xEF\xBB\xBF"))
+        {
+            contents.remove_prefix(3U);
+        }
+        const auto pos = contents.find_first_not_of(" \t\r\n");
+        return pos == std::string_view::npos ? std::string_view() : contents.substr(pos);
+    }
+
+    static bool tokenFromURI(const std::string &text, OTPToken &token)
+    {
+        try {
+            otpauthURI uri(text);
+            if (!uri.valid())
+            {
+                return false;
+            }
+
+            token = OTPToken(uri.type() == otpauthURI::HOTP ? OTPToken::HOTP : OTPToken::TOTP);
+            token.setLabel(uri.label());
+            const auto prefix = uri.label().find(':');
+            token.setIssuer(!uri.issuer().empty() || prefix == std::string::npos ? uri.issuer() : uri.label().substr(0, prefix));
+            token.setSecret(uri.secret());
+            token.setAlgorithm(uri.algorithm());
+            token.setDigitLength(static_cast<OTPToken::DigitType>(uri.digitsNumber()));
+            if (uri.type() == otpauthURI::HOTP)
+            {
+                token.setCounter(uri.counterNumber());
+            }
+            else if (!uri.period().empty())
+            {
+                token.setPeriod(uri.periodNumber());
+            }
+        } catch (...) {
+            // malformed numbers
+            return false;
+        }
+        return true;
+    }
+}
+
+namespace AppSupport {
+
+ImportPipeline::ImportPipeline(Executor *executor)
+    : _executor(executor), _keys(std::make_shared<KeyCache>())
+{
+}
+
+void ImportPipeline::addFile(const std::string &file, const Format &format)
+{
+    Result result;
+    result.file = file;
+    result.format = format;
+    this->_results.emplace_back(std::move(result));
+    this->_inputs.emplace_back();
+}
+
+void ImportPipeline::addFile(const std::string &file, const std::shared_ptr<const FileFormat> &format)
+{
+    this->addFile(file, format ? Registered : Unknown);
+    this->_results.back().registered = format;
+}
+
+void ImportPipeline::addURIs(const std::string &name, std::string uris)
+{
+    Result result;
+    result.file = name;
+    result.format = OtpauthURIs;
+    this->_results.emplace_back(std::move(result));
+
+    Input input;
+    input.memory = true;
+    input.contents = std::move(uris);
+    this->_inputs.emplace_back(std::move(input));
+}
+
+ImportPipeline::Format ImportPipeline::detectFormat(const std::string &file)
+{
+    std::error_code error;
+    if (std::filesystem::is_directory(file, error))
+    {
+        return SteamMaFiles;
+    }
+
+    Internal::MappedFile in;
+    if (!in.open(file))
+    {
+        return Unknown;
+    }
+    return detectFormat(in.view());
+}
+
+ImportPipeline::Format ImportPipeline::detectFormat(std::string_view contents, bool registered)
+{
+    // image signatures, PNG, JPEG, GIF and BMP
+    if (startsWith(contents, "\x89PNG") || startsWith(contents, "\xFF\xD8\xFF") ||
+        startsWith(contents, "GIF8") || startsWith(contents, "BM"))
+    {
+        return QRCodeImage;
+    }
+
+    const auto text = skipWhitespace(contents);
+    if (startsWith(text, "otpauth://") || startsWith(text, GoogleAuthenticator::MIGRATION_PREFIX))
+    {
+        return OtpauthURIs;
+    }
+
+    // Android shared preferences of Authy
+    if (startsWith(text, "<"))
+    {
+        if (contains(text, "com.authy.storage.tokens.authenticator.key"))
+        {
+            return AuthyTOTPXML;
+        }
+        if (contains(text, "com.authy.storage.tokens.authy.key"))
+        {
+            return AuthyNativeXML;
+        }
+    }
+
+    if (startsWith(text, "["))
+    {
+        if (contains(text, "\"decryptedSecret\""))
+        {
+            return AuthyTOTPJSON;
+        }
+        if (contains(text, "\"secretSeed\""))
+        {
+            return AuthyNativeJSON;
+        }
+        // empty backups are valid too
+        if (contains(text, "\"secret\"") || skipWhitespace(text.substr(1U)).substr(0, 1) == "]")
+        {
+            return andOTPPlainText;
+        }
+    }
+
+    if (registered && FormatRegistry::detect(contents, false))
+    {
+        return Registered;
+    }
+
+    if (startsWith(text, "{") && contains(text, "\"shared_secret\""))
+    {
+        return SteamGuard;
+    }
+    if (startsWith(text, "{") && contains(text, "\"entries\"") && contains(text, "\"encrypted\""))
+    {
+        return SteamMaFiles;
+    }
+
+    // encrypted andOTP backups of both kinds are random bytes after the PBKDF2 header, which may
+    // start like a text file by chance
+    return contents.size() > 12U + 16U ? andOTPEncrypted : Unknown;
+}
+
+bool ImportPipeline::run(std::size_t *inserted)
+{
+    if (inserted)
+    {
+        *inserted = 0U;
+    }
+
+    // decrypt, parse and decode every file on its own
+    std::vector<std::vector<OTPToken>> tokens(this->_results.size());
+    const Executor::Task task = [&](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; ++i)
+        {
+            auto &result = this->_results[i];
+            result.success = this->importFile(result, this->_inputs[i], tokens[i]);
+            result.tokens = result.success ? tokens[i].size() : 0U;
+            result.inserted = 0U;
+            result.duplicates = 0U;
+        }
+    };
+    if (this->_executor && this->_results.size() > 1U)
+    {
+        this->_executor->parallelFor(this->_results.size(), 1U, task);
+    }
+    else
+    {
+        task(0U, this->_results.size());
+    }
+
+    // icons of all files are normalized on the executor before they are encrypted and stored
+    if (this->_transcodeIcons)
+    {
+        for (auto&& file : tokens)
+        {
+            (void) IconTranscoder::transcode(file, this->_executor);
+        }
+    }
+
+    // the first occurrence in file order wins
+    std::unordered_set<TokenKey, TokenKeyHash> seen;
+    std::vector<std::pair<std::size_t, const OTPToken*>> unique;
+    for (auto i = 0U; i < tokens.size(); ++i)
+    {
+        for (auto&& token : tokens[i])
+        {
+            if (seen.insert({token.label(), token.secret()}).second)
+            {
+                unique.emplace_back(i, &token);
+            }
+            else
+            {
+                ++this->_results[i].duplicates;
+            }
+        }
+    }
+
+    if (unique.empty())
+    {
+        return true;
+    }
+
+    std::vector<TokenDatabase::Error> errors;
+    const auto status = TokenDatabase::insertTokens([&](const TokenDatabase::TokenCallback &insert) {
+        for (auto&& entry : unique)
+        {
+            insert(*entry.second);
+        }
+        return TokenDatabase::Success;
+    }, &errors, this->_skipDuplicateSecrets ? TokenDatabase::SkipDuplicates : TokenDatabase::KeepDuplicates);
+    if (status != TokenDatabase::Success)
+    {
+        return false;
+    }
+
+    // tokens which are already in the database count as duplicates
+    for (auto i = 0U; i < unique.size() && i < errors.size(); ++i)
+    {
+        auto &result = this->_results[unique[i].first];
+        if (errors[i] == TokenDatabase::Success)
+        {
+            ++result.inserted;
+        }
+        else if (errors[i] == TokenDatabase::SqlConstraintViolation || errors[i] == TokenDatabase::DuplicateSecret)
+        {
+            ++result.duplicates;
+        }
+    }
+
+    if (inserted)
+    {
+        *inserted = static_cast<std::size_t>(std::count(errors.begin(), errors.end(), TokenDatabase::Success));
+    }
+    return true;
+}
+
+bool ImportPipeline::importFile(Result &result, const Input &input, std::vector<OTPToken> &tokens) const
+{
+    if (result.format == Unknown)
+    {
+        result.format = detectFormat(result.file);
+    }
+
+    VectorSink sink(tokens);
+    switch (result.format)
+    {
+        case andOTPPlainText:
+            return andOTP::importTokens(result.file, sink, andOTP::PlainText);
+        case andOTPEncrypted:
+            return andOTP::importEncrypted(result.file, sink, this->_password, this->_keys.get());
+        case AuthyTOTPXML:
+            return Authy::importTOTP(result.file, sink, Authy::XML);
+        case AuthyTOTPJSON:
+            return Authy::importTOTP(result.file, sink, Authy::JSON);
+        case AuthyNativeXML:
+            return Authy::importNative(result.file, sink, Authy::XML);
+        case AuthyNativeJSON:
+            return Authy::importNative(result.file, sink, Authy::JSON);
+        case SteamGuard:
+            return Steam::importFromSteamGuard(result.file, sink);
+        case SteamMaFiles:
+            return Steam::importFromMaFiles(result.file, sink, this->_password, this->_executor);
+
+        case OtpauthURIs: {
+            if (input.memory)
+            {
+                return importURIs(input.contents, tokens);
+            }
+            Internal::MappedFile in;
+            return in.open(result.file) && importURIs(in.view(), tokens);
+        }
+
+        case Registered: {
+            FileFormat::Options options;
+            options.password = this->_password;
+            options.executor = this->_executor;
+            options.keys = this->_keys.get();
+            return FormatRegistry::importFile(result.file, sink, options, result.registered.get());
+        }
+
+        case QRCodeImage: {
+            std::string data;
+            if (!this->_decoder || !this->_decoder(result.file, data))
+            {
+                return false;
+            }
+            return importURIs(data, tokens);
+        }
+
+        case Unknown:
+            break;
+    }
+
+    return false;
+}
+
+bool ImportPipeline::importURIs(std::string_view text, std::vector<OTPToken> &tokens)
+{
+    const auto first = tokens.size();
+    while (!text.empty())
+    {
+        const auto end = text.find('\n');
+        auto line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1U);
+
+        while (!line.empty() && std::strchr(" \t\r", line.back()))
+        {
+            line.remove_suffix(1U);
+        }
+        line = skipWhitespace(line);
+        if (line.empty())
+        {
+            continue;
+        }
+
+        // Google Authenticator exports carry many accounts in one URI
+        if (startsWith(line, GoogleAuthenticator::MIGRATION_PREFIX))
+        {
+            if (!GoogleAuthenticator::importMigration(line, tokens))
+            {
+                tokens.erase(tokens.begin() + static_cast<std::ptrdiff_t>(first), tokens.end());
+                return false;
+            }
+            continue;
+        }
+
+        OTPToken token(OTPToken::TOTP);
+        if (!tokenFromURI(std::string(line), token))
+        {
+            tokens.erase(tokens.begin() + static_cast<std::ptrdiff_t>(first), tokens.end());
+            return false;
+        }
+        tokens.emplace_back(std::move(token));
+    }
+
+    return tokens.size() != first;
+}
+
+}
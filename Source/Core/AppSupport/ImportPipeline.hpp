@@ -0,0 +1,134 @@
+#ifndef IMPORTPIPELINE_HPP
+#define IMPORTPIPELINE_HPP
+
+#include <OTPToken.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Executor;
+
+namespace AppSupport {
+
+class FileFormat;
+class KeyCache;
+
+/**
+ * Imports many files of different apps at once
+ *
+ * The format of every file is detected from its contents unless it is
+ * given explicitly. All files are decrypted, parsed and decoded
+ * concurrently on the executor, the tokens are then deduplicated by label
+ * and secret in the order the files were added and committed to the open
+ * token database in a single transaction. Tokens whose secret is already in
+ * the database can be skipped as well, see setSkipDuplicateSecrets().
+ *
+ * Formats of the FormatRegistry (Aegis, FreeOTP+, 2FAS and the ones added
+ * by the application) are detected after the built-in formats. Keys
+ * derived from the password are cached for all runs of the pipeline, so
+ * several files of the same encrypted backup pay the key derivation once.
+ *
+ * QR code images are decoded by the image decoder, which must be set by
+ * applications built with QR code support (see QRCode::decode).
+ *
+ * Icons of the imported tokens are brought into a compact form on the
+ * executor before they are inserted, see IconTranscoder.
+ *
+ */
+class ImportPipeline
+{
+public:
+    enum Format {
+        Unknown,
+        andOTPPlainText,
+        andOTPEncrypted,
+        AuthyTOTPXML,
+        AuthyTOTPJSON,
+        AuthyNativeXML,
+        AuthyNativeJSON,
+        SteamGuard,
+        SteamMaFiles,       // maFiles folder of Steam Desktop Authenticator or its manifest.json
+        OtpauthURIs,        // text file with one otpauth:// or otpauth-migration:// URI per line
+        QRCodeImage,
+        Registered,         // a format of the FormatRegistry, see Result::registered
+    };
+
+    struct Result
+    {
+        std::string file;
+        Format format = Unknown;
+        bool success = false;
+        std::size_t tokens = 0U;        // parsed from the file
+        std::size_t inserted = 0U;      // committed to the database
+        std::size_t duplicates = 0U;    // also in an earlier file or twice in this one, or already in the database
+        std::shared_ptr<const FileFormat> registered;
+    };
+
+    // decodes the QR code in the image file into its text
+    using ImageDecoder = std::function<bool(const std::string &file, std::string &data)>;
+
+    explicit ImportPipeline(Executor *executor = nullptr);
+
+    // password of encrypted backups and the passkey of encrypted maFiles
+    inline void setPassword(const std::string &password)
+    { this->_password = password; }
+    // shares the derived keys with other pipelines
+    inline void setKeyCache(const std::shared_ptr<KeyCache> &keys)
+    { this->_keys = keys; }
+    inline void setImageDecoder(const ImageDecoder &decoder)
+    { this->_decoder = decoder; }
+    // tokens with the secret of a token in the database (under any label) aren't inserted,
+    // see TokenDatabase::SkipDuplicates
+    inline void setSkipDuplicateSecrets(bool skip)
+    { this->_skipDuplicateSecrets = skip; }
+    // icons are normalized by default, disabled they are stored as they are in the backup
+    inline void setTranscodeIcons(bool transcode)
+    { this->_transcodeIcons = transcode; }
+
+    void addFile(const std::string &file, const Format &format = Unknown);
+    void addFile(const std::string &file, const std::shared_ptr<const FileFormat> &format);
+    // URIs which are already in memory, for example decoded from QR codes (see QRCode::decodeBatch),
+    // name is reported as the file of the result
+    void addURIs(const std::string &name, std::string uris);
+    inline std::size_t fileCount() const
+    { return this->_results.size(); }
+
+    // detection from the file contents, Unknown if the file can't be read or isn't recognized,
+    // folders are always maFiles folders, registered formats are only looked up if enabled
+    static Format detectFormat(const std::string &file);
+    static Format detectFormat(std::string_view contents, bool registered = true);
+
+    // runs the pipeline, returns false if the database transaction failed,
+    // files which couldn't be imported are reported in the results
+    bool run(std::size_t *inserted = nullptr);
+    inline const std::vector<Result> &results() const
+    { return this->_results; }
+
+private:
+    // contents of inputs added from memory
+    struct Input
+    {
+        bool memory = false;
+        std::string contents;
+    };
+
+    bool importFile(Result &result, const Input &input, std::vector<OTPToken> &tokens) const;
+    static bool importURIs(std::string_view text, std::vector<OTPToken> &tokens);
+
+    Executor *_executor = nullptr;
+    std::string _password;
+    ImageDecoder _decoder;
+    std::shared_ptr<KeyCache> _keys;
+    bool _skipDuplicateSecrets = false;
+    bool _transcodeIcons = true;
+
+    std::vector<Result> _results;
+    std::vector<Input> _inputs;
+};
+
+}
+
+#endif // IMPORTPIPELINE_HPP
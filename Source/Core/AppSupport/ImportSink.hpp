@@ -0,0 +1,89 @@
+#ifndef IMPORTSINK_HPP
+#define IMPORTSINK_HPP
+
+#include <OTPToken.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace AppSupport {
+
+/**
+ * Destination of imported tokens
+ *
+ * Importers move every token into the sink as soon as it is parsed, no
+ * token is allocated or copied on its own. reserve() announces the amount
+ * of entries which follow if the importer knows it up front. When an
+ * import fails after tokens were added (like an encrypted backup which
+ * fails to authenticate at the end), the importer calls abort().
+ *
+ */
+class ImportSink
+{
+public:
+    virtual ~ImportSink() = default;
+
+    virtual void reserve(std::size_t count)
+    { (void) count; }
+
+    virtual void add(OTPToken &&token) = 0;
+
+    // discard the tokens added by the failed import
+    virtual void abort()
+    { }
+};
+
+// appends the tokens to a vector, abort() removes the tokens appended through this sink
+class VectorSink : public ImportSink
+{
+public:
+    explicit VectorSink(std::vector<OTPToken> &target)
+        : _target(target), _first(target.size())
+    {
+    }
+
+    void reserve(std::size_t count) override
+    { this->_target.reserve(this->_target.size() + count); }
+
+    void add(OTPToken &&token) override
+    { this->_target.emplace_back(std::move(token)); }
+
+    void abort() override
+    { this->_target.erase(this->_target.begin() + static_cast<std::ptrdiff_t>(this->_first), this->_target.end()); }
+
+private:
+    std::vector<OTPToken> &_target;
+    std::size_t _first;
+};
+
+// passes every token to a callback, abort() is forwarded to the optional abort callback
+class CallbackSink : public ImportSink
+{
+public:
+    using Callback = std::function<void(OTPToken &&token)>;
+    using AbortCallback = std::function<void()>;
+
+    explicit CallbackSink(const Callback &callback, const AbortCallback &abort = {})
+        : _callback(callback), _abort(abort)
+    {
+    }
+
+    void add(OTPToken &&token) override
+    { this->_callback(std::move(token)); }
+
+    void abort() override
+    {
+        if (this->_abort)
+        {
+            this->_abort();
+        }
+    }
+
+private:
+    Callback _callback;
+    AbortCallback _abort;
+};
+
+}
+
+#endif // IMPORTSINK_HPP
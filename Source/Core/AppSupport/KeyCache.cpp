@@ -0,0 +1,149 @@
+#include "KeyCache.hpp"
+
+#include <Executor.hpp>
+#include "../Internal/BackupFile.hpp"
+
+#include <cryptopp/pwdbased.h>
+#include <cryptopp/scrypt.h>
+#include <cryptopp/sha.h>
+
+namespace {
+    // the parameters and the salt are stored as they are, the password only as its hash
+    static SecureString cache_key(const AppSupport::KeyCache::Parameters &parameters,
+                                  const std::string &password, std::string_view salt)
+    {
+        const std::uint64_t numbers[] = {static_cast<std::uint64_t>(parameters.function), parameters.cost,
+                                         parameters.blockSize, parameters.parallelization, parameters.keySize};
+        SecureString key(reinterpret_cast<const char*>(numbers), sizeof(numbers));
+        key.append(salt.data(), salt.size());
+
+        CryptoPP::byte hash[CryptoPP::SHA256::DIGESTSIZE];
+        CryptoPP::SHA256().CalculateDigest(hash, reinterpret_cast<const CryptoPP::byte*>(password.data()), password.size());
+        key.append(reinterpret_cast<const char*>(hash), sizeof(hash));
+        SecureMemory::wipe(hash, sizeof(hash));
+        return key;
+    }
+}
+
+namespace AppSupport {
+
+const SecureString KeyCache::key(const Parameters &parameters, const std::string &password, std::string_view salt)
+{
+    const auto id = cache_key(parameters, password, salt);
+
+    std::promise<SecureString> promise;
+    std::shared_future<SecureString> future;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        const auto it = this->_keys.find(id);
+        if (it != this->_keys.end())
+        {
+            future = it->second;
+        }
+        else
+        {
+            this->_keys.emplace(id, promise.get_future().share());
+        }
+    }
+
+    // another thread derives it already or did so before
+    if (future.valid())
+    {
+        return future.get();
+    }
+
+    auto key = derive(parameters, password, salt);
+    promise.set_value(key);
+    return key;
+}
+
+const SecureString KeyCache::encryptionKey(const Parameters &parameters, const std::string &password,
+                                           std::size_t saltSize, std::string &salt)
+{
+    // the salt size is part of the parameters of the export
+    const auto id = cache_key(parameters, password, std::string_view(reinterpret_cast<const char*>(&saltSize), sizeof(saltSize)));
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        const auto it = this->_salts.find(id);
+        if (it != this->_salts.end())
+        {
+            salt = it->second;
+        }
+        else
+        {
+            salt = Internal::randomBytes(saltSize);
+            this->_salts.emplace(id, salt);
+        }
+    }
+    return this->key(parameters, password, salt);
+}
+
+const std::vector<SecureString> KeyCache::keys(const std::vector<Request> &requests, const std::string &password,
+                                               Executor *executor)
+{
+    std::vector<SecureString> keys(requests.size());
+    const Executor::Task task = [&](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; ++i)
+        {
+            keys[i] = this->key(requests[i].parameters, password, requests[i].salt);
+        }
+    };
+    if (executor && requests.size() > 1U)
+    {
+        executor->parallelFor(requests.size(), 1U, task);
+    }
+    else
+    {
+        task(0U, requests.size());
+    }
+    return keys;
+}
+
+const SecureString KeyCache::derive(const Parameters &parameters, const std::string &password, std::string_view salt)
+{
+    if (parameters.cost == 0U || parameters.keySize == 0U)
+    {
+        return {};
+    }
+
+    SecureString key(parameters.keySize, '\0');
+    const auto derived = reinterpret_cast<CryptoPP::byte*>(&key[0]);
+    const auto secret = reinterpret_cast<const CryptoPP::byte*>(password.data());
+    const auto bytes = reinterpret_cast<const CryptoPP::byte*>(salt.data());
+    try {
+        switch (parameters.function)
+        {
+            case Scrypt:
+                CryptoPP::Scrypt().DeriveKey(derived, key.size(), secret, password.size(), bytes, salt.size(),
+                                             parameters.cost, parameters.blockSize, parameters.parallelization);
+                break;
+            case PBKDF2_SHA1:
+                CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA1>().DeriveKey(derived, key.size(), 0, secret, password.size(),
+                    bytes, salt.size(), static_cast<unsigned int>(parameters.cost));
+                break;
+            case PBKDF2_SHA256:
+                CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256>().DeriveKey(derived, key.size(), 0, secret, password.size(),
+                    bytes, salt.size(), static_cast<unsigned int>(parameters.cost));
+                break;
+        }
+    } catch (...) {
+        // invalid scrypt parameters
+        return {};
+    }
+    return key;
+}
+
+std::size_t KeyCache::size() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_keys.size();
+}
+
+void KeyCache::clear()
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_keys.clear();
+    this->_salts.clear();
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef KEYCACHE_HPP
+#define KEYCACHE_HPP
+
+#include <SecureMemory.hpp>
+
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Executor;
+
+namespace AppSupport {
+
+/**
+ * Session cache of keys derived from backup passwords
+ *
+ * The importers and exporters of encrypted backups derive their keys
+ * through the cache, so a series of files of the same backup (equal
+ * password, salt and parameters) pays the key derivation once. Keys are
+ * looked up by a SHA-256 of the password together with the parameters and
+ * the salt, the password itself is never stored. Threads which ask for a
+ * key which is being derived wait for it instead of deriving it again.
+ *
+ * Writers of new files ask for an encryption key, which reuses the salt
+ * of an earlier file with the same password and parameters. The files of
+ * an export series then share the key and differ in their IVs only.
+ *
+ * Keys stay in secure memory until clear() is called or the cache is
+ * destroyed.
+ *
+ */
+class KeyCache
+{
+public:
+    enum Function {
+        Scrypt,         // cost is N
+        PBKDF2_SHA1,    // cost is the amount of iterations
+        PBKDF2_SHA256,
+    };
+
+    struct Parameters
+    {
+        Function function = PBKDF2_SHA256;
+        std::uint64_t cost = 0U;
+        std::uint32_t blockSize = 8U;       // scrypt only
+        std::uint32_t parallelization = 1U; // scrypt only
+        std::size_t keySize = 32U;
+    };
+
+    struct Request
+    {
+        Parameters parameters;
+        std::string salt;
+    };
+
+    KeyCache() = default;
+    KeyCache(const KeyCache&) = delete;
+    KeyCache &operator= (const KeyCache&) = delete;
+
+    // derives the key or returns the cached one, empty if the parameters are invalid
+    const SecureString key(const Parameters &parameters, const std::string &password, std::string_view salt);
+
+    // key of a new file, the salt is random unless a file with the same password and
+    // parameters was written before, every file must use a new IV
+    const SecureString encryptionKey(const Parameters &parameters, const std::string &password,
+                                     std::size_t saltSize, std::string &salt);
+
+    // derives the keys of all requests on the executor, in the order of the requests
+    const std::vector<SecureString> keys(const std::vector<Request> &requests, const std::string &password,
+                                         Executor *executor = nullptr);
+
+    // derivation without the cache
+    static const SecureString derive(const Parameters &parameters, const std::string &password, std::string_view salt);
+
+    std::size_t size() const;
+    void clear();
+
+private:
+    mutable std::mutex _mutex;
+    std::map<SecureString, std::shared_future<SecureString>> _keys;
+    std::map<SecureString, std::string> _salts;
+};
+
+}
+
+#endif // KEYCACHE_HPP
@@ -1,11 +1,23 @@
 #include "Steam.hpp"
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
 
+#include <Codec.hpp>
+#include <Executor.hpp>
 #include <TokenDatabase.hpp>
+#include <PerfStats.hpp>
+#include <SecureMemory.hpp>
+#include "../Internal/JsonArena.hpp"
+#include "../Internal/MappedFile.hpp"
 
 #include <cereal/external/rapidjson/document.h>
-#include <cereal/external/rapidjson/memorystream.h>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/pwdbased.h>
+#include <cryptopp/sha.h>
 
 #include <otpauthURI.hpp>
 
@@ -26,29 +38,279 @@
 //     "steamguard_scheme": ""
 // }
 
+// Steam Desktop Authenticator manifest.json schema
+//
+// {
+//     "encrypted": false,
+//     "entries": [
+//         {
+//             "encryption_iv": "",     <-- base-64 encoded, null if not encrypted
+//             "encryption_salt": "",   <-- base-64 encoded, null if not encrypted
+//             "filename": "",          <-- maFile next to the manifest
+//             "steamid": 0
+//         }
+//     ],
+//     ...
+// }
+
+namespace {
+    static const char *const MANIFEST = "manifest.json";
+    static const char *const MAFILE_EXTENSION = ".maFile";
+
+    // key derivation and cipher of Steam Desktop Authenticator
+    static const constexpr unsigned int PBKDF2_ITERATIONS = 50000U;
+    static const constexpr std::size_t KEY_SIZE = 32U;
+
+    struct MaFile
+    {
+        std::string file;
+        std::string salt;   // decoded, empty if not encrypted
+        std::string iv;
+    };
+
+    static bool base64Decode(const rapidjson::Value &value, std::string &out)
+    {
+        if (!value.IsString())
+        {
+            return false;
+        }
+        out.resize(Codec::base64DecodedSize(value.GetStringLength()));
+        out.resize(Codec::base64Decode(value.GetString(), value.GetStringLength(),
+                                       reinterpret_cast<unsigned char*>(&out[0])));
+        return !out.empty();
+    }
+
+    // the base-64 encoded secret straight into a base-32 secret, without intermediate strings
+    static bool setBase64Secret(const rapidjson::Value &value, OTPToken &target)
+    {
+        if (!value.IsString() || value.GetStringLength() == 0U)
+        {
+            return false;
+        }
+        SecureBuffer bytes(Codec::base64DecodedSize(value.GetStringLength()));
+        bytes.resize(Codec::base64Decode(value.GetString(), value.GetStringLength(), bytes.data()));
+        if (bytes.empty())
+        {
+            return false;
+        }
+        SecureString secret(Codec::base32EncodedSize(bytes.size()), '\0');
+        secret.resize(Codec::base32Encode(bytes.data(), bytes.size(), &secret[0]));
+        target.setSecret(std::string_view(secret));
+        return true;
+    }
+
+    // encrypted maFiles are base-64 encoded AES-256-CBC with PKCS#7 padding
+    static bool decrypt(std::string_view contents, const MaFile &entry, const std::string &passkey, SecureString &out)
+    {
+        if (passkey.empty() || entry.iv.size() != CryptoPP::AES::BLOCKSIZE)
+        {
+            return false;
+        }
+
+        SecureBuffer ciphertext(Codec::base64DecodedSize(contents.size()));
+        ciphertext.resize(Codec::base64Decode(contents.data(), contents.size(), ciphertext.data()));
+        if (ciphertext.empty() || ciphertext.size() % CryptoPP::AES::BLOCKSIZE != 0U)
+        {
+            return false;
+        }
+
+        try {
+            SecureBuffer key(KEY_SIZE);
+            CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA1> kdf;
+            kdf.DeriveKey(key.data(), key.size(), 0, reinterpret_cast<const CryptoPP::byte*>(passkey.data()), passkey.size(),
+                          reinterpret_cast<const CryptoPP::byte*>(entry.salt.data()), entry.salt.size(), PBKDF2_ITERATIONS);
+
+            CryptoPP::CBC_Mode<CryptoPP::AES>::Decryption cipher(key.data(), key.size(),
+                reinterpret_cast<const CryptoPP::byte*>(entry.iv.data()));
+            out.resize(ciphertext.size());
+            cipher.ProcessData(reinterpret_cast<CryptoPP::byte*>(&out[0]), ciphertext.data(), ciphertext.size());
+        } catch (...) {
+            return false;
+        }
+
+        // a wrong passkey almost never ends with a valid padding
+        const auto padding = static_cast<unsigned char>(out.back());
+        if (padding == 0U || padding > CryptoPP::AES::BLOCKSIZE ||
+            std::any_of(out.end() - padding, out.end(), [&](char c) { return static_cast<unsigned char>(c) != padding; }))
+        {
+            return false;
+        }
+        out.resize(out.size() - padding);
+        return true;
+    }
+
+    static bool readManifest(const std::filesystem::path &file, std::vector<MaFile> &entries)
+    {
+        Internal::MappedFile in;
+        if (!in.open(file.string()))
+        {
+            return false;
+        }
+
+        try {
+            Internal::JsonArena arena;
+            auto json = arena.document();
+            json.Parse(in.data(), in.size());
+            if (!json.IsObject() || !json.HasMember("entries") || !json["entries"].IsArray())
+            {
+                return false;
+            }
+
+            const auto encrypted = json.HasMember("encrypted") && json["encrypted"].IsBool() && json["encrypted"].GetBool();
+            const auto folder = file.parent_path();
+            const auto array = json["entries"].GetArray();
+            entries.reserve(array.Size());
+            for (auto&& value : array)
+            {
+                if (!value.IsObject() || !value.HasMember("filename") || !value["filename"].IsString())
+                {
+                    return false;
+                }
+
+                MaFile entry;
+                entry.file = (folder / value["filename"].GetString()).string();
+                if (encrypted && !(value.HasMember("encryption_salt") && base64Decode(value["encryption_salt"], entry.salt) &&
+                                   value.HasMember("encryption_iv") && base64Decode(value["encryption_iv"], entry.iv)))
+                {
+                    return false;
+                }
+                entries.emplace_back(std::move(entry));
+            }
+        } catch (...) {
+            // catch all rapidjson exceptions
+            return false;
+        }
+
+        return true;
+    }
+
+    // folders without a manifest, the maFiles are never encrypted then
+    static bool listMaFiles(const std::filesystem::path &folder, std::vector<MaFile> &entries)
+    {
+        std::error_code error;
+        for (auto&& file : std::filesystem::directory_iterator(folder, error))
+        {
+            if (file.path().extension() == MAFILE_EXTENSION)
+            {
+                entries.push_back({file.path().string(), {}, {}});
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const MaFile &a, const MaFile &b) { return a.file < b.file; });
+        return !error;
+    }
+}
+
 namespace AppSupport {
 
 bool Steam::importFromSteamGuard(const std::string &file, OTPToken &target)
 {
-    // read file contents into memory
-    std::string out;
-    auto status = TokenDatabase::readFile(file, out);
-    if (status != TokenDatabase::Success)
+    return parse(file, target, false);
+}
+
+bool Steam::importFromSteamGuard(const std::string &file, ImportSink &sink)
+{
+    OTPToken token(OTPToken::Steam);
+    if (!parse(file, token, true))
     {
-        out.clear();
         return false;
     }
 
-    if (out.empty())
+    sink.reserve(1U);
+    sink.add(std::move(token));
+    return true;
+}
+
+bool Steam::importFromMaFiles(const std::string &path, ImportSink &sink, const std::string &passkey, Executor *executor)
+{
+    std::error_code error;
+    const std::filesystem::path location(path);
+    const auto folder = std::filesystem::is_directory(location, error);
+    const auto manifest = folder ? location / MANIFEST : location;
+
+    std::vector<MaFile> entries;
+    if (!folder || std::filesystem::exists(manifest, error))
+    {
+        if (!readManifest(manifest, entries))
+        {
+            return false;
+        }
+    }
+    else if (!listMaFiles(location, entries))
     {
         return false;
     }
 
+    // the key derivation dominates, every file has its own salt
+    std::vector<OTPToken> tokens(entries.size(), OTPToken(OTPToken::Steam));
+    std::vector<unsigned char> imported(entries.size(), 0U);
+    const Executor::Task task = [&](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; ++i)
+        {
+            Internal::MappedFile in;
+            if (TokenDatabase::readFile(entries[i].file, in) != TokenDatabase::Success)
+            {
+                continue;
+            }
+
+            if (entries[i].salt.empty())
+            {
+                imported[i] = parse(in.view(), tokens[i], true);
+                continue;
+            }
+            SecureString contents;
+            imported[i] = decrypt(in.view(), entries[i], passkey, contents) && parse(contents, tokens[i], true);
+        }
+    };
+    if (executor && entries.size() > 1U)
+    {
+        executor->parallelFor(entries.size(), 1U, task);
+    }
+    else
+    {
+        task(0U, entries.size());
+    }
+
+    if (std::find(imported.begin(), imported.end(), 0U) != imported.end())
+    {
+        return false;
+    }
+
+    sink.reserve(tokens.size());
+    for (auto&& token : tokens)
+    {
+        sink.add(std::move(token));
+    }
+    return true;
+}
+
+bool Steam::parse(const std::string &file, OTPToken &target, bool label)
+{
+    // map the file contents
+    Internal::MappedFile in;
+    auto status = TokenDatabase::readFile(file, in);
+    if (status != TokenDatabase::Success)
+    {
+        return false;
+    }
+
+    return parse(in.view(), target, label);
+}
+
+bool Steam::parse(std::string_view contents, OTPToken &target, bool label)
+{
+    // the copy is parsed in place, the secrets stay in secure memory
+    SecureString text(contents.data(), contents.size());
+    return parse(text, target, label);
+}
+
+bool Steam::parse(SecureString &contents, OTPToken &target, bool label)
+{
     // parse json
     try {
-        rapidjson::StringStream s(out.c_str());
-        rapidjson::Document json;
-        json.ParseStream(s);
+        Internal::JsonArena arena;
+        auto json = arena.document();
+        Internal::JsonArena::parseInsitu(json, contents);
+        OTPGEN_PERF_MEMORY(ImportDocuments, json.GetAllocator().Capacity());
 
         // root element must be an object
         if (!json.IsObject())
@@ -66,7 +328,7 @@ bool Steam::importFromSteamGuard(const std::string &file, OTPToken &target)
         }
 
         // try to import base-64 secret
-        if (!target.importBase64Secret(object["shared_secret"].GetString()))
+        if (!setBase64Secret(object["shared_secret"], target))
         {
             // if that fails parse the URI and use the base-32 secret directly
             if (object.HasMember("uri"))
@@ -84,6 +346,11 @@ bool Steam::importFromSteamGuard(const std::string &file, OTPToken &target)
                 return false;
             }
         }
+
+        if (label && object.HasMember("account_name") && object["account_name"].IsString())
+        {
+            target.setLabel(object["account_name"].GetString());
+        }
     } catch (...) {
         // catch all rapidjson exceptions
         return false;
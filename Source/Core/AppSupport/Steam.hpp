@@ -2,15 +2,46 @@
 #define STEAM_HPP
 
 #include <OTPToken.hpp>
+#include <SecureMemory.hpp>
+
+#include "ImportSink.hpp"
+
+#include <string_view>
+
+class Executor;
 
 namespace AppSupport {
 
+/**
+ * SteamGuard import
+ *
+ * A SteamGuard file (.maFile) holds a single account. Steam Desktop
+ * Authenticator keeps the maFiles of all accounts in a folder together with
+ * a manifest.json, which lists the files and, when the folder is encrypted,
+ * the salt and IV of every file (PBKDF2-SHA1 and AES-256-CBC of the
+ * passkey). Folders are decrypted and parsed in parallel on the executor.
+ *
+ */
 class Steam
 {
     Steam() = delete;
 
 public:
+    // stores the secret in the given token
     static bool importFromSteamGuard(const std::string &file, OTPToken &target);
+    // adds a Steam token labeled with the account name
+    static bool importFromSteamGuard(const std::string &file, ImportSink &sink);
+
+    // imports all accounts of a maFiles folder or its manifest.json in the order of the manifest,
+    // folders without a manifest are imported in file name order, nothing is added if a file fails
+    static bool importFromMaFiles(const std::string &path, ImportSink &sink,
+                                  const std::string &passkey = {}, Executor *executor = nullptr);
+
+private:
+    static bool parse(const std::string &file, OTPToken &target, bool label);
+    static bool parse(std::string_view contents, OTPToken &target, bool label);
+    // parses the contents in place
+    static bool parse(SecureString &contents, OTPToken &target, bool label);
 };
 
 }
@@ -0,0 +1,235 @@
+#include "TwoFAS.hpp"
+
+#include "KeyCache.hpp"
+
+#include <Codec.hpp>
+#include <TokenDatabase.hpp>
+#include "../Internal/BackupFile.hpp"
+#include "../Internal/JsonArena.hpp"
+#include "../Internal/JsonMembers.hpp"
+#include "../Internal/MappedFile.hpp"
+
+#include <cereal/external/rapidjson/document.h>
+#include <cereal/external/rapidjson/writer.h>
+
+// 2FAS backup schema (version 4)
+//
+// {
+//     "services": [
+//         {
+//             "name": "",                  <-- name of the service, the issuer
+//             "secret": "",                <-- base-32 encoded
+//             "otp": {
+//                 "account": "",
+//                 "issuer": "",
+//                 "digits": 6,
+//                 "period": 30,
+//                 "algorithm": "SHA1",
+//                 "counter": 0,
+//                 "tokenType": "TOTP"      <-- TOTP, HOTP or STEAM
+//             },
+//             "order": {"position": 0}
+//         }
+//     ],
+//     "servicesEncrypted": "",     <-- base-64 ciphertext with tag, salt and IV separated by ':'
+//     "groups": [],
+//     "schemaVersion": 4
+// }
+
+namespace {
+    static const constexpr std::size_t TAG_SIZE = 16U;
+    static const AppSupport::KeyCache::Parameters PBKDF2 = {AppSupport::KeyCache::PBKDF2_SHA256, 10000U, 0U, 0U, 32U};
+
+    template<typename Writer>
+    static void writeString(Writer &writer, std::string_view string)
+    {
+        writer.String(string.data(), static_cast<rapidjson::SizeType>(string.size()));
+    }
+
+    static bool parseServices(const rapidjson::Value &services, AppSupport::ImportSink &sink)
+    {
+        if (!services.IsArray())
+        {
+            return false;
+        }
+
+        sink.reserve(services.Size());
+        for (auto&& service : services.GetArray())
+        {
+            const auto secret = Internal::stringMember(service, "secret");
+            if (secret.empty())
+            {
+                return false;
+            }
+
+            static const rapidjson::Value none(rapidjson::kObjectType);
+            const auto otp = Internal::member(service, "otp");
+            const auto &params = otp ? *otp : none;
+
+            const auto type = Internal::stringMember(params, "tokenType", "TOTP");
+            OTPToken token(type == "HOTP" ? OTPToken::HOTP : type == "STEAM" ? OTPToken::Steam : OTPToken::TOTP);
+            const auto name = Internal::stringMember(service, "name");
+            token.setLabel(std::string(Internal::stringMember(params, "account", name)));
+            token.setIssuer(std::string(Internal::stringMember(params, "issuer", name)));
+            token.setSecret(secret);
+            if (token.type() != OTPToken::Steam)
+            {
+                token.setAlgorithm(std::string(Internal::stringMember(params, "algorithm", "SHA1")));
+                token.setDigitLength(static_cast<OTPToken::DigitType>(Internal::uintMember(params, "digits", 6U)));
+            }
+            if (token.type() == OTPToken::HOTP)
+            {
+                token.setCounter(static_cast<OTPToken::CounterType>(Internal::uintMember(params, "counter")));
+            }
+            else
+            {
+                token.setPeriod(static_cast<OTPToken::PeriodType>(Internal::uintMember(params, "period", 30U)));
+            }
+            sink.add(std::move(token));
+        }
+        return true;
+    }
+}
+
+namespace AppSupport {
+
+bool TwoFAS::importTokens(const std::string &file, ImportSink &sink, const std::string &password, KeyCache *keys)
+{
+    Internal::MappedFile in;
+    if (TokenDatabase::readFile(file, in) != TokenDatabase::Success)
+    {
+        return false;
+    }
+    if (!read(in.view(), sink, password, keys))
+    {
+        sink.abort();
+        return false;
+    }
+    return true;
+}
+
+bool TwoFAS::exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens)
+{
+    return write(target, [&](const FileFormat::TokenWriter &add) {
+        for (auto&& token : tokens)
+        {
+            add(*token);
+        }
+        return true;
+    });
+}
+
+bool TwoFAS::detect(std::string_view contents)
+{
+    return Internal::isJsonObjectWith(contents, {"services", "schemaVersion"});
+}
+
+bool TwoFAS::read(std::string_view contents, ImportSink &sink, const std::string &password, KeyCache *keys)
+{
+    try {
+        Internal::JsonArena arena;
+        auto json = arena.document();
+        json.Parse(contents.data(), contents.size());
+        const auto services = Internal::member(json, "services");
+        const auto encrypted = Internal::stringMember(json, "servicesEncrypted");
+        if (encrypted.empty())
+        {
+            return services && parseServices(*services, sink);
+        }
+
+        // ciphertext and tag, salt and IV
+        const auto first = encrypted.find(':');
+        const auto second = first == std::string_view::npos ? first : encrypted.find(':', first + 1U);
+        if (second == std::string_view::npos || password.empty())
+        {
+            return false;
+        }
+        const auto message = Codec::base64Decode(std::string(encrypted.substr(0, first)));
+        const auto salt = Codec::base64Decode(std::string(encrypted.substr(first + 1U, second - first - 1U)));
+        const auto iv = Codec::base64Decode(std::string(encrypted.substr(second + 1U)));
+        if (message.size() < TAG_SIZE || salt.empty())
+        {
+            return false;
+        }
+
+        const auto key = keys ? keys->key(PBKDF2, password, salt) : KeyCache::derive(PBKDF2, password, salt);
+        const std::string_view view(message);
+        SecureString decrypted;
+        if (!Internal::gcmDecrypt(key, iv, view.substr(0, view.size() - TAG_SIZE), view.substr(view.size() - TAG_SIZE),
+                                  decrypted))
+        {
+            return false;
+        }
+
+        auto array = arena.document();
+        Internal::JsonArena::parseInsitu(array, decrypted);
+        return parseServices(array, sink);
+    } catch (...) {
+        // catch all rapidjson exceptions
+        return false;
+    }
+}
+
+bool TwoFAS::write(const std::string &target, const FileFormat::TokenSource &source)
+{
+    try {
+        SecureString out;
+        Internal::SecureStringStream stream(out);
+        rapidjson::Writer<Internal::SecureStringStream> writer(stream);
+
+        std::size_t position = 0U;
+        writer.StartObject();
+        writer.Key("services");
+        writer.StartArray();
+        const auto res = source([&](const OTPToken &token) {
+            const auto steam = token.type() == OTPToken::Steam;
+            const auto hotp = token.type() == OTPToken::HOTP;
+
+            writer.StartObject();
+            writer.Key("name");
+            writeString(writer, token.issuer().empty() ? token.label() : token.issuer());
+            writer.Key("secret");
+            writeString(writer, token.secret());
+            writer.Key("otp");
+            writer.StartObject();
+            writer.Key("label");
+            writeString(writer, token.label());
+            writer.Key("account");
+            writeString(writer, token.label());
+            writer.Key("issuer");
+            writeString(writer, token.issuer());
+            writer.Key("digits");
+            writer.Uint(steam ? 5U : token.digitLength());
+            writer.Key("period");
+            writer.Uint(hotp ? 30U : token.period());
+            writer.Key("algorithm");
+            writeString(writer, steam ? std::string("SHA1") : token.algorithmName());
+            writer.Key("counter");
+            writer.Uint64(hotp ? token.counter() : 0U);
+            writer.Key("tokenType");
+            writer.String(hotp ? "HOTP" : steam ? "STEAM" : "TOTP");
+            writer.Key("source");
+            writer.String("Link");
+            writer.EndObject();
+            writer.Key("order");
+            writer.StartObject();
+            writer.Key("position");
+            writer.Uint64(position++);
+            writer.EndObject();
+            writer.EndObject();
+        });
+        writer.EndArray();
+        writer.Key("groups");
+        writer.StartArray();
+        writer.EndArray();
+        writer.Key("schemaVersion");
+        writer.Uint(4U);
+        writer.EndObject();
+
+        return res && Internal::writeFile(target, out);
+    } catch (...) {
+        return false;
+    }
+}
+
+}
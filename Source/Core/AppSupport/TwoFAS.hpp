@@ -0,0 +1,40 @@
+#ifndef TWOFAS_HPP
+#define TWOFAS_HPP
+
+#include <OTPToken.hpp>
+
+#include "FileFormat.hpp"
+#include "ImportSink.hpp"
+
+#include <string_view>
+#include <vector>
+
+namespace AppSupport {
+
+class KeyCache;
+
+/**
+ * 2FAS Authenticator backups (.2fas)
+ *
+ * Password protected backups hold the services encrypted with AES-256-GCM
+ * under a key derived with PBKDF2-SHA256, the salt is stored with the
+ * ciphertext. Exports are written without a password.
+ *
+ */
+class TwoFAS
+{
+    TwoFAS() = delete;
+
+public:
+    static bool importTokens(const std::string &file, ImportSink &sink, const std::string &password = std::string(),
+                             KeyCache *keys = nullptr);
+    static bool exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens);
+
+    static bool detect(std::string_view contents);
+    static bool read(std::string_view contents, ImportSink &sink, const std::string &password, KeyCache *keys);
+    static bool write(const std::string &target, const FileFormat::TokenSource &source);
+};
+
+}
+
+#endif // TWOFAS_HPP
@@ -1,18 +1,22 @@
 #include "andOTP.hpp"
 
+#include "KeyCache.hpp"
+
+#include <algorithm>
 #include <iostream>
 
 #include <TokenDatabase.hpp>
+#include "../Internal/AtomicFile.hpp"
+#include "../Internal/BackupFile.hpp"
+#include "../Internal/JsonArena.hpp"
+#include "../Internal/MappedFile.hpp"
 
-#include <cereal/external/rapidjson/document.h>
 #include <cereal/external/rapidjson/memorystream.h>
-#include <cereal/external/rapidjson/stringbuffer.h>
+#include <cereal/external/rapidjson/reader.h>
 #include <cereal/external/rapidjson/writer.h>
 
 #include <cryptopp/sha.h>
 #include <cryptopp/filters.h>
-#include <cryptopp/randpool.h>
-#include <cryptopp/osrng.h>
 
 #include <cryptopp/aes.h>
 #include <cryptopp/gcm.h>
@@ -25,6 +29,7 @@
 // {
 //     "secret": "",
 //     "label": "",
+//     "issuer": "",
 //     "period": 30,
 //     "digits": 6,
 //     "type": "TOTP/HOTP/STEAM",
@@ -34,189 +39,703 @@
 //     "tags": []
 // }
 
-namespace AppSupport {
+// PBKDF2 backup layout, andOTP 0.6.3 and later
+//
+// [iterations, 4 bytes big endian][salt, 12 bytes][IV, 12 bytes][message][tag, 16 bytes]
+//
+// the key is the PBKDF2-HMAC-SHA1 of the password, 256 bits
 
-const uint8_t andOTP::ANDOTP_IV_SIZE = 12U;
-const uint8_t andOTP::ANDOTP_TAG_SIZE = 16U;
+namespace {
+    // size of the decrypted chunks handed to the parser
+    static const constexpr std::size_t CHUNK_SIZE = 64U * 1024U;
 
-bool andOTP::importTokens(const std::string &file, std::vector<OTPToken*> &target, const Type &type, const std::string &password)
-{
-    // read file contents into memory
-    std::string out;
-    auto status = TokenDatabase::readFile(file, out);
-    if (status != TokenDatabase::Success)
+    // iterations of PBKDF2 backups which are accepted by the detection
+    static const constexpr std::uint32_t MIN_ITERATIONS = 1000U;
+    static const constexpr std::uint32_t MAX_ITERATIONS = 10000000U;
+
+    static AppSupport::KeyCache::Parameters pbkdf2(std::uint32_t iterations)
     {
-        out.clear();
-        return false;
+        return {AppSupport::KeyCache::PBKDF2_SHA1, iterations, 0U, 0U, 32U};
     }
 
-    if (out.empty())
+    static std::uint32_t readIterations(std::string_view contents)
     {
-        return false;
+        const auto bytes = reinterpret_cast<const unsigned char*>(contents.data());
+        return (static_cast<std::uint32_t>(bytes[0]) << 24) | (static_cast<std::uint32_t>(bytes[1]) << 16) |
+               (static_cast<std::uint32_t>(bytes[2]) << 8) | static_cast<std::uint32_t>(bytes[3]);
     }
 
-    // decrypt contents first if they are encrypted
-    if (type == Encrypted)
+    // rapidjson input stream over a plain or encrypted backup,
+    // encrypted backups are decrypted chunk by chunk as the parser reads them
+    class BackupStream
     {
-        std::string decrypted;
-        auto status = decrypt(password, out, decrypted);
-        if (status)
+    public:
+        using Ch = char;
+
+        explicit BackupStream(std::string_view contents)
+            : _pos(contents.data()), _end(contents.data() + contents.size())
         {
-            out = decrypted;
-            decrypted.clear();
         }
-        else
+
+        // the ciphertext without IV and tag
+        BackupStream(CryptoPP::GCM<CryptoPP::AES>::Decryption &cipher, std::string_view ciphertext)
+            : _cipher(&cipher), _input(ciphertext), _chunk(std::min(ciphertext.size(), CHUNK_SIZE))
         {
-            out.clear();
-            decrypted.clear();
-            return false;
         }
-    }
 
-    // parse json
-    try {
-        rapidjson::StringStream s(out.c_str());
-        rapidjson::Document json;
-        json.ParseStream(s);
+        inline Ch Peek()
+        {
+            if (_pos == _end && !fill())
+            {
+                return '\0';
+            }
+            return *_pos;
+        }
 
-        // root element must be an array
-        if (!json.IsArray())
+        inline Ch Take()
         {
-            return false;
+            const auto c = Peek();
+            if (_pos != _end)
+            {
+                ++_pos;
+                ++_count;
+            }
+            return c;
+        }
+
+        inline std::size_t Tell() const
+        { return _count; }
+
+        // decrypt the remaining input, which the parser didn't need
+        void drain()
+        {
+            while (fill())
+            {
+                _pos = _end;
+            }
         }
 
-        auto array = json.GetArray();
-        for (auto&& elem : array)
+        // not an output stream
+        Ch *PutBegin() { return nullptr; }
+        void Put(Ch) {}
+        void Flush() {}
+        std::size_t PutEnd(Ch*) { return 0U; }
+
+    private:
+        bool fill()
         {
-            // check if object has all andOTP members
-            if (!(elem.HasMember("type") &&
-                elem.HasMember("secret") &&
-                elem.HasMember("label")))
+            if (!_cipher || _input.empty())
             {
-                continue;
+                return false;
             }
 
-            try {
+            const auto size = std::min(_input.size(), _chunk.size());
+            _cipher->ProcessData(_chunk.data(), reinterpret_cast<const CryptoPP::byte*>(_input.data()), size);
+            _input.remove_prefix(size);
+            _pos = reinterpret_cast<const char*>(_chunk.data());
+            _end = _pos + size;
+            return true;
+        }
+
+        const char *_pos = nullptr;
+        const char *_end = nullptr;
+        std::size_t _count = 0U;
+
+        CryptoPP::GCM<CryptoPP::AES>::Decryption *_cipher = nullptr;
+        std::string_view _input;
+        // wiped when released, holds decrypted secrets
+        SecureBuffer _chunk;
+    };
+
+    // SAX handler for the entry array, a token is emitted when its object ends
+    // values of unknown members and nested values are skipped
+    class EntryHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, EntryHandler>
+    {
+    public:
+        explicit EntryHandler(AppSupport::ImportSink &sink)
+            : _sink(sink)
+        {
+        }
+
+        bool StartArray()
+        {
+            ++_depth;
+            return true;
+        }
+
+        bool EndArray(rapidjson::SizeType)
+        {
+            --_depth;
+            return true;
+        }
 
-            const auto typeStr = std::string(elem["type"].GetString());
+        bool StartObject()
+        {
+            // root element must be an array
+            if (_depth == 0U)
+            {
+                return false;
+            }
+            if (_depth == 1U)
+            {
+                _entry = Entry();
+            }
+            ++_depth;
+            return true;
+        }
 
-            if (typeStr == "TOTP")
+        bool EndObject(rapidjson::SizeType)
+        {
+            --_depth;
+            if (_depth == 1U)
             {
-                auto token = new OTPToken(OTPToken::TOTP);
-                token->setSecret(elem["secret"].GetString());
-                token->setLabel(elem["label"].GetString());
-                token->setPeriod(elem["period"].GetUint());
-                token->setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-                token->setAlgorithm(elem["algorithm"].GetString());
-                target.push_back(token);
+                emit();
             }
-            else if (typeStr == "HOTP")
+            return true;
+        }
+
+        bool Key(const char *str, rapidjson::SizeType length, bool)
+        {
+            if (_depth == 2U)
             {
-                auto token = new OTPToken(OTPToken::HOTP);
-                token->setSecret(elem["secret"].GetString());
-                token->setLabel(elem["label"].GetString());
-                token->setCounter(elem["counter"].GetUint());
-                token->setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-                token->setAlgorithm(elem["algorithm"].GetString());
-                target.push_back(token);
+                _key.assign(str, length);
             }
-            else if (typeStr == "STEAM")
+            return true;
+        }
+
+        bool String(const char *str, rapidjson::SizeType length, bool)
+        {
+            // the strings of the tags array
+            if (_depth == 3U && _key == "tags")
             {
-                auto token = new OTPToken(OTPToken::Steam);
-                token->setSecret(elem["secret"].GetString());
-                token->setLabel(elem["label"].GetString());
-                target.push_back(token);
+                _entry.tags.emplace_back(str, length);
+                return true;
             }
-            else
+            if (_depth != 2U)
             {
-                continue;
+                return _depth != 0U;
             }
 
-            } catch (...) {
-                continue;
+            if (_key == "type")
+            {
+                _entry.type.assign(str, length);
+                _entry.fields |= Type;
+            }
+            else if (_key == "secret")
+            {
+                _entry.secret.assign(str, length);
+                _entry.fields |= Secret;
             }
+            else if (_key == "label")
+            {
+                _entry.label.assign(str, length);
+                _entry.fields |= Label;
+            }
+            else if (_key == "algorithm")
+            {
+                _entry.algorithm.assign(str, length);
+                _entry.fields |= Algorithm;
+            }
+            else if (_key == "issuer")
+            {
+                _entry.issuer.assign(str, length);
+            }
+            return true;
         }
-    } catch (...) {
-        // catch all rapidjson exceptions
-        return false;
-    }
 
-    return true;
-}
+        bool Uint(unsigned int value)
+        {
+            if (_depth != 2U)
+            {
+                return _depth != 0U;
+            }
 
-bool andOTP::exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens, const Type &type, const std::string &password)
-{
-    try {
-        rapidjson::Document json(rapidjson::kArrayType);
+            if (_key == "period")
+            {
+                _entry.period = value;
+                _entry.fields |= Period;
+            }
+            else if (_key == "digits")
+            {
+                _entry.digits = value;
+                _entry.fields |= Digits;
+            }
+            else if (_key == "counter")
+            {
+                _entry.counter = value;
+                _entry.fields |= Counter;
+            }
+            return true;
+        }
 
-        for (auto&& token : tokens)
+        // all other values, scalar roots are rejected
+        bool Default()
+        {
+            return _depth != 0U;
+        }
+
+    private:
+        enum Field {
+            Type      = 1 << 0,
+            Secret    = 1 << 1,
+            Label     = 1 << 2,
+            Algorithm = 1 << 3,
+            Period    = 1 << 4,
+            Digits    = 1 << 5,
+            Counter   = 1 << 6,
+        };
+
+        struct Entry
         {
-            rapidjson::Value value(rapidjson::kObjectType);
-            value.AddMember("secret", rapidjson::Value(token->secret().c_str(), json.GetAllocator()), json.GetAllocator());
-            value.AddMember("label", rapidjson::Value(token->label().c_str(), json.GetAllocator()), json.GetAllocator());
-            value.AddMember("period", token->period(), json.GetAllocator());
-            value.AddMember("digits", token->digitLength(), json.GetAllocator());
+            std::string type;
+            SecureString secret;
+            std::string label;
+            std::string algorithm;
+            std::string issuer;
+            OTPToken::Tags tags;
+            unsigned int period = 0U;
+            unsigned int digits = 0U;
+            unsigned int counter = 0U;
+            unsigned int fields = 0U;
+        };
+
+        inline bool has(unsigned int fields) const
+        { return (_entry.fields & fields) == fields; }
+
+        void emit()
+        {
+            // entries without all andOTP members of their type are skipped
+            if (!has(Type | Secret | Label))
+            {
+                return;
+            }
 
-            if (token->type() == OTPToken::HOTP)
+            if (_entry.type == "TOTP" && has(Period | Digits | Algorithm))
             {
-                value.AddMember("type", "HOTP", json.GetAllocator());
+                OTPToken token(OTPToken::TOTP);
+                token.setSecret(_entry.secret);
+                token.setLabel(std::move(_entry.label));
+                token.setPeriod(_entry.period);
+                token.setDigitLength(static_cast<OTPToken::DigitType>(_entry.digits));
+                token.setAlgorithm(_entry.algorithm);
+                token.setIssuer(_entry.issuer);
+                token.setTags(std::move(_entry.tags));
+                _sink.add(std::move(token));
             }
-            else if (token->type() == OTPToken::Steam)
+            else if (_entry.type == "HOTP" && has(Counter | Digits | Algorithm))
             {
-                value.AddMember("type", "STEAM", json.GetAllocator());
+                OTPToken token(OTPToken::HOTP);
+                token.setSecret(_entry.secret);
+                token.setLabel(std::move(_entry.label));
+                token.setCounter(_entry.counter);
+                token.setDigitLength(static_cast<OTPToken::DigitType>(_entry.digits));
+                token.setAlgorithm(_entry.algorithm);
+                token.setIssuer(_entry.issuer);
+                token.setTags(std::move(_entry.tags));
+                _sink.add(std::move(token));
             }
-            else
+            else if (_entry.type == "STEAM")
             {
-                value.AddMember("type", "TOTP", json.GetAllocator());
+                OTPToken token(OTPToken::Steam);
+                token.setSecret(_entry.secret);
+                token.setLabel(std::move(_entry.label));
+                token.setIssuer(_entry.issuer);
+                token.setTags(std::move(_entry.tags));
+                _sink.add(std::move(token));
             }
+        }
 
-            if (token->type() == OTPToken::Steam)
+        AppSupport::ImportSink &_sink;
+        unsigned int _depth = 0U;
+        std::string _key;
+        Entry _entry;
+    };
+
+    // rapidjson output stream into the target file, encrypted backups are
+    // encrypted chunk by chunk as the writer fills them, the tag follows the last chunk
+    class ExportStream
+    {
+    public:
+        using Ch = char;
+
+        ExportStream(Internal::AtomicFile &file, CryptoPP::GCM<CryptoPP::AES>::Encryption *cipher)
+            : _file(file), _cipher(cipher)
+        {
+            _chunk.reserve(CHUNK_SIZE);
+        }
+
+        inline void Put(Ch c)
+        {
+            _chunk.push_back(static_cast<unsigned char>(c));
+            if (_chunk.size() == CHUNK_SIZE)
+            {
+                Flush();
+            }
+        }
+
+        void Flush()
+        {
+            if (_chunk.empty())
             {
-                value.AddMember("algorithm", "SHA1", json.GetAllocator());
-                value["digits"].SetUint(5);
+                return;
             }
-            else
+            if (_cipher)
             {
-                value.AddMember("algorithm", rapidjson::Value(token->algorithmName().c_str(), json.GetAllocator()), json.GetAllocator());
+                _cipher->ProcessData(_chunk.data(), _chunk.data(), _chunk.size());
             }
+            _failed = _failed || !_file.write(_chunk.data(), _chunk.size());
+            SecureMemory::wipe(_chunk.data(), _chunk.size());
+            _chunk.clear();
+        }
 
-            value.AddMember("thumbnail", "Default", json.GetAllocator());
-            value.AddMember("last_used", 0, json.GetAllocator());
-            value.AddMember("tags", rapidjson::Value(rapidjson::kArrayType), json.GetAllocator());
-            json.PushBack(value, json.GetAllocator());
+        // writes the pending chunk and the tag, false if anything couldn't be written
+        bool finish(std::size_t tagSize)
+        {
+            Flush();
+            if (_cipher)
+            {
+                CryptoPP::byte tag[CryptoPP::AES::BLOCKSIZE];
+                _cipher->TruncatedFinal(tag, tagSize);
+                _failed = _failed || !_file.write(tag, tagSize);
+            }
+            return !_failed;
         }
 
-        rapidjson::StringBuffer buffer;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-        json.Accept(writer);
+        // not an input stream
+        Ch Peek() const { return '\0'; }
+        Ch Take() { return '\0'; }
+        std::size_t Tell() const { return 0U; }
+        Ch *PutBegin() { return nullptr; }
+        std::size_t PutEnd(Ch*) { return 0U; }
+
+    private:
+        Internal::AtomicFile &_file;
+        CryptoPP::GCM<CryptoPP::AES>::Encryption *_cipher = nullptr;
+        // wiped when released, holds the plain text secrets
+        SecureBuffer _chunk;
+        bool _failed = false;
+    };
+
+    static void writeEntry(rapidjson::Writer<ExportStream> &writer, const OTPToken &token)
+    {
+        const auto steam = token.type() == OTPToken::Steam;
+
+        writer.StartObject();
+        writer.Key("secret");
+        writer.String(token.secret().data(), static_cast<rapidjson::SizeType>(token.secret().size()));
+        writer.Key("label");
+        writer.String(token.label().data(), static_cast<rapidjson::SizeType>(token.label().size()));
+        if (!token.issuer().empty())
+        {
+            writer.Key("issuer");
+            writer.String(token.issuer().data(), static_cast<rapidjson::SizeType>(token.issuer().size()));
+        }
+        writer.Key("period");
+        writer.Uint(token.period());
+        writer.Key("digits");
+        writer.Uint(steam ? 5U : token.digitLength());
+
+        writer.Key("type");
+        if (token.type() == OTPToken::HOTP)
+        {
+            writer.String("HOTP");
+            writer.Key("counter");
+            writer.Uint64(token.counter());
+        }
+        else if (steam)
+        {
+            writer.String("STEAM");
+        }
+        else
+        {
+            writer.String("TOTP");
+        }
+
+        writer.Key("algorithm");
+        if (steam)
+        {
+            writer.String("SHA1");
+        }
+        else
+        {
+            const auto algorithm = token.algorithmName();
+            writer.String(algorithm.data(), static_cast<rapidjson::SizeType>(algorithm.size()));
+        }
 
+        writer.Key("thumbnail");
+        writer.String("Default");
+        writer.Key("last_used");
+        writer.Uint(0U);
+        writer.Key("tags");
+        writer.StartArray();
+        for (auto&& tag : token.tags())
+        {
+            writer.String(tag.data(), static_cast<rapidjson::SizeType>(tag.size()));
+        }
+        writer.EndArray();
+        writer.EndObject();
+    }
+}
+
+namespace AppSupport {
+
+const uint8_t andOTP::ANDOTP_IV_SIZE = 12U;
+const uint8_t andOTP::ANDOTP_TAG_SIZE = 16U;
+const uint8_t andOTP::ANDOTP_SALT_SIZE = 12U;
+const uint8_t andOTP::ANDOTP_ITERATIONS_SIZE = 4U;
+const unsigned int andOTP::PBKDF2_ITERATIONS = 150000U;
+
+bool andOTP::importTokens(const std::string &file, ImportSink &sink, const Type &type, const std::string &password,
+                          KeyCache *keys)
+{
+    // tokens of backups which failed to authenticate are dropped again
+    const auto res = parse(file, type, password, sink, keys);
+    if (!res)
+    {
+        sink.abort();
+    }
+    return res;
+}
+
+bool andOTP::importTokens(const std::string &file, std::vector<OTPToken*> &target, const Type &type, const std::string &password)
+{
+    const auto first = target.size();
+    CallbackSink sink([&](OTPToken &&token) {
+        target.push_back(new OTPToken(std::move(token)));
+    }, [&]{
+        for (auto i = first; i < target.size(); ++i)
+        {
+            delete target[i];
+        }
+        target.resize(first);
+    });
+    return importTokens(file, sink, type, password);
+}
+
+bool andOTP::importIntoDatabase(const std::string &file, const Type &type, const std::string &password, std::size_t *inserted,
+                                KeyCache *keys)
+{
+    std::vector<TokenDatabase::Error> results;
+    const auto status = TokenDatabase::insertTokens([&](const TokenDatabase::TokenCallback &insert) {
+        CallbackSink sink([&](OTPToken &&token) {
+            insert(token);
+        });
+        const auto res = parse(file, type, password, sink, keys);
+        return res ? TokenDatabase::Success : TokenDatabase::InvalidTokenFile;
+    }, &results);
+
+    if (inserted)
+    {
+        *inserted = static_cast<std::size_t>(std::count(results.begin(), results.end(), TokenDatabase::Success));
+    }
+    return status == TokenDatabase::Success;
+}
+
+bool andOTP::looksLikePBKDF2(std::string_view contents)
+{
+    if (contents.size() <= static_cast<std::size_t>(ANDOTP_ITERATIONS_SIZE + ANDOTP_SALT_SIZE + ANDOTP_IV_SIZE + ANDOTP_TAG_SIZE))
+    {
+        return false;
+    }
+    const auto iterations = readIterations(contents);
+    return iterations >= MIN_ITERATIONS && iterations <= MAX_ITERATIONS;
+}
+
+bool andOTP::importEncrypted(const std::string &file, ImportSink &sink, const std::string &password, KeyCache *keys)
+{
+    bool pbkdf2 = false;
+    {
+        Internal::MappedFile in;
+        if (!in.open(file))
+        {
+            return false;
+        }
+        pbkdf2 = looksLikePBKDF2(in.view());
+    }
+
+    // failed attempts abort the sink, so the second one starts clean
+    if (pbkdf2 && importTokens(file, sink, EncryptedPBKDF2, password, keys))
+    {
+        return true;
+    }
+    return importTokens(file, sink, Encrypted, password);
+}
+
+bool andOTP::parse(const std::string &file, const Type &type, const std::string &password, ImportSink &sink, KeyCache *keys)
+{
+    // map the file contents
+    Internal::MappedFile in;
+    auto status = TokenDatabase::readFile(file, in);
+    if (status != TokenDatabase::Success)
+    {
+        return false;
+    }
+
+    // the decoded strings are copied to the stack of the reader, which lives in the arena
+    EntryHandler handler(sink);
+    Internal::JsonArena arena;
+    auto reader = arena.reader();
+
+    try {
+        // plain text is parsed directly from the mapped file
         if (type == PlainText)
         {
-            const auto res = TokenDatabase::writeFile(target, buffer.GetString());
-            if (res != TokenDatabase::Success)
+            BackupStream stream(in.view());
+            return !reader.Parse(stream, handler).IsError();
+        }
+
+        // the IV is stored before the message and the tag after it,
+        // PBKDF2 backups store the iterations and the salt before the IV
+        auto contents = in.view();
+        SecureString key;
+        if (type == EncryptedPBKDF2)
+        {
+            if (!looksLikePBKDF2(contents) || password.empty())
             {
                 return false;
             }
+            const auto iterations = readIterations(contents);
+            const auto salt = contents.substr(ANDOTP_ITERATIONS_SIZE, ANDOTP_SALT_SIZE);
+            key = keys ? keys->key(pbkdf2(iterations), password, salt) : KeyCache::derive(pbkdf2(iterations), password, salt);
+            contents.remove_prefix(ANDOTP_ITERATIONS_SIZE + ANDOTP_SALT_SIZE);
         }
         else
         {
-            std::string encrypted;
-            auto res = encrypt(password, buffer.GetString(), encrypted);
-            if (!res)
+            const auto pwd = sha256_password(password);
+            key.assign(pwd.data(), pwd.size());
+        }
+
+        if (key.empty() || contents.size() <= static_cast<std::size_t>(ANDOTP_IV_SIZE + ANDOTP_TAG_SIZE))
+        {
+            return false;
+        }
+
+        CryptoPP::GCM<CryptoPP::AES>::Decryption d;
+        d.SetKeyWithIV(reinterpret_cast<const unsigned char*>(key.data()), key.size(),
+                       reinterpret_cast<const unsigned char*>(contents.data()), ANDOTP_IV_SIZE);
+
+        BackupStream stream(d, contents.substr(ANDOTP_IV_SIZE, contents.size() - ANDOTP_IV_SIZE - ANDOTP_TAG_SIZE));
+        if (reader.Parse(stream, handler).IsError())
+        {
+            return false;
+        }
+
+        // the tag covers the whole message, including anything after the array
+        stream.drain();
+        return d.TruncatedVerify(reinterpret_cast<const CryptoPP::byte*>(contents.data() + contents.size() - ANDOTP_TAG_SIZE),
+                                 ANDOTP_TAG_SIZE);
+    } catch (...) {
+        // catch all rapidjson and crypto++ exceptions
+        return false;
+    }
+}
+
+bool andOTP::exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens, const Type &type, const std::string &password,
+                          KeyCache *keys)
+{
+    return write(target, type, password, [&](const TokenWriter &add) {
+        for (auto&& token : tokens)
+        {
+            add(*token);
+        }
+        return true;
+    }, keys);
+}
+
+bool andOTP::exportDatabase(const std::string &target, const Type &type, const std::string &password, std::size_t *exported,
+                            KeyCache *keys)
+{
+    if (exported)
+    {
+        *exported = 0U;
+    }
+
+    return write(target, type, password, [&](const TokenWriter &add) {
+        // icons aren't part of the backup
+        return TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+            add(token);
+            if (exported)
+            {
+                ++(*exported);
+            }
+        }, false) == TokenDatabase::Success;
+    }, keys);
+}
+
+bool andOTP::write(const std::string &target, const Type &type, const std::string &password, const TokenSource &source,
+                   KeyCache *keys)
+{
+    Internal::AtomicFile file;
+    if (!file.open(target))
+    {
+        return false;
+    }
+
+    try {
+        CryptoPP::GCM<CryptoPP::AES>::Encryption e;
+        if (type == EncryptedPBKDF2)
+        {
+            if (password.empty())
             {
                 return false;
             }
-            res = TokenDatabase::writeFile(target, encrypted);
-            if (res != TokenDatabase::Success)
+
+            // the salt is shared by the exports of the cache, the IV is new for every file
+            std::string salt = Internal::randomBytes(ANDOTP_SALT_SIZE);
+            const auto parameters = pbkdf2(PBKDF2_ITERATIONS);
+            const auto key = keys ? keys->encryptionKey(parameters, password, ANDOTP_SALT_SIZE, salt) :
+                                    KeyCache::derive(parameters, password, salt);
+            const auto iv = Internal::randomBytes(ANDOTP_IV_SIZE);
+            if (key.empty())
             {
                 return false;
             }
+            e.SetKeyWithIV(reinterpret_cast<const unsigned char*>(key.data()), key.size(),
+                           reinterpret_cast<const unsigned char*>(iv.data()), ANDOTP_IV_SIZE);
+
+            const unsigned char iterations[ANDOTP_ITERATIONS_SIZE] = {
+                static_cast<unsigned char>(PBKDF2_ITERATIONS >> 24), static_cast<unsigned char>(PBKDF2_ITERATIONS >> 16),
+                static_cast<unsigned char>(PBKDF2_ITERATIONS >> 8), static_cast<unsigned char>(PBKDF2_ITERATIONS)};
+            if (!file.write(iterations, ANDOTP_ITERATIONS_SIZE) ||
+                !file.write(salt.data(), salt.size()) ||
+                !file.write(iv.data(), iv.size()))
+            {
+                return false;
+            }
+        }
+        else if (type == Encrypted)
+        {
+            // andOTP requires the IV to be stored before the message
+            CryptoPP::byte iv[ANDOTP_IV_SIZE];
+            Internal::randomBytes(iv, ANDOTP_IV_SIZE);
+
+            const auto pwd = sha256_password(password);
+            e.SetKeyWithIV(reinterpret_cast<const unsigned char*>(pwd.c_str()), pwd.size(),
+                           iv, ANDOTP_IV_SIZE);
+            if (!file.write(iv, ANDOTP_IV_SIZE))
+            {
+                return false;
+            }
+        }
+
+        ExportStream stream(file, type == PlainText ? nullptr : &e);
+        rapidjson::Writer<ExportStream> writer(stream);
+
+        writer.StartArray();
+        const auto res = source([&](const OTPToken &token) {
+            writeEntry(writer, token);
+        });
+        writer.EndArray();
+
+        if (!res || !stream.finish(ANDOTP_TAG_SIZE))
+        {
+            return false;
         }
     } catch (...) {
         return false;
     }
 
-    return true;
+    return file.commit();
 }
 
 const std::string andOTP::sha256_password(const std::string &password)
@@ -235,7 +754,7 @@ const std::string andOTP::sha256_password(const std::string &password)
     return hashed_password;
 }
 
-bool andOTP::decrypt(const std::string &password, const std::string &buffer, std::string &decrypted)
+bool andOTP::decrypt(const std::string &password, std::string_view buffer, std::string &decrypted)
 {
     // stream too small
     if (buffer.size() <= (ANDOTP_IV_SIZE + ANDOTP_TAG_SIZE))
@@ -251,11 +770,12 @@ bool andOTP::decrypt(const std::string &password, const std::string &buffer, std
         CryptoPP::GCM<CryptoPP::AES>::Decryption d;
         const auto pwd = sha256_password(password);
         d.SetKeyWithIV(reinterpret_cast<const unsigned char*>(pwd.c_str()), pwd.size(),
-                       reinterpret_cast<const unsigned char*>(iv.c_str()), ANDOTP_IV_SIZE);
+                       reinterpret_cast<const unsigned char*>(iv.data()), ANDOTP_IV_SIZE);
         CryptoPP::AuthenticatedDecryptionFilter df(d, new CryptoPP::StringSink(decrypted),
                                                    CryptoPP::AuthenticatedDecryptionFilter::MAC_AT_END,
                                                    ANDOTP_TAG_SIZE);
-        CryptoPP::StringSource(enc_buf, true, new CryptoPP::Redirector(df));
+        CryptoPP::StringSource(reinterpret_cast<const CryptoPP::byte*>(enc_buf.data()), enc_buf.size(),
+                               true, new CryptoPP::Redirector(df));
     } catch (...) {
         decrypted.clear();
         return false;
@@ -264,42 +784,4 @@ bool andOTP::decrypt(const std::string &password, const std::string &buffer, std
     return true;
 }
 
-bool andOTP::encrypt(const std::string &password, const std::string &buffer, std::string &encrypted)
-{
-    // stream is empty
-    if (buffer.empty())
-    {
-        return false;
-    }
-
-    // generate random IV
-    CryptoPP::AutoSeededRandomPool prng;
-    CryptoPP::byte *iv = static_cast<CryptoPP::byte*>(std::malloc(ANDOTP_IV_SIZE));
-    prng.GenerateBlock(iv, ANDOTP_IV_SIZE);
-
-    try {
-        std::string enc_buf;
-
-        CryptoPP::GCM<CryptoPP::AES>::Encryption e;
-        const auto pwd = sha256_password(password);
-        e.SetKeyWithIV(reinterpret_cast<const unsigned char*>(pwd.c_str()), pwd.size(),
-                       iv, ANDOTP_IV_SIZE);
-        CryptoPP::StringSource ss(buffer, true,
-                                    new CryptoPP::AuthenticatedEncryptionFilter(e,
-                                      new CryptoPP::StringSink(enc_buf), false, ANDOTP_TAG_SIZE));
-
-        // andOTP requires the IV to be stored before the message
-        encrypted.clear();
-        encrypted.append(std::string(iv, iv + ANDOTP_IV_SIZE));
-        encrypted.append(enc_buf);
-    } catch (...) {
-        std::free(iv);
-        encrypted.clear();
-        return false;
-    }
-
-    std::free(iv);
-    return true;
-}
-
 }
@@ -3,10 +3,18 @@
 
 #include <OTPToken.hpp>
 
+#include "ImportSink.hpp"
+
+#include <functional>
+#include <string_view>
 #include <vector>
 
 namespace AppSupport {
 
+class KeyCache;
+
+// the PBKDF2 keys are derived through the key cache if one is given, so a series
+// of imports and exports with the same password pays the key derivation once
 class andOTP
 {
     andOTP() = delete;
@@ -14,20 +22,56 @@ class andOTP
     // andOTP cipher constants
     static const uint8_t ANDOTP_IV_SIZE;
     static const uint8_t ANDOTP_TAG_SIZE;
+    static const uint8_t ANDOTP_SALT_SIZE;
+    static const uint8_t ANDOTP_ITERATIONS_SIZE;
 
 public:
     enum Type {
         PlainText,
-        Encrypted,
+        Encrypted,          // SHA-256 of the password, andOTP before 0.6.3
+        EncryptedPBKDF2,    // PBKDF2-SHA1 of the password, the iterations and the salt are stored before the IV
     };
 
+    // iterations of new PBKDF2 backups, andOTP picks them between 140000 and 160000
+    static const unsigned int PBKDF2_ITERATIONS;
+
+    static bool importTokens(const std::string &file, ImportSink &sink, const Type &type = PlainText, const std::string &password = std::string(),
+                             KeyCache *keys = nullptr);
+    // the caller owns the tokens appended to target
     static bool importTokens(const std::string &file, std::vector<OTPToken*> &target, const Type &type = PlainText, const std::string &password = std::string());
-    static bool exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens, const Type &type = PlainText, const std::string &password = std::string());
+    static bool exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens, const Type &type = PlainText, const std::string &password = std::string(),
+                             KeyCache *keys = nullptr);
+    // streams all tokens of the open token database into the backup in a single pass,
+    // the backup is encrypted as it is written and replaces the target once it is complete
+    static bool exportDatabase(const std::string &target, const Type &type = PlainText, const std::string &password = std::string(), std::size_t *exported = nullptr,
+                               KeyCache *keys = nullptr);
+
+    // streams the backup into the open token database in a single transaction,
+    // the file is parsed while it is decrypted and is never held in memory as a whole,
+    // nothing is inserted unless the whole backup is valid and authenticated
+    static bool importIntoDatabase(const std::string &file, const Type &type = PlainText, const std::string &password = std::string(), std::size_t *inserted = nullptr,
+                                   KeyCache *keys = nullptr);
+
+    // PBKDF2 backups start with a plausible amount of iterations, which is only a hint,
+    // older encrypted backups start with a random IV
+    static bool looksLikePBKDF2(std::string_view contents);
+    // encrypted backup of either kind, files which look like PBKDF2 backups are tried
+    // as such first and as older backups if they don't authenticate
+    static bool importEncrypted(const std::string &file, ImportSink &sink, const std::string &password, KeyCache *keys = nullptr);
+
+    // writes the tokens handed to the writer, returns false to abort the export
+    using TokenWriter = std::function<void(const OTPToken &token)>;
+    using TokenSource = std::function<bool(const TokenWriter &add)>;
+    static bool write(const std::string &target, const Type &type, const std::string &password, const TokenSource &source,
+                      KeyCache *keys = nullptr);
 
 private:
+    // parses the backup entry by entry, encrypted backups are authenticated after the last
+    // entry, the tokens added to the sink must be discarded if false is returned
+    static bool parse(const std::string &file, const Type &type, const std::string &password, ImportSink &sink, KeyCache *keys);
+
     static const std::string sha256_password(const std::string &password);
-    static bool decrypt(const std::string &password, const std::string &buffer, std::string &decrypted);
-    static bool encrypt(const std::string &password, const std::string &buffer, std::string &encrypted);
+    static bool decrypt(const std::string &password, std::string_view buffer, std::string &decrypted);
 };
 
 }
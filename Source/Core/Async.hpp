@@ -0,0 +1,348 @@
+#ifndef ASYNC_HPP
+#define ASYNC_HPP
+
+/**
+ * Coroutine API for the blocking database, import and verification calls
+ *
+ * Only available to code compiled as C++20 with coroutine support, which
+ * defines OTPGEN_HAS_COROUTINES, the library itself stays C++17. Every operation
+ * is an awaitable which runs the blocking call on a worker of AsyncFileIO
+ * and resumes the awaiting coroutine on that worker with the result, file
+ * reads and writes are submitted to the io_uring if available and don't
+ * occupy a worker while the transfer runs. Any amount of operations can be
+ * in flight, they only take a thread while they actually run.
+ *
+ *   Async::Task<> refresh()
+ *   {
+ *       if (co_await Async::loadTokens() != TokenDatabase::Success) co_return;
+ *       const auto matched = co_await Async::verifyTOTPBatch(keys, codes, now, 1, 6, 30, &pool);
+ *       ...
+ *   }
+ *
+ * Tasks are lazy and start when they are awaited, Async::spawn() starts one
+ * without waiting for it and Async::wait() blocks the calling thread until
+ * it finished. The arguments of the operations are referenced and must stay
+ * valid until the operation finished, which is always the case when the
+ * operation is awaited directly.
+ *
+ */
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define OTPGEN_HAS_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "AsyncFileIO.hpp"
+#include "OTPGen.hpp"
+#include "TokenDatabase.hpp"
+#include "AppSupport/ImportPipeline.hpp"
+
+class Executor;
+
+namespace Async {
+
+namespace Detail {
+    // result of an operation or coroutine, void has none
+    template<typename T>
+    struct Value
+    {
+        std::optional<T> value;
+
+        template<typename F>
+        inline void set(F &fn)
+        { this->value.emplace(fn()); }
+        inline void return_value(T result)
+        { this->value.emplace(std::move(result)); }
+        inline T take()
+        { return std::move(*this->value); }
+    };
+
+    template<>
+    struct Value<void>
+    {
+        template<typename F>
+        inline void set(F &fn)
+        { fn(); }
+        inline void return_void() noexcept
+        {}
+        inline void take() noexcept
+        {}
+    };
+
+    // coroutine which runs on its own and frees itself at the end
+    struct Detached
+    {
+        struct promise_type
+        {
+            inline Detached get_return_object() noexcept
+            { return {}; }
+            inline std::suspend_never initial_suspend() noexcept
+            { return {}; }
+            inline std::suspend_never final_suspend() noexcept
+            { return {}; }
+            inline void return_void() noexcept
+            {}
+            inline void unhandled_exception() noexcept
+            { std::terminate(); }
+        };
+    };
+}
+
+// lazy coroutine with a single awaiter, exceptions are rethrown to the awaiter
+template<typename T = void>
+class Task
+{
+public:
+    struct promise_type : Detail::Value<T>
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        // resume the awaiter when the coroutine finished
+        struct Final
+        {
+            inline bool await_ready() const noexcept
+            { return false; }
+            inline std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                const auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            inline void await_resume() const noexcept
+            {}
+        };
+
+        inline Task get_return_object() noexcept
+        { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        inline std::suspend_always initial_suspend() const noexcept
+        { return {}; }
+        inline Final final_suspend() const noexcept
+        { return {}; }
+        inline void unhandled_exception() noexcept
+        { this->exception = std::current_exception(); }
+    };
+
+    Task(Task &&other) noexcept
+        : _handle(std::exchange(other._handle, {}))
+    {}
+    Task &operator= (Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            this->reset();
+            this->_handle = std::exchange(other._handle, {});
+        }
+        return *this;
+    }
+    ~Task()
+    { this->reset(); }
+
+    Task(const Task&) = delete;
+    Task &operator= (const Task&) = delete;
+
+    inline bool await_ready() const noexcept
+    { return !this->_handle || this->_handle.done(); }
+    inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        this->_handle.promise().continuation = awaiting;
+        return this->_handle;
+    }
+    inline T await_resume()
+    {
+        auto &promise = this->_handle.promise();
+        if (promise.exception)
+        {
+            std::rethrow_exception(promise.exception);
+        }
+        return promise.take();
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+        : _handle(handle)
+    {}
+
+    inline void reset() noexcept
+    {
+        if (this->_handle)
+        {
+            this->_handle.destroy();
+            this->_handle = {};
+        }
+    }
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+// co_await run(fn): fn runs on a worker and the coroutine resumes there with its result
+template<typename F>
+class RunAwaitable
+{
+public:
+    using Result = std::invoke_result_t<F&>;
+
+    RunAwaitable(AsyncFileIO &io, F fn)
+        : _io(io), _fn(std::move(fn))
+    {}
+
+    inline bool await_ready() const noexcept
+    { return false; }
+    inline void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->_io.run([this, handle]{
+            this->_result.set(this->_fn);
+            handle.resume();
+        });
+    }
+    inline Result await_resume()
+    { return this->_result.take(); }
+
+private:
+    AsyncFileIO &_io;
+    F _fn;
+    Detail::Value<Result> _result;
+};
+
+template<typename F>
+inline RunAwaitable<F> run(F fn, AsyncFileIO &io = AsyncFileIO::instance())
+{ return RunAwaitable<F>(io, std::move(fn)); }
+
+// whole file, errors match TokenDatabase::readFile()
+class ReadAwaitable
+{
+public:
+    ReadAwaitable(AsyncFileIO &io, const std::string &file)
+        : _io(io), _file(file)
+    {}
+
+    inline bool await_ready() const noexcept
+    { return false; }
+    inline void await_suspend(std::coroutine_handle<> handle)
+    {
+        // the callback runs on the I/O thread, the coroutine continues on a worker
+        this->_io.read(this->_file, [this, handle](const TokenDatabase::Error &status, std::string &&data) {
+            this->_result.status = status;
+            this->_result.data = std::move(data);
+            this->_io.run([handle]{ handle.resume(); });
+        });
+    }
+    inline AsyncFileIO::ReadResult await_resume()
+    { return std::move(this->_result); }
+
+private:
+    AsyncFileIO &_io;
+    const std::string &_file;
+    AsyncFileIO::ReadResult _result;
+};
+
+// replaces the file with the buffer, errors match TokenDatabase::writeFile()
+class WriteAwaitable
+{
+public:
+    WriteAwaitable(AsyncFileIO &io, const std::string &file, std::string buffer)
+        : _io(io), _file(file), _buffer(std::move(buffer))
+    {}
+
+    inline bool await_ready() const noexcept
+    { return false; }
+    inline void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->_io.write(this->_file, std::move(this->_buffer), [this, handle](const TokenDatabase::Error &status) {
+            this->_status = status;
+            this->_io.run([handle]{ handle.resume(); });
+        });
+    }
+    inline TokenDatabase::Error await_resume() const noexcept
+    { return this->_status; }
+
+private:
+    AsyncFileIO &_io;
+    const std::string &_file;
+    std::string _buffer;
+    TokenDatabase::Error _status = TokenDatabase::Success;
+};
+
+inline ReadAwaitable read(const std::string &file, AsyncFileIO &io = AsyncFileIO::instance())
+{ return ReadAwaitable(io, file); }
+inline WriteAwaitable write(const std::string &file, std::string buffer, AsyncFileIO &io = AsyncFileIO::instance())
+{ return WriteAwaitable(io, file, std::move(buffer)); }
+
+// token database
+inline auto loadTokens(AsyncFileIO &io = AsyncFileIO::instance())
+{ return run([]{ return TokenDatabase::loadTokens(); }, io); }
+inline auto saveTokens(AsyncFileIO &io = AsyncFileIO::instance())
+{ return run([]{ return TokenDatabase::saveTokens(); }, io); }
+
+// imports all files of the pipeline, the result of ImportPipeline::run()
+inline auto importFiles(AppSupport::ImportPipeline &pipeline, std::size_t *inserted = nullptr,
+                        AsyncFileIO &io = AsyncFileIO::instance())
+{ return run([&pipeline, inserted]{ return pipeline.run(inserted); }, io); }
+
+// verification on the executor, the matched flags of OTPGen::verifyTOTPBatch()
+inline auto verifyTOTPBatch(const std::vector<OTPKey> &keys,
+                            const std::vector<OTPToken::TokenString> &codes,
+                            const std::time_t &time,
+                            const unsigned int &window,
+                            const OTPToken::DigitType &digits,
+                            const OTPToken::PeriodType &period,
+                            Executor *executor = nullptr,
+                            AsyncFileIO &io = AsyncFileIO::instance())
+{
+    return run([&keys, &codes, time, window, digits, period, executor]{
+        std::vector<std::uint8_t> matched;
+        OTPGen::verifyTOTPBatch(keys, codes, time, window, digits, period, matched, executor);
+        return matched;
+    }, io);
+}
+
+namespace Detail {
+    template<typename T>
+    Detached notify(Task<T> task, std::promise<T> &done)
+    {
+        try {
+            if constexpr (std::is_void_v<T>)
+            {
+                co_await task;
+                done.set_value();
+            }
+            else
+            {
+                done.set_value(co_await task);
+            }
+        } catch (...) {
+            done.set_exception(std::current_exception());
+        }
+    }
+
+    inline Detached start(Task<> task)
+    {
+        co_await task;
+    }
+}
+
+// start the task without waiting for it, the task must not throw
+inline void spawn(Task<> task)
+{ Detail::start(std::move(task)); }
+
+// block until the task finished, for code outside of coroutines
+template<typename T>
+T wait(Task<T> task)
+{
+    std::promise<T> done;
+    auto result = done.get_future();
+    Detail::notify(std::move(task), done);
+    return result.get();
+}
+
+}
+
+#endif // coroutines
+
+#endif // ASYNC_HPP
@@ -0,0 +1,538 @@
+#include "AsyncFileIO.hpp"
+
+#include <cstdint>
+#include <utility>
+
+#if defined(__linux__)
+#define ASYNCFILEIO_URING
+#include "Internal/IoUring.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // operations in flight on the ring, one slot is kept for the wakeup poll
+    static const constexpr unsigned int RING_ENTRIES = 64U;
+    // largest transfer of a single operation
+    static const constexpr std::size_t MAX_TRANSFER = 1U << 30;
+
+    static const constexpr std::uint64_t WAKEUP_TAG = 0U;
+}
+
+struct AsyncFileIO::Request
+{
+    enum Kind {
+        Read,
+        Write,
+    };
+
+    enum Step {
+        Transfer,
+        Sync,
+        SyncDirectory,
+    };
+
+    Kind kind = Read;
+    Step step = Transfer;
+    std::string path;
+    std::string data;
+    std::size_t offset = 0U;
+    int fd = -1;
+    int directory = -1;
+
+    ReadCallback on_read;
+    WriteCallback on_write;
+};
+
+#ifdef ASYNCFILEIO_URING
+struct AsyncFileIO::Ring
+{
+    Internal::IoUring ring;
+    int wakeup = -1;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Request>> incoming;
+    bool stop = false;
+
+    ~Ring()
+    {
+        if (wakeup >= 0)
+        {
+            ::close(wakeup);
+        }
+    }
+};
+#else
+struct AsyncFileIO::Ring
+{
+};
+#endif
+
+AsyncFileIO &AsyncFileIO::instance()
+{
+    static AsyncFileIO io;
+    return io;
+}
+
+AsyncFileIO::AsyncFileIO(const Backend &backend, std::size_t threads)
+    : _backend(Threads)
+{
+#ifdef ASYNCFILEIO_URING
+    if (backend == IoUring)
+    {
+        std::unique_ptr<Ring> ring(new Ring());
+        ring->wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ring->wakeup >= 0 && ring->ring.open(RING_ENTRIES) && ring->ring.entries() > 1U)
+        {
+            this->_ring = std::move(ring);
+            this->_backend = IoUring;
+        }
+    }
+#else
+    (void) backend;
+#endif
+
+    for (auto i = 0U; i < std::max<std::size_t>(threads, 1U); ++i)
+    {
+        this->_workers.emplace_back(&AsyncFileIO::worker, this);
+    }
+    if (this->_ring)
+    {
+        this->_driver = std::thread(&AsyncFileIO::driver, this);
+    }
+}
+
+AsyncFileIO::~AsyncFileIO()
+{
+    // the I/O thread may still hand work over to the workers, it is stopped first
+#ifdef ASYNCFILEIO_URING
+    if (this->_ring)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->_ring->mutex);
+            this->_ring->stop = true;
+        }
+        const std::uint64_t value = 1U;
+        (void) ::write(this->_ring->wakeup, &value, sizeof(value));
+        this->_driver.join();
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(this->_tasks_mutex);
+        this->_stop = true;
+    }
+    this->_tasks_wakeup.notify_all();
+    for (auto&& worker : this->_workers)
+    {
+        worker.join();
+    }
+}
+
+void AsyncFileIO::read(const std::string &file, ReadCallback callback)
+{
+    if (this->_backend == Threads)
+    {
+        this->run([file, callback]{
+            std::string data;
+            const auto status = TokenDatabase::readFile(file, data);
+            if (callback)
+            {
+                callback(status, std::move(data));
+            }
+        });
+        return;
+    }
+
+    std::unique_ptr<Request> request(new Request());
+    request->kind = Request::Read;
+    request->path = file;
+    request->on_read = std::move(callback);
+    this->enqueue(std::move(request));
+}
+
+std::future<AsyncFileIO::ReadResult> AsyncFileIO::read(const std::string &file)
+{
+    const auto promise = std::make_shared<std::promise<ReadResult>>();
+    auto future = promise->get_future();
+    this->read(file, [promise](const TokenDatabase::Error &status, std::string &&data) {
+        promise->set_value({status, std::move(data)});
+    });
+    return future;
+}
+
+void AsyncFileIO::write(const std::string &file, std::string buffer, WriteCallback callback)
+{
+    if (this->_backend == Threads)
+    {
+        const auto data = std::make_shared<std::string>(std::move(buffer));
+        this->run([file, data, callback]{
+            const auto status = TokenDatabase::writeFile(file, *data);
+            data->clear();
+            if (callback)
+            {
+                callback(status);
+            }
+        });
+        return;
+    }
+
+    std::unique_ptr<Request> request(new Request());
+    request->kind = Request::Write;
+    request->path = file;
+    request->data = std::move(buffer);
+    request->on_write = std::move(callback);
+    this->enqueue(std::move(request));
+}
+
+std::future<TokenDatabase::Error> AsyncFileIO::write(const std::string &file, std::string buffer)
+{
+    const auto promise = std::make_shared<std::promise<TokenDatabase::Error>>();
+    auto future = promise->get_future();
+    this->write(file, std::move(buffer), [promise](const TokenDatabase::Error &status) {
+        promise->set_value(status);
+    });
+    return future;
+}
+
+void AsyncFileIO::run(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_tasks_mutex);
+        this->_tasks.emplace_back(std::move(task));
+    }
+    this->_tasks_wakeup.notify_one();
+}
+
+void AsyncFileIO::worker()
+{
+    for (;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(this->_tasks_mutex);
+            this->_tasks_wakeup.wait(lock, [&]{
+                return this->_stop || !this->_tasks.empty();
+            });
+            // queued tasks are finished before the workers stop
+            if (this->_tasks.empty())
+            {
+                return;
+            }
+            task = std::move(this->_tasks.front());
+            this->_tasks.pop_front();
+        }
+
+        try {
+            task();
+        } catch (...) {
+        }
+    }
+}
+
+void AsyncFileIO::finish(Request &request, const TokenDatabase::Error &status)
+{
+    try {
+        if (request.kind == Request::Read && request.on_read)
+        {
+            request.on_read(status, std::move(request.data));
+        }
+        else if (request.kind == Request::Write && request.on_write)
+        {
+            request.data.clear();
+            request.on_write(status);
+        }
+    } catch (...) {
+    }
+}
+
+#ifdef ASYNCFILEIO_URING
+
+void AsyncFileIO::enqueue(std::unique_ptr<Request> request)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_ring->mutex);
+        this->_ring->incoming.emplace_back(std::move(request));
+    }
+    const std::uint64_t value = 1U;
+    (void) ::write(this->_ring->wakeup, &value, sizeof(value));
+}
+
+void AsyncFileIO::driver()
+{
+    auto &ring = this->_ring->ring;
+    const auto capacity = ring.entries() - 1U;
+
+    std::deque<std::unique_ptr<Request>> backlog;
+    unsigned int in_flight = 0U;
+
+    ring.poll(this->_ring->wakeup, WAKEUP_TAG);
+    for (;;)
+    {
+        auto stop = false;
+        {
+            std::lock_guard<std::mutex> lock(this->_ring->mutex);
+            for (auto&& request : this->_ring->incoming)
+            {
+                backlog.emplace_back(std::move(request));
+            }
+            this->_ring->incoming.clear();
+            stop = this->_ring->stop;
+        }
+
+        while (!backlog.empty() && in_flight < capacity)
+        {
+            // requests in flight are owned by the ring
+            auto request = backlog.front().release();
+            backlog.pop_front();
+            if (this->start(*request))
+            {
+                ++in_flight;
+            }
+            else
+            {
+                delete request;
+            }
+        }
+
+        if (stop && in_flight == 0U && backlog.empty())
+        {
+            break;
+        }
+
+        ring.submit(1U);
+
+        std::uint64_t user_data;
+        std::int32_t result;
+        while (ring.pop(user_data, result))
+        {
+            if (user_data == WAKEUP_TAG)
+            {
+                std::uint64_t value;
+                (void) ::read(this->_ring->wakeup, &value, sizeof(value));
+                ring.poll(this->_ring->wakeup, WAKEUP_TAG);
+                continue;
+            }
+
+            auto request = reinterpret_cast<Request*>(user_data);
+            if (!this->advance(*request, result))
+            {
+                delete request;
+                --in_flight;
+            }
+        }
+    }
+}
+
+bool AsyncFileIO::start(Request &request)
+{
+    if (request.kind == Request::Read)
+    {
+        request.fd = ::open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (request.fd < 0)
+        {
+            this->finish(request, TokenDatabase::FileReadFailure);
+            return false;
+        }
+
+        struct stat st{};
+        if (::fstat(request.fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            // the size of pipes and devices isn't known up front, they are read by a worker
+            ::close(request.fd);
+            const auto file = request.path;
+            const auto callback = request.on_read;
+            this->run([file, callback]{
+                std::string data;
+                const auto status = TokenDatabase::readFile(file, data);
+                if (callback)
+                {
+                    callback(status, std::move(data));
+                }
+            });
+            return false;
+        }
+
+        if (st.st_size == 0)
+        {
+            ::close(request.fd);
+            this->finish(request, TokenDatabase::FileEmpty);
+            return false;
+        }
+
+        try {
+            request.data.resize(static_cast<std::size_t>(st.st_size));
+        } catch (...) {
+            ::close(request.fd);
+            this->finish(request, TokenDatabase::FileReadFailure);
+            return false;
+        }
+    }
+    else
+    {
+        // written to a temporary file next to the target which replaces it once everything is on disk
+        const auto temporary = request.path + ".tmp";
+        request.fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (request.fd < 0)
+        {
+            this->finish(request, TokenDatabase::FileWriteFailure);
+            return false;
+        }
+        if (request.data.empty())
+        {
+            request.step = Request::Sync;
+        }
+    }
+
+    return this->submit(request);
+}
+
+bool AsyncFileIO::submit(Request &request)
+{
+    auto &ring = this->_ring->ring;
+    const auto user_data = reinterpret_cast<std::uintptr_t>(&request);
+
+    if (request.step == Request::Transfer)
+    {
+        const auto size = static_cast<std::uint32_t>(std::min(request.data.size() - request.offset, MAX_TRANSFER));
+        return request.kind == Request::Read ?
+            ring.read(request.fd, &request.data[request.offset], size, request.offset, user_data) :
+            ring.write(request.fd, request.data.data() + request.offset, size, request.offset, user_data);
+    }
+    return ring.fsync(request.step == Request::Sync ? request.fd : request.directory, user_data);
+}
+
+bool AsyncFileIO::advance(Request &request, const std::int32_t &result)
+{
+    const auto retry = result == -EINTR || result == -EAGAIN;
+    const auto temporary = request.path + ".tmp";
+    const auto fail = [&](const TokenDatabase::Error &status) {
+        if (request.fd >= 0)
+        {
+            ::close(request.fd);
+        }
+        if (request.kind == Request::Write)
+        {
+            ::unlink(temporary.c_str());
+        }
+        this->finish(request, status);
+        return false;
+    };
+
+    if (request.kind == Request::Read)
+    {
+        if (retry)
+        {
+            return this->submit(request) || fail(TokenDatabase::FileReadFailure);
+        }
+        if (result < 0)
+        {
+            request.data.clear();
+            return fail(TokenDatabase::FileReadFailure);
+        }
+
+        request.offset += static_cast<std::size_t>(result);
+        if (result != 0 && request.offset < request.data.size())
+        {
+            return this->submit(request) || fail(TokenDatabase::FileReadFailure);
+        }
+
+        // the file may have been truncated while it was read
+        request.data.resize(request.offset);
+        ::close(request.fd);
+        this->finish(request, request.data.empty() ? TokenDatabase::FileEmpty : TokenDatabase::Success);
+        return false;
+    }
+
+    if (retry)
+    {
+        return this->submit(request) || fail(TokenDatabase::FileWriteFailure);
+    }
+
+    switch (request.step)
+    {
+        case Request::Transfer:
+            if (result <= 0)
+            {
+                return fail(TokenDatabase::FileWriteFailure);
+            }
+            request.offset += static_cast<std::size_t>(result);
+            if (request.offset == request.data.size())
+            {
+                request.step = Request::Sync;
+            }
+            return this->submit(request) || fail(TokenDatabase::FileWriteFailure);
+
+        case Request::Sync:
+        {
+            if (result < 0)
+            {
+                return fail(TokenDatabase::FileWriteFailure);
+            }
+            const auto closed = ::close(request.fd);
+            request.fd = -1;
+            if (closed != 0 || ::rename(temporary.c_str(), request.path.c_str()) != 0)
+            {
+                return fail(TokenDatabase::FileWriteFailure);
+            }
+
+            // sync the directory so the rename itself survives a crash
+            auto directory = request.path.substr(0, request.path.find_last_of('/') + 1);
+            if (directory.empty())
+            {
+                directory = ".";
+            }
+            request.directory = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+            if (request.directory < 0)
+            {
+                this->finish(request, TokenDatabase::Success);
+                return false;
+            }
+            request.step = Request::SyncDirectory;
+            if (this->submit(request))
+            {
+                return true;
+            }
+            ::close(request.directory);
+            this->finish(request, TokenDatabase::Success);
+            return false;
+        }
+
+        case Request::SyncDirectory:
+            ::close(request.directory);
+            this->finish(request, TokenDatabase::Success);
+            return false;
+    }
+    return false;
+}
+
+#else
+
+void AsyncFileIO::enqueue(std::unique_ptr<Request>)
+{
+}
+
+void AsyncFileIO::driver()
+{
+}
+
+bool AsyncFileIO::start(Request&)
+{
+    return false;
+}
+
+bool AsyncFileIO::submit(Request&)
+{
+    return false;
+}
+
+bool AsyncFileIO::advance(Request&, const std::int32_t&)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef ASYNCFILEIO_HPP
+#define ASYNCFILEIO_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TokenDatabase.hpp"
+
+/**
+ * Asynchronous file reads and writes
+ *
+ * Reads return the whole file, writes replace the file atomically and are
+ * synced like TokenDatabase::saveTokens(). On Linux the transfers and syncs
+ * are submitted to an io_uring and one I/O thread waits for all of them,
+ * elsewhere (and on kernels without io_uring) every operation runs on one
+ * of the worker threads.
+ *
+ * Callbacks run on the I/O thread or a worker thread, they should return
+ * quickly and hand the result over to the thread which needs it. Blocking
+ * work like imports, QR code decoding or database saves can be moved to the
+ * worker threads with run().
+ *
+ */
+class AsyncFileIO
+{
+public:
+    enum Backend {
+        Threads,
+        IoUring,
+    };
+
+    struct ReadResult
+    {
+        TokenDatabase::Error status = TokenDatabase::Success;
+        std::string data;
+    };
+
+    using ReadCallback = std::function<void(const TokenDatabase::Error &status, std::string &&data)>;
+    using WriteCallback = std::function<void(const TokenDatabase::Error &status)>;
+    using Task = std::function<void()>;
+
+    // shared instance, started on first use and stopped at exit
+    static AsyncFileIO &instance();
+
+    /**
+     * start the I/O thread and the workers, falls back to the workers
+     * if io_uring isn't available, 0 threads starts one worker
+     */
+    AsyncFileIO(const Backend &backend = IoUring, std::size_t threads = 2U);
+
+    /**
+     * finish all queued operations and stop the threads
+     */
+    ~AsyncFileIO();
+
+    AsyncFileIO(const AsyncFileIO&) = delete;
+    AsyncFileIO &operator= (const AsyncFileIO&) = delete;
+
+    inline const Backend &backend() const
+    { return this->_backend; }
+
+    // read the whole file, errors match TokenDatabase::readFile()
+    void read(const std::string &file, ReadCallback callback);
+    std::future<ReadResult> read(const std::string &file);
+
+    // replace the file with the buffer, errors match TokenDatabase::writeFile()
+    void write(const std::string &file, std::string buffer, WriteCallback callback);
+    std::future<TokenDatabase::Error> write(const std::string &file, std::string buffer);
+
+    // run a blocking task on a worker thread
+    void run(Task task);
+
+private:
+    struct Request;
+
+    void worker();
+    void driver();
+    bool start(Request &request);
+    bool submit(Request &request);
+    bool advance(Request &request, const std::int32_t &result);
+    void finish(Request &request, const TokenDatabase::Error &status);
+    void enqueue(std::unique_ptr<Request> request);
+
+    Backend _backend;
+
+    std::vector<std::thread> _workers;
+    std::mutex _tasks_mutex;
+    std::condition_variable _tasks_wakeup;
+    std::deque<Task> _tasks;
+    bool _stop = false;
+
+    // io_uring backend, requests are started by the I/O thread
+    struct Ring;
+    std::unique_ptr<Ring> _ring;
+    std::thread _driver;
+};
+
+#endif // ASYNCFILEIO_HPP
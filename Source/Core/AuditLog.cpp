@@ -0,0 +1,678 @@
+#include "AuditLog.hpp"
+#include "PerfStats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+
+#include <zlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AUDITLOG_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    static const unsigned char MAGIC[4] = {'O', 'T', 'P', 'A'};
+    static const constexpr unsigned char VERSION = 1;
+
+    static const constexpr std::size_t SALT_SIZE = 16;
+    static const constexpr std::size_t SALT_OFFSET = AuditLog::HEADER_SIZE - SALT_SIZE;
+    static const constexpr std::size_t KEY_SIZE = 32;
+    static const constexpr std::size_t NONCE_SIZE = 12;
+    static const constexpr std::size_t TAG_SIZE = 16;
+    static const char *const KEY_INFO = "OTPGen audit log";
+
+    // block header: ciphertext size | records | first time | last time | reserved
+    static const constexpr std::size_t SIZE_OFFSET = 0;
+    static const constexpr std::size_t COUNT_OFFSET = 4;
+    static const constexpr std::size_t FIRST_OFFSET = 8;
+    static const constexpr std::size_t LAST_OFFSET = 16;
+    static const constexpr std::size_t INDEX_SIZE = 8;
+
+    // larger batches are split, a reader never inflates more than this many records at once
+    static const constexpr std::size_t MAX_BLOCK_RECORDS = 1U << 16;
+
+    using Record = AuditLog::Record;
+
+    static inline void writeLE(unsigned char *out, std::uint64_t value, std::size_t bytes)
+    {
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            out[i] = static_cast<unsigned char>(value & 0xff);
+            value >>= 8;
+        }
+    }
+
+    static inline std::uint64_t readLE(const unsigned char *in, std::size_t bytes)
+    {
+        std::uint64_t value = 0;
+        for (auto i = bytes; i > 0; --i)
+        {
+            value = (value << 8) | in[i - 1];
+        }
+        return value;
+    }
+
+    static CryptoPP::SecByteBlock deriveKey(const SecureString &password, const unsigned char *salt)
+    {
+        CryptoPP::SecByteBlock key(KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(key, key.size(), reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                       salt, SALT_SIZE, reinterpret_cast<const unsigned char*>(KEY_INFO), std::strlen(KEY_INFO));
+        return key;
+    }
+
+    // the header of a block and its index in the log
+    static inline void blockAad(const unsigned char *header, std::uint64_t index, unsigned char *out)
+    {
+        std::memcpy(out, header, AuditLog::BLOCK_HEADER_SIZE);
+        writeLE(out + AuditLog::BLOCK_HEADER_SIZE, index, INDEX_SIZE);
+    }
+
+    // a block header which can't have been written by the log
+    static inline bool validHeader(const unsigned char *header)
+    {
+        const auto size = readLE(header + SIZE_OFFSET, 4);
+        const auto count = readLE(header + COUNT_OFFSET, 4);
+        return count != 0U && count <= MAX_BLOCK_RECORDS &&
+               size != 0U && size <= ::compressBound(static_cast<uLong>(count * AuditLog::RECORD_SIZE));
+    }
+
+    static inline std::size_t blockSize(const unsigned char *header)
+    {
+        return AuditLog::BLOCK_HEADER_SIZE + NONCE_SIZE + static_cast<std::size_t>(readLE(header + SIZE_OFFSET, 4)) + TAG_SIZE;
+    }
+
+    // decrypts and inflates a whole block, false if it doesn't authenticate
+    static bool openBlock(const CryptoPP::SecByteBlock &key, std::uint64_t index, const unsigned char *block,
+                          std::vector<unsigned char> &records, bool &malformed)
+    {
+        const auto size = static_cast<std::size_t>(readLE(block + SIZE_OFFSET, 4));
+        const auto count = static_cast<std::size_t>(readLE(block + COUNT_OFFSET, 4));
+        const auto nonce = block + AuditLog::BLOCK_HEADER_SIZE;
+        const auto ciphertext = nonce + NONCE_SIZE;
+
+        unsigned char aad[AuditLog::BLOCK_HEADER_SIZE + INDEX_SIZE];
+        blockAad(block, index, aad);
+        std::vector<unsigned char> compressed(size);
+        CryptoPP::GCM<CryptoPP::AES>::Decryption decryption;
+        decryption.SetKeyWithIV(key, key.size(), nonce, NONCE_SIZE);
+        if (!decryption.DecryptAndVerify(compressed.data(), ciphertext + size, TAG_SIZE, nonce, NONCE_SIZE,
+                                         aad, sizeof(aad), ciphertext, size))
+        {
+            return false;
+        }
+
+        records.resize(count * AuditLog::RECORD_SIZE);
+        auto inflated = static_cast<uLongf>(records.size());
+        malformed = ::uncompress(records.data(), &inflated, compressed.data(), static_cast<uLong>(size)) != Z_OK ||
+                    inflated != records.size();
+        return true;
+    }
+
+    // single producer (the recording thread), single consumer (the writer)
+    struct Ring
+    {
+        explicit Ring(const std::size_t &size)
+            : records(new Record[size]),
+              mask(size - 1U)
+        {}
+
+        alignas(64) std::atomic<std::uint64_t> head{0U};
+        alignas(64) std::atomic<std::uint64_t> tail{0U};
+        std::unique_ptr<Record[]> records;
+        std::uint64_t mask;
+    };
+
+    // rings of the logs this thread recorded to, by the generation of the log
+    struct ThreadRing
+    {
+        std::uint64_t generation;
+        Ring *ring;
+    };
+    static thread_local std::vector<ThreadRing> thread_rings;
+
+    // every open() is a new generation, the rings of a closed log are never found again
+    static std::atomic<std::uint64_t> generations{0U};
+}
+
+struct AuditLog::State
+{
+    std::uint64_t generation = 0U;
+    Options options;
+    std::string path;
+    CryptoPP::SecByteBlock key;
+    CryptoPP::AutoSeededRandomPool random;
+
+    // written by the writer thread only
+    std::uint64_t blocks = 0U;
+    int fd = -1;
+    // platforms without POSIX I/O
+    std::FILE *file = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::uint64_t flushRequests = 0U;
+    std::uint64_t flushesDone = 0U;
+    bool stop = false;
+
+    std::atomic<bool> pending{false};
+    std::atomic<bool> healthy{true};
+    std::atomic<std::uint64_t> written{0U};
+    std::thread writer;
+
+    ~State()
+    {
+#ifdef AUDITLOG_POSIX_IO
+        if (this->fd != -1)
+        {
+            ::close(this->fd);
+        }
+#else
+        if (this->file)
+        {
+            std::fclose(this->file);
+        }
+#endif
+    }
+
+    bool append(const unsigned char *data, std::size_t size)
+    {
+#ifdef AUDITLOG_POSIX_IO
+        while (size > 0U)
+        {
+            const auto written = ::write(this->fd, data, size);
+            if (written == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+#else
+        return std::fwrite(data, size, 1, this->file) == 1 && std::fflush(this->file) == 0;
+#endif
+    }
+
+    bool sync()
+    {
+#if defined(__APPLE__)
+        return ::fsync(this->fd) == 0;
+#elif defined(AUDITLOG_POSIX_IO)
+        return ::fdatasync(this->fd) == 0;
+#else
+        return true;
+#endif
+    }
+
+    // compresses and encrypts the records as the next block
+    bool writeBlock(const Record *records, std::size_t count)
+    {
+        std::vector<unsigned char> plain(count * RECORD_SIZE);
+        for (auto i = 0U; i < count; ++i)
+        {
+            auto out = plain.data() + i * RECORD_SIZE;
+            writeLE(out, static_cast<std::uint64_t>(records[i].time), 8);
+            writeLE(out + 8, static_cast<std::uint64_t>(records[i].token), 8);
+            out[16] = records[i].action;
+        }
+
+        // the records are sorted by time, neighbouring records share most of their bytes
+        auto size = ::compressBound(static_cast<uLong>(plain.size()));
+        std::vector<unsigned char> compressed(size);
+        if (::compress2(compressed.data(), &size, plain.data(), static_cast<uLong>(plain.size()), Z_BEST_SPEED) != Z_OK)
+        {
+            return false;
+        }
+
+        std::vector<unsigned char> block(BLOCK_HEADER_SIZE + NONCE_SIZE + size + TAG_SIZE, 0U);
+        writeLE(block.data() + SIZE_OFFSET, size, 4);
+        writeLE(block.data() + COUNT_OFFSET, count, 4);
+        writeLE(block.data() + FIRST_OFFSET, static_cast<std::uint64_t>(records[0].time), 8);
+        writeLE(block.data() + LAST_OFFSET, static_cast<std::uint64_t>(records[count - 1U].time), 8);
+
+        unsigned char aad[BLOCK_HEADER_SIZE + INDEX_SIZE];
+        blockAad(block.data(), this->blocks, aad);
+        const auto nonce = block.data() + BLOCK_HEADER_SIZE;
+        this->random.GenerateBlock(nonce, NONCE_SIZE);
+        CryptoPP::GCM<CryptoPP::AES>::Encryption encryption;
+        encryption.SetKeyWithIV(this->key, this->key.size(), nonce, NONCE_SIZE);
+        encryption.EncryptAndAuthenticate(nonce + NONCE_SIZE, nonce + NONCE_SIZE + size, TAG_SIZE,
+                                          nonce, NONCE_SIZE, aad, sizeof(aad), compressed.data(), size);
+
+        if (!this->append(block.data(), block.size()))
+        {
+            return false;
+        }
+        ++this->blocks;
+        this->written.fetch_add(count, std::memory_order_relaxed);
+        OTPGEN_PERF_COUNT(AuditRecords, count);
+        return true;
+    }
+
+    void run()
+    {
+        std::vector<Record> batch;
+        std::vector<Ring*> drained;
+        auto last_sync = std::chrono::steady_clock::now();
+        auto dirty = false;
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        for (;;)
+        {
+            this->wake.wait_for(lock, this->options.flushInterval, [this]{
+                return this->stop || this->flushRequests != this->flushesDone ||
+                       this->pending.exchange(false, std::memory_order_relaxed);
+            });
+            const auto target = this->flushRequests;
+            const auto stopping = this->stop;
+            drained.clear();
+            for (auto&& ring : this->rings)
+            {
+                drained.emplace_back(ring.get());
+            }
+            lock.unlock();
+
+            batch.clear();
+            for (auto&& ring : drained)
+            {
+                const auto tail = ring->tail.load(std::memory_order_relaxed);
+                const auto head = ring->head.load(std::memory_order_acquire);
+                for (auto i = tail; i != head; ++i)
+                {
+                    batch.emplace_back(ring->records[i & ring->mask]);
+                }
+                ring->tail.store(head, std::memory_order_release);
+            }
+
+            // a log which failed to write keeps draining, the recording threads never wait for it
+            if (!batch.empty() && this->healthy.load(std::memory_order_relaxed))
+            {
+                std::stable_sort(batch.begin(), batch.end(), [](const Record &lhs, const Record &rhs) {
+                    return lhs.time < rhs.time;
+                });
+                for (std::size_t i = 0U; i < batch.size() && this->healthy; i += MAX_BLOCK_RECORDS)
+                {
+                    if (!this->writeBlock(batch.data() + i, std::min(MAX_BLOCK_RECORDS, batch.size() - i)))
+                    {
+                        this->healthy = false;
+                    }
+                }
+                dirty = true;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if (dirty && this->healthy && (target != this->flushesDone || stopping ||
+                                           now - last_sync >= this->options.syncInterval))
+            {
+                if (!this->sync())
+                {
+                    this->healthy = false;
+                }
+                dirty = false;
+                last_sync = now;
+            }
+
+            lock.lock();
+            this->flushesDone = target;
+            this->flushed.notify_all();
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+};
+
+AuditLog::AuditLog()
+{
+}
+
+AuditLog::~AuditLog()
+{
+    this->close();
+}
+
+AuditLog::Error AuditLog::open(const std::string &path, const SecureString &password)
+{
+    return this->open(path, password, Options());
+}
+
+AuditLog::Error AuditLog::open(const std::string &path, const SecureString &password, const Options &options)
+{
+    this->close();
+
+    std::unique_ptr<State> state(new State());
+    state->generation = ++generations;
+    state->path = path;
+    state->options = options;
+    std::size_t ring_size = 64U;
+    while (ring_size < options.ringSize)
+    {
+        ring_size <<= 1U;
+    }
+    state->options.ringSize = ring_size;
+    state->options.flushInterval = std::max(options.flushInterval, std::chrono::milliseconds(1));
+
+    // find the end of the last complete block, a header which wasn't written completely starts a new log
+    std::uint64_t file_size = 0U, valid = 0U;
+    unsigned char header[HEADER_SIZE] = {};
+    {
+        std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+        if (in)
+        {
+            in.seekg(0, std::ios_base::end);
+            file_size = static_cast<std::uint64_t>(in.tellg());
+            in.seekg(0, std::ios_base::beg);
+        }
+        if (file_size >= HEADER_SIZE)
+        {
+            in.read(reinterpret_cast<char*>(header), HEADER_SIZE);
+            if (!in || std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[sizeof(MAGIC)] != VERSION)
+            {
+                return Malformed;
+            }
+            state->key = deriveKey(password, header + SALT_OFFSET);
+            valid = HEADER_SIZE;
+
+            std::uint64_t last = 0U;
+            unsigned char block_header[BLOCK_HEADER_SIZE];
+            while (valid + BLOCK_HEADER_SIZE <= file_size)
+            {
+                in.seekg(static_cast<std::streamoff>(valid));
+                in.read(reinterpret_cast<char*>(block_header), BLOCK_HEADER_SIZE);
+                if (!in || !validHeader(block_header) || valid + blockSize(block_header) > file_size)
+                {
+                    break;
+                }
+                last = valid;
+                valid += blockSize(block_header);
+                ++state->blocks;
+            }
+
+            // the last block checks the password, the writer continues after it
+            if (state->blocks != 0U)
+            {
+                in.clear();
+                in.seekg(static_cast<std::streamoff>(last));
+                std::vector<unsigned char> block(valid - last), records;
+                in.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size()));
+                auto malformed = false;
+                if (!in)
+                {
+                    return FileReadFailure;
+                }
+                if (!openBlock(state->key, state->blocks - 1U, block.data(), records, malformed))
+                {
+                    return AuthenticationFailed;
+                }
+                if (malformed)
+                {
+                    return Malformed;
+                }
+            }
+        }
+    }
+
+    if (valid == 0U)
+    {
+        std::memcpy(header, MAGIC, sizeof(MAGIC));
+        header[sizeof(MAGIC)] = VERSION;
+        state->random.GenerateBlock(header + SALT_OFFSET, SALT_SIZE);
+        state->key = deriveKey(password, header + SALT_OFFSET);
+    }
+
+#ifdef AUDITLOG_POSIX_IO
+    state->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (state->fd == -1 || ::ftruncate(state->fd, static_cast<off_t>(valid)) != 0 ||
+        ::lseek(state->fd, static_cast<off_t>(valid), SEEK_SET) == -1)
+    {
+        return FileWriteFailure;
+    }
+#else
+    if (valid != file_size)
+    {
+        std::vector<char> data(valid);
+        {
+            std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+            in.read(data.data(), static_cast<std::streamsize>(valid));
+        }
+        std::ofstream out(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(valid));
+        if (!out)
+        {
+            return FileWriteFailure;
+        }
+    }
+    state->file = std::fopen(path.c_str(), "ab");
+    if (!state->file)
+    {
+        return FileWriteFailure;
+    }
+#endif
+    if (valid == 0U && (!state->append(header, HEADER_SIZE) || !state->sync()))
+    {
+        return FileWriteFailure;
+    }
+
+    auto &writer = *state;
+    state->writer = std::thread([&writer]{ writer.run(); });
+    this->_state = std::move(state);
+    return Success;
+}
+
+void AuditLog::close()
+{
+    if (!this->_state)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->_state->mutex);
+        this->_state->stop = true;
+    }
+    this->_state->wake.notify_one();
+    this->_state->writer.join();
+    this->_state.reset();
+}
+
+void AuditLog::record(const OTPToken::sqliteTokenID &token, const Action &action) noexcept
+{
+    Record record;
+    record.time = static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    record.token = token;
+    record.action = action;
+    this->record(record);
+}
+
+void AuditLog::record(const Record &record) noexcept
+{
+    const auto state = this->_state.get();
+    if (!state)
+    {
+        return;
+    }
+
+    // the ring of this thread, created on its first record
+    Ring *ring = nullptr;
+    for (auto&& entry : thread_rings)
+    {
+        if (entry.generation == state->generation)
+        {
+            ring = entry.ring;
+            break;
+        }
+    }
+    if (!ring)
+    {
+        try {
+            std::unique_ptr<Ring> created(new Ring(state->options.ringSize));
+            ring = created.get();
+            thread_rings.push_back({state->generation, ring});
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->rings.emplace_back(std::move(created));
+        } catch (...) {
+            state->healthy = false;
+            return;
+        }
+    }
+
+    const auto head = ring->head.load(std::memory_order_relaxed);
+    auto tail = ring->tail.load(std::memory_order_acquire);
+    if (head - tail > ring->mask)
+    {
+        OTPGEN_PERF_COUNT(AuditStalls, 1U);
+        do {
+            if (!state->healthy.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            state->pending.store(true, std::memory_order_relaxed);
+            state->wake.notify_one();
+            std::this_thread::yield();
+            tail = ring->tail.load(std::memory_order_acquire);
+        } while (head - tail > ring->mask);
+    }
+
+    ring->records[head & ring->mask] = record;
+    ring->head.store(head + 1U, std::memory_order_release);
+
+    // a half full ring doesn't wait for the flush interval
+    if (head - tail == (ring->mask + 1U) / 2U)
+    {
+        state->pending.store(true, std::memory_order_relaxed);
+        state->wake.notify_one();
+    }
+}
+
+bool AuditLog::flush()
+{
+    const auto state = this->_state.get();
+    if (!state)
+    {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(state->mutex);
+    const auto target = ++state->flushRequests;
+    state->wake.notify_one();
+    state->flushed.wait(lock, [&]{ return state->flushesDone >= target; });
+    return state->healthy;
+}
+
+std::uint64_t AuditLog::written() const
+{
+    return this->_state ? this->_state->written.load(std::memory_order_relaxed) : 0U;
+}
+
+bool AuditLog::healthy() const
+{
+    return this->_state && this->_state->healthy.load(std::memory_order_relaxed);
+}
+
+AuditLog::Error AuditLog::scan(const std::string &path, const SecureString &password,
+                               const OTPToken::sqliteTokenID &token, const std::int64_t &from, const std::int64_t &to,
+                               std::vector<Record> &out)
+{
+    std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+    if (!in)
+    {
+        return FileReadFailure;
+    }
+
+    unsigned char header[HEADER_SIZE];
+    in.read(reinterpret_cast<char*>(header), HEADER_SIZE);
+    if (!in || std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[sizeof(MAGIC)] != VERSION)
+    {
+        return Malformed;
+    }
+    const auto key = deriveKey(password, header + SALT_OFFSET);
+
+    // a torn block at the end is where the writer stopped, it isn't an error
+    std::vector<unsigned char> block, records;
+    for (std::uint64_t index = 0U;; ++index)
+    {
+        block.resize(BLOCK_HEADER_SIZE);
+        in.read(reinterpret_cast<char*>(block.data()), BLOCK_HEADER_SIZE);
+        if (in.gcount() != static_cast<std::streamsize>(BLOCK_HEADER_SIZE))
+        {
+            break;
+        }
+        if (!validHeader(block.data()))
+        {
+            return Malformed;
+        }
+
+        const auto size = blockSize(block.data());
+        const auto first = static_cast<std::int64_t>(readLE(block.data() + FIRST_OFFSET, 8));
+        const auto last = static_cast<std::int64_t>(readLE(block.data() + LAST_OFFSET, 8));
+        if (last < from || first >= to)
+        {
+            in.seekg(static_cast<std::streamoff>(size - BLOCK_HEADER_SIZE), std::ios_base::cur);
+            continue;
+        }
+
+        block.resize(size);
+        in.read(reinterpret_cast<char*>(block.data() + BLOCK_HEADER_SIZE), static_cast<std::streamsize>(size - BLOCK_HEADER_SIZE));
+        if (in.gcount() != static_cast<std::streamsize>(size - BLOCK_HEADER_SIZE))
+        {
+            break;
+        }
+
+        auto malformed = false;
+        if (!openBlock(key, index, block.data(), records, malformed))
+        {
+            return AuthenticationFailed;
+        }
+        if (malformed)
+        {
+            return Malformed;
+        }
+        for (auto i = 0U; i < records.size(); i += RECORD_SIZE)
+        {
+            Record record;
+            record.time = static_cast<std::int64_t>(readLE(records.data() + i, 8));
+            record.token = static_cast<OTPToken::sqliteTokenID>(readLE(records.data() + i + 8, 8));
+            record.action = static_cast<Action>(records[i + 16]);
+            if ((token == 0 || record.token == token) && record.time >= from && record.time < to)
+            {
+                out.emplace_back(record);
+            }
+        }
+    }
+    return Success;
+}
+
+const char *AuditLog::actionName(const Action &action)
+{
+    switch (action)
+    {
+        case Generated: return "generated";
+        case Verified:  return "verified";
+        case Rejected:  return "rejected";
+        case Resynced:  return "resynced";
+        case Limited:   return "limited";
+    }
+    return "unknown";
+}
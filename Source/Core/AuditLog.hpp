@@ -0,0 +1,124 @@
+#ifndef AUDITLOG_HPP
+#define AUDITLOG_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "OTPToken.hpp"
+#include "SecureMemory.hpp"
+
+/**
+ * Append-only, encrypted log of code generations and verifications
+ *
+ * record() never writes to the file: every thread appends to its own ring
+ * buffer (single producer, single consumer, no lock) and a background
+ * writer drains all rings every flush interval. The drained records are
+ * sorted by time, compressed with zlib and encrypted as one block, the
+ * file is synced every sync interval. A thread whose ring is full waits
+ * for the writer, records are never dropped while the log can be written.
+ *
+ * Layout, all integers are little-endian:
+ *  -> header (32 bytes): magic "OTPA" | version | 11 reserved | 16 bytes salt
+ *  -> blocks: size of the ciphertext (u32) | records (u32) | first time (i64) |
+ *     last time (i64) | 8 reserved | 12 bytes random nonce | AES-256-GCM
+ *     ciphertext of the compressed records | 16 bytes tag
+ *  -> record: time (i64, unix time in milliseconds) | token id (i64) | action (u8)
+ *
+ * The key is derived from the password and the salt with HKDF-SHA256. The
+ * block header and the index of the block are authenticated, so blocks
+ * can't be changed, reordered or removed from the middle of the log. The
+ * time range of a block is readable without the password, scan() skips
+ * the blocks outside of the requested range without decrypting them, only
+ * a scan of the whole range authenticates every block.
+ *
+ * open() continues an existing log, a block which was only partially
+ * written when the process died is cut off. record() must not run
+ * concurrently with open() or close().
+ *
+ */
+class AuditLog final
+{
+public:
+    enum Error {
+        Success = 0,
+        FileWriteFailure,
+        FileReadFailure,
+        Malformed,
+        AuthenticationFailed,
+    };
+
+    enum Action : std::uint8_t {
+        Generated = 1, // a code was handed out
+        Verified,      // a code matched
+        Rejected,      // a code didn't match or was reused
+        Resynced,      // the counter of a HOTP token was resynchronized
+        Limited,       // the attempt was refused by the rate limiter
+    };
+
+    struct Record
+    {
+        // unix time in milliseconds
+        std::int64_t time = 0;
+        OTPToken::sqliteTokenID token = 0;
+        Action action = Generated;
+    };
+
+    struct Options
+    {
+        // records of a thread which fit into its ring, rounded up to a power of 2
+        std::size_t ringSize = 4096U;
+        // time between two blocks, the records are in the file at most this late
+        std::chrono::milliseconds flushInterval = std::chrono::milliseconds(200);
+        // time between two syncs of the file
+        std::chrono::milliseconds syncInterval = std::chrono::milliseconds(1000);
+    };
+
+    static const constexpr std::size_t HEADER_SIZE = 32U;
+    static const constexpr std::size_t BLOCK_HEADER_SIZE = 32U;
+    static const constexpr std::size_t RECORD_SIZE = 17U;
+
+    AuditLog();
+    ~AuditLog();
+
+    AuditLog(const AuditLog&) = delete;
+    AuditLog &operator=(const AuditLog&) = delete;
+
+    // creates the log or continues the existing one, which must have the same password
+    Error open(const std::string &path, const SecureString &password);
+    Error open(const std::string &path, const SecureString &password, const Options &options);
+    // writes the pending records and stops the writer
+    void close();
+
+    inline bool isOpen() const
+    { return this->_state != nullptr; }
+
+    // records the action at the current time, does nothing if the log isn't open
+    void record(const OTPToken::sqliteTokenID &token, const Action &action) noexcept;
+    void record(const Record &record) noexcept;
+
+    // waits until the records of this thread are written and synced, false if writing failed
+    bool flush();
+
+    // records written to the file
+    std::uint64_t written() const;
+    // false once a write failed, the log drops all records from then on
+    bool healthy() const;
+
+    // records of the token (0 for all tokens) with from <= time < to, in the order of the log
+    static Error scan(const std::string &path, const SecureString &password,
+                      const OTPToken::sqliteTokenID &token, const std::int64_t &from, const std::int64_t &to,
+                      std::vector<Record> &out);
+
+    static const char *actionName(const Action &action);
+
+private:
+    // rings, writer thread and file of the open log
+    struct State;
+    std::unique_ptr<State> _state;
+};
+
+#endif // AUDITLOG_HPP
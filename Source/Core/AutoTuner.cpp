@@ -0,0 +1,571 @@
+#include "AutoTuner.hpp"
+
+#include "BatchEngine.hpp"
+#include "OTPGen.hpp"
+#include "ThreadPool.hpp"
+
+#include "Internal/AtomicFile.hpp"
+#include "Internal/Sha1MultiBuffer.hpp"
+#include "Internal/Sha2MultiBuffer.hpp"
+#include "Internal/ShaCompress.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+    // increased when the file format or the meaning of a decision changes
+    static const constexpr unsigned FORMAT_VERSION = 1U;
+
+    static const constexpr OTPToken::ShaAlgorithm ALGORITHMS[] = {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512};
+
+    struct ShaBackendName
+    {
+        Internal::ShaBackend backend;
+        const char *name;
+    };
+    static const constexpr ShaBackendName SHA_BACKENDS[] = {
+        {Internal::ShaBackend::Portable, "portable"},
+        {Internal::ShaBackend::SHANI, "shani"},
+        {Internal::ShaBackend::ARMv8, "armv8"},
+    };
+
+    struct MultiBufferBackendName
+    {
+        Internal::Sha1MultiBufferBackend backend;
+        const char *name;
+    };
+    static const constexpr MultiBufferBackendName MULTI_BUFFER_BACKENDS[] = {
+        {Internal::Sha1MultiBufferBackend::Scalar, "scalar"},
+        {Internal::Sha1MultiBufferBackend::SSE2, "sse2"},
+        {Internal::Sha1MultiBufferBackend::AVX2, "avx2"},
+        {Internal::Sha1MultiBufferBackend::AVX512, "avx512"},
+        {Internal::Sha1MultiBufferBackend::NEON, "neon"},
+        {Internal::Sha1MultiBufferBackend::WasmSIMD128, "simd128"},
+    };
+
+    // every measurement is the fastest of a few runs, the first one also warms the caches
+    static const constexpr unsigned RUNS = 3U;
+    // codes of the single token generators per backend
+    static const constexpr std::size_t SINGLE_CODES = 2048U;
+    // keys of the multi-buffer comparison, enough to fill the lanes many times
+    static const constexpr std::size_t MULTI_BUFFER_KEYS = 1024U;
+    // more threads must add this much throughput to be worth using
+    static const constexpr double THREAD_GAIN = 1.05;
+    static const constexpr std::size_t GRAINS[] = {256U, 512U, 1024U, 2048U, 4096U};
+    // keys of the offload comparison, the sizes grow by 4 until the engine wins
+    static const constexpr std::size_t OFFLOAD_KEYS = 64U;
+    static const constexpr std::size_t OFFLOAD_MIN_WORK = std::size_t(1U) << 12U;
+    static const constexpr std::size_t OFFLOAD_MAX_WORK = std::size_t(1U) << 22U;
+
+    static const constexpr std::time_t BENCH_TIME = 1536573862;
+
+    static std::mutex current_mutex;
+    static AutoTuner::Result current_result;
+
+    template<typename Function>
+    static std::uint64_t fastest_ns(const Function &function)
+    {
+        auto best = std::numeric_limits<std::uint64_t>::max();
+        for (auto i = 0U; i < RUNS; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            function();
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, static_cast<std::uint64_t>(std::max<std::int64_t>(ns, 1)));
+        }
+        return best;
+    }
+
+    // distinct keys of the usual secret sizes, their bytes don't matter for the timing
+    static std::vector<OTPKey> synthetic_keys(const OTPToken::ShaAlgorithm &algorithm, std::size_t count)
+    {
+        const auto size = algorithm == OTPToken::SHA512 ? 64U : algorithm == OTPToken::SHA256 ? 32U : 20U;
+        std::vector<OTPKey> keys;
+        keys.reserve(count);
+        unsigned char secret[64];
+        for (std::size_t i = 0U; i < count; ++i)
+        {
+            for (auto j = 0U; j < size; ++j)
+            {
+                secret[j] = static_cast<unsigned char>(i * 131U + j * 7U + 1U);
+            }
+            keys.emplace_back(OTPGen::prepareRawKey(secret, size, algorithm));
+        }
+        return keys;
+    }
+
+    static std::size_t algorithm_index(const OTPToken::ShaAlgorithm &algorithm)
+    {
+        return algorithm == OTPToken::SHA512 ? 2U : algorithm == OTPToken::SHA256 ? 1U : 0U;
+    }
+
+    static const char *sha_backend_name(const Internal::ShaBackend &backend)
+    {
+        for (auto&& entry : SHA_BACKENDS)
+        {
+            if (entry.backend == backend) return entry.name;
+        }
+        return "";
+    }
+
+    static const char *multi_buffer_backend_name(const Internal::Sha1MultiBufferBackend &backend)
+    {
+        for (auto&& entry : MULTI_BUFFER_BACKENDS)
+        {
+            if (entry.backend == backend) return entry.name;
+        }
+        return "";
+    }
+
+    // the first model line of /proc/cpuinfo (x86: model name, ARM: Hardware or CPU part)
+    static std::string cpu_model()
+    {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        std::string model;
+        while (std::getline(cpuinfo, line))
+        {
+            const auto colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            auto key = line.substr(0U, colon);
+            key.erase(key.find_last_not_of(" \t") + 1U);
+            if (key == "model name" || key == "Hardware" || (model.empty() && key == "CPU part"))
+            {
+                const auto value = line.find_first_not_of(" \t", colon + 1U);
+                model = value == std::string::npos ? std::string() : line.substr(value);
+                if (key != "CPU part")
+                {
+                    break;
+                }
+            }
+        }
+        std::replace(model.begin(), model.end(), '\t', ' ');
+        return model.empty() ? "unknown" : model;
+    }
+}
+
+const AutoTuner::Choice *AutoTuner::Result::choice(const OTPToken::ShaAlgorithm &algorithm) const
+{
+    const auto it = std::find_if(this->choices.begin(), this->choices.end(), [&](const Choice &choice) {
+        return choice.algorithm == algorithm;
+    });
+    return it == this->choices.end() ? nullptr : &*it;
+}
+
+std::size_t AutoTuner::Result::threads() const
+{
+    std::size_t threads = 0U;
+    for (auto&& choice : this->choices)
+    {
+        threads = std::max(threads, choice.threads);
+    }
+    return threads;
+}
+
+AutoTuner::Result AutoTuner::calibrate()
+{
+    return calibrate(Options());
+}
+
+AutoTuner::Result AutoTuner::calibrate(const Options &options)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    // everything is measured on the process settings, which are restored afterwards
+    const auto previous_sha = Internal::shaBackend();
+    const auto previous_multi_buffer = Internal::sha1MultiBufferBackend();
+    const auto previous_offload = OTPGen::offloadMinimumWork();
+    std::size_t previous_grains[3];
+    for (auto&& algorithm : ALGORITHMS)
+    {
+        previous_grains[algorithm_index(algorithm)] = OTPGen::batchGrain(algorithm);
+    }
+
+    Result result;
+    result.machine = machine();
+
+    const auto batch_keys = std::max<std::size_t>(options.batchKeys, MULTI_BUFFER_KEYS);
+    std::vector<OTPKey> keys[3];
+    for (auto&& algorithm : ALGORITHMS)
+    {
+        keys[algorithm_index(algorithm)] = synthetic_keys(algorithm, batch_keys);
+    }
+    std::vector<OTPToken::TokenString> out;
+
+    // single block compression of the single token generators, SHA-512 is always portable
+    auto best_ns = std::numeric_limits<std::uint64_t>::max();
+    auto best_sha = previous_sha;
+    for (auto&& entry : SHA_BACKENDS)
+    {
+        if (!Internal::setShaBackend(entry.backend))
+        {
+            continue;
+        }
+        const auto ns = fastest_ns([&]{
+            OTPGen::TokenBuffer code;
+            for (std::size_t i = 0U; i < SINGLE_CODES; ++i)
+            {
+                const auto &key = keys[i % 2U][i % MULTI_BUFFER_KEYS];
+                (void) OTPGen::computeTOTPInto(code, BENCH_TIME + static_cast<std::time_t>(i) * 30, key, 6U, 30U);
+            }
+        });
+        if (ns < best_ns)
+        {
+            best_ns = ns;
+            best_sha = entry.backend;
+        }
+    }
+    Internal::setShaBackend(best_sha);
+    result.shaBackend = sha_backend_name(best_sha);
+
+    // multi-buffer lanes, one backend for all algorithms, scored by the time relative to the fastest
+    // backend of every algorithm so that SHA-512 doesn't decide alone
+    std::vector<Internal::Sha1MultiBufferBackend> backends;
+    std::vector<std::uint64_t> times;
+    for (auto&& entry : MULTI_BUFFER_BACKENDS)
+    {
+        if (!Internal::setSha1MultiBufferBackend(entry.backend))
+        {
+            continue;
+        }
+        backends.emplace_back(entry.backend);
+        for (auto&& algorithm : ALGORITHMS)
+        {
+            const std::vector<OTPKey> subset(keys[algorithm_index(algorithm)].begin(),
+                                              keys[algorithm_index(algorithm)].begin() + MULTI_BUFFER_KEYS);
+            times.emplace_back(fastest_ns([&]{
+                OTPGen::computeTOTPBatch(BENCH_TIME, subset, 6U, 30U, out);
+            }));
+        }
+    }
+    auto best_multi_buffer = previous_multi_buffer;
+    auto best_score = std::numeric_limits<double>::max();
+    for (std::size_t b = 0U; b < backends.size(); ++b)
+    {
+        double score = 0.0;
+        for (std::size_t a = 0U; a < 3U; ++a)
+        {
+            auto fastest = std::numeric_limits<std::uint64_t>::max();
+            for (std::size_t other = 0U; other < backends.size(); ++other)
+            {
+                fastest = std::min(fastest, times[other * 3U + a]);
+            }
+            score += static_cast<double>(times[b * 3U + a]) / static_cast<double>(fastest);
+        }
+        if (score < best_score)
+        {
+            best_score = score;
+            best_multi_buffer = backends[b];
+        }
+    }
+    Internal::setSha1MultiBufferBackend(best_multi_buffer);
+    result.multiBufferBackend = multi_buffer_backend_name(best_multi_buffer);
+    result.lanes = Internal::sha1MultiBufferLanes();
+
+    // thread counts, doubling up to the hardware threads, a pool per count serves all algorithms
+    const auto hardware = std::max<std::size_t>(1U, std::thread::hardware_concurrency());
+    const auto max_threads = options.maxThreads != 0U ? std::min(options.maxThreads, hardware) : hardware;
+    std::vector<std::size_t> thread_counts;
+    for (std::size_t n = 1U; n < max_threads; n *= 2U)
+    {
+        thread_counts.emplace_back(n);
+    }
+    thread_counts.emplace_back(max_threads);
+
+    std::vector<std::uint64_t> thread_times(thread_counts.size() * 3U);
+    for (std::size_t t = 0U; t < thread_counts.size(); ++t)
+    {
+        std::unique_ptr<ThreadPool> pool(thread_counts[t] > 1U ? new ThreadPool(thread_counts[t]) : nullptr);
+        for (auto&& algorithm : ALGORITHMS)
+        {
+            OTPGen::setBatchGrain(algorithm, OTPGen::DEFAULT_BATCH_GRAIN);
+            thread_times[t * 3U + algorithm_index(algorithm)] = fastest_ns([&]{
+                OTPGen::computeTOTPBatch(BENCH_TIME, keys[algorithm_index(algorithm)], 6U, 30U, out, nullptr, pool.get());
+            });
+        }
+    }
+
+    for (auto&& algorithm : ALGORITHMS)
+    {
+        const auto a = algorithm_index(algorithm);
+        auto fastest = std::numeric_limits<std::uint64_t>::max();
+        for (std::size_t t = 0U; t < thread_counts.size(); ++t)
+        {
+            fastest = std::min(fastest, thread_times[t * 3U + a]);
+        }
+
+        // the fewest threads which come close to the fastest
+        Choice choice;
+        choice.algorithm = algorithm;
+        for (std::size_t t = 0U; t < thread_counts.size(); ++t)
+        {
+            if (static_cast<double>(thread_times[t * 3U + a]) <= static_cast<double>(fastest) * THREAD_GAIN)
+            {
+                choice.threads = thread_counts[t];
+                break;
+            }
+        }
+
+        // the grain only matters when the batch is split
+        choice.grain = OTPGen::DEFAULT_BATCH_GRAIN;
+        auto grain_ns = std::numeric_limits<std::uint64_t>::max();
+        if (choice.threads > 1U)
+        {
+            ThreadPool pool(choice.threads);
+            for (auto&& grain : GRAINS)
+            {
+                OTPGen::setBatchGrain(algorithm, grain);
+                const auto ns = fastest_ns([&]{
+                    OTPGen::computeTOTPBatch(BENCH_TIME, keys[a], 6U, 30U, out, nullptr, &pool);
+                });
+                if (ns < grain_ns)
+                {
+                    grain_ns = ns;
+                    choice.grain = grain;
+                }
+            }
+        }
+        else
+        {
+            grain_ns = fastest;
+        }
+        choice.codesPerSecond = static_cast<double>(batch_keys) * 1e9 / static_cast<double>(grain_ns);
+        result.choices.emplace_back(choice);
+    }
+
+    // offload threshold, the first job size at which the engine beats the CPU
+    const auto engine = OTPGen::batchEngine();
+    if (options.offload && engine && engine->supports(OTPToken::SHA1))
+    {
+        result.offloadMinimumWork = std::numeric_limits<std::size_t>::max();
+
+        const auto sha1 = result.choice(OTPToken::SHA1);
+        std::unique_ptr<ThreadPool> pool(sha1->threads > 1U ? new ThreadPool(sha1->threads) : nullptr);
+        const std::vector<OTPKey> offload_keys(keys[0].begin(), keys[0].begin() + OFFLOAD_KEYS);
+        const std::vector<std::uint64_t> first(OFFLOAD_KEYS, 0U);
+        std::vector<std::uint32_t> values;
+
+        // the CPU path is forced by a threshold nothing reaches
+        OTPGen::setOffloadMinimumWork(std::numeric_limits<std::size_t>::max());
+        for (auto work = OFFLOAD_MIN_WORK; work <= OFFLOAD_MAX_WORK; work *= 4U)
+        {
+            const auto count = work / OFFLOAD_KEYS;
+            values.resize(work);
+            auto failed = false;
+            const auto engine_ns = fastest_ns([&]{
+                failed |= !engine->computeHOTPValues(offload_keys.data(), OFFLOAD_KEYS, first.data(), count, 6U, values.data());
+            });
+            if (failed)
+            {
+                break;
+            }
+            const auto cpu_ns = fastest_ns([&]{
+                OTPGen::computeHOTPValues(offload_keys, first, count, 6U, values, nullptr, pool.get());
+            });
+            if (engine_ns < cpu_ns)
+            {
+                result.offloadMinimumWork = work;
+                break;
+            }
+        }
+    }
+
+    Internal::setShaBackend(previous_sha);
+    Internal::setSha1MultiBufferBackend(previous_multi_buffer);
+    OTPGen::setOffloadMinimumWork(previous_offload);
+    for (auto&& algorithm : ALGORITHMS)
+    {
+        OTPGen::setBatchGrain(algorithm, previous_grains[algorithm_index(algorithm)]);
+    }
+
+    result.calibrationNs = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    return result;
+}
+
+void AutoTuner::apply(const Result &result)
+{
+    for (auto&& entry : SHA_BACKENDS)
+    {
+        if (result.shaBackend == entry.name)
+        {
+            (void) Internal::setShaBackend(entry.backend);
+        }
+    }
+    for (auto&& entry : MULTI_BUFFER_BACKENDS)
+    {
+        if (result.multiBufferBackend == entry.name)
+        {
+            (void) Internal::setSha1MultiBufferBackend(entry.backend);
+        }
+    }
+    for (auto&& choice : result.choices)
+    {
+        OTPGen::setBatchGrain(choice.algorithm, choice.grain);
+    }
+    OTPGen::setOffloadMinimumWork(result.offloadMinimumWork);
+
+    std::lock_guard<std::mutex> lock(current_mutex);
+    current_result = result;
+}
+
+AutoTuner::Result AutoTuner::current()
+{
+    std::lock_guard<std::mutex> lock(current_mutex);
+    return current_result;
+}
+
+AutoTuner::Result AutoTuner::load(const std::string &path)
+{
+    return load(path, Options());
+}
+
+AutoTuner::Result AutoTuner::load(const std::string &path, const Options &options)
+{
+    Result result;
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (file)
+    {
+        std::stringstream text;
+        text << file.rdbuf();
+        if (parse(text.str(), result) && result.machine == machine())
+        {
+            result.cached = true;
+            apply(result);
+            return result;
+        }
+    }
+
+    // a failed write only costs a calibration at the next start
+    result = calibrate(options);
+    const auto text = serialize(result);
+    Internal::AtomicFile out;
+    if (out.open(path) && out.write(text.data(), text.size()))
+    {
+        (void) out.commit();
+    }
+    apply(result);
+    return result;
+}
+
+bool AutoTuner::parse(const std::string &text, Result &result)
+{
+    Result parsed;
+    auto version = false;
+    std::istringstream lines(text);
+    std::string line;
+    try {
+        while (std::getline(lines, line))
+        {
+            std::vector<std::string> fields;
+            std::istringstream words(line);
+            std::string word;
+            while (std::getline(words, word, '\t'))
+            {
+                fields.emplace_back(word);
+            }
+            if (fields.size() < 2U)
+            {
+                continue;
+            }
+
+            const auto &key = fields.at(0);
+            if (key == "version")
+            {
+                if (std::stoul(fields.at(1)) != FORMAT_VERSION)
+                {
+                    return false;
+                }
+                version = true;
+            }
+            else if (key == "machine") parsed.machine = fields.at(1);
+            else if (key == "sha") parsed.shaBackend = fields.at(1);
+            else if (key == "multibuffer") parsed.multiBufferBackend = fields.at(1);
+            else if (key == "lanes") parsed.lanes = std::stoul(fields.at(1));
+            else if (key == "offload") parsed.offloadMinimumWork = static_cast<std::size_t>(std::stoull(fields.at(1)));
+            else if (key == "calibration") parsed.calibrationNs = std::stoull(fields.at(1));
+            else if (key == "choice" && fields.size() == 5U)
+            {
+                Choice choice;
+                const auto algorithm = std::stoul(fields.at(1));
+                if (algorithm < OTPToken::SHA1 || algorithm > OTPToken::SHA512)
+                {
+                    return false;
+                }
+                choice.algorithm = static_cast<OTPToken::ShaAlgorithm>(algorithm);
+                choice.grain = std::stoul(fields.at(2));
+                choice.threads = std::stoul(fields.at(3));
+                choice.codesPerSecond = std::stod(fields.at(4));
+                parsed.choices.emplace_back(choice);
+            }
+        }
+    } catch (...) {
+        return false;
+    }
+
+    if (!version || !parsed.valid())
+    {
+        return false;
+    }
+    result = std::move(parsed);
+    return true;
+}
+
+const std::string AutoTuner::serialize(const Result &result)
+{
+    std::string text;
+    text += "version\t" + std::to_string(FORMAT_VERSION) + "\n";
+    text += "machine\t" + result.machine + "\n";
+    text += "sha\t" + result.shaBackend + "\n";
+    text += "multibuffer\t" + result.multiBufferBackend + "\n";
+    text += "lanes\t" + std::to_string(result.lanes) + "\n";
+    text += "offload\t" + std::to_string(result.offloadMinimumWork) + "\n";
+    text += "calibration\t" + std::to_string(result.calibrationNs) + "\n";
+    for (auto&& choice : result.choices)
+    {
+        char rate[32];
+        std::snprintf(rate, sizeof(rate), "%.6g", choice.codesPerSecond);
+        text += "choice\t" + std::to_string(static_cast<unsigned>(choice.algorithm)) + "\t" + std::to_string(choice.grain) +
+                "\t" + std::to_string(choice.threads) + "\t" + rate + "\n";
+    }
+    return text;
+}
+
+const std::string AutoTuner::machine()
+{
+    return cpu_model() + " / " + std::to_string(std::thread::hardware_concurrency()) + " threads / v" + std::to_string(FORMAT_VERSION);
+}
+
+void AutoTuner::appendGauges(const Result &result, std::vector<PerfStats::Gauge> &gauges)
+{
+    if (!result.valid())
+    {
+        return;
+    }
+
+    static const char *const NAMES[] = {"", "sha1", "sha256", "sha512"};
+    gauges.push_back({"tuning_sha_extensions", "Single tokens use the SHA instructions of the CPU",
+                      result.shaBackend == "portable" ? 0.0 : 1.0});
+    gauges.push_back({"tuning_lanes", "SHA-1 lanes of the selected multi-buffer backend", static_cast<double>(result.lanes)});
+    gauges.push_back({"tuning_offload_minimum_work", "Smallest job of the batch engine (0: decided by the engine)",
+                      static_cast<double>(result.offloadMinimumWork)});
+    gauges.push_back({"tuning_calibration_seconds", "Duration of the calibration", static_cast<double>(result.calibrationNs) / 1e9});
+    gauges.push_back({"tuning_cached", "The tuning was loaded from the file of an earlier calibration", result.cached ? 1.0 : 0.0});
+    for (auto&& choice : result.choices)
+    {
+        const std::string name = NAMES[choice.algorithm];
+        gauges.push_back({"tuning_" + name + "_grain", "Keys per batch task of " + name + " keys", static_cast<double>(choice.grain)});
+        gauges.push_back({"tuning_" + name + "_threads", "Threads worth using for " + name + " batches", static_cast<double>(choice.threads)});
+        gauges.push_back({"tuning_" + name + "_codes_per_second", "Calibrated batch throughput of " + name + " keys", choice.codesPerSecond});
+    }
+}
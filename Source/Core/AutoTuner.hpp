@@ -0,0 +1,111 @@
+#ifndef AUTOTUNER_HPP
+#define AUTOTUNER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "OTPToken.hpp"
+#include "PerfStats.hpp"
+
+/**
+ * Calibration of the code generators for the running machine
+ *
+ * Which backend is the fastest depends on the CPU: the SHA extensions beat
+ * the portable compression on most CPUs but not on all of them, the widest
+ * SIMD lanes lose to narrower ones on CPUs which lower their clock for
+ * them, and the grain of the executor tasks and the amount of threads
+ * worth using depend on the caches and the cores. calibrate() times short
+ * runs of every backend the CPU supports on synthetic keys and leaves the
+ * process as it found it, apply() installs the decisions process wide.
+ *
+ * A calibration takes a few hundred milliseconds, load() keeps its result
+ * in a file per machine (in the config directory of the daemon and the
+ * server) and only measures again on another CPU or after the format of
+ * the file changed.
+ *
+ * The installed decisions are reported through current(), as gauges of
+ * the metrics endpoints and as tuning lines of the daemon stats.
+ *
+ */
+class AutoTuner
+{
+public:
+    // decisions for the keys of one algorithm
+    struct Choice
+    {
+        OTPToken::ShaAlgorithm algorithm = OTPToken::SHA1;
+        // keys per executor task of the batch generators (see OTPGen::setBatchGrain)
+        std::size_t grain = 0U;
+        // threads worth using for batches, more threads didn't add throughput
+        std::size_t threads = 1U;
+        // batch throughput with the grain and the threads
+        double codesPerSecond = 0.0;
+    };
+
+    struct Result
+    {
+        // machine the result was measured on, see machine()
+        std::string machine;
+        // single block compression (see Internal::ShaBackend) and multi-buffer lanes
+        std::string shaBackend;
+        std::string multiBufferBackend;
+        std::size_t lanes = 0U;
+        // SHA1, SHA256 and SHA512
+        std::vector<Choice> choices;
+        // smallest job worth the batch engine, 0 without an installed engine (it decides itself),
+        // SIZE_MAX when the CPU won at every size
+        std::size_t offloadMinimumWork = 0U;
+        std::uint64_t calibrationNs = 0U;
+        // taken from the file of load() instead of measured
+        bool cached = false;
+
+        bool valid() const
+        { return !this->choices.empty(); }
+
+        // nullptr for algorithms which weren't measured
+        const Choice *choice(const OTPToken::ShaAlgorithm &algorithm) const;
+
+        // threads worth using for a mix of all algorithms, 0 when not calibrated
+        std::size_t threads() const;
+    };
+
+    struct Options
+    {
+        // most threads tried, 0 for one per hardware thread
+        std::size_t maxThreads = 0U;
+        // keys of the timed batches
+        std::size_t batchKeys = 8192U;
+        // also time the installed batch engine (see OTPGen::setBatchEngine) against the CPU
+        bool offload = true;
+    };
+
+    // measures the backends, the grains and the thread counts, the process keeps its settings
+    static Result calibrate();
+    static Result calibrate(const Options &options);
+
+    // installs the backends, the grains and the offload threshold of the result, unsupported
+    // backends (a result of another machine) are skipped
+    static void apply(const Result &result);
+
+    // the result applied last, invalid before
+    static Result current();
+
+    // the result stored for this machine in the file, or a new calibration which is stored there,
+    // the result is applied either way
+    static Result load(const std::string &path);
+    static Result load(const std::string &path, const Options &options);
+
+    // text form of the file, false for results of another format version
+    static bool parse(const std::string &text, Result &result);
+    static const std::string serialize(const Result &result);
+
+    // the CPU model, the hardware threads and the version of the file format
+    static const std::string machine();
+
+    // the decisions as gauges, prefixed with tuning_
+    static void appendGauges(const Result &result, std::vector<PerfStats::Gauge> &gauges);
+};
+
+#endif // AUTOTUNER_HPP
@@ -0,0 +1,44 @@
+#ifndef BATCHENGINE_HPP
+#define BATCHENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "OTPToken.hpp"
+
+class OTPKey;
+
+/**
+ * Offload interface for large series of HOTP values
+ *
+ * An engine computes the truncated HOTP values (the codes as numbers) of
+ * consecutive counters for many prepared keys at once on hardware of its
+ * own, like a GPU (see OpenCLEngine). OTPGen::computeHOTPValues() and
+ * OTPGen::resyncHOTPBatch() hand jobs to the installed engine when every
+ * key is supported and the job is large enough, everything else and every
+ * job the engine fails on is computed on the CPU.
+ *
+ * TOTP codes of a time range are the HOTP values of the counters
+ * time / period.
+ *
+ */
+class BatchEngine
+{
+public:
+    virtual ~BatchEngine() = default;
+
+    // checks if the engine computes keys of the algorithm
+    virtual bool supports(const OTPToken::ShaAlgorithm &algorithm) const = 0;
+
+    // smallest amount of values (keys * count) worth the transfer to the engine
+    virtual std::size_t minimumWork() const = 0;
+
+    // values of the counters first[i]..first[i] + count - 1 of the valid key i, out holds
+    // key_count * count values key by key, returns false if the job failed
+    virtual bool computeHOTPValues(const OTPKey *keys, std::size_t key_count,
+                                   const std::uint64_t *first, std::size_t count,
+                                   const OTPToken::DigitType &digits,
+                                   std::uint32_t *out) = 0;
+};
+
+#endif // BATCHENGINE_HPP
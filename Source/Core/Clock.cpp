@@ -0,0 +1,86 @@
+#include "Clock.hpp"
+
+namespace {
+    static std::atomic<const Clock*> default_clock{nullptr};
+    static std::atomic<std::time_t> steam_offset{0};
+}
+
+const Clock &Clock::defaultClock()
+{
+    const auto clock = default_clock.load(std::memory_order_acquire);
+    return clock ? *clock : SystemClock::instance();
+}
+
+void Clock::setDefaultClock(const Clock *clock)
+{
+    default_clock.store(clock, std::memory_order_release);
+}
+
+std::time_t Clock::current()
+{
+    return defaultClock().now();
+}
+
+void Clock::setSteamOffset(const std::time_t &offset)
+{
+    steam_offset.store(offset, std::memory_order_relaxed);
+}
+
+std::time_t Clock::steamOffset()
+{
+    return steam_offset.load(std::memory_order_relaxed);
+}
+
+std::time_t SystemClock::now() const
+{
+    // time() reads the coarse clock from the vDSO on Linux, which is faster than
+    // clock_gettime(CLOCK_REALTIME_COARSE) and has the seconds resolution we need
+    return std::time(nullptr);
+}
+
+const SystemClock &SystemClock::instance()
+{
+    static const SystemClock clock;
+    return clock;
+}
+
+FixedClock::FixedClock(const std::time_t &time)
+    : _time(time)
+{
+}
+
+std::time_t FixedClock::now() const
+{
+    return this->_time.load(std::memory_order_relaxed);
+}
+
+void FixedClock::set(const std::time_t &time)
+{
+    this->_time.store(time, std::memory_order_relaxed);
+}
+
+void FixedClock::advance(const std::time_t &seconds)
+{
+    this->_time.fetch_add(seconds, std::memory_order_relaxed);
+}
+
+OffsetClock::OffsetClock(const Clock &source, const std::time_t &offset)
+    : _source(source),
+      _offset(offset)
+{
+}
+
+std::time_t OffsetClock::now() const
+{
+    return this->_source.now() + this->_offset.load(std::memory_order_relaxed);
+}
+
+void OffsetClock::setOffset(const std::time_t &offset)
+{
+    this->_offset.store(offset, std::memory_order_relaxed);
+}
+
+std::time_t OffsetClock::offset() const
+{
+    return this->_offset.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,91 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <atomic>
+#include <ctime>
+
+/**
+ * Time source for code generation
+ *
+ * The APIs without an explicit time read the default clock, which is the
+ * system clock unless another one is installed. Batch callers read the
+ * clock once and pass the time to every token.
+ *
+ *  -> SystemClock: coarse wall clock, served from the vDSO where available
+ *  -> FixedClock: injected time for replays, tests and benchmarks
+ *  -> OffsetClock: another clock corrected by an offset, e.g. from NTP
+ *
+ * Steam codes are only accepted at the time of the Steam servers, the token
+ * level APIs (OTPToken, TokenSet, TokenCodeCache, ...) compute them at the
+ * time of the default clock corrected by the Steam offset, which the
+ * SteamTimeService measures. The functions taking a prepared key compute
+ * at exactly the given time.
+ *
+ * Implementations must be safe to call from multiple threads.
+ *
+ */
+class Clock
+{
+public:
+    virtual ~Clock() = default;
+
+    // seconds since the epoch
+    virtual std::time_t now() const = 0;
+
+    // the clock used when no time is given, the system clock by default,
+    // the installed clock must outlive its use, nullptr restores the system clock
+    static const Clock &defaultClock();
+    static void setDefaultClock(const Clock *clock);
+
+    // shorthand for defaultClock().now()
+    static std::time_t current();
+
+    // seconds the clock of the Steam servers is ahead of the default clock, 0 by default
+    static void setSteamOffset(const std::time_t &offset);
+    static std::time_t steamOffset();
+    // the time of the Steam servers at the given time of the default clock
+    static inline std::time_t steamTime(const std::time_t &time)
+    { return time + steamOffset(); }
+};
+
+class SystemClock final : public Clock
+{
+public:
+    std::time_t now() const override;
+
+    // shared instance
+    static const SystemClock &instance();
+};
+
+class FixedClock final : public Clock
+{
+public:
+    explicit FixedClock(const std::time_t &time = 0);
+
+    std::time_t now() const override;
+
+    void set(const std::time_t &time);
+    void advance(const std::time_t &seconds);
+
+private:
+    std::atomic<std::time_t> _time;
+};
+
+class OffsetClock final : public Clock
+{
+public:
+    // the source must outlive this clock
+    explicit OffsetClock(const Clock &source, const std::time_t &offset = 0);
+
+    std::time_t now() const override;
+
+    // seconds added to the source time, negative when the source is ahead
+    void setOffset(const std::time_t &offset);
+    std::time_t offset() const;
+
+private:
+    const Clock &_source;
+    std::atomic<std::time_t> _offset;
+};
+
+#endif // CLOCK_HPP
@@ -0,0 +1,60 @@
+#include "ClockDrift.hpp"
+
+#include <algorithm>
+#include <limits>
+
+ClockDrift ClockDrift::unpack(const Packed &packed)
+{
+    ClockDrift drift;
+    drift._offset = static_cast<std::int8_t>(packed & 0xffU);
+    drift._confidence = static_cast<std::uint8_t>(std::min<unsigned>(packed >> 8U, MAX_CONFIDENCE));
+    return drift;
+}
+
+ClockDrift::Packed ClockDrift::pack() const
+{
+    return static_cast<Packed>((static_cast<unsigned>(this->_confidence) << 8U) | static_cast<std::uint8_t>(this->_offset));
+}
+
+int ClockDrift::probe(const unsigned &n, const unsigned &window) const
+{
+    const auto w = static_cast<int>(window);
+    const auto center = std::max(-w, std::min(w, static_cast<int>(this->_offset)));
+
+    // offsets on both sides of the center alternate until one side reaches the end
+    // of the window, the remaining ones of the other side follow in order
+    const auto above = w - center;
+    const auto below = center + w;
+    const auto i = static_cast<int>(n);
+    const auto both = 2 * std::min(above, below);
+
+    if (i == 0)
+    {
+        return center;
+    }
+    if (i <= both)
+    {
+        return (i & 1) ? center + (i + 1) / 2 : center - i / 2;
+    }
+    const auto rest = i - both + std::min(above, below);
+    return above > below ? center + rest : center - rest;
+}
+
+void ClockDrift::learn(const int &step)
+{
+    const auto clamped = static_cast<std::int8_t>(std::max<int>(std::numeric_limits<std::int8_t>::min(),
+                                                  std::min<int>(std::numeric_limits<std::int8_t>::max(), step)));
+
+    if (this->_confidence != 0U && clamped == this->_offset)
+    {
+        this->_confidence = static_cast<std::uint8_t>(std::min<unsigned>(this->_confidence + 1U, MAX_CONFIDENCE));
+        return;
+    }
+
+    this->_confidence = static_cast<std::uint8_t>(this->_confidence / 2U);
+    if (this->_confidence == 0U)
+    {
+        this->_offset = clamped;
+        this->_confidence = 1U;
+    }
+}
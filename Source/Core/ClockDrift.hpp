@@ -0,0 +1,57 @@
+#ifndef CLOCKDRIFT_HPP
+#define CLOCKDRIFT_HPP
+
+#include <cstdint>
+
+/**
+ * Learned clock skew of a time-based token
+ *
+ * Remembers the step offset at which the codes of a token matched in past
+ * verifications, so verification can compute the most likely step first and
+ * stop at the first match instead of computing the whole window. Tokens
+ * with a drifting clock usually match at the same offset for a long time.
+ *
+ * The offset is followed with some hysteresis: a match at another offset
+ * halves the confidence, the offset moves once the confidence is used up.
+ * The state packs into 16 bits for storage, the confidence saturates after
+ * a few matches so a settled token doesn't change its stored state.
+ *
+ */
+class ClockDrift
+{
+public:
+    using Packed = std::uint16_t;
+
+    static const constexpr unsigned MAX_CONFIDENCE = 7U;
+
+    ClockDrift() = default;
+
+    static ClockDrift unpack(const Packed &packed);
+    Packed pack() const;
+
+    // most likely offset in steps, 0 without any match
+    inline int offset() const
+    { return this->_offset; }
+    // consecutive matches at the offset, 0 without any match
+    inline unsigned confidence() const
+    { return this->_confidence; }
+
+    // the n-th offset to try within ±window, the learned offset first and then
+    // alternating around it, every offset of the window comes up exactly once
+    // for n in 0..2*window
+    int probe(const unsigned &n, const unsigned &window) const;
+
+    // learn from a verification which matched at the given offset
+    void learn(const int &step);
+
+    inline bool operator== (const ClockDrift &other) const
+    { return this->_offset == other._offset && this->_confidence == other._confidence; }
+    inline bool operator!= (const ClockDrift &other) const
+    { return !this->operator== (other); }
+
+private:
+    std::int8_t _offset = 0;
+    std::uint8_t _confidence = 0U;
+};
+
+#endif // CLOCKDRIFT_HPP
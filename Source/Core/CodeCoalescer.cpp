@@ -0,0 +1,15 @@
+#include "CodeCoalescer.hpp"
+
+CodeCoalescer::CodeCoalescer(const std::size_t &capacity)
+    : _table(capacity, 1U)
+{
+}
+
+CodeCoalescer::~CodeCoalescer()
+{
+}
+
+void CodeCoalescer::clear() noexcept
+{
+    this->_table.clear();
+}
@@ -0,0 +1,106 @@
+#ifndef CODECOALESCER_HPP
+#define CODECOALESCER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "OTPToken.hpp"
+#include "PerfStats.hpp"
+#include "Internal/SlotTable.hpp"
+
+/**
+ * Sharing of the codes computed by concurrent verifications
+ *
+ * Bursts of verifications for the same token (retries, duplicates from a
+ * load balancer) compute the same time steps again and again. The table
+ * remembers the binary code of recently computed (token id, time step)
+ * pairs, a verification which finds the pair uses the code, and one which
+ * finds another thread computing it waits for that result instead of
+ * computing it a second time.
+ *
+ * Every slot is a single atomic word holding a 32-bit fingerprint of the
+ * pair, the 31-bit binary code and a ready bit, the table is direct mapped
+ * and a pair simply replaces whatever was in its slot. Waiting is bounded:
+ * a computation which doesn't finish within a few yields is done again by
+ * the waiter, so no thread ever blocks on another one.
+ *
+ */
+class CodeCoalescer
+{
+public:
+    static const constexpr std::size_t DEFAULT_CAPACITY = 1U << 16;
+
+    // the capacity is rounded up to a power of 2
+    explicit CodeCoalescer(const std::size_t &capacity = DEFAULT_CAPACITY);
+    ~CodeCoalescer();
+
+    CodeCoalescer(const CodeCoalescer&) = delete;
+    CodeCoalescer &operator= (const CodeCoalescer&) = delete;
+
+    // the 31-bit binary code of the step of the token, compute() is called
+    // unless another thread computed or is computing the same pair
+    template<typename Compute>
+    std::uint32_t code(const OTPToken::sqliteTokenID &id, const std::uint64_t &step, const Compute &compute);
+
+    // forgets all codes, must not run concurrently with lookups
+    void clear() noexcept;
+
+    inline std::size_t capacity() const
+    { return this->_table.capacity(); }
+
+private:
+    static const constexpr std::uint64_t READY = 1U;
+    static const constexpr std::uint64_t LOW_MASK = 0xffffffffULL;
+    static const constexpr unsigned MAX_YIELDS = 16U;
+
+    Internal::SlotTable _table;
+};
+
+template<typename Compute>
+std::uint32_t CodeCoalescer::code(const OTPToken::sqliteTokenID &id, const std::uint64_t &step, const Compute &compute)
+{
+    // the low bits select the slot, the high bits are the fingerprint
+    const auto h = Internal::SlotTable::hash(id, step);
+    const std::uint64_t print = (h | (1ULL << 63U)) & ~LOW_MASK;
+    auto &slot = this->_table.slot(h);
+
+    auto current = slot.load(std::memory_order_acquire);
+    auto yields = 0U;
+    for (;;)
+    {
+        if ((current & ~LOW_MASK) == print)
+        {
+            if (current & READY)
+            {
+                OTPGEN_PERF_COUNT(CodesShared, 1U);
+                return static_cast<std::uint32_t>((current & LOW_MASK) >> 1U);
+            }
+
+            // computed by another thread right now
+            if (++yields > MAX_YIELDS)
+            {
+                return compute();
+            }
+            std::this_thread::yield();
+            current = slot.load(std::memory_order_acquire);
+            continue;
+        }
+
+        // claim the slot, a lost race is looked at again
+        if (slot.compare_exchange_weak(current, print, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            break;
+        }
+    }
+
+    const auto bin_code = compute() & 0x7fffffffU;
+
+    // publish unless the slot was taken over in between
+    std::uint64_t claimed = print;
+    slot.compare_exchange_strong(claimed, print | (static_cast<std::uint64_t>(bin_code) << 1U) | READY,
+                                 std::memory_order_release, std::memory_order_relaxed);
+    return bin_code;
+}
+
+#endif // CODECOALESCER_HPP
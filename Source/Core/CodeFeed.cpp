@@ -0,0 +1,354 @@
+#include "CodeFeed.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CODEFEED_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    static const constexpr std::uint32_t MAGIC = 0x4650544FU; // "OTPF"
+    static const constexpr std::uint32_t VERSION = 1U;
+
+    // a writer which died while publishing leaves an odd sequence, readers give up after this
+    static const constexpr unsigned MAX_ATTEMPTS = 1024U;
+    static const constexpr unsigned SPIN_ATTEMPTS = 16U;
+
+    static const constexpr std::size_t CODE_WORDS = CodeFeed::MAX_CODE_LENGTH / sizeof(std::uint64_t);
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the table is shared between processes");
+
+    // codes are zero padded, a code of MAX_CODE_LENGTH characters has no terminator
+    static void unpack(const std::uint64_t (&words)[CODE_WORDS], std::string &code)
+    {
+        const auto chars = reinterpret_cast<const char*>(words);
+        const auto end = static_cast<const char*>(std::memchr(chars, '\0', sizeof(words)));
+        code.assign(chars, end ? static_cast<std::size_t>(end - chars) : sizeof(words));
+    }
+}
+
+struct CodeFeed::Header
+{
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t capacity;
+    std::uint32_t entry_size;
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> count;
+};
+
+// label hash, code (two words of characters, zero padded) and expiry
+struct CodeFeed::Entry
+{
+    std::atomic<std::uint64_t> label;
+    std::atomic<std::uint64_t> code[CODE_WORDS];
+    std::atomic<std::uint64_t> expiry;
+};
+
+CodeFeed::~CodeFeed()
+{
+    this->close();
+}
+
+std::uint64_t CodeFeed::labelHash(const std::string_view &label)
+{
+    // FNV-1a of the label in lower case, like the NOCASE collation of the database
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto&& c : label)
+    {
+        auto byte = static_cast<unsigned char>(c);
+        if (byte >= 'A' && byte <= 'Z')
+        {
+            byte = static_cast<unsigned char>(byte - 'A' + 'a');
+        }
+        hash ^= byte;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool CodeFeed::create(const std::string &path, const std::size_t &capacity)
+{
+    this->close();
+#ifdef CODEFEED_MMAP
+    if (capacity == 0U || capacity > UINT32_MAX)
+    {
+        return false;
+    }
+
+    // a new file, never one which someone else prepared
+    (void) ::unlink(path.c_str());
+    const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    const auto size = sizeof(Header) + capacity * sizeof(Entry);
+    void *data = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+    {
+        data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        (void) ::unlink(path.c_str());
+        return false;
+    }
+
+    auto entries = reinterpret_cast<Entry*>(static_cast<unsigned char*>(data) + sizeof(Header));
+    for (auto i = 0U; i < capacity; ++i)
+    {
+        new (&entries[i]) Entry{{0U}, {{0U}, {0U}}, {0U}};
+    }
+
+    // the magic is written last, readers check it before anything else
+    auto header = new (data) Header{0U, VERSION, static_cast<std::uint32_t>(capacity),
+                                    static_cast<std::uint32_t>(sizeof(Entry)), {0U}, {0U}};
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = MAGIC;
+
+    this->_header = header;
+    this->_entries = entries;
+    this->_size = size;
+    this->_writer = true;
+    this->_path = path;
+    return true;
+#else
+    (void) path;
+    (void) capacity;
+    return false;
+#endif
+}
+
+bool CodeFeed::open(const std::string &path)
+{
+    this->close();
+#ifdef CODEFEED_MMAP
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    std::size_t size = 0U;
+    if (::fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) >= sizeof(Header))
+    {
+        size = static_cast<std::size_t>(info.st_size);
+        data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const auto header = static_cast<Header*>(data);
+    if (header->magic != MAGIC || header->version != VERSION || header->entry_size != sizeof(Entry) ||
+        size < sizeof(Header) + static_cast<std::size_t>(header->capacity) * sizeof(Entry))
+    {
+        (void) ::munmap(data, size);
+        return false;
+    }
+
+    this->_header = header;
+    this->_entries = reinterpret_cast<Entry*>(static_cast<unsigned char*>(data) + sizeof(Header));
+    this->_size = size;
+    this->_writer = false;
+    return true;
+#else
+    (void) path;
+    return false;
+#endif
+}
+
+void CodeFeed::close()
+{
+    if (!this->_header)
+    {
+        return;
+    }
+
+#ifdef CODEFEED_MMAP
+    if (this->_writer)
+    {
+        // readers which still map the file see an empty table
+        (void) this->publish({});
+        for (auto i = 0U; i < this->_header->capacity; ++i)
+        {
+            for (auto&& word : this->_entries[i].code)
+            {
+                word.store(0U, std::memory_order_relaxed);
+            }
+        }
+        (void) ::unlink(this->_path.c_str());
+    }
+    (void) ::munmap(this->_header, this->_size);
+#endif
+
+    this->_header = nullptr;
+    this->_entries = nullptr;
+    this->_size = 0U;
+    this->_writer = false;
+    this->_path.clear();
+}
+
+std::size_t CodeFeed::publish(const std::vector<Code> &codes)
+{
+    if (!this->_header || !this->_writer)
+    {
+        return 0U;
+    }
+
+    const auto sequence = this->_header->sequence.load(std::memory_order_relaxed);
+    this->_header->sequence.store(sequence + 1U, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::size_t count = 0U;
+    for (auto&& code : codes)
+    {
+        if (count == this->_header->capacity || code.code.size() > MAX_CODE_LENGTH)
+        {
+            continue;
+        }
+
+        std::uint64_t words[CODE_WORDS] = {};
+        std::memcpy(words, code.code.data(), code.code.size());
+
+        auto &entry = this->_entries[count++];
+        entry.label.store(code.label, std::memory_order_relaxed);
+        for (auto i = 0U; i < std::size(words); ++i)
+        {
+            entry.code[i].store(words[i], std::memory_order_relaxed);
+        }
+        entry.expiry.store(static_cast<std::uint64_t>(code.expiry), std::memory_order_relaxed);
+    }
+    this->_header->count.store(count, std::memory_order_relaxed);
+
+    this->_header->sequence.store(sequence + 2U, std::memory_order_release);
+    return count;
+}
+
+bool CodeFeed::read(std::vector<Code> &codes) const
+{
+    codes.clear();
+    if (!this->_header)
+    {
+        return false;
+    }
+
+    for (auto attempt = 0U; attempt < MAX_ATTEMPTS; ++attempt)
+    {
+        if (attempt >= SPIN_ATTEMPTS)
+        {
+            std::this_thread::yield();
+        }
+
+        const auto before = this->_header->sequence.load(std::memory_order_acquire);
+        if (before & 1U)
+        {
+            continue;
+        }
+
+        const auto count = std::min<std::uint64_t>(this->_header->count.load(std::memory_order_relaxed),
+                                                   this->_header->capacity);
+        codes.resize(count);
+        for (auto i = 0U; i < count; ++i)
+        {
+            const auto &entry = this->_entries[i];
+            std::uint64_t words[CODE_WORDS];
+            for (auto w = 0U; w < std::size(words); ++w)
+            {
+                words[w] = entry.code[w].load(std::memory_order_relaxed);
+            }
+
+            auto &code = codes[i];
+            code.label = entry.label.load(std::memory_order_relaxed);
+            code.expiry = static_cast<std::time_t>(entry.expiry.load(std::memory_order_relaxed));
+            unpack(words, code.code);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->_header->sequence.load(std::memory_order_relaxed) == before)
+        {
+            return true;
+        }
+    }
+
+    codes.clear();
+    return false;
+}
+
+bool CodeFeed::find(const OTPToken::Label &label, Code &code) const
+{
+    if (!this->_header)
+    {
+        return false;
+    }
+
+    const auto hash = labelHash(label);
+    for (auto attempt = 0U; attempt < MAX_ATTEMPTS; ++attempt)
+    {
+        if (attempt >= SPIN_ATTEMPTS)
+        {
+            std::this_thread::yield();
+        }
+
+        const auto before = this->_header->sequence.load(std::memory_order_acquire);
+        if (before & 1U)
+        {
+            continue;
+        }
+
+        const auto count = std::min<std::uint64_t>(this->_header->count.load(std::memory_order_relaxed),
+                                                   this->_header->capacity);
+        auto found = false;
+        std::uint64_t words[CODE_WORDS] = {};
+        std::uint64_t expiry = 0U;
+        for (auto i = 0U; i < count && !found; ++i)
+        {
+            const auto &entry = this->_entries[i];
+            if (entry.label.load(std::memory_order_relaxed) != hash)
+            {
+                continue;
+            }
+            for (auto w = 0U; w < std::size(words); ++w)
+            {
+                words[w] = entry.code[w].load(std::memory_order_relaxed);
+            }
+            expiry = entry.expiry.load(std::memory_order_relaxed);
+            found = true;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->_header->sequence.load(std::memory_order_relaxed) != before)
+        {
+            continue;
+        }
+
+        if (found)
+        {
+            code.label = hash;
+            code.expiry = static_cast<std::time_t>(expiry);
+            unpack(words, code.code);
+        }
+        return found;
+    }
+    return false;
+}
+
+std::uint64_t CodeFeed::generation() const
+{
+    return this->_header ? this->_header->sequence.load(std::memory_order_acquire) / 2U : 0U;
+}
@@ -0,0 +1,92 @@
+#ifndef CODEFEED_HPP
+#define CODEFEED_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "OTPToken.hpp"
+
+/**
+ * Current codes of selected tokens in a shared file mapping
+ *
+ * The CLI daemon publishes the codes of the tokens it was told to share,
+ * local programs (browser extension hosts, status bars, SSH helpers) map
+ * the file once and read a code with a few loads, without a request to the
+ * daemon and without a system call.
+ *
+ * The table holds the hash of the label, the code and the time it expires
+ * for every token, all words are lock-free atomics. The writer guards the
+ * table with a sequence lock: the sequence is odd while the table changes,
+ * readers retry when it was odd or changed during their copy. Readers never
+ * block the writer, the writer publishes once per rotation.
+ *
+ * The file is created with owner-only permissions. Codes past their expiry
+ * are stale, the daemon stopped publishing; the writer wipes the table and
+ * removes the file when it is closed.
+ *
+ */
+class CodeFeed
+{
+public:
+    struct Code
+    {
+        std::uint64_t label = 0U;
+        std::string code;
+        // first time the code isn't valid anymore
+        std::time_t expiry = 0;
+    };
+
+    static const constexpr std::size_t MAX_CODE_LENGTH = 16U;
+    static const constexpr std::size_t DEFAULT_CAPACITY = 64U;
+
+    CodeFeed() = default;
+    ~CodeFeed();
+
+    CodeFeed(const CodeFeed&) = delete;
+    CodeFeed &operator= (const CodeFeed&) = delete;
+
+    // creates (or replaces) the feed file with room for capacity codes, for the writer
+    bool create(const std::string &path, const std::size_t &capacity = DEFAULT_CAPACITY);
+
+    // maps an existing feed read-only, for readers
+    bool open(const std::string &path);
+
+    // unmaps the feed, the writer wipes the table and removes the file
+    void close();
+
+    inline bool isOpen() const
+    { return this->_header != nullptr; }
+
+    // replaces the table, codes beyond the capacity or longer than MAX_CODE_LENGTH are skipped,
+    // returns the amount of published codes
+    std::size_t publish(const std::vector<Code> &codes);
+
+    // a consistent copy of the table
+    bool read(std::vector<Code> &codes) const;
+
+    // the code of the label, false if the label isn't in the table
+    bool find(const OTPToken::Label &label, Code &code) const;
+
+    // times the table was published
+    std::uint64_t generation() const;
+
+    // hash of the label as stored in the table, labels are case insensitive
+    static std::uint64_t labelHash(const std::string_view &label);
+
+private:
+    struct Header;
+    struct Entry;
+
+    Header *_header = nullptr;
+    Entry *_entries = nullptr;
+    std::size_t _size = 0U;
+    bool _writer = false;
+    std::string _path;
+};
+
+#endif // CODEFEED_HPP
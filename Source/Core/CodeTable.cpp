@@ -0,0 +1,440 @@
+#include "CodeTable.hpp"
+#include "Executor.hpp"
+#include "OTPGen.hpp"
+#include "Internal/AtomicFile.hpp"
+#include "Internal/MappedFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/hmac.h>
+#include <cryptopp/misc.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+
+namespace {
+    static const constexpr char MAGIC[] = "OTPT";
+    static const constexpr std::size_t MAGIC_SIZE = 4;
+    static const constexpr unsigned char VERSION = 1;
+
+    static const constexpr std::size_t VERSION_OFFSET = 4;
+    static const constexpr std::size_t COUNT_OFFSET = 8;
+    static const constexpr std::size_t LABELS_OFFSET = 12;
+    static const constexpr std::size_t BEGIN_OFFSET = 16;
+    static const constexpr std::size_t END_OFFSET = 24;
+    static const constexpr std::size_t SALT_OFFSET = 32;
+    static const constexpr std::size_t NONCE_OFFSET = 48;
+    static const constexpr std::size_t SALT_SIZE = 16;
+    static const constexpr std::size_t NONCE_SIZE = CryptoPP::AES::BLOCKSIZE;
+    static_assert(NONCE_OFFSET + NONCE_SIZE == CodeTable::HEADER_SIZE, "header doesn't match the layout");
+
+    static const constexpr std::size_t KEY_SIZE = 32;
+    static const char *const KEY_INFO = "OTPGen code table";
+
+    // the codes are computed in tasks of this many periods, the body is encrypted in tasks of this many bytes
+    static const constexpr std::uint64_t CHUNK_PERIODS = 4096U;
+    static const constexpr std::size_t CHUNK_BYTES = 1024U * 1024U;
+
+    static const constexpr std::size_t MAX_CODE_LENGTH = sizeof(OTPGen::TokenBuffer) - 1U;
+
+    using Cipher = CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption;
+
+    static inline void writeLE(unsigned char *out, std::uint64_t value, std::size_t bytes)
+    {
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            out[i] = static_cast<unsigned char>(value & 0xff);
+            value >>= 8;
+        }
+    }
+
+    static inline std::uint64_t readLE(const unsigned char *in, std::size_t bytes)
+    {
+        std::uint64_t value = 0;
+        for (auto i = bytes; i > 0; --i)
+        {
+            value = (value << 8) | in[i - 1];
+        }
+        return value;
+    }
+
+    // the first half encrypts, the second half authenticates
+    static CryptoPP::SecByteBlock deriveKeys(const SecureString &password, const unsigned char *salt)
+    {
+        CryptoPP::SecByteBlock keys(2 * KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(keys, keys.size(),
+                       reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                       salt, SALT_SIZE,
+                       reinterpret_cast<const unsigned char*>(KEY_INFO), std::strlen(KEY_INFO));
+        return keys;
+    }
+
+    // encrypts or decrypts data at the given offset of the stream after the header
+    static void crypt(const CryptoPP::SecByteBlock &keys, const unsigned char *nonce,
+                      std::uint64_t offset, unsigned char *data, std::size_t size)
+    {
+        Cipher cipher;
+        cipher.SetKeyWithIV(keys, KEY_SIZE, nonce, NONCE_SIZE);
+        cipher.Seek(offset);
+        cipher.ProcessData(data, data, size);
+    }
+
+    static void mac(const CryptoPP::SecByteBlock &keys, const unsigned char *header,
+                    const unsigned char *body, std::size_t size, unsigned char *out)
+    {
+        CryptoPP::HMAC<CryptoPP::SHA256> hmac(keys.data() + KEY_SIZE, KEY_SIZE);
+        hmac.Update(header, CodeTable::HEADER_SIZE);
+        hmac.Update(body, size);
+        hmac.Final(out);
+    }
+
+    // a task of write(), codes of consecutive periods of one token
+    struct Job {
+        std::size_t token;
+        std::uint64_t first;
+        std::uint64_t periods;
+        OTPToken::PeriodType period;
+        std::size_t length;
+        std::uint64_t offset;
+    };
+}
+
+struct CodeTable::State
+{
+    struct Entry {
+        std::uint64_t first = 0U;
+        std::uint64_t periods = 0U;
+        OTPToken::PeriodType period = 0U;
+        std::size_t length = 0U;
+        // stream offset of the first code
+        std::uint64_t offset = 0U;
+    };
+
+    Internal::MappedFile file;
+    // seeked to the slot of every lookup
+    Cipher cipher;
+
+    std::vector<Entry> entries;
+    std::unordered_map<OTPToken::Label, std::size_t> labels;
+    std::unordered_map<OTPToken::sqliteTokenID, std::size_t> ids;
+
+    Result verify(const Entry &entry, const std::string &code, const std::time_t &time, unsigned window);
+};
+
+CodeTable::CodeTable() = default;
+CodeTable::~CodeTable() = default;
+
+CodeTable::Error CodeTable::write(const std::string &path, const std::vector<OTPToken> &tokens,
+                                  const std::time_t &t_begin, const std::time_t &t_end, const SecureString &password,
+                                  Executor *executor, std::size_t *written)
+{
+    if (written)
+    {
+        *written = 0U;
+    }
+    if (t_begin < 0 || t_end <= t_begin)
+    {
+        return InvalidRange;
+    }
+
+    // directory and labels of the time-based tokens, the codes follow them
+    struct Planned {
+        std::size_t token;
+        std::uint64_t first;
+        std::uint64_t periods;
+        OTPToken::PeriodType period;
+        std::size_t length;
+        std::size_t label;
+    };
+    std::vector<Planned> planned;
+    std::uint64_t labelBytes = 0U;
+    std::uint64_t codeBytes = 0U;
+    for (auto i = 0U; i < tokens.size(); ++i)
+    {
+        const auto &token = tokens[i];
+        if ((token.type() != OTPToken::TOTP && token.type() != OTPToken::Steam) ||
+            !OTPGen::TOTPSeries(token, t_begin, t_end).isValid())
+        {
+            continue;
+        }
+
+        const auto period = token.type() == OTPToken::Steam ? OTPToken::defaultPeriod(OTPToken::Steam) : token.period();
+        const auto length = token.type() == OTPToken::Steam ? std::size_t(5U) : std::size_t(token.digitLength());
+        const auto first = static_cast<std::uint64_t>(t_begin / period);
+        const auto periods = static_cast<std::uint64_t>((t_end - 1) / period) + 1U - first;
+        if (periods > std::numeric_limits<std::uint32_t>::max())
+        {
+            return InvalidRange;
+        }
+
+        const auto label = std::min<std::size_t>(token.label().size(), UINT16_MAX);
+        planned.emplace_back(Planned{i, first, periods, period, length, label});
+        labelBytes += label;
+        codeBytes += periods * length;
+    }
+    if (planned.empty())
+    {
+        return NoTokens;
+    }
+    if (labelBytes > std::numeric_limits<std::uint32_t>::max())
+    {
+        return InvalidRange;
+    }
+
+    const auto directoryBytes = planned.size() * ENTRY_SIZE + labelBytes;
+    std::vector<unsigned char> body(directoryBytes + codeBytes);
+    std::vector<Job> jobs;
+    auto label = body.data() + planned.size() * ENTRY_SIZE;
+    auto offset = directoryBytes;
+    for (auto i = 0U; i < planned.size(); ++i)
+    {
+        const auto &plan = planned[i];
+        const auto &token = tokens[plan.token];
+        const auto entry = body.data() + i * ENTRY_SIZE;
+        writeLE(entry, static_cast<std::uint64_t>(token.id()), 8);
+        writeLE(entry + 8, plan.first, 8);
+        writeLE(entry + 16, plan.periods, 4);
+        writeLE(entry + 20, plan.period, 4);
+        entry[24] = static_cast<unsigned char>(plan.length);
+        entry[25] = token.type();
+        writeLE(entry + 26, plan.label, 2);
+        std::memcpy(label, token.label().data(), plan.label);
+        label += plan.label;
+
+        for (std::uint64_t first = 0U; first < plan.periods; first += CHUNK_PERIODS)
+        {
+            const auto periods = std::min<std::uint64_t>(CHUNK_PERIODS, plan.periods - first);
+            jobs.emplace_back(Job{plan.token, plan.first + first, periods, plan.period, plan.length,
+                                 offset + first * plan.length});
+        }
+        offset += plan.periods * plan.length;
+    }
+
+    // every job fills its own slots, the series of a chunk prepares the secret once
+    const auto compute = [&](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto &job = jobs[i];
+            const auto period = static_cast<std::time_t>(job.period);
+            OTPGen::TOTPSeries series(tokens[job.token], static_cast<std::time_t>(job.first) * period,
+                                      static_cast<std::time_t>(job.first + job.periods) * period);
+            OTPGen::TokenBuffer code;
+            auto slot = body.data() + job.offset;
+            for (std::uint64_t n = 0U; n < job.periods && series.next(code); ++n, slot += job.length)
+            {
+                std::memcpy(slot, code, std::min(job.length, std::strlen(code)));
+            }
+        }
+    };
+    if (executor && jobs.size() > 1U)
+    {
+        executor->parallelFor(jobs.size(), 1U, compute);
+    }
+    else
+    {
+        compute(0U, jobs.size());
+    }
+
+    unsigned char header[HEADER_SIZE] = {};
+    std::memcpy(header, MAGIC, MAGIC_SIZE);
+    header[VERSION_OFFSET] = VERSION;
+    writeLE(header + COUNT_OFFSET, planned.size(), 4);
+    writeLE(header + LABELS_OFFSET, labelBytes, 4);
+    writeLE(header + BEGIN_OFFSET, static_cast<std::uint64_t>(t_begin), 8);
+    writeLE(header + END_OFFSET, static_cast<std::uint64_t>(t_end), 8);
+    CryptoPP::AutoSeededRandomPool random;
+    random.GenerateBlock(header + SALT_OFFSET, SALT_SIZE);
+    random.GenerateBlock(header + NONCE_OFFSET, NONCE_SIZE);
+
+    // the counter mode stream is split at block boundaries, so the chunks are encrypted in parallel
+    const auto keys = deriveKeys(password, header + SALT_OFFSET);
+    const auto chunks = (body.size() + CHUNK_BYTES - 1U) / CHUNK_BYTES;
+    const auto encrypt = [&](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto start = i * CHUNK_BYTES;
+            crypt(keys, header + NONCE_OFFSET, start, body.data() + start, std::min(CHUNK_BYTES, body.size() - start));
+        }
+    };
+    if (executor && chunks > 1U)
+    {
+        executor->parallelFor(chunks, 1U, encrypt);
+    }
+    else
+    {
+        encrypt(0U, chunks);
+    }
+
+    unsigned char tag[MAC_SIZE];
+    mac(keys, header, body.data(), body.size(), tag);
+
+    Internal::AtomicFile file;
+    if (!file.open(path) ||
+        !file.write(header, HEADER_SIZE) ||
+        !file.write(body.data(), body.size()) ||
+        !file.write(tag, MAC_SIZE) ||
+        !file.commit())
+    {
+        return FileWriteFailure;
+    }
+
+    if (written)
+    {
+        *written = planned.size();
+    }
+    return Success;
+}
+
+CodeTable::Error CodeTable::open(const std::string &path, const SecureString &password)
+{
+    this->close();
+
+    auto state = std::make_unique<State>();
+    if (!state->file.open(path))
+    {
+        return FileReadFailure;
+    }
+
+    const auto data = state->file.bytes();
+    const auto size = state->file.size();
+    if (size < HEADER_SIZE + MAC_SIZE || std::memcmp(data, MAGIC, MAGIC_SIZE) != 0 || data[VERSION_OFFSET] != VERSION)
+    {
+        return Malformed;
+    }
+
+    // the whole table is authenticated once, lookups only decrypt their slots
+    const auto keys = deriveKeys(password, data + SALT_OFFSET);
+    const auto bodySize = size - HEADER_SIZE - MAC_SIZE;
+    unsigned char tag[MAC_SIZE];
+    mac(keys, data, data + HEADER_SIZE, bodySize, tag);
+    if (!CryptoPP::VerifyBufsEqual(tag, data + HEADER_SIZE + bodySize, MAC_SIZE))
+    {
+        return AuthenticationFailed;
+    }
+
+    const auto count = readLE(data + COUNT_OFFSET, 4);
+    const auto labelBytes = readLE(data + LABELS_OFFSET, 4);
+    const auto directoryBytes = count * ENTRY_SIZE + labelBytes;
+    if (directoryBytes > bodySize)
+    {
+        return Malformed;
+    }
+
+    std::vector<unsigned char> directory(data + HEADER_SIZE, data + HEADER_SIZE + directoryBytes);
+    crypt(keys, data + NONCE_OFFSET, 0U, directory.data(), directory.size());
+
+    auto label = directory.data() + count * ENTRY_SIZE;
+    const auto labelsEnd = directory.data() + directory.size();
+    std::uint64_t offset = directoryBytes;
+    state->entries.reserve(count);
+    for (auto i = 0U; i < count; ++i)
+    {
+        const auto entry = directory.data() + i * ENTRY_SIZE;
+        State::Entry parsed;
+        parsed.first = readLE(entry + 8, 8);
+        parsed.periods = readLE(entry + 16, 4);
+        parsed.period = static_cast<OTPToken::PeriodType>(readLE(entry + 20, 4));
+        parsed.length = entry[24];
+        parsed.offset = offset;
+        const auto labelSize = readLE(entry + 26, 2);
+        if (parsed.period == 0U || parsed.length == 0U || parsed.length > MAX_CODE_LENGTH ||
+            labelSize > static_cast<std::uint64_t>(labelsEnd - label) ||
+            parsed.periods * parsed.length > bodySize - offset)
+        {
+            return Malformed;
+        }
+
+        // the first token of a label or id wins, like in the database they are unique
+        state->ids.emplace(static_cast<OTPToken::sqliteTokenID>(readLE(entry, 8)), i);
+        state->labels.emplace(OTPToken::Label(reinterpret_cast<const char*>(label), labelSize), i);
+        label += labelSize;
+        offset += parsed.periods * parsed.length;
+        state->entries.emplace_back(parsed);
+    }
+    if (offset != bodySize)
+    {
+        return Malformed;
+    }
+
+    state->cipher.SetKeyWithIV(keys, KEY_SIZE, data + NONCE_OFFSET, NONCE_SIZE);
+    this->_begin = static_cast<std::time_t>(readLE(data + BEGIN_OFFSET, 8));
+    this->_end = static_cast<std::time_t>(readLE(data + END_OFFSET, 8));
+    this->_state = std::move(state);
+    return Success;
+}
+
+void CodeTable::close()
+{
+    this->_state.reset();
+    this->_begin = this->_end = 0;
+}
+
+std::size_t CodeTable::tokenCount() const
+{
+    return this->_state ? this->_state->entries.size() : 0U;
+}
+
+CodeTable::Result CodeTable::verify(const OTPToken::Label &label, const std::string &code,
+                                    const std::time_t &time, unsigned window) const
+{
+    if (!this->_state)
+    {
+        return UnknownToken;
+    }
+    const auto it = this->_state->labels.find(label);
+    return it == this->_state->labels.end() ? UnknownToken :
+           this->_state->verify(this->_state->entries[it->second], code, time, window);
+}
+
+CodeTable::Result CodeTable::verify(const OTPToken::sqliteTokenID &id, const std::string &code,
+                                    const std::time_t &time, unsigned window) const
+{
+    if (!this->_state)
+    {
+        return UnknownToken;
+    }
+    const auto it = this->_state->ids.find(id);
+    return it == this->_state->ids.end() ? UnknownToken :
+           this->_state->verify(this->_state->entries[it->second], code, time, window);
+}
+
+CodeTable::Result CodeTable::State::verify(const Entry &entry, const std::string &code, const std::time_t &time, unsigned window)
+{
+    if (time < 0)
+    {
+        return OutOfRange;
+    }
+
+    // periods of the window which are part of the table
+    const auto counter = static_cast<std::uint64_t>(time) / entry.period;
+    const auto low = std::max(counter - std::min<std::uint64_t>(counter, window), entry.first);
+    const auto high = std::min(counter + window + 1U, entry.first + entry.periods);
+    if (low >= high)
+    {
+        return OutOfRange;
+    }
+    if (code.size() != entry.length)
+    {
+        return NoMatch;
+    }
+
+    // all slots of the window are compared, the time taken doesn't tell which one matched
+    auto matched = false;
+    unsigned char slot[MAX_CODE_LENGTH];
+    for (auto step = low; step < high; ++step)
+    {
+        const auto offset = entry.offset + (step - entry.first) * entry.length;
+        std::memcpy(slot, this->file.bytes() + HEADER_SIZE + offset, entry.length);
+        this->cipher.Seek(offset);
+        this->cipher.ProcessData(slot, slot, entry.length);
+        matched |= CryptoPP::VerifyBufsEqual(slot, reinterpret_cast<const unsigned char*>(code.data()), entry.length);
+    }
+    CryptoPP::SecureWipeArray(slot, MAX_CODE_LENGTH);
+    return matched ? Match : NoMatch;
+}
@@ -0,0 +1,104 @@
+#ifndef CODETABLE_HPP
+#define CODETABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "OTPToken.hpp"
+#include "SecureMemory.hpp"
+
+class Executor;
+
+/**
+ * Pregenerated codes of time-based tokens for offline verifiers
+ *
+ * write() computes the codes of all periods of a time range for every TOTP
+ * and Steam token with OTPGen::TOTPSeries, split into chunks on the given
+ * executor, and stores them as an encrypted table. A verifier opens the
+ * table once and checks a code by reading its slot from the mapped file,
+ * without the secrets and without any HMAC work, so it needs neither crypto
+ * acceleration nor more than a rough clock.
+ *
+ * Layout, all integers are little-endian:
+ *  -> header (64 bytes): magic "OTPT" | version | 3 reserved | token count (u32) |
+ *     label bytes (u32) | begin (i64) | end (i64) | 16 bytes salt | 16 bytes nonce
+ *  -> directory: 32 bytes per token: id (i64) | first counter (u64) | periods (u32) |
+ *     period (u32) | code length (u8) | type (u8) | label length (u16) | 4 reserved
+ *  -> labels:    the labels of the directory, back to back
+ *  -> codes:     per token the codes of its periods, code length bytes each
+ *  -> mac:       HMAC-SHA256 of everything before it
+ *
+ * Everything after the header is encrypted with AES-256-CTR (the nonce is
+ * the initial counter block), the keys are derived from the password and
+ * the salt with HKDF-SHA256. open() checks the MAC and decrypts the
+ * directory, a lookup decrypts only the one or two blocks of its slot.
+ *
+ * The table holds no secrets, but every code of the range, keep it as
+ * protected as the codes themselves. HOTP and invalid tokens are skipped.
+ * An opened table must not be shared by threads.
+ *
+ */
+class CodeTable final
+{
+public:
+    enum Error {
+        Success = 0,
+        InvalidRange,
+        NoTokens,
+        FileWriteFailure,
+        FileReadFailure,
+        Malformed,
+        AuthenticationFailed,
+    };
+
+    enum Result {
+        Match = 0,
+        NoMatch,
+        UnknownToken,
+        OutOfRange, // the time isn't covered by the table
+    };
+
+    static const constexpr std::size_t HEADER_SIZE = 64U;
+    static const constexpr std::size_t ENTRY_SIZE = 32U;
+    static const constexpr std::size_t MAC_SIZE = 32U;
+
+    // codes of all periods overlapping [t_begin, t_end), written is the amount of tokens in the table
+    static Error write(const std::string &path, const std::vector<OTPToken> &tokens,
+                       const std::time_t &t_begin, const std::time_t &t_end, const SecureString &password,
+                       Executor *executor = nullptr, std::size_t *written = nullptr);
+
+    CodeTable();
+    ~CodeTable();
+
+    CodeTable(const CodeTable&) = delete;
+    CodeTable &operator=(const CodeTable&) = delete;
+
+    Error open(const std::string &path, const SecureString &password);
+    void close();
+
+    inline bool isOpen() const
+    { return this->_state != nullptr; }
+
+    // checks the code of the period at the given time, and of window periods before and after it
+    Result verify(const OTPToken::Label &label, const std::string &code, const std::time_t &time, unsigned window = 0U) const;
+    Result verify(const OTPToken::sqliteTokenID &id, const std::string &code, const std::time_t &time, unsigned window = 0U) const;
+
+    std::size_t tokenCount() const;
+    inline std::time_t begin() const
+    { return this->_begin; }
+    inline std::time_t end() const
+    { return this->_end; }
+
+private:
+    // mapping, keys and directory of the open table
+    struct State;
+    std::unique_ptr<State> _state;
+    std::time_t _begin = 0;
+    std::time_t _end = 0;
+};
+
+#endif // CODETABLE_HPP
@@ -0,0 +1,305 @@
+#include "Codec.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+    static const constexpr char BASE32_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+    static const constexpr char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const constexpr char HEX_ALPHABET[] = "0123456789abcdef";
+
+    static const constexpr unsigned char INVALID = 0xff;
+
+    // character to value lookup table, generated at compile time
+    struct DecodeTable
+    {
+        unsigned char values[256];
+    };
+
+    static constexpr DecodeTable make_decode_table(const char *alphabet, std::size_t size, bool case_insensitive)
+    {
+        DecodeTable table{};
+        for (auto i = 0U; i < 256U; ++i)
+        {
+            table.values[i] = INVALID;
+        }
+        for (auto i = 0U; i < size; ++i)
+        {
+            const auto c = static_cast<unsigned char>(alphabet[i]);
+            table.values[c] = static_cast<unsigned char>(i);
+            if (case_insensitive && c >= 'A' && c <= 'Z')
+            {
+                table.values[c - 'A' + 'a'] = static_cast<unsigned char>(i);
+            }
+            else if (case_insensitive && c >= 'a' && c <= 'z')
+            {
+                table.values[c - 'a' + 'A'] = static_cast<unsigned char>(i);
+            }
+        }
+        return table;
+    }
+
+    static const constexpr auto BASE32_TABLE = make_decode_table(BASE32_ALPHABET, 32U, true);
+    static const constexpr auto BASE64_TABLE = make_decode_table(BASE64_ALPHABET, 64U, false);
+    static const constexpr auto HEX_TABLE = make_decode_table(HEX_ALPHABET, 16U, true);
+
+    // generic decoder for alphabets with Bits bits per character
+    template<unsigned Bits>
+    static std::size_t decode_helper(const DecodeTable &table, const char *str, std::size_t length, unsigned char *out) noexcept
+    {
+        std::uint32_t buffer = 0U;
+        unsigned int bits = 0U;
+        std::size_t size = 0U;
+
+        for (auto i = 0U; i < length && str[i] != '\0'; ++i)
+        {
+            const auto value = table.values[static_cast<unsigned char>(str[i])];
+            if (value == INVALID)
+            {
+                continue;
+            }
+
+            buffer = (buffer << Bits) | value;
+            bits += Bits;
+            if (bits >= 8U)
+            {
+                bits -= 8U;
+                out[size++] = static_cast<unsigned char>(buffer >> bits);
+            }
+        }
+
+        return size;
+    }
+
+    // generic encoder for alphabets with Bits bits per character, without padding
+    template<unsigned Bits>
+    static std::size_t encode_helper(const char *alphabet, const unsigned char *data, std::size_t size, char *out) noexcept
+    {
+        static const constexpr std::uint32_t MASK = (1U << Bits) - 1U;
+
+        std::uint32_t buffer = 0U;
+        unsigned int bits = 0U;
+        std::size_t length = 0U;
+
+        for (auto i = 0U; i < size; ++i)
+        {
+            buffer = (buffer << 8) | data[i];
+            bits += 8U;
+            while (bits >= Bits)
+            {
+                bits -= Bits;
+                out[length++] = alphabet[(buffer >> bits) & MASK];
+            }
+        }
+
+        // remaining bits are padded with zeros
+        if (bits > 0U)
+        {
+            out[length++] = alphabet[(buffer << (Bits - bits)) & MASK];
+        }
+
+        return length;
+    }
+
+    // portable SIMD vector of bytes (GCC/Clang vector extensions)
+    typedef unsigned char u8x16 __attribute__((vector_size(16)));
+    typedef signed char s8x16 __attribute__((vector_size(16)));
+
+    static inline u8x16 broadcast(unsigned char c) noexcept
+    {
+        return u8x16{c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c};
+    }
+
+    // 0xff for every base-32 character in the block, letters of both cases and 2-7
+    static inline s8x16 classify_base32(const u8x16 &v) noexcept
+    {
+        const auto letter = (v | broadcast(0x20)) - broadcast('a');
+        const auto digit = v - broadcast('2');
+        return (letter < broadcast(26)) | (digit < broadcast(6));
+    }
+
+    template<std::size_t(*Encode)(const unsigned char*, std::size_t, char*) noexcept>
+    static const std::string encode_string(const std::string &data, std::size_t max_length)
+    {
+        std::string str(max_length, '\0');
+        str.resize(Encode(reinterpret_cast<const unsigned char*>(data.data()), data.size(), &str[0]));
+        return str;
+    }
+
+    template<std::size_t(*Decode)(const char*, std::size_t, unsigned char*) noexcept>
+    static const std::string decode_string(const std::string &str, std::size_t max_size)
+    {
+        std::string data(max_size, '\0');
+        data.resize(Decode(str.data(), str.size(), reinterpret_cast<unsigned char*>(&data[0])));
+        return data;
+    }
+}
+
+std::size_t Codec::base32Encode(const unsigned char *data, std::size_t size, char *out) noexcept
+{
+    return encode_helper<5U>(BASE32_ALPHABET, data, size, out);
+}
+
+std::size_t Codec::base64Encode(const unsigned char *data, std::size_t size, char *out) noexcept
+{
+    auto length = encode_helper<6U>(BASE64_ALPHABET, data, size, out);
+    while (length % 4U != 0U)
+    {
+        out[length++] = '=';
+    }
+    return length;
+}
+
+std::size_t Codec::hexEncode(const unsigned char *data, std::size_t size, char *out) noexcept
+{
+    return encode_helper<4U>(HEX_ALPHABET, data, size, out);
+}
+
+std::size_t Codec::base32Decode(const char *str, std::size_t length, unsigned char *out) noexcept
+{
+    return decode_helper<5U>(BASE32_TABLE, str, length, out);
+}
+
+// classify 16 characters at once, the scalar table handles the tail and blocks with a '\0'
+std::size_t Codec::base32Characters(const char *str, std::size_t length) noexcept
+{
+    std::size_t count = 0U;
+    std::size_t i = 0U;
+    for (; i + 16U <= length; i += 16U)
+    {
+        u8x16 v;
+        std::memcpy(&v, str + i, sizeof(v));
+        const auto zero = v == broadcast(0);
+        auto found = false;
+        for (auto j = 0U; j < 16U; ++j)
+        {
+            found |= zero[j] != 0;
+        }
+        if (found)
+        {
+            break;
+        }
+
+        const auto valid = classify_base32(v);
+        for (auto j = 0U; j < 16U; ++j)
+        {
+            count += static_cast<unsigned char>(valid[j]) & 1U;
+        }
+    }
+
+    for (; i < length && str[i] != '\0'; ++i)
+    {
+        count += BASE32_TABLE.values[static_cast<unsigned char>(str[i])] != INVALID;
+    }
+    return count;
+}
+
+std::size_t Codec::base64Decode(const char *str, std::size_t length, unsigned char *out) noexcept
+{
+    return decode_helper<6U>(BASE64_TABLE, str, length, out);
+}
+
+std::size_t Codec::hexDecode(const char *str, std::size_t length, unsigned char *out) noexcept
+{
+    return decode_helper<4U>(HEX_TABLE, str, length, out);
+}
+
+std::size_t Codec::hexToBase32(const char *str, std::size_t length, char *out) noexcept
+{
+    // whole bytes are decoded into the lower bits of input and re-encoded right away,
+    // a trailing half byte is dropped like hexDecode() does
+    std::uint32_t input = 0U;
+    unsigned int input_bits = 0U;
+    std::uint32_t buffer = 0U;
+    unsigned int bits = 0U;
+    std::size_t size = 0U;
+
+    for (auto i = 0U; i < length && str[i] != '\0'; ++i)
+    {
+        const auto value = HEX_TABLE.values[static_cast<unsigned char>(str[i])];
+        if (value == INVALID)
+        {
+            continue;
+        }
+
+        input = (input << 4) | value;
+        input_bits += 4U;
+        if (input_bits < 8U)
+        {
+            continue;
+        }
+
+        input_bits = 0U;
+        buffer = (buffer << 8) | (input & 0xFFU);
+        bits += 8U;
+        while (bits >= 5U)
+        {
+            bits -= 5U;
+            out[size++] = BASE32_ALPHABET[(buffer >> bits) & 0x1FU];
+        }
+    }
+
+    if (bits > 0U)
+    {
+        out[size++] = BASE32_ALPHABET[(buffer << (5U - bits)) & 0x1FU];
+    }
+
+    return size;
+}
+
+std::size_t Codec::hexToBase32(const char *str, std::size_t *lengths, std::size_t count, char *out) noexcept
+{
+    std::size_t total = 0U;
+    for (auto i = 0U; i < count; ++i)
+    {
+        const auto length = lengths[i];
+        lengths[i] = hexToBase32(str, length, out + total);
+        total += lengths[i];
+        str += length;
+    }
+    return total;
+}
+
+const std::string Codec::base32Encode(const std::string &data)
+{
+    return encode_string<&Codec::base32Encode>(data, base32EncodedSize(data.size()));
+}
+
+const std::string Codec::base64Encode(const std::string &data)
+{
+    return encode_string<&Codec::base64Encode>(data, base64EncodedSize(data.size()));
+}
+
+const std::string Codec::hexEncode(const std::string &data)
+{
+    return encode_string<&Codec::hexEncode>(data, hexEncodedSize(data.size()));
+}
+
+const std::string Codec::base32Decode(const std::string &str)
+{
+    return decode_string<&Codec::base32Decode>(str, base32DecodedSize(str.size()));
+}
+
+const std::string Codec::base64Decode(const std::string &str)
+{
+    return decode_string<&Codec::base64Decode>(str, base64DecodedSize(str.size()));
+}
+
+const std::string Codec::hexDecode(const std::string &str)
+{
+    return decode_string<&Codec::hexDecode>(str, hexDecodedSize(str.size()));
+}
+
+bool Codec::base32Decode(const std::string &str, std::string &out)
+{
+    out.resize(base32DecodedSize(str.size()));
+    out.resize(base32Decode(str.data(), str.size(), reinterpret_cast<unsigned char*>(&out[0])));
+    return !out.empty();
+}
+
+bool Codec::base32Decode(const std::string_view &str, SecureString &out)
+{
+    out.resize(base32DecodedSize(str.size()));
+    out.resize(base32Decode(str.data(), str.size(), reinterpret_cast<unsigned char*>(&out[0])));
+    return !out.empty();
+}
@@ -0,0 +1,79 @@
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "SecureMemory.hpp"
+
+/**
+ * Binary to text conversions used by the token secrets
+ *
+ *  -> base-32 (RFC 4648 alphabet, no padding)
+ *  -> base-64 (RFC 4648 alphabet, padded)
+ *  -> hexadecimal
+ *
+ * The buffer interfaces don't allocate and are safe to call from multiple
+ * threads. Decoders skip invalid characters (whitespace, padding, ...) and
+ * drop incomplete trailing bits, the output buffer must have at least the
+ * size returned by the matching *DecodedSize() function.
+ *
+ */
+class Codec
+{
+public:
+    // maximum output sizes
+    static constexpr std::size_t base32EncodedSize(std::size_t size)
+    { return (size * 8U + 4U) / 5U; }
+    static constexpr std::size_t base32DecodedSize(std::size_t length)
+    { return length * 5U / 8U; }
+    static constexpr std::size_t base64EncodedSize(std::size_t size)
+    { return (size + 2U) / 3U * 4U; }
+    static constexpr std::size_t base64DecodedSize(std::size_t length)
+    { return length * 3U / 4U; }
+    static constexpr std::size_t hexEncodedSize(std::size_t size)
+    { return size * 2U; }
+    static constexpr std::size_t hexDecodedSize(std::size_t length)
+    { return length / 2U; }
+
+    // encode into the buffer, returns the amount of characters written (no '\0' terminator)
+    static std::size_t base32Encode(const unsigned char *data, std::size_t size, char *out) noexcept;
+    static std::size_t base64Encode(const unsigned char *data, std::size_t size, char *out) noexcept;
+    static std::size_t hexEncode(const unsigned char *data, std::size_t size, char *out) noexcept;
+
+    // decode into the buffer, returns the amount of bytes written
+    // decoding stops at the first '\0' character
+    static std::size_t base32Decode(const char *str, std::size_t length, unsigned char *out) noexcept;
+    static std::size_t base64Decode(const char *str, std::size_t length, unsigned char *out) noexcept;
+    static std::size_t hexDecode(const char *str, std::size_t length, unsigned char *out) noexcept;
+
+    // hexadecimal to base-32 in a single pass, same result as base32Encode(hexDecode()) without
+    // the intermediate bytes, out must have base32EncodedSize(hexDecodedSize(length)) characters
+    static std::size_t hexToBase32(const char *str, std::size_t length, char *out) noexcept;
+    // converts count hexadecimal strings stored back to back, lengths holds the size of every
+    // string and is updated to the size of its base-32 string, which are written back to back,
+    // returns the total amount of characters written
+    static std::size_t hexToBase32(const char *str, std::size_t *lengths, std::size_t count, char *out) noexcept;
+
+    // amount of base-32 alphabet characters (either case) before the first '\0',
+    // this is the input the decoder uses, everything else is skipped
+    static std::size_t base32Characters(const char *str, std::size_t length) noexcept;
+
+    // string convenience wrappers
+    static const std::string base32Encode(const std::string &data);
+    static const std::string base64Encode(const std::string &data);
+    static const std::string hexEncode(const std::string &data);
+    static const std::string base32Decode(const std::string &str);
+    static const std::string base64Decode(const std::string &str);
+    static const std::string hexDecode(const std::string &str);
+
+    // decode into the given string, the capacity is reused when possible
+    static bool base32Decode(const std::string &str, std::string &out);
+    static bool base32Decode(const std::string_view &str, SecureString &out);
+
+private:
+    Codec() = delete;
+};
+
+#endif // CODEC_HPP
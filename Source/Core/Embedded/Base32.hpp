@@ -0,0 +1,103 @@
+#ifndef EMBEDDED_BASE32_HPP
+#define EMBEDDED_BASE32_HPP
+
+// constexpr base-32 codec (RFC 4648) for the freestanding profile
+//
+// decodes like Codec::base32Decode(): letters in either case, characters outside
+// of the alphabet (spaces, dashes, padding) are skipped and trailing bits which
+// don't make up a byte are dropped
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Embedded {
+
+namespace Detail {
+
+constexpr int base32Value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+    {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - 'a';
+    }
+    if (c >= '2' && c <= '7')
+    {
+        return c - '2' + 26;
+    }
+    return -1;
+}
+
+} // namespace Detail
+
+constexpr std::size_t base32DecodedSize(std::size_t length)
+{
+    return length * 5U / 8U;
+}
+
+constexpr std::size_t base32EncodedSize(std::size_t size)
+{
+    return (size * 8U + 4U) / 5U;
+}
+
+// decoded bytes, 0 when the output would exceed the capacity
+constexpr std::size_t base32Decode(const char *str, std::size_t length, unsigned char *out, std::size_t capacity)
+{
+    std::uint32_t buffer = 0U;
+    unsigned int bits = 0U;
+    std::size_t size = 0U;
+
+    for (std::size_t i = 0U; i < length && str[i] != '\0'; ++i)
+    {
+        const auto value = Detail::base32Value(str[i]);
+        if (value < 0)
+        {
+            continue;
+        }
+
+        buffer = (buffer << 5) | static_cast<std::uint32_t>(value);
+        bits += 5U;
+        if (bits >= 8U)
+        {
+            bits -= 8U;
+            if (size == capacity)
+            {
+                return 0U;
+            }
+            out[size++] = static_cast<unsigned char>(buffer >> bits);
+        }
+    }
+    return size;
+}
+
+// upper case characters without padding, out must have base32EncodedSize(size) characters
+constexpr std::size_t base32Encode(const unsigned char *data, std::size_t size, char *out)
+{
+    constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+    std::uint32_t buffer = 0U;
+    unsigned int bits = 0U;
+    std::size_t length = 0U;
+
+    for (std::size_t i = 0U; i < size; ++i)
+    {
+        buffer = (buffer << 8) | data[i];
+        bits += 8U;
+        while (bits >= 5U)
+        {
+            bits -= 5U;
+            out[length++] = alphabet[(buffer >> bits) & 31U];
+        }
+    }
+    if (bits > 0U)
+    {
+        out[length++] = alphabet[(buffer << (5U - bits)) & 31U];
+    }
+    return length;
+}
+
+} // namespace Embedded
+
+#endif // EMBEDDED_BASE32_HPP
@@ -0,0 +1,493 @@
+#ifndef EMBEDDED_SHA_HPP
+#define EMBEDDED_SHA_HPP
+
+// portable SHA-1, SHA-256, SHA-512 and HMAC (RFC 2104) for the freestanding profile
+//
+// no heap, no exceptions, no RTTI and nothing of the standard library beyond the
+// fixed width integers, every function is constexpr so the kernels can be checked
+// at compile time. The desktop library has its own accelerated kernels (see
+// Internal/ShaCompress.hpp), the tests run both to keep them at parity.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Embedded {
+
+namespace Detail {
+
+template<typename Word>
+constexpr Word rotr(Word x, unsigned n)
+{
+    return static_cast<Word>((x >> n) | (x << (sizeof(Word) * 8U - n)));
+}
+
+template<typename Word>
+constexpr Word rotl(Word x, unsigned n)
+{
+    return static_cast<Word>((x << n) | (x >> (sizeof(Word) * 8U - n)));
+}
+
+template<typename Word>
+constexpr Word loadBE(const unsigned char *p)
+{
+    Word w = 0;
+    for (auto i = 0U; i < sizeof(Word); ++i)
+    {
+        w = static_cast<Word>((w << 8) | p[i]);
+    }
+    return w;
+}
+
+template<typename Word>
+constexpr void storeBE(Word w, unsigned char *p)
+{
+    for (auto i = sizeof(Word); i > 0U; --i)
+    {
+        p[i - 1U] = static_cast<unsigned char>(w & 0xffU);
+        w = static_cast<Word>(w >> 8);
+    }
+}
+
+// overwrites memory which held keys, the loop isn't removed for memory which is read later
+constexpr void wipe(unsigned char *p, std::size_t size)
+{
+    for (std::size_t i = 0U; i < size; ++i)
+    {
+        p[i] = 0U;
+    }
+}
+
+struct Sha1Engine
+{
+    using Word = std::uint32_t;
+    static const constexpr std::size_t BLOCK_SIZE = 64U;
+    static const constexpr std::size_t DIGEST_SIZE = 20U;
+    static const constexpr std::size_t STATE_WORDS = 5U;
+    static const constexpr std::size_t LENGTH_SIZE = 8U;
+
+    static constexpr void init(Word *state)
+    {
+        state[0] = 0x67452301U;
+        state[1] = 0xefcdab89U;
+        state[2] = 0x98badcfeU;
+        state[3] = 0x10325476U;
+        state[4] = 0xc3d2e1f0U;
+    }
+
+    static constexpr void compress(Word *state, const unsigned char *block)
+    {
+        // the schedule is kept in a rolling window of 16 words
+        Word w[16] = {};
+        for (auto i = 0U; i < 16U; ++i)
+        {
+            w[i] = loadBE<Word>(block + i * 4U);
+        }
+
+        auto a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (auto i = 0U; i < 80U; ++i)
+        {
+            if (i >= 16U)
+            {
+                w[i & 15U] = rotl<Word>(w[(i + 13U) & 15U] ^ w[(i + 8U) & 15U] ^ w[(i + 2U) & 15U] ^ w[i & 15U], 1U);
+            }
+
+            Word f = 0, k = 0;
+            if (i < 20U)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999U;
+            }
+            else if (i < 40U)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1U;
+            }
+            else if (i < 60U)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdcU;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6U;
+            }
+
+            const auto t = static_cast<Word>(rotl<Word>(a, 5U) + f + e + k + w[i & 15U]);
+            e = d;
+            d = c;
+            c = rotl<Word>(b, 30U);
+            b = a;
+            a = t;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+};
+
+struct Sha256Engine
+{
+    using Word = std::uint32_t;
+    static const constexpr std::size_t BLOCK_SIZE = 64U;
+    static const constexpr std::size_t DIGEST_SIZE = 32U;
+    static const constexpr std::size_t STATE_WORDS = 8U;
+    static const constexpr std::size_t LENGTH_SIZE = 8U;
+
+    static constexpr void init(Word *state)
+    {
+        const Word iv[8] = {
+            0x6a09e667U, 0xbb67ae85U, 0x3c6ef372U, 0xa54ff53aU,
+            0x510e527fU, 0x9b05688cU, 0x1f83d9abU, 0x5be0cd19U,
+        };
+        for (auto i = 0U; i < 8U; ++i)
+        {
+            state[i] = iv[i];
+        }
+    }
+
+    static constexpr void compress(Word *state, const unsigned char *block)
+    {
+        constexpr Word K[64] = {
+            0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU, 0x59f111f1U, 0x923f82a4U, 0xab1c5ed5U,
+            0xd807aa98U, 0x12835b01U, 0x243185beU, 0x550c7dc3U, 0x72be5d74U, 0x80deb1feU, 0x9bdc06a7U, 0xc19bf174U,
+            0xe49b69c1U, 0xefbe4786U, 0x0fc19dc6U, 0x240ca1ccU, 0x2de92c6fU, 0x4a7484aaU, 0x5cb0a9dcU, 0x76f988daU,
+            0x983e5152U, 0xa831c66dU, 0xb00327c8U, 0xbf597fc7U, 0xc6e00bf3U, 0xd5a79147U, 0x06ca6351U, 0x14292967U,
+            0x27b70a85U, 0x2e1b2138U, 0x4d2c6dfcU, 0x53380d13U, 0x650a7354U, 0x766a0abbU, 0x81c2c92eU, 0x92722c85U,
+            0xa2bfe8a1U, 0xa81a664bU, 0xc24b8b70U, 0xc76c51a3U, 0xd192e819U, 0xd6990624U, 0xf40e3585U, 0x106aa070U,
+            0x19a4c116U, 0x1e376c08U, 0x2748774cU, 0x34b0bcb5U, 0x391c0cb3U, 0x4ed8aa4aU, 0x5b9cca4fU, 0x682e6ff3U,
+            0x748f82eeU, 0x78a5636fU, 0x84c87814U, 0x8cc70208U, 0x90befffaU, 0xa4506cebU, 0xbef9a3f7U, 0xc67178f2U,
+        };
+
+        Word w[16] = {};
+        for (auto i = 0U; i < 16U; ++i)
+        {
+            w[i] = loadBE<Word>(block + i * 4U);
+        }
+
+        Word v[8] = {};
+        for (auto i = 0U; i < 8U; ++i)
+        {
+            v[i] = state[i];
+        }
+
+        for (auto i = 0U; i < 64U; ++i)
+        {
+            if (i >= 16U)
+            {
+                const auto w15 = w[(i + 1U) & 15U], w2 = w[(i + 14U) & 15U];
+                const auto s0 = rotr<Word>(w15, 7U) ^ rotr<Word>(w15, 18U) ^ (w15 >> 3);
+                const auto s1 = rotr<Word>(w2, 17U) ^ rotr<Word>(w2, 19U) ^ (w2 >> 10);
+                w[i & 15U] = static_cast<Word>(w[i & 15U] + s0 + w[(i + 9U) & 15U] + s1);
+            }
+
+            const auto S1 = rotr<Word>(v[4], 6U) ^ rotr<Word>(v[4], 11U) ^ rotr<Word>(v[4], 25U);
+            const auto ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+            const auto t1 = static_cast<Word>(v[7] + S1 + ch + K[i] + w[i & 15U]);
+            const auto S0 = rotr<Word>(v[0], 2U) ^ rotr<Word>(v[0], 13U) ^ rotr<Word>(v[0], 22U);
+            const auto maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+            const auto t2 = static_cast<Word>(S0 + maj);
+
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = static_cast<Word>(v[3] + t1);
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = static_cast<Word>(t1 + t2);
+        }
+
+        for (auto i = 0U; i < 8U; ++i)
+        {
+            state[i] += v[i];
+        }
+    }
+};
+
+struct Sha512Engine
+{
+    using Word = std::uint64_t;
+    static const constexpr std::size_t BLOCK_SIZE = 128U;
+    static const constexpr std::size_t DIGEST_SIZE = 64U;
+    static const constexpr std::size_t STATE_WORDS = 8U;
+    static const constexpr std::size_t LENGTH_SIZE = 16U;
+
+    static constexpr void init(Word *state)
+    {
+        const Word iv[8] = {
+            0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+            0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+        };
+        for (auto i = 0U; i < 8U; ++i)
+        {
+            state[i] = iv[i];
+        }
+    }
+
+    static constexpr void compress(Word *state, const unsigned char *block)
+    {
+        constexpr Word K[80] = {
+            0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+            0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+            0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+            0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+            0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+            0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+            0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+            0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+            0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+            0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+            0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+            0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+            0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+            0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+            0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+            0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+            0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+            0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+            0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+            0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+        };
+
+        Word w[16] = {};
+        for (auto i = 0U; i < 16U; ++i)
+        {
+            w[i] = loadBE<Word>(block + i * 8U);
+        }
+
+        Word v[8] = {};
+        for (auto i = 0U; i < 8U; ++i)
+        {
+            v[i] = state[i];
+        }
+
+        for (auto i = 0U; i < 80U; ++i)
+        {
+            if (i >= 16U)
+            {
+                const auto w15 = w[(i + 1U) & 15U], w2 = w[(i + 14U) & 15U];
+                const auto s0 = rotr<Word>(w15, 1U) ^ rotr<Word>(w15, 8U) ^ (w15 >> 7);
+                const auto s1 = rotr<Word>(w2, 19U) ^ rotr<Word>(w2, 61U) ^ (w2 >> 6);
+                w[i & 15U] = w[i & 15U] + s0 + w[(i + 9U) & 15U] + s1;
+            }
+
+            const auto S1 = rotr<Word>(v[4], 14U) ^ rotr<Word>(v[4], 18U) ^ rotr<Word>(v[4], 41U);
+            const auto ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+            const auto t1 = v[7] + S1 + ch + K[i] + w[i & 15U];
+            const auto S0 = rotr<Word>(v[0], 28U) ^ rotr<Word>(v[0], 34U) ^ rotr<Word>(v[0], 39U);
+            const auto maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = v[3] + t1;
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = t1 + S0 + maj;
+        }
+
+        for (auto i = 0U; i < 8U; ++i)
+        {
+            state[i] += v[i];
+        }
+    }
+};
+
+} // namespace Detail
+
+// streaming hash over one of the engines above, the whole state is inline
+template<class Engine>
+class Hash
+{
+public:
+    using Word = typename Engine::Word;
+    static const constexpr std::size_t BLOCK_SIZE = Engine::BLOCK_SIZE;
+    static const constexpr std::size_t DIGEST_SIZE = Engine::DIGEST_SIZE;
+    static const constexpr std::size_t STATE_WORDS = Engine::STATE_WORDS;
+
+    constexpr Hash()
+    {
+        this->init();
+    }
+
+    // also clears the buffered block, which may hold key material
+    constexpr void init()
+    {
+        Engine::init(this->_state);
+        Detail::wipe(this->_block, BLOCK_SIZE);
+        this->_used = 0U;
+        this->_length = 0U;
+    }
+
+    constexpr void update(const unsigned char *data, std::size_t size)
+    {
+        this->_length += size;
+        for (std::size_t i = 0U; i < size; ++i)
+        {
+            this->_block[this->_used++] = data[i];
+            if (this->_used == BLOCK_SIZE)
+            {
+                Engine::compress(this->_state, this->_block);
+                this->_used = 0U;
+            }
+        }
+    }
+
+    // the digest has DIGEST_SIZE bytes, the hash must be initialized again for the next message
+    constexpr void finish(unsigned char *digest)
+    {
+        const auto bits = static_cast<std::uint64_t>(this->_length) * 8U;
+
+        // padding, the length is stored big endian in the last bytes of the block
+        this->_block[this->_used++] = 0x80U;
+        if (this->_used > BLOCK_SIZE - Engine::LENGTH_SIZE)
+        {
+            while (this->_used < BLOCK_SIZE)
+            {
+                this->_block[this->_used++] = 0U;
+            }
+            Engine::compress(this->_state, this->_block);
+            this->_used = 0U;
+        }
+        while (this->_used < BLOCK_SIZE - 8U)
+        {
+            this->_block[this->_used++] = 0U;
+        }
+        Detail::storeBE<std::uint64_t>(bits, this->_block + BLOCK_SIZE - 8U);
+        Engine::compress(this->_state, this->_block);
+
+        for (auto i = 0U; i < DIGEST_SIZE / sizeof(Word); ++i)
+        {
+            Detail::storeBE<Word>(this->_state[i], digest + i * sizeof(Word));
+        }
+        Detail::wipe(this->_block, BLOCK_SIZE);
+    }
+
+    // the state after the given blocks, used by Hmac to start from the precomputed pads
+    constexpr void setState(const Word *state, std::size_t length)
+    {
+        for (auto i = 0U; i < Engine::STATE_WORDS; ++i)
+        {
+            this->_state[i] = state[i];
+        }
+        this->_used = 0U;
+        this->_length = length;
+    }
+    constexpr const Word *state() const
+    {
+        return this->_state;
+    }
+
+private:
+    Word _state[Engine::STATE_WORDS] = {};
+    unsigned char _block[BLOCK_SIZE] = {};
+    std::size_t _used = 0U;
+    std::size_t _length = 0U;
+};
+
+using Sha1 = Hash<Detail::Sha1Engine>;
+using Sha256 = Hash<Detail::Sha256Engine>;
+using Sha512 = Hash<Detail::Sha512Engine>;
+
+// HMAC with the hash states after the key pads, computed once per key,
+// only the states are kept (no key bytes and no block buffers)
+template<class H>
+class Hmac
+{
+public:
+    using Word = typename H::Word;
+    static const constexpr std::size_t DIGEST_SIZE = H::DIGEST_SIZE;
+    static const constexpr std::size_t STATE_WORDS = H::STATE_WORDS;
+
+    constexpr Hmac() = default;
+
+    // restores a key from the states of inner() and outer()
+    constexpr Hmac(const Word *inner, const Word *outer)
+    {
+        for (auto i = 0U; i < STATE_WORDS; ++i)
+        {
+            this->_inner[i] = inner[i];
+            this->_outer[i] = outer[i];
+        }
+    }
+
+    // keys longer than the block size are hashed first (RFC 2104)
+    constexpr Hmac(const unsigned char *key, std::size_t size)
+    {
+        unsigned char block[H::BLOCK_SIZE] = {};
+        if (size > H::BLOCK_SIZE)
+        {
+            H hash;
+            hash.update(key, size);
+            hash.finish(block);
+        }
+        else
+        {
+            for (std::size_t i = 0U; i < size; ++i)
+            {
+                block[i] = key[i];
+            }
+        }
+
+        unsigned char pad[H::BLOCK_SIZE] = {};
+        H hash;
+        for (auto i = 0U; i < H::BLOCK_SIZE; ++i)
+        {
+            pad[i] = static_cast<unsigned char>(block[i] ^ 0x36U);
+        }
+        hash.update(pad, H::BLOCK_SIZE);
+        this->copyState(hash.state(), this->_inner);
+
+        hash.init();
+        for (auto i = 0U; i < H::BLOCK_SIZE; ++i)
+        {
+            pad[i] = static_cast<unsigned char>(block[i] ^ 0x5cU);
+        }
+        hash.update(pad, H::BLOCK_SIZE);
+        this->copyState(hash.state(), this->_outer);
+
+        Detail::wipe(block, H::BLOCK_SIZE);
+        Detail::wipe(pad, H::BLOCK_SIZE);
+    }
+
+    constexpr const Word *inner() const
+    { return this->_inner; }
+    constexpr const Word *outer() const
+    { return this->_outer; }
+
+    // MAC of the message, the prepared key can be used again
+    constexpr void mac(const unsigned char *message, std::size_t size, unsigned char *out) const
+    {
+        H inner;
+        inner.setState(this->_inner, H::BLOCK_SIZE);
+        inner.update(message, size);
+        unsigned char digest[H::DIGEST_SIZE] = {};
+        inner.finish(digest);
+
+        H outer;
+        outer.setState(this->_outer, H::BLOCK_SIZE);
+        outer.update(digest, H::DIGEST_SIZE);
+        outer.finish(out);
+    }
+
+private:
+    static constexpr void copyState(const Word *from, Word *to)
+    {
+        for (auto i = 0U; i < STATE_WORDS; ++i)
+        {
+            to[i] = from[i];
+        }
+    }
+
+    Word _inner[STATE_WORDS] = {};
+    Word _outer[STATE_WORDS] = {};
+};
+
+} // namespace Embedded
+
+#endif // EMBEDDED_SHA_HPP
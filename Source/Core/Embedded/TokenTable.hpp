@@ -0,0 +1,410 @@
+#ifndef EMBEDDED_TOKENTABLE_HPP
+#define EMBEDDED_TOKENTABLE_HPP
+
+// code generation and verification for the freestanding profile
+//
+// HOTP (RFC 4226), TOTP (RFC 6238) and Steam Guard codes over the kernels of
+// Sha.hpp, written into caller buffers, and a table with a fixed capacity of
+// tokens chosen at compile time. Nothing allocates, nothing throws, results
+// are reported as Status. The type and algorithm numbers are the ones of
+// OTPToken, so records of the token database map one to one.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Base32.hpp"
+#include "Sha.hpp"
+
+namespace Embedded {
+
+enum class Status : std::uint8_t {
+    Ok = 0,
+    Mismatch,         // the code was checked and doesn't match
+    NotFound,         // no token with this id
+    Full,             // the table has no free slot
+    InvalidArgument,  // out of range parameter or invalid secret
+};
+
+// same values as OTPToken::TokenType and OTPToken::ShaAlgorithm
+enum class TokenType : std::uint8_t {
+    TOTP  = 1,
+    HOTP  = 2,
+    Steam = 3,
+};
+
+enum class Algorithm : std::uint8_t {
+    SHA1   = 1,
+    SHA256 = 2,
+    SHA512 = 3,
+};
+
+static const constexpr std::uint8_t MIN_DIGITS = 3U;
+static const constexpr std::uint8_t MAX_DIGITS = 10U;
+static const constexpr std::size_t STEAM_DIGITS = 5U;
+// the code and its terminating '\0'
+static const constexpr std::size_t CODE_BUFFER = MAX_DIGITS + 1U;
+
+namespace Detail {
+
+constexpr std::size_t digestSize(Algorithm algorithm)
+{
+    return algorithm == Algorithm::SHA512 ? Sha512::DIGEST_SIZE :
+           algorithm == Algorithm::SHA256 ? Sha256::DIGEST_SIZE : Sha1::DIGEST_SIZE;
+}
+
+// dynamic truncation (RFC 4226), the 31-bit binary code of the MAC
+constexpr std::uint32_t truncate(const unsigned char *mac, std::size_t size)
+{
+    const auto offset = mac[size - 1U] & 0x0fU;
+    return (static_cast<std::uint32_t>(mac[offset] & 0x7fU) << 24) |
+           (static_cast<std::uint32_t>(mac[offset + 1U]) << 16) |
+           (static_cast<std::uint32_t>(mac[offset + 2U]) << 8) |
+           static_cast<std::uint32_t>(mac[offset + 3U]);
+}
+
+constexpr void encodeDecimal(std::uint32_t value, std::uint8_t digits, char *out)
+{
+    for (auto i = digits; i > 0U; --i)
+    {
+        out[i - 1U] = static_cast<char>('0' + value % 10U);
+        value /= 10U;
+    }
+    out[digits] = '\0';
+}
+
+constexpr void encodeSteam(std::uint32_t value, char *out)
+{
+    constexpr char alphabet[] = "23456789BCDFGHJKMNPQRTVWXY";
+    for (auto i = 0U; i < STEAM_DIGITS; ++i)
+    {
+        out[i] = alphabet[value % 26U];
+        value /= 26U;
+    }
+    out[STEAM_DIGITS] = '\0';
+}
+
+// compares the whole code to not leak the position of the first mismatch
+constexpr bool equalCodes(const char *lhs, const char *rhs)
+{
+    unsigned char diff = 0U;
+    std::size_t i = 0U;
+    for (; lhs[i] != '\0' && rhs[i] != '\0'; ++i)
+    {
+        diff |= static_cast<unsigned char>(lhs[i] ^ rhs[i]);
+    }
+    return diff == 0U && lhs[i] == '\0' && rhs[i] == '\0';
+}
+
+} // namespace Detail
+
+// prepared key of a token, the hash states after the key pads of its algorithm
+// (128 bytes whatever the algorithm, a zero key is the state of an empty slot)
+class Key
+{
+public:
+    constexpr Key() = default;
+
+    constexpr Key(const unsigned char *key, std::size_t size, Algorithm algorithm)
+        : _algorithm(algorithm)
+    {
+        switch (algorithm)
+        {
+            case Algorithm::SHA1:   this->store(Hmac<Sha1>(key, size)); break;
+            case Algorithm::SHA256: this->store(Hmac<Sha256>(key, size)); break;
+            case Algorithm::SHA512: this->store(Hmac<Sha512>(key, size)); break;
+        }
+    }
+
+    constexpr Algorithm algorithm() const
+    { return this->_algorithm; }
+
+    // the 31-bit binary code of the counter (big endian moving factor)
+    constexpr std::uint32_t binaryCode(std::uint64_t counter) const
+    {
+        unsigned char message[8] = {};
+        Detail::storeBE<std::uint64_t>(counter, message);
+        unsigned char mac[Sha512::DIGEST_SIZE] = {};
+        switch (this->_algorithm)
+        {
+            case Algorithm::SHA1:   this->load<Sha1>().mac(message, sizeof(message), mac); break;
+            case Algorithm::SHA256: this->load<Sha256>().mac(message, sizeof(message), mac); break;
+            case Algorithm::SHA512: this->load<Sha512>().mac(message, sizeof(message), mac); break;
+        }
+        return Detail::truncate(mac, Detail::digestSize(this->_algorithm));
+    }
+
+private:
+    static const constexpr std::size_t STATE_WORDS = 8U;
+
+    template<class H>
+    constexpr void store(const Hmac<H> &hmac)
+    {
+        for (auto i = 0U; i < Hmac<H>::STATE_WORDS; ++i)
+        {
+            this->_inner[i] = hmac.inner()[i];
+            this->_outer[i] = hmac.outer()[i];
+        }
+    }
+
+    template<class H>
+    constexpr Hmac<H> load() const
+    {
+        using Word = typename Hmac<H>::Word;
+        Word inner[Hmac<H>::STATE_WORDS] = {};
+        Word outer[Hmac<H>::STATE_WORDS] = {};
+        for (auto i = 0U; i < Hmac<H>::STATE_WORDS; ++i)
+        {
+            inner[i] = static_cast<Word>(this->_inner[i]);
+            outer[i] = static_cast<Word>(this->_outer[i]);
+        }
+        return Hmac<H>(inner, outer);
+    }
+
+    std::uint64_t _inner[STATE_WORDS] = {};
+    std::uint64_t _outer[STATE_WORDS] = {};
+    Algorithm _algorithm = {};
+};
+
+// the counter of time-based tokens, false before the epoch or for period 0
+constexpr bool timeCounter(std::int64_t time, std::uint32_t period, std::uint64_t &counter)
+{
+    if (period == 0U || time < 0)
+    {
+        return false;
+    }
+    counter = static_cast<std::uint64_t>(time) / period;
+    return true;
+}
+
+// out must have CODE_BUFFER characters, codes of more digits than the 31 bits of the binary code are zero padded
+constexpr Status hotp(const Key &key, std::uint64_t counter, std::uint8_t digits, char *out)
+{
+    if (digits < MIN_DIGITS || digits > MAX_DIGITS)
+    {
+        return Status::InvalidArgument;
+    }
+    Detail::encodeDecimal(key.binaryCode(counter), digits, out);
+    return Status::Ok;
+}
+
+constexpr Status totp(const Key &key, std::int64_t time, std::uint32_t period, std::uint8_t digits, char *out)
+{
+    std::uint64_t counter = 0U;
+    if (!timeCounter(time, period, counter))
+    {
+        return Status::InvalidArgument;
+    }
+    return hotp(key, counter, digits, out);
+}
+
+// Steam Guard uses SHA-1 and a period of 30 seconds, the time should be the one of the Steam servers
+constexpr Status steam(const Key &key, std::int64_t time, char *out)
+{
+    std::uint64_t counter = 0U;
+    if (key.algorithm() != Algorithm::SHA1 || !timeCounter(time, 30U, counter))
+    {
+        return Status::InvalidArgument;
+    }
+    Detail::encodeSteam(key.binaryCode(counter), out);
+    return Status::Ok;
+}
+
+/**
+ * Tokens of a verifier in a fixed amount of memory
+ *
+ * Capacity tokens with secrets of up to MaxSecret bytes, the secrets are
+ * only kept as prepared keys. Ids are chosen by the caller and unique in
+ * the table. Verification of counter-based tokens looks ahead and moves
+ * the counter past the accepted code, like a verification server does.
+ *
+ */
+template<std::size_t Capacity, std::size_t MaxSecret = 64U>
+class TokenTable
+{
+public:
+    struct Token
+    {
+        std::uint32_t id = 0U;
+        TokenType type = TokenType::TOTP;
+        Algorithm algorithm = Algorithm::SHA1;
+        std::uint8_t digits = 6U;
+        std::uint32_t period = 30U;
+        std::uint64_t counter = 0U;
+    };
+
+    constexpr TokenTable() = default;
+
+    static constexpr std::size_t capacity()
+    { return Capacity; }
+    constexpr std::size_t size() const
+    { return this->_size; }
+
+    // the secret is the raw key, id 0 is reserved for free slots
+    constexpr Status add(const Token &token, const unsigned char *secret, std::size_t size)
+    {
+        if (token.id == 0U || size == 0U || size > MaxSecret ||
+            (token.type != TokenType::Steam && (token.digits < MIN_DIGITS || token.digits > MAX_DIGITS)) ||
+            (token.type != TokenType::HOTP && token.period == 0U) ||
+            (token.type == TokenType::Steam && token.algorithm != Algorithm::SHA1))
+        {
+            return Status::InvalidArgument;
+        }
+        if (this->find(token.id) != Capacity)
+        {
+            return Status::InvalidArgument;
+        }
+        if (this->_size == Capacity)
+        {
+            return Status::Full;
+        }
+
+        auto &slot = this->_slots[this->_size++];
+        slot.id = token.id;
+        slot.type = token.type;
+        slot.digits = token.digits;
+        slot.period = token.period;
+        slot.counter = token.counter;
+        slot.key = Key(secret, size, token.algorithm);
+        return Status::Ok;
+    }
+
+    // the secret in base-32 like in otpauth URIs
+    constexpr Status addBase32(const Token &token, const char *secret, std::size_t length)
+    {
+        unsigned char key[MaxSecret] = {};
+        const auto size = base32Decode(secret, length, key, MaxSecret);
+        const auto status = size == 0U ? Status::InvalidArgument : this->add(token, key, size);
+        Detail::wipe(key, MaxSecret);
+        return status;
+    }
+
+    constexpr Status remove(std::uint32_t id)
+    {
+        const auto index = this->find(id);
+        if (index == Capacity)
+        {
+            return Status::NotFound;
+        }
+
+        // the last slot moves into the gap, the removed key is overwritten
+        this->_slots[index] = this->_slots[this->_size - 1U];
+        this->_slots[--this->_size] = Slot();
+        return Status::Ok;
+    }
+
+    constexpr Status token(std::uint32_t id, Token &token) const
+    {
+        const auto index = this->find(id);
+        if (index == Capacity)
+        {
+            return Status::NotFound;
+        }
+        const auto &slot = this->_slots[index];
+        token.id = slot.id;
+        token.type = slot.type;
+        token.algorithm = slot.key.algorithm();
+        token.digits = slot.digits;
+        token.period = slot.period;
+        token.counter = slot.counter;
+        return Status::Ok;
+    }
+
+    // the current code, counter-based tokens use their counter without advancing it
+    constexpr Status generate(std::uint32_t id, std::int64_t time, char *out) const
+    {
+        const auto index = this->find(id);
+        if (index == Capacity)
+        {
+            return Status::NotFound;
+        }
+        const auto &slot = this->_slots[index];
+        switch (slot.type)
+        {
+            case TokenType::TOTP:  return totp(slot.key, time, slot.period, slot.digits, out);
+            case TokenType::HOTP:  return hotp(slot.key, slot.counter, slot.digits, out);
+            case TokenType::Steam: return steam(slot.key, time, out);
+        }
+        return Status::InvalidArgument;
+    }
+
+    // time-based codes are accepted within window periods before and after the time, counter-based
+    // ones within window counters ahead, an accepted counter-based code advances the counter past it
+    constexpr Status verify(std::uint32_t id, const char *code, std::int64_t time, std::uint32_t window)
+    {
+        const auto index = this->find(id);
+        if (index == Capacity)
+        {
+            return Status::NotFound;
+        }
+        auto &slot = this->_slots[index];
+
+        char expected[CODE_BUFFER] = {};
+        if (slot.type == TokenType::HOTP)
+        {
+            for (std::uint64_t i = 0U; i <= window; ++i)
+            {
+                (void) hotp(slot.key, slot.counter + i, slot.digits, expected);
+                if (Detail::equalCodes(code, expected))
+                {
+                    slot.counter += i + 1U;
+                    return Status::Ok;
+                }
+            }
+            return Status::Mismatch;
+        }
+
+        const auto period = slot.type == TokenType::Steam ? 30U : slot.period;
+        std::uint64_t counter = 0U;
+        if (!timeCounter(time, period, counter))
+        {
+            return Status::InvalidArgument;
+        }
+
+        // every step is computed, the time doesn't tell at which offset the code matched
+        auto matched = false;
+        for (std::uint64_t i = counter > window ? counter - window : 0U; i <= counter + window; ++i)
+        {
+            if (slot.type == TokenType::Steam)
+            {
+                Detail::encodeSteam(slot.key.binaryCode(i), expected);
+            }
+            else
+            {
+                (void) hotp(slot.key, i, slot.digits, expected);
+            }
+            matched |= Detail::equalCodes(code, expected);
+        }
+        return matched ? Status::Ok : Status::Mismatch;
+    }
+
+private:
+    // all zero when free, the table is zero-initialized (.bss) in static memory
+    struct Slot
+    {
+        std::uint64_t counter = 0U;
+        std::uint32_t id = 0U;
+        std::uint32_t period = 0U;
+        TokenType type = {};
+        std::uint8_t digits = 0U;
+        Key key;
+    };
+
+    constexpr std::size_t find(std::uint32_t id) const
+    {
+        for (std::size_t i = 0U; i < this->_size; ++i)
+        {
+            if (this->_slots[i].id == id)
+            {
+                return i;
+            }
+        }
+        return Capacity;
+    }
+
+    Slot _slots[Capacity] = {};
+    std::size_t _size = 0U;
+};
+
+} // namespace Embedded
+
+#endif // EMBEDDED_TOKENTABLE_HPP
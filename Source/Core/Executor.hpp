@@ -0,0 +1,31 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * Parallel execution interface for the batch APIs
+ *
+ * Splits an index range into chunks of a given grain size and runs the
+ * task on all of them, parallelFor() returns after every chunk was
+ * processed. Library users can plug in their own scheduler by
+ * implementing this interface, ThreadPool is the default implementation.
+ *
+ */
+class Executor
+{
+public:
+    // processes the index range [begin, end)
+    using Task = std::function<void(std::size_t begin, std::size_t end)>;
+
+    virtual ~Executor() = default;
+
+    // amount of threads tasks are executed on
+    virtual std::size_t concurrency() const = 0;
+
+    // run the task over [0, count) in chunks of grain indices
+    virtual void parallelFor(std::size_t count, std::size_t grain, const Task &task) = 0;
+};
+
+#endif // EXECUTOR_HPP
@@ -0,0 +1,162 @@
+#include "AtomicFile.hpp"
+
+#include <cerrno>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ATOMICFILE_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Internal {
+
+AtomicFile::~AtomicFile()
+{
+    discard();
+}
+
+bool AtomicFile::open(const std::string &location)
+{
+    discard();
+
+    const auto temporary = location + ".tmp";
+
+#ifdef ATOMICFILE_POSIX_IO
+    _fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (_fd == -1)
+    {
+        return false;
+    }
+#else
+    try {
+        _stream.open(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    } catch (...) {
+    }
+    if (!_stream.is_open())
+    {
+        return false;
+    }
+#endif
+
+    _location = location;
+    _temporary = temporary;
+    return true;
+}
+
+bool AtomicFile::write(const void *data, std::size_t size)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+#ifdef ATOMICFILE_POSIX_IO
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        const auto written = ::write(_fd, bytes, size);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+#else
+    try {
+        return static_cast<bool>(_stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size)));
+    } catch (...) {
+        return false;
+    }
+#endif
+}
+
+bool AtomicFile::commit()
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+#ifdef ATOMICFILE_POSIX_IO
+    const auto synced = ::fsync(_fd) == 0;
+    const auto closed = ::close(_fd) == 0;
+    _fd = -1;
+    if (!synced || !closed || ::rename(_temporary.c_str(), _location.c_str()) != 0)
+    {
+        discard();
+        return false;
+    }
+
+    // sync the directory so the rename itself survives a crash
+    auto directory = _location.substr(0, _location.find_last_of('/') + 1);
+    if (directory.empty())
+    {
+        directory = ".";
+    }
+    const auto dirfd = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirfd != -1)
+    {
+        (void) ::fsync(dirfd);
+        ::close(dirfd);
+    }
+#else
+    auto flushed = false;
+    try {
+        flushed = static_cast<bool>(_stream.flush());
+        _stream.close();
+    } catch (...) {
+        flushed = false;
+    }
+    if (!flushed)
+    {
+        discard();
+        return false;
+    }
+
+    // std::rename doesn't replace existing files on every platform
+    std::remove(_location.c_str());
+    if (std::rename(_temporary.c_str(), _location.c_str()) != 0)
+    {
+        discard();
+        return false;
+    }
+#endif
+
+    _location.clear();
+    _temporary.clear();
+    return true;
+}
+
+void AtomicFile::discard()
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+#ifdef ATOMICFILE_POSIX_IO
+    if (_fd != -1)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+#else
+    try {
+        _stream.close();
+    } catch (...) {
+    }
+#endif
+
+    std::remove(_temporary.c_str());
+    _location.clear();
+    _temporary.clear();
+}
+
+}
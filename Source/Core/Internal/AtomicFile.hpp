@@ -0,0 +1,48 @@
+#ifndef INTERNAL_ATOMICFILE_HPP
+#define INTERNAL_ATOMICFILE_HPP
+
+// file which is written incrementally and replaces its target at once
+//
+// the data is written to a temporary file next to the target, commit() syncs it
+// and renames it over the target, a crash or a failed write never leaves a truncated
+// or partially written file behind, the temporary file is removed if the object is
+// destroyed without a successful commit
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+namespace Internal {
+
+class AtomicFile final
+{
+public:
+    AtomicFile() = default;
+    ~AtomicFile();
+
+    AtomicFile(const AtomicFile&) = delete;
+    AtomicFile &operator=(const AtomicFile&) = delete;
+
+    // creates the temporary file, returns false if it can't be created
+    bool open(const std::string &location);
+    bool write(const void *data, std::size_t size);
+    // syncs and replaces the target, the file is closed afterwards
+    bool commit();
+    // removes the temporary file, the target is left untouched
+    void discard();
+
+    inline bool isOpen() const
+    { return !_temporary.empty(); }
+
+private:
+    std::string _location;
+    std::string _temporary;
+
+    int _fd = -1;
+    // platforms without POSIX I/O
+    std::ofstream _stream;
+};
+
+}
+
+#endif // INTERNAL_ATOMICFILE_HPP
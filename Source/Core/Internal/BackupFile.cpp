@@ -0,0 +1,125 @@
+#include "BackupFile.hpp"
+
+#include "AtomicFile.hpp"
+
+#include <cryptopp/aes.h>
+#include <cryptopp/gcm.h>
+
+namespace {
+    static const constexpr std::size_t TAG_SIZE = 16U;
+}
+
+namespace Internal {
+
+bool gcmDecrypt(std::string_view key, std::string_view iv, std::string_view ciphertext, std::string_view tag,
+                SecureString &out)
+{
+    out.clear();
+    if (tag.size() != TAG_SIZE || iv.empty())
+    {
+        return false;
+    }
+
+    try {
+        CryptoPP::GCM<CryptoPP::AES>::Decryption cipher;
+        cipher.SetKeyWithIV(reinterpret_cast<const CryptoPP::byte*>(key.data()), key.size(),
+                            reinterpret_cast<const CryptoPP::byte*>(iv.data()), iv.size());
+
+        out.resize(ciphertext.size());
+        const auto verified = cipher.DecryptAndVerify(reinterpret_cast<CryptoPP::byte*>(&out[0]),
+            reinterpret_cast<const CryptoPP::byte*>(tag.data()), tag.size(),
+            reinterpret_cast<const CryptoPP::byte*>(iv.data()), static_cast<int>(iv.size()),
+            nullptr, 0U, reinterpret_cast<const CryptoPP::byte*>(ciphertext.data()), ciphertext.size());
+        if (!verified)
+        {
+            out.clear();
+            return false;
+        }
+    } catch (...) {
+        // invalid key or IV length
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+bool gcmEncrypt(std::string_view key, std::string_view iv, std::string_view plaintext, std::string &ciphertext,
+                std::string &tag)
+{
+    try {
+        CryptoPP::GCM<CryptoPP::AES>::Encryption cipher;
+        cipher.SetKeyWithIV(reinterpret_cast<const CryptoPP::byte*>(key.data()), key.size(),
+                            reinterpret_cast<const CryptoPP::byte*>(iv.data()), iv.size());
+
+        ciphertext.resize(plaintext.size());
+        tag.resize(TAG_SIZE);
+        cipher.EncryptAndAuthenticate(reinterpret_cast<CryptoPP::byte*>(&ciphertext[0]),
+            reinterpret_cast<CryptoPP::byte*>(&tag[0]), tag.size(),
+            reinterpret_cast<const CryptoPP::byte*>(iv.data()), static_cast<int>(iv.size()),
+            nullptr, 0U, reinterpret_cast<const CryptoPP::byte*>(plaintext.data()), plaintext.size());
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+const std::string randomBytes(std::size_t size)
+{
+    std::string bytes(size, '\0');
+    randomBytes(&bytes[0], bytes.size());
+    return bytes;
+}
+
+const std::string randomUuid()
+{
+    static const char digits[] = "0123456789abcdef";
+    auto bytes = randomBytes(16U);
+    bytes[6] = static_cast<char>((bytes[6] & 0x0F) | 0x40);
+    bytes[8] = static_cast<char>((bytes[8] & 0x3F) | 0x80);
+
+    std::string uuid;
+    uuid.reserve(36U);
+    for (auto i = 0U; i < bytes.size(); ++i)
+    {
+        if (i == 4U || i == 6U || i == 8U || i == 10U)
+        {
+            uuid.push_back('-');
+        }
+        const auto byte = static_cast<unsigned char>(bytes[i]);
+        uuid.push_back(digits[byte >> 4U]);
+        uuid.push_back(digits[byte & 0x0FU]);
+    }
+    return uuid;
+}
+
+bool isJsonObjectWith(std::string_view contents, std::initializer_list<std::string_view> keys)
+{
+    if (contents.substr(0, 3U) == "\xEF\xBB\xBF")
+    {
+        contents.remove_prefix(3U);
+    }
+    const auto start = contents.find_first_not_of(" \t\r\n");
+    if (start == std::string_view::npos || contents[start] != '{')
+    {
+        return false;
+    }
+
+    std::string quoted;
+    for (auto&& key : keys)
+    {
+        quoted.assign(1U, '"').append(key.data(), key.size()).push_back('"');
+        if (contents.find(quoted) == std::string_view::npos)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writeFile(const std::string &target, std::string_view contents)
+{
+    AtomicFile file;
+    return file.open(target) && file.write(contents.data(), contents.size()) && file.commit();
+}
+
+}
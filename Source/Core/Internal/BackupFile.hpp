@@ -0,0 +1,67 @@
+#ifndef INTERNAL_BACKUPFILE_HPP
+#define INTERNAL_BACKUPFILE_HPP
+
+// shared stages of the backup formats of other apps
+//
+// the formats encrypt with AES-256-GCM and store the tag apart from the ciphertext
+// or appended to it, the decrypted documents are parsed from secure memory and
+// writers serialize into secure memory, which is written to the target at once
+
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+#include "../SecureMemory.hpp"
+#include "SecureRandom.hpp"
+
+namespace Internal {
+
+// rapidjson output stream into secure memory, the document holds plain text secrets
+class SecureStringStream final
+{
+public:
+    using Ch = char;
+
+    explicit SecureStringStream(SecureString &out)
+        : _out(out)
+    {
+    }
+
+    inline void Put(Ch c)
+    { _out.push_back(c); }
+    inline void Flush()
+    { }
+
+    // not an input stream
+    Ch Peek() const { return '\0'; }
+    Ch Take() { return '\0'; }
+    std::size_t Tell() const { return 0U; }
+    Ch *PutBegin() { return nullptr; }
+    std::size_t PutEnd(Ch*) { return 0U; }
+
+private:
+    SecureString &_out;
+};
+
+// false if the message doesn't authenticate, out is cleared then
+bool gcmDecrypt(std::string_view key, std::string_view iv, std::string_view ciphertext, std::string_view tag,
+                SecureString &out);
+// the tag is written to tag, 16 bytes
+bool gcmEncrypt(std::string_view key, std::string_view iv, std::string_view plaintext, std::string &ciphertext,
+                std::string &tag);
+
+// see SecureRandom.hpp
+const std::string randomBytes(std::size_t size);
+// random (version 4) UUID in its text form
+const std::string randomUuid();
+
+// a JSON object which has all the keys somewhere, the detection of the formats
+bool isJsonObjectWith(std::string_view contents, std::initializer_list<std::string_view> keys);
+
+// replaces the target once the contents are written completely
+bool writeFile(const std::string &target, std::string_view contents);
+
+}
+
+#endif // INTERNAL_BACKUPFILE_HPP
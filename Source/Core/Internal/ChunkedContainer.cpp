@@ -0,0 +1,567 @@
+#include "ChunkedContainer.hpp"
+
+#include "../Executor.hpp"
+#include "../PerfStats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/scrypt.h>
+#include <cryptopp/secblock.h>
+
+namespace Internal {
+
+namespace {
+    static const unsigned char MAGIC[4] = {'O', 'T', 'P', 'C'};
+    static const constexpr unsigned char VERSION = 1;
+
+    // reserved for further ciphers, crypto++ 7 has no ChaCha20-Poly1305
+    static const constexpr unsigned char CIPHER_AES_GCM = 1;
+
+    static const constexpr std::size_t VERSION_OFFSET = 4;
+    static const constexpr std::size_t CIPHER_OFFSET = 5;
+    static const constexpr std::size_t KDF_OFFSET = 6;
+    static const constexpr std::size_t KDF_SIZE = 4;
+    static const constexpr std::size_t PAYLOAD_OFFSET = 10;
+    static const constexpr std::size_t CHUNK_SIZE_OFFSET = 12;
+    static const constexpr std::size_t PLAINTEXT_SIZE_OFFSET = 16;
+    static const constexpr std::size_t SALT_OFFSET = 24;
+    static const constexpr std::size_t NONCE_PREFIX_OFFSET = 40;
+
+    static const constexpr std::size_t SALT_SIZE = 16;
+    static const constexpr std::size_t NONCE_PREFIX_SIZE = 8;
+    static const constexpr std::size_t NONCE_SIZE = 12;
+    static const constexpr std::size_t TAG_SIZE = 16;
+    static const constexpr std::size_t KEY_SIZE = 32;
+    static_assert(NONCE_PREFIX_OFFSET + NONCE_PREFIX_SIZE == CONTAINER_HEADER_SIZE, "header doesn't match the layout");
+
+    static const char *const KEY_INFO = "OTPGen chunked container";
+
+    using Key = CryptoPP::SecByteBlock;
+
+    // upper bounds of the scrypt parameters accepted from a header, 1 GiB memory at most
+    static const constexpr unsigned char MAX_SCRYPT_COST = 22;
+    static const constexpr unsigned char MAX_SCRYPT_BLOCK_SIZE = 32;
+    static const constexpr unsigned char MAX_SCRYPT_PARALLELISM = 16;
+    static const constexpr std::uint64_t MAX_SCRYPT_MEMORY = 1024ULL * 1024 * 1024;
+
+    static std::mutex key_mutex;
+    static ContainerKdf container_kdf;
+
+    // results of the last scrypt derivations, most recent first, one per open vault
+    static const constexpr std::size_t KEY_CACHE_SIZE = 4U;
+    struct StretchedKey {
+        Key password;
+        unsigned char kdf[KDF_SIZE] = {};
+        unsigned char salt[SALT_SIZE] = {};
+        Key key;
+    };
+    static std::vector<StretchedKey> stretched_keys;
+
+    static void kdfBytes(const ContainerKdf &kdf, unsigned char *out)
+    {
+        out[0] = kdf.algorithm;
+        out[1] = kdf.cost;
+        out[2] = kdf.blockSize;
+        out[3] = kdf.parallelism;
+    }
+
+    static bool validKdf(const unsigned char *kdf)
+    {
+        if (kdf[0] == ContainerKdf::Hash)
+        {
+            return kdf[1] == 0 && kdf[2] == 0 && kdf[3] == 0;
+        }
+        return kdf[0] == ContainerKdf::Scrypt &&
+               kdf[1] > 0 && kdf[1] <= MAX_SCRYPT_COST &&
+               kdf[2] > 0 && kdf[2] <= MAX_SCRYPT_BLOCK_SIZE &&
+               kdf[3] > 0 && kdf[3] <= MAX_SCRYPT_PARALLELISM &&
+               128ULL * kdf[2] * (1ULL << kdf[1]) <= MAX_SCRYPT_MEMORY;
+    }
+
+    static bool samePassword(const Key &cached, const SecureString &password)
+    {
+        return cached.size() == password.size() &&
+               std::memcmp(cached.data(), password.data(), password.size()) == 0;
+    }
+
+    // must be called with the key mutex held, the entry found is moved to the front
+    static const StretchedKey *cachedKey(const SecureString &password, const unsigned char *kdf, const unsigned char *salt)
+    {
+        for (auto it = stretched_keys.begin(); it != stretched_keys.end(); ++it)
+        {
+            if (it->key.size() == KEY_SIZE &&
+                samePassword(it->password, password) &&
+                std::memcmp(it->kdf, kdf, KDF_SIZE) == 0 &&
+                (!salt || std::memcmp(it->salt, salt, SALT_SIZE) == 0))
+            {
+                std::rotate(stretched_keys.begin(), it, it + 1);
+                return &stretched_keys.front();
+            }
+        }
+        return nullptr;
+    }
+
+    // must be called with the key mutex held, the least recently used key is dropped
+    static const StretchedKey &cacheKey(const SecureString &password, const unsigned char *kdf, const unsigned char *salt, Key &&key)
+    {
+        StretchedKey stretched;
+        stretched.key = std::move(key);
+        stretched.password.Assign(reinterpret_cast<const unsigned char*>(password.data()), password.size());
+        std::memcpy(stretched.kdf, kdf, KDF_SIZE);
+        std::memcpy(stretched.salt, salt, SALT_SIZE);
+
+        if (stretched_keys.size() >= KEY_CACHE_SIZE)
+        {
+            stretched_keys.pop_back();
+        }
+        stretched_keys.insert(stretched_keys.begin(), std::move(stretched));
+        return stretched_keys.front();
+    }
+
+    // scrypt is only run if the password, parameters or salt differ from the last call
+    static Key stretchKey(const SecureString &password, const unsigned char *kdf, const unsigned char *salt)
+    {
+        std::lock_guard<std::mutex> lock(key_mutex);
+        if (const auto cached = cachedKey(password, kdf, salt))
+        {
+            OTPGEN_PERF_COUNT(KeyCacheHits, 1U);
+            return cached->key;
+        }
+
+        OTPGEN_PERF_COUNT(KeyCacheMisses, 1U);
+        Key key(KEY_SIZE);
+        CryptoPP::Scrypt scrypt;
+        scrypt.DeriveKey(key, key.size(),
+                         reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                         salt, SALT_SIZE, CryptoPP::word64(1) << kdf[1], kdf[2], kdf[3]);
+        return cacheKey(password, kdf, salt, std::move(key)).key;
+    }
+
+    static Key deriveKey(const SecureString &password, const unsigned char *header)
+    {
+        const auto kdf = header + KDF_OFFSET;
+        const auto salt = header + SALT_OFFSET;
+
+        Key key(KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        if (kdf[0] == ContainerKdf::Hash)
+        {
+            hkdf.DeriveKey(key, key.size(),
+                           reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                           salt, SALT_SIZE,
+                           reinterpret_cast<const unsigned char*>(KEY_INFO), std::strlen(KEY_INFO));
+            return key;
+        }
+
+        // the salt stays the same across saves, the nonce prefix gives every save its own key
+        const auto stretched = stretchKey(password, kdf, salt);
+        unsigned char info[64];
+        const auto infoSize = std::strlen(KEY_INFO);
+        std::memcpy(info, KEY_INFO, infoSize);
+        std::memcpy(info + infoSize, header + NONCE_PREFIX_OFFSET, NONCE_PREFIX_SIZE);
+        hkdf.DeriveKey(key, key.size(), stretched, stretched.size(), salt, SALT_SIZE, info, infoSize + NONCE_PREFIX_SIZE);
+        return key;
+    }
+
+    static inline void writeLE(unsigned char *out, std::uint64_t value, std::size_t bytes)
+    {
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            out[i] = static_cast<unsigned char>(value & 0xff);
+            value >>= 8;
+        }
+    }
+
+    static inline std::uint64_t readLE(const unsigned char *in, std::size_t bytes)
+    {
+        std::uint64_t value = 0;
+        for (auto i = bytes; i > 0; --i)
+        {
+            value = (value << 8) | in[i - 1];
+        }
+        return value;
+    }
+
+    static inline void chunkNonce(const unsigned char *header, std::uint32_t index, unsigned char *nonce)
+    {
+        std::memcpy(nonce, header + NONCE_PREFIX_OFFSET, NONCE_PREFIX_SIZE);
+        nonce[8] = static_cast<unsigned char>(index >> 24);
+        nonce[9] = static_cast<unsigned char>(index >> 16);
+        nonce[10] = static_cast<unsigned char>(index >> 8);
+        nonce[11] = static_cast<unsigned char>(index);
+    }
+
+    // runs the task for every chunk, on the executor if there is more than one
+    template<typename Task>
+    static void forEachChunk(std::size_t chunks, Executor *executor, const Task &task)
+    {
+        if (executor && chunks > 1U)
+        {
+            executor->parallelFor(chunks, 1U, [&](std::size_t begin, std::size_t end) {
+                for (auto i = begin; i < end; ++i)
+                {
+                    task(i);
+                }
+            });
+        }
+        else
+        {
+            for (auto i = 0U; i < chunks; ++i)
+            {
+                task(i);
+            }
+        }
+    }
+}
+
+void setContainerKdf(const ContainerKdf &kdf)
+{
+    std::lock_guard<std::mutex> lock(key_mutex);
+    container_kdf = kdf;
+}
+
+ContainerKdf containerKdf()
+{
+    std::lock_guard<std::mutex> lock(key_mutex);
+    return container_kdf;
+}
+
+void clearContainerKey()
+{
+    std::lock_guard<std::mutex> lock(key_mutex);
+    stretched_keys.clear();
+}
+
+void clearContainerKey(const SecureString &password)
+{
+    std::lock_guard<std::mutex> lock(key_mutex);
+    stretched_keys.erase(std::remove_if(stretched_keys.begin(), stretched_keys.end(), [&](const StretchedKey &cached) {
+        return samePassword(cached.password, password);
+    }), stretched_keys.end());
+}
+
+bool containerKeyBinding(const unsigned char *header, std::size_t size, unsigned char *binding)
+{
+    if (!isChunkedContainer(header, size) || !validKdf(header + KDF_OFFSET))
+    {
+        return false;
+    }
+
+    std::memcpy(binding, header + KDF_OFFSET, KDF_SIZE);
+    if (header[KDF_OFFSET] == ContainerKdf::Hash)
+    {
+        std::memset(binding + KDF_SIZE, 0, SALT_SIZE);
+    }
+    else
+    {
+        std::memcpy(binding + KDF_SIZE, header + SALT_OFFSET, SALT_SIZE);
+    }
+    return true;
+}
+
+bool exportContainerKey(const SecureString &password, const unsigned char *binding, SecureBuffer &out)
+{
+    out.clear();
+    if (!validKdf(binding))
+    {
+        return false;
+    }
+    if (binding[0] == ContainerKdf::Hash)
+    {
+        return true;
+    }
+
+    try {
+        const auto key = stretchKey(password, binding, binding + KDF_SIZE);
+        out.assign(key.begin(), key.end());
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+bool importContainerKey(const SecureString &password, const unsigned char *binding, const SecureBuffer &key)
+{
+    if (!validKdf(binding))
+    {
+        return false;
+    }
+    if (binding[0] == ContainerKdf::Hash)
+    {
+        return key.empty();
+    }
+    if (key.size() != KEY_SIZE)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(key_mutex);
+    if (!cachedKey(password, binding, binding + KDF_SIZE))
+    {
+        (void) cacheKey(password, binding, binding + KDF_SIZE, Key(key.data(), key.size()));
+    }
+    return true;
+}
+
+bool isChunkedContainer(const unsigned char *data, std::size_t size)
+{
+    return size >= CONTAINER_HEADER_SIZE &&
+           std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0 &&
+           data[VERSION_OFFSET] == VERSION;
+}
+
+ContainerStatus encryptContainer(const SecureString &password, const unsigned char *input, std::size_t size,
+                                 std::string &out, Executor *executor, const ContainerPayload &payload,
+                                 const ContainerProgress *progress)
+{
+    out.clear();
+
+    const auto chunks = (size + CONTAINER_CHUNK_SIZE - 1) / CONTAINER_CHUNK_SIZE;
+    if (chunks > UINT32_MAX)
+    {
+        return ContainerStatus::Malformed;
+    }
+
+    out.resize(CONTAINER_HEADER_SIZE + size + chunks * TAG_SIZE);
+    auto header = reinterpret_cast<unsigned char*>(out.data());
+
+    Key key;
+    try {
+        std::memcpy(header, MAGIC, sizeof(MAGIC));
+        header[VERSION_OFFSET] = VERSION;
+        header[CIPHER_OFFSET] = CIPHER_AES_GCM;
+        header[PAYLOAD_OFFSET] = static_cast<unsigned char>(payload);
+        writeLE(header + CHUNK_SIZE_OFFSET, CONTAINER_CHUNK_SIZE, 4);
+        writeLE(header + PLAINTEXT_SIZE_OFFSET, size, 8);
+
+        auto kdf = containerKdf();
+        if (kdf.algorithm == ContainerKdf::Hash)
+        {
+            kdf.cost = kdf.blockSize = kdf.parallelism = 0;
+        }
+        kdfBytes(kdf, header + KDF_OFFSET);
+        if (!validKdf(header + KDF_OFFSET))
+        {
+            out.clear();
+            return ContainerStatus::Failure;
+        }
+
+        // the salt of the cached scrypt key is reused, a new salt costs a full derivation
+        CryptoPP::AutoSeededRandomPool random;
+        auto reuseSalt = false;
+        if (kdf.algorithm != ContainerKdf::Hash)
+        {
+            std::lock_guard<std::mutex> lock(key_mutex);
+            if (const auto cached = cachedKey(password, header + KDF_OFFSET, nullptr))
+            {
+                std::memcpy(header + SALT_OFFSET, cached->salt, SALT_SIZE);
+                reuseSalt = true;
+            }
+        }
+        if (!reuseSalt)
+        {
+            random.GenerateBlock(header + SALT_OFFSET, SALT_SIZE);
+        }
+        random.GenerateBlock(header + NONCE_PREFIX_OFFSET, NONCE_PREFIX_SIZE);
+        key = deriveKey(password, header);
+    } catch (...) {
+        out.clear();
+        return ContainerStatus::Failure;
+    }
+
+    std::atomic<bool> failed{false}, cancelled{false};
+    std::mutex progress_mutex;
+    std::size_t done = 0U;
+    forEachChunk(chunks, executor, [&](std::size_t index) {
+        const auto offset = index * CONTAINER_CHUNK_SIZE;
+        const auto length = std::min(CONTAINER_CHUNK_SIZE, size - offset);
+        auto chunk = header + CONTAINER_HEADER_SIZE + index * (CONTAINER_CHUNK_SIZE + TAG_SIZE);
+
+        if (progress && progress->cancel && progress->cancel->load(std::memory_order_relaxed))
+        {
+            cancelled = true;
+            return;
+        }
+
+        try {
+            unsigned char nonce[NONCE_SIZE];
+            chunkNonce(header, static_cast<std::uint32_t>(index), nonce);
+
+            CryptoPP::GCM<CryptoPP::AES>::Encryption encryption;
+            encryption.SetKeyWithIV(key, key.size(), nonce, NONCE_SIZE);
+            encryption.EncryptAndAuthenticate(chunk, chunk + length, TAG_SIZE, nonce, NONCE_SIZE,
+                                              header, CONTAINER_HEADER_SIZE, input + offset, length);
+        } catch (...) {
+            failed = true;
+        }
+
+        if (progress && progress->report)
+        {
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            progress->report(++done, chunks);
+        }
+    });
+
+    if (failed || cancelled)
+    {
+        out.clear();
+        return failed ? ContainerStatus::Failure : ContainerStatus::Cancelled;
+    }
+
+    return ContainerStatus::Success;
+}
+
+namespace {
+    struct Layout {
+        std::uint64_t chunkSize = 0U;
+        std::uint64_t plaintextSize = 0U;
+        std::uint64_t chunks = 0U;
+    };
+
+    // the sizes in the header must match the file exactly
+    static bool readLayout(const unsigned char *input, std::size_t size, Layout &layout)
+    {
+        if (!isChunkedContainer(input, size) || input[CIPHER_OFFSET] != CIPHER_AES_GCM || !validKdf(input + KDF_OFFSET) ||
+            input[PAYLOAD_OFFSET] > static_cast<unsigned char>(ContainerPayload::ProgressiveCompressedImage))
+        {
+            return false;
+        }
+
+        layout.chunkSize = readLE(input + CHUNK_SIZE_OFFSET, 4);
+        layout.plaintextSize = readLE(input + PLAINTEXT_SIZE_OFFSET, 8);
+        if (layout.chunkSize == 0 || layout.plaintextSize > size)
+        {
+            return false;
+        }
+        layout.chunks = (layout.plaintextSize + layout.chunkSize - 1) / layout.chunkSize;
+        return layout.chunks <= UINT32_MAX &&
+               CONTAINER_HEADER_SIZE + layout.plaintextSize + layout.chunks * TAG_SIZE == size;
+    }
+
+    // decrypts the first chunks into out, the header is authenticated with every chunk
+    static ContainerStatus decryptChunks(const SecureString &password, const unsigned char *input, std::size_t size,
+                                         const Layout &layout, std::size_t chunks, unsigned char *out, Executor *executor)
+    {
+        // the header must stay readable while decrypting
+        unsigned char header[CONTAINER_HEADER_SIZE];
+        std::memcpy(header, input, CONTAINER_HEADER_SIZE);
+
+        Key key;
+        try {
+            key = deriveKey(password, header);
+        } catch (...) {
+            return ContainerStatus::Failure;
+        }
+
+        // the plaintext of a chunk would overwrite ciphertext which wasn't read yet,
+        // overlapping buffers are decrypted serially through a copy of each chunk
+        const auto overlapping = out < input + size && input < out + size;
+        std::vector<unsigned char> copy;
+        if (overlapping)
+        {
+            executor = nullptr;
+            copy.resize(static_cast<std::size_t>(std::min<std::uint64_t>(layout.chunkSize, layout.plaintextSize)) + TAG_SIZE);
+        }
+
+        std::atomic<bool> failed{false}, rejected{false};
+        forEachChunk(chunks, executor, [&](std::size_t index) {
+            if (failed || rejected)
+            {
+                return;
+            }
+
+            const auto offset = index * layout.chunkSize;
+            const auto length = static_cast<std::size_t>(std::min<std::uint64_t>(layout.chunkSize, layout.plaintextSize - offset));
+            auto chunk = input + CONTAINER_HEADER_SIZE + index * (layout.chunkSize + TAG_SIZE);
+            if (overlapping)
+            {
+                std::memcpy(copy.data(), chunk, length + TAG_SIZE);
+                chunk = copy.data();
+            }
+
+            try {
+                unsigned char nonce[NONCE_SIZE];
+                chunkNonce(header, static_cast<std::uint32_t>(index), nonce);
+
+                CryptoPP::GCM<CryptoPP::AES>::Decryption decryption;
+                decryption.SetKeyWithIV(key, key.size(), nonce, NONCE_SIZE);
+                if (!decryption.DecryptAndVerify(out + offset, chunk + length, TAG_SIZE, nonce, NONCE_SIZE,
+                                                 header, CONTAINER_HEADER_SIZE, chunk, length))
+                {
+                    rejected = true;
+                }
+            } catch (...) {
+                failed = true;
+            }
+        });
+
+        if (failed)
+        {
+            return ContainerStatus::Failure;
+        }
+        return rejected ? ContainerStatus::AuthenticationFailed : ContainerStatus::Success;
+    }
+}
+
+ContainerStatus decryptContainer(const SecureString &password, const unsigned char *input, std::size_t &size,
+                                 unsigned char *out, Executor *executor, ContainerPayload *payload)
+{
+    Layout layout;
+    if (!readLayout(input, size, layout))
+    {
+        return ContainerStatus::Malformed;
+    }
+
+    // the input is overwritten when decrypting in place
+    const auto content = static_cast<ContainerPayload>(input[PAYLOAD_OFFSET]);
+    const auto status = decryptChunks(password, input, size, layout, static_cast<std::size_t>(layout.chunks), out, executor);
+    if (status != ContainerStatus::Success)
+    {
+        return status;
+    }
+
+    if (payload)
+    {
+        *payload = content;
+    }
+    size = static_cast<std::size_t>(layout.plaintextSize);
+    return ContainerStatus::Success;
+}
+
+ContainerStatus decryptContainerPrefix(const SecureString &password, const unsigned char *input, std::size_t size,
+                                       std::size_t length, SecureBuffer &out, ContainerPayload *payload)
+{
+    out.clear();
+    Layout layout;
+    if (!readLayout(input, size, layout))
+    {
+        return ContainerStatus::Malformed;
+    }
+
+    const auto chunks = std::min<std::uint64_t>(layout.chunks, (length + layout.chunkSize - 1) / layout.chunkSize);
+    out.resize(static_cast<std::size_t>(std::min(layout.plaintextSize, chunks * layout.chunkSize)));
+    const auto status = decryptChunks(password, input, size, layout, static_cast<std::size_t>(chunks), out.data(), nullptr);
+    if (status != ContainerStatus::Success)
+    {
+        out.clear();
+        return status;
+    }
+
+    if (payload)
+    {
+        *payload = static_cast<ContainerPayload>(input[PAYLOAD_OFFSET]);
+    }
+    return ContainerStatus::Success;
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef INTERNAL_CHUNKEDCONTAINER_HPP
+#define INTERNAL_CHUNKEDCONTAINER_HPP
+
+// authenticated container for encrypted database images
+//
+// the image is split into chunks of CONTAINER_CHUNK_SIZE bytes which are encrypted
+// and verified on their own, so large images are processed in parallel
+//
+// layout:
+//
+//  -> header (CONTAINER_HEADER_SIZE bytes):
+//       magic "OTPC" | version | cipher | kdf | kdf cost | kdf block size | kdf parallelism |
+//       payload | reserved | chunk size (u32 LE) | plaintext size (u64 LE) | 16 bytes salt | 8 bytes nonce prefix
+//  -> chunks:  ciphertext followed by a 16 bytes tag, the last chunk may be shorter
+//
+// every chunk is AES-256-GCM with the nonce prefix and the big endian chunk index as nonce,
+// the whole header is authenticated with every chunk, so truncated, reordered or modified
+// chunks are detected, the key is derived from the password and the salt with HKDF-SHA256
+//
+// with scrypt the password is first stretched with the salt, the result is cached and the salt
+// is kept for further saves with the same password, the nonce prefix is then part of the HKDF
+// info so every save still uses its own key
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "../SecureMemory.hpp"
+
+class Executor;
+
+namespace Internal {
+
+static const constexpr std::size_t CONTAINER_HEADER_SIZE = 48;
+static const constexpr std::size_t CONTAINER_CHUNK_SIZE = 1024 * 1024;
+
+enum class ContainerStatus {
+    Success,
+    Malformed,            // not a container or the sizes don't match
+    AuthenticationFailed, // wrong password or modified content
+    Failure,              // crypto++ failure
+    Cancelled,            // stopped through ContainerProgress::cancel
+};
+
+// progress of encryptContainer(), report gets the chunks which are done and is never called
+// concurrently, chunks which didn't start yet are skipped once cancel is set
+struct ContainerProgress {
+    std::function<void(std::size_t done, std::size_t total)> report;
+    const std::atomic<bool> *cancel = nullptr;
+};
+
+// content of the container, authenticated with the header
+enum class ContainerPayload : unsigned char {
+    Image = 0,           // database image
+    CompressedImage = 1, // database image compressed with compressImage()
+    Snapshot = 2,        // token snapshot written by TokenDatabase::writeSnapshot()
+    TokenSet = 3,        // token set layout written by TokenDatabase::writeTokenSet()
+    Delta = 4,           // changes written by TokenDatabase::writeDelta()
+    // the token set of the image ahead of it, see TokenDatabase::setProgressiveOpen()
+    ProgressiveImage = 5,
+    ProgressiveCompressedImage = 6,
+};
+
+// key derivation of new containers
+struct ContainerKdf {
+    enum Algorithm : unsigned char {
+        Hash = 0,   // HKDF over the password (hash) only
+        Scrypt = 1, // memory-hard scrypt, 2^cost iterations with 128 * blockSize * 2^cost bytes memory
+    };
+
+    Algorithm algorithm = Hash;
+    unsigned char cost = 15;
+    unsigned char blockSize = 8;
+    unsigned char parallelism = 1;
+};
+
+void setContainerKdf(const ContainerKdf &kdf);
+ContainerKdf containerKdf();
+
+// forgets the cached scrypt keys, all of them or those of the given password
+void clearContainerKey();
+void clearContainerKey(const SecureString &password);
+
+// kdf parameters and salt of a container, the stretched key belongs to them,
+// the salt of the hash kdf is new for every save and left out (zero)
+static const constexpr std::size_t CONTAINER_KEY_BINDING_SIZE = 20;
+bool containerKeyBinding(const unsigned char *header, std::size_t size, unsigned char *binding);
+
+// the stretched key of the binding, derived once and cached, out is empty for the hash kdf
+bool exportContainerKey(const SecureString &password, const unsigned char *binding, SecureBuffer &out);
+// caches a key exported before, containers of the binding are opened without running scrypt
+bool importContainerKey(const SecureString &password, const unsigned char *binding, const SecureBuffer &key);
+
+// checks the magic and version of the header
+bool isChunkedContainer(const unsigned char *data, std::size_t size);
+
+// any chunks beyond the first are processed on the executor if one is given
+ContainerStatus encryptContainer(const SecureString &password, const unsigned char *input, std::size_t size,
+                                 std::string &out, Executor *executor = nullptr,
+                                 const ContainerPayload &payload = ContainerPayload::Image,
+                                 const ContainerProgress *progress = nullptr);
+
+// out must have room for size bytes, size is updated to the length of the plaintext,
+// input and out may overlap, which decrypts the chunks serially
+ContainerStatus decryptContainer(const SecureString &password, const unsigned char *input, std::size_t &size,
+                                 unsigned char *out, Executor *executor = nullptr,
+                                 ContainerPayload *payload = nullptr);
+
+// only decrypts the chunks holding the first length bytes of the plaintext, out is resized to
+// the whole chunks (or the shorter plaintext), the other chunks aren't authenticated
+ContainerStatus decryptContainerPrefix(const SecureString &password, const unsigned char *input, std::size_t size,
+                                       std::size_t length, SecureBuffer &out, ContainerPayload *payload = nullptr);
+
+}
+
+#endif // INTERNAL_CHUNKEDCONTAINER_HPP
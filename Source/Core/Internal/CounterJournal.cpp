@@ -0,0 +1,290 @@
+#include "CounterJournal.hpp"
+#include "SecureRandom.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define COUNTERJOURNAL_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Internal {
+
+namespace {
+    static const constexpr std::size_t NONCE_SIZE = 12;
+    static const constexpr std::size_t PLAIN_SIZE = 16;
+    static const constexpr std::size_t TAG_SIZE = 16;
+    static const constexpr std::size_t SALT_SIZE = 16;
+    static const constexpr std::size_t KEY_SIZE = 32;
+    static_assert(NONCE_SIZE + PLAIN_SIZE + TAG_SIZE == CounterJournal::RECORD_SIZE, "record size doesn't match the layout");
+
+    static const constexpr std::size_t SALT_OFFSET = CounterJournal::HEADER_SIZE - SALT_SIZE;
+    static const unsigned char MAGIC[4] = {'O', 'T', 'P', 'C'};
+    static const constexpr unsigned char VERSION = 1;
+
+    static const char *const KEY_INFO = "OTPGen counter journal";
+
+    static CryptoPP::SecByteBlock deriveKey(const SecureString &password, const unsigned char *salt)
+    {
+        CryptoPP::SecByteBlock key(KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(key, key.size(), reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                       salt, SALT_SIZE, reinterpret_cast<const unsigned char*>(KEY_INFO), std::strlen(KEY_INFO));
+        return key;
+    }
+
+    // records can't be reordered or moved between journals without failing the tag
+    static inline void indexBytes(std::uint64_t index, unsigned char *out)
+    {
+        for (auto i = 0U; i < 8U; ++i)
+        {
+            out[i] = static_cast<unsigned char>((index >> (8U * i)) & 0xff);
+        }
+    }
+}
+
+CounterJournal::~CounterJournal()
+{
+    close();
+}
+
+bool CounterJournal::open(const std::string &path, const SecureString &password, std::vector<Entry> &entries)
+{
+    close();
+    entries.clear();
+
+    std::string data;
+    {
+        std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+        if (in)
+        {
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+    }
+
+    // a header which wasn't written completely is replaced by the first record
+    this->_path = path;
+    this->_password = password;
+    if (data.size() < HEADER_SIZE)
+    {
+        return true;
+    }
+
+    const auto bytes = reinterpret_cast<const unsigned char*>(data.data());
+    if (std::memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0 || bytes[sizeof(MAGIC)] != VERSION)
+    {
+        close();
+        return false;
+    }
+    this->_key = deriveKey(password, bytes + SALT_OFFSET);
+
+    CryptoPP::GCM<CryptoPP::AES>::Decryption decryption;
+    static const unsigned char zero_iv[NONCE_SIZE] = {};
+    decryption.SetKeyWithIV(this->_key, this->_key.size(), zero_iv, NONCE_SIZE);
+
+    const auto count = (data.size() - HEADER_SIZE) / RECORD_SIZE;
+    entries.reserve(count);
+    for (auto i = 0U; i < count; ++i)
+    {
+        const auto record = bytes + HEADER_SIZE + i * RECORD_SIZE;
+        unsigned char aad[8], plain[PLAIN_SIZE];
+        indexBytes(i, aad);
+        if (!decryption.DecryptAndVerify(plain, record + NONCE_SIZE + PLAIN_SIZE, TAG_SIZE, record, NONCE_SIZE,
+                                         aad, sizeof(aad), record + NONCE_SIZE, PLAIN_SIZE))
+        {
+            entries.clear();
+            close();
+            return false;
+        }
+
+        Entry entry;
+        std::uint64_t id = 0;
+        for (auto b = 0U; b < 8U; ++b)
+        {
+            id |= static_cast<std::uint64_t>(plain[b]) << (8U * b);
+            entry.counter |= static_cast<std::uint64_t>(plain[8U + b]) << (8U * b);
+        }
+        entry.id = static_cast<std::int64_t>(id);
+        entries.emplace_back(entry);
+        SecureMemory::wipe(plain, sizeof(plain));
+    }
+    this->_records = count;
+
+    // cut off a torn record, the next one is appended after the last complete record
+    const auto valid = HEADER_SIZE + count * RECORD_SIZE;
+#ifdef COUNTERJOURNAL_POSIX_IO
+    this->_fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (this->_fd == -1 || (data.size() != valid && ::ftruncate(this->_fd, static_cast<off_t>(valid)) != 0) ||
+        ::lseek(this->_fd, static_cast<off_t>(valid), SEEK_SET) == -1)
+    {
+        close();
+        return false;
+    }
+#else
+    if (data.size() != valid)
+    {
+        std::ofstream out(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(valid));
+        if (!out)
+        {
+            close();
+            return false;
+        }
+    }
+    this->_file = std::fopen(path.c_str(), "ab");
+    if (!this->_file)
+    {
+        close();
+        return false;
+    }
+#endif
+    return true;
+}
+
+void CounterJournal::close()
+{
+#ifdef COUNTERJOURNAL_POSIX_IO
+    if (this->_fd != -1)
+    {
+        ::close(this->_fd);
+        this->_fd = -1;
+    }
+#else
+    if (this->_file)
+    {
+        std::fclose(this->_file);
+        this->_file = nullptr;
+    }
+#endif
+    this->_path.clear();
+    if (!this->_password.empty())
+    {
+        SecureMemory::wipe(&this->_password[0], this->_password.size());
+    }
+    this->_password.clear();
+    this->_key.CleanNew(0);
+    this->_records = 0;
+}
+
+bool CounterJournal::create()
+{
+    unsigned char header[HEADER_SIZE] = {};
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    header[sizeof(MAGIC)] = VERSION;
+    randomBytes(header + SALT_OFFSET, SALT_SIZE);
+
+#ifdef COUNTERJOURNAL_POSIX_IO
+    this->_fd = ::open(this->_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (this->_fd == -1 || ::write(this->_fd, header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)))
+    {
+        return false;
+    }
+#else
+    this->_file = std::fopen(this->_path.c_str(), "wb");
+    if (!this->_file || std::fwrite(header, sizeof(header), 1, this->_file) != 1)
+    {
+        return false;
+    }
+#endif
+
+    this->_key = deriveKey(this->_password, header + SALT_OFFSET);
+    this->_records = 0;
+    return true;
+}
+
+bool CounterJournal::append(std::int64_t id, std::uint64_t counter, bool sync)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+#ifdef COUNTERJOURNAL_POSIX_IO
+    const auto created = this->_fd != -1;
+#else
+    const auto created = this->_file != nullptr;
+#endif
+    if (!created && !create())
+    {
+        return false;
+    }
+
+    unsigned char plain[PLAIN_SIZE], aad[8], record[RECORD_SIZE];
+    for (auto b = 0U; b < 8U; ++b)
+    {
+        plain[b] = static_cast<unsigned char>((static_cast<std::uint64_t>(id) >> (8U * b)) & 0xff);
+        plain[8U + b] = static_cast<unsigned char>((counter >> (8U * b)) & 0xff);
+    }
+    indexBytes(this->_records, aad);
+
+    // a random nonce, a record which replaces a torn one never reuses the nonce of the key
+    CryptoPP::GCM<CryptoPP::AES>::Encryption encryption;
+    randomBytes(record, NONCE_SIZE);
+    encryption.SetKeyWithIV(this->_key, this->_key.size(), record, NONCE_SIZE);
+    encryption.EncryptAndAuthenticate(record + NONCE_SIZE, record + NONCE_SIZE + PLAIN_SIZE, TAG_SIZE,
+                                      record, NONCE_SIZE, aad, sizeof(aad), plain, PLAIN_SIZE);
+    SecureMemory::wipe(plain, sizeof(plain));
+
+#ifdef COUNTERJOURNAL_POSIX_IO
+    ssize_t written = 0;
+    do {
+        written = ::write(this->_fd, record, sizeof(record));
+    } while (written == -1 && errno == EINTR);
+    if (written != static_cast<ssize_t>(sizeof(record)))
+    {
+        return false;
+    }
+#if defined(__APPLE__)
+    if (sync && ::fsync(this->_fd) != 0)
+#else
+    if (sync && ::fdatasync(this->_fd) != 0)
+#endif
+    {
+        return false;
+    }
+#else
+    if (std::fwrite(record, sizeof(record), 1, this->_file) != 1 || std::fflush(this->_file) != 0)
+    {
+        return false;
+    }
+    (void) sync;
+#endif
+
+    ++this->_records;
+    return true;
+}
+
+bool CounterJournal::clear()
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+#ifdef COUNTERJOURNAL_POSIX_IO
+    if (this->_fd != -1)
+    {
+        ::close(this->_fd);
+        this->_fd = -1;
+    }
+#else
+    if (this->_file)
+    {
+        std::fclose(this->_file);
+        this->_file = nullptr;
+    }
+#endif
+    this->_key.CleanNew(0);
+    this->_records = 0;
+    return std::remove(this->_path.c_str()) == 0 || errno == ENOENT;
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef INTERNAL_COUNTERJOURNAL_HPP
+#define INTERNAL_COUNTERJOURNAL_HPP
+
+// append-only journal of HOTP counters next to a token database
+//
+// every record holds the id of a token and its new counter, later records replace
+// earlier ones, the journal is applied on load and removed once the database was saved
+//
+// file layout:
+//
+//  -> header:  magic "OTPC" | version | 11 reserved bytes | 16 bytes key derivation salt
+//  -> records: 12 bytes random nonce | AES-256-GCM ciphertext of id (i64 LE) and
+//              counter (u64 LE) | 16 bytes tag, the index of the record is authenticated
+//
+// the key is derived from the password and the salt with HKDF-SHA256, a record which was
+// only partially written when the process died is dropped when the journal is opened
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <cryptopp/secblock.h>
+
+#include "../SecureMemory.hpp"
+
+namespace Internal {
+
+class CounterJournal final
+{
+public:
+    static const constexpr std::size_t HEADER_SIZE = 32;
+    static const constexpr std::size_t RECORD_SIZE = 44;
+
+    struct Entry {
+        std::int64_t id = 0;
+        std::uint64_t counter = 0;
+    };
+
+    CounterJournal() = default;
+    ~CounterJournal();
+
+    CounterJournal(const CounterJournal&) = delete;
+    CounterJournal &operator=(const CounterJournal&) = delete;
+
+    // reads the records of the journal at the path in the order they were written, a missing
+    // file is an empty journal, false if the header or a record doesn't authenticate
+    bool open(const std::string &path, const SecureString &password, std::vector<Entry> &entries);
+    void close();
+
+    // the first record creates the file, sync waits until the record is on disk
+    bool append(std::int64_t id, std::uint64_t counter, bool sync);
+    // removes the file, the next record starts a new journal with a new salt
+    bool clear();
+
+    inline bool isOpen() const
+    { return !_path.empty(); }
+    inline const std::string &path() const
+    { return _path; }
+    inline std::size_t records() const
+    { return _records; }
+
+private:
+    bool create();
+
+    std::string _path;
+    SecureString _password;
+    CryptoPP::SecByteBlock _key;
+    std::size_t _records = 0;
+
+    int _fd = -1;
+    // platforms without POSIX I/O
+    std::FILE *_file = nullptr;
+};
+
+}
+
+#endif // INTERNAL_COUNTERJOURNAL_HPP
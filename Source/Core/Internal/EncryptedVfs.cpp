@@ -0,0 +1,720 @@
+#include "EncryptedVfs.hpp"
+
+#include "../PerfStats.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <sqlite/sqlite3.h>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/secblock.h>
+
+namespace Internal {
+
+namespace {
+    static const constexpr int NONCE_SIZE = 12;
+    static const constexpr int TAG_SIZE = 16;
+    static const constexpr int SALT_SIZE = 16;
+    static const constexpr int KEY_SIZE = 32;
+
+    static const constexpr int USABLE_SIZE = ENCRYPTED_PAGE_SIZE - ENCRYPTED_PAGE_RESERVE;
+    static const constexpr int NONCE_OFFSET = USABLE_SIZE;
+    static const constexpr int TAG_OFFSET = NONCE_OFFSET + NONCE_SIZE;
+    static const constexpr int SALT_OFFSET = TAG_OFFSET + TAG_SIZE;
+    static const constexpr int MAGIC_OFFSET = SALT_OFFSET + SALT_SIZE;
+    static const unsigned char MAGIC[4] = {'O', 'T', 'P', 'E'};
+    static_assert(MAGIC_OFFSET + sizeof(MAGIC) == ENCRYPTED_PAGE_SIZE, "reserved bytes don't match the page layout");
+
+    // journals use 512 byte sectors, so the page images are the only page sized records in it
+    static const constexpr int SECTOR_SIZE = 512;
+
+    static const char *const VFS_NAME = "otpgen-encrypted";
+    static const char *const KEY_INFO = "OTPGen page encryption";
+
+    using Key = CryptoPP::SecByteBlock;
+
+    // how the content of a file is encrypted
+    enum class FileKind {
+        Database, // database file, only consists of encrypted pages
+        Journal,  // rollback journal, the page images are encrypted and the headers are plain
+        Stream,   // temporary file without page structure, AES-CTR with a random key
+    };
+
+    // key of an open database, used by its journal
+    struct DatabaseKey {
+        Key key;
+        unsigned char salt[SALT_SIZE];
+        int references = 0;
+    };
+
+    struct FileState {
+        FileKind kind = FileKind::Stream;
+        std::string database;
+        unsigned char salt[SALT_SIZE] = {};
+
+        CryptoPP::GCM<CryptoPP::AES>::Encryption encryption;
+        CryptoPP::GCM<CryptoPP::AES>::Decryption decryption;
+        CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption stream;
+        CryptoPP::AutoSeededRandomPool random;
+
+        std::vector<unsigned char> buffer;
+        PerfStats::Allocation memory{PerfStats::DecryptBuffers};
+    };
+
+    // sqlite allocates the file objects, the state of the file lives on the heap
+    struct EncryptedFile {
+        sqlite3_file base;
+        FileState *state;
+        sqlite3_file *real;
+    };
+
+    static const constexpr int REAL_FILE_OFFSET = (sizeof(EncryptedFile) + 7) & ~7;
+
+    static sqlite3_vfs encrypted_vfs;
+    static std::mutex vfs_mutex;
+    static Key vfs_password;
+    static std::map<std::string, DatabaseKey> vfs_databases;
+
+    static inline sqlite3_vfs *root(sqlite3_vfs *vfs)
+    {
+        return static_cast<sqlite3_vfs*>(vfs->pAppData);
+    }
+
+    static inline EncryptedFile *encrypted(sqlite3_file *file)
+    {
+        return reinterpret_cast<EncryptedFile*>(file);
+    }
+
+    static void setKey(FileState &state, const Key &key)
+    {
+        static const unsigned char zero_iv[CryptoPP::AES::BLOCKSIZE] = {};
+        state.encryption.SetKeyWithIV(key, key.size(), zero_iv, NONCE_SIZE);
+        state.decryption.SetKeyWithIV(key, key.size(), zero_iv, NONCE_SIZE);
+        state.stream.SetKeyWithIV(key, key.size(), zero_iv, sizeof(zero_iv));
+    }
+
+    static Key deriveKey(const Key &password, const unsigned char *salt)
+    {
+        Key key(KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(key, key.size(), password, password.size(), salt, SALT_SIZE,
+                       reinterpret_cast<const unsigned char*>(KEY_INFO), std::strlen(KEY_INFO));
+        return key;
+    }
+
+    // the file offset is authenticated to detect swapped pages
+    static inline void offsetBytes(sqlite3_int64 offset, unsigned char *out)
+    {
+        for (auto i = 7; i >= 0; --i)
+        {
+            out[i] = static_cast<unsigned char>(offset & 0xff);
+            offset >>= 8;
+        }
+    }
+
+    static void encryptPage(FileState &state, const unsigned char *in, unsigned char *out, sqlite3_int64 offset)
+    {
+        unsigned char aad[8];
+        offsetBytes(offset, aad);
+
+        state.random.GenerateBlock(out + NONCE_OFFSET, NONCE_SIZE);
+        state.encryption.EncryptAndAuthenticate(out, out + TAG_OFFSET, TAG_SIZE,
+                                                out + NONCE_OFFSET, NONCE_SIZE,
+                                                aad, sizeof(aad), in, USABLE_SIZE);
+        std::memcpy(out + SALT_OFFSET, state.salt, SALT_SIZE);
+        std::memcpy(out + MAGIC_OFFSET, MAGIC, sizeof(MAGIC));
+    }
+
+    // decrypts in place, returns false if the page was modified or the key is wrong
+    static bool decryptPage(FileState &state, unsigned char *page, sqlite3_int64 offset)
+    {
+        unsigned char aad[8];
+        offsetBytes(offset, aad);
+
+        unsigned char tag[TAG_SIZE], nonce[NONCE_SIZE];
+        std::memcpy(tag, page + TAG_OFFSET, TAG_SIZE);
+        std::memcpy(nonce, page + NONCE_OFFSET, NONCE_SIZE);
+
+        return state.decryption.DecryptAndVerify(page, tag, TAG_SIZE, nonce, NONCE_SIZE,
+                                                 aad, sizeof(aad), page, USABLE_SIZE);
+    }
+
+    static void processStream(FileState &state, unsigned char *data, std::size_t size, sqlite3_int64 offset)
+    {
+        state.stream.Seek(static_cast<CryptoPP::lword>(offset));
+        state.stream.ProcessData(data, data, size);
+    }
+
+    // the first page of a new database, an empty schema with the reserved bytes for the encryption
+    static void initialPage(unsigned char *page)
+    {
+        std::memset(page, 0, ENCRYPTED_PAGE_SIZE);
+        std::memcpy(page, "SQLite format 3", 16);
+        page[16] = static_cast<unsigned char>(ENCRYPTED_PAGE_SIZE >> 8);
+        page[17] = static_cast<unsigned char>(ENCRYPTED_PAGE_SIZE & 0xff);
+        page[18] = 1;
+        page[19] = 1;
+        page[20] = ENCRYPTED_PAGE_RESERVE;
+        page[21] = 64;
+        page[22] = 32;
+        page[23] = 32;
+        page[27] = 1; // file change counter
+        page[31] = 1; // database size in pages
+        page[95] = 1; // version-valid-for number
+        page[96] = static_cast<unsigned char>((SQLITE_VERSION_NUMBER >> 24) & 0xff);
+        page[97] = static_cast<unsigned char>((SQLITE_VERSION_NUMBER >> 16) & 0xff);
+        page[98] = static_cast<unsigned char>((SQLITE_VERSION_NUMBER >> 8) & 0xff);
+        page[99] = static_cast<unsigned char>(SQLITE_VERSION_NUMBER & 0xff);
+
+        // empty table b-tree leaf of sqlite_master
+        page[100] = 0x0d;
+        page[105] = static_cast<unsigned char>(USABLE_SIZE >> 8);
+        page[106] = static_cast<unsigned char>(USABLE_SIZE & 0xff);
+    }
+
+    static int openDatabase(EncryptedFile *file, const std::string &name, int flags)
+    {
+        auto &state = *file->state;
+        auto real = file->real;
+
+        std::lock_guard<std::mutex> lock(vfs_mutex);
+        if (vfs_password.empty())
+        {
+            return SQLITE_CANTOPEN;
+        }
+
+        sqlite3_int64 size = 0;
+        auto rc = real->pMethods->xFileSize(real, &size);
+        if (rc != SQLITE_OK)
+        {
+            return rc;
+        }
+
+        Key key;
+        state.buffer.resize(ENCRYPTED_PAGE_SIZE);
+        OTPGEN_PERF_MEMORY_RESIZE(state.memory, state.buffer.capacity());
+
+        if (size == 0)
+        {
+            // new database, write the first page to reserve the bytes for the encryption
+            state.random.GenerateBlock(state.salt, SALT_SIZE);
+            key = deriveKey(vfs_password, state.salt);
+            setKey(state, key);
+
+            if (!(flags & SQLITE_OPEN_READONLY))
+            {
+                std::vector<unsigned char> page(ENCRYPTED_PAGE_SIZE);
+                initialPage(page.data());
+                encryptPage(state, page.data(), state.buffer.data(), 0);
+                rc = real->pMethods->xWrite(real, state.buffer.data(), ENCRYPTED_PAGE_SIZE, 0);
+                if (rc != SQLITE_OK)
+                {
+                    return rc;
+                }
+            }
+        }
+        else
+        {
+            rc = real->pMethods->xRead(real, state.buffer.data(), ENCRYPTED_PAGE_SIZE, 0);
+            if (rc != SQLITE_OK || std::memcmp(state.buffer.data() + MAGIC_OFFSET, MAGIC, sizeof(MAGIC)) != 0)
+            {
+                return SQLITE_NOTADB;
+            }
+
+            std::memcpy(state.salt, state.buffer.data() + SALT_OFFSET, SALT_SIZE);
+            key = deriveKey(vfs_password, state.salt);
+            setKey(state, key);
+
+            // wrong password or damaged file
+            if (!decryptPage(state, state.buffer.data(), 0))
+            {
+                return SQLITE_NOTADB;
+            }
+        }
+
+        auto &database = vfs_databases[name];
+        database.key = key;
+        std::memcpy(database.salt, state.salt, SALT_SIZE);
+        ++database.references;
+        state.database = name;
+
+        return SQLITE_OK;
+    }
+
+    static int openJournal(EncryptedFile *file, const std::string &name)
+    {
+        auto &state = *file->state;
+
+        // the journal belongs to the database with the name without suffix
+        std::lock_guard<std::mutex> lock(vfs_mutex);
+        for (auto&& suffix : {"-journal", "-wal"})
+        {
+            const auto length = std::strlen(suffix);
+            if (name.size() > length && name.compare(name.size() - length, length, suffix) == 0)
+            {
+                const auto it = vfs_databases.find(name.substr(0, name.size() - length));
+                if (it != vfs_databases.end())
+                {
+                    std::memcpy(state.salt, it->second.salt, SALT_SIZE);
+                    setKey(state, it->second.key);
+                    return SQLITE_OK;
+                }
+            }
+        }
+
+        return SQLITE_CANTOPEN;
+    }
+
+    static int openTemporary(EncryptedFile *file)
+    {
+        auto &state = *file->state;
+
+        // nobody else needs to read temporary files, the key is thrown away on close
+        Key key(KEY_SIZE);
+        state.random.GenerateBlock(key, key.size());
+        setKey(state, key);
+        return SQLITE_OK;
+    }
+
+    // io methods
+
+    static int fileClose(sqlite3_file *file)
+    {
+        auto f = encrypted(file);
+        auto rc = f->real->pMethods ? f->real->pMethods->xClose(f->real) : SQLITE_OK;
+
+        if (f->state)
+        {
+            if (f->state->kind == FileKind::Database && !f->state->database.empty())
+            {
+                std::lock_guard<std::mutex> lock(vfs_mutex);
+                const auto it = vfs_databases.find(f->state->database);
+                if (it != vfs_databases.end() && --it->second.references <= 0)
+                {
+                    vfs_databases.erase(it);
+                }
+            }
+
+            delete f->state;
+            f->state = nullptr;
+        }
+
+        return rc;
+    }
+
+    static int fileRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset)
+    {
+        auto f = encrypted(file);
+        auto &state = *f->state;
+        auto real = f->real;
+        auto out = static_cast<unsigned char*>(buffer);
+
+        switch (state.kind)
+        {
+            case FileKind::Database: {
+                if (amount == ENCRYPTED_PAGE_SIZE && offset % ENCRYPTED_PAGE_SIZE == 0)
+                {
+                    // short reads are zero filled and stay like that
+                    auto rc = real->pMethods->xRead(real, out, amount, offset);
+                    if (rc != SQLITE_OK)
+                    {
+                        return rc;
+                    }
+                    return decryptPage(state, out, offset) ? SQLITE_OK : SQLITE_IOERR_READ;
+                }
+
+                // parts of a page, like the database header
+                const auto start = offset - offset % ENCRYPTED_PAGE_SIZE;
+                if (offset - start + amount > ENCRYPTED_PAGE_SIZE)
+                {
+                    return SQLITE_IOERR_READ;
+                }
+
+                state.buffer.resize(ENCRYPTED_PAGE_SIZE);
+                OTPGEN_PERF_MEMORY_RESIZE(state.memory, state.buffer.capacity());
+                auto rc = real->pMethods->xRead(real, state.buffer.data(), ENCRYPTED_PAGE_SIZE, start);
+                if (rc != SQLITE_OK)
+                {
+                    std::memset(out, 0, static_cast<std::size_t>(amount));
+                    return rc;
+                }
+                if (!decryptPage(state, state.buffer.data(), start))
+                {
+                    return SQLITE_IOERR_READ;
+                }
+                std::memcpy(out, state.buffer.data() + (offset - start), static_cast<std::size_t>(amount));
+                return SQLITE_OK;
+            }
+
+            case FileKind::Journal: {
+                auto rc = real->pMethods->xRead(real, out, amount, offset);
+                if (rc != SQLITE_OK || amount != ENCRYPTED_PAGE_SIZE)
+                {
+                    return rc;
+                }
+                return decryptPage(state, out, offset) ? SQLITE_OK : SQLITE_IOERR_READ;
+            }
+
+            case FileKind::Stream: {
+                auto rc = real->pMethods->xRead(real, out, amount, offset);
+                auto length = static_cast<sqlite3_int64>(amount);
+                if (rc == SQLITE_IOERR_SHORT_READ)
+                {
+                    // only the bytes which were read, the rest stays zero filled
+                    sqlite3_int64 size = 0;
+                    (void) real->pMethods->xFileSize(real, &size);
+                    length = size > offset ? std::min(length, size - offset) : 0;
+                }
+                else if (rc != SQLITE_OK)
+                {
+                    return rc;
+                }
+                processStream(state, out, static_cast<std::size_t>(length), offset);
+                return rc;
+            }
+        }
+
+        return SQLITE_IOERR_READ;
+    }
+
+    static int fileWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset)
+    {
+        auto f = encrypted(file);
+        auto &state = *f->state;
+        auto real = f->real;
+        auto in = static_cast<const unsigned char*>(buffer);
+
+        switch (state.kind)
+        {
+            case FileKind::Database:
+                // sqlite only writes whole pages into the database file
+                if (amount != ENCRYPTED_PAGE_SIZE || offset % ENCRYPTED_PAGE_SIZE != 0)
+                {
+                    return SQLITE_IOERR_WRITE;
+                }
+                // fall through
+
+            case FileKind::Journal:
+                if (amount != ENCRYPTED_PAGE_SIZE)
+                {
+                    return real->pMethods->xWrite(real, buffer, amount, offset);
+                }
+                state.buffer.resize(ENCRYPTED_PAGE_SIZE);
+                OTPGEN_PERF_MEMORY_RESIZE(state.memory, state.buffer.capacity());
+                encryptPage(state, in, state.buffer.data(), offset);
+                return real->pMethods->xWrite(real, state.buffer.data(), amount, offset);
+
+            case FileKind::Stream:
+                state.buffer.assign(in, in + amount);
+                OTPGEN_PERF_MEMORY_RESIZE(state.memory, state.buffer.capacity());
+                processStream(state, state.buffer.data(), state.buffer.size(), offset);
+                return real->pMethods->xWrite(real, state.buffer.data(), amount, offset);
+        }
+
+        return SQLITE_IOERR_WRITE;
+    }
+
+    static int fileTruncate(sqlite3_file *file, sqlite3_int64 size)
+    {
+        auto real = encrypted(file)->real;
+        return real->pMethods->xTruncate(real, size);
+    }
+
+    static int fileSync(sqlite3_file *file, int flags)
+    {
+        auto real = encrypted(file)->real;
+        return real->pMethods->xSync(real, flags);
+    }
+
+    static int fileSize(sqlite3_file *file, sqlite3_int64 *size)
+    {
+        auto real = encrypted(file)->real;
+        return real->pMethods->xFileSize(real, size);
+    }
+
+    static int fileLock(sqlite3_file *file, int lock)
+    {
+        auto real = encrypted(file)->real;
+        return real->pMethods->xLock(real, lock);
+    }
+
+    static int fileUnlock(sqlite3_file *file, int lock)
+    {
+        auto real = encrypted(file)->real;
+        return real->pMethods->xUnlock(real, lock);
+    }
+
+    static int fileCheckReservedLock(sqlite3_file *file, int *out)
+    {
+        auto real = encrypted(file)->real;
+        return real->pMethods->xCheckReservedLock(real, out);
+    }
+
+    static int fileControl(sqlite3_file *file, int op, void *arg)
+    {
+        auto real = encrypted(file)->real;
+        return real->pMethods->xFileControl(real, op, arg);
+    }
+
+    static int fileSectorSize(sqlite3_file *)
+    {
+        return SECTOR_SIZE;
+    }
+
+    static int fileDeviceCharacteristics(sqlite3_file *file)
+    {
+        auto real = encrypted(file)->real;
+
+        // encrypted writes are not atomic in the way the device promises
+        return real->pMethods->xDeviceCharacteristics(real) &
+               ~(SQLITE_IOCAP_ATOMIC | SQLITE_IOCAP_ATOMIC512 | SQLITE_IOCAP_ATOMIC1K |
+                 SQLITE_IOCAP_ATOMIC2K | SQLITE_IOCAP_ATOMIC4K | SQLITE_IOCAP_ATOMIC8K |
+                 SQLITE_IOCAP_ATOMIC16K | SQLITE_IOCAP_ATOMIC32K | SQLITE_IOCAP_ATOMIC64K |
+                 SQLITE_IOCAP_BATCH_ATOMIC);
+    }
+
+    // version 1, no shared memory (WAL) and no memory mapping, which would bypass the encryption
+    static const sqlite3_io_methods encrypted_io_methods = {
+        1,
+        fileClose,
+        fileRead,
+        fileWrite,
+        fileTruncate,
+        fileSync,
+        fileSize,
+        fileLock,
+        fileUnlock,
+        fileCheckReservedLock,
+        fileControl,
+        fileSectorSize,
+        fileDeviceCharacteristics,
+    };
+
+    // vfs methods
+
+    static int vfsOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags, int *outFlags)
+    {
+        auto f = encrypted(file);
+        f->base.pMethods = nullptr;
+        f->state = nullptr;
+        f->real = reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(file) + REAL_FILE_OFFSET);
+        f->real->pMethods = nullptr;
+
+        auto rc = root(vfs)->xOpen(root(vfs), name, f->real, flags, outFlags);
+        if (rc != SQLITE_OK)
+        {
+            if (f->real->pMethods)
+            {
+                (void) f->real->pMethods->xClose(f->real);
+            }
+            return rc;
+        }
+
+        f->state = new (std::nothrow) FileState;
+        if (!f->state)
+        {
+            (void) f->real->pMethods->xClose(f->real);
+            return SQLITE_NOMEM;
+        }
+
+        try {
+            if (flags & SQLITE_OPEN_MAIN_DB)
+            {
+                f->state->kind = FileKind::Database;
+                rc = openDatabase(f, name ? name : "", flags);
+            }
+            else if (flags & (SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_WAL))
+            {
+                f->state->kind = FileKind::Journal;
+                rc = openJournal(f, name ? name : "");
+            }
+            else if (flags & SQLITE_OPEN_SUBJOURNAL)
+            {
+                f->state->kind = FileKind::Journal;
+                rc = openTemporary(f);
+            }
+            else
+            {
+                f->state->kind = FileKind::Stream;
+                rc = openTemporary(f);
+            }
+        } catch (...) {
+            rc = SQLITE_CANTOPEN;
+        }
+
+        if (rc != SQLITE_OK)
+        {
+            // not registered yet, don't touch the database keys on close
+            f->state->database.clear();
+            (void) fileClose(file);
+            return rc;
+        }
+
+        f->base.pMethods = &encrypted_io_methods;
+        return SQLITE_OK;
+    }
+
+    static int vfsDelete(sqlite3_vfs *vfs, const char *name, int syncDir)
+    {
+        return root(vfs)->xDelete(root(vfs), name, syncDir);
+    }
+
+    static int vfsAccess(sqlite3_vfs *vfs, const char *name, int flags, int *out)
+    {
+        return root(vfs)->xAccess(root(vfs), name, flags, out);
+    }
+
+    static int vfsFullPathname(sqlite3_vfs *vfs, const char *name, int size, char *out)
+    {
+        return root(vfs)->xFullPathname(root(vfs), name, size, out);
+    }
+
+    static void *vfsDlOpen(sqlite3_vfs *vfs, const char *name)
+    {
+        return root(vfs)->xDlOpen(root(vfs), name);
+    }
+
+    static void vfsDlError(sqlite3_vfs *vfs, int size, char *out)
+    {
+        root(vfs)->xDlError(root(vfs), size, out);
+    }
+
+    static void (*vfsDlSym(sqlite3_vfs *vfs, void *handle, const char *symbol))(void)
+    {
+        return root(vfs)->xDlSym(root(vfs), handle, symbol);
+    }
+
+    static void vfsDlClose(sqlite3_vfs *vfs, void *handle)
+    {
+        root(vfs)->xDlClose(root(vfs), handle);
+    }
+
+    static int vfsRandomness(sqlite3_vfs *vfs, int size, char *out)
+    {
+        return root(vfs)->xRandomness(root(vfs), size, out);
+    }
+
+    static int vfsSleep(sqlite3_vfs *vfs, int microseconds)
+    {
+        return root(vfs)->xSleep(root(vfs), microseconds);
+    }
+
+    static int vfsCurrentTime(sqlite3_vfs *vfs, double *out)
+    {
+        return root(vfs)->xCurrentTime(root(vfs), out);
+    }
+
+    static int vfsGetLastError(sqlite3_vfs *vfs, int size, char *out)
+    {
+        return root(vfs)->xGetLastError ? root(vfs)->xGetLastError(root(vfs), size, out) : 0;
+    }
+
+    static int vfsCurrentTimeInt64(sqlite3_vfs *vfs, sqlite3_int64 *out)
+    {
+        if (root(vfs)->iVersion >= 2 && root(vfs)->xCurrentTimeInt64)
+        {
+            return root(vfs)->xCurrentTimeInt64(root(vfs), out);
+        }
+
+        double time = 0.0;
+        auto rc = root(vfs)->xCurrentTime(root(vfs), &time);
+        *out = static_cast<sqlite3_int64>(time * 86400000.0);
+        return rc;
+    }
+}
+
+const char *encryptedVfs()
+{
+    // registered once, wraps the default VFS of the platform
+    static const bool registered = [] {
+        auto platform = sqlite3_vfs_find(nullptr);
+        if (!platform)
+        {
+            return false;
+        }
+
+        encrypted_vfs = {};
+        encrypted_vfs.iVersion = 2;
+        encrypted_vfs.szOsFile = REAL_FILE_OFFSET + platform->szOsFile;
+        encrypted_vfs.mxPathname = platform->mxPathname;
+        encrypted_vfs.zName = VFS_NAME;
+        encrypted_vfs.pAppData = platform;
+        encrypted_vfs.xOpen = vfsOpen;
+        encrypted_vfs.xDelete = vfsDelete;
+        encrypted_vfs.xAccess = vfsAccess;
+        encrypted_vfs.xFullPathname = vfsFullPathname;
+        encrypted_vfs.xDlOpen = vfsDlOpen;
+        encrypted_vfs.xDlError = vfsDlError;
+        encrypted_vfs.xDlSym = vfsDlSym;
+        encrypted_vfs.xDlClose = vfsDlClose;
+        encrypted_vfs.xRandomness = vfsRandomness;
+        encrypted_vfs.xSleep = vfsSleep;
+        encrypted_vfs.xCurrentTime = vfsCurrentTime;
+        encrypted_vfs.xGetLastError = vfsGetLastError;
+        encrypted_vfs.xCurrentTimeInt64 = vfsCurrentTimeInt64;
+
+        return sqlite3_vfs_register(&encrypted_vfs, 0) == SQLITE_OK;
+    }();
+
+    return registered ? VFS_NAME : nullptr;
+}
+
+void setEncryptedVfsPassword(const SecureString &password)
+{
+    std::lock_guard<std::mutex> lock(vfs_mutex);
+    vfs_password.Assign(reinterpret_cast<const unsigned char*>(password.data()), password.size());
+}
+
+namespace {
+    // the reserved bytes of the first page, false if the file isn't an encrypted page file
+    static bool readFirstReserve(const std::string &path, unsigned char *reserve)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+
+        file.seekg(0, std::ios::end);
+        const auto size = static_cast<long long>(file.tellg());
+        if (size < ENCRYPTED_PAGE_SIZE || size % ENCRYPTED_PAGE_SIZE != 0)
+        {
+            return false;
+        }
+
+        file.seekg(USABLE_SIZE, std::ios::beg);
+        file.read(reinterpret_cast<char*>(reserve), ENCRYPTED_PAGE_RESERVE);
+        return file && std::memcmp(reserve + (MAGIC_OFFSET - USABLE_SIZE), MAGIC, sizeof(MAGIC)) == 0;
+    }
+}
+
+bool isEncryptedPageFile(const std::string &path)
+{
+    unsigned char reserve[ENCRYPTED_PAGE_RESERVE];
+    return readFirstReserve(path, reserve);
+}
+
+bool encryptedPageFileSalt(const std::string &path, unsigned char *salt)
+{
+    static_assert(static_cast<int>(ENCRYPTED_PAGE_SALT_SIZE) == SALT_SIZE, "salt size doesn't match the page layout");
+    unsigned char reserve[ENCRYPTED_PAGE_RESERVE];
+    if (!readFirstReserve(path, reserve))
+    {
+        return false;
+    }
+    std::memcpy(salt, reserve + (SALT_OFFSET - USABLE_SIZE), SALT_SIZE);
+    return true;
+}
+
+}
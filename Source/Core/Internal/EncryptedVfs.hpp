@@ -0,0 +1,47 @@
+#ifndef INTERNAL_ENCRYPTEDVFS_HPP
+#define INTERNAL_ENCRYPTEDVFS_HPP
+
+// SQLite VFS which encrypts every database page on its own
+//
+// the database is opened directly on disk and pages are decrypted on demand,
+// a commit only writes the changed pages (and the rollback journal)
+//
+// page layout (ENCRYPTED_PAGE_SIZE bytes, SQLite reserves the last bytes of every page):
+//
+//  -> [0, usable):  AES-256-GCM ciphertext of the page content
+//  -> nonce:        12 random bytes, new for every write
+//  -> tag:          16 bytes GCM authentication tag, the file offset is authenticated as well
+//  -> salt:         16 bytes key derivation salt of the database
+//  -> magic:        4 bytes to detect encrypted page files
+//
+// the key is derived from the password and the salt with HKDF-SHA256, rollback journals use
+// the key of their database and encrypt the page images (the journal headers stay plain),
+// temporary files use a random key
+
+#include <cstddef>
+#include <string>
+
+#include "../SecureMemory.hpp"
+
+namespace Internal {
+
+// page size of encrypted databases and bytes reserved for the encryption
+static const constexpr int ENCRYPTED_PAGE_SIZE = 4096;
+static const constexpr int ENCRYPTED_PAGE_RESERVE = 48;
+
+// name of the VFS, registered on first use, returns nullptr if the registration failed
+const char *encryptedVfs();
+
+// password which is used for all databases opened after this call
+void setEncryptedVfsPassword(const SecureString &password);
+
+// checks if the file looks like a database written by this VFS
+bool isEncryptedPageFile(const std::string &path);
+
+// key derivation salt of a database written by this VFS, it stays the same for the whole file
+static const constexpr std::size_t ENCRYPTED_PAGE_SALT_SIZE = 16;
+bool encryptedPageFileSalt(const std::string &path, unsigned char *salt);
+
+}
+
+#endif // INTERNAL_ENCRYPTEDVFS_HPP
@@ -0,0 +1,146 @@
+#ifndef INTERNAL_HMAC_HPP
+#define INTERNAL_HMAC_HPP
+
+// HMAC (RFC 2104) building blocks on top of the static SHA compression
+// functions, shared by the code generators in OTPGen.cpp and the
+// multi-buffer kernels
+//
+// SHA-1 and SHA-256 blocks go through the hardware accelerated backends
+// of ShaCompress.hpp, SHA-512 uses crypto++
+
+#include <cstdint>
+#include <cstring>
+
+#include <cryptopp/sha.h>
+
+#include <OTPKey.hpp>
+
+#include "ShaCompress.hpp"
+
+namespace Internal {
+
+// big endian load and store of hash words
+template<typename Word>
+inline Word load_be(const unsigned char *p)
+{
+    Word w = 0;
+    for (auto i = 0U; i < sizeof(Word); ++i)
+    {
+        w = static_cast<Word>((w << 8) | p[i]);
+    }
+    return w;
+}
+
+template<typename Word>
+inline void store_be(Word w, unsigned char *p)
+{
+    for (auto i = sizeof(Word); i > 0; --i)
+    {
+        p[i - 1] = static_cast<unsigned char>(w & 0xff);
+        w >>= 8;
+    }
+}
+
+// run the compression function of the hash over a single block
+template<class Hash>
+inline void hash_block(typename Hash::HashWordType *state, const unsigned char *block)
+{
+    using Word = typename Hash::HashWordType;
+    static const constexpr auto words = Hash::BLOCKSIZE / sizeof(Word);
+
+    alignas(16) Word data[words];
+    for (auto i = 0U; i < words; ++i)
+    {
+        data[i] = load_be<Word>(block + i * sizeof(Word));
+    }
+    clearUpperState();
+    Hash::Transform(state, data);
+}
+
+template<>
+inline void hash_block<CryptoPP::SHA1>(CryptoPP::word32 *state, const unsigned char *block)
+{
+    sha1Compress(state, block);
+}
+
+template<>
+inline void hash_block<CryptoPP::SHA256>(CryptoPP::word32 *state, const unsigned char *block)
+{
+    sha256Compress(state, block);
+}
+
+// precompute the hash states after the ipad and opad key blocks (RFC 2104)
+template<class Hash>
+inline void hmac_prepare_helper(const OTPKey::KeyData &key, unsigned char *inner, unsigned char *outer)
+{
+    using Word = typename Hash::HashWordType;
+    static const constexpr auto block_size = Hash::BLOCKSIZE;
+
+    // keys longer than the block size are hashed first
+    unsigned char block[block_size] = {};
+    if (key.size() > block_size)
+    {
+        Hash().CalculateDigest(block, reinterpret_cast<const unsigned char*>(key.data()), key.size());
+    }
+    else
+    {
+        std::memcpy(block, key.data(), key.size());
+    }
+
+    unsigned char padded[block_size];
+    alignas(16) Word state[8];
+
+    for (auto i = 0U; i < block_size; ++i) padded[i] = block[i] ^ 0x36;
+    Hash::InitState(state);
+    hash_block<Hash>(state, padded);
+    std::memcpy(inner, state, sizeof(state));
+
+    for (auto i = 0U; i < block_size; ++i) padded[i] = block[i] ^ 0x5c;
+    Hash::InitState(state);
+    hash_block<Hash>(state, padded);
+    std::memcpy(outer, state, sizeof(state));
+
+    std::memset(block, 0, block_size);
+    std::memset(padded, 0, block_size);
+}
+
+// compute the HMAC of the 8 byte value from the precomputed key states
+template<class Hash>
+inline void hmac_compute_helper(const unsigned char *inner, const unsigned char *outer,
+                                const unsigned char value[8], unsigned char *digest)
+{
+    using Word = typename Hash::HashWordType;
+    static const constexpr auto block_size = Hash::BLOCKSIZE;
+    static const constexpr auto digest_size = Hash::DIGESTSIZE;
+
+    alignas(16) Word state[8];
+    unsigned char block[block_size] = {};
+
+    // inner hash: H(K ^ ipad || value)
+    std::memcpy(state, inner, sizeof(state));
+    std::memcpy(block, value, 8);
+    block[8] = 0x80;
+    store_be<std::uint64_t>((block_size + 8) * 8, block + block_size - 8);
+    hash_block<Hash>(state, block);
+
+    // outer hash: H(K ^ opad || inner)
+    std::memset(block, 0, block_size);
+    for (auto i = 0U; i < digest_size / sizeof(Word); ++i)
+    {
+        store_be<Word>(state[i], block + i * sizeof(Word));
+    }
+    block[digest_size] = 0x80;
+    store_be<std::uint64_t>((block_size + digest_size) * 8, block + block_size - 8);
+
+    std::memcpy(state, outer, sizeof(state));
+    hash_block<Hash>(state, block);
+
+    for (auto i = 0U; i < digest_size / sizeof(Word); ++i)
+    {
+        store_be<Word>(state[i], digest + i * sizeof(Word));
+    }
+}
+
+}
+
+#endif // INTERNAL_HMAC_HPP
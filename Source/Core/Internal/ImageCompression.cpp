@@ -0,0 +1,265 @@
+#include "ImageCompression.hpp"
+
+#include "../Executor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <zlib.h>
+
+namespace Internal {
+
+namespace {
+    static const unsigned char MAGIC[4] = {'O', 'T', 'P', 'Z'};
+    static const constexpr unsigned char VERSION = 1;
+    static const constexpr unsigned char DICTIONARY_VERSION = 1;
+
+    static const constexpr std::size_t VERSION_OFFSET = 4;
+    static const constexpr std::size_t DICTIONARY_OFFSET = 5;
+    static const constexpr std::size_t IMAGE_SIZE_OFFSET = 8;
+    static const constexpr std::size_t FRAME_COUNT_OFFSET = 16;
+    static const constexpr std::size_t HEADER_SIZE = 20;
+
+    // fast compression, most of the savings are free pages and the schema
+    static const constexpr int COMPRESSION_LEVEL = 1;
+
+    // content every database shares, deflate prefers recent matches so the schema is last,
+    // changing this requires a new DICTIONARY_VERSION
+    static const char DICTIONARY[] =
+        "\x89PNG\r\n\x1a\n" "IHDR" "sRGB" "gAMA" "pHYs" "tEXtSoftware" "IDAT" "IEND\xae\x42\x60\x82"
+        "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>"
+        "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+        "version=\"1.1\" width=\"\" height=\"\" viewBox=\"0 0 \"><defs></defs><g transform=\"translate(\">"
+        "<path d=\"M\" fill=\"#\" stroke=\"#\" stroke-width=\"\" fill-rule=\"evenodd\"/></g></svg>"
+        "TOTPHOTPSteamSHA1SHA256SHA512databasesqlite_autoindex_"
+        "CREATE TABLE 'icons' ('hash' blob PRIMARY KEY NOT NULL, 'data' blob NOT NULL)"
+        "CREATE INDEX token_order_position on token_order (position)"
+        "CREATE TABLE 'token_order' ('id' INTEGER PRIMARY KEY NOT NULL, 'position' INTEGER NOT NULL, "
+        "FOREIGN KEY(id) REFERENCES tokens(id))"
+        "CREATE TABLE 'tokens' ('id' INTEGER PRIMARY KEY NOT NULL, 'type' int(1) NOT NULL, "
+        "'label' text NOT NULL UNIQUE COLLATE NOCASE, 'icon' blob, 'secret' text NOT NULL, "
+        "'digits' int(1) NOT NULL, 'period' INTEGER NOT NULL, 'counter' INTEGER NOT NULL, "
+        "'algorithm' int(1) NOT NULL, FOREIGN KEY(type) REFERENCES types(id), "
+        "FOREIGN KEY(algorithm) REFERENCES algorithms(id))"
+        "CREATE TABLE 'config' ('id' text PRIMARY KEY NOT NULL, 'data' blob)"
+        "CREATE TABLE 'algorithms' ('id' int(1) PRIMARY KEY NOT NULL, 'name' text UNIQUE)"
+        "CREATE TABLE 'types' ('id' int(1) PRIMARY KEY NOT NULL, 'name' text UNIQUE)"
+        "SQLite format 3";
+
+    static inline const Bytef *dictionary()
+    {
+        return reinterpret_cast<const Bytef*>(DICTIONARY);
+    }
+    static const constexpr uInt DICTIONARY_SIZE = sizeof(DICTIONARY); // includes the terminator, as in the image
+
+    static inline void writeLE(unsigned char *out, std::uint64_t value, std::size_t bytes)
+    {
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            out[i] = static_cast<unsigned char>(value & 0xff);
+            value >>= 8;
+        }
+    }
+
+    static inline std::uint64_t readLE(const unsigned char *in, std::size_t bytes)
+    {
+        std::uint64_t value = 0;
+        for (auto i = bytes; i > 0; --i)
+        {
+            value = (value << 8) | in[i - 1];
+        }
+        return value;
+    }
+
+    // runs the task for every frame, on the executor if there is more than one
+    template<typename Task>
+    static void forEachFrame(std::size_t frames, Executor *executor, const Task &task)
+    {
+        if (executor && frames > 1U)
+        {
+            executor->parallelFor(frames, 1U, [&](std::size_t begin, std::size_t end) {
+                for (auto i = begin; i < end; ++i)
+                {
+                    task(i);
+                }
+            });
+        }
+        else
+        {
+            for (auto i = 0U; i < frames; ++i)
+            {
+                task(i);
+            }
+        }
+    }
+
+    static bool compressFrame(const unsigned char *in, std::size_t size, SecureBuffer &out)
+    {
+        z_stream stream{};
+        if (deflateInit2(&stream, COMPRESSION_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return false;
+        }
+
+        auto ok = deflateSetDictionary(&stream, dictionary(), DICTIONARY_SIZE) == Z_OK;
+        if (ok)
+        {
+            out.resize(deflateBound(&stream, static_cast<uLong>(size)));
+            stream.next_in = const_cast<Bytef*>(in);
+            stream.avail_in = static_cast<uInt>(size);
+            stream.next_out = out.data();
+            stream.avail_out = static_cast<uInt>(out.size());
+            ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+            out.resize(ok ? stream.total_out : 0U);
+        }
+
+        deflateEnd(&stream);
+        return ok;
+    }
+
+    static bool decompressFrame(const unsigned char *in, std::size_t size, unsigned char *out, std::size_t length)
+    {
+        z_stream stream{};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        {
+            return false;
+        }
+
+        auto ok = inflateSetDictionary(&stream, dictionary(), DICTIONARY_SIZE) == Z_OK;
+        if (ok)
+        {
+            stream.next_in = const_cast<Bytef*>(in);
+            stream.avail_in = static_cast<uInt>(size);
+            stream.next_out = out;
+            stream.avail_out = static_cast<uInt>(length);
+            ok = inflate(&stream, Z_FINISH) == Z_STREAM_END &&
+                 stream.avail_in == 0 && stream.avail_out == 0;
+        }
+
+        inflateEnd(&stream);
+        return ok;
+    }
+}
+
+bool compressImage(const unsigned char *image, std::size_t size, SecureBuffer &out, Executor *executor)
+{
+    out.clear();
+
+    const auto frames = (size + COMPRESSION_FRAME_SIZE - 1) / COMPRESSION_FRAME_SIZE;
+    if (frames > std::numeric_limits<std::uint32_t>::max())
+    {
+        return false;
+    }
+
+    std::vector<SecureBuffer> compressed(frames);
+    std::atomic<bool> failed{false};
+    forEachFrame(frames, executor, [&](std::size_t index) {
+        const auto offset = index * COMPRESSION_FRAME_SIZE;
+        try {
+            if (!compressFrame(image + offset, std::min(COMPRESSION_FRAME_SIZE, size - offset), compressed[index]))
+            {
+                failed = true;
+            }
+        } catch (...) {
+            failed = true;
+        }
+    });
+    if (failed)
+    {
+        return false;
+    }
+
+    auto total = HEADER_SIZE + frames * 4;
+    for (auto&& frame : compressed)
+    {
+        total += frame.size();
+    }
+
+    out.resize(total);
+    auto data = out.data();
+    std::memset(data, 0, HEADER_SIZE);
+    std::memcpy(data, MAGIC, sizeof(MAGIC));
+    data[VERSION_OFFSET] = VERSION;
+    data[DICTIONARY_OFFSET] = DICTIONARY_VERSION;
+    writeLE(data + IMAGE_SIZE_OFFSET, size, 8);
+    writeLE(data + FRAME_COUNT_OFFSET, frames, 4);
+
+    auto position = HEADER_SIZE + frames * 4;
+    for (auto i = 0U; i < frames; ++i)
+    {
+        writeLE(data + HEADER_SIZE + i * 4, compressed[i].size(), 4);
+        std::memcpy(data + position, compressed[i].data(), compressed[i].size());
+        position += compressed[i].size();
+    }
+
+    return true;
+}
+
+std::size_t compressedImageSize(const unsigned char *data, std::size_t size)
+{
+    if (size < HEADER_SIZE ||
+        std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+        data[VERSION_OFFSET] != VERSION ||
+        data[DICTIONARY_OFFSET] != DICTIONARY_VERSION)
+    {
+        return 0U;
+    }
+
+    // the frames must cover the image and the buffer exactly
+    const auto imageSize = readLE(data + IMAGE_SIZE_OFFSET, 8);
+    const auto frames = readLE(data + FRAME_COUNT_OFFSET, 4);
+    if (imageSize == 0 || frames != (imageSize + COMPRESSION_FRAME_SIZE - 1) / COMPRESSION_FRAME_SIZE ||
+        frames > (size - HEADER_SIZE) / 4)
+    {
+        return 0U;
+    }
+
+    std::uint64_t total = HEADER_SIZE + frames * 4;
+    for (auto i = 0U; i < frames; ++i)
+    {
+        total += readLE(data + HEADER_SIZE + i * 4, 4);
+    }
+    if (total != size || imageSize > std::numeric_limits<std::size_t>::max())
+    {
+        return 0U;
+    }
+
+    return static_cast<std::size_t>(imageSize);
+}
+
+bool decompressImage(const unsigned char *data, std::size_t size, unsigned char *out, Executor *executor)
+{
+    const auto imageSize = compressedImageSize(data, size);
+    if (imageSize == 0)
+    {
+        return false;
+    }
+
+    const auto frames = (imageSize + COMPRESSION_FRAME_SIZE - 1) / COMPRESSION_FRAME_SIZE;
+    std::vector<std::size_t> offsets(frames);
+    auto position = HEADER_SIZE + frames * 4;
+    for (auto i = 0U; i < frames; ++i)
+    {
+        offsets[i] = position;
+        position += static_cast<std::size_t>(readLE(data + HEADER_SIZE + i * 4, 4));
+    }
+
+    std::atomic<bool> failed{false};
+    forEachFrame(frames, executor, [&](std::size_t index) {
+        const auto offset = index * COMPRESSION_FRAME_SIZE;
+        const auto end = index + 1 < frames ? offsets[index + 1] : size;
+        if (!decompressFrame(data + offsets[index], end - offsets[index],
+                             out + offset, std::min(COMPRESSION_FRAME_SIZE, imageSize - offset)))
+        {
+            failed = true;
+        }
+    });
+
+    return !failed;
+}
+
+}
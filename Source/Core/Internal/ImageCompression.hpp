@@ -0,0 +1,41 @@
+#ifndef INTERNAL_IMAGECOMPRESSION_HPP
+#define INTERNAL_IMAGECOMPRESSION_HPP
+
+// zlib compression of database images before they are encrypted
+//
+// the image is split into frames of COMPRESSION_FRAME_SIZE bytes which are compressed
+// on their own, so large images are processed in parallel
+//
+// layout:
+//
+//  -> header (20 bytes): magic "OTPZ" | version | dictionary | 2 reserved |
+//                        image size (u64 LE) | frame count (u32 LE)
+//  -> frame table:       compressed size of every frame (u32 LE)
+//  -> frames:            raw deflate streams, the last frame may be shorter
+//
+// every frame uses a preset dictionary with the schema of the token database and
+// common icon markers (PNG chunks, SVG elements), which helps small databases where most
+// of the content is the schema, free pages are runs of zeros and compress well anyway
+
+#include <cstddef>
+
+#include "../SecureMemory.hpp"
+
+class Executor;
+
+namespace Internal {
+
+static const constexpr std::size_t COMPRESSION_FRAME_SIZE = 1024 * 1024;
+
+// the compressed image is kept in secure memory
+bool compressImage(const unsigned char *image, std::size_t size, SecureBuffer &out, Executor *executor = nullptr);
+
+// size of the image in a compressed buffer, 0 if the buffer isn't a compressed image
+std::size_t compressedImageSize(const unsigned char *data, std::size_t size);
+
+// out must have room for compressedImageSize() bytes
+bool decompressImage(const unsigned char *data, std::size_t size, unsigned char *out, Executor *executor = nullptr);
+
+}
+
+#endif // INTERNAL_IMAGECOMPRESSION_HPP
@@ -0,0 +1,287 @@
+#include "IoUring.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define IOURING_AVAILABLE
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// headers older than Linux 5.7 lack the operations used here
+#ifndef IORING_FEAT_FAST_POLL
+#undef IOURING_AVAILABLE
+#endif
+#endif
+
+namespace Internal {
+
+IoUring::~IoUring()
+{
+    close();
+}
+
+#ifdef IOURING_AVAILABLE
+
+bool IoUring::open(unsigned int entries)
+{
+    close();
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const auto fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+    {
+        return false;
+    }
+    _fd = fd;
+    _entries = params.sq_entries;
+
+    // plain reads and writes need Linux 5.6, fast poll arrived with the next release
+    if (!(params.features & IORING_FEAT_FAST_POLL))
+    {
+        close();
+        return false;
+    }
+
+    // the rings are mapped separately, which also works with the single mapping of newer kernels
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    auto sq = ::mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    auto cq = ::mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    auto sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    _sq_ring = sq == MAP_FAILED ? nullptr : sq;
+    _cq_ring = cq == MAP_FAILED ? nullptr : cq;
+    _sqes = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+    if (!_sq_ring || !_cq_ring || !_sqes)
+    {
+        close();
+        return false;
+    }
+
+    const auto sq_base = static_cast<unsigned char*>(_sq_ring);
+    _sq_head = reinterpret_cast<unsigned int*>(sq_base + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned int*>(sq_base + params.sq_off.tail);
+    _sq_mask = reinterpret_cast<unsigned int*>(sq_base + params.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<unsigned int*>(sq_base + params.sq_off.array);
+
+    const auto cq_base = static_cast<unsigned char*>(_cq_ring);
+    _cq_head = reinterpret_cast<unsigned int*>(cq_base + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned int*>(cq_base + params.cq_off.tail);
+    _cq_mask = reinterpret_cast<unsigned int*>(cq_base + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+    return true;
+}
+
+void IoUring::close()
+{
+    if (_sqes)
+    {
+        ::munmap(_sqes, _sqes_size);
+    }
+    if (_cq_ring)
+    {
+        ::munmap(_cq_ring, _cq_ring_size);
+    }
+    if (_sq_ring)
+    {
+        ::munmap(_sq_ring, _sq_ring_size);
+    }
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+    }
+
+    _fd = -1;
+    _entries = 0;
+    _queued = 0;
+    _sq_ring = nullptr;
+    _cq_ring = nullptr;
+    _sqes = nullptr;
+}
+
+io_uring_sqe *IoUring::next()
+{
+    if (_fd < 0)
+    {
+        return nullptr;
+    }
+
+    // the kernel advances the head once it consumed an entry
+    const auto head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    const auto tail = *_sq_tail + _queued;
+    if (tail - head >= _entries)
+    {
+        return nullptr;
+    }
+
+    const auto index = tail & *_sq_mask;
+    auto sqe = &_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+    ++_queued;
+    return sqe;
+}
+
+bool IoUring::read(int fd, void *data, std::uint32_t size, std::uint64_t offset, std::uint64_t user_data)
+{
+    auto sqe = next();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uintptr_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::write(int fd, const void *data, std::uint32_t size, std::uint64_t offset, std::uint64_t user_data)
+{
+    auto sqe = next();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uintptr_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::fsync(int fd, std::uint64_t user_data)
+{
+    auto sqe = next();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool IoUring::poll(int fd, std::uint64_t user_data)
+{
+    auto sqe = next();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = user_data;
+    return true;
+}
+
+int IoUring::submit(unsigned int wait)
+{
+    if (_fd < 0)
+    {
+        return -EBADF;
+    }
+
+    // publish the queued entries
+    const auto count = _queued;
+    __atomic_store_n(_sq_tail, *_sq_tail + count, __ATOMIC_RELEASE);
+    _queued = 0;
+
+    for (;;)
+    {
+        const auto res = ::syscall(__NR_io_uring_enter, _fd, count, wait, wait ? IORING_ENTER_GETEVENTS : 0U, nullptr, 0);
+        if (res >= 0)
+        {
+            return static_cast<int>(res);
+        }
+        if (errno != EINTR)
+        {
+            return -errno;
+        }
+        // the entries were consumed before the wait was interrupted
+        if (__atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == *_sq_tail)
+        {
+            return 0;
+        }
+    }
+}
+
+bool IoUring::pop(std::uint64_t &user_data, std::int32_t &result)
+{
+    if (_fd < 0)
+    {
+        return false;
+    }
+
+    const auto head = *_cq_head;
+    if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    const auto &cqe = _cqes[head & *_cq_mask];
+    user_data = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+bool IoUring::open(unsigned int)
+{
+    return false;
+}
+
+void IoUring::close()
+{
+}
+
+io_uring_sqe *IoUring::next()
+{
+    return nullptr;
+}
+
+bool IoUring::read(int, void*, std::uint32_t, std::uint64_t, std::uint64_t)
+{
+    return false;
+}
+
+bool IoUring::write(int, const void*, std::uint32_t, std::uint64_t, std::uint64_t)
+{
+    return false;
+}
+
+bool IoUring::fsync(int, std::uint64_t)
+{
+    return false;
+}
+
+bool IoUring::poll(int, std::uint64_t)
+{
+    return false;
+}
+
+int IoUring::submit(unsigned int)
+{
+    return -1;
+}
+
+bool IoUring::pop(std::uint64_t&, std::int32_t&)
+{
+    return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,74 @@
+#ifndef INTERNAL_IOURING_HPP
+#define INTERNAL_IOURING_HPP
+
+// minimal io_uring instance using the system calls directly (no liburing)
+//
+// the submission and completion rings are driven by a single thread, on other
+// platforms and kernels without io_uring open() fails and callers fall back
+// to blocking I/O
+
+#include <cstddef>
+#include <cstdint>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace Internal {
+
+class IoUring final
+{
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring &operator=(const IoUring&) = delete;
+
+    // returns false if io_uring isn't available
+    bool open(unsigned int entries);
+    void close();
+
+    inline bool isOpen() const
+    { return _fd >= 0; }
+    inline unsigned int entries() const
+    { return _entries; }
+
+    // queue operations, returns false if the submission queue is full
+    bool read(int fd, void *data, std::uint32_t size, std::uint64_t offset, std::uint64_t user_data);
+    bool write(int fd, const void *data, std::uint32_t size, std::uint64_t offset, std::uint64_t user_data);
+    bool fsync(int fd, std::uint64_t user_data);
+    bool poll(int fd, std::uint64_t user_data);
+
+    // submit the queued operations and wait for at least wait completions, returns -errno on failure
+    int submit(unsigned int wait);
+
+    // takes the next completion, returns false if there is none
+    bool pop(std::uint64_t &user_data, std::int32_t &result);
+
+private:
+    io_uring_sqe *next();
+
+    int _fd = -1;
+    unsigned int _entries = 0;
+    unsigned int _queued = 0;
+
+    void *_sq_ring = nullptr;
+    std::size_t _sq_ring_size = 0;
+    void *_cq_ring = nullptr;
+    std::size_t _cq_ring_size = 0;
+    io_uring_sqe *_sqes = nullptr;
+    std::size_t _sqes_size = 0;
+
+    unsigned int *_sq_head = nullptr;
+    unsigned int *_sq_tail = nullptr;
+    unsigned int *_sq_mask = nullptr;
+    unsigned int *_sq_array = nullptr;
+    unsigned int *_cq_head = nullptr;
+    unsigned int *_cq_tail = nullptr;
+    unsigned int *_cq_mask = nullptr;
+    io_uring_cqe *_cqes = nullptr;
+};
+
+}
+
+#endif // INTERNAL_IOURING_HPP
@@ -0,0 +1,92 @@
+#include "JsonArena.hpp"
+
+#include "../PerfStats.hpp"
+
+#include <algorithm>
+
+namespace {
+    // buffer of the thread and whether an arena holds it
+    struct ThreadBuffer
+    {
+        SecureBuffer buffer;
+        bool taken = false;
+    };
+
+    static ThreadBuffer &threadBuffer()
+    {
+        static thread_local ThreadBuffer local;
+        return local;
+    }
+
+    // the pool places its chunk header at the start of the buffer
+    static const constexpr std::size_t HEADER_SIZE = 64U;
+    // initial parse stack of documents, grows within the arena
+    static const constexpr std::size_t STACK_CAPACITY = 1024U;
+}
+
+namespace Internal {
+
+JsonArena::JsonArena()
+{
+    auto &local = threadBuffer();
+    if (!local.taken)
+    {
+        local.taken = true;
+        this->_buffer = &local.buffer;
+    }
+    else
+    {
+        this->_buffer = &this->_own;
+    }
+
+    if (this->_buffer->size() < INITIAL_SIZE)
+    {
+        this->_buffer->resize(INITIAL_SIZE);
+    }
+    this->_allocator.emplace(this->_buffer->data(), this->_buffer->size());
+}
+
+JsonArena::~JsonArena()
+{
+    // the pool reports the used bytes of all chunks, the buffer holds at most all of them
+    const auto used = this->_allocator->Size();
+    const auto capacity = this->_allocator->Capacity();
+    SecureMemory::wipe(this->_buffer->data(), std::min(this->_buffer->size(), used + HEADER_SIZE));
+    this->_allocator.reset();
+
+    // the next arena of the thread fits the document which spilled
+    if (capacity + HEADER_SIZE > this->_buffer->size())
+    {
+        OTPGEN_PERF_COUNT(JsonArenaSpills, 1U);
+        const auto size = std::min(capacity + HEADER_SIZE, MAX_SIZE);
+        if (size > this->_buffer->size())
+        {
+            SecureBuffer().swap(*this->_buffer);
+            this->_buffer->resize(size);
+        }
+    }
+
+    if (this->_buffer != &this->_own)
+    {
+        threadBuffer().taken = false;
+    }
+}
+
+JsonArena::Document JsonArena::document()
+{
+    return Document(&this->allocator(), STACK_CAPACITY, &this->allocator());
+}
+
+JsonArena::Reader JsonArena::reader()
+{
+    return Reader(&this->allocator());
+}
+
+bool JsonArena::parseInsitu(Document &document, SecureString &text)
+{
+    // the text is terminated by the string
+    document.ParseInsitu(&text[0]);
+    return !document.HasParseError();
+}
+
+}
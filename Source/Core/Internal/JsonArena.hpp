@@ -0,0 +1,62 @@
+#ifndef INTERNAL_JSONARENA_HPP
+#define INTERNAL_JSONARENA_HPP
+
+// memory of the JSON documents and readers of the importers
+//
+// every thread keeps one buffer in secure memory, an arena hands it to rapidjson as the
+// first chunk of a memory pool, so parsing a backup allocates nothing in the common case,
+// the used part is wiped when the arena ends and the buffer is kept for the next import
+// of the thread, it grows to the largest document seen (up to MAX_SIZE)
+//
+// documents parsed in place keep their strings in the input buffer, which should be a
+// SecureString, the arena then only holds the value nodes; documents which don't fit
+// spill into regular heap chunks, an arena created while another one is alive on the
+// same thread gets a buffer of its own
+
+#include <cstddef>
+#include <optional>
+
+#include "../SecureMemory.hpp"
+
+#include <cereal/external/rapidjson/document.h>
+#include <cereal/external/rapidjson/reader.h>
+
+namespace Internal {
+
+class JsonArena final
+{
+public:
+    using Allocator = rapidjson::MemoryPoolAllocator<>;
+    // values and the parse stack in the arena, the values are plain rapidjson::Value
+    using Document = rapidjson::GenericDocument<rapidjson::UTF8<>, Allocator, Allocator>;
+    using Reader = rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>, Allocator>;
+
+    static const constexpr std::size_t INITIAL_SIZE = 64U * 1024U;
+    static const constexpr std::size_t MAX_SIZE = 4U * 1024U * 1024U;
+
+    JsonArena();
+    ~JsonArena();
+
+    JsonArena(const JsonArena&) = delete;
+    JsonArena &operator=(const JsonArena&) = delete;
+
+    inline Allocator &allocator()
+    { return *_allocator; }
+
+    // empty document and SAX reader, must not outlive the arena
+    Document document();
+    Reader reader();
+
+    // parses the text in place, the strings of the document point into it
+    static bool parseInsitu(Document &document, SecureString &text);
+
+private:
+    SecureBuffer *_buffer = nullptr;
+    // buffer of a nested arena
+    SecureBuffer _own;
+    std::optional<Allocator> _allocator;
+};
+
+}
+
+#endif // INTERNAL_JSONARENA_HPP
@@ -0,0 +1,40 @@
+#ifndef INTERNAL_JSONMEMBERS_HPP
+#define INTERNAL_JSONMEMBERS_HPP
+
+// typed access to optional members of parsed rapidjson objects
+//
+// missing members and members of another type yield the fallback, the importers
+// of other apps use them for the fields which aren't present in every version
+
+#include <cstdint>
+#include <string_view>
+
+#include <cereal/external/rapidjson/document.h>
+
+namespace Internal {
+
+inline const rapidjson::Value *member(const rapidjson::Value &object, const char *name)
+{
+    if (!object.IsObject())
+    {
+        return nullptr;
+    }
+    const auto it = object.FindMember(name);
+    return it == object.MemberEnd() ? nullptr : &it->value;
+}
+
+inline std::string_view stringMember(const rapidjson::Value &object, const char *name, std::string_view fallback = {})
+{
+    const auto value = member(object, name);
+    return value && value->IsString() ? std::string_view(value->GetString(), value->GetStringLength()) : fallback;
+}
+
+inline std::uint64_t uintMember(const rapidjson::Value &object, const char *name, std::uint64_t fallback = 0U)
+{
+    const auto value = member(object, name);
+    return value && value->IsUint64() ? value->GetUint64() : fallback;
+}
+
+}
+
+#endif // INTERNAL_JSONMEMBERS_HPP
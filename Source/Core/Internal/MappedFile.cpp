@@ -0,0 +1,125 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPEDFILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Internal {
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        _mapped = other._mapped;
+        _size = other._size;
+        _buffer = std::move(other._buffer);
+        _data = _mapped ? other._data : _buffer.data();
+
+        other._data = nullptr;
+        other._size = 0;
+        other._mapped = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+
+#ifdef MAPPEDFILE_MMAP
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // only regular files are mapped, everything else is read
+    struct stat st{};
+    const auto regular = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (regular && st.st_size == 0)
+    {
+        // empty files can't be mapped
+        ::close(fd);
+        return true;
+    }
+
+    // the mapping keeps the file referenced after the descriptor is closed
+    const auto size = static_cast<std::size_t>(regular ? st.st_size : 0);
+    auto address = regular ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (address != MAP_FAILED)
+    {
+        // the file is usually read from start to end
+        (void) ::madvise(address, size, MADV_SEQUENTIAL);
+
+        _data = static_cast<const char*>(address);
+        _size = size;
+        _mapped = true;
+        return true;
+    }
+#endif
+
+    // fallback, read the whole file into memory
+    try {
+        std::ifstream stream(path, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+        if (!stream)
+        {
+            return false;
+        }
+        const auto stream_size = static_cast<std::streamsize>(stream.tellg());
+        if (stream_size < 0)
+        {
+            return false;
+        }
+        stream.seekg(0, std::ios::beg);
+
+        _buffer.resize(static_cast<std::size_t>(stream_size));
+        if (!stream.read(_buffer.data(), stream_size))
+        {
+            _buffer.clear();
+            return false;
+        }
+    } catch (...) {
+        _buffer.clear();
+        return false;
+    }
+
+    _data = _buffer.data();
+    _size = _buffer.size();
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef MAPPEDFILE_MMAP
+    if (_mapped)
+    {
+        (void) ::munmap(const_cast<char*>(_data), _size);
+    }
+#endif
+
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+    _buffer.clear();
+}
+
+}
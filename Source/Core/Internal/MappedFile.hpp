@@ -0,0 +1,55 @@
+#ifndef INTERNAL_MAPPEDFILE_HPP
+#define INTERNAL_MAPPEDFILE_HPP
+
+// read-only view of a whole file
+//
+// the file is memory mapped where supported, pages are read lazily by the kernel
+// and there is no copy into user space, other platforms read the file into memory
+//
+// the view stays valid until the object is closed or destroyed, the file must not be
+// truncated by someone else while it is mapped
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace Internal {
+
+class MappedFile final
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    // returns false if the file can't be opened or read, empty files are valid
+    bool open(const std::string &path);
+    void close();
+
+    inline const char *data() const
+    { return _data; }
+    inline const unsigned char *bytes() const
+    { return reinterpret_cast<const unsigned char*>(_data); }
+    inline std::size_t size() const
+    { return _size; }
+    inline bool empty() const
+    { return _size == 0; }
+    inline std::string_view view() const
+    { return std::string_view(_data, _size); }
+
+private:
+    const char *_data = nullptr;
+    std::size_t _size = 0;
+    bool _mapped = false;
+
+    // contents of files which couldn't be mapped
+    std::string _buffer;
+};
+
+}
+
+#endif // INTERNAL_MAPPEDFILE_HPP
@@ -0,0 +1,117 @@
+#ifndef INTERNAL_OTPPROFILE_HPP
+#define INTERNAL_OTPPROFILE_HPP
+
+// code generation kernels specialized at compile time for a fixed algorithm,
+// digit length and period
+//
+// almost all real tokens use one of a handful of parameter sets, for those the
+// batch generators in OTPGen.cpp use an OTPProfile: the digest size, the offset
+// of the truncation byte, the 10^digits divisor and the period are constants,
+// so the kernel inlines into a single straight code path without any dispatch
+
+#include <cstdint>
+#include <ctime>
+
+#include <cryptopp/sha.h>
+
+#include <OTPToken.hpp>
+#include <OTPKey.hpp>
+#include <OTPGen.hpp>
+
+#include "Hmac.hpp"
+
+namespace Internal {
+
+// 10^Digits as compile-time constant
+template<unsigned Digits>
+struct DigitsPower
+{
+    static const constexpr std::uint64_t value = 10U * DigitsPower<Digits - 1U>::value;
+};
+
+template<>
+struct DigitsPower<0U>
+{
+    static const constexpr std::uint64_t value = 1U;
+};
+
+// reduce the binary code to the given amount of digits, the divisor is a
+// constant so the modulo compiles down to a multiplication
+template<unsigned Digits>
+inline std::uint32_t reduce_code(std::uint32_t bin_code) noexcept
+{
+    return static_cast<std::uint32_t>(bin_code % DigitsPower<Digits>::value);
+}
+
+// write the lowest Digits digits of the code zero-padded into the buffer,
+// the loop has a fixed trip count and is fully unrolled without branches
+template<unsigned Digits>
+inline void format_code(std::uint32_t code, char *token) noexcept
+{
+    for (auto i = Digits; i > 0U; --i)
+    {
+        token[i - 1U] = static_cast<char>('0' + code % 10U);
+        code /= 10U;
+    }
+    token[Digits] = '\0';
+}
+
+// crypto++ hash of the token algorithm
+template<OTPToken::ShaAlgorithm Algo>
+struct ProfileHash;
+
+template<>
+struct ProfileHash<OTPToken::SHA1>
+{ using type = CryptoPP::SHA1; };
+
+template<>
+struct ProfileHash<OTPToken::SHA256>
+{ using type = CryptoPP::SHA256; };
+
+template<>
+struct ProfileHash<OTPToken::SHA512>
+{ using type = CryptoPP::SHA512; };
+
+template<OTPToken::ShaAlgorithm Algo, unsigned Digits, unsigned Period>
+struct OTPProfile
+{
+    static_assert(Digits >= OTPGen::minDigitLength() && Digits <= OTPGen::maxDigitLength(), "digit length out of range");
+    static_assert(Period > OTPGen::minPeriod() && Period <= OTPGen::maxPeriod(), "period out of range");
+
+    using Hash = typename ProfileHash<Algo>::type;
+
+    static const constexpr OTPToken::ShaAlgorithm algorithm = Algo;
+    static const constexpr OTPToken::DigitType digits = Digits;
+    static const constexpr OTPToken::PeriodType period = Period;
+
+    // time step of the time, the division by the constant period is a multiplication
+    static inline std::uint64_t counter(const std::time_t &time) noexcept
+    {
+        return static_cast<std::uint64_t>(time / static_cast<std::time_t>(Period));
+    }
+
+    // dynamic truncation (RFC 4226) of the digest, reduced to the digit length
+    static inline std::uint32_t truncate(const unsigned char *hmac) noexcept
+    {
+        const auto offset = hmac[Hash::DIGESTSIZE - 1] & 0x0f;
+        const auto bin_code =
+            (static_cast<std::uint32_t>(hmac[offset] & 0x7f) << 24) |
+            (static_cast<std::uint32_t>(hmac[offset + 1]) << 16) |
+            (static_cast<std::uint32_t>(hmac[offset + 2]) << 8) |
+            (static_cast<std::uint32_t>(hmac[offset + 3]));
+        return reduce_code<Digits>(bin_code);
+    }
+
+    // write the code of the big endian counter into the buffer,
+    // the key must be valid and prepared for the algorithm of the profile
+    static inline void compute(const OTPKey &key, const unsigned char value[8], char *token) noexcept
+    {
+        unsigned char digest[Hash::DIGESTSIZE];
+        hmac_compute_helper<Hash>(key.innerState(), key.outerState(), value, digest);
+        format_code<Digits>(truncate(digest), token);
+    }
+};
+
+}
+
+#endif // INTERNAL_OTPPROFILE_HPP
@@ -0,0 +1,92 @@
+#include "RawStatement.hpp"
+
+#include <sqlite/sqlite3.h>
+
+namespace Internal {
+
+RawStatement::RawStatement(sqlite3 *connection, const std::string_view &sql)
+{
+    _status = sqlite3_prepare_v2(connection, sql.data(), static_cast<int>(sql.size()), &_stmt, nullptr);
+    if (_status != SQLITE_OK)
+    {
+        sqlite3_finalize(_stmt);
+        _stmt = nullptr;
+    }
+}
+
+RawStatement::~RawStatement()
+{
+    sqlite3_finalize(_stmt);
+}
+
+RawStatement &RawStatement::bind(std::int64_t value)
+{
+    const auto rc = sqlite3_bind_int64(_stmt, ++_index, value);
+    _bindStatus = _bindStatus == SQLITE_OK ? rc : _bindStatus;
+    return *this;
+}
+
+RawStatement &RawStatement::bind(const std::string &text)
+{
+    const auto rc = sqlite3_bind_text(_stmt, ++_index, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+    _bindStatus = _bindStatus == SQLITE_OK ? rc : _bindStatus;
+    return *this;
+}
+
+RawStatement &RawStatement::bind(const void *data, std::size_t size)
+{
+    // a null pointer binds NULL, like the empty vectors of sqlite_modern_cpp
+    const auto rc = sqlite3_bind_blob(_stmt, ++_index, data, static_cast<int>(size), SQLITE_TRANSIENT);
+    _bindStatus = _bindStatus == SQLITE_OK ? rc : _bindStatus;
+    return *this;
+}
+
+RawStatement &RawStatement::bindNull()
+{
+    const auto rc = sqlite3_bind_null(_stmt, ++_index);
+    _bindStatus = _bindStatus == SQLITE_OK ? rc : _bindStatus;
+    return *this;
+}
+
+int RawStatement::step()
+{
+    if (!_stmt)
+    {
+        // SQL text without a statement prepares without error
+        return _status != SQLITE_OK ? _status : SQLITE_MISUSE;
+    }
+    if (_bindStatus != SQLITE_OK)
+    {
+        return _bindStatus;
+    }
+
+    const auto rc = sqlite3_step(_stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE ? rc : (rc & 0xff);
+}
+
+int RawStatement::execute()
+{
+    auto rc = SQLITE_ROW;
+    while ((rc = step()) == SQLITE_ROW) {}
+    return rc;
+}
+
+std::int64_t RawStatement::int64(int column) const
+{
+    return sqlite3_column_int64(_stmt, column);
+}
+
+bool RawStatement::null(int column) const
+{
+    return sqlite3_column_type(_stmt, column) == SQLITE_NULL;
+}
+
+void RawStatement::reset()
+{
+    sqlite3_reset(_stmt);
+    sqlite3_clear_bindings(_stmt);
+    _index = 0;
+    _bindStatus = SQLITE_OK;
+}
+
+} // namespace Internal
@@ -0,0 +1,81 @@
+#ifndef INTERNAL_RAWSTATEMENT_HPP
+#define INTERNAL_RAWSTATEMENT_HPP
+
+// prepared statement which reports through result codes instead of exceptions
+//
+// sqlite_modern_cpp throws for every failed step, including the expected ones like
+// a constraint violation of an insert, unwinding costs far more than the statement
+// itself when most rows of a bulk import are duplicates. The statements of the hot
+// paths use this thin wrapper instead, the results are the codes of sqlite.
+//
+// values are bound in order like the operator<< of sqlite_modern_cpp and with the
+// same conversions (empty vectors bind as NULL, strings are copied), a failed bind
+// is remembered and returned by the next step()
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace Internal {
+
+class RawStatement final
+{
+public:
+    // prepares the statement, status() has the error code when it fails
+    RawStatement(sqlite3 *connection, const std::string_view &sql);
+    ~RawStatement();
+
+    RawStatement(const RawStatement&) = delete;
+    RawStatement &operator=(const RawStatement&) = delete;
+
+    // SQLITE_OK once prepared, else the code of the failed prepare
+    inline int status() const
+    { return _status; }
+    inline bool valid() const
+    { return _stmt != nullptr; }
+
+    RawStatement &bind(std::int64_t value);
+    RawStatement &bind(const std::string &text);
+    RawStatement &bind(const void *data, std::size_t size);
+    RawStatement &bindNull();
+
+    template<typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    inline RawStatement &bind(T value)
+    { return bind(static_cast<std::int64_t>(value)); }
+    template<typename T, typename A>
+    inline RawStatement &bind(const std::vector<T, A> &blob)
+    { return bind(blob.data(), blob.size() * sizeof(T)); }
+
+    // SQLITE_ROW, SQLITE_DONE or the primary code of the error (like SQLITE_CONSTRAINT)
+    int step();
+    // steps to the end, SQLITE_DONE or the error
+    int execute();
+
+    // values of the current row, the index starts at 0
+    std::int64_t int64(int column) const;
+    bool null(int column) const;
+
+    // ready for the next use, the bindings are cleared
+    void reset();
+
+private:
+    sqlite3_stmt *_stmt = nullptr;
+    int _status = 0;
+    int _index = 0;
+    int _bindStatus = 0;
+};
+
+// prepared statements of a connection, keyed by the SQL text
+using RawStatementMap = std::unordered_map<std::string, std::unique_ptr<RawStatement>>;
+
+} // namespace Internal
+
+#endif // INTERNAL_RAWSTATEMENT_HPP
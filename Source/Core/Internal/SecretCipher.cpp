@@ -0,0 +1,135 @@
+#include "SecretCipher.hpp"
+#include "SecureRandom.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/hmac.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/misc.h>
+
+namespace Internal {
+
+namespace {
+    static const constexpr unsigned char VERSION = 1;
+    static const constexpr std::size_t NONCE_SIZE = CryptoPP::AES::BLOCKSIZE;
+    static const constexpr std::size_t HEADER_SIZE = 1 + NONCE_SIZE;
+    static const constexpr std::size_t KEY_SIZE = 32;
+
+    static const char *const KEY_INFO = "OTPGen token secrets";
+    static const char *const HASH_KEY_INFO = "OTPGen token secret fingerprints";
+
+    // ciphers are shared by threads and the block cipher of crypto++ isn't, every thread keeps
+    // the key schedule of the cipher it used last (until it uses another one), ids aren't reused
+    static std::atomic<std::uint64_t> next_id{1U};
+
+    struct Schedule {
+        std::uint64_t cipher = 0U;
+        CryptoPP::AES::Encryption aes;
+    };
+
+    static const CryptoPP::AES::Encryption &schedule(const std::uint64_t &id, const CryptoPP::SecByteBlock &key)
+    {
+        static thread_local Schedule current;
+        if (current.cipher != id)
+        {
+            current.aes.SetKey(key, key.size());
+            current.cipher = id;
+        }
+        return current.aes;
+    }
+
+    // the keyed HMAC state the same way, HMAC restarts with its key after every digest
+    struct Mac {
+        std::uint64_t cipher = 0U;
+        CryptoPP::HMAC<CryptoPP::SHA256> hmac;
+    };
+
+    static CryptoPP::HMAC<CryptoPP::SHA256> &mac(const std::uint64_t &id, const CryptoPP::SecByteBlock &key)
+    {
+        static thread_local Mac current;
+        if (current.cipher != id)
+        {
+            current.hmac.SetKey(key, key.size());
+            current.cipher = id;
+        }
+        return current.hmac;
+    }
+
+    // CTR with the nonce as initial counter block, secrets are only a few blocks long
+    static void process(const CryptoPP::AES::Encryption &aes, const unsigned char *nonce,
+                        const unsigned char *in, unsigned char *out, std::size_t size)
+    {
+        static const constexpr auto BLOCK = CryptoPP::AES::BLOCKSIZE;
+        unsigned char counter[BLOCK], stream[BLOCK];
+        std::memcpy(counter, nonce, BLOCK);
+        for (std::size_t offset = 0; offset < size; offset += BLOCK)
+        {
+            const auto length = std::min<std::size_t>(BLOCK, size - offset);
+            aes.ProcessBlock(counter, stream);
+            for (std::size_t i = 0; i < length; ++i)
+            {
+                out[offset + i] = static_cast<unsigned char>(in[offset + i] ^ stream[i]);
+            }
+            CryptoPP::IncrementCounterByOne(counter, BLOCK);
+        }
+        CryptoPP::SecureWipeBuffer(stream, BLOCK);
+    }
+}
+
+SecretCipher::SecretCipher(const SecureString &password)
+    : _key(KEY_SIZE),
+      _hashKey(KEY_SIZE),
+      _id(next_id.fetch_add(1U, std::memory_order_relaxed))
+{
+    CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+    hkdf.DeriveKey(this->_key, this->_key.size(),
+                   reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                   nullptr, 0, reinterpret_cast<const unsigned char*>(KEY_INFO), std::strlen(KEY_INFO));
+    hkdf.DeriveKey(this->_hashKey, this->_hashKey.size(),
+                   reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                   nullptr, 0, reinterpret_cast<const unsigned char*>(HASH_KEY_INFO), std::strlen(HASH_KEY_INFO));
+}
+
+bool SecretCipher::operator== (const SecretCipher &other) const
+{
+    return CryptoPP::VerifyBufsEqual(this->_key, other._key, KEY_SIZE);
+}
+
+void SecretCipher::encrypt(const char *secret, std::size_t size, SecureBuffer &out) const
+{
+    out.resize(HEADER_SIZE + size);
+    out[0] = VERSION;
+    randomBytes(out.data() + 1, NONCE_SIZE);
+    process(schedule(this->_id, this->_key), out.data() + 1, reinterpret_cast<const unsigned char*>(secret), out.data() + HEADER_SIZE, size);
+}
+
+void SecretCipher::fingerprint(const unsigned char *data, std::size_t size, std::vector<unsigned char> &out) const
+{
+    auto &hmac = mac(this->_id, this->_hashKey);
+    hmac.Update(data, size);
+    out.resize(FINGERPRINT_SIZE);
+    hmac.TruncatedFinal(out.data(), out.size());
+}
+
+bool SecretCipher::decrypt(const unsigned char *value, std::size_t size, SecureString &out) const
+{
+    out.clear();
+    if (size == 0)
+    {
+        return true;
+    }
+    if (size < HEADER_SIZE || value[0] != VERSION)
+    {
+        return false;
+    }
+
+    out.resize(size - HEADER_SIZE);
+    process(schedule(this->_id, this->_key), value + 1, value + HEADER_SIZE, reinterpret_cast<unsigned char*>(&out[0]), out.size());
+    return true;
+}
+
+}
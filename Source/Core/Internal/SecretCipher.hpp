@@ -0,0 +1,59 @@
+#ifndef INTERNAL_SECRETCIPHER_HPP
+#define INTERNAL_SECRETCIPHER_HPP
+
+// encryption of the secret column of the token database
+//
+// the secrets stay encrypted while the database is open, only the rows which are selected
+// with their secret are decrypted, straight into the secure memory of the token
+//
+// value layout (stored as BLOB):
+//
+//  -> version:    1 byte
+//  -> nonce:      16 random bytes, new for every write
+//  -> ciphertext: AES-256-CTR of the secret, as long as the secret
+//
+// the key is derived from the database password with HKDF-SHA256, the values aren't
+// authenticated on their own since the database file itself is
+//
+// fingerprints are HMAC-SHA256 (truncated to 16 bytes) under a second key derived the same way,
+// equal secrets have equal fingerprints, so duplicates are found without decrypting the secrets
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <cryptopp/secblock.h>
+
+#include "../SecureMemory.hpp"
+
+namespace Internal {
+
+class SecretCipher final
+{
+public:
+    explicit SecretCipher(const SecureString &password);
+
+    SecretCipher(const SecretCipher&) = delete;
+    SecretCipher &operator=(const SecretCipher&) = delete;
+
+    // ciphers of the same password produce the same values
+    bool operator== (const SecretCipher &other) const;
+    inline bool operator!= (const SecretCipher &other) const
+    { return !(*this == other); }
+
+    void encrypt(const char *secret, std::size_t size, SecureBuffer &out) const;
+    // false if the value isn't an encrypted secret, out is cleared then, empty values are empty secrets
+    bool decrypt(const unsigned char *value, std::size_t size, SecureString &out) const;
+
+    static const constexpr std::size_t FINGERPRINT_SIZE = 16;
+    void fingerprint(const unsigned char *data, std::size_t size, std::vector<unsigned char> &out) const;
+
+private:
+    CryptoPP::SecByteBlock _key;
+    CryptoPP::SecByteBlock _hashKey;
+    std::uint64_t _id;
+};
+
+}
+
+#endif // INTERNAL_SECRETCIPHER_HPP
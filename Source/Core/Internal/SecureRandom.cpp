@@ -0,0 +1,78 @@
+#include "SecureRandom.hpp"
+
+#include <algorithm>
+#include <optional>
+
+#include <cryptopp/drbg.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/sha.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace {
+    using Drbg = CryptoPP::Hash_DRBG<CryptoPP::SHA256, 256U / 8U, 440U / 8U>;
+
+    static const constexpr std::size_t ENTROPY_SIZE = Drbg::SECURITY_STRENGTH;
+    static const constexpr std::size_t NONCE_SIZE = Drbg::SECURITY_STRENGTH / 2U;
+
+    static long processId()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        return static_cast<long>(::getpid());
+#else
+        return 0L;
+#endif
+    }
+
+    struct ThreadDrbg
+    {
+        std::optional<Drbg> drbg;
+        long process = 0L;
+        std::size_t output = 0U;
+
+        inline bool stale() const
+        { return !this->drbg || this->output >= Internal::RESEED_BYTES || this->process != processId(); }
+
+        void reseed()
+        {
+            CryptoPP::FixedSizeSecBlock<CryptoPP::byte, ENTROPY_SIZE + NONCE_SIZE> seed;
+            CryptoPP::OS_GenerateRandomBlock(false, seed, seed.size());
+            if (this->drbg)
+            {
+                this->drbg->IncorporateEntropy(seed, ENTROPY_SIZE);
+            }
+            else
+            {
+                this->drbg.emplace(seed, ENTROPY_SIZE, seed + ENTROPY_SIZE, NONCE_SIZE);
+            }
+            this->process = processId();
+            this->output = 0U;
+        }
+    };
+}
+
+namespace Internal {
+
+void randomBytes(void *out, std::size_t size)
+{
+    static thread_local ThreadDrbg local;
+
+    // requests of the DRBG are limited in size
+    auto bytes = static_cast<CryptoPP::byte*>(out);
+    while (size > 0U)
+    {
+        if (local.stale())
+        {
+            local.reseed();
+        }
+        const auto chunk = std::min<std::size_t>(size, local.drbg->MaxBytesPerRequest());
+        local.drbg->GenerateBlock(bytes, chunk);
+        bytes += chunk;
+        size -= chunk;
+        local.output += chunk;
+    }
+}
+
+}
@@ -0,0 +1,21 @@
+#ifndef INTERNAL_SECURERANDOM_HPP
+#define INTERNAL_SECURERANDOM_HPP
+
+// cryptographically secure random bytes of the whole library
+//
+// every thread keeps a Hash_DRBG (SHA-256, 256 bits of security) seeded from the operating
+// system, a seeded pool constructed per call reads the system entropy source every time,
+// the DRBG reads it once per reseed; it is reseeded after RESEED_BYTES of output and in
+// processes forked from the one which seeded it, so forked workers never share a stream
+
+#include <cstddef>
+
+namespace Internal {
+
+static const constexpr std::size_t RESEED_BYTES = 1U << 20;
+
+void randomBytes(void *out, std::size_t size);
+
+}
+
+#endif // INTERNAL_SECURERANDOM_HPP
@@ -0,0 +1,281 @@
+#include "Sha1MultiBuffer.hpp"
+
+#include "Hmac.hpp"
+
+#include <atomic>
+#include <cstring>
+
+#include <cryptopp/sha.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OTPGEN_SHA1_MB_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__)
+#define OTPGEN_SHA1_MB_NEON
+#endif
+
+// the vector extensions compile to SIMD128 instructions, there is no runtime detection
+// on WebAssembly, a module built with -msimd128 doesn't load without SIMD support anyway
+#if defined(__wasm_simd128__)
+#define OTPGEN_SHA1_MB_WASM_SIMD
+#endif
+
+namespace Internal {
+
+namespace {
+    // portable SIMD vectors of 32-bit words (GCC/Clang vector extensions)
+    // the instruction set is chosen by the target of the function which uses them
+    typedef std::uint32_t u32x4 __attribute__((vector_size(16)));
+    typedef std::uint32_t u32x8 __attribute__((vector_size(32)));
+    typedef std::uint32_t u32x16 __attribute__((vector_size(64)));
+
+    static const constexpr std::uint32_t SHA1_K[] = {
+        0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6,
+    };
+
+    // message length in bits of the inner (ipad block + counter) and
+    // outer (opad block + inner digest) messages
+    static const constexpr std::uint32_t INNER_BITS = (64 + 8) * 8;
+    static const constexpr std::uint32_t OUTER_BITS = (64 + 20) * 8;
+
+    // no helper function to avoid passing vectors by value outside of the target code
+    #define SHA1_MB_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+    // SHA-1 compression function over one block per lane, the state is updated in place
+    template<typename V>
+    __attribute__((always_inline)) inline void sha1_compress(V *s, V *w)
+    {
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];
+
+        for (auto t = 0; t < 80; ++t)
+        {
+            if (t >= 16)
+            {
+                w[t & 15] = SHA1_MB_ROTL(w[(t - 3) & 15] ^ w[(t - 8) & 15] ^ w[(t - 14) & 15] ^ w[t & 15], 1);
+            }
+
+            V f;
+            if (t < 20)      f = d ^ (b & (c ^ d));
+            else if (t < 40) f = b ^ c ^ d;
+            else if (t < 60) f = (b & c) | (d & (b | c));
+            else             f = b ^ c ^ d;
+
+            const V tmp = SHA1_MB_ROTL(a, 5) + f + e + SHA1_K[t / 20] + w[t & 15];
+            e = d;
+            d = c;
+            c = SHA1_MB_ROTL(b, 30);
+            b = a;
+            a = tmp;
+        }
+
+        s[0] += a;
+        s[1] += b;
+        s[2] += c;
+        s[3] += d;
+        s[4] += e;
+    }
+
+    #undef SHA1_MB_ROTL
+
+    // load the precomputed key state of every lane into the vectors
+    template<typename V, std::size_t N>
+    __attribute__((always_inline)) inline void load_states(V *s, const HmacSha1Lane *lanes, bool inner)
+    {
+        for (auto j = 0U; j < N; ++j)
+        {
+            std::uint32_t state[5];
+            std::memcpy(state, inner ? lanes[j].inner : lanes[j].outer, sizeof(state));
+            for (auto k = 0U; k < 5; ++k)
+            {
+                s[k][j] = state[k];
+            }
+        }
+    }
+
+    // HMAC-SHA1 of N lanes at once
+    template<typename V, std::size_t N>
+    __attribute__((always_inline)) inline void hmac_sha1_lanes(HmacSha1Lane *lanes)
+    {
+        const V zero = {};
+        V s[5], w[16];
+
+        // inner hash: H(K ^ ipad || value)
+        load_states<V, N>(s, lanes, true);
+        for (auto j = 0U; j < N; ++j)
+        {
+            w[0][j] = load_be<std::uint32_t>(lanes[j].value);
+            w[1][j] = load_be<std::uint32_t>(lanes[j].value + 4);
+        }
+        w[2] = zero + 0x80000000U;
+        for (auto k = 3U; k < 15; ++k) w[k] = zero;
+        w[15] = zero + INNER_BITS;
+        sha1_compress(s, w);
+
+        // outer hash: H(K ^ opad || inner)
+        for (auto k = 0U; k < 5; ++k) w[k] = s[k];
+        w[5] = zero + 0x80000000U;
+        for (auto k = 6U; k < 15; ++k) w[k] = zero;
+        w[15] = zero + OUTER_BITS;
+        load_states<V, N>(s, lanes, false);
+        sha1_compress(s, w);
+
+        for (auto j = 0U; j < N; ++j)
+        {
+            for (auto k = 0U; k < 5; ++k)
+            {
+                store_be<std::uint32_t>(s[k][j], lanes[j].digest + k * 4);
+            }
+        }
+    }
+
+#ifdef OTPGEN_SHA1_MB_X86
+    __attribute__((target("avx512f")))
+    static void hmac_sha1_x16(HmacSha1Lane *lanes)
+    {
+        hmac_sha1_lanes<u32x16, 16>(lanes);
+    }
+
+    __attribute__((target("avx2")))
+    static void hmac_sha1_x8(HmacSha1Lane *lanes)
+    {
+        hmac_sha1_lanes<u32x8, 8>(lanes);
+    }
+#endif
+
+    // SSE2 is part of the x86-64 baseline, NEON is mandatory on AArch64,
+    // SIMD128 is enabled for the whole WebAssembly module
+    static void hmac_sha1_x4(HmacSha1Lane *lanes)
+    {
+        hmac_sha1_lanes<u32x4, 4>(lanes);
+    }
+
+    static void hmac_sha1_x1(HmacSha1Lane *lane)
+    {
+        hmac_compute_helper<CryptoPP::SHA1>(lane->inner, lane->outer, lane->value, lane->digest);
+    }
+
+    static bool backend_supported(const Sha1MultiBufferBackend &backend)
+    {
+        switch (backend)
+        {
+            case Sha1MultiBufferBackend::Scalar:
+                return true;
+#ifdef OTPGEN_SHA1_MB_X86
+            case Sha1MultiBufferBackend::SSE2:
+                return __builtin_cpu_supports("sse2");
+            case Sha1MultiBufferBackend::AVX2:
+                return __builtin_cpu_supports("avx2");
+            case Sha1MultiBufferBackend::AVX512:
+                return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef OTPGEN_SHA1_MB_NEON
+            case Sha1MultiBufferBackend::NEON:
+                return true;
+#endif
+#ifdef OTPGEN_SHA1_MB_WASM_SIMD
+            case Sha1MultiBufferBackend::WasmSIMD128:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    static Sha1MultiBufferBackend detect_backend()
+    {
+        for (auto&& backend : {Sha1MultiBufferBackend::AVX512,
+                               Sha1MultiBufferBackend::AVX2,
+                               Sha1MultiBufferBackend::SSE2,
+                               Sha1MultiBufferBackend::NEON,
+                               Sha1MultiBufferBackend::WasmSIMD128})
+        {
+            if (backend_supported(backend))
+            {
+                return backend;
+            }
+        }
+        return Sha1MultiBufferBackend::Scalar;
+    }
+
+    // constant initialized, the detection runs on first use without any
+    // static initialization guard, concurrent detections store the same value
+    static std::atomic<int> selected_backend{-1};
+
+    static Sha1MultiBufferBackend active_backend()
+    {
+        auto backend = selected_backend.load(std::memory_order_relaxed);
+        if (backend < 0)
+        {
+            backend = static_cast<int>(detect_backend());
+            selected_backend.store(backend, std::memory_order_relaxed);
+        }
+        return static_cast<Sha1MultiBufferBackend>(backend);
+    }
+}
+
+Sha1MultiBufferBackend sha1MultiBufferBackend()
+{
+    return active_backend();
+}
+
+std::size_t sha1MultiBufferLanes()
+{
+    switch (sha1MultiBufferBackend())
+    {
+        case Sha1MultiBufferBackend::Scalar: return 1U;
+        case Sha1MultiBufferBackend::SSE2:   return 4U;
+        case Sha1MultiBufferBackend::AVX2:   return 8U;
+        case Sha1MultiBufferBackend::AVX512: return 16U;
+        case Sha1MultiBufferBackend::NEON:   return 4U;
+        case Sha1MultiBufferBackend::WasmSIMD128: return 4U;
+    }
+    return 1U;
+}
+
+bool setSha1MultiBufferBackend(const Sha1MultiBufferBackend &backend)
+{
+    if (!backend_supported(backend))
+    {
+        return false;
+    }
+
+    selected_backend.store(static_cast<int>(backend), std::memory_order_relaxed);
+    return true;
+}
+
+void hmacSha1MultiBuffer(HmacSha1Lane *lanes, std::size_t count)
+{
+    const auto width = sha1MultiBufferLanes();
+
+    // use the widest kernel first, the remaining lanes go to the narrower ones
+#ifdef OTPGEN_SHA1_MB_X86
+    if (width >= 16)
+    {
+        for (; count >= 16; lanes += 16, count -= 16)
+        {
+            hmac_sha1_x16(lanes);
+        }
+    }
+    if (width >= 8)
+    {
+        for (; count >= 8; lanes += 8, count -= 8)
+        {
+            hmac_sha1_x8(lanes);
+        }
+    }
+#endif
+    if (width >= 4)
+    {
+        for (; count >= 4; lanes += 4, count -= 4)
+        {
+            hmac_sha1_x4(lanes);
+        }
+    }
+    for (; count > 0; ++lanes, --count)
+    {
+        hmac_sha1_x1(lanes);
+    }
+}
+
+}
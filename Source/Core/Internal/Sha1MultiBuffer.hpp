@@ -0,0 +1,54 @@
+#ifndef INTERNAL_SHA1MULTIBUFFER_HPP
+#define INTERNAL_SHA1MULTIBUFFER_HPP
+
+// multi-buffer HMAC-SHA1 for prepared keys
+//
+// hashes 4, 8 or 16 independent messages at once, one message per SIMD lane,
+// the lane width is selected at runtime depending on the CPU features
+//
+//  -> 16 lanes: AVX-512 (x86)
+//  ->  8 lanes: AVX2 (x86)
+//  ->  4 lanes: SSE2 (x86) / NEON (ARM) / SIMD128 (WebAssembly, -msimd128)
+//  ->  1 lane:  scalar fallback, same code path as the single token generators
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Internal {
+
+// one HMAC-SHA1 computation
+struct HmacSha1Lane
+{
+    // precomputed key states, see OTPKey::innerState() and OTPKey::outerState()
+    const unsigned char *inner;
+    const unsigned char *outer;
+
+    // 8 byte big endian counter
+    unsigned char value[8];
+
+    // resulting HMAC
+    unsigned char digest[20];
+};
+
+enum class Sha1MultiBufferBackend {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512,
+    NEON,
+    WasmSIMD128,
+};
+
+// backend selected for this CPU and its amount of lanes
+Sha1MultiBufferBackend sha1MultiBufferBackend();
+std::size_t sha1MultiBufferLanes();
+
+// force a specific backend, returns false if the CPU doesn't support it
+bool setSha1MultiBufferBackend(const Sha1MultiBufferBackend &backend);
+
+// compute the HMAC of all given lanes
+void hmacSha1MultiBuffer(HmacSha1Lane *lanes, std::size_t count);
+
+}
+
+#endif // INTERNAL_SHA1MULTIBUFFER_HPP
@@ -0,0 +1,352 @@
+#include "Sha2MultiBuffer.hpp"
+
+#include "Sha1MultiBuffer.hpp"
+#include "Hmac.hpp"
+
+#include <cstring>
+
+#include <cryptopp/sha.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OTPGEN_SHA2_MB_X86
+#endif
+
+namespace Internal {
+
+namespace {
+    // portable SIMD vectors (GCC/Clang vector extensions), see Sha1MultiBuffer.cpp
+    typedef std::uint32_t u32x4 __attribute__((vector_size(16)));
+    typedef std::uint32_t u32x8 __attribute__((vector_size(32)));
+    typedef std::uint32_t u32x16 __attribute__((vector_size(64)));
+    typedef std::uint64_t u64x2 __attribute__((vector_size(16)));
+    typedef std::uint64_t u64x4 __attribute__((vector_size(32)));
+    typedef std::uint64_t u64x8 __attribute__((vector_size(64)));
+
+    static const constexpr std::uint32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    static const constexpr std::uint64_t SHA512_K[80] = {
+        0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+        0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+        0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+        0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+        0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+        0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+        0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+        0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+        0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+        0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+        0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+        0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+        0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+        0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+        0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+        0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+        0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+        0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+        0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+        0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+    };
+
+    // message length in bits of the inner (ipad block + counter) and
+    // outer (opad block + inner digest) messages
+    static const constexpr std::uint32_t SHA256_INNER_BITS = (64 + 8) * 8;
+    static const constexpr std::uint32_t SHA256_OUTER_BITS = (64 + 32) * 8;
+    static const constexpr std::uint64_t SHA512_INNER_BITS = (128 + 8) * 8;
+    static const constexpr std::uint64_t SHA512_OUTER_BITS = (128 + 64) * 8;
+
+    // no helper function to avoid passing vectors by value outside of the target code
+    #define SHA2_MB_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+    #define SHA2_MB_ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+    // SHA-256 compression function over one block per lane, the state is updated in place
+    template<typename V>
+    __attribute__((always_inline)) inline void sha256_compress(V *s, V *w)
+    {
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+        for (auto t = 0; t < 64; ++t)
+        {
+            if (t >= 16)
+            {
+                const V w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+                w[t & 15] += (SHA2_MB_ROTR32(w2, 17) ^ SHA2_MB_ROTR32(w2, 19) ^ (w2 >> 10)) + w[(t - 7) & 15] +
+                             (SHA2_MB_ROTR32(w15, 7) ^ SHA2_MB_ROTR32(w15, 18) ^ (w15 >> 3));
+            }
+
+            const V t1 = h + (SHA2_MB_ROTR32(e, 6) ^ SHA2_MB_ROTR32(e, 11) ^ SHA2_MB_ROTR32(e, 25)) +
+                         (g ^ (e & (f ^ g))) + SHA256_K[t] + w[t & 15];
+            const V t2 = (SHA2_MB_ROTR32(a, 2) ^ SHA2_MB_ROTR32(a, 13) ^ SHA2_MB_ROTR32(a, 22)) +
+                         ((a & b) | (c & (a | b)));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+        s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+    }
+
+    // SHA-512 compression function over one block per lane
+    template<typename V>
+    __attribute__((always_inline)) inline void sha512_compress(V *s, V *w)
+    {
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+        for (auto t = 0; t < 80; ++t)
+        {
+            if (t >= 16)
+            {
+                const V w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+                w[t & 15] += (SHA2_MB_ROTR64(w2, 19) ^ SHA2_MB_ROTR64(w2, 61) ^ (w2 >> 6)) + w[(t - 7) & 15] +
+                             (SHA2_MB_ROTR64(w15, 1) ^ SHA2_MB_ROTR64(w15, 8) ^ (w15 >> 7));
+            }
+
+            const V t1 = h + (SHA2_MB_ROTR64(e, 14) ^ SHA2_MB_ROTR64(e, 18) ^ SHA2_MB_ROTR64(e, 41)) +
+                         (g ^ (e & (f ^ g))) + SHA512_K[t] + w[t & 15];
+            const V t2 = (SHA2_MB_ROTR64(a, 28) ^ SHA2_MB_ROTR64(a, 34) ^ SHA2_MB_ROTR64(a, 39)) +
+                         ((a & b) | (c & (a | b)));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+        s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+    }
+
+    #undef SHA2_MB_ROTR32
+    #undef SHA2_MB_ROTR64
+
+    // load the precomputed key state of every lane into the vectors
+    template<typename V, typename Word, std::size_t N, typename Lane>
+    __attribute__((always_inline)) inline void load_states(V *s, const Lane *lanes, bool inner)
+    {
+        for (auto j = 0U; j < N; ++j)
+        {
+            Word state[8];
+            std::memcpy(state, inner ? lanes[j].inner : lanes[j].outer, sizeof(state));
+            for (auto k = 0U; k < 8; ++k)
+            {
+                s[k][j] = state[k];
+            }
+        }
+    }
+
+    // HMAC-SHA256 of N lanes at once
+    template<typename V, std::size_t N>
+    __attribute__((always_inline)) inline void hmac_sha256_lanes(HmacSha256Lane *lanes)
+    {
+        const V zero = {};
+        V s[8], w[16];
+
+        // inner hash: H(K ^ ipad || value)
+        load_states<V, std::uint32_t, N>(s, lanes, true);
+        for (auto j = 0U; j < N; ++j)
+        {
+            w[0][j] = load_be<std::uint32_t>(lanes[j].value);
+            w[1][j] = load_be<std::uint32_t>(lanes[j].value + 4);
+        }
+        w[2] = zero + 0x80000000U;
+        for (auto k = 3U; k < 15; ++k) w[k] = zero;
+        w[15] = zero + SHA256_INNER_BITS;
+        sha256_compress(s, w);
+
+        // outer hash: H(K ^ opad || inner)
+        for (auto k = 0U; k < 8; ++k) w[k] = s[k];
+        w[8] = zero + 0x80000000U;
+        for (auto k = 9U; k < 15; ++k) w[k] = zero;
+        w[15] = zero + SHA256_OUTER_BITS;
+        load_states<V, std::uint32_t, N>(s, lanes, false);
+        sha256_compress(s, w);
+
+        for (auto j = 0U; j < N; ++j)
+        {
+            for (auto k = 0U; k < 8; ++k)
+            {
+                store_be<std::uint32_t>(s[k][j], lanes[j].digest + k * 4);
+            }
+        }
+    }
+
+    // HMAC-SHA512 of N lanes at once
+    template<typename V, std::size_t N>
+    __attribute__((always_inline)) inline void hmac_sha512_lanes(HmacSha512Lane *lanes)
+    {
+        const V zero = {};
+        V s[8], w[16];
+
+        // inner hash: H(K ^ ipad || value)
+        load_states<V, std::uint64_t, N>(s, lanes, true);
+        for (auto j = 0U; j < N; ++j)
+        {
+            w[0][j] = load_be<std::uint64_t>(lanes[j].value);
+        }
+        w[1] = zero + 0x8000000000000000ULL;
+        for (auto k = 2U; k < 15; ++k) w[k] = zero;
+        w[15] = zero + SHA512_INNER_BITS;
+        sha512_compress(s, w);
+
+        // outer hash: H(K ^ opad || inner)
+        for (auto k = 0U; k < 8; ++k) w[k] = s[k];
+        w[8] = zero + 0x8000000000000000ULL;
+        for (auto k = 9U; k < 15; ++k) w[k] = zero;
+        w[15] = zero + SHA512_OUTER_BITS;
+        load_states<V, std::uint64_t, N>(s, lanes, false);
+        sha512_compress(s, w);
+
+        for (auto j = 0U; j < N; ++j)
+        {
+            for (auto k = 0U; k < 8; ++k)
+            {
+                store_be<std::uint64_t>(s[k][j], lanes[j].digest + k * 8);
+            }
+        }
+    }
+
+#ifdef OTPGEN_SHA2_MB_X86
+    __attribute__((target("avx512f")))
+    static void hmac_sha256_x16(HmacSha256Lane *lanes)
+    {
+        hmac_sha256_lanes<u32x16, 16>(lanes);
+    }
+
+    __attribute__((target("avx2")))
+    static void hmac_sha256_x8(HmacSha256Lane *lanes)
+    {
+        hmac_sha256_lanes<u32x8, 8>(lanes);
+    }
+
+    __attribute__((target("avx512f")))
+    static void hmac_sha512_x8(HmacSha512Lane *lanes)
+    {
+        hmac_sha512_lanes<u64x8, 8>(lanes);
+    }
+
+    __attribute__((target("avx2")))
+    static void hmac_sha512_x4(HmacSha512Lane *lanes)
+    {
+        hmac_sha512_lanes<u64x4, 4>(lanes);
+    }
+#endif
+
+    // baseline vector width on every platform with a SIMD backend
+    static void hmac_sha256_x4(HmacSha256Lane *lanes)
+    {
+        hmac_sha256_lanes<u32x4, 4>(lanes);
+    }
+
+    static void hmac_sha512_x2(HmacSha512Lane *lanes)
+    {
+        hmac_sha512_lanes<u64x2, 2>(lanes);
+    }
+
+    static void hmac_sha256_x1(HmacSha256Lane *lane)
+    {
+        hmac_compute_helper<CryptoPP::SHA256>(lane->inner, lane->outer, lane->value, lane->digest);
+    }
+
+    static void hmac_sha512_x1(HmacSha512Lane *lane)
+    {
+        hmac_compute_helper<CryptoPP::SHA512>(lane->inner, lane->outer, lane->value, lane->digest);
+    }
+}
+
+std::size_t sha256MultiBufferLanes()
+{
+    return sha1MultiBufferLanes();
+}
+
+std::size_t sha512MultiBufferLanes()
+{
+    // the vectors hold half as many 64-bit words
+    const auto lanes = sha1MultiBufferLanes();
+    return lanes > 1U ? lanes / 2U : 1U;
+}
+
+void hmacSha256MultiBuffer(HmacSha256Lane *lanes, std::size_t count)
+{
+    const auto width = sha256MultiBufferLanes();
+
+    // use the widest kernel first, the remaining lanes go to the narrower ones
+#ifdef OTPGEN_SHA2_MB_X86
+    if (width >= 16)
+    {
+        for (; count >= 16; lanes += 16, count -= 16)
+        {
+            hmac_sha256_x16(lanes);
+        }
+    }
+    if (width >= 8)
+    {
+        for (; count >= 8; lanes += 8, count -= 8)
+        {
+            hmac_sha256_x8(lanes);
+        }
+    }
+#endif
+    if (width >= 4)
+    {
+        for (; count >= 4; lanes += 4, count -= 4)
+        {
+            hmac_sha256_x4(lanes);
+        }
+    }
+    for (; count > 0; ++lanes, --count)
+    {
+        hmac_sha256_x1(lanes);
+    }
+}
+
+void hmacSha512MultiBuffer(HmacSha512Lane *lanes, std::size_t count)
+{
+    const auto width = sha512MultiBufferLanes();
+
+#ifdef OTPGEN_SHA2_MB_X86
+    if (width >= 8)
+    {
+        for (; count >= 8; lanes += 8, count -= 8)
+        {
+            hmac_sha512_x8(lanes);
+        }
+    }
+    if (width >= 4)
+    {
+        for (; count >= 4; lanes += 4, count -= 4)
+        {
+            hmac_sha512_x4(lanes);
+        }
+    }
+#endif
+    if (width >= 2)
+    {
+        for (; count >= 2; lanes += 2, count -= 2)
+        {
+            hmac_sha512_x2(lanes);
+        }
+    }
+    for (; count > 0; ++lanes, --count)
+    {
+        hmac_sha512_x1(lanes);
+    }
+}
+
+}
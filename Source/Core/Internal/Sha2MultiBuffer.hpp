@@ -0,0 +1,52 @@
+#ifndef INTERNAL_SHA2MULTIBUFFER_HPP
+#define INTERNAL_SHA2MULTIBUFFER_HPP
+
+// multi-buffer HMAC-SHA256 and HMAC-SHA512 for prepared keys
+//
+// same approach as Sha1MultiBuffer.hpp: one message per SIMD lane, using the
+// backend selected there, SHA-256 works on 32-bit lanes and SHA-512 on 64-bit lanes
+//
+//  -> AVX-512 (x86):                                   16 SHA-256 / 8 SHA-512 lanes
+//  -> AVX2 (x86):                                       8 SHA-256 / 4 SHA-512 lanes
+//  -> SSE2 (x86) / NEON (ARM) / SIMD128 (WebAssembly):  4 SHA-256 / 2 SHA-512 lanes
+//  -> scalar fallback, same code path as the single token generators
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Internal {
+
+// one HMAC-SHA256 computation
+struct HmacSha256Lane
+{
+    // precomputed key states, see OTPKey::innerState() and OTPKey::outerState()
+    const unsigned char *inner;
+    const unsigned char *outer;
+
+    // 8 byte big endian counter
+    unsigned char value[8];
+
+    // resulting HMAC
+    unsigned char digest[32];
+};
+
+// one HMAC-SHA512 computation
+struct HmacSha512Lane
+{
+    const unsigned char *inner;
+    const unsigned char *outer;
+    unsigned char value[8];
+    unsigned char digest[64];
+};
+
+// amount of lanes of the selected backend
+std::size_t sha256MultiBufferLanes();
+std::size_t sha512MultiBufferLanes();
+
+// compute the HMAC of all given lanes
+void hmacSha256MultiBuffer(HmacSha256Lane *lanes, std::size_t count);
+void hmacSha512MultiBuffer(HmacSha512Lane *lanes, std::size_t count);
+
+}
+
+#endif // INTERNAL_SHA2MULTIBUFFER_HPP
@@ -0,0 +1,378 @@
+#include "ShaCompress.hpp"
+
+#include <atomic>
+#include <utility>
+
+#include <cryptopp/sha.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OTPGEN_SHA_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#define OTPGEN_SHANI_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__)
+#define OTPGEN_SHA_ARMV8
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#if defined(__clang__)
+#define OTPGEN_ARMV8_TARGET __attribute__((target("crypto")))
+#else
+#define OTPGEN_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
+namespace Internal {
+
+namespace {
+    alignas(16) static const constexpr std::uint32_t SHA256_K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    // crypto++ transform functions, expect the message as native words
+    template<class Hash>
+    static void portable_compress(std::uint32_t *state, const unsigned char *block)
+    {
+        alignas(16) CryptoPP::word32 data[16];
+        for (auto i = 0U; i < 16; ++i)
+        {
+            data[i] = (static_cast<CryptoPP::word32>(block[i * 4]) << 24) |
+                      (static_cast<CryptoPP::word32>(block[i * 4 + 1]) << 16) |
+                      (static_cast<CryptoPP::word32>(block[i * 4 + 2]) << 8) |
+                      (static_cast<CryptoPP::word32>(block[i * 4 + 3]));
+        }
+        Hash::Transform(state, data);
+    }
+
+#ifdef OTPGEN_SHA_X86
+    static bool cpu_has_shani()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1))
+        {
+            return false;
+        }
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        {
+            return false;
+        }
+        return (ebx & bit_SHA) != 0;
+    }
+
+    // the SHA extensions have no VEX encoding, see clearUpperState()
+    __attribute__((target("avx")))
+    static void zero_upper()
+    {
+        _mm256_zeroupper();
+    }
+
+    // 4 rounds of SHA-1, the message registers are rotated between the groups
+    template<int G>
+    OTPGEN_SHANI_TARGET __attribute__((always_inline))
+    inline void sha1_shani_group(__m128i &abcd, __m128i *e, __m128i *msg)
+    {
+        const auto cur = msg[G % 4];
+
+        if constexpr (G == 0) e[0] = _mm_add_epi32(e[0], cur);
+        else                  e[G % 2] = _mm_sha1nexte_epu32(e[G % 2], cur);
+        e[(G + 1) % 2] = abcd;
+
+        if constexpr (G >= 3 && G <= 18) msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], cur);
+        abcd = _mm_sha1rnds4_epu32(abcd, e[G % 2], G / 5);
+        if constexpr (G >= 1 && G <= 16) msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], cur);
+        if constexpr (G >= 2 && G <= 17) msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], cur);
+    }
+
+    template<int... G>
+    OTPGEN_SHANI_TARGET __attribute__((always_inline))
+    inline void sha1_shani_rounds(std::integer_sequence<int, G...>, __m128i &abcd, __m128i *e, __m128i *msg)
+    {
+        (sha1_shani_group<G>(abcd, e, msg), ...);
+    }
+
+    OTPGEN_SHANI_TARGET
+    static void sha1_shani(std::uint32_t *state, const unsigned char *block)
+    {
+        const auto mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+        auto abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+        __m128i e[2] = {_mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0), _mm_setzero_si128()};
+
+        const auto abcd_save = abcd;
+        const auto e_save = e[0];
+
+        __m128i msg[4];
+        for (auto i = 0; i < 4; ++i)
+        {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16)), mask);
+        }
+
+        sha1_shani_rounds(std::make_integer_sequence<int, 20>(), abcd, e, msg);
+
+        e[0] = _mm_sha1nexte_epu32(e[0], e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+        state[4] = static_cast<std::uint32_t>(_mm_extract_epi32(e[0], 3));
+    }
+
+    // 4 rounds of SHA-256, the message registers are rotated between the groups
+    template<int G>
+    OTPGEN_SHANI_TARGET __attribute__((always_inline))
+    inline void sha256_shani_group(__m128i &state0, __m128i &state1, __m128i *msg)
+    {
+        const auto cur = msg[G % 4];
+
+        auto m = _mm_add_epi32(cur, _mm_load_si128(reinterpret_cast<const __m128i*>(SHA256_K + G * 4)));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+        if constexpr (G >= 3 && G <= 14)
+        {
+            const auto tmp = _mm_alignr_epi8(cur, msg[(G + 3) % 4], 4);
+            msg[(G + 1) % 4] = _mm_sha256msg2_epu32(_mm_add_epi32(msg[(G + 1) % 4], tmp), cur);
+        }
+        m = _mm_shuffle_epi32(m, 0x0E);
+        state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+        if constexpr (G >= 1 && G <= 12) msg[(G + 3) % 4] = _mm_sha256msg1_epu32(msg[(G + 3) % 4], cur);
+    }
+
+    template<int... G>
+    OTPGEN_SHANI_TARGET __attribute__((always_inline))
+    inline void sha256_shani_rounds(std::integer_sequence<int, G...>, __m128i &state0, __m128i &state1, __m128i *msg)
+    {
+        (sha256_shani_group<G>(state0, state1, msg), ...);
+    }
+
+    OTPGEN_SHANI_TARGET
+    static void sha256_shani(std::uint32_t *state, const unsigned char *block)
+    {
+        const auto mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+        // ABCD EFGH -> ABEF CDGH as expected by the instructions
+        auto tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+        auto state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+        auto state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+        const auto state0_save = state0;
+        const auto state1_save = state1;
+
+        __m128i msg[4];
+        for (auto i = 0; i < 4; ++i)
+        {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16)), mask);
+        }
+
+        sha256_shani_rounds(std::make_integer_sequence<int, 16>(), state0, state1, msg);
+
+        state0 = _mm_add_epi32(state0, state0_save);
+        state1 = _mm_add_epi32(state1, state1_save);
+
+        // ABEF CDGH -> ABCD EFGH
+        tmp = _mm_shuffle_epi32(state0, 0x1B);
+        state1 = _mm_shuffle_epi32(state1, 0xB1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(tmp, state1, 0xF0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+    }
+#endif
+
+#ifdef OTPGEN_SHA_ARMV8
+    static bool cpu_has_armv8_sha()
+    {
+#if defined(__linux__)
+        const auto hwcap = getauxval(AT_HWCAP);
+        return (hwcap & HWCAP_SHA1) && (hwcap & HWCAP_SHA2);
+#elif defined(__APPLE__)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    OTPGEN_ARMV8_TARGET
+    static void sha1_armv8(std::uint32_t *state, const unsigned char *block)
+    {
+        static const constexpr std::uint32_t K[] = {
+            0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6,
+        };
+
+        auto abcd = vld1q_u32(state);
+        auto e = state[4];
+
+        const auto abcd_save = abcd;
+        const auto e_save = e;
+
+        uint32x4_t msg[4];
+        for (auto i = 0; i < 4; ++i)
+        {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + i * 16)));
+        }
+
+        for (auto g = 0; g < 20; ++g)
+        {
+            const auto tmp = vaddq_u32(msg[g % 4], vdupq_n_u32(K[g / 5]));
+            const auto e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+            if (g < 5)       abcd = vsha1cq_u32(abcd, e, tmp);
+            else if (g < 10) abcd = vsha1pq_u32(abcd, e, tmp);
+            else if (g < 15) abcd = vsha1mq_u32(abcd, e, tmp);
+            else             abcd = vsha1pq_u32(abcd, e, tmp);
+            e = e_next;
+
+            // message schedule for the block used 4 groups later
+            if (g < 16)
+            {
+                msg[g % 4] = vsha1su1q_u32(vsha1su0q_u32(msg[g % 4], msg[(g + 1) % 4], msg[(g + 2) % 4]), msg[(g + 3) % 4]);
+            }
+        }
+
+        vst1q_u32(state, vaddq_u32(abcd, abcd_save));
+        state[4] = e + e_save;
+    }
+
+    OTPGEN_ARMV8_TARGET
+    static void sha256_armv8(std::uint32_t *state, const unsigned char *block)
+    {
+        auto state0 = vld1q_u32(state);
+        auto state1 = vld1q_u32(state + 4);
+
+        const auto state0_save = state0;
+        const auto state1_save = state1;
+
+        uint32x4_t msg[4];
+        for (auto i = 0; i < 4; ++i)
+        {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(block + i * 16)));
+        }
+
+        for (auto g = 0; g < 16; ++g)
+        {
+            const auto tmp = vaddq_u32(msg[g % 4], vld1q_u32(SHA256_K + g * 4));
+            const auto abcd = state0;
+            state0 = vsha256hq_u32(state0, state1, tmp);
+            state1 = vsha256h2q_u32(state1, abcd, tmp);
+
+            // message schedule for the block used 4 groups later
+            if (g < 12)
+            {
+                msg[g % 4] = vsha256su1q_u32(vsha256su0q_u32(msg[g % 4], msg[(g + 1) % 4]), msg[(g + 2) % 4], msg[(g + 3) % 4]);
+            }
+        }
+
+        vst1q_u32(state, vaddq_u32(state0, state0_save));
+        vst1q_u32(state + 4, vaddq_u32(state1, state1_save));
+    }
+#endif
+
+    static bool backend_supported(const ShaBackend &backend)
+    {
+        switch (backend)
+        {
+            case ShaBackend::Portable:
+                return true;
+#ifdef OTPGEN_SHA_X86
+            case ShaBackend::SHANI:
+                return cpu_has_shani();
+#endif
+#ifdef OTPGEN_SHA_ARMV8
+            case ShaBackend::ARMv8:
+                return cpu_has_armv8_sha();
+#endif
+            default:
+                return false;
+        }
+    }
+
+    static ShaBackend detect_backend()
+    {
+        for (auto&& backend : {ShaBackend::SHANI, ShaBackend::ARMv8})
+        {
+            if (backend_supported(backend))
+            {
+                return backend;
+            }
+        }
+        return ShaBackend::Portable;
+    }
+
+    // constant initialized, the detection runs on first use without any
+    // static initialization guard, concurrent detections store the same value
+    static std::atomic<int> selected_backend{-1};
+
+    static ShaBackend active_backend()
+    {
+        auto backend = selected_backend.load(std::memory_order_relaxed);
+        if (backend < 0)
+        {
+            backend = static_cast<int>(detect_backend());
+            selected_backend.store(backend, std::memory_order_relaxed);
+        }
+        return static_cast<ShaBackend>(backend);
+    }
+}
+
+ShaBackend shaBackend()
+{
+    return active_backend();
+}
+
+bool setShaBackend(const ShaBackend &backend)
+{
+    if (!backend_supported(backend))
+    {
+        return false;
+    }
+
+    selected_backend.store(static_cast<int>(backend), std::memory_order_relaxed);
+    return true;
+}
+
+void clearUpperState()
+{
+#ifdef OTPGEN_SHA_X86
+    if (__builtin_cpu_supports("avx"))
+    {
+        zero_upper();
+    }
+#endif
+}
+
+void sha1Compress(std::uint32_t *state, const unsigned char *block)
+{
+    switch (shaBackend())
+    {
+#ifdef OTPGEN_SHA_X86
+        case ShaBackend::SHANI: clearUpperState(); sha1_shani(state, block); return;
+#endif
+#ifdef OTPGEN_SHA_ARMV8
+        case ShaBackend::ARMv8: sha1_armv8(state, block); return;
+#endif
+        default: portable_compress<CryptoPP::SHA1>(state, block); return;
+    }
+}
+
+void sha256Compress(std::uint32_t *state, const unsigned char *block)
+{
+    switch (shaBackend())
+    {
+#ifdef OTPGEN_SHA_X86
+        case ShaBackend::SHANI: clearUpperState(); sha256_shani(state, block); return;
+#endif
+#ifdef OTPGEN_SHA_ARMV8
+        case ShaBackend::ARMv8: sha256_armv8(state, block); return;
+#endif
+        default: portable_compress<CryptoPP::SHA256>(state, block); return;
+    }
+}
+
+}
@@ -0,0 +1,39 @@
+#ifndef INTERNAL_SHACOMPRESS_HPP
+#define INTERNAL_SHACOMPRESS_HPP
+
+// SHA-1 and SHA-256 compression functions with hardware acceleration
+//
+// the backend is selected at runtime depending on the CPU features
+//
+//  -> SHANI:    Intel SHA extensions (x86)
+//  -> ARMv8:    ARMv8 cryptography extensions (AArch64)
+//  -> Portable: static transform functions of crypto++
+
+#include <cstdint>
+
+namespace Internal {
+
+enum class ShaBackend {
+    Portable,
+    SHANI,
+    ARMv8,
+};
+
+// backend selected for this CPU
+ShaBackend shaBackend();
+
+// force a specific backend, returns false if the CPU doesn't support it
+bool setShaBackend(const ShaBackend &backend);
+
+// legacy SSE instructions (SHA extensions, crypto++ transforms) are very slow while
+// the upper halves of the AVX registers are dirty, which AVX code elsewhere in the
+// process can leave behind, this clears them on CPUs with AVX and is a no-op otherwise
+void clearUpperState();
+
+// compress a single 64 byte block (big endian message) into the state (native word order)
+void sha1Compress(std::uint32_t *state, const unsigned char *block);
+void sha256Compress(std::uint32_t *state, const unsigned char *block);
+
+}
+
+#endif // INTERNAL_SHACOMPRESS_HPP
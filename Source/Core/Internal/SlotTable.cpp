@@ -0,0 +1,76 @@
+#include "SlotTable.hpp"
+
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SLOTTABLE_MMAP
+#include <sys/mman.h>
+#endif
+
+namespace {
+    // the slots of a shared table are used by other processes, their atomics must not need a lock
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the slots must be lock-free");
+
+    static inline std::size_t round_capacity(const std::size_t &capacity, const std::size_t &minimum) noexcept
+    {
+        auto size = minimum;
+        while (size < capacity)
+        {
+            size <<= 1U;
+        }
+        return size;
+    }
+}
+
+namespace Internal {
+
+SlotTable::SlotTable(const std::size_t &capacity, const std::size_t &minimum, const Placement &placement)
+    : _capacity(round_capacity(capacity, minimum))
+{
+#ifdef SLOTTABLE_MMAP
+    if (placement == Shared)
+    {
+        const auto data = ::mmap(nullptr, _capacity * sizeof(Slot), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+        _slots = static_cast<Slot*>(data);
+        for (auto i = 0U; i < _capacity; ++i)
+        {
+            new (&_slots[i]) Slot(0U);
+        }
+        _mapped = true;
+    }
+#else
+    (void) placement;
+#endif
+    if (!_slots)
+    {
+        _slots = new Slot[_capacity];
+    }
+    clear();
+}
+
+SlotTable::~SlotTable()
+{
+#ifdef SLOTTABLE_MMAP
+    if (_mapped)
+    {
+        (void) ::munmap(_slots, _capacity * sizeof(Slot));
+        return;
+    }
+#endif
+    delete[] _slots;
+}
+
+void SlotTable::clear() noexcept
+{
+    for (auto i = 0U; i < _capacity; ++i)
+    {
+        _slots[i].store(0U, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+}
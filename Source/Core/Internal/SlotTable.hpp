@@ -0,0 +1,113 @@
+#ifndef INTERNAL_SLOTTABLE_HPP
+#define INTERNAL_SLOTTABLE_HPP
+
+// fixed array of atomic 64-bit slots, the storage of the lock-free tables keyed by token
+// (UsedCodeStore, RateLimiter, CodeCoalescer)
+//
+// every user packs a fingerprint of its key and its value into one word, 0 is a free slot;
+// the table only hashes keys, allocates the slots and hands out where a key may be:
+//
+//  -> probe(): PROBE_LENGTH slots within the SHARD_SIZE slots (two cache lines of probes)
+//              selected by the hash, for tables which search a few slots per key
+//  -> slot():  the single slot of the hash, for direct mapped tables
+//
+// shared slots are in a shared anonymous mapping, processes forked after the construction
+// use the same slots; where there is no mmap the slots are always private
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Internal {
+
+class SlotTable final
+{
+public:
+    using Slot = std::atomic<std::uint64_t>;
+
+    enum Placement {
+        Private = 0,
+        Shared,
+    };
+
+    static const constexpr std::size_t SHARD_SIZE = 256U;
+    static const constexpr std::size_t PROBE_LENGTH = 16U;
+
+    // the capacity is rounded up to a power of 2 of at least minimum slots, all slots are free
+    SlotTable(const std::size_t &capacity, const std::size_t &minimum, const Placement &placement = Private);
+    ~SlotTable();
+
+    SlotTable(const SlotTable&) = delete;
+    SlotTable &operator= (const SlotTable&) = delete;
+
+    // splitmix64 finalizer
+    static inline std::uint64_t mix(std::uint64_t x) noexcept
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // hash of a token and of a (token, time step) pair
+    static inline std::uint64_t hash(const std::int64_t &id) noexcept
+    { return mix(static_cast<std::uint64_t>(id)); }
+    static inline std::uint64_t hash(const std::int64_t &id, const std::uint64_t &step) noexcept
+    { return mix(static_cast<std::uint64_t>(id) ^ mix(step + 0x9e3779b97f4a7c15ULL)); }
+
+    // the probe sequence of a hash, the low bits select the shard, the high bits the first slot
+    class Probe
+    {
+    public:
+        inline Slot &operator[] (const std::size_t &probe) const noexcept
+        { return _shard[(_first + probe) & (SHARD_SIZE - 1U)]; }
+
+    private:
+        friend class SlotTable;
+        inline Probe(Slot *shard, const std::size_t &first) noexcept
+            : _shard(shard), _first(first)
+        { }
+
+        Slot *_shard;
+        std::size_t _first;
+    };
+
+    inline Probe probe(const std::uint64_t &h) const noexcept
+    { return Probe(_slots + (h & (_capacity / SHARD_SIZE - 1U)) * SHARD_SIZE, static_cast<std::size_t>(h >> 40U)); }
+
+    // the low bits of the hash select the slot
+    inline Slot &slot(const std::uint64_t &h) const noexcept
+    { return _slots[static_cast<std::size_t>(h) & (_capacity - 1U)]; }
+
+    // amount of slots the predicate holds for, scans all slots without blocking the users
+    template<typename Predicate>
+    std::size_t count(const Predicate &predicate) const noexcept
+    {
+        std::size_t used = 0U;
+        for (auto i = 0U; i < _capacity; ++i)
+        {
+            used += predicate(_slots[i].load(std::memory_order_relaxed)) ? 1U : 0U;
+        }
+        return used;
+    }
+
+    // frees all slots, must not run concurrently with other users
+    void clear() noexcept;
+
+    inline std::size_t capacity() const
+    { return _capacity; }
+    inline bool shared() const
+    { return _mapped; }
+
+private:
+    std::size_t _capacity = 0U;
+    Slot *_slots = nullptr;
+    // the slots are a shared mapping instead of an array
+    bool _mapped = false;
+};
+
+}
+
+#endif // INTERNAL_SLOTTABLE_HPP
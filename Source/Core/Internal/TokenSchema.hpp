@@ -0,0 +1,232 @@
+#ifndef INTERNAL_TOKENSCHEMA_HPP
+#define INTERNAL_TOKENSCHEMA_HPP
+
+// the columns of the tokens table and the statements which write and read them
+//
+// the statements are generated at compile time, so the table definition, the placeholders
+// and the bind order of TokenDatabase::executeGenericTokenStatement() can't drift apart.
+// the text is the one the runtime builders produced, the schema fingerprint of existing
+// databases stays the same
+
+#include <cstddef>
+#include <string_view>
+
+namespace Internal {
+
+namespace TokenSchema {
+
+struct Column
+{
+    std::string_view name;
+    std::string_view datatype;
+    // expression in the token selects, empty when it isn't selected
+    std::string_view select;
+    // bound by the write statements, in the order of the columns
+    bool bound;
+};
+
+inline constexpr Column COLUMNS[] = {
+    {"id",          "INTEGER PRIMARY KEY NOT NULL",            "tokens.id",        false},
+    {"type",        "int(1) NOT NULL",                         "tokens.type",      true},
+    {"label",       "text NOT NULL UNIQUE COLLATE NOCASE",     "tokens.label",     true},
+    {"icon",        "blob",                                    "icons.data",       true},
+    {"secret",      "text NOT NULL",                           "tokens.secret",    true},
+    {"digits",      "int(1) NOT NULL",                         "tokens.digits",    true},
+    {"period",      "INTEGER NOT NULL",                        "tokens.period",    true},
+    {"counter",     "INTEGER NOT NULL",                        "tokens.counter",   true},
+    {"algorithm",   "int(1) NOT NULL",                         "tokens.algorithm", true},
+    {"issuer",      "text NOT NULL DEFAULT '' COLLATE NOCASE", "tokens.issuer",    true},
+    {"secret_hash", "blob",                                    {},                 true},
+};
+
+inline constexpr std::string_view TABLE = "tokens";
+inline constexpr std::string_view KEY = "id";
+inline constexpr std::string_view CONSTRAINTS =
+    "FOREIGN KEY(type) REFERENCES types(id), "
+    "FOREIGN KEY(algorithm) REFERENCES algorithms(id)";
+
+inline constexpr std::size_t bindCount()
+{
+    std::size_t count = 0U;
+    for (auto&& column : COLUMNS)
+    {
+        count += column.bound ? 1U : 0U;
+    }
+    return count;
+}
+
+// placeholders of the insert statement, update statements and inserts with an id bind the id after them
+inline constexpr std::size_t BIND_COUNT = bindCount();
+
+// position of the column among the bound ones, BIND_COUNT if it isn't bound
+inline constexpr std::size_t bindIndex(std::string_view name)
+{
+    std::size_t index = 0U;
+    for (auto&& column : COLUMNS)
+    {
+        if (column.name == name)
+        {
+            return column.bound ? index : BIND_COUNT;
+        }
+        index += column.bound ? 1U : 0U;
+    }
+    return BIND_COUNT;
+}
+
+// null terminated text of a fixed capacity, filled by the generators below
+template<std::size_t Capacity>
+struct Text
+{
+    char data[Capacity + 1U]{};
+    std::size_t size = 0U;
+
+    constexpr void append(std::string_view text)
+    {
+        for (auto c : text)
+        {
+            data[size++] = c;
+        }
+        data[size] = '\0';
+    }
+
+    constexpr std::string_view view() const
+    {
+        return std::string_view(data, size);
+    }
+};
+
+// every generator runs twice, first with a sink which only counts to size the Text
+struct Length
+{
+    std::size_t size = 0U;
+
+    constexpr void append(std::string_view text)
+    {
+        size += text.size();
+    }
+};
+
+enum class Icon { Joined, Null };
+
+// 'id' INTEGER PRIMARY KEY NOT NULL, ..., FOREIGN KEY(...)
+template<typename Sink>
+constexpr void definitions(Sink &sink)
+{
+    for (auto&& column : COLUMNS)
+    {
+        sink.append("'");
+        sink.append(column.name);
+        sink.append("' ");
+        sink.append(column.datatype);
+        sink.append(", ");
+    }
+    sink.append(CONSTRAINTS);
+}
+
+// insert into 'tokens' (type, ...) values (?, ...);
+template<typename Sink>
+constexpr void insert(Sink &sink, bool withKey)
+{
+    sink.append("insert into '");
+    sink.append(TABLE);
+    sink.append("' (");
+    auto first = true;
+    for (auto&& column : COLUMNS)
+    {
+        if (column.bound)
+        {
+            sink.append(first ? "" : ", ");
+            sink.append(column.name);
+            first = false;
+        }
+    }
+    if (withKey)
+    {
+        sink.append(", ");
+        sink.append(KEY);
+    }
+    sink.append(") values (");
+    for (auto i = 0U; i < BIND_COUNT + (withKey ? 1U : 0U); ++i)
+    {
+        sink.append(i == 0U ? "?" : ", ?");
+    }
+    sink.append(");");
+}
+
+// update 'tokens' set type=?, ... where id = ?;
+template<typename Sink>
+constexpr void update(Sink &sink)
+{
+    sink.append("update '");
+    sink.append(TABLE);
+    sink.append("' set ");
+    auto first = true;
+    for (auto&& column : COLUMNS)
+    {
+        if (column.bound)
+        {
+            sink.append(first ? "" : ", ");
+            sink.append(column.name);
+            sink.append("=?");
+            first = false;
+        }
+    }
+    sink.append(" where ");
+    sink.append(KEY);
+    sink.append(" = ?;");
+}
+
+// tokens.id, tokens.type, ..., tokens.issuer, (the caller appends the tags)
+template<typename Sink>
+constexpr void select(Sink &sink, Icon icon)
+{
+    for (auto&& column : COLUMNS)
+    {
+        if (!column.select.empty())
+        {
+            sink.append(icon == Icon::Null && column.name == "icon" ? std::string_view("null") : column.select);
+            sink.append(", ");
+        }
+    }
+}
+
+template<typename Generator>
+constexpr std::size_t length(Generator generator)
+{
+    Length length;
+    generator(length);
+    return length.size;
+}
+
+template<std::size_t Capacity, typename Generator>
+constexpr Text<Capacity> generate(Generator generator)
+{
+    Text<Capacity> text;
+    generator(text);
+    return text;
+}
+
+inline constexpr auto DEFINITIONS_GENERATOR = [](auto &sink) { definitions(sink); };
+inline constexpr auto INSERT_GENERATOR = [](auto &sink) { insert(sink, false); };
+inline constexpr auto INSERT_WITH_KEY_GENERATOR = [](auto &sink) { insert(sink, true); };
+inline constexpr auto UPDATE_GENERATOR = [](auto &sink) { update(sink); };
+inline constexpr auto SELECT_GENERATOR = [](auto &sink) { select(sink, Icon::Joined); };
+inline constexpr auto SELECT_WITHOUT_ICON_GENERATOR = [](auto &sink) { select(sink, Icon::Null); };
+
+// the column list of create table
+inline constexpr auto DEFINITIONS = generate<length(DEFINITIONS_GENERATOR)>(DEFINITIONS_GENERATOR);
+// BIND_COUNT placeholders
+inline constexpr auto INSERT = generate<length(INSERT_GENERATOR)>(INSERT_GENERATOR);
+// BIND_COUNT placeholders and the id, for rows which keep the id of another database
+inline constexpr auto INSERT_WITH_KEY = generate<length(INSERT_WITH_KEY_GENERATOR)>(INSERT_WITH_KEY_GENERATOR);
+// BIND_COUNT placeholders and the id
+inline constexpr auto UPDATE = generate<length(UPDATE_GENERATOR)>(UPDATE_GENERATOR);
+// the token columns without the tags, in the order expected by TokenDatabase::extractTokens()
+inline constexpr auto SELECT = generate<length(SELECT_GENERATOR)>(SELECT_GENERATOR);
+inline constexpr auto SELECT_WITHOUT_ICON = generate<length(SELECT_WITHOUT_ICON_GENERATOR)>(SELECT_WITHOUT_ICON_GENERATOR);
+
+}
+
+}
+
+#endif // INTERNAL_TOKENSCHEMA_HPP
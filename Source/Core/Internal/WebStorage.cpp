@@ -0,0 +1,310 @@
+#include "WebStorage.hpp"
+
+#ifdef OS_WASM
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <cryptopp/sha.h>
+
+#include <emscripten.h>
+#ifdef __EMSCRIPTEN_PTHREADS__
+#include <emscripten/threading.h>
+#endif
+
+namespace {
+    // a block is only skipped if it is unchanged, a colliding hash would keep a stale
+    // block in the storage, so the blocks are compared by their SHA-256 digest
+    using BlockHash = std::array<unsigned char, CryptoPP::SHA256::DIGESTSIZE>;
+
+    // hashes of the stored blocks of every file
+    static std::mutex storage_mutex;
+    static std::unordered_map<std::string, std::vector<BlockHash>> stored_blocks;
+
+    static BlockHash blockHash(const char *data, std::size_t size)
+    {
+        BlockHash hash;
+        CryptoPP::SHA256().CalculateDigest(hash.data(), reinterpret_cast<const unsigned char*>(data), size);
+        return hash;
+    }
+
+    // blocks of one store, handed to the main thread
+    struct PendingStore
+    {
+        std::string path;
+        std::vector<std::pair<int, std::string>> blocks;
+        int count = 0;
+        double size = 0;
+        int previous = 0;
+    };
+
+    // IndexedDB belongs to the main thread, saves on workers hand their blocks over,
+    // calls on the main thread run right away
+    static void runOnMainThread(void (*function)(void*), void *argument)
+    {
+#ifdef __EMSCRIPTEN_PTHREADS__
+        if (!emscripten_is_main_runtime_thread())
+        {
+            emscripten_async_run_in_main_runtime_thread(EM_FUNC_SIG_VI, reinterpret_cast<void*>(function), argument);
+            return;
+        }
+#endif
+        function(argument);
+    }
+}
+
+extern "C" {
+
+// called by the restore script, context is the heap allocated callback
+EMSCRIPTEN_KEEPALIVE void otpgen_web_storage_restored(void *context, int restored)
+{
+    std::unique_ptr<std::function<void(bool)>> callback(static_cast<std::function<void(bool)>*>(context));
+    (*callback)(restored != 0);
+}
+
+}
+
+// the database is opened once, every request runs in a transaction of its own
+EM_JS(void, otpgen_web_storage_open, (), {
+    if (Module.otpgenStorage) {
+        return;
+    }
+    Module.otpgenStorage = new Promise(function(resolve, reject) {
+        var request = indexedDB.open("otpgen", 1);
+        request.onupgradeneeded = function() {
+            request.result.createObjectStore("blocks");
+        };
+        request.onsuccess = function() { resolve(request.result); };
+        request.onerror = function() { reject(request.error); };
+    });
+});
+
+EM_JS(void, otpgen_web_storage_restore, (const char *path, void *context), {
+    var file = UTF8ToString(path);
+    var done = function(restored) { Module._otpgen_web_storage_restored(context, restored ? 1 : 0); };
+    Module.otpgenStorage.then(function(db) {
+        var store = db.transaction("blocks", "readonly").objectStore("blocks");
+        var manifest = store.get(file + "#manifest");
+        manifest.onerror = function() { done(false); };
+        manifest.onsuccess = function() {
+            var m = manifest.result;
+            if (!m || m.count === 0) {
+                done(false);
+                return;
+            }
+            var data = new Uint8Array(m.size);
+            var pending = m.count;
+            var failed = false;
+            for (var i = 0; i < m.count; ++i) {
+                (function(index) {
+                    var block = store.get(file + "#" + index);
+                    block.onerror = function() { failed = true; if (--pending === 0) done(false); };
+                    block.onsuccess = function() {
+                        if (block.result) {
+                            data.set(new Uint8Array(block.result), index * m.block);
+                        } else {
+                            failed = true;
+                        }
+                        if (--pending === 0) {
+                            if (!failed) {
+                                FS.writeFile(file, data);
+                            }
+                            done(!failed);
+                        }
+                    };
+                })(i);
+            }
+        };
+    }, function() { done(false); });
+});
+
+// data is copied right away, the put runs once the database is open
+EM_JS(void, otpgen_web_storage_store_block, (const char *path, int index, const char *data, int size), {
+    var key = UTF8ToString(path) + "#" + index;
+    var block = HEAPU8.slice(data, data + size).buffer;
+    Module.otpgenStorage.then(function(db) {
+        db.transaction("blocks", "readwrite").objectStore("blocks").put(block, key);
+    });
+});
+
+// transactions on the same store run in the order they were created, the manifest
+// is only committed after all blocks of this store
+EM_JS(void, otpgen_web_storage_store_manifest, (const char *path, int count, double size, int block, int previous), {
+    var file = UTF8ToString(path);
+    Module.otpgenStorage.then(function(db) {
+        var store = db.transaction("blocks", "readwrite").objectStore("blocks");
+        store.put({count: count, size: size, block: block}, file + "#manifest");
+        for (var i = count; i < previous; ++i) {
+            store.delete(file + "#" + i);
+        }
+    });
+});
+
+EM_JS(void, otpgen_web_storage_remove, (const char *path), {
+    var file = UTF8ToString(path);
+    Module.otpgenStorage.then(function(db) {
+        var store = db.transaction("blocks", "readwrite").objectStore("blocks");
+        var manifest = store.get(file + "#manifest");
+        manifest.onsuccess = function() {
+            var count = manifest.result ? manifest.result.count : 0;
+            for (var i = 0; i < count; ++i) {
+                store.delete(file + "#" + i);
+            }
+            store.delete(file + "#manifest");
+        };
+    });
+});
+
+EM_JS(int, otpgen_web_storage_supported, (), {
+    return typeof indexedDB !== "undefined" ? 1 : 0;
+});
+
+namespace Internal {
+
+bool webStorageAvailable()
+{
+    return otpgen_web_storage_supported() != 0;
+}
+
+void restoreWebFile(const std::string &path, const std::function<void(bool)> &callback)
+{
+    if (!webStorageAvailable())
+    {
+        callback(false);
+        return;
+    }
+
+    // the hashes of the restored file are known, the next store only writes what changed
+    auto done = new std::function<void(bool)>([path, callback](bool restored) {
+        if (restored)
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::vector<BlockHash> hashes;
+            std::vector<char> block(WEB_STORAGE_BLOCK_SIZE);
+            while (in.read(block.data(), static_cast<std::streamsize>(block.size())) || in.gcount() > 0)
+            {
+                hashes.emplace_back(blockHash(block.data(), static_cast<std::size_t>(in.gcount())));
+            }
+
+            std::lock_guard<std::mutex> lock(storage_mutex);
+            stored_blocks[path] = std::move(hashes);
+        }
+        callback(restored);
+    });
+
+    otpgen_web_storage_open();
+    otpgen_web_storage_restore(path.c_str(), done);
+}
+
+bool persistWebFile(const std::string &path)
+{
+    if (!webStorageAvailable())
+    {
+        return false;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+
+    auto pending = std::make_unique<PendingStore>();
+    pending->path = path;
+    {
+        std::lock_guard<std::mutex> lock(storage_mutex);
+        auto &hashes = stored_blocks[path];
+        pending->previous = static_cast<int>(hashes.size());
+
+        std::vector<char> block(WEB_STORAGE_BLOCK_SIZE);
+        std::size_t count = 0;
+        std::size_t size = 0;
+        while (in.read(block.data(), static_cast<std::streamsize>(block.size())) || in.gcount() > 0)
+        {
+            const auto length = static_cast<std::size_t>(in.gcount());
+            const auto hash = blockHash(block.data(), length);
+            if (count >= hashes.size() || hashes[count] != hash)
+            {
+                pending->blocks.emplace_back(static_cast<int>(count), std::string(block.data(), length));
+                if (count >= hashes.size())
+                {
+                    hashes.emplace_back(hash);
+                }
+                else
+                {
+                    hashes[count] = hash;
+                }
+            }
+            size += length;
+            ++count;
+        }
+        hashes.resize(count);
+        pending->count = static_cast<int>(count);
+        pending->size = static_cast<double>(size);
+    }
+
+    runOnMainThread([](void *argument) {
+        std::unique_ptr<PendingStore> store(static_cast<PendingStore*>(argument));
+        otpgen_web_storage_open();
+        for (auto&& block : store->blocks)
+        {
+            otpgen_web_storage_store_block(store->path.c_str(), block.first, block.second.data(), static_cast<int>(block.second.size()));
+        }
+        otpgen_web_storage_store_manifest(store->path.c_str(), store->count, store->size,
+                                          static_cast<int>(WEB_STORAGE_BLOCK_SIZE), store->previous);
+    }, pending.release());
+    return true;
+}
+
+void removeWebFile(const std::string &path)
+{
+    if (!webStorageAvailable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(storage_mutex);
+        stored_blocks.erase(path);
+    }
+
+    runOnMainThread([](void *argument) {
+        std::unique_ptr<std::string> file(static_cast<std::string*>(argument));
+        otpgen_web_storage_open();
+        otpgen_web_storage_remove(file->c_str());
+    }, new std::string(path));
+}
+
+}
+
+#else // OS_WASM
+
+namespace Internal {
+
+bool webStorageAvailable()
+{
+    return false;
+}
+
+void restoreWebFile(const std::string &, const std::function<void(bool)> &callback)
+{
+    callback(false);
+}
+
+bool persistWebFile(const std::string &)
+{
+    return false;
+}
+
+void removeWebFile(const std::string &)
+{
+}
+
+}
+
+#endif // OS_WASM
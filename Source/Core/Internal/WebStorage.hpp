@@ -0,0 +1,40 @@
+#ifndef INTERNAL_WEBSTORAGE_HPP
+#define INTERNAL_WEBSTORAGE_HPP
+
+// persistence of files of the in-memory filesystem on WebAssembly
+//
+// files are stored in IndexedDB as blocks of WEB_STORAGE_BLOCK_SIZE bytes next to a manifest
+// with the block count and size, a store only writes the blocks whose content changed since
+// the last store or restore, the manifest is written last in a transaction of its own, so an
+// interrupted store keeps the previous manifest
+//
+// page encrypted databases only rewrite the changed pages, so a save stores a few blocks,
+// image databases are encrypted with a new key on every save and store all blocks
+//
+// on other platforms files are on disk already, restoring does nothing and reports no file
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace Internal {
+
+static const constexpr std::size_t WEB_STORAGE_BLOCK_SIZE = 64 * 1024;
+
+// IndexedDB is used for the files
+bool webStorageAvailable();
+
+// copies the stored file into the filesystem, the callback runs on the main thread
+// once done, restored is false if nothing was stored or it can't be read
+void restoreWebFile(const std::string &path, const std::function<void(bool restored)> &callback);
+
+// stores the changed blocks of the file in the background, stores from other threads are handed
+// to the main thread, which owns IndexedDB, returns false if the file can't be read
+bool persistWebFile(const std::string &path);
+
+// forgets the stored file
+void removeWebFile(const std::string &path);
+
+}
+
+#endif // INTERNAL_WEBSTORAGE_HPP
@@ -0,0 +1,138 @@
+#include "LabelArena.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+namespace {
+    // labels are short, a block holds a few hundred of them
+    static const constexpr std::size_t BLOCK_SIZE = 16U * 1024U;
+}
+
+void LabelArena::fold(const std::string_view &text, std::string &folded)
+{
+    folded.assign(text.data(), text.size());
+    for (auto&& c : folded)
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+}
+
+std::string_view LabelArena::store(const std::string_view &text)
+{
+    if (text.empty())
+    {
+        return {};
+    }
+
+    // labels larger than a block get a block of their own
+    if (this->_blockUsed + text.size() > this->_blockSize)
+    {
+        const auto size = std::max(BLOCK_SIZE, text.size());
+        this->_blocks.emplace_back(std::make_unique<char[]>(size));
+        this->_blockSize = size;
+        this->_blockUsed = 0U;
+    }
+
+    const auto data = this->_blocks.back().get() + this->_blockUsed;
+    std::memcpy(data, text.data(), text.size());
+    this->_blockUsed += text.size();
+    this->_bytes += text.size();
+    return std::string_view(data, text.size());
+}
+
+LabelArena::Label LabelArena::intern(const std::string_view &text)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(this->_mutex);
+        const auto it = this->_texts.find(text);
+        if (it != this->_texts.end())
+        {
+            return this->_labels[it->second - 1U];
+        }
+    }
+
+    std::string folded;
+    fold(text, folded);
+
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    const auto it = this->_texts.find(text);
+    if (it != this->_texts.end())
+    {
+        return this->_labels[it->second - 1U];
+    }
+
+    Label label;
+    label.id = static_cast<Id>(this->_labels.size() + 1U);
+    label.text = this->store(text);
+
+    // the folded text is shared with the first label which has it
+    const auto key = this->_keys.find(folded);
+    if (key != this->_keys.end())
+    {
+        const auto &first = this->_labels[key->second - 1U];
+        label.key = first.key;
+        label.folded = first.folded;
+        label.hash = first.hash;
+    }
+    else
+    {
+        label.key = label.id;
+        label.folded = folded == text ? label.text : this->store(folded);
+        label.hash = std::hash<std::string_view>()(label.folded);
+        this->_keys.emplace(label.folded, label.id);
+    }
+
+    this->_labels.emplace_back(label);
+    this->_texts.emplace(label.text, label.id);
+    return label;
+}
+
+bool LabelArena::find(const std::string_view &text, Label &label) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    const auto it = this->_texts.find(text);
+    if (it == this->_texts.end())
+    {
+        return false;
+    }
+    label = this->_labels[it->second - 1U];
+    return true;
+}
+
+bool LabelArena::findFolded(const std::string_view &text, Label &label) const
+{
+    std::string folded;
+    fold(text, folded);
+
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    const auto it = this->_keys.find(folded);
+    if (it == this->_keys.end())
+    {
+        return false;
+    }
+    label = this->_labels[it->second - 1U];
+    return true;
+}
+
+LabelArena::Label LabelArena::get(const Id &id) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return id == 0U || id > this->_labels.size() ? Label() : this->_labels[id - 1U];
+}
+
+std::size_t LabelArena::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_labels.size();
+}
+
+std::size_t LabelArena::bytes() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_bytes;
+}
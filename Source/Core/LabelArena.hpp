@@ -0,0 +1,94 @@
+#ifndef LABELARENA_HPP
+#define LABELARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Interned token labels
+ *
+ * Every distinct label is stored once in large blocks together with its
+ * folded form and the hash of it, indexes keep the small Label handle
+ * instead of a copy of the string. The views stay valid as long as the
+ * arena lives, labels are never removed; the token database starts a new
+ * arena with every vault it opens and hands it out as a shared pointer.
+ *
+ * Labels with the same text have the same id, labels which only differ
+ * in the case of ASCII letters (like COLLATE NOCASE of the database) have
+ * the same key, so indexes compare integers instead of strings.
+ *
+ * The arena is safe to use from multiple threads.
+ *
+ */
+class LabelArena
+{
+public:
+    using Id = std::uint32_t;
+
+    struct Label
+    {
+        // same text, 0 for no label
+        Id id = 0U;
+        // same folded text, the id of the first label with it
+        Id key = 0U;
+        std::string_view text;
+        // ASCII lower case, the text itself if it has no upper case letters
+        std::string_view folded;
+        // hash of the folded text
+        std::size_t hash = 0U;
+
+        inline bool valid() const
+        { return this->id != 0U; }
+        inline bool operator== (const Label &other) const
+        { return this->id == other.id; }
+        inline bool operator!= (const Label &other) const
+        { return this->id != other.id; }
+    };
+
+    LabelArena() = default;
+
+    LabelArena(const LabelArena&) = delete;
+    LabelArena &operator= (const LabelArena&) = delete;
+
+    // the label of the text, stored when it is new
+    Label intern(const std::string_view &text);
+
+    // the label of exactly this text, false if it was never interned
+    bool find(const std::string_view &text, Label &label) const;
+    // the first interned label which equals the text when folded, false if there is none
+    bool findFolded(const std::string_view &text, Label &label) const;
+
+    // the label of the id, an invalid one for unknown ids
+    Label get(const Id &id) const;
+
+    // amount of distinct labels and bytes of the stored strings
+    std::size_t size() const;
+    std::size_t bytes() const;
+
+    // ASCII lower case
+    static void fold(const std::string_view &text, std::string &folded);
+
+private:
+    std::string_view store(const std::string_view &text);
+
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    std::size_t _blockUsed = 0U;
+    std::size_t _blockSize = 0U;
+    std::size_t _bytes = 0U;
+
+    // indexed by id - 1, a deque keeps the labels in place while it grows
+    std::deque<Label> _labels;
+    std::unordered_map<std::string_view, Id> _texts;
+    std::unordered_map<std::string_view, Id> _keys;
+
+    mutable std::shared_mutex _mutex;
+};
+
+#endif // LABELARENA_HPP
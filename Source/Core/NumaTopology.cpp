@@ -0,0 +1,279 @@
+#include "NumaTopology.hpp"
+#include "SecureMemory.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NUMATOPOLOGY_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+    // the nodes in sysfs, numbered by the kernel
+    static const char *const NODE_DIRECTORY = "/sys/devices/system/node";
+
+    // mbind(2) policy, the kernel falls back when the node is full
+    static const constexpr int MPOL_PREFERRED_POLICY = 1;
+
+    static std::size_t pageSize()
+    {
+#ifdef NUMATOPOLOGY_MMAP
+        static const auto size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+#else
+        return 4096U;
+#endif
+    }
+
+    // the CPU number at the position, returns the position after it or npos without digits
+    static std::size_t parse_cpu(const std::string &list, std::size_t position, const std::size_t &end, std::size_t &cpu)
+    {
+        const auto begin = position;
+        cpu = 0U;
+        for (; position < end && list[position] >= '0' && list[position] <= '9'; ++position)
+        {
+            cpu = cpu * 10U + static_cast<std::size_t>(list[position] - '0');
+        }
+        return position == begin ? std::string::npos : position;
+    }
+
+    static bool useHugePages(const std::size_t &size, bool huge_pages)
+    {
+        return huge_pages && size >= NumaTopology::HUGE_PAGE_SIZE;
+    }
+
+    // size of the mapping of an allocation
+    static std::size_t mappedSize(std::size_t size, bool huge_pages)
+    {
+        const auto page = useHugePages(size, huge_pages) ? NumaTopology::HUGE_PAGE_SIZE : pageSize();
+        size = std::max<std::size_t>(size, 1U);
+        return (size + page - 1U) / page * page;
+    }
+
+    static const std::vector<std::vector<std::size_t>> readNodes()
+    {
+        std::vector<std::vector<std::size_t>> nodes;
+#if defined(__linux__)
+        const auto directory = ::opendir(NODE_DIRECTORY);
+        if (directory)
+        {
+            for (auto entry = ::readdir(directory); entry; entry = ::readdir(directory))
+            {
+                const std::string name(entry->d_name);
+                if (name.size() <= 4U || name.compare(0U, 4U, "node") != 0 ||
+                    name.find_first_not_of("0123456789", 4U) != std::string::npos)
+                {
+                    continue;
+                }
+
+                const auto node = std::stoul(name.substr(4U));
+                std::ifstream file(std::string(NODE_DIRECTORY) + "/" + name + "/cpulist");
+                std::string list;
+                std::vector<std::size_t> cpus;
+                if (!std::getline(file, list) || !NumaTopology::parseCpuList(list, cpus))
+                {
+                    continue;
+                }
+                // memory-only nodes stay without CPUs
+                if (nodes.size() <= node)
+                {
+                    nodes.resize(node + 1U);
+                }
+                nodes[node] = std::move(cpus);
+            }
+            ::closedir(directory);
+        }
+#endif
+
+        const auto has_cpus = std::any_of(nodes.begin(), nodes.end(), [](const std::vector<std::size_t> &cpus) {
+            return !cpus.empty();
+        });
+        if (!has_cpus)
+        {
+            nodes.assign(1U, {});
+            const auto threads = std::max(1U, std::thread::hardware_concurrency());
+            for (auto i = 0U; i < threads; ++i)
+            {
+                nodes[0].emplace_back(i);
+            }
+        }
+        return nodes;
+    }
+}
+
+const NumaTopology &NumaTopology::system()
+{
+    static const NumaTopology topology(readNodes());
+    return topology;
+}
+
+NumaTopology::NumaTopology(const std::vector<std::vector<std::size_t>> &nodes)
+    : _nodes(nodes)
+{
+    if (this->_nodes.empty())
+    {
+        this->_nodes.resize(1U);
+    }
+}
+
+std::size_t NumaTopology::nodeOf(const std::size_t &cpu) const
+{
+    for (auto node = 0U; node < this->_nodes.size(); ++node)
+    {
+        const auto &cpus = this->_nodes[node];
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+        {
+            return node;
+        }
+    }
+    return 0U;
+}
+
+bool NumaTopology::pinThread(const std::size_t &node) const
+{
+    if (node >= this->_nodes.size() || this->_nodes[node].empty())
+    {
+        return false;
+    }
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto&& cpu : this->_nodes[node])
+    {
+        if (cpu < CPU_SETSIZE)
+        {
+            CPU_SET(static_cast<int>(cpu), &set);
+        }
+    }
+    return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+bool NumaTopology::parseCpuList(const std::string &list, std::vector<std::size_t> &cpus)
+{
+    cpus.clear();
+    const auto end = list.find_last_not_of(" \t\n");
+    if (end == std::string::npos)
+    {
+        return true;
+    }
+    if (list[end] == ',')
+    {
+        return false;
+    }
+
+    // comma separated CPUs and ranges of CPUs
+    std::size_t begin = 0U;
+    while (begin <= end)
+    {
+        const auto comma = std::min(list.find(',', begin), end + 1U);
+        std::size_t first = 0U, last = 0U;
+        const auto next = parse_cpu(list, begin, comma, first);
+        if (next == std::string::npos)
+        {
+            cpus.clear();
+            return false;
+        }
+        last = first;
+        if (next != comma && (list[next] != '-' || parse_cpu(list, next + 1U, comma, last) != comma || last < first))
+        {
+            cpus.clear();
+            return false;
+        }
+
+        for (auto cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.emplace_back(cpu);
+        }
+        begin = comma + 1U;
+    }
+    return true;
+}
+
+void *NumaTopology::allocate(std::size_t size, const std::size_t &node, bool huge_pages)
+{
+    const auto huge = useHugePages(size, huge_pages);
+    const auto mapped = mappedSize(size, huge_pages);
+#ifdef NUMATOPOLOGY_MMAP
+    // huge pages need an aligned mapping, the parts around it are unmapped again
+    const auto reserved = huge ? mapped + HUGE_PAGE_SIZE : mapped;
+    auto base = ::mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    auto data = static_cast<unsigned char*>(base);
+    if (huge)
+    {
+        const auto address = reinterpret_cast<std::uintptr_t>(base);
+        const auto aligned = (address + HUGE_PAGE_SIZE - 1U) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        data = reinterpret_cast<unsigned char*>(aligned);
+        const auto head = aligned - address;
+        if (head != 0U)
+        {
+            (void) ::munmap(base, head);
+        }
+        if (reserved - head - mapped != 0U)
+        {
+            (void) ::munmap(data + mapped, reserved - head - mapped);
+        }
+#ifdef MADV_HUGEPAGE
+        (void) ::madvise(data, mapped, MADV_HUGEPAGE);
+#endif
+    }
+
+#if defined(__linux__) && defined(SYS_mbind)
+    // the placement applies to the pages touched from now on
+    if (node < sizeof(unsigned long) * 8U)
+    {
+        const unsigned long mask = 1UL << node;
+        (void) ::syscall(SYS_mbind, data, mapped, MPOL_PREFERRED_POLICY, &mask, sizeof(mask) * 8U, 0U);
+    }
+#else
+    (void) node;
+#endif
+#ifdef MADV_DONTDUMP
+    (void) ::madvise(data, mapped, MADV_DONTDUMP);
+#endif
+    (void) ::mlock(data, mapped);
+    return data;
+#else
+    (void) node;
+    (void) huge;
+    auto data = std::calloc(1U, mapped);
+    if (!data)
+    {
+        throw std::bad_alloc();
+    }
+    return data;
+#endif
+}
+
+void NumaTopology::deallocate(void *data, std::size_t size, bool huge_pages) noexcept
+{
+    if (!data)
+    {
+        return;
+    }
+    const auto mapped = mappedSize(size, huge_pages);
+    SecureMemory::wipe(data, mapped);
+#ifdef NUMATOPOLOGY_MMAP
+    (void) ::munlock(data, mapped);
+    (void) ::munmap(data, mapped);
+#else
+    std::free(data);
+#endif
+}
@@ -0,0 +1,105 @@
+#ifndef NUMATOPOLOGY_HPP
+#define NUMATOPOLOGY_HPP
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * NUMA nodes of the system and node-local memory
+ *
+ * The nodes and their CPUs are read from sysfs (Linux), other systems and
+ * machines without the information are a single node holding every
+ * hardware thread. Memory is placed with the system calls directly, no
+ * libnuma is needed.
+ *
+ * Node memory is preferred on the node (the kernel falls back to other nodes
+ * when it is full), locked if possible and wiped when it is released, as
+ * it holds prepared keys. Large allocations can ask for transparent 2 MB
+ * pages to cut the TLB misses of long key arrays.
+ *
+ */
+class NumaTopology
+{
+public:
+    static const constexpr std::size_t HUGE_PAGE_SIZE = 2U * 1024U * 1024U;
+
+    // nodes of the running system, read once
+    static const NumaTopology &system();
+
+    // topology of the given CPU lists, one per node
+    explicit NumaTopology(const std::vector<std::vector<std::size_t>> &nodes);
+
+    inline std::size_t nodeCount() const
+    { return this->_nodes.size(); }
+    inline const std::vector<std::size_t> &cpus(const std::size_t &node) const
+    { return this->_nodes[node]; }
+
+    // node of the CPU, 0 for unknown CPUs
+    std::size_t nodeOf(const std::size_t &cpu) const;
+
+    // binds the calling thread to the CPUs of the node, returns false if not supported
+    bool pinThread(const std::size_t &node) const;
+
+    // parses a sysfs CPU list like "0-3,8,10-11", returns false on malformed lists
+    static bool parseCpuList(const std::string &list, std::vector<std::size_t> &cpus);
+
+    // zeroed memory on the node, throws std::bad_alloc on failure
+    static void *allocate(std::size_t size, const std::size_t &node, bool huge_pages = false);
+    // wipe and release memory, size must be the size given to allocate()
+    static void deallocate(void *data, std::size_t size, bool huge_pages = false) noexcept;
+
+private:
+    std::vector<std::vector<std::size_t>> _nodes;
+};
+
+template<typename T>
+class NodeAllocator
+{
+public:
+    using value_type = T;
+
+    explicit NodeAllocator(std::size_t node = 0U, bool huge_pages = false) noexcept
+        : _node(node), _huge_pages(huge_pages)
+    {
+    }
+    template<typename U>
+    NodeAllocator(const NodeAllocator<U> &other) noexcept
+        : _node(other.node()), _huge_pages(other.hugePages())
+    {
+    }
+
+    T *allocate(std::size_t count)
+    {
+        if (count > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(NumaTopology::allocate(count * sizeof(T), this->_node, this->_huge_pages));
+    }
+
+    void deallocate(T *data, std::size_t count) noexcept
+    {
+        NumaTopology::deallocate(data, count * sizeof(T), this->_huge_pages);
+    }
+
+    inline std::size_t node() const noexcept
+    { return this->_node; }
+    inline bool hugePages() const noexcept
+    { return this->_huge_pages; }
+
+    template<typename U>
+    inline bool operator== (const NodeAllocator<U> &other) const noexcept
+    { return this->_node == other.node() && this->_huge_pages == other.hugePages(); }
+    template<typename U>
+    inline bool operator!= (const NodeAllocator<U> &other) const noexcept
+    { return !(*this == other); }
+
+private:
+    std::size_t _node;
+    bool _huge_pages;
+};
+
+#endif // NUMATOPOLOGY_HPP
@@ -1,9 +1,26 @@
 #include "OTPGen.hpp"
 
-#include <cryptopp/filters.h>
-#include <cryptopp/base32.h>
-#include <cryptopp/base64.h>
-#include <cryptopp/hmac.h>
+#include "BatchEngine.hpp"
+#include "Clock.hpp"
+#include "ClockDrift.hpp"
+#include "CodeCoalescer.hpp"
+#include "Codec.hpp"
+#include "Executor.hpp"
+#include "PerfStats.hpp"
+#include "UsedCodeStore.hpp"
+
+#include "Internal/Hmac.hpp"
+#include "Internal/OTPProfile.hpp"
+#include "Internal/Sha1MultiBuffer.hpp"
+#include "Internal/Sha2MultiBuffer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <utility>
+#include <cstring>
+
 #include <cryptopp/sha.h>
 
 namespace {
@@ -11,98 +28,69 @@ namespace {
     static const constexpr auto SHA256_DIGEST_SIZE = 32;
     static const constexpr auto SHA512_DIGEST_SIZE = 64;
 
-    static const constexpr std::uint64_t DIGITS_POWER[] = {
-        1,
-        10,
-        100,
-        1000,
-        10000,
-        100000,
-        1000000,
-        10000000,
-        100000000,
-        1000000000,
-        10000000000,
-    };
+    // runtime dispatch tables indexed by the digit length
+    using CodeReducer = std::uint32_t(*)(std::uint32_t) noexcept;
+    using CodeFormatter = void(*)(std::uint32_t, char*) noexcept;
 
-    static const std::string normalize_secret(const std::string &secret)
+    template<unsigned... Digits>
+    static constexpr std::array<CodeReducer, sizeof...(Digits)> make_reducers(std::integer_sequence<unsigned, Digits...>)
     {
-        auto nK = static_cast<char*>(std::calloc(1, secret.size() + 1));
-
-        std::size_t i = 0, j = 0;
-        while (secret[i] != '\0')
-        {
-            if (secret[i] != ' ')
-            {
-                if (secret[i] >= 'a' && secret[i] <= 'z')
-                {
-                    nK[j++] = static_cast<char>( (secret[i] - 32) );
-                }
-                else
-                {
-                    nK[j++] = secret[i];
-                }
-            }
-            i++;
-        }
+        return {{&Internal::reduce_code<Digits>...}};
+    }
 
-        std::string normalized(nK, nK + strlen(nK));
-        std::free(nK);
-        return normalized;
+    template<unsigned... Digits>
+    static constexpr std::array<CodeFormatter, sizeof...(Digits)> make_formatters(std::integer_sequence<unsigned, Digits...>)
+    {
+        return {{&Internal::format_code<Digits>...}};
     }
 
-    static const std::string base32_rfc4648_decode(const std::string &key)
+    static const constexpr auto CODE_REDUCERS = make_reducers(std::make_integer_sequence<unsigned, OTPGen::maxDigitLength() + 1U>());
+    static const constexpr auto CODE_FORMATTERS = make_formatters(std::make_integer_sequence<unsigned, OTPGen::maxDigitLength() + 1U>());
+
+    // store the counter as 8 byte big endian integer
+    static void encode_counter(std::uint64_t C, unsigned char value[8]) noexcept
     {
-        if (key.empty())
+        for (auto i = 7; i >= 0; --i)
         {
-            return {};
+            value[i] = static_cast<unsigned char>(C & 0xff);
+            C >>= 8;
         }
+    }
 
-        // create an RFC 4648 base-32 decoder
-        // crypto++ uses DUDE by default which isn't TOTP compatible
-        auto decoder = new CryptoPP::Base32Decoder();
-
-        static int lookup[256];
-        static const CryptoPP::byte ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-        static const auto init = ([&]{ CryptoPP::Base64Decoder::InitializeDecodingLookupArray(lookup, ALPHABET, 32, true); return 0; })(); (void) init;
-        static const CryptoPP::AlgorithmParameters params = CryptoPP::MakeParameters(
-                                                            CryptoPP::Name::DecodingLookupArray(),
-                                                            static_cast<const int*>(lookup));
-        decoder->IsolatedInitialize(params);
+    // template helper function to compute HMAC's of different SHA algorithms
+    // the compression function is provided by the runtime selected SHA backend
+    template<class Hash>
+    static inline const std::string compute_hmac_helper(const OTPKey::KeyData &key, unsigned char value[8])
+    {
+        unsigned char inner[OTPKey::HMAC_STATE_SIZE], outer[OTPKey::HMAC_STATE_SIZE];
+        unsigned char digest[Hash::DIGESTSIZE];
 
-        // raw pointers are automatically deleted by crypto++
-        std::string base32;
-        decoder->Attach(new CryptoPP::StringSink(base32));
+        Internal::hmac_prepare_helper<Hash>(key, inner, outer);
+        Internal::hmac_compute_helper<Hash>(inner, outer, value, digest);
 
-        // result may be binary (unsigned char)
-        try {
-            CryptoPP::StringSource(key, true, decoder);
-        } catch (...) {
-            return {};
-        }
+        std::memset(inner, 0, sizeof(inner));
+        std::memset(outer, 0, sizeof(outer));
 
-        return base32;
+        return std::string(reinterpret_cast<const char*>(digest), sizeof(digest));
     }
 
-    // template helper function to compute HMAC's of different SHA algorithms
-    template<class CryptoPPHMacClass>
-    static inline const std::string compute_hmac_helper(const std::string &key, unsigned char value[8])
+    // compute the HMAC of a prepared key, the digest buffer must hold SHA512_DIGEST_SIZE bytes
+    static void compute_hmac_prepared(const OTPKey &key, std::uint64_t C, unsigned char *digest) noexcept
     {
-        CryptoPPHMacClass cryptoHmac(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+        unsigned char value[8];
+        encode_counter(C, value);
 
-        std::string hmac;
-        CryptoPP::StringSource(value, 8, true,
-            new CryptoPP::HashFilter(cryptoHmac,
-                new CryptoPP::StringSink(hmac)));
-        return hmac;
+        switch (key.algorithm())
+        {
+            case OTPToken::SHA1:   Internal::hmac_compute_helper<CryptoPP::SHA1>(key.innerState(), key.outerState(), value, digest); break;
+            case OTPToken::SHA256: Internal::hmac_compute_helper<CryptoPP::SHA256>(key.innerState(), key.outerState(), value, digest); break;
+            case OTPToken::SHA512: Internal::hmac_compute_helper<CryptoPP::SHA512>(key.innerState(), key.outerState(), value, digest); break;
+        }
     }
 
-    static const std::string compute_hmac(const std::string &key, long C, const OTPToken::ShaAlgorithm &algo)
+    // compute the HMAC of an already decoded key
+    static const std::string compute_hmac_raw(const OTPKey::KeyData &secret, std::uint64_t C, const OTPToken::ShaAlgorithm &algo)
     {
-        // normalize and decode secret
-        const auto normalized_key = normalize_secret(key);
-        const auto secret = base32_rfc4648_decode(normalized_key);
-
         // don't continue on empty secret
         if (secret.empty())
         {
@@ -111,19 +99,15 @@ namespace {
 
         // calculate reverse byte order of C
         unsigned char C_reverse_byte_order[8];
-        int j, i;
-        for (j = 0, i = 7; j < 8 && i >= 0; j++, i--)
-        {
-            C_reverse_byte_order[i] = (reinterpret_cast<unsigned char*>(&C))[j];
-        }
+        encode_counter(C, C_reverse_byte_order);
 
         // compute the HMAC and store it into a string
         std::string hmac;
         switch (algo)
         {
-            case OTPToken::SHA1:   hmac = compute_hmac_helper<CryptoPP::HMAC<CryptoPP::SHA1>>(secret, C_reverse_byte_order); break;
-            case OTPToken::SHA256: hmac = compute_hmac_helper<CryptoPP::HMAC<CryptoPP::SHA256>>(secret, C_reverse_byte_order); break;
-            case OTPToken::SHA512: hmac = compute_hmac_helper<CryptoPP::HMAC<CryptoPP::SHA512>>(secret, C_reverse_byte_order); break;
+            case OTPToken::SHA1:   hmac = compute_hmac_helper<CryptoPP::SHA1>(secret, C_reverse_byte_order); break;
+            case OTPToken::SHA256: hmac = compute_hmac_helper<CryptoPP::SHA256>(secret, C_reverse_byte_order); break;
+            case OTPToken::SHA512: hmac = compute_hmac_helper<CryptoPP::SHA512>(secret, C_reverse_byte_order); break;
         }
 
         // validate HMAC
@@ -135,24 +119,35 @@ namespace {
         return hmac;
     }
 
-    static const std::string finalize(const OTPToken::DigitType &digits_length, int tk)
+    static const std::string compute_hmac(const OTPToken::SecretView &key, long C, const OTPToken::ShaAlgorithm &algo)
     {
-        auto token = static_cast<char*>(std::malloc(digits_length + 1));
+        // normalize and decode secret
+        OTPKey::KeyData secret;
+        (void) Codec::base32Decode(key, secret);
+
+        return compute_hmac_raw(secret, static_cast<std::uint64_t>(C), algo);
+    }
 
-        int extra_char = digits_length < 10 ? 0 : 1;
-        auto fmt = static_cast<char*>(std::calloc(1, 5 + extra_char));
-        std::memcpy(fmt, "%.", 2);
-        std::snprintf(fmt + 2, 2 + extra_char, "%d", digits_length);
-        std::memcpy(fmt + 3 + extra_char, "d", 2);
-        std::snprintf(token, digits_length + 1, fmt, tk);
-        std::free(fmt);
+    // write the zero-padded token into the buffer
+    // the buffer must have room for at least digits_length + 1 characters
+    static void finalize(const OTPToken::DigitType &digits_length, int tk, char *token) noexcept
+    {
+        if (digits_length >= CODE_FORMATTERS.size())
+        {
+            token[0] = '\0';
+            return;
+        }
+        CODE_FORMATTERS[digits_length](static_cast<std::uint32_t>(tk), token);
+    }
 
-        std::string tokenStr(token, token + strlen(token));
-        std::free(token);
-        return tokenStr;
+    static const std::string finalize(const OTPToken::DigitType &digits_length, int tk)
+    {
+        char token[OTPGen::maxDigitLength() + 1];
+        finalize(digits_length, tk, token);
+        return std::string(token);
     }
 
-    static int compute_bin_code(const std::string &hmac, unsigned long offset)
+    static int compute_bin_code(const unsigned char *hmac, unsigned long offset) noexcept
     {
         // starting from the offset, take the successive 4 bytes while stripping
         // the topmost bit to prevent it being handled as a signed integer
@@ -163,9 +158,9 @@ namespace {
             ((hmac[offset + 3] & 0xff));
     }
 
-    static int truncate(const std::string &hmac,
-                        const OTPToken::DigitType &digits_length,
-                        const OTPToken::ShaAlgorithm algo)
+    // dynamic truncation (RFC 4226), returns the 31-bit binary code of the HMAC
+    static std::uint32_t dynamic_truncation(const unsigned char *hmac,
+                                            const OTPToken::ShaAlgorithm algo) noexcept
     {
         // take the lower four bits of the last byte
         unsigned long offset = 0;
@@ -182,12 +177,144 @@ namespace {
                 break;
         }
 
-        auto bin_code = compute_bin_code(hmac, offset);
-        int token = bin_code % DIGITS_POWER[digits_length];
-        return token;
+        return static_cast<std::uint32_t>(compute_bin_code(hmac, offset));
+    }
+
+    static int truncate(const unsigned char *hmac,
+                        const OTPToken::DigitType &digits_length,
+                        const OTPToken::ShaAlgorithm algo) noexcept
+    {
+        const auto bin_code = dynamic_truncation(hmac, algo);
+        if (digits_length >= CODE_REDUCERS.size())
+        {
+            return static_cast<int>(bin_code);
+        }
+        return static_cast<int>(CODE_REDUCERS[digits_length](bin_code));
     }
 
-    static const OTPToken::TokenString hotp_helper(const OTPToken::TokenSecret &base32_secret,
+    // multi-buffer HMAC kernel of an algorithm
+    template<OTPToken::ShaAlgorithm Algo>
+    struct MultiBuffer;
+
+    template<>
+    struct MultiBuffer<OTPToken::SHA1>
+    {
+        using Lane = Internal::HmacSha1Lane;
+        static inline void compute(Lane *lanes, std::size_t count) noexcept
+        { Internal::hmacSha1MultiBuffer(lanes, count); }
+    };
+
+    template<>
+    struct MultiBuffer<OTPToken::SHA256>
+    {
+        using Lane = Internal::HmacSha256Lane;
+        static inline void compute(Lane *lanes, std::size_t count) noexcept
+        { Internal::hmacSha256MultiBuffer(lanes, count); }
+    };
+
+    template<>
+    struct MultiBuffer<OTPToken::SHA512>
+    {
+        using Lane = Internal::HmacSha512Lane;
+        static inline void compute(Lane *lanes, std::size_t count) noexcept
+        { Internal::hmacSha512MultiBuffer(lanes, count); }
+    };
+
+    // keys are collected into chunks of lanes for the multi-buffer kernels
+    static const constexpr std::size_t LANE_CHUNK_SIZE = 64U;
+
+    // tokens which are prepared before their keys are scheduled, large enough
+    // to fill the queues of a mix of algorithms
+    static const constexpr std::size_t TOKEN_CHUNK_SIZE = 4U * LANE_CHUNK_SIZE;
+
+    // HMAC computations of one algorithm waiting for the multi-buffer kernel,
+    // the keys must stay valid until the queue is flushed
+    template<OTPToken::ShaAlgorithm Algo>
+    struct LaneQueue
+    {
+        typename MultiBuffer<Algo>::Lane lanes[LANE_CHUNK_SIZE];
+        std::size_t index[LANE_CHUNK_SIZE];
+        std::size_t count = 0U;
+
+        // queue the HMAC of the counter, returns true once the queue is full
+        inline bool push(const OTPKey &key, const unsigned char value[8], std::size_t i) noexcept
+        {
+            auto &lane = this->lanes[this->count];
+            lane.inner = key.innerState();
+            lane.outer = key.outerState();
+            std::memcpy(lane.value, value, sizeof(lane.value));
+            this->index[this->count] = i;
+            return ++this->count == LANE_CHUNK_SIZE;
+        }
+
+        // run the kernel, finish(index, digest) is called for every lane
+        template<typename Finish>
+        inline void flush(const Finish &finish)
+        {
+            if (this->count == 0U)
+            {
+                return;
+            }
+
+            MultiBuffer<Algo>::compute(this->lanes, this->count);
+            for (auto j = 0U; j < this->count; ++j)
+            {
+                finish(this->index[j], this->lanes[j].digest);
+            }
+            this->count = 0U;
+        }
+    };
+
+    // schedules the HMAC computations of a batch with mixed algorithms, every
+    // algorithm has its own queue so the SIMD lanes are always filled with keys
+    // of the same algorithm, lanes don't need to share the counter
+    //
+    // finish(index, digest, algorithm) receives the index given to push(),
+    // the caller stores the result at its original position
+    struct HmacScheduler
+    {
+        LaneQueue<OTPToken::SHA1> sha1;
+        LaneQueue<OTPToken::SHA256> sha256;
+        LaneQueue<OTPToken::SHA512> sha512;
+
+        // the key must be valid
+        template<typename Finish>
+        inline void push(const OTPKey &key, const unsigned char value[8], std::size_t i, const Finish &finish)
+        {
+            switch (key.algorithm())
+            {
+                case OTPToken::SHA1:
+                    if (this->sha1.push(key, value, i)) flush(this->sha1, finish);
+                    break;
+                case OTPToken::SHA256:
+                    if (this->sha256.push(key, value, i)) flush(this->sha256, finish);
+                    break;
+                case OTPToken::SHA512:
+                    if (this->sha512.push(key, value, i)) flush(this->sha512, finish);
+                    break;
+            }
+        }
+
+        // run the remaining partially filled queues
+        template<typename Finish>
+        inline void flush(const Finish &finish)
+        {
+            flush(this->sha1, finish);
+            flush(this->sha256, finish);
+            flush(this->sha512, finish);
+        }
+
+    private:
+        template<OTPToken::ShaAlgorithm Algo, typename Finish>
+        static inline void flush(LaneQueue<Algo> &queue, const Finish &finish)
+        {
+            queue.flush([&](std::size_t i, const unsigned char *digest){
+                finish(i, digest, Algo);
+            });
+        }
+    };
+
+    static const OTPToken::TokenString hotp_helper(const OTPToken::SecretView &base32_secret,
                                                    const std::time_t &counter,
                                                    const OTPToken::DigitType &digits,
                                                    const OTPToken::ShaAlgorithm &sha_algo,
@@ -200,21 +327,154 @@ namespace {
             return {};
         }
 
-        auto tk = truncate(hmac, digits, sha_algo);
+        OTPGEN_PERF_COUNT(CodesGenerated, 1U);
+        auto tk = truncate(reinterpret_cast<const unsigned char*>(hmac.data()), digits, sha_algo);
         return finalize(digits, tk);
     }
 
-    static bool check_period(const OTPToken::PeriodType &period)
+    // write the hotp token of a prepared key into the buffer, no heap allocations
+    static bool hotp_into(const OTPKey &key,
+                          const std::uint64_t &counter,
+                          const OTPToken::DigitType &digits,
+                          char *token) noexcept
+    {
+        if (!key.isValid())
+        {
+            return false;
+        }
+
+        unsigned char hmac[SHA512_DIGEST_SIZE];
+        compute_hmac_prepared(key, counter, hmac);
+
+        OTPGEN_PERF_COUNT(CodesGenerated, 1U);
+        finalize(digits, truncate(hmac, digits, key.algorithm()), token);
+        return true;
+    }
+
+    static const OTPToken::TokenString hotp_helper(const OTPKey &key,
+                                                   const std::uint64_t &counter,
+                                                   const OTPToken::DigitType &digits,
+                                                   OTPGenErrorCode *error)
+    {
+        char token[OTPGen::maxDigitLength() + 1];
+        if (!hotp_into(key, counter, digits, token))
+        {
+            if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+            return {};
+        }
+
+        return std::string(token);
+    }
+
+    // encode a SHA-1 HMAC using the Steam alphabet into the buffer
+    static const constexpr char STEAM_ALPHABET[] = "23456789BCDFGHJKMNPQRTVWXY";
+    static const constexpr std::uint32_t STEAM_ALPHABET_SIZE = sizeof(STEAM_ALPHABET) - 1U;
+    static const constexpr std::size_t STEAM_CODE_LENGTH = 5U;
+
+    // encode the binary code using the Steam alphabet, the unsigned constant
+    // divisor compiles down to a multiplication
+    static void steam_encode(std::uint32_t bin_code, char *code) noexcept
+    {
+        for (auto i = 0U; i < STEAM_CODE_LENGTH; ++i)
+        {
+            code[i] = STEAM_ALPHABET[bin_code % STEAM_ALPHABET_SIZE];
+            bin_code /= STEAM_ALPHABET_SIZE;
+        }
+        code[STEAM_CODE_LENGTH] = '\0';
+    }
+
+    // encode a SHA-1 HMAC using the Steam alphabet into the buffer
+    static void steam_into(const unsigned char *hmac, char *code) noexcept
+    {
+        OTPGEN_PERF_COUNT(CodesGenerated, 1U);
+        unsigned long offset = (hmac[SHA1_DIGEST_SIZE-1] & 0x0f);
+        steam_encode(static_cast<std::uint32_t>(compute_bin_code(hmac, offset)), code);
+    }
+
+    static const OTPToken::TokenString steam_helper(const unsigned char *hmac)
+    {
+        char code[STEAM_CODE_LENGTH + 1];
+        steam_into(hmac, code);
+        return std::string(code, STEAM_CODE_LENGTH);
+    }
+
+    // parse a submitted code of exactly digits_length decimal digits
+    static bool parse_code(const OTPToken::TokenString &code,
+                           const OTPToken::DigitType &digits_length,
+                           std::uint32_t &value) noexcept
+    {
+        if (code.size() != digits_length)
+        {
+            return false;
+        }
+
+        // 10 digits don't fit into 32 bits, a wrapped value would match another code
+        std::uint64_t parsed = 0U;
+        for (auto&& c : code)
+        {
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            parsed = parsed * 10U + static_cast<std::uint64_t>(c - '0');
+        }
+        if (parsed > std::numeric_limits<std::uint32_t>::max())
+        {
+            return false;
+        }
+        value = static_cast<std::uint32_t>(parsed);
+        return true;
+    }
+
+    // compute the binary codes of consecutive counters using the multi-buffer
+    // kernels, count must not exceed HOTP_CHUNK_SIZE
+    static const constexpr std::size_t HOTP_CHUNK_SIZE = LANE_CHUNK_SIZE;
+    static void hotp_bin_codes(const OTPKey &key,
+                               std::uint64_t first,
+                               std::size_t count,
+                               std::uint32_t *bin_codes) noexcept
+    {
+        const auto finish = [&](std::size_t i, const unsigned char *digest, const OTPToken::ShaAlgorithm &algo){
+            bin_codes[i] = dynamic_truncation(digest, algo);
+        };
+
+        HmacScheduler scheduler;
+        unsigned char value[8];
+        for (auto i = 0U; i < count; ++i)
+        {
+            encode_counter(first + i, value);
+            scheduler.push(key, value, i, finish);
+        }
+        scheduler.flush(finish);
+    }
+
+    // compute the truncated hotp values of consecutive counters
+    static void hotp_values(const OTPKey &key,
+                            std::uint64_t first,
+                            std::size_t count,
+                            const OTPToken::DigitType &digits,
+                            std::uint32_t *values) noexcept
+    {
+        hotp_bin_codes(key, first, count, values);
+
+        const auto reduce = CODE_REDUCERS[digits];
+        for (auto i = 0U; i < count; ++i)
+        {
+            values[i] = reduce(values[i]);
+        }
+    }
+
+    static bool check_period(const OTPToken::PeriodType &period) noexcept
     {
         return !(period <= OTPGen::minPeriod() || period > OTPGen::maxPeriod());
     }
 
-    static bool check_otp_length(const OTPToken::DigitType &digits_length)
+    static bool check_otp_length(const OTPToken::DigitType &digits_length) noexcept
     {
         return !(digits_length < OTPGen::minDigitLength() || digits_length > OTPGen::maxDigitLength());
     }
 
-    static bool check_algo(const OTPToken::ShaAlgorithm &algo)
+    static bool check_algo(const OTPToken::ShaAlgorithm &algo) noexcept
     {
         switch (algo)
         {
@@ -229,18 +489,18 @@ namespace {
 }
 
 // compute totp at current time
-const OTPToken::TokenString OTPGen::computeTOTP(const OTPToken::TokenSecret &base32_secret,
+const OTPToken::TokenString OTPGen::computeTOTP(const OTPToken::SecretView &base32_secret,
                                                 const OTPToken::DigitType &digits,
                                                 const OTPToken::PeriodType &period,
                                                 const OTPToken::ShaAlgorithm &sha_algo,
                                                 OTPGenErrorCode *error)
 {
-    return computeTOTP(time(nullptr), base32_secret, digits, period, sha_algo, error);
+    return computeTOTP(Clock::current(), base32_secret, digits, period, sha_algo, error);
 }
 
 // compute totp at a given time
 const OTPToken::TokenString OTPGen::computeTOTP(const std::time_t &time,
-                                                const OTPToken::TokenSecret &base32_secret,
+                                                const OTPToken::SecretView &base32_secret,
                                                 const OTPToken::DigitType &digits,
                                                 const OTPToken::PeriodType &period,
                                                 const OTPToken::ShaAlgorithm &sha_algo,
@@ -255,6 +515,13 @@ const OTPToken::TokenString OTPGen::computeTOTP(const std::time_t &time,
     if (!check_period(period))
     {
         if (error) (*error) = OTPGenErrorCode::InvalidPeriod;
+        return {};
+    }
+
+    if (!check_algo(sha_algo))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return {};
     }
 
     auto timestamp = time / period;
@@ -263,8 +530,95 @@ const OTPToken::TokenString OTPGen::computeTOTP(const std::time_t &time,
     return hotp_helper(base32_secret, timestamp, digits, sha_algo, error);
 }
 
+// compute totp for a list of tokens at a given time
+void OTPGen::computeTOTPBatch(const std::time_t &time,
+                              const std::vector<OTPToken> &tokens,
+                              std::vector<OTPToken::TokenString> &out,
+                              std::vector<OTPGenErrorCode> *errors)
+{
+    out.resize(tokens.size());
+    if (errors)
+    {
+        errors->assign(tokens.size(), OTPGenErrorCode::Valid);
+    }
+
+    // the keys of a chunk of tokens are prepared first and scheduled by algorithm,
+    // the scheduler references the keys until it is flushed at the end of the chunk
+    std::vector<OTPKey> keys(std::min(tokens.size(), TOKEN_CHUNK_SIZE));
+    HmacScheduler scheduler;
+    char token[OTPGen::maxDigitLength() + 1];
+    std::size_t generated = 0U;
+
+    const auto finish = [&](std::size_t i, const unsigned char *digest, const OTPToken::ShaAlgorithm &algo){
+        const auto &digits = tokens[i].digitLength();
+        finalize(digits, truncate(digest, digits, algo), token);
+        out[i].assign(token);
+        ++generated;
+    };
+
+    // most tokens share the same period, only recompute the counter when it changes
+    OTPToken::PeriodType last_period = 0U;
+    unsigned char counter[8];
+
+    for (std::size_t begin = 0U; begin < tokens.size(); begin += TOKEN_CHUNK_SIZE)
+    {
+        const auto end = std::min(tokens.size(), begin + TOKEN_CHUNK_SIZE);
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto &t = tokens[i];
+            auto error = OTPGenErrorCode::Valid;
+
+            out[i].clear();
+
+            if (t.type() != OTPToken::TOTP)
+            {
+                error = OTPGenErrorCode::InvalidType;
+            }
+            else if (!check_otp_length(t.digitLength()))
+            {
+                error = OTPGenErrorCode::InvalidDigits;
+            }
+            else if (!check_period(t.period()))
+            {
+                error = OTPGenErrorCode::InvalidPeriod;
+            }
+            else if (!check_algo(t.algorithm()))
+            {
+                error = OTPGenErrorCode::InvalidAlgorithm;
+            }
+            else
+            {
+                if (t.period() != last_period)
+                {
+                    last_period = t.period();
+                    encode_counter(static_cast<std::uint64_t>(time / last_period), counter);
+                }
+
+                auto &key = keys[i - begin];
+                key = prepareKey(t.secret(), t.algorithm());
+                if (!key.isValid())
+                {
+                    error = OTPGenErrorCode::InvalidBase32Input;
+                }
+                else
+                {
+                    scheduler.push(key, counter, i, finish);
+                }
+            }
+
+            if (errors)
+            {
+                (*errors)[i] = error;
+            }
+        }
+        scheduler.flush(finish);
+    }
+
+    OTPGEN_PERF_COUNT(CodesGenerated, generated);
+}
+
 // compute hotp
-const OTPToken::TokenString OTPGen::computeHOTP(const OTPToken::TokenSecret &base32_secret,
+const OTPToken::TokenString OTPGen::computeHOTP(const OTPToken::SecretView &base32_secret,
                                                 const OTPToken::CounterType &counter,
                                                 const OTPToken::DigitType &digits,
                                                 const OTPToken::ShaAlgorithm &sha_algo,
@@ -286,19 +640,17 @@ const OTPToken::TokenString OTPGen::computeHOTP(const OTPToken::TokenSecret &bas
 }
 
 // compute steam token at current time
-const OTPToken::TokenString OTPGen::computeSteam(const OTPToken::TokenSecret &base32_secret,
+const OTPToken::TokenString OTPGen::computeSteam(const OTPToken::SecretView &base32_secret,
                                                  OTPGenErrorCode *error)
 {
-    return computeSteam(time(nullptr), base32_secret, error);
+    return computeSteam(Clock::steamTime(Clock::current()), base32_secret, error);
 }
 
 // compute steam token at a given time
 const OTPToken::TokenString OTPGen::computeSteam(const std::time_t &time,
-                                                 const OTPToken::TokenSecret &base32_secret,
+                                                 const OTPToken::SecretView &base32_secret,
                                                  OTPGenErrorCode *error)
 {
-    static const std::string steam_alphabet = "23456789BCDFGHJKMNPQRTVWXY";
-
     auto timestamp = time / OTPToken::defaultPeriod(OTPToken::Steam);
 
     const auto hmac = compute_hmac(base32_secret, timestamp, OTPToken::SHA1);
@@ -308,18 +660,1209 @@ const OTPToken::TokenString OTPGen::computeSteam(const std::time_t &time,
         return {};
     }
 
-    unsigned long offset = (hmac[SHA1_DIGEST_SIZE-1] & 0x0f);
-    auto bin_code = compute_bin_code(hmac, offset);
+    return steam_helper(reinterpret_cast<const unsigned char*>(hmac.data()));
+}
+
+// prepare a key for repeated use
+const OTPKey OTPGen::prepareKey(const OTPToken::SecretView &base32_secret,
+                                const OTPToken::ShaAlgorithm &sha_algo,
+                                OTPGenErrorCode *error)
+{
+    OTPKey key;
+
+    if (!check_algo(sha_algo))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return key;
+    }
+
+    if (!Codec::base32Decode(base32_secret, key._key))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return key;
+    }
+
+    switch (sha_algo)
+    {
+        case OTPToken::SHA1:   Internal::hmac_prepare_helper<CryptoPP::SHA1>(key._key, key._inner, key._outer); break;
+        case OTPToken::SHA256: Internal::hmac_prepare_helper<CryptoPP::SHA256>(key._key, key._inner, key._outer); break;
+        case OTPToken::SHA512: Internal::hmac_prepare_helper<CryptoPP::SHA512>(key._key, key._inner, key._outer); break;
+    }
+
+    key._algorithm = sha_algo;
+    return key;
+}
+
+const OTPKey OTPGen::prepareRawKey(const unsigned char *raw, std::size_t size,
+                                   const OTPToken::ShaAlgorithm &sha_algo,
+                                   OTPGenErrorCode *error)
+{
+    OTPKey key;
+
+    if (!check_algo(sha_algo))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return key;
+    }
+
+    if (!raw || size == 0)
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return key;
+    }
+
+    key._key.assign(reinterpret_cast<const char*>(raw), size);
+    switch (sha_algo)
+    {
+        case OTPToken::SHA1:   Internal::hmac_prepare_helper<CryptoPP::SHA1>(key._key, key._inner, key._outer); break;
+        case OTPToken::SHA256: Internal::hmac_prepare_helper<CryptoPP::SHA256>(key._key, key._inner, key._outer); break;
+        case OTPToken::SHA512: Internal::hmac_prepare_helper<CryptoPP::SHA512>(key._key, key._inner, key._outer); break;
+    }
+
+    key._algorithm = sha_algo;
+    return key;
+}
+
+const OTPKey OTPGen::restoreKey(const unsigned char *raw, std::size_t size,
+                                const OTPToken::ShaAlgorithm &sha_algo,
+                                const unsigned char *inner, const unsigned char *outer,
+                                OTPGenErrorCode *error)
+{
+    OTPKey key;
+
+    if (!check_algo(sha_algo))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return key;
+    }
+
+    if (!raw || size == 0 || !inner || !outer)
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return key;
+    }
+
+    key._key.assign(reinterpret_cast<const char*>(raw), size);
+    std::memcpy(key._inner, inner, OTPKey::HMAC_STATE_SIZE);
+    std::memcpy(key._outer, outer, OTPKey::HMAC_STATE_SIZE);
+    key._algorithm = sha_algo;
+    return key;
+}
+
+// compute totp at a given time using a prepared key
+const OTPToken::TokenString OTPGen::computeTOTP(const std::time_t &time,
+                                                const OTPKey &key,
+                                                const OTPToken::DigitType &digits,
+                                                const OTPToken::PeriodType &period,
+                                                OTPGenErrorCode *error)
+{
+    if (!check_otp_length(digits))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+        return {};
+    }
 
-    char code[6];
-    for (auto i = 0; i < 5; i++)
+    if (!check_period(period))
     {
-        int mod = bin_code % steam_alphabet.size();
-        bin_code = bin_code / steam_alphabet.size();
-        code[i] = steam_alphabet[mod];
+        if (error) (*error) = OTPGenErrorCode::InvalidPeriod;
+        return {};
     }
-    code[5] = '\0';
 
-    std::string codeStr(code, code + strlen(code));
-    return codeStr;
+    auto timestamp = static_cast<std::uint64_t>(time / period);
+
+    return hotp_helper(key, timestamp, digits, error);
+}
+
+// compute hotp using a prepared key
+const OTPToken::TokenString OTPGen::computeHOTP(const OTPKey &key,
+                                                const OTPToken::CounterType &counter,
+                                                const OTPToken::DigitType &digits,
+                                                OTPGenErrorCode *error)
+{
+    if (!check_otp_length(digits))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+        return {};
+    }
+
+    return hotp_helper(key, counter, digits, error);
+}
+
+// compute steam token at a given time using a prepared key
+const OTPToken::TokenString OTPGen::computeSteam(const std::time_t &time,
+                                                 const OTPKey &key,
+                                                 OTPGenErrorCode *error)
+{
+    if (key.algorithm() != OTPToken::SHA1)
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return {};
+    }
+
+    if (!key.isValid())
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return {};
+    }
+
+    auto timestamp = static_cast<std::uint64_t>(time / OTPToken::defaultPeriod(OTPToken::Steam));
+
+    unsigned char hmac[SHA512_DIGEST_SIZE];
+    compute_hmac_prepared(key, timestamp, hmac);
+
+    return steam_helper(hmac);
+}
+
+namespace {
+    // amount of keys per executor task by algorithm, keeps the keys and results of a task in the cache,
+    // the default fits most CPUs, AutoTuner measures the best one of the machine
+    static std::atomic<std::size_t> executor_grains[] = {
+        {OTPGen::DEFAULT_BATCH_GRAIN}, {OTPGen::DEFAULT_BATCH_GRAIN},
+        {OTPGen::DEFAULT_BATCH_GRAIN}, {OTPGen::DEFAULT_BATCH_GRAIN},
+    };
+
+    static std::size_t executor_grain(const OTPToken::ShaAlgorithm &algo)
+    {
+        const auto index = static_cast<std::size_t>(algo);
+        return executor_grains[index < 4U ? index : 0U].load(std::memory_order_relaxed);
+    }
+
+    // the grain of the algorithm of the first valid key, the keys of a batch normally share it
+    static std::size_t executor_grain(const OTPKey *keys, std::size_t count)
+    {
+        const auto first = std::find_if(keys, keys + count, [](const OTPKey &key){ return key.isValid(); });
+        return executor_grain(first == keys + count ? OTPToken::SHA1 : first->algorithm());
+    }
+
+    // compute totp for a range of prepared keys with an already validated digits and period
+    static void totp_keys_helper(const std::uint64_t &timestamp,
+                                 const OTPKey *keys,
+                                 std::size_t count,
+                                 const OTPToken::DigitType &digits,
+                                 OTPToken::TokenString *out,
+                                 OTPGenErrorCode *errors)
+    {
+        unsigned char counter[8];
+        encode_counter(timestamp, counter);
+
+        char token[OTPGen::maxDigitLength() + 1];
+        std::size_t generated = 0U;
+        const auto finish = [&](std::size_t i, const unsigned char *digest, const OTPToken::ShaAlgorithm &algo){
+            finalize(digits, truncate(digest, digits, algo), token);
+            out[i].assign(token);
+            ++generated;
+        };
+
+        HmacScheduler scheduler;
+        for (auto i = 0U; i < count; ++i)
+        {
+            if (!keys[i].isValid())
+            {
+                if (errors) errors[i] = OTPGenErrorCode::InvalidBase32Input;
+                continue;
+            }
+            scheduler.push(keys[i], counter, i, finish);
+        }
+        scheduler.flush(finish);
+
+        OTPGEN_PERF_COUNT(CodesGenerated, generated);
+    }
+
+    // compute totp for a range of prepared keys with the kernel of a profile, keys of
+    // another algorithm than the profile are truncated by the generic generator
+    template<class Profile>
+    static void totp_profile_helper(const std::time_t &time,
+                                    const OTPKey *keys,
+                                    std::size_t count,
+                                    OTPToken::TokenString *out,
+                                    OTPGenErrorCode *errors)
+    {
+        unsigned char counter[8];
+        encode_counter(Profile::counter(time), counter);
+
+        char token[Profile::digits + 1];
+        std::size_t generated = 0U;
+        const auto finish = [&](std::size_t i, const unsigned char *digest, const OTPToken::ShaAlgorithm &algo){
+            if (algo == Profile::algorithm)
+            {
+                Internal::format_code<Profile::digits>(Profile::truncate(digest), token);
+            }
+            else
+            {
+                finalize(Profile::digits, truncate(digest, Profile::digits, algo), token);
+            }
+            out[i].assign(token, Profile::digits);
+            ++generated;
+        };
+
+        HmacScheduler scheduler;
+        for (auto i = 0U; i < count; ++i)
+        {
+            if (!keys[i].isValid())
+            {
+                if (errors) errors[i] = OTPGenErrorCode::InvalidBase32Input;
+                continue;
+            }
+            scheduler.push(keys[i], counter, i, finish);
+        }
+        scheduler.flush(finish);
+
+        OTPGEN_PERF_COUNT(CodesGenerated, generated);
+    }
+
+    // the parameter sets used by almost all real tokens, everything else goes
+    // through the generic generator
+    using ProfileKernel = void(*)(const std::time_t&, const OTPKey*, std::size_t, OTPToken::TokenString*, OTPGenErrorCode*);
+    struct ProfileEntry
+    {
+        OTPToken::ShaAlgorithm algorithm;
+        OTPToken::DigitType digits;
+        OTPToken::PeriodType period;
+        ProfileKernel kernel;
+    };
+
+    template<OTPToken::ShaAlgorithm Algo, unsigned Digits, unsigned Period>
+    static constexpr ProfileEntry make_profile()
+    {
+        return {Algo, Digits, Period, &totp_profile_helper<Internal::OTPProfile<Algo, Digits, Period>>};
+    }
+
+    static const constexpr ProfileEntry PROFILES[] = {
+        make_profile<OTPToken::SHA1, 6U, 30U>(),
+        make_profile<OTPToken::SHA1, 8U, 30U>(),
+        make_profile<OTPToken::SHA1, 6U, 60U>(),
+        make_profile<OTPToken::SHA256, 6U, 30U>(),
+        make_profile<OTPToken::SHA256, 8U, 30U>(),
+        make_profile<OTPToken::SHA512, 6U, 30U>(),
+        make_profile<OTPToken::SHA512, 8U, 30U>(),
+        // Authy
+        make_profile<OTPToken::SHA1, 7U, 10U>(),
+    };
+
+    static ProfileKernel find_profile(const OTPToken::ShaAlgorithm &algo,
+                                      const OTPToken::DigitType &digits,
+                                      const OTPToken::PeriodType &period) noexcept
+    {
+        for (auto&& profile : PROFILES)
+        {
+            if (profile.algorithm == algo && profile.digits == digits && profile.period == period)
+            {
+                return profile.kernel;
+            }
+        }
+        return nullptr;
+    }
+
+    // compute steam tokens for a range of prepared keys
+    static void steam_keys_helper(const std::uint64_t &timestamp,
+                                  const OTPKey *keys,
+                                  std::size_t count,
+                                  OTPToken::TokenString *out,
+                                  OTPGenErrorCode *errors)
+    {
+        unsigned char counter[8];
+        encode_counter(timestamp, counter);
+
+        Internal::HmacSha1Lane lanes[LANE_CHUNK_SIZE];
+        std::size_t lane_index[LANE_CHUNK_SIZE];
+        std::size_t lane_count = 0U;
+
+        const auto flush = [&]{
+            Internal::hmacSha1MultiBuffer(lanes, lane_count);
+            OTPGEN_PERF_COUNT(CodesGenerated, lane_count);
+
+            std::uint32_t bin_codes[LANE_CHUNK_SIZE];
+            for (auto j = 0U; j < lane_count; ++j)
+            {
+                const auto &digest = lanes[j].digest;
+                bin_codes[j] = static_cast<std::uint32_t>(compute_bin_code(digest, digest[SHA1_DIGEST_SIZE-1] & 0x0f));
+            }
+
+            // encode position by position over all lanes, the loops vectorize
+            char codes[LANE_CHUNK_SIZE][STEAM_CODE_LENGTH];
+            for (auto i = 0U; i < STEAM_CODE_LENGTH; ++i)
+            {
+                for (auto j = 0U; j < lane_count; ++j)
+                {
+                    codes[j][i] = STEAM_ALPHABET[bin_codes[j] % STEAM_ALPHABET_SIZE];
+                    bin_codes[j] /= STEAM_ALPHABET_SIZE;
+                }
+            }
+
+            for (auto j = 0U; j < lane_count; ++j)
+            {
+                out[lane_index[j]].assign(codes[j], STEAM_CODE_LENGTH);
+            }
+            lane_count = 0U;
+        };
+
+        for (auto i = 0U; i < count; ++i)
+        {
+            const auto &key = keys[i];
+
+            if (key.algorithm() != OTPToken::SHA1)
+            {
+                if (errors) errors[i] = OTPGenErrorCode::InvalidAlgorithm;
+                continue;
+            }
+
+            if (!key.isValid())
+            {
+                if (errors) errors[i] = OTPGenErrorCode::InvalidBase32Input;
+                continue;
+            }
+
+            auto &lane = lanes[lane_count];
+            lane.inner = key.innerState();
+            lane.outer = key.outerState();
+            std::memcpy(lane.value, counter, sizeof(counter));
+            lane_index[lane_count] = i;
+
+            if (++lane_count == LANE_CHUNK_SIZE)
+            {
+                flush();
+            }
+        }
+
+        if (lane_count > 0U)
+        {
+            flush();
+        }
+    }
+
+    // run the helper over all keys, split into tasks of grain keys when an executor is given
+    template<typename Helper>
+    static void run_keys_batch(const std::size_t &count, const std::size_t &grain, Executor *executor, const Helper &helper)
+    {
+        if (executor && count > grain)
+        {
+            executor->parallelFor(count, grain, helper);
+        }
+        else
+        {
+            helper(0U, count);
+        }
+    }
+}
+
+// compute totp for a list of prepared keys at a given time
+void OTPGen::computeTOTPBatch(const std::time_t &time,
+                              const std::vector<OTPKey> &keys,
+                              const OTPToken::DigitType &digits,
+                              const OTPToken::PeriodType &period,
+                              std::vector<OTPToken::TokenString> &out,
+                              std::vector<OTPGenErrorCode> *errors,
+                              Executor *executor)
+{
+    out.assign(keys.size(), {});
+
+    auto error = OTPGenErrorCode::Valid;
+    if (!check_otp_length(digits))
+    {
+        error = OTPGenErrorCode::InvalidDigits;
+    }
+    else if (!check_period(period))
+    {
+        error = OTPGenErrorCode::InvalidPeriod;
+    }
+
+    if (errors)
+    {
+        errors->assign(keys.size(), error);
+    }
+
+    if (error != OTPGenErrorCode::Valid)
+    {
+        return;
+    }
+
+    // the keys of a batch normally share the algorithm, pick the profile of the first valid key
+    const auto first = std::find_if(keys.begin(), keys.end(), [](const OTPKey &key){ return key.isValid(); });
+    const auto kernel = first == keys.end() ? nullptr : find_profile(first->algorithm(), digits, period);
+    if (kernel)
+    {
+        run_keys_batch(keys.size(), executor_grain(first->algorithm()), executor, [&](std::size_t begin, std::size_t end){
+            kernel(time, keys.data() + begin, end - begin,
+                   out.data() + begin, errors ? errors->data() + begin : nullptr);
+        });
+        return;
+    }
+
+    const auto timestamp = static_cast<std::uint64_t>(time / period);
+    const auto grain = first == keys.end() ? executor_grain(OTPToken::SHA1) : executor_grain(first->algorithm());
+    run_keys_batch(keys.size(), grain, executor, [&](std::size_t begin, std::size_t end){
+        totp_keys_helper(timestamp, keys.data() + begin, end - begin, digits,
+                         out.data() + begin, errors ? errors->data() + begin : nullptr);
+    });
+}
+
+bool OTPGen::isProfile(const OTPToken::ShaAlgorithm &algo,
+                       const OTPToken::DigitType &digits,
+                       const OTPToken::PeriodType &period)
+{
+    return find_profile(algo, digits, period) != nullptr;
+}
+
+// compute totp at a given time using a prepared key into the buffer
+bool OTPGen::computeTOTPInto(TokenBuffer &out,
+                             const std::time_t &time,
+                             const OTPKey &key,
+                             const OTPToken::DigitType &digits,
+                             const OTPToken::PeriodType &period,
+                             OTPGenErrorCode *error) noexcept
+{
+    out[0] = '\0';
+
+    if (!check_otp_length(digits))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+        return false;
+    }
+
+    if (!check_period(period))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidPeriod;
+        return false;
+    }
+
+    if (!hotp_into(key, static_cast<std::uint64_t>(time / period), digits, out))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return false;
+    }
+
+    return true;
+}
+
+// compute hotp using a prepared key into the buffer
+bool OTPGen::computeHOTPInto(TokenBuffer &out,
+                             const OTPKey &key,
+                             const OTPToken::CounterType &counter,
+                             const OTPToken::DigitType &digits,
+                             OTPGenErrorCode *error) noexcept
+{
+    out[0] = '\0';
+
+    if (!check_otp_length(digits))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+        return false;
+    }
+
+    if (!hotp_into(key, counter, digits, out))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return false;
+    }
+
+    return true;
+}
+
+// compute steam token at a given time using a prepared key into the buffer
+bool OTPGen::computeSteamInto(TokenBuffer &out,
+                              const std::time_t &time,
+                              const OTPKey &key,
+                              OTPGenErrorCode *error) noexcept
+{
+    out[0] = '\0';
+
+    if (key.algorithm() != OTPToken::SHA1)
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return false;
+    }
+
+    if (!key.isValid())
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return false;
+    }
+
+    unsigned char hmac[SHA512_DIGEST_SIZE];
+    compute_hmac_prepared(key, static_cast<std::uint64_t>(time / OTPToken::defaultPeriod(OTPToken::Steam)), hmac);
+
+    steam_into(hmac, out);
+    return true;
+}
+
+// verify a totp code at a given time
+bool OTPGen::verifyTOTP(const OTPToken::SecretView &base32_secret,
+                        const OTPToken::TokenString &code,
+                        const std::time_t &time,
+                        const unsigned int &window,
+                        const OTPToken::DigitType &digits,
+                        const OTPToken::PeriodType &period,
+                        const OTPToken::ShaAlgorithm &sha_algo,
+                        int *step,
+                        OTPGenErrorCode *error)
+{
+    auto prepare_error = OTPGenErrorCode::Valid;
+    const auto key = prepareKey(base32_secret, sha_algo, &prepare_error);
+    if (prepare_error != OTPGenErrorCode::Valid)
+    {
+        if (error) (*error) = prepare_error;
+        return false;
+    }
+
+    return verifyTOTP(key, code, time, window, digits, period, step, error);
+}
+
+namespace {
+    // verify a totp code, without a hint every step of the window is computed and the first
+    // match from -window to +window wins, with a hint the steps are computed in the order of
+    // its probe sequence and the first match ends the search, the offset of the match is stored,
+    // with a coalescer the codes are shared with concurrent verifications of the same token
+    static bool verify_totp_helper(const OTPKey &key,
+                                   const OTPToken::TokenString &code,
+                                   const std::time_t &time,
+                                   const unsigned int &window,
+                                   const OTPToken::DigitType &digits,
+                                   const OTPToken::PeriodType &period,
+                                   const ClockDrift *hint,
+                                   CodeCoalescer *shared,
+                                   const OTPToken::sqliteTokenID &id,
+                                   int &step,
+                                   OTPGenErrorCode *error)
+    {
+        if (!check_otp_length(digits))
+        {
+            if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+            return false;
+        }
+
+        if (!check_period(period))
+        {
+            if (error) (*error) = OTPGenErrorCode::InvalidPeriod;
+            return false;
+        }
+
+        if (!key.isValid())
+        {
+            if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+            return false;
+        }
+
+        // malformed codes can never match, this only depends on the public code length
+        std::uint32_t submitted;
+        if (!parse_code(code, digits, submitted))
+        {
+            return false;
+        }
+
+        OTPGEN_PERF_COUNT(CodesVerified, 1U);
+        const auto counter = static_cast<std::int64_t>(time / period);
+        const auto offsets = static_cast<std::int64_t>(window);
+
+        // the comparison is branch-free to avoid leaking which step matched through timing,
+        // with a hint only the amount of computed steps of a matching code depends on the step
+        std::uint32_t matched = 0U;
+        std::uint32_t matched_offset = 0U;
+
+        unsigned char hmac[SHA512_DIGEST_SIZE];
+        auto n = 0;
+        for (; n <= 2 * offsets; ++n)
+        {
+            const auto offset = hint ? static_cast<std::int64_t>(hint->probe(static_cast<unsigned>(n), window)) : n - offsets;
+            if (counter + offset < 0)
+            {
+                continue;
+            }
+
+            // concurrent verifications of the token share the binary code of the step
+            std::uint32_t bin_code;
+            if (shared)
+            {
+                bin_code = shared->code(id, static_cast<std::uint64_t>(counter + offset), [&]{
+                    compute_hmac_prepared(key, static_cast<std::uint64_t>(counter + offset), hmac);
+                    return dynamic_truncation(hmac, key.algorithm());
+                });
+            }
+            else
+            {
+                compute_hmac_prepared(key, static_cast<std::uint64_t>(counter + offset), hmac);
+                bin_code = dynamic_truncation(hmac, key.algorithm());
+            }
+            const auto diff = CODE_REDUCERS[digits](bin_code) ^ submitted;
+
+            // 1 if diff is zero, 0 otherwise
+            const auto equal = 1U ^ ((diff | (0U - diff)) >> 31);
+            const auto take = 0U - (equal & ~matched & 1U);
+
+            matched_offset = (matched_offset & ~take) | (static_cast<std::uint32_t>(offset) & take);
+            matched |= equal;
+
+            if (hint && matched)
+            {
+                break;
+            }
+        }
+
+        std::memset(hmac, 0, sizeof(hmac));
+        OTPGEN_PERF_COUNT(StepsVerified, static_cast<std::uint64_t>(std::min<std::int64_t>(n + 1, 2 * offsets + 1)));
+
+        if (matched)
+        {
+            step = static_cast<int>(static_cast<std::int32_t>(matched_offset));
+        }
+
+        return matched != 0U;
+    }
+}
+
+// verify a totp code using a prepared key
+bool OTPGen::verifyTOTP(const OTPKey &key,
+                        const OTPToken::TokenString &code,
+                        const std::time_t &time,
+                        const unsigned int &window,
+                        const OTPToken::DigitType &digits,
+                        const OTPToken::PeriodType &period,
+                        int *step,
+                        OTPGenErrorCode *error)
+{
+    int offset = 0;
+    if (!verify_totp_helper(key, code, time, window, digits, period, nullptr, nullptr, 0, offset, error))
+    {
+        return false;
+    }
+
+    if (step)
+    {
+        (*step) = offset;
+    }
+    return true;
+}
+
+// verify a totp code starting at the learned drift of the token
+bool OTPGen::verifyTOTP(const OTPKey &key,
+                        const OTPToken::TokenString &code,
+                        const std::time_t &time,
+                        const unsigned int &window,
+                        const OTPToken::DigitType &digits,
+                        const OTPToken::PeriodType &period,
+                        ClockDrift &drift,
+                        int *step,
+                        OTPGenErrorCode *error)
+{
+    int offset = 0;
+    if (!verify_totp_helper(key, code, time, window, digits, period, &drift, nullptr, 0, offset, error))
+    {
+        return false;
+    }
+
+    drift.learn(offset);
+    if (step)
+    {
+        (*step) = offset;
+    }
+    return true;
+}
+
+// resynchronize a drifted hotp counter
+bool OTPGen::resyncHOTP(const OTPToken::SecretView &base32_secret,
+                        const OTPToken::CounterType &counter,
+                        const OTPToken::DigitType &digits,
+                        const OTPToken::ShaAlgorithm &sha_algo,
+                        const OTPToken::TokenString &first_code,
+                        const OTPToken::TokenString &second_code,
+                        const unsigned int &look_ahead,
+                        OTPToken::CounterType &new_counter,
+                        OTPGenErrorCode *error)
+{
+    auto prepare_error = OTPGenErrorCode::Valid;
+    const auto key = prepareKey(base32_secret, sha_algo, &prepare_error);
+    if (prepare_error != OTPGenErrorCode::Valid)
+    {
+        if (error) (*error) = prepare_error;
+        return false;
+    }
+
+    return resyncHOTP(key, counter, digits, first_code, second_code, look_ahead, new_counter, error);
+}
+
+// resynchronize a drifted hotp counter using a prepared key
+bool OTPGen::resyncHOTP(const OTPKey &key,
+                        const OTPToken::CounterType &counter,
+                        const OTPToken::DigitType &digits,
+                        const OTPToken::TokenString &first_code,
+                        const OTPToken::TokenString &second_code,
+                        const unsigned int &look_ahead,
+                        OTPToken::CounterType &new_counter,
+                        OTPGenErrorCode *error)
+{
+    if (!check_otp_length(digits))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+        return false;
+    }
+
+    if (!key.isValid())
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+        return false;
+    }
+
+    const auto require_second = !second_code.empty();
+
+    std::uint32_t first_value, second_value = 0U;
+    if (!parse_code(first_code, digits, first_value) ||
+        (require_second && !parse_code(second_code, digits, second_value)))
+    {
+        return false;
+    }
+
+    // the new counter must still fit into the token counter
+    const std::uint64_t max_counter = OTPGen::maxCounter();
+    const std::uint64_t first = counter;
+    const auto last = std::min<std::uint64_t>(first + look_ahead, max_counter - (require_second ? 2U : 1U));
+    if (first > last)
+    {
+        return false;
+    }
+
+    // scan the window in chunks, a match of the first code at the end of
+    // a chunk is carried over to check the second code on the next chunk
+    std::uint32_t values[HOTP_CHUNK_SIZE];
+    auto pending = false;
+
+    // with a second code the window is extended by one counter to check the code following the last one
+    const auto end = last + (require_second ? 1U : 0U);
+    for (auto chunk = first; chunk <= end; chunk += HOTP_CHUNK_SIZE)
+    {
+        const auto count = static_cast<std::size_t>(std::min<std::uint64_t>(HOTP_CHUNK_SIZE, end - chunk + 1U));
+        hotp_values(key, chunk, count, digits, values);
+
+        for (auto i = 0U; i < count; ++i)
+        {
+            const auto c = chunk + i;
+
+            if (pending && values[i] == second_value)
+            {
+                new_counter = static_cast<OTPToken::CounterType>(c + 1U);
+                return true;
+            }
+
+            pending = false;
+            if (c <= last && values[i] == first_value)
+            {
+                if (!require_second)
+                {
+                    new_counter = static_cast<OTPToken::CounterType>(c + 1U);
+                    return true;
+                }
+                pending = true;
+            }
+        }
+    }
+
+    return false;
+}
+
+namespace {
+    static std::atomic<BatchEngine*> batch_engine{nullptr};
+
+    // tuned offload threshold, 0 leaves it to the engine
+    static std::atomic<std::size_t> offload_minimum_work{0U};
+
+    // chunks of hotp values per executor task
+    static const constexpr std::size_t VALUES_GRAIN = 16U;
+
+    // values of a resync block, windows which don't fit are resynced key by key
+    static const constexpr std::size_t RESYNC_BLOCK_VALUES = std::size_t(1U) << 22U;
+
+    // computeHOTPValues() of a range of keys, the digits are already checked
+    static void hotp_values_helper(const OTPKey *keys,
+                                   std::size_t key_count,
+                                   const std::uint64_t *first,
+                                   std::size_t count,
+                                   const OTPToken::DigitType &digits,
+                                   std::uint32_t *out,
+                                   OTPGenErrorCode *errors,
+                                   Executor *executor)
+    {
+        // the engine takes the job only as a whole
+        const auto engine = OTPGen::batchEngine();
+        const auto minimum_work = engine ? OTPGen::offloadMinimumWork() : 0U;
+        auto offload = engine && key_count * count >= (minimum_work != 0U ? minimum_work : engine->minimumWork());
+        for (auto i = 0U; i < key_count; ++i)
+        {
+            if (!keys[i].isValid())
+            {
+                if (errors) errors[i] = OTPGenErrorCode::InvalidBase32Input;
+                offload = false;
+            }
+            else if (offload && !engine->supports(keys[i].algorithm()))
+            {
+                offload = false;
+            }
+        }
+        if (offload && engine->computeHOTPValues(keys, key_count, first, count, digits, out))
+        {
+            OTPGEN_PERF_COUNT(CodesGenerated, key_count * count);
+            return;
+        }
+
+        // every task is a chunk of the counters of one key
+        const auto chunks = (count + HOTP_CHUNK_SIZE - 1U) / HOTP_CHUNK_SIZE;
+        const auto task = [&](std::size_t begin, std::size_t end){
+            for (auto t = begin; t < end; ++t)
+            {
+                const auto key = t / chunks;
+                if (!keys[key].isValid())
+                {
+                    continue;
+                }
+                const auto offset = (t % chunks) * HOTP_CHUNK_SIZE;
+                const auto size = std::min(HOTP_CHUNK_SIZE, count - offset);
+                hotp_values(keys[key], first[key] + offset, size, digits, out + key * count + offset);
+                OTPGEN_PERF_COUNT(CodesGenerated, size);
+            }
+        };
+
+        const auto tasks = key_count * chunks;
+        if (executor && tasks > VALUES_GRAIN)
+        {
+            executor->parallelFor(tasks, VALUES_GRAIN, task);
+        }
+        else
+        {
+            task(0U, tasks);
+        }
+    }
+}
+
+void OTPGen::setBatchEngine(BatchEngine *engine)
+{
+    batch_engine.store(engine, std::memory_order_release);
+}
+
+BatchEngine *OTPGen::batchEngine()
+{
+    return batch_engine.load(std::memory_order_acquire);
+}
+
+void OTPGen::setOffloadMinimumWork(const std::size_t &values)
+{
+    offload_minimum_work.store(values, std::memory_order_relaxed);
+}
+
+std::size_t OTPGen::offloadMinimumWork()
+{
+    return offload_minimum_work.load(std::memory_order_relaxed);
+}
+
+void OTPGen::setBatchGrain(const OTPToken::ShaAlgorithm &algo, const std::size_t &grain)
+{
+    const auto index = static_cast<std::size_t>(algo);
+    if (index == 0U || index >= 4U)
+    {
+        return;
+    }
+    executor_grains[index].store(grain != 0U ? grain : DEFAULT_BATCH_GRAIN, std::memory_order_relaxed);
+}
+
+std::size_t OTPGen::batchGrain(const OTPToken::ShaAlgorithm &algo)
+{
+    return executor_grain(algo);
+}
+
+// compute the hotp values of consecutive counters for a list of prepared keys
+void OTPGen::computeHOTPValues(const std::vector<OTPKey> &keys,
+                               const std::vector<std::uint64_t> &first,
+                               const std::size_t &count,
+                               const OTPToken::DigitType &digits,
+                               std::vector<std::uint32_t> &out,
+                               std::vector<OTPGenErrorCode> *errors,
+                               Executor *executor)
+{
+    const auto key_count = std::min(keys.size(), first.size());
+    out.assign(key_count * count, 0U);
+
+    const auto error = check_otp_length(digits) ? OTPGenErrorCode::Valid : OTPGenErrorCode::InvalidDigits;
+    if (errors)
+    {
+        errors->assign(key_count, error);
+    }
+    if (error != OTPGenErrorCode::Valid || out.empty())
+    {
+        return;
+    }
+
+    hotp_values_helper(keys.data(), key_count, first.data(), count, digits, out.data(),
+                       errors ? errors->data() : nullptr, executor);
+}
+
+// resynchronize the hotp counters of a list of prepared keys
+void OTPGen::resyncHOTPBatch(const std::vector<OTPKey> &keys,
+                             const std::vector<OTPToken::CounterType> &counters,
+                             const OTPToken::DigitType &digits,
+                             const std::vector<OTPToken::TokenString> &first_codes,
+                             const std::vector<OTPToken::TokenString> &second_codes,
+                             const unsigned int &look_ahead,
+                             std::vector<OTPToken::CounterType> &new_counters,
+                             std::vector<std::uint8_t> &matched,
+                             Executor *executor)
+{
+    const auto key_count = std::min({keys.size(), counters.size(), first_codes.size()});
+    new_counters.assign(counters.begin(), counters.begin() + static_cast<std::ptrdiff_t>(key_count));
+    matched.assign(key_count, 0U);
+    if (!check_otp_length(digits) || key_count == 0U)
+    {
+        return;
+    }
+
+    const auto second_code = [&](std::size_t i) -> const OTPToken::TokenString& {
+        static const OTPToken::TokenString none;
+        return i < second_codes.size() ? second_codes[i] : none;
+    };
+
+    // the window and the counter following it
+    const auto count = static_cast<std::size_t>(look_ahead) + 2U;
+    if (count > RESYNC_BLOCK_VALUES)
+    {
+        for (auto i = 0U; i < key_count; ++i)
+        {
+            matched[i] = resyncHOTP(keys[i], counters[i], digits, first_codes[i], second_code(i), look_ahead, new_counters[i]) ? 1U : 0U;
+        }
+        return;
+    }
+
+    const auto block = std::max<std::size_t>(1U, RESYNC_BLOCK_VALUES / count);
+    std::vector<std::uint64_t> first(key_count);
+    std::copy(counters.begin(), counters.begin() + static_cast<std::ptrdiff_t>(key_count), first.begin());
+    std::vector<std::uint32_t> values;
+    for (std::size_t begin = 0U; begin < key_count; begin += block)
+    {
+        const auto size = std::min(block, key_count - begin);
+        values.assign(size * count, 0U);
+        hotp_values_helper(keys.data() + begin, size, first.data() + begin, count, digits, values.data(), nullptr, executor);
+
+        // same search as resyncHOTP(), the second code must follow the first one
+        for (auto i = begin; i < begin + size; ++i)
+        {
+            const auto require_second = !second_code(i).empty();
+            std::uint32_t first_value, second_value = 0U;
+            if (!keys[i].isValid() || !parse_code(first_codes[i], digits, first_value) ||
+                (require_second && !parse_code(second_code(i), digits, second_value)))
+            {
+                continue;
+            }
+
+            const std::uint64_t max_counter = OTPGen::maxCounter();
+            const auto last = std::min<std::uint64_t>(first[i] + look_ahead, max_counter - (require_second ? 2U : 1U));
+            const auto row = values.data() + (i - begin) * count;
+            for (auto c = first[i]; c <= last; ++c)
+            {
+                const auto j = c - first[i];
+                if (row[j] == first_value && (!require_second || row[j + 1U] == second_value))
+                {
+                    new_counters[i] = static_cast<OTPToken::CounterType>(c + (require_second ? 2U : 1U));
+                    matched[i] = 1U;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// compute steam tokens for a list of prepared keys at a given time
+void OTPGen::computeSteamBatch(const std::time_t &time,
+                               const std::vector<OTPKey> &keys,
+                               std::vector<OTPToken::TokenString> &out,
+                               std::vector<OTPGenErrorCode> *errors,
+                               Executor *executor)
+{
+    out.assign(keys.size(), {});
+    if (errors)
+    {
+        errors->assign(keys.size(), OTPGenErrorCode::Valid);
+    }
+
+    const auto timestamp = static_cast<std::uint64_t>(time / OTPToken::defaultPeriod(OTPToken::Steam));
+    run_keys_batch(keys.size(), executor_grain(OTPToken::SHA1), executor, [&](std::size_t begin, std::size_t end){
+        steam_keys_helper(timestamp, keys.data() + begin, end - begin,
+                          out.data() + begin, errors ? errors->data() + begin : nullptr);
+    });
+}
+
+// verify a list of totp codes at a given time using prepared keys
+bool OTPGen::verifyTOTP(const OTPKey &key,
+                        const OTPToken::TokenString &code,
+                        const std::time_t &time,
+                        const unsigned int &window,
+                        const OTPToken::DigitType &digits,
+                        const OTPToken::PeriodType &period,
+                        UsedCodeStore &used,
+                        const OTPToken::sqliteTokenID &id,
+                        int *step,
+                        OTPGenErrorCode *error,
+                        ClockDrift *drift,
+                        CodeCoalescer *shared)
+{
+    int offset = 0;
+    if (!verify_totp_helper(key, code, time, window, digits, period, drift, shared, id, offset, error))
+    {
+        return false;
+    }
+
+    // the step can be verified until the window doesn't reach it anymore
+    const auto matched = static_cast<std::int64_t>(time / period) + offset;
+    const auto expiry = static_cast<std::time_t>((matched + static_cast<std::int64_t>(window) + 1) * period);
+    switch (used.insert(id, static_cast<std::uint64_t>(matched), expiry, time))
+    {
+        case UsedCodeStore::Accepted:
+            break;
+        case UsedCodeStore::Reused:
+            OTPGEN_PERF_COUNT(CodesReused, 1U);
+            if (error) (*error) = OTPGenErrorCode::CodeReused;
+            return false;
+        case UsedCodeStore::Full:
+            if (error) (*error) = OTPGenErrorCode::UsedCodeStoreFull;
+            return false;
+    }
+
+    // only accepted codes are learned from, a replayed code says nothing about the clock
+    if (drift)
+    {
+        drift->learn(offset);
+    }
+    if (step)
+    {
+        (*step) = offset;
+    }
+    return true;
+}
+
+void OTPGen::verifyTOTPBatch(const std::vector<OTPKey> &keys,
+                             const std::vector<OTPToken::TokenString> &codes,
+                             const std::time_t &time,
+                             const unsigned int &window,
+                             const OTPToken::DigitType &digits,
+                             const OTPToken::PeriodType &period,
+                             std::vector<std::uint8_t> &matched,
+                             Executor *executor)
+{
+    const auto count = std::min(keys.size(), codes.size());
+    matched.assign(count, 0U);
+
+    run_keys_batch(count, executor_grain(keys.data(), count), executor, [&](std::size_t begin, std::size_t end){
+        for (auto i = begin; i < end; ++i)
+        {
+            matched[i] = verifyTOTP(keys[i], codes[i], time, window, digits, period) ? 1U : 0U;
+        }
+    });
+}
+
+void OTPGen::verifyTOTPBatch(const std::vector<OTPKey> &keys,
+                             const std::vector<OTPToken::TokenString> &codes,
+                             const std::vector<OTPToken::sqliteTokenID> &ids,
+                             const std::time_t &time,
+                             const unsigned int &window,
+                             const OTPToken::DigitType &digits,
+                             const OTPToken::PeriodType &period,
+                             UsedCodeStore &used,
+                             std::vector<std::uint8_t> &matched,
+                             Executor *executor,
+                             ClockDrift *drifts,
+                             CodeCoalescer *shared)
+{
+    const auto count = std::min({keys.size(), codes.size(), ids.size()});
+    matched.assign(count, 0U);
+
+    run_keys_batch(count, executor_grain(keys.data(), count), executor, [&](std::size_t begin, std::size_t end){
+        for (auto i = begin; i < end; ++i)
+        {
+            matched[i] = verifyTOTP(keys[i], codes[i], time, window, digits, period, used, ids[i],
+                                    nullptr, nullptr, drifts ? drifts + i : nullptr, shared) ? 1U : 0U;
+        }
+    });
+}
+
+// stream the codes of a token
+OTPGen::TOTPSeries::TOTPSeries(const OTPToken &token, const std::time_t &t_begin, const std::time_t &t_end)
+{
+    if (token.type() == OTPToken::Steam)
+    {
+        this->_steam = true;
+        this->_key = prepareKey(token.secret(), OTPToken::SHA1);
+        this->_period = OTPToken::defaultPeriod(OTPToken::Steam);
+    }
+    else if (token.type() == OTPToken::TOTP)
+    {
+        this->_key = prepareKey(token.secret(), token.algorithm());
+        this->_digits = token.digitLength();
+        this->_period = token.period();
+    }
+
+    this->init(t_begin, t_end);
+}
+
+OTPGen::TOTPSeries::TOTPSeries(const OTPKey &key,
+                               const OTPToken::DigitType &digits,
+                               const OTPToken::PeriodType &period,
+                               const std::time_t &t_begin,
+                               const std::time_t &t_end)
+    : _key(key),
+      _digits(digits),
+      _period(period)
+{
+    this->init(t_begin, t_end);
+}
+
+void OTPGen::TOTPSeries::init(const std::time_t &t_begin, const std::time_t &t_end)
+{
+    if (!this->_key.isValid() || !check_period(this->_period) ||
+        (!this->_steam && !check_otp_length(this->_digits)) ||
+        t_begin < 0 || t_end <= t_begin)
+    {
+        this->_counter = this->_end = 0U;
+        return;
+    }
+
+    // the period of t_begin up to and including the period of t_end - 1
+    this->_counter = static_cast<std::uint64_t>(t_begin / this->_period);
+    this->_end = static_cast<std::uint64_t>((t_end - 1) / this->_period) + 1U;
+    this->_valid = true;
+}
+
+bool OTPGen::TOTPSeries::next(TokenBuffer &code, std::time_t *time) noexcept
+{
+    code[0] = '\0';
+
+    if (this->_position == this->_buffered)
+    {
+        if (this->_counter >= this->_end)
+        {
+            return false;
+        }
+
+        // compute the next chunk of codes at once
+        this->_first = this->_counter;
+        this->_buffered = static_cast<std::size_t>(std::min<std::uint64_t>(CHUNK_SIZE, this->_end - this->_counter));
+        this->_position = 0U;
+        hotp_bin_codes(this->_key, this->_counter, this->_buffered, this->_bin_codes);
+        this->_counter += this->_buffered;
+    }
+
+    const auto bin_code = this->_bin_codes[this->_position];
+    if (this->_steam)
+    {
+        steam_encode(bin_code, code);
+    }
+    else
+    {
+        finalize(this->_digits, static_cast<int>(bin_code), code);
+    }
+
+    if (time)
+    {
+        (*time) = static_cast<std::time_t>((this->_first + this->_position) * this->_period);
+    }
+
+    ++this->_position;
+    return true;
+}
+
+std::uint64_t OTPGen::TOTPSeries::remaining() const
+{
+    return (this->_end - this->_counter) + (this->_buffered - this->_position);
 }
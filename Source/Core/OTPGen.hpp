@@ -15,28 +15,40 @@
  */
 
 #include <string>
+#include <vector>
 #include <numeric>
+#include <limits>
 #include <ctime>
 
 #include "OTPToken.hpp"
+#include "OTPKey.hpp"
 #include "OTPGenErrorCodes.hpp"
 
+class BatchEngine;
+class ClockDrift;
+class CodeCoalescer;
+class Executor;
+class UsedCodeStore;
+
 class OTPGen
 {
     OTPGen() = delete;
 
 public:
 
+    // buffer for the allocation-free code generators, fits the longest possible code
+    using TokenBuffer = char[11];
+
     // library limits, going beyond this values may cause a segmentation fault
-    inline static OTPToken::DigitType minDigitLength() { return 3U; }
-    inline static OTPToken::DigitType maxDigitLength() { return 10U; }
-    inline static OTPToken::PeriodType minPeriod() { return 1U; }
-    inline static OTPToken::PeriodType maxPeriod() { return 120U; }
+    inline static constexpr OTPToken::DigitType minDigitLength() { return 3U; }
+    inline static constexpr OTPToken::DigitType maxDigitLength() { return 10U; }
+    inline static constexpr OTPToken::PeriodType minPeriod() { return 1U; }
+    inline static constexpr OTPToken::PeriodType maxPeriod() { return 120U; }
     inline static OTPToken::CounterType minCounter() { return 0U; }
     inline static OTPToken::CounterType maxCounter() { return std::numeric_limits<OTPToken::CounterType>::max(); }
 
-    // compute totp at current time
-    static const OTPToken::TokenString computeTOTP(const OTPToken::TokenSecret &base32_secret,
+    // compute totp at the time of the default clock
+    static const OTPToken::TokenString computeTOTP(const OTPToken::SecretView &base32_secret,
                                                    const OTPToken::DigitType &digits,
                                                    const OTPToken::PeriodType &period,
                                                    const OTPToken::ShaAlgorithm &sha_algo,
@@ -44,27 +56,317 @@ public:
 
     // compute totp at a given time
     static const OTPToken::TokenString computeTOTP(const std::time_t &time,
-                                                   const OTPToken::TokenSecret &base32_secret,
+                                                   const OTPToken::SecretView &base32_secret,
                                                    const OTPToken::DigitType &digits,
                                                    const OTPToken::PeriodType &period,
                                                    const OTPToken::ShaAlgorithm &sha_algo,
                                                    OTPGenErrorCode *error = nullptr);
 
+    // compute totp for a list of tokens at a given time
+    // the keys are prepared in chunks and hashed in parallel by algorithm using the
+    // multi-buffer SIMD backends, results are stored at the same index as the token
+    // non-TOTP tokens and invalid tokens end up as empty string
+    static void computeTOTPBatch(const std::time_t &time,
+                                 const std::vector<OTPToken> &tokens,
+                                 std::vector<OTPToken::TokenString> &out,
+                                 std::vector<OTPGenErrorCode> *errors = nullptr);
+
     // compute hotp
-    static const OTPToken::TokenString computeHOTP(const OTPToken::TokenSecret &base32_secret,
+    static const OTPToken::TokenString computeHOTP(const OTPToken::SecretView &base32_secret,
                                                    const OTPToken::CounterType &counter,
                                                    const OTPToken::DigitType &digits,
                                                    const OTPToken::ShaAlgorithm &sha_algo,
                                                    OTPGenErrorCode *error = nullptr);
 
-    // compute steam token at current time
-    static const OTPToken::TokenString computeSteam(const OTPToken::TokenSecret &base32_secret,
+    // compute steam token at the time of the default clock, corrected by the Steam offset (see Clock)
+    static const OTPToken::TokenString computeSteam(const OTPToken::SecretView &base32_secret,
                                                     OTPGenErrorCode *error = nullptr);
 
     // compute steam token at a given time
     static const OTPToken::TokenString computeSteam(const std::time_t &time,
-                                                    const OTPToken::TokenSecret &base32_secret,
+                                                    const OTPToken::SecretView &base32_secret,
                                                     OTPGenErrorCode *error = nullptr);
+
+    // decode a secret once for repeated use with the overloads below
+    // on error an invalid key is returned
+    static const OTPKey prepareKey(const OTPToken::SecretView &base32_secret,
+                                   const OTPToken::ShaAlgorithm &sha_algo,
+                                   OTPGenErrorCode *error = nullptr);
+
+    // same for key bytes which are already decoded, like the keys of a TokenSetView
+    static const OTPKey prepareRawKey(const unsigned char *key, std::size_t size,
+                                      const OTPToken::ShaAlgorithm &sha_algo,
+                                      OTPGenErrorCode *error = nullptr);
+
+    // rebuilds a key prepared before from its key bytes and HMAC states, like the keys
+    // of a token snapshot in shared memory, the key schedule isn't computed again
+    static const OTPKey restoreKey(const unsigned char *key, std::size_t size,
+                                   const OTPToken::ShaAlgorithm &sha_algo,
+                                   const unsigned char *inner, const unsigned char *outer,
+                                   OTPGenErrorCode *error = nullptr);
+
+    // compute totp at a given time using a prepared key
+    static const OTPToken::TokenString computeTOTP(const std::time_t &time,
+                                                   const OTPKey &key,
+                                                   const OTPToken::DigitType &digits,
+                                                   const OTPToken::PeriodType &period,
+                                                   OTPGenErrorCode *error = nullptr);
+
+    // compute hotp using a prepared key
+    static const OTPToken::TokenString computeHOTP(const OTPKey &key,
+                                                   const OTPToken::CounterType &counter,
+                                                   const OTPToken::DigitType &digits,
+                                                   OTPGenErrorCode *error = nullptr);
+
+    // compute steam token at a given time using a prepared key (must be SHA1)
+    static const OTPToken::TokenString computeSteam(const std::time_t &time,
+                                                    const OTPKey &key,
+                                                    OTPGenErrorCode *error = nullptr);
+
+    // compute totp for a list of prepared keys sharing the same digits and period
+    // keys are hashed in parallel using the multi-buffer SIMD backend selected for this
+    // CPU, mixed algorithms are packed into separate lanes, results are stored at the
+    // same index as the key
+    // with an executor large lists are split into tasks running on multiple threads
+    // common parameter sets run a kernel specialized at compile time (see isProfile)
+    static void computeTOTPBatch(const std::time_t &time,
+                                 const std::vector<OTPKey> &keys,
+                                 const OTPToken::DigitType &digits,
+                                 const OTPToken::PeriodType &period,
+                                 std::vector<OTPToken::TokenString> &out,
+                                 std::vector<OTPGenErrorCode> *errors = nullptr,
+                                 Executor *executor = nullptr);
+
+    // checks if the batch generator has a specialized kernel for the parameters
+    static bool isProfile(const OTPToken::ShaAlgorithm &algo,
+                          const OTPToken::DigitType &digits,
+                          const OTPToken::PeriodType &period);
+
+    // compute steam tokens for a list of prepared keys (must be SHA1) at a given time
+    // keys are hashed in parallel using the multi-buffer SIMD backend,
+    // results are stored at the same index as the key
+    static void computeSteamBatch(const std::time_t &time,
+                                  const std::vector<OTPKey> &keys,
+                                  std::vector<OTPToken::TokenString> &out,
+                                  std::vector<OTPGenErrorCode> *errors = nullptr,
+                                  Executor *executor = nullptr);
+
+    // allocation-free variants of the prepared key generators
+    // the code is written into the given buffer, an empty string is written on error
+    static bool computeTOTPInto(TokenBuffer &out,
+                                const std::time_t &time,
+                                const OTPKey &key,
+                                const OTPToken::DigitType &digits,
+                                const OTPToken::PeriodType &period,
+                                OTPGenErrorCode *error = nullptr) noexcept;
+
+    static bool computeHOTPInto(TokenBuffer &out,
+                                const OTPKey &key,
+                                const OTPToken::CounterType &counter,
+                                const OTPToken::DigitType &digits,
+                                OTPGenErrorCode *error = nullptr) noexcept;
+
+    static bool computeSteamInto(TokenBuffer &out,
+                                 const std::time_t &time,
+                                 const OTPKey &key,
+                                 OTPGenErrorCode *error = nullptr) noexcept;
+
+    // verify a totp code at a given time, accepting a clock skew of up to ±window steps
+    // all steps are always computed and compared in constant time, on success the offset
+    // of the matching step is stored in step (-window..+window)
+    static bool verifyTOTP(const OTPToken::SecretView &base32_secret,
+                           const OTPToken::TokenString &code,
+                           const std::time_t &time,
+                           const unsigned int &window,
+                           const OTPToken::DigitType &digits,
+                           const OTPToken::PeriodType &period,
+                           const OTPToken::ShaAlgorithm &sha_algo,
+                           int *step = nullptr,
+                           OTPGenErrorCode *error = nullptr);
+
+    // verify a totp code using a prepared key
+    static bool verifyTOTP(const OTPKey &key,
+                           const OTPToken::TokenString &code,
+                           const std::time_t &time,
+                           const unsigned int &window,
+                           const OTPToken::DigitType &digits,
+                           const OTPToken::PeriodType &period,
+                           int *step = nullptr,
+                           OTPGenErrorCode *error = nullptr);
+
+    // verify a totp code starting at the learned clock drift of the token, the steps are
+    // computed from the most likely one outwards and the first match ends the search,
+    // the drift learns from every match; a code which doesn't match still computes
+    // every step, only the time of a successful verification depends on the step
+    static bool verifyTOTP(const OTPKey &key,
+                           const OTPToken::TokenString &code,
+                           const std::time_t &time,
+                           const unsigned int &window,
+                           const OTPToken::DigitType &digits,
+                           const OTPToken::PeriodType &period,
+                           ClockDrift &drift,
+                           int *step = nullptr,
+                           OTPGenErrorCode *error = nullptr);
+
+    // verify a totp code and mark the matched step of the token as used in the store,
+    // the check and the insert are one atomic operation, a code which was accepted
+    // before is rejected with CodeReused until its step leaves the window,
+    // with a drift the search starts at it and accepted codes are learned from,
+    // with a coalescer the codes of the token's steps are shared with concurrent verifications
+    static bool verifyTOTP(const OTPKey &key,
+                           const OTPToken::TokenString &code,
+                           const std::time_t &time,
+                           const unsigned int &window,
+                           const OTPToken::DigitType &digits,
+                           const OTPToken::PeriodType &period,
+                           UsedCodeStore &used,
+                           const OTPToken::sqliteTokenID &id,
+                           int *step = nullptr,
+                           OTPGenErrorCode *error = nullptr,
+                           ClockDrift *drift = nullptr,
+                           CodeCoalescer *shared = nullptr);
+
+    // verify a list of totp codes using prepared keys, codes are matched by index
+    // the result for every key is 1 if the code matched and 0 otherwise
+    static void verifyTOTPBatch(const std::vector<OTPKey> &keys,
+                                const std::vector<OTPToken::TokenString> &codes,
+                                const std::time_t &time,
+                                const unsigned int &window,
+                                const OTPToken::DigitType &digits,
+                                const OTPToken::PeriodType &period,
+                                std::vector<std::uint8_t> &matched,
+                                Executor *executor = nullptr);
+
+    // same with replay protection, ids are the token ids of the keys,
+    // reused codes are reported as not matched, drifts are the learned drifts
+    // of the keys by index which are updated in place, the coalescer shares the
+    // codes of the same token within the batch and with concurrent ones
+    static void verifyTOTPBatch(const std::vector<OTPKey> &keys,
+                                const std::vector<OTPToken::TokenString> &codes,
+                                const std::vector<OTPToken::sqliteTokenID> &ids,
+                                const std::time_t &time,
+                                const unsigned int &window,
+                                const OTPToken::DigitType &digits,
+                                const OTPToken::PeriodType &period,
+                                UsedCodeStore &used,
+                                std::vector<std::uint8_t> &matched,
+                                Executor *executor = nullptr,
+                                ClockDrift *drifts = nullptr,
+                                CodeCoalescer *shared = nullptr);
+
+    // resynchronize a drifted hotp counter by searching the codes of the look-ahead window
+    // counter..counter+look_ahead, with a second code both codes must match on consecutive
+    // counters, on success the counter following the last matched code is stored in new_counter
+    static bool resyncHOTP(const OTPToken::SecretView &base32_secret,
+                           const OTPToken::CounterType &counter,
+                           const OTPToken::DigitType &digits,
+                           const OTPToken::ShaAlgorithm &sha_algo,
+                           const OTPToken::TokenString &first_code,
+                           const OTPToken::TokenString &second_code,
+                           const unsigned int &look_ahead,
+                           OTPToken::CounterType &new_counter,
+                           OTPGenErrorCode *error = nullptr);
+
+    // resynchronize a drifted hotp counter using a prepared key
+    static bool resyncHOTP(const OTPKey &key,
+                           const OTPToken::CounterType &counter,
+                           const OTPToken::DigitType &digits,
+                           const OTPToken::TokenString &first_code,
+                           const OTPToken::TokenString &second_code,
+                           const unsigned int &look_ahead,
+                           OTPToken::CounterType &new_counter,
+                           OTPGenErrorCode *error = nullptr);
+
+    // installs the engine large jobs of hotp values are offloaded to (see BatchEngine), the
+    // engine isn't owned and must outlive its use, nullptr computes everything on the CPU
+    static void setBatchEngine(BatchEngine *engine);
+    static BatchEngine *batchEngine();
+
+    // smallest job (keys * count values) handed to the batch engine, 0 uses the minimumWork() of the engine
+    static void setOffloadMinimumWork(const std::size_t &values);
+    static std::size_t offloadMinimumWork();
+
+    // keys per executor task of the batch generators and verifiers for keys of the algorithm,
+    // batches use the grain of their first valid key, 0 restores the default (see AutoTuner)
+    static void setBatchGrain(const OTPToken::ShaAlgorithm &algo, const std::size_t &grain);
+    static std::size_t batchGrain(const OTPToken::ShaAlgorithm &algo);
+    static const constexpr std::size_t DEFAULT_BATCH_GRAIN = 1024U;
+
+    // truncated hotp values (the codes as numbers) of the counters first[i]..first[i] + count - 1
+    // of every key, stored key by key in out, the values of invalid keys are 0
+    // jobs the batch engine takes are computed there, the rest is split into tasks on the executor
+    static void computeHOTPValues(const std::vector<OTPKey> &keys,
+                                  const std::vector<std::uint64_t> &first,
+                                  const std::size_t &count,
+                                  const OTPToken::DigitType &digits,
+                                  std::vector<std::uint32_t> &out,
+                                  std::vector<OTPGenErrorCode> *errors = nullptr,
+                                  Executor *executor = nullptr);
+
+    // resynchronize a list of prepared keys, counters and codes are matched by index,
+    // without second codes (or with an empty one) the first code alone is searched,
+    // keys which matched get the flag 1 and their new counter, the others keep their counter
+    // the windows of all keys go through computeHOTPValues() at once
+    static void resyncHOTPBatch(const std::vector<OTPKey> &keys,
+                                const std::vector<OTPToken::CounterType> &counters,
+                                const OTPToken::DigitType &digits,
+                                const std::vector<OTPToken::TokenString> &first_codes,
+                                const std::vector<OTPToken::TokenString> &second_codes,
+                                const unsigned int &look_ahead,
+                                std::vector<OTPToken::CounterType> &new_counters,
+                                std::vector<std::uint8_t> &matched,
+                                Executor *executor = nullptr);
+
+    /**
+     * Streams the codes of consecutive periods of a TOTP or Steam token
+     *
+     * The secret is prepared once and the codes are computed in chunks of
+     * consecutive counters (multi-buffer for SHA1), every call to next()
+     * only formats an already computed code.
+     *
+     */
+    class TOTPSeries
+    {
+    public:
+        // codes of all periods overlapping [t_begin, t_end)
+        TOTPSeries(const OTPToken &token, const std::time_t &t_begin, const std::time_t &t_end);
+        TOTPSeries(const OTPKey &key,
+                   const OTPToken::DigitType &digits,
+                   const OTPToken::PeriodType &period,
+                   const std::time_t &t_begin,
+                   const std::time_t &t_end);
+
+        // checks if the token and time range are valid
+        inline bool isValid() const
+        { return this->_valid; }
+
+        // write the next code and the start time of its period, returns false at the end
+        bool next(TokenBuffer &code, std::time_t *time = nullptr) noexcept;
+
+        // amount of codes left
+        std::uint64_t remaining() const;
+
+    private:
+        static const constexpr std::size_t CHUNK_SIZE = 64U;
+
+        void init(const std::time_t &t_begin, const std::time_t &t_end);
+
+        OTPKey _key;
+        OTPToken::DigitType _digits = 0U;
+        OTPToken::PeriodType _period = 0U;
+        bool _steam = false;
+        bool _valid = false;
+
+        // next counter to compute and the end of the series
+        std::uint64_t _counter = 0U;
+        std::uint64_t _end = 0U;
+
+        // computed chunk of binary codes starting at counter _first
+        std::uint64_t _first = 0U;
+        std::uint32_t _bin_codes[CHUNK_SIZE];
+        std::size_t _buffered = 0U;
+        std::size_t _position = 0U;
+    };
 };
 
 #endif // OTPGEN_HPP
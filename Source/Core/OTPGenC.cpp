@@ -0,0 +1,508 @@
+#include "OTPGenC.h"
+
+#include "OTPGen.hpp"
+#include "ThreadPool.hpp"
+#include "TokenDatabase.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+struct otpgen_key
+{
+    OTPKey key;
+};
+
+struct otpgen_key_list
+{
+    std::vector<OTPKey> keys;
+};
+
+struct otpgen_pool
+{
+    explicit otpgen_pool(std::size_t threads)
+        : pool(threads)
+    {
+    }
+
+    ThreadPool pool;
+};
+
+struct otpgen_cursor
+{
+    TokenDatabase::TokenFilter filter;
+    TokenDatabase::TokenPage page;
+    std::size_t position = 0U;
+    bool started = false;
+};
+
+namespace {
+    // tokens fetched per page of a cursor
+    static const constexpr std::size_t CURSOR_PAGE_SIZE = 256U;
+
+    static const constexpr unsigned CURSOR_COLUMNS = TokenDatabase::LabelColumn | TokenDatabase::TypeColumn |
+                                                     TokenDatabase::SecretColumn | TokenDatabase::ParameterColumns;
+
+    // exceptions don't cross the interface
+    template<typename Function>
+    static int guarded(const Function &function) noexcept
+    {
+        try {
+            return function();
+        } catch (const std::bad_alloc&) {
+            return OTPGEN_OUT_OF_MEMORY;
+        } catch (...) {
+            return OTPGEN_UNKNOWN_FAILURE;
+        }
+    }
+
+    static int status(const OTPGenErrorCode &error)
+    {
+        return static_cast<int>(error);
+    }
+
+    static int status(const TokenDatabase::Error &error)
+    {
+        return error == TokenDatabase::Success ? OTPGEN_OK : OTPGEN_DATABASE_ERROR + static_cast<int>(error);
+    }
+
+    static OTPGen::TokenBuffer &slot(char *codes, std::size_t index)
+    {
+        return *reinterpret_cast<OTPGen::TokenBuffer*>(codes + index * OTPGEN_CODE_SIZE);
+    }
+
+    // the generators stop at the terminating NUL, the rest of the slot is cleared too
+    static void pad(char *code)
+    {
+        const auto length = ::strnlen(code, OTPGEN_CODE_SIZE);
+        std::memset(code + length, 0, OTPGEN_CODE_SIZE - length);
+    }
+
+    static bool fits(const std::size_t &count, const std::size_t &size)
+    {
+        return count <= size / OTPGEN_CODE_SIZE;
+    }
+
+    static int newKey(const OTPKey &key, const OTPGenErrorCode &error, otpgen_key **out)
+    {
+        if (error != OTPGenErrorCode::Valid)
+        {
+            return status(error);
+        }
+        (*out) = new otpgen_key{key};
+        return OTPGEN_OK;
+    }
+
+    // the string results of the batch generators are copied into the slots, the buffers are
+    // kept by the thread, short codes are stored in place so only the first batch allocates
+    static std::vector<OTPToken::TokenString> &batchCodes()
+    {
+        static thread_local std::vector<OTPToken::TokenString> codes;
+        return codes;
+    }
+
+    static void copyCodes(const std::vector<OTPToken::TokenString> &codes, const std::vector<OTPGenErrorCode> &errors,
+                          char *out, int *statuses)
+    {
+        for (auto i = 0U; i < codes.size(); ++i)
+        {
+            auto &code = slot(out, i);
+            const auto length = std::min<std::size_t>(codes[i].size(), OTPGEN_CODE_SIZE - 1U);
+            std::memcpy(code, codes[i].data(), length);
+            std::memset(code + length, 0, OTPGEN_CODE_SIZE - length);
+            if (statuses)
+            {
+                statuses[i] = status(errors[i]);
+            }
+        }
+    }
+
+    static Executor *executor(otpgen_pool *pool)
+    {
+        return pool ? &pool->pool : nullptr;
+    }
+}
+
+unsigned otpgen_abi_version(void)
+{
+    return OTPGEN_ABI_VERSION;
+}
+
+const char *otpgen_status_message(int status)
+{
+    switch (status)
+    {
+        case OTPGEN_OK: return "Success.";
+        case OTPGEN_INVALID_TYPE: return "The token type is invalid.";
+        case OTPGEN_INVALID_BASE32: return "The secret isn't valid base-32 or the key is empty.";
+        case OTPGEN_INVALID_ALGORITHM: return "The algorithm is invalid.";
+        case OTPGEN_INVALID_DIGITS: return "The digit length is out of range.";
+        case OTPGEN_INVALID_PERIOD: return "The period is out of range.";
+        case OTPGEN_CODE_REUSED: return "The code was used before.";
+        case OTPGEN_USED_CODE_STORE_FULL: return "The store of used codes is full.";
+        case OTPGEN_NO_MATCH: return "The code doesn't match.";
+        case OTPGEN_END: return "There are no further tokens.";
+        case OTPGEN_INVALID_ARGUMENT: return "An argument is null or a buffer is too small.";
+        case OTPGEN_OUT_OF_MEMORY: return "Out of memory.";
+    }
+
+    if (status > OTPGEN_DATABASE_ERROR)
+    {
+        static thread_local std::string message;
+        message = TokenDatabase::getErrorMessage(static_cast<TokenDatabase::Error>(status - OTPGEN_DATABASE_ERROR));
+        return message.c_str();
+    }
+    return "Unknown failure.";
+}
+
+int otpgen_prepare_key(const char *secret, size_t size, unsigned algorithm, otpgen_key **out)
+{
+    if (!secret || !out)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        auto error = OTPGenErrorCode::Valid;
+        const auto key = OTPGen::prepareKey(OTPToken::SecretView(secret, size), static_cast<OTPToken::ShaAlgorithm>(algorithm), &error);
+        return newKey(key, error, out);
+    });
+}
+
+int otpgen_prepare_raw_key(const unsigned char *key, size_t size, unsigned algorithm, otpgen_key **out)
+{
+    if (!key || !out)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        auto error = OTPGenErrorCode::Valid;
+        const auto prepared = OTPGen::prepareRawKey(key, size, static_cast<OTPToken::ShaAlgorithm>(algorithm), &error);
+        return newKey(prepared, error, out);
+    });
+}
+
+void otpgen_free_key(otpgen_key *key)
+{
+    delete key;
+}
+
+int otpgen_totp(const otpgen_key *key, int64_t time, unsigned digits, unsigned period, char *code)
+{
+    if (!key || !code)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    auto error = OTPGenErrorCode::Valid;
+    (void) OTPGen::computeTOTPInto(slot(code, 0U), static_cast<std::time_t>(time), key->key,
+                                   static_cast<OTPToken::DigitType>(digits), static_cast<OTPToken::PeriodType>(period), &error);
+    pad(code);
+    return status(error);
+}
+
+int otpgen_hotp(const otpgen_key *key, uint64_t counter, unsigned digits, char *code)
+{
+    if (!key || !code)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    auto error = OTPGenErrorCode::Valid;
+    (void) OTPGen::computeHOTPInto(slot(code, 0U), key->key, static_cast<OTPToken::CounterType>(counter),
+                                   static_cast<OTPToken::DigitType>(digits), &error);
+    pad(code);
+    return status(error);
+}
+
+int otpgen_steam(const otpgen_key *key, int64_t time, char *code)
+{
+    if (!key || !code)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    auto error = OTPGenErrorCode::Valid;
+    (void) OTPGen::computeSteamInto(slot(code, 0U), static_cast<std::time_t>(time), key->key, &error);
+    pad(code);
+    return status(error);
+}
+
+int otpgen_totp_span(const otpgen_key *key, const int64_t *times, size_t count,
+                     unsigned digits, unsigned period, char *codes, size_t codes_size)
+{
+    if (!key || (count > 0U && (!times || !codes)) || !fits(count, codes_size))
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+
+    // parameter errors are the same for every time, a key error too
+    auto error = OTPGenErrorCode::Valid;
+    for (auto i = 0U; i < count; ++i)
+    {
+        if (!OTPGen::computeTOTPInto(slot(codes, i), static_cast<std::time_t>(times[i]), key->key,
+                                     static_cast<OTPToken::DigitType>(digits), static_cast<OTPToken::PeriodType>(period), &error))
+        {
+            std::memset(codes, 0, count * OTPGEN_CODE_SIZE);
+            return status(error);
+        }
+        pad(codes + i * OTPGEN_CODE_SIZE);
+    }
+    return OTPGEN_OK;
+}
+
+int otpgen_verify(const otpgen_key *key, const char *code, size_t code_size, int64_t time,
+                  unsigned window, unsigned digits, unsigned period, int *step)
+{
+    if (!key || !code)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        auto error = OTPGenErrorCode::Valid;
+        const auto matched = OTPGen::verifyTOTP(key->key, OTPToken::TokenString(code, code_size), static_cast<std::time_t>(time), window,
+                                                static_cast<OTPToken::DigitType>(digits), static_cast<OTPToken::PeriodType>(period),
+                                                step, &error);
+        if (error != OTPGenErrorCode::Valid)
+        {
+            return status(error);
+        }
+        return matched ? OTPGEN_OK : OTPGEN_NO_MATCH;
+    });
+}
+
+otpgen_key_list *otpgen_key_list_new(void)
+{
+    return new (std::nothrow) otpgen_key_list;
+}
+
+int otpgen_key_list_add(otpgen_key_list *list, const otpgen_key *key, size_t *index)
+{
+    if (!list || !key)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        list->keys.push_back(key->key);
+        if (index)
+        {
+            (*index) = list->keys.size() - 1U;
+        }
+        return OTPGEN_OK;
+    });
+}
+
+size_t otpgen_key_list_size(const otpgen_key_list *list)
+{
+    return list ? list->keys.size() : 0U;
+}
+
+void otpgen_free_key_list(otpgen_key_list *list)
+{
+    delete list;
+}
+
+otpgen_pool *otpgen_pool_new(size_t threads)
+{
+    try {
+        return new otpgen_pool(threads);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void otpgen_free_pool(otpgen_pool *pool)
+{
+    delete pool;
+}
+
+int otpgen_totp_batch(const otpgen_key_list *keys, int64_t time, unsigned digits, unsigned period,
+                      char *codes, size_t codes_size, int *statuses, otpgen_pool *pool)
+{
+    if (!keys || (!keys->keys.empty() && !codes) || !fits(keys->keys.size(), codes_size))
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        auto &out = batchCodes();
+        std::vector<OTPGenErrorCode> errors;
+        OTPGen::computeTOTPBatch(static_cast<std::time_t>(time), keys->keys,
+                                 static_cast<OTPToken::DigitType>(digits), static_cast<OTPToken::PeriodType>(period),
+                                 out, &errors, executor(pool));
+        copyCodes(out, errors, codes, statuses);
+
+        // digits and period are checked for the whole batch
+        if (!errors.empty() && (errors.front() == OTPGenErrorCode::InvalidDigits || errors.front() == OTPGenErrorCode::InvalidPeriod))
+        {
+            return status(errors.front());
+        }
+        return OTPGEN_OK;
+    });
+}
+
+int otpgen_steam_batch(const otpgen_key_list *keys, int64_t time,
+                       char *codes, size_t codes_size, int *statuses, otpgen_pool *pool)
+{
+    if (!keys || (!keys->keys.empty() && !codes) || !fits(keys->keys.size(), codes_size))
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        auto &out = batchCodes();
+        std::vector<OTPGenErrorCode> errors;
+        OTPGen::computeSteamBatch(static_cast<std::time_t>(time), keys->keys, out, &errors, executor(pool));
+        copyCodes(out, errors, codes, statuses);
+        return OTPGEN_OK;
+    });
+}
+
+int otpgen_verify_batch(const otpgen_key_list *keys, const char *codes, size_t codes_size, int64_t time,
+                        unsigned window, unsigned digits, unsigned period, uint8_t *matched, otpgen_pool *pool)
+{
+    if (!keys || (!keys->keys.empty() && (!codes || !matched)) || !fits(keys->keys.size(), codes_size))
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        auto &given = batchCodes();
+        given.resize(keys->keys.size());
+        for (auto i = 0U; i < given.size(); ++i)
+        {
+            const auto code = codes + i * OTPGEN_CODE_SIZE;
+            given[i].assign(code, ::strnlen(code, OTPGEN_CODE_SIZE));
+        }
+
+        std::vector<std::uint8_t> results;
+        OTPGen::verifyTOTPBatch(keys->keys, given, static_cast<std::time_t>(time), window,
+                                static_cast<OTPToken::DigitType>(digits), static_cast<OTPToken::PeriodType>(period),
+                                results, executor(pool));
+        std::copy(results.begin(), results.end(), matched);
+        return OTPGEN_OK;
+    });
+}
+
+int otpgen_db_open(const char *file, const char *password, size_t password_size)
+{
+    if (!file || !password)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        if (!TokenDatabase::setPassword(std::string(password, password_size)))
+        {
+            return status(TokenDatabase::PasswordEmpty);
+        }
+        if (!TokenDatabase::setTokenDatabase(file))
+        {
+            return status(TokenDatabase::FileReadFailure);
+        }
+
+        auto result = TokenDatabase::loadTokens();
+        if (result == TokenDatabase::FileReadFailure)
+        {
+            result = TokenDatabase::initializeTokens();
+        }
+        return status(result);
+    });
+}
+
+int otpgen_db_save(void)
+{
+    return guarded([]() -> int {
+        return status(TokenDatabase::saveTokens());
+    });
+}
+
+void otpgen_db_close(void)
+{
+    TokenDatabase::closeDatabase();
+}
+
+int otpgen_db_cursor_open(unsigned type, otpgen_cursor **out)
+{
+    if (!out)
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    if (!TokenDatabase::databaseConnected())
+    {
+        return status(TokenDatabase::SqlDatabaseNotOpen);
+    }
+    return guarded([&]() -> int {
+        auto cursor = new otpgen_cursor;
+        cursor->filter.type = static_cast<OTPToken::sqliteTypesID>(type);
+        (*out) = cursor;
+        return OTPGEN_OK;
+    });
+}
+
+int otpgen_db_cursor_next(otpgen_cursor *cursor, otpgen_token_info *info)
+{
+    if (!cursor || !info || (info->label_capacity > 0U && !info->label))
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        // the first page or the next one once the current page is done
+        if (!cursor->started || cursor->position + 1U >= cursor->page.tokens.size())
+        {
+            if (cursor->started && cursor->page.last)
+            {
+                cursor->position = cursor->page.tokens.size();
+                return OTPGEN_END;
+            }
+
+            const auto after = cursor->page.next;
+            const auto result = TokenDatabase::selectTokens(cursor->filter, CURSOR_COLUMNS, after, CURSOR_PAGE_SIZE, cursor->page);
+            if (result != TokenDatabase::Success)
+            {
+                return status(result);
+            }
+            cursor->started = true;
+            cursor->position = 0U;
+            if (cursor->page.tokens.empty())
+            {
+                return OTPGEN_END;
+            }
+        }
+        else
+        {
+            ++cursor->position;
+        }
+
+        const auto &token = cursor->page.tokens[cursor->position];
+        info->id = token.id();
+        info->type = token.type();
+        info->algorithm = token.algorithm();
+        info->digits = token.digitLength();
+        info->period = token.period();
+        info->counter = token.counter();
+        info->label_size = token.label().size();
+        if (info->label_capacity > 0U)
+        {
+            const auto length = std::min(token.label().size(), info->label_capacity - 1U);
+            std::memcpy(info->label, token.label().data(), length);
+            info->label[length] = '\0';
+        }
+        return OTPGEN_OK;
+    });
+}
+
+int otpgen_db_cursor_key(const otpgen_cursor *cursor, otpgen_key **out)
+{
+    if (!cursor || !out || !cursor->started || cursor->position >= cursor->page.tokens.size())
+    {
+        return OTPGEN_INVALID_ARGUMENT;
+    }
+    return guarded([&]() -> int {
+        const auto &token = cursor->page.tokens[cursor->position];
+        // steam codes are always SHA1
+        const auto algorithm = token.type() == OTPToken::Steam ? OTPToken::SHA1 : token.algorithm();
+        auto error = OTPGenErrorCode::Valid;
+        const auto key = OTPGen::prepareKey(token.secret(), algorithm, &error);
+        return newKey(key, error, out);
+    });
+}
+
+void otpgen_free_cursor(otpgen_cursor *cursor)
+{
+    delete cursor;
+}
@@ -0,0 +1,162 @@
+#ifndef OTPGENC_H
+#define OTPGENC_H
+
+/*
+ * Stable C interface of libotpgen
+ *
+ * For bindings of other languages and programs which don't want to depend
+ * on the C++ standard library types of the core classes. All buffers are
+ * owned by the caller, no function returns memory which the caller frees
+ * other than through the matching free function of a handle.
+ *
+ * Keys are prepared once (the secret is decoded and the HMAC key schedule
+ * is cached) and used for any amount of codes. Key lists pack prepared keys
+ * next to each other for the multi-buffer batch generators.
+ *
+ * Codes are written into slots of OTPGEN_CODE_SIZE bytes, every slot holds
+ * a code padded with NUL bytes (like fixed size strings of numpy), failed
+ * slots hold an empty string.
+ *
+ * Functions never throw and don't keep pointers to the arguments. Handles
+ * may be used by several threads at the same time, except for the cursor
+ * and adding to a key list. The database functions share the one database
+ * of the process with the C++ interface.
+ *
+ * Changes of this interface are additive, OTPGEN_ABI_VERSION is increased
+ * when functions are added.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTPGEN_ABI_VERSION 1
+
+/* longest code (10 digits) and the terminating NUL */
+#define OTPGEN_CODE_SIZE 11
+
+/* status codes, 1-7 are the OTPGenErrorCode values of the C++ interface */
+enum {
+    OTPGEN_OK = 0,
+    OTPGEN_INVALID_TYPE = 1,
+    OTPGEN_INVALID_BASE32 = 2,
+    OTPGEN_INVALID_ALGORITHM = 3,
+    OTPGEN_INVALID_DIGITS = 4,
+    OTPGEN_INVALID_PERIOD = 5,
+    OTPGEN_CODE_REUSED = 6,
+    OTPGEN_USED_CODE_STORE_FULL = 7,
+
+    OTPGEN_NO_MATCH = 32,         /* the code didn't match */
+    OTPGEN_END = 33,              /* the cursor has no further tokens */
+    OTPGEN_INVALID_ARGUMENT = 34, /* null handle or buffer, or a buffer too small */
+    OTPGEN_OUT_OF_MEMORY = 35,
+    OTPGEN_UNKNOWN_FAILURE = 36,
+
+    /* OTPGEN_DATABASE_ERROR + TokenDatabase::Error */
+    OTPGEN_DATABASE_ERROR = 256
+};
+
+/* token types and algorithms, same values as in the database */
+enum {
+    OTPGEN_TOTP = 1,
+    OTPGEN_HOTP = 2,
+    OTPGEN_STEAM = 3
+};
+
+enum {
+    OTPGEN_SHA1 = 1,
+    OTPGEN_SHA256 = 2,
+    OTPGEN_SHA512 = 3
+};
+
+typedef struct otpgen_key otpgen_key;
+typedef struct otpgen_key_list otpgen_key_list;
+typedef struct otpgen_pool otpgen_pool;
+typedef struct otpgen_cursor otpgen_cursor;
+
+/* OTPGEN_ABI_VERSION of the loaded library */
+unsigned otpgen_abi_version(void);
+
+/* English description of a status, valid until the next call on the same thread */
+const char *otpgen_status_message(int status);
+
+/* keys, the base-32 secret doesn't need to be NUL-terminated */
+int otpgen_prepare_key(const char *secret, size_t size, unsigned algorithm, otpgen_key **out);
+int otpgen_prepare_raw_key(const unsigned char *key, size_t size, unsigned algorithm, otpgen_key **out);
+void otpgen_free_key(otpgen_key *key);
+
+/* single codes, code must hold OTPGEN_CODE_SIZE bytes */
+int otpgen_totp(const otpgen_key *key, int64_t time, unsigned digits, unsigned period, char *code);
+int otpgen_hotp(const otpgen_key *key, uint64_t counter, unsigned digits, char *code);
+int otpgen_steam(const otpgen_key *key, int64_t time, char *code);
+
+/* codes of one key at many times, codes holds count slots (audits of past codes) */
+int otpgen_totp_span(const otpgen_key *key, const int64_t *times, size_t count,
+                     unsigned digits, unsigned period, char *codes, size_t codes_size);
+
+/* OTPGEN_OK if the code matches within ±window steps, the offset of the step is stored in step */
+int otpgen_verify(const otpgen_key *key, const char *code, size_t code_size, int64_t time,
+                  unsigned window, unsigned digits, unsigned period, int *step);
+
+/* lists of prepared keys, adding copies the key and stores its index in the list */
+otpgen_key_list *otpgen_key_list_new(void);
+int otpgen_key_list_add(otpgen_key_list *list, const otpgen_key *key, size_t *index);
+size_t otpgen_key_list_size(const otpgen_key_list *list);
+void otpgen_free_key_list(otpgen_key_list *list);
+
+/* worker threads for the batch functions, 0 uses one thread per hardware thread */
+otpgen_pool *otpgen_pool_new(size_t threads);
+void otpgen_free_pool(otpgen_pool *pool);
+
+/*
+ * codes of all keys of the list at one time, codes holds a slot per key, statuses
+ * (may be null) a status per key, the pool (may be null) splits large lists
+ * the function fails as a whole only on invalid arguments, digits or period
+ */
+int otpgen_totp_batch(const otpgen_key_list *keys, int64_t time, unsigned digits, unsigned period,
+                      char *codes, size_t codes_size, int *statuses, otpgen_pool *pool);
+int otpgen_steam_batch(const otpgen_key_list *keys, int64_t time,
+                       char *codes, size_t codes_size, int *statuses, otpgen_pool *pool);
+
+/* codes are matched by index in slots of OTPGEN_CODE_SIZE bytes, matched holds 1 or 0 per key */
+int otpgen_verify_batch(const otpgen_key_list *keys, const char *codes, size_t codes_size, int64_t time,
+                        unsigned window, unsigned digits, unsigned period, uint8_t *matched, otpgen_pool *pool);
+
+/* token database of the process, opens or creates the file */
+int otpgen_db_open(const char *file, const char *password, size_t password_size);
+int otpgen_db_save(void);
+void otpgen_db_close(void);
+
+/* current token of a cursor, the label is written into the buffer provided by the caller */
+typedef struct otpgen_token_info {
+    int64_t id;
+    unsigned type;
+    unsigned algorithm;
+    unsigned digits;
+    uint32_t period;
+    uint64_t counter;
+
+    char *label;           /* in: buffer, NUL-terminated, truncated to label_capacity - 1 bytes */
+    size_t label_capacity; /* in: size of the buffer, may be 0 */
+    size_t label_size;     /* out: full size of the label */
+} otpgen_token_info;
+
+/*
+ * tokens in display order, type 0 selects all types
+ * next returns OTPGEN_END after the last token, key prepares the key of the current
+ * token so the secret itself never leaves the library
+ */
+int otpgen_db_cursor_open(unsigned type, otpgen_cursor **out);
+int otpgen_db_cursor_next(otpgen_cursor *cursor, otpgen_token_info *info);
+int otpgen_db_cursor_key(const otpgen_cursor *cursor, otpgen_key **out);
+void otpgen_free_cursor(otpgen_cursor *cursor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OTPGENC_H */
@@ -8,6 +8,8 @@ enum class OTPGenErrorCode {
     InvalidAlgorithm,
     InvalidDigits,
     InvalidPeriod,
+    CodeReused,
+    UsedCodeStoreFull,
 };
 
 #endif // OTPGENERRORCODES_HPP
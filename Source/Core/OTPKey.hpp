@@ -0,0 +1,87 @@
+#ifndef OTPKEY_HPP
+#define OTPKEY_HPP
+
+#include <string>
+#include <cstdint>
+
+#include "OTPToken.hpp"
+
+/**
+ * Pre-decoded token secret
+ *
+ * Holds the normalized and base-32 decoded key bytes of a token secret
+ * together with the SHA algorithm it is used with. Long-lived tokens can
+ * be prepared once with OTPGen::prepareKey() to skip the decoding on
+ * every generated code.
+ *
+ * The key also caches the HMAC key schedule: the hash states after
+ * processing the inner (ipad) and outer (opad) key blocks. Generating
+ * a code from a prepared key only costs the two compression calls over
+ * the counter and the inner digest.
+ *
+ */
+class OTPKey
+{
+public:
+    using KeyData = SecureString;
+
+    // size of the precomputed hash states, large enough for the 8x 64-bit state of SHA-512
+    static const constexpr std::size_t HMAC_STATE_SIZE = 64U;
+
+    /**
+     * construct empty (invalid) key
+     */
+    OTPKey()
+    {
+    }
+
+    /**
+     * destroy key object, wipe the key bytes
+     */
+    ~OTPKey()
+    {
+        this->_key.assign(this->_key.size(), '\0');
+        this->_key.clear();
+        this->_algorithm = OTPToken::Invalid;
+        for (auto i = 0U; i < HMAC_STATE_SIZE; ++i)
+        {
+            this->_inner[i] = 0U;
+            this->_outer[i] = 0U;
+        }
+    }
+
+    OTPKey(const OTPKey &other) = default;
+    OTPKey(OTPKey &&other) noexcept = default;
+    OTPKey &operator= (const OTPKey &other) = default;
+    OTPKey &operator= (OTPKey &&other) noexcept = default;
+
+    // checks if the key holds decoded key bytes
+    inline bool isValid() const
+    { return !this->_key.empty() && this->_algorithm != OTPToken::Invalid; }
+
+    // raw (binary) key bytes
+    inline const KeyData &key() const
+    { return this->_key; }
+
+    // SHA algorithm the key was prepared for
+    inline const OTPToken::ShaAlgorithm &algorithm() const
+    { return this->_algorithm; }
+
+    // precomputed HMAC hash states, used by the OTPGen code generators
+    inline const unsigned char *innerState() const
+    { return this->_inner; }
+    inline const unsigned char *outerState() const
+    { return this->_outer; }
+
+private:
+    friend class OTPGen;
+
+    KeyData _key;
+    OTPToken::ShaAlgorithm _algorithm = OTPToken::Invalid;
+
+    // hash states after the ipad/opad blocks, stored in native word order
+    unsigned char _inner[HMAC_STATE_SIZE] = {};
+    unsigned char _outer[HMAC_STATE_SIZE] = {};
+};
+
+#endif // OTPKEY_HPP
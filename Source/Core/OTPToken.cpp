@@ -1,17 +1,54 @@
 #include "OTPToken.hpp"
 #include "OTPGen.hpp"
 
-#include "TokenDatabase.hpp"
-
-#include <cryptopp/base64.h>
-#include <cryptopp/base32.h>
-#include <cryptopp/filters.h>
+#include "Codec.hpp"
+#include "Clock.hpp"
 
 #include <algorithm>
+#include <functional>
+#include <iterator>
 #include <numeric>
 
-OTPToken::OTPToken()
+namespace {
+    // indexed by the type and algorithm ids of the database
+    static const constexpr std::string_view TYPE_NAMES[] = {{}, "TOTP", "HOTP", "Steam"};
+    static const constexpr std::string_view ALGORITHM_NAMES[] = {{}, "SHA1", "SHA256", "SHA512"};
+}
+
+OTPToken::SharedIcon::SharedIcon(Icon &&icon)
+{
+    if (icon.empty())
+    {
+        return;
+    }
+    const auto hash = std::hash<std::string_view>()(
+        std::string_view(reinterpret_cast<const char*>(icon.data()), icon.size()));
+    this->_buffer = std::make_shared<const Buffer>(Buffer{std::move(icon), hash});
+}
+
+OTPToken::SharedIcon::SharedIcon(const Icon &icon)
+    : SharedIcon(Icon(icon))
+{
+}
+
+const OTPToken::Icon &OTPToken::SharedIcon::bytes() const
+{
+    static const Icon empty;
+    return this->_buffer ? this->_buffer->bytes : empty;
+}
+
+bool OTPToken::SharedIcon::operator== (const SharedIcon &other) const
 {
+    // the bytes are only compared for equal hashes of different buffers
+    if (this->_buffer == other._buffer)
+    {
+        return true;
+    }
+    if (!this->_buffer || !other._buffer || this->_buffer->hash != other._buffer->hash)
+    {
+        return false;
+    }
+    return this->_buffer->bytes == other._buffer->bytes;
 }
 
 OTPToken::OTPToken(const TokenType &type)
@@ -26,7 +63,7 @@ OTPToken::OTPToken(const TokenType &type)
 OTPToken::OTPToken(const TokenType &type,
                    const Label &label,
                    const Icon &icon,
-                   const TokenSecret &secret,
+                   const SecretView &secret,
                    const DigitType &digits,
                    const PeriodType &period,
                    const CounterType &counter,
@@ -34,8 +71,8 @@ OTPToken::OTPToken(const TokenType &type,
 {
     this->_type = type;
     this->_label = label;
-    this->_icon = icon;
-    this->_secret = secret;
+    this->_icon = SharedIcon(icon);
+    this->_secret.assign(secret.data(), secret.size());
     this->_digits = digits;
     this->_period = period;
     this->_counter = counter;
@@ -45,12 +82,12 @@ OTPToken::OTPToken(const TokenType &type,
 OTPToken::OTPToken(const TokenType &type,
                    const Label &label,
                    const Icon &icon,
-                   const TokenSecret &secret)
+                   const SecretView &secret)
     : OTPToken(type)
 {
     this->_label = label;
-    this->_icon = icon;
-    this->_secret = secret;
+    this->_icon = SharedIcon(icon);
+    this->_secret.assign(secret.data(), secret.size());
 }
 
 OTPToken::OTPToken(const TokenType &type,
@@ -60,35 +97,6 @@ OTPToken::OTPToken(const TokenType &type,
     this->_label = label;
 }
 
-OTPToken::OTPToken(const OTPToken &other)
-    : OTPToken()
-{
-    this->_type = other._type;
-    this->_label = other._label;
-    this->_icon = other._icon;
-    this->_secret = other._secret;
-    this->_digits = other._digits;
-    this->_period = other._period;
-    this->_counter = other._counter;
-    this->_algorithm = other._algorithm;
-
-    this->_id = other._id;
-}
-
-OTPToken::~OTPToken()
-{
-    this->_type = None;
-    this->_label.clear();
-    this->_icon.clear();
-    this->_secret.clear();
-    this->_digits = 0U;
-    this->_period = 0U;
-    this->_counter = 0U;
-    this->_algorithm = Invalid;
-
-    this->_id = 0U;
-}
-
 bool OTPToken::importBase64Secret(const std::string &base64_str)
 {
     // input can't be empty
@@ -97,27 +105,8 @@ bool OTPToken::importBase64Secret(const std::string &base64_str)
         return false;
     }
 
-    try {
-
-        // create an RFC 4648 base-32 encoder
-        // crypto++ uses DUDE by default which isn't TOTP compatible
-        auto encoder = new CryptoPP::Base32Encoder();
-        static const CryptoPP::byte ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-        static const CryptoPP::AlgorithmParameters params = CryptoPP::MakeParameters(
-                                                            CryptoPP::Name::EncodingLookupArray(),
-                                                            static_cast<const CryptoPP::byte*>(ALPHABET));
-        encoder->IsolatedInitialize(params);
-
-        encoder->Attach(new CryptoPP::StringSink(_secret));
-
-        // decode and reencode base-64 data into base-32
-        CryptoPP::StringSource src(base64_str, true,
-            new CryptoPP::Base64Decoder(encoder));
-
-    } catch (...) {
-        _secret.clear();
-        return false;
-    }
+    // decode and reencode base-64 data into base-32
+    setSecret(Codec::base32Encode(Codec::base64Decode(base64_str)));
 
     if (_secret.empty())
     {
@@ -131,24 +120,36 @@ const OTPToken::TokenString OTPToken::convertBase64Secret(const std::string &bas
 {
     OTPToken token;
     token.importBase64Secret(base64_str);
-    return token.secret();
+    return TokenString(token.secret().data(), token.secret().size());
+}
+
+void OTPToken::setTags(const Tags &tags)
+{
+    this->setTags(Tags(tags));
+}
+
+void OTPToken::setTags(Tags &&tags)
+{
+    // empty tags can't be stored
+    tags.erase(std::remove(tags.begin(), tags.end(), std::string()), tags.end());
+    std::sort(tags.begin(), tags.end());
+    tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+    this->_tags = std::move(tags);
+}
+
+bool OTPToken::hasTag(const std::string &tag) const
+{
+    return std::binary_search(this->_tags.begin(), this->_tags.end(), tag);
 }
 
 const std::string OTPToken::typeName() const
 {
-    const auto name = TokenDatabase::selectTokenTypeName(static_cast<sqliteTypesID>(this->_type));
-    // fallback when database is not connected
-    if (name.empty())
-    {
-        switch (this->_type)
-        {
-            case None:  return {};
-            case TOTP:  return "TOTP";
-            case HOTP:  return "HOTP";
-            case Steam: return "Steam";
-        }
-    }
-    return name;
+    return std::string(typeName(this->_type));
+}
+
+std::string_view OTPToken::typeName(const TokenType &type)
+{
+    return type < std::size(TYPE_NAMES) ? TYPE_NAMES[type] : std::string_view();
 }
 
 void OTPToken::setAlgorithm(const std::string &algorithm_name)
@@ -174,23 +175,17 @@ void OTPToken::setAlgorithm(const std::string &algorithm_name)
     {
         _algorithm = Invalid;
     }
+    _validity = Unchecked;
 }
 
 const std::string OTPToken::algorithmName() const
 {
-    const auto name = TokenDatabase::selectAlgorithmName(static_cast<sqliteAlgorithmsID>(this->_algorithm));
-    // fallback when database is not connected
-    if (name.empty())
-    {
-        switch (this->_algorithm)
-        {
-            case Invalid: return {};
-            case SHA1:    return "SHA1";
-            case SHA256:  return "SHA256";
-            case SHA512:  return "SHA512";
-        }
-    }
-    return name;
+    return std::string(algorithmName(this->_algorithm));
+}
+
+std::string_view OTPToken::algorithmName(const ShaAlgorithm &algorithm)
+{
+    return algorithm < std::size(ALGORITHM_NAMES) ? ALGORITHM_NAMES[algorithm] : std::string_view();
 }
 
 OTPToken::DigitType OTPToken::defaultDigitLength(const TokenType &type)
@@ -312,17 +307,71 @@ OTPToken::CounterType OTPToken::maxCounter(const TokenType &type)
 
 bool OTPToken::isValid() const
 {
-    if (_label.empty())
+    if (_validity == Unchecked)
     {
+        _validity = !_label.empty() && this->validate() ? CheckedValid : CheckedInvalid;
+    }
+    return _validity == CheckedValid;
+}
+
+bool OTPToken::validate(OTPGenErrorCode *error) const
+{
+    const auto fail = [&](const OTPGenErrorCode &code) {
+        if (error)
+        {
+            (*error) = code;
+        }
         return false;
+    };
+    const auto validAlgorithm = _algorithm == SHA1 || _algorithm == SHA256 || _algorithm == SHA512;
+    const auto validDigits = _digits >= OTPGen::minDigitLength() && _digits <= OTPGen::maxDigitLength();
+
+    // same checks and order as generateToken() and the generators
+    if (_type == None)
+    {
+        return fail(OTPGenErrorCode::InvalidType);
+    }
+    if (_secret.empty())
+    {
+        return fail(OTPGenErrorCode::InvalidBase32Input);
+    }
+    if (_type != TOTP && _type != HOTP && _type != Steam)
+    {
+        return fail(OTPGenErrorCode::InvalidType);
+    }
+
+    switch (_type)
+    {
+        case TOTP:
+            if (!validDigits) return fail(OTPGenErrorCode::InvalidDigits);
+            if (_period <= OTPGen::minPeriod() || _period > OTPGen::maxPeriod()) return fail(OTPGenErrorCode::InvalidPeriod);
+            if (!validAlgorithm) return fail(OTPGenErrorCode::InvalidAlgorithm);
+            break;
+        case HOTP:
+            if (!validAlgorithm) return fail(OTPGenErrorCode::InvalidAlgorithm);
+            if (!validDigits) return fail(OTPGenErrorCode::InvalidDigits);
+            break;
+    }
+
+    // the key needs at least one full byte, two base-32 characters
+    if (Codec::base32Characters(_secret.data(), _secret.size()) < 2U)
+    {
+        return fail(OTPGenErrorCode::InvalidBase32Input);
     }
 
-    auto error = OTPGenErrorCode::Valid;
-    const auto &token = this->generateToken(&error);
-    return !(token.empty() || error != OTPGenErrorCode::Valid);
+    if (error)
+    {
+        (*error) = OTPGenErrorCode::Valid;
+    }
+    return true;
 }
 
 const OTPToken::TokenString OTPToken::generateToken(OTPGenErrorCode *error) const
+{
+    return this->generateToken(Clock::current(), error);
+}
+
+const OTPToken::TokenString OTPToken::generateToken(const std::time_t &time, OTPGenErrorCode *error) const
 {
     if (error)
     {
@@ -354,7 +403,7 @@ const OTPToken::TokenString OTPToken::generateToken(OTPGenErrorCode *error) cons
     // generate token based on type
     if (_type == TOTP)
     {
-        token = OTPGen::computeTOTP(_secret, _digits, _period, _algorithm, &err);
+        token = OTPGen::computeTOTP(time, _secret, _digits, _period, _algorithm, &err);
     }
     else if (_type == HOTP)
     {
@@ -362,7 +411,7 @@ const OTPToken::TokenString OTPToken::generateToken(OTPGenErrorCode *error) cons
     }
     else if (_type == Steam)
     {
-        token = OTPGen::computeSteam(_secret, &err);
+        token = OTPGen::computeSteam(Clock::steamTime(time), _secret, &err);
     }
     else
     {
@@ -390,31 +439,44 @@ const OTPToken::TokenString OTPToken::generateToken(OTPGenErrorCode *error) cons
 
 std::uint64_t OTPToken::remainingTokenValidity() const
 {
-    if (_period == 0U)
+    return secondsUntilRotation(Clock::current());
+}
+
+std::time_t OTPToken::nextRotationTime() const
+{
+    return nextRotationTime(Clock::current());
+}
+
+std::uint64_t OTPToken::secondsUntilRotation(const std::time_t &now) const
+{
+    return secondsUntilRotation(this->rotationPeriod(), _type == Steam ? Clock::steamTime(now) : now);
+}
+
+std::uint64_t OTPToken::secondsUntilRotation(const PeriodType &period, const std::time_t &now)
+{
+    if (period == 0U)
     {
         return 0U;
     }
+    return period - static_cast<std::uint64_t>(now) % period;
+}
 
-    // get remaining seconds since last minute
-    auto now = std::time(nullptr);
-    auto local = std::localtime(&now);
+std::time_t OTPToken::nextRotationTime(const PeriodType &period, const std::time_t &now)
+{
+    return now + static_cast<std::time_t>(secondsUntilRotation(period, now));
+}
 
-    // calculate token validity with 1 second update threshold
-    auto sec_expired = local->tm_sec;
-    auto token_validity = ( static_cast<int>(_period) - sec_expired );
-    if (token_validity < 0)
-    {
-        token_validity = ( static_cast<int>(_period) - (sec_expired % static_cast<int>(_period)) ) + 1;
-    }
-    else
+OTPToken::PeriodType OTPToken::rotationPeriod() const
+{
+    switch (this->_type)
     {
-        token_validity++;
+        case TOTP:  return this->_period;
+        case Steam: return defaultPeriod(Steam);
     }
-
-    return static_cast<std::uint64_t>(token_validity);
+    return 0U;
 }
 
-bool OTPToken::validateSecret(const TokenSecret &secret, OTPGenErrorCode *error)
+bool OTPToken::validateSecret(const SecretView &secret, OTPGenErrorCode *error)
 {
     if (secret.empty())
     {
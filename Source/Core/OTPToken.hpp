@@ -2,9 +2,15 @@
 #define OTPTOKEN_HPP
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <cinttypes>
+#include <ctime>
+
+#include "SecureMemory.hpp"
 
 enum class OTPGenErrorCode;
 
@@ -13,8 +19,13 @@ class OTPToken
 public:
     using TokenType = std::uint8_t;
     using TokenString = std::string;
-    using TokenSecret = std::string;
+    // secrets are kept in locked memory which is wiped on release
+    using TokenSecret = SecureString;
+    using SecretView = std::string_view;
     using Label = std::string;
+    using Issuer = std::string;
+    // tags are kept sorted and without duplicates
+    using Tags = std::vector<std::string>;
     using Icon = std::vector<unsigned char>;
     using DigitType = std::uint8_t;
     using PeriodType = std::uint32_t;
@@ -46,11 +57,55 @@ public:
         SHA512  = 3,
     };
 
+    /**
+     * Immutable icon data shared by reference count
+     *
+     * Copies of a token share the buffer of its icon instead of copying
+     * the image. The hash of the contents is computed once when the buffer
+     * is created, so copies compare by address and different icons compare
+     * by their hash without reading the image. An empty icon has no buffer.
+     *
+     */
+    class SharedIcon
+    {
+    public:
+        SharedIcon() = default;
+        explicit SharedIcon(Icon &&icon);
+        explicit SharedIcon(const Icon &icon);
+
+        // the image, an empty one without a buffer
+        const Icon &bytes() const;
+        inline const unsigned char *data() const
+        { return this->bytes().data(); }
+        inline std::size_t size() const
+        { return this->_buffer ? this->_buffer->bytes.size() : 0U; }
+        inline bool empty() const
+        { return !this->_buffer; }
+        inline std::size_t hash() const
+        { return this->_buffer ? this->_buffer->hash : 0U; }
+
+        // both refer to the same buffer
+        inline bool shares(const SharedIcon &other) const
+        { return this->_buffer == other._buffer; }
+
+        bool operator== (const SharedIcon &other) const;
+        inline bool operator!= (const SharedIcon &other) const
+        { return !this->operator== (other); }
+
+    private:
+        struct Buffer
+        {
+            Icon bytes;
+            std::size_t hash;
+        };
+        std::shared_ptr<const Buffer> _buffer;
+    };
+
 public:
     /**
      * construct empty (invalid) token
      */
-    OTPToken();
+    OTPToken() = default;
 
     /**
      * construct empty (invalid) token of given type
@@ -63,7 +118,7 @@ public:
     OTPToken(const TokenType &type,
              const Label &label,
              const Icon &icon,
-             const TokenSecret &secret,
+             const SecretView &secret,
              const DigitType &digits,
              const PeriodType &period,
              const CounterType &counter,
@@ -76,7 +131,7 @@ public:
     OTPToken(const TokenType &type,
              const Label &label,
              const Icon &icon,
-             const TokenSecret &secret);
+             const SecretView &secret);
 
     /**
      * construct an invalid token of the given type and a label
@@ -84,15 +139,16 @@ public:
     OTPToken(const TokenType &type,
              const Label &label);
 
-    /**
-     * copy constructor
-     */
-    OTPToken(const OTPToken &other);
+    OTPToken(const OTPToken &other) = default;
+    OTPToken(OTPToken &&other) noexcept = default;
+    OTPToken &operator= (const OTPToken &other) = default;
+    OTPToken &operator= (OTPToken &&other) noexcept = default;
 
     /**
-     * destroy token object
+     * destroy token object, short secrets are wiped here, longer ones by their allocator
      */
-    ~OTPToken();
+    ~OTPToken()
+    { SecureMemory::wipeInline(this->_secret); }
 
     // Steam tokens are stored in base-64 (RFC 3548, RFC 4648) on the device,
     // but the library libcotp only supports base-32 (RFC 4648) input.
@@ -107,24 +163,45 @@ public:
 
     // Type
     inline void setType(const TokenType &type)
-    { this->_type = type; }
+    { this->_type = type; this->_validity = Unchecked; }
     inline const TokenType &type() const
     { return this->_type; }
     const std::string typeName() const;
 
     // Label
     inline void setLabel(const Label &label)
-    { this->_label = label; }
+    { this->_label = label; this->_validity = Unchecked; }
+    inline void setLabel(Label &&label)
+    { this->_label = std::move(label); this->_validity = Unchecked; }
     inline const Label &label() const
     { return this->_label; }
 
+    // Issuer
+    inline void setIssuer(const Issuer &issuer)
+    { this->_issuer = issuer; }
+    inline const Issuer &issuer() const
+    { return this->_issuer; }
+
+    // Tags
+    void setTags(const Tags &tags);
+    void setTags(Tags &&tags);
+    inline const Tags &tags() const
+    { return this->_tags; }
+    bool hasTag(const std::string &tag) const;
+
     // Icon
-    // images are stored as std::strings for easier management
+    // images are kept in a SharedIcon, copies of the token share it
     inline void setIcon(const Icon &icon)
-    { this->_icon = icon; }
+    { this->_icon = SharedIcon(icon); }
+    inline void setIcon(Icon &&icon)
+    { this->_icon = SharedIcon(std::move(icon)); }
     inline void setIcon(const unsigned char *icon, const std::size_t &size)
-    { this->_icon = Icon(icon, icon + size); }
+    { this->_icon = SharedIcon(Icon(icon, icon + size)); }
+    inline void setSharedIcon(const SharedIcon &icon)
+    { this->_icon = icon; }
     inline const Icon &icon() const
+    { return this->_icon.bytes(); }
+    inline const SharedIcon &sharedIcon() const
     { return this->_icon; }
     inline const unsigned char *iconBuffer() const
     { return this->_icon.data(); }
@@ -132,20 +209,20 @@ public:
     { return this->_icon.size(); }
 
     // Secret
-    inline void setSecret(const TokenSecret &secret)
-    { this->_secret = secret; }
+    inline void setSecret(const SecretView &secret)
+    { this->_secret.assign(secret.data(), secret.size()); this->_validity = Unchecked; }
     inline const TokenSecret &secret() const
     { return this->_secret; }
 
     // Digits
     inline void setDigitLength(const DigitType &digits)
-    { this->_digits = digits; }
+    { this->_digits = digits; this->_validity = Unchecked; }
     inline const DigitType &digitLength() const
     { return this->_digits; }
 
     // Period
     inline void setPeriod(const PeriodType &period)
-    { this->_period = period; }
+    { this->_period = period; this->_validity = Unchecked; }
     inline const PeriodType &period() const
     { return this->_period; }
 
@@ -161,7 +238,7 @@ public:
 
     // Algorithm
     inline void setAlgorithm(const ShaAlgorithm &algorithm)
-    { this->_algorithm = algorithm; }
+    { this->_algorithm = algorithm; this->_validity = Unchecked; }
     inline const ShaAlgorithm &algorithm() const
     { return this->_algorithm; }
     void setAlgorithm(const std::string &algorithm_name);
@@ -178,6 +255,13 @@ public:
     static PeriodType defaultPeriod(const TokenType &type);
     static ShaAlgorithm defaultAlgorithm(const TokenType &type);
 
+    /**
+     * get the names of types and algorithms, empty for unknown values
+     * the database tables are created from the same mapping
+     */
+    static std::string_view typeName(const TokenType &type);
+    static std::string_view algorithmName(const ShaAlgorithm &algorithm);
+
     /**
      * get defaults based on the current type
      */
@@ -216,19 +300,44 @@ public:
 
     /**
      * checks if this token object generates a non-empty token
+     * the verdict is cached until one of the relevant setters is called
      */
     bool isValid() const;
 
+    /**
+     * checks the type, parameter ranges and the secret without generating a code,
+     * the error is the one generateToken() would report
+     */
+    bool validate(OTPGenErrorCode *error = nullptr) const;
+
     /**
      * tries to generate a one-time password token
+     * at the time of the default clock or the given time
      */
     const TokenString generateToken(OTPGenErrorCode *error = nullptr) const;
+    const TokenString generateToken(const std::time_t &time, OTPGenErrorCode *error = nullptr) const;
 
     /**
      * calculates the remaining token validity from the current system time
      */
     std::uint64_t remainingTokenValidity() const;
 
+    /**
+     * rotations of time-based codes, computed from the epoch
+     * all tokens with the same period rotate at the same time, callers can compute
+     * this once per period and tick; tokens without a period return 0 and the given time
+     */
+    static std::uint64_t secondsUntilRotation(const PeriodType &period, const std::time_t &now);
+    static std::time_t nextRotationTime(const PeriodType &period, const std::time_t &now);
+
+    // period after which the code of this token changes, 0 for counter-based tokens,
+    // Steam codes rotate at the periods of the Steam time (see Clock::steamTime())
+    PeriodType rotationPeriod() const;
+    std::uint64_t secondsUntilRotation(const std::time_t &now) const;
+    inline std::time_t nextRotationTime(const std::time_t &now) const
+    { return now + static_cast<std::time_t>(this->secondsUntilRotation(now)); }
+    std::time_t nextRotationTime() const;
+
     /**
      * equality check
      */
@@ -237,6 +346,8 @@ public:
         return (
             this->_type == other._type &&
             this->_label == other._label &&
+            this->_issuer == other._issuer &&
+            this->_tags == other._tags &&
             this->_icon == other._icon &&
             this->_secret == other._secret &&
             this->_digits == other._digits &&
@@ -255,10 +366,13 @@ public:
 
 private:
     friend class TokenDatabase;
+    friend class TokenSet;
 
     TokenType _type = 0U;
     Label _label;
-    Icon _icon;
+    Issuer _issuer;
+    Tags _tags;
+    SharedIcon _icon;
     TokenSecret _secret;
     DigitType _digits = 0U;
     PeriodType _period = 0U;
@@ -267,7 +381,15 @@ private:
 
     sqliteTokenID _id = 0U;
 
-    static bool validateSecret(const TokenSecret &secret, OTPGenErrorCode *error);
+    // cached result of isValid(), not synchronized like the rest of the token
+    enum : std::uint8_t {
+        Unchecked = 0,
+        CheckedValid,
+        CheckedInvalid,
+    };
+    mutable std::uint8_t _validity = Unchecked;
+
+    static bool validateSecret(const SecretView &secret, OTPGenErrorCode *error);
 };
 
 inline std::ostream &operator<< (std::ostream &out, const OTPToken &token)
@@ -275,6 +397,8 @@ inline std::ostream &operator<< (std::ostream &out, const OTPToken &token)
     out << "OTPToken{"
         << "type=" << token.typeName() << ", "
         << "label=\"" << token.label() << "\", "
+        << "issuer=\"" << token.issuer() << "\", "
+        << "tags=" << token.tags().size() << ", "
         << "icon=" << +token.iconBufferSize() << "B, "
         << "digits=" << +token.digitLength() << ", "
         << "period=" << +token.period() << ", "
@@ -0,0 +1,423 @@
+#include "OpenCLEngine.hpp"
+
+#include "OTPGen.hpp"
+#include "OTPKey.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(OTPGEN_WITH_OPENCL) && (defined(__linux__) || defined(__APPLE__))
+#define OTPGEN_OPENCL_RUNTIME
+#include <dlfcn.h>
+#endif
+
+// the few OpenCL 1.2 entry points the engine calls, resolved from the ICD loader at runtime
+// so the library doesn't depend on an OpenCL SDK, the types match the ones of CL/cl.h
+
+namespace {
+    using cl_int = std::int32_t;
+    using cl_uint = std::uint32_t;
+    using cl_ulong = std::uint64_t;
+    using cl_bitfield = cl_ulong;
+    using cl_bool = cl_uint;
+
+    using cl_platform_id = struct _cl_platform_id*;
+    using cl_device_id = struct _cl_device_id*;
+    using cl_context = struct _cl_context*;
+    using cl_command_queue = struct _cl_command_queue*;
+    using cl_mem = struct _cl_mem*;
+    using cl_program = struct _cl_program*;
+    using cl_kernel = struct _cl_kernel*;
+    using cl_event = struct _cl_event*;
+
+    static const constexpr cl_int CL_SUCCESS = 0;
+    static const constexpr cl_bool CL_TRUE = 1U;
+    static const constexpr cl_bitfield CL_DEVICE_TYPE_GPU = 1U << 2U;
+    static const constexpr cl_bitfield CL_DEVICE_TYPE_ACCELERATOR = 1U << 3U;
+    static const constexpr cl_uint CL_DEVICE_NAME = 0x102bU;
+    static const constexpr cl_bitfield CL_MEM_WRITE_ONLY = 1U << 1U;
+    static const constexpr cl_bitfield CL_MEM_READ_ONLY = 1U << 2U;
+    static const constexpr cl_bitfield CL_MEM_COPY_HOST_PTR = 1U << 5U;
+
+    // one work item per counter, the HMAC states of the key are the ones of OTPKey
+    // (5 inner and 5 outer words), the values are reduced to the digits by the modulo
+    static const char *const KERNEL_SOURCE = R"CL(
+        #define ROTL(x, n) rotate((uint)(x), (uint)(n))
+
+        void sha1_block(uint *h, uint *w)
+        {
+            uint a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int t = 0; t < 80; ++t)
+            {
+                if (t >= 16)
+                {
+                    w[t & 15] = ROTL(w[(t + 13) & 15] ^ w[(t + 8) & 15] ^ w[(t + 2) & 15] ^ w[t & 15], 1);
+                }
+                uint f, k;
+                if (t < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999U; }
+                else if (t < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1U; }
+                else if (t < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdcU; }
+                else             { f = b ^ c ^ d;                   k = 0xca62c1d6U; }
+                const uint temp = ROTL(a, 5) + f + e + k + w[t & 15];
+                e = d; d = c; c = ROTL(b, 30); b = a; a = temp;
+            }
+            h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+        }
+
+        __kernel void hotp_sha1(__global const uint *states, __global const ulong *first,
+                                const uint count, const ulong modulo, __global uint *out)
+        {
+            const size_t id = get_global_id(0);
+            const size_t key = id / count;
+            const ulong counter = first[key] + (id % count);
+            __global const uint *state = states + key * 10;
+
+            // inner hash over the counter, the ipad block is already in the state
+            uint h[5], w[16];
+            for (int i = 0; i < 5; ++i) h[i] = state[i];
+            w[0] = (uint)(counter >> 32);
+            w[1] = (uint)counter;
+            w[2] = 0x80000000U;
+            for (int i = 3; i < 15; ++i) w[i] = 0U;
+            w[15] = (64 + 8) * 8;
+            sha1_block(h, w);
+
+            // outer hash over the inner digest
+            for (int i = 0; i < 5; ++i) w[i] = h[i];
+            w[5] = 0x80000000U;
+            for (int i = 6; i < 15; ++i) w[i] = 0U;
+            w[15] = (64 + 20) * 8;
+            for (int i = 0; i < 5; ++i) h[i] = state[5 + i];
+            sha1_block(h, w);
+
+            // dynamic truncation (RFC 4226), the 4 bytes at the offset of the big endian digest
+            const uint offset = h[4] & 0x0fU;
+            const uint word = offset >> 2;
+            const ulong pair = ((ulong)h[word] << 32) | h[word + 1];
+            const uint bin = (uint)(pair >> (32 - (offset & 3U) * 8)) & 0x7fffffffU;
+            out[id] = (uint)(bin % modulo);
+        }
+    )CL";
+
+    static const constexpr std::size_t STATE_WORDS = 10U;
+}
+
+struct OpenCLEngine::Runtime
+{
+#ifdef OTPGEN_OPENCL_RUNTIME
+    void *library = nullptr;
+
+    cl_int (*GetPlatformIDs)(cl_uint, cl_platform_id*, cl_uint*) = nullptr;
+    cl_int (*GetDeviceIDs)(cl_platform_id, cl_bitfield, cl_uint, cl_device_id*, cl_uint*) = nullptr;
+    cl_int (*GetDeviceInfo)(cl_device_id, cl_uint, std::size_t, void*, std::size_t*) = nullptr;
+    cl_context (*CreateContext)(const std::intptr_t*, cl_uint, const cl_device_id*,
+                                void(*)(const char*, const void*, std::size_t, void*), void*, cl_int*) = nullptr;
+    cl_command_queue (*CreateCommandQueue)(cl_context, cl_device_id, cl_bitfield, cl_int*) = nullptr;
+    cl_program (*CreateProgramWithSource)(cl_context, cl_uint, const char**, const std::size_t*, cl_int*) = nullptr;
+    cl_int (*BuildProgram)(cl_program, cl_uint, const cl_device_id*, const char*, void(*)(cl_program, void*), void*) = nullptr;
+    cl_kernel (*CreateKernel)(cl_program, const char*, cl_int*) = nullptr;
+    cl_mem (*CreateBuffer)(cl_context, cl_bitfield, std::size_t, void*, cl_int*) = nullptr;
+    cl_int (*SetKernelArg)(cl_kernel, cl_uint, std::size_t, const void*) = nullptr;
+    cl_int (*EnqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, const std::size_t*, const std::size_t*,
+                                   const std::size_t*, cl_uint, const cl_event*, cl_event*) = nullptr;
+    cl_int (*EnqueueReadBuffer)(cl_command_queue, cl_mem, cl_bool, std::size_t, std::size_t, void*,
+                                cl_uint, const cl_event*, cl_event*) = nullptr;
+    cl_int (*ReleaseMemObject)(cl_mem) = nullptr;
+    cl_int (*ReleaseKernel)(cl_kernel) = nullptr;
+    cl_int (*ReleaseProgram)(cl_program) = nullptr;
+    cl_int (*ReleaseCommandQueue)(cl_command_queue) = nullptr;
+    cl_int (*ReleaseContext)(cl_context) = nullptr;
+
+    cl_device_id device = nullptr;
+    cl_context context = nullptr;
+    cl_command_queue queue = nullptr;
+    cl_program program = nullptr;
+    cl_kernel kernel = nullptr;
+
+    template<typename Function>
+    bool resolve(Function &function, const char *name)
+    {
+        function = reinterpret_cast<Function>(::dlsym(this->library, name));
+        return function != nullptr;
+    }
+
+    bool load()
+    {
+        static const char *const names[] = {
+#ifdef __APPLE__
+            "/System/Library/Frameworks/OpenCL.framework/OpenCL",
+#endif
+            "libOpenCL.so.1",
+            "libOpenCL.so",
+        };
+        for (auto&& name : names)
+        {
+            this->library = ::dlopen(name, RTLD_NOW | RTLD_LOCAL);
+            if (this->library)
+            {
+                break;
+            }
+        }
+
+        return this->library &&
+               resolve(this->GetPlatformIDs, "clGetPlatformIDs") &&
+               resolve(this->GetDeviceIDs, "clGetDeviceIDs") &&
+               resolve(this->GetDeviceInfo, "clGetDeviceInfo") &&
+               resolve(this->CreateContext, "clCreateContext") &&
+               resolve(this->CreateCommandQueue, "clCreateCommandQueue") &&
+               resolve(this->CreateProgramWithSource, "clCreateProgramWithSource") &&
+               resolve(this->BuildProgram, "clBuildProgram") &&
+               resolve(this->CreateKernel, "clCreateKernel") &&
+               resolve(this->CreateBuffer, "clCreateBuffer") &&
+               resolve(this->SetKernelArg, "clSetKernelArg") &&
+               resolve(this->EnqueueNDRangeKernel, "clEnqueueNDRangeKernel") &&
+               resolve(this->EnqueueReadBuffer, "clEnqueueReadBuffer") &&
+               resolve(this->ReleaseMemObject, "clReleaseMemObject") &&
+               resolve(this->ReleaseKernel, "clReleaseKernel") &&
+               resolve(this->ReleaseProgram, "clReleaseProgram") &&
+               resolve(this->ReleaseCommandQueue, "clReleaseCommandQueue") &&
+               resolve(this->ReleaseContext, "clReleaseContext");
+    }
+
+    // the first GPU of any platform, accelerators otherwise
+    bool findDevice()
+    {
+        cl_uint platform_count = 0U;
+        if (this->GetPlatformIDs(0U, nullptr, &platform_count) != CL_SUCCESS || platform_count == 0U)
+        {
+            return false;
+        }
+        std::vector<cl_platform_id> platforms(platform_count);
+        if (this->GetPlatformIDs(platform_count, platforms.data(), nullptr) != CL_SUCCESS)
+        {
+            return false;
+        }
+
+        for (auto&& type : {CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ACCELERATOR})
+        {
+            for (auto&& platform : platforms)
+            {
+                cl_uint found = 0U;
+                if (this->GetDeviceIDs(platform, type, 1U, &this->device, &found) == CL_SUCCESS && found > 0U)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool open(std::string &name)
+    {
+        if (!load() || !findDevice())
+        {
+            return false;
+        }
+
+        char buffer[256] = {};
+        if (this->GetDeviceInfo(this->device, CL_DEVICE_NAME, sizeof(buffer) - 1U, buffer, nullptr) == CL_SUCCESS)
+        {
+            name = buffer;
+        }
+
+        cl_int status = CL_SUCCESS;
+        this->context = this->CreateContext(nullptr, 1U, &this->device, nullptr, nullptr, &status);
+        if (status != CL_SUCCESS)
+        {
+            return false;
+        }
+        this->queue = this->CreateCommandQueue(this->context, this->device, 0U, &status);
+        if (status != CL_SUCCESS)
+        {
+            return false;
+        }
+        const char *source = KERNEL_SOURCE;
+        this->program = this->CreateProgramWithSource(this->context, 1U, &source, nullptr, &status);
+        if (status != CL_SUCCESS || this->BuildProgram(this->program, 1U, &this->device, "", nullptr, nullptr) != CL_SUCCESS)
+        {
+            return false;
+        }
+        this->kernel = this->CreateKernel(this->program, "hotp_sha1", &status);
+        return status == CL_SUCCESS;
+    }
+
+    // one launch over key_count keys with count counters each
+    bool launch(const cl_uint *states, const cl_ulong *first, std::size_t key_count, std::size_t count,
+                cl_ulong modulo, std::uint32_t *out)
+    {
+        const auto items = key_count * count;
+        cl_int status = CL_SUCCESS, states_status = CL_SUCCESS, first_status = CL_SUCCESS;
+        auto states_buffer = this->CreateBuffer(this->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                                key_count * STATE_WORDS * sizeof(cl_uint), const_cast<cl_uint*>(states), &states_status);
+        auto first_buffer = this->CreateBuffer(this->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                               key_count * sizeof(cl_ulong), const_cast<cl_ulong*>(first), &first_status);
+        auto out_buffer = this->CreateBuffer(this->context, CL_MEM_WRITE_ONLY, items * sizeof(cl_uint), nullptr, &status);
+
+        const auto count_arg = static_cast<cl_uint>(count);
+        auto result = states_status == CL_SUCCESS && first_status == CL_SUCCESS && status == CL_SUCCESS &&
+                      this->SetKernelArg(this->kernel, 0U, sizeof(cl_mem), &states_buffer) == CL_SUCCESS &&
+                      this->SetKernelArg(this->kernel, 1U, sizeof(cl_mem), &first_buffer) == CL_SUCCESS &&
+                      this->SetKernelArg(this->kernel, 2U, sizeof(cl_uint), &count_arg) == CL_SUCCESS &&
+                      this->SetKernelArg(this->kernel, 3U, sizeof(cl_ulong), &modulo) == CL_SUCCESS &&
+                      this->SetKernelArg(this->kernel, 4U, sizeof(cl_mem), &out_buffer) == CL_SUCCESS &&
+                      this->EnqueueNDRangeKernel(this->queue, this->kernel, 1U, nullptr, &items, nullptr, 0U, nullptr, nullptr) == CL_SUCCESS &&
+                      this->EnqueueReadBuffer(this->queue, out_buffer, CL_TRUE, 0U, items * sizeof(cl_uint), out, 0U, nullptr, nullptr) == CL_SUCCESS;
+
+        for (auto&& buffer : {states_buffer, first_buffer, out_buffer})
+        {
+            if (buffer)
+            {
+                this->ReleaseMemObject(buffer);
+            }
+        }
+        return result;
+    }
+
+    ~Runtime()
+    {
+        if (this->kernel) this->ReleaseKernel(this->kernel);
+        if (this->program) this->ReleaseProgram(this->program);
+        if (this->queue) this->ReleaseCommandQueue(this->queue);
+        if (this->context) this->ReleaseContext(this->context);
+        if (this->library) ::dlclose(this->library);
+    }
+#else
+    bool open(std::string&)
+    {
+        return false;
+    }
+
+    bool launch(const cl_uint*, const cl_ulong*, std::size_t, std::size_t, cl_ulong, std::uint32_t*)
+    {
+        return false;
+    }
+#endif
+};
+
+OpenCLEngine::OpenCLEngine()
+    : _runtime(new Runtime())
+{
+    if (!this->_runtime->open(this->_device) || !this->selfTest())
+    {
+        this->_runtime.reset();
+        this->_device.clear();
+    }
+}
+
+OpenCLEngine::~OpenCLEngine()
+{
+}
+
+bool OpenCLEngine::isAvailable() const
+{
+    return this->_runtime != nullptr;
+}
+
+const std::string &OpenCLEngine::deviceName() const
+{
+    return this->_device;
+}
+
+bool OpenCLEngine::supports(const OTPToken::ShaAlgorithm &algorithm) const
+{
+    return this->_runtime && algorithm == OTPToken::SHA1;
+}
+
+std::size_t OpenCLEngine::minimumWork() const
+{
+    return MINIMUM_WORK;
+}
+
+bool OpenCLEngine::computeHOTPValues(const OTPKey *keys, std::size_t key_count,
+                                     const std::uint64_t *first, std::size_t count,
+                                     const OTPToken::DigitType &digits,
+                                     std::uint32_t *out)
+{
+    if (!this->_runtime || digits < OTPGen::minDigitLength() || digits > OTPGen::maxDigitLength())
+    {
+        return false;
+    }
+    for (auto i = 0U; i < key_count; ++i)
+    {
+        if (!keys[i].isValid() || keys[i].algorithm() != OTPToken::SHA1)
+        {
+            return false;
+        }
+    }
+
+    cl_ulong modulo = 1U;
+    for (auto i = 0U; i < digits; ++i)
+    {
+        modulo *= 10U;
+    }
+
+    // launches cover blocks of keys with a part of their counters, the values of a
+    // launch are copied into the rows of the keys
+    const auto span = std::min(count, LAUNCH_SIZE);
+    const auto block = std::max<std::size_t>(1U, LAUNCH_SIZE / span);
+    std::vector<cl_uint> states;
+    std::vector<cl_ulong> starts;
+    std::vector<std::uint32_t> values;
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    for (std::size_t begin = 0U; begin < key_count; begin += block)
+    {
+        const auto size = std::min(block, key_count - begin);
+        states.resize(size * STATE_WORDS);
+        for (auto i = 0U; i < size; ++i)
+        {
+            std::memcpy(states.data() + i * STATE_WORDS, keys[begin + i].innerState(), 5U * sizeof(cl_uint));
+            std::memcpy(states.data() + i * STATE_WORDS + 5U, keys[begin + i].outerState(), 5U * sizeof(cl_uint));
+        }
+
+        for (std::size_t offset = 0U; offset < count; offset += span)
+        {
+            const auto length = std::min(span, count - offset);
+            starts.resize(size);
+            for (auto i = 0U; i < size; ++i)
+            {
+                starts[i] = first[begin + i] + offset;
+            }
+
+            values.resize(size * length);
+            if (!this->_runtime->launch(states.data(), starts.data(), size, length, modulo, values.data()))
+            {
+                std::fill(states.begin(), states.end(), 0U);
+                return false;
+            }
+            for (auto i = 0U; i < size; ++i)
+            {
+                std::copy_n(values.data() + i * length, length, out + (begin + i) * count + offset);
+            }
+        }
+    }
+
+    // the states are keys as well
+    std::fill(states.begin(), states.end(), 0U);
+    return true;
+}
+
+// the RFC 4226 test key and counters, compared with the codes of OTPGen
+bool OpenCLEngine::selfTest()
+{
+    static const char RFC_KEY[] = "12345678901234567890";
+    static const constexpr std::size_t COUNTERS = 10U;
+
+    const auto key = OTPGen::prepareRawKey(reinterpret_cast<const unsigned char*>(RFC_KEY), sizeof(RFC_KEY) - 1U, OTPToken::SHA1);
+    const std::uint64_t first = 0U;
+    std::uint32_t values[COUNTERS] = {};
+    if (!this->computeHOTPValues(&key, 1U, &first, COUNTERS, 6U, values))
+    {
+        return false;
+    }
+
+    for (auto i = 0U; i < COUNTERS; ++i)
+    {
+        if (values[i] != std::stoul(OTPGen::computeHOTP(key, i, 6U)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef OPENCLENGINE_HPP
+#define OPENCLENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "BatchEngine.hpp"
+
+/**
+ * OpenCL batch engine for very large HOTP series
+ *
+ * Resyncing the windows of whole fleets of hardware tokens and recomputing
+ * years of TOTP codes for audits are millions of independent HMACs. The
+ * engine runs them on the first GPU (or accelerator) of the system, one
+ * work item per counter, from the cached HMAC states of the prepared keys.
+ *
+ * The OpenCL runtime is loaded when the engine is constructed, neither the
+ * SDK nor the runtime is needed to build or run the library. The engine is
+ * only available when a device was found and its results of the RFC 4226
+ * test vectors are identical to the ones of OTPGen, otherwise every job
+ * is refused and stays on the CPU.
+ *
+ * Only SHA1 keys are offloaded, jobs are split into launches of a bounded
+ * size, calls from several threads are serialized.
+ *
+ *   OpenCLEngine gpu;
+ *   if (gpu.isAvailable()) OTPGen::setBatchEngine(&gpu);
+ *
+ */
+class OpenCLEngine : public BatchEngine
+{
+public:
+    OpenCLEngine();
+    ~OpenCLEngine();
+
+    OpenCLEngine(const OpenCLEngine&) = delete;
+    OpenCLEngine &operator= (const OpenCLEngine&) = delete;
+
+    // a device was found and passed the test vectors
+    bool isAvailable() const;
+    // name of the device, empty if not available
+    const std::string &deviceName() const;
+
+    bool supports(const OTPToken::ShaAlgorithm &algorithm) const override;
+    std::size_t minimumWork() const override;
+    bool computeHOTPValues(const OTPKey *keys, std::size_t key_count,
+                           const std::uint64_t *first, std::size_t count,
+                           const OTPToken::DigitType &digits,
+                           std::uint32_t *out) override;
+
+private:
+    // values per kernel launch, bounds the device buffers
+    static const constexpr std::size_t LAUNCH_SIZE = std::size_t(1U) << 22U;
+    // below this the transfers cost more than the multi-buffer kernels of the CPU
+    static const constexpr std::size_t MINIMUM_WORK = std::size_t(1U) << 16U;
+
+    bool selfTest();
+
+    struct Runtime;
+    std::unique_ptr<Runtime> _runtime;
+    std::string _device;
+    std::mutex _mutex;
+};
+
+#endif // OPENCLENGINE_HPP
@@ -0,0 +1,410 @@
+#include "PerfStats.hpp"
+#include "SecureMemory.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+namespace {
+    struct AtomicHistogram {
+        std::atomic<std::uint64_t> count{0U};
+        std::atomic<std::uint64_t> totalNs{0U};
+        std::atomic<std::uint64_t> maxNs{0U};
+        std::atomic<std::uint64_t> buckets[PerfStats::HISTOGRAM_BUCKETS] = {};
+    };
+
+    // the counters of a group of threads, on cache lines of their own
+    struct alignas(64) Stripe {
+        AtomicHistogram timers[PerfStats::TimerCount];
+        std::atomic<std::uint64_t> counters[PerfStats::CounterCount] = {};
+    };
+
+    static const constexpr std::size_t STRIPES = 16U;
+
+    static Stripe stripes[STRIPES];
+    static std::atomic<std::size_t> next_stripe{0U};
+    static std::atomic<const PerfStats::TraceHooks*> trace_hooks{nullptr};
+
+    struct AtomicMemory {
+        std::atomic<std::uint64_t> current{0U};
+        std::atomic<std::uint64_t> peak{0U};
+    };
+
+    static AtomicMemory memory_usage[PerfStats::MemoryCount];
+
+    // threads are assigned to the stripes round robin when they first record
+    static Stripe &stripe() noexcept
+    {
+        thread_local Stripe &own = stripes[next_stripe.fetch_add(1U, std::memory_order_relaxed) % STRIPES];
+        return own;
+    }
+
+    static std::size_t bucket(std::uint64_t ns)
+    {
+        auto us = ns / 1000U;
+        auto index = 0U;
+        while (us > 1U && index + 1U < PerfStats::HISTOGRAM_BUCKETS)
+        {
+            us >>= 1U;
+            ++index;
+        }
+        return index;
+    }
+}
+
+std::uint64_t PerfStats::Histogram::percentileUs(double fraction) const
+{
+    if (this->count == 0U)
+    {
+        return 0U;
+    }
+
+    const auto target = static_cast<std::uint64_t>(fraction * static_cast<double>(this->count));
+    std::uint64_t seen = 0U;
+    for (auto i = 0U; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += this->buckets[i];
+        if (seen > target || seen == this->count)
+        {
+            return 2ULL << i;
+        }
+    }
+    return 2ULL << (HISTOGRAM_BUCKETS - 1U);
+}
+
+void PerfStats::record(const Timer &timer, std::uint64_t ns) noexcept
+{
+    if (timer >= TimerCount)
+    {
+        return;
+    }
+
+    auto &h = stripe().timers[timer];
+    h.count.fetch_add(1U, std::memory_order_relaxed);
+    h.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    h.buckets[bucket(ns)].fetch_add(1U, std::memory_order_relaxed);
+
+    auto max = h.maxNs.load(std::memory_order_relaxed);
+    while (ns > max && !h.maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+void PerfStats::add(const Counter &counter, std::uint64_t value) noexcept
+{
+    if (counter < CounterCount)
+    {
+        stripe().counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+}
+
+void PerfStats::allocate(const Memory &memory, std::uint64_t bytes) noexcept
+{
+    if (memory >= MemoryCount || bytes == 0U)
+    {
+        return;
+    }
+
+    auto &m = memory_usage[memory];
+    const auto current = m.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    auto peak = m.peak.load(std::memory_order_relaxed);
+    while (current > peak && !m.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+    {
+    }
+}
+
+void PerfStats::release(const Memory &memory, std::uint64_t bytes) noexcept
+{
+    if (memory < MemoryCount && bytes != 0U)
+    {
+        memory_usage[memory].current.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+}
+
+PerfStats::Snapshot PerfStats::snapshot() noexcept
+{
+    Snapshot s;
+    for (auto&& stripe : stripes)
+    {
+        for (auto t = 0U; t < TimerCount; ++t)
+        {
+            const auto &h = stripe.timers[t];
+            s.timers[t].count += h.count.load(std::memory_order_relaxed);
+            s.timers[t].totalNs += h.totalNs.load(std::memory_order_relaxed);
+            s.timers[t].maxNs = std::max(s.timers[t].maxNs, h.maxNs.load(std::memory_order_relaxed));
+            for (auto i = 0U; i < HISTOGRAM_BUCKETS; ++i)
+            {
+                s.timers[t].buckets[i] += h.buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+        for (auto c = 0U; c < CounterCount; ++c)
+        {
+            s.counters[c] += stripe.counters[c].load(std::memory_order_relaxed);
+        }
+    }
+    for (auto m = 0U; m < MemoryCount; ++m)
+    {
+        s.memory[m].currentBytes = memory_usage[m].current.load(std::memory_order_relaxed);
+        s.memory[m].peakBytes = std::max(s.memory[m].currentBytes, memory_usage[m].peak.load(std::memory_order_relaxed));
+    }
+
+#ifdef OTPGEN_WITH_PERF_STATS
+    // the arena keeps its own statistics
+    s.memory[SecretMemory].currentBytes = SecureMemory::allocatedBytes();
+    s.memory[SecretMemory].peakBytes = SecureMemory::peakBytes();
+#endif
+    return s;
+}
+
+void PerfStats::reset() noexcept
+{
+    for (auto&& stripe : stripes)
+    {
+        for (auto&& h : stripe.timers)
+        {
+            h.count.store(0U, std::memory_order_relaxed);
+            h.totalNs.store(0U, std::memory_order_relaxed);
+            h.maxNs.store(0U, std::memory_order_relaxed);
+            for (auto&& b : h.buckets)
+            {
+                b.store(0U, std::memory_order_relaxed);
+            }
+        }
+        for (auto&& c : stripe.counters)
+        {
+            c.store(0U, std::memory_order_relaxed);
+        }
+    }
+    for (auto&& m : memory_usage)
+    {
+        m.peak.store(m.current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    SecureMemory::resetPeak();
+}
+
+const char *PerfStats::timerName(const Timer &timer)
+{
+    switch (timer)
+    {
+        case Load:         return "load";
+        case Decrypt:      return "decrypt";
+        case Deserialize:  return "deserialize";
+        case Validate:     return "validate";
+        case Save:         return "save";
+        case Encrypt:      return "encrypt";
+        case Write:        return "write";
+        case Verify:       return "verify";
+        case Generate:     return "generate";
+        case Frame:        return "frame";
+        case ModelFetch:   return "model_fetch";
+        case EventLoopLag: return "event_loop_lag";
+        case TimerCount:   break;
+    }
+    return "";
+}
+
+const char *PerfStats::counterName(const Counter &counter)
+{
+    switch (counter)
+    {
+        case CodesGenerated:       return "codes_generated";
+        case CodesVerified:        return "codes_verified";
+        case CodesReused:          return "codes_reused";
+        case StepsVerified:        return "steps_verified";
+        case CodesShared:          return "codes_shared";
+        case CodeCacheHits:        return "code_cache_hits";
+        case CodeCacheMisses:      return "code_cache_misses";
+        case StatementCacheHits:   return "statement_cache_hits";
+        case StatementCacheMisses: return "statement_cache_misses";
+        case LabelCacheHits:       return "label_cache_hits";
+        case LabelCacheMisses:     return "label_cache_misses";
+        case KeyCacheHits:         return "key_cache_hits";
+        case KeyCacheMisses:       return "key_cache_misses";
+        case ImageBytesCopied:     return "image_bytes_copied";
+        case PreparedKeyHits:      return "prepared_key_hits";
+        case PreparedKeyMisses:    return "prepared_key_misses";
+        case AttemptsLimited:      return "attempts_limited";
+        case AuditRecords:         return "audit_records";
+        case AuditStalls:          return "audit_stalls";
+        case JsonArenaSpills:      return "json_arena_spills";
+        case IconCacheHits:        return "icon_cache_hits";
+        case IconCacheMisses:      return "icon_cache_misses";
+        case EventLoopStalls:      return "event_loop_stalls";
+        case CounterCount:         break;
+    }
+    return "";
+}
+
+const char *PerfStats::memoryName(const Memory &memory)
+{
+    switch (memory)
+    {
+        case SqliteMemory:    return "sqlite";
+        case SqlitePageCache: return "sqlite_page_cache";
+        case SecretMemory:    return "secrets";
+        case DecryptBuffers:  return "decrypt_buffers";
+        case TokenStorage:    return "tokens";
+        case ImportDocuments: return "import_documents";
+        case QRCodeBitmaps:   return "qrcode_bitmaps";
+        case MemoryCount:     break;
+    }
+    return "";
+}
+
+void PerfStats::writeMetrics(const Snapshot &snapshot, const std::vector<Gauge> &gauges,
+                             std::string &out, bool openmetrics)
+{
+    const auto number = [](double value) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        return std::string(buffer);
+    };
+
+    // bucket i holds the latencies below 2^(i+1) microseconds, the last one everything above
+    for (auto t = 0U; t < TimerCount; ++t)
+    {
+        const auto &h = snapshot.timers[t];
+        const auto name = std::string("otpgen_") + timerName(static_cast<Timer>(t)) + "_seconds";
+        out += "# HELP " + name + " Latency of " + timerName(static_cast<Timer>(t)) + " operations.\n";
+        out += "# TYPE " + name + " histogram\n";
+        std::uint64_t cumulative = 0U;
+        for (auto i = 0U; i + 1U < HISTOGRAM_BUCKETS; ++i)
+        {
+            cumulative += h.buckets[i];
+            out += name + "_bucket{le=\"" + number(static_cast<double>(2ULL << i) / 1e6) + "\"} " + std::to_string(cumulative) + "\n";
+        }
+        out += name + "_bucket{le=\"+Inf\"} " + std::to_string(h.count) + "\n";
+        out += name + "_sum " + number(static_cast<double>(h.totalNs) / 1e9) + "\n";
+        out += name + "_count " + std::to_string(h.count) + "\n";
+    }
+
+    // counter families carry no _total suffix in OpenMetrics, their samples do
+    for (auto c = 0U; c < CounterCount; ++c)
+    {
+        const auto name = std::string("otpgen_") + counterName(static_cast<Counter>(c));
+        const auto family = openmetrics ? name : name + "_total";
+        out += "# HELP " + family + " Count of " + counterName(static_cast<Counter>(c)) + ".\n";
+        out += "# TYPE " + family + " counter\n";
+        out += name + "_total " + std::to_string(snapshot.counters[c]) + "\n";
+    }
+
+    // one family for the current sizes and one for the peaks, labeled by subsystem
+    for (auto&& peak : {false, true})
+    {
+        const auto name = std::string(peak ? "otpgen_memory_peak_bytes" : "otpgen_memory_bytes");
+        out += "# HELP " + name + (peak ? " Peak" : " Current") + " memory of the subsystems in bytes.\n";
+        out += "# TYPE " + name + " gauge\n";
+        for (auto m = 0U; m < MemoryCount; ++m)
+        {
+            const auto &usage = snapshot.memory[m];
+            out += name + "{subsystem=\"" + memoryName(static_cast<Memory>(m)) + "\"} " +
+                   std::to_string(peak ? usage.peakBytes : usage.currentBytes) + "\n";
+        }
+    }
+
+    for (auto&& gauge : gauges)
+    {
+        const auto name = "otpgen_" + gauge.name;
+        out += "# HELP " + name + " " + gauge.help + "\n";
+        out += "# TYPE " + name + " gauge\n";
+        out += name + " " + number(gauge.value) + "\n";
+    }
+
+    if (openmetrics)
+    {
+        out += "# EOF\n";
+    }
+}
+
+void PerfStats::setTraceHooks(const TraceHooks *hooks) noexcept
+{
+    trace_hooks.store(hooks, std::memory_order_release);
+}
+
+PerfStats::Scope::Scope(const char *name, const Timer &timer) noexcept
+    : _hooks(trace_hooks.load(std::memory_order_acquire)),
+      _timer(timer)
+{
+    if (this->_hooks && this->_hooks->begin)
+    {
+        this->_context = this->_hooks->begin(name);
+    }
+    if (this->_timer < TimerCount)
+    {
+        this->_start = std::chrono::steady_clock::now();
+    }
+}
+
+PerfStats::Scope::~Scope()
+{
+    if (this->_timer < TimerCount)
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - this->_start;
+        record(this->_timer, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+    if (this->_hooks && this->_hooks->end)
+    {
+        this->_hooks->end(this->_context);
+    }
+}
+
+PerfStats::Allocation::Allocation(const Memory &memory, std::uint64_t bytes) noexcept
+    : _memory(memory),
+      _bytes(bytes)
+{
+    allocate(this->_memory, this->_bytes);
+}
+
+PerfStats::Allocation::~Allocation()
+{
+    release(this->_memory, this->_bytes);
+}
+
+PerfStats::Allocation::Allocation(const Allocation &other) noexcept
+    : Allocation(other._memory, other._bytes)
+{
+}
+
+PerfStats::Allocation::Allocation(Allocation &&other) noexcept
+    : _memory(other._memory),
+      _bytes(other._bytes)
+{
+    other._bytes = 0U;
+}
+
+PerfStats::Allocation &PerfStats::Allocation::operator= (const Allocation &other) noexcept
+{
+    if (this != &other)
+    {
+        release(this->_memory, this->_bytes);
+        this->_memory = other._memory;
+        this->_bytes = other._bytes;
+        allocate(this->_memory, this->_bytes);
+    }
+    return *this;
+}
+
+PerfStats::Allocation &PerfStats::Allocation::operator= (Allocation &&other) noexcept
+{
+    if (this != &other)
+    {
+        release(this->_memory, this->_bytes);
+        this->_memory = other._memory;
+        this->_bytes = other._bytes;
+        other._bytes = 0U;
+    }
+    return *this;
+}
+
+void PerfStats::Allocation::resize(std::uint64_t bytes) noexcept
+{
+    if (bytes > this->_bytes)
+    {
+        allocate(this->_memory, bytes - this->_bytes);
+    }
+    else
+    {
+        release(this->_memory, this->_bytes - bytes);
+    }
+    this->_bytes = bytes;
+}
@@ -0,0 +1,228 @@
+#ifndef PERFSTATS_HPP
+#define PERFSTATS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Process wide performance counters and trace scopes
+ *
+ * Timers record the latency of the expensive database operations into
+ * histograms with power of two buckets (in microseconds), counters count
+ * generated and verified codes and the hits and misses of the caches.
+ * All counters are relaxed atomics, recording never takes a lock. The
+ * atomics are striped over cache lines, every thread records into a stripe
+ * of its own and the snapshot adds them up, so threads recording at the
+ * same time don't contend for the same lines.
+ *
+ * Memory is accounted per subsystem, with the current and the peak size.
+ * Buffers are accounted by an Allocation which lives as long as they do,
+ * sqlite through its memory hooks and the secure memory arena by itself.
+ * Unlike the counters the sizes are single atomics, peaks need the total.
+ *
+ * writeMetrics() renders a snapshot in the Prometheus text format (or as
+ * OpenMetrics) for scraping.
+ *
+ * Trace hooks forward the named scopes to an external profiler, the begin
+ * hook returns a value which is passed to the end hook of the same scope,
+ * which fits the zone context of Tracy (___tracy_emit_zone_begin) and the
+ * begin/end events of Perfetto (TRACE_EVENT_BEGIN / TRACE_EVENT_END).
+ *
+ * Without OTPGEN_WITH_PERF_STATS the OTPGEN_PERF_* macros expand to nothing,
+ * the snapshot is empty and the hooks are never called.
+ *
+ */
+class PerfStats
+{
+public:
+    enum Timer : std::uint8_t {
+        Load = 0,     // TokenDatabase::loadTokens()
+        Decrypt,      // decryption of database images
+        Deserialize,  // handing the decrypted image to sqlite
+        Validate,     // migrations and schema validation
+        Save,         // TokenDatabase::saveTokens() which wrote to disk
+        Encrypt,      // encryption of database images
+        Write,        // atomic file writes
+        Verify,       // verify requests of the server and the daemon
+        Generate,     // generate requests of the server and the daemon
+        Frame,        // paint events of the GUI token list
+        ModelFetch,   // updates of the GUI token model from the database
+        EventLoopLag, // delay of the GUI event loop beyond its heartbeat interval
+
+        TimerCount
+    };
+
+    enum Counter : std::uint8_t {
+        CodesGenerated = 0,   // codes computed by OTPGen
+        CodesVerified,        // codes checked by the verify functions
+        CodesReused,          // matching codes rejected by the used code store
+        StepsVerified,        // time steps computed by the verify functions
+        CodesShared,          // codes of concurrent verifications taken from the code coalescer
+        CodeCacheHits,        // TokenCodeCache lookups
+        CodeCacheMisses,
+        StatementCacheHits,   // prepared statements of TokenDatabase
+        StatementCacheMisses,
+        LabelCacheHits,       // label to id lookups of TokenDatabase
+        LabelCacheMisses,
+        KeyCacheHits,         // derived keys of the encrypted container
+        KeyCacheMisses,
+        ImageBytesCopied,     // bytes of database images written into memory by loadTokens()
+        PreparedKeyHits,      // keys of PreparedKeyCache
+        PreparedKeyMisses,
+        AttemptsLimited,      // verifications refused by RateLimiter
+        AuditRecords,         // records written by AuditLog
+        AuditStalls,          // records which waited for room in the ring of their thread
+        JsonArenaSpills,      // imports whose documents didn't fit into the JSON arena of their thread
+        IconCacheHits,        // GUI icon renderings found in memory or on disk
+        IconCacheMisses,      // GUI icons rendered from SVG
+        EventLoopStalls,      // GUI heartbeats which were 50 ms or more late
+
+        CounterCount
+    };
+
+    enum Memory : std::uint8_t {
+        SqliteMemory = 0,     // all allocations of sqlite, through its memory hooks
+        SqlitePageCache,      // pages cached by the open database, part of the sqlite memory
+        SecretMemory,         // the secure memory arena: secrets, keys and passwords
+        DecryptBuffers,       // encrypted images while they are saved, page buffers of encrypted databases
+        TokenStorage,         // labels, icons and keys held by TokenSet, TokenCodeCache and PreparedKeyCache
+        ImportDocuments,      // documents and unescaped copies of the importers
+        QRCodeBitmaps,        // pixels of decoded QR Code images
+
+        MemoryCount
+    };
+
+    // bucket 0 holds latencies below 2 microseconds, bucket i those below 2^(i+1)
+    static const constexpr std::size_t HISTOGRAM_BUCKETS = 32U;
+
+    struct Histogram
+    {
+        std::uint64_t count = 0U;
+        std::uint64_t totalNs = 0U;
+        std::uint64_t maxNs = 0U;
+        std::uint64_t buckets[HISTOGRAM_BUCKETS] = {};
+
+        // upper bound of the bucket which holds the given fraction (0..1) of the samples
+        std::uint64_t percentileUs(double fraction) const;
+        inline double meanNs() const
+        { return this->count ? static_cast<double>(this->totalNs) / static_cast<double>(this->count) : 0.0; }
+    };
+
+    struct MemoryUsage
+    {
+        std::uint64_t currentBytes = 0U;
+        std::uint64_t peakBytes = 0U;
+    };
+
+    struct Snapshot
+    {
+        Histogram timers[TimerCount];
+        std::uint64_t counters[CounterCount] = {};
+        MemoryUsage memory[MemoryCount];
+    };
+
+    // value computed by the frontend at scrape time, like the occupancy of a store
+    struct Gauge
+    {
+        std::string name;
+        std::string help;
+        double value = 0.0;
+    };
+
+    struct TraceHooks
+    {
+        std::uint64_t (*begin)(const char *name) = nullptr;
+        void (*end)(std::uint64_t context) = nullptr;
+    };
+
+    // records a latency or adds to a counter
+    static void record(const Timer &timer, std::uint64_t ns) noexcept;
+    static void add(const Counter &counter, std::uint64_t value = 1U) noexcept;
+
+    // accounts memory to a subsystem, released bytes must have been allocated before
+    static void allocate(const Memory &memory, std::uint64_t bytes) noexcept;
+    static void release(const Memory &memory, std::uint64_t bytes) noexcept;
+
+    // reset() starts the peaks of the memory again at the current sizes
+    static Snapshot snapshot() noexcept;
+    static void reset() noexcept;
+
+    static const char *timerName(const Timer &timer);
+    static const char *counterName(const Counter &counter);
+    static const char *memoryName(const Memory &memory);
+
+    // appends the timers (as histograms in seconds), the counters, the memory and the gauges in the Prometheus
+    // text format, metric names are prefixed with otpgen_, openmetrics ends the exposition with # EOF
+    static void writeMetrics(const Snapshot &snapshot, const std::vector<Gauge> &gauges,
+                             std::string &out, bool openmetrics = false);
+
+    // the hooks must stay valid until they are replaced, nullptr removes them
+    static void setTraceHooks(const TraceHooks *hooks) noexcept;
+
+    // times the enclosing block and reports it to the trace hooks,
+    // TimerCount only traces the scope
+    class Scope
+    {
+    public:
+        Scope(const char *name, const Timer &timer = TimerCount) noexcept;
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope &operator= (const Scope&) = delete;
+
+    private:
+        const TraceHooks *_hooks;
+        std::uint64_t _context = 0U;
+        Timer _timer;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    // bytes accounted to a subsystem while the owner lives, copies account them again
+    class Allocation
+    {
+    public:
+        explicit Allocation(const Memory &memory, std::uint64_t bytes = 0U) noexcept;
+        ~Allocation();
+
+        Allocation(const Allocation &other) noexcept;
+        Allocation(Allocation &&other) noexcept;
+        Allocation &operator= (const Allocation &other) noexcept;
+        Allocation &operator= (Allocation &&other) noexcept;
+
+        void resize(std::uint64_t bytes) noexcept;
+        inline void add(std::uint64_t bytes) noexcept
+        { this->resize(this->_bytes + bytes); }
+        inline std::uint64_t bytes() const
+        { return this->_bytes; }
+
+    private:
+        Memory _memory;
+        std::uint64_t _bytes = 0U;
+    };
+
+private:
+    PerfStats() = delete;
+};
+
+#ifdef OTPGEN_WITH_PERF_STATS
+#define OTPGEN_PERF_CONCAT_IMPL(a, b) a##b
+#define OTPGEN_PERF_CONCAT(a, b) OTPGEN_PERF_CONCAT_IMPL(a, b)
+#define OTPGEN_PERF_SCOPE(name, timer) PerfStats::Scope OTPGEN_PERF_CONCAT(perf_scope_, __LINE__)(name, PerfStats::timer)
+#define OTPGEN_PERF_TRACE(name) PerfStats::Scope OTPGEN_PERF_CONCAT(perf_scope_, __LINE__)(name)
+#define OTPGEN_PERF_COUNT(counter, value) PerfStats::add(PerfStats::counter, value)
+#define OTPGEN_PERF_MEMORY(memory, bytes) PerfStats::Allocation OTPGEN_PERF_CONCAT(perf_memory_, __LINE__)(PerfStats::memory, bytes)
+#define OTPGEN_PERF_MEMORY_ADD(allocation, bytes) (allocation).add(bytes)
+#define OTPGEN_PERF_MEMORY_RESIZE(allocation, bytes) (allocation).resize(bytes)
+#else
+#define OTPGEN_PERF_SCOPE(name, timer) do {} while (0)
+#define OTPGEN_PERF_TRACE(name) do {} while (0)
+#define OTPGEN_PERF_COUNT(counter, value) do {} while (0)
+#define OTPGEN_PERF_MEMORY(memory, bytes) do {} while (0)
+#define OTPGEN_PERF_MEMORY_ADD(allocation, bytes) do {} while (0)
+#define OTPGEN_PERF_MEMORY_RESIZE(allocation, bytes) do {} while (0)
+#endif
+
+#endif // PERFSTATS_HPP
@@ -0,0 +1,247 @@
+#include "PreparedKeyCache.hpp"
+#include "OTPGen.hpp"
+#include "Clock.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+    // allocation of the shared key and the index node of the id, roughly
+    static const constexpr std::size_t ENTRY_OVERHEAD = 64U;
+
+    static std::size_t roundUpPowerOf2(std::size_t value)
+    {
+        std::size_t power = 1U;
+        while (power < value)
+        {
+            power <<= 1U;
+        }
+        return power;
+    }
+}
+
+PreparedKeyCache::PreparedKeyCache(const std::size_t &budget, const std::size_t &shards)
+    : _budget(budget)
+{
+    const auto count = roundUpPowerOf2(shards ? shards : std::max(1U, std::thread::hardware_concurrency()));
+    this->_shardBudget = budget / count;
+    this->_shards.reserve(count);
+    for (auto i = 0U; i < count; ++i)
+    {
+        this->_shards.emplace_back(std::make_unique<Shard>());
+    }
+}
+
+std::size_t PreparedKeyCache::cost(const OTPKey &key)
+{
+    return sizeof(Slot) + sizeof(OTPKey) + key.key().capacity() + ENTRY_OVERHEAD;
+}
+
+std::uint64_t PreparedKeyCache::tag(const OTPToken &token)
+{
+    // FNV-1a of the secret and the algorithm the key is prepared for, only tells if the token changed
+    const auto algorithm = token.type() == OTPToken::Steam ? OTPToken::SHA1 : token.algorithm();
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto&& c : token.secret())
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return (hash ^ algorithm) * 0x100000001b3ULL;
+}
+
+PreparedKeyCache::Shard &PreparedKeyCache::shard(const OTPToken::sqliteTokenID &id)
+{
+    const auto hash = static_cast<std::uint64_t>(id) * 0x9e3779b97f4a7c15ULL;
+    return *this->_shards[(hash >> 32U) & (this->_shards.size() - 1U)];
+}
+
+PreparedKeyCache::KeyPointer PreparedKeyCache::key(const OTPToken &token, OTPGenErrorCode *error)
+{
+    if (error)
+    {
+        (*error) = OTPGenErrorCode::Valid;
+    }
+
+    // tokens which aren't stored have no unique id and are never cached
+    const auto id = token.id();
+    const auto t = tag(token);
+    auto &s = this->shard(id);
+    if (id != 0)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        const auto it = s.index.find(id);
+        if (it != s.index.end() && s.slots[it->second].tag == t)
+        {
+            auto &slot = s.slots[it->second];
+            slot.referenced = true;
+            this->_hits.fetch_add(1U, std::memory_order_relaxed);
+            OTPGEN_PERF_COUNT(PreparedKeyHits, 1U);
+            return slot.key;
+        }
+    }
+    this->_misses.fetch_add(1U, std::memory_order_relaxed);
+    OTPGEN_PERF_COUNT(PreparedKeyMisses, 1U);
+
+    // the key is prepared without holding the lock
+    if (token.type() != OTPToken::TOTP && token.type() != OTPToken::HOTP && token.type() != OTPToken::Steam)
+    {
+        if (error)
+        {
+            (*error) = OTPGenErrorCode::InvalidType;
+        }
+        return nullptr;
+    }
+    const auto algorithm = token.type() == OTPToken::Steam ? OTPToken::SHA1 : token.algorithm();
+    auto err = OTPGenErrorCode::Valid;
+    auto prepared = OTPGen::prepareKey(token.secret(), algorithm, &err);
+    if (err != OTPGenErrorCode::Valid || !prepared.isValid())
+    {
+        if (error)
+        {
+            (*error) = err != OTPGenErrorCode::Valid ? err : OTPGenErrorCode::InvalidBase32Input;
+        }
+        return nullptr;
+    }
+
+    KeyPointer key = std::make_shared<const OTPKey>(std::move(prepared));
+    const auto c = cost(*key);
+    if (id == 0 || c > this->_shardBudget)
+    {
+        return key;
+    }
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.index.find(id);
+    if (it != s.index.end())
+    {
+        // prepared concurrently or the token changed, the new key replaces the old one
+        auto &slot = s.slots[it->second];
+        s.bytes -= slot.cost;
+        slot.key.reset();
+        slot.cost = 0U;
+    }
+    this->makeRoom(s, c);
+
+    std::size_t index = 0U;
+    if (it != s.index.end())
+    {
+        index = it->second;
+    }
+    else if (!s.free.empty())
+    {
+        index = s.free.back();
+        s.free.pop_back();
+    }
+    else
+    {
+        index = s.slots.size();
+        s.slots.emplace_back();
+    }
+
+    auto &slot = s.slots[index];
+    slot.id = id;
+    slot.tag = t;
+    slot.key = key;
+    slot.cost = c;
+    slot.referenced = false;
+    s.index[id] = index;
+    s.bytes += c;
+    OTPGEN_PERF_MEMORY_RESIZE(s.memory, s.bytes);
+    return key;
+}
+
+void PreparedKeyCache::makeRoom(Shard &shard, const std::size_t &cost)
+{
+    // second chance: referenced keys are skipped once, every key is evicted within two rounds,
+    // keys are left as long as there are bytes accounted
+    while (shard.bytes + cost > this->_shardBudget && !shard.slots.empty())
+    {
+        auto &slot = shard.slots[shard.hand];
+        const auto index = shard.hand;
+        shard.hand = (shard.hand + 1U) % shard.slots.size();
+
+        // free slots and the slot of a key which is being replaced
+        if (!slot.key)
+        {
+            continue;
+        }
+        if (slot.referenced)
+        {
+            slot.referenced = false;
+            continue;
+        }
+
+        shard.bytes -= slot.cost;
+        shard.index.erase(slot.id);
+        shard.free.emplace_back(index);
+        slot = Slot();
+        ++shard.evictions;
+    }
+}
+
+OTPToken::TokenString PreparedKeyCache::generateToken(const OTPToken &token, const std::time_t &time, OTPGenErrorCode *error)
+{
+    const auto key = this->key(token, error);
+    if (!key)
+    {
+        return {};
+    }
+
+    switch (token.type())
+    {
+        case OTPToken::TOTP:
+            return OTPGen::computeTOTP(time, *key, token.digitLength(), token.period(), error);
+        case OTPToken::HOTP:
+            return OTPGen::computeHOTP(*key, token.counter(), token.digitLength(), error);
+        case OTPToken::Steam:
+            return OTPGen::computeSteam(Clock::steamTime(time), *key, error);
+    }
+    return {};
+}
+
+void PreparedKeyCache::erase(const OTPToken::sqliteTokenID &id)
+{
+    auto &s = this->shard(id);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    const auto it = s.index.find(id);
+    if (it == s.index.end())
+    {
+        return;
+    }
+
+    auto &slot = s.slots[it->second];
+    s.bytes -= slot.cost;
+    s.free.emplace_back(it->second);
+    slot = Slot();
+    s.index.erase(it);
+    OTPGEN_PERF_MEMORY_RESIZE(s.memory, s.bytes);
+}
+
+void PreparedKeyCache::clear()
+{
+    for (auto&& s : this->_shards)
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->slots.clear();
+        s->index.clear();
+        s->free.clear();
+        s->hand = 0U;
+        s->bytes = 0U;
+        OTPGEN_PERF_MEMORY_RESIZE(s->memory, 0U);
+    }
+}
+
+PreparedKeyCache::Stats PreparedKeyCache::stats() const
+{
+    Stats stats;
+    stats.hits = this->_hits.load(std::memory_order_relaxed);
+    stats.misses = this->_misses.load(std::memory_order_relaxed);
+    for (auto&& s : this->_shards)
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        stats.evictions += s->evictions;
+        stats.entries += s->index.size();
+        stats.bytes += s->bytes;
+    }
+    return stats;
+}
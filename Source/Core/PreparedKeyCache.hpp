@@ -0,0 +1,114 @@
+#ifndef PREPAREDKEYCACHE_HPP
+#define PREPAREDKEYCACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "OTPToken.hpp"
+#include "OTPKey.hpp"
+#include "OTPGenErrorCodes.hpp"
+#include "PerfStats.hpp"
+
+/**
+ * Bounded cache of prepared keys for very large vaults
+ *
+ * Holds the decoded secret and HMAC states (OTPKey) of recently used
+ * tokens, so hot tokens skip the base-32 decoding and the key schedule on
+ * every code. The cache keeps at most the configured amount of bytes, when
+ * it is full the CLOCK hand of the shard evicts a key which wasn't used
+ * since the hand passed it last.
+ *
+ * Keys are looked up by token id and checked against a tag of the secret
+ * and algorithm, a changed token prepares its key again. The shards are
+ * locked on their own, keys are handed out as shared pointers which stay
+ * valid after an eviction.
+ *
+ */
+class PreparedKeyCache
+{
+public:
+    using KeyPointer = std::shared_ptr<const OTPKey>;
+
+    static const constexpr std::size_t DEFAULT_BUDGET = 64U * 1024U * 1024U;
+
+    struct Stats
+    {
+        std::uint64_t hits = 0U;
+        std::uint64_t misses = 0U;
+        std::uint64_t evictions = 0U;
+        std::size_t entries = 0U;
+        std::size_t bytes = 0U;
+    };
+
+    /**
+     * the budget is split evenly among the shards, 0 shards picks
+     * one per hardware thread (rounded up to a power of 2)
+     */
+    explicit PreparedKeyCache(const std::size_t &budget = DEFAULT_BUDGET, const std::size_t &shards = 0U);
+
+    PreparedKeyCache(const PreparedKeyCache&) = delete;
+    PreparedKeyCache &operator= (const PreparedKeyCache&) = delete;
+
+    // prepared key of the token, prepared on a miss, tokens whose key can't be
+    // prepared return nullptr with the error and aren't cached
+    KeyPointer key(const OTPToken &token, OTPGenErrorCode *error = nullptr);
+
+    // code of the token at the given time with the cached key, HOTP tokens use their counter
+    OTPToken::TokenString generateToken(const OTPToken &token, const std::time_t &time, OTPGenErrorCode *error = nullptr);
+
+    void erase(const OTPToken::sqliteTokenID &id);
+    void clear();
+
+    Stats stats() const;
+
+    inline std::size_t budget() const
+    { return this->_budget; }
+
+    // bytes accounted for a key, the key itself, its secret and the bookkeeping
+    static std::size_t cost(const OTPKey &key);
+
+private:
+    struct Slot
+    {
+        OTPToken::sqliteTokenID id = 0;
+        std::uint64_t tag = 0U;
+        KeyPointer key;
+        std::size_t cost = 0U;
+        // set by every hit, cleared when the hand passes
+        bool referenced = false;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        std::unordered_map<OTPToken::sqliteTokenID, std::size_t> index;
+        // free slots of erased keys
+        std::vector<std::size_t> free;
+        std::size_t hand = 0U;
+        std::size_t bytes = 0U;
+        std::uint64_t evictions = 0U;
+        PerfStats::Allocation memory{PerfStats::TokenStorage};
+    };
+
+    static std::uint64_t tag(const OTPToken &token);
+
+    Shard &shard(const OTPToken::sqliteTokenID &id);
+    // must be called with the shard locked, evicts until the cost fits into the shard budget
+    void makeRoom(Shard &shard, const std::size_t &cost);
+
+    std::size_t _budget = 0U;
+    std::size_t _shardBudget = 0U;
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    std::atomic<std::uint64_t> _hits{0U};
+    std::atomic<std::uint64_t> _misses{0U};
+};
+
+#endif // PREPAREDKEYCACHE_HPP
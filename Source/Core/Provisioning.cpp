@@ -0,0 +1,84 @@
+#include "Provisioning.hpp"
+
+#include "Codec.hpp"
+#include "Executor.hpp"
+#include "otpauthURI.hpp"
+#include "Internal/SecureRandom.hpp"
+
+namespace {
+    // tokens per chunk, one request to the DRBG of the worker per chunk
+    static const constexpr std::size_t GRAIN = 256U;
+
+    static void run(std::size_t count, Executor *executor, const Executor::Task &task)
+    {
+        if (executor && count > GRAIN)
+        {
+            executor->parallelFor(count, GRAIN, task);
+        }
+        else
+        {
+            task(0U, count);
+        }
+    }
+
+    // encodes the random bytes of the tokens [begin, end) into their secrets
+    static void encodeSecrets(std::size_t begin, std::size_t end, std::size_t size, std::vector<SecureString> &secrets)
+    {
+        SecureBuffer bytes((end - begin) * size);
+        Internal::randomBytes(bytes.data(), bytes.size());
+        for (auto i = begin; i < end; ++i)
+        {
+            auto &secret = secrets[i];
+            secret.resize(Codec::base32EncodedSize(size));
+            secret.resize(Codec::base32Encode(bytes.data() + (i - begin) * size, size, &secret[0]));
+        }
+    }
+}
+
+void Provisioning::generateSecrets(std::size_t count, std::size_t size, std::vector<SecureString> &secrets,
+                                   Executor *executor)
+{
+    secrets.clear();
+    secrets.resize(count);
+    run(count, executor, [&](std::size_t begin, std::size_t end) {
+        encodeSecrets(begin, end, size, secrets);
+    });
+}
+
+TokenDatabase::Error Provisioning::provision(const Request &request, std::vector<SecureString> &uris,
+                                             std::vector<TokenDatabase::Error> *results, Executor *executor)
+{
+    uris.clear();
+    if (request.secretSize < MIN_SECRET_SIZE || request.secretSize > MAX_SECRET_SIZE ||
+        request.prototype.type() == OTPToken::None)
+    {
+        return TokenDatabase::InvalidArgument;
+    }
+
+    // secrets, tokens and URIs are built by the same worker
+    const auto count = request.labels.size();
+    std::vector<SecureString> secrets(count);
+    TokenDatabase::OTPTokenList tokens(count, request.prototype);
+    uris.resize(count);
+    run(count, executor, [&](std::size_t begin, std::size_t end) {
+        encodeSecrets(begin, end, request.secretSize, secrets);
+        for (auto i = begin; i < end; ++i)
+        {
+            tokens[i].setLabel(request.labels[i]);
+            tokens[i].setSecret(secrets[i]);
+            (void) otpauthURI::appendURI(tokens[i], uris[i]);
+        }
+    });
+
+    std::vector<TokenDatabase::Error> local;
+    auto &errors = results ? *results : local;
+    const auto status = TokenDatabase::insertTokens(tokens, &errors);
+    for (auto i = 0U; i < count; ++i)
+    {
+        if (status != TokenDatabase::Success || i >= errors.size() || errors[i] != TokenDatabase::Success)
+        {
+            uris[i].clear();
+        }
+    }
+    return status;
+}
@@ -0,0 +1,60 @@
+#ifndef PROVISIONING_HPP
+#define PROVISIONING_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "OTPToken.hpp"
+#include "SecureMemory.hpp"
+#include "TokenDatabase.hpp"
+
+class Executor;
+
+/**
+ * Bulk enrollment of new tokens
+ *
+ * Creates the secrets of many tokens at once, for example to seed a batch
+ * of hardware tokens or to enroll the users of a service. The secrets come
+ * from the DRBG of the worker thread (see Internal/SecureRandom.hpp), every
+ * worker draws the bytes of its whole chunk in one request and encodes them
+ * to base-32 in place, the secrets never leave secure memory.
+ *
+ * provision() inserts all tokens into the open database in a single
+ * transaction and returns the otpauth URI of every token, ready to be
+ * handed out or encoded as QR codes.
+ *
+ */
+class Provisioning final
+{
+    Provisioning() = delete;
+
+public:
+    struct Request
+    {
+        Request(const OTPToken &prototype = OTPToken(OTPToken::TOTP)) : prototype(prototype)
+        {}
+
+        // type, algorithm, digits, period and issuer of all tokens, the label and secret are replaced
+        OTPToken prototype;
+        // one token per label, labels must be unique in the database
+        std::vector<OTPToken::Label> labels;
+        // random bytes of every secret, 20 (160 bits) as recommended by RFC 4226
+        std::size_t secretSize = 20U;
+    };
+
+    static const constexpr std::size_t MIN_SECRET_SIZE = 10U;
+    static const constexpr std::size_t MAX_SECRET_SIZE = 64U;
+
+    // count base-32 encoded secrets of size random bytes each, without padding
+    static void generateSecrets(std::size_t count, std::size_t size, std::vector<SecureString> &secrets,
+                                Executor *executor = nullptr);
+
+    // creates and inserts the tokens of the request, uris has one entry per label, tokens whose row
+    // failed have an empty URI and their error in the optional results list; returns InvalidArgument
+    // for a secret size outside of [MIN_SECRET_SIZE, MAX_SECRET_SIZE] or a token type without secrets
+    static TokenDatabase::Error provision(const Request &request, std::vector<SecureString> &uris,
+                                          std::vector<TokenDatabase::Error> *results = nullptr,
+                                          Executor *executor = nullptr);
+};
+
+#endif // PROVISIONING_HPP
@@ -0,0 +1,169 @@
+#include "RateLimiter.hpp"
+#include "PerfStats.hpp"
+
+#include <algorithm>
+
+namespace {
+    using Internal::SlotTable;
+
+    // slot layout: fingerprint (24 bits) | time the bucket is full again (40 bits), 0 is a free slot
+    static const constexpr unsigned TIME_BITS = 40U;
+    static const constexpr std::uint64_t TIME_MASK = (1ULL << TIME_BITS) - 1U;
+    static const constexpr std::uint64_t TIME_RANGE = TIME_MASK >> 1U;
+
+    static inline std::uint64_t fingerprint(const std::uint64_t &h) noexcept
+    {
+        return (SlotTable::mix(h) | 1U) << TIME_BITS;
+    }
+
+    // the time is compared modulo 2^40 milliseconds (34 years), buckets are full within half of it
+    static inline std::uint64_t remaining(const std::uint64_t &slot, const std::uint64_t &now) noexcept
+    {
+        const auto left = (slot - now) & TIME_MASK;
+        return slot != 0U && left <= TIME_RANGE ? left : 0U;
+    }
+
+    static inline bool matches(const std::uint64_t &slot, const std::uint64_t &print) noexcept
+    {
+        return (slot & ~TIME_MASK) == print;
+    }
+}
+
+RateLimiter::RateLimiter(const Limit &limit, const std::size_t &capacity, const Placement &placement)
+    : _limit(limit),
+      _table(capacity, SlotTable::SHARD_SIZE, placement == Shared ? SlotTable::Shared : SlotTable::Private)
+{
+    // a token always has one attempt, the whole bucket must fit into the time range
+    this->_limit.burst = std::max<std::uint32_t>(1U, this->_limit.burst);
+    this->_limit.interval = std::clamp(this->_limit.interval, std::chrono::milliseconds(1),
+                                       std::chrono::milliseconds(TIME_RANGE / this->_limit.burst));
+}
+
+RateLimiter::~RateLimiter()
+{
+}
+
+std::uint64_t RateLimiter::now() noexcept
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+RateLimiter::Result RateLimiter::acquire(const OTPToken::sqliteTokenID &id) noexcept
+{
+    return this->acquire(id, now());
+}
+
+RateLimiter::Result RateLimiter::acquire(const OTPToken::sqliteTokenID &id, const std::uint64_t &now) noexcept
+{
+    const auto h = SlotTable::hash(id);
+    const auto print = fingerprint(h);
+    const auto interval = static_cast<std::uint64_t>(this->_limit.interval.count());
+    const auto window = interval * this->_limit.burst;
+    const auto slot = this->_table.probe(h);
+
+    for (;;)
+    {
+        // the bucket of the token, an attempt moves the time it is full again by one interval
+        auto found = false;
+        for (auto p = 0U; p < SlotTable::PROBE_LENGTH && !found; ++p)
+        {
+            auto current = slot[p].load(std::memory_order_acquire);
+            while (matches(current, print) && remaining(current, now) != 0U)
+            {
+                found = true;
+                const auto left = remaining(current, now);
+                if (left + interval > window)
+                {
+                    OTPGEN_PERF_COUNT(AttemptsLimited, 1U);
+                    return Limited;
+                }
+                const auto value = print | ((now + left + interval) & TIME_MASK);
+                if (slot[p].compare_exchange_weak(current, value, std::memory_order_acq_rel))
+                {
+                    return Allowed;
+                }
+            }
+        }
+
+        // the bucket filled up or was taken by another token in between, search again
+        if (found)
+        {
+            continue;
+        }
+
+        // a full bucket takes the first free slot, two first attempts of the same token
+        // which race for different slots create two buckets, which expire like any other
+        const auto value = print | ((now + interval) & TIME_MASK);
+        for (auto p = 0U; p < SlotTable::PROBE_LENGTH; ++p)
+        {
+            auto current = slot[p].load(std::memory_order_acquire);
+            while (remaining(current, now) == 0U)
+            {
+                if (slot[p].compare_exchange_weak(current, value, std::memory_order_acq_rel))
+                {
+                    return Allowed;
+                }
+            }
+            if (matches(current, print))
+            {
+                // claimed by another attempt of the token
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+        {
+            return Full;
+        }
+    }
+}
+
+std::uint64_t RateLimiter::retryAfter(const OTPToken::sqliteTokenID &id, const std::uint64_t &now) const noexcept
+{
+    const auto h = SlotTable::hash(id);
+    const auto print = fingerprint(h);
+    const auto interval = static_cast<std::uint64_t>(this->_limit.interval.count());
+    const auto window = interval * this->_limit.burst;
+    const auto slot = this->_table.probe(h);
+    for (auto p = 0U; p < SlotTable::PROBE_LENGTH; ++p)
+    {
+        const auto current = slot[p].load(std::memory_order_acquire);
+        const auto left = remaining(current, now);
+        if (left != 0U && matches(current, print))
+        {
+            return left + interval > window ? left + interval - window : 0U;
+        }
+    }
+    return 0U;
+}
+
+void RateLimiter::reset(const OTPToken::sqliteTokenID &id, const std::uint64_t &now) noexcept
+{
+    const auto h = SlotTable::hash(id);
+    const auto print = fingerprint(h);
+    const auto slot = this->_table.probe(h);
+    for (auto p = 0U; p < SlotTable::PROBE_LENGTH; ++p)
+    {
+        auto current = slot[p].load(std::memory_order_acquire);
+        while (matches(current, print) && remaining(current, now) != 0U)
+        {
+            if (slot[p].compare_exchange_weak(current, 0U, std::memory_order_acq_rel))
+            {
+                break;
+            }
+        }
+    }
+}
+
+std::size_t RateLimiter::occupancy(const std::uint64_t &now) const noexcept
+{
+    return this->_table.count([&](const std::uint64_t &slot) {
+        return remaining(slot, now) != 0U;
+    });
+}
+
+void RateLimiter::clear() noexcept
+{
+    this->_table.clear();
+}
@@ -0,0 +1,107 @@
+#ifndef RATELIMITER_HPP
+#define RATELIMITER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include "OTPToken.hpp"
+#include "Internal/SlotTable.hpp"
+
+/**
+ * Attempt limits of verifications per token
+ *
+ * Every token has a bucket of burst attempts which refills by one attempt
+ * per interval. A verification takes an attempt before any code is
+ * computed, a token whose bucket is empty is refused, so guessing the codes
+ * of a token takes at least an interval per guess.
+ *
+ * The buckets are kept like the uses of UsedCodeStore: a fixed amount of
+ * slots split into shards, every slot a single atomic word holding a 24-bit
+ * fingerprint of the token and the time (40 bits of milliseconds) at which
+ * its bucket is full again. Taking an attempt moves that time forward by one
+ * interval with a compare-and-swap, no lock is taken. A slot whose time has
+ * passed is a full bucket, it is free for another token and is reused in
+ * place, so the buckets expire without a cleanup pass.
+ *
+ * When all slots of the probe sequence belong to other tokens with empty or
+ * partly used buckets the attempt fails with Full, the caller should refuse
+ * it. Fingerprints may collide, two tokens sharing a fingerprint within a
+ * shard share their bucket.
+ *
+ * A shared limiter keeps its slots in a shared anonymous mapping, processes
+ * forked after the construction share the buckets.
+ *
+ */
+class RateLimiter
+{
+public:
+    enum Result {
+        Allowed = 0,
+        Limited,
+        Full,
+    };
+
+    enum Placement {
+        Private = 0,
+        // shared with the processes forked later on, private where there is no mmap
+        Shared,
+    };
+
+    struct Limit
+    {
+        Limit(const std::uint32_t &burst = 5U, const std::chrono::milliseconds &interval = std::chrono::seconds(6))
+            : burst(burst), interval(interval)
+        {}
+
+        // attempts of a token which wasn't verified for burst * interval
+        std::uint32_t burst;
+        // time in which one attempt is refilled
+        std::chrono::milliseconds interval;
+    };
+
+    static const constexpr std::size_t DEFAULT_CAPACITY = 1U << 18;
+
+    /**
+     * allocate the slots, the capacity is rounded up to a power of 2
+     * and should be about twice the amount of tokens verified per burst * interval
+     */
+    explicit RateLimiter(const Limit &limit = Limit(), const std::size_t &capacity = DEFAULT_CAPACITY,
+                         const Placement &placement = Private);
+    ~RateLimiter();
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter &operator= (const RateLimiter&) = delete;
+
+    // takes an attempt of the token at the given time in milliseconds of a monotonic clock
+    Result acquire(const OTPToken::sqliteTokenID &id, const std::uint64_t &now) noexcept;
+    // same at the current time of the steady clock
+    Result acquire(const OTPToken::sqliteTokenID &id) noexcept;
+
+    // milliseconds until the token has an attempt again, 0 if it has one
+    std::uint64_t retryAfter(const OTPToken::sqliteTokenID &id, const std::uint64_t &now) const noexcept;
+
+    // refills the bucket of the token, like after a successful verification
+    void reset(const OTPToken::sqliteTokenID &id, const std::uint64_t &now) noexcept;
+
+    // amount of buckets which aren't full at the given time, scans the whole limiter
+    std::size_t occupancy(const std::uint64_t &now) const noexcept;
+
+    // refills all buckets, must not run concurrently with acquire()
+    void clear() noexcept;
+
+    inline std::size_t capacity() const
+    { return this->_table.capacity(); }
+    inline const Limit &limit() const
+    { return this->_limit; }
+    inline bool shared() const
+    { return this->_table.shared(); }
+
+    // milliseconds of the steady clock, the time base of acquire()
+    static std::uint64_t now() noexcept;
+
+private:
+    Limit _limit;
+    Internal::SlotTable _table;
+};
+
+#endif // RATELIMITER_HPP
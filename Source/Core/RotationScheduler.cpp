@@ -0,0 +1,204 @@
+#include "RotationScheduler.hpp"
+#include "Clock.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+RotationScheduler::RotationScheduler(const Clock *clock)
+    : _clock(clock)
+{
+}
+
+RotationScheduler::~RotationScheduler()
+{
+    this->stop();
+}
+
+void RotationScheduler::setTokens(const std::vector<OTPToken> &tokens)
+{
+    std::vector<Group> groups;
+    for (auto i = 0U; i < tokens.size(); ++i)
+    {
+        const auto period = tokens[i].rotationPeriod();
+        if (period == 0U)
+        {
+            continue;
+        }
+
+        // there are only a few distinct periods, a linear search is enough
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const Group &g) {
+            return g.period == period;
+        });
+        if (group == groups.end())
+        {
+            groups.emplace_back();
+            group = groups.end() - 1;
+            group->period = period;
+        }
+        group->indices.emplace_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_groups = std::move(groups);
+        this->_changed = true;
+    }
+    this->_wakeup.notify_all();
+}
+
+void RotationScheduler::clear()
+{
+    this->setTokens({});
+}
+
+std::size_t RotationScheduler::periodCount() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_groups.size();
+}
+
+RotationScheduler::Event RotationScheduler::nextRotation(const std::time_t &time) const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->next(time);
+}
+
+void RotationScheduler::start(const Callback &callback)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if (this->_thread.joinable())
+    {
+        return;
+    }
+
+    this->_callback = callback;
+    this->_stop = false;
+    this->_thread = std::thread(&RotationScheduler::worker, this);
+}
+
+void RotationScheduler::stop()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+        thread.swap(this->_thread);
+    }
+    this->_wakeup.notify_all();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+bool RotationScheduler::running() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_thread.joinable();
+}
+
+RotationScheduler::Event RotationScheduler::next(const std::time_t &time) const
+{
+    Event event;
+    for (auto&& group : this->_groups)
+    {
+        const auto rotation = OTPToken::nextRotationTime(group.period, time);
+        if (event.time != 0 && rotation > event.time)
+        {
+            continue;
+        }
+        if (rotation != event.time)
+        {
+            event.time = rotation;
+            event.periods.clear();
+            event.indices.clear();
+        }
+        event.periods.emplace_back(group.period);
+        event.indices.insert(event.indices.end(), group.indices.begin(), group.indices.end());
+    }
+
+    std::sort(event.indices.begin(), event.indices.end());
+    return event;
+}
+
+std::time_t RotationScheduler::now() const
+{
+    return this->_clock ? this->_clock->now() : Clock::current();
+}
+
+void RotationScheduler::worker()
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    auto last = this->now();
+    this->_changed = false;
+
+    while (!this->_stop)
+    {
+        const auto upcoming = this->next(last);
+
+        // nothing rotates, sleep until the tokens change
+        if (upcoming.time == 0)
+        {
+            this->_wakeup.wait(lock, [&]{
+                return this->_stop || this->_changed;
+            });
+        }
+        else
+        {
+            // the clock only has seconds, align the wakeup to the second boundary of the system clock
+            const auto system = std::chrono::system_clock::now();
+            const auto second = std::chrono::time_point_cast<std::chrono::seconds>(system);
+            const auto start = second > system ? second - std::chrono::seconds(1) : second;
+            const auto remaining = std::max<std::time_t>(upcoming.time - this->now(), 0);
+            this->_wakeup.wait_until(lock, start + std::chrono::seconds(remaining), [&]{
+                return this->_stop || this->_changed;
+            });
+        }
+
+        if (this->_stop)
+        {
+            break;
+        }
+        if (this->_changed)
+        {
+            this->_changed = false;
+            last = this->now();
+            continue;
+        }
+
+        const auto current = this->now();
+        if (current <= last)
+        {
+            continue;
+        }
+
+        // every group which crossed a boundary since the last wakeup, a single event
+        // also covers more boundaries when the process was suspended
+        Event event;
+        for (auto&& group : this->_groups)
+        {
+            const auto boundary = current / group.period;
+            if (boundary == last / group.period)
+            {
+                continue;
+            }
+            event.time = std::max<std::time_t>(event.time, boundary * group.period);
+            event.periods.emplace_back(group.period);
+            event.indices.insert(event.indices.end(), group.indices.begin(), group.indices.end());
+        }
+        last = current;
+
+        if (event.indices.empty())
+        {
+            continue;
+        }
+        std::sort(event.indices.begin(), event.indices.end());
+
+        // setTokens() may be called from the callback
+        lock.unlock();
+        this->_callback(event);
+        lock.lock();
+    }
+}
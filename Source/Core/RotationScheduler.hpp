@@ -0,0 +1,96 @@
+#ifndef ROTATIONSCHEDULER_HPP
+#define ROTATIONSCHEDULER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "OTPToken.hpp"
+
+class Clock;
+
+/**
+ * Code rotation events for a set of tokens
+ *
+ * Tokens are grouped by their rotation period, the scheduler wakes up once
+ * per distinct period boundary and reports all tokens whose codes changed
+ * at that time in one event. A list of tokens needs one wakeup per distinct
+ * period instead of a timer per token.
+ *
+ * Counter-based tokens never rotate and are never reported. Indices are
+ * the positions of the tokens in the list given to setTokens().
+ *
+ * The worker reads the time from the given clock (the default clock when
+ * none is given) and sleeps on the system clock until the next rotation.
+ *
+ */
+class RotationScheduler
+{
+public:
+    struct Event
+    {
+        // time of the rotation, a multiple of every listed period
+        std::time_t time = 0;
+        std::vector<OTPToken::PeriodType> periods;
+        // tokens whose codes changed, ascending
+        std::vector<std::size_t> indices;
+    };
+
+    using Callback = std::function<void(const Event &event)>;
+
+    /**
+     * the clock must outlive the scheduler
+     */
+    RotationScheduler(const Clock *clock = nullptr);
+
+    /**
+     * stop the worker and destroy the scheduler
+     */
+    ~RotationScheduler();
+
+    RotationScheduler(const RotationScheduler&) = delete;
+    RotationScheduler &operator= (const RotationScheduler&) = delete;
+
+    // replace the scheduled tokens, the worker picks up the change right away
+    void setTokens(const std::vector<OTPToken> &tokens);
+    void clear();
+
+    // amount of distinct periods, this is the amount of timers a caller would need
+    std::size_t periodCount() const;
+
+    // the first rotation after the given time, the time is 0 when nothing rotates
+    Event nextRotation(const std::time_t &time) const;
+
+    // run the callback on the worker thread for every rotation
+    // the callback must not call start() or stop()
+    void start(const Callback &callback);
+    void stop();
+    bool running() const;
+
+private:
+    struct Group
+    {
+        OTPToken::PeriodType period = 0U;
+        std::vector<std::size_t> indices;
+    };
+
+    Event next(const std::time_t &time) const;
+    std::time_t now() const;
+    void worker();
+
+    std::vector<Group> _groups;
+    const Clock *_clock;
+
+    Callback _callback;
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stop = false;
+    bool _changed = false;
+};
+
+#endif // ROTATIONSCHEDULER_HPP
@@ -0,0 +1,290 @@
+#include "SecureMemory.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SECUREMEMORY_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // blocks of 16 bytes up to 4 KiB in slabs of 64 KiB
+    static const constexpr std::size_t MIN_BLOCK_SIZE = 16;
+    static const constexpr std::size_t MAX_BLOCK_SIZE = 4096;
+    static const constexpr std::size_t SIZE_CLASSES = 9;
+    static const constexpr std::size_t SLAB_SIZE = 64 * 1024;
+
+    struct Region {
+        unsigned char *data = nullptr;
+        std::size_t size = 0;
+        bool locked = false;
+    };
+
+    struct SizeClass {
+        void *free = nullptr;              // released blocks, linked through their first bytes
+        unsigned char *next = nullptr;     // unused part of the current slab
+        unsigned char *end = nullptr;
+    };
+
+    struct Arena {
+        std::mutex mutex;
+        SizeClass classes[SIZE_CLASSES];
+        std::vector<Region> slabs;
+        std::vector<Region> large;
+        std::size_t allocated = 0;
+        std::size_t peak = 0;
+        std::size_t locked = 0;
+        std::size_t blocks = 0;
+    };
+
+    // never destroyed, strings with static storage duration may be released after it
+    static Arena &arena()
+    {
+        static auto instance = new Arena();
+        return *instance;
+    }
+
+    static std::size_t sizeClass(std::size_t size)
+    {
+        auto index = 0U;
+        for (auto block = MIN_BLOCK_SIZE; block < size; block <<= 1)
+        {
+            ++index;
+        }
+        return index;
+    }
+
+    static std::size_t pageSize()
+    {
+#ifdef SECUREMEMORY_MMAP
+        static const auto size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+#else
+        return 4096U;
+#endif
+    }
+
+    // zeroed pages, locked if possible
+    static Region mapRegion(std::size_t size)
+    {
+        Region region;
+        region.size = size;
+#ifdef SECUREMEMORY_MMAP
+        auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            return {};
+        }
+        region.data = static_cast<unsigned char*>(data);
+        region.locked = ::mlock(data, size) == 0;
+#ifdef MADV_DONTDUMP
+        (void) ::madvise(data, size, MADV_DONTDUMP);
+#endif
+#else
+        region.data = static_cast<unsigned char*>(std::calloc(1, size));
+#endif
+        return region;
+    }
+
+    // the region must be wiped already
+    static void unmapRegion(const Region &region)
+    {
+#ifdef SECUREMEMORY_MMAP
+        if (region.locked)
+        {
+            (void) ::munlock(region.data, region.size);
+        }
+        (void) ::munmap(region.data, region.size);
+#else
+        std::free(region.data);
+#endif
+    }
+
+    static std::size_t largeSize(std::size_t size)
+    {
+        const auto page = pageSize();
+        return (size + page - 1) / page * page;
+    }
+}
+
+void *SecureMemory::allocate(std::size_t size)
+{
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    auto &a = arena();
+
+    // large allocations get pages of their own
+    if (size > MAX_BLOCK_SIZE)
+    {
+        const auto region = mapRegion(largeSize(size));
+        if (!region.data)
+        {
+            throw std::bad_alloc();
+        }
+
+        std::lock_guard<std::mutex> lock(a.mutex);
+        try {
+            a.large.emplace_back(region);
+        } catch (...) {
+            unmapRegion(region);
+            throw;
+        }
+        a.allocated += region.size;
+        a.peak = std::max(a.peak, a.allocated);
+        a.locked += region.locked ? region.size : 0U;
+        return region.data;
+    }
+
+    const auto index = sizeClass(size);
+    const auto block = MIN_BLOCK_SIZE << index;
+
+    std::lock_guard<std::mutex> lock(a.mutex);
+    auto &c = a.classes[index];
+
+    void *data = nullptr;
+    if (c.free)
+    {
+        data = c.free;
+        std::memcpy(&c.free, data, sizeof(void*));
+        std::memset(data, 0, sizeof(void*));
+    }
+    else
+    {
+        if (c.next == c.end)
+        {
+            const auto region = mapRegion(SLAB_SIZE);
+            if (!region.data)
+            {
+                throw std::bad_alloc();
+            }
+            a.slabs.emplace_back(region);
+            a.locked += region.locked ? region.size : 0U;
+            c.next = region.data;
+            c.end = region.data + region.size;
+        }
+        data = c.next;
+        c.next += block;
+    }
+
+    a.allocated += block;
+    a.peak = std::max(a.peak, a.allocated);
+    ++a.blocks;
+    return data;
+}
+
+void SecureMemory::deallocate(void *data, std::size_t size) noexcept
+{
+    if (!data)
+    {
+        return;
+    }
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    auto &a = arena();
+
+    if (size > MAX_BLOCK_SIZE)
+    {
+        Region region;
+        {
+            std::lock_guard<std::mutex> lock(a.mutex);
+            const auto it = std::find_if(a.large.begin(), a.large.end(), [&](const Region &r) {
+                return r.data == data;
+            });
+            if (it == a.large.end())
+            {
+                return;
+            }
+            region = *it;
+            a.large.erase(it);
+            a.allocated -= region.size;
+            a.locked -= region.locked ? region.size : 0U;
+        }
+
+        wipe(region.data, region.size);
+        unmapRegion(region);
+        return;
+    }
+
+    const auto index = sizeClass(size);
+    const auto block = MIN_BLOCK_SIZE << index;
+    wipe(data, block);
+
+    std::lock_guard<std::mutex> lock(a.mutex);
+    auto &c = a.classes[index];
+    std::memcpy(data, &c.free, sizeof(void*));
+    c.free = data;
+
+    a.allocated -= block;
+    --a.blocks;
+}
+
+void SecureMemory::wipe(void *data, std::size_t size) noexcept
+{
+    auto p = static_cast<volatile unsigned char*>(data);
+    while (size--)
+    {
+        *p++ = 0;
+    }
+}
+
+void SecureMemory::trim() noexcept
+{
+    auto &a = arena();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    if (a.blocks != 0)
+    {
+        return;
+    }
+
+    for (auto&& slab : a.slabs)
+    {
+        wipe(slab.data, slab.size);
+        a.locked -= slab.locked ? slab.size : 0U;
+        unmapRegion(slab);
+    }
+    a.slabs.clear();
+    a.slabs.shrink_to_fit();
+
+    for (auto&& c : a.classes)
+    {
+        c = SizeClass();
+    }
+}
+
+std::size_t SecureMemory::allocatedBytes() noexcept
+{
+    auto &a = arena();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    return a.allocated;
+}
+
+std::size_t SecureMemory::peakBytes() noexcept
+{
+    auto &a = arena();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    return a.peak;
+}
+
+void SecureMemory::resetPeak() noexcept
+{
+    auto &a = arena();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    a.peak = a.allocated;
+}
+
+std::size_t SecureMemory::lockedBytes() noexcept
+{
+    auto &a = arena();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    return a.locked;
+}
@@ -0,0 +1,113 @@
+#ifndef SECUREMEMORY_HPP
+#define SECUREMEMORY_HPP
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Locked memory for secrets and decrypted buffers
+ *
+ * Small allocations are served from slabs of locked pages (mlock)
+ * which are split into blocks of a single size class, larger allocations get
+ * pages of their own. Every block is wiped when it is released, so secrets
+ * don't linger in memory after the owning string or buffer is gone.
+ *
+ * Locking is best effort, when the limit for locked memory is reached the
+ * pages are still wiped but may be swapped out. Platforms without page
+ * mappings fall back to the heap.
+ *
+ * A string short enough for the small string optimization is stored in the
+ * string object itself and never reaches the allocator, owners of such
+ * strings must wipe them on their own.
+ *
+ */
+class SecureMemory
+{
+public:
+    // allocate zeroed memory, throws std::bad_alloc on failure
+    static void *allocate(std::size_t size);
+    // wipe and release memory, size must be the size given to allocate()
+    static void deallocate(void *data, std::size_t size) noexcept;
+
+    // overwrite the memory with zeros, not removed by the optimizer
+    static void wipe(void *data, std::size_t size) noexcept;
+    // wipes short strings stored in the string object, others are wiped by the allocator
+    template<typename String>
+    static void wipeInline(String &string) noexcept
+    {
+        const auto object = reinterpret_cast<const unsigned char*>(&string);
+        const auto data = reinterpret_cast<const unsigned char*>(string.data());
+        if (data >= object && data < object + sizeof(String))
+        {
+            const auto available = static_cast<std::size_t>(object + sizeof(String) - data);
+            const auto size = (string.capacity() + 1) * sizeof(typename String::value_type);
+            wipe(&string[0], size < available ? size : available);
+        }
+    }
+
+    // returns the slabs to the system once all blocks are released
+    static void trim() noexcept;
+
+    // statistics, size of all blocks in use and of the locked pages
+    static std::size_t allocatedBytes() noexcept;
+    static std::size_t lockedBytes() noexcept;
+    // most bytes allocated at once since the start or the last resetPeak()
+    static std::size_t peakBytes() noexcept;
+    static void resetPeak() noexcept;
+
+private:
+    SecureMemory() = delete;
+};
+
+template<typename T>
+class SecureAllocator
+{
+public:
+    using value_type = T;
+
+    SecureAllocator() noexcept = default;
+    template<typename U>
+    SecureAllocator(const SecureAllocator<U> &) noexcept
+    {
+    }
+
+    T *allocate(std::size_t count)
+    {
+        if (count > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(SecureMemory::allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T *data, std::size_t count) noexcept
+    {
+        SecureMemory::deallocate(data, count * sizeof(T));
+    }
+
+    template<typename U>
+    inline bool operator== (const SecureAllocator<U> &) const noexcept
+    { return true; }
+    template<typename U>
+    inline bool operator!= (const SecureAllocator<U> &) const noexcept
+    { return false; }
+};
+
+using SecureString = std::basic_string<char, std::char_traits<char>, SecureAllocator<char>>;
+using SecureBuffer = std::vector<unsigned char, SecureAllocator<unsigned char>>;
+
+// comparison with regular strings, found by argument dependent lookup through the allocator
+inline bool operator== (const SecureString &lhs, const std::string &rhs) noexcept
+{ return std::string_view(lhs) == std::string_view(rhs); }
+inline bool operator== (const std::string &lhs, const SecureString &rhs) noexcept
+{ return std::string_view(lhs) == std::string_view(rhs); }
+inline bool operator!= (const SecureString &lhs, const std::string &rhs) noexcept
+{ return !(lhs == rhs); }
+inline bool operator!= (const std::string &lhs, const SecureString &rhs) noexcept
+{ return !(lhs == rhs); }
+
+#endif // SECUREMEMORY_HPP
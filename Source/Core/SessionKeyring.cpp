@@ -0,0 +1,101 @@
+#include "SessionKeyring.hpp"
+
+#if defined(__linux__) && __has_include(<linux/keyctl.h>)
+#include <linux/keyctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define OTPGEN_HAS_KEYRING
+#endif
+
+namespace {
+#if defined(OTPGEN_HAS_KEYRING)
+    static const constexpr char KEY_TYPE[] = "user";
+    // possessor: all, user: view, read, search, setattr (linux/keyctl.h lacks the permission bits)
+    static const constexpr unsigned long KEY_PERMISSIONS = 0x3f000000UL | 0x002b0000UL;
+
+    static const std::string description(const std::string &name)
+    {
+        return "otpgen:" + name;
+    }
+
+    static long find(const std::string &name)
+    {
+        return ::syscall(SYS_keyctl, KEYCTL_SEARCH, KEY_SPEC_USER_KEYRING, KEY_TYPE, description(name).c_str(), 0);
+    }
+#endif
+}
+
+namespace SessionKeyring {
+
+bool load(const std::string &name, SecureBuffer &key)
+{
+    key.clear();
+#if defined(OTPGEN_HAS_KEYRING)
+    const auto id = find(name);
+    if (id < 0)
+    {
+        return false;
+    }
+
+    // the size is returned even if the buffer is too small
+    const auto size = ::syscall(SYS_keyctl, KEYCTL_READ, id, nullptr, 0);
+    if (size <= 0)
+    {
+        return false;
+    }
+    key.resize(static_cast<std::size_t>(size));
+    if (::syscall(SYS_keyctl, KEYCTL_READ, id, key.data(), key.size()) != size)
+    {
+        key.clear();
+        return false;
+    }
+    return true;
+#else
+    (void) name;
+    return false;
+#endif
+}
+
+bool store(const std::string &name, const SecureBuffer &key, const std::chrono::seconds &lifetime)
+{
+#if defined(OTPGEN_HAS_KEYRING)
+    if (key.empty() || lifetime.count() <= 0)
+    {
+        return false;
+    }
+
+    const auto id = ::syscall(SYS_add_key, KEY_TYPE, description(name).c_str(), key.data(), key.size(),
+                              KEY_SPEC_USER_KEYRING);
+    if (id < 0)
+    {
+        return false;
+    }
+    if (::syscall(SYS_keyctl, KEYCTL_SETPERM, id, KEY_PERMISSIONS) < 0 ||
+        ::syscall(SYS_keyctl, KEYCTL_SET_TIMEOUT, id, static_cast<unsigned long>(lifetime.count())) < 0)
+    {
+        (void) ::syscall(SYS_keyctl, KEYCTL_INVALIDATE, id);
+        return false;
+    }
+    return true;
+#else
+    (void) name;
+    (void) key;
+    (void) lifetime;
+    return false;
+#endif
+}
+
+void remove(const std::string &name)
+{
+#if defined(OTPGEN_HAS_KEYRING)
+    const auto id = find(name);
+    if (id >= 0)
+    {
+        (void) ::syscall(SYS_keyctl, KEYCTL_INVALIDATE, id);
+    }
+#else
+    (void) name;
+#endif
+}
+
+}
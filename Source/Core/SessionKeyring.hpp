@@ -0,0 +1,35 @@
+#ifndef SESSIONKEYRING_HPP
+#define SESSIONKEYRING_HPP
+
+#include <chrono>
+#include <string>
+
+#include "SecureMemory.hpp"
+
+/**
+ * Wrapping keys of session keys in the user keyring of the kernel
+ *
+ * A session key (see TokenDatabase::sessionKey()) is only of use together
+ * with its wrapping key, which must not be stored next to it. The wrapping
+ * key is kept in the user keyring of the kernel under a name, readable by
+ * the processes of the user, it is dropped by the kernel once the lifetime
+ * is over and on reboot. The session key itself goes into a file or the
+ * keychain of the application.
+ *
+ * Only Linux has a keyring, elsewhere no wrapping key is stored and session
+ * keys are not used.
+ *
+ */
+namespace SessionKeyring {
+
+// false without a keyring or if the key is gone
+bool load(const std::string &name, SecureBuffer &key);
+
+// replaces the key of the name
+bool store(const std::string &name, const SecureBuffer &key, const std::chrono::seconds &lifetime);
+
+void remove(const std::string &name);
+
+}
+
+#endif // SESSIONKEYRING_HPP
@@ -0,0 +1,156 @@
+#include "SteamTimeService.hpp"
+#include "Clock.hpp"
+#include "TokenDatabase.hpp"
+
+#include <algorithm>
+
+SteamTimeService::SteamTimeService(const Query &query, const Clock *clock)
+    : _query(query),
+      _clock(clock)
+{
+}
+
+SteamTimeService::~SteamTimeService()
+{
+    this->stop();
+}
+
+bool SteamTimeService::load()
+{
+    std::time_t offset = 0, measured = 0;
+    if (TokenDatabase::selectSteamTimeOffset(offset, measured) != TokenDatabase::Success)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->install(offset, measured);
+    return true;
+}
+
+bool SteamTimeService::query()
+{
+    if (!this->_query)
+    {
+        return false;
+    }
+
+    // the request is not made under the lock, it may take a while
+    const auto before = this->now();
+    std::time_t server = 0;
+    if (!this->_query(server) || server <= 0)
+    {
+        return false;
+    }
+    const auto after = this->now();
+
+    const auto offset = server - (before + (after - before) / 2);
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->install(offset, after);
+    }
+
+    // without an open database the offset is only kept until the process exits
+    (void) TokenDatabase::storeSteamTimeOffset(offset, after);
+    return true;
+}
+
+void SteamTimeService::start()
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if (this->_thread.joinable())
+    {
+        return;
+    }
+
+    this->_stop = false;
+    this->_refresh = false;
+    this->_thread = std::thread(&SteamTimeService::worker, this);
+}
+
+void SteamTimeService::stop()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+        thread.swap(this->_thread);
+    }
+    this->_wakeup.notify_all();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+bool SteamTimeService::running() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_thread.joinable();
+}
+
+void SteamTimeService::refresh()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_refresh = true;
+    }
+    this->_wakeup.notify_all();
+}
+
+std::time_t SteamTimeService::offset() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_offset;
+}
+
+std::time_t SteamTimeService::measured() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_measured;
+}
+
+std::time_t SteamTimeService::now() const
+{
+    return this->_clock ? this->_clock->now() : Clock::current();
+}
+
+void SteamTimeService::install(const std::time_t &offset, const std::time_t &measured)
+{
+    this->_offset = offset;
+    this->_measured = measured;
+    Clock::setSteamOffset(offset);
+}
+
+void SteamTimeService::worker()
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    auto retry = std::chrono::seconds(0);
+
+    while (!this->_stop)
+    {
+        // a failed request is retried after the backoff, a measured offset is refreshed once it is old
+        auto delay = retry;
+        if (retry.count() == 0 && this->_measured != 0)
+        {
+            const auto age = std::max<std::time_t>(this->now() - this->_measured, 0);
+            delay = std::max(REFRESH_INTERVAL - std::chrono::seconds(age), std::chrono::seconds(0));
+        }
+
+        this->_wakeup.wait_for(lock, delay, [&]{
+            return this->_stop || this->_refresh;
+        });
+        if (this->_stop)
+        {
+            break;
+        }
+        this->_refresh = false;
+
+        lock.unlock();
+        const auto success = this->query();
+        lock.lock();
+
+        retry = success ? std::chrono::seconds(0) : std::clamp(retry * 2, RETRY_MIN, RETRY_MAX);
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef STEAMTIMESERVICE_HPP
+#define STEAMTIMESERVICE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class Clock;
+
+/**
+ * Offset of the Steam server time to the local clock
+ *
+ * Steam Guard only accepts codes computed at the time of the Steam servers,
+ * a local clock which is off by a few seconds produces codes which are
+ * rejected near the end of every period. The service asks the servers for
+ * their time once, installs the difference as Clock::setSteamOffset() and
+ * keeps it in the database, so later starts use the cached offset without
+ * a request. The offset is refreshed once a day in the background, failed
+ * requests are retried with a growing delay.
+ *
+ * The core has no network access, the request is given as a Query which
+ * returns the server time in seconds since the epoch (the GUI uses
+ * ITwoFactorService/QueryTime). The offset is measured against the middle
+ * of the request, the time the server most likely answered at.
+ *
+ */
+class SteamTimeService
+{
+public:
+    // the time of the Steam servers, false when the request failed
+    using Query = std::function<bool(std::time_t &serverTime)>;
+
+    static const constexpr std::chrono::seconds REFRESH_INTERVAL{24 * 60 * 60};
+    static const constexpr std::chrono::seconds RETRY_MIN{60};
+    static const constexpr std::chrono::seconds RETRY_MAX{60 * 60};
+
+    /**
+     * the clock must outlive the service, the default clock when none is given
+     */
+    SteamTimeService(const Query &query, const Clock *clock = nullptr);
+
+    /**
+     * stop the worker and destroy the service
+     */
+    ~SteamTimeService();
+
+    SteamTimeService(const SteamTimeService&) = delete;
+    SteamTimeService &operator= (const SteamTimeService&) = delete;
+
+    // install the offset stored in the database, false if there is none
+    bool load();
+
+    // ask the servers now, install and store the offset on success
+    bool query();
+
+    // refresh the offset on a worker thread, right away when it wasn't measured within the refresh interval
+    void start();
+    void stop();
+    bool running() const;
+
+    // wake the worker up to ask the servers now
+    void refresh();
+
+    // the last measured offset and the local time of the measurement, 0 if it never was measured
+    std::time_t offset() const;
+    std::time_t measured() const;
+
+private:
+    std::time_t now() const;
+    void install(const std::time_t &offset, const std::time_t &measured);
+    void worker();
+
+    Query _query;
+    const Clock *_clock;
+
+    std::time_t _offset = 0;
+    std::time_t _measured = 0;
+
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stop = false;
+    bool _refresh = false;
+};
+
+#endif // STEAMTIMESERVICE_HPP
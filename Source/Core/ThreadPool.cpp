@@ -0,0 +1,251 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+    // pool the current thread is a worker of, used to run nested calls inline
+    thread_local const ThreadPool *current_pool = nullptr;
+
+    static std::uint64_t pack_range(std::uint64_t front, std::uint64_t back)
+    {
+        return (back << 32) | front;
+    }
+
+    static void pin_thread(std::thread &thread, std::size_t cpu)
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<int>(cpu), &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void) thread;
+        (void) cpu;
+#endif
+    }
+}
+
+ThreadPool::ThreadPool(std::size_t threads, bool pin_workers)
+{
+    const auto hardware_threads = std::max<std::size_t>(1U, std::thread::hardware_concurrency());
+    if (threads == 0U)
+    {
+        threads = hardware_threads;
+    }
+
+    // the calling thread participates in every job
+    this->_ranges.reset(new Range[threads]);
+    for (auto i = 0U; i + 1U < threads; ++i)
+    {
+        this->_workers.emplace_back(&ThreadPool::worker, this, i);
+        if (pin_workers)
+        {
+            pin_thread(this->_workers.back(), i % hardware_threads);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+    }
+    this->_wakeup.notify_all();
+
+    for (auto&& worker : this->_workers)
+    {
+        worker.join();
+    }
+}
+
+std::size_t ThreadPool::concurrency() const
+{
+    return this->_workers.size() + 1U;
+}
+
+void ThreadPool::parallelFor(std::size_t count, std::size_t grain, const Task &task)
+{
+    if (count == 0U)
+    {
+        return;
+    }
+
+    // chunk indices must fit into half of a range word
+    static const constexpr std::size_t max_chunks = std::numeric_limits<std::uint32_t>::max();
+    grain = std::max<std::size_t>(grain, 1U);
+    grain = std::max<std::size_t>(grain, count / max_chunks + 1U);
+    const auto chunks = (count + grain - 1U) / grain;
+
+    // nothing to parallelize or nested call from a task
+    if (this->_workers.empty() || chunks == 1U || current_pool == this)
+    {
+        for (std::size_t begin = 0U; begin < count; begin += grain)
+        {
+            task(begin, std::min(count, begin + grain));
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(this->_submit);
+
+    // distribute the chunks evenly, stealing balances the rest
+    const auto participants = this->concurrency();
+    const auto per_participant = chunks / participants;
+    const auto remainder = chunks % participants;
+    std::uint64_t front = 0U;
+    for (auto i = 0U; i < participants; ++i)
+    {
+        const auto back = front + per_participant + (i < remainder ? 1U : 0U);
+        this->_ranges[i].bounds.store(pack_range(front, back), std::memory_order_relaxed);
+        front = back;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_task = &task;
+        this->_count = count;
+        this->_grain = grain;
+        this->_exception = nullptr;
+        this->_active = this->_workers.size();
+        ++this->_generation;
+    }
+    this->_wakeup.notify_all();
+
+    // the caller works on the last range
+    current_pool = this;
+    this->run(participants - 1U);
+    current_pool = nullptr;
+
+    std::exception_ptr exception;
+    {
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        this->_finished.wait(lock, [&]{
+            return this->_active == 0U;
+        });
+        this->_task = nullptr;
+        exception = this->_exception;
+    }
+
+    if (exception)
+    {
+        std::rethrow_exception(exception);
+    }
+}
+
+bool ThreadPool::pop(std::size_t self, std::uint64_t &chunk)
+{
+    auto &bounds = this->_ranges[self].bounds;
+    auto range = bounds.load(std::memory_order_acquire);
+
+    for (;;)
+    {
+        const auto front = range & 0xffffffffU;
+        const auto back = range >> 32;
+        if (front >= back)
+        {
+            return false;
+        }
+
+        if (bounds.compare_exchange_weak(range, pack_range(front + 1U, back),
+                                         std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            chunk = front;
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::steal(std::size_t self)
+{
+    const auto participants = this->concurrency();
+
+    for (auto i = 1U; i < participants; ++i)
+    {
+        auto &bounds = this->_ranges[(self + i) % participants].bounds;
+        auto range = bounds.load(std::memory_order_acquire);
+
+        for (;;)
+        {
+            const auto front = range & 0xffffffffU;
+            const auto back = range >> 32;
+            if (front >= back)
+            {
+                break;
+            }
+
+            // take the upper half, the owner keeps working on the lower one
+            const auto split = back - (back - front + 1U) / 2U;
+            if (bounds.compare_exchange_weak(range, pack_range(front, split),
+                                             std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                // the own range is empty, thieves never touch it
+                this->_ranges[self].bounds.store(pack_range(split, back), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run(std::size_t self)
+{
+    std::uint64_t chunk;
+    do
+    {
+        while (this->pop(self, chunk))
+        {
+            const auto begin = static_cast<std::size_t>(chunk) * this->_grain;
+            const auto end = std::min(this->_count, begin + this->_grain);
+
+            try
+            {
+                (*this->_task)(begin, end);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                if (!this->_exception)
+                {
+                    this->_exception = std::current_exception();
+                }
+            }
+        }
+    } while (this->steal(self));
+}
+
+void ThreadPool::worker(std::size_t index)
+{
+    current_pool = this;
+
+    std::uint64_t generation = 0U;
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    for (;;)
+    {
+        this->_wakeup.wait(lock, [&]{
+            return this->_stop || this->_generation != generation;
+        });
+
+        if (this->_stop)
+        {
+            return;
+        }
+
+        generation = this->_generation;
+        lock.unlock();
+        this->run(index);
+        lock.lock();
+
+        if (--this->_active == 0U)
+        {
+            this->_finished.notify_all();
+        }
+    }
+}
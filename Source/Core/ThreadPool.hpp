@@ -0,0 +1,78 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Executor.hpp"
+
+/**
+ * Work-stealing thread pool
+ *
+ * Every participant (the workers and the calling thread) owns a range of
+ * chunks and takes them from the front, idle participants steal half of
+ * the remaining chunks from the back of another range. The ranges are
+ * single atomic words, no lock is taken while the work is running.
+ *
+ * Only one parallelFor() runs at a time, calls from inside a task are
+ * executed inline on the calling worker.
+ *
+ */
+class ThreadPool : public Executor
+{
+public:
+    /**
+     * start the worker threads, 0 uses one thread per hardware thread
+     * with pin_workers every worker is bound to a fixed CPU (Linux only)
+     */
+    ThreadPool(std::size_t threads = 0U, bool pin_workers = false);
+
+    /**
+     * stop and join all worker threads
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator= (const ThreadPool&) = delete;
+
+    std::size_t concurrency() const override;
+    void parallelFor(std::size_t count, std::size_t grain, const Task &task) override;
+
+private:
+    // chunk range [front, back) packed into one word, front in the lower half
+    struct alignas(64) Range
+    {
+        std::atomic<std::uint64_t> bounds{0U};
+    };
+
+    bool pop(std::size_t self, std::uint64_t &chunk);
+    bool steal(std::size_t self);
+    void run(std::size_t self);
+    void worker(std::size_t index);
+
+    std::vector<std::thread> _workers;
+    std::unique_ptr<Range[]> _ranges;
+
+    std::mutex _submit;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    std::condition_variable _finished;
+    std::uint64_t _generation = 0U;
+    std::size_t _active = 0U;
+    bool _stop = false;
+
+    // current job
+    const Task *_task = nullptr;
+    std::size_t _count = 0U;
+    std::size_t _grain = 1U;
+    std::exception_ptr _exception;
+};
+
+#endif // THREADPOOL_HPP
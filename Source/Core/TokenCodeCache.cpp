@@ -0,0 +1,314 @@
+#include "TokenCodeCache.hpp"
+#include "Clock.hpp"
+#include "PerfStats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+namespace {
+    // the time the codes of the token type are computed at
+    static inline std::time_t codeTime(const OTPToken::TokenType &type, const std::time_t &time) noexcept
+    {
+        return type == OTPToken::Steam ? Clock::steamTime(time) : time;
+    }
+}
+
+TokenCodeCache::TokenCodeCache(const std::vector<OTPToken> &tokens, const Clock *clock)
+    : _entries(tokens.size()),
+      _clock(clock)
+{
+    for (auto i = 0U; i < tokens.size(); ++i)
+    {
+        const auto &token = tokens[i];
+        auto &entry = this->_entries[i];
+
+        // only time-based tokens can be cached
+        if (token.type() != OTPToken::TOTP && token.type() != OTPToken::Steam)
+        {
+            continue;
+        }
+
+        const auto algorithm = token.type() == OTPToken::Steam ? OTPToken::SHA1 : token.algorithm();
+        entry.key = OTPGen::prepareKey(token.secret(), algorithm);
+        if (!entry.key.isValid())
+        {
+            continue;
+        }
+
+        entry.type = token.type();
+        entry.digits = token.digitLength();
+        entry.period = token.type() == OTPToken::Steam ? OTPToken::defaultPeriod(OTPToken::Steam) : token.period();
+
+        // there are only a few distinct periods, a linear search is enough
+        const auto steam = entry.type == OTPToken::Steam;
+        auto group = this->_groups.begin();
+        while (group != this->_groups.end() && (group->period != entry.period || group->steam != steam))
+        {
+            ++group;
+        }
+        if (group == this->_groups.end())
+        {
+            this->_groups.emplace_back();
+            group = this->_groups.end() - 1;
+            group->period = entry.period;
+            group->steam = steam;
+        }
+        group->entries.emplace_back(i);
+    }
+    OTPGEN_PERF_MEMORY_ADD(this->_memory, this->_entries.capacity() * sizeof(Entry));
+
+    this->update(this->_clock ? this->_clock->now() : Clock::current());
+}
+
+TokenCodeCache::~TokenCodeCache()
+{
+    this->stop();
+}
+
+void TokenCodeCache::start()
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if (this->_thread.joinable())
+    {
+        return;
+    }
+
+    this->_stop = false;
+    this->_thread = std::thread(&TokenCodeCache::worker, this);
+}
+
+void TokenCodeCache::stop()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+        thread.swap(this->_thread);
+    }
+    this->_wakeup.notify_all();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+bool TokenCodeCache::running() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_thread.joinable();
+}
+
+std::time_t TokenCodeCache::refresh(const std::time_t &time)
+{
+    // the worker and manual refreshes must not write the slots at the same time
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->update(time);
+}
+
+std::time_t TokenCodeCache::update(const std::time_t &time)
+{
+    auto next_rotation = std::numeric_limits<std::time_t>::max();
+
+    OTPGen::TokenBuffer buffer;
+    for (auto&& entry : this->_entries)
+    {
+        if (entry.period == 0U)
+        {
+            continue;
+        }
+
+        const auto at = codeTime(entry.type, time);
+        const auto counter = static_cast<std::uint64_t>(at / entry.period);
+
+        // the current code only needs to be computed on the first refresh,
+        // afterwards it is always available as the previous next code
+        for (auto&& c : {counter, counter + 1U})
+        {
+            auto &slot = entry.slots[c & 1U];
+            if (slot.counter.load(std::memory_order_relaxed) != c && this->compute(entry, c, buffer))
+            {
+                write(slot, c, buffer);
+            }
+        }
+
+        const auto rotation = time + static_cast<std::time_t>(OTPToken::secondsUntilRotation(entry.period, at));
+        if (rotation < next_rotation)
+        {
+            next_rotation = rotation;
+        }
+    }
+
+    for (auto&& group : this->_groups)
+    {
+        const auto at = group.steam ? Clock::steamTime(time) : time;
+        this->updateIndex(group, static_cast<std::uint64_t>(at / group.period));
+    }
+
+    return next_rotation;
+}
+
+void TokenCodeCache::updateIndex(PeriodGroup &group, const std::uint64_t &counter)
+{
+    const auto current = std::atomic_load_explicit(&group.index, std::memory_order_acquire);
+    if (current && current->counter == counter)
+    {
+        return;
+    }
+
+    // the codes were computed by the update, the index is built from the slots
+    auto index = std::make_shared<CodeIndex>();
+    index->counter = counter;
+    index->codes.resize(group.entries.size() * sizeof(OTPGen::TokenBuffer));
+    index->tokens.reserve(group.entries.size());
+    for (auto i = 0U; i < group.entries.size(); ++i)
+    {
+        const auto &entry = this->_entries[group.entries[i]];
+        auto &code = *reinterpret_cast<OTPGen::TokenBuffer*>(index->codes.data() + i * sizeof(OTPGen::TokenBuffer));
+        if (read(entry.slots[counter & 1U], counter, code))
+        {
+            index->tokens.emplace(std::string_view(code), group.entries[i]);
+        }
+    }
+
+    std::atomic_store_explicit(&group.index, std::shared_ptr<const CodeIndex>(std::move(index)), std::memory_order_release);
+}
+
+bool TokenCodeCache::code(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out) const noexcept
+{
+    out[0] = '\0';
+
+    if (index >= this->_entries.size() || this->_entries[index].period == 0U)
+    {
+        return false;
+    }
+
+    const auto &entry = this->_entries[index];
+    const auto counter = static_cast<std::uint64_t>(codeTime(entry.type, time) / entry.period);
+    if (!read(entry.slots[counter & 1U], counter, out))
+    {
+        OTPGEN_PERF_COUNT(CodeCacheMisses, 1U);
+        return false;
+    }
+    OTPGEN_PERF_COUNT(CodeCacheHits, 1U);
+    return true;
+}
+
+bool TokenCodeCache::nextCode(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out) const noexcept
+{
+    out[0] = '\0';
+
+    if (index >= this->_entries.size() || this->_entries[index].period == 0U)
+    {
+        return false;
+    }
+
+    const auto &entry = this->_entries[index];
+    const auto counter = static_cast<std::uint64_t>(codeTime(entry.type, time) / entry.period) + 1U;
+    return read(entry.slots[counter & 1U], counter, out);
+}
+
+bool TokenCodeCache::findCode(const std::string_view &code, const std::time_t &time, std::vector<std::size_t> &indices) const
+{
+    indices.clear();
+
+    for (auto&& group : this->_groups)
+    {
+        const auto index = std::atomic_load_explicit(&group.index, std::memory_order_acquire);
+        const auto at = group.steam ? Clock::steamTime(time) : time;
+        if (!index || index->counter != static_cast<std::uint64_t>(at / group.period))
+        {
+            OTPGEN_PERF_COUNT(CodeCacheMisses, 1U);
+            continue;
+        }
+        OTPGEN_PERF_COUNT(CodeCacheHits, 1U);
+
+        const auto range = index->tokens.equal_range(code);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            indices.emplace_back(it->second);
+        }
+    }
+
+    // codes of different periods come in the order of the token list
+    std::sort(indices.begin(), indices.end());
+    return !indices.empty();
+}
+
+bool TokenCodeCache::read(const Slot &slot, const std::uint64_t &counter, OTPGen::TokenBuffer &out) noexcept
+{
+    if (slot.counter.load(std::memory_order_acquire) != counter)
+    {
+        return false;
+    }
+
+    const std::uint64_t code[2] = {
+        slot.code[0].load(std::memory_order_relaxed),
+        slot.code[1].load(std::memory_order_relaxed),
+    };
+
+    // the slot was rewritten while reading
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.counter.load(std::memory_order_relaxed) != counter)
+    {
+        return false;
+    }
+
+    std::memcpy(out, code, sizeof(OTPGen::TokenBuffer));
+    return true;
+}
+
+void TokenCodeCache::write(Slot &slot, const std::uint64_t &counter, const OTPGen::TokenBuffer &code) noexcept
+{
+    static_assert(sizeof(OTPGen::TokenBuffer) <= sizeof(slot.code), "token buffer must fit into a slot");
+
+    std::uint64_t words[2] = {};
+    std::memcpy(words, code, sizeof(OTPGen::TokenBuffer));
+
+    slot.counter.store(INVALID_COUNTER, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.code[0].store(words[0], std::memory_order_relaxed);
+    slot.code[1].store(words[1], std::memory_order_relaxed);
+    slot.counter.store(counter, std::memory_order_release);
+}
+
+bool TokenCodeCache::compute(const Entry &entry, const std::uint64_t &counter, OTPGen::TokenBuffer &out) const noexcept
+{
+    const auto time = static_cast<std::time_t>(counter * entry.period);
+
+    if (entry.type == OTPToken::Steam)
+    {
+        return OTPGen::computeSteamInto(out, time, entry.key);
+    }
+    return OTPGen::computeTOTPInto(out, time, entry.key, entry.digits, entry.period);
+}
+
+void TokenCodeCache::worker()
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    while (!this->_stop)
+    {
+        const auto now = this->_clock ? this->_clock->now() : Clock::current();
+        auto next_rotation = this->update(now);
+
+        // nothing to rotate, sleep until stopped
+        if (next_rotation == std::numeric_limits<std::time_t>::max())
+        {
+            this->_wakeup.wait(lock, [&]{
+                return this->_stop;
+            });
+            break;
+        }
+
+        if (next_rotation <= now)
+        {
+            next_rotation = now + 1;
+        }
+
+        this->_wakeup.wait_until(lock, std::chrono::system_clock::from_time_t(next_rotation), [&]{
+            return this->_stop;
+        });
+    }
+}
@@ -0,0 +1,148 @@
+#ifndef TOKENCODECACHE_HPP
+#define TOKENCODECACHE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "OTPToken.hpp"
+#include "OTPKey.hpp"
+#include "OTPGen.hpp"
+#include "PerfStats.hpp"
+
+class Clock;
+
+/**
+ * Precomputed code cache for a set of time-based tokens
+ *
+ * Holds the codes of the current and the next period for every TOTP and
+ * Steam token. A background worker wakes up at the period boundaries of
+ * the tokens and computes the code of the following period, so the next
+ * code is always ready before the rotation happens.
+ *
+ * Lookups are lock-free and never wait for HMAC work, if a code isn't
+ * cached (yet) the lookup fails and the caller can fall back to OTPGen.
+ *
+ * For every period the cache also keeps a reverse index from the current
+ * codes to the tokens showing them, rebuilt from the cached codes when the
+ * period rotates, so finding the token of a code doesn't compute any HMAC.
+ *
+ * Steam codes follow the Steam time (see Clock::steamTime()), times given
+ * to the cache are always times of the default clock.
+ *
+ * The token set is fixed at construction, create a new cache to reload.
+ * The worker reads the time from the given clock (the default clock when
+ * none is given) and sleeps on the system clock until the next rotation.
+ *
+ */
+class TokenCodeCache
+{
+public:
+    /**
+     * prepare all tokens and compute the codes for the current time
+     * the clock must outlive the cache
+     */
+    TokenCodeCache(const std::vector<OTPToken> &tokens, const Clock *clock = nullptr);
+
+    /**
+     * stop the background worker and destroy the cache
+     */
+    ~TokenCodeCache();
+
+    TokenCodeCache(const TokenCodeCache&) = delete;
+    TokenCodeCache &operator= (const TokenCodeCache&) = delete;
+
+    // start and stop the background worker
+    void start();
+    void stop();
+    bool running() const;
+
+    // compute the missing codes of the current and next period at the given time
+    // returns the time of the next rotation of any token
+    std::time_t refresh(const std::time_t &time);
+
+    // amount of tokens in the cache, indices match the token list of the constructor
+    inline std::size_t size() const
+    { return this->_entries.size(); }
+
+    // code of the token at the given time, returns false if the code isn't cached
+    bool code(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out) const noexcept;
+
+    // code of the token in the period following the given time
+    bool nextCode(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out) const noexcept;
+
+    // indices of all tokens showing the code at the given time, periods whose
+    // index isn't built for the time are skipped, returns false without a match
+    bool findCode(const std::string_view &code, const std::time_t &time, std::vector<std::size_t> &indices) const;
+
+private:
+    // the code of one period, guarded by a sequence lock
+    struct Slot
+    {
+        std::atomic<std::uint64_t> counter{INVALID_COUNTER};
+        std::atomic<std::uint64_t> code[2] = {};
+    };
+
+    struct Entry
+    {
+        OTPKey key;
+        OTPToken::TokenType type = OTPToken::None;
+        OTPToken::DigitType digits = 0U;
+        OTPToken::PeriodType period = 0U;
+
+        // one slot per counter parity, the slot of a period is rewritten
+        // only after the period has expired
+        Slot slots[2];
+    };
+
+    // codes of one period to the indices of their tokens
+    struct CodeIndex
+    {
+        std::uint64_t counter = INVALID_COUNTER;
+        std::unordered_multimap<std::string_view, std::size_t> tokens;
+        // storage of the codes referenced by the keys, one token buffer per token
+        std::vector<char> codes;
+    };
+
+    // all tokens sharing a period, the index is replaced as a whole
+    // and accessed with the atomic shared_ptr functions, Steam tokens
+    // rotate at the Steam time and are grouped apart
+    struct PeriodGroup
+    {
+        OTPToken::PeriodType period = 0U;
+        bool steam = false;
+        std::vector<std::size_t> entries;
+        std::shared_ptr<const CodeIndex> index;
+    };
+
+    static const constexpr std::uint64_t INVALID_COUNTER = ~0ULL;
+
+    static bool read(const Slot &slot, const std::uint64_t &counter, OTPGen::TokenBuffer &out) noexcept;
+    static void write(Slot &slot, const std::uint64_t &counter, const OTPGen::TokenBuffer &code) noexcept;
+    std::time_t update(const std::time_t &time);
+    void updateIndex(PeriodGroup &group, const std::uint64_t &counter);
+    bool compute(const Entry &entry, const std::uint64_t &counter, OTPGen::TokenBuffer &out) const noexcept;
+
+    void worker();
+
+    std::vector<Entry> _entries;
+    std::vector<PeriodGroup> _groups;
+    const Clock *_clock;
+
+    // the prepared keys of the entries
+    PerfStats::Allocation _memory{PerfStats::TokenStorage};
+
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stop = false;
+};
+
+#endif // TOKENCODECACHE_HPP
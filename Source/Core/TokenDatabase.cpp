@@ -1,9 +1,43 @@
 #include "TokenDatabase.hpp"
-
+#include "AsyncFileIO.hpp"
+#include "Codec.hpp"
+#include "Internal/AtomicFile.hpp"
+#include "Internal/BackupFile.hpp"
+#include "Internal/ChunkedContainer.hpp"
+#include "Internal/CounterJournal.hpp"
+#include "Internal/EncryptedVfs.hpp"
+#include "Internal/ImageCompression.hpp"
+#include "Internal/MappedFile.hpp"
+#include "Internal/RawStatement.hpp"
+#include "Internal/SecureRandom.hpp"
+#include "Internal/SecretCipher.hpp"
+#include "Internal/TokenSchema.hpp"
+#include "Internal/WebStorage.hpp"
+#include "PreparedKeyCache.hpp"
+#include "ThreadPool.hpp"
+#include "TokenSet.hpp"
+#include "TokenSetView.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
 #include <ostream>
 #include <sstream>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <sqlite/sqlite3.h>
 #include <sqlite_modern_cpp.h>
@@ -23,38 +57,564 @@
 
 namespace {
     // database version, used for possible migrations
-    static const std::uint32_t DATABASE_VERSION = 0x0f000005;
+    static const std::uint32_t DATABASE_VERSION = 0x0f00000f;
+
+    // distance between the positions of neighbouring tokens in the display order,
+    // moves take the middle between two positions and only renumber once a gap is used up
+    static const constexpr OTPToken::sqliteLongID DISPLAY_ORDER_GAP = 1024;
+
+    // operations of the change log, an order change renumbered all positions and has no token
+    enum ChangeOp : std::uint8_t {
+        ChangeWrite = 1,  // inserted or updated token
+        ChangeMove = 2,   // new display position
+        ChangeDelete = 3,
+        ChangeOrder = 4,
+    };
 
     // SQLite3 connection handle
     static std::shared_ptr<sqlite::database> db;
     static bool db_status;
-    static std::string db_data;
+
+    // page encrypted databases are opened on disk and keep a transaction open until the next save,
+    // the file which is open might differ from databasePath after setTokenDatabase()
+    static bool db_paged = false;
+    static std::string db_paged_path;
+
+    // saves which were deferred by the durability policy and the time of the last write
+    static bool db_save_pending = false;
+    static bool db_last_write_valid = false;
+    static std::chrono::steady_clock::time_point db_last_write;
+
+    // cipher of the secret column, see secretCipher()
+    static std::shared_ptr<const Internal::SecretCipher> db_secret_cipher;
+
+    // every row has its secret hash, see fillSecretHashes()
+    static bool db_secret_hashes_valid = false;
+
+    // hash of the decoded secret for the secret_hash column, empty (bound as NULL) if it doesn't decode
+    // secrets are decoded on the stack, only unusually long ones go through the secure allocator
+    static void secretHash(const Internal::SecretCipher &cipher, const OTPToken::TokenSecret &secret, std::vector<unsigned char> &out)
+    {
+        unsigned char buffer[256];
+        SecureString heap;
+        auto decoded = buffer;
+        if (Codec::base32DecodedSize(secret.size()) > sizeof(buffer))
+        {
+            heap.resize(Codec::base32DecodedSize(secret.size()));
+            decoded = reinterpret_cast<unsigned char*>(&heap[0]);
+        }
+
+        const auto size = Codec::base32Decode(secret.data(), secret.size(), decoded);
+        if (size == 0)
+        {
+            out.clear();
+        }
+        else
+        {
+            cipher.fingerprint(decoded, size, out);
+        }
+        SecureMemory::wipe(buffer, sizeof(buffer));
+    }
+
+    // prepared statements of the current connection, keyed by the SQL text
+    // the statements keep a reference to the connection and must be released before closing it
+    using StatementMap = std::unordered_map<std::string, std::unique_ptr<sqlite::database_binder>>;
+    static StatementMap db_statements;
+    // statements of the hot paths which report misses and constraint violations without throwing
+    static Internal::RawStatementMap db_raw_statements;
+
+    // counts the changes of the database, readers of an older generation are outdated
+    static std::atomic<std::uint64_t> db_generation{1U};
+
+#ifdef OTPGEN_WITH_PERF_STATS
+    // execution times of the prepared statements, keyed by the SQL text, kept across connections
+    static std::unordered_map<std::string, TokenDatabase::StatementStats> db_statement_stats;
+
+    // most pages the open database cached at once
+    static std::uint64_t db_page_cache_peak = 0U;
+
+    // the default allocator of sqlite, wrapped to account its memory
+    static sqlite3_mem_methods sqlite_memory;
+
+    static void *sqliteMalloc(int size)
+    {
+        auto data = sqlite_memory.xMalloc(size);
+        if (data)
+        {
+            PerfStats::allocate(PerfStats::SqliteMemory, static_cast<std::uint64_t>(sqlite_memory.xSize(data)));
+        }
+        return data;
+    }
+
+    static void sqliteFree(void *data)
+    {
+        if (data)
+        {
+            PerfStats::release(PerfStats::SqliteMemory, static_cast<std::uint64_t>(sqlite_memory.xSize(data)));
+        }
+        sqlite_memory.xFree(data);
+    }
+
+    static void *sqliteRealloc(void *data, int size)
+    {
+        const auto before = static_cast<std::uint64_t>(sqlite_memory.xSize(data));
+        auto resized = sqlite_memory.xRealloc(data, size);
+        if (resized)
+        {
+            PerfStats::release(PerfStats::SqliteMemory, before);
+            PerfStats::allocate(PerfStats::SqliteMemory, static_cast<std::uint64_t>(sqlite_memory.xSize(resized)));
+        }
+        return resized;
+    }
+
+    // sqlite must not be initialized yet, the hooks are installed while the library is loaded
+    static bool installSqliteMemoryHooks()
+    {
+        if (sqlite3_config(SQLITE_CONFIG_GETMALLOC, &sqlite_memory) != SQLITE_OK)
+        {
+            return false;
+        }
+        auto hooks = sqlite_memory;
+        hooks.xMalloc = &sqliteMalloc;
+        hooks.xFree = &sqliteFree;
+        hooks.xRealloc = &sqliteRealloc;
+        return sqlite3_config(SQLITE_CONFIG_MALLOC, &hooks) == SQLITE_OK;
+    }
+
+    static const bool sqlite_memory_hooks = installSqliteMemoryHooks();
+#endif
+
+    // interned labels of the open vault, labels compare like COLLATE NOCASE by their key
+    static std::shared_ptr<LabelArena> db_labels = std::make_shared<LabelArena>();
+
+    // label key to id map of all tokens, built on the first label lookup and kept up to date
+    // by inserts, other changes to the tokens table invalidate it
+    static std::unordered_map<LabelArena::Id, OTPToken::sqliteTokenID> db_label_ids;
+    static bool db_label_ids_valid = false;
+
+    static void invalidateReaders()
+    {
+        db_generation.fetch_add(1U, std::memory_order_relaxed);
+    }
+
+    static void invalidateLabelIds()
+    {
+        db_label_ids.clear();
+        db_label_ids_valid = false;
+    }
+
+    // number of tokens of each type with the total at 0, rebuilt on load and kept up to date
+    // by inserts, updates and deletes, other changes to the tokens table invalidate it
+    static std::array<OTPToken::sqliteTokenID, OTPToken::Steam + 1> db_type_counts;
+    static bool db_type_counts_valid = false;
+
+    static void invalidateTypeCounts()
+    {
+        db_type_counts.fill(0);
+        db_type_counts_valid = false;
+    }
+
+    static void countToken(const OTPToken::sqliteTypesID &type, const OTPToken::sqliteTokenID &delta)
+    {
+        if (!db_type_counts_valid)
+        {
+            return;
+        }
+        if (type <= OTPToken::None || type > OTPToken::Steam)
+        {
+            invalidateTypeCounts();
+            return;
+        }
+        db_type_counts[static_cast<std::size_t>(type)] += delta;
+        db_type_counts[OTPToken::None] += delta;
+    }
+
+    // recently used icons, most recent first, icons are only loaded on demand
+    static const constexpr std::size_t ICON_CACHE_SIZE = 64;
+    using IconCacheList = std::list<std::pair<OTPToken::sqliteTokenID, OTPToken::SharedIcon>>;
+    static IconCacheList db_icon_lru;
+    static std::unordered_map<OTPToken::sqliteTokenID, IconCacheList::iterator> db_icons;
+
+    static void invalidateIcon(const OTPToken::sqliteTokenID &id)
+    {
+        const auto it = db_icons.find(id);
+        if (it != db_icons.end())
+        {
+            db_icon_lru.erase(it->second);
+            db_icons.erase(it);
+        }
+    }
+
+    static void invalidateIcons()
+    {
+        db_icons.clear();
+        db_icon_lru.clear();
+    }
+
+    // all public functions are serialized, the auto save runs on a background thread
+    static std::recursive_mutex db_mutex;
+
+    // observers of the changes and the events which weren't published yet,
+    // the events after the mark belong to the innermost change batch
+    struct ChangeObserverEntry
+    {
+        TokenDatabase::ObserverId id;
+        TokenDatabase::ChangeObserver observer;
+        TokenDatabase::Dispatcher dispatcher;
+    };
+    static std::vector<ChangeObserverEntry> db_observers;
+    static TokenDatabase::ObserverId db_next_observer = 1;
+    static TokenDatabase::ChangeEvents db_events;
+    static std::size_t db_event_depth = 0;
+    static std::size_t db_event_mark = 0;
+
+    // changes since the last write
+    static bool db_dirty = false;
+
+    // the database file as it was after the last load or write, used to detect
+    // changes made by other processes without decrypting the file
+    struct FileStamp
+    {
+        bool valid = false;
+        std::string path;
+        std::filesystem::file_time_type mtime;
+        std::uintmax_t size = 0;
+        std::size_t hash = 0;
+    };
+    static FileStamp db_file_stamp;
+
+    // HOTP counters changed since the last write, opened by loadTokens()
+    static std::unique_ptr<Internal::CounterJournal> db_counters;
+
+    static bool statFile(const std::string &path, FileStamp &stamp)
+    {
+        std::error_code error;
+        stamp.path = path;
+        stamp.mtime = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            return false;
+        }
+        stamp.size = std::filesystem::file_size(path, error);
+        return !error;
+    }
+
+    // the file is read instead of mapped, another process may truncate it while it is hashed
+    static bool hashFile(const std::string &path, std::size_t &hash)
+    {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+
+        static const constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+        std::string chunk(CHUNK_SIZE, '\0');
+        hash = 0;
+        while (file)
+        {
+            file.read(&chunk[0], static_cast<std::streamsize>(chunk.size()));
+            const auto read = static_cast<std::size_t>(file.gcount());
+            if (read == 0)
+            {
+                break;
+            }
+            const auto h = std::hash<std::string_view>()(std::string_view(chunk.data(), read));
+            hash ^= h + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        }
+        return !file.bad();
+    }
+
+    static void recordFileStamp(const std::string &path)
+    {
+        FileStamp stamp;
+        stamp.valid = statFile(path, stamp) && hashFile(path, stamp.hash);
+        db_file_stamp = std::move(stamp);
+    }
+
+    // debounced background saves, every change pushes the deadline back,
+    // the worker is started with the first scheduled save and joined on exit
+    class SaveScheduler final
+    {
+    public:
+        ~SaveScheduler()
+        {
+            std::thread thread;
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                this->_stop = true;
+                thread.swap(this->_thread);
+            }
+            this->_wakeup.notify_all();
+
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+
+        void schedule(const std::chrono::steady_clock::time_point &deadline)
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->_mutex);
+                if (this->_stop)
+                {
+                    return;
+                }
+                this->_deadline = deadline;
+                this->_scheduled = true;
+                if (!this->_thread.joinable())
+                {
+                    this->_thread = std::thread(&SaveScheduler::worker, this);
+                }
+            }
+            this->_wakeup.notify_all();
+        }
+
+    private:
+        void worker()
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            while (!this->_stop)
+            {
+                if (!this->_scheduled)
+                {
+                    this->_wakeup.wait(lock, [&]{
+                        return this->_stop || this->_scheduled;
+                    });
+                    continue;
+                }
+
+                // wait until the deadline passed without another change
+                const auto deadline = this->_deadline;
+                if (this->_wakeup.wait_until(lock, deadline, [&]{
+                    return this->_stop || this->_deadline != deadline;
+                }))
+                {
+                    continue;
+                }
+                this->_scheduled = false;
+
+                // the database mutex is never taken while holding the scheduler mutex
+                lock.unlock();
+                {
+                    std::lock_guard<std::recursive_mutex> db_lock(db_mutex);
+                    if (db_save_pending)
+                    {
+                        (void) TokenDatabase::saveTokens();
+                    }
+                }
+                lock.lock();
+            }
+        }
+
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+        std::chrono::steady_clock::time_point _deadline;
+        bool _scheduled = false;
+        bool _stop = false;
+    };
+
+    // declared last so the worker is joined before the state it uses is destroyed
+    static SaveScheduler db_scheduler;
+
+    // executor for the chunks of large images, the internal pool is started on first use
+    static Executor *db_executor = nullptr;
+
+    // prepared keys of the hot tokens, holders of the previous cache keep it after a budget change
+    static std::shared_ptr<PreparedKeyCache> db_key_cache = std::make_shared<PreparedKeyCache>();
+
+    static const char *const JOURNAL_MODES[] = {"delete", "truncate", "persist", "memory"};
+
+    // connection wide settings, must be applied before the first transaction
+    static void applyTuning(sqlite::database &target, const TokenDatabase::Tuning &tuning)
+    {
+        target << "pragma cache_size = " + std::to_string(-static_cast<std::int64_t>(tuning.cacheSizeKb)) + ";";
+        target << (tuning.tempStoreMemory ? "pragma temp_store = memory;" : "pragma temp_store = default;");
+        target << std::string("pragma journal_mode = ") + JOURNAL_MODES[tuning.journalMode] + ";";
+        target << "pragma synchronous = " + std::to_string(static_cast<int>(tuning.synchronous)) + ";";
+        target << (tuning.foreignKeys ? "pragma foreign_keys = on;" : "pragma foreign_keys = off;");
+    }
+
+    static Executor *imageExecutor(std::size_t size)
+    {
+        if (size <= Internal::CONTAINER_CHUNK_SIZE)
+        {
+            return nullptr;
+        }
+        if (db_executor)
+        {
+            return db_executor;
+        }
+        static ThreadPool pool;
+        return &pool;
+    }
 }
 
-template<typename T, class L = std::vector<T>>
-static bool contains(const L &list, const T &value)
+SecureString TokenDatabase::databasePassword;
+std::string TokenDatabase::databasePath;
+TokenDatabase::StorageFormat TokenDatabase::databaseFormat = TokenDatabase::EncryptedImage;
+TokenDatabase::Compression TokenDatabase::databaseCompression = TokenDatabase::Uncompressed;
+bool TokenDatabase::databaseProgressive = false;
+double TokenDatabase::databaseCompaction = 0.25;
+std::uint32_t TokenDatabase::databasePageSize = 0;
+TokenDatabase::Durability TokenDatabase::databaseDurability = TokenDatabase::Immediate;
+std::chrono::milliseconds TokenDatabase::groupCommitWindow = std::chrono::milliseconds(500);
+std::chrono::milliseconds TokenDatabase::autoSaveDelay = std::chrono::milliseconds(0);
+TokenDatabase::Tuning TokenDatabase::imageTuning = TokenDatabase::defaultTuning(TokenDatabase::EncryptedImage);
+TokenDatabase::Tuning TokenDatabase::pagesTuning = TokenDatabase::defaultTuning(TokenDatabase::EncryptedPages);
+
+TokenDatabase::Stats TokenDatabase::stats()
 {
-    return std::find(list.begin(), list.end(), value) != list.end();
+    Stats stats;
+    stats.perf = PerfStats::snapshot();
+
+#ifdef OTPGEN_WITH_PERF_STATS
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+
+    // the cache of the open connection, sqlite keeps no peak of it
+    int cached = 0, highwater = 0;
+    if (db_status && db && sqlite3_db_status(db->connection().get(), SQLITE_DBSTATUS_CACHE_USED, &cached, &highwater, 0) == SQLITE_OK)
+    {
+        db_page_cache_peak = std::max(db_page_cache_peak, static_cast<std::uint64_t>(cached));
+        stats.perf.memory[PerfStats::SqlitePageCache].currentBytes = static_cast<std::uint64_t>(cached);
+    }
+    stats.perf.memory[PerfStats::SqlitePageCache].peakBytes = db_page_cache_peak;
+
+    stats.statements.reserve(db_statement_stats.size());
+    for (auto&& s : db_statement_stats)
+    {
+        stats.statements.emplace_back(s.second);
+        stats.statements.back().sql = s.first;
+    }
+
+    // the most expensive statements first
+    std::sort(stats.statements.begin(), stats.statements.end(), [](const StatementStats &a, const StatementStats &b) {
+        return a.totalNs > b.totalNs;
+    });
+#endif
+
+    return stats;
 }
 
-template<typename T, class L = std::vector<T>>
-static auto positionOf(const L &list, const T &value)
+void TokenDatabase::resetStats()
 {
-    return std::distance(list.begin(), std::find(list.begin(), list.end(), value));
+    PerfStats::reset();
+
+#ifdef OTPGEN_WITH_PERF_STATS
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    db_statement_stats.clear();
+    db_page_cache_peak = 0U;
+#endif
 }
 
-template<typename POSITION = std::size_t, typename LENGTH = std::size_t, typename LIST = TokenDatabase::DisplayOrder>
-static void moveRange(POSITION start, LENGTH length, POSITION dst, LIST &list)
+std::uint64_t TokenDatabase::Inspection::compactionSavings() const
 {
-    const auto final_dst = dst > start ? dst - length : dst;
-
-    LIST tmp(list.begin() + start, list.begin() + start + length);
-    list.erase(list.begin() + start, list.begin() + start + length);
-    list.insert(list.begin() + final_dst, tmp.begin(), tmp.end());
+    auto pages = this->freePages;
+    if (this->usableSize != 0U)
+    {
+        for (auto&& table : this->tables)
+        {
+            const auto used = table.leafPages * this->usableSize - std::min(table.leafUnusedBytes, table.leafPages * this->usableSize);
+            const auto needed = std::max<std::uint64_t>(1U, (used + this->usableSize - 1U) / this->usableSize);
+            pages += table.leafPages > needed ? table.leafPages - needed : 0U;
+        }
+    }
+    return pages * this->pageSize;
 }
 
-std::string TokenDatabase::databasePassword;
-std::string TokenDatabase::databasePath;
+TokenDatabase::Error TokenDatabase::inspect(Inspection &out)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    out = {};
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // text columns are measured in bytes, length() counts their characters
+    try {
+        (*db) << "pragma page_size;" >> out.pageSize;
+        (*db) << "pragma page_count;" >> out.pageCount;
+        (*db) << "pragma freelist_count;" >> out.freePages;
+        out.usableSize = out.pageSize - (db_paged ? static_cast<std::uint32_t>(Internal::ENCRYPTED_PAGE_RESERVE) : 0U);
+
+        // every page once, the tables and their indexes separately
+        (*db) << "select name, count(*), sum(payload), sum(unused), total(pagetype = 'leaf'), "
+                 "total(case when pagetype = 'leaf' then unused else 0 end) from dbstat group by name;"
+              >> [&](const std::string &name, const std::uint64_t &pages, const std::uint64_t &payload, const std::uint64_t &unused,
+                     const double &leafPages, const double &leafUnused) {
+            out.tables.push_back({name, pages, payload, unused, static_cast<std::uint64_t>(leafPages), static_cast<std::uint64_t>(leafUnused)});
+            if (name == "token_order" || name == "token_order_position")
+            {
+                out.orderBytes += payload;
+            }
+        };
+
+        (*db) << "select type, count(*), total(length(cast(label as blob))), total(length(cast(issuer as blob))), "
+                 "total(length(cast(secret as blob))), total(length(secret_hash)), total(length(icon)) from tokens group by type;"
+              >> [&](const OTPToken::sqliteTypesID &type, const std::uint64_t &rows, const double &label, const double &issuer,
+                     const double &secret, const double &hash, const double &icon) {
+            if (type >= 0 && static_cast<std::size_t>(type) < out.tokens.size())
+            {
+                out.tokens[static_cast<std::size_t>(type)] = rows;
+            }
+            out.labelBytes += static_cast<std::uint64_t>(label);
+            out.issuerBytes += static_cast<std::uint64_t>(issuer);
+            out.secretBytes += static_cast<std::uint64_t>(secret);
+            out.secretHashBytes += static_cast<std::uint64_t>(hash);
+            out.iconReferenceBytes += static_cast<std::uint64_t>(icon);
+        };
+
+        // the references of every icon are counted in one pass over the tokens
+        (*db) << "select length(icons.data), coalesce(refs.count, 0) from icons left join "
+                 "(select icon, count(*) as count from tokens where icon is not null group by icon) as refs on refs.icon = icons.hash;"
+              >> [&](const std::uint64_t &bytes, const std::uint64_t &references) {
+            ++out.icons;
+            out.iconBytes += bytes;
+            if (references == 0U)
+            {
+                ++out.orphanedIcons;
+                out.orphanedIconBytes += bytes;
+            }
+            else
+            {
+                out.sharedIconBytes += (references - 1U) * bytes;
+            }
+        };
+        (*db) << "select count(*), total(length(data)), "
+                 "total(case when hash not in (select icon from tokens where icon is not null) then length(data) else 0 end) "
+                 "from icon_thumbnails;"
+              >> [&](const std::uint64_t &count, const double &bytes, const double &orphaned) {
+            out.thumbnails = count;
+            out.thumbnailBytes = static_cast<std::uint64_t>(bytes);
+            out.orphanedIconBytes += static_cast<std::uint64_t>(orphaned);
+        };
+
+        (*db) << "select count(*), "
+                 "total(not exists (select 1 from tokens where tokens.id = token_order.id)) from token_order;"
+              >> [&](const std::uint64_t &rows, const double &dead) {
+            out.orderEntries = rows;
+            out.deadOrderEntries = static_cast<std::uint64_t>(dead);
+        };
+        (*db) << "select count(*) from tokens where not exists (select 1 from token_order where token_order.id = tokens.id);"
+              >> out.unorderedTokens;
+        (*db) << "select count(*) from changelog;" >> out.changeLogEntries;
+    } catch (sqlite::sqlite_exception &) {
+        out = {};
+        return SqlExecutionFailed;
+    }
+
+    std::sort(out.tables.begin(), out.tables.end(), [](const Inspection::Table &a, const Inspection::Table &b) {
+        return a.pages > b.pages;
+    });
+
+    std::error_code error;
+    const auto size = std::filesystem::file_size(databasePath, error);
+    out.fileBytes = error ? 0U : static_cast<std::uint64_t>(size);
+    return Success;
+}
 
 const std::string TokenDatabase::getErrorMessage(const Error &error)
 {
@@ -90,6 +650,14 @@ const std::string TokenDatabase::getErrorMessage(const Error &error)
         case SqlEmptyResults:              return "SQL statement returned nothing.";
         case SqlSchemaValidationFailed:    return "Database schema is invalid / was user-modified.";
 
+        case ChangeLogPruned: return "The change log no longer holds the requested changes.";
+        case EmptyFilter: return "The group filter has no condition.";
+        case DuplicateSecret: return "A token with the same secret already exists.";
+        case OperationCancelled: return "The operation was cancelled.";
+        case SessionKeyInvalid: return "The session key is invalid or belongs to another database.";
+        case SessionKeyExpired: return "The session key has expired.";
+        case InvalidArgument: return "A parameter is out of its range.";
+
         case UnknownFailure: return "An unknown error occurred!";
     }
 
@@ -98,11 +666,13 @@ const std::string TokenDatabase::getErrorMessage(const Error &error)
 
 bool TokenDatabase::databaseConnected()
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     return db_status;
 }
 
 TokenDatabase::Error TokenDatabase::initDatabase()
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     if (db_status)
     {
         closeDatabase();
@@ -111,7 +681,9 @@ TokenDatabase::Error TokenDatabase::initDatabase()
     // create in-memory database
     try {
         db = std::make_shared<sqlite::database>(":memory:");
+        applyTuning(*db, imageTuning);
         db_status = true;
+        invalidateReaders();
     } catch (sqlite::sqlite_exception &) {
         db_status = false;
         return SqlMemoryAllocationError;
@@ -121,1266 +693,6735 @@ TokenDatabase::Error TokenDatabase::initDatabase()
 }
 
 void TokenDatabase::closeDatabase()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (db_status)
+    {
+        // deferred and scheduled saves are written before closing, the counter journal is merged
+        if (db_counters && db_counters->records() > 0)
+        {
+            db_save_pending = true;
+        }
+        (void) flushTokens();
+        releaseDatabase();
+        notifyChange(ChangeEvent::Reloaded, 0);
+    }
+}
+
+void TokenDatabase::discardDatabase()
+{
+    // the signal may have interrupted a save, waiting for it would never return
+    std::unique_lock<std::recursive_mutex> lock(db_mutex, std::try_to_lock);
+    if (lock.owns_lock())
+    {
+        releaseDatabase();
+    }
+}
+
+void TokenDatabase::releaseDatabase()
 {
     if (db_status)
     {
-        // force close database
-        (void) sqlite3_close_v2(db->connection().get());
+        // finalize all prepared statements, the last reference closes the connection, readers keep their copy
+        db_statements.clear();
+        db_raw_statements.clear();
+        invalidateReaders();
+        invalidateLabelIds();
+        db_labels = std::make_shared<LabelArena>();
+        invalidateTypeCounts();
+        invalidateIcons();
+        db_secret_hashes_valid = false;
+
+        // changes since the last save are discarded
+        if (db_paged)
+        {
+            try {
+                (*db) << "rollback;";
+            } catch (sqlite::sqlite_exception &) {}
+        }
+
+        // the journal stays on disk and is applied by the next load
+        if (db_counters)
+        {
+            db_counters->close();
+        }
+
         db = nullptr;
         db_status = false;
-        db_data.clear();
+        db_paged = false;
+        db_paged_path.clear();
+        db_save_pending = false;
+        db_last_write_valid = false;
+        db_dirty = false;
+        db_secret_cipher.reset();
+        db_key_cache->clear();
+
+        // the secrets of the session are wiped on release, the locked pages are returned once all are gone
+        SecureMemory::trim();
+    }
+}
+
+namespace {
+    // the image (or the compressed image) which is encrypted, a progressive image appends it to the prefix
+    static Internal::ContainerPayload imagePayload(SecureBuffer &prefix, const SecureBuffer &compressed,
+                                                   const unsigned char *&data, std::size_t &size)
+    {
+        if (!compressed.empty())
+        {
+            data = compressed.data();
+            size = compressed.size();
+        }
+        if (prefix.empty())
+        {
+            return compressed.empty() ? Internal::ContainerPayload::Image : Internal::ContainerPayload::CompressedImage;
+        }
+
+        prefix.insert(prefix.end(), data, data + size);
+        data = prefix.data();
+        size = prefix.size();
+        return compressed.empty() ? Internal::ContainerPayload::ProgressiveImage : Internal::ContainerPayload::ProgressiveCompressedImage;
+    }
+
+    // the database password is the base-64 SHA-256 of the password
+    static void hashPassword(const std::string &password, SecureString &out)
+    {
+        // don't use smart pointers here, already managed/deleted by crypto++ itself
+        CryptoPP::SHA256 hash;
+        CryptoPP::StringSource src(password, true,
+            new CryptoPP::HashFilter(hash,
+                new CryptoPP::Base64Encoder(
+                    new CryptoPP::StringSinkTemplate<SecureString>(out))));
     }
 }
 
 bool TokenDatabase::setPassword(const std::string &password)
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     if (password.empty())
         return false;
 
-    // remove old password
-    TokenDatabase::databasePassword.clear();
-
-    // don't use smart pointers here, already managed/deleted by crypto++ itself
-    CryptoPP::SHA256 hash;
-    CryptoPP::StringSource src(password, true,
-        new CryptoPP::HashFilter(hash,
-            new CryptoPP::Base64Encoder(
-                new CryptoPP::StringSink(TokenDatabase::databasePassword))));
-
+    SecureString hash;
+    hashPassword(password, hash);
+    setPasswordHash(hash);
     return true;
 }
 
-bool TokenDatabase::setTokenDatabase(const std::string &file)
+void TokenDatabase::setPasswordHash(const SecureString &password)
 {
-    if (file.empty())
+    // deferred saves still belong to the old password
+    (void) flushTokens();
+
+    // the secrets of the open database keep the key of the old password until it is written with the new one
+    if (db_status)
     {
-        return false;
+        (void) secretCipher();
     }
 
-    databasePath = file;
-    return true;
-}
+    // remove old password and its key, the keys of other vaults are kept
+    Internal::clearContainerKey(TokenDatabase::databasePassword);
+    TokenDatabase::databasePassword = password;
 
-TokenDatabase::Error TokenDatabase::changePassword(const std::string &newPassword)
-{
-    Error status = Success;
+    // databases opened from now on use the new password, open databases keep their key
+    Internal::setEncryptedVfsPassword(TokenDatabase::databasePassword);
+}
 
-    if (newPassword.empty())
+namespace {
+    // session key layout (base-64 encoded):
+    //
+    //  -> version:  1 byte
+    //  -> iv:       SESSION_KEY_IV_SIZE random bytes
+    //  -> payload:  encrypted with AES-256-GCM under the wrapping key
+    //  -> tag:      GCM tag of the payload, 16 bytes
+    //
+    // payload layout:
+    //
+    //  -> expiry:   milliseconds since the epoch (u64 LE)
+    //  -> binding:  kdf parameters and salt of the file, see Internal::containerKeyBinding()
+    //  -> password: length (1 byte) and the hashed password
+    //  -> key:      length (1 byte) and the stretched key, empty without scrypt
+    static const constexpr unsigned char SESSION_KEY_VERSION = 2;
+    static const constexpr std::size_t SESSION_KEY_IV_SIZE = 12;
+    static const constexpr std::size_t SESSION_KEY_TAG_SIZE = 16;
+
+    // page encrypted files derive their key from the hashed password and the salt of the file
+    static bool fileKeyBinding(const std::string &path, unsigned char *binding)
     {
-        return PasswordEmpty;
+        if (Internal::isEncryptedPageFile(path))
+        {
+            std::memset(binding, 0, Internal::CONTAINER_KEY_BINDING_SIZE);
+            return Internal::encryptedPageFileSalt(path,
+                binding + Internal::CONTAINER_KEY_BINDING_SIZE - Internal::ENCRYPTED_PAGE_SALT_SIZE);
+        }
+
+        unsigned char header[Internal::CONTAINER_HEADER_SIZE];
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        return file && Internal::containerKeyBinding(header, sizeof(header), binding);
     }
 
-    auto pwdStatus = setPassword(newPassword);
-    if (!pwdStatus)
+    static std::string_view bytes(const SecureBuffer &buffer)
     {
-        return PasswordHashFailure;
+        return std::string_view(reinterpret_cast<const char*>(buffer.data()), buffer.size());
     }
 
-    status = saveTokens();
-    return status;
-}
-
-namespace {
-    // sanitize SQL query and return it as a managed std::string, C pointer from sqlite3_mprintf() is deleted
-    template<class... Args>
-    static inline const std::string sanitizeQuery(const std::string &_template, Args&&... args)
+    static std::uint64_t epochMilliseconds()
     {
-        auto statement = sqlite3_mprintf(_template.c_str(), std::forward<Args>(args)...);
-        std::string query(statement);
-        sqlite3_free(statement);
-        return query;
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
     }
 }
 
-TokenDatabase::Error TokenDatabase::executeGenericTokenStatement(const std::string &statement, const OTPToken &token)
+SecureBuffer TokenDatabase::sessionWrappingKey()
 {
-    // BLOB == std::vector<T> in this C++ SQL library
-    // requires exactly 8 '?' placeholders
-    try {
-        (*db) << statement
-              << token.type()
-              << token.label()
-              << token.icon() // already a std::vector<>
-              << mangleTokenSecret(token.secret())
-              << std::vector<OTPToken::DigitType>{token.digitLength()}
-              << std::vector<OTPToken::PeriodType>{token.period()}
-              << std::vector<OTPToken::CounterType>{token.counter()}
-              << token.algorithm();
-    } catch (sqlite::sqlite_exception &e) {
-        if (e.get_code() == SQLITE_CONSTRAINT)
-        {
-            return SqlConstraintViolation;
-        }
-        else
-        {
-            return SqlExecutionFailed;
-        }
-    }
-
-    return Success;
+    SecureBuffer key(SessionWrappingKeySize);
+    Internal::randomBytes(key.data(), key.size());
+    return key;
 }
 
-const OTPToken TokenDatabase::selectToken(const OTPToken::sqliteTokenID &id)
+TokenDatabase::Error TokenDatabase::sessionKey(const std::chrono::seconds &lifetime, const SecureBuffer &wrappingKey,
+                                               SecureString &out)
 {
-    if (!db_status)
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    out.clear();
+    if (databasePassword.empty())
     {
-        return {};
+        return PasswordEmpty;
     }
-
-    const auto statement = sanitizeQuery("select * from %Q where id = %u limit 1;", "tokens", id);
-
-    OTPToken token;
-
-    // BLOB == std::vector<T> in this C++ SQL library
-    std::vector<OTPToken::DigitType> digits;
-    std::vector<OTPToken::PeriodType> period;
-    std::vector<OTPToken::CounterType> counter;
-
-    try {
-        (*db) << statement
-              >> [&](const OTPToken::sqliteLongID &id,
-                     const OTPToken::TokenType &type,
-                     const OTPToken::Label &label,
-                     const OTPToken::Icon &icon,
-                     const OTPToken::TokenSecret &secret,
-                     const std::vector<OTPToken::DigitType> &digits,
-                     const std::vector<OTPToken::PeriodType> &period,
-                     const std::vector<OTPToken::CounterType> &counter,
-                     const OTPToken::ShaAlgorithm &algorithm)
-        {
-            token._id = id;
-            token.setType(type);
-            token.setLabel(label);
-            token.setIcon(icon);
-            token.setSecret(unmangleTokenSecret(secret));
-            token.setDigitLength(digits.empty() ? 0U : digits.at(0));
-            token.setPeriod(period.empty() ? 0U : period.at(0));
-            token.setCounter(counter.empty() ? 0U : counter.at(0));
-            token.setAlgorithm(algorithm);
-        };
-    } catch (sqlite::sqlite_exception &) {
-        return {};
+    if (databasePassword.size() > 0xff)
+    {
+        return PasswordHashFailure;
     }
-
-    return token;
-}
-
-const OTPToken TokenDatabase::selectToken(const OTPToken::Label &label)
-{
-    if (!db_status)
+    if (wrappingKey.size() != SessionWrappingKeySize)
     {
-        return {};
+        return EncryptionFailure;
     }
 
-    // get token which matches the label absolute
-    auto results = selectTokens(escapeStringLIKE(label));
-
-    if (results.empty())
+    // the salt is only in the file once it was written
+    (void) flushTokens();
+    unsigned char binding[Internal::CONTAINER_KEY_BINDING_SIZE];
+    if (!std::filesystem::exists(databasePath))
     {
-        return {};
+        return FileReadFailure;
     }
-
-    return results.at(0);
-}
-
-const TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::sqliteTypesID &type)
-{
-    if (!db_status)
+    if (!fileKeyBinding(databasePath, binding))
     {
-        return {};
+        return SessionKeyInvalid;
     }
-
-    // prepare query
-    auto statement = sanitizeQuery("select id from %Q ", "tokens");
-    std::string order_by_query;
-    auto ret = displayOrderQuery(order_by_query);
-
-    if (type != OTPToken::None)
+    SecureBuffer key;
+    if (!Internal::exportContainerKey(databasePassword, binding, key))
     {
-        statement += sanitizeQuery("where type = %u ", type);
+        return EncryptionFailure;
     }
 
-    if (ret)
+    const auto expiry = epochMilliseconds() + static_cast<std::uint64_t>(std::max<std::int64_t>(0,
+        std::chrono::duration_cast<std::chrono::milliseconds>(lifetime).count()));
+    SecureBuffer payload;
+    for (auto i = 0U; i < 8U; ++i)
     {
-        statement += order_by_query;
+        payload.push_back(static_cast<unsigned char>((expiry >> (8U * i)) & 0xff));
     }
-    else
+    payload.insert(payload.end(), binding, binding + sizeof(binding));
+    payload.push_back(static_cast<unsigned char>(databasePassword.size()));
+    payload.insert(payload.end(), databasePassword.begin(), databasePassword.end());
+    payload.push_back(static_cast<unsigned char>(key.size()));
+    payload.insert(payload.end(), key.begin(), key.end());
+
+    SecureBuffer iv(SESSION_KEY_IV_SIZE);
+    Internal::randomBytes(iv.data(), iv.size());
+    std::string ciphertext, tag;
+    if (!Internal::gcmEncrypt(bytes(wrappingKey), bytes(iv), bytes(payload), ciphertext, tag))
     {
-        statement += "order by id asc;";
+        return EncryptionFailure;
     }
 
-    std::vector<OTPToken::sqliteLongID> ids;
-
-    // fetch all ids
-    try {
-        (*db) << statement
-              >> [&](const OTPToken::sqliteLongID &id)
-        {
-            ids.emplace_back(id);
-        };
-    } catch (sqlite::sqlite_exception &) {
-        return {};
-    }
+    SecureBuffer data;
+    data.push_back(SESSION_KEY_VERSION);
+    data.insert(data.end(), iv.begin(), iv.end());
+    data.insert(data.end(), ciphertext.begin(), ciphertext.end());
+    data.insert(data.end(), tag.begin(), tag.end());
+    out.resize(Codec::base64EncodedSize(data.size()));
+    out.resize(Codec::base64Encode(data.data(), data.size(), &out[0]));
+    return Success;
+}
 
-    // fetch all tokens
-    OTPTokenList tokens;
+TokenDatabase::Error TokenDatabase::unlockWithSessionKey(const SecureString &sessionKey, const SecureBuffer &wrappingKey)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
 
-    for (auto&& id : ids)
+    SecureBuffer data(Codec::base64DecodedSize(sessionKey.size()));
+    data.resize(Codec::base64Decode(sessionKey.data(), sessionKey.size(), data.data()));
+    if (data.size() < 1U + SESSION_KEY_IV_SIZE + SESSION_KEY_TAG_SIZE || data[0] != SESSION_KEY_VERSION ||
+        wrappingKey.size() != SessionWrappingKeySize)
     {
-        tokens.emplace_back(selectToken(id));
+        return SessionKeyInvalid;
     }
 
-    return tokens;
-}
-
-const TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::Label &label_like)
-{
-    if (!db_status)
+    // nothing in the session key is looked at before it authenticated under the wrapping key
+    const std::string_view sealed(reinterpret_cast<const char*>(data.data()) + 1U, data.size() - 1U);
+    SecureString payload;
+    if (!Internal::gcmDecrypt(bytes(wrappingKey), sealed.substr(0U, SESSION_KEY_IV_SIZE),
+                              sealed.substr(SESSION_KEY_IV_SIZE, sealed.size() - SESSION_KEY_IV_SIZE - SESSION_KEY_TAG_SIZE),
+                              sealed.substr(sealed.size() - SESSION_KEY_TAG_SIZE), payload))
     {
-        return {};
+        return SessionKeyInvalid;
     }
 
-    // prepare query
-    auto statement = sanitizeQuery("select * from %Q where label like %Q escape '\\' ", "tokens", label_like.c_str());
-    std::string order_by_query;
-    auto ret = displayOrderQuery(order_by_query);
-
-    if (ret)
+    // expiry, binding and the lengths of the password and the key come first
+    static const constexpr std::size_t fixed = 8U + Internal::CONTAINER_KEY_BINDING_SIZE + 2U;
+    const auto fields = reinterpret_cast<const unsigned char*>(payload.data());
+    if (payload.size() < fixed)
     {
-        statement += order_by_query;
+        return SessionKeyInvalid;
     }
-    else
+    const auto binding = fields + 8;
+    const std::size_t passwordSize = binding[Internal::CONTAINER_KEY_BINDING_SIZE];
+    const auto password = binding + Internal::CONTAINER_KEY_BINDING_SIZE + 1;
+    if (passwordSize == 0 || payload.size() < fixed + passwordSize)
     {
-        statement += "order by id asc;";
+        return SessionKeyInvalid;
     }
-
-    OTPTokenList tokens;
-
-    // BLOB == std::vector<T> in this C++ SQL library
-    std::vector<OTPToken::DigitType> digits;
-    std::vector<OTPToken::PeriodType> period;
-    std::vector<OTPToken::CounterType> counter;
-
-    try {
-        (*db) << statement
-              >> [&](const OTPToken::sqliteLongID &id,
-                     const OTPToken::TokenType &type,
-                     const OTPToken::Label &label,
-                     const OTPToken::Icon &icon,
-                     const OTPToken::TokenSecret &secret,
-                     const std::vector<OTPToken::DigitType> &digits,
-                     const std::vector<OTPToken::PeriodType> &period,
-                     const std::vector<OTPToken::CounterType> &counter,
-                     const OTPToken::ShaAlgorithm &algorithm)
-        {
-            OTPToken token;
-            token._id = id;
-            token.setType(type);
-            token.setLabel(label);
-            token.setIcon(icon);
-            token.setSecret(unmangleTokenSecret(secret));
-            token.setDigitLength(digits.empty() ? 0U : digits.at(0));
-            token.setPeriod(period.empty() ? 0U : period.at(0));
-            token.setCounter(counter.empty() ? 0U : counter.at(0));
-            token.setAlgorithm(algorithm);
-            tokens.emplace_back(token);
-        };
-    } catch (sqlite::sqlite_exception &) {
-        return {};
+    const std::size_t keySize = password[passwordSize];
+    if (payload.size() != fixed + passwordSize + keySize)
+    {
+        return SessionKeyInvalid;
     }
 
-    return tokens;
-}
-
-TokenDatabase::Error TokenDatabase::insertToken(const OTPToken &token)
-{
-    if (!db_status)
+    std::uint64_t expiry = 0;
+    for (auto i = 8U; i > 0U; --i)
     {
-        return SqlDatabaseNotOpen;
+        expiry = (expiry << 8U) | fields[i - 1U];
     }
-
-    // prepare insert query
-    const auto statement = genInsertQuery("tokens",
-        {"type", "label", "icon", "secret", "digits", "period", "counter", "algorithm"});
-
-    auto status = executeGenericTokenStatement(statement, token);
-    if (status != Success)
+    if (epochMilliseconds() >= expiry)
     {
-        return status;
+        return SessionKeyExpired;
     }
 
-    // append last insert id to display order
-    DisplayOrder order;
-    status = getDisplayOrder(order);
-    if (status != Success)
+    // a rewritten file has another salt and a key of another password
+    unsigned char current[Internal::CONTAINER_KEY_BINDING_SIZE];
+    if (!fileKeyBinding(databasePath, current) || std::memcmp(current, binding, sizeof(current)) != 0)
     {
-        return status;
+        return SessionKeyInvalid;
     }
-    order.emplace_back(db->last_insert_rowid());
-    status = updateDisplayOrder(order);
-    if (status != Success)
+
+    const SecureString hash(reinterpret_cast<const char*>(password), passwordSize);
+    const SecureBuffer key(password + passwordSize + 1, password + passwordSize + 1 + keySize);
+    if (!Internal::importContainerKey(hash, binding, key))
     {
-        return status;
+        return SessionKeyInvalid;
     }
 
+    // the keys of the old password are dropped, which may be the same password
+    setPasswordHash(hash);
+    (void) Internal::importContainerKey(databasePassword, binding, key);
     return Success;
 }
 
-TokenDatabase::Error TokenDatabase::updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token)
+bool TokenDatabase::setTokenDatabase(const std::string &file)
 {
-    if (!db_status)
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (file.empty())
     {
-        return SqlDatabaseNotOpen;
+        return false;
     }
 
-    // prepare update query
-    const auto statement = genUpdateQuery("tokens",
-        {"type", "label", "icon", "secret", "digits", "period", "counter", "algorithm"},
-        sanitizeQuery("id = %u", id));
+    // deferred saves still belong to the old file
+    (void) flushTokens();
 
-    return executeGenericTokenStatement(statement, token);
+    databasePath = file;
+    return true;
 }
 
-TokenDatabase::Error TokenDatabase::renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label)
+void TokenDatabase::setStorageFormat(const StorageFormat &format)
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    auto token = selectToken(id);
-    if (token.id() == 0)
-    {
-        return SqlEmptyResults;
-    }
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    databaseFormat = format;
+}
 
-    token.setLabel(label);
+TokenDatabase::StorageFormat TokenDatabase::storageFormat()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return databaseFormat;
+}
 
-    return updateToken(id, token);
+void TokenDatabase::setCompression(const Compression &compression)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    databaseCompression = compression;
 }
 
-TokenDatabase::Error TokenDatabase::deleteToken(const OTPToken::sqliteTokenID &id)
+TokenDatabase::Compression TokenDatabase::compression()
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return databaseCompression;
+}
 
-    const auto statement = sanitizeQuery("delete from %Q where id = %u;", "tokens", id);
+void TokenDatabase::setProgressiveOpen(bool enabled)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    databaseProgressive = enabled;
+}
 
-    try {
-        (*db) << statement;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlExecutionFailed;
-    }
+bool TokenDatabase::progressiveOpen()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return databaseProgressive;
+}
 
-    // update display order, remove deleted id
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-    std::remove_if(order.begin(), order.end(), [&](const OTPToken::sqliteSortOrder &lid) {
-        return lid == id;
-    });
-    status = updateDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
+void TokenDatabase::setCompactionThreshold(double threshold)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    databaseCompaction = std::min(std::max(threshold, 0.0), 1.0);
+}
 
-    return Success;
+double TokenDatabase::compactionThreshold()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return databaseCompaction;
 }
 
-OTPToken::sqliteTokenID TokenDatabase::tokenCount(const OTPToken::sqliteTypesID &type)
+bool TokenDatabase::setPageSize(std::uint32_t pageSize)
 {
-    if (!db_status)
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (pageSize != 0 && (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0))
     {
-        return SqlDatabaseNotOpen;
+        return false;
     }
 
-    std::string statement;
+    databasePageSize = pageSize;
+    return true;
+}
 
-    if (type == OTPToken::None)
-    {
-        statement = sanitizeQuery("select count(*) from %Q;", "tokens");
-    }
-    else
-    {
-        statement = sanitizeQuery("select count(*) from %Q where type = %u;", "tokens", type);
-    }
+std::uint32_t TokenDatabase::pageSize()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return databasePageSize;
+}
 
-    OTPToken::sqliteTokenID count = 0;
+void TokenDatabase::setDurability(const Durability &durability, const std::chrono::milliseconds &window)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    databaseDurability = durability;
+    groupCommitWindow = window;
+}
 
-    try {
-        (*db) << statement >> count;
-    } catch (sqlite::sqlite_exception &) {
-        return -1;
-    }
+TokenDatabase::Durability TokenDatabase::durability()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return databaseDurability;
+}
 
-    return count;
+void TokenDatabase::setAutoSave(const std::chrono::milliseconds &delay)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    autoSaveDelay = delay;
 }
 
-TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken &token1, const OTPToken &token2)
+std::chrono::milliseconds TokenDatabase::autoSave()
 {
-    return swapTokens(token1.label(), token2.label());
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return autoSaveDelay;
 }
 
-TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken::Label &label1, const OTPToken::Label &label2)
+bool TokenDatabase::hasUnsavedChanges()
 {
-    auto tokenId1 = selectToken(label1).id();
-    if (tokenId1 == 0)
-    {
-        return SqlEmptyResults;
-    }
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return db_status && db_dirty;
+}
 
-    auto tokenId2 = selectToken(label2).id();
-    if (tokenId2 == 0)
-    {
-        return SqlEmptyResults;
-    }
+void TokenDatabase::setKeyDerivation(const KeyDerivation &kdf, unsigned char cost)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    Internal::ContainerKdf containerKdf;
+    containerKdf.algorithm = kdf == Scrypt ? Internal::ContainerKdf::Scrypt : Internal::ContainerKdf::Hash;
+    containerKdf.cost = cost;
+    Internal::setContainerKdf(containerKdf);
+}
 
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
+TokenDatabase::KeyDerivation TokenDatabase::keyDerivation()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return Internal::containerKdf().algorithm == Internal::ContainerKdf::Scrypt ? Scrypt : PasswordHash;
+}
 
-    if (!contains(order, tokenId1) || !contains(order, tokenId2))
-    {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
-    }
+void TokenDatabase::setExecutor(Executor *executor)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    db_executor = executor;
+}
 
-    unsigned long pos1 = static_cast<unsigned long>(positionOf(order, tokenId1));
-    unsigned long pos2 = static_cast<unsigned long>(positionOf(order, tokenId2));
+void TokenDatabase::setKeyCacheBudget(std::size_t budget)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    db_key_cache = std::make_shared<PreparedKeyCache>(budget);
+}
 
-    std::swap(order[pos1], order[pos2]);
+std::size_t TokenDatabase::keyCacheBudget()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return db_key_cache->budget();
+}
 
-    return updateDisplayOrder(order);
+std::shared_ptr<PreparedKeyCache> TokenDatabase::preparedKeys()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return db_key_cache;
 }
 
-TokenDatabase::Error TokenDatabase::moveToken(const OTPToken &token, const std::size_t &newPos)
+void TokenDatabase::setTuning(const StorageFormat &format, const Tuning &tuning)
 {
-    return moveToken(token.label(), newPos);
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    (format == EncryptedPages ? pagesTuning : imageTuning) = tuning;
 }
 
-TokenDatabase::Error TokenDatabase::moveToken(const OTPToken::Label &token, const std::size_t &newPos)
+TokenDatabase::Tuning TokenDatabase::tuning(const StorageFormat &format)
 {
-    auto tokenId = selectToken(token).id();
-    if (tokenId == 0)
-    {
-        return SqlEmptyResults;
-    }
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return format == EncryptedPages ? pagesTuning : imageTuning;
+}
 
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
+TokenDatabase::Tuning TokenDatabase::defaultTuning(const StorageFormat &format)
+{
+    Tuning tuning;
+    if (format == EncryptedPages)
     {
-        return status;
+        // decrypted pages are kept in a bounded cache, everything else is read on demand,
+        // the journal is truncated instead of deleted after every commit
+        tuning.cacheSizeKb = 2048U;
+        tuning.journalMode = JournalTruncate;
+        tuning.synchronous = SyncFull;
     }
-
-    if (!contains(order, tokenId))
+    else
     {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
+        // all pages are in memory already, the cache only holds the pages in use
+        tuning.cacheSizeKb = 2048U;
+        tuning.journalMode = JournalMemory;
+        tuning.synchronous = SyncOff;
     }
-
-    long oldPos = static_cast<long>(positionOf(order, tokenId));
-
-    // rebuild list, splits up the list and puts it back again in a different order
-    moveRange(static_cast<std::size_t>(std::distance(order.begin(), order.begin() + oldPos)), 1, newPos, order);
-
-    return updateDisplayOrder(order);
+    return tuning;
 }
 
-TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken &token, const OTPToken &below)
+void TokenDatabase::markDirty()
 {
-    return moveTokenBelow(token.label(), below.label());
-}
+    db_dirty = true;
+    invalidateReaders();
 
-TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken::Label &token, const OTPToken::Label &below)
-{
-    auto tokenId1 = selectToken(token).id();
-    if (tokenId1 == 0)
+    // the save is written by the scheduler or on close
+    if (autoSaveDelay.count() > 0)
     {
-        return SqlEmptyResults;
+        db_save_pending = true;
+        db_scheduler.schedule(std::chrono::steady_clock::now() + autoSaveDelay);
     }
+}
 
-    auto tokenId2 = selectToken(below).id();
-    if (tokenId2 == 0)
-    {
-        return SqlEmptyResults;
-    }
+TokenDatabase::Error TokenDatabase::changePassword(const std::string &newPassword)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    Error status = Success;
 
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
+    if (newPassword.empty())
     {
-        return status;
+        return PasswordEmpty;
     }
 
-    if (!contains(order, tokenId1) || !contains(order, tokenId2))
+    auto pwdStatus = setPassword(newPassword);
+    if (!pwdStatus)
     {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
+        return PasswordHashFailure;
     }
 
-    long pos1 = static_cast<long>(positionOf(order, tokenId1));
-    long pos2 = static_cast<long>(positionOf(order, tokenId2));
-
-    // rebuild list, splits up the list and puts it back again in a different order
-    moveRange(std::distance(order.begin(), order.begin() + pos1), 1, std::distance(order.begin(), order.begin() + pos2) + 1, order);
-
-    return updateDisplayOrder(order);
-}
-
-TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken &token, const OTPToken &above)
-{
-    return moveTokenAbove(token.label(), above.label());
-}
-
-TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken::Label &token, const OTPToken::Label &above)
-{
-    auto tokenId1 = selectToken(token).id();
-    if (tokenId1 == 0)
+    // the pages of the open file are encrypted with the key of the old password
+    if (db_paged)
     {
-        return SqlEmptyResults;
+        status = removeUnusedIcons();
+        if (status != Success)
+        {
+            return status;
+        }
+        return rewritePagedDatabase();
     }
 
-    auto tokenId2 = selectToken(above).id();
-    if (tokenId2 == 0)
-    {
-        return SqlEmptyResults;
-    }
+    status = writeTokens();
+    return status;
+}
 
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
+void TokenDatabase::changePasswordAsync(const std::string &newPassword, const StatusCallback &callback,
+                                        const ProgressCallback &progress, const std::atomic<bool> *cancel)
+{
+    SecureString password;
+    if (!newPassword.empty())
     {
-        return status;
+        hashPassword(newPassword, password);
     }
 
-    if (!contains(order, tokenId1) || !contains(order, tokenId2))
-    {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
-    }
+    AsyncFileIO::instance().run([newPassword, password, callback, progress, cancel]{
+        const auto finish = [&](const Error &status) {
+            if (callback)
+            {
+                callback(status);
+            }
+        };
 
-    long pos1 = static_cast<long>(positionOf(order, tokenId1));
-    long pos2 = static_cast<long>(positionOf(order, tokenId2));
+        if (password.empty())
+        {
+            finish(PasswordEmpty);
+            return;
+        }
 
-    // rebuild list, splits up the list and puts it back again in a different order
-    moveRange(std::distance(order.begin(), order.begin() + pos1), 1, std::distance(order.begin(), order.begin() + pos2), order);
+        // the pages of page encrypted files are re-encrypted while the file is copied
+        auto paged = false;
+        {
+            std::lock_guard<std::recursive_mutex> lock(db_mutex);
+            paged = db_paged || databaseFormat == EncryptedPages;
+        }
+        if (paged)
+        {
+            finish(changePassword(newPassword));
+            return;
+        }
 
-    return updateDisplayOrder(order);
-}
+        // changes while a pass runs are rare, a database which keeps changing is re-keyed while it is held
+        static const constexpr auto attempts = 3;
+        for (auto attempt = 0; attempt < attempts; ++attempt)
+        {
+            auto changed = false;
+            const auto status = rekeyImageCopy(password, progress, cancel, changed);
+            if (status != Success || !changed)
+            {
+                finish(status);
+                return;
+            }
+        }
 
-const std::string TokenDatabase::selectTokenTypeName(const OTPToken::sqliteTypesID &id)
-{
-    return selectStaticValue("types", id);
+        if (cancel && cancel->load())
+        {
+            finish(OperationCancelled);
+            return;
+        }
+        finish(changePassword(newPassword));
+    });
 }
 
-const std::string TokenDatabase::selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id)
+TokenDatabase::Error TokenDatabase::rekeyImageCopy(const SecureString &password, const ProgressCallback &progress,
+                                                   const std::atomic<bool> *cancel, bool &changed)
 {
-    return selectStaticValue("algorithms", id);
-}
+    changed = false;
+    const auto cancelled = [&] {
+        return cancel && cancel->load();
+    };
 
-TokenDatabase::Error TokenDatabase::bootstrapDatabase()
-{
-    if (!db_status)
+    // the copy is taken while the database is held, like a save
+    std::shared_ptr<sqlite::database> copy;
+    std::shared_ptr<const Internal::SecretCipher> from;
+    const sqlite::database *original = nullptr;
+    std::uint64_t generation = 0;
+    std::string path;
+    auto compression = Uncompressed;
+    SecureBuffer prefix;
     {
-        return SqlDatabaseNotOpen;
-    }
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (!db_status)
+        {
+            return SqlDatabaseNotOpen;
+        }
+        if (cancelled())
+        {
+            return OperationCancelled;
+        }
 
-    // create tables to store types and algorithms
-    for (auto&& table : {"types", "algorithms"})
-    {
-        auto res = createTable(table, {
-            {"id",   "int(1) PRIMARY KEY NOT NULL"},
-            {"name", "text UNIQUE"},
-        });
-        if (res != Success)
+        if (db_paged || databaseFormat == EncryptedPages)
         {
-            return res;
+            changed = true;
+            return Success;
+        }
+
+        auto status = flushTokens();
+        if (status == Success)
+        {
+            status = removeUnusedIcons();
+        }
+        if (status == Success)
+        {
+            status = compactDatabase();
+        }
+        if (status != Success)
+        {
+            return status;
+        }
+
+        sqlite3_int64 size = 0;
+        auto data = sqlite3_serialize(db->connection().get(), "main", &size, 0);
+        if (!data)
+        {
+            return SqlSerializationError;
+        }
+        try {
+            copy = std::make_shared<sqlite::database>(":memory:");
+            applyTuning(*copy, imageTuning);
+        } catch (sqlite::sqlite_exception &) {
+            sqlite3_free(data);
+            return SqlMemoryAllocationError;
+        }
+        if (sqlite3_deserialize(copy->connection().get(), "main", data, size, size,
+                                SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE) != SQLITE_OK)
+        {
+            return SqlDeserializationError;
+        }
+
+        if (databaseProgressive)
+        {
+            status = progressivePrefix(prefix);
+            if (status != Success)
+            {
+                return status;
+            }
         }
+
+        from = secretCipher();
+        original = db.get();
+        generation = db_generation.load();
+        path = databasePath;
+        compression = databaseCompression;
     }
 
-    // insert static types
-    auto res = insertStaticValues("types", {
-        {OTPToken::TOTP,  "TOTP"},
-        {OTPToken::HOTP,  "HOTP"},
-        {OTPToken::Steam, "Steam"},
-    });
-    if (res != Success)
+    // the secrets of the copy get the key of the new password, then it is encrypted with it
+    const auto to = std::make_shared<const Internal::SecretCipher>(password);
+    auto status = rekeySecrets(*copy, *from, *to);
+    if (status != Success)
     {
-        return res;
+        return status;
     }
 
-    // insert static algorithms
-    res = insertStaticValues("algorithms", {
-        {OTPToken::SHA1,   "SHA1"},
-        {OTPToken::SHA256, "SHA256"},
-        {OTPToken::SHA512, "SHA512"},
-    });
-    if (res != Success)
+    std::string encrypted;
     {
-        return res;
+        sqlite3_int64 length = 0;
+        const auto image = sqlite3_serialize(copy->connection().get(), "main", &length, SQLITE_SERIALIZE_NOCOPY);
+        if (!image)
+        {
+            return SqlSerializationError;
+        }
+        const auto size = static_cast<std::size_t>(length);
+
+        Internal::ContainerProgress chunks;
+        chunks.report = progress;
+        chunks.cancel = cancel;
+
+        SecureBuffer compressed;
+        if (compression == Zlib && !Internal::compressImage(image, size, compressed, imageExecutor(size)))
+        {
+            return EncryptionFailure;
+        }
+        const unsigned char *data = image;
+        auto dataSize = size;
+        const auto payload = imagePayload(prefix, compressed, data, dataSize);
+        status = encrypt(password, data, dataSize, encrypted, payload, &chunks);
+        if (status != Success)
+        {
+            return status;
+        }
     }
 
-    // create config table
-    res = createTable("config", {
-        {"id",   "text PRIMARY KEY NOT NULL"},
-        {"data", "blob"},
-    });
-    if (res != Success)
+    // written next to the file, it only replaces the file if nothing changed meanwhile
+    Internal::AtomicFile file;
+    if (cancelled())
     {
-        return res;
+        return OperationCancelled;
     }
-
-    // store database version into config
-    res = storeDatabaseVersion();
-    if (res != Success)
+    if (!file.open(path) || !file.write(encrypted.data(), encrypted.size()))
     {
-        return res;
+        return FileWriteFailure;
     }
+    encrypted.clear();
 
-    // create record to store the sort order (display order)
-    res = storeDisplayOrder({});
-    if (res != Success)
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (cancelled())
     {
-        return res;
+        return OperationCancelled;
     }
-
-    // create table to store the tokens
-    res = createTable("tokens", {
-        {"id",        "INTEGER PRIMARY KEY NOT NULL"},
-        {"type",      "int(1) NOT NULL"},
-        {"label",     "text NOT NULL UNIQUE COLLATE NOCASE"},
-        {"icon",      "blob"},
-        {"secret",    "text NOT NULL"},
-        {"digits",    "blob"},
-        {"period",    "blob"},
-        {"counter",   "blob"},
-        {"algorithm", "int(1) NOT NULL"},
-    },
-        "FOREIGN KEY(type) REFERENCES types(id), "
-        "FOREIGN KEY(algorithm) REFERENCES algorithms(id)");
-    if (res != Success)
+    if (!db_status || db.get() != original || db_generation.load() != generation || databasePath != path)
     {
-        return res;
+        changed = true;
+        return Success;
+    }
+    if (!file.commit())
+    {
+        return FileWriteFailure;
     }
 
+    // the copy holds the same tokens, the caches stay valid
+    Internal::clearContainerKey(databasePassword);
+    databasePassword = password;
+    Internal::setEncryptedVfsPassword(databasePassword);
+    db_statements.clear();
+    db_raw_statements.clear();
+    db = copy;
+    db_secret_cipher = to;
+    invalidateReaders();
+
+    db_save_pending = false;
+    db_last_write = std::chrono::steady_clock::now();
+    db_last_write_valid = true;
+    db_dirty = false;
+    recordFileStamp(path);
+    resetCounterJournal();
+    (void) Internal::persistWebFile(path);
     return Success;
 }
 
-TokenDatabase::Error TokenDatabase::createTable(const std::string &table_name, const std::vector<SchemaField> &schema, const std::string &additional)
-{
-    if (!db_status)
+namespace {
+    // sanitize SQL query and return it as a managed std::string, C pointer from sqlite3_mprintf() is deleted
+    template<class... Args>
+    static inline const std::string sanitizeQuery(const std::string &_template, Args&&... args)
     {
-        return SqlDatabaseNotOpen;
+        auto statement = sqlite3_mprintf(_template.c_str(), std::forward<Args>(args)...);
+        std::string query(statement);
+        sqlite3_free(statement);
+        return query;
     }
 
-    // sanitize table name
-    auto query = sanitizeQuery("create table %Q ", table_name.c_str());
-
-    // prepare schema
-    query += "(";
-    for (auto&& s : schema)
+    // run the function with the cached prepared statement of the SQL text, the statement
+    // is prepared on first use and parameters must be bound on every use
+    // the statement is taken out of the cache while in use so nested queries of the same
+    // text get their own statement, statements which failed are finalized instead of reused
+    // the function must execute the statement explicitly (execute() or operator>>)
+    template<typename Function>
+    static void cachedStatement(sqlite::database &connection, StatementMap &statements,
+                                const std::string &sql, Function &&function)
     {
-        query += sanitizeQuery("%Q %s, ", s.name.c_str(), s.datatype.c_str());
-    }
-    query.erase(query.find_last_of(','));
+        std::unique_ptr<sqlite::database_binder> statement;
+
+#ifdef OTPGEN_WITH_PERF_STATS
+        // readers run without the database mutex, only the statements of the database are timed
+        const auto timed = &statements == &db_statements;
+        const auto start = std::chrono::steady_clock::now();
+        const auto recordTiming = [&] {
+            if (!timed)
+            {
+                return;
+            }
+            const auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+            auto &stats = db_statement_stats[sql];
+            ++stats.count;
+            stats.totalNs += ns;
+            stats.maxNs = std::max(stats.maxNs, ns);
+        };
+#endif
 
-    // add additional content to query
-    if (!additional.empty())
-    {
-        query += ", " + additional;
-    }
+        auto it = statements.find(sql);
+        if (it != statements.end())
+        {
+            OTPGEN_PERF_COUNT(StatementCacheHits, 1U);
+            statement = std::move(it->second);
+            statements.erase(it);
+        }
+        else
+        {
+            OTPGEN_PERF_COUNT(StatementCacheMisses, 1U);
+            statement = std::make_unique<sqlite::database_binder>(connection << sql);
+        }
 
-    // finalize query
-    query += ");";
+        try {
+            function(*statement);
+        } catch (...) {
+            // prevent the destructor from executing a half bound statement
+            statement->used(true);
+#ifdef OTPGEN_WITH_PERF_STATS
+            recordTiming();
+#endif
+            throw;
+        }
 
-    // execute query
-    try {
-        (*db) << query;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlSystemTableCreationError;
+#ifdef OTPGEN_WITH_PERF_STATS
+        recordTiming();
+#endif
+        statements.emplace(sql, std::move(statement));
     }
 
-    return Success;
-}
-
-TokenDatabase::Error TokenDatabase::insertStaticValues(const std::string &table_name, const std::vector<StaticValueSet> &values)
-{
-    if (!db_status)
+    template<typename Function>
+    static void cachedStatement(const std::string &sql, Function &&function)
     {
-        return SqlDatabaseNotOpen;
+        cachedStatement(*db, db_statements, sql, std::forward<Function>(function));
     }
 
-    // sanitize table name
-    auto query = sanitizeQuery("insert into %Q ", table_name.c_str());
-
-    // prepare values
-    query += "values ";
-    for (auto&& v : values)
+    // run the function with the cached raw statement of the SQL text and return its result code,
+    // misses and constraint violations are results instead of exceptions
+    // the statement is taken out of the cache while in use like in cachedStatement() and reset
+    // afterwards, a failed prepare is returned without calling the function
+    template<typename Function>
+    static int rawStatement(const std::string &sql, Function &&function)
     {
-        query += sanitizeQuery("(%u, %Q), ", v.id, v.value.c_str());
-    }
-    query.erase(query.find_last_of(','));
-
-    // finalize query
-    query += ";";
+        std::unique_ptr<Internal::RawStatement> statement;
+        auto it = db_raw_statements.find(sql);
+        if (it != db_raw_statements.end())
+        {
+            OTPGEN_PERF_COUNT(StatementCacheHits, 1U);
+            statement = std::move(it->second);
+            db_raw_statements.erase(it);
+        }
+        else
+        {
+            OTPGEN_PERF_COUNT(StatementCacheMisses, 1U);
+            statement = std::make_unique<Internal::RawStatement>(db->connection().get(), sql);
+            if (!statement->valid())
+            {
+                return statement->status();
+            }
+        }
 
-    // execute query
-    try {
-        (*db) << query;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlStaticRecordCreationError;
+        const int rc = function(*statement);
+        statement->reset();
+        db_raw_statements.emplace(sql, std::move(statement));
+        return rc;
     }
 
-    return Success;
-}
-
-const std::string TokenDatabase::selectStaticValue(const std::string &table, const OTPToken::sqliteShortID &id)
-{
-    if (!db_status)
+    // oldest token with the secret hash, an index probe, 0 if there is none
+    static TokenDatabase::Error firstTokenWithHash(const std::vector<unsigned char> &hash, OTPToken::sqliteTokenID &id)
     {
-        return {};
+        id = 0;
+        if (hash.empty())
+        {
+            return TokenDatabase::Success;
+        }
+        const auto rc = rawStatement("select id from tokens where secret_hash = ? order by id limit 1;", [&](Internal::RawStatement &query) {
+            const auto rc = query.bind(hash).step();
+            if (rc == SQLITE_ROW)
+            {
+                id = query.int64(0);
+            }
+            return rc;
+        });
+        return rc == SQLITE_ROW || rc == SQLITE_DONE ? TokenDatabase::Success : TokenDatabase::SqlExecutionFailed;
     }
 
-    const auto statement = sanitizeQuery("select name from %Q where id = %i limit 1;", table.c_str(), id);
-
-    std::string name;
+    // changes are grouped in savepoints, which nest into the open transaction of page encrypted databases
+    static void rollbackSavepoint()
+    {
+        try {
+            (*db) << "rollback to token_database;";
+            (*db) << "release token_database;";
+        } catch (sqlite::sqlite_exception &) {}
 
-    try {
-        (*db) << statement >> name;
-    } catch (sqlite::sqlite_exception &) {
+        // the rolled back changes are never published
+        if (db_events.size() > db_event_mark)
+        {
+            db_events.resize(db_event_mark);
+        }
     }
 
-    return name;
-}
-
-const std::string TokenDatabase::genUpdateQuery(const std::string &table, const std::vector<std::string> &fields, const std::string &condition)
-{
-    auto query = sanitizeQuery("update %Q set ", table.c_str());
+    // tokens of one result with the same icon share its buffer, keyed by the hash of the contents
+    using SharedIcons = std::unordered_map<std::size_t, OTPToken::SharedIcon>;
 
-    for (auto&& f : fields)
+    static OTPToken::SharedIcon shareIcon(OTPToken::Icon &&icon, SharedIcons &shared)
     {
-        query += sanitizeQuery("%s=?, ", f.c_str());
+        OTPToken::SharedIcon candidate(std::move(icon));
+        if (candidate.empty())
+        {
+            return candidate;
+        }
+        const auto it = shared.emplace(candidate.hash(), candidate).first;
+        return it->second == candidate ? it->second : candidate;
     }
-    query.erase(query.find_last_of(','));
 
-    if (!condition.empty())
+    // icons are stored once per content in the icons table, tokens.icon holds the
+    // SHA-256 hash of the icon (or an empty BLOB if the token has no icon)
+    static const OTPToken::Icon iconHash(const OTPToken::Icon &icon)
     {
-        query += " where " + condition;
+        OTPToken::Icon hash(CryptoPP::SHA256::DIGESTSIZE);
+        CryptoPP::SHA256().CalculateDigest(hash.data(), icon.data(), icon.size());
+        return hash;
     }
 
-    query += ";";
-
-    return query;
-}
-
-const std::string TokenDatabase::genInsertQuery(const std::string &table, const std::vector<std::string> &fields)
-{
-    auto query = sanitizeQuery("insert into %Q (", table.c_str());
+    // pixel sizes and scaler of the thumbnails, see TokenDatabase::setIconScaler()
+    static TokenDatabase::IconScaler db_icon_scaler;
+    static std::vector<unsigned> db_thumbnail_sizes;
 
-    for (auto&& f : fields)
+    // thumbnails are a cache, the ones which can't be created or stored are left out
+    static void storeThumbnails(const OTPToken::Icon &hash, const OTPToken::Icon &icon)
     {
-        query += sanitizeQuery("%s, ", f.c_str());
+        for (auto&& size : db_thumbnail_sizes)
+        {
+            const auto thumbnail = db_icon_scaler(icon, size);
+            if (thumbnail.empty())
+            {
+                continue;
+            }
+
+            try {
+                cachedStatement("insert or replace into icon_thumbnails values (?, ?, ?);", [&](sqlite::database_binder &query) {
+                    query << hash << size << thumbnail;
+                    query.execute();
+                });
+            } catch (sqlite::sqlite_exception &) {}
+        }
     }
-    query.erase(query.find_last_of(','));
-
-    query += ") values (";
 
-    for (auto i = 0U; i < fields.size(); ++i)
+    // adds the icon to the icons table if not already present and returns its reference,
+    // new icons get their thumbnails right away
+    static const OTPToken::Icon storeIcon(const OTPToken::Icon &icon)
     {
-        query += "?, ";
+        if (icon.empty())
+        {
+            return {};
+        }
+
+        auto hash = iconHash(icon);
+        auto added = false;
+        cachedStatement("insert or ignore into icons values (?, ?);", [&](sqlite::database_binder &query) {
+            query << hash << icon;
+            query.execute();
+            added = sqlite3_changes(db->connection().get()) != 0;
+        });
+        if (added && db_icon_scaler)
+        {
+            storeThumbnails(hash, icon);
+        }
+        return hash;
     }
-    query.erase(query.find_last_of(','));
 
-    query += ");";
+    // tags of the token separated by the unit separator, a lookup of the primary key of token_tags
+    static const std::string TAG_COLUMN =
+        "(select group_concat(tag, char(31)) from token_tags where token_tags.token = tokens.id) ";
+    static const constexpr char TAG_SEPARATOR = '\x1f';
 
-    return query;
-}
+    // token columns in the order expected by extractTokens(), with the icon resolved
+    static const std::string TOKEN_COLUMNS = std::string(Internal::TokenSchema::SELECT.view()) + TAG_COLUMN;
+    static const std::string TOKEN_COLUMNS_WITHOUT_ICON = std::string(Internal::TokenSchema::SELECT_WITHOUT_ICON.view()) + TAG_COLUMN;
 
-const std::string TokenDatabase::escapeStringLIKE(const std::string &input)
-{
-    // escape string to match absolute in a SQL LIKE expression
-    // ... LIKE "input" ESCAPE '\';
-    std::string str = input;
-    for (auto i = 0U; i < str.size(); ++i)
+    static OTPToken::Tags splitTags(const std::string &tags)
     {
-        if (str.at(i) == '%')
+        OTPToken::Tags out;
+        std::size_t begin = 0U;
+        while (begin < tags.size())
         {
-            str.replace(i, 1, "\\%");
-            ++i;
+            auto end = tags.find(TAG_SEPARATOR, begin);
+            end = end == std::string::npos ? tags.size() : end;
+            out.emplace_back(tags.substr(begin, end - begin));
+            begin = end + 1U;
         }
-        else if (str.at(i) == '_')
+        return out;
+    }
+
+    // conditions of the filter appended to a where clause, bound in the same order by bindFilter()
+    static std::string filterClause(const TokenDatabase::TokenFilter &filter)
+    {
+        std::string clause;
+        if (filter.type != OTPToken::None)
         {
-            str.replace(i, 1, "\\_");
-            ++i;
+            clause += " and tokens.type = ?";
         }
-        else if (str.at(i) == '\\')
+        if (filter.algorithm != OTPToken::Invalid)
         {
-            str.replace(i, 1, "\\\\");
-            ++i;
+            clause += " and tokens.algorithm = ?";
+        }
+        if (filter.digits != 0U)
+        {
+            clause += " and tokens.digits = ?";
+        }
+        if (filter.period != 0U)
+        {
+            clause += " and tokens.period = ?";
+        }
+        if (!filter.issuer.empty())
+        {
+            clause += " and tokens.issuer = ?";
+        }
+        if (!filter.tag.empty())
+        {
+            clause += " and tokens.id in (select token from token_tags where tag = ?)";
         }
+        return clause;
     }
-    return str;
+
+    static void bindFilter(sqlite::database_binder &query, const TokenDatabase::TokenFilter &filter)
+    {
+        if (filter.type != OTPToken::None)
+        {
+            query << filter.type;
+        }
+        if (filter.algorithm != OTPToken::Invalid)
+        {
+            query << static_cast<int>(filter.algorithm);
+        }
+        if (filter.digits != 0U)
+        {
+            query << static_cast<int>(filter.digits);
+        }
+        if (filter.period != 0U)
+        {
+            query << static_cast<OTPToken::sqliteLongID>(filter.period);
+        }
+        if (!filter.issuer.empty())
+        {
+            query << filter.issuer;
+        }
+        if (!filter.tag.empty())
+        {
+            query << filter.tag;
+        }
+    }
+    static const std::string ICON_JOIN = "left join icons on icons.hash = tokens.icon ";
 }
 
-bool TokenDatabase::displayOrderQuery(std::string &query)
+struct TokenDatabase::ChangeBatch
 {
-    query = sanitizeQuery("order by case %s ", "id");
+    ChangeBatch()
+        : outerMark(db_event_mark)
+    {
+        ++db_event_depth;
+        db_event_mark = db_events.size();
+    }
 
-    DisplayOrder order;
-    if (getDisplayOrder(order) != Success)
+    ~ChangeBatch()
     {
-        return false;
+        db_event_mark = outerMark;
+        if (--db_event_depth == 0)
+        {
+            publishChanges();
+        }
     }
 
-    if (order.empty())
+    ChangeBatch(const ChangeBatch&) = delete;
+    ChangeBatch &operator=(const ChangeBatch&) = delete;
+
+    std::size_t outerMark;
+};
+
+TokenDatabase::ObserverId TokenDatabase::addObserver(const ChangeObserver &observer, const Dispatcher &dispatcher)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    const auto id = db_next_observer++;
+    db_observers.emplace_back(ChangeObserverEntry{id, observer, dispatcher});
+    return id;
+}
+
+void TokenDatabase::removeObserver(const ObserverId &id)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    db_observers.erase(std::remove_if(db_observers.begin(), db_observers.end(), [&](const ChangeObserverEntry &entry) {
+        return entry.id == id;
+    }), db_observers.end());
+}
+
+void TokenDatabase::notifyChange(const ChangeEvent::Kind &kind, const OTPToken::sqliteTokenID &id)
+{
+    // nothing is recorded without observers
+    if (db_observers.empty())
     {
-        return false;
+        return;
     }
 
-    auto pos = 0U;
-    for (auto&& id : order)
+    // repeated events of the same token (like several counter changes) are delivered once
+    if (db_events.empty() || db_events.back().kind != kind || db_events.back().id != id)
+    {
+        db_events.emplace_back(ChangeEvent{kind, id});
+    }
+    if (db_event_depth == 0)
     {
-        query += sanitizeQuery("when %u then %u ", id, pos);
-        ++pos;
+        publishChanges();
     }
+}
 
-    query += "end;";
-    return true;
+TokenDatabase::Error TokenDatabase::executeGenericTokenStatement(const std::string &statement, const OTPToken &token,
+                                                                 const OTPToken::sqliteTokenID &id, bool *written)
+{
+    // BLOB == std::vector<T> in this C++ SQL library
+    // requires the statements of Internal/TokenSchema.hpp, the id is bound after the columns
+    // the secret is bound encrypted together with its hash, see Internal/SecretCipher.hpp
+    // the tags are written after the row, inserts without an id have none yet
+    SecureBuffer secret;
+    std::vector<unsigned char> hash;
+    auto status = Success;
+    try {
+        const auto icon = storeIcon(token.icon());
+        const auto cipher = secretCipher();
+        cipher->encrypt(token.secret().data(), token.secret().size(), secret);
+        secretHash(*cipher, token.secret(), hash);
+        auto changed = false;
+        // the bind order is the column order of the schema
+        using Internal::TokenSchema::bindIndex;
+        static_assert(Internal::TokenSchema::BIND_COUNT == 10U, "every bound column needs a value below");
+        static_assert(bindIndex("type") == 0U && bindIndex("label") == 1U && bindIndex("icon") == 2U &&
+                      bindIndex("secret") == 3U && bindIndex("digits") == 4U && bindIndex("period") == 5U &&
+                      bindIndex("counter") == 6U && bindIndex("algorithm") == 7U && bindIndex("issuer") == 8U &&
+                      bindIndex("secret_hash") == 9U, "the values are bound in another order than the columns");
+        // a label which is taken fails often in bulk imports, the row is written without exceptions
+        const auto rc = rawStatement(statement, [&](Internal::RawStatement &query) {
+            query.bind(token.type())
+                 .bind(token.label())
+                 .bind(icon) // reference into the icons table
+                 .bind(secret)
+                 .bind(token.digitLength())
+                 .bind(token.period())
+                 .bind(token.counter())
+                 .bind(token.algorithm())
+                 .bind(token.issuer())
+                 .bind(hash);
+            if (id != 0)
+            {
+                query.bind(id);
+            }
+            return query.execute();
+        });
+        if (rc != SQLITE_DONE)
+        {
+            return rc == SQLITE_CONSTRAINT ? SqlConstraintViolation : SqlExecutionFailed;
+        }
+        changed = sqlite3_changes(db->connection().get()) != 0;
+        if (written)
+        {
+            *written = changed;
+        }
+        if (changed)
+        {
+            storeTags(id != 0 ? id : db->last_insert_rowid(), token.tags(), id != 0);
+        }
+    } catch (sqlite::sqlite_exception &e) {
+        status = e.get_code() == SQLITE_CONSTRAINT ? SqlConstraintViolation : SqlExecutionFailed;
+    }
+
+    return status;
 }
 
-TokenDatabase::Error TokenDatabase::storeDatabaseVersion()
+void TokenDatabase::extractTokens(sqlite::database_binder &statement, const Internal::SecretCipher &cipher, const TokenSink &sink)
+{
+    // every row is turned into a token and passed to the callback right away,
+    // requires a statement which selects the TOKEN_COLUMNS
+    // BLOB == std::vector<T> in this C++ SQL library, the secret is decrypted into the secure memory of the token,
+    // secrets which don't decrypt are left empty
+    // the columns are handed over as rvalues, so the label and icon are moved into the token
+    OTPToken token;
+    SharedIcons icons;
+
+    statement >> [&](const OTPToken::sqliteLongID &id,
+                     const OTPToken::TokenType &type,
+                     OTPToken::Label &&label,
+                     OTPToken::Icon &&icon,
+                     const SecureBuffer &secret,
+                     const OTPToken::DigitType &digits,
+                     const OTPToken::PeriodType &period,
+                     const OTPToken::CounterType &counter,
+                     const OTPToken::ShaAlgorithm &algorithm,
+                     OTPToken::Issuer &&issuer,
+                     const std::string &tags)
+    {
+        token._id = id;
+        token.setType(type);
+        token.setLabel(std::move(label));
+        token.setSharedIcon(shareIcon(std::move(icon), icons));
+        (void) cipher.decrypt(secret.data(), secret.size(), token._secret);
+        token.setDigitLength(digits);
+        token.setPeriod(period);
+        token.setCounter(counter);
+        token.setAlgorithm(algorithm);
+        token._issuer = std::move(issuer);
+        token.setTags(splitTags(tags));
+        sink(token);
+    };
+}
+
+OTPToken TokenDatabase::selectToken(const OTPToken::sqliteTokenID &id)
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     if (!db_status)
     {
-        return SqlDatabaseNotOpen;
+        return {};
     }
 
-    // prepare statement
-    const auto statement = sanitizeQuery("insert into %Q values (?, ?);",
-                                         "config");
+    return selectTokenRow(*db, db_statements, *secretCipher(), id);
+}
+
+OTPToken TokenDatabase::selectTokenRow(sqlite::database &connection, StatementCache &statements, const Internal::SecretCipher &cipher,
+                                       const OTPToken::sqliteTokenID &id)
+{
+    static const std::string select = "select " + TOKEN_COLUMNS + "from tokens " + ICON_JOIN + "where tokens.id = ? limit 1;";
+    OTPToken token;
 
     try {
-        (*db) << statement << "database" << std::vector<std::uint32_t>{DATABASE_VERSION};
+        cachedStatement(connection, statements, select, [&](sqlite::database_binder &query) {
+            query << id;
+            extractTokens(query, cipher, [&](OTPToken &t) {
+                token = std::move(t);
+            });
+        });
     } catch (sqlite::sqlite_exception &) {
-        return SqlExecutionFailed;
+        return {};
     }
 
-    return Success;
+    return token;
 }
 
-TokenDatabase::Error TokenDatabase::getDatabaseVersion(std::uint32_t &version)
+OTPToken TokenDatabase::selectToken(const OTPToken::Label &label)
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     if (!db_status)
     {
-        return SqlDatabaseNotOpen;
+        return {};
     }
 
-    // prepare statement
-    const auto statement = sanitizeQuery("select %s from %Q where %s = %Q limit 1;",
-                                         "data", "config", "id", "database");
+    // get token which matches the label absolute
+    const auto id = tokenId(label);
+    if (id == 0)
+    {
+        return {};
+    }
 
-    std::vector<std::uint32_t> data;
+    return selectToken(id);
+}
 
-    try {
-        (*db) << statement >> data;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlExecutionFailed;
+OTPToken::sqliteTokenID TokenDatabase::tokenId(const OTPToken::Label &label)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return 0;
     }
 
-    if (data.empty())
+    if (!db_label_ids_valid)
     {
-        // assume user manipulation when this field is empty or
-        // doesn't contain a serialized std::vector<>
-        return SqlSchemaValidationFailed;
+        OTPGEN_PERF_COUNT(LabelCacheMisses, 1U);
+        db_label_ids.clear();
+
+        try {
+            cachedStatement("select id, label from tokens;", [&](sqlite::database_binder &query) {
+                query >> [&](const OTPToken::sqliteTokenID &id, const OTPToken::Label &l) {
+                    db_label_ids.emplace(db_labels->intern(l).key, id);
+                };
+            });
+        } catch (sqlite::sqlite_exception &) {
+            db_label_ids.clear();
+            return 0;
+        }
+
+        db_label_ids_valid = true;
+    }
+    else
+    {
+        OTPGEN_PERF_COUNT(LabelCacheHits, 1U);
     }
 
-    // the database version is the first element
-    version = data.at(0);
+    // a label which was never interned isn't the label of any token
+    LabelArena::Label interned;
+    if (!db_labels->findFolded(label, interned))
+    {
+        return 0;
+    }
+    const auto it = db_label_ids.find(interned.key);
+    return it == db_label_ids.end() ? 0 : it->second;
+}
 
-    return Success;
+std::shared_ptr<LabelArena> TokenDatabase::labelArena()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return db_labels;
+}
+
+TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::sqliteTypesID &type, bool withIcons)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    OTPTokenList tokens;
+    if (!db_status)
+    {
+        return {};
+    }
+
+    const auto status = selectTokenRows(*db, db_statements, *secretCipher(), type, [&](OTPToken &token) {
+        tokens.emplace_back(std::move(token));
+    }, withIcons);
+    if (status != Success)
+    {
+        return {};
+    }
+
+    return tokens;
 }
 
-TokenDatabase::Error TokenDatabase::storeDisplayOrder(const DisplayOrder &order)
+TokenDatabase::Error TokenDatabase::forEachToken(const OTPToken::sqliteTypesID &type, const TokenCallback &callback, bool withIcons)
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     if (!db_status)
     {
         return SqlDatabaseNotOpen;
     }
 
-    // prepare statement
-    const auto statement = sanitizeQuery("insert into %Q values (?, ?);",
-                                         "config");
+    return selectTokenRows(*db, db_statements, *secretCipher(), type, [&](OTPToken &token) {
+        callback(token);
+    }, withIcons);
+}
+
+TokenDatabase::Error TokenDatabase::selectTokenRange(const std::size_t &offset, const std::size_t &count,
+                                                     const TokenCallback &callback, bool withIcons)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+    if (count == 0)
+    {
+        return Success;
+    }
+
+    static const std::string with_icons = "select " + TOKEN_COLUMNS +
+        "from token_order join tokens on tokens.id = token_order.id " + ICON_JOIN +
+        "order by token_order.position limit ? offset ?;";
+    static const std::string without_icons = "select " + TOKEN_COLUMNS_WITHOUT_ICON +
+        "from token_order join tokens on tokens.id = token_order.id "
+        "order by token_order.position limit ? offset ?;";
 
     try {
-        (*db) << statement << "order" << order;
+        cachedStatement(withIcons ? with_icons : without_icons, [&](sqlite::database_binder &query) {
+            query << static_cast<OTPToken::sqliteLongID>(count)
+                  << static_cast<OTPToken::sqliteLongID>(offset);
+            extractTokens(query, *secretCipher(), [&](OTPToken &token) {
+                callback(token);
+            });
+        });
     } catch (sqlite::sqlite_exception &) {
-        return SqlDisplayOrderStoreFailed;
+        return SqlExecutionFailed;
     }
 
     return Success;
 }
 
-TokenDatabase::Error TokenDatabase::updateDisplayOrder(const DisplayOrder &order)
+TokenDatabase::Error TokenDatabase::selectTokens(const TokenFilter &filter, const unsigned &columns, const SortKey &after,
+                                                 const std::size_t &limit, TokenPage &page)
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    // after might be the next key of the page
+    const auto key = after;
+    page = TokenPage();
     if (!db_status)
     {
         return SqlDatabaseNotOpen;
     }
+    if (limit == 0)
+    {
+        page.next = key;
+        page.last = false;
+        return Success;
+    }
 
-    // prepare statement
-    const auto statement = sanitizeQuery("update %Q set %s=? where %s = %Q;",
-                                         "config", "data", "id", "order");
+    // columns which aren't selected are constants in the order of TOKEN_COLUMNS,
+    // every combination of columns and filters is a statement of its own
+    std::string select = "select tokens.id, ";
+    select += columns & TypeColumn ? "tokens.type, " : "0, ";
+    select += columns & LabelColumn ? "tokens.label, " : "'', ";
+    select += columns & IconColumn ? "icons.data, " : "null, ";
+    select += columns & SecretColumn ? "tokens.secret, " : "x'', ";
+    select += columns & ParameterColumns ? "tokens.digits, tokens.period, tokens.counter, tokens.algorithm, " : "0, 0, 0, 0, ";
+    select += columns & LabelColumn ? "tokens.issuer, " : "'', ";
+    select += columns & TagColumn ? TAG_COLUMN + ", " : "null, ";
+    select += "token_order.position from token_order join tokens on tokens.id = token_order.id ";
+    if (columns & IconColumn)
+    {
+        select += ICON_JOIN;
+    }
+    select += "where token_order.position > ?" + filterClause(filter);
+    // one more row than the limit tells if there is a further page
+    select += " order by token_order.position limit ?;";
 
+    const auto cipher = secretCipher();
     try {
-        (*db) << statement << order;
+        cachedStatement(select, [&](sqlite::database_binder &query) {
+            query << key;
+            bindFilter(query, filter);
+            query << static_cast<OTPToken::sqliteLongID>(std::min<std::size_t>(limit, std::numeric_limits<int>::max()) + 1U);
+
+            page.tokens.reserve(std::min<std::size_t>(limit, 4096U));
+            std::size_t rows = 0U;
+            SharedIcons icons;
+            query >> [&](const OTPToken::sqliteLongID &id,
+                         const OTPToken::TokenType &type,
+                         OTPToken::Label &&label,
+                         OTPToken::Icon &&icon,
+                         const SecureBuffer &secret,
+                         const OTPToken::DigitType &digits,
+                         const OTPToken::PeriodType &period,
+                         const OTPToken::CounterType &counter,
+                         const OTPToken::ShaAlgorithm &algorithm,
+                         OTPToken::Issuer &&issuer,
+                         const std::string &tags,
+                         const SortKey &position)
+            {
+                if (rows++ == limit)
+                {
+                    page.last = false;
+                    return;
+                }
+
+                OTPToken token;
+                token._id = id;
+                token.setType(type);
+                token.setLabel(std::move(label));
+                token.setSharedIcon(shareIcon(std::move(icon), icons));
+                (void) cipher->decrypt(secret.data(), secret.size(), token._secret);
+                token.setDigitLength(digits);
+                token.setPeriod(period);
+                token.setCounter(counter);
+                token.setAlgorithm(algorithm);
+                token._issuer = std::move(issuer);
+                token.setTags(splitTags(tags));
+                page.tokens.emplace_back(std::move(token));
+                page.next = position;
+            };
+        });
     } catch (sqlite::sqlite_exception &) {
-        return SqlDisplayOrderUpdateFailed;
+        page = TokenPage();
+        return SqlExecutionFailed;
     }
 
+    if (page.tokens.empty())
+    {
+        page.next = key;
+    }
     return Success;
 }
 
-TokenDatabase::Error TokenDatabase::getDisplayOrder(DisplayOrder &order)
+TokenDatabase::Error TokenDatabase::selectTokenSet(TokenSet &set, const OTPToken::sqliteTypesID &type, bool withIcons)
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    set.clear();
     if (!db_status)
     {
         return SqlDatabaseNotOpen;
     }
 
-    // prepare statement
-    const auto statement = sanitizeQuery("select %s from %Q where %s = %Q limit 1;",
-                                         "data", "config", "id", "order");
+    set.reserve(static_cast<std::size_t>(tokenCount(type)));
+    set.setKeyCache(db_key_cache.get());
+    const auto status = selectTokenRows(*db, db_statements, *secretCipher(), type, [&](OTPToken &token) {
+        set.insert(std::move(token));
+    }, withIcons);
+    set.setKeyCache(nullptr);
+    if (status != Success)
+    {
+        set.clear();
+    }
+    return status;
+}
+
+TokenDatabase::Error TokenDatabase::selectGroupRows(const TokenFilter &filter, const TokenSink &sink, bool withIcons)
+{
+    // one statement per combination of filters, the issuer and tag filters use their indices
+    const auto select = "select " + (withIcons ? TOKEN_COLUMNS : TOKEN_COLUMNS_WITHOUT_ICON) +
+        "from token_order join tokens on tokens.id = token_order.id " + (withIcons ? ICON_JOIN : std::string()) +
+        "where 1" + filterClause(filter) + " order by token_order.position;";
 
     try {
-        (*db) << statement >> order;
+        cachedStatement(select, [&](sqlite::database_binder &query) {
+            bindFilter(query, filter);
+            extractTokens(query, *secretCipher(), sink);
+        });
     } catch (sqlite::sqlite_exception &) {
-        return SqlDisplayOrderGetFailed;
+        return SqlExecutionFailed;
     }
 
     return Success;
 }
 
-bool TokenDatabase::serializeDatabase(std::string &out)
+TokenDatabase::Error TokenDatabase::selectGroup(const TokenFilter &filter, OTPTokenList &tokens, bool withIcons)
 {
-    // database must be open
-    sqlite3_int64 size = 0;
-    auto data = sqlite3_serialize(db->connection().get(), "main", &size, 0);
-
-    if (!data)
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    tokens.clear();
+    if (!db_status)
     {
-        out.clear();
-        return false;
+        return SqlDatabaseNotOpen;
     }
 
-    out = std::string(reinterpret_cast<const char*>(data), static_cast<std::size_t>(size));
-    sqlite3_free(data);
-    return true;
+    const auto status = selectGroupRows(filter, [&](OTPToken &token) {
+        tokens.emplace_back(std::move(token));
+    }, withIcons);
+    if (status != Success)
+    {
+        tokens.clear();
+    }
+    return status;
 }
 
-bool TokenDatabase::deserializeDatabase(const std::string &data)
+TokenDatabase::Error TokenDatabase::selectGroupSet(const TokenFilter &filter, TokenSet &set)
 {
-    if (data.empty())
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    set.clear();
+    if (!db_status)
     {
-        return false;
+        return SqlDatabaseNotOpen;
     }
 
-    // copy stream, sqlite uses this
-    // clearing it or changing its content will cause failure later
-    db_data = data;
-
-    // empty database must be open
-    auto rc = sqlite3_deserialize(db->connection().get(), "main",
-                                  const_cast<unsigned char*>(
-                                      reinterpret_cast<const unsigned char*>(db_data.data())
-                                  ),
-                                  static_cast<sqlite3_int64>(db_data.size()),
-                                  static_cast<sqlite3_int64>(db_data.size()),
-                                  0);
-    if (rc)
+    const auto status = selectGroupRows(filter, [&](OTPToken &token) {
+        set.insert(std::move(token));
+    }, false);
+    if (status != Success)
     {
-        return false;
+        set.clear();
     }
-
-    return true;
+    return status;
 }
 
-TokenDatabase::Error TokenDatabase::validateSchema()
+TokenDatabase::Error TokenDatabase::deleteGroup(const TokenFilter &filter, std::size_t *deleted)
 {
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (deleted)
+    {
+        *deleted = 0U;
+    }
     if (!db_status)
     {
         return SqlDatabaseNotOpen;
     }
+    const auto clause = filterClause(filter);
+    if (clause.empty())
+    {
+        return EmptyFilter;
+    }
 
-    const auto pragma = "pragma table_info(%Q)";
-
-#define SQLITE_PRAGMA_ARGLIST \
-    const sqlite3_int64 &/*cid*/, \
-    const std::string &name, \
-    const std::string &type, \
-    const bool &notnull, \
-    const std::string &dflt_value, \
-    const bool &pk
-
-    const auto verifyStatics = [&](const std::string &table) {
-        const auto statement = sanitizeQuery(pragma, table.c_str());
-
-        bool validId = false, validName = false;
+    std::vector<std::pair<OTPToken::sqliteTokenID, OTPToken::sqliteTypesID>> group;
+    try {
+        cachedStatement("select tokens.id, tokens.type from tokens where 1" + clause + ";", [&](sqlite::database_binder &query) {
+            bindFilter(query, filter);
+            query >> [&](const OTPToken::sqliteTokenID &id, const OTPToken::sqliteTypesID &type) {
+                group.emplace_back(id, type);
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+    if (group.empty())
+    {
+        return Success;
+    }
 
-        try {
-            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+    // the tags and the search index follow through their triggers
+    invalidateLabelIds();
+    ChangeBatch batch;
+    try {
+        (*db) << "savepoint token_database;";
+        for (auto&& token : group)
+        {
+            for (auto&& statement : {"delete from token_order where id = ?;", "delete from tokens where id = ?;",
+                                     "delete from token_drift where id = ?;"})
             {
-                if (name == "id")
-                {
-                    validId = (type == "int(1)" && notnull && dflt_value.empty() && pk);
-                }
-                else if (name == "name")
-                {
-                    validName = (type == "text" && !notnull && dflt_value.empty() && !pk);
-                }
-            };
-        } catch (sqlite::sqlite_exception &) {
-            return false;
+                cachedStatement(statement, [&](sqlite::database_binder &query) {
+                    query << token.first;
+                    query.execute();
+                });
+            }
+            recordChange(ChangeDelete, token.first);
+        }
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        return SqlExecutionFailed;
+    }
+
+    for (auto&& token : group)
+    {
+        invalidateIcon(token.first);
+        countToken(token.second, -1);
+        notifyChange(ChangeEvent::Deleted, token.first);
+    }
+    if (deleted)
+    {
+        *deleted = group.size();
+    }
+    markDirty();
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::moveGroup(const TokenFilter &filter, const std::size_t &position)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+    const auto clause = filterClause(filter);
+    if (clause.empty())
+    {
+        return EmptyFilter;
+    }
+
+    DisplayOrder group;
+    try {
+        cachedStatement("select tokens.id from token_order join tokens on tokens.id = token_order.id where 1" + clause +
+                        " order by token_order.position;", [&](sqlite::database_binder &query) {
+            bindFilter(query, filter);
+            query >> [&](const OTPToken::sqliteSortOrder &id) {
+                group.emplace_back(id);
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderGetFailed;
+    }
+    if (group.empty())
+    {
+        return SqlEmptyResults;
+    }
+
+    DisplayOrder order;
+    auto status = getDisplayOrder(order);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // the other tokens keep their order, the group is inserted as a block
+    const std::unordered_set<OTPToken::sqliteSortOrder> members(group.begin(), group.end());
+    DisplayOrder moved;
+    moved.reserve(order.size());
+    std::copy_if(order.begin(), order.end(), std::back_inserter(moved), [&](const OTPToken::sqliteSortOrder &id) {
+        return members.count(id) == 0;
+    });
+    const auto at = moved.begin() + static_cast<std::ptrdiff_t>(std::min(position, moved.size()));
+    moved.insert(at, group.begin(), group.end());
+    if (moved == order)
+    {
+        return Success;
+    }
+
+    return reorder(moved);
+}
+
+std::vector<OTPToken::Issuer> TokenDatabase::issuers()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    std::vector<OTPToken::Issuer> issuers;
+    if (!db_status)
+    {
+        return issuers;
+    }
+
+    try {
+        cachedStatement("select distinct issuer from tokens where issuer != '' order by issuer;", [&](sqlite::database_binder &query) {
+            query >> [&](OTPToken::Issuer &&issuer) {
+                issuers.emplace_back(std::move(issuer));
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        issuers.clear();
+    }
+    return issuers;
+}
+
+std::vector<std::string> TokenDatabase::tags()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    std::vector<std::string> tags;
+    if (!db_status)
+    {
+        return tags;
+    }
+
+    try {
+        cachedStatement("select distinct tag from token_tags order by tag;", [&](sqlite::database_binder &query) {
+            query >> [&](std::string &&tag) {
+                tags.emplace_back(std::move(tag));
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        tags.clear();
+    }
+    return tags;
+}
+
+TokenDatabase::Error TokenDatabase::selectTokenRows(sqlite::database &connection, StatementCache &statements, const Internal::SecretCipher &cipher,
+                                                    const OTPToken::sqliteTypesID &type, const TokenSink &sink, bool withIcons)
+{
+    // all tokens are fetched in a single statement, the order table drives the
+    // query so the listing is a scan over the position index
+    // listings without icons select NULL in place of the icon BLOB
+    static const std::string with_icons = "select " + TOKEN_COLUMNS +
+        "from token_order join tokens on tokens.id = token_order.id " + ICON_JOIN;
+    static const std::string without_icons = "select " + TOKEN_COLUMNS_WITHOUT_ICON +
+        "from token_order join tokens on tokens.id = token_order.id ";
+
+    const auto &select = withIcons ? with_icons : without_icons;
+
+    try {
+        if (type == OTPToken::None)
+        {
+            cachedStatement(connection, statements, select + "order by token_order.position;", [&](sqlite::database_binder &query) {
+                extractTokens(query, cipher, sink);
+            });
+        }
+        else
+        {
+            cachedStatement(connection, statements, select + "where tokens.type = ? order by token_order.position;", [&](sqlite::database_binder &query) {
+                query << type;
+                extractTokens(query, cipher, sink);
+            });
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+void TokenDatabase::setIconScaler(const IconScaler &scaler, const std::vector<unsigned> &sizes)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    db_icon_scaler = scaler;
+    db_thumbnail_sizes = sizes;
+    std::sort(db_thumbnail_sizes.begin(), db_thumbnail_sizes.end());
+    db_thumbnail_sizes.erase(std::unique(db_thumbnail_sizes.begin(), db_thumbnail_sizes.end()), db_thumbnail_sizes.end());
+}
+
+const OTPToken::Icon TokenDatabase::selectIconThumbnail(const OTPToken::sqliteTokenID &id, unsigned size)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return {};
+    }
+
+    OTPToken::Icon thumbnail;
+    try {
+        cachedStatement("select icon_thumbnails.data from tokens join icon_thumbnails on icon_thumbnails.hash = tokens.icon "
+                        "where tokens.id = ? and icon_thumbnails.size = ? limit 1;", [&](sqlite::database_binder &query) {
+            query << id << size;
+            query >> [&](OTPToken::Icon &&data) {
+                thumbnail = std::move(data);
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+    return thumbnail;
+}
+
+TokenDatabase::Error TokenDatabase::storeIconThumbnail(const OTPToken::sqliteTokenID &id, unsigned size, const OTPToken::Icon &thumbnail)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+    if (thumbnail.empty())
+    {
+        return SqlEmptyResults;
+    }
+
+    try {
+        auto changes = 0;
+        cachedStatement("insert or replace into icon_thumbnails select icon, ?, ? from tokens "
+                        "where id = ? and length(icon) > 0;", [&](sqlite::database_binder &query) {
+            query << size << thumbnail << id;
+            query.execute();
+            changes = sqlite3_changes(db->connection().get());
+        });
+        if (changes == 0)
+        {
+            return SqlEmptyResults;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    // the image of the readers would miss it
+    invalidateReaders();
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::storeSteamTimeOffset(const std::time_t &offset, const std::time_t &measured)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        cachedStatement("insert or replace into config values (?, ?);", [&](sqlite::database_binder &query) {
+            query << "steam_time" << std::vector<std::int64_t>{static_cast<std::int64_t>(offset), static_cast<std::int64_t>(measured)};
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    invalidateReaders();
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::selectSteamTimeOffset(std::time_t &offset, std::time_t &measured)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    std::vector<std::int64_t> data;
+    try {
+        cachedStatement("select data from config where id = ? limit 1;", [&](sqlite::database_binder &query) {
+            query << "steam_time";
+            query >> data;
+        });
+    } catch (sqlite::sqlite_exception &) {
+        // no record before the first measurement
+        return SqlEmptyResults;
+    }
+
+    if (data.size() != 2U)
+    {
+        return SqlEmptyResults;
+    }
+    offset = static_cast<std::time_t>(data[0]);
+    measured = static_cast<std::time_t>(data[1]);
+    return Success;
+}
+
+const OTPToken::Icon TokenDatabase::selectIcon(const OTPToken::sqliteTokenID &id)
+{
+    return selectSharedIcon(id).bytes();
+}
+
+const OTPToken::SharedIcon TokenDatabase::selectSharedIcon(const OTPToken::sqliteTokenID &id)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return {};
+    }
+
+    const auto it = db_icons.find(id);
+    if (it != db_icons.end())
+    {
+        // move to the front of the lru list
+        db_icon_lru.splice(db_icon_lru.begin(), db_icon_lru, it->second);
+        return it->second->second;
+    }
+
+    OTPToken::SharedIcon icon;
+
+    try {
+        cachedStatement("select icons.data from tokens join icons on icons.hash = tokens.icon where tokens.id = ? limit 1;", [&](sqlite::database_binder &query) {
+            query << id;
+            query >> [&](OTPToken::Icon &&i) {
+                icon = OTPToken::SharedIcon(std::move(i));
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    db_icon_lru.emplace_front(id, icon);
+    db_icons.emplace(id, db_icon_lru.begin());
+    if (db_icon_lru.size() > ICON_CACHE_SIZE)
+    {
+        db_icons.erase(db_icon_lru.back().first);
+        db_icon_lru.pop_back();
+    }
+
+    return icon;
+}
+
+TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::Label &label_like)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return {};
+    }
+
+    OTPTokenList tokens;
+
+    try {
+        cachedStatement("select " + TOKEN_COLUMNS + "from token_order join tokens on tokens.id = token_order.id " + ICON_JOIN +
+                        "where tokens.label like ? escape '\\' order by token_order.position;", [&](sqlite::database_binder &query) {
+            query << label_like;
+            extractTokens(query, *secretCipher(), [&](OTPToken &token) {
+                tokens.emplace_back(std::move(token));
+            });
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    return tokens;
+}
+
+TokenDatabase::Error TokenDatabase::searchTokens(const std::string &text, const std::size_t &limit, OTPTokenList &tokens, bool withIcons)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    tokens.clear();
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // every word becomes a quoted prefix query, so the text never reaches the query syntax,
+    // words are split like the unicode61 tokenizer does for ASCII
+    std::string match, word;
+    const auto flush = [&] {
+        if (!word.empty())
+        {
+            match += (match.empty() ? "\"" : " \"") + word + "\"*";
+            word.clear();
         }
-
-        return validId && validName;
     };
+    for (auto&& c : text)
+    {
+        const auto byte = static_cast<unsigned char>(c);
+        if (byte >= 0x80 || std::isalnum(byte))
+        {
+            word += c;
+        }
+        else
+        {
+            flush();
+        }
+    }
+    flush();
+    if (match.empty() || limit == 0)
+    {
+        return Success;
+    }
+
+    static const std::string with_icons = "select " + TOKEN_COLUMNS +
+        "from token_search join tokens on tokens.id = token_search.rowid " + ICON_JOIN +
+        "join token_order on token_order.id = tokens.id "
+        "where token_search match ? order by token_search.rank, token_order.position limit ?;";
+    static const std::string without_icons = "select " + TOKEN_COLUMNS_WITHOUT_ICON +
+        "from token_search join tokens on tokens.id = token_search.rowid "
+        "join token_order on token_order.id = tokens.id "
+        "where token_search match ? order by token_search.rank, token_order.position limit ?;";
+
+    try {
+        cachedStatement(withIcons ? with_icons : without_icons, [&](sqlite::database_binder &query) {
+            query << match << static_cast<OTPToken::sqliteLongID>(std::min<std::size_t>(limit, std::numeric_limits<OTPToken::sqliteLongID>::max()));
+            extractTokens(query, *secretCipher(), [&](OTPToken &token) {
+                tokens.emplace_back(std::move(token));
+            });
+        });
+    } catch (sqlite::sqlite_exception &) {
+        tokens.clear();
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+std::vector<OTPToken::sqliteTokenID> TokenDatabase::tokensWithSecret(const OTPToken::TokenSecret &secret)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    std::vector<OTPToken::sqliteTokenID> ids;
+    if (!db_status)
+    {
+        return ids;
+    }
+
+    std::vector<unsigned char> hash;
+    secretHash(*secretCipher(), secret, hash);
+    if (hash.empty())
+    {
+        return ids;
+    }
+
+    try {
+        fillSecretHashes();
+    } catch (sqlite::sqlite_exception &) {
+        return ids;
+    }
+    const auto rc = rawStatement("select id from tokens where secret_hash = ? order by id;", [&](Internal::RawStatement &query) {
+        auto rc = query.bind(hash).step();
+        for (; rc == SQLITE_ROW; rc = query.step())
+        {
+            ids.emplace_back(query.int64(0));
+        }
+        return rc;
+    });
+    if (rc != SQLITE_DONE)
+    {
+        ids.clear();
+    }
+    return ids;
+}
+
+TokenDatabase::Error TokenDatabase::insertToken(const OTPToken &token)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    static const std::string statement(Internal::TokenSchema::INSERT.view());
+
+    auto status = executeGenericTokenStatement(statement, token);
+    if (status != Success)
+    {
+        return status;
+    }
+    markDirty();
+
+    const auto id = db->last_insert_rowid();
+    if (db_label_ids_valid)
+    {
+        db_label_ids.emplace(db_labels->intern(token.label()).key, id);
+    }
+    countToken(token.type(), 1);
+
+    // append last insert id to display order
+    try {
+        cachedStatement("insert into token_order select ?, coalesce(max(position), 0) + ? from token_order;", [&](sqlite::database_binder &query) {
+            query << id << DISPLAY_ORDER_GAP;
+            query.execute();
+        });
+        recordChange(ChangeWrite, id);
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderUpdateFailed;
+    }
+
+    notifyChange(ChangeEvent::Inserted, id);
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::insertTokens(const OTPTokenList &tokens, std::vector<Error> *results,
+                                                 const DuplicatePolicy &duplicates)
+{
+    return insertTokens([&](const TokenCallback &insert) {
+        for (auto&& token : tokens)
+        {
+            insert(token);
+        }
+        return Success;
+    }, results, duplicates);
+}
+
+TokenDatabase::Error TokenDatabase::insertTokens(const TokenProducer &producer, std::vector<Error> *results,
+                                                 const DuplicatePolicy &duplicates)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (results)
+    {
+        results->clear();
+    }
+
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    static const std::string statement(Internal::TokenSchema::INSERT.view());
+
+    // the hashes are filled outside of the transaction, a rollback keeps them
+    if (duplicates != KeepDuplicates)
+    {
+        try {
+            fillSecretHashes();
+        } catch (sqlite::sqlite_exception &) {
+            return SqlExecutionFailed;
+        }
+    }
+
+    ChangeBatch batch;
+    try {
+        (*db) << "savepoint token_database;";
+
+        OTPToken::sqliteLongID position = 0;
+        cachedStatement("select coalesce(max(position), 0) from token_order;", [&](sqlite::database_binder &query) {
+            query >> position;
+        });
+
+        std::vector<unsigned char> hash;
+        const auto produced = producer([&](const OTPToken &token) {
+            // duplicates are found through the index of the secret hashes, rows inserted before are in it as well
+            OTPToken::sqliteTokenID duplicate = 0;
+            auto status = Success;
+            if (duplicates != KeepDuplicates)
+            {
+                secretHash(*secretCipher(), token.secret(), hash);
+                status = firstTokenWithHash(hash, duplicate);
+            }
+
+            // a failed row only rolls back its own statement, the transaction continues
+            if (status == Success && duplicate == 0)
+            {
+                status = executeGenericTokenStatement(statement, token);
+            }
+            else if (status == Success)
+            {
+                status = duplicates == SkipDuplicates ? DuplicateSecret : updateToken(duplicate, token);
+            }
+
+            if (duplicate == 0 && status == Success)
+            {
+                const auto id = db->last_insert_rowid();
+                position += DISPLAY_ORDER_GAP;
+                cachedStatement("insert into token_order values (?, ?);", [&](sqlite::database_binder &query) {
+                    query << id << position;
+                    query.execute();
+                });
+                recordChange(ChangeWrite, id);
+                notifyChange(ChangeEvent::Inserted, id);
+                if (db_label_ids_valid)
+                {
+                    db_label_ids.emplace(db_labels->intern(token.label()).key, id);
+                }
+                countToken(token.type(), 1);
+            }
+
+            if (results)
+            {
+                results->emplace_back(status);
+            }
+        });
+
+        if (produced != Success)
+        {
+            rollbackSavepoint();
+            invalidateLabelIds();
+            invalidateTypeCounts();
+            if (results)
+            {
+                results->clear();
+            }
+            return produced;
+        }
+
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        invalidateLabelIds();
+        invalidateTypeCounts();
+        if (results)
+        {
+            results->clear();
+        }
+        return SqlExecutionFailed;
+    } catch (...) {
+        // exceptions of the producer end the transaction as well
+        rollbackSavepoint();
+        invalidateLabelIds();
+        invalidateTypeCounts();
+        if (results)
+        {
+            results->clear();
+        }
+        return UnknownFailure;
+    }
+
+    markDirty();
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    static const std::string statement(Internal::TokenSchema::UPDATE.view());
+
+    // the label and icon might have changed
+    invalidateLabelIds();
+    invalidateIcon(id);
+
+    // observers are told about renames, the type counts follow a changed type
+    auto renamed = false;
+    OTPToken::sqliteTypesID type = OTPToken::None;
+    if (!db_observers.empty() || db_type_counts_valid)
+    {
+        try {
+            cachedStatement("select label, type from tokens where id = ?;", [&](sqlite::database_binder &query) {
+                query << id;
+                query >> [&](const std::string &label, const OTPToken::sqliteTypesID &current) {
+                    renamed = label != token.label();
+                    type = current;
+                };
+            });
+        } catch (sqlite::sqlite_exception &) {
+            return SqlExecutionFailed;
+        }
+    }
+
+    auto updated = false;
+    const auto status = executeGenericTokenStatement(statement, token, id, &updated);
+    if (status != Success)
+    {
+        return status;
+    }
+    markDirty();
+    if (updated && type != token.type())
+    {
+        countToken(type, -1);
+        countToken(token.type(), 1);
+    }
+
+    try {
+        recordChange(ChangeWrite, id);
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+    if (updated)
+    {
+        notifyChange(renamed ? ChangeEvent::Renamed : ChangeEvent::Updated, id);
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    auto token = selectToken(id);
+    if (token.id() == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    token.setLabel(label);
+
+    return updateToken(id, token);
+}
+
+TokenDatabase::Error TokenDatabase::incrementCounter(const OTPToken::sqliteTokenID &id, OTPToken::CounterType *counter)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    OTPToken::sqliteLongID current = -1;
+    try {
+        cachedStatement("select counter from tokens where id = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query >> [&](const OTPToken::sqliteLongID &value) {
+                current = value;
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+    if (current < 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    const auto next = static_cast<OTPToken::CounterType>(current + 1);
+    const auto status = setCounter(id, next);
+    if (status == Success && counter)
+    {
+        *counter = next;
+    }
+    return status;
+}
+
+TokenDatabase::Error TokenDatabase::setCounter(const OTPToken::sqliteTokenID &id, const OTPToken::CounterType &counter)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        cachedStatement("update tokens set counter = ? where id = ?;", [&](sqlite::database_binder &query) {
+            query << counter << id;
+            query.execute();
+        });
+        if (sqlite3_changes(db->connection().get()) == 0)
+        {
+            return SqlEmptyResults;
+        }
+        recordChange(ChangeWrite, id);
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    // one record of the journal instead of writing the database, which is saved
+    // the usual way if there is no journal (like right after initializeTokens())
+    invalidateReaders();
+    notifyChange(ChangeEvent::CounterChanged, id);
+    if (!db_counters || !db_counters->isOpen())
+    {
+        markDirty();
+        return Success;
+    }
+    if (!db_counters->append(id, counter, databaseDurability == Immediate))
+    {
+        markDirty();
+        return FileWriteFailure;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::deleteToken(const OTPToken::sqliteTokenID &id)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    invalidateLabelIds();
+    invalidateIcon(id);
+
+    OTPToken::sqliteTypesID type = OTPToken::None;
+    if (db_type_counts_valid)
+    {
+        try {
+            cachedStatement("select type from tokens where id = ?;", [&](sqlite::database_binder &query) {
+                query << id;
+                query >> [&](const OTPToken::sqliteTypesID &current) {
+                    type = current;
+                };
+            });
+        } catch (sqlite::sqlite_exception &) {
+            return SqlExecutionFailed;
+        }
+    }
+
+    // update display order first, it references the token
+    try {
+        cachedStatement("delete from token_order where id = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderUpdateFailed;
+    }
+    markDirty();
+
+    auto deleted = false;
+    try {
+        cachedStatement("delete from tokens where id = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query.execute();
+        });
+        deleted = sqlite3_changes(db->connection().get()) != 0;
+        cachedStatement("delete from token_drift where id = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query.execute();
+        });
+        recordChange(ChangeDelete, id);
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    if (deleted)
+    {
+        countToken(type, -1);
+        notifyChange(ChangeEvent::Deleted, id);
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::getClockDrift(const OTPToken::sqliteTokenID &id, ClockDrift &drift)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    drift = ClockDrift();
+    try {
+        cachedStatement("select drift from token_drift where id = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query >> [&](const std::int64_t &value) {
+                drift = ClockDrift::unpack(static_cast<ClockDrift::Packed>(value));
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::setClockDrift(const OTPToken::sqliteTokenID &id, const ClockDrift &drift)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        std::int64_t tokens = 0;
+        cachedStatement("select count(*) from tokens where id = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query >> tokens;
+        });
+        if (tokens == 0)
+        {
+            return SqlEmptyResults;
+        }
+
+        cachedStatement("insert or replace into token_drift (id, drift) values (?, ?);", [&](sqlite::database_binder &query) {
+            query << id << static_cast<std::int64_t>(drift.pack());
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    // not part of the change log, the drift belongs to the clock of the device
+    // verifying against this database and not to the token itself
+    markDirty();
+    return Success;
+}
+
+OTPToken::sqliteTokenID TokenDatabase::tokenCount(const OTPToken::sqliteTypesID &type)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return 0;
+    }
+
+    if (!db_type_counts_valid)
+    {
+        try {
+            cachedStatement("select type, count(*) from tokens group by type;", [&](sqlite::database_binder &query) {
+                query >> [&](const OTPToken::sqliteTypesID &current, const OTPToken::sqliteTokenID &count) {
+                    if (current > OTPToken::None && current <= OTPToken::Steam)
+                    {
+                        db_type_counts[static_cast<std::size_t>(current)] = count;
+                    }
+                    db_type_counts[OTPToken::None] += count;
+                };
+            });
+        } catch (sqlite::sqlite_exception &) {
+            db_type_counts.fill(0);
+            return -1;
+        }
+        db_type_counts_valid = true;
+    }
+
+    if (type < OTPToken::None || type > OTPToken::Steam)
+    {
+        return 0;
+    }
+    return db_type_counts[static_cast<std::size_t>(type)];
+}
+
+OTPToken::sqliteTokenID TokenDatabase::countTokens(sqlite::database &connection, StatementCache &statements,
+                                                   const OTPToken::sqliteTypesID &type)
+{
+    OTPToken::sqliteTokenID count = 0;
+
+    try {
+        if (type == OTPToken::None)
+        {
+            cachedStatement(connection, statements, "select count(*) from tokens;", [&](sqlite::database_binder &query) {
+                query >> count;
+            });
+        }
+        else
+        {
+            cachedStatement(connection, statements, "select count(*) from tokens where type = ?;", [&](sqlite::database_binder &query) {
+                query << type;
+                query >> count;
+            });
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return -1;
+    }
+
+    return count;
+}
+
+TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken &token1, const OTPToken &token2)
+{
+    return swapTokens(token1.label(), token2.label());
+}
+
+TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken::Label &label1, const OTPToken::Label &label2)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto tokenId1 = tokenId(label1);
+    if (tokenId1 == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    auto tokenId2 = tokenId(label2);
+    if (tokenId2 == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    OTPToken::sqliteLongID pos1 = 0, pos2 = 0;
+    auto status = getDisplayPosition(tokenId1, pos1);
+    if (status != Success)
+    {
+        return status;
+    }
+    status = getDisplayPosition(tokenId2, pos2);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // only the positions of both tokens are exchanged
+    ChangeBatch batch;
+    try {
+        (*db) << "savepoint token_database;";
+        for (auto&& entry : {std::make_pair(tokenId1, pos2), std::make_pair(tokenId2, pos1)})
+        {
+            cachedStatement("update token_order set position = ? where id = ?;", [&](sqlite::database_binder &query) {
+                query << entry.second << entry.first;
+                query.execute();
+            });
+            recordChange(ChangeMove, entry.first);
+            notifyChange(ChangeEvent::Moved, entry.first);
+        }
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        return SqlDisplayOrderUpdateFailed;
+    }
+
+    markDirty();
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::moveToken(const OTPToken &token, const std::size_t &newPos)
+{
+    return moveToken(token.label(), newPos);
+}
+
+TokenDatabase::Error TokenDatabase::moveToken(const OTPToken::Label &token, const std::size_t &newPos)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto movedId = tokenId(token);
+    if (movedId == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    // the token is placed above the one currently at the new position,
+    // or below the last token if the position is past the end
+    OTPToken::sqliteTokenID targetId = 0;
+    auto below = false;
+
+    try {
+        cachedStatement("select id from token_order order by position limit 1 offset ?;", [&](sqlite::database_binder &query) {
+            query << static_cast<OTPToken::sqliteLongID>(newPos);
+            query >> [&](const OTPToken::sqliteTokenID &id) {
+                targetId = id;
+            };
+        });
+
+        if (targetId == 0)
+        {
+            below = true;
+            cachedStatement("select id from token_order order by position desc limit 1;", [&](sqlite::database_binder &query) {
+                query >> [&](const OTPToken::sqliteTokenID &id) {
+                    targetId = id;
+                };
+            });
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderGetFailed;
+    }
+
+    if (targetId == 0)
+    {
+        return SqlDisplayOrderIncomplete;
+    }
+
+    return moveDisplayPosition(movedId, targetId, below);
+}
+
+TokenDatabase::Error TokenDatabase::applyOrder(const DisplayOrder &order)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    DisplayOrder current;
+    auto status = getDisplayOrder(current);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // a permutation of the current order
+    auto sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+    std::sort(current.begin(), current.end());
+    if (sorted != current)
+    {
+        return SqlDisplayOrderIncomplete;
+    }
+
+    return reorder(order);
+}
+
+TokenDatabase::Error TokenDatabase::sortTokens(const SortOrder &order)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // the current position breaks ties
+    static const std::string select = "select token_order.id from token_order join tokens on tokens.id = token_order.id order by ";
+    DisplayOrder sorted;
+    try {
+        cachedStatement(select + (order == SortByLabel ? "tokens.label collate nocase, token_order.position;" :
+                                  order == SortByType ? "tokens.type, token_order.position;" :
+                                  "tokens.id;"), [&](sqlite::database_binder &query) {
+            query >> [&](const OTPToken::sqliteSortOrder &id) {
+                sorted.emplace_back(id);
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderGetFailed;
+    }
+
+    return reorder(sorted);
+}
+
+TokenDatabase::Error TokenDatabase::reorder(const DisplayOrder &order)
+{
+    // all positions and the change log entry in one transaction
+    try {
+        (*db) << "savepoint token_database;";
+        if (updateDisplayOrder(order) != Success)
+        {
+            rollbackSavepoint();
+            return SqlDisplayOrderUpdateFailed;
+        }
+        recordChange(ChangeOrder, 0);
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        return SqlDisplayOrderUpdateFailed;
+    }
+
+    markDirty();
+    notifyChange(ChangeEvent::Reordered, 0);
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken &token, const OTPToken &below)
+{
+    return moveTokenBelow(token.label(), below.label());
+}
+
+TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken::Label &token, const OTPToken::Label &below)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto tokenId1 = tokenId(token);
+    if (tokenId1 == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    auto tokenId2 = tokenId(below);
+    if (tokenId2 == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    return moveDisplayPosition(tokenId1, tokenId2, true);
+}
+
+TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken &token, const OTPToken &above)
+{
+    return moveTokenAbove(token.label(), above.label());
+}
+
+TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken::Label &token, const OTPToken::Label &above)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto tokenId1 = tokenId(token);
+    if (tokenId1 == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    auto tokenId2 = tokenId(above);
+    if (tokenId2 == 0)
+    {
+        return SqlEmptyResults;
+    }
+
+    return moveDisplayPosition(tokenId1, tokenId2, false);
+}
+
+const std::string TokenDatabase::selectTokenTypeName(const OTPToken::sqliteTypesID &id)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status || id < 0)
+    {
+        return {};
+    }
+    return std::string(OTPToken::typeName(static_cast<OTPToken::TokenType>(id)));
+}
+
+const std::string TokenDatabase::selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status || id < 0)
+    {
+        return {};
+    }
+    return std::string(OTPToken::algorithmName(static_cast<OTPToken::ShaAlgorithm>(id)));
+}
+
+// serialized database image shared by the readers of one generation, wiped on release
+struct TokenDatabase::Reader::Image
+{
+    unsigned char *data = nullptr;
+    sqlite3_int64 size = 0;
+
+    ~Image()
+    {
+        if (this->data)
+        {
+            SecureMemory::wipe(this->data, static_cast<std::size_t>(this->size));
+            sqlite3_free(this->data);
+        }
+    }
+};
+
+struct TokenDatabase::Reader::Connection
+{
+    std::uint64_t generation = 0U;
+    std::shared_ptr<const Internal::SecretCipher> cipher;
+    std::unique_ptr<sqlite::database> db;
+    // declared after the connection, the statements are finalized first
+    StatementCache statements;
+};
+
+struct TokenDatabase::Reader::Pool
+{
+    // idle connections of the current generation, at most MAX_IDLE of them are kept
+    static const constexpr std::size_t MAX_IDLE = 4U;
+
+    std::mutex mutex;
+    std::uint64_t generation = 0U;
+    std::shared_ptr<const Image> image;
+    std::vector<std::unique_ptr<Connection>> idle;
+};
+
+TokenDatabase::Reader::Pool &TokenDatabase::Reader::pool()
+{
+    static Pool pool;
+    return pool;
+}
+
+TokenDatabase::Reader TokenDatabase::reader()
+{
+    auto &pool = Reader::pool();
+    std::shared_ptr<const Reader::Image> image;
+    std::uint64_t generation = 0U;
+    std::shared_ptr<const Internal::SecretCipher> cipher;
+    Tuning tuning;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (!db_status)
+        {
+            return {};
+        }
+
+        // the database can't change while its mutex is held
+        generation = db_generation.load(std::memory_order_relaxed);
+        cipher = secretCipher();
+        tuning = imageTuning;
+
+        std::vector<std::unique_ptr<Reader::Connection>> outdated;
+        {
+            std::lock_guard<std::mutex> pool_lock(pool.mutex);
+            if (pool.generation != generation)
+            {
+                outdated.swap(pool.idle);
+                pool.image.reset();
+                pool.generation = generation;
+            }
+            if (!pool.idle.empty())
+            {
+                auto connection = std::move(pool.idle.back());
+                pool.idle.pop_back();
+                return Reader(std::move(connection));
+            }
+            image = pool.image;
+        }
+
+        // serialized once per generation, works for page encrypted databases on disk as well
+        if (!image)
+        {
+            auto copy = std::make_shared<Reader::Image>();
+            copy->data = sqlite3_serialize(db->connection().get(), "main", &copy->size, 0);
+            if (!copy->data)
+            {
+                return {};
+            }
+
+            image = copy;
+            std::lock_guard<std::mutex> pool_lock(pool.mutex);
+            pool.image = std::move(copy);
+        }
+    }
+
+    // every reader deserializes its own copy of the image, the database is free to change meanwhile
+    auto connection = std::make_unique<Reader::Connection>();
+    connection->generation = generation;
+    connection->cipher = std::move(cipher);
+    try {
+        connection->db = std::make_unique<sqlite::database>(":memory:");
+        tuning.foreignKeys = false;
+        applyTuning(*connection->db, tuning);
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    auto data = static_cast<unsigned char*>(sqlite3_malloc64(static_cast<sqlite3_uint64>(image->size)));
+    if (!data)
+    {
+        return {};
+    }
+    std::memcpy(data, image->data, static_cast<std::size_t>(image->size));
+    if (sqlite3_deserialize(connection->db->connection().get(), "main", data, image->size, image->size,
+                            SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_READONLY) != SQLITE_OK)
+    {
+        return {};
+    }
+
+    return Reader(std::move(connection));
+}
+
+TokenDatabase::Reader TokenDatabase::exportReader()
+{
+    // pages copied per step of the online backup, the mutex is released between the steps
+    static const constexpr int EXPORT_STEP_PAGES = 256;
+
+    auto connection = std::make_unique<Reader::Connection>();
+    const sqlite::database *original = nullptr;
+    sqlite3_backup *backup = nullptr;
+    {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (!db_status)
+        {
+            return {};
+        }
+
+        auto tuning = imageTuning;
+        try {
+            connection->db = std::make_unique<sqlite::database>(":memory:");
+            tuning.foreignKeys = false;
+            applyTuning(*connection->db, tuning);
+        } catch (sqlite::sqlite_exception &) {
+            return {};
+        }
+
+        original = db.get();
+        backup = sqlite3_backup_init(connection->db->connection().get(), "main", db->connection().get(), "main");
+        if (!backup)
+        {
+            return {};
+        }
+    }
+
+    // changes through the database connection are carried into the copy by sqlite, so the copy
+    // holds the state of the last step; writers which keep restarting it get the rest in one step
+    // sqlite can't copy uncommitted pages, so page encrypted databases with unsaved changes
+    // are copied at once like the readers
+    auto steps = 0;
+    auto done = false;
+    while (!done)
+    {
+        {
+            std::lock_guard<std::recursive_mutex> lock(db_mutex);
+            if (!db_status || db.get() != original)
+            {
+                (void) sqlite3_backup_finish(backup);
+                return {};
+            }
+
+            const auto restarted = ++steps > 2 * (sqlite3_backup_pagecount(backup) / EXPORT_STEP_PAGES + 8);
+            const auto result = sqlite3_backup_step(backup, restarted ? -1 : EXPORT_STEP_PAGES);
+            if (result == SQLITE_DONE)
+            {
+                // the copy and the cipher of the secrets belong to the same state
+                connection->generation = db_generation.load(std::memory_order_relaxed);
+                connection->cipher = secretCipher();
+                done = true;
+            }
+            else if (result == SQLITE_BUSY || result == SQLITE_LOCKED)
+            {
+                (void) sqlite3_backup_finish(backup);
+                return reader();
+            }
+            else if (result != SQLITE_OK)
+            {
+                (void) sqlite3_backup_finish(backup);
+                return {};
+            }
+        }
+        std::this_thread::yield();
+    }
+
+    if (sqlite3_backup_finish(backup) != SQLITE_OK)
+    {
+        return {};
+    }
+    return Reader(std::move(connection));
+}
+
+TokenDatabase::Reader::Reader() = default;
+
+TokenDatabase::Reader::Reader(std::unique_ptr<Connection> connection)
+    : _connection(std::move(connection))
+{
+}
+
+TokenDatabase::Reader::~Reader()
+{
+    if (!this->_connection)
+    {
+        return;
+    }
+
+    // connections of the current generation are kept for the next reader
+    auto &pool = Reader::pool();
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    if (this->_connection->generation == pool.generation &&
+        this->_connection->generation == db_generation.load(std::memory_order_relaxed) &&
+        pool.idle.size() < Pool::MAX_IDLE)
+    {
+        pool.idle.emplace_back(std::move(this->_connection));
+        return;
+    }
+    lock.unlock();
+    this->_connection.reset();
+}
+
+TokenDatabase::Reader::Reader(Reader &&other) noexcept = default;
+TokenDatabase::Reader &TokenDatabase::Reader::operator= (Reader &&other) noexcept
+{
+    if (this != &other)
+    {
+        Reader released(std::move(*this));
+        this->_connection = std::move(other._connection);
+    }
+    return *this;
+}
+
+bool TokenDatabase::Reader::isCurrent() const
+{
+    return this->_connection && this->_connection->generation == db_generation.load(std::memory_order_relaxed);
+}
+
+OTPToken TokenDatabase::Reader::selectToken(const OTPToken::sqliteTokenID &id)
+{
+    if (!this->_connection)
+    {
+        return {};
+    }
+
+    return selectTokenRow(*this->_connection->db, this->_connection->statements, *this->_connection->cipher, id);
+}
+
+OTPToken TokenDatabase::Reader::selectToken(const OTPToken::Label &label)
+{
+    if (!this->_connection)
+    {
+        return {};
+    }
+
+    // the label column compares like the keys of the label arena
+    OTPToken::sqliteTokenID id = 0;
+    try {
+        cachedStatement(*this->_connection->db, this->_connection->statements, "select id from tokens where label = ? limit 1;",
+                        [&](sqlite::database_binder &query) {
+            query << label;
+            query >> [&](const OTPToken::sqliteTokenID &row) {
+                id = row;
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    return id == 0 ? OTPToken() : this->selectToken(id);
+}
+
+TokenDatabase::OTPTokenList TokenDatabase::Reader::selectTokens(const OTPToken::sqliteTypesID &type, bool withIcons)
+{
+    if (!this->_connection)
+    {
+        return {};
+    }
+
+    OTPTokenList tokens;
+    const auto status = selectTokenRows(*this->_connection->db, this->_connection->statements, *this->_connection->cipher, type, [&](OTPToken &token) {
+        tokens.emplace_back(std::move(token));
+    }, withIcons);
+    if (status != Success)
+    {
+        return {};
+    }
+
+    return tokens;
+}
+
+TokenDatabase::Error TokenDatabase::Reader::forEachToken(const OTPToken::sqliteTypesID &type, const TokenCallback &callback, bool withIcons)
+{
+    if (!this->_connection)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    return selectTokenRows(*this->_connection->db, this->_connection->statements, *this->_connection->cipher, type, [&](OTPToken &token) {
+        callback(token);
+    }, withIcons);
+}
+
+TokenDatabase::Error TokenDatabase::Reader::selectTokenSet(TokenSet &set, const OTPToken::sqliteTypesID &type, bool withIcons)
+{
+    set.clear();
+    if (!this->_connection)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    set.reserve(static_cast<std::size_t>(std::max<OTPToken::sqliteTokenID>(this->tokenCount(type), 0)));
+    const auto status = selectTokenRows(*this->_connection->db, this->_connection->statements, *this->_connection->cipher, type, [&](OTPToken &token) {
+        set.insert(std::move(token));
+    }, withIcons);
+    if (status != Success)
+    {
+        set.clear();
+    }
+    return status;
+}
+
+OTPToken::sqliteTokenID TokenDatabase::Reader::tokenCount(const OTPToken::sqliteTypesID &type)
+{
+    if (!this->_connection)
+    {
+        return 0;
+    }
+
+    return countTokens(*this->_connection->db, this->_connection->statements, type);
+}
+
+struct TokenDatabase::Vault
+{
+    std::shared_ptr<sqlite::database> db;
+    bool status = false;
+    bool paged = false;
+    std::string pagedPath;
+    bool savePending = false;
+    bool lastWriteValid = false;
+    std::chrono::steady_clock::time_point lastWrite;
+    StatementMap statements;
+    Internal::RawStatementMap rawStatements;
+    std::shared_ptr<LabelArena> labels = std::make_shared<LabelArena>();
+    std::unordered_map<LabelArena::Id, OTPToken::sqliteTokenID> labelIds;
+    bool labelIdsValid = false;
+    std::array<OTPToken::sqliteTokenID, OTPToken::Steam + 1> typeCounts{};
+    bool typeCountsValid = false;
+    IconCacheList iconLru;
+    std::unordered_map<OTPToken::sqliteTokenID, IconCacheList::iterator> icons;
+    bool dirty = false;
+    FileStamp fileStamp;
+    std::unique_ptr<Internal::CounterJournal> counters;
+    std::shared_ptr<const Internal::SecretCipher> secretCipher;
+    bool secretHashesValid = false;
+
+    SecureString password;
+    std::string path;
+    StorageFormat format = EncryptedImage;
+};
+
+struct TokenDatabase::Vaults
+{
+    std::string selected;
+    std::map<std::string, std::unique_ptr<Vault>> parked;
+};
+
+TokenDatabase::Vaults &TokenDatabase::vaultRegistry()
+{
+    static Vaults vaults;
+    return vaults;
+}
+
+void TokenDatabase::publishChanges()
+{
+    if (db_events.empty())
+    {
+        return;
+    }
+
+    // observers may add or remove observers and make changes of their own
+    const auto events = std::make_shared<const ChangeEvents>(std::move(db_events));
+    db_events.clear();
+    db_event_mark = 0;
+
+    const auto vault = std::make_shared<const std::string>(vaultRegistry().selected);
+    const auto observers = db_observers;
+    for (auto&& entry : observers)
+    {
+        if (entry.dispatcher)
+        {
+            const auto observer = entry.observer;
+            entry.dispatcher([observer, vault, events] {
+                observer(*vault, *events);
+            });
+        }
+        else
+        {
+            entry.observer(*vault, *events);
+        }
+    }
+}
+
+void TokenDatabase::exchangeVault(Vault &vault)
+{
+    // events always belong to the vault they were made in
+    publishChanges();
+
+    // the iterators of the icon cache stay valid, swapped lists keep their nodes
+    std::swap(db, vault.db);
+    std::swap(db_status, vault.status);
+    std::swap(db_paged, vault.paged);
+    std::swap(db_paged_path, vault.pagedPath);
+    std::swap(db_save_pending, vault.savePending);
+    std::swap(db_last_write_valid, vault.lastWriteValid);
+    std::swap(db_last_write, vault.lastWrite);
+    std::swap(db_statements, vault.statements);
+    std::swap(db_raw_statements, vault.rawStatements);
+    std::swap(db_labels, vault.labels);
+    std::swap(db_label_ids, vault.labelIds);
+    std::swap(db_label_ids_valid, vault.labelIdsValid);
+    std::swap(db_type_counts, vault.typeCounts);
+    std::swap(db_type_counts_valid, vault.typeCountsValid);
+    std::swap(db_icon_lru, vault.iconLru);
+    std::swap(db_icons, vault.icons);
+    std::swap(db_dirty, vault.dirty);
+    std::swap(db_file_stamp, vault.fileStamp);
+    std::swap(db_counters, vault.counters);
+    std::swap(db_secret_cipher, vault.secretCipher);
+    std::swap(db_secret_hashes_valid, vault.secretHashesValid);
+    std::swap(databasePassword, vault.password);
+    std::swap(databasePath, vault.path);
+    std::swap(databaseFormat, vault.format);
+
+    // page encrypted databases keep the key they were opened with, only new ones use this password
+    Internal::setEncryptedVfsPassword(databasePassword);
+    invalidateReaders();
+}
+
+bool TokenDatabase::selectVault(const std::string &name, bool create)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto &vaults = vaultRegistry();
+    if (name == vaults.selected)
+    {
+        return true;
+    }
+
+    auto it = vaults.parked.find(name);
+    if (it == vaults.parked.end())
+    {
+        if (!create)
+        {
+            return false;
+        }
+        auto vault = std::make_unique<Vault>();
+        vault->format = databaseFormat;
+        it = vaults.parked.emplace(name, std::move(vault)).first;
+    }
+
+    // the scheduler only saves the selected vault
+    (void) flushTokens();
+
+    auto vault = std::move(it->second);
+    vaults.parked.erase(it);
+    exchangeVault(*vault);
+    vaults.parked.emplace(vaults.selected, std::move(vault));
+    vaults.selected = name;
+    return true;
+}
+
+bool TokenDatabase::closeVault(const std::string &name)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto &vaults = vaultRegistry();
+    const auto previous = vaults.selected;
+    if (!selectVault(name))
+    {
+        return false;
+    }
+
+    closeDatabase();
+    if (name.empty())
+    {
+        (void) selectVault(previous);
+        return true;
+    }
+
+    // forget the key of the removed vault, the other vaults keep theirs
+    Internal::clearContainerKey(databasePassword);
+    (void) selectVault(previous == name ? std::string() : previous);
+    vaults.parked.erase(name);
+    return true;
+}
+
+const std::string TokenDatabase::selectedVault()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    return vaultRegistry().selected;
+}
+
+std::vector<std::string> TokenDatabase::vaults()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto &vaults = vaultRegistry();
+    std::vector<std::string> names;
+    names.reserve(vaults.parked.size() + 1);
+    for (auto&& vault : vaults.parked)
+    {
+        names.emplace_back(vault.first);
+    }
+    names.insert(std::upper_bound(names.begin(), names.end(), vaults.selected), vaults.selected);
+    return names;
+}
+
+void TokenDatabase::forEachVault(const VaultCallback &callback)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    const auto previous = vaultRegistry().selected;
+    for (auto&& name : vaults())
+    {
+        // closed vaults are skipped without being selected
+        const auto &parked = vaultRegistry().parked;
+        const auto it = parked.find(name);
+        if (it != parked.end() && !it->second->status)
+        {
+            continue;
+        }
+
+        (void) selectVault(name);
+        if (db_status)
+        {
+            callback(name);
+        }
+    }
+    (void) selectVault(previous);
+}
+
+std::vector<TokenDatabase::VaultToken> TokenDatabase::searchVaults(const OTPToken::Label &label_like)
+{
+    std::vector<VaultToken> results;
+    forEachVault([&](const std::string &vault) {
+        for (auto&& token : selectTokens(label_like))
+        {
+            results.emplace_back(VaultToken{vault, std::move(token)});
+        }
+    });
+    return results;
+}
+
+TokenDatabase::Error TokenDatabase::computeVaultCodes(const std::time_t &time, std::vector<VaultCode> &out,
+                                                      const OTPToken::sqliteTypesID &type)
+{
+    out.clear();
+    auto status = Success;
+    TokenSet set;
+    std::vector<OTPToken::TokenString> codes;
+    std::vector<OTPGenErrorCode> errors;
+    forEachVault([&](const std::string &vault) {
+        const auto selected = selectTokenSet(set, type);
+        if (selected != Success)
+        {
+            if (status == Success)
+            {
+                status = selected;
+            }
+            return;
+        }
+
+        // the codes are generated in batches, grouped by the generation parameters
+        set.computeCodes(time, codes, &errors, db_executor);
+        out.reserve(out.size() + set.size());
+        for (auto i = 0U; i < set.size(); ++i)
+        {
+            out.emplace_back(VaultCode{vault, set.id(i), set.label(i), std::move(codes[i]), errors[i]});
+        }
+    });
+    return status;
+}
+
+TokenDatabase::Error TokenDatabase::bootstrapDatabase()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // create tables to store types and algorithms
+    for (auto&& table : {"types", "algorithms"})
+    {
+        auto res = createTable(table, {
+            {"id",   "int(1) PRIMARY KEY NOT NULL"},
+            {"name", "text UNIQUE"},
+        });
+        if (res != Success)
+        {
+            return res;
+        }
+    }
+
+    // insert static types
+    auto res = insertStaticValues("types", {
+        {OTPToken::TOTP,  std::string(OTPToken::typeName(OTPToken::TOTP))},
+        {OTPToken::HOTP,  std::string(OTPToken::typeName(OTPToken::HOTP))},
+        {OTPToken::Steam, std::string(OTPToken::typeName(OTPToken::Steam))},
+    });
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // insert static algorithms
+    res = insertStaticValues("algorithms", {
+        {OTPToken::SHA1,   std::string(OTPToken::algorithmName(OTPToken::SHA1))},
+        {OTPToken::SHA256, std::string(OTPToken::algorithmName(OTPToken::SHA256))},
+        {OTPToken::SHA512, std::string(OTPToken::algorithmName(OTPToken::SHA512))},
+    });
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create config table
+    res = createTable("config", {
+        {"id",   "text PRIMARY KEY NOT NULL"},
+        {"data", "blob"},
+    });
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // store database version into config
+    res = storeDatabaseVersion();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create table to store the tokens
+    res = createTokenTable("tokens");
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create table to store the sort order (display order)
+    res = createDisplayOrderTable();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create table to store the icons
+    res = createIconTable();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create table to store the icon thumbnails
+    res = createThumbnailTable();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create table to log the changes
+    res = createChangeLogTable();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create table to store the learned clock drift
+    res = createClockDriftTable();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create the full text index of the labels
+    res = createSearchTable();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create the issuer index and the table of the tags
+    res = createGroupTables();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // create the index of the secret hashes
+    res = createSecretHashIndex();
+    if (res != Success)
+    {
+        return res;
+    }
+
+    // the schema is known to be valid
+    return storeSchemaFingerprint();
+}
+
+TokenDatabase::Error TokenDatabase::createTable(const std::string &table_name, const std::vector<SchemaField> &schema, const std::string &additional)
+{
+    // prepare schema
+    std::string definitions;
+    for (auto&& s : schema)
+    {
+        definitions += sanitizeQuery("%Q %s, ", s.name.c_str(), s.datatype.c_str());
+    }
+    definitions.erase(definitions.find_last_of(','));
+
+    // add additional content to query
+    if (!additional.empty())
+    {
+        definitions += ", " + additional;
+    }
+
+    return createTable(table_name, definitions);
+}
+
+TokenDatabase::Error TokenDatabase::createTable(const std::string &table_name, std::string_view definitions)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // sanitize table name
+    auto query = sanitizeQuery("create table %Q ", table_name.c_str());
+    query += "(";
+    query += definitions;
+    query += ");";
+
+    // execute query
+    try {
+        (*db) << query;
+    } catch (sqlite::sqlite_exception &) {
+        return SqlSystemTableCreationError;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::insertStaticValues(const std::string &table_name, const std::vector<StaticValueSet> &values)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // sanitize table name
+    auto query = sanitizeQuery("insert into %Q ", table_name.c_str());
+
+    // prepare values
+    query += "values ";
+    for (auto&& v : values)
+    {
+        query += sanitizeQuery("(%u, %Q), ", v.id, v.value.c_str());
+    }
+    query.erase(query.find_last_of(','));
+
+    // finalize query
+    query += ";";
+
+    // execute query
+    try {
+        (*db) << query;
+    } catch (sqlite::sqlite_exception &) {
+        return SqlStaticRecordCreationError;
+    }
+
+    return Success;
+}
+
+const std::string TokenDatabase::escapeStringLIKE(const std::string &input)
+{
+    // escape string to match absolute in a SQL LIKE expression
+    // ... LIKE "input" ESCAPE '\';
+    std::string str = input;
+    for (auto i = 0U; i < str.size(); ++i)
+    {
+        if (str.at(i) == '%')
+        {
+            str.replace(i, 1, "\\%");
+            ++i;
+        }
+        else if (str.at(i) == '_')
+        {
+            str.replace(i, 1, "\\_");
+            ++i;
+        }
+        else if (str.at(i) == '\\')
+        {
+            str.replace(i, 1, "\\\\");
+            ++i;
+        }
+    }
+    return str;
+}
+
+TokenDatabase::Error TokenDatabase::storeDatabaseVersion()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // prepare statement
+    try {
+        cachedStatement("insert into config values (?, ?);", [&](sqlite::database_binder &query) {
+            query << "database" << std::vector<std::uint32_t>{DATABASE_VERSION};
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::updateDatabaseVersion(const std::uint32_t &version)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        cachedStatement("update config set data=? where id = ?;", [&](sqlite::database_binder &query) {
+            query << std::vector<std::uint32_t>{version} << "database";
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::getDatabaseVersion(std::uint32_t &version)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // prepare statement
+    std::vector<std::uint32_t> data;
+
+    try {
+        cachedStatement("select data from config where id = ? limit 1;", [&](sqlite::database_binder &query) {
+            query << "database";
+            query >> data;
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    if (data.empty())
+    {
+        // assume user manipulation when this field is empty or
+        // doesn't contain a serialized std::vector<>
+        return SqlSchemaValidationFailed;
+    }
+
+    // the database version is the first element
+    version = data.at(0);
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::schemaFingerprint(std::vector<unsigned char> &fingerprint)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    CryptoPP::SHA256 hash;
+    try {
+        // the fields are separated by their terminating null character,
+        // automatic indices have no SQL and only contribute their name
+        (*db) << "select type, name, tbl_name, coalesce(sql, '') from sqlite_master order by type, name;"
+              >> [&](const std::string &type, const std::string &name, const std::string &table, const std::string &sql)
+        {
+            for (auto&& field : {&type, &name, &table, &sql})
+            {
+                hash.Update(reinterpret_cast<const unsigned char*>(field->c_str()), field->size() + 1);
+            }
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    fingerprint.resize(hash.DigestSize());
+    hash.Final(fingerprint.data());
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::storeSchemaFingerprint()
+{
+    std::vector<unsigned char> fingerprint;
+    auto status = schemaFingerprint(fingerprint);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    try {
+        cachedStatement("insert or replace into config values (?, ?);", [&](sqlite::database_binder &query) {
+            query << "schema" << fingerprint;
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+bool TokenDatabase::schemaFingerprintMatches()
+{
+    std::vector<unsigned char> fingerprint;
+    if (schemaFingerprint(fingerprint) != Success)
+    {
+        return false;
+    }
+
+    std::vector<unsigned char> stored;
+    try {
+        cachedStatement("select data from config where id = ? limit 1;", [&](sqlite::database_binder &query) {
+            query << "schema";
+            query >> stored;
+        });
+    } catch (sqlite::sqlite_exception &) {
+        // no record in databases which were never validated
+        return false;
+    }
+
+    return stored == fingerprint;
+}
+
+TokenDatabase::Error TokenDatabase::createDisplayOrderTable()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    auto res = createTable("token_order", {
+        {"id",       "INTEGER PRIMARY KEY NOT NULL"},
+        {"position", "INTEGER NOT NULL"},
+    },
+        "FOREIGN KEY(id) REFERENCES tokens(id)");
+    if (res != Success)
+    {
+        return res;
+    }
+
+    try {
+        (*db) << "create index token_order_position on token_order (position);";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlSystemTableCreationError;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::updateDisplayOrder(const DisplayOrder &order)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // rewrite all positions in a single transaction, this also restores the gaps
+    try {
+        (*db) << "savepoint token_database;";
+        cachedStatement("delete from token_order;", [&](sqlite::database_binder &query) {
+            query.execute();
+        });
+        cachedStatement("insert into token_order values (?, ?);", [&](sqlite::database_binder &query) {
+            OTPToken::sqliteLongID position = 0;
+            for (auto&& id : order)
+            {
+                position += DISPLAY_ORDER_GAP;
+                query << id << position;
+                query.execute();
+            }
+        });
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        return SqlDisplayOrderUpdateFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::getDisplayOrder(DisplayOrder &order)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    order.clear();
+
+    try {
+        cachedStatement("select id from token_order order by position;", [&](sqlite::database_binder &query) {
+            query >> [&](const OTPToken::sqliteSortOrder &id) {
+                order.emplace_back(id);
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderGetFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::checkDisplayOrder(bool repair, std::size_t *repaired)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (repaired)
+    {
+        *repaired = 0U;
+    }
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // both are lookups of the primary keys, tokens without a position are usually none
+    OTPToken::sqliteLongID dead = 0;
+    std::vector<OTPToken::sqliteTokenID> missing;
+    try {
+        cachedStatement("select count(*) from token_order where not exists "
+                        "(select 1 from tokens where tokens.id = token_order.id);", [&](sqlite::database_binder &query) {
+            query >> dead;
+        });
+        cachedStatement("select id from tokens where not exists "
+                        "(select 1 from token_order where token_order.id = tokens.id) order by id;", [&](sqlite::database_binder &query) {
+            query >> [&](const OTPToken::sqliteTokenID &id) {
+                missing.emplace_back(id);
+            };
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderGetFailed;
+    }
+
+    if (dead == 0 && missing.empty())
+    {
+        return Success;
+    }
+    if (!repair)
+    {
+        return SqlDisplayOrderIncomplete;
+    }
+
+    try {
+        (*db) << "savepoint token_database;";
+        cachedStatement("delete from token_order where not exists "
+                        "(select 1 from tokens where tokens.id = token_order.id);", [&](sqlite::database_binder &query) {
+            query.execute();
+        });
+        OTPToken::sqliteLongID position = 0;
+        cachedStatement("select coalesce(max(position), 0) from token_order;", [&](sqlite::database_binder &query) {
+            query >> position;
+        });
+        for (auto&& id : missing)
+        {
+            position += DISPLAY_ORDER_GAP;
+            cachedStatement("insert into token_order values (?, ?);", [&](sqlite::database_binder &query) {
+                query << id << position;
+                query.execute();
+            });
+        }
+        recordChange(ChangeOrder, 0);
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        return SqlDisplayOrderUpdateFailed;
+    }
+
+    if (repaired)
+    {
+        *repaired = static_cast<std::size_t>(dead) + missing.size();
+    }
+    markDirty();
+    notifyChange(ChangeEvent::Reordered, 0);
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::getDisplayPosition(const OTPToken::sqliteTokenID &id, OTPToken::sqliteLongID &position)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        cachedStatement("select position from token_order where id = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query >> position;
+        });
+    } catch (sqlite::errors::no_rows &) {
+        return SqlDisplayOrderIncomplete;
+    } catch (sqlite::sqlite_exception &) {
+        return SqlDisplayOrderGetFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::moveDisplayPosition(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteTokenID &target, bool below)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    OTPToken::sqliteLongID position = 0;
+    auto status = getDisplayPosition(id, position);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // a second attempt is only required after renumbering the positions
+    ChangeBatch batch;
+    for (auto attempt = 0; attempt < 2; ++attempt)
+    {
+        OTPToken::sqliteLongID targetPosition = 0;
+        status = getDisplayPosition(target, targetPosition);
+        if (status != Success)
+        {
+            return status;
+        }
+
+        // nearest neighbour of the target on the side the token is moved to
+        auto found = false;
+        OTPToken::sqliteLongID neighbour = 0;
+        try {
+            const auto neighbourQuery = below ?
+                "select position from token_order where position > ? and id != ? order by position asc limit 1;" :
+                "select position from token_order where position < ? and id != ? order by position desc limit 1;";
+            cachedStatement(neighbourQuery, [&](sqlite::database_binder &query) {
+                query << targetPosition << id;
+                query >> [&](const OTPToken::sqliteLongID &p) {
+                    found = true;
+                    neighbour = p;
+                };
+            });
+        } catch (sqlite::sqlite_exception &) {
+            return SqlDisplayOrderGetFailed;
+        }
+
+        if (!found)
+        {
+            position = below ? targetPosition + DISPLAY_ORDER_GAP : targetPosition - DISPLAY_ORDER_GAP;
+        }
+        else if (std::abs(neighbour - targetPosition) >= 2)
+        {
+            position = targetPosition + (neighbour - targetPosition) / 2;
+        }
+        else
+        {
+            // the gap is used up, renumber all positions and try again
+            DisplayOrder order;
+            status = getDisplayOrder(order);
+            if (status != Success)
+            {
+                return status;
+            }
+            status = updateDisplayOrder(order);
+            if (status != Success)
+            {
+                return status;
+            }
+            markDirty();
+            try {
+                recordChange(ChangeOrder, 0);
+            } catch (sqlite::sqlite_exception &) {
+                return SqlDisplayOrderUpdateFailed;
+            }
+            notifyChange(ChangeEvent::Reordered, 0);
+            continue;
+        }
+
+        try {
+            cachedStatement("update token_order set position = ? where id = ?;", [&](sqlite::database_binder &query) {
+                query << position << id;
+                query.execute();
+            });
+            recordChange(ChangeMove, id);
+        } catch (sqlite::sqlite_exception &) {
+            return SqlDisplayOrderUpdateFailed;
+        }
+        notifyChange(ChangeEvent::Moved, id);
+
+        markDirty();
+        return Success;
+    }
+
+    return SqlDisplayOrderUpdateFailed;
+}
+
+TokenDatabase::Error TokenDatabase::createTokenTable(const std::string &table_name)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    return createTable(table_name, Internal::TokenSchema::DEFINITIONS.view());
+}
+
+TokenDatabase::Error TokenDatabase::createIconTable()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    return createTable("icons", {
+        {"hash", "blob PRIMARY KEY NOT NULL"},
+        {"data", "blob NOT NULL"},
+    });
+}
+
+TokenDatabase::Error TokenDatabase::createThumbnailTable()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // looked up by the icon hash and the size only
+    try {
+        (*db) << "create table icon_thumbnails (hash blob NOT NULL, size INTEGER NOT NULL, data blob NOT NULL, "
+                 "PRIMARY KEY(hash, size)) without rowid;";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlSystemTableCreationError;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::removeUnusedIcons()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        cachedStatement("delete from icons where hash not in (select icon from tokens where icon is not null);", [&](sqlite::database_binder &query) {
+            query.execute();
+        });
+        cachedStatement("delete from icon_thumbnails where hash not in (select hash from icons);", [&](sqlite::database_binder &query) {
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::createChangeLogTable()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // autoincrement never reuses sequence numbers, not even after pruning the log
+    return createTable("changelog", {
+        {"seq",   "INTEGER PRIMARY KEY AUTOINCREMENT"},
+        {"token", "INTEGER NOT NULL"},
+        {"op",    "int(1) NOT NULL"},
+    });
+}
+
+void TokenDatabase::recordChange(const std::uint8_t &op, const OTPToken::sqliteTokenID &id)
+{
+    cachedStatement("insert into changelog (token, op) values (?, ?);", [&](sqlite::database_binder &query) {
+        query << id << static_cast<int>(op);
+        query.execute();
+    });
+}
+
+TokenDatabase::Error TokenDatabase::createClockDriftTable()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    return createTable("token_drift", {
+        {"id",    "INTEGER PRIMARY KEY NOT NULL"},
+        {"drift", "INTEGER NOT NULL"},
+    });
+}
+
+TokenDatabase::Error TokenDatabase::createSearchTable()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // the index refers to the rows of the tokens table, the triggers keep it in sync with
+    // every write to the labels, including the ones of deltas and migrations
+    try {
+        (*db) << "create virtual table token_search using fts5 "
+                 "(label, content = 'tokens', content_rowid = 'id', prefix = '1 2');";
+        (*db) << "create trigger token_search_insert after insert on tokens begin "
+                 "insert into token_search (rowid, label) values (new.id, new.label); end;";
+        (*db) << "create trigger token_search_delete after delete on tokens begin "
+                 "insert into token_search (token_search, rowid, label) values ('delete', old.id, old.label); end;";
+        (*db) << "create trigger token_search_update after update of label on tokens when old.label is not new.label begin "
+                 "insert into token_search (token_search, rowid, label) values ('delete', old.id, old.label); "
+                 "insert into token_search (rowid, label) values (new.id, new.label); end;";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlSystemTableCreationError;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::createGroupTables()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // the primary key finds the tags of a token, the indices the tokens of a group, inserts into
+    // tables without rowid leave the last insert rowid of the token alone
+    try {
+        (*db) << "create table token_tags (token INTEGER NOT NULL, tag text NOT NULL COLLATE NOCASE, "
+                 "PRIMARY KEY(token, tag), FOREIGN KEY(token) REFERENCES tokens(id)) without rowid;";
+        (*db) << "create index token_tags_tag on token_tags (tag);";
+        (*db) << "create index tokens_issuer on tokens (issuer);";
+        (*db) << "create trigger token_tags_delete after delete on tokens begin "
+                 "delete from token_tags where token = old.id; end;";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlSystemTableCreationError;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::createSecretHashIndex()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // tokens without a hash aren't looked up and stay out of the index
+    try {
+        (*db) << "create index tokens_secret_hash on tokens (secret_hash) where secret_hash is not null;";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlSystemTableCreationError;
+    }
+
+    return Success;
+}
+
+void TokenDatabase::storeTags(const OTPToken::sqliteTokenID &id, const OTPToken::Tags &tags, bool replace)
+{
+    if (replace)
+    {
+        cachedStatement("delete from token_tags where token = ?;", [&](sqlite::database_binder &query) {
+            query << id;
+            query.execute();
+        });
+    }
+    if (tags.empty())
+    {
+        return;
+    }
+
+    // tags which only differ in case are stored once
+    cachedStatement("insert or ignore into token_tags values (?, ?);", [&](sqlite::database_binder &query) {
+        for (auto&& tag : tags)
+        {
+            query << id << tag;
+            query.execute();
+        }
+    });
+}
+
+TokenDatabase::Error TokenDatabase::migrateDatabase(const std::uint32_t &version)
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // ordered by version, a step must detect on its own if its change is already there,
+    // a missing version record runs all of them
+    static const MigrationStep steps[] = {
+        {0x0f000006, &TokenDatabase::migrateDisplayOrder},
+        {0x0f000007, &TokenDatabase::migrateIcons},
+        {0x0f000008, &TokenDatabase::migrateTokenColumns},
+        {0x0f000009, &TokenDatabase::migrateChangeLog},
+        {0x0f00000a, &TokenDatabase::migrateClockDrift},
+        {0x0f00000b, &TokenDatabase::migrateSearchIndex},
+        {0x0f00000c, &TokenDatabase::migrateTokenGroups},
+        {0x0f00000d, &TokenDatabase::migrateSecrets},
+        {0x0f00000e, &TokenDatabase::migrateThumbnails},
+        {0x0f00000f, &TokenDatabase::migrateSecretHashes},
+    };
+
+    // databases of newer releases are left as they are, validateSchema() decides about them
+    if (version >= DATABASE_VERSION)
+    {
+        return Success;
+    }
+
+    auto migrated = false;
+    for (auto&& step : steps)
+    {
+        if (version >= step.version)
+        {
+            continue;
+        }
+
+        try {
+            (*db) << "savepoint database_migration;";
+        } catch (sqlite::sqlite_exception &) {
+            return SqlExecutionFailed;
+        }
+
+        auto status = step.upgrade();
+        if (status == Success)
+        {
+            status = updateDatabaseVersion(step.version);
+        }
+
+        try {
+            if (status != Success)
+            {
+                (*db) << "rollback to database_migration;";
+            }
+            (*db) << "release database_migration;";
+        } catch (sqlite::sqlite_exception &) {
+            status = status == Success ? SqlExecutionFailed : status;
+        }
+
+        if (status != Success)
+        {
+            db_statements.clear();
+            db_raw_statements.clear();
+            invalidateLabelIds();
+            invalidateTypeCounts();
+            return status;
+        }
+        migrated = true;
+    }
+
+    if (migrated)
+    {
+        // the cached statements were prepared against the old tables
+        db_statements.clear();
+        db_raw_statements.clear();
+        invalidateLabelIds();
+        invalidateTypeCounts();
+
+        // release the pages of the old tables once, the database is still usable without it,
+        // this fails in the open transaction of page encrypted databases which are compacted on save
+        try {
+            (*db) << "vacuum;";
+        } catch (sqlite::sqlite_exception &) {}
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::migrateDisplayOrder()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        int tables = 0;
+        (*db) << "select count(*) from sqlite_master where type = 'table' and name = 'token_order';" >> tables;
+        if (tables != 0)
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    // read the old display order blob, a missing or broken record results in the id order
+    DisplayOrder old_order;
+    try {
+        (*db) << "select data from config where id = 'order' limit 1;" >> old_order;
+    } catch (sqlite::sqlite_exception &) {
+        old_order.clear();
+    }
+
+    // keep all existing tokens, ids which are not part of the old order are appended
+    DisplayOrder ids;
+    try {
+        (*db) << "select id from tokens order by id asc;" >> [&](const OTPToken::sqliteSortOrder &id) {
+            ids.emplace_back(id);
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    DisplayOrder order;
+    std::unordered_set<OTPToken::sqliteSortOrder> seen;
+    for (auto&& id : old_order)
+    {
+        if (std::binary_search(ids.begin(), ids.end(), id) && seen.insert(id).second)
+        {
+            order.emplace_back(id);
+        }
+    }
+    for (auto&& id : ids)
+    {
+        if (seen.insert(id).second)
+        {
+            order.emplace_back(id);
+        }
+    }
+
+    auto status = createDisplayOrderTable();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    status = updateDisplayOrder(order);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    try {
+        (*db) << "delete from config where id = 'order';";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::migrateIcons()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        int tables = 0;
+        (*db) << "select count(*) from sqlite_master where type = 'table' and name = 'icons';" >> tables;
+        if (tables != 0)
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    auto status = createIconTable();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // move the icons of all tokens into the icons table, duplicates are stored once
+    try {
+        std::vector<std::pair<OTPToken::sqliteTokenID, OTPToken::Icon>> icons;
+        (*db) << "select id, icon from tokens where length(icon) > 0;" >> [&](const OTPToken::sqliteTokenID &id, const OTPToken::Icon &icon) {
+            icons.emplace_back(id, icon);
+        };
+
+        auto update = (*db) << "update tokens set icon = ? where id = ?;";
+        for (auto&& icon : icons)
+        {
+            update << storeIcon(icon.second) << icon.first;
+            update.execute();
+        }
+        update.used(true);
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::migrateTokenColumns()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // digits, period and counter were stored as serialized std::vector<> BLOBs,
+    // don't touch the table if the version record is wrong
+    try {
+        std::string digits_type;
+        (*db) << "select type from pragma_table_info('tokens') where name = 'digits';" >> digits_type;
+        if (digits_type != "blob")
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    // sqlite can't change the type of a column, the table is rebuilt with the new schema
+    // in a single insert, the new table is renamed afterwards so references to "tokens" stay intact
+    try {
+        auto status = createTokenTable("tokens_migrated");
+        if (status != Success)
+        {
+            return status;
+        }
+
+        // the BLOBs hold the native representation of the vector elements
+        db->define("otpgen_first_digits", [](const std::vector<OTPToken::DigitType> &v) {
+            return static_cast<int>(v.empty() ? 0U : v.front());
+        });
+        db->define("otpgen_first_u32", [](const std::vector<std::uint32_t> &v) {
+            return static_cast<sqlite3_int64>(v.empty() ? 0U : v.front());
+        });
+
+        (*db) << "insert into tokens_migrated (id, type, label, icon, secret, digits, period, counter, algorithm) "
+                 "select id, type, label, icon, secret, otpgen_first_digits(digits), otpgen_first_u32(period), "
+                 "otpgen_first_u32(counter), algorithm from tokens;";
+
+        // with enforced foreign keys dropping the tokens would violate the display order,
+        // which is moved aside until the new table is in place
+        int foreignKeys = 0;
+        (*db) << "pragma foreign_keys;" >> foreignKeys;
+        if (foreignKeys)
+        {
+            (*db) << "create temp table token_order_migrated as select * from token_order;";
+            (*db) << "delete from token_order;";
+        }
+        (*db) << "drop table tokens;";
+        (*db) << "alter table tokens_migrated rename to tokens;";
+        if (foreignKeys)
+        {
+            (*db) << "insert into token_order select * from temp.token_order_migrated;";
+            (*db) << "drop table temp.token_order_migrated;";
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::migrateChangeLog()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // the log starts empty, deltas can only be written for changes after the migration
+    try {
+        int tables = 0;
+        (*db) << "select count(*) from sqlite_master where type = 'table' and name = 'changelog';" >> tables;
+        if (tables != 0)
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return createChangeLogTable();
+}
+
+TokenDatabase::Error TokenDatabase::migrateClockDrift()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // all tokens start without a learned drift
+    try {
+        int tables = 0;
+        (*db) << "select count(*) from sqlite_master where type = 'table' and name = 'token_drift';" >> tables;
+        if (tables != 0)
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return createClockDriftTable();
+}
+
+TokenDatabase::Error TokenDatabase::migrateSearchIndex()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        int tables = 0;
+        (*db) << "select count(*) from sqlite_master where type = 'table' and name = 'token_search';" >> tables;
+        if (tables != 0)
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    auto status = createSearchTable();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // index the existing labels
+    try {
+        (*db) << "insert into token_search (token_search) values ('rebuild');";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::migrateTokenGroups()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // tables rebuilt by migrateTokenColumns() already have the issuer column
+    try {
+        int tables = 0, columns = 0;
+        (*db) << "select count(*) from sqlite_master where type = 'table' and name = 'token_tags';" >> tables;
+        if (tables != 0)
+        {
+            return Success;
+        }
+        (*db) << "select count(*) from pragma_table_info('tokens') where name = 'issuer';" >> columns;
+        if (columns == 0)
+        {
+            (*db) << "alter table tokens add column issuer text NOT NULL DEFAULT '' COLLATE NOCASE;";
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return createGroupTables();
+}
+
+TokenDatabase::Error TokenDatabase::migrateSecrets()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // mangled secrets are text, encrypted ones are BLOBs, tables without secrets are left to validateSchema()
+    const auto cipher = secretCipher();
+    try {
+        int columns = 0;
+        (*db) << "select count(*) from pragma_table_info('tokens') where name = 'secret';" >> columns;
+        if (columns == 0)
+        {
+            return Success;
+        }
+
+        std::vector<std::pair<OTPToken::sqliteTokenID, SecureBuffer>> rows;
+        (*db) << "select id, secret from tokens where typeof(secret) = 'text';"
+              >> [&](const OTPToken::sqliteTokenID &id, const SecureBuffer &secret) {
+            const auto plain = unmangleTokenSecret(OTPToken::TokenSecret(secret.begin(), secret.end()));
+            rows.emplace_back(id, SecureBuffer());
+            cipher->encrypt(plain.data(), plain.size(), rows.back().second);
+        };
+
+        auto update = (*db) << "update tokens set secret = ? where id = ?;";
+        for (auto&& row : rows)
+        {
+            update << row.second << row.first;
+            update.execute();
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::migrateThumbnails()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    try {
+        int tables = 0;
+        (*db) << "select count(*) from sqlite_master where type = 'table' and name = 'icon_thumbnails';" >> tables;
+        if (tables != 0)
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    auto status = createThumbnailTable();
+    if (status != Success || !db_icon_scaler)
+    {
+        return status;
+    }
+
+    // the icons which are already stored get their thumbnails once
+    try {
+        std::vector<std::pair<OTPToken::Icon, OTPToken::Icon>> icons;
+        (*db) << "select hash, data from icons;" >> [&](OTPToken::Icon &&hash, OTPToken::Icon &&data) {
+            icons.emplace_back(std::move(hash), std::move(data));
+        };
+        for (auto&& icon : icons)
+        {
+            storeThumbnails(icon.first, icon.second);
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::migrateSecretHashes()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // tables rebuilt by migrateTokenColumns() already have the column, the hashes of the
+    // existing rows are left to fillSecretHashes(), so loading doesn't touch every row
+    try {
+        int columns = 0, indices = 0;
+        (*db) << "select count(*) from pragma_table_info('tokens') where name = 'secret';" >> columns;
+        if (columns == 0)
+        {
+            return Success;
+        }
+        (*db) << "select count(*) from pragma_table_info('tokens') where name = 'secret_hash';" >> columns;
+        if (columns == 0)
+        {
+            (*db) << "alter table tokens add column secret_hash blob;";
+        }
+        (*db) << "select count(*) from sqlite_master where type = 'index' and name = 'tokens_secret_hash';" >> indices;
+        if (indices != 0)
+        {
+            return Success;
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return createSecretHashIndex();
+}
+
+void TokenDatabase::fillSecretHashes()
+{
+    if (db_secret_hashes_valid)
+    {
+        return;
+    }
+
+    // a single update with the hashes computed by a function of the connection, the function
+    // keeps its own reference to the cipher; the hashes are derived data like the thumbnails
+    // and are written by the next save, the rows of secrets which don't decode stay NULL
+    const auto cipher = secretCipher();
+    db->define("otpgen_secret_hash", [cipher](const SecureBuffer &secret) {
+        OTPToken::TokenSecret plain;
+        std::vector<unsigned char> hash;
+        (void) cipher->decrypt(secret.data(), secret.size(), plain);
+        secretHash(*cipher, plain, hash);
+        return hash;
+    });
+    (*db) << "update tokens set secret_hash = otpgen_secret_hash(secret) where secret_hash is null;";
+    db_secret_hashes_valid = true;
+}
+
+TokenDatabase::Error TokenDatabase::compactDatabase()
+{
+    std::int64_t pages = 0, freePages = 0, pageSize = 0;
+    try {
+        (*db) << "pragma page_count;" >> pages;
+        (*db) << "pragma freelist_count;" >> freePages;
+        (*db) << "pragma page_size;" >> pageSize;
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    const auto resize = databasePageSize != 0 && pageSize != static_cast<std::int64_t>(databasePageSize);
+    const auto fragmented = databaseCompaction > 0.0 && pages > 0 &&
+                            static_cast<double>(freePages) > databaseCompaction * static_cast<double>(pages);
+    if (!resize && !fragmented)
+    {
+        return Success;
+    }
+
+    // vacuum fails while statements are still running
+    db_statements.clear();
+    db_raw_statements.clear();
+
+    // vacuum can't change the page size of in-memory databases, the rows are copied into a new one instead
+    if (resize)
+    {
+        std::shared_ptr<sqlite::database> target;
+        try {
+            target = std::make_shared<sqlite::database>(":memory:");
+            (*target) << "pragma page_size = " + std::to_string(databasePageSize) + ";";
+            const auto status = copyDatabase(*target);
+            if (status != Success)
+            {
+                return status;
+            }
+        } catch (sqlite::sqlite_exception &) {
+            return SqlExecutionFailed;
+        }
+
+        // the ids are copied, only the connection is replaced
+        invalidateIcons();
+        db = target;
+        return Success;
+    }
+
+    try {
+        (*db) << "vacuum;";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    return Success;
+}
+
+unsigned char *TokenDatabase::serializeDatabase(std::size_t &size, bool &owned)
+{
+    // database must be open, in-memory databases are handed out without a copy,
+    // the buffer is only valid until the database is changed or closed
+    sqlite3_int64 length = 0;
+    auto data = sqlite3_serialize(db->connection().get(), "main", &length, SQLITE_SERIALIZE_NOCOPY);
+    owned = false;
+
+    // databases which are not stored in a single buffer must be copied
+    if (!data)
+    {
+        data = sqlite3_serialize(db->connection().get(), "main", &length, 0);
+        owned = data != nullptr;
+    }
+
+    size = data ? static_cast<std::size_t>(length) : 0U;
+    return data;
+}
+
+bool TokenDatabase::deserializeDatabase(unsigned char *data, std::size_t size, std::size_t capacity)
+{
+    if (!data || size == 0)
+    {
+        sqlite3_free(data);
+        return false;
+    }
+
+    // the prepared statements and caches belong to the replaced database
+    db_statements.clear();
+    db_raw_statements.clear();
+    invalidateLabelIds();
+    invalidateTypeCounts();
+    invalidateIcons();
+    invalidateReaders();
+
+    // sqlite takes ownership of the buffer (also on failure), it must be allocated by sqlite
+    // to let the database grow after loading (new tables, inserts, ...)
+    // empty database must be open
+    auto rc = sqlite3_deserialize(db->connection().get(), "main", data,
+                                  static_cast<sqlite3_int64>(size), static_cast<sqlite3_int64>(capacity),
+                                  SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE);
+    if (rc)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+TokenDatabase::Error TokenDatabase::openPagedDatabase()
+{
+    OTPGEN_PERF_TRACE("TokenDatabase::openPagedDatabase");
+    if (db_status)
+    {
+        releaseDatabase();
+    }
+
+    const auto vfs = Internal::encryptedVfs();
+    if (!vfs)
+    {
+        return SqlMemoryAllocationError;
+    }
+
+    try {
+        sqlite::sqlite_config config;
+        config.zVfs = vfs;
+        db = std::make_shared<sqlite::database>(databasePath, config);
+        applyTuning(*db, pagesTuning);
+
+        // all changes are collected in one transaction, saveTokens() commits it
+        (*db) << "begin;";
+    } catch (sqlite::sqlite_exception &e) {
+        db = nullptr;
+        db_status = false;
+
+        // the first page didn't decrypt with the key of the password
+        if ((e.get_extended_code() & 0xff) == SQLITE_NOTADB)
+        {
+            return InvalidCiphertext;
+        }
+        return FileReadFailure;
+    }
+
+    db_status = true;
+    db_paged = true;
+    db_paged_path = databasePath;
+    invalidateReaders();
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::rewritePagedDatabase()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    const auto vfs = Internal::encryptedVfs();
+    if (!vfs)
+    {
+        return SqlMemoryAllocationError;
+    }
+
+    // the copy is written next to the target and replaces it once complete
+    const auto tmpPath = databasePath + ".tmp";
+    (void) std::remove(tmpPath.c_str());
+    (void) std::remove((tmpPath + "-journal").c_str());
+
+    // a backup can't read from a connection with pending changes, they are saved into the open file first
+    try {
+        (*db) << "commit;";
+    } catch (sqlite::sqlite_exception &) {
+        return FileWriteFailure;
+    }
+
+    // the page images are copied as they are and encrypted with the current key
+    auto status = Success;
+    try {
+        sqlite::sqlite_config config;
+        config.zVfs = vfs;
+        sqlite::database target(tmpPath, config);
+
+        auto backup = sqlite3_backup_init(target.connection().get(), "main", db->connection().get(), "main");
+        if (!backup || sqlite3_backup_step(backup, -1) != SQLITE_DONE)
+        {
+            status = FileWriteFailure;
+        }
+        if (backup)
+        {
+            (void) sqlite3_backup_finish(backup);
+        }
+
+        // the copy is opened with the current password, the open file keeps the old key
+        const Internal::SecretCipher cipher(databasePassword);
+        if (status == Success && cipher != *secretCipher())
+        {
+            status = rekeySecrets(target, *secretCipher(), cipher);
+        }
+    } catch (sqlite::sqlite_exception &) {
+        status = FileWriteFailure;
+    }
+
+    if (status == Success)
+    {
+        releaseDatabase();
+        if (std::rename(tmpPath.c_str(), databasePath.c_str()) != 0)
+        {
+            status = FileWriteFailure;
+        }
+    }
+
+    if (status != Success)
+    {
+        (void) std::remove(tmpPath.c_str());
+
+        // keep collecting changes in the open file
+        if (db_status)
+        {
+            try {
+                (*db) << "begin;";
+            } catch (sqlite::sqlite_exception &) {}
+        }
+        return status;
+    }
+
+    return openPagedDatabase();
+}
+
+TokenDatabase::Error TokenDatabase::convertToPagedDatabase()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    const auto vfs = Internal::encryptedVfs();
+    if (!vfs)
+    {
+        return SqlMemoryAllocationError;
+    }
+
+    const auto tmpPath = databasePath + ".tmp";
+    (void) std::remove(tmpPath.c_str());
+    (void) std::remove((tmpPath + "-journal").c_str());
+
+    // the image has no reserved bytes for the encryption, so the pages can't be copied as they are,
+    // the schema and rows are copied into a new page encrypted file instead
+    auto status = Success;
+    try {
+        sqlite::sqlite_config config;
+        config.zVfs = vfs;
+        sqlite::database target(tmpPath, config);
+
+        // the rows are copied table by table, the references are enforced once the file is opened
+        auto tuning = pagesTuning;
+        tuning.foreignKeys = false;
+        applyTuning(target, tuning);
+        status = copyDatabase(target);
+
+        const Internal::SecretCipher cipher(databasePassword);
+        if (status == Success && cipher != *secretCipher())
+        {
+            status = rekeySecrets(target, *secretCipher(), cipher);
+        }
+    } catch (sqlite::sqlite_exception &) {
+        status = FileWriteFailure;
+    }
+
+    if (status == Success)
+    {
+        releaseDatabase();
+        if (std::rename(tmpPath.c_str(), databasePath.c_str()) != 0)
+        {
+            status = FileWriteFailure;
+        }
+    }
+
+    if (status != Success)
+    {
+        (void) std::remove(tmpPath.c_str());
+        return status;
+    }
+
+    return openPagedDatabase();
+}
+
+TokenDatabase::Error TokenDatabase::copyDatabase(sqlite::database &target)
+{
+    std::size_t image_size = 0;
+    bool image_owned = false;
+    auto image = serializeDatabase(image_size, image_owned);
+    if (!image)
+    {
+        return SqlSerializationError;
+    }
+
+    try {
+        // sqlite takes ownership of the buffer, it must be allocated by sqlite
+        target << "attach database ':memory:' as image;";
+        const auto size = static_cast<sqlite3_int64>(image_size);
+        auto buffer = image;
+        if (!image_owned)
+        {
+            buffer = static_cast<unsigned char*>(sqlite3_malloc64(static_cast<sqlite3_uint64>(size)));
+            if (!buffer)
+            {
+                throw sqlite::sqlite_exception(SQLITE_NOMEM, "attach database ':memory:' as image;");
+            }
+            std::memcpy(buffer, image, image_size);
+        }
+        image_owned = false;
+        const auto rc = sqlite3_deserialize(target.connection().get(), "image", buffer, size, size,
+                                            SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_READONLY);
+        if (rc != SQLITE_OK)
+        {
+            throw sqlite::sqlite_exception(rc, "attach database ':memory:' as image;");
+        }
+
+        // tables first, indices and everything else after the rows are copied, virtual tables
+        // create their own shadow tables and are rebuilt from their content afterwards
+        std::vector<std::pair<std::string, std::string>> tables;
+        std::vector<std::pair<std::string, std::string>> virtuals;
+        std::vector<std::string> others;
+        target << "select type, name, sql from image.sqlite_master where sql is not null and name not like 'sqlite_%';"
+               >> [&](const std::string &type, const std::string &name, const std::string &sql) {
+            if (type == "table" && sql.compare(0, 20, "CREATE VIRTUAL TABLE") == 0)
+            {
+                virtuals.emplace_back(name, sql);
+            }
+            else if (type == "table")
+            {
+                tables.emplace_back(name, sql);
+            }
+            else
+            {
+                others.emplace_back(sql);
+            }
+        };
+        const auto shadow = [&](const std::string &name) {
+            return std::any_of(virtuals.begin(), virtuals.end(), [&](const std::pair<std::string, std::string> &table) {
+                return name.compare(0, table.first.size() + 1, table.first + "_") == 0;
+            });
+        };
+
+        target << "begin;";
+        for (auto&& table : tables)
+        {
+            if (shadow(table.first))
+            {
+                continue;
+            }
+            target << table.second;
+            target << sanitizeQuery("insert into main.\"%w\" select * from image.\"%w\";", table.first.c_str(), table.first.c_str());
+        }
+        for (auto&& table : virtuals)
+        {
+            target << table.second;
+            target << sanitizeQuery("insert into main.\"%w\" (\"%w\") values ('rebuild');", table.first.c_str(), table.first.c_str());
+        }
+        for (auto&& sql : others)
+        {
+            target << sql;
+        }
+        target << "commit;";
+        target << "detach database image;";
+    } catch (sqlite::sqlite_exception &) {
+        if (image_owned)
+        {
+            sqlite3_free(image);
+        }
+        throw;
+    }
+
+    if (image_owned)
+    {
+        sqlite3_free(image);
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::validateSchema()
+{
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    const auto pragma = "pragma table_info(%Q)";
+
+#define SQLITE_PRAGMA_ARGLIST \
+    const sqlite3_int64 &/*cid*/, \
+    const std::string &name, \
+    const std::string &type, \
+    const bool &notnull, \
+    const std::string &dflt_value, \
+    const bool &pk
+
+    const auto verifyStatics = [&](const std::string &table) {
+        const auto statement = sanitizeQuery(pragma, table.c_str());
+
+        bool validId = false, validName = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (type == "int(1)" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "name")
+                {
+                    validName = (type == "text" && !notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId && validName;
+    };
+
+    const auto verifyConfig = [&] {
+        const auto statement = sanitizeQuery(pragma, "config");
+
+        bool validId = false, validData = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (type == "text" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "data")
+                {
+                    validData = (type == "blob" && !notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId && validData;
+    };
+
+    const auto verifyTokens = [&] {
+        const auto statement = sanitizeQuery(pragma, "tokens");
+
+        bool validId = false,
+             validType = false,
+             validLabel = false,
+             validIcon = false,
+             validSecret = false,
+             validDigits = false,
+             validPeriod = false,
+             validCounter = false,
+             validAlgorithm = false,
+             validIssuer = false,
+             validSecretHash = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (type == "INTEGER" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "type")
+                {
+                    validType = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "label")
+                {
+                    validLabel = (type == "text" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "icon")
+                {
+                    validIcon = (type == "blob" && !notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "secret")
+                {
+                    validSecret = (type == "text" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "digits")
+                {
+                    validDigits = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "period")
+                {
+                    validPeriod = (type == "INTEGER" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "counter")
+                {
+                    validCounter = (type == "INTEGER" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "algorithm")
+                {
+                    validAlgorithm = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "issuer")
+                {
+                    validIssuer = (type == "text" && notnull && dflt_value == "''" && !pk);
+                }
+                else if (name == "secret_hash")
+                {
+                    validSecretHash = (type == "blob" && !notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId &&
+               validType &&
+               validLabel &&
+               validIcon &&
+               validSecret &&
+               validDigits &&
+               validPeriod &&
+               validCounter &&
+               validAlgorithm &&
+               validIssuer &&
+               validSecretHash;
+    };
+
+    const auto verifyOrder = [&] {
+        const auto statement = sanitizeQuery(pragma, "token_order");
+
+        bool validId = false, validPosition = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (type == "INTEGER" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "position")
+                {
+                    validPosition = (type == "INTEGER" && notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId && validPosition;
+    };
+
+    const auto verifyIcons = [&] {
+        const auto statement = sanitizeQuery(pragma, "icons");
+
+        bool validHash = false, validData = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "hash")
+                {
+                    validHash = (type == "blob" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "data")
+                {
+                    validData = (type == "blob" && notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validHash && validData;
+    };
+
+    const auto verifyChangeLog = [&] {
+        const auto statement = sanitizeQuery(pragma, "changelog");
+
+        bool validSeq = false, validToken = false, validOp = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "seq")
+                {
+                    validSeq = (type == "INTEGER" && !notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "token")
+                {
+                    validToken = (type == "INTEGER" && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "op")
+                {
+                    validOp = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validSeq && validToken && validOp;
+    };
+
+    const auto verifyClockDrift = [&] {
+        const auto statement = sanitizeQuery(pragma, "token_drift");
+
+        bool validId = false, validDrift = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (type == "INTEGER" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "drift")
+                {
+                    validDrift = (type == "INTEGER" && notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId && validDrift;
+    };
+
+    const auto verifyTags = [&] {
+        const auto statement = sanitizeQuery(pragma, "token_tags");
+
+        bool validToken = false, validTag = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "token")
+                {
+                    validToken = (type == "INTEGER" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "tag")
+                {
+                    validTag = (type == "text" && notnull && dflt_value.empty() && pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        // tags of deleted tokens would stay behind without the trigger
+        int triggers = 0;
+        try {
+            (*db) << "select count(*) from sqlite_master where type = 'trigger' and tbl_name = 'tokens' "
+                     "and name = 'token_tags_delete';" >> triggers;
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validToken && validTag && triggers == 1;
+    };
+
+    const auto verifyThumbnails = [&] {
+        const auto statement = sanitizeQuery(pragma, "icon_thumbnails");
+
+        bool validHash = false, validSize = false, validData = false;
+
+        try {
+            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "hash")
+                {
+                    validHash = (type == "blob" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "size")
+                {
+                    validSize = (type == "INTEGER" && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "data")
+                {
+                    validData = (type == "blob" && notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validHash && validSize && validData;
+    };
+
+    const auto verifySearch = [&] {
+        // the index is only correct as long as all triggers are there
+        int count = 0;
+        try {
+            (*db) << "select count(*) from sqlite_master where (type = 'table' and name = 'token_search') or "
+                     "(type = 'trigger' and tbl_name = 'tokens' and name in "
+                     "('token_search_insert', 'token_search_delete', 'token_search_update'));" >> count;
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+        return count == 4;
+    };
+
+    auto ret = verifyStatics("types");
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyStatics("algorithms");
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyConfig();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyTokens();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyOrder();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyIcons();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyChangeLog();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyClockDrift();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifySearch();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyTags();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    ret = verifyThumbnails();
+    if (!ret) return SqlSchemaValidationFailed;
+
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::initializeTokens()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    auto status = Success;
+
+    if (databaseFormat == EncryptedPages)
+    {
+        // replace the file, a leftover journal would be rolled back into the new database
+        closeDatabase();
+        (void) std::remove(databasePath.c_str());
+        (void) std::remove((databasePath + "-journal").c_str());
+        status = openPagedDatabase();
+    }
+    else
+    {
+        // allocate a new sqlite database in-memory, the page size must be set before the first table
+        status = initDatabase();
+        if (status == Success && databasePageSize != 0)
+        {
+            try {
+                (*db) << "pragma page_size = " + std::to_string(databasePageSize) + ";";
+            } catch (sqlite::sqlite_exception &) {
+                status = SqlExecutionFailed;
+            }
+        }
+    }
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // bootstrap a new database from the built-in schema
+    status = bootstrapDatabase();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // write to disk, the file must exist right away
+    status = writeTokens();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    notifyChange(ChangeEvent::Reloaded, 0);
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::saveTokens()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    // check if the database is open
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    // saves are coalesced depending on the durability policy
+    if (databaseDurability == OnExit ||
+        (databaseDurability == GroupCommit && db_last_write_valid &&
+         std::chrono::steady_clock::now() - db_last_write < groupCommitWindow))
+    {
+        db_save_pending = true;
+        return Success;
+    }
+
+    return writeTokens();
+}
+
+TokenDatabase::Error TokenDatabase::flushTokens()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status || !db_save_pending)
+    {
+        return Success;
+    }
+
+    return writeTokens();
+}
+
+void TokenDatabase::saveTokensAsync(const StatusCallback &callback)
+{
+    AsyncFileIO::instance().run([callback]{
+        const auto status = saveTokens();
+        if (callback)
+        {
+            callback(status);
+        }
+    });
+}
+
+void TokenDatabase::loadTokensAsync(const StatusCallback &callback)
+{
+    AsyncFileIO::instance().run([callback]{
+        const auto status = loadTokens();
+        if (callback)
+        {
+            callback(status);
+        }
+    });
+}
+
+void TokenDatabase::restoreDatabaseFile(const StatusCallback &callback)
+{
+    if (!Internal::webStorageAvailable())
+    {
+        callback(Success);
+        return;
+    }
+
+    std::string path;
+    {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        path = databasePath;
+    }
+    Internal::restoreWebFile(path, [callback](bool restored) {
+        callback(restored ? Success : FileReadFailure);
+    });
+}
+
+TokenDatabase::Error TokenDatabase::writeTokens()
+{
+    // check if the database is open
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    OTPGEN_PERF_SCOPE("TokenDatabase::saveTokens", Save);
+
+    // the conversions below close and reopen the database, which must not flush again
+    db_save_pending = false;
+    auto status = writeDatabase();
+    if (status != Success)
+    {
+        db_save_pending = true;
+        return status;
+    }
+
+    db_last_write = std::chrono::steady_clock::now();
+    db_last_write_valid = true;
+    db_dirty = false;
+    recordFileStamp(databasePath);
+    resetCounterJournal();
+    // the in-memory filesystem of the browser is lost on reload
+    (void) Internal::persistWebFile(databasePath);
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::writeDatabase()
+{
+    // icons which are no longer referenced by any token are not saved
+    auto status = removeUnusedIcons();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // image databases are converted on the first save
+    if (!db_paged && databaseFormat == EncryptedPages)
+    {
+        return convertToPagedDatabase();
+    }
+
+    // only the changed pages are written, the file is copied when the location changed
+    if (db_paged)
+    {
+        if (db_paged_path != databasePath)
+        {
+            return rewritePagedDatabase();
+        }
+
+        try {
+            (*db) << "commit;";
+            (*db) << "begin;";
+        } catch (sqlite::sqlite_exception &) {
+            return FileWriteFailure;
+        }
+        return Success;
+    }
+
+    // the secrets follow the password the image is written with
+    const auto cipher = std::make_shared<const Internal::SecretCipher>(databasePassword);
+    if (*cipher != *secretCipher())
+    {
+        status = rekeySecrets(*db, *secretCipher(), *cipher);
+        if (status != Success)
+        {
+            return status;
+        }
+        db_secret_cipher = cipher;
+        invalidateReaders();
+    }
+
+    // free pages would be written with the image
+    status = compactDatabase();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // serialize the sqlite database, usually the buffer of the in-memory database itself
+    std::size_t size = 0;
+    bool owned = false;
+    auto sqlitedb = serializeDatabase(size, owned);
+    if (!sqlitedb)
+    {
+        return SqlSerializationError;
+    }
+
+    // compress and encrypt the stream, the token set goes ahead of a progressive image
+    SecureBuffer compressed, prefix;
+    std::string encrypted;
+    if (databaseCompression == Zlib)
+    {
+        status = Internal::compressImage(sqlitedb, size, compressed, imageExecutor(size)) ? Success : EncryptionFailure;
+    }
+    if (status == Success && databaseProgressive)
+    {
+        status = progressivePrefix(prefix);
+    }
+    if (status == Success)
+    {
+        const unsigned char *data = sqlitedb;
+        auto length = size;
+        const auto payload = imagePayload(prefix, compressed, data, length);
+        status = encrypt(databasePassword, data, length, encrypted, payload);
+    }
+    if (owned)
+    {
+        sqlite3_free(sqlitedb);
+    }
+    compressed = SecureBuffer();
+    prefix = SecureBuffer();
+    if (status != Success)
+    {
+        return status;
+    }
+    OTPGEN_PERF_MEMORY(DecryptBuffers, encrypted.capacity());
+
+    // write the encrypted stream to a file
+    status = writeFile(databasePath, encrypted);
+    encrypted.clear();
+    return status;
+}
+
+TokenDatabase::Error TokenDatabase::loadTokens()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    OTPGEN_PERF_SCOPE("TokenDatabase::loadTokens", Load);
+    // deferred saves of the open database are written before it is replaced
+    auto status = flushTokens();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    if (Internal::isEncryptedPageFile(databasePath))
+    {
+        // pages are read and decrypted on demand
+        status = openPagedDatabase();
+        if (status != Success)
+        {
+            return status;
+        }
+    }
+    else
+    {
+        // map the encrypted file
+        Internal::MappedFile in;
+        status = readFile(databasePath, in);
+        if (status != Success)
+        {
+            return status;
+        }
+
+        // decrypt the stream directly into memory allocated by sqlite
+        auto capacity = in.size();
+        auto size = capacity;
+        auto data = static_cast<unsigned char*>(sqlite3_malloc64(static_cast<sqlite3_uint64>(capacity)));
+        auto compressed = false;
+        status = data ? decrypt(databasePassword, in.bytes(), size, data, &compressed) : SqlMemoryAllocationError;
+        in.close();
+        if (status == Success)
+        {
+            OTPGEN_PERF_COUNT(ImageBytesCopied, size);
+        }
+        if (status == Success && compressed)
+        {
+            status = decompressDatabase(data, size, capacity);
+        }
+        if (status == Success && (!db_status || db_paged))
+        {
+            // allocate memory for a database, if not yet initialized
+            status = initDatabase();
+        }
+        if (status != Success)
+        {
+            sqlite3_free(data);
+            return status;
+        }
+
+        // the buffer is handed over to the sqlite database
+        OTPGEN_PERF_SCOPE("TokenDatabase::deserializeDatabase", Deserialize);
+        auto ret = deserializeDatabase(data, size, capacity);
+        if (!ret)
+        {
+            return SqlDeserializationError;
+        }
+    }
+
+    OTPGEN_PERF_SCOPE("TokenDatabase::validateSchema", Validate);
+
+    // perform a query in this function to avoid failure later
+    // FIXME: still couldn't figure out why this happens, but
+    // it works after the first execution in the same function
+    std::uint32_t version = 0;
+    {
+        OTPGEN_PERF_TRACE("TokenDatabase::getDatabaseVersion");
+        (void) getDatabaseVersion(version);
+    }
+
+    // bring older databases up to date
+    status = migrateDatabase(version);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // validate the schema of the database, unless it is unchanged since the last validation
+    if (!schemaFingerprintMatches())
+    {
+        status = validateSchema();
+        if (status != Success)
+        {
+            return status;
+        }
+
+        // written with the next save
+        (void) storeSchemaFingerprint();
+    }
+
+    // listings join the display order, it must hold every token once
+    status = checkDisplayOrder(true);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // counters which were changed after the last save
+    status = applyCounterJournal();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    // counted once here, later counts come from memory
+    invalidateTypeCounts();
+    (void) tokenCount();
+
+    recordFileStamp(databasePath);
+    notifyChange(ChangeEvent::Reloaded, 0);
+    return Success;
+}
+
+const std::string TokenDatabase::counterJournalPath()
+{
+    return databasePath + "-counters";
+}
+
+TokenDatabase::Error TokenDatabase::applyCounterJournal()
+{
+    if (!db_counters)
+    {
+        db_counters = std::make_unique<Internal::CounterJournal>();
+    }
+
+    std::vector<Internal::CounterJournal::Entry> entries;
+    if (!db_counters->open(counterJournalPath(), databasePassword, entries))
+    {
+        return InvalidCiphertext;
+    }
+    if (entries.empty())
+    {
+        return Success;
+    }
+
+    // only the last counter of every token counts
+    std::map<OTPToken::sqliteTokenID, std::uint64_t> counters;
+    for (auto&& entry : entries)
+    {
+        counters[entry.id] = entry.counter;
+    }
+
+    // the counters stay in the journal until the next save, the database isn't dirty
+    try {
+        (*db) << "savepoint token_database;";
+        for (auto&& counter : counters)
+        {
+            cachedStatement("update tokens set counter = ? where id = ?;", [&](sqlite::database_binder &query) {
+                query << static_cast<OTPToken::sqliteLongID>(counter.second) << counter.first;
+                query.execute();
+            });
+            recordChange(ChangeWrite, counter.first);
+        }
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        return SqlExecutionFailed;
+    }
+    return Success;
+}
+
+void TokenDatabase::resetCounterJournal()
+{
+    if (!db_counters)
+    {
+        db_counters = std::make_unique<Internal::CounterJournal>();
+    }
+
+    // the written database holds all counters, a journal at a new location is stale
+    const auto path = counterJournalPath();
+    if (db_counters->isOpen() && db_counters->records() > 0)
+    {
+        (void) db_counters->clear();
+    }
+    if (!db_counters->isOpen() || db_counters->path() != path)
+    {
+        (void) std::remove(path.c_str());
+    }
+
+    // the next record uses the current password
+    std::vector<Internal::CounterJournal::Entry> entries;
+    (void) db_counters->open(path, databasePassword, entries);
+}
+
+bool TokenDatabase::databaseFileChanged()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_file_stamp.valid || db_file_stamp.path != databasePath)
+    {
+        return true;
+    }
+
+    FileStamp current;
+    if (!statFile(databasePath, current))
+    {
+        return true;
+    }
+    if (current.mtime == db_file_stamp.mtime && current.size == db_file_stamp.size)
+    {
+        return false;
+    }
+
+    // the file was touched or rewritten, only a different content counts
+    if (current.size != db_file_stamp.size || !hashFile(databasePath, current.hash) || current.hash != db_file_stamp.hash)
+    {
+        return true;
+    }
+
+    db_file_stamp.mtime = current.mtime;
+    return false;
+}
+
+TokenDatabase::Error TokenDatabase::reloadTokens(bool *changed)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (changed)
+    {
+        *changed = false;
+    }
+    if (db_status && !databaseFileChanged())
+    {
+        return Success;
+    }
+
+    const auto status = loadTokens();
+    if (status == Success && changed)
+    {
+        *changed = true;
+    }
+    return status;
+}
+
+const TokenDatabase::DisplayOrder TokenDatabase::displayOrder()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    DisplayOrder order;
+    auto status = getDisplayOrder(order);
+    if (status != Success)
+    {
+        return {};
+    }
+    return order;
+}
+
+namespace {
+    // plaintext of snapshots: version | count (u32 LE) | entries,
+    // every entry is id (i64 LE) | type | label size (u32 LE) | label
+    static const constexpr unsigned char SNAPSHOT_VERSION = 1;
+
+    template<typename Buffer>
+    static void appendLE(Buffer &out, std::uint64_t value, std::size_t bytes)
+    {
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            out.push_back(static_cast<typename Buffer::value_type>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    static bool readLE(const unsigned char *&data, const unsigned char *end, std::size_t bytes, std::uint64_t &value)
+    {
+        if (static_cast<std::size_t>(end - data) < bytes)
+        {
+            return false;
+        }
+        value = 0;
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            value |= static_cast<std::uint64_t>(*data++) << (8 * i);
+        }
+        return true;
+    }
+
+    // progressive images: token set size (u32 LE) | display order size (u32 LE) | token set | ids (i64 LE) | image,
+    // without complete the data only needs to hold the sizes
+    static bool progressivePrefixSize(const unsigned char *data, std::size_t size, std::size_t &prefix, bool complete = true)
+    {
+        const auto end = data + size;
+        std::uint64_t view = 0, count = 0;
+        if (!readLE(data, end, 4, view) || !readLE(data, end, 4, count))
+        {
+            return false;
+        }
+        const auto total = 8U + view + 8U * count;
+        if (complete && total > size)
+        {
+            return false;
+        }
+        prefix = static_cast<std::size_t>(total);
+        return true;
+    }
 
-    const auto verifyConfig = [&] {
-        const auto statement = sanitizeQuery(pragma, "config");
+    static bool parseSnapshot(const unsigned char *data, std::size_t size, TokenDatabase::Snapshot &out)
+    {
+        const auto end = data + size;
+        std::uint64_t count = 0;
+        if (size == 0 || *data++ != SNAPSHOT_VERSION || !readLE(data, end, 4, count))
+        {
+            return false;
+        }
 
-        bool validId = false, validData = false;
+        // every entry takes at least 13 bytes, a bogus count doesn't reserve anything huge
+        out.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, size / 13)));
+        for (auto i = 0ULL; i < count; ++i)
+        {
+            TokenDatabase::SnapshotEntry entry;
+            std::uint64_t id = 0, type = 0, length = 0;
+            if (!readLE(data, end, 8, id) || !readLE(data, end, 1, type) || !readLE(data, end, 4, length) ||
+                static_cast<std::uint64_t>(end - data) < length)
+            {
+                return false;
+            }
+            entry.id = static_cast<OTPToken::sqliteTokenID>(id);
+            entry.type = static_cast<OTPToken::TokenType>(type);
+            entry.label.assign(reinterpret_cast<const char*>(data), static_cast<std::size_t>(length));
+            data += length;
+            out.emplace_back(std::move(entry));
+        }
+        return data == end;
+    }
+}
 
-        try {
-            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+TokenDatabase::Error TokenDatabase::writeSnapshot(const std::string &file, const std::vector<OTPToken::sqliteTokenID> &ids)
+{
+    SecureString password;
+    {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (!db_status)
+        {
+            return SqlDatabaseNotOpen;
+        }
+        if (databasePassword.empty())
+        {
+            return PasswordEmpty;
+        }
+        password = databasePassword;
+    }
+
+    // the entries are read from a copy, writers only wait for the steps of the copy
+    auto reader = exportReader();
+    if (!reader.isValid())
+    {
+        return SqlDatabaseNotOpen;
+    }
+
+    std::string entries;
+    std::uint32_t count = 0;
+    for (auto&& id : ids)
+    {
+        const auto token = reader.selectToken(id);
+        if (token.id() == 0)
+        {
+            continue;
+        }
+        appendLE(entries, static_cast<std::uint64_t>(token.id()), 8);
+        appendLE(entries, token.type(), 1);
+        appendLE(entries, token.label().size(), 4);
+        entries.append(token.label());
+        ++count;
+    }
+
+    std::string plain;
+    plain.reserve(entries.size() + 5);
+    plain.push_back(static_cast<char>(SNAPSHOT_VERSION));
+    appendLE(plain, count, 4);
+    plain.append(entries);
+
+    // a container of its own payload type, which loadTokens() never accepts as database
+    std::string encrypted;
+    const auto status = Internal::encryptContainer(password, reinterpret_cast<const unsigned char*>(plain.data()),
+                                                   plain.size(), encrypted, nullptr, Internal::ContainerPayload::Snapshot);
+    SecureMemory::wipe(&plain[0], plain.size());
+    SecureMemory::wipe(&entries[0], entries.size());
+    if (status != Internal::ContainerStatus::Success)
+    {
+        return EncryptionFailure;
+    }
+
+    return writeFile(file, encrypted);
+}
+
+TokenDatabase::Error TokenDatabase::readSnapshot(const std::string &file, Snapshot &out)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    out.clear();
+    if (databasePassword.empty())
+    {
+        return PasswordEmpty;
+    }
+
+    std::string in;
+    auto status = readFile(file, in);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    const auto data = reinterpret_cast<unsigned char*>(in.data());
+    auto size = in.size();
+    if (!Internal::isChunkedContainer(data, size))
+    {
+        return InvalidTokenFile;
+    }
+
+    auto payload = Internal::ContainerPayload::Image;
+    switch (Internal::decryptContainer(databasePassword, data, size, data, nullptr, &payload))
+    {
+        case Internal::ContainerStatus::Success: break;
+        case Internal::ContainerStatus::AuthenticationFailed: return InvalidCiphertext;
+        case Internal::ContainerStatus::Failure:
+        case Internal::ContainerStatus::Cancelled: return DecryptionFailure;
+        case Internal::ContainerStatus::Malformed: return InvalidTokenFile;
+    }
+
+    const auto valid = payload == Internal::ContainerPayload::Snapshot && parseSnapshot(data, size, out);
+    SecureMemory::wipe(data, in.size());
+    if (!valid)
+    {
+        out.clear();
+        return InvalidTokenFile;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::writeTokenSet(const std::string &file, const OTPToken::sqliteTypesID &type)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+    if (databasePassword.empty())
+    {
+        return PasswordEmpty;
+    }
+
+    TokenSet set;
+    auto status = selectTokenSet(set, type);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    SecureBuffer plain;
+    if (!TokenSetView::serialize(set, plain))
+    {
+        return InvalidTokenFile;
+    }
+
+    // a container of its own payload type, which loadTokens() never accepts as database
+    std::string encrypted;
+    if (Internal::encryptContainer(databasePassword, plain.data(), plain.size(), encrypted,
+                                   imageExecutor(plain.size()), Internal::ContainerPayload::TokenSet) != Internal::ContainerStatus::Success)
+    {
+        return EncryptionFailure;
+    }
+
+    return writeFile(file, encrypted);
+}
+
+TokenDatabase::Error TokenDatabase::readTokenSet(const std::string &file, TokenSetView &out)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    out.close();
+    if (databasePassword.empty())
+    {
+        return PasswordEmpty;
+    }
+
+    Internal::MappedFile in;
+    auto status = readFile(file, in);
+    if (status != Success)
+    {
+        return status;
+    }
+    if (!Internal::isChunkedContainer(in.bytes(), in.size()))
+    {
+        return InvalidTokenFile;
+    }
+
+    // the chunks are decrypted straight from the mapped file into locked memory
+    SecureBuffer plain(in.size());
+    auto size = in.size();
+    auto payload = Internal::ContainerPayload::Image;
+    switch (Internal::decryptContainer(databasePassword, in.bytes(), size, plain.data(), imageExecutor(size), &payload))
+    {
+        case Internal::ContainerStatus::Success: break;
+        case Internal::ContainerStatus::AuthenticationFailed: return InvalidCiphertext;
+        case Internal::ContainerStatus::Failure:
+        case Internal::ContainerStatus::Cancelled: return DecryptionFailure;
+        case Internal::ContainerStatus::Malformed: return InvalidTokenFile;
+    }
+    in.close();
+
+    plain.resize(size);
+    if (payload != Internal::ContainerPayload::TokenSet || !out.open(std::move(plain)))
+    {
+        return InvalidTokenFile;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::progressivePrefix(SecureBuffer &out)
+{
+    out.clear();
+    TokenSet set;
+    auto status = selectTokenSet(set);
+    if (status != Success)
+    {
+        return status;
+    }
+    DisplayOrder order;
+    status = getDisplayOrder(order);
+    if (status != Success)
+    {
+        return status;
+    }
+
+    SecureBuffer view;
+    if (!TokenSetView::serialize(set, view))
+    {
+        return InvalidTokenFile;
+    }
+    out.reserve(8U + view.size() + 8U * order.size());
+    appendLE(out, view.size(), 4);
+    appendLE(out, order.size(), 4);
+    out.insert(out.end(), view.begin(), view.end());
+    for (auto&& id : order)
+    {
+        appendLE(out, static_cast<std::uint64_t>(id), 8);
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::openTokensProgressive(TokenSetView &out, DisplayOrder &order, const StatusCallback &loaded)
+{
+    out.close();
+    order.clear();
+    const auto opened = [&] {
+        std::lock_guard<std::recursive_mutex> lock(db_mutex);
+        if (databasePassword.empty())
+        {
+            return PasswordEmpty;
+        }
+
+        Internal::MappedFile in;
+        auto status = readFile(databasePath, in);
+        if (status != Success)
+        {
+            return status;
+        }
+
+        // the sizes come first, the chunks of the prefix follow once they are known
+        SecureBuffer plain;
+        auto payload = Internal::ContainerPayload::Image;
+        std::size_t prefix = 8U;
+        for (auto pass = 0; pass < 2 && plain.size() < prefix; ++pass)
+        {
+            switch (Internal::decryptContainerPrefix(databasePassword, in.bytes(), in.size(), prefix, plain, &payload))
             {
-                if (name == "id")
-                {
-                    validId = (type == "text" && notnull && dflt_value.empty() && pk);
-                }
-                else if (name == "data")
-                {
-                    validData = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-            };
-        } catch (sqlite::sqlite_exception &) {
-            return false;
+                case Internal::ContainerStatus::Success: break;
+                case Internal::ContainerStatus::AuthenticationFailed: return InvalidCiphertext;
+                case Internal::ContainerStatus::Failure:
+                case Internal::ContainerStatus::Cancelled: return DecryptionFailure;
+                case Internal::ContainerStatus::Malformed: return InvalidTokenFile;
+            }
+            if ((payload != Internal::ContainerPayload::ProgressiveImage &&
+                 payload != Internal::ContainerPayload::ProgressiveCompressedImage) ||
+                !progressivePrefixSize(plain.data(), plain.size(), prefix, false))
+            {
+                return InvalidTokenFile;
+            }
+        }
+        in.close();
+        if (plain.size() < prefix)
+        {
+            return InvalidTokenFile;
         }
 
-        return validId && validData;
+        const unsigned char *data = plain.data();
+        std::uint64_t viewSize = 0, count = 0;
+        (void) readLE(data, data + 8, 4, viewSize);
+        (void) readLE(data, data + 4, 4, count);
+        SecureBuffer view(data, data + viewSize);
+        data += viewSize;
+        if (!out.open(std::move(view)))
+        {
+            return InvalidTokenFile;
+        }
+        order.reserve(static_cast<std::size_t>(count));
+        for (auto i = 0ULL; i < count; ++i)
+        {
+            std::uint64_t id = 0;
+            (void) readLE(data, data + 8, 8, id);
+            order.emplace_back(static_cast<OTPToken::sqliteSortOrder>(id));
+        }
+        return Success;
+    }();
+
+    loadTokensAsync(loaded);
+    return opened;
+}
+
+namespace {
+    // plaintext of deltas: version | first and last sequence number (u64 LE) | count (u32 LE) | records,
+    // every record is op | id (i64 LE), moves add the position (i64 LE), writes add the position,
+    // type, algorithm, digits, period (u32 LE), counter (u64 LE) and the size (u32 LE) and bytes
+    // of the label, secret, icon and issuer followed by the count (u32 LE) and the sized tags;
+    // deletions have nothing else, version 1 has no issuer and tags
+    static const constexpr unsigned char DELTA_VERSION = 2;
+
+    struct DeltaRecord {
+        std::uint8_t op = 0;
+        OTPToken::sqliteTokenID id = 0;
+        OTPToken::sqliteLongID position = 0;
+        OTPToken token;
     };
 
-    const auto verifyTokens = [&] {
-        const auto statement = sanitizeQuery(pragma, "tokens");
+    template<typename Bytes>
+    static void appendBytes(SecureBuffer &out, const Bytes &bytes)
+    {
+        appendLE(out, bytes.size(), 4);
+        out.insert(out.end(), bytes.begin(), bytes.end());
+    }
 
-        bool validId = false,
-             validType = false,
-             validLabel = false,
-             validIcon = false,
-             validSecret = false,
-             validDigits = false,
-             validPeriod = false,
-             validCounter = false,
-             validAlgorithm = false;
+    static bool readBytes(const unsigned char *&data, const unsigned char *end, std::string &out)
+    {
+        std::uint64_t length = 0;
+        if (!readLE(data, end, 4, length) || static_cast<std::uint64_t>(end - data) < length)
+        {
+            return false;
+        }
+        out.assign(reinterpret_cast<const char*>(data), static_cast<std::size_t>(length));
+        data += length;
+        return true;
+    }
+}
 
-        try {
-            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
-            {
-                if (name == "id")
-                {
-                    validId = (type == "INTEGER" && notnull && dflt_value.empty() && pk);
-                }
-                else if (name == "type")
-                {
-                    validType = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "label")
-                {
-                    validLabel = (type == "text" && notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "icon")
-                {
-                    validIcon = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "secret")
-                {
-                    validSecret = (type == "text" && notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "digits")
-                {
-                    validDigits = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "period")
+TokenDatabase::ChangeSequence TokenDatabase::changeSequence()
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return 0;
+    }
+
+    // sqlite keeps the largest sequence number ever handed out, also after pruning
+    ChangeSequence seq = 0;
+    try {
+        cachedStatement("select coalesce(max(seq), 0) from sqlite_sequence where name = 'changelog';", [&](sqlite::database_binder &query) {
+            query >> seq;
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return 0;
+    }
+    return seq;
+}
+
+TokenDatabase::Error TokenDatabase::writeDelta(const std::string &file, const ChangeSequence &since, ChangeSequence *last)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
+    }
+    if (databasePassword.empty())
+    {
+        return PasswordEmpty;
+    }
+
+    // the ops of a token are merged into one record with its current state, so a token which
+    // changed many times costs the same as one changed once
+    const auto newest = changeSequence();
+    std::map<OTPToken::sqliteTokenID, std::uint8_t> changed;
+    auto reordered = false;
+    try {
+        // the log is only pruned from the front, the sequence numbers of the rest are contiguous
+        ChangeSequence oldest = 0;
+        cachedStatement("select coalesce(min(seq), 0) from changelog;", [&](sqlite::database_binder &query) {
+            query >> oldest;
+        });
+        if (since < newest && (oldest == 0 || since + 1 < oldest))
+        {
+            return ChangeLogPruned;
+        }
+
+        cachedStatement("select token, op from changelog where seq > ? order by seq;", [&](sqlite::database_binder &query) {
+            query << static_cast<OTPToken::sqliteLongID>(since);
+            query >> [&](const OTPToken::sqliteTokenID &id, const int &op) {
+                if (op == ChangeOrder)
                 {
-                    validPeriod = (type == "blob" && !notnull && dflt_value.empty() && !pk);
+                    reordered = true;
                 }
-                else if (name == "counter")
+                else if (op != ChangeMove)
                 {
-                    validCounter = (type == "blob" && !notnull && dflt_value.empty() && !pk);
+                    // the record of a write or delete also carries the position
+                    changed[id] = ChangeWrite;
                 }
-                else if (name == "algorithm")
+                else
                 {
-                    validAlgorithm = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
+                    changed.emplace(id, ChangeMove);
                 }
             };
-        } catch (sqlite::sqlite_exception &) {
-            return false;
-        }
-
-        return validId &&
-               validType &&
-               validLabel &&
-               validIcon &&
-               validSecret &&
-               validDigits &&
-               validPeriod &&
-               validCounter &&
-               validAlgorithm;
-    };
-
-    auto ret = verifyStatics("types");
-    if (!ret) return SqlSchemaValidationFailed;
-
-    ret = verifyStatics("algorithms");
-    if (!ret) return SqlSchemaValidationFailed;
+        });
 
-    ret = verifyConfig();
-    if (!ret) return SqlSchemaValidationFailed;
+        // renumbering moved every token
+        if (reordered)
+        {
+            cachedStatement("select id from token_order;", [&](sqlite::database_binder &query) {
+                query >> [&](const OTPToken::sqliteTokenID &id) {
+                    changed.emplace(id, ChangeMove);
+                };
+            });
+        }
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
 
-    ret = verifyTokens();
-    if (!ret) return SqlSchemaValidationFailed;
+    SecureBuffer plain;
+    plain.push_back(DELTA_VERSION);
+    appendLE(plain, since, 8);
+    appendLE(plain, std::max(since, newest), 8);
+    appendLE(plain, changed.size(), 4);
+    for (auto&& change : changed)
+    {
+        const auto token = change.second == ChangeWrite ? selectToken(change.first) : OTPToken();
+        OTPToken::sqliteLongID position = 0;
+        const auto exists = getDisplayPosition(change.first, position) == Success;
 
-    return Success;
-}
+        // the token is gone, whatever happened to it before
+        if (!exists || (change.second == ChangeWrite && token.id() == 0))
+        {
+            plain.push_back(ChangeDelete);
+            appendLE(plain, static_cast<std::uint64_t>(change.first), 8);
+            continue;
+        }
 
-TokenDatabase::Error TokenDatabase::initializeTokens()
-{
-    // allocate a new sqlite database in-memory
-    auto status = initDatabase();
-    if (status != Success)
-    {
-        return status;
+        plain.push_back(change.second);
+        appendLE(plain, static_cast<std::uint64_t>(change.first), 8);
+        appendLE(plain, static_cast<std::uint64_t>(position), 8);
+        if (change.second == ChangeWrite)
+        {
+            plain.push_back(token.type());
+            plain.push_back(token.algorithm());
+            plain.push_back(token.digitLength());
+            appendLE(plain, token.period(), 4);
+            appendLE(plain, token.counter(), 8);
+            appendBytes(plain, token.label());
+            appendBytes(plain, token.secret());
+            appendBytes(plain, token.icon());
+            appendBytes(plain, token.issuer());
+            appendLE(plain, token.tags().size(), 4);
+            for (auto&& tag : token.tags())
+            {
+                appendBytes(plain, tag);
+            }
+        }
     }
 
-    // bootstrap a new database from the built-in schema
-    status = bootstrapDatabase();
-    if (status != Success)
+    // a container of its own payload type, which loadTokens() never accepts as database
+    std::string encrypted;
+    if (Internal::encryptContainer(databasePassword, plain.data(), plain.size(), encrypted,
+                                   nullptr, Internal::ContainerPayload::Delta) != Internal::ContainerStatus::Success)
     {
-        return status;
+        return EncryptionFailure;
     }
 
-    // write to disk
-    status = saveTokens();
-    if (status != Success)
+    const auto status = writeFile(file, encrypted);
+    if (status == Success && last)
     {
-        return status;
+        *last = std::max(since, newest);
     }
-
-    return Success;
+    return status;
 }
 
-TokenDatabase::Error TokenDatabase::saveTokens()
+TokenDatabase::Error TokenDatabase::applyDelta(const std::string &file, ChangeSequence *last)
 {
-    // check if the database is open
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
     if (!db_status)
     {
         return SqlDatabaseNotOpen;
     }
-
-    // serialize the sqlite database
-    std::string sqlitedb;
-    auto ret = serializeDatabase(sqlitedb);
-    if (!ret)
+    if (databasePassword.empty())
     {
-        return SqlSerializationError;
+        return PasswordEmpty;
     }
 
-    // encrypt the stream
-    std::string encrypted;
-    auto status = encrypt(databasePassword, sqlitedb, encrypted);
-    sqlitedb.clear();
+    Internal::MappedFile in;
+    auto status = readFile(file, in);
     if (status != Success)
     {
         return status;
     }
-
-    // write the encrypted stream to a file
-    status = writeFile(databasePath, encrypted);
-    encrypted.clear();
-    return status;
-}
-
-TokenDatabase::Error TokenDatabase::loadTokens()
-{
-    // read the encrypted file
-    std::string in;
-    auto status = readFile(databasePath, in);
-    if (status != Success)
+    if (!Internal::isChunkedContainer(in.bytes(), in.size()))
     {
-        return status;
+        return InvalidTokenFile;
     }
 
-    // decrypt the stream
-    std::string decrypted;
-    status = decrypt(databasePassword, in, decrypted);
-    in.clear();
-    if (status != Success)
+    SecureBuffer plain(in.size());
+    auto size = in.size();
+    auto payload = Internal::ContainerPayload::Image;
+    switch (Internal::decryptContainer(databasePassword, in.bytes(), size, plain.data(), nullptr, &payload))
     {
-        return status;
+        case Internal::ContainerStatus::Success: break;
+        case Internal::ContainerStatus::AuthenticationFailed: return InvalidCiphertext;
+        case Internal::ContainerStatus::Failure:
+        case Internal::ContainerStatus::Cancelled: return DecryptionFailure;
+        case Internal::ContainerStatus::Malformed: return InvalidTokenFile;
+    }
+    in.close();
+
+    // the whole delta is parsed before anything is changed
+    auto data = static_cast<const unsigned char*>(plain.data());
+    const auto end = data + size;
+    std::uint64_t first = 0, newest = 0, count = 0;
+    const auto version = size == 0 ? 0U : *data++;
+    if (payload != Internal::ContainerPayload::Delta || version == 0U || version > DELTA_VERSION ||
+        !readLE(data, end, 8, first) || !readLE(data, end, 8, newest) || !readLE(data, end, 4, count))
+    {
+        return InvalidTokenFile;
     }
 
-    // allocate memory for a database, if not yet initialized
-    if (!db_status)
+    // every record takes at least 9 bytes, a bogus count doesn't reserve anything huge
+    std::vector<DeltaRecord> records;
+    records.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, size / 9)));
+    for (auto i = 0ULL; i < count; ++i)
     {
-        status = initDatabase();
-        if (status != Success)
+        DeltaRecord record;
+        std::uint64_t op = 0, id = 0, position = 0;
+        if (!readLE(data, end, 1, op) || !readLE(data, end, 8, id) || static_cast<OTPToken::sqliteTokenID>(id) <= 0 ||
+            (op != ChangeDelete && !readLE(data, end, 8, position)))
         {
-            return status;
+            return InvalidTokenFile;
+        }
+        record.op = static_cast<std::uint8_t>(op);
+        record.id = static_cast<OTPToken::sqliteTokenID>(id);
+        record.position = static_cast<OTPToken::sqliteLongID>(position);
+
+        if (record.op == ChangeWrite)
+        {
+            std::uint64_t type = 0, algorithm = 0, digits = 0, period = 0, counter = 0, tagCount = 0;
+            OTPToken::Label label;
+            OTPToken::Issuer issuer;
+            OTPToken::Tags tags;
+            std::string secret, icon;
+            auto valid = readLE(data, end, 1, type) && readLE(data, end, 1, algorithm) && readLE(data, end, 1, digits) &&
+                         readLE(data, end, 4, period) && readLE(data, end, 8, counter) &&
+                         readBytes(data, end, label) && readBytes(data, end, secret) && readBytes(data, end, icon);
+            if (valid && version >= 2U)
+            {
+                valid = readBytes(data, end, issuer) && readLE(data, end, 4, tagCount);
+                for (auto t = 0ULL; valid && t < tagCount; ++t)
+                {
+                    tags.emplace_back();
+                    valid = readBytes(data, end, tags.back());
+                }
+            }
+            if (valid)
+            {
+                record.token.setType(static_cast<OTPToken::TokenType>(type));
+                record.token.setAlgorithm(static_cast<OTPToken::ShaAlgorithm>(algorithm));
+                record.token.setDigitLength(static_cast<OTPToken::DigitType>(digits));
+                record.token.setPeriod(static_cast<OTPToken::PeriodType>(period));
+                record.token.setCounter(static_cast<OTPToken::CounterType>(counter));
+                record.token.setLabel(std::move(label));
+                record.token.setSecret(OTPToken::TokenSecret(secret.begin(), secret.end()));
+                record.token.setIcon(OTPToken::Icon(icon.begin(), icon.end()));
+                record.token.setIssuer(issuer);
+                record.token.setTags(std::move(tags));
+            }
+            SecureMemory::wipe(&secret[0], secret.size());
+            if (!valid)
+            {
+                return InvalidTokenFile;
+            }
         }
+        else if (record.op != ChangeMove && record.op != ChangeDelete)
+        {
+            return InvalidTokenFile;
+        }
+        records.emplace_back(std::move(record));
+    }
+    if (data != end)
+    {
+        return InvalidTokenFile;
     }
 
-    // deserialize the sqlite database
-    auto ret = deserializeDatabase(decrypted);
-    decrypted.clear();
-    if (!ret)
+    if (records.empty())
     {
-        return SqlDeserializationError;
+        if (last)
+        {
+            *last = newest;
+        }
+        return Success;
     }
 
-    // perform a query in this function to avoid failure later
-    // FIXME: still couldn't figure out why this happens, but
-    // it works after the first execution in the same function
-    std::uint32_t version = 0;
-    (void) getDatabaseVersion(version);
+    static const std::string insert(Internal::TokenSchema::INSERT_WITH_KEY.view());
+    static const std::string update(Internal::TokenSchema::UPDATE.view());
 
-    // validate the schema of the database
-    status = validateSchema();
-    if (status != Success)
+    invalidateLabelIds();
+    invalidateTypeCounts();
+    invalidateIcons();
+    ChangeBatch batch;
+    try {
+        (*db) << "savepoint token_database;";
+
+        // deletions first, and the labels of the written tokens are parked on a name no user
+        // label has, so labels which moved between tokens don't collide
+        for (auto&& record : records)
+        {
+            if (record.op == ChangeDelete)
+            {
+                for (auto&& statement : {"delete from token_order where id = ?;", "delete from tokens where id = ?;",
+                                         "delete from token_drift where id = ?;"})
+                {
+                    cachedStatement(statement, [&](sqlite::database_binder &query) {
+                        query << record.id;
+                        query.execute();
+                    });
+                }
+                recordChange(ChangeDelete, record.id);
+                notifyChange(ChangeEvent::Deleted, record.id);
+            }
+            else if (record.op == ChangeWrite)
+            {
+                cachedStatement("update tokens set label = ? where id = ?;", [&](sqlite::database_binder &query) {
+                    query << "\x1f" + std::to_string(record.id) << record.id;
+                    query.execute();
+                });
+            }
+        }
+
+        for (auto&& record : records)
+        {
+            if (record.op == ChangeWrite)
+            {
+                auto exists = 0;
+                cachedStatement("select count(*) from tokens where id = ?;", [&](sqlite::database_binder &query) {
+                    query << record.id;
+                    query >> exists;
+                });
+                status = executeGenericTokenStatement(exists ? update : insert, record.token, record.id);
+                if (status != Success)
+                {
+                    rollbackSavepoint();
+                    invalidateLabelIds();
+                    invalidateTypeCounts();
+                    return status;
+                }
+                cachedStatement("insert or replace into token_order values (?, ?);", [&](sqlite::database_binder &query) {
+                    query << record.id << record.position;
+                    query.execute();
+                });
+                notifyChange(exists ? ChangeEvent::Updated : ChangeEvent::Inserted, record.id);
+            }
+            else if (record.op == ChangeMove)
+            {
+                // tokens which don't exist here have no position
+                cachedStatement("update token_order set position = ? where id = ?;", [&](sqlite::database_binder &query) {
+                    query << record.position << record.id;
+                    query.execute();
+                });
+                if (sqlite3_changes(db->connection().get()) != 0)
+                {
+                    notifyChange(ChangeEvent::Moved, record.id);
+                }
+            }
+            else
+            {
+                continue;
+            }
+            recordChange(record.op, record.id);
+        }
+
+        (*db) << "release token_database;";
+    } catch (sqlite::sqlite_exception &) {
+        rollbackSavepoint();
+        invalidateLabelIds();
+        invalidateTypeCounts();
+        invalidateIcons();
+        return SqlExecutionFailed;
+    }
+
+    markDirty();
+    if (last)
     {
-        return status;
+        *last = newest;
+    }
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::pruneChangeLog(const ChangeSequence &upTo)
+{
+    std::lock_guard<std::recursive_mutex> lock(db_mutex);
+    if (!db_status)
+    {
+        return SqlDatabaseNotOpen;
     }
 
+    try {
+        cachedStatement("delete from changelog where seq <= ?;", [&](sqlite::database_binder &query) {
+            query << static_cast<OTPToken::sqliteLongID>(upTo);
+            query.execute();
+        });
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+
+    markDirty();
     return Success;
 }
 
-const TokenDatabase::DisplayOrder TokenDatabase::displayOrder()
+std::shared_ptr<const Internal::SecretCipher> TokenDatabase::secretCipher()
 {
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
+    if (!db_secret_cipher)
     {
-        return {};
+        db_secret_cipher = std::make_shared<const Internal::SecretCipher>(databasePassword);
     }
-    return order;
+    return db_secret_cipher;
+}
+
+TokenDatabase::Error TokenDatabase::rekeySecrets(sqlite::database &connection, const Internal::SecretCipher &from,
+                                                 const Internal::SecretCipher &to)
+{
+    // the rows are collected first, every secret gets a new nonce, the hashes are keyed as well
+    struct Row
+    {
+        OTPToken::sqliteTokenID id;
+        SecureBuffer secret;
+        std::vector<unsigned char> hash;
+    };
+    try {
+        connection << "savepoint secret_rekey;";
+        try {
+            std::vector<Row> rows;
+            OTPToken::TokenSecret plain;
+            connection << "select id, secret from tokens;" >> [&](const OTPToken::sqliteTokenID &id, const SecureBuffer &secret) {
+                (void) from.decrypt(secret.data(), secret.size(), plain);
+                rows.emplace_back(Row{id, {}, {}});
+                to.encrypt(plain.data(), plain.size(), rows.back().secret);
+                secretHash(to, plain, rows.back().hash);
+            };
+
+            auto update = connection << "update tokens set secret = ?, secret_hash = ? where id = ?;";
+            for (auto&& row : rows)
+            {
+                update << row.secret << row.hash << row.id;
+                update.execute();
+            }
+        } catch (sqlite::sqlite_exception &) {
+            connection << "rollback to secret_rekey;";
+            connection << "release secret_rekey;";
+            return SqlExecutionFailed;
+        }
+        connection << "release secret_rekey;";
+    } catch (sqlite::sqlite_exception &) {
+        return SqlExecutionFailed;
+    }
+    return Success;
 }
 
 const OTPToken::TokenSecret TokenDatabase::mangleTokenSecret(const OTPToken::TokenSecret &secret)
@@ -1396,157 +7437,287 @@ const OTPToken::TokenSecret TokenDatabase::unmangleTokenSecret(const OTPToken::T
     return mangleTokenSecret(secret);
 }
 
-TokenDatabase::Error TokenDatabase::encrypt(const std::string &password,
-                                            const std::string &input_buffer, std::string &out, const int64_t &size)
-{
-    out.clear();
-
-    try {
+namespace {
+    // AES-256 key (first 16 bytes used) and block derived from the password hash,
+    // the first block of the password hash is the IV
+    static CryptoPP::SecByteBlock deriveImageKey(const SecureString &password)
+    {
         CryptoPP::SecByteBlock key(CryptoPP::AES::MAX_KEYLENGTH + CryptoPP::AES::BLOCKSIZE);
         CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
         hkdf.DeriveKey(key, key.size(),
                        reinterpret_cast<const unsigned char*>(password.data()), password.size(),
                        reinterpret_cast<const unsigned char*>(password.data()), password.size(), nullptr, 0);
+        return key;
+    }
+}
 
-        std::string ciphertext;
-
-        CryptoPP::AES::Encryption aesEncryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
-        CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption(aesEncryption, reinterpret_cast<const unsigned char*>(password.data()));
-
-        CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, new CryptoPP::StringSink(ciphertext));
-        auto input_buffer_size = (size == -1 ? input_buffer.size() : static_cast<std::size_t>(size));
-        stfEncryptor.Put(reinterpret_cast<const unsigned char*>(input_buffer.data()), input_buffer_size);
-        stfEncryptor.MessageEnd();
-
-        for (auto&& c : ciphertext)
-        {
-            out.push_back(c);
-        }
+TokenDatabase::Error TokenDatabase::encrypt(const SecureString &password,
+                                            const std::string &input_buffer, std::string &out, const int64_t &size)
+{
+    auto input_buffer_size = (size == -1 ? input_buffer.size() : static_cast<std::size_t>(size));
+    return encrypt(password, reinterpret_cast<const unsigned char*>(input_buffer.data()), input_buffer_size, out,
+                   Internal::ContainerPayload::Image);
+}
 
-        return Success;
-    } catch (CryptoPP::InvalidCiphertext e) {
-        // e.what();
-        return InvalidCiphertext;
-    } catch (...) {
-        return EncryptionFailure;
+TokenDatabase::Error TokenDatabase::encrypt(const SecureString &password,
+                                            const unsigned char *input, std::size_t size, std::string &out,
+                                            const Internal::ContainerPayload &payload, const Internal::ContainerProgress *progress)
+{
+    OTPGEN_PERF_SCOPE("TokenDatabase::encrypt", Encrypt);
+    const auto status = Internal::encryptContainer(password, input, size, out, imageExecutor(size), payload, progress);
+    switch (status)
+    {
+        case Internal::ContainerStatus::Success: return Success;
+        case Internal::ContainerStatus::Cancelled: return OperationCancelled;
+        default: return EncryptionFailure;
     }
 }
 
-TokenDatabase::Error TokenDatabase::encryptFromFile(const std::string &password,
+TokenDatabase::Error TokenDatabase::encryptFromFile(const SecureString &password,
                                                     const std::string &file, std::string &out)
 {
     out.clear();
 
-    auto status = readFile(file, out);
+    std::string in;
+    auto status = readFile(file, in);
     if (status != Success)
     {
-        out.clear();
         return status;
     }
 
-    auto in = out;
-
     return encrypt(password, in, out);
 }
 
-TokenDatabase::Error TokenDatabase::decrypt(const std::string &password,
+TokenDatabase::Error TokenDatabase::decrypt(const SecureString &password,
                                             const std::string &input_buffer, std::string &out, const int64_t &size)
 {
-    out.clear();
+    auto input_buffer_size = (size == -1 ? input_buffer.size() : static_cast<std::size_t>(size));
+    out.resize(input_buffer_size);
 
-    try {
-        CryptoPP::SecByteBlock key(CryptoPP::AES::MAX_KEYLENGTH + CryptoPP::AES::BLOCKSIZE);
-        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
-        hkdf.DeriveKey(key, key.size(),
-                       reinterpret_cast<const unsigned char*>(password.data()), password.size(),
-                       reinterpret_cast<const unsigned char*>(password.data()), password.size(), nullptr, 0);
+    auto status = decrypt(password, reinterpret_cast<const unsigned char*>(input_buffer.data()), input_buffer_size,
+                          reinterpret_cast<unsigned char*>(out.data()));
+    out.resize(status == Success ? input_buffer_size : 0U);
+    return status;
+}
 
-        std::string decryptedtext;
+TokenDatabase::Error TokenDatabase::decrypt(const SecureString &password,
+                                            const unsigned char *input, std::size_t &size, unsigned char *out, bool *compressed)
+{
+    OTPGEN_PERF_SCOPE("TokenDatabase::decrypt", Decrypt);
+    if (compressed)
+    {
+        *compressed = false;
+    }
+
+    if (Internal::isChunkedContainer(input, size))
+    {
+        auto payload = Internal::ContainerPayload::Image;
+        switch (Internal::decryptContainer(password, input, size, out, imageExecutor(size), &payload))
+        {
+            case Internal::ContainerStatus::Success:
+                // snapshots, token sets and deltas are no database
+                if (payload == Internal::ContainerPayload::Snapshot || payload == Internal::ContainerPayload::TokenSet ||
+                    payload == Internal::ContainerPayload::Delta)
+                {
+                    return InvalidTokenFile;
+                }
+                // the image follows the token set of progressive images
+                if (payload == Internal::ContainerPayload::ProgressiveImage ||
+                    payload == Internal::ContainerPayload::ProgressiveCompressedImage)
+                {
+                    std::size_t prefix = 0;
+                    if (!progressivePrefixSize(out, size, prefix))
+                    {
+                        return InvalidTokenFile;
+                    }
+                    std::memmove(out, out + prefix, size - prefix);
+                    size -= prefix;
+                }
+                if (compressed)
+                {
+                    *compressed = payload == Internal::ContainerPayload::CompressedImage ||
+                                  payload == Internal::ContainerPayload::ProgressiveCompressedImage;
+                }
+                return Success;
+            case Internal::ContainerStatus::AuthenticationFailed: return InvalidCiphertext;
+            case Internal::ContainerStatus::Failure:
+            case Internal::ContainerStatus::Cancelled: return DecryptionFailure;
+            // a former image which happens to start with the magic
+            case Internal::ContainerStatus::Malformed: break;
+        }
+    }
+
+    // former images, CBC with PKCS #7 padding, a wrong password usually ends with an invalid padding
+    if (size == 0 || size % CryptoPP::AES::BLOCKSIZE != 0)
+    {
+        return InvalidCiphertext;
+    }
 
-        CryptoPP::AES::Decryption aesDecryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
-        CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(aesDecryption, reinterpret_cast<const unsigned char*>(password.data()));
+    try {
+        const auto key = deriveImageKey(password);
+
+        // every block only depends on the previous ciphertext block, so ranges are decrypted on
+        // their own with the last ciphertext block before them as IV, the IVs are copied first
+        // because out may be the same buffer as input
+        const auto range = Internal::CONTAINER_CHUNK_SIZE;
+        const auto ranges = (size + range - 1) / range;
+        std::vector<unsigned char> ivs(ranges * CryptoPP::AES::BLOCKSIZE);
+        std::memcpy(ivs.data(), password.data(), CryptoPP::AES::BLOCKSIZE);
+        for (auto i = 1U; i < ranges; ++i)
+        {
+            std::memcpy(ivs.data() + i * CryptoPP::AES::BLOCKSIZE, input + i * range - CryptoPP::AES::BLOCKSIZE, CryptoPP::AES::BLOCKSIZE);
+        }
 
-        CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, new CryptoPP::StringSink(decryptedtext));
-        auto input_buffer_size = (size == -1 ? input_buffer.size() : static_cast<std::size_t>(size));
-        stfDecryptor.Put(reinterpret_cast<const unsigned char*>(input_buffer.data()), input_buffer_size);
-        stfDecryptor.MessageEnd();
+        std::atomic<bool> failed{false};
+        const auto decryptRanges = [&](std::size_t begin, std::size_t end) {
+            try {
+                CryptoPP::AES::Decryption aesDecryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
+                for (auto i = begin; i < end; ++i)
+                {
+                    const auto offset = i * range;
+                    CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(aesDecryption, ivs.data() + i * CryptoPP::AES::BLOCKSIZE);
+                    cbcDecryption.ProcessData(out + offset, input + offset, std::min(range, size - offset));
+                }
+            } catch (...) {
+                failed = true;
+            }
+        };
 
-        for (auto&& c : decryptedtext)
+        const auto executor = imageExecutor(size);
+        if (executor)
         {
-            out.push_back(c);
+            executor->parallelFor(ranges, 1U, decryptRanges);
+        }
+        else
+        {
+            decryptRanges(0U, ranges);
         }
 
-        return Success;
-    } catch (CryptoPP::InvalidCiphertext e) {
-        // e.what();
-        return InvalidCiphertext;
+        if (failed)
+        {
+            return DecryptionFailure;
+        }
     } catch (...) {
         return DecryptionFailure;
     }
+
+    const auto padding = static_cast<std::size_t>(out[size - 1]);
+    if (padding == 0 || padding > CryptoPP::AES::BLOCKSIZE)
+    {
+        return InvalidCiphertext;
+    }
+    for (auto i = size - padding; i < size; ++i)
+    {
+        if (out[i] != padding)
+        {
+            return InvalidCiphertext;
+        }
+    }
+
+    size -= padding;
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::decompressDatabase(unsigned char *&data, std::size_t &size, std::size_t &capacity)
+{
+    const auto imageSize = Internal::compressedImageSize(data, size);
+    auto image = imageSize ? static_cast<unsigned char*>(sqlite3_malloc64(static_cast<sqlite3_uint64>(imageSize))) : nullptr;
+    auto status = !imageSize ? InvalidTokenFile : image ? Success : SqlMemoryAllocationError;
+    if (status == Success && !Internal::decompressImage(data, size, image, imageExecutor(imageSize)))
+    {
+        status = InvalidTokenFile;
+    }
+
+    sqlite3_free(data);
+    if (status != Success)
+    {
+        sqlite3_free(image);
+        data = nullptr;
+        return status;
+    }
+
+    OTPGEN_PERF_COUNT(ImageBytesCopied, imageSize);
+    data = image;
+    size = capacity = imageSize;
+    return Success;
 }
 
-TokenDatabase::Error TokenDatabase::decryptFromFile(const std::string &password,
+TokenDatabase::Error TokenDatabase::decryptFromFile(const SecureString &password,
                                                     const std::string &file, std::string &out)
 {
     out.clear();
 
-    std::string buffer;
-    auto status = readFile(file, buffer);
+    Internal::MappedFile in;
+    auto status = readFile(file, in);
     if (status != Success)
     {
         return status;
     }
 
-    return decrypt(password, buffer, out);
+    auto size = in.size();
+    out.resize(size);
+    status = decrypt(password, in.bytes(), size, reinterpret_cast<unsigned char*>(out.data()));
+    out.resize(status == Success ? size : 0U);
+    return status;
 }
 
 TokenDatabase::Error TokenDatabase::readFile(const std::string &file, std::string &out)
 {
-    std::string buffer;
+    out.clear();
 
     try {
         std::ifstream stream(file, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+        if (!stream)
+        {
+            return FileReadFailure;
+        }
         std::streamsize stream_size = stream.tellg();
         stream.seekg(0, std::ios::beg);
 
-        // reserve memory for file
-        buffer.resize(static_cast<std::size_t>(stream_size));
-
-        // read file into buffer
-        if (!stream.read(buffer.data(), stream_size))
+        // read the file directly into the output
+        out.resize(static_cast<std::size_t>(stream_size));
+        if (!stream.read(out.data(), stream_size))
         {
-            stream.close();
-            buffer.clear();
+            out.clear();
             return FileReadFailure;
         }
-
-        stream.close();
     } catch (...) {
+        out.clear();
         return FileReadFailure;
     }
 
-    if (buffer.empty())
+    if (out.empty())
     {
         return FileEmpty;
     }
 
-    out = buffer;
+    return Success;
+}
+
+TokenDatabase::Error TokenDatabase::readFile(const std::string &file, Internal::MappedFile &out)
+{
+    OTPGEN_PERF_TRACE("TokenDatabase::readFile");
+    if (!out.open(file))
+    {
+        return FileReadFailure;
+    }
+
+    if (out.empty())
+    {
+        return FileEmpty;
+    }
 
     return Success;
 }
 
 TokenDatabase::Error TokenDatabase::writeFile(const std::string &location, const std::string &buffer)
 {
-    try {
-        std::ofstream stream(location, std::ios_base::out | std::ios_base::binary);
-        if (!stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size())))
-        {
-            stream.close();
-            return FileWriteFailure;
-        }
-
-        stream.close();
-    } catch (...) {
+    OTPGEN_PERF_SCOPE("TokenDatabase::writeFile", Write);
+    // the buffer is written to a temporary file next to the target which replaces it once
+    // everything is on disk, a crash never leaves a truncated or partially written database
+    Internal::AtomicFile file;
+    if (!file.open(location) || !file.write(buffer.data(), buffer.size()) || !file.commit())
+    {
         return FileWriteFailure;
     }
 
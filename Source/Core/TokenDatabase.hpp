@@ -2,12 +2,48 @@
 #define TOKENDATABASE_HPP
 
 #include "AppSupport.hpp"
+#include "ClockDrift.hpp"
+#include "LabelArena.hpp"
+#include "OTPGenErrorCodes.hpp"
 #include "OTPToken.hpp"
+#include "PerfStats.hpp"
+#include "SecureMemory.hpp"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <ctime>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+namespace sqlite {
+    class database;
+    class database_binder;
+}
+
+namespace Internal {
+    class MappedFile;
+    class SecretCipher;
+    struct ContainerProgress;
+    enum class ContainerPayload : unsigned char;
+}
+
+class AsyncFileIO;
+class Executor;
+class PreparedKeyCache;
+class TokenSet;
+class TokenSetView;
+
+// all functions are serialized and can be called from any thread,
+// readers are snapshots which don't take part in that, see TokenDatabase::Reader
+// the functions work on the selected vault, see TokenDatabase::selectVault()
 class TokenDatabase final
 {
     TokenDatabase() = delete;
@@ -16,11 +52,82 @@ class TokenDatabase final
     friend class AppSupport::andOTP;
     friend class AppSupport::Authy;
     friend class AppSupport::Steam;
+    friend class AppSupport::Aegis;
+    friend class AppSupport::FreeOTPPlus;
+    friend class AppSupport::TwoFAS;
+    friend class AsyncFileIO;
 
-    static std::string databasePassword;
+    static SecureString databasePassword;
     static std::string databasePath;
 
 public:
+    // how databases are stored on disk, loadTokens() detects the format of existing files
+    //  -> EncryptedImage: the whole database is encrypted as one image, every save rewrites the file
+    //  -> EncryptedPages: every page is encrypted on its own and the database is opened on disk,
+    //                     a save only writes the changed pages, unsaved changes are discarded on close,
+    //                     image databases are converted on the next save
+    enum StorageFormat {
+        EncryptedImage,
+        EncryptedPages,
+    };
+
+    // when saveTokens() writes the changes to disk, writes are atomic and synced in every case
+    //  -> Immediate:   every save is written right away
+    //  -> GroupCommit: saves within the group commit window after a write are deferred and
+    //                  written together by the next save after the window, flushTokens() or closeDatabase()
+    //  -> OnExit:      saves are only written by flushTokens() or closeDatabase()
+    enum Durability {
+        Immediate,
+        GroupCommit,
+        OnExit,
+    };
+
+    // compression of image databases before they are encrypted, loadTokens() reads both
+    enum Compression {
+        Uncompressed,
+        Zlib,
+    };
+
+    // how the key of image databases is derived from the password, loadTokens() reads it from the file
+    //  -> PasswordHash: HKDF over the password hash
+    //  -> Scrypt:       memory-hard scrypt with 2^cost iterations and 2^cost KiB of memory, which
+    //                   makes unlocking deliberately slow, the key is cached after unlocking so
+    //                   saves with the same password don't derive it again
+    enum KeyDerivation {
+        PasswordHash,
+        Scrypt,
+    };
+
+    // rollback journal of the database, WAL needs shared memory which the encrypted VFS doesn't provide
+    enum JournalMode {
+        JournalDelete,
+        JournalTruncate,
+        JournalPersist,
+        JournalMemory,
+    };
+
+    // how often the database file is synced by sqlite, only page encrypted databases are synced,
+    // Off and Normal can corrupt the file on power loss (the rename of image writes is always synced)
+    enum SyncMode {
+        SyncOff,
+        SyncNormal,
+        SyncFull,
+    };
+
+    // sqlite settings applied when the database connection is opened,
+    // see defaultTuning() for the defaults of both storage formats
+    //  -> cacheSizeKb:     page cache in KiB
+    //  -> tempStoreMemory: temporary tables and sorts never touch the disk
+    //  -> foreignKeys:     enforce the references of the tokens and the display order
+    struct Tuning
+    {
+        std::uint32_t cacheSizeKb = 2048U;
+        bool tempStoreMemory = true;
+        JournalMode journalMode = JournalMemory;
+        SyncMode synchronous = SyncOff;
+        bool foreignKeys = false;
+    };
+
     enum Error {
         Success = 0,
 
@@ -53,46 +160,412 @@ public:
         SqlSchemaValidationFailed,    // tables are missing or don't have the correct schema,
                                       // edge-case when the user replaces the file manually
 
+        ChangeLogPruned,     // the change log doesn't reach back to the requested sequence number
+        EmptyFilter,         // the group operation has a filter without any condition
+        DuplicateSecret,     // a token with the same secret is already in the vault, see DuplicatePolicy
+        OperationCancelled,  // stopped through the cancel flag of the operation
+        SessionKeyInvalid,   // malformed session key or it belongs to another database or salt
+        SessionKeyExpired,   // the lifetime of the session key is over
+        InvalidArgument,     // a parameter of the call is out of its range
+
         UnknownFailure,      // unknown or unhandled error
     };
 
     using OTPTokenList = std::vector<OTPToken>;
     using DisplayOrder = std::vector<OTPToken::sqliteSortOrder>;
+    using TokenCallback = std::function<void(const OTPToken&)>;
 
     // translate error enum to a human readable message describing the error
     static const std::string getErrorMessage(const Error &error);
 
+    // execution times of a prepared statement
+    struct StatementStats
+    {
+        std::string sql;
+        std::uint64_t count = 0U;
+        std::uint64_t totalNs = 0U;
+        std::uint64_t maxNs = 0U;
+    };
+
+    struct Stats
+    {
+        PerfStats::Snapshot perf;
+        // ordered by the total time, most expensive first
+        std::vector<StatementStats> statements;
+    };
+
+    // process wide performance counters and the timings of the prepared statements,
+    // all zero when built without OTPGEN_WITH_PERF_STATS
+    static Stats stats();
+    static void resetStats();
+
+    // where the bytes of the open vault are, to decide when to vacuum, deduplicate or migrate
+    struct Inspection
+    {
+        // pages of a table or index, from the dbstat table
+        struct Table
+        {
+            std::string name;
+            std::uint64_t pages = 0U;
+            std::uint64_t payloadBytes = 0U;
+            std::uint64_t unusedBytes = 0U;
+            // leaf pages and their unused bytes, the only pages a vacuum packs closer together
+            std::uint64_t leafPages = 0U;
+            std::uint64_t leafUnusedBytes = 0U;
+        };
+
+        // rows per OTPToken::TokenType
+        std::array<std::uint64_t, OTPToken::Steam + 1> tokens{};
+
+        // payload of the token columns, icons are references into the icons table
+        std::uint64_t labelBytes = 0U;
+        std::uint64_t issuerBytes = 0U;
+        std::uint64_t secretBytes = 0U;
+        std::uint64_t secretHashBytes = 0U;
+        std::uint64_t iconReferenceBytes = 0U;
+
+        std::uint64_t icons = 0U;
+        std::uint64_t iconBytes = 0U;
+        std::uint64_t thumbnails = 0U;
+        std::uint64_t thumbnailBytes = 0U;
+        // bytes tokens with the same icon don't store again through the references
+        std::uint64_t sharedIconBytes = 0U;
+        // icons no token refers to anymore, with their thumbnails
+        std::uint64_t orphanedIcons = 0U;
+        std::uint64_t orphanedIconBytes = 0U;
+
+        // display order rows, rows of deleted tokens and tokens without a row (see checkDisplayOrder())
+        std::uint64_t orderEntries = 0U;
+        std::uint64_t orderBytes = 0U;
+        std::uint64_t deadOrderEntries = 0U;
+        std::uint64_t unorderedTokens = 0U;
+
+        std::uint64_t changeLogEntries = 0U;
+
+        std::uint32_t pageSize = 0U;
+        // page size without the bytes reserved for the page encryption
+        std::uint32_t usableSize = 0U;
+        std::uint64_t pageCount = 0U;
+        std::uint64_t freePages = 0U;
+        // size of the file, image databases are compressed and encrypted as a whole
+        std::uint64_t fileBytes = 0U;
+        // largest first
+        std::vector<Table> tables;
+
+        double freePageRatio() const
+        { return this->pageCount == 0U ? 0.0 : static_cast<double>(this->freePages) / static_cast<double>(this->pageCount); }
+        // free pages and the leaf pages every table and index could do without if its leaves were
+        // full, an upper bound of what a vacuum returns; b-trees aren't merged and keep their root page
+        std::uint64_t compactionSavings() const;
+        // orphaned icons and their thumbnails
+        std::uint64_t dedupSavings() const
+        { return this->orphanedIconBytes; }
+    };
+    // reads every page of the database once through dbstat and the token, icon and order tables
+    // once each, the database isn't changed
+    static Error inspect(Inspection &out);
+
     // get database connection status
     static bool databaseConnected();
 
     // initialize an empty database; close opened database
     static Error initDatabase();
     static void closeDatabase();
+    // closes without writing deferred and scheduled saves, which are lost; for signal handlers,
+    // nothing happens while the database is in use, the normal exit path calls closeDatabase()
+    static void discardDatabase();
 
     // initialize/save/load the token database
     static Error initializeTokens();
     static Error saveTokens();
     static Error loadTokens();
+    // writes saves deferred by the durability policy, does nothing if there are none
+    static Error flushTokens();
+    // the file was changed by someone else since it was last loaded or written, checks the
+    // modification time and size, the contents are only compared when those differ
+    static bool databaseFileChanged();
+    // loadTokens() if the database isn't open or the file changed, changed is set if it was loaded
+    static Error reloadTokens(bool *changed = nullptr);
+    // saveTokens() and loadTokens() on a worker of AsyncFileIO, the callback runs on the worker
+    using StatusCallback = std::function<void(const Error&)>;
+    static void saveTokensAsync(const StatusCallback &callback = {});
+    static void loadTokensAsync(const StatusCallback &callback = {});
+    // on WebAssembly the database file is kept in IndexedDB and every write stores the changed
+    // blocks, the file is copied into the in-memory filesystem before it can be loaded,
+    // FileReadFailure if nothing was stored, elsewhere the callback runs right away with Success
+    static void restoreDatabaseFile(const StatusCallback &callback);
 
     // display order
     static const DisplayOrder displayOrder();
+    // positions of deleted tokens and tokens without a position (only written by other tools or
+    // damaged files) are repaired by loadTokens(), tokens without a position are appended
+    // in the order they were added, without repair SqlDisplayOrderIncomplete is returned for them
+    static Error checkDisplayOrder(bool repair = false, std::size_t *repaired = nullptr);
+
+    // snapshot of the id, type and label of some tokens in a small file of its own, encrypted with
+    // the database password, so the tokens can be listed before the database is loaded
+    struct SnapshotEntry {
+        OTPToken::sqliteTokenID id = 0;
+        OTPToken::TokenType type = OTPToken::None;
+        OTPToken::Label label;
+    };
+    using Snapshot = std::vector<SnapshotEntry>;
+    // the entries follow the order of the ids, ids which aren't in the database are skipped
+    static Error writeSnapshot(const std::string &file, const std::vector<OTPToken::sqliteTokenID> &ids);
+    // doesn't need an open database, only the password
+    static Error readSnapshot(const std::string &file, Snapshot &out);
+
+    // progressive open of image databases written with setProgressiveOpen(true): only the chunks of the
+    // token set ahead of the image are decrypted into out and order, which list the tokens and generate
+    // their codes right away, independent of the icons and the size of the database; the database is
+    // loaded by loadTokensAsync() meanwhile, which runs whatever this returns, the callback gets its result
+    //  -> InvalidTokenFile: the file has no token set (page encrypted files open on demand anyway)
+    static Error openTokensProgressive(TokenSetView &out, DisplayOrder &order, const StatusCallback &loaded);
+
+    // read-only distribution of the tokens in the layout of TokenSetView, encrypted with the
+    // database password, tokens whose secret can't be decoded are left out
+    static Error writeTokenSet(const std::string &file, const OTPToken::sqliteTypesID &type = OTPToken::None);
+    // doesn't need an open database, only the password, the file is decrypted into the view
+    static Error readTokenSet(const std::string &file, TokenSetView &out);
+
+    // every change of a token or the display order is logged with a sequence number which only grows,
+    // a delta holds the current state of the tokens changed after a sequence number, encrypted with
+    // the database password; deltas are meant for copies of the same database, tokens are matched by id
+    using ChangeSequence = std::uint64_t;
+    static ChangeSequence changeSequence();
+    // last is set to the newest sequence number in the delta, which is the next since of the receiver
+    static Error writeDelta(const std::string &file, const ChangeSequence &since, ChangeSequence *last = nullptr);
+    // all changes are applied in one transaction or none of them, they are logged again locally,
+    // last is set to the sequence number of the sender
+    static Error applyDelta(const std::string &file, ChangeSequence *last = nullptr);
+    // drops the log up to the sequence number, older deltas fail with ChangeLogPruned afterwards
+    static Error pruneChangeLog(const ChangeSequence &upTo);
+
+    // observers are told about every change of the tokens of a vault once it is made, so views and
+    // caches can update the affected tokens instead of selecting all of them again
+    //  -> Inserted, Updated, Deleted:  the token with the id
+    //  -> Renamed:                     the label of the token changed (covers Updated)
+    //  -> CounterChanged:              only the counter of the token changed
+    //  -> Moved:                       new display position of the token
+    //  -> Reordered:                   all display positions were renumbered, the id is 0
+    //  -> Reloaded:                    the database was loaded, initialized or closed, the id is 0
+    struct ChangeEvent {
+        enum Kind : std::uint8_t {
+            Inserted,
+            Updated,
+            Renamed,
+            CounterChanged,
+            Deleted,
+            Moved,
+            Reordered,
+            Reloaded,
+        };
+        Kind kind;
+        OTPToken::sqliteTokenID id;
+    };
+    using ChangeEvents = std::vector<ChangeEvent>;
+    // the events of one call (all tokens of insertTokens(), a delta, ...) are delivered together,
+    // in the order they were made, changes which were rolled back are never delivered
+    using ChangeObserver = std::function<void(const std::string &vault, const ChangeEvents &events)>;
+    // runs the delivery on the executor of the observer, like a GUI event loop or AsyncFileIO::run(),
+    // observers without a dispatcher are called right away on the changing thread with the database locked,
+    // deliveries which were already dispatched still run after removeObserver()
+    using Dispatcher = std::function<void(const std::function<void()> &delivery)>;
+    using ObserverId = std::uint64_t;
+    static ObserverId addObserver(const ChangeObserver &observer, const Dispatcher &dispatcher = {});
+    static void removeObserver(const ObserverId &id);
 
     // database configuration
     static bool setPassword(const std::string &password);
     static bool setTokenDatabase(const std::string &file);
+    static void setStorageFormat(const StorageFormat &format);
+    static StorageFormat storageFormat();
+    static void setCompression(const Compression &compression);
+    static Compression compression();
+    // image databases are written with the token set of their tokens and the display order ahead
+    // of the image, which openTokensProgressive() decrypts on its own
+    static void setProgressiveOpen(bool enabled);
+    static bool progressiveOpen();
+    // image databases are vacuumed before they are written once free pages make up more than
+    // the threshold (0 to 1) of the pages, 0 disables it
+    static void setCompactionThreshold(double threshold);
+    static double compactionThreshold();
+    // page size of image databases, applied to new databases and by the next write of existing ones,
+    // must be a power of two from 512 to 65536, 0 keeps the page size of the database
+    static bool setPageSize(std::uint32_t pageSize);
+    static std::uint32_t pageSize();
+    static void setDurability(const Durability &durability,
+                              const std::chrono::milliseconds &window = std::chrono::milliseconds(500));
+    static Durability durability();
+    // every change schedules a saveTokens() on a background thread once no further change happened
+    // for the delay, closeDatabase() writes scheduled saves right away, a zero delay disables it
+    static void setAutoSave(const std::chrono::milliseconds &delay);
+    static std::chrono::milliseconds autoSave();
+    // changes since the last write to disk
+    static bool hasUnsavedChanges();
+    static void setKeyDerivation(const KeyDerivation &kdf, unsigned char cost = 15);
+    static KeyDerivation keyDerivation();
+    // executor for the encryption of large database images, nullptr uses an internal thread pool
+    static void setExecutor(Executor *executor);
+    // byte budget of the prepared keys kept for selectTokenSet() and preparedKeys(), replaces the cache
+    static void setKeyCacheBudget(std::size_t budget);
+    static std::size_t keyCacheBudget();
+    // cache of the prepared keys of the open database, emptied when the database is released
+    static std::shared_ptr<PreparedKeyCache> preparedKeys();
+    // applied by the next initializeTokens() or loadTokens() of the storage format
+    static void setTuning(const StorageFormat &format, const Tuning &tuning);
+    static Tuning tuning(const StorageFormat &format);
+    static Tuning defaultTuning(const StorageFormat &format);
 
     // change database password
     static Error changePassword(const std::string &newPassword);
+    // changePassword() on a worker of AsyncFileIO which doesn't hold the database while it is re-encrypted,
+    // a copy of the open image database is re-keyed and encrypted with the new password (the chunks in
+    // parallel) into a new file, which replaces the old one at once, the copy becomes the open database;
+    // changes made meanwhile restart the copy, the last attempt holds the database throughout
+    //  -> progress: encrypted chunks of the container, called on the encrypting threads one at a time
+    //  -> cancel:   checked until the file is replaced, file and password are kept (OperationCancelled),
+    //               must stay valid until the callback ran
+    // page encrypted databases are rewritten by changePassword() on the worker
+    using ProgressCallback = std::function<void(std::size_t done, std::size_t total)>;
+    static void changePasswordAsync(const std::string &newPassword, const StatusCallback &callback = {},
+                                    const ProgressCallback &progress = {}, const std::atomic<bool> *cancel = nullptr);
+
+    // session keys unlock the database file again without the password and without running the key
+    // derivation, they hold the derived keys of the current password (never the password itself)
+    // as base-64 text; a session key is bound to the key derivation salt of the file and valid
+    // for the lifetime, it is encrypted and authenticated (AES-GCM) under the wrapping key, so
+    // neither its keys nor its expiry are of use to anyone who holds the session key without
+    // the wrapping key; the caller keeps the wrapping key apart from the session key
+    static const constexpr std::size_t SessionWrappingKeySize = 32;
+    // new random wrapping key of SessionWrappingKeySize bytes
+    static SecureBuffer sessionWrappingKey();
+    static Error sessionKey(const std::chrono::seconds &lifetime, const SecureBuffer &wrappingKey, SecureString &out);
+    // replaces the password like setPassword(), nothing is changed if the session key is rejected
+    static Error unlockWithSessionKey(const SecureString &sessionKey, const SecureBuffer &wrappingKey);
 
     // sqlite SQL statement wrappers
-    static const OTPToken selectToken(const OTPToken::sqliteTokenID &id);
-    static const OTPToken selectToken(const OTPToken::Label &label);
-    static const OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type = OTPToken::None);
-    static const OTPTokenList selectTokens(const OTPToken::Label &label_like);
+    static OTPToken selectToken(const OTPToken::sqliteTokenID &id);
+    static OTPToken selectToken(const OTPToken::Label &label);
+    // id of the token with the exact label (case insensitive), 0 if there is none
+    static OTPToken::sqliteTokenID tokenId(const OTPToken::Label &label);
+    // labels of the open vault, the label lookups intern into it and in-memory indexes (see TokenSearchIndex)
+    // can share it; a new arena is started when the vault is closed, holders keep the old one alive
+    static std::shared_ptr<LabelArena> labelArena();
+    // listings without icons leave OTPToken::icon() empty, use selectIcon() to load it on demand
+    static OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type = OTPToken::None, bool withIcons = true);
+    static OTPTokenList selectTokens(const OTPToken::Label &label_like);
+    // full text search over the labels, every word of the text matches the start of a word in
+    // the label, the best matches come first and equal ones in display order
+    static Error searchTokens(const std::string &text, const std::size_t &limit, OTPTokenList &tokens, bool withIcons = false);
+    static Error forEachToken(const OTPToken::sqliteTypesID &type, const TokenCallback &callback, bool withIcons = true);
+    // rows [offset, offset + count) of the display order, for views which only show a part of the tokens
+    static Error selectTokenRange(const std::size_t &offset, const std::size_t &count,
+                                  const TokenCallback &callback, bool withIcons = false);
+
+    // pages of the tokens in display order, the query continues after the display position of the
+    // last token of the previous page (keyset pagination), so every page costs the same no matter
+    // how deep it is and pages don't skip or repeat tokens when tokens before them are deleted
+    // the filters which are set must all match, issuer and tag compare case insensitive
+    struct TokenFilter {
+        OTPToken::sqliteTypesID type = OTPToken::None;
+        OTPToken::ShaAlgorithm algorithm = OTPToken::Invalid;
+        OTPToken::DigitType digits = 0U;
+        OTPToken::PeriodType period = 0U;
+        OTPToken::Issuer issuer;
+        std::string tag;
+    };
+    // columns to select, the id is always selected, the other members of the tokens stay empty
+    enum TokenColumns : unsigned {
+        LabelColumn      = 1U << 0, // label and issuer
+        TypeColumn       = 1U << 1,
+        IconColumn       = 1U << 2,
+        SecretColumn     = 1U << 3,
+        ParameterColumns = 1U << 4, // digits, period, counter and algorithm
+        TagColumn        = 1U << 5,
+        AllColumns       = 0x3fU,
+    };
+    using SortKey = OTPToken::sqliteSortOrder;
+    static const constexpr SortKey FirstPage = std::numeric_limits<SortKey>::min();
+    struct TokenPage {
+        OTPTokenList tokens;
+        // after of the next page
+        SortKey next = FirstPage;
+        // there are no further tokens
+        bool last = true;
+    };
+    // up to limit tokens after the sort key, FirstPage starts at the front
+    static Error selectTokens(const TokenFilter &filter, const unsigned &columns, const SortKey &after,
+                              const std::size_t &limit, TokenPage &page);
+    // loads the tokens into the packed set for bulk code generation, in display order
+    static Error selectTokenSet(TokenSet &set, const OTPToken::sqliteTypesID &type = OTPToken::None, bool withIcons = false);
+    // groups of tokens matching a filter, usually an issuer or a tag, in display order; the groups
+    // are single indexed queries, the changes refuse filters without a condition with EmptyFilter
+    static Error selectGroup(const TokenFilter &filter, OTPTokenList &tokens, bool withIcons = false);
+    static Error selectGroupSet(const TokenFilter &filter, TokenSet &set);
+    static Error deleteGroup(const TokenFilter &filter, std::size_t *deleted = nullptr);
+    // moves the group to the position among the other tokens, the group keeps its order
+    static Error moveGroup(const TokenFilter &filter, const std::size_t &position);
+    // distinct issuers and tags of all tokens, sorted case insensitive
+    static std::vector<OTPToken::Issuer> issuers();
+    static std::vector<std::string> tags();
+    static const OTPToken::Icon selectIcon(const OTPToken::sqliteTokenID &id);
+    // the icon as kept in the cache of recently used icons, without a copy of the image
+    static const OTPToken::SharedIcon selectSharedIcon(const OTPToken::sqliteTokenID &id);
+    // thumbnails of the icons in the pixel sizes the frontend shows them at, so rows never scale the full icon;
+    // the scaler gets the icon and the size of the square it must fit in and returns the encoded thumbnail
+    // (empty if it can't decode the icon), it runs once per new icon when a token is stored, icons which
+    // were stored without a scaler get their thumbnails through storeIconThumbnail()
+    using IconScaler = std::function<OTPToken::Icon(const OTPToken::Icon &icon, unsigned size)>;
+    static void setIconScaler(const IconScaler &scaler, const std::vector<unsigned> &sizes);
+    // empty if the icon of the token has no thumbnail of this size
+    static const OTPToken::Icon selectIconThumbnail(const OTPToken::sqliteTokenID &id, unsigned size);
+    // thumbnails are a cache, storing one is no change of the token and is written by the next save
+    static Error storeIconThumbnail(const OTPToken::sqliteTokenID &id, unsigned size, const OTPToken::Icon &thumbnail);
+    // seconds the Steam servers are ahead of the local clock and the time they were measured at (see SteamTimeService),
+    // kept in the config table, storing it is no change of the tokens and is written by the next save;
+    // SqlEmptyResults if it was never stored
+    static Error storeSteamTimeOffset(const std::time_t &offset, const std::time_t &measured);
+    static Error selectSteamTimeOffset(std::time_t &offset, std::time_t &measured);
+    // the secrets are indexed by a keyed hash of the decoded secret, so secrets which only differ
+    // in case, spacing or padding are the same, secrets which can't be decoded never match
+    // ids of the tokens with the secret, in the order they were added
+    static std::vector<OTPToken::sqliteTokenID> tokensWithSecret(const OTPToken::TokenSecret &secret);
     static Error insertToken(const OTPToken &token);
+    // what insertTokens() does with tokens whose secret is already in the vault, tokens
+    // inserted earlier by the same call count as well
+    //  -> KeepDuplicates:    they are inserted like any other token
+    //  -> SkipDuplicates:    they are left out and reported as DuplicateSecret
+    //  -> ReplaceDuplicates: the oldest token with the secret is updated instead, keeping its id and position
+    enum DuplicatePolicy {
+        KeepDuplicates,
+        SkipDuplicates,
+        ReplaceDuplicates,
+    };
+    // inserts all tokens in a single transaction and appends them to the display order,
+    // failed rows (like SqlConstraintViolation on duplicate labels) are skipped and
+    // reported in the optional results list, which has one entry per token
+    static Error insertTokens(const OTPTokenList &tokens, std::vector<Error> *results = nullptr,
+                              const DuplicatePolicy &duplicates = KeepDuplicates);
+    // streaming variant, the producer passes the tokens one by one to insert, when it
+    // returns an error the whole transaction is rolled back and the error is returned
+    using TokenProducer = std::function<Error(const TokenCallback &insert)>;
+    static Error insertTokens(const TokenProducer &producer, std::vector<Error> *results = nullptr,
+                              const DuplicatePolicy &duplicates = KeepDuplicates);
     static Error updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token);
     static Error renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label);
+    // HOTP counters without saving the whole database, the counter is changed in the open database
+    // and appended to a small journal next to the file, loadTokens() applies the journal and the
+    // next save or closeDatabase() removes it; counter is set to the new value
+    static Error incrementCounter(const OTPToken::sqliteTokenID &id, OTPToken::CounterType *counter = nullptr);
+    static Error setCounter(const OTPToken::sqliteTokenID &id, const OTPToken::CounterType &counter);
     static Error deleteToken(const OTPToken::sqliteTokenID &id);
+    // learned clock drift of a TOTP token for verification, tokens without one get the
+    // default drift; stored next to the token and removed together with it
+    static Error getClockDrift(const OTPToken::sqliteTokenID &id, ClockDrift &drift);
+    static Error setClockDrift(const OTPToken::sqliteTokenID &id, const ClockDrift &drift);
+    // number of tokens of the type or of all tokens on None, kept in memory and counted once
+    // on load; 0 when the database is not open
     static OTPToken::sqliteTokenID tokenCount(const OTPToken::sqliteTypesID &type = OTPToken::None);
 
     static Error swapTokens(const OTPToken &token1, const OTPToken &token2);
@@ -103,11 +576,138 @@ public:
     static Error moveTokenBelow(const OTPToken::Label &token, const OTPToken::Label &below);
     static Error moveTokenAbove(const OTPToken &token, const OTPToken &above);
     static Error moveTokenAbove(const OTPToken::Label &token, const OTPToken::Label &above);
+    // replaces the whole display order in one transaction, the order must hold every token exactly once,
+    // SqlDisplayOrderIncomplete otherwise
+    static Error applyOrder(const DisplayOrder &order);
+    // sorts the display order, ties keep their current order
+    //  -> SortByLabel:    case insensitive like the label lookups
+    //  -> SortByType:     TOTP, HOTP, Steam
+    //  -> SortByCreation: order in which the tokens were added
+    enum SortOrder {
+        SortByLabel,
+        SortByType,
+        SortByCreation,
+    };
+    static Error sortTokens(const SortOrder &order);
 
+    // names of the static tables, served from the mapping they are created from
     static const std::string selectTokenTypeName(const OTPToken::sqliteTypesID &id);
     static const std::string selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id);
 
+    // read-only view of the database as it was when the reader was acquired, unsaved changes
+    // included, later changes aren't visible to it
+    // readers have a connection of their own and never take the database mutex, so any number
+    // of them can be used by other threads while the database is changed or saved,
+    // a single reader must only be used by one thread at a time
+    class Reader final
+    {
+    public:
+        Reader();
+        ~Reader();
+
+        Reader(Reader &&other) noexcept;
+        Reader &operator= (Reader &&other) noexcept;
+        Reader(const Reader&) = delete;
+        Reader &operator= (const Reader&) = delete;
+
+        // false if the database wasn't open when the reader was acquired
+        inline bool isValid() const
+        { return this->_connection != nullptr; }
+        // false once the database was changed after the reader was acquired
+        bool isCurrent() const;
+
+        OTPToken selectToken(const OTPToken::sqliteTokenID &id);
+        OTPToken selectToken(const OTPToken::Label &label);
+        OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type = OTPToken::None, bool withIcons = true);
+        Error forEachToken(const OTPToken::sqliteTypesID &type, const TokenCallback &callback, bool withIcons = true);
+        Error selectTokenSet(TokenSet &set, const OTPToken::sqliteTypesID &type = OTPToken::None, bool withIcons = false);
+        // 0 for invalid readers, -1 on failure
+        OTPToken::sqliteTokenID tokenCount(const OTPToken::sqliteTypesID &type = OTPToken::None);
+
+    private:
+        friend class TokenDatabase;
+
+        struct Image;
+        struct Connection;
+        struct Pool;
+        static Pool &pool();
+
+        explicit Reader(std::unique_ptr<Connection> connection);
+        std::unique_ptr<Connection> _connection;
+    };
+
+    // readers of the same state share one copy of the database image, released readers are
+    // kept for reuse until the database changes, invalid if the database isn't open
+    static Reader reader();
+    // reader for exports of large databases: the database is copied a few pages at a time through the
+    // online backup and the mutex is released between the steps, so writers are never stalled for the
+    // whole copy; changes made meanwhile are carried into the copy, which holds the state of the end of
+    // the copy and is never torn; page encrypted databases with unsaved changes are copied at once like
+    // for reader(), invalid if the database isn't open or was closed during the copy
+    static Reader exportReader();
+
+    // several databases (vaults) can be open at the same time, the functions above work on the
+    // selected one, the others keep their connection, password, caches and unsaved changes,
+    // so switching never reads or decrypts the file again
+    // the default vault has an empty name and always exists, new vaults start closed with the
+    // storage format of the selected one, set their file and password and load or initialize them
+    // switching writes deferred saves of the vault which is left first
+    static bool selectVault(const std::string &name, bool create = false);
+    // closes the vault like closeDatabase(), vaults other than the default one are removed,
+    // the default vault is selected if the closed vault was selected
+    static bool closeVault(const std::string &name);
+    static const std::string selectedVault();
+    // names of all vaults, the default one included
+    static std::vector<std::string> vaults();
+
+    // calls back with every open vault selected in turn, the selected vault is restored afterwards,
+    // the callback must not select another vault
+    using VaultCallback = std::function<void(const std::string &vault)>;
+    static void forEachVault(const VaultCallback &callback);
+
+    struct VaultToken {
+        std::string vault;
+        OTPToken token;
+    };
+    struct VaultCode {
+        std::string vault;
+        OTPToken::sqliteTokenID id;
+        OTPToken::Label label;
+        OTPToken::TokenString code;
+        OTPGenErrorCode error;
+    };
+
+    // tokens matching the label (like selectTokens()) in all open vaults
+    static std::vector<VaultToken> searchVaults(const OTPToken::Label &label_like);
+    // codes of the tokens of all open vaults at the given time, vault by vault in display order,
+    // HOTP tokens are computed with their stored counter which isn't incremented
+    static Error computeVaultCodes(const std::time_t &time, std::vector<VaultCode> &out,
+                                   const OTPToken::sqliteTypesID &type = OTPToken::None);
+
 private:
+    static StorageFormat databaseFormat;
+    static Compression databaseCompression;
+    static bool databaseProgressive;
+    static double databaseCompaction;
+    static std::uint32_t databasePageSize;
+    static Durability databaseDurability;
+    static std::chrono::milliseconds groupCommitWindow;
+    static std::chrono::milliseconds autoSaveDelay;
+    static Tuning imageTuning;
+    static Tuning pagesTuning;
+
+    // state of the vaults which aren't selected, exchanged with the state of the selected one
+    struct Vault;
+    struct Vaults;
+    static Vaults &vaultRegistry();
+    static void exchangeVault(Vault &vault);
+
+    // events of the changes made while a batch is alive are published when the outermost one ends,
+    // rolled back savepoints drop the events of their batch
+    struct ChangeBatch;
+    static void notifyChange(const ChangeEvent::Kind &kind, const OTPToken::sqliteTokenID &id);
+    static void publishChanges();
+
     struct SchemaField {
         const std::string name;
         const std::string datatype;
@@ -117,53 +717,193 @@ private:
         const std::string value;
     };
 
+    // writes the database right away, writeDatabase() does the work for the current storage format
+    static Error writeTokens();
+    static Error writeDatabase();
+
+    // vacuums image databases with too many free pages or another page size than databasePageSize
+    static Error compactDatabase();
+
+    // called by every successful change, schedules the auto save
+    static void markDirty();
+
+    // the counter journal belongs to databasePath, a save starts a new one with the current password
+    static const std::string counterJournalPath();
+    static Error applyCounterJournal();
+    static void resetCounterJournal();
+
+    // closes the connection without writing deferred saves
+    static void releaseDatabase();
+
     // creates an empty database with all the tables required for operation
     // types, algorithms and config are also created there
     static Error bootstrapDatabase();
     static Error createTable(const std::string &table_name, const std::vector<SchemaField> &schema, const std::string &additional = {});
+    // definitions is the column list, constraints included
+    static Error createTable(const std::string &table_name, std::string_view definitions);
     static Error insertStaticValues(const std::string &table_name, const std::vector<StaticValueSet> &values);
-    static const std::string selectStaticValue(const std::string &table, const OTPToken::sqliteShortID &id);
 
-    static Error executeGenericTokenStatement(const std::string &statement, const OTPToken &token);
-
-    static const std::string genUpdateQuery(const std::string &table, const std::vector<std::string> &fields, const std::string &condition = {});
-    static const std::string genInsertQuery(const std::string &table, const std::vector<std::string> &fields);
+    // written tells if a row was inserted or updated, the tags of the token are only written then
+    static Error executeGenericTokenStatement(const std::string &statement, const OTPToken &token,
+                                              const OTPToken::sqliteTokenID &id = 0, bool *written = nullptr);
+    // replaces the tags of the token, throws like the statements
+    static void storeTags(const OTPToken::sqliteTokenID &id, const OTPToken::Tags &tags, bool replace);
+    // the sink may move from the token, it is refilled for every row
+    using TokenSink = std::function<void(OTPToken&)>;
+    static void extractTokens(sqlite::database_binder &statement, const Internal::SecretCipher &cipher, const TokenSink &sink);
+    // tokens matching the filter in display order
+    static Error selectGroupRows(const TokenFilter &filter, const TokenSink &sink, bool withIcons);
+
+    // queries shared by the database and its readers, run on the given connection
+    using StatementCache = std::unordered_map<std::string, std::unique_ptr<sqlite::database_binder>>;
+    static Error selectTokenRows(sqlite::database &connection, StatementCache &statements, const Internal::SecretCipher &cipher,
+                                 const OTPToken::sqliteTypesID &type, const TokenSink &sink, bool withIcons);
+    static OTPToken selectTokenRow(sqlite::database &connection, StatementCache &statements, const Internal::SecretCipher &cipher,
+                                   const OTPToken::sqliteTokenID &id);
+    static OTPToken::sqliteTokenID countTokens(sqlite::database &connection, StatementCache &statements,
+                                               const OTPToken::sqliteTypesID &type);
 
     static const std::string escapeStringLIKE(const std::string &input);
-    static bool displayOrderQuery(std::string &query);
 
     // database config functions
     static Error storeDatabaseVersion();
+    static Error updateDatabaseVersion(const std::uint32_t &version);
     static Error getDatabaseVersion(std::uint32_t &version);
-    static Error storeDisplayOrder(const DisplayOrder &order);
+
+    // SHA-256 over the SQL of all schema objects, stored in the config table when the schema
+    // is created or validated, loadTokens() only validates the schema when it doesn't match
+    static Error schemaFingerprint(std::vector<unsigned char> &fingerprint);
+    static Error storeSchemaFingerprint();
+    static bool schemaFingerprintMatches();
+
+    // display order, stored in the indexed token_order table
+    static Error createDisplayOrderTable();
     static Error updateDisplayOrder(const DisplayOrder &order);
+    // updateDisplayOrder() as a logged change
+    static Error reorder(const DisplayOrder &order);
     static Error getDisplayOrder(DisplayOrder &order);
-
-    // serialization functions
-    static bool serializeDatabase(std::string &out);
-    static bool deserializeDatabase(const std::string &data);
+    static Error getDisplayPosition(const OTPToken::sqliteTokenID &id, OTPToken::sqliteLongID &position);
+    static Error moveDisplayPosition(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteTokenID &target, bool below);
+
+    static Error createTokenTable(const std::string &table_name);
+
+    // icons are stored once per content and referenced by the tokens, their thumbnails by the icon hash,
+    // unused icons are removed with their thumbnails
+    static Error createIconTable();
+    static Error createThumbnailTable();
+    static Error removeUnusedIcons();
+
+    // change log of the tokens and the display order, recordChange() throws like the statements
+    static Error createChangeLogTable();
+    static void recordChange(const std::uint8_t &op, const OTPToken::sqliteTokenID &id);
+
+    // learned clock drift by token id, the packed ClockDrift
+    static Error createClockDriftTable();
+
+    // external content full text index of the labels, kept in sync by triggers on tokens
+    static Error createSearchTable();
+
+    // index of the issuers and the tags by token, the tags are removed together with the token
+    static Error createGroupTables();
+
+    // index of the secret hashes of the tokens, see tokensWithSecret()
+    static Error createSecretHashIndex();
+    // hashes the secrets of rows without a hash once after every load, only the rows of
+    // migrated databases miss them, throws like the statements
+    static void fillSecretHashes();
+
+    // schema migrations, every step upgrades databases older than its version and runs
+    // in a savepoint together with the update of the stored version, the steps run in
+    // ascending order and a failed step rolls back only itself
+    struct MigrationStep
+    {
+        std::uint32_t version;
+        Error (*upgrade)();
+    };
+    static Error migrateDatabase(const std::uint32_t &version);
+
+    // older databases stored the display order as a blob in the config table
+    // and the icons as part of the tokens, digits, period and counter were BLOBs
+    static Error migrateDisplayOrder();
+    static Error migrateIcons();
+    static Error migrateTokenColumns();
+    // the change log is new in 0x0f000009
+    static Error migrateChangeLog();
+    // the drift table is new in 0x0f00000a
+    static Error migrateClockDrift();
+    // the search index is new in 0x0f00000b
+    static Error migrateSearchIndex();
+    // the issuer column and the tags are new in 0x0f00000c
+    static Error migrateTokenGroups();
+    // the secrets are encrypted since 0x0f00000d, before they were only mangled
+    static Error migrateSecrets();
+    // the icon thumbnails are new in 0x0f00000e
+    static Error migrateThumbnails();
+    // the secret hashes are new in 0x0f00000f
+    static Error migrateSecretHashes();
+
+    // cipher of the secret column of the open database, derived from the password on first use
+    // and kept until the database is released, readers keep the cipher of their image
+    static std::shared_ptr<const Internal::SecretCipher> secretCipher();
+    // files are written with the current password, the secrets and their hashes of the target follow it
+    static Error rekeySecrets(sqlite::database &connection, const Internal::SecretCipher &from, const Internal::SecretCipher &to);
+    // one pass of changePasswordAsync() over a copy of the image database, changed is set and nothing is
+    // replaced if the database changed during the pass, which must be repeated then
+    static Error rekeyImageCopy(const SecureString &password, const ProgressCallback &progress,
+                                const std::atomic<bool> *cancel, bool &changed);
+    // setPassword() with the hashed password
+    static void setPasswordHash(const SecureString &password);
+
+    // page encrypted databases, opens databasePath on disk or saves the open database and
+    // copies it into a new file at databasePath with the current password, which is opened afterwards,
+    // the conversion copies an in-memory image database into a new page encrypted file
+    static Error openPagedDatabase();
+    static Error rewritePagedDatabase();
+    static Error convertToPagedDatabase();
+    // copies the schema and rows of the image database into the open target database, throws on failure
+    static Error copyDatabase(sqlite::database &target);
+
+    // serialization functions, the in-memory database is serialized without a copy if possible,
+    // otherwise owned is set and the copy must be released with sqlite3_free()
+    // deserializeDatabase() takes ownership of the sqlite3_malloc() buffer, also on failure
+    static unsigned char *serializeDatabase(std::size_t &size, bool &owned);
+    static bool deserializeDatabase(unsigned char *data, std::size_t size, std::size_t capacity);
 
     // validate the schema of user-loaded (encrypted file on disk) databases
     static Error validateSchema();
 
-    // additional token obfuscation
+    // former obfuscation of the secret column, only read by migrateSecrets()
     static const OTPToken::TokenSecret mangleTokenSecret(const OTPToken::TokenSecret &secret);
     static const OTPToken::TokenSecret unmangleTokenSecret(const OTPToken::TokenSecret &secret);
 
-    // encryption APIs
-    static Error encrypt(const std::string &password,
+    // encryption APIs, images are written as chunked AES-256-GCM container
+    static Error encrypt(const SecureString &password,
                          const std::string &input_buffer, std::string &out, const int64_t &size = -1);
-    static Error encryptFromFile(const std::string &password,
+    static Error encrypt(const SecureString &password,
+                         const unsigned char *input, std::size_t size, std::string &out,
+                         const Internal::ContainerPayload &payload, const Internal::ContainerProgress *progress = nullptr);
+    // the token set and display order of the open database which go ahead of a progressive image
+    static Error progressivePrefix(SecureBuffer &out);
+    static Error encryptFromFile(const SecureString &password,
                                  const std::string &file, std::string &out);
 
     // decryption APIs
-    static Error decrypt(const std::string &password,
+    static Error decrypt(const SecureString &password,
                          const std::string &input_buffer, std::string &out, const int64_t &size = -1);
-    static Error decryptFromFile(const std::string &password,
+    // reads chunked containers and the former AES-CBC images,
+    // input and out may be the same buffer, size is updated to the length of the plaintext
+    // compressed is set if the plaintext is a compressed image
+    static Error decrypt(const SecureString &password,
+                         const unsigned char *input, std::size_t &size, unsigned char *out, bool *compressed = nullptr);
+    // replaces a decrypted compressed image with the image itself
+    static Error decompressDatabase(unsigned char *&data, std::size_t &size, std::size_t &capacity);
+    static Error decryptFromFile(const SecureString &password,
                                  const std::string &file, std::string &out);
 
     // write I/O APIs
     static Error readFile(const std::string &file, std::string &out);
+    // maps the file instead of reading it, the view is valid as long as out is open
+    static Error readFile(const std::string &file, Internal::MappedFile &out);
     static Error writeFile(const std::string &location, const std::string &buffer);
 };
 
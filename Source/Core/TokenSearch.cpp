@@ -0,0 +1,124 @@
+#include "TokenSearch.hpp"
+
+#include <utility>
+
+TokenSearch::TokenSearch(const TokenSearchIndex &index, const std::chrono::milliseconds &delay)
+    : _index(index),
+      _delay(delay)
+{
+}
+
+TokenSearch::~TokenSearch()
+{
+    this->stop();
+}
+
+void TokenSearch::start(const Callback &callback)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if (this->_thread.joinable())
+    {
+        return;
+    }
+
+    this->_callback = callback;
+    this->_stop = false;
+    this->_thread = std::thread(&TokenSearch::worker, this);
+}
+
+void TokenSearch::stop()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+        this->_cancel = true;
+        thread.swap(this->_thread);
+    }
+    this->_wakeup.notify_all();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+bool TokenSearch::running() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_thread.joinable();
+}
+
+std::uint64_t TokenSearch::query(const std::string &pattern)
+{
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_pattern = pattern;
+        this->_pending = true;
+        this->_due = std::chrono::steady_clock::now() + this->_delay;
+        this->_cancel = true;
+        generation = ++this->_generation;
+    }
+    this->_wakeup.notify_all();
+    return generation;
+}
+
+void TokenSearch::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_pending = false;
+        this->_cancel = true;
+        ++this->_generation;
+    }
+    this->_wakeup.notify_all();
+}
+
+void TokenSearch::worker()
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    while (!this->_stop)
+    {
+        this->_wakeup.wait(lock, [&]{
+            return this->_stop || this->_pending;
+        });
+
+        // every query moves the due time, wait until the input is idle
+        while (!this->_stop && this->_pending && std::chrono::steady_clock::now() < this->_due)
+        {
+            this->_wakeup.wait_until(lock, this->_due);
+        }
+        if (this->_stop)
+        {
+            break;
+        }
+        if (!this->_pending)
+        {
+            continue;
+        }
+
+        Result result;
+        result.generation = this->_generation;
+        result.pattern = this->_pattern;
+        this->_pending = false;
+        this->_cancel = false;
+
+        lock.unlock();
+        result.valid = this->_index.search(result.pattern, result.ids, &this->_cancel);
+        lock.lock();
+
+        // a newer query or cancel() came in while searching
+        if (this->_stop || this->_generation != result.generation)
+        {
+            continue;
+        }
+        lock.unlock();
+        if (this->_callback)
+        {
+            this->_callback(result);
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef TOKENSEARCH_HPP
+#define TOKENSEARCH_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TokenSearchIndex.hpp"
+
+/**
+ * Debounced label search on a worker thread
+ *
+ * Every query replaces the pending one and cancels a search which is
+ * still running, the worker starts searching once no new query arrived
+ * for the delay. Only the results of the latest query are reported, so a
+ * search bar can pass every keystroke.
+ *
+ */
+class TokenSearch
+{
+public:
+    struct Result
+    {
+        // the value query() returned for the pattern
+        std::uint64_t generation = 0;
+        std::string pattern;
+        // false if the pattern isn't a valid regular expression
+        bool valid = false;
+        std::vector<TokenSearchIndex::TokenId> ids;
+    };
+
+    using Callback = std::function<void(const Result &result)>;
+
+    /**
+     * the index must outlive the search
+     */
+    TokenSearch(const TokenSearchIndex &index,
+                const std::chrono::milliseconds &delay = std::chrono::milliseconds(150));
+
+    /**
+     * stop the worker and destroy the search
+     */
+    ~TokenSearch();
+
+    TokenSearch(const TokenSearch&) = delete;
+    TokenSearch &operator= (const TokenSearch&) = delete;
+
+    // run the callback on the worker thread for the results of the latest query
+    // the callback must not call start() or stop()
+    void start(const Callback &callback);
+    void stop();
+    bool running() const;
+
+    // schedule a search, returns the generation reported with its results
+    std::uint64_t query(const std::string &pattern);
+    // drop the pending query and the running search
+    void cancel();
+
+private:
+    void worker();
+
+    const TokenSearchIndex &_index;
+    const std::chrono::milliseconds _delay;
+
+    std::string _pattern;
+    std::uint64_t _generation = 0;
+    bool _pending = false;
+    std::chrono::steady_clock::time_point _due;
+    std::atomic<bool> _cancel{false};
+
+    Callback _callback;
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stop = false;
+};
+
+#endif // TOKENSEARCH_HPP
@@ -0,0 +1,476 @@
+#include "TokenSearchIndex.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <regex>
+
+namespace {
+    // removed entries are dropped once they outnumber the others
+    static const constexpr std::size_t COMPACT_THRESHOLD = 1024;
+    // how often a search looks at the cancel flag
+    static const constexpr std::size_t CANCEL_INTERVAL = 256;
+
+    static bool isAlnum(const char &c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+    }
+}
+
+TokenSearchIndex::TokenSearchIndex(const std::shared_ptr<LabelArena> &arena)
+    : _arena(arena ? arena : std::make_shared<LabelArena>()),
+      _sharedArena(arena != nullptr)
+{
+}
+
+std::string TokenSearchIndex::fold(const std::string &label)
+{
+    std::string folded;
+    LabelArena::fold(label, folded);
+    return folded;
+}
+
+std::vector<std::string> TokenSearchIndex::requiredLiterals(const std::string &pattern)
+{
+    // an alternation anywhere makes every literal optional
+    for (auto i = 0U; i < pattern.size(); ++i)
+    {
+        if (pattern[i] == '\\')
+        {
+            ++i;
+        }
+        else if (pattern[i] == '|')
+        {
+            return {};
+        }
+    }
+
+    std::vector<std::string> literals;
+    std::string run;
+    const auto flush = [&]{
+        if (!run.empty())
+        {
+            literals.emplace_back(fold(run));
+            run.clear();
+        }
+    };
+
+    // only literals outside of groups are collected, a quantifier makes the
+    // preceding character optional or repeated, so it ends the run
+    auto depth = 0;
+    for (auto i = 0U; i < pattern.size(); ++i)
+    {
+        const auto c = pattern[i];
+        switch (c)
+        {
+            case '\\':
+                if (i + 1 < pattern.size() && !isAlnum(pattern[i + 1]))
+                {
+                    if (depth == 0)
+                    {
+                        run += pattern[i + 1];
+                    }
+                }
+                else
+                {
+                    // character classes, anchors, control escapes and back references
+                    flush();
+                    if (i + 1 < pattern.size())
+                    {
+                        const auto e = pattern[i + 1];
+                        const auto arguments = e == 'x' ? 2U : e == 'u' ? 4U : e == 'c' ? 1U : 0U;
+                        i += arguments;
+                        while (e >= '0' && e <= '9' && i + 2 < pattern.size() && pattern[i + 2] >= '0' && pattern[i + 2] <= '9')
+                        {
+                            ++i;
+                        }
+                    }
+                }
+                ++i;
+                break;
+            case '*':
+            case '?':
+            case '{':
+                if (!run.empty())
+                {
+                    run.pop_back();
+                }
+                flush();
+                if (c == '{')
+                {
+                    while (i < pattern.size() && pattern[i] != '}')
+                    {
+                        ++i;
+                    }
+                }
+                break;
+            case '+':
+                flush();
+                break;
+            case '[':
+                flush();
+                ++i;
+                if (i < pattern.size() && pattern[i] == '^')
+                {
+                    ++i;
+                }
+                if (i < pattern.size() && pattern[i] == ']')
+                {
+                    ++i;
+                }
+                while (i < pattern.size() && pattern[i] != ']')
+                {
+                    if (pattern[i] == '\\')
+                    {
+                        ++i;
+                    }
+                    ++i;
+                }
+                break;
+            case '(':
+                flush();
+                ++depth;
+                break;
+            case ')':
+                flush();
+                depth = std::max(depth - 1, 0);
+                break;
+            case '.':
+            case '^':
+            case '$':
+            case '}':
+            case ']':
+                flush();
+                break;
+            default:
+                if (depth == 0)
+                {
+                    run += c;
+                }
+                break;
+        }
+    }
+    flush();
+
+    return literals;
+}
+
+std::vector<TokenSearchIndex::Trigram> TokenSearchIndex::trigrams(const std::string_view &folded)
+{
+    std::vector<Trigram> result;
+    if (folded.size() < 3)
+    {
+        return result;
+    }
+
+    result.reserve(folded.size() - 2);
+    for (auto i = 0U; i + 2 < folded.size(); ++i)
+    {
+        result.emplace_back((static_cast<Trigram>(static_cast<unsigned char>(folded[i])) << 16) |
+                            (static_cast<Trigram>(static_cast<unsigned char>(folded[i + 1])) << 8) |
+                             static_cast<Trigram>(static_cast<unsigned char>(folded[i + 2])));
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void TokenSearchIndex::insert(const TokenId &id, const OTPToken::Label &label)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    const auto interned = this->_arena->intern(label);
+    const auto it = this->_slots.find(id);
+    if (it != this->_slots.end())
+    {
+        // the token keeps its slot, so it keeps its place in the results
+        const auto slot = it->second;
+        auto &entry = this->_entries[slot];
+        if (entry.label == interned)
+        {
+            return;
+        }
+        this->unlink(slot);
+        entry.label = interned;
+        this->add(slot);
+        return;
+    }
+
+    const auto slot = static_cast<Slot>(this->_entries.size());
+    Entry entry;
+    entry.id = id;
+    entry.label = interned;
+    entry.alive = true;
+    this->_entries.emplace_back(std::move(entry));
+    this->_slots.emplace(id, slot);
+    this->add(slot);
+}
+
+void TokenSearchIndex::rename(const TokenId &id, const OTPToken::Label &label)
+{
+    this->insert(id, label);
+}
+
+void TokenSearchIndex::remove(const TokenId &id)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    const auto it = this->_slots.find(id);
+    if (it == this->_slots.end())
+    {
+        return;
+    }
+
+    const auto slot = it->second;
+    this->unlink(slot);
+    this->_slots.erase(it);
+
+    auto &entry = this->_entries[slot];
+    entry.alive = false;
+    entry.label = LabelArena::Label();
+    ++this->_removed;
+
+    if (this->_removed >= COMPACT_THRESHOLD && this->_removed > this->_slots.size())
+    {
+        this->compact();
+    }
+}
+
+void TokenSearchIndex::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    this->_entries.clear();
+    this->_slots.clear();
+    this->_postings.clear();
+    this->_removed = 0;
+    if (!this->_sharedArena)
+    {
+        this->_arena = std::make_shared<LabelArena>();
+    }
+}
+
+void TokenSearchIndex::setArena(const std::shared_ptr<LabelArena> &arena)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    if (!arena || arena == this->_arena)
+    {
+        return;
+    }
+
+    // the text doesn't change, so the trigrams and postings stay as they are
+    for (auto&& entry : this->_entries)
+    {
+        if (entry.alive)
+        {
+            entry.label = arena->intern(entry.label.text);
+        }
+    }
+    this->_arena = arena;
+    this->_sharedArena = true;
+}
+
+std::shared_ptr<LabelArena> TokenSearchIndex::arena() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_arena;
+}
+
+std::size_t TokenSearchIndex::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_slots.size();
+}
+
+bool TokenSearchIndex::contains(const TokenId &id) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_slots.count(id) != 0;
+}
+
+std::vector<TokenSearchIndex::TokenId> TokenSearchIndex::ids() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    std::vector<TokenId> result;
+    result.reserve(this->_slots.size());
+    for (auto&& entry : this->_entries)
+    {
+        if (entry.alive)
+        {
+            result.emplace_back(entry.id);
+        }
+    }
+    return result;
+}
+
+void TokenSearchIndex::add(const Slot &slot)
+{
+    for (auto&& trigram : trigrams(this->_entries[slot].label.folded))
+    {
+        // new slots are the largest, renamed ones are placed in order
+        auto &posting = this->_postings[trigram];
+        if (posting.empty() || posting.back() < slot)
+        {
+            posting.emplace_back(slot);
+        }
+        else
+        {
+            posting.insert(std::lower_bound(posting.begin(), posting.end(), slot), slot);
+        }
+    }
+}
+
+void TokenSearchIndex::unlink(const Slot &slot)
+{
+    for (auto&& trigram : trigrams(this->_entries[slot].label.folded))
+    {
+        const auto it = this->_postings.find(trigram);
+        if (it == this->_postings.end())
+        {
+            continue;
+        }
+
+        auto &posting = it->second;
+        const auto pos = std::lower_bound(posting.begin(), posting.end(), slot);
+        if (pos != posting.end() && *pos == slot)
+        {
+            posting.erase(pos);
+        }
+        if (posting.empty())
+        {
+            this->_postings.erase(it);
+        }
+    }
+}
+
+void TokenSearchIndex::compact()
+{
+    std::vector<Entry> entries;
+    entries.reserve(this->_slots.size());
+    for (auto&& entry : this->_entries)
+    {
+        if (entry.alive)
+        {
+            entries.emplace_back(std::move(entry));
+        }
+    }
+
+    this->_entries = std::move(entries);
+    this->_slots.clear();
+    this->_postings.clear();
+    this->_removed = 0;
+    for (auto slot = 0U; slot < this->_entries.size(); ++slot)
+    {
+        this->_slots.emplace(this->_entries[slot].id, slot);
+        this->add(slot);
+    }
+}
+
+void TokenSearchIndex::candidateSlots(const std::string &pattern, std::vector<Slot> &out, bool &all) const
+{
+    out.clear();
+    all = true;
+
+    std::vector<Trigram> required;
+    for (auto&& literal : requiredLiterals(pattern))
+    {
+        const auto t = trigrams(literal);
+        required.insert(required.end(), t.begin(), t.end());
+    }
+    if (required.empty())
+    {
+        return;
+    }
+    all = false;
+
+    // intersect the postings, starting with the shortest one
+    std::vector<const std::vector<Slot>*> postings;
+    for (auto&& trigram : required)
+    {
+        const auto it = this->_postings.find(trigram);
+        if (it == this->_postings.end())
+        {
+            return;
+        }
+        postings.emplace_back(&it->second);
+    }
+    std::sort(postings.begin(), postings.end(), [](const std::vector<Slot> *a, const std::vector<Slot> *b) {
+        return a->size() < b->size();
+    });
+
+    out = *postings.front();
+    std::vector<Slot> next;
+    for (auto i = 1U; i < postings.size() && !out.empty(); ++i)
+    {
+        next.clear();
+        std::set_intersection(out.begin(), out.end(), postings[i]->begin(), postings[i]->end(), std::back_inserter(next));
+        out.swap(next);
+    }
+}
+
+void TokenSearchIndex::candidates(const std::string &pattern, std::vector<TokenId> &out) const
+{
+    out.clear();
+
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    std::vector<Slot> slots;
+    auto all = false;
+    this->candidateSlots(pattern, slots, all);
+
+    if (all)
+    {
+        out.reserve(this->_slots.size());
+        for (auto&& entry : this->_entries)
+        {
+            if (entry.alive)
+            {
+                out.emplace_back(entry.id);
+            }
+        }
+        return;
+    }
+
+    out.reserve(slots.size());
+    for (auto&& slot : slots)
+    {
+        out.emplace_back(this->_entries[slot].id);
+    }
+}
+
+bool TokenSearchIndex::search(const std::string &pattern, std::vector<TokenId> &out, const std::atomic<bool> *cancel) const
+{
+    out.clear();
+
+    std::regex regex;
+    if (!pattern.empty())
+    {
+        try {
+            regex = std::regex(pattern, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+        } catch (std::regex_error &) {
+            return false;
+        }
+    }
+
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    std::vector<Slot> slots;
+    auto all = false;
+    this->candidateSlots(pattern, slots, all);
+
+    const auto count = all ? this->_entries.size() : slots.size();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (cancel && i % CANCEL_INTERVAL == 0 && cancel->load(std::memory_order_relaxed))
+        {
+            out.clear();
+            return false;
+        }
+
+        const auto &entry = this->_entries[all ? i : slots[i]];
+        if (!entry.alive)
+        {
+            continue;
+        }
+        if (pattern.empty() || std::regex_search(entry.label.text.begin(), entry.label.text.end(), regex))
+        {
+            out.emplace_back(entry.id);
+        }
+    }
+
+    return true;
+}
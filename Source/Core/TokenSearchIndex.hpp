@@ -0,0 +1,108 @@
+#ifndef TOKENSEARCHINDEX_HPP
+#define TOKENSEARCHINDEX_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LabelArena.hpp"
+#include "OTPToken.hpp"
+
+/**
+ * Label search for large token lists
+ *
+ * The labels are folded to lower case once when they are added and
+ * indexed by their trigrams. A search pattern is an ECMAScript regular
+ * expression matched case insensitive, the literal parts every match must
+ * contain narrow the labels down to the ones with all their trigrams, the
+ * expression is only evaluated on those.
+ *
+ * Patterns without usable literals (alternations, short literals, only
+ * classes) are evaluated on every label. Labels are folded like the label
+ * lookups of the token database, only ASCII letters are folded.
+ *
+ * The labels are interned in a LabelArena, the index keeps views of them.
+ * Given the arena of the token database (TokenDatabase::labelArena()) the
+ * index shares the strings with the label lookups, without an arena it
+ * keeps one of its own.
+ *
+ * The index is safe to search from other threads while it is updated.
+ *
+ */
+class TokenSearchIndex
+{
+public:
+    using TokenId = OTPToken::sqliteTokenID;
+
+    explicit TokenSearchIndex(const std::shared_ptr<LabelArena> &arena = nullptr);
+
+    TokenSearchIndex(const TokenSearchIndex&) = delete;
+    TokenSearchIndex &operator= (const TokenSearchIndex&) = delete;
+
+    // add a token, a known id is renamed instead
+    void insert(const TokenId &id, const OTPToken::Label &label);
+    // update the label of a token, unknown ids are added
+    void rename(const TokenId &id, const OTPToken::Label &label);
+    void remove(const TokenId &id);
+    void clear();
+
+    // moves the labels to another arena, nothing happens if it is the current one
+    void setArena(const std::shared_ptr<LabelArena> &arena);
+    std::shared_ptr<LabelArena> arena() const;
+
+    std::size_t size() const;
+    bool contains(const TokenId &id) const;
+    // ids of all tokens in insertion order
+    std::vector<TokenId> ids() const;
+
+    // ids of the labels matching the pattern in insertion order, an empty pattern matches all labels,
+    // returns false if the pattern is invalid or the search was cancelled through the flag
+    bool search(const std::string &pattern, std::vector<TokenId> &out, const std::atomic<bool> *cancel = nullptr) const;
+
+    // ids of the labels containing the trigrams of the pattern literals, a superset of the matches
+    void candidates(const std::string &pattern, std::vector<TokenId> &out) const;
+
+    // lower case literals every match of the pattern contains, empty if nothing is certain
+    static std::vector<std::string> requiredLiterals(const std::string &pattern);
+
+    // ASCII lower case
+    static std::string fold(const std::string &label);
+
+private:
+    struct Entry
+    {
+        TokenId id = 0;
+        LabelArena::Label label;
+        bool alive = false;
+    };
+
+    using Trigram = std::uint32_t;
+    using Slot = std::uint32_t;
+
+    static std::vector<Trigram> trigrams(const std::string_view &folded);
+
+    void add(const Slot &slot);
+    void unlink(const Slot &slot);
+    void compact();
+
+    // candidate slots, all is set if the pattern gives no trigrams
+    void candidateSlots(const std::string &pattern, std::vector<Slot> &out, bool &all) const;
+
+    std::vector<Entry> _entries;
+    std::unordered_map<TokenId, Slot> _slots;
+    // ascending slots of the labels containing a trigram
+    std::unordered_map<Trigram, std::vector<Slot>> _postings;
+    std::size_t _removed = 0;
+
+    // a private arena is replaced on clear(), a shared one keeps its labels
+    std::shared_ptr<LabelArena> _arena;
+    bool _sharedArena = false;
+
+    mutable std::shared_mutex _mutex;
+};
+
+#endif // TOKENSEARCHINDEX_HPP
@@ -0,0 +1,176 @@
+#include "TokenSet.hpp"
+#include "PreparedKeyCache.hpp"
+#include "Clock.hpp"
+
+#include <utility>
+
+TokenSet::TokenSet(const std::vector<OTPToken> &tokens)
+{
+    this->reserve(tokens.size());
+    for (auto&& token : tokens)
+    {
+        this->insert(token);
+    }
+}
+
+std::size_t TokenSet::insert(const OTPToken &token)
+{
+    const auto index = this->insertParameters(token);
+    this->_labels.emplace_back(token.label());
+    this->_icons.emplace_back(token.sharedIcon());
+    OTPGEN_PERF_MEMORY_ADD(this->_memory, sizeof(OTPKey) + this->_labels.back().capacity() + this->_icons.back().size());
+    return index;
+}
+
+std::size_t TokenSet::insert(OTPToken &&token)
+{
+    const auto index = this->insertParameters(token);
+    this->_labels.emplace_back(std::move(token._label));
+    this->_icons.emplace_back(std::move(token._icon));
+    OTPGEN_PERF_MEMORY_ADD(this->_memory, sizeof(OTPKey) + this->_labels.back().capacity() + this->_icons.back().size());
+    return index;
+}
+
+std::size_t TokenSet::insertParameters(const OTPToken &token)
+{
+    const auto index = this->_ids.size();
+    this->_ids.emplace_back(token.id());
+    this->_types.emplace_back(token.type());
+    this->_periods.emplace_back(token.rotationPeriod());
+
+    // Steam tokens always use SHA1 and the Steam period
+    const auto steam = token.type() == OTPToken::Steam;
+    const auto algorithm = steam ? OTPToken::SHA1 : token.algorithm();
+    const auto period = token.type() == OTPToken::HOTP ? 0U :
+                        steam ? OTPToken::defaultPeriod(OTPToken::Steam) : token.period();
+    const auto digits = steam ? OTPToken::defaultDigitLength(OTPToken::Steam) : token.digitLength();
+
+    auto error = OTPGenErrorCode::Valid;
+    auto key = OTPKey();
+    if (token.type() != OTPToken::TOTP && token.type() != OTPToken::HOTP && !steam)
+    {
+        error = OTPGenErrorCode::InvalidType;
+    }
+    else if (this->_keyCache)
+    {
+        const auto cached = this->_keyCache->key(token, &error);
+        if (cached)
+        {
+            key = *cached;
+        }
+    }
+    else
+    {
+        key = OTPGen::prepareKey(token.secret(), algorithm, &error);
+        if (error == OTPGenErrorCode::Valid && !key.isValid())
+        {
+            error = OTPGenErrorCode::InvalidBase32Input;
+        }
+    }
+
+    if (error != OTPGenErrorCode::Valid)
+    {
+        this->_errors.emplace_back(error);
+        return index;
+    }
+
+    // there are only a few distinct parameter sets, a linear search is enough
+    auto group = 0U;
+    while (group < this->_groups.size())
+    {
+        const auto &g = this->_groups[group];
+        if (g.type == token.type() && g.period == period && g.algorithm == algorithm && g.digits == digits)
+        {
+            break;
+        }
+        ++group;
+    }
+    if (group == this->_groups.size())
+    {
+        Group g;
+        g.type = token.type();
+        g.period = period;
+        g.algorithm = algorithm;
+        g.digits = digits;
+        this->_groups.emplace_back(std::move(g));
+    }
+
+    auto &g = this->_groups[group];
+    g.keys.emplace_back(std::move(key));
+    g.indices.emplace_back(index);
+    if (token.type() == OTPToken::HOTP)
+    {
+        g.counters.emplace_back(token.counter());
+    }
+
+    this->_errors.emplace_back(OTPGenErrorCode::Valid);
+    return index;
+}
+
+void TokenSet::reserve(const std::size_t &size)
+{
+    this->_errors.reserve(size);
+    this->_ids.reserve(size);
+    this->_types.reserve(size);
+    this->_periods.reserve(size);
+    this->_labels.reserve(size);
+    this->_icons.reserve(size);
+}
+
+void TokenSet::clear()
+{
+    this->_groups.clear();
+    this->_errors.clear();
+    this->_ids.clear();
+    this->_types.clear();
+    this->_periods.clear();
+    this->_labels.clear();
+    this->_icons.clear();
+    OTPGEN_PERF_MEMORY_RESIZE(this->_memory, 0U);
+}
+
+void TokenSet::computeCodes(const std::time_t &time,
+                            std::vector<OTPToken::TokenString> &out,
+                            std::vector<OTPGenErrorCode> *errors,
+                            Executor *executor) const
+{
+    out.assign(this->size(), {});
+    if (errors)
+    {
+        // invalid tokens keep the preparation error
+        *errors = this->_errors;
+    }
+
+    std::vector<OTPToken::TokenString> codes;
+    std::vector<OTPGenErrorCode> code_errors;
+    for (auto&& g : this->_groups)
+    {
+        if (g.type == OTPToken::TOTP)
+        {
+            OTPGen::computeTOTPBatch(time, g.keys, g.digits, g.period, codes, &code_errors, executor);
+        }
+        else if (g.type == OTPToken::Steam)
+        {
+            OTPGen::computeSteamBatch(Clock::steamTime(time), g.keys, codes, &code_errors, executor);
+        }
+        else
+        {
+            codes.resize(g.keys.size());
+            code_errors.resize(g.keys.size());
+            for (auto i = 0U; i < g.keys.size(); ++i)
+            {
+                code_errors[i] = OTPGenErrorCode::Valid;
+                codes[i] = OTPGen::computeHOTP(g.keys[i], g.counters[i], g.digits, &code_errors[i]);
+            }
+        }
+
+        for (auto i = 0U; i < g.indices.size(); ++i)
+        {
+            out[g.indices[i]] = std::move(codes[i]);
+            if (errors)
+            {
+                (*errors)[g.indices[i]] = code_errors[i];
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef TOKENSET_HPP
+#define TOKENSET_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "OTPToken.hpp"
+#include "OTPKey.hpp"
+#include "OTPGen.hpp"
+#include "PerfStats.hpp"
+
+class Executor;
+class PreparedKeyCache;
+
+/**
+ * Packed token storage for bulk code generation
+ *
+ * The generation parameters are grouped by (type, period, algorithm, digits),
+ * every group keeps the prepared keys of its tokens in one contiguous array,
+ * so the batch generators stream through a group without touching anything
+ * else. Labels, icons and ids are kept in side tables indexed by the position
+ * of the token in the set, the icons share the buffers of the tokens.
+ *
+ * Tokens whose secret can't be prepared are kept in the side tables, their
+ * codes are empty and the preparation error is reported.
+ *
+ */
+class TokenSet
+{
+public:
+    struct Group
+    {
+        OTPToken::TokenType type = OTPToken::None;
+        OTPToken::PeriodType period = 0U;
+        OTPToken::ShaAlgorithm algorithm = OTPToken::Invalid;
+        OTPToken::DigitType digits = 0U;
+
+        // prepared keys and the index of their token in the set
+        std::vector<OTPKey> keys;
+        std::vector<std::size_t> indices;
+        // counters of HOTP tokens, empty for the time-based groups
+        std::vector<OTPToken::CounterType> counters;
+    };
+
+    TokenSet() = default;
+    explicit TokenSet(const std::vector<OTPToken> &tokens);
+
+    // appends the token, returns its index
+    std::size_t insert(const OTPToken &token);
+    std::size_t insert(OTPToken &&token);
+
+    void reserve(const std::size_t &size);
+    void clear();
+
+    // keys of inserted tokens are taken from the cache and prepared into it on a miss,
+    // nullptr (the default) prepares every key on its own
+    inline void setKeyCache(PreparedKeyCache *cache)
+    { this->_keyCache = cache; }
+
+    inline std::size_t size() const
+    { return this->_ids.size(); }
+    inline bool empty() const
+    { return this->_ids.empty(); }
+
+    // side tables
+    inline const OTPToken::sqliteTokenID &id(const std::size_t &index) const
+    { return this->_ids[index]; }
+    inline const OTPToken::Label &label(const std::size_t &index) const
+    { return this->_labels[index]; }
+    inline const OTPToken::Icon &icon(const std::size_t &index) const
+    { return this->_icons[index].bytes(); }
+    inline const OTPToken::SharedIcon &sharedIcon(const std::size_t &index) const
+    { return this->_icons[index]; }
+    inline const OTPToken::TokenType &type(const std::size_t &index) const
+    { return this->_types[index]; }
+    inline const OTPToken::PeriodType &rotationPeriod(const std::size_t &index) const
+    { return this->_periods[index]; }
+
+    inline const std::vector<Group> &groups() const
+    { return this->_groups; }
+
+    // codes of all tokens at the given time, stored at the index of the token,
+    // HOTP tokens use the counter they were inserted with
+    void computeCodes(const std::time_t &time,
+                      std::vector<OTPToken::TokenString> &out,
+                      std::vector<OTPGenErrorCode> *errors = nullptr,
+                      Executor *executor = nullptr) const;
+
+private:
+    std::size_t insertParameters(const OTPToken &token);
+
+    std::vector<Group> _groups;
+
+    // preparation error of every token, invalid tokens are in no group
+    std::vector<OTPGenErrorCode> _errors;
+
+    std::vector<OTPToken::sqliteTokenID> _ids;
+    std::vector<OTPToken::TokenType> _types;
+    std::vector<OTPToken::PeriodType> _periods;
+    std::vector<OTPToken::Label> _labels;
+    std::vector<OTPToken::SharedIcon> _icons;
+
+    PreparedKeyCache *_keyCache = nullptr;
+
+    // the keys, labels and icons of the tokens
+    PerfStats::Allocation _memory{PerfStats::TokenStorage};
+};
+
+#endif // TOKENSET_HPP
@@ -0,0 +1,500 @@
+#include "TokenSetView.hpp"
+#include "TokenSet.hpp"
+#include "Clock.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+    static const unsigned char MAGIC[4] = {'O', 'T', 'P', 'T'};
+    static const constexpr unsigned char VERSION = 1;
+
+    static const constexpr std::size_t HEADER_SIZE = 48U;
+    static const constexpr std::size_t GROUP_SIZE = 16U;
+    static const constexpr std::size_t TOKEN_SIZE = 32U;
+    static const constexpr std::size_t BUCKET_SIZE = 4U;
+
+    // header fields
+    static const constexpr std::size_t VERSION_OFFSET = 4U;
+    static const constexpr std::size_t COUNT_OFFSET = 8U;
+    static const constexpr std::size_t GROUP_COUNT_OFFSET = 12U;
+    static const constexpr std::size_t BUCKETS_OFFSET = 16U;
+    static const constexpr std::size_t GROUPS_OFFSET = 24U;
+    static const constexpr std::size_t TOKENS_OFFSET = 28U;
+    static const constexpr std::size_t INDEX_OFFSET = 32U;
+    static const constexpr std::size_t LABELS_OFFSET = 36U;
+    static const constexpr std::size_t KEYS_OFFSET = 40U;
+    static const constexpr std::size_t TOTAL_OFFSET = 44U;
+
+    static std::uint64_t load(const unsigned char *data, std::size_t bytes)
+    {
+        std::uint64_t value = 0U;
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            value |= static_cast<std::uint64_t>(data[i]) << (8U * i);
+        }
+        return value;
+    }
+
+    static void store(unsigned char *data, std::uint64_t value, std::size_t bytes)
+    {
+        for (auto i = 0U; i < bytes; ++i)
+        {
+            data[i] = static_cast<unsigned char>((value >> (8U * i)) & 0xFFU);
+        }
+    }
+
+    static std::size_t align(std::size_t offset)
+    {
+        return (offset + 7U) & ~static_cast<std::size_t>(7U);
+    }
+
+    static unsigned char foldChar(unsigned char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+    }
+
+    // FNV-1a over the label, only ASCII is folded like COLLATE NOCASE
+    static std::uint32_t labelHash(const std::string_view &label)
+    {
+        std::uint32_t hash = 2166136261U;
+        for (auto&& c : label)
+        {
+            hash ^= foldChar(static_cast<unsigned char>(c));
+            hash *= 16777619U;
+        }
+        return hash;
+    }
+
+    static bool sameLabel(const std::string_view &a, const std::string_view &b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (auto i = 0U; i < a.size(); ++i)
+        {
+            if (foldChar(static_cast<unsigned char>(a[i])) != foldChar(static_cast<unsigned char>(b[i])))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool validParameters(const unsigned char *group)
+    {
+        const auto type = group[0];
+        const auto algorithm = group[1];
+        const auto digits = group[2];
+        const auto period = load(group + 4U, 4U);
+        if (algorithm != OTPToken::SHA1 && algorithm != OTPToken::SHA256 && algorithm != OTPToken::SHA512)
+        {
+            return false;
+        }
+        if (digits < OTPGen::minDigitLength() || digits > OTPGen::maxDigitLength())
+        {
+            return false;
+        }
+        switch (type)
+        {
+            case OTPToken::TOTP:
+            case OTPToken::Steam:
+                return period >= OTPGen::minPeriod() && period <= OTPGen::maxPeriod();
+            case OTPToken::HOTP:
+                return period == 0U;
+        }
+        return false;
+    }
+}
+
+TokenSetView::~TokenSetView()
+{
+    this->close();
+}
+
+TokenSetView::TokenSetView(TokenSetView &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+TokenSetView &TokenSetView::operator= (TokenSetView &&other) noexcept
+{
+    if (this != &other)
+    {
+        this->close();
+
+        // the data of the moved buffer stays where it is
+        this->_buffer = std::move(other._buffer);
+        this->_data = other._data;
+        this->_size = other._size;
+        this->_count = other._count;
+        this->_buckets = other._buckets;
+        this->_groups = other._groups;
+        this->_tokens = other._tokens;
+        this->_index = other._index;
+        this->_labels = other._labels;
+        this->_keys = other._keys;
+        other.close();
+    }
+    return *this;
+}
+
+bool TokenSetView::serialize(const TokenSet &set, SecureBuffer &out)
+{
+    out.clear();
+    const auto &groups = set.groups();
+    if (groups.size() > std::numeric_limits<std::uint32_t>::max())
+    {
+        return false;
+    }
+
+    // the tokens of a group are written in label order
+    std::vector<std::pair<std::size_t, std::size_t>> entries;
+    std::size_t label_bytes = 0U, key_bytes = 0U;
+    for (auto g = 0U; g < groups.size(); ++g)
+    {
+        const auto first = entries.size();
+        for (auto k = 0U; k < groups[g].indices.size(); ++k)
+        {
+            const auto &label = set.label(groups[g].indices[k]);
+            const auto &key = groups[g].keys[k].key();
+            if (label.size() > std::numeric_limits<std::uint16_t>::max() ||
+                key.empty() || key.size() > std::numeric_limits<std::uint16_t>::max())
+            {
+                return false;
+            }
+            label_bytes += label.size();
+            key_bytes += key.size();
+            entries.emplace_back(g, k);
+        }
+        std::sort(entries.begin() + static_cast<std::ptrdiff_t>(first), entries.end(), [&](const auto &a, const auto &b) {
+            const auto ia = groups[a.first].indices[a.second];
+            const auto ib = groups[b.first].indices[b.second];
+            return set.label(ia) != set.label(ib) ? set.label(ia) < set.label(ib) : set.id(ia) < set.id(ib);
+        });
+    }
+
+    // at least twice as many buckets as tokens, there is always an empty one to end the probing
+    const auto count = entries.size();
+    std::size_t buckets = count == 0U ? 0U : 2U;
+    while (buckets < 2U * count)
+    {
+        buckets <<= 1U;
+    }
+
+    const auto groups_offset = HEADER_SIZE;
+    const auto tokens_offset = align(groups_offset + groups.size() * GROUP_SIZE);
+    const auto index_offset = align(tokens_offset + count * TOKEN_SIZE);
+    const auto labels_offset = align(index_offset + buckets * BUCKET_SIZE);
+    const auto keys_offset = align(labels_offset + label_bytes);
+    const auto total = keys_offset + key_bytes;
+    if (total > std::numeric_limits<std::uint32_t>::max())
+    {
+        return false;
+    }
+
+    out.assign(total, 0U);
+    auto data = out.data();
+    std::memcpy(data, MAGIC, sizeof(MAGIC));
+    data[VERSION_OFFSET] = VERSION;
+    store(data + COUNT_OFFSET, count, 4U);
+    store(data + GROUP_COUNT_OFFSET, groups.size(), 4U);
+    store(data + BUCKETS_OFFSET, buckets, 4U);
+    store(data + GROUPS_OFFSET, groups_offset, 4U);
+    store(data + TOKENS_OFFSET, tokens_offset, 4U);
+    store(data + INDEX_OFFSET, index_offset, 4U);
+    store(data + LABELS_OFFSET, labels_offset, 4U);
+    store(data + KEYS_OFFSET, keys_offset, 4U);
+    store(data + TOTAL_OFFSET, total, 4U);
+
+    std::size_t first = 0U;
+    for (auto g = 0U; g < groups.size(); ++g)
+    {
+        auto record = data + groups_offset + g * GROUP_SIZE;
+        record[0] = groups[g].type;
+        record[1] = groups[g].algorithm;
+        record[2] = groups[g].digits;
+        store(record + 4U, groups[g].period, 4U);
+        store(record + 8U, first, 4U);
+        store(record + 12U, groups[g].indices.size(), 4U);
+        first += groups[g].indices.size();
+    }
+
+    const auto mask = buckets - 1U;
+    std::size_t label_offset = 0U, key_offset = 0U;
+    for (auto i = 0U; i < count; ++i)
+    {
+        const auto &g = groups[entries[i].first];
+        const auto k = entries[i].second;
+        const auto index = g.indices[k];
+        const auto &label = set.label(index);
+        const auto &key = g.keys[k].key();
+
+        auto record = data + tokens_offset + i * TOKEN_SIZE;
+        store(record, static_cast<std::uint64_t>(set.id(index)), 8U);
+        store(record + 8U, g.type == OTPToken::HOTP ? g.counters[k] : 0U, 8U);
+        store(record + 16U, label_offset, 4U);
+        store(record + 20U, label.size(), 2U);
+        store(record + 22U, key.size(), 2U);
+        store(record + 24U, key_offset, 4U);
+        store(record + 28U, entries[i].first, 4U);
+
+        std::memcpy(data + labels_offset + label_offset, label.data(), label.size());
+        std::memcpy(data + keys_offset + key_offset, key.data(), key.size());
+        label_offset += label.size();
+        key_offset += key.size();
+
+        auto bucket = labelHash(label) & mask;
+        while (load(data + index_offset + bucket * BUCKET_SIZE, 4U) != 0U)
+        {
+            bucket = (bucket + 1U) & mask;
+        }
+        store(data + index_offset + bucket * BUCKET_SIZE, i + 1U, 4U);
+    }
+
+    return true;
+}
+
+bool TokenSetView::open(SecureBuffer &&buffer)
+{
+    this->close();
+    this->_buffer = std::move(buffer);
+    if (!this->validate(this->_buffer.data(), this->_buffer.size()))
+    {
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+bool TokenSetView::open(const unsigned char *data, std::size_t size)
+{
+    this->close();
+    return this->validate(data, size);
+}
+
+bool TokenSetView::validate(const unsigned char *data, std::size_t size)
+{
+    if (!data || size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+        data[VERSION_OFFSET] != VERSION || load(data + TOTAL_OFFSET, 4U) != size)
+    {
+        return false;
+    }
+
+    const auto count = load(data + COUNT_OFFSET, 4U);
+    const auto group_count = load(data + GROUP_COUNT_OFFSET, 4U);
+    const auto buckets = load(data + BUCKETS_OFFSET, 4U);
+    const auto groups_offset = load(data + GROUPS_OFFSET, 4U);
+    const auto tokens_offset = load(data + TOKENS_OFFSET, 4U);
+    const auto index_offset = load(data + INDEX_OFFSET, 4U);
+    const auto labels_offset = load(data + LABELS_OFFSET, 4U);
+    const auto keys_offset = load(data + KEYS_OFFSET, 4U);
+
+    // the sections follow each other, the index has more buckets than tokens
+    if ((buckets & (buckets - 1U)) != 0U || (count == 0U ? buckets != 0U : buckets <= count) ||
+        groups_offset < HEADER_SIZE ||
+        groups_offset + group_count * GROUP_SIZE > tokens_offset ||
+        tokens_offset + count * TOKEN_SIZE > index_offset ||
+        index_offset + buckets * BUCKET_SIZE > labels_offset ||
+        labels_offset > keys_offset || keys_offset > size)
+    {
+        return false;
+    }
+
+    std::uint64_t first = 0U;
+    for (auto g = 0ULL; g < group_count; ++g)
+    {
+        const auto record = data + groups_offset + g * GROUP_SIZE;
+        if (!validParameters(record) || load(record + 8U, 4U) != first)
+        {
+            return false;
+        }
+        first += load(record + 12U, 4U);
+    }
+    if (first != count)
+    {
+        return false;
+    }
+
+    const auto label_bytes = keys_offset - labels_offset;
+    const auto key_bytes = size - keys_offset;
+    for (auto i = 0ULL; i < count; ++i)
+    {
+        const auto record = data + tokens_offset + i * TOKEN_SIZE;
+        const auto label_offset = load(record + 16U, 4U);
+        const auto label_size = load(record + 20U, 2U);
+        const auto key_size = load(record + 22U, 2U);
+        const auto key_offset = load(record + 24U, 4U);
+        const auto g = load(record + 28U, 4U);
+        if (label_offset + label_size > label_bytes || key_size == 0U || key_offset + key_size > key_bytes ||
+            g >= group_count)
+        {
+            return false;
+        }
+
+        const auto group = data + groups_offset + g * GROUP_SIZE;
+        const auto group_first = load(group + 8U, 4U);
+        if (i < group_first || i >= group_first + load(group + 12U, 4U))
+        {
+            return false;
+        }
+    }
+
+    for (auto b = 0ULL; b < buckets; ++b)
+    {
+        if (load(data + index_offset + b * BUCKET_SIZE, 4U) > count)
+        {
+            return false;
+        }
+    }
+
+    this->_data = data;
+    this->_size = size;
+    this->_count = static_cast<std::size_t>(count);
+    this->_buckets = static_cast<std::size_t>(buckets);
+    this->_groups = data + groups_offset;
+    this->_tokens = data + tokens_offset;
+    this->_index = data + index_offset;
+    this->_labels = data + labels_offset;
+    this->_keys = data + keys_offset;
+    return true;
+}
+
+void TokenSetView::close()
+{
+    // the secure allocator wipes the buffer on release
+    SecureBuffer().swap(this->_buffer);
+    this->_data = nullptr;
+    this->_size = 0U;
+    this->_count = 0U;
+    this->_buckets = 0U;
+    this->_groups = this->_tokens = this->_index = this->_labels = this->_keys = nullptr;
+}
+
+const unsigned char *TokenSetView::token(const std::size_t &index) const
+{
+    return this->_tokens + index * TOKEN_SIZE;
+}
+
+const unsigned char *TokenSetView::group(const std::size_t &index) const
+{
+    return this->_groups + load(this->token(index) + 28U, 4U) * GROUP_SIZE;
+}
+
+OTPToken::sqliteTokenID TokenSetView::id(const std::size_t &index) const
+{
+    return index < this->_count ? static_cast<OTPToken::sqliteTokenID>(load(this->token(index), 8U)) : 0;
+}
+
+std::string_view TokenSetView::label(const std::size_t &index) const
+{
+    if (index >= this->_count)
+    {
+        return {};
+    }
+    const auto record = this->token(index);
+    return std::string_view(reinterpret_cast<const char*>(this->_labels + load(record + 16U, 4U)),
+                            static_cast<std::size_t>(load(record + 20U, 2U)));
+}
+
+OTPToken::TokenType TokenSetView::type(const std::size_t &index) const
+{
+    return index < this->_count ? static_cast<OTPToken::TokenType>(this->group(index)[0]) : OTPToken::None;
+}
+
+OTPToken::ShaAlgorithm TokenSetView::algorithm(const std::size_t &index) const
+{
+    return index < this->_count ? static_cast<OTPToken::ShaAlgorithm>(this->group(index)[1]) : OTPToken::Invalid;
+}
+
+OTPToken::DigitType TokenSetView::digitLength(const std::size_t &index) const
+{
+    return index < this->_count ? static_cast<OTPToken::DigitType>(this->group(index)[2]) : 0U;
+}
+
+OTPToken::PeriodType TokenSetView::period(const std::size_t &index) const
+{
+    return index < this->_count ? static_cast<OTPToken::PeriodType>(load(this->group(index) + 4U, 4U)) : 0U;
+}
+
+OTPToken::CounterType TokenSetView::counter(const std::size_t &index) const
+{
+    return index < this->_count ? static_cast<OTPToken::CounterType>(load(this->token(index) + 8U, 8U)) : 0U;
+}
+
+std::size_t TokenSetView::find(const std::string_view &label) const
+{
+    if (this->_buckets == 0U)
+    {
+        return npos;
+    }
+
+    const auto mask = this->_buckets - 1U;
+    auto bucket = labelHash(label) & mask;
+    for (;;)
+    {
+        const auto entry = static_cast<std::size_t>(load(this->_index + bucket * BUCKET_SIZE, 4U));
+        if (entry == 0U)
+        {
+            return npos;
+        }
+        if (sameLabel(this->label(entry - 1U), label))
+        {
+            return entry - 1U;
+        }
+        bucket = (bucket + 1U) & mask;
+    }
+}
+
+bool TokenSetView::computeCode(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out,
+                               OTPGenErrorCode *error) const
+{
+    out[0] = '\0';
+    if (index >= this->_count)
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidType;
+        return false;
+    }
+
+    const auto record = this->token(index);
+    const auto group = this->group(index);
+    const auto key = OTPGen::prepareRawKey(this->_keys + load(record + 24U, 4U), static_cast<std::size_t>(load(record + 22U, 2U)),
+                                           group[1], error);
+    if (!key.isValid())
+    {
+        return false;
+    }
+
+    switch (group[0])
+    {
+        case OTPToken::TOTP:
+            return OTPGen::computeTOTPInto(out, time, key, group[2], static_cast<OTPToken::PeriodType>(load(group + 4U, 4U)), error);
+        case OTPToken::HOTP:
+            return OTPGen::computeHOTPInto(out, key, static_cast<OTPToken::CounterType>(load(record + 8U, 8U)), group[2], error);
+        case OTPToken::Steam:
+            return OTPGen::computeSteamInto(out, Clock::steamTime(time), key, error);
+    }
+
+    if (error) (*error) = OTPGenErrorCode::InvalidType;
+    return false;
+}
+
+bool TokenSetView::verifyCode(const std::size_t &index, const OTPToken::TokenString &code, const std::time_t &time,
+                              const unsigned int &window, int *step) const
+{
+    if (index >= this->_count || this->type(index) != OTPToken::TOTP)
+    {
+        return false;
+    }
+
+    const auto record = this->token(index);
+    const auto group = this->group(index);
+    const auto key = OTPGen::prepareRawKey(this->_keys + load(record + 24U, 4U), static_cast<std::size_t>(load(record + 22U, 2U)),
+                                           group[1]);
+    return key.isValid() &&
+           OTPGen::verifyTOTP(key, code, time, window, group[2], static_cast<OTPToken::PeriodType>(load(group + 4U, 4U)), step);
+}
@@ -0,0 +1,106 @@
+#ifndef TOKENSETVIEW_HPP
+#define TOKENSETVIEW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string_view>
+
+#include "OTPToken.hpp"
+#include "OTPGen.hpp"
+#include "SecureMemory.hpp"
+
+class TokenSet;
+
+/**
+ * Read-only token set in a flat binary layout
+ *
+ * The layout holds everything needed to generate and verify codes: the
+ * decoded keys, the generation parameters grouped like in TokenSet and a
+ * hash index over the folded labels. Sections are referenced by offsets
+ * and all fields are little-endian, so the layout is used in place, from
+ * a decrypted buffer or a mapped file, without parsing or SQLite.
+ *
+ * Opening only validates the bounds of the sections and records, lookups
+ * and codes work directly on the buffer.
+ *
+ * Layout (version 1), sections aligned to 8 bytes:
+ *  -> header:  magic "OTPT" | version | 3 reserved | token count | group count |
+ *              index buckets | reserved | offsets of groups, tokens, index,
+ *              labels and keys | total size (all u32)
+ *  -> groups:  type | algorithm | digits | reserved | period (u32) |
+ *              first token (u32) | token count (u32)
+ *  -> tokens:  id (i64) | counter (u64) | label offset (u32) | label size (u16) |
+ *              key size (u16) | key offset (u32) | group (u32)
+ *  -> index:   open addressing table of token index + 1, 0 marks empty buckets
+ *  -> labels and keys: the bytes of all labels and keys
+ *
+ * The tokens are sorted by group and within a group by label.
+ *
+ */
+class TokenSetView
+{
+public:
+    static const constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    TokenSetView() = default;
+    ~TokenSetView();
+
+    TokenSetView(TokenSetView &&other) noexcept;
+    TokenSetView &operator= (TokenSetView &&other) noexcept;
+    TokenSetView(const TokenSetView&) = delete;
+    TokenSetView &operator= (const TokenSetView&) = delete;
+
+    // writes the layout of the valid tokens of the set, tokens without a group are skipped
+    static bool serialize(const TokenSet &set, SecureBuffer &out);
+
+    // takes the buffer and validates the layout, closed on failure
+    bool open(SecureBuffer &&buffer);
+    // uses the memory in place, it must stay valid and unchanged until the view is closed
+    bool open(const unsigned char *data, std::size_t size);
+    void close();
+
+    inline bool isOpen() const
+    { return this->_data != nullptr; }
+    inline std::size_t size() const
+    { return this->_count; }
+    inline bool empty() const
+    { return this->_count == 0; }
+
+    OTPToken::sqliteTokenID id(const std::size_t &index) const;
+    std::string_view label(const std::size_t &index) const;
+    OTPToken::TokenType type(const std::size_t &index) const;
+    OTPToken::ShaAlgorithm algorithm(const std::size_t &index) const;
+    OTPToken::DigitType digitLength(const std::size_t &index) const;
+    OTPToken::PeriodType period(const std::size_t &index) const;
+    OTPToken::CounterType counter(const std::size_t &index) const;
+
+    // index of the token with the label (compared like the database, ASCII case folded), npos if missing
+    std::size_t find(const std::string_view &label) const;
+
+    // code of the token at the given time, HOTP tokens use their stored counter
+    bool computeCode(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out,
+                     OTPGenErrorCode *error = nullptr) const;
+    // verifies the code of a TOTP token with a skew of up to ±window steps, false for other types
+    bool verifyCode(const std::size_t &index, const OTPToken::TokenString &code, const std::time_t &time,
+                    const unsigned int &window, int *step = nullptr) const;
+
+private:
+    bool validate(const unsigned char *data, std::size_t size);
+    const unsigned char *token(const std::size_t &index) const;
+    const unsigned char *group(const std::size_t &index) const;
+
+    SecureBuffer _buffer;
+    const unsigned char *_data = nullptr;
+    std::size_t _size = 0U;
+
+    std::size_t _count = 0U;
+    std::size_t _buckets = 0U;
+    const unsigned char *_groups = nullptr;
+    const unsigned char *_tokens = nullptr;
+    const unsigned char *_index = nullptr;
+    const unsigned char *_labels = nullptr;
+    const unsigned char *_keys = nullptr;
+};
+
+#endif // TOKENSETVIEW_HPP
@@ -0,0 +1,135 @@
+#include "UsedCodeStore.hpp"
+
+namespace {
+    using Internal::SlotTable;
+
+    // slot layout: fingerprint (40 bits) | expiry time (24 bits), 0 is a free slot
+    static const constexpr unsigned EXPIRY_BITS = 24U;
+    static const constexpr std::uint64_t EXPIRY_MASK = (1ULL << EXPIRY_BITS) - 1U;
+    static const constexpr std::uint64_t EXPIRY_RANGE = EXPIRY_MASK >> 1U;
+
+    // the fingerprint is taken from a second mix, the hash itself selects the slot
+    static inline std::uint64_t fingerprint(const std::uint64_t &h) noexcept
+    {
+        return (SlotTable::mix(h) | 1U) << EXPIRY_BITS;
+    }
+
+    // the expiry is compared modulo 2^24 seconds (194 days), live slots expire within half of it
+    static inline bool live(const std::uint64_t &slot, const std::time_t &now) noexcept
+    {
+        const auto left = (slot - static_cast<std::uint64_t>(now)) & EXPIRY_MASK;
+        return slot != 0U && left != 0U && left <= EXPIRY_RANGE;
+    }
+
+    static inline bool matches(const std::uint64_t &slot, const std::uint64_t &print) noexcept
+    {
+        return (slot & ~EXPIRY_MASK) == print;
+    }
+}
+
+UsedCodeStore::UsedCodeStore(const std::size_t &capacity, const Placement &placement)
+    : _table(capacity, SlotTable::SHARD_SIZE, placement == Shared ? SlotTable::Shared : SlotTable::Private)
+{
+}
+
+UsedCodeStore::~UsedCodeStore()
+{
+}
+
+UsedCodeStore::Result UsedCodeStore::insert(const OTPToken::sqliteTokenID &id, const std::uint64_t &step,
+                                            const std::time_t &expiry, const std::time_t &now) noexcept
+{
+    // already expired, nothing to remember
+    if (expiry <= now)
+    {
+        return Accepted;
+    }
+
+    const auto h = SlotTable::hash(id, step);
+    const auto print = fingerprint(h);
+    const auto until = expiry - now > static_cast<std::time_t>(EXPIRY_RANGE) ? now + static_cast<std::time_t>(EXPIRY_RANGE) : expiry;
+    const auto value = print | (static_cast<std::uint64_t>(until) & EXPIRY_MASK);
+    const auto slot = this->_table.probe(h);
+
+    // a live use anywhere in the probe sequence, expired slots may come first
+    for (auto p = 0U; p < SlotTable::PROBE_LENGTH; ++p)
+    {
+        const auto current = slot[p].load(std::memory_order_acquire);
+        if (live(current, now) && matches(current, print))
+        {
+            return Reused;
+        }
+    }
+
+    // claim the first free or expired slot, a slot taken in between is checked again
+    auto claimed = SlotTable::PROBE_LENGTH;
+    for (auto p = 0U; p < SlotTable::PROBE_LENGTH && claimed == SlotTable::PROBE_LENGTH; ++p)
+    {
+        auto current = slot[p].load(std::memory_order_acquire);
+        while (!live(current, now))
+        {
+            if (slot[p].compare_exchange_weak(current, value))
+            {
+                claimed = p;
+                break;
+            }
+        }
+        if (claimed == SlotTable::PROBE_LENGTH && matches(current, print))
+        {
+            return Reused;
+        }
+    }
+
+    if (claimed == SlotTable::PROBE_LENGTH)
+    {
+        return Full;
+    }
+
+    // two inserts of the same pair which raced for different slots, in the order of the
+    // swaps the later one sees the earlier claim, so a claim which sees another live use
+    // is rejected, both may be rejected but the pair is never accepted twice, both claims
+    // stay in place until they expire
+    for (auto p = 0U; p < SlotTable::PROBE_LENGTH; ++p)
+    {
+        if (p == claimed)
+        {
+            continue;
+        }
+
+        const auto current = slot[p].load();
+        if (live(current, now) && matches(current, print))
+        {
+            return Reused;
+        }
+    }
+
+    return Accepted;
+}
+
+bool UsedCodeStore::contains(const OTPToken::sqliteTokenID &id, const std::uint64_t &step, const std::time_t &now) const noexcept
+{
+    const auto h = SlotTable::hash(id, step);
+    const auto print = fingerprint(h);
+    const auto slot = this->_table.probe(h);
+    for (auto p = 0U; p < SlotTable::PROBE_LENGTH; ++p)
+    {
+        const auto current = slot[p].load(std::memory_order_acquire);
+        if (live(current, now) && matches(current, print))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::size_t UsedCodeStore::occupancy(const std::time_t &now) const noexcept
+{
+    return this->_table.count([&](const std::uint64_t &slot) {
+        return live(slot, now);
+    });
+}
+
+void UsedCodeStore::clear() noexcept
+{
+    this->_table.clear();
+}
@@ -0,0 +1,82 @@
+#ifndef USEDCODESTORE_HPP
+#define USEDCODESTORE_HPP
+
+#include <cstdint>
+#include <ctime>
+
+#include "OTPToken.hpp"
+#include "Internal/SlotTable.hpp"
+
+/**
+ * Replay protection for verified codes
+ *
+ * Remembers which (token id, time step) pairs were already accepted until
+ * the step leaves the verification window, so a code can be used only once.
+ *
+ * The store has a fixed amount of slots split into shards, every slot is a
+ * single atomic word holding a 40-bit fingerprint of the pair and the low
+ * 24 bits of its expiry time. Inserting is lock-free: the probe sequence of
+ * the pair is searched for a live use and a free or expired slot is claimed
+ * with a compare-and-swap. Expired slots are reused in place, the store
+ * never allocates after construction and never needs a cleanup pass.
+ *
+ * When all slots of the probe sequence are live the insert fails with Full,
+ * the caller should reject the code in that case.
+ *
+ * A shared store keeps its slots in a shared anonymous mapping, processes
+ * forked after the construction insert into the same slots, so a code is
+ * accepted only once by all of them.
+ *
+ */
+class UsedCodeStore
+{
+public:
+    enum Result {
+        Accepted = 0,
+        Reused,
+        Full,
+    };
+
+    enum Placement {
+        Private = 0,
+        // shared with the processes forked later on, private where there is no mmap
+        Shared,
+    };
+
+    static const constexpr std::size_t DEFAULT_CAPACITY = 1U << 20;
+
+    /**
+     * allocate the slots, the capacity is rounded up to a power of 2
+     * and should be about twice the amount of codes used per window
+     */
+    explicit UsedCodeStore(const std::size_t &capacity = DEFAULT_CAPACITY, const Placement &placement = Private);
+    ~UsedCodeStore();
+
+    UsedCodeStore(const UsedCodeStore&) = delete;
+    UsedCodeStore &operator= (const UsedCodeStore&) = delete;
+
+    // marks the step of the token as used until the expiry time,
+    // fails with Reused if it was marked before and didn't expire at the given time
+    Result insert(const OTPToken::sqliteTokenID &id, const std::uint64_t &step,
+                  const std::time_t &expiry, const std::time_t &now) noexcept;
+
+    // checks if the step of the token is marked as used at the given time
+    bool contains(const OTPToken::sqliteTokenID &id, const std::uint64_t &step, const std::time_t &now) const noexcept;
+
+    // amount of slots holding a use which didn't expire at the given time, scans the whole store
+    // without blocking inserts, so the amount is approximate while codes are inserted
+    std::size_t occupancy(const std::time_t &now) const noexcept;
+
+    // forgets all codes, must not run concurrently with inserts
+    void clear() noexcept;
+
+    inline std::size_t capacity() const
+    { return this->_table.capacity(); }
+    inline bool shared() const
+    { return this->_table.shared(); }
+
+private:
+    Internal::SlotTable _table;
+};
+
+#endif // USEDCODESTORE_HPP
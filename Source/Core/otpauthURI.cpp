@@ -2,10 +2,10 @@
 
 #include <OTPToken.hpp>
 
-#include <cstring>
-#include <vector>
 #include <algorithm>
-#include <regex>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 
 const std::string otpauthURI::OTPAUTH_PREFIX = "otpauth://";
 
@@ -13,126 +13,236 @@ otpauthURI::otpauthURI()
 {
 }
 
-otpauthURI::otpauthURI(const std::string &uri)
-{
-    if (uri.size() >= OTPAUTH_PREFIX.size() && uri.substr(0, OTPAUTH_PREFIX.size()) == OTPAUTH_PREFIX)
+namespace {
+    // characters which are written as-is by the percent encoder, generated at compile time
+    struct UnreservedTable
     {
-        this->uri = uri.substr(OTPAUTH_PREFIX.size());
-    }
+        bool values[256];
+    };
 
-    if (!empty())
+    static constexpr UnreservedTable make_unreserved_table()
     {
-        // extract type
-        auto delim = this->uri.find_first_of('/');
-        if (delim == std::string::npos)
+        UnreservedTable table{};
+        for (auto c = 0U; c < 256U; ++c)
         {
-            setTypeEnum(this->uri);
-            return;
-        }
-        else
-        {
-            setTypeEnum(this->uri.substr(0, delim));
-            if (_type == Invalid)
-            {
-                return;
-            }
+            table.values[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                              c == '-' || c == '_' || c == '.' || c == '~';
         }
+        return table;
+    }
 
-        ++delim;
+    static const constexpr auto UNRESERVED = make_unreserved_table();
 
-        // extract label, use URI decoding
-        auto delim2 = this->uri.find_first_of('?', delim);
-        if (delim2 == std::string::npos)
-        {
-            UriComponent label(this->uri.substr(delim));
-            _label = label.decoded();
-            return;
-        }
-        else
-        {
-            UriComponent label(this->uri.substr(delim, delim2 - delim));
-            _label = label.decoded();
-        }
+    static const constexpr unsigned char INVALID_HEX = 0xff;
 
-        ++delim2;
+    struct HexTable
+    {
+        unsigned char values[256];
+    };
 
-        // extract parameters
-        auto params_str = this->uri.substr(delim2);
-        if (params_str.empty() || params_str.find('=') == std::string::npos)
+    static constexpr HexTable make_hex_table()
+    {
+        HexTable table{};
+        for (auto c = 0U; c < 256U; ++c)
         {
-            return;
+            table.values[c] = c >= '0' && c <= '9' ? static_cast<unsigned char>(c - '0') :
+                              c >= 'a' && c <= 'f' ? static_cast<unsigned char>(c - 'a' + 10U) :
+                              c >= 'A' && c <= 'F' ? static_cast<unsigned char>(c - 'A' + 10U) : INVALID_HEX;
         }
+        return table;
+    }
 
-        std::regex re(R"(\&)");
-        std::sregex_token_iterator first{
-            params_str.begin(), params_str.end(), re, -1
-        }, last;
-        std::vector<std::string> params_vec = {first, last};
+    static const constexpr auto HEX_VALUES = make_hex_table();
 
-        for (auto&& p : params_vec)
-        {
-            auto delim = p.find('=');
-            if (delim == std::string::npos)
-            {
-                continue;
-            }
+    // portable SIMD vector of bytes (GCC/Clang vector extensions)
+    typedef unsigned char u8x16 __attribute__((vector_size(16)));
 
-            auto key = p.substr(0, delim);
-            auto value = p.substr(delim + 1);
+    static inline u8x16 broadcast(unsigned char c) noexcept
+    {
+        return u8x16{c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c};
+    }
 
-            // URI decode issuer
-            if (key == "issuer")
+    // true if every lane of the comparison result is set
+    template<typename Mask>
+    static inline bool all(const Mask &mask) noexcept
+    {
+        std::uint64_t lanes[2];
+        std::memcpy(lanes, &mask, sizeof(lanes));
+        return (lanes[0] & lanes[1]) == ~std::uint64_t(0U);
+    }
+
+    // length of the leading blocks of 16 unreserved characters
+    static std::size_t unreservedRun(const char *str, std::size_t length) noexcept
+    {
+        std::size_t i = 0U;
+        for (; i + 16U <= length; i += 16U)
+        {
+            u8x16 v;
+            std::memcpy(&v, str + i, sizeof(v));
+            const auto letter = (v | broadcast(0x20)) - broadcast('a');
+            const auto digit = v - broadcast('0');
+            const auto safe = (letter < broadcast(26)) | (digit < broadcast(10)) |
+                              (v == broadcast('-')) | (v == broadcast('_')) |
+                              (v == broadcast('.')) | (v == broadcast('~'));
+            if (!all(safe))
             {
-                UriComponent issuer(value);
-                value = issuer.decoded();
+                break;
             }
-
-            _params.insert({key, value});
         }
+        return i;
+    }
 
-        // parameters may not be empty
-        if (_params.empty())
+    // length of the leading blocks of 16 characters which are decoded as-is
+    static std::size_t plainRun(const char *str, std::size_t length) noexcept
+    {
+        std::size_t i = 0U;
+        for (; i + 16U <= length; i += 16U)
         {
-            return;
+            u8x16 v;
+            std::memcpy(&v, str + i, sizeof(v));
+            if (!all((v != broadcast('%')) & (v != broadcast('+'))))
+            {
+                break;
+            }
         }
+        return i;
+    }
 
-        // check for mandatory fields
-        if (_params.count("secret") != 1)
-        {
-            _params.clear();
-            return;
-        }
-        if (_type == HOTP && _params.count("counter") != 1)
-        {
-            _params.clear();
-            return;
-        }
+    template<typename String, typename Number>
+    static void appendNumber(String &out, std::string_view name, Number value)
+    {
+        char buffer[24];
+        const auto res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(name.data(), name.size());
+        out.append(buffer, static_cast<std::size_t>(res.ptr - buffer));
+    }
+
+    static const std::string_view PARAM_NAMES[otpauthURI::ParamCount] = {
+        "secret", "issuer", "algorithm", "digits", "counter", "period",
+    };
+
+}
+
+otpauthURI::otpauthURI(std::string_view uri)
+{
+    const std::string_view prefix(OTPAUTH_PREFIX);
+    if (uri.size() >= prefix.size() && uri.substr(0, prefix.size()) == prefix)
+    {
+        parse(uri.substr(prefix.size()));
+    }
+}
+
+void otpauthURI::parse(std::string_view uri)
+{
+    this->uri.assign(uri.data(), uri.size());
+    if (uri.empty())
+    {
+        return;
+    }
 
-        // add defaults when missing
-        if (_params.count("algorithm") == 0)
+    // extract type
+    auto delim = uri.find('/');
+    setTypeEnum(uri.substr(0, delim));
+    if (delim == std::string_view::npos || _type == Invalid)
+    {
+        return;
+    }
+    uri.remove_prefix(delim + 1U);
+
+    // extract label, use URI decoding
+    delim = uri.find('?');
+    UriComponent::decode(uri.substr(0, delim), _label);
+    if (delim == std::string_view::npos)
+    {
+        return;
+    }
+    uri.remove_prefix(delim + 1U);
+
+    // extract parameters, the first occurrence of a key is used
+    while (!uri.empty())
+    {
+        const auto end = uri.find('&');
+        const auto param = uri.substr(0, end);
+        uri = end == std::string_view::npos ? std::string_view() : uri.substr(end + 1U);
+
+        const auto equals = param.find('=');
+        if (equals == std::string_view::npos)
         {
-            _params.insert({"algorithm", "SHA1"});
+            continue;
         }
-        if (_params.count("digits") == 0)
+
+        const auto key = param.substr(0, equals);
+        for (auto i = 0U; i < ParamCount; ++i)
         {
-            _params.insert({"digits", "6"});
+            if (key == PARAM_NAMES[i])
+            {
+                const auto p = static_cast<Param>(i);
+                if (!hasParam(p))
+                {
+                    // URI decode issuer
+                    setParam(p, param.substr(equals + 1U), p == Issuer);
+                }
+                break;
+            }
         }
+    }
+
+    // check for mandatory fields
+    if (!hasParam(Secret) || (_type == HOTP && !hasParam(Counter)))
+    {
+        _values = {};
+        _present = 0U;
+        return;
+    }
+
+    // add defaults when missing
+    if (!hasParam(Algorithm))
+    {
+        setParam(Algorithm, "SHA1", false);
+    }
+    if (!hasParam(Digits))
+    {
+        setParam(Digits, "6", false);
+    }
+    if (_type == TOTP && !hasParam(Period))
+    {
+        setParam(Period, "30", false);
+    }
+
+    // set valid if reached here
+    _valid = true;
+}
 
-        if (_type == TOTP && _params.count("period") == 0)
+void otpauthURI::setParam(const Param &param, std::string_view value, bool decode)
+{
+    if (decode)
+    {
+        UriComponent::decode(value, _values[param]);
+    }
+    else
+    {
+        _values[param].assign(value.data(), value.size());
+    }
+    _present |= 1U << param;
+}
+
+const std::map<std::string, std::string> otpauthURI::params() const
+{
+    std::map<std::string, std::string> params;
+    for (auto i = 0U; i < ParamCount; ++i)
+    {
+        if (hasParam(static_cast<Param>(i)))
         {
-            _params.insert({"period", "30"});
+            params.emplace(std::string(PARAM_NAMES[i]), _values[i]);
         }
-
-        // set valid if reached here
-        _valid = true;
     }
+    return params;
 }
 
 otpauthURI::~otpauthURI()
 {
     uri.clear();
     _label.clear();
-    _params.clear();
 }
 
 otpauthURI otpauthURI::fromOtpToken(const OTPToken *token)
@@ -142,45 +252,62 @@ otpauthURI otpauthURI::fromOtpToken(const OTPToken *token)
         return otpauthURI();
     }
 
-    auto t = const_cast<OTPToken*>(token);
-
-    std::string uri = OTPAUTH_PREFIX;
-
-    switch (t->type())
+    std::string uri;
+    if (!appendURI(*token, uri))
     {
-        case OTPToken::TOTP:  uri.append("totp/"); break;
-        case OTPToken::HOTP:  uri.append("hotp/"); break;
-        case OTPToken::Steam: uri.append("totp/"); break;
-        default: return otpauthURI(); break;
+        return otpauthURI();
     }
+    return otpauthURI(uri);
+}
 
-    UriComponent label(t->label());
-    uri.append(label.encoded());
-
-    uri.append("?");
-    uri.append("secret=" + t->secret());
-
-    if (t->type() != OTPToken::Steam)
+template<typename String>
+bool otpauthURI::appendURI(const OTPToken &token, String &out)
+{
+    std::string_view type;
+    switch (token.type())
     {
-        uri.append("&");
-        uri.append("digits=" + std::to_string(t->digitLength()));
+        case OTPToken::TOTP:  type = "totp/"; break;
+        case OTPToken::HOTP:  type = "hotp/"; break;
+        case OTPToken::Steam: type = "totp/"; break;
+        default: return false;
+    }
 
-        uri.append("&");
-        uri.append("period=" + std::to_string(t->period()));
+    // upper bound, every label character may be percent encoded
+    const auto &label = token.label();
+    const auto &secret = token.secret();
+    out.reserve(out.size() + OTPAUTH_PREFIX.size() + type.size() + (label.size() + token.issuer().size()) * 3U + secret.size() + 96U);
+
+    out.append(OTPAUTH_PREFIX.data(), OTPAUTH_PREFIX.size());
+    out.append(type.data(), type.size());
+    UriComponent::encode(label, out);
+    out.append("?secret=", 8U);
+    out.append(secret.data(), secret.size());
+    if (!token.issuer().empty())
+    {
+        out.append("&issuer=", 8U);
+        UriComponent::encode(token.issuer(), out);
+    }
 
-        if (t->type() == OTPToken::HOTP)
+    if (token.type() != OTPToken::Steam)
+    {
+        appendNumber(out, "&digits=", token.digitLength());
+        appendNumber(out, "&period=", token.period());
+        if (token.type() == OTPToken::HOTP)
         {
-            uri.append("&");
-            uri.append("counter=" + std::to_string(t->counter()));
+            appendNumber(out, "&counter=", token.counter());
         }
 
-        uri.append("&");
-        uri.append("algorithm=" + t->algorithmName());
+        const auto algorithm = OTPToken::algorithmName(token.algorithm());
+        out.append("&algorithm=", 11U);
+        out.append(algorithm.data(), algorithm.size());
     }
 
-    return otpauthURI(uri);
+    return true;
 }
 
+template bool otpauthURI::appendURI<std::string>(const OTPToken &token, std::string &out);
+template bool otpauthURI::appendURI<SecureString>(const OTPToken &token, SecureString &out);
+
 std::uint8_t otpauthURI::digitsNumber() const
 {
     return static_cast<std::uint8_t>(std::stoul(digits()));
@@ -196,7 +323,7 @@ std::uint32_t otpauthURI::periodNumber() const
     return static_cast<std::uint32_t>(std::stoul(period()));
 }
 
-void otpauthURI::setTypeEnum(const std::string &type)
+void otpauthURI::setTypeEnum(std::string_view type)
 {
     if (type == "totp")
     {
@@ -233,69 +360,108 @@ otpauthURI::UriComponent::~UriComponent()
 
 const std::string otpauthURI::UriComponent::encoded() const
 {
-    std::string new_str = "";
-    char c;
-    int ic;
-    const char *chars = uri.c_str();
-    char bufHex[10];
-    auto len = strlen(chars);
-
-    for (auto i = 0U; i < len; i++)
-    {
-        c = chars[i];
-        ic = c;
-//        if (c == ' ')
-//        {
-//            new_str += '+';
-//        }
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+    std::string str = prefix;
+    encode(uri, str);
+    return str;
+}
+
+std::size_t otpauthURI::UriComponent::encodedSize(std::string_view component)
+{
+    const auto data = component.data();
+    const auto size = component.size();
+
+    auto escaped = 0U;
+    std::size_t i = 0U;
+    while (i < size)
+    {
+        i += unreservedRun(data + i, size - i);
+
+        // block with reserved characters or the tail
+        const auto end = std::min(size, i + 16U);
+        for (; i < end; ++i)
         {
-            new_str += c;
+            escaped += !UNRESERVED.values[static_cast<unsigned char>(data[i])];
         }
-        else
+    }
+    return size + escaped * 2U;
+}
+
+void otpauthURI::UriComponent::decode(std::string_view component, std::string &out)
+{
+    const auto data = component.data();
+    const auto size = component.size();
+
+    // the decoded component is never longer
+    out.resize(size);
+    auto dst = &out[0];
+
+    std::size_t i = 0U;
+    while (i < size)
+    {
+        const auto run = plainRun(data + i, size - i);
+        std::memcpy(dst, data + i, run);
+        dst += run;
+        i += run;
+
+        const auto end = std::min(size, i + 16U);
+        while (i < end)
         {
-            std::sprintf(bufHex, "%X", c);
-            if (ic < 16)
+            const auto c = data[i];
+            if (c == '%' && i + 2U < size &&
+                HEX_VALUES.values[static_cast<unsigned char>(data[i + 1U])] != INVALID_HEX &&
+                HEX_VALUES.values[static_cast<unsigned char>(data[i + 2U])] != INVALID_HEX)
             {
-                new_str += "%0";
+                *dst++ = static_cast<char>(HEX_VALUES.values[static_cast<unsigned char>(data[i + 1U])] << 4 |
+                                           HEX_VALUES.values[static_cast<unsigned char>(data[i + 2U])]);
+                i += 3U;
             }
             else
             {
-                new_str += "%";
+                *dst++ = c == '+' ? ' ' : c;
+                ++i;
             }
-            new_str += bufHex;
         }
     }
-    return prefix + new_str;
+
+    out.resize(static_cast<std::size_t>(dst - out.data()));
 }
 
-const std::string otpauthURI::UriComponent::decoded() const
+template<typename String>
+void otpauthURI::UriComponent::encode(std::string_view component, String &out)
 {
-    std::string ret;
-    char ch;
-    unsigned int i, ii;
-    auto len = uri.length();
+    static const constexpr char HEX[] = "0123456789ABCDEF";
+
+    const auto data = component.data();
+    const auto size = component.size();
+
+    // the output is sized up front and written without appends
+    const auto start = out.size();
+    out.resize(start + encodedSize(component));
+    auto dst = &out[start];
 
-    for (i = 0U; i < len; i++)
+    std::size_t i = 0U;
+    while (i < size)
     {
-        if (uri[i] != '%')
+        const auto run = unreservedRun(data + i, size - i);
+        std::memcpy(dst, data + i, run);
+        dst += run;
+        i += run;
+
+        const auto end = std::min(size, i + 16U);
+        for (; i < end; ++i)
         {
-            if (uri[i] == '+')
+            const auto u = static_cast<unsigned char>(data[i]);
+            if (UNRESERVED.values[u])
             {
-                ret += ' ';
+                *dst++ = data[i];
             }
             else
             {
-                ret += uri[i];
+                dst[0] = '%';
+                dst[1] = HEX[u >> 4];
+                dst[2] = HEX[u & 0x0fU];
+                dst += 3;
             }
         }
-        else
-        {
-            std::sscanf(uri.substr(i + 1, 2).c_str(), "%x", &ii);
-            ch = static_cast<char>(ii);
-            ret += ch;
-            i = i + 2;
-        }
     }
-    return prefix + ret;
 }
@@ -1,8 +1,11 @@
 #ifndef OTPAUTHURI_HPP
 #define OTPAUTHURI_HPP
 
+#include <array>
+#include <cstdint>
 #include <map>
 #include <string>
+#include <string_view>
 
 /**
  * otpauth URI
@@ -18,7 +21,7 @@
  * Parameters:
  *
  *  => secret (REQUIRED)
- *  => issuer (OPTIMAL, unused in this application)
+ *  => issuer (OPTIMAL, the issuer of the token)
  *  => algorithm (OPTIMAL, default is "SHA1")
  *  => digits (OPTIMAL, default is "6")
  *  => counter (REQUIRED if type is "HOTP", otherwise unused)
@@ -26,7 +29,8 @@
  *
  * Note about issuer prefixes:
  *
- *  This application doesn't use "issuers", the prefix is part of the label as-is.
+ *  The prefix stays part of the label as-is, imports take the issuer from the
+ *  parameter or from the prefix when there is no parameter.
  *
  */
 
@@ -38,10 +42,15 @@ class otpauthURI
 
 public:
     otpauthURI();
-    otpauthURI(const std::string &uri);
+    // parsed in a single pass, unknown parameters are ignored
+    otpauthURI(std::string_view uri);
     ~otpauthURI();
 
     static otpauthURI fromOtpToken(const OTPToken *token);
+    // appends the URI of the token to out without temporaries, out is left unchanged
+    // for unsupported token types, implemented for std::string and SecureString
+    template<typename String>
+    static bool appendURI(const OTPToken &token, String &out);
 
     inline const std::string to_s() const
     {
@@ -58,51 +67,47 @@ public:
         HOTP,
     };
 
+    // known parameters
+    enum Param {
+        Secret,
+        Issuer,
+        Algorithm,
+        Digits,
+        Counter,
+        Period,
+        ParamCount,
+    };
+
     inline const Type &type() const
     { return _type; }
 
     inline const std::string &label() const
     { return _label; }
 
+    // parameters which aren't in the URI are empty
+    inline const std::string &param(const Param &param) const
+    { return _values[param]; }
+    inline bool hasParam(const Param &param) const
+    { return (_present & (1U << param)) != 0U; }
+
     inline const std::string &secret() const
-    { return _params.at("secret"); }
+    { return _values[Secret]; }
+    inline const std::string &issuer() const
+    { return _values[Issuer]; }
     inline const std::string &algorithm() const
-    { return _params.at("algorithm"); }
+    { return _values[Algorithm]; }
     inline const std::string &digits() const
-    { return _params.at("digits"); }
-
+    { return _values[Digits]; }
     std::uint8_t digitsNumber() const;
-
     inline const std::string &counter() const
-    {
-        static const std::string empty;
-        if (_params.count("counter") != 0)
-        {
-            return _params.at("counter");
-        }
-        else
-        {
-            return empty;
-        }
-    }
+    { return _values[Counter]; }
     std::uint32_t counterNumber() const;
-
     inline const std::string &period() const
-    {
-        static const std::string empty;
-        if (_params.count("period") != 0)
-        {
-            return _params.at("period");
-        }
-        else
-        {
-            return empty;
-        }
-    }
+    { return _values[Period]; }
     std::uint32_t periodNumber() const;
 
-    inline const std::map<std::string, std::string> &params() const
-    { return _params; }
+    // all parameters of the URI by name
+    const std::map<std::string, std::string> params() const;
 
     inline bool empty() const
     { return uri.empty(); }
@@ -117,11 +122,14 @@ private:
 
     Type _type = Invalid;
     std::string _label;
-    std::map<std::string, std::string> _params;
+    std::array<std::string, ParamCount> _values;
+    unsigned int _present = 0U;
 
-    void setTypeEnum(const std::string &type);
+    void parse(std::string_view uri);
+    void setParam(const Param &param, std::string_view value, bool decode);
+    void setTypeEnum(std::string_view type);
 
-    // helper class to decode and encode URI components (percent signs)
+    // helper class to encode URI components (percent signs)
     class UriComponent
     {
     public:
@@ -129,7 +137,14 @@ private:
         ~UriComponent();
 
         const std::string encoded() const;
-        const std::string decoded() const;
+
+        // appends the percent encoded component, unreserved characters are kept,
+        // the size is computed first and runs of unreserved characters are copied in blocks
+        template<typename String>
+        static void encode(std::string_view component, String &out);
+        static std::size_t encodedSize(std::string_view component);
+        // percent signs and '+' (space) are decoded into out
+        static void decode(std::string_view component, std::string &out);
 
     private:
         std::string prefix;
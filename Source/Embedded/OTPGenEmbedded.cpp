@@ -0,0 +1,154 @@
+#include "OTPGenEmbedded.h"
+
+#include <Embedded/TokenTable.hpp>
+
+#ifndef OTPGEN_EMBEDDED_CAPACITY
+#define OTPGEN_EMBEDDED_CAPACITY 16
+#endif
+
+#ifndef OTPGEN_EMBEDDED_MAX_SECRET
+#define OTPGEN_EMBEDDED_MAX_SECRET 64
+#endif
+
+namespace {
+    using Table = Embedded::TokenTable<OTPGEN_EMBEDDED_CAPACITY, OTPGEN_EMBEDDED_MAX_SECRET>;
+
+    // constant initialized, the table is in .bss and there is no static constructor
+    static Table table;
+
+    // the kernels are checked by the compiler against the test vectors of RFC 4226 and RFC 6238,
+    // a toolchain which miscompiles them fails to build the library instead of producing wrong codes
+    template<std::size_t N>
+    static constexpr bool code_is(const char (&secret)[N], Embedded::Algorithm algorithm,
+                                  std::int64_t time, std::uint32_t period, std::uint8_t digits, const char *expected)
+    {
+        unsigned char bytes[N] = {};
+        for (std::size_t i = 0U; i < N; ++i)
+        {
+            bytes[i] = static_cast<unsigned char>(secret[i]);
+        }
+        const Embedded::Key key(bytes, N - 1U, algorithm);
+        char code[Embedded::CODE_BUFFER] = {};
+        return Embedded::totp(key, time, period, digits, code) == Embedded::Status::Ok &&
+               Embedded::Detail::equalCodes(code, expected);
+    }
+
+    static constexpr char RFC_SHA1_SECRET[] = "12345678901234567890";
+    static constexpr char RFC_SHA256_SECRET[] = "12345678901234567890123456789012";
+    static constexpr char RFC_SHA512_SECRET[] = "1234567890123456789012345678901234567890123456789012345678901234";
+
+    static_assert(code_is(RFC_SHA1_SECRET, Embedded::Algorithm::SHA1, 0, 1, 6, "755224"), "HOTP (SHA-1) kernel");
+    static_assert(code_is(RFC_SHA1_SECRET, Embedded::Algorithm::SHA1, 9, 1, 6, "520489"), "HOTP (SHA-1) kernel");
+    static_assert(code_is(RFC_SHA1_SECRET, Embedded::Algorithm::SHA1, 59, 30, 8, "94287082"), "TOTP (SHA-1) kernel");
+    static_assert(code_is(RFC_SHA256_SECRET, Embedded::Algorithm::SHA256, 59, 30, 8, "46119246"), "TOTP (SHA-256) kernel");
+    static_assert(code_is(RFC_SHA512_SECRET, Embedded::Algorithm::SHA512, 59, 30, 8, "90693936"), "TOTP (SHA-512) kernel");
+
+    static int status(Embedded::Status status)
+    {
+        switch (status)
+        {
+            case Embedded::Status::Ok:              return OTPGEN_EMBEDDED_OK;
+            case Embedded::Status::Mismatch:        return OTPGEN_EMBEDDED_NO_MATCH;
+            case Embedded::Status::NotFound:        return OTPGEN_EMBEDDED_NOT_FOUND;
+            case Embedded::Status::Full:            return OTPGEN_EMBEDDED_FULL;
+            case Embedded::Status::InvalidArgument: return OTPGEN_EMBEDDED_INVALID_ARGUMENT;
+        }
+        return OTPGEN_EMBEDDED_INVALID_ARGUMENT;
+    }
+
+    static bool to_token(const otpgen_embedded_token *in, Table::Token &out)
+    {
+        if (!in || in->type < OTPGEN_EMBEDDED_TOTP || in->type > OTPGEN_EMBEDDED_STEAM ||
+            in->algorithm < OTPGEN_EMBEDDED_SHA1 || in->algorithm > OTPGEN_EMBEDDED_SHA512)
+        {
+            return false;
+        }
+        out.id = in->id;
+        out.type = static_cast<Embedded::TokenType>(in->type);
+        out.algorithm = static_cast<Embedded::Algorithm>(in->algorithm);
+        out.digits = in->type == OTPGEN_EMBEDDED_STEAM ? Embedded::STEAM_DIGITS : in->digits;
+        out.period = in->type == OTPGEN_EMBEDDED_STEAM ? 30U : in->period;
+        out.counter = in->counter;
+        return true;
+    }
+}
+
+size_t otpgen_embedded_capacity(void)
+{
+    return Table::capacity();
+}
+
+size_t otpgen_embedded_max_secret(void)
+{
+    return OTPGEN_EMBEDDED_MAX_SECRET;
+}
+
+size_t otpgen_embedded_size(void)
+{
+    return table.size();
+}
+
+int otpgen_embedded_add(const otpgen_embedded_token *token, const char *secret, size_t length)
+{
+    Table::Token t;
+    if (!secret || !to_token(token, t))
+    {
+        return OTPGEN_EMBEDDED_INVALID_ARGUMENT;
+    }
+    return status(table.addBase32(t, secret, length));
+}
+
+int otpgen_embedded_add_raw(const otpgen_embedded_token *token, const unsigned char *secret, size_t size)
+{
+    Table::Token t;
+    if (!secret || !to_token(token, t))
+    {
+        return OTPGEN_EMBEDDED_INVALID_ARGUMENT;
+    }
+    return status(table.add(t, secret, size));
+}
+
+int otpgen_embedded_remove(uint32_t id)
+{
+    return status(table.remove(id));
+}
+
+int otpgen_embedded_token_get(uint32_t id, otpgen_embedded_token *token)
+{
+    if (!token)
+    {
+        return OTPGEN_EMBEDDED_INVALID_ARGUMENT;
+    }
+
+    Table::Token t;
+    const auto res = table.token(id, t);
+    if (res == Embedded::Status::Ok)
+    {
+        token->id = t.id;
+        token->type = static_cast<uint8_t>(t.type);
+        token->algorithm = static_cast<uint8_t>(t.algorithm);
+        token->digits = t.digits;
+        token->period = t.period;
+        token->counter = t.counter;
+    }
+    return status(res);
+}
+
+int otpgen_embedded_generate(uint32_t id, int64_t time, char *code)
+{
+    if (!code)
+    {
+        return OTPGEN_EMBEDDED_INVALID_ARGUMENT;
+    }
+    code[0] = '\0';
+    return status(table.generate(id, time, code));
+}
+
+int otpgen_embedded_verify(uint32_t id, const char *code, int64_t time, uint32_t window)
+{
+    if (!code)
+    {
+        return OTPGEN_EMBEDDED_INVALID_ARGUMENT;
+    }
+    return status(table.verify(id, code, time, window));
+}
@@ -0,0 +1,83 @@
+#ifndef OTPGENEMBEDDED_H
+#define OTPGENEMBEDDED_H
+
+/*
+ * C interface of the freestanding core profile
+ *
+ * For verifier appliances without a heap. The tokens live in one table
+ * of OTPGEN_EMBEDDED_CAPACITY slots in static memory, the secrets are only
+ * kept as prepared HMAC keys and are overwritten when a token is removed.
+ * Nothing allocates, throws or depends on the C++ standard library at run
+ * time, the library is built without exceptions and RTTI.
+ *
+ * The functions are not reentrant, an appliance verifies from one task or
+ * serializes the calls itself.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* longest code (10 digits) and the terminating NUL, same as OTPGEN_CODE_SIZE */
+#define OTPGEN_EMBEDDED_CODE_SIZE 11
+
+/* status codes */
+enum {
+    OTPGEN_EMBEDDED_OK = 0,
+    OTPGEN_EMBEDDED_NO_MATCH = 1,         /* the code didn't match */
+    OTPGEN_EMBEDDED_NOT_FOUND = 2,        /* no token with the id */
+    OTPGEN_EMBEDDED_FULL = 3,             /* all slots are taken */
+    OTPGEN_EMBEDDED_INVALID_ARGUMENT = 4  /* null buffer, out of range parameter or invalid secret */
+};
+
+/* token types and algorithms, same values as in the database and OTPGenC.h */
+enum {
+    OTPGEN_EMBEDDED_TOTP = 1,
+    OTPGEN_EMBEDDED_HOTP = 2,
+    OTPGEN_EMBEDDED_STEAM = 3
+};
+
+enum {
+    OTPGEN_EMBEDDED_SHA1 = 1,
+    OTPGEN_EMBEDDED_SHA256 = 2,
+    OTPGEN_EMBEDDED_SHA512 = 3
+};
+
+typedef struct otpgen_embedded_token {
+    uint32_t id;        /* chosen by the caller, unique and not 0 */
+    uint8_t type;
+    uint8_t algorithm;
+    uint8_t digits;     /* 3-10, ignored for Steam */
+    uint32_t period;    /* seconds, ignored for HOTP and Steam */
+    uint64_t counter;   /* next counter of HOTP tokens */
+} otpgen_embedded_token;
+
+/* slots and longest secret in bytes, chosen when the library is built */
+size_t otpgen_embedded_capacity(void);
+size_t otpgen_embedded_max_secret(void);
+size_t otpgen_embedded_size(void);
+
+/* the secret in base-32 like in otpauth URIs or raw */
+int otpgen_embedded_add(const otpgen_embedded_token *token, const char *secret, size_t length);
+int otpgen_embedded_add_raw(const otpgen_embedded_token *token, const unsigned char *secret, size_t size);
+int otpgen_embedded_remove(uint32_t id);
+
+/* the token with its current counter */
+int otpgen_embedded_token_get(uint32_t id, otpgen_embedded_token *token);
+
+/* the code at the unix time into OTPGEN_EMBEDDED_CODE_SIZE bytes, HOTP uses the counter of the token */
+int otpgen_embedded_generate(uint32_t id, int64_t time, char *code);
+
+/* time-based codes are accepted within window periods of the time, HOTP codes within window
+ * counters ahead of the counter, which then moves past the accepted code */
+int otpgen_embedded_verify(uint32_t id, const char *code, int64_t time, uint32_t window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OTPGENEMBEDDED_H */
@@ -28,6 +28,42 @@ bool GuiConfig::useTheming()
 const QString GuiConfig::iconColor()
 { return settings()->value(keyIconColor(), "default").toString(); }
 
+const QList<qlonglong> GuiConfig::trayTokens()
+{
+    QList<qlonglong> ids;
+    for (auto&& id : settings()->value(keyTrayTokens()).toList())
+    {
+        ids.append(id.toLongLong());
+    }
+    return ids;
+}
+
+void GuiConfig::setTrayTokens(const QList<qlonglong> &ids)
+{
+    QVariantList list;
+    for (auto&& id : ids)
+    {
+        list.append(id);
+    }
+    settings()->setValue(keyTrayTokens(), list);
+}
+
+bool GuiConfig::useTraySnapshot()
+{ return settings()->value(keyTraySnapshot(), true).toBool(); }
+
+int GuiConfig::sessionKeyLifetime()
+{ return settings()->value(keySessionKeyLifetime(), 0).toInt(); }
+
+bool GuiConfig::performanceOverlay()
+{
+    const auto env = qgetenv("OTPGEN_DEBUG");
+    if (!env.isEmpty() && env != "0")
+    {
+        return true;
+    }
+    return settings()->value(keyPerformanceOverlay(), false).toBool();
+}
+
 const QString GuiConfig::titleBarBackground()
 { return settings()->value(keyTitleBarBackground(), "#454545").toString(); }
 
@@ -75,6 +111,16 @@ const std::string &GuiConfig::database()
     return db;
 }
 
+const std::string &GuiConfig::traySnapshot()
+{
+#ifdef OTPGEN_DEBUG
+    static const std::string snapshot = (path() + "/tokens.tray.debug").toUtf8().constData();
+#else
+    static const std::string snapshot = (path() + "/tokens.tray").toUtf8().constData();
+#endif
+    return snapshot;
+}
+
 void GuiConfig::initDefaultSettings()
 {
     if (!settingsHasKey(keyStartMinimizedToTray()))
@@ -85,6 +131,14 @@ void GuiConfig::initDefaultSettings()
     {
         settings()->setValue(keyUseTheming(), true);
     }
+    if (!settingsHasKey(keyTraySnapshot()))
+    {
+        settings()->setValue(keyTraySnapshot(), true);
+    }
+    if (!settingsHasKey(keySessionKeyLifetime()))
+    {
+        settings()->setValue(keySessionKeyLifetime(), 0);
+    }
     if (!settingsHasKey(keyIconColor()))
     {
         settings()->setValue(keyIconColor(), "default");
@@ -4,6 +4,7 @@
 #include <QString>
 #include <QSettings>
 #include <QSize>
+#include <QList>
 
 class GuiConfig final
 {
@@ -16,6 +17,19 @@ public:
 
     static const QString iconColor();
 
+    // ids of the tokens shown in the tray menu, in menu order
+    static const QList<qlonglong> trayTokens();
+    static void setTrayTokens(const QList<qlonglong> &ids);
+    // keep the labels of the tray tokens in an encrypted snapshot, so the tray menu
+    // is built at startup without loading the database
+    static bool useTraySnapshot();
+    // seconds a session key of the unlocked database is kept in the keychain, starts within that
+    // time unlock without the password and the key derivation, 0 disables it
+    static int sessionKeyLifetime();
+    // shows frame times, cache hit rates and event loop stalls over the token list,
+    // also enabled by setting OTPGEN_DEBUG in the environment
+    static bool performanceOverlay();
+
     static const QString titleBarBackground();
     static const QString titleBarForeground();
     static const QString titleBarButtonBackground();
@@ -24,6 +38,7 @@ public:
     static QSettings *settings();
     static const QString &path();
     static const std::string &database();
+    static const std::string &traySnapshot();
 
     // QSettings keys
     static const QString keyGeometryMainWindow()
@@ -44,6 +59,14 @@ public:
     { return "UI/Theming"; }
     static const QString keyIconColor()
     { return "UI/IconColor"; }
+    static const QString keyTrayTokens()
+    { return "UI/TrayTokens"; }
+    static const QString keyTraySnapshot()
+    { return "UI/TraySnapshot"; }
+    static const QString keySessionKeyLifetime()
+    { return "Security/SessionKeyLifetime"; }
+    static const QString keyPerformanceOverlay()
+    { return "Debug/PerformanceOverlay"; }
     static const QString keyTitleBarBackground()
     { return "UI/TitleBarBackground"; }
     static const QString keyTitleBarForeground()
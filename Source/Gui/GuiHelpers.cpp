@@ -2,13 +2,73 @@
 
 #include "GuiConfig.hpp"
 
-#include <Tools/zlibTool.hpp>
-#include <Tools/SvgTool.hpp>
+#include <Tools/IconCache.hpp>
+
+#include <PerfStats.hpp>
 
 #include <QScreen>
+#include <QHash>
+
+namespace {
+    // colors of the theme settings and the palettes made from them
+    struct Theme
+    {
+        bool loaded = false;
+        bool enabled = false;
+        QColor background;
+        QColor foreground;
+        QColor buttonBackground;
+        QColor buttonForeground;
+
+        // keyed by QPalette::cacheKey() of the base palette
+        QHash<qint64, QPalette> palettes;
+        QHash<qint64, QPalette> cbPalettes;
+    };
+
+    // there are only a few distinct base palettes, this only bounds odd cases
+    static const constexpr int MAX_CACHED_PALETTES = 32;
+
+    static Theme &theme()
+    {
+        static Theme t;
+        if (!t.loaded)
+        {
+            t.enabled = gcfg::useTheming();
+            t.background = QColor(gcfg::titleBarBackground());
+            t.foreground = QColor(gcfg::titleBarForeground());
+            t.buttonBackground = QColor(gcfg::titleBarButtonBackground());
+            t.buttonForeground = QColor(gcfg::titleBarButtonForeground());
+            t.loaded = true;
+        }
+        return t;
+    }
+
+    template<typename Make>
+    static const QPalette cachedPalette(QHash<qint64, QPalette> &cache, const QPalette &base, const Make &make)
+    {
+        const auto key = base.cacheKey();
+        const auto it = cache.constFind(key);
+        if (it != cache.constEnd())
+        {
+            return it.value();
+        }
+
+        if (cache.size() >= MAX_CACHED_PALETTES)
+        {
+            cache.clear();
+        }
+        auto palette = base;
+        make(palette);
+        cache.insert(key, palette);
+        return palette;
+    }
+}
 
 GuiHelpers::GuiHelpers()
 {
+    // part of the startup, shown by --profile-startup
+    OTPGEN_PERF_TRACE("GuiHelpers::loadIcons");
+
     _app_icon = QIcon(":/app-icon.svgz");
     _tray_icon = QIcon(":/tray-icon.png");
 
@@ -31,25 +91,8 @@ GuiHelpers::GuiHelpers()
 
 const QIcon GuiHelpers::loadIcon(const QString &path)
 {
-    const auto color = gcfg::iconColor();
-    if (color.compare("default", Qt::CaseInsensitive) == 0)
-    {
-        return QIcon(path);
-    }
-    else
-    {
-        QFile file(path);
-        file.open(QIODevice::ReadOnly);
-        auto buf = file.readAll();
-        file.close();
-
-        auto svg = zlibTool::uncompress(buf.constData(), buf.size());
-        SvgTool::changeFillColor(svg, color.toUtf8().constData());
-
-        QPixmap pixmap;
-        pixmap.loadFromData(reinterpret_cast<const unsigned char*>(svg.data()), static_cast<uint>(svg.size()));
-        return QIcon(pixmap);
-    }
+    // rendered and recolored on first use, later launches load the cached pixmaps
+    return IconCache::icon(path, gcfg::iconColor());
 }
 
 GuiHelpers *GuiHelpers::i()
@@ -114,11 +157,12 @@ std::shared_ptr<QPushButton> GuiHelpers::make_toolbtn(const QIcon &icon, const Q
     btn->setIcon(icon);
     btn->setToolTip(tooltip);
 
-    if (gcfg::useTheming())
+    const auto &t = theme();
+    if (t.enabled)
     {
         auto palette = btn->palette();
-        palette.setColor(QPalette::Active, QPalette::Button, QColor(gcfg::titleBarButtonBackground()));
-        palette.setColor(QPalette::Active, QPalette::ButtonText, QColor(gcfg::titleBarButtonForeground()));
+        palette.setColor(QPalette::Active, QPalette::Button, t.buttonBackground);
+        palette.setColor(QPalette::Active, QPalette::ButtonText, t.buttonForeground);
         // TODO: Inactive, Disabled
         btn->setPalette(palette);
     }
@@ -193,21 +237,27 @@ std::shared_ptr<QAction> GuiHelpers::make_menuAction(const QString &name, const
 
 const QPalette GuiHelpers::make_theme(const QPalette &base)
 {
-    if (gcfg::useTheming())
+    auto &t = theme();
+    if (!t.enabled)
     {
-        auto palette = base;
-        palette.setColor(QPalette::All, QPalette::Background, QColor(gcfg::titleBarBackground()));
-        palette.setColor(QPalette::All, QPalette::Foreground, QColor(gcfg::titleBarForeground()));
-        return palette;
+        return base;
     }
-    return base;
+
+    return cachedPalette(t.palettes, base, [&](QPalette &palette) {
+        palette.setColor(QPalette::All, QPalette::Background, t.background);
+        palette.setColor(QPalette::All, QPalette::Foreground, t.foreground);
+    });
 }
 
 const QPalette GuiHelpers::make_cb_theme(const QPalette &base)
 {
-    if (gcfg::useTheming())
+    auto &t = theme();
+    if (!t.enabled)
     {
-        auto palette = base;
+        return base;
+    }
+
+    return cachedPalette(t.cbPalettes, base, [](QPalette &palette) {
         palette.setColor(QPalette::Active, QPalette::Text, QColor("#000000"));
         palette.setColor(QPalette::Active, QPalette::ButtonText, QColor("#000000"));
 
@@ -216,9 +266,15 @@ const QPalette GuiHelpers::make_cb_theme(const QPalette &base)
 
         palette.setColor(QPalette::Disabled, QPalette::Text, QColor("#CCCCCC"));
         palette.setColor(QPalette::Disabled, QPalette::ButtonText, QColor("#CCCCCC"));
-        return palette;
-    }
-    return base;
+    });
+}
+
+void GuiHelpers::reloadTheme()
+{
+    auto &t = theme();
+    t.palettes.clear();
+    t.cbPalettes.clear();
+    t.loaded = false;
 }
 
 const QFont GuiHelpers::font_titleBar()
@@ -269,8 +325,10 @@ qreal Scr::scaledF(qreal base, const QWidget *target)
 
 const QSize Scr::scaled(const QSize &base, const QWidget *target)
 {
-    auto width = static_cast<int>((base.width() * currentScreen(target)->logicalDotsPerInch()) / 96);
-    auto height = static_cast<int>((base.height() * currentScreen(target)->logicalDotsPerInch()) / 96);
+    // one screen lookup for both dimensions
+    const auto dpi = currentScreen(target)->logicalDotsPerInch();
+    auto width = static_cast<int>((base.width() * dpi) / 96);
+    auto height = static_cast<int>((base.height() * dpi) / 96);
 #ifdef OTPGEN_DEBUG
     qDebug() << "scaled():" << base << "->" << QSize{width, height};
 #endif
@@ -62,8 +62,11 @@ public:
     static std::shared_ptr<QAction> make_menuAction(const QString &name, const QIcon &icon,
                                                     const QObject *receiver, const std::function<void()> &callback);
 
+    // themed palettes are computed once per base palette, the colors are read once from the settings
     static const QPalette make_theme(const QPalette &base);
     static const QPalette make_cb_theme(const QPalette &base);
+    // call after the theme settings changed, widgets created afterwards use the new colors
+    static void reloadTheme();
 
     inline const QIcon &app_icon() const             { return _app_icon; }
     inline const QIcon &tray_icon() const            { return _tray_icon; }
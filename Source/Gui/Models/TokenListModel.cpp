@@ -0,0 +1,355 @@
+#include "TokenListModel.hpp"
+
+#include <TokenDatabase.hpp>
+#include <TokenCodeCache.hpp>
+#include <Clock.hpp>
+#include <PerfStats.hpp>
+
+#include <Tools/IconCache.hpp>
+
+#include <algorithm>
+
+TokenListModel::TokenListModel(QObject *parent)
+    : QAbstractListModel(parent),
+      _iconSize(32, 32)
+{
+    // empty until reload(), the database may still be loading
+    // the remaining time changes every second
+    this->_timer.setInterval(1000);
+    this->_timer.setTimerType(Qt::CoarseTimer);
+    QObject::connect(&this->_timer, &QTimer::timeout, this, &TokenListModel::tick);
+    this->_timer.start();
+}
+
+TokenListModel::~TokenListModel()
+{
+    this->_timer.stop();
+}
+
+int TokenListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : this->rows();
+}
+
+QVariant TokenListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= this->rows())
+    {
+        return QVariant();
+    }
+
+    auto p = this->page(index.row());
+    const auto i = index.row() - p->first;
+    if (i >= static_cast<int>(p->rows.size()))
+    {
+        return QVariant();
+    }
+
+    auto &row = p->rows[static_cast<std::size_t>(i)];
+    switch (role)
+    {
+        case Qt::DisplayRole:
+        case Qt::ToolTipRole:
+            return row.label;
+        case Qt::DecorationRole:
+            return this->icon(row);
+        case IdRole:
+            return static_cast<qlonglong>(row.id);
+        case TypeRole:
+            return static_cast<int>(row.type);
+        case TypeNameRole:
+            return row.typeName;
+        case CodeRole:
+            return this->code(*p, i, Clock::current());
+        case PeriodRole:
+            return row.period;
+        case RemainingRole:
+            return static_cast<int>(OTPToken::secondsUntilRotation(row.period, Clock::current()));
+        default:
+            return QVariant();
+    }
+}
+
+QHash<int, QByteArray> TokenListModel::roleNames() const
+{
+    auto roles = QAbstractListModel::roleNames();
+    roles.insert(IdRole, "id");
+    roles.insert(TypeRole, "type");
+    roles.insert(TypeNameRole, "typeName");
+    roles.insert(CodeRole, "code");
+    roles.insert(PeriodRole, "period");
+    roles.insert(RemainingRole, "remaining");
+    return roles;
+}
+
+void TokenListModel::reload()
+{
+    this->beginResetModel();
+    this->_pages.clear();
+    this->_ids.clear();
+    if (TokenDatabase::databaseConnected())
+    {
+        const auto order = TokenDatabase::displayOrder();
+        this->_ids.assign(order.begin(), order.end());
+    }
+    this->endResetModel();
+}
+
+void TokenListModel::update()
+{
+    OTPGEN_PERF_SCOPE("TokenListModel::update", ModelFetch);
+    if (!TokenDatabase::databaseConnected())
+    {
+        this->reload();
+        return;
+    }
+
+    if (!this->_filtered)
+    {
+        const auto order = TokenDatabase::displayOrder();
+        const std::vector<OTPToken::sqliteTokenID> ids(order.begin(), order.end());
+
+        // the rows between the common prefix and suffix are replaced
+        const auto common = std::min(this->_ids.size(), ids.size());
+        std::size_t prefix = 0;
+        while (prefix < common && this->_ids[prefix] == ids[prefix])
+        {
+            ++prefix;
+        }
+        std::size_t suffix = 0;
+        while (suffix < common - prefix && this->_ids[this->_ids.size() - 1 - suffix] == ids[ids.size() - 1 - suffix])
+        {
+            ++suffix;
+        }
+
+        const auto removed = this->_ids.size() - prefix - suffix;
+        const auto inserted = ids.size() - prefix - suffix;
+        if (removed != 0 || inserted != 0)
+        {
+            // pages reaching past the first change no longer match their rows
+            this->_pages.remove_if([&](const Page &p) {
+                return static_cast<std::size_t>(p.first + PAGE_SIZE) > prefix;
+            });
+        }
+
+        const auto first = static_cast<int>(prefix);
+        if (removed != 0)
+        {
+            this->beginRemoveRows(QModelIndex(), first, first + static_cast<int>(removed) - 1);
+            this->_ids.erase(this->_ids.begin() + static_cast<std::ptrdiff_t>(prefix),
+                             this->_ids.begin() + static_cast<std::ptrdiff_t>(prefix + removed));
+            this->endRemoveRows();
+        }
+        if (inserted != 0)
+        {
+            this->beginInsertRows(QModelIndex(), first, first + static_cast<int>(inserted) - 1);
+            this->_ids.insert(this->_ids.begin() + static_cast<std::ptrdiff_t>(prefix),
+                              ids.begin() + static_cast<std::ptrdiff_t>(prefix),
+                              ids.begin() + static_cast<std::ptrdiff_t>(prefix + inserted));
+            this->endInsertRows();
+        }
+    }
+
+    // the remaining pages are fetched again, only rows which look different are reported
+    const auto now = Clock::current();
+    for (auto&& p : this->_pages)
+    {
+        auto fresh = this->fetch(p.first);
+        const auto count = std::min(p.rows.size(), fresh.rows.size());
+        for (auto i = 0U; i < count; ++i)
+        {
+            auto &old_row = p.rows[i];
+            auto &new_row = fresh.rows[i];
+            const auto index = static_cast<int>(i);
+            if (old_row.id == new_row.id && old_row.type == new_row.type && old_row.period == new_row.period &&
+                old_row.label == new_row.label && this->code(p, index, now) == this->code(fresh, index, now))
+            {
+                new_row.iconLoaded = old_row.iconLoaded;
+                new_row.icon = old_row.icon;
+                continue;
+            }
+            emit dataChanged(this->index(p.first + index), this->index(p.first + index));
+        }
+        p = std::move(fresh);
+    }
+}
+
+void TokenListModel::setFilter(const std::vector<OTPToken::sqliteTokenID> &ids)
+{
+    this->beginResetModel();
+    this->_pages.clear();
+    this->_filter = ids;
+    this->_filtered = true;
+    this->endResetModel();
+}
+
+void TokenListModel::clearFilter()
+{
+    if (!this->_filtered)
+    {
+        return;
+    }
+
+    this->beginResetModel();
+    this->_pages.clear();
+    this->_filter.clear();
+    this->_filtered = false;
+    this->endResetModel();
+}
+
+int TokenListModel::rows() const
+{
+    return static_cast<int>(this->_filtered ? this->_filter.size() : this->_ids.size());
+}
+
+void TokenListModel::setIconSize(const QSize &size)
+{
+    if (size == this->_iconSize)
+    {
+        return;
+    }
+
+    this->_iconSize = size;
+    for (auto&& p : this->_pages)
+    {
+        for (auto&& row : p.rows)
+        {
+            row.iconLoaded = false;
+            row.icon = QPixmap();
+        }
+    }
+
+    if (this->rows() > 0)
+    {
+        emit dataChanged(this->index(0), this->index(this->rows() - 1), {Qt::DecorationRole});
+    }
+}
+
+TokenListModel::Page *TokenListModel::page(int row) const
+{
+    const auto first = row / PAGE_SIZE * PAGE_SIZE;
+    for (auto it = this->_pages.begin(); it != this->_pages.end(); ++it)
+    {
+        if (it->first == first)
+        {
+            this->_pages.splice(this->_pages.begin(), this->_pages, it);
+            return &this->_pages.front();
+        }
+    }
+
+    this->_pages.emplace_front(this->fetch(first));
+    if (this->_pages.size() > MAX_PAGES)
+    {
+        this->_pages.pop_back();
+    }
+    return &this->_pages.front();
+}
+
+TokenListModel::Page TokenListModel::fetch(int first) const
+{
+    OTPGEN_PERF_SCOPE("TokenListModel::fetch", ModelFetch);
+    // the tokens only live until the code cache is prepared
+    std::vector<OTPToken> tokens;
+    tokens.reserve(PAGE_SIZE);
+    if (this->_filtered)
+    {
+        // missing tokens keep an empty row, so the rows stay aligned with the filter
+        const auto last = std::min<std::size_t>(this->_filter.size(), static_cast<std::size_t>(first + PAGE_SIZE));
+        for (auto i = static_cast<std::size_t>(first); i < last; ++i)
+        {
+            tokens.emplace_back(TokenDatabase::selectToken(this->_filter[i]));
+            tokens.back().setIcon({});
+        }
+    }
+    else
+    {
+        (void) TokenDatabase::selectTokenRange(static_cast<std::size_t>(first), PAGE_SIZE, [&](const OTPToken &token) {
+            tokens.emplace_back(token);
+        });
+    }
+
+    Page p;
+    p.first = first;
+    p.rows.reserve(tokens.size());
+    for (auto&& token : tokens)
+    {
+        Row r;
+        r.id = token.id();
+        r.type = token.type();
+        r.period = token.rotationPeriod();
+        r.label = QString::fromStdString(token.label());
+        r.typeName = QString::fromStdString(token.typeName());
+        p.rows.emplace_back(std::move(r));
+    }
+    p.codes = std::make_unique<TokenCodeCache>(tokens);
+    return p;
+}
+
+const QPixmap &TokenListModel::icon(Row &row) const
+{
+    if (!row.iconLoaded)
+    {
+        row.iconLoaded = true;
+
+        // thumbnails are stored in the list sizes, other sizes are scaled once and stored as well
+        const auto size = static_cast<unsigned>(std::max(this->_iconSize.width(), this->_iconSize.height()));
+        const auto thumbnail = TokenDatabase::selectIconThumbnail(row.id, size);
+        if (!thumbnail.empty() && row.icon.loadFromData(thumbnail.data(), static_cast<uint>(thumbnail.size())))
+        {
+            OTPGEN_PERF_COUNT(IconCacheHits, 1U);
+            return row.icon;
+        }
+        OTPGEN_PERF_COUNT(IconCacheMisses, 1U);
+
+        const auto scaled = IconCache::thumbnail(TokenDatabase::selectSharedIcon(row.id).bytes(), size);
+        if (!scaled.empty() && row.icon.loadFromData(scaled.data(), static_cast<uint>(scaled.size())))
+        {
+            (void) TokenDatabase::storeIconThumbnail(row.id, size, scaled);
+        }
+    }
+    return row.icon;
+}
+
+QString TokenListModel::code(Page &page, int index, const std::time_t &time) const
+{
+    const auto &row = page.rows[static_cast<std::size_t>(index)];
+    if (row.type != OTPToken::TOTP && row.type != OTPToken::Steam)
+    {
+        return QString();
+    }
+
+    // codes of a new period are computed for the whole page at once
+    OTPGen::TokenBuffer out;
+    if (!page.codes->code(static_cast<std::size_t>(index), time, out))
+    {
+        (void) page.codes->refresh(time);
+        if (!page.codes->code(static_cast<std::size_t>(index), time, out))
+        {
+            return QString();
+        }
+    }
+    return QString::fromLatin1(out);
+}
+
+void TokenListModel::tick()
+{
+    // the remaining time changes every second, the codes only when a period of the page ended
+    const auto now = Clock::current();
+    const auto last = this->_lastTick;
+    this->_lastTick = now;
+
+    // rows outside the loaded pages aren't visible, views ask for them when they are scrolled in
+    for (auto&& p : this->_pages)
+    {
+        if (p.rows.empty())
+        {
+            continue;
+        }
+
+        const auto rotated = last == 0 || now < last || std::any_of(p.rows.begin(), p.rows.end(), [&](const Row &row) {
+            return row.period != 0U && now - last >= static_cast<std::time_t>(OTPToken::secondsUntilRotation(row.period, last));
+        });
+        emit dataChanged(this->index(p.first), this->index(p.first + static_cast<int>(p.rows.size()) - 1),
+                         rotated ? QVector<int>{CodeRole, RemainingRole} : QVector<int>{RemainingRole});
+    }
+}
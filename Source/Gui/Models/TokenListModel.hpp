@@ -0,0 +1,121 @@
+#ifndef TOKENLISTMODEL_HPP
+#define TOKENLISTMODEL_HPP
+
+#include <ctime>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <QAbstractListModel>
+#include <QPixmap>
+#include <QSize>
+#include <QTimer>
+
+#include <OTPToken.hpp>
+
+class TokenCodeCache;
+
+/**
+ * Token list backed by the token database
+ *
+ * Rows are fetched in pages from the display order when the view asks for
+ * them (or from the filter ids when a filter is set), only the most recently used pages are kept, so the memory doesn't
+ * depend on the size of the database. Every page keeps a code cache for
+ * its tokens, the secrets are only held by the cache. Icons are loaded
+ * from their stored thumbnail (TokenDatabase::selectIconThumbnail()) the
+ * first time a row is painted, missing sizes are scaled once and stored.
+ *
+ * The codes and the remaining time of the loaded rows are updated once a
+ * second. Use a view with uniform item sizes to keep the scrolling cost
+ * independent of the row count.
+ *
+ */
+class TokenListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        IdRole = Qt::UserRole + 1,  // sqliteTokenID
+        TypeRole,                   // OTPToken::TokenType
+        TypeNameRole,               // type name
+        CodeRole,                   // current code, empty for HOTP and invalid tokens
+        PeriodRole,                 // rotation period in seconds, 0 for HOTP
+        RemainingRole,              // seconds until the next rotation
+    };
+
+    explicit TokenListModel(QObject *parent = nullptr);
+    ~TokenListModel() override;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // drop all pages and read the rows again
+    void reload();
+    // compare the rows with the database and only report the changed ones,
+    // call after the database changed
+    void update();
+
+    // show only the given tokens in the given order, e.g. the results of a search
+    void setFilter(const std::vector<OTPToken::sqliteTokenID> &ids);
+    void clearFilter();
+    inline bool filtered() const
+    { return this->_filtered; }
+
+    // size of the decoration icons, cached icons are rescaled
+    void setIconSize(const QSize &size);
+    inline const QSize &iconSize() const
+    { return this->_iconSize; }
+
+private:
+    struct Row
+    {
+        OTPToken::sqliteTokenID id = 0;
+        OTPToken::TokenType type = OTPToken::None;
+        OTPToken::PeriodType period = 0U;
+        QString label;
+        QString typeName;
+
+        // loaded on first use
+        bool iconLoaded = false;
+        QPixmap icon;
+    };
+
+    struct Page
+    {
+        int first = 0;
+        std::vector<Row> rows;
+        std::unique_ptr<TokenCodeCache> codes;
+    };
+
+    // rows per page and pages kept in memory
+    static const constexpr int PAGE_SIZE = 64;
+    static const constexpr std::size_t MAX_PAGES = 8;
+
+    Page *page(int row) const;
+    Page fetch(int first) const;
+    const QPixmap &icon(Row &row) const;
+    QString code(Page &page, int index, const std::time_t &time) const;
+
+    // emits dataChanged for the time dependent roles of the loaded pages,
+    // CodeRole only for pages with a token whose period ended since the last tick
+    void tick();
+
+    int rows() const;
+
+    // display order
+    std::vector<OTPToken::sqliteTokenID> _ids;
+    QSize _iconSize;
+
+    bool _filtered = false;
+    std::vector<OTPToken::sqliteTokenID> _filter;
+
+    // most recently used first
+    mutable std::list<Page> _pages;
+
+    QTimer _timer;
+    std::time_t _lastTick = 0;
+};
+
+#endif // TOKENLISTMODEL_HPP
@@ -0,0 +1,240 @@
+#include "IconCache.hpp"
+
+#include "SvgTool.hpp"
+#include "zlibTool.hpp"
+
+#include <PerfStats.hpp>
+
+#include <QApplication>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QIconEngine>
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QPainter>
+#include <QPixmap>
+#include <QPixmapCache>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStyle>
+#include <QStyleOption>
+
+namespace {
+    class CachedIconEngine : public QIconEngine
+    {
+    public:
+        CachedIconEngine(const QString &asset, const QString &color)
+            : _asset(asset),
+              _color(color)
+        {
+        }
+
+        QIconEngine *clone() const override
+        {
+            return new CachedIconEngine(*this);
+        }
+
+        QSize actualSize(const QSize &size, QIcon::Mode, QIcon::State) override
+        {
+            return size;
+        }
+
+        void paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state) override
+        {
+            const auto ratio = painter->device() ? painter->device()->devicePixelRatioF() : qreal(1);
+            auto pm = this->pixmap(rect.size() * ratio, mode, state);
+            pm.setDevicePixelRatio(ratio);
+            painter->drawPixmap(rect, pm);
+        }
+
+        QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State) override
+        {
+            if (size.isEmpty())
+            {
+                return QPixmap();
+            }
+
+            const auto normal = this->rendering(size);
+            if (mode == QIcon::Normal || normal.isNull())
+            {
+                return normal;
+            }
+
+            // disabled and selected variants are cheap, they aren't cached on disk
+            QStyleOption option;
+            option.palette = QApplication::palette();
+            return QApplication::style()->generatedIconPixmap(mode, normal, &option);
+        }
+
+    private:
+        // memory first, then the disk cache, rendered only when both miss
+        QPixmap rendering(const QSize &size)
+        {
+            if (this->_hash.isEmpty())
+            {
+                QFile file(this->_asset);
+                if (!file.open(QIODevice::ReadOnly))
+                {
+                    return QPixmap();
+                }
+                this->_contents = file.readAll();
+
+                QCryptographicHash hash(QCryptographicHash::Sha1);
+                hash.addData(this->_contents);
+                hash.addData(this->_color.toUtf8());
+                this->_hash = QString::fromLatin1(hash.result().toHex());
+            }
+
+            const auto key = this->_hash + QString("-%1x%2").arg(size.width()).arg(size.height());
+            QPixmap pm;
+            if (QPixmapCache::find(key, pm))
+            {
+                OTPGEN_PERF_COUNT(IconCacheHits, 1U);
+                return pm;
+            }
+
+            const auto file = IconCache::directory() + "/" + key + ".png";
+            if (pm.load(file, "PNG"))
+            {
+                OTPGEN_PERF_COUNT(IconCacheHits, 1U);
+            }
+            else
+            {
+                OTPGEN_PERF_COUNT(IconCacheMisses, 1U);
+                const auto image = this->render(size);
+                if (image.isNull())
+                {
+                    return QPixmap();
+                }
+
+                QDir().mkpath(IconCache::directory());
+                QSaveFile out(file);
+                if (out.open(QIODevice::WriteOnly) && image.save(&out, "PNG"))
+                {
+                    out.commit();
+                }
+                pm = QPixmap::fromImage(image);
+            }
+
+            QPixmapCache::insert(key, pm);
+            return pm;
+        }
+
+        QImage render(const QSize &size)
+        {
+            bool success = false;
+            auto svg = zlibTool::uncompress(this->_contents.constData(), this->_contents.size(), &success);
+            if (!success)
+            {
+                // plain svg assets
+                svg = std::string(this->_contents.constData(), static_cast<std::size_t>(this->_contents.size()));
+            }
+            if (this->_color.compare("default", Qt::CaseInsensitive) != 0)
+            {
+                SvgTool::changeFillColor(svg, this->_color.toUtf8().constData());
+            }
+
+            auto data = QByteArray::fromRawData(svg.data(), static_cast<int>(svg.size()));
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::ReadOnly);
+            QImageReader reader(&buffer, "svg");
+            reader.setScaledSize(size);
+            return reader.read();
+        }
+
+        QString _asset;
+        QString _color;
+
+        // compressed asset, read on first use
+        QByteArray _contents;
+        QString _hash;
+    };
+}
+
+QIcon IconCache::icon(const QString &asset, const QString &color)
+{
+    return QIcon(new CachedIconEngine(asset, color));
+}
+
+void IconCache::clear()
+{
+    QPixmapCache::clear();
+    QDir(directory()).removeRecursively();
+}
+
+const QString &IconCache::directory()
+{
+    static const auto location = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/icons";
+    return location;
+}
+
+const std::vector<unsigned> &IconCache::thumbnailSizes()
+{
+    static const std::vector<unsigned> sizes{16U, 24U, 32U, 48U, 64U, 96U};
+    return sizes;
+}
+
+OTPToken::Icon IconCache::thumbnail(const OTPToken::Icon &icon, unsigned size)
+{
+    QImage image;
+    if (icon.empty() || size == 0 || !image.loadFromData(icon.data(), static_cast<int>(icon.size())))
+    {
+        return {};
+    }
+
+    const auto side = static_cast<int>(size);
+    image = image.scaled(side, side, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (!image.save(&buffer, "PNG"))
+    {
+        return {};
+    }
+    return OTPToken::Icon(data.begin(), data.end());
+}
+
+bool IconCache::normalize(const OTPToken::Icon &icon, unsigned maxSize, OTPToken::Icon &out)
+{
+    QImage image;
+    if (icon.empty() || maxSize == 0 || !image.loadFromData(icon.data(), static_cast<int>(icon.size())))
+    {
+        return false;
+    }
+
+    // never scaled up, the list thumbnails are made from this
+    const auto side = static_cast<int>(maxSize);
+    if (image.width() > side || image.height() > side)
+    {
+        image = image.scaled(side, side, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    const auto encode = [](const QImage &source, const char *format, int quality) {
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        return source.save(&buffer, format, quality) ? data : QByteArray();
+    };
+
+    // the smaller of the formats wins, the palette keeps the alpha channel of icons
+    auto encoded = encode(image.convertToFormat(QImage::Format_Indexed8, Qt::DiffuseDither | Qt::PreferDither), "PNG", 100);
+    if (QImageWriter::supportedImageFormats().contains("webp"))
+    {
+        const auto webp = encode(image, "WEBP", 90);
+        if (!webp.isEmpty() && (encoded.isEmpty() || webp.size() < encoded.size()))
+        {
+            encoded = webp;
+        }
+    }
+    if (encoded.isEmpty())
+    {
+        return false;
+    }
+
+    out.assign(encoded.begin(), encoded.end());
+    return true;
+}
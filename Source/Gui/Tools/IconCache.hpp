@@ -0,0 +1,47 @@
+#ifndef ICONCACHE_HPP
+#define ICONCACHE_HPP
+
+#include <vector>
+
+#include <QIcon>
+#include <QString>
+
+#include <OTPToken.hpp>
+
+/**
+ * Rasterized SVG icons cached on disk
+ *
+ * Icons are rendered on first use at the device pixel size they are shown
+ * at. Every rendering is stored as PNG in the cache location, keyed by the
+ * hash of the compressed asset, the fill color and the pixel size, so later
+ * launches and theme changes back to a known color don't parse or recolor
+ * any SVG. Changed assets get a new key, old renderings are never hit.
+ *
+ * Token icons are scaled once into PNG thumbnails when they are stored,
+ * the thumbnails are kept in the token database next to the icons.
+ *
+ */
+class IconCache final
+{
+    IconCache() = delete;
+
+public:
+    // svgz asset, recolored with color unless it is "default"
+    static QIcon icon(const QString &asset, const QString &color);
+
+    // removes all renderings from memory and disk
+    static void clear();
+
+    static const QString &directory();
+
+    // pixel sizes of the token icon thumbnails, the list icon sizes at 1x and 2x
+    static const std::vector<unsigned> &thumbnailSizes();
+    // PNG of the icon scaled into a square of the size, empty if the icon can't be decoded,
+    // the scaler of TokenDatabase::setIconScaler()
+    static OTPToken::Icon thumbnail(const OTPToken::Icon &icon, unsigned size);
+    // the icon scaled to fit the size and encoded compactly (WebP when available, otherwise PNG
+    // with at most 256 colors), the raster encoder of AppSupport::IconTranscoder for imports
+    static bool normalize(const OTPToken::Icon &icon, unsigned maxSize, OTPToken::Icon &out);
+};
+
+#endif // ICONCACHE_HPP
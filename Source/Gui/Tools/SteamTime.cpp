@@ -0,0 +1,50 @@
+#include "SteamTime.hpp"
+
+#include <QEventLoop>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+
+namespace {
+    static const char *const QUERY_TIME_URL = "https://api.steampowered.com/ITwoFactorService/QueryTime/v0001";
+    static const constexpr int TIMEOUT_MS = 10000;
+}
+
+bool SteamTime::query(std::time_t &serverTime)
+{
+    // the worker has no event loop, the manager and its reply live for this request only
+    QNetworkAccessManager manager;
+    QNetworkRequest request(QUrl(QUERY_TIME_URL));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+    auto reply = manager.post(request, QByteArray("steamid=0"));
+    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    timeout.start(TIMEOUT_MS);
+    loop.exec();
+
+    if (!reply->isFinished() || reply->error() != QNetworkReply::NoError)
+    {
+        reply->abort();
+        return false;
+    }
+
+    // {"response":{"server_time":"1536573900", ...}}
+    const auto response = QJsonDocument::fromJson(reply->readAll()).object().value("response").toObject();
+    bool ok = false;
+    const auto time = response.value("server_time").toVariant().toLongLong(&ok);
+    if (!ok || time <= 0)
+    {
+        return false;
+    }
+
+    serverTime = static_cast<std::time_t>(time);
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef STEAMTIME_HPP
+#define STEAMTIME_HPP
+
+#include <SteamTimeService.hpp>
+
+class SteamTime final
+{
+    SteamTime() = delete;
+
+public:
+    // blocking request of ITwoFactorService/QueryTime, for the worker of the SteamTimeService
+    static bool query(std::time_t &serverTime);
+};
+
+#endif // STEAMTIME_HPP
@@ -2,70 +2,115 @@
 
 #include <zlib.h>
 
-const std::string zlibTool::uncompress(const std::string &data, bool *success)
-{
-    if (data.size() <= 4)
+#include <algorithm>
+#include <limits>
+
+namespace {
+    // deflate can't compress better than about 1:1032
+    static const constexpr std::size_t MAX_RATIO = 1032;
+
+    // output size from the gzip trailer (ISIZE, the size modulo 2^32), 0 if unknown
+    static std::size_t sizeHint(std::string_view data)
     {
-        if (success) *success = false;
-        return std::string();
-    }
+        if (data.size() < 18 || static_cast<unsigned char>(data[0]) != 0x1F || static_cast<unsigned char>(data[1]) != 0x8B)
+        {
+            return 0;
+        }
 
-    std::string result;
+        const auto trailer = reinterpret_cast<const unsigned char*>(data.data() + data.size() - 4);
+        const std::size_t size = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) |
+                                 (static_cast<std::size_t>(trailer[3]) << 24);
+        // a damaged or crafted trailer must not cause a huge allocation
+        return size <= data.size() * MAX_RATIO ? size : 0;
+    }
+}
 
-    int ret;
-    z_stream strm;
-    static const int CHUNK_SIZE = 1024;
-    char out[CHUNK_SIZE];
+bool zlibTool::uncompress(std::string_view data, std::string &out)
+{
+    out.clear();
+    if (data.size() <= 4 || data.size() > std::numeric_limits<uInt>::max())
+    {
+        return false;
+    }
 
-    /* allocate inflate state */
-    strm.zalloc = nullptr;
-    strm.zfree = nullptr;
-    strm.opaque = nullptr;
+    z_stream strm{};
     strm.avail_in = static_cast<uInt>(data.size());
     strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
 
-    // gzip decoding
-    ret = inflateInit2(&strm, 15 + 32);
-    if (ret != Z_OK)
+    // gzip and zlib decoding
+    if (inflateInit2(&strm, 15 + 32) != Z_OK)
     {
-        if (success) *success = false;
-        return std::string();
+        return false;
     }
 
-    // run inflate()
-    do {
-        strm.avail_out = CHUNK_SIZE;
-        strm.next_out = (Bytef*)(out);
+    const auto hint = sizeHint(data);
+    out.resize(hint ? hint : data.size() * 4);
 
-        ret = inflate(&strm, Z_NO_FLUSH);
-        if (ret == Z_STREAM_ERROR)
+    // a correct hint inflates in a single call, otherwise the buffer grows
+    for (;;)
+    {
+        strm.next_out = reinterpret_cast<Bytef*>(&out[strm.total_out]);
+        strm.avail_out = static_cast<uInt>(std::min<std::size_t>(out.size() - strm.total_out, std::numeric_limits<uInt>::max()));
+
+        const auto ret = inflate(&strm, Z_FINISH);
+        if (ret == Z_STREAM_END)
         {
-            // state not clobbered
-            if (success) *success = false;
-            return std::string();
+            break;
         }
-
-        switch (ret)
+        if ((ret != Z_OK && ret != Z_BUF_ERROR) || (ret == Z_BUF_ERROR && strm.avail_in == 0 && strm.avail_out != 0))
         {
-            case Z_NEED_DICT:
-                ret = Z_DATA_ERROR; // and fall through
-            case Z_DATA_ERROR:
-            case Z_MEM_ERROR:
-                (void) inflateEnd(&strm);
-                if (success) *success = false;
-                return std::string();
+            // damaged or truncated input
+            (void) inflateEnd(&strm);
+            out.clear();
+            return false;
         }
+        out.resize(out.size() * 2);
+    }
 
-        result.append(out, CHUNK_SIZE - strm.avail_out);
-    } while (strm.avail_out == 0);
+    out.resize(strm.total_out);
+    (void) inflateEnd(&strm);
+    return true;
+}
 
-    // clean up and return
-    inflateEnd(&strm);
-    if (success) *success = true;
+bool zlibTool::compress(std::string_view data, std::string &out, int level)
+{
+    out.clear();
+    if (data.size() > std::numeric_limits<uInt>::max())
+    {
+        return false;
+    }
+
+    z_stream strm{};
+    // gzip header and trailer
+    if (deflateInit2(&strm, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return false;
+    }
+
+    out.resize(deflateBound(&strm, static_cast<uLong>(data.size())));
+    strm.avail_in = static_cast<uInt>(data.size());
+    strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    strm.avail_out = static_cast<uInt>(out.size());
+    strm.next_out = reinterpret_cast<Bytef*>(&out[0]);
+
+    const auto ret = deflate(&strm, Z_FINISH);
+    out.resize(ret == Z_STREAM_END ? strm.total_out : 0);
+    (void) deflateEnd(&strm);
+    return ret == Z_STREAM_END;
+}
+
+const std::string zlibTool::uncompress(const std::string &data, bool *success)
+{
+    std::string result;
+    const auto ok = uncompress(std::string_view(data), result);
+    if (success) *success = ok;
     return result;
 }
 
 const std::string zlibTool::uncompress(const char *data, int size, bool *success)
 {
-    return uncompress(std::string(data, data + size), success);
+    std::string result;
+    const auto ok = size > 0 && uncompress(std::string_view(data, static_cast<std::size_t>(size)), result);
+    if (success) *success = ok;
+    return result;
 }
@@ -1,7 +1,9 @@
 #ifndef ZLIBTOOL_HPP
 #define ZLIBTOOL_HPP
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 
 class zlibTool final
 {
@@ -9,6 +11,14 @@ public:
     static const std::string uncompress(const std::string &data, bool *success = nullptr);
     static const std::string uncompress(const char *data, int size, bool *success = nullptr);
 
+    // gzip or zlib input, read in place, the output is inflated in one pass,
+    // the size is taken from the gzip trailer when the input has one
+    static bool uncompress(std::string_view data, std::string &out);
+
+    // gzip output, sized by the deflate bound and compressed in one pass,
+    // the level is a zlib level, -1 is the zlib default
+    static bool compress(std::string_view data, std::string &out, int level = -1);
+
 private:
     zlibTool() = delete;
 };
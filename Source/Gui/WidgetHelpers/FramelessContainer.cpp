@@ -1,5 +1,19 @@
 #include "FramelessContainer.hpp"
 
+#include <QGuiApplication>
+#include <QScreen>
+#include <QWindow>
+
+namespace {
+    // interval of one frame of the screen the widget is on
+    static int frameInterval(const QWidget *widget)
+    {
+        auto screen = widget->windowHandle() ? widget->windowHandle()->screen() : QGuiApplication::primaryScreen();
+        const auto rate = screen ? screen->refreshRate() : 60.0;
+        return rate > 1.0 ? static_cast<int>(1000.0 / rate) : 16;
+    }
+}
+
 FramelessContainer::FramelessContainer(QWidget *target) :
     _target(target),
     _cursorchanged(false),
@@ -12,6 +26,12 @@ FramelessContainer::FramelessContainer(QWidget *target) :
     _target->setAttribute(Qt::WA_Hover);
     _target->installEventFilter(this);
     _rubberband = std::make_shared<QRubberBand>(QRubberBand::Rectangle);
+
+    // mouse moves arrive far more often than the screen refreshes on high-DPI displays,
+    // only the last geometry of a frame is applied
+    _geometryTimer.setSingleShot(true);
+    _geometryTimer.setTimerType(Qt::PreciseTimer);
+    connect(&_geometryTimer, &QTimer::timeout, this, &FramelessContainer::applyGeometry);
 }
 
 bool FramelessContainer::eventFilter(QObject *o, QEvent*e)
@@ -60,7 +80,7 @@ void FramelessContainer::mouseLeave(QEvent*)
 {
     if (!_leftButtonPressed)
     {
-        _target->unsetCursor();
+        setCursorShape(Qt::ArrowCursor);
     }
 }
 
@@ -88,6 +108,8 @@ void FramelessContainer::mouseRealese(QMouseEvent *e)
     {
         _leftButtonPressed = false;
         _dragStart = false;
+        // the final geometry must not wait for the next frame
+        applyGeometry();
     }
 }
 
@@ -97,7 +119,11 @@ void FramelessContainer::mouseMove(QMouseEvent *e)
     {
         if (_dragStart)
         {
-            _target->move(_target->frameGeometry().topLeft() + (e->pos() - _dragPos));
+            // from the global position, the target may not have moved to the last one yet
+            const auto frameOffset = _target->mapToGlobal(QPoint()) - _target->frameGeometry().topLeft();
+            _pendingPos = e->globalPos() - _dragPos - frameOffset;
+            _pendingMove = true;
+            scheduleGeometry();
         }
 
         if (!_mousePress.testFlag(Edge::None))
@@ -146,8 +172,11 @@ void FramelessContainer::mouseMove(QMouseEvent *e)
             {
                 top = _target->frameGeometry().y();
             }
-            _target->setGeometry(QRect(QPoint(left, top), QPoint(right, bottom)));
-            _rubberband->setGeometry(QRect(QPoint(left, top), QPoint(right, bottom)));
+            // the hidden rubber band tracks every event, the target follows once per frame
+            _pendingGeometry = QRect(QPoint(left, top), QPoint(right, bottom));
+            _pendingResize = true;
+            _rubberband->setGeometry(_pendingGeometry);
+            scheduleGeometry();
         }
     }
     else
@@ -162,7 +191,8 @@ void FramelessContainer::updateCursorShape(const QPoint &pos)
     {
         if (_cursorchanged)
         {
-            _target->unsetCursor();
+            setCursorShape(Qt::ArrowCursor);
+            _cursorchanged = false;
         }
         return;
     }
@@ -172,28 +202,71 @@ void FramelessContainer::updateCursorShape(const QPoint &pos)
         _cursorchanged = true;
         if (_mouseMove.testFlag(Edge::Top) || _mouseMove.testFlag(Edge::Bottom))
         {
-            _target->setCursor(Qt::SizeVerCursor);
+            setCursorShape(Qt::SizeVerCursor);
         }
         else if (_mouseMove.testFlag(Edge::Left) || _mouseMove.testFlag(Edge::Right))
         {
-            _target->setCursor(Qt::SizeHorCursor);
+            setCursorShape(Qt::SizeHorCursor);
         }
         else if (_mouseMove.testFlag(Edge::TopLeft) || _mouseMove.testFlag(Edge::BottomRight))
         {
-            _target->setCursor(Qt::SizeFDiagCursor);
+            setCursorShape(Qt::SizeFDiagCursor);
         }
         else if (_mouseMove.testFlag(Edge::TopRight) || _mouseMove.testFlag(Edge::BottomLeft))
         {
-            _target->setCursor(Qt::SizeBDiagCursor);
+            setCursorShape(Qt::SizeBDiagCursor);
         }
-        else if (_cursorchanged)
+        else
         {
-            _target->unsetCursor();
+            setCursorShape(Qt::ArrowCursor);
             _cursorchanged = false;
         }
     }
 }
 
+void FramelessContainer::setCursorShape(Qt::CursorShape shape)
+{
+    // hover events arrive for every pixel, only touch the cursor when the edge changes
+    if (shape == _cursorShape)
+    {
+        return;
+    }
+    _cursorShape = shape;
+
+    if (shape == Qt::ArrowCursor)
+    {
+        _target->unsetCursor();
+    }
+    else
+    {
+        _target->setCursor(shape);
+    }
+}
+
+void FramelessContainer::scheduleGeometry()
+{
+    if (!_geometryTimer.isActive())
+    {
+        _geometryTimer.start(frameInterval(_target));
+    }
+}
+
+void FramelessContainer::applyGeometry()
+{
+    _geometryTimer.stop();
+
+    if (_pendingResize)
+    {
+        _target->setGeometry(_pendingGeometry);
+    }
+    else if (_pendingMove)
+    {
+        _target->move(_pendingPos);
+    }
+    _pendingResize = false;
+    _pendingMove = false;
+}
+
 void FramelessContainer::calculateCursorPosition(const QPoint &pos, const QRect &framerect, Edges &_edge)
 {
     bool onLeft = pos.x() >= framerect.x() - _borderWidth && pos.x() <= framerect.x() + _borderWidth &&
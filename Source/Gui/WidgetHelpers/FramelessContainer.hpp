@@ -9,6 +9,7 @@
 #include <QPoint>
 #include <QHoverEvent>
 #include <QMouseEvent>
+#include <QTimer>
 
 #include <memory>
 
@@ -62,6 +63,11 @@ protected:
     void mouseMove(QMouseEvent*);
     void updateCursorShape(const QPoint &);
     void calculateCursorPosition(const QPoint &, const QRect &, Edges &);
+    void setCursorShape(Qt::CursorShape shape);
+
+    // moves and resizes are applied at most once per frame
+    void scheduleGeometry();
+    void applyGeometry();
 
 private:
     QWidget *_target = nullptr;
@@ -74,6 +80,15 @@ private:
 
     QPoint _dragPos;
     bool _dragStart = false;
+
+    // the shape last set on the target, ArrowCursor when it was unset
+    Qt::CursorShape _cursorShape = Qt::ArrowCursor;
+
+    QTimer _geometryTimer;
+    QRect _pendingGeometry;
+    QPoint _pendingPos;
+    bool _pendingResize = false;
+    bool _pendingMove = false;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS(FramelessContainer::Edges);
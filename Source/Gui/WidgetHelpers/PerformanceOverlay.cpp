@@ -0,0 +1,150 @@
+#include "PerformanceOverlay.hpp"
+
+#include <QEvent>
+#include <QFont>
+#include <QStringList>
+
+#include <algorithm>
+
+namespace {
+    // the heartbeat should fire every interval, a later one was blocked by other work
+    static const constexpr int HEARTBEAT_MS = 16;
+    static const constexpr qint64 STALL_NS = 50 * 1000 * 1000;
+    static const constexpr int REFRESH_MS = 500;
+
+    // samples recorded since the previous snapshot, the maximum can't be taken apart
+    static PerfStats::Histogram since(const PerfStats::Histogram &now, const PerfStats::Histogram &before)
+    {
+        PerfStats::Histogram h;
+        h.count = now.count - before.count;
+        h.totalNs = now.totalNs - before.totalNs;
+        h.maxNs = now.maxNs;
+        for (auto i = 0U; i < PerfStats::HISTOGRAM_BUCKETS; ++i)
+        {
+            h.buckets[i] = now.buckets[i] - before.buckets[i];
+        }
+        return h;
+    }
+
+    static QString timing(const char *name, const PerfStats::Histogram &h)
+    {
+        return QString("%1 %2  avg %3 ms  p99 <%4 ms  max %5 ms")
+            .arg(QLatin1String(name), -8)
+            .arg(h.count, 4)
+            .arg(h.meanNs() / 1e6, 0, 'f', 2)
+            .arg(static_cast<double>(h.percentileUs(0.99)) / 1e3, 0, 'f', 1)
+            .arg(static_cast<double>(h.maxNs) / 1e6, 0, 'f', 1);
+    }
+
+    static QString rate(const char *name, std::uint64_t hits, std::uint64_t misses)
+    {
+        const auto total = hits + misses;
+        return QString("%1 %2 hits  %3 misses  %4%")
+            .arg(QLatin1String(name), -8)
+            .arg(hits, 4)
+            .arg(misses)
+            .arg(total ? 100.0 * static_cast<double>(hits) / static_cast<double>(total) : 100.0, 0, 'f', 1);
+    }
+}
+
+PerformanceOverlay::PerformanceOverlay(QAbstractScrollArea *view)
+    : QLabel(view),
+      _view(view)
+{
+    // opaque, updating the text doesn't repaint the list below
+    this->setAttribute(Qt::WA_TransparentForMouseEvents);
+    this->setAutoFillBackground(true);
+    auto palette = this->palette();
+    palette.setColor(QPalette::Window, QColor(0, 0, 0));
+    palette.setColor(QPalette::WindowText, QColor(0, 255, 0));
+    this->setPalette(palette);
+    this->setFont(QFont("monospace", 8));
+    this->setMargin(4);
+    this->setTextFormat(Qt::PlainText);
+
+    view->installEventFilter(this);
+    view->viewport()->installEventFilter(this);
+
+    this->_heartbeat.setTimerType(Qt::PreciseTimer);
+    this->_heartbeat.setInterval(HEARTBEAT_MS);
+    QObject::connect(&this->_heartbeat, &QTimer::timeout, this, &PerformanceOverlay::heartbeat);
+    this->_heartbeat.start();
+    this->_sinceHeartbeat.start();
+
+    this->_refresh.setInterval(REFRESH_MS);
+    QObject::connect(&this->_refresh, &QTimer::timeout, this, &PerformanceOverlay::refresh);
+    this->_refresh.start();
+    this->_sinceRefresh.start();
+    this->_last = PerfStats::snapshot();
+
+    this->refresh();
+    this->raise();
+    this->show();
+}
+
+bool PerformanceOverlay::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == this->_view && event->type() == QEvent::Resize)
+    {
+        this->place();
+    }
+    else if (watched == this->_view->viewport() && event->type() == QEvent::Paint && !this->_painting)
+    {
+        // the viewport paints here instead of after the filter, so the paint can be timed
+        QElapsedTimer frame;
+        frame.start();
+        this->_painting = true;
+        const auto handled = watched->event(event);
+        this->_painting = false;
+        PerfStats::record(PerfStats::Frame, static_cast<std::uint64_t>(frame.nsecsElapsed()));
+        return handled;
+    }
+    return QLabel::eventFilter(watched, event);
+}
+
+void PerformanceOverlay::heartbeat()
+{
+    const auto elapsed = this->_sinceHeartbeat.nsecsElapsed();
+    this->_sinceHeartbeat.restart();
+
+    const auto lag = std::max<qint64>(elapsed - HEARTBEAT_MS * 1000 * 1000, 0);
+    PerfStats::record(PerfStats::EventLoopLag, static_cast<std::uint64_t>(lag));
+    if (lag >= STALL_NS)
+    {
+        PerfStats::add(PerfStats::EventLoopStalls);
+    }
+}
+
+void PerformanceOverlay::refresh()
+{
+#ifdef OTPGEN_WITH_PERF_STATS
+    const auto now = PerfStats::snapshot();
+    const auto counter = [&](PerfStats::Counter c) {
+        return now.counters[c] - this->_last.counters[c];
+    };
+    const auto seconds = std::max<double>(static_cast<double>(this->_sinceRefresh.restart()) / 1e3, 1e-3);
+
+    const auto frames = since(now.timers[PerfStats::Frame], this->_last.timers[PerfStats::Frame]);
+    QStringList lines;
+    lines << QString("%1 fps").arg(static_cast<double>(frames.count) / seconds, 0, 'f', 1)
+          << timing("frame", frames)
+          << timing("fetch", since(now.timers[PerfStats::ModelFetch], this->_last.timers[PerfStats::ModelFetch]))
+          << timing("lag", since(now.timers[PerfStats::EventLoopLag], this->_last.timers[PerfStats::EventLoopLag]))
+          << QString("%1 %2").arg(QLatin1String("stalls"), -8).arg(counter(PerfStats::EventLoopStalls), 4)
+          << rate("codes", counter(PerfStats::CodeCacheHits), counter(PerfStats::CodeCacheMisses))
+          << rate("icons", counter(PerfStats::IconCacheHits), counter(PerfStats::IconCacheMisses));
+    this->setText(lines.join('\n'));
+    this->_last = now;
+#else
+    this->setText("performance counters are disabled in this build");
+#endif
+    this->place();
+}
+
+void PerformanceOverlay::place()
+{
+    // top right corner of the viewport, left of the scroll bar
+    this->adjustSize();
+    const auto viewport = this->_view->viewport()->geometry();
+    this->move(viewport.right() - this->width() + 1, viewport.top());
+}
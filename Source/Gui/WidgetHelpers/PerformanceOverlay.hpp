@@ -0,0 +1,53 @@
+#ifndef PERFORMANCEOVERLAY_HPP
+#define PERFORMANCEOVERLAY_HPP
+
+#include <QAbstractScrollArea>
+#include <QElapsedTimer>
+#include <QLabel>
+#include <QTimer>
+
+#include <PerfStats.hpp>
+
+/**
+ * Debug overlay with the live costs of the GUI
+ *
+ * Shown in the corner of the watched view, enabled with the debug setting
+ * or the OTPGEN_DEBUG environment variable (see GuiConfig). The overlay
+ * times the paint events of the view (PerfStats::Frame) and measures how
+ * late a heartbeat timer fires (PerfStats::EventLoopLag), both through the
+ * shared counters, so they show up in the metrics as well.
+ *
+ * Twice a second it shows what happened since its last update: frames,
+ * token model fetches, the hit rates of the code and icon caches and the
+ * event loop stalls. Percentiles are the upper bounds of the histogram
+ * buckets.
+ *
+ */
+class PerformanceOverlay : public QLabel
+{
+    Q_OBJECT
+
+public:
+    // the overlay is a child of the view and follows its size, the paint events of the viewport are timed
+    explicit PerformanceOverlay(QAbstractScrollArea *view);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    void heartbeat();
+    void refresh();
+    void place();
+
+    QAbstractScrollArea *_view;
+    bool _painting = false;
+
+    QTimer _heartbeat;
+    QElapsedTimer _sinceHeartbeat;
+
+    QTimer _refresh;
+    QElapsedTimer _sinceRefresh;
+    PerfStats::Snapshot _last;
+};
+
+#endif // PERFORMANCEOVERLAY_HPP
@@ -1,6 +1,10 @@
 #include "TitleBar.hpp"
 #include "GuiHelpers.hpp"
 
+#include <QPainter>
+#include <QScreen>
+#include <QWindow>
+
 TitleBar::TitleBar(int minimumHeight, QWidget *parent)
     : QWidget(parent)
 {
@@ -19,6 +23,7 @@ TitleBar::TitleBar(int minimumHeight, QWidget *parent)
 
     windowTitle = std::make_shared<QLabel>(qApp->applicationDisplayName());
     windowTitle->setFont(GuiHelpers::font_titleBar());
+    windowTitle->setTextFormat(Qt::PlainText);
     windowTitle->setMargin(10);
     hbox->addWidget(windowTitle.get(), 0, Qt::AlignVCenter | Qt::AlignHCenter);
     hbox->addSpacerItem(new QSpacerItem(10, 0, QSizePolicy::Fixed, QSizePolicy::Minimum));
@@ -32,6 +37,13 @@ TitleBar::TitleBar(int minimumHeight, QWidget *parent)
     hbox->addSpacerItem(new QSpacerItem(5, 0, QSizePolicy::Fixed, QSizePolicy::Minimum));
 
     this->setLayout(hbox.get());
+
+    // the background is blitted from the cache, nothing underneath needs to be drawn
+    this->setAttribute(Qt::WA_OpaquePaintEvent);
+
+    moveTimer.setSingleShot(true);
+    moveTimer.setTimerType(Qt::PreciseTimer);
+    connect(&moveTimer, &QTimer::timeout, this, &TitleBar::applyMove);
 }
 
 void TitleBar::setLeftButtons(const QList<std::shared_ptr<QPushButton>> &buttons)
@@ -86,8 +98,19 @@ void TitleBar::mouseMoveEvent(QMouseEvent *event)
         return;
     }
 
-    this->parentWidget()->move(event->globalX() - m_nMouseClick_X_Coordinate,
-                               event->globalY() - m_nMouseClick_Y_Coordinate);
+    pendingPos = QPoint(event->globalX() - m_nMouseClick_X_Coordinate,
+                        event->globalY() - m_nMouseClick_Y_Coordinate);
+    if (!moveTimer.isActive())
+    {
+        auto screen = this->window()->windowHandle() ? this->window()->windowHandle()->screen() : nullptr;
+        const auto rate = screen ? screen->refreshRate() : 60.0;
+        moveTimer.start(rate > 1.0 ? static_cast<int>(1000.0 / rate) : 16);
+    }
+}
+
+void TitleBar::applyMove()
+{
+    this->parentWidget()->move(pendingPos);
 }
 
 void TitleBar::mouseDoubleClickEvent(QMouseEvent *)
@@ -106,3 +129,47 @@ void TitleBar::mouseDoubleClickEvent(QMouseEvent *)
         this->parentWidget()->showMaximized();
     }
 }
+
+void TitleBar::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(this);
+    painter.setClipRect(event->rect());
+    painter.drawPixmap(0, 0, background(this->isActiveWindow()));
+}
+
+void TitleBar::changeEvent(QEvent *event)
+{
+    if (event->type() == QEvent::ActivationChange)
+    {
+        this->update();
+    }
+    else if (event->type() == QEvent::PaletteChange)
+    {
+        backgroundCache[0] = QPixmap();
+        backgroundCache[1] = QPixmap();
+        this->update();
+    }
+    QWidget::changeEvent(event);
+}
+
+const QPixmap &TitleBar::background(bool active)
+{
+    auto &pixmap = backgroundCache[active ? 1 : 0];
+    const auto ratio = this->devicePixelRatioF();
+    if (!pixmap.isNull() && pixmap.devicePixelRatioF() == ratio && pixmap.size() == this->size() * ratio)
+    {
+        return pixmap;
+    }
+
+    // rendered at device resolution, the blit is never scaled on high-DPI displays
+    pixmap = QPixmap(this->size() * ratio);
+    pixmap.setDevicePixelRatio(ratio);
+
+    auto color = this->palette().color(QPalette::Background);
+    if (!active)
+    {
+        color = color.darker(110);
+    }
+    pixmap.fill(color);
+    return pixmap;
+}
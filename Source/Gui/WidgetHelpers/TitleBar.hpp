@@ -6,6 +6,9 @@
 #include <QWidget>
 #include <QBoxLayout>
 #include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPixmap>
+#include <QTimer>
 
 #include <QPushButton>
 #include <QLabel>
@@ -28,10 +31,22 @@ protected:
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void mouseDoubleClickEvent(QMouseEvent *event);
+    void paintEvent(QPaintEvent *event);
+    void changeEvent(QEvent *event);
     int m_nMouseClick_X_Coordinate;
     int m_nMouseClick_Y_Coordinate;
 
 private:
+    // background of the active and inactive window, rendered once per size and pixel ratio
+    const QPixmap &background(bool active);
+    void applyMove();
+
+    QPixmap backgroundCache[2];
+
+    // the window follows the mouse at most once per frame
+    QTimer moveTimer;
+    QPoint pendingPos;
+
     std::shared_ptr<QHBoxLayout> hbox;
 
     std::shared_ptr<QLabel> windowTitle;
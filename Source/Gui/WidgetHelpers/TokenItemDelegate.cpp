@@ -0,0 +1,281 @@
+#include "TokenItemDelegate.hpp"
+#include "TokenListView.hpp"
+
+#include <Models/TokenListModel.hpp>
+
+#include <StartupProfile.hpp>
+
+#include <QApplication>
+#include <QPainter>
+#include <QFontDatabase>
+#include <QGlyphRun>
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+    static const constexpr int MARGIN = 8;
+    static const constexpr int SPACING = 8;
+    static const constexpr int PROGRESS_HEIGHT = 2;
+
+    // one label per token, a list of unusual size starts over instead of growing
+    static const constexpr int MAX_STATIC_TEXTS = 4096;
+
+    // QFontMetrics::horizontalAdvance() is new in Qt 5.11 and QPalette::PlaceholderText in Qt 5.12
+    static int textAdvance(const QFont &font, const QString &text)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+        return QFontMetrics(font).horizontalAdvance(text);
+#else
+        return QFontMetrics(font).width(text);
+#endif
+    }
+
+    static QColor placeholderColor(const QPalette &palette)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+        return palette.color(QPalette::PlaceholderText);
+#else
+        // older versions draw placeholder texts in the half transparent text color
+        auto color = palette.color(QPalette::Text);
+        color.setAlpha(128);
+        return color;
+#endif
+    }
+
+    static QStaticText prepared(const QString &text, const QFont &font)
+    {
+        QStaticText prepared(text);
+        prepared.setTextFormat(Qt::PlainText);
+        prepared.setPerformanceHint(QStaticText::AggressiveCaching);
+        prepared.prepare(QTransform(), font);
+        return prepared;
+    }
+
+    static const QStaticText &cachedText(QHash<QString, QStaticText> &cache, const QString &key,
+                                         const std::function<QString()> &text, const QFont &font)
+    {
+        auto it = cache.find(key);
+        if (it == cache.end())
+        {
+            if (cache.size() >= MAX_STATIC_TEXTS)
+            {
+                cache.clear();
+            }
+            it = cache.insert(key, prepared(text(), font));
+        }
+        return *it;
+    }
+}
+
+TokenItemDelegate::TokenItemDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+void TokenItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    QStyleOptionViewItem opt = option;
+    this->initStyleOption(&opt, index);
+
+    painter->save();
+
+    // selection and hover background only, the contents are painted below
+    const auto style = opt.widget ? opt.widget->style() : QApplication::style();
+    opt.text.clear();
+    opt.icon = QIcon();
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &opt, painter, opt.widget);
+
+    // a tick only repaints the code and the progress bar, the other parts are skipped then
+    const auto view = qobject_cast<const TokenListView*>(opt.widget);
+    const auto dirty = [&](const QRect &part) {
+        return !view || view->paintRegion().isEmpty() || view->paintRegion().intersects(part);
+    };
+
+    auto &layout = this->layout(opt.font, opt.widget ? static_cast<const QPaintDevice*>(opt.widget) : painter->device());
+    const auto rect = opt.rect.adjusted(MARGIN, 0, -MARGIN, 0);
+    const auto &palette = opt.palette;
+    const auto selected = opt.state & QStyle::State_Selected;
+    painter->setPen(palette.color(selected ? QPalette::HighlightedText : QPalette::Text));
+
+    // icon
+    auto left = rect.left();
+    const auto model = qobject_cast<const TokenListModel*>(index.model());
+    const auto iconSize = model ? model->iconSize() : QSize(32, 32);
+    const QRect icon_rect(left, rect.top(), iconSize.width(), rect.height());
+    if (dirty(icon_rect))
+    {
+        const auto icon = index.data(Qt::DecorationRole).value<QPixmap>();
+        if (!icon.isNull())
+        {
+            const auto size = icon.size().scaled(iconSize, Qt::KeepAspectRatio);
+            painter->drawPixmap(QRect(QPoint(left, rect.center().y() - size.height() / 2), size), icon);
+        }
+    }
+    left += iconSize.width() + SPACING;
+
+    // code on the right, the width of the longest code keeps the columns aligned
+    const auto code_rect = this->codeRect(opt);
+    if (dirty(code_rect))
+    {
+        const auto code = index.data(TokenListModel::CodeRole).toString();
+        this->drawCode(painter, layout, code_rect, code);
+        if (!code.isEmpty())
+        {
+            StartupProfile::firstCode();
+        }
+    }
+
+    // label and type name
+    const QRect text_rect(left, rect.top(), code_rect.left() - SPACING - left, rect.height());
+    if (dirty(text_rect))
+    {
+        if (layout.labelWidth != text_rect.width())
+        {
+            layout.labels.clear();
+            layout.labelWidth = text_rect.width();
+        }
+
+        const auto top = text_rect.center().y() - (layout.labelHeight + layout.typeHeight) / 2;
+        const auto label = index.data(Qt::DisplayRole).toString();
+        painter->setFont(opt.font);
+        painter->drawStaticText(QPoint(text_rect.left(), top), cachedText(layout.labels, label, [&] {
+            return QFontMetrics(opt.font).elidedText(label, Qt::ElideRight, text_rect.width());
+        }, opt.font));
+
+        const auto type = index.data(TokenListModel::TypeNameRole).toString();
+        painter->setFont(layout.typeFont);
+        painter->setPen(selected ? palette.color(QPalette::HighlightedText) : placeholderColor(palette));
+        painter->drawStaticText(QPoint(text_rect.left(), top + layout.labelHeight), cachedText(layout.types, type, [&] {
+            return type;
+        }, layout.typeFont));
+    }
+
+    // remaining time of time-based tokens
+    const auto period = index.data(TokenListModel::PeriodRole).toInt();
+    if (period > 0)
+    {
+        const auto remaining = index.data(TokenListModel::RemainingRole).toInt();
+        auto bar = this->progressRect(opt);
+        bar.setWidth(bar.width() * remaining / period);
+        painter->fillRect(bar, palette.color(QPalette::Highlight));
+    }
+
+    painter->restore();
+}
+
+QSize TokenItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    // independent of the row, the view may use uniform item sizes
+    const auto &layout = this->layout(option.font, option.widget);
+    const auto model = qobject_cast<const TokenListModel*>(index.model());
+    const auto icon_height = model ? model->iconSize().height() : 32;
+    const auto text_height = layout.labelHeight + layout.typeHeight;
+    const auto code_height = QFontMetrics(layout.codeFont).height();
+    return QSize(option.rect.width(), std::max({icon_height, text_height, code_height}) + 2 * MARGIN);
+}
+
+QRect TokenItemDelegate::codeRect(const QStyleOptionViewItem &option) const
+{
+    const auto &layout = this->layout(option.font, option.widget);
+    const auto rect = option.rect.adjusted(MARGIN, 0, -MARGIN, 0);
+    return QRect(rect.right() - layout.codeWidth, rect.top(), layout.codeWidth, rect.height());
+}
+
+QRect TokenItemDelegate::progressRect(const QStyleOptionViewItem &option) const
+{
+    const auto rect = option.rect.adjusted(MARGIN, 0, -MARGIN, 0);
+    return QRect(rect.left(), option.rect.bottom() - PROGRESS_HEIGHT + 1, rect.width(), PROGRESS_HEIGHT);
+}
+
+TokenItemDelegate::Layout &TokenItemDelegate::layout(const QFont &base, const QPaintDevice *device) const
+{
+    // the fonts are scaled by Qt, the resolution only decides which glyphs are rasterized
+    const auto key = base.key() + QLatin1Char('@') +
+        (device ? QString::number(device->logicalDpiY()) + QLatin1Char('x') + QString::number(device->devicePixelRatioF()) : QString());
+    if (this->_layout.key == key)
+    {
+        return this->_layout;
+    }
+
+    Layout layout;
+    layout.key = key;
+    layout.codeFont = this->codeFont(base);
+    layout.typeFont = this->typeFont(base);
+    layout.codeWidth = textAdvance(layout.codeFont, QStringLiteral("0000000000"));
+    layout.labelHeight = QFontMetrics(base).height();
+    layout.typeHeight = QFontMetrics(layout.typeFont).height();
+    layout.codeGlyphs = QRawFont::fromFont(layout.codeFont);
+    this->_layout = std::move(layout);
+    return this->_layout;
+}
+
+void TokenItemDelegate::drawCode(QPainter *painter, Layout &layout, const QRect &rect, const QString &code) const
+{
+    if (code.isEmpty())
+    {
+        return;
+    }
+
+    // the glyphs of the characters are looked up once, codes are never shaped
+    QVector<quint32> glyphs;
+    QVector<QPointF> positions;
+    glyphs.reserve(code.size());
+    positions.reserve(code.size());
+    qreal width = 0;
+    for (auto&& c : code)
+    {
+        const auto u = c.unicode();
+        if (!layout.codeGlyphs.isValid() || u >= layout.glyphs.size())
+        {
+            glyphs.clear();
+            break;
+        }
+        if (layout.glyphs[u] == 0U)
+        {
+            const auto indexes = layout.codeGlyphs.glyphIndexesForString(QString(c));
+            if (indexes.isEmpty() || indexes.first() == 0U)
+            {
+                glyphs.clear();
+                break;
+            }
+            layout.glyphs[u] = indexes.first();
+            layout.advances[u] = layout.codeGlyphs.advancesForGlyphIndexes(indexes).value(0).x();
+        }
+        glyphs.append(layout.glyphs[u]);
+        positions.append(QPointF(width, 0));
+        width += layout.advances[u];
+    }
+
+    // characters the font doesn't have are left to the font fallback of the text layout
+    if (glyphs.isEmpty())
+    {
+        painter->setFont(layout.codeFont);
+        painter->drawText(rect, Qt::AlignRight | Qt::AlignVCenter, code);
+        return;
+    }
+
+    // right aligned, the baseline centers the glyphs vertically
+    const QPointF origin(rect.right() + 1 - width,
+                         rect.center().y() + (layout.codeGlyphs.ascent() - layout.codeGlyphs.descent()) / 2);
+    QGlyphRun run;
+    run.setRawFont(layout.codeGlyphs);
+    run.setGlyphIndexes(glyphs);
+    run.setPositions(positions);
+    painter->drawGlyphRun(origin, run);
+}
+
+QFont TokenItemDelegate::codeFont(const QFont &base) const
+{
+    auto font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    font.setPointSizeF(base.pointSizeF() * 1.5);
+    font.setBold(true);
+    return font;
+}
+
+QFont TokenItemDelegate::typeFont(const QFont &base) const
+{
+    auto font = base;
+    font.setPointSizeF(base.pointSizeF() * 0.85);
+    return font;
+}
@@ -0,0 +1,73 @@
+#ifndef TOKENITEMDELEGATE_HPP
+#define TOKENITEMDELEGATE_HPP
+
+#include <QStyledItemDelegate>
+#include <QFont>
+#include <QHash>
+#include <QRawFont>
+#include <QStaticText>
+
+#include <array>
+
+/**
+ * Paints the rows of the TokenListModel
+ *
+ * Rows are painted straight from the model roles, there are no widgets
+ * per row. All rows have the same height, which lets the view skip the
+ * rows outside of the viewport.
+ *
+ * Nothing is laid out while painting: labels and type names are kept as
+ * prepared QStaticText, codes are drawn as one glyph run from the cached
+ * glyphs of their characters. The caches belong to the font and the
+ * resolution of the last painted rows and start over when either changes.
+ * In a TokenListView the parts of the row outside of the repainted region
+ * are skipped, a tick only repaints the codes and the progress bars.
+ *
+ */
+class TokenItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit TokenItemDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+    // parts of the row which change with the time
+    QRect codeRect(const QStyleOptionViewItem &option) const;
+    QRect progressRect(const QStyleOptionViewItem &option) const;
+
+private:
+    struct Layout
+    {
+        // base font and resolution the layout belongs to
+        QString key;
+
+        QFont codeFont;
+        QFont typeFont;
+        int codeWidth = 0;
+        int labelHeight = 0;
+        int typeHeight = 0;
+
+        // glyphs and advances of the ASCII characters of the codes, 0 before their first use
+        QRawFont codeGlyphs;
+        std::array<quint32, 128> glyphs{};
+        std::array<qreal, 128> advances{};
+
+        // elided labels of the current width and the type names
+        int labelWidth = -1;
+        QHash<QString, QStaticText> labels;
+        QHash<QString, QStaticText> types;
+    };
+
+    Layout &layout(const QFont &base, const QPaintDevice *device) const;
+    void drawCode(QPainter *painter, Layout &layout, const QRect &rect, const QString &code) const;
+
+    QFont codeFont(const QFont &base) const;
+    QFont typeFont(const QFont &base) const;
+
+    mutable Layout _layout;
+};
+
+#endif // TOKENITEMDELEGATE_HPP
@@ -0,0 +1,62 @@
+#include "TokenListView.hpp"
+#include "TokenItemDelegate.hpp"
+
+#include <Models/TokenListModel.hpp>
+
+#include <QPaintEvent>
+
+#include <algorithm>
+
+TokenListView::TokenListView(QWidget *parent)
+    : QListView(parent)
+{
+}
+
+void TokenListView::dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    // other changes may change the whole row, they take the usual way
+    const auto delegate = qobject_cast<TokenItemDelegate*>(this->itemDelegate());
+    const auto timeOnly = !roles.isEmpty() && std::all_of(roles.begin(), roles.end(), [](int role) {
+        return role == TokenListModel::CodeRole || role == TokenListModel::RemainingRole;
+    });
+    if (!delegate || !timeOnly || this->viewMode() != QListView::ListMode)
+    {
+        QListView::dataChanged(topLeft, bottomRight, roles);
+        return;
+    }
+
+    // all rows have the same height, the visible ones are between the corners of the viewport
+    const auto viewport = this->viewport()->rect();
+    const auto first = this->indexAt(viewport.topLeft());
+    if (!first.isValid())
+    {
+        return;
+    }
+    const auto last = this->indexAt(viewport.bottomLeft());
+    const auto from = std::max(topLeft.row(), first.row());
+    const auto to = std::min(bottomRight.row(), last.isValid() ? last.row() : this->model()->rowCount(topLeft.parent()) - 1);
+
+    const auto code = roles.contains(TokenListModel::CodeRole);
+    auto option = this->viewOptions();
+    QRegion dirty;
+    for (auto row = from; row <= to; ++row)
+    {
+        option.rect = this->visualRect(this->model()->index(row, 0, topLeft.parent()));
+        if (code)
+        {
+            dirty += delegate->codeRect(option);
+        }
+        dirty += delegate->progressRect(option);
+    }
+    if (!dirty.isEmpty())
+    {
+        this->viewport()->update(dirty);
+    }
+}
+
+void TokenListView::paintEvent(QPaintEvent *event)
+{
+    this->_paintRegion = event->region();
+    QListView::paintEvent(event);
+    this->_paintRegion = QRegion();
+}
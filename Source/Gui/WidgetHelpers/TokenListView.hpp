@@ -0,0 +1,37 @@
+#ifndef TOKENLISTVIEW_HPP
+#define TOKENLISTVIEW_HPP
+
+#include <QListView>
+#include <QRegion>
+
+/**
+ * List view of the TokenListModel
+ *
+ * The model changes the codes and the remaining time of all loaded rows
+ * every second, QListView repaints the whole viewport for such changes.
+ * This view only repaints the code and the progress bar of the visible
+ * rows (see TokenItemDelegate::codeRect() and progressRect()), the region
+ * of the current paint event is kept so the delegate can skip the parts
+ * of the rows which are outside of it.
+ *
+ */
+class TokenListView : public QListView
+{
+    Q_OBJECT
+
+public:
+    explicit TokenListView(QWidget *parent = nullptr);
+
+    // region of the paint event in progress, empty outside of it
+    inline const QRegion &paintRegion() const
+    { return this->_paintRegion; }
+
+protected:
+    void dataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) override;
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QRegion _paintRegion;
+};
+
+#endif // TOKENLISTVIEW_HPP
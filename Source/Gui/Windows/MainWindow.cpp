@@ -3,6 +3,21 @@
 #include "GuiHelpers.hpp"
 
 #include <TokenDatabase.hpp>
+#include <AsyncFileIO.hpp>
+#include <Clock.hpp>
+
+#include <QSet>
+
+#ifdef OTPGEN_WITH_QR_CODES
+#include <AppSupport/ImportPipeline.hpp>
+#include <QRCodeTileScan.hpp>
+#include <ThreadPool.hpp>
+#include <otpauthURI.hpp>
+
+#include <QImage>
+#include <QMessageBox>
+#include <QScreen>
+#endif
 
 MainWindow::MainWindow(QWidget *parent)
     : QRootWidget(parent)
@@ -13,7 +28,42 @@ MainWindow::MainWindow(QWidget *parent)
     data.titleBar = GuiHelpers::make_titlebar(this, "");
 
     data.vbox->addWidget(data.titleBar.get());
-    data.vbox->addSpacerItem(new QSpacerItem(0, 10, QSizePolicy::Minimum, QSizePolicy::Expanding));
+
+    // regex search over the labels, runs on a worker while typing
+    searchBar = std::make_shared<QLineEdit>();
+    searchBar->setPlaceholderText(QObject::tr("Search (regular expression)"));
+    searchBar->setClearButtonEnabled(true);
+    QObject::connect(searchBar.get(), &QLineEdit::textChanged, this, &MainWindow::searchTokens);
+    data.vbox->addWidget(searchBar.get());
+
+    // token list, rows are painted by the delegate and fetched on demand
+    tokenModel = std::make_shared<TokenListModel>();
+    tokenModel->setIconSize(Scr::scaled(QSize(32, 32), this));
+    tokenDelegate = std::make_shared<TokenItemDelegate>();
+    tokenList = std::make_shared<TokenListView>();
+    tokenList->setModel(tokenModel.get());
+    tokenList->setItemDelegate(tokenDelegate.get());
+    tokenList->setUniformItemSizes(true);
+    tokenList->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    tokenList->setSelectionMode(QAbstractItemView::SingleSelection);
+    tokenList->setFrameShape(QFrame::NoFrame);
+    QObject::connect(tokenList.get(), &QListView::activated, this, &MainWindow::copyTokenCode);
+    tokenList->setContextMenuPolicy(Qt::CustomContextMenu);
+    QObject::connect(tokenList.get(), &QListView::customContextMenuRequested, this, &MainWindow::showTokenMenu);
+    data.vbox->addWidget(tokenList.get());
+
+    if (gcfg::performanceOverlay())
+    {
+        perfOverlay = std::make_shared<PerformanceOverlay>(tokenList.get());
+    }
+
+    search = std::make_unique<TokenSearch>(searchIndex);
+    search->start([this](const TokenSearch::Result &result) {
+        QMetaObject::invokeMethod(this, [this, result]{
+            showSearchResult(result);
+        }, Qt::QueuedConnection);
+    });
+
     this->setLayout(data.vbox.get());
 
     // create system tray icon
@@ -34,6 +84,10 @@ MainWindow::MainWindow(QWidget *parent)
 
         trayMenu->addSeparator();
 
+#ifdef OTPGEN_WITH_QR_CODES
+        trayMenu->addAction(QObject::tr("Scan QR code on screen"), this, &MainWindow::scanScreen);
+#endif
+
         traySeparatorBeforeTokens = std::make_shared<QAction>();
         traySeparatorBeforeTokens->setSeparator(true);
         trayMenu->addAction(traySeparatorBeforeTokens.get());
@@ -52,6 +106,13 @@ MainWindow::MainWindow(QWidget *parent)
 
         trayIcon->show();
 
+        // one refresh per rotation for all tray tokens
+        trayScheduler.start([this](const RotationScheduler::Event &event) {
+            QMetaObject::invokeMethod(this, [this, event]{
+                refreshTray(event.indices, event.time);
+            }, Qt::QueuedConnection);
+        });
+
         if (gcfg::startMinimizedToTray())
         {
             trayShowHide->setText(trayShowText);
@@ -64,6 +125,12 @@ MainWindow::MainWindow(QWidget *parent)
         this->close();
     });
 
+#ifdef OTPGEN_WITH_QR_CODES
+    // Scan Screen for QR Codes
+    auto ctrl_shift_s = new QShortcut(QKeySequence("Ctrl+Shift+S"), this);
+    QObject::connect(ctrl_shift_s, &QShortcut::activated, this, &MainWindow::scanScreen);
+#endif
+
     // Initialize Clipboard
     clipboard = QGuiApplication::clipboard();
 
@@ -74,9 +141,425 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    trayScheduler.stop();
+    search->stop();
+#ifdef OTPGEN_WITH_QR_CODES
+    if (screenScan)
+    {
+        screenScan->cancel();
+    }
+    if (scanThread.joinable())
+    {
+        scanThread.join();
+    }
+#endif
     clipboard = nullptr;
 }
 
+void MainWindow::setUnlocking(bool unlocking)
+{
+    searchBar->setEnabled(!unlocking);
+    tokenList->setEnabled(!unlocking);
+    searchBar->setPlaceholderText(unlocking ? QObject::tr("Unlocking token database...")
+                                            : QObject::tr("Search (regular expression)"));
+}
+
+void MainWindow::updateTokenList()
+{
+    tokenModel->update();
+
+    // the index is updated in place, unchanged labels aren't indexed again,
+    // the labels are shared with the label lookups of the open vault
+    searchIndex.setArena(TokenDatabase::labelArena());
+    QSet<qlonglong> ids;
+    (void) TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+        searchIndex.insert(token.id(), token.label());
+        ids.insert(static_cast<qlonglong>(token.id()));
+    }, false);
+    for (auto&& id : searchIndex.ids())
+    {
+        if (!ids.contains(static_cast<qlonglong>(id)))
+        {
+            searchIndex.remove(id);
+        }
+    }
+    if (!searchBar->text().isEmpty())
+    {
+        searchTokens(searchBar->text());
+    }
+
+    updateTrayTokens();
+}
+
+void MainWindow::updateTrayTokens()
+{
+    // the snapshot menu stays until the database is loaded
+    if (!trayMenu || !TokenDatabase::databaseConnected())
+    {
+        return;
+    }
+
+    // deleted tokens are skipped, tokens which stay keep their action
+    std::vector<OTPToken> tokens;
+    for (auto&& id : gcfg::trayTokens())
+    {
+        auto token = TokenDatabase::selectToken(static_cast<OTPToken::sqliteTokenID>(id));
+        if (token.id() != 0)
+        {
+            token.setIcon({});
+            tokens.emplace_back(std::move(token));
+        }
+    }
+
+    std::vector<OTPToken::sqliteTokenID> ids;
+    for (auto&& token : tokens)
+    {
+        ids.emplace_back(token.id());
+    }
+    setTrayActions(ids);
+
+    trayTokenList = std::move(tokens);
+    trayCodes = std::make_unique<TokenCodeCache>(trayTokenList);
+    trayCodes->start();
+    trayScheduler.setTokens(trayTokenList);
+
+    std::vector<std::size_t> all(trayTokenList.size());
+    for (auto i = 0U; i < all.size(); ++i)
+    {
+        all[i] = i;
+    }
+    refreshTray(all, Clock::current());
+
+    if (gcfg::useTraySnapshot())
+    {
+        writeTraySnapshot();
+    }
+
+    // requested from the snapshot menu before the database was loaded
+    if (pendingTrayCopy != 0)
+    {
+        const auto id = pendingTrayCopy;
+        pendingTrayCopy = 0;
+        copyTrayToken(id);
+    }
+}
+
+void MainWindow::showTraySnapshot(const TokenDatabase::Snapshot &snapshot)
+{
+    if (!trayMenu)
+    {
+        return;
+    }
+
+    std::vector<OTPToken::sqliteTokenID> ids;
+    for (auto&& entry : snapshot)
+    {
+        ids.emplace_back(entry.id);
+    }
+    setTrayActions(ids);
+
+    // no codes until the database is loaded
+    trayTokenList.clear();
+    trayCodes.reset();
+    trayScheduler.setTokens(trayTokenList);
+    for (auto i = 0U; i < snapshot.size(); ++i)
+    {
+        trayTokens[static_cast<int>(i)]->setText(QString::fromStdString(snapshot[i].label));
+    }
+
+    traySnapshotState.clear();
+    for (auto&& entry : snapshot)
+    {
+        traySnapshotState += QString::number(entry.id) + QLatin1Char(':') + QString::fromStdString(entry.label) + QLatin1Char('\n');
+    }
+}
+
+void MainWindow::setTrayActions(const std::vector<OTPToken::sqliteTokenID> &ids)
+{
+    QHash<qlonglong, std::shared_ptr<QAction>> actions;
+    for (auto it = trayTokenIndex.constBegin(); it != trayTokenIndex.constEnd(); ++it)
+    {
+        actions.insert(it.key(), trayTokens[it.value()]);
+    }
+
+    QList<std::shared_ptr<QAction>> list;
+    QHash<qlonglong, int> index;
+    for (auto&& id : ids)
+    {
+        auto action = actions.take(static_cast<qlonglong>(id));
+        if (!action)
+        {
+            action = std::make_shared<QAction>();
+            QObject::connect(action.get(), &QAction::triggered, this, [this, id]{
+                copyTrayToken(id);
+            });
+        }
+        index.insert(static_cast<qlonglong>(id), list.size());
+        list.append(action);
+    }
+
+    // the menu is only touched if the order changed
+    if (list != trayTokens)
+    {
+        for (auto&& action : actions)
+        {
+            trayMenu->removeAction(action.get());
+        }
+        for (auto&& action : list)
+        {
+            trayMenu->insertAction(traySeparatorBeforeTokens.get(), action.get());
+        }
+    }
+    traySeparatorBeforeTokens->setVisible(!list.isEmpty());
+
+    trayTokens = list;
+    trayTokenIndex = index;
+}
+
+void MainWindow::writeTraySnapshot()
+{
+    // only written when the entries changed
+    QString state;
+    std::vector<OTPToken::sqliteTokenID> ids;
+    for (auto&& token : trayTokenList)
+    {
+        state += QString::number(token.id()) + QLatin1Char(':') + QString::fromStdString(token.label()) + QLatin1Char('\n');
+        ids.emplace_back(token.id());
+    }
+    if (state == traySnapshotState)
+    {
+        return;
+    }
+    traySnapshotState = state;
+
+    // synced to disk, which must not block the event loop
+    const auto file = gcfg::traySnapshot();
+    AsyncFileIO::instance().run([file, ids]{
+        (void) TokenDatabase::writeSnapshot(file, ids);
+    });
+}
+
+void MainWindow::refreshTray(const std::vector<std::size_t> &indices, const std::time_t &time)
+{
+    if (!trayCodes)
+    {
+        return;
+    }
+
+    // events for a replaced token list may still be queued
+    for (auto&& i : indices)
+    {
+        if (i >= trayTokenList.size())
+        {
+            continue;
+        }
+
+        const auto &token = trayTokenList[i];
+        auto text = QString::fromStdString(token.label());
+        OTPGen::TokenBuffer code;
+        if (trayCodes->code(i, time, code))
+        {
+            text += QStringLiteral("  ") + QString::fromLatin1(code);
+        }
+
+        // only changed entries are rebuilt
+        auto &action = trayTokens[static_cast<int>(i)];
+        if (action->text() != text)
+        {
+            action->setText(text);
+        }
+    }
+}
+
+void MainWindow::copyTrayToken(const OTPToken::sqliteTokenID &id)
+{
+    const auto it = trayTokenIndex.find(static_cast<qlonglong>(id));
+    if (it == trayTokenIndex.end() || !clipboard)
+    {
+        return;
+    }
+
+    // the menu was built from the snapshot, copied once the database is loaded
+    if (!trayCodes)
+    {
+        pendingTrayCopy = id;
+        emit tokensRequested();
+        return;
+    }
+
+    // cached codes are copied without any HMAC work
+    const auto i = static_cast<std::size_t>(it.value());
+    OTPGen::TokenBuffer code;
+    if (trayCodes->code(i, Clock::current(), code))
+    {
+        clipboard->setText(QString::fromLatin1(code));
+    }
+    else
+    {
+        clipboard->setText(QString::fromStdString(trayTokenList[i].generateToken()));
+    }
+}
+
+void MainWindow::showTokenMenu(const QPoint &pos)
+{
+    const auto index = tokenList->indexAt(pos);
+    if (!index.isValid())
+    {
+        return;
+    }
+
+    const auto id = index.data(TokenListModel::IdRole).toLongLong();
+    auto ids = gcfg::trayTokens();
+    const auto pinned = ids.contains(id);
+
+    QMenu menu;
+    auto pin = menu.addAction(pinned ? QObject::tr("Remove from tray menu") : QObject::tr("Show in tray menu"));
+    pin->setEnabled(static_cast<bool>(trayMenu));
+    if (menu.exec(tokenList->viewport()->mapToGlobal(pos)) != pin)
+    {
+        return;
+    }
+
+    if (pinned)
+    {
+        ids.removeAll(id);
+    }
+    else
+    {
+        ids.append(id);
+    }
+    gcfg::setTrayTokens(ids);
+    updateTrayTokens();
+}
+
+void MainWindow::searchTokens(const QString &text)
+{
+    if (text.isEmpty())
+    {
+        search->cancel();
+        searchGeneration = 0;
+        searchBar->setToolTip(QString());
+        tokenModel->clearFilter();
+        return;
+    }
+
+    searchGeneration = search->query(text.toStdString());
+}
+
+void MainWindow::showSearchResult(const TokenSearch::Result &result)
+{
+    // results of older queries may still be queued
+    if (result.generation != searchGeneration)
+    {
+        return;
+    }
+
+    if (!result.valid)
+    {
+        searchBar->setToolTip(QObject::tr("Invalid regular expression"));
+        return;
+    }
+
+    searchBar->setToolTip(QString());
+    tokenModel->setFilter(result.ids);
+}
+
+#ifdef OTPGEN_WITH_QR_CODES
+void MainWindow::scanScreen()
+{
+    if (screenScan || !TokenDatabase::databaseConnected() || !QRCode::available())
+    {
+        return;
+    }
+
+    // grabbing must happen on the GUI thread, the pixels are converted and searched on the worker
+    QList<QImage> screens;
+    for (auto&& screen : QGuiApplication::screens())
+    {
+        screens.append(screen->grabWindow(0).toImage());
+    }
+
+    if (!scanPool)
+    {
+        scanPool = std::make_unique<ThreadPool>();
+    }
+    screenScan = std::make_shared<QRCodeTileScan>(scanPool.get());
+    searchBar->setPlaceholderText(QObject::tr("Scanning the screen for QR codes..."));
+
+    auto scan = screenScan;
+    scanThread = std::thread([this, scan, screens]{
+        const auto accept = [](const std::string &data) {
+            return otpauthURI(data).valid();
+        };
+
+        std::string data;
+        for (auto&& screen : screens)
+        {
+            // 32-bit screenshots are read in place, everything else as grayscale
+            auto format = QRCode::Gray8;
+            QImage image;
+            if (screen.format() == QImage::Format_RGB32 || screen.format() == QImage::Format_ARGB32)
+            {
+                image = screen;
+                format = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? QRCode::BGRA32 : QRCode::RGBA32;
+            }
+            else
+            {
+                image = screen.convertToFormat(QImage::Format_Grayscale8);
+            }
+
+            if (scan->decode(image.constBits(), image.width(), image.height(), image.bytesPerLine(), format, accept, data))
+            {
+                break;
+            }
+        }
+
+        const auto uri = QString::fromStdString(data);
+        QMetaObject::invokeMethod(this, [this, uri]{
+            scanThread.join();
+            screenScan.reset();
+            searchBar->setPlaceholderText(QObject::tr("Search (regular expression)"));
+            importScannedURI(uri);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::importScannedURI(const QString &uri)
+{
+    if (uri.isEmpty())
+    {
+        showScanMessage(QObject::tr("No otpauth QR code found on the screen."));
+        return;
+    }
+
+    AppSupport::ImportPipeline pipeline;
+    pipeline.addURIs(QObject::tr("Screen").toStdString(), uri.toStdString());
+
+    std::size_t inserted = 0U;
+    if (!pipeline.run(&inserted))
+    {
+        showScanMessage(QObject::tr("Unable to insert the token into the database!"));
+        return;
+    }
+
+    updateTokenList();
+    showScanMessage(inserted != 0U ? QObject::tr("Imported the token of the QR code on the screen.")
+                                   : QObject::tr("The token of the QR code on the screen is already in the database."));
+}
+
+void MainWindow::showScanMessage(const QString &message)
+{
+    if (trayIcon && !this->isVisible())
+    {
+        trayIcon->showMessage(qApp->applicationDisplayName(), message);
+    }
+    else
+    {
+        QMessageBox::information(this, qApp->applicationDisplayName(), message);
+    }
+}
+#endif
+
 void MainWindow::minimizeToTray()
 {
     // minimize to tray when available, otherwise minimize normally
@@ -106,6 +589,15 @@ void MainWindow::trayShowHideCallback()
     }
 }
 
+void MainWindow::copyTokenCode(const QModelIndex &index)
+{
+    const auto code = index.data(TokenListModel::CodeRole).toString();
+    if (clipboard && !code.isEmpty())
+    {
+        clipboard->setText(code);
+    }
+}
+
 void MainWindow::showEvent(QShowEvent *event)
 {
     // Set system tray icon visible text
@@ -114,6 +606,12 @@ void MainWindow::showEvent(QShowEvent *event)
         trayShowHide->setText(trayHideText);
     }
 
+    // started into the tray from the snapshot, the list needs the database
+    if (trayMenu && !trayCodes && !trayTokens.isEmpty())
+    {
+        emit tokensRequested();
+    }
+
     event->accept();
 }
 
@@ -11,8 +11,29 @@
 
 #include <QShortcut>
 #include <QClipboard>
+#include <QListView>
+#include <QLineEdit>
 
 #include <WidgetHelpers/QRootWidget.hpp>
+#include <WidgetHelpers/TokenItemDelegate.hpp>
+#include <WidgetHelpers/TokenListView.hpp>
+#include <WidgetHelpers/PerformanceOverlay.hpp>
+#include <Models/TokenListModel.hpp>
+
+#include <TokenDatabase.hpp>
+#include <TokenSearchIndex.hpp>
+#include <TokenSearch.hpp>
+#include <TokenCodeCache.hpp>
+#include <RotationScheduler.hpp>
+
+#include <QHash>
+
+#ifdef OTPGEN_WITH_QR_CODES
+#include <thread>
+
+class QRCodeTileScan;
+class ThreadPool;
+#endif
 
 class MainWindow : public QRootWidget
 {
@@ -24,20 +45,61 @@ public:
 
     void minimizeToTray();
 
+    // the token list and search are disabled while the database is unlocked in the background
+    void setUnlocking(bool unlocking);
+
+    // reads the token list from the database again
+    void updateTokenList();
+    // reads the tokens of the tray menu from the settings again
+    void updateTrayTokens();
+    // builds the tray menu from the snapshot before the database is loaded, the entries
+    // show the labels only, the first request for a code emits tokensRequested()
+    void showTraySnapshot(const TokenDatabase::Snapshot &snapshot);
+
 private:
     void trayShowHideCallback();
+    void copyTokenCode(const QModelIndex &index);
+    void searchTokens(const QString &text);
+    void showSearchResult(const TokenSearch::Result &result);
+    void showTokenMenu(const QPoint &pos);
+
+    void refreshTray(const std::vector<std::size_t> &indices, const std::time_t &time);
+    void copyTrayToken(const OTPToken::sqliteTokenID &id);
+    // reuses the actions of ids which stay in the menu
+    void setTrayActions(const std::vector<OTPToken::sqliteTokenID> &ids);
+    void writeTraySnapshot();
+
+#ifdef OTPGEN_WITH_QR_CODES
+    // grabs all screens and searches them for an otpauth QR code on a worker thread,
+    // the first code found is imported
+    void scanScreen();
+    void importScannedURI(const QString &uri);
+    void showScanMessage(const QString &message);
+#endif
 
 signals:
     void resized();
     void closed();
+    // the tokens are needed but the database wasn't loaded yet
+    void tokensRequested();
 
 protected:
     void showEvent(QShowEvent *event);
     void closeEvent(QCloseEvent *event);
 
 private:
+    std::shared_ptr<TokenListModel> tokenModel;
+    std::shared_ptr<TokenItemDelegate> tokenDelegate;
+    std::shared_ptr<TokenListView> tokenList;
+    // debug overlay over the token list, see GuiConfig::performanceOverlay()
+    std::shared_ptr<PerformanceOverlay> perfOverlay;
+
+    std::shared_ptr<QLineEdit> searchBar;
+    TokenSearchIndex searchIndex;
+    std::unique_ptr<TokenSearch> search;
+    std::uint64_t searchGeneration = 0;
+
     std::shared_ptr<QTimer> masterTimer;
-    QList<std::shared_ptr<QTimer>> timers;
 
     std::shared_ptr<QSystemTrayIcon> trayIcon;
     std::shared_ptr<QMenu> trayMenu;
@@ -47,7 +109,25 @@ private:
     std::shared_ptr<QAction> traySeparatorBeforeTokens;
     QList<std::shared_ptr<QAction>> trayTokens;
 
+    // tray tokens, their codes and the index of every id, the scheduler reports
+    // the rotations of all tray tokens at once
+    std::vector<OTPToken> trayTokenList;
+    QHash<qlonglong, int> trayTokenIndex;
+    std::unique_ptr<TokenCodeCache> trayCodes;
+    RotationScheduler trayScheduler;
+
+    // what the snapshot on disk holds, and the tray token copied once the database is loaded
+    QString traySnapshotState;
+    OTPToken::sqliteTokenID pendingTrayCopy = 0;
+
     QClipboard *clipboard = nullptr;
+
+#ifdef OTPGEN_WITH_QR_CODES
+    // the pool is created on the first scan, one scan runs at a time
+    std::unique_ptr<ThreadPool> scanPool;
+    std::shared_ptr<QRCodeTileScan> screenScan;
+    std::thread scanThread;
+#endif
 };
 
 #endif // MAINWINDOW_HPP
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <vector>
+#include <memory>
 #include <string>
 #include <cstdlib>
 #include <cstdio>
@@ -24,14 +25,19 @@ Q_IMPORT_PLUGIN(QWebpPlugin)
 #include <AppConfig.hpp>
 #include "GuiConfig.hpp"
 #include <CommandLineOperation.hpp>
+#include <StartupProfile.hpp>
 
+#include <SessionKeyring.hpp>
 #include <TokenDatabase.hpp>
+#include <AppSupport/IconTranscoder.hpp>
 
 #include <QApplication>
 #include <QMessageBox>
 #include <QFileInfo>
 
 #include <Windows/MainWindow.hpp>
+#include <Tools/IconCache.hpp>
+#include <Tools/SteamTime.hpp>
 #include <Windows/UserInputDialog.hpp>
 
 #ifdef OS_WASM
@@ -60,6 +66,13 @@ MainWindow *mainWindow = nullptr;
 // QKeychain already handles raw pointers and deletes them
 QKeychain::ReadPasswordJob *receivePassword = nullptr;
 QKeychain::WritePasswordJob *storePassword = nullptr;
+QKeychain::ReadPasswordJob *receiveSessionKey = nullptr;
+
+QString keychain_service_name;
+const QString keychain_secret_key = "secret";
+const QString keychain_session_key = "session";
+// the wrapping key of the session key stays out of the keychain
+const std::string keyring_session_key = "gui-session";
 #endif
 
 // name conflict with Qt (macro)
@@ -74,7 +87,7 @@ static void graceful_terminate(int signal)
     std::cerr << "Terminated by signal: " << signal << std::endl;
 
     // close database connection handle and cleanup
-    TokenDatabase::closeDatabase();
+    TokenDatabase::discardDatabase();
 
     // clean up gui, just delete
     // calling Qt functions here is not supported
@@ -129,16 +142,116 @@ int askPass(const QString &dialogNotice, const QString &error, std::string &pass
     return 0;
 }
 
+// set while the token database is loaded in the background
+static bool unlocking = false;
+// set while the tray menu shows the snapshot, the database is loaded on the first request
+static bool deferred = false;
+// set when the database was unlocked with the session key of the keychain
+static bool session_unlocked = false;
+// offset of the Steam server time, started with the cached offset once the tokens are loaded
+static std::unique_ptr<SteamTimeService> steam_time;
+
+#ifdef QTKEYCHAIN_SUPPORT
+// a new session key is stored after every unlock with the password, it isn't renewed by itself
+void store_session_key(OTPGenApplication *a)
+{
+    const auto lifetime = gcfg::sessionKeyLifetime();
+    SecureString key;
+    const auto wrapping = TokenDatabase::sessionWrappingKey();
+    if (lifetime <= 0 || session_unlocked ||
+        TokenDatabase::sessionKey(std::chrono::seconds(lifetime), wrapping, key) != TokenDatabase::Success ||
+        !SessionKeyring::store(keyring_session_key, wrapping, std::chrono::seconds(lifetime)))
+    {
+        return;
+    }
+
+    auto job = new QKeychain::WritePasswordJob(keychain_service_name, a);
+    job->setKey(keychain_session_key);
+    job->setTextData(QString::fromUtf8(key.c_str()));
+    job->start();
+}
+#endif
+
+void show_tokens(OTPGenApplication *a)
+{
+    // run command line operation if any
+    // FIXME: change how command line arguments are handled
+    const auto args = a->arguments();
+    exec_commandline_operation(qtargs_to_strvec(args));
+
+    if (!steam_time)
+    {
+        steam_time = std::make_unique<SteamTimeService>(&SteamTime::query);
+        steam_time->load();
+        steam_time->start();
+    }
+
+    mainWindow->setUnlocking(false);
+    mainWindow->updateTokenList();
+}
+
+void unlock_tokens(OTPGenApplication *a)
+{
+    if (unlocking)
+    {
+        return;
+    }
+
+    deferred = false;
+    unlocking = true;
+    mainWindow->setUnlocking(true);
+    TokenDatabase::loadTokensAsync([a](const TokenDatabase::Error &status) {
+        QMetaObject::invokeMethod(a, [a, status]{
+            unlocking = false;
+
+            // the session key is outdated, the file was replaced meanwhile
+            if (status != TokenDatabase::Success && session_unlocked)
+            {
+                session_unlocked = false;
+                std::string password;
+                if (askPass("Please enter the decryption password for your token database.",
+                            "You didn't entered a password for decryption. Application will quit now.",
+                            password, a) != 0)
+                {
+                    a->exit(1);
+                    return;
+                }
+                TokenDatabase::setPassword(password);
+                password.clear();
+                unlock_tokens(a);
+                return;
+            }
+
+            if (status != TokenDatabase::Success)
+            {
+                QMessageBox::critical(nullptr, "Error", QString(TokenDatabase::getErrorMessage(status).c_str()));
+                a->exit(static_cast<int>(status) + 5);
+                return;
+            }
+#ifdef QTKEYCHAIN_SUPPORT
+            store_session_key(a);
+#endif
+            StartupProfile::mark("load tokens");
+            show_tokens(a);
+        }, Qt::QueuedConnection);
+    });
+}
+
 int start(OTPGenApplication *a, const std::string &keychainPassword, bool create = false)
 {
     std::string password;
+    bool unlock = false;
 
     // token database exists, ask for decryption and load tokens
     if (QFileInfo(QString::fromUtf8(gcfg::database().c_str())).exists())
     {
         // Release Build
 #ifndef OTPGEN_DEBUG
-        if (keychainPassword.empty())
+        if (session_unlocked)
+        {
+            // the password was replaced by the session key already
+        }
+        else if (keychainPassword.empty())
         {
             int res = askPass("Please enter the decryption password for your token database.",
                               "You didn't entered a password for decryption. Application will quit now.",
@@ -154,15 +267,14 @@ int start(OTPGenApplication *a, const std::string &keychainPassword, bool create
             password = keychainPassword;
         }
 
-        TokenDatabase::setPassword(password);
-
-        const auto status = TokenDatabase::loadTokens();
-        if (status != TokenDatabase::Success)
+        if (!session_unlocked)
         {
-            QMessageBox::critical(nullptr, "Error", QString(TokenDatabase::getErrorMessage(status).c_str()));
-            return static_cast<int>(status) + 5;
+            TokenDatabase::setPassword(password);
         }
 
+        // decrypted and loaded on a worker once the window is shown
+        unlock = true;
+
 #else
         // Development Build
 
@@ -218,11 +330,7 @@ int start(OTPGenApplication *a, const std::string &keychainPassword, bool create
 #endif
 
     password.clear();
-
-    // run command line operation if any
-    // FIXME: change how command line arguments are handled
-    const auto args = a->arguments();
-    exec_commandline_operation(qtargs_to_strvec(args));
+    StartupProfile::mark(session_unlocked ? "session key" : "password");
 
     // create main window
     mainWindow = new MainWindow();
@@ -233,10 +341,40 @@ int start(OTPGenApplication *a, const std::string &keychainPassword, bool create
         mainWindow->show();
         mainWindow->activateWindow();
     }
+    StartupProfile::mark("main window");
+
+    // the window is usable right away, the tokens appear once the database is unlocked
+    if (unlock)
+    {
+        // started into the tray, the snapshot gives the tray menu without decrypting the database,
+        // which is loaded once a code is requested or the window is shown
+        TokenDatabase::Snapshot snapshot;
+        if (gcfg::startMinimizedToTray() && gcfg::useTraySnapshot() &&
+            TokenDatabase::readSnapshot(gcfg::traySnapshot(), snapshot) == TokenDatabase::Success)
+        {
+            deferred = true;
+            mainWindow->setUnlocking(true);
+            mainWindow->showTraySnapshot(snapshot);
+            QObject::connect(mainWindow, &MainWindow::tokensRequested, a, [a]{
+                if (deferred)
+                {
+                    unlock_tokens(a);
+                }
+            });
+        }
+        else
+        {
+            unlock_tokens(a);
+        }
+    }
+    else
+    {
+        show_tokens(a);
+    }
 
     // process messages sent from additional instances
 #ifndef OS_WASM
-    QObject::connect(a, &OTPGenApplication::messageReceived, a, [&](const QString &message, QObject *socket){
+    QObject::connect(a, &OTPGenApplication::messageReceived, a, [a](const QString &message, QObject *socket){
         if (message.isEmpty() || message.compare("activateWindow", Qt::CaseInsensitive) == 0)
         {
             std::printf("Trying to activate window...\n");
@@ -245,11 +383,27 @@ int start(OTPGenApplication *a, const std::string &keychainPassword, bool create
         }
         else if (message.compare("reloadTokens", Qt::CaseInsensitive) == 0)
         {
+            // the database is being loaded anyway
+            if (unlocking)
+            {
+                return;
+            }
+            if (deferred)
+            {
+                unlock_tokens(a);
+                return;
+            }
+
             std::printf("Trying to reload the token database...\n");
-            if (TokenDatabase::loadTokens() == TokenDatabase::Success)
+            // only loaded again if the file changed, the list only updates the changed rows
+            auto changed = false;
+            if (TokenDatabase::reloadTokens(&changed) == TokenDatabase::Success)
             {
-                std::printf("Updated!\n");
-                //mainWindow->updateTokenList();
+                std::printf(changed ? "Updated!\n" : "Token database is unchanged.\n");
+                if (changed)
+                {
+                    mainWindow->updateTokenList();
+                }
             }
             else
             {
@@ -278,6 +432,9 @@ int main(int argc, char **argv)
 #endif
 #endif
 
+    // the flag is removed before Qt and the command line operations see the arguments
+    StartupProfile::enable(argc, argv);
+
     // use Qt's built-in style
     QApplication::setDesktopSettingsAware(false);
 
@@ -298,6 +455,7 @@ int main(int argc, char **argv)
     a.setApplicationName(gcfg::q(cfg::Name));
     a.setApplicationDisplayName(gcfg::q(cfg::Name));
     a.setApplicationVersion(gcfg::q(cfg::Version));
+    StartupProfile::mark("application");
 
     // set global application attributes
     for (auto&& attr : {
@@ -338,17 +496,37 @@ int main(int argc, char **argv)
     std::printf("path: %s\n", gcfg::path().toUtf8().constData());
     std::printf("settings: %s\n", gcfg::settings()->fileName().toUtf8().constData());
     gcfg::initDefaultSettings();
+    StartupProfile::mark("settings");
 
     // set token database path
     TokenDatabase::setTokenDatabase(gcfg::database());
 
+    // labels of a disabled snapshot must not stay on disk
+    if (!gcfg::useTraySnapshot())
+    {
+        std::remove(gcfg::traySnapshot().c_str());
+    }
+
+    // only write the changed pages on save, older databases are converted
+    TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+
+    // changes are saved in the background, closeDatabase() writes outstanding changes
+    TokenDatabase::setAutoSave(std::chrono::milliseconds(1000));
+
+    // icons are scaled into the list sizes when they are stored
+    TokenDatabase::setIconScaler(&IconCache::thumbnail, IconCache::thumbnailSizes());
+    // imported icons are scaled down and encoded compactly before they are stored
+    AppSupport::IconTranscoder::setRasterEncoder(&IconCache::normalize);
+
+    // sqlite settings shared by all frontends
+    cfg::applyDatabaseTuning();
+
 #ifdef QTKEYCHAIN_SUPPORT
 #ifdef OTPGEN_DEBUG
-    const auto keychain_service_name = a.applicationDisplayName() + "_d";
+    keychain_service_name = a.applicationDisplayName() + "_d";
 #else
-    const auto keychain_service_name = a.applicationDisplayName();
+    keychain_service_name = a.applicationDisplayName();
 #endif
-    const QString keychain_secret_key = "secret";
 
     // setup QKeychain
     receivePassword = new QKeychain::ReadPasswordJob(keychain_service_name, &a);
@@ -357,6 +535,7 @@ int main(int argc, char **argv)
     storePassword->setKey(keychain_secret_key);
 
     QObject::connect(receivePassword, &QKeychain::ReadPasswordJob::finished, &a, [&]{
+        StartupProfile::mark("keychain");
         auto error = receivePassword->error();
 
         // success, use password from keychain
@@ -404,17 +583,60 @@ int main(int argc, char **argv)
             }
         }
     });
-    receivePassword->start();
+
+    // a session key which is still valid skips the password and the key derivation
+    if (gcfg::sessionKeyLifetime() > 0 && QFileInfo(QString::fromUtf8(gcfg::database().c_str())).exists())
+    {
+        receiveSessionKey = new QKeychain::ReadPasswordJob(keychain_service_name, &a);
+        receiveSessionKey->setKey(keychain_session_key);
+        QObject::connect(receiveSessionKey, &QKeychain::ReadPasswordJob::finished, &a, [&]{
+            StartupProfile::mark("keychain session key");
+            SecureBuffer wrapping;
+            if (receiveSessionKey->error() == QKeychain::NoError &&
+                SessionKeyring::load(keyring_session_key, wrapping) &&
+                TokenDatabase::unlockWithSessionKey(SecureString(receiveSessionKey->textData().toUtf8().constData()), wrapping) == TokenDatabase::Success)
+            {
+                session_unlocked = true;
+                auto res = start(&a, "");
+                if (res != 0)
+                {
+                    qApp->exit(res);
+                }
+                return;
+            }
+            receivePassword->start();
+        });
+        receiveSessionKey->start();
+    }
+    else
+    {
+        receivePassword->start();
+    }
 #else // QTKEYCHAIN_SUPPORT
+#ifdef OS_WASM
+    // the database is copied from IndexedDB into the in-memory filesystem first,
+    // without a stored database a new one is created
+    TokenDatabase::restoreDatabaseFile([&a](const TokenDatabase::Error &) {
+        QMetaObject::invokeMethod(&a, [&a]{
+            auto res = start(&a, "");
+            if (res != 0)
+            {
+                a.exit(res);
+            }
+        }, Qt::QueuedConnection);
+    });
+#else
     auto res = start(&a, "");
     if (res != 0)
     {
         return res;
     }
+#endif
 #endif
 
     // clean up
     const auto ret = a.exec();
+    steam_time.reset();
     delete mainWindow;
     TokenDatabase::closeDatabase();
     return ret;
@@ -1,7 +1,9 @@
 #include "TokenDatabase_Old.hpp"
 #include "TokenStore_Old.hpp"
 
+#include <algorithm>
 #include <fstream>
+#include <istream>
 #include <ostream>
 #include <sstream>
 
@@ -21,10 +23,22 @@
 namespace {
     static const std::string TOKEN_ARCHIVE_MAGIC = "OTPTokenArchive";
     static const uint32_t TOKEN_ARCHIVE_VERSION = 0x02;
+
+    // reads the decrypted archive in place, without copying it into a string stream
+    class ArchiveBuffer : public std::streambuf
+    {
+    public:
+        ArchiveBuffer(const std::string &buffer)
+        {
+            auto data = const_cast<char*>(buffer.data());
+            this->setg(data, data, data + buffer.size());
+        }
+    };
 }
 
 std::string TokenDatabase_Old::password;
 std::string TokenDatabase_Old::tokenFile;
+std::string TokenDatabase_Old::archive;
 
 const std::string TokenDatabase_Old::getErrorMessage(const Error &error)
 {
@@ -95,24 +109,6 @@ TokenDatabase_Old::Error TokenDatabase_Old::changePassword(const std::string &ne
     return status;
 }
 
-struct TokenData
-{
-    OTPToken_Old::TokenType type;
-    OTPToken_Old::Label label;
-    OTPToken_Old::Icon icon;
-    OTPToken_Old::SecretType secret;
-    OTPToken_Old::DigitType digits;
-    OTPToken_Old::PeriodType period;
-    OTPToken_Old::CounterType counter;
-    OTPToken_Old::ShaAlgorithm algorithm;
-
-    template<class Archive>
-    void serialize(Archive &ar)
-    {
-        ar(type, label, icon, secret, digits, period, counter, algorithm);
-    }
-};
-
 // Container to store the entire token store in a single file.
 template<class TokenDataVersion = TokenData>
 struct TokenDataAdapter
@@ -184,6 +180,44 @@ TokenDatabase_Old::Error TokenDatabase_Old::saveTokens()
 
 TokenDatabase_Old::Error TokenDatabase_Old::loadTokens()
 {
+    auto status = openTokens();
+    if (status != Success)
+    {
+        return status;
+    }
+
+    TokenStore_Old::i()->clear();
+
+    status = readTokens([](const TokenData &t) {
+#ifdef OTPGEN_DEBUG
+        std::cout << "Loading " << t.label << std::endl;
+#endif
+
+        switch (t.type)
+        {
+            case OTPToken_Old::TOTP:
+                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<TOTPToken_Old>(t.label, t.icon, t.secret, t.digits, t.period, t.counter, t.algorithm));
+                break;
+            case OTPToken_Old::HOTP:
+                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<HOTPToken_Old>(t.label, t.icon, t.secret, t.digits, t.period, t.counter, t.algorithm));
+                break;
+            case OTPToken_Old::Steam:
+                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<SteamToken_Old>(t.label, t.icon, t.secret, t.digits, t.period, t.counter, t.algorithm));
+                break;
+            case OTPToken_Old::Authy:
+                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<AuthyToken_Old>(t.label, t.icon, t.secret, t.digits, t.period, t.counter, t.algorithm));
+                break;
+        }
+    });
+
+    closeTokens();
+    return status;
+}
+
+TokenDatabase_Old::Error TokenDatabase_Old::openTokens()
+{
+    closeTokens();
+
     // read the encrypted file
     std::string in;
     auto status = readFile(tokenFile, in);
@@ -193,71 +227,83 @@ TokenDatabase_Old::Error TokenDatabase_Old::loadTokens()
     }
 
     // decrypt the stream
-    std::string decrypted;
-    status = decrypt(password, in, decrypted);
+    status = decrypt(password, in, archive);
+    in.clear();
     if (status != Success)
     {
-        in.clear();
+        closeTokens();
         return status;
     }
 
-    // create a string stream for cereal
-    std::istringstream buffer(decrypted);
-
-#ifdef OTPGEN_DEBUG
-//    std::cout << "=== BINARY ARCHIVE BEGIN ===" << std::endl;
-//    std::cout << decrypted << std::endl;
-//    std::cout << "=== BINARY ARCHIVE END ===" << std::endl;
-#endif
+    // check the header, the tokens are decoded by readTokens()
+    ArchiveBuffer buffer(archive);
+    std::istream stream(&buffer);
+    cereal::PortableBinaryInputArchive ar(stream);
 
-    TokenDataAdapter<> data;
-    cereal::PortableBinaryInputArchive archive(buffer);
+    std::string archiveMagic;
+    uint32_t archiveVersion = 0;
     try {
-        archive(data);
-    } catch (cereal::Exception e) {
+        ar(archiveMagic, archiveVersion);
+    } catch (cereal::Exception &) {
+        closeTokens();
         return InvalidTokenFile;
     }
 
-    if (data.archiveMagic != TOKEN_ARCHIVE_MAGIC)
+    if (archiveMagic != TOKEN_ARCHIVE_MAGIC)
     {
+        closeTokens();
         return InvalidTokenFile;
     }
 
-    TokenStore_Old::i()->clear();
+    return Success;
+}
 
-    for (auto&& t : data.data)
+TokenDatabase_Old::Error TokenDatabase_Old::readTokens(const TokenCallback &callback)
+{
+    if (archive.empty())
     {
-#ifdef OTPGEN_DEBUG
-        std::cout << "Loading " << t.label << std::endl;
-#endif
+        return FileEmpty;
+    }
 
-        auto unmangledSecret = unmangleTokenSecret(t.secret);
-        t.secret.clear();
+    // same layout as TokenDataAdapter, but only one token is decoded at a time
+    ArchiveBuffer buffer(archive);
+    std::istream stream(&buffer);
+    cereal::PortableBinaryInputArchive ar(stream);
 
-        switch (t.type)
+    try {
+        std::string archiveMagic;
+        uint32_t archiveVersion = 0;
+        ar(archiveMagic, archiveVersion);
+
+        cereal::size_type count = 0;
+        ar(cereal::make_size_tag(count));
+
+        TokenData t;
+        for (cereal::size_type i = 0; i < count; ++i)
         {
-            case OTPToken_Old::TOTP:
-                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<TOTPToken_Old>(t.label, t.icon, unmangledSecret, t.digits, t.period, t.counter, t.algorithm));
-                break;
-            case OTPToken_Old::HOTP:
-                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<HOTPToken_Old>(t.label, t.icon, unmangledSecret, t.digits, t.period, t.counter, t.algorithm));
-                break;
-            case OTPToken_Old::Steam:
-                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<SteamToken_Old>(t.label, t.icon, unmangledSecret, t.digits, t.period, t.counter, t.algorithm));
-                break;
-            case OTPToken_Old::Authy:
-                TokenStore_Old::i()->addTokenUnsafe(std::make_shared<AuthyToken_Old>(t.label, t.icon, unmangledSecret, t.digits, t.period, t.counter, t.algorithm));
-                break;
+            ar(t);
+
+            // currently the token secret is only reversed
+            std::reverse(t.secret.begin(), t.secret.end());
+            callback(t);
         }
 
-        unmangledSecret.clear();
+        t.secret.clear();
+    } catch (cereal::Exception &) {
+        return InvalidTokenFile;
     }
 
-    data.data.clear();
-
     return Success;
 }
 
+void TokenDatabase_Old::closeTokens()
+{
+    // overwrite the decrypted secrets before releasing the buffer
+    std::fill(archive.begin(), archive.end(), '\0');
+    archive.clear();
+    archive.shrink_to_fit();
+}
+
 const OTPToken_Old::SecretType TokenDatabase_Old::mangleTokenSecret(const OTPToken_Old::SecretType &secret)
 {
     auto mangled = secret;
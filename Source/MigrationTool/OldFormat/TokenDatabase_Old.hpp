@@ -1,6 +1,7 @@
 #ifndef TOKENDATABASE_OLD_HPP
 #define TOKENDATABASE_OLD_HPP
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,25 @@
 
 #include "AppSupport.hpp"
 
+// token record as stored in the archive
+struct TokenData
+{
+    OTPToken_Old::TokenType type;
+    OTPToken_Old::Label label;
+    OTPToken_Old::Icon icon;
+    OTPToken_Old::SecretType secret;
+    OTPToken_Old::DigitType digits;
+    OTPToken_Old::PeriodType period;
+    OTPToken_Old::CounterType counter;
+    OTPToken_Old::ShaAlgorithm algorithm;
+
+    template<class Archive>
+    void serialize(Archive &ar)
+    {
+        ar(type, label, icon, secret, digits, period, counter, algorithm);
+    }
+};
+
 class TokenDatabase_Old
 {
     TokenDatabase_Old() = delete;
@@ -24,6 +44,9 @@ class TokenDatabase_Old
     static std::string password;
     static std::string tokenFile;
 
+    // decrypted archive of openTokens()
+    static std::string archive;
+
 public:
     enum Error {
         Success = 0,
@@ -47,6 +70,14 @@ public:
     static Error saveTokens();
     static Error loadTokens();
 
+    // streaming access without the token store, openTokens() decrypts the file and
+    // checks the archive header, readTokens() decodes the tokens one at a time into
+    // the same record and passes it to the callback with the secret already unmangled
+    using TokenCallback = std::function<void(const TokenData&)>;
+    static Error openTokens();
+    static Error readTokens(const TokenCallback &callback);
+    static void closeTokens();
+
     static bool setPassword(const std::string &password);
     static bool setTokenFile(const std::string &file);
 
@@ -6,7 +6,6 @@
 /// OLD FORMAT HEADERS
 ///
 #include <OldFormat/TokenDatabase_Old.hpp>
-#include <OldFormat/TokenStore_Old.hpp>
 
 ///
 /// NEW FORMAT HEADERS
@@ -47,7 +46,8 @@ int load_old(const std::string &path)
 
     std::cout << std::endl;
 
-    auto status = TokenDatabase_Old::loadTokens();
+    // the tokens are decoded one by one during the migration
+    auto status = TokenDatabase_Old::openTokens();
     if (status != TokenDatabase_Old::Success)
     {
         std::cerr << TokenDatabase_Old::getErrorMessage(status) << std::endl;
@@ -99,53 +99,85 @@ int init_new(const std::string &path)
 
 void do_migration()
 {
-    for (auto&& token : TokenStore_Old::i()->tokens())
+    // report progress every this many tokens
+    static const constexpr std::size_t PROGRESS_INTERVAL = 1000U;
+
+    // decode, convert and insert the tokens one at a time in a single transaction,
+    // the legacy archive is never loaded into the token store
+    std::vector<TokenDatabase::Error> results;
+    std::vector<OTPToken::Label> failed;
+    std::size_t migrated = 0U;
+    OTPToken new_token;
+    auto status = TokenDatabase::insertTokens([&](const TokenDatabase::TokenCallback &insert) {
+        const auto read = TokenDatabase_Old::readTokens([&](const TokenData &token) {
+            // type mapping changed
+            OTPToken::TokenType new_type = OTPToken::None;
+            switch (token.type)
+            {
+                case OTPToken_Old::None:  new_type = OTPToken::None; break;
+                case OTPToken_Old::TOTP:  new_type = OTPToken::TOTP; break;
+                case OTPToken_Old::HOTP:  new_type = OTPToken::HOTP; break;
+                case OTPToken_Old::Steam: new_type = OTPToken::Steam; break;
+                case OTPToken_Old::Authy: new_type = OTPToken::TOTP; break;
+            }
+
+            // algorithm mapping
+            OTPToken::ShaAlgorithm new_algo = OTPToken::Invalid;
+            switch (token.algorithm)
+            {
+                case OTPToken_Old::Invalid: new_algo = OTPToken::Invalid; break;
+                case OTPToken_Old::SHA1:    new_algo = OTPToken::SHA1; break;
+                case OTPToken_Old::SHA256:  new_algo = OTPToken::SHA256; break;
+                case OTPToken_Old::SHA512:  new_algo = OTPToken::SHA512; break;
+            }
+
+            new_token = OTPToken(
+                new_type,
+                token.label,
+                OTPToken::Icon(),
+                token.secret,
+                token.digits,
+                token.period,
+                token.counter,
+                new_algo
+            );
+
+            // icon format changed, copy the bytes straight into the new token
+            new_token.setIcon(reinterpret_cast<const unsigned char*>(token.icon.data()), token.icon.size());
+
+            insert(new_token);
+            if (results.back() != TokenDatabase::Success)
+            {
+                failed.emplace_back(token.label);
+            }
+
+            if (++migrated % PROGRESS_INTERVAL == 0)
+            {
+                std::cout << "migrated " << migrated << " tokens" << std::endl;
+            }
+        });
+
+        return read == TokenDatabase_Old::Success ? TokenDatabase::Success : TokenDatabase::InvalidTokenFile;
+    }, &results);
+
+    new_token = OTPToken();
+    TokenDatabase_Old::closeTokens();
+
+    if (status != TokenDatabase::Success)
+    {
+        std::cerr << TokenDatabase::getErrorMessage(status) << std::endl;
+        return;
+    }
+
+    std::cout << "migrated " << migrated << " tokens" << std::endl;
+
+    // inform user about failed/skipped tokens
+    for (auto&& label : failed)
     {
-        // type mapping changed
-        OTPToken::TokenType new_type;
-        switch (token->type())
-        {
-            case OTPToken_Old::None:  new_type = OTPToken::None; break;
-            case OTPToken_Old::TOTP:  new_type = OTPToken::TOTP; break;
-            case OTPToken_Old::HOTP:  new_type = OTPToken::HOTP; break;
-            case OTPToken_Old::Steam: new_type = OTPToken::Steam; break;
-            case OTPToken_Old::Authy: new_type = OTPToken::TOTP; break;
-        }
-
-        // algorithm mapping
-        OTPToken::ShaAlgorithm new_algo;
-        switch (token->algorithm())
-        {
-            case OTPToken_Old::Invalid: new_algo = OTPToken::Invalid; break;
-            case OTPToken_Old::SHA1:    new_algo = OTPToken::SHA1; break;
-            case OTPToken_Old::SHA256:  new_algo = OTPToken::SHA256; break;
-            case OTPToken_Old::SHA512:  new_algo = OTPToken::SHA512; break;
-        }
-
-        // icon format changed
-        const auto old_icon = reinterpret_cast<const unsigned char*>(token->icon().data());
-        OTPToken::Icon new_icon(old_icon, old_icon + token->icon().size());
-
-        // insert migrated token
-        auto status = TokenDatabase::insertToken(OTPToken(
-            new_type,
-            token->label(),
-            new_icon,
-            token->secret(),
-            token->digits(),
-            token->period(),
-            token->counter(),
-            new_algo
-        ));
-
-        // check for errors and inform user about failed/skipped tokens
-        if (status != TokenDatabase::Success)
-        {
-            std::cerr << "failed to insert: " << token->label() << std::endl;
-        }
+        std::cerr << "failed to insert: " << label << std::endl;
     }
 
-    auto status = TokenDatabase::saveTokens();
+    status = TokenDatabase::saveTokens();
     if (status != TokenDatabase::Success)
     {
         std::cerr << TokenDatabase::getErrorMessage(status) << std::endl;
@@ -0,0 +1,599 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <OTPGenC.h>
+
+#include <cstdint>
+#include <cstring>
+
+// Python interface over the C interface of libotpgen
+//
+//   import otpgen, numpy
+//   key = otpgen.Key("XYZA123456KDDK83D")
+//   otpgen.totp(key, 1536573862)
+//   codes = otpgen.totp_span(key, numpy.arange(0, 86400 * 365, 30, dtype=numpy.int64))
+//   numpy.frombuffer(codes, dtype="S11")                     # one code per item
+//
+//   keys = otpgen.KeyList([key, ...])
+//   codes = otpgen.totp_batch(keys, 1536573862, pool=otpgen.Pool())
+//   matched = otpgen.verify_batch(keys, codes, 1536573862)   # one byte per key
+//
+// arrays are read and written through the buffer protocol, times are int64 and codes are
+// NUL-padded slots of CODE_SIZE bytes, the GIL is released while codes are computed
+
+namespace {
+    struct KeyObject {
+        PyObject_HEAD
+        otpgen_key *key;
+    };
+
+    struct KeyListObject {
+        PyObject_HEAD
+        otpgen_key_list *list;
+    };
+
+    struct PoolObject {
+        PyObject_HEAD
+        otpgen_pool *pool;
+    };
+
+    static PyObject *error_type = nullptr;
+
+    static PyObject *raise(int status)
+    {
+        if (status == OTPGEN_OUT_OF_MEMORY)
+        {
+            return PyErr_NoMemory();
+        }
+        PyObject *args = Py_BuildValue("(is)", status, otpgen_status_message(status));
+        if (args)
+        {
+            PyErr_SetObject(error_type, args);
+            Py_DECREF(args);
+        }
+        return nullptr;
+    }
+
+    // buffers are released when the view goes out of scope
+    struct Buffer {
+        Py_buffer view = {};
+        bool held = false;
+
+        ~Buffer()
+        {
+            if (this->held)
+            {
+                PyBuffer_Release(&this->view);
+            }
+        }
+
+        bool get(PyObject *object, int flags)
+        {
+            this->held = PyObject_GetBuffer(object, &this->view, flags) == 0;
+            return this->held;
+        }
+    };
+
+    // int64 items in native byte order, like numpy.int64 arrays and array('q')
+    static bool timesBuffer(PyObject *object, Buffer &buffer)
+    {
+        if (!buffer.get(object, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT))
+        {
+            return false;
+        }
+        const char *format = buffer.view.format ? buffer.view.format : "B";
+        if (*format == '@' || *format == '=' || (*format == '<' && PY_LITTLE_ENDIAN) || (*format == '>' && !PY_LITTLE_ENDIAN))
+        {
+            ++format;
+        }
+        if (buffer.view.itemsize != 8 || (std::strcmp(format, "q") != 0 && std::strcmp(format, "l") != 0))
+        {
+            PyErr_SetString(PyExc_TypeError, "times must be a contiguous array of int64");
+            return false;
+        }
+        return true;
+    }
+
+    // a writable buffer of the given size or a new bytearray
+    static PyObject *outputBuffer(PyObject *out, Py_ssize_t size, Buffer &buffer)
+    {
+        if (out && out != Py_None)
+        {
+            if (!buffer.get(out, PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE))
+            {
+                return nullptr;
+            }
+            if (buffer.view.len < size)
+            {
+                PyErr_SetString(PyExc_ValueError, "out is too small for the codes");
+                return nullptr;
+            }
+            Py_INCREF(out);
+            return out;
+        }
+
+        PyObject *array = PyByteArray_FromStringAndSize(nullptr, size);
+        if (array && !buffer.get(array, PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE))
+        {
+            Py_DECREF(array);
+            return nullptr;
+        }
+        return array;
+    }
+
+    // Key
+
+    static PyTypeObject KeyType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    static int Key_init(KeyObject *self, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"secret", "algorithm", "raw", nullptr};
+        Py_buffer secret = {};
+        unsigned algorithm = OTPGEN_SHA1;
+        int raw = 0;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s*|Ip", const_cast<char**>(keywords), &secret, &algorithm, &raw))
+        {
+            return -1;
+        }
+
+        otpgen_key *key = nullptr;
+        const auto status = raw ? otpgen_prepare_raw_key(static_cast<const unsigned char*>(secret.buf), static_cast<std::size_t>(secret.len), algorithm, &key)
+                                : otpgen_prepare_key(static_cast<const char*>(secret.buf), static_cast<std::size_t>(secret.len), algorithm, &key);
+        PyBuffer_Release(&secret);
+        if (status != OTPGEN_OK)
+        {
+            raise(status);
+            return -1;
+        }
+        otpgen_free_key(self->key);
+        self->key = key;
+        return 0;
+    }
+
+    static void Key_dealloc(KeyObject *self)
+    {
+        otpgen_free_key(self->key);
+        Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+    }
+
+    static const otpgen_key *keyOf(PyObject *object)
+    {
+        if (!PyObject_TypeCheck(object, &KeyType) || !reinterpret_cast<KeyObject*>(object)->key)
+        {
+            PyErr_SetString(PyExc_TypeError, "expected an otpgen.Key");
+            return nullptr;
+        }
+        return reinterpret_cast<KeyObject*>(object)->key;
+    }
+
+    // KeyList
+
+    static PyTypeObject KeyListType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    static int KeyList_init(KeyListObject *self, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"keys", nullptr};
+        PyObject *keys = nullptr;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", const_cast<char**>(keywords), &keys))
+        {
+            return -1;
+        }
+
+        otpgen_free_key_list(self->list);
+        self->list = otpgen_key_list_new();
+        if (!self->list)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (!keys)
+        {
+            return 0;
+        }
+
+        PyObject *iterator = PyObject_GetIter(keys);
+        if (!iterator)
+        {
+            return -1;
+        }
+        for (PyObject *item = PyIter_Next(iterator); item; item = PyIter_Next(iterator))
+        {
+            const auto key = keyOf(item);
+            const auto status = key ? otpgen_key_list_add(self->list, key, nullptr) : OTPGEN_OK;
+            Py_DECREF(item);
+            if (!key || status != OTPGEN_OK)
+            {
+                Py_DECREF(iterator);
+                if (key) raise(status);
+                return -1;
+            }
+        }
+        Py_DECREF(iterator);
+        return PyErr_Occurred() ? -1 : 0;
+    }
+
+    static PyObject *KeyList_append(KeyListObject *self, PyObject *object)
+    {
+        const auto key = keyOf(object);
+        if (!key)
+        {
+            return nullptr;
+        }
+        std::size_t index = 0U;
+        const auto status = otpgen_key_list_add(self->list, key, &index);
+        if (status != OTPGEN_OK)
+        {
+            return raise(status);
+        }
+        return PyLong_FromSize_t(index);
+    }
+
+    static Py_ssize_t KeyList_length(KeyListObject *self)
+    {
+        return static_cast<Py_ssize_t>(otpgen_key_list_size(self->list));
+    }
+
+    static void KeyList_dealloc(KeyListObject *self)
+    {
+        otpgen_free_key_list(self->list);
+        Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+    }
+
+    static PyMethodDef KeyList_methods[] = {
+        {"append", reinterpret_cast<PyCFunction>(KeyList_append), METH_O, "add a key, returns its index"},
+        {nullptr, nullptr, 0, nullptr},
+    };
+
+    static PySequenceMethods KeyList_sequence = {};
+
+    static const otpgen_key_list *keyListOf(PyObject *object)
+    {
+        if (!PyObject_TypeCheck(object, &KeyListType) || !reinterpret_cast<KeyListObject*>(object)->list)
+        {
+            PyErr_SetString(PyExc_TypeError, "expected an otpgen.KeyList");
+            return nullptr;
+        }
+        return reinterpret_cast<KeyListObject*>(object)->list;
+    }
+
+    // Pool
+
+    static PyTypeObject PoolType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+    static int Pool_init(PoolObject *self, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"threads", nullptr};
+        Py_ssize_t threads = 0;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|n", const_cast<char**>(keywords), &threads))
+        {
+            return -1;
+        }
+        if (threads < 0)
+        {
+            PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+            return -1;
+        }
+        otpgen_free_pool(self->pool);
+        self->pool = otpgen_pool_new(static_cast<std::size_t>(threads));
+        if (!self->pool)
+        {
+            PyErr_SetString(PyExc_RuntimeError, "unable to start the worker threads");
+            return -1;
+        }
+        return 0;
+    }
+
+    static void Pool_dealloc(PoolObject *self)
+    {
+        otpgen_free_pool(self->pool);
+        Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+    }
+
+    static otpgen_pool *poolOf(PyObject *pool)
+    {
+        if (!pool || pool == Py_None)
+        {
+            return nullptr;
+        }
+        if (!PyObject_TypeCheck(pool, &PoolType))
+        {
+            PyErr_SetString(PyExc_TypeError, "expected an otpgen.Pool");
+            return nullptr;
+        }
+        return reinterpret_cast<PoolObject*>(pool)->pool;
+    }
+
+    // functions
+
+    static PyObject *totp(PyObject*, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"key", "time", "digits", "period", nullptr};
+        PyObject *object = nullptr;
+        long long time = 0;
+        unsigned digits = 6U, period = 30U;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OL|II", const_cast<char**>(keywords), &object, &time, &digits, &period))
+        {
+            return nullptr;
+        }
+        const auto key = keyOf(object);
+        if (!key)
+        {
+            return nullptr;
+        }
+
+        char code[OTPGEN_CODE_SIZE];
+        const auto status = otpgen_totp(key, time, digits, period, code);
+        if (status != OTPGEN_OK)
+        {
+            return raise(status);
+        }
+        return PyUnicode_FromString(code);
+    }
+
+    static PyObject *hotp(PyObject*, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"key", "counter", "digits", nullptr};
+        PyObject *object = nullptr;
+        unsigned long long counter = 0U;
+        unsigned digits = 6U;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OK|I", const_cast<char**>(keywords), &object, &counter, &digits))
+        {
+            return nullptr;
+        }
+        const auto key = keyOf(object);
+        if (!key)
+        {
+            return nullptr;
+        }
+
+        char code[OTPGEN_CODE_SIZE];
+        const auto status = otpgen_hotp(key, counter, digits, code);
+        if (status != OTPGEN_OK)
+        {
+            return raise(status);
+        }
+        return PyUnicode_FromString(code);
+    }
+
+    static PyObject *totp_span(PyObject*, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"key", "times", "digits", "period", "out", nullptr};
+        PyObject *object = nullptr, *timesObject = nullptr, *outObject = nullptr;
+        unsigned digits = 6U, period = 30U;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|IIO", const_cast<char**>(keywords), &object, &timesObject, &digits, &period, &outObject))
+        {
+            return nullptr;
+        }
+        const auto key = keyOf(object);
+        Buffer times;
+        if (!key || !timesBuffer(timesObject, times))
+        {
+            return nullptr;
+        }
+
+        const auto count = static_cast<std::size_t>(times.view.len / 8);
+        Buffer codes;
+        PyObject *out = outputBuffer(outObject, static_cast<Py_ssize_t>(count * OTPGEN_CODE_SIZE), codes);
+        if (!out)
+        {
+            return nullptr;
+        }
+
+        int status = OTPGEN_OK;
+        Py_BEGIN_ALLOW_THREADS
+        status = otpgen_totp_span(key, static_cast<const std::int64_t*>(times.view.buf), count, digits, period,
+                                  static_cast<char*>(codes.view.buf), static_cast<std::size_t>(codes.view.len));
+        Py_END_ALLOW_THREADS
+        if (status != OTPGEN_OK)
+        {
+            Py_DECREF(out);
+            return raise(status);
+        }
+        return out;
+    }
+
+    static PyObject *totp_batch(PyObject*, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"keys", "time", "digits", "period", "out", "pool", nullptr};
+        PyObject *object = nullptr, *outObject = nullptr, *poolObject = nullptr;
+        long long time = 0;
+        unsigned digits = 6U, period = 30U;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OL|IIOO", const_cast<char**>(keywords),
+                                         &object, &time, &digits, &period, &outObject, &poolObject))
+        {
+            return nullptr;
+        }
+        const auto keys = keyListOf(object);
+        const auto pool = poolOf(poolObject);
+        if (!keys || PyErr_Occurred())
+        {
+            return nullptr;
+        }
+
+        const auto count = otpgen_key_list_size(keys);
+        Buffer codes;
+        PyObject *out = outputBuffer(outObject, static_cast<Py_ssize_t>(count * OTPGEN_CODE_SIZE), codes);
+        if (!out)
+        {
+            return nullptr;
+        }
+
+        int status = OTPGEN_OK;
+        Py_BEGIN_ALLOW_THREADS
+        status = otpgen_totp_batch(keys, time, digits, period, static_cast<char*>(codes.view.buf),
+                                   static_cast<std::size_t>(codes.view.len), nullptr, pool);
+        Py_END_ALLOW_THREADS
+        if (status != OTPGEN_OK)
+        {
+            Py_DECREF(out);
+            return raise(status);
+        }
+        return out;
+    }
+
+    static PyObject *verify(PyObject*, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"key", "code", "time", "window", "digits", "period", nullptr};
+        PyObject *object = nullptr;
+        const char *code = nullptr;
+        Py_ssize_t size = 0;
+        long long time = 0;
+        unsigned window = 1U, digits = 6U, period = 30U;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os#L|III", const_cast<char**>(keywords),
+                                         &object, &code, &size, &time, &window, &digits, &period))
+        {
+            return nullptr;
+        }
+        const auto key = keyOf(object);
+        if (!key)
+        {
+            return nullptr;
+        }
+
+        int step = 0;
+        const auto status = otpgen_verify(key, code, static_cast<std::size_t>(size), time, window, digits, period, &step);
+        if (status == OTPGEN_NO_MATCH)
+        {
+            Py_RETURN_NONE;
+        }
+        if (status != OTPGEN_OK)
+        {
+            return raise(status);
+        }
+        return PyLong_FromLong(step);
+    }
+
+    static PyObject *verify_batch(PyObject*, PyObject *args, PyObject *kwargs)
+    {
+        static const char *keywords[] = {"keys", "codes", "time", "window", "digits", "period", "pool", nullptr};
+        PyObject *object = nullptr, *codesObject = nullptr, *poolObject = nullptr;
+        long long time = 0;
+        unsigned window = 1U, digits = 6U, period = 30U;
+        if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOL|IIIO", const_cast<char**>(keywords),
+                                         &object, &codesObject, &time, &window, &digits, &period, &poolObject))
+        {
+            return nullptr;
+        }
+        const auto keys = keyListOf(object);
+        const auto pool = poolOf(poolObject);
+        Buffer codes;
+        if (!keys || PyErr_Occurred() || !codes.get(codesObject, PyBUF_C_CONTIGUOUS))
+        {
+            return nullptr;
+        }
+
+        const auto count = otpgen_key_list_size(keys);
+        if (static_cast<std::size_t>(codes.view.len) < count * OTPGEN_CODE_SIZE)
+        {
+            PyErr_SetString(PyExc_ValueError, "codes must hold a slot of CODE_SIZE bytes per key");
+            return nullptr;
+        }
+        Buffer matched;
+        PyObject *out = outputBuffer(nullptr, static_cast<Py_ssize_t>(count), matched);
+        if (!out)
+        {
+            return nullptr;
+        }
+
+        int status = OTPGEN_OK;
+        Py_BEGIN_ALLOW_THREADS
+        status = otpgen_verify_batch(keys, static_cast<const char*>(codes.view.buf), static_cast<std::size_t>(codes.view.len),
+                                     time, window, digits, period, static_cast<std::uint8_t*>(matched.view.buf), pool);
+        Py_END_ALLOW_THREADS
+        if (status != OTPGEN_OK)
+        {
+            Py_DECREF(out);
+            return raise(status);
+        }
+        return out;
+    }
+
+    static PyMethodDef methods[] = {
+        {"totp", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(totp)), METH_VARARGS | METH_KEYWORDS,
+         "totp(key, time, digits=6, period=30) -> str"},
+        {"hotp", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(hotp)), METH_VARARGS | METH_KEYWORDS,
+         "hotp(key, counter, digits=6) -> str"},
+        {"totp_span", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(totp_span)), METH_VARARGS | METH_KEYWORDS,
+         "totp_span(key, times, digits=6, period=30, out=None) -> codes of the int64 times"},
+        {"totp_batch", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(totp_batch)), METH_VARARGS | METH_KEYWORDS,
+         "totp_batch(keys, time, digits=6, period=30, out=None, pool=None) -> codes of all keys"},
+        {"verify", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(verify)), METH_VARARGS | METH_KEYWORDS,
+         "verify(key, code, time, window=1, digits=6, period=30) -> matched step or None"},
+        {"verify_batch", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(verify_batch)), METH_VARARGS | METH_KEYWORDS,
+         "verify_batch(keys, codes, time, window=1, digits=6, period=30, pool=None) -> 1 or 0 per key"},
+        {nullptr, nullptr, 0, nullptr},
+    };
+
+    static PyModuleDef module = {
+        PyModuleDef_HEAD_INIT, "otpgen", "OTP code generation of libotpgen", -1, methods,
+        nullptr, nullptr, nullptr, nullptr,
+    };
+
+    static bool addType(PyObject *target, PyTypeObject &type, const char *name)
+    {
+        if (PyType_Ready(&type) < 0)
+        {
+            return false;
+        }
+        Py_INCREF(&type);
+        if (PyModule_AddObject(target, name, reinterpret_cast<PyObject*>(&type)) < 0)
+        {
+            Py_DECREF(&type);
+            return false;
+        }
+        return true;
+    }
+}
+
+PyMODINIT_FUNC PyInit_otpgen(void)
+{
+    KeyType.tp_name = "otpgen.Key";
+    KeyType.tp_doc = "Key(secret, algorithm=SHA1, raw=False), a prepared secret";
+    KeyType.tp_basicsize = sizeof(KeyObject);
+    KeyType.tp_flags = Py_TPFLAGS_DEFAULT;
+    KeyType.tp_new = PyType_GenericNew;
+    KeyType.tp_init = reinterpret_cast<initproc>(Key_init);
+    KeyType.tp_dealloc = reinterpret_cast<destructor>(Key_dealloc);
+
+    KeyList_sequence.sq_length = reinterpret_cast<lenfunc>(KeyList_length);
+    KeyListType.tp_name = "otpgen.KeyList";
+    KeyListType.tp_doc = "KeyList(keys=()), prepared keys for the batch functions";
+    KeyListType.tp_basicsize = sizeof(KeyListObject);
+    KeyListType.tp_flags = Py_TPFLAGS_DEFAULT;
+    KeyListType.tp_new = PyType_GenericNew;
+    KeyListType.tp_init = reinterpret_cast<initproc>(KeyList_init);
+    KeyListType.tp_dealloc = reinterpret_cast<destructor>(KeyList_dealloc);
+    KeyListType.tp_methods = KeyList_methods;
+    KeyListType.tp_as_sequence = &KeyList_sequence;
+
+    PoolType.tp_name = "otpgen.Pool";
+    PoolType.tp_doc = "Pool(threads=0), worker threads for the batch functions";
+    PoolType.tp_basicsize = sizeof(PoolObject);
+    PoolType.tp_flags = Py_TPFLAGS_DEFAULT;
+    PoolType.tp_new = PyType_GenericNew;
+    PoolType.tp_init = reinterpret_cast<initproc>(Pool_init);
+    PoolType.tp_dealloc = reinterpret_cast<destructor>(Pool_dealloc);
+
+    PyObject *target = PyModule_Create(&module);
+    if (!target)
+    {
+        return nullptr;
+    }
+
+    // the module owns one reference, the other one is kept for raise()
+    error_type = PyErr_NewException("otpgen.Error", nullptr, nullptr);
+    Py_XINCREF(error_type);
+    if (!error_type || PyModule_AddObject(target, "Error", error_type) < 0 ||
+        !addType(target, KeyType, "Key") || !addType(target, KeyListType, "KeyList") || !addType(target, PoolType, "Pool"))
+    {
+        Py_DECREF(target);
+        return nullptr;
+    }
+
+    PyModule_AddIntConstant(target, "SHA1", OTPGEN_SHA1);
+    PyModule_AddIntConstant(target, "SHA256", OTPGEN_SHA256);
+    PyModule_AddIntConstant(target, "SHA512", OTPGEN_SHA512);
+    PyModule_AddIntConstant(target, "CODE_SIZE", OTPGEN_CODE_SIZE);
+    PyModule_AddIntConstant(target, "ABI_VERSION", static_cast<long>(otpgen_abi_version()));
+    return target;
+}
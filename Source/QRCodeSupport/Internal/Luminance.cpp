@@ -0,0 +1,271 @@
+#include "Luminance.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OTPGEN_LUMA_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__)
+#define OTPGEN_LUMA_NEON
+#include <arm_neon.h>
+#endif
+
+namespace Internal {
+
+namespace {
+    static const constexpr unsigned WEIGHT_R = 306U;
+    static const constexpr unsigned WEIGHT_G = 601U;
+    static const constexpr unsigned WEIGHT_B = 117U;
+
+    static inline std::uint8_t luma(unsigned r, unsigned g, unsigned b)
+    {
+        return static_cast<std::uint8_t>((WEIGHT_R * r + WEIGHT_G * g + WEIGHT_B * b + 0x200U) >> 10);
+    }
+
+    static void luma_portable(const std::uint8_t *pixels, std::uint8_t *out, int width, int bytes, bool bgr)
+    {
+        const auto r = bgr ? 2 : 0;
+        const auto b = bgr ? 0 : 2;
+        for (auto x = 0; x < width; ++x, pixels += bytes)
+        {
+            out[x] = luma(pixels[r], pixels[1], pixels[b]);
+        }
+    }
+
+#ifdef OTPGEN_LUMA_X86
+    // 4 pixels of 4 bytes into 4 sums, madd pairs the weights with R, G and B, A
+    __attribute__((target("sse2")))
+    static inline __m128i luma4_sse2(const std::uint8_t *pixels, const __m128i &weights)
+    {
+        const auto zero = _mm_setzero_si128();
+        const auto px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+        auto lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), weights);
+        auto hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), weights);
+        lo = _mm_shuffle_epi32(_mm_add_epi32(lo, _mm_srli_epi64(lo, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+        hi = _mm_shuffle_epi32(_mm_add_epi32(hi, _mm_srli_epi64(hi, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+        const auto sum = _mm_unpacklo_epi64(lo, hi);
+        return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(0x200)), 10);
+    }
+
+    __attribute__((target("sse2")))
+    static void luma_sse2(const std::uint8_t *pixels, std::uint8_t *out, int width, int bytes, bool bgr)
+    {
+        auto x = 0;
+        if (bytes == 4)
+        {
+            const auto weights = bgr ? _mm_setr_epi16(WEIGHT_B, WEIGHT_G, WEIGHT_R, 0, WEIGHT_B, WEIGHT_G, WEIGHT_R, 0)
+                                     : _mm_setr_epi16(WEIGHT_R, WEIGHT_G, WEIGHT_B, 0, WEIGHT_R, WEIGHT_G, WEIGHT_B, 0);
+            for (; x + 16 <= width; x += 16)
+            {
+                const auto p = pixels + x * 4;
+                const auto a = luma4_sse2(p, weights);
+                const auto b = luma4_sse2(p + 16, weights);
+                const auto c = luma4_sse2(p + 32, weights);
+                const auto d = luma4_sse2(p + 48, weights);
+                const auto bytes16 = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), bytes16);
+            }
+        }
+        luma_portable(pixels + x * bytes, out + x, width - x, bytes, bgr);
+    }
+
+    __attribute__((target("avx2")))
+    static inline __m256i luma8_avx2(const std::uint8_t *pixels, const __m256i &weights)
+    {
+        const auto zero = _mm256_setzero_si256();
+        const auto px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels));
+        auto lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), weights);
+        auto hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), weights);
+        lo = _mm256_shuffle_epi32(_mm256_add_epi32(lo, _mm256_srli_epi64(lo, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+        hi = _mm256_shuffle_epi32(_mm256_add_epi32(hi, _mm256_srli_epi64(hi, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+        // pixels 0-3 and 4-7 in the two lanes, in order
+        const auto sum = _mm256_unpacklo_epi64(lo, hi);
+        return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(0x200)), 10);
+    }
+
+    __attribute__((target("avx2")))
+    static void luma_avx2(const std::uint8_t *pixels, std::uint8_t *out, int width, int bytes, bool bgr)
+    {
+        auto x = 0;
+        if (bytes == 4)
+        {
+            const auto weights = bgr ? _mm256_setr_epi16(WEIGHT_B, WEIGHT_G, WEIGHT_R, 0, WEIGHT_B, WEIGHT_G, WEIGHT_R, 0,
+                                                         WEIGHT_B, WEIGHT_G, WEIGHT_R, 0, WEIGHT_B, WEIGHT_G, WEIGHT_R, 0)
+                                     : _mm256_setr_epi16(WEIGHT_R, WEIGHT_G, WEIGHT_B, 0, WEIGHT_R, WEIGHT_G, WEIGHT_B, 0,
+                                                         WEIGHT_R, WEIGHT_G, WEIGHT_B, 0, WEIGHT_R, WEIGHT_G, WEIGHT_B, 0);
+            // the packs work per lane, the permutation puts the groups of 4 pixels back in order
+            const auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            for (; x + 32 <= width; x += 32)
+            {
+                const auto p = pixels + x * 4;
+                const auto a = luma8_avx2(p, weights);
+                const auto b = luma8_avx2(p + 32, weights);
+                const auto c = luma8_avx2(p + 64, weights);
+                const auto d = luma8_avx2(p + 96, weights);
+                const auto bytes32 = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_permutevar8x32_epi32(bytes32, order));
+            }
+            _mm256_zeroupper();
+        }
+        luma_sse2(pixels + x * bytes, out + x, width - x, bytes, bgr);
+    }
+#endif
+
+#ifdef OTPGEN_LUMA_NEON
+    static inline uint8x8_t luma8_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+    {
+        const auto r16 = vmovl_u8(r);
+        const auto g16 = vmovl_u8(g);
+        const auto b16 = vmovl_u8(b);
+        auto lo = vmull_n_u16(vget_low_u16(r16), WEIGHT_R);
+        lo = vmlal_n_u16(lo, vget_low_u16(g16), WEIGHT_G);
+        lo = vmlal_n_u16(lo, vget_low_u16(b16), WEIGHT_B);
+        auto hi = vmull_n_u16(vget_high_u16(r16), WEIGHT_R);
+        hi = vmlal_n_u16(hi, vget_high_u16(g16), WEIGHT_G);
+        hi = vmlal_n_u16(hi, vget_high_u16(b16), WEIGHT_B);
+        // rounding shift, adds 1 << 9 first
+        return vmovn_u16(vcombine_u16(vrshrn_n_u32(lo, 10), vrshrn_n_u32(hi, 10)));
+    }
+
+    static void luma_neon(const std::uint8_t *pixels, std::uint8_t *out, int width, int bytes, bool bgr)
+    {
+        auto x = 0;
+        for (; x + 16 <= width; x += 16)
+        {
+            uint8x16_t c0, c1, c2;
+            if (bytes == 4)
+            {
+                const auto px = vld4q_u8(pixels + x * 4);
+                c0 = px.val[0];
+                c1 = px.val[1];
+                c2 = px.val[2];
+            }
+            else
+            {
+                const auto px = vld3q_u8(pixels + x * 3);
+                c0 = px.val[0];
+                c1 = px.val[1];
+                c2 = px.val[2];
+            }
+            const auto r = bgr ? c2 : c0;
+            const auto b = bgr ? c0 : c2;
+            const auto lo = luma8_neon(vget_low_u8(r), vget_low_u8(c1), vget_low_u8(b));
+            const auto hi = luma8_neon(vget_high_u8(r), vget_high_u8(c1), vget_high_u8(b));
+            vst1q_u8(out + x, vcombine_u8(lo, hi));
+        }
+        luma_portable(pixels + x * bytes, out + x, width - x, bytes, bgr);
+    }
+#endif
+
+    static bool backend_supported(const LumaBackend &backend)
+    {
+        switch (backend)
+        {
+            case LumaBackend::Portable:
+                return true;
+#ifdef OTPGEN_LUMA_X86
+            case LumaBackend::SSE2:
+                return __builtin_cpu_supports("sse2");
+            case LumaBackend::AVX2:
+                return __builtin_cpu_supports("avx2");
+#endif
+#ifdef OTPGEN_LUMA_NEON
+            case LumaBackend::NEON:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    static LumaBackend detect_backend()
+    {
+        for (auto&& backend : {LumaBackend::AVX2, LumaBackend::SSE2, LumaBackend::NEON})
+        {
+            if (backend_supported(backend))
+            {
+                return backend;
+            }
+        }
+        return LumaBackend::Portable;
+    }
+
+    // constant initialized, concurrent detections store the same value
+    static std::atomic<int> selected_backend{-1};
+}
+
+LumaBackend lumaBackend()
+{
+    auto backend = selected_backend.load(std::memory_order_relaxed);
+    if (backend < 0)
+    {
+        backend = static_cast<int>(detect_backend());
+        selected_backend.store(backend, std::memory_order_relaxed);
+    }
+    return static_cast<LumaBackend>(backend);
+}
+
+bool setLumaBackend(const LumaBackend &backend)
+{
+    if (!backend_supported(backend))
+    {
+        return false;
+    }
+
+    selected_backend.store(static_cast<int>(backend), std::memory_order_relaxed);
+    return true;
+}
+
+void lumaRow(const std::uint8_t *pixels, std::uint8_t *out, int width, int bytes, bool bgr)
+{
+    switch (lumaBackend())
+    {
+#ifdef OTPGEN_LUMA_X86
+        case LumaBackend::AVX2: luma_avx2(pixels, out, width, bytes, bgr); return;
+        case LumaBackend::SSE2: luma_sse2(pixels, out, width, bytes, bgr); return;
+#endif
+#ifdef OTPGEN_LUMA_NEON
+        case LumaBackend::NEON: luma_neon(pixels, out, width, bytes, bgr); return;
+#endif
+        default: luma_portable(pixels, out, width, bytes, bgr); return;
+    }
+}
+
+void downscale(const std::uint8_t *in, int width, int height, int factor, std::uint8_t *out)
+{
+    const auto scaledWidth = width / factor;
+    const auto scaledHeight = height / factor;
+    const auto area = static_cast<unsigned>(factor * factor);
+
+    // whole input rows are summed first, that loop has no dependencies and vectorizes
+    std::vector<unsigned> columns(static_cast<std::size_t>(scaledWidth * factor));
+    for (auto y = 0; y < scaledHeight; ++y)
+    {
+        std::fill(columns.begin(), columns.end(), 0U);
+        for (auto dy = 0; dy < factor; ++dy)
+        {
+            const auto row = in + static_cast<std::size_t>(y * factor + dy) * static_cast<std::size_t>(width);
+            for (std::size_t x = 0; x < columns.size(); ++x)
+            {
+                columns[x] += row[x];
+            }
+        }
+
+        auto target = out + static_cast<std::size_t>(y) * static_cast<std::size_t>(scaledWidth);
+        for (auto x = 0; x < scaledWidth; ++x)
+        {
+            auto sum = 0U;
+            for (auto dx = 0; dx < factor; ++dx)
+            {
+                sum += columns[static_cast<std::size_t>(x * factor + dx)];
+            }
+            target[x] = static_cast<std::uint8_t>((sum + area / 2U) / area);
+        }
+    }
+}
+
+}
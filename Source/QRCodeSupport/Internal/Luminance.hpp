@@ -0,0 +1,43 @@
+#ifndef INTERNAL_LUMINANCE_HPP
+#define INTERNAL_LUMINANCE_HPP
+
+// luminance conversion of decoded images before binarization
+//
+// the backend is selected at runtime depending on the CPU features
+//
+//  -> AVX2:     32 pixels per step (x86)
+//  -> SSE2:     16 pixels per step (x86)
+//  -> NEON:     16 pixels per step (AArch64)
+//  -> Portable: one pixel per step
+//
+// every backend computes (306 R + 601 G + 117 B + 512) >> 10 exactly,
+// the weights of the zxing image reader
+
+#include <cstdint>
+
+namespace Internal {
+
+enum class LumaBackend {
+    Portable,
+    SSE2,
+    AVX2,
+    NEON,
+};
+
+// backend selected for this CPU
+LumaBackend lumaBackend();
+
+// force a specific backend, returns false if the CPU doesn't support it
+bool setLumaBackend(const LumaBackend &backend);
+
+// converts width pixels of 3 or 4 bytes (the fourth byte is ignored),
+// with bgr the blue channel comes first
+void lumaRow(const std::uint8_t *pixels, std::uint8_t *out, int width, int bytes, bool bgr);
+
+// box filter, every side is divided by factor and the remainder is cut off,
+// out receives (width / factor) * (height / factor) rounded averages
+void downscale(const std::uint8_t *in, int width, int height, int factor, std::uint8_t *out);
+
+}
+
+#endif // INTERNAL_LUMINANCE_HPP
@@ -0,0 +1,223 @@
+#include <QRCode.hpp>
+#include <QRCodeModule.hpp>
+#include <QRCodeSheet.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+// QRCode and QRCodeSheet of applications which load the QR code support library on first use,
+// the library and zxing aren't mapped or relocated at startup unless QR codes are used
+
+namespace {
+    // directory of the running executable, empty if unknown
+    static std::string executableDirectory()
+    {
+        std::string path(4096U, '\0');
+#ifdef __APPLE__
+        auto size = static_cast<std::uint32_t>(path.size());
+        if (_NSGetExecutablePath(&path[0], &size) != 0)
+        {
+            return {};
+        }
+        path.resize(std::char_traits<char>::length(path.c_str()));
+#else
+        const auto length = ::readlink("/proc/self/exe", &path[0], path.size());
+        if (length <= 0 || static_cast<std::size_t>(length) >= path.size())
+        {
+            return {};
+        }
+        path.resize(static_cast<std::size_t>(length));
+#endif
+        const auto slash = path.rfind('/');
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1U);
+    }
+
+    static const QRCodeModule *load()
+    {
+        // an explicit path, next to the executable, the library folder of the build tree and of the
+        // installation, then the search path of the dynamic linker
+        std::vector<std::string> candidates;
+        if (const auto path = std::getenv("OTPGEN_QRCODE_MODULE"))
+        {
+            candidates.emplace_back(path);
+        }
+        const auto directory = executableDirectory();
+        if (!directory.empty())
+        {
+            candidates.emplace_back(directory + OTPGEN_QRCODE_MODULE_NAME);
+            candidates.emplace_back(directory + "../lib/" + OTPGEN_QRCODE_MODULE_NAME);
+        }
+        candidates.emplace_back(std::string(OTPGEN_QRCODE_MODULE_DIR "/") + OTPGEN_QRCODE_MODULE_NAME);
+        candidates.emplace_back(OTPGEN_QRCODE_MODULE_NAME);
+
+        for (auto&& candidate : candidates)
+        {
+            const auto library = ::dlopen(candidate.c_str(), RTLD_NOW | RTLD_LOCAL);
+            if (!library)
+            {
+                continue;
+            }
+
+            using EntryPoint = const QRCodeModule *(*)();
+            const auto entry = reinterpret_cast<EntryPoint>(::dlsym(library, QRCodeModule::ENTRY_POINT));
+            const auto module = entry ? entry() : nullptr;
+            if (module && module->version == QRCodeModule::VERSION)
+            {
+                // stays loaded until the process exits
+                return module;
+            }
+            ::dlclose(library);
+        }
+        return nullptr;
+    }
+
+    static const QRCodeModule *module()
+    {
+        static std::once_flag once;
+        static const QRCodeModule *module = nullptr;
+        std::call_once(once, []{
+            module = load();
+        });
+        return module;
+    }
+}
+
+bool QRCode::available()
+{
+    return module() != nullptr;
+}
+
+bool QRCode::decode(const std::string &filename, std::string &data, Effort effort)
+{
+    data.clear();
+    const auto m = module();
+    return m && m->decodeFile(filename, data, effort);
+}
+
+bool QRCode::decode(const std::uint8_t *pixels, int width, int height, int stride,
+                    PixelFormat format, std::string &data, Effort effort)
+{
+    data.clear();
+    const auto m = module();
+    return m && m->decodePixels(pixels, width, height, stride, format, data, effort);
+}
+
+bool QRCode::decode(const std::uint8_t *pixels, int width, int height, int stride,
+                    PixelFormat format, const Region &region, std::string &data, Region *bounds, Effort effort)
+{
+    data.clear();
+    const auto m = module();
+    return m && m->decodeRegion(pixels, width, height, stride, format, region, data, bounds, effort);
+}
+
+bool QRCode::decode(const std::uint8_t *image, std::size_t size, std::string &data, Effort effort)
+{
+    data.clear();
+    const auto m = module();
+    return m && m->decodeImage(image, size, data, effort);
+}
+
+bool QRCode::decodeAll(const std::string &filename, std::vector<std::string> &data, Effort effort)
+{
+    data.clear();
+    const auto m = module();
+    return m && m->decodeAllFile(filename, data, effort);
+}
+
+bool QRCode::decodeAll(const std::uint8_t *pixels, int width, int height, int stride,
+                       PixelFormat format, std::vector<std::string> &data, Effort effort)
+{
+    data.clear();
+    const auto m = module();
+    return m && m->decodeAllPixels(pixels, width, height, stride, format, data, effort);
+}
+
+bool QRCode::decodeAll(const std::uint8_t *image, std::size_t size, std::vector<std::string> &data, Effort effort)
+{
+    data.clear();
+    const auto m = module();
+    return m && m->decodeAllImage(image, size, data, effort);
+}
+
+std::size_t QRCode::decodeBatch(const std::vector<std::string> &files, const BatchCallback &callback,
+                                Executor *executor, Effort effort, bool all)
+{
+    const auto m = module();
+    return m ? m->decodeBatchFiles(files, callback, executor, effort, all) : 0U;
+}
+
+std::size_t QRCode::decodeBatch(const std::vector<ImageBuffer> &images, const BatchCallback &callback,
+                                Executor *executor, Effort effort, bool all)
+{
+    const auto m = module();
+    return m ? m->decodeBatchImages(images, callback, executor, effort, all) : 0U;
+}
+
+bool QRCode::encode(const std::string &input, std::string &out)
+{
+    const auto m = module();
+    return m && m->encode(input, out);
+}
+
+bool QRCode::encodeRaster(const std::string &input, std::vector<std::uint8_t> &pixels, int &size, int scale, int border)
+{
+    const auto m = module();
+    return m && m->encodeRaster(input, pixels, size, scale, border);
+}
+
+// the cache lives in the library, nothing is cached before it was loaded
+void QRCode::setEncodeCacheCapacity(std::size_t capacity)
+{
+    if (const auto m = module())
+    {
+        m->setEncodeCacheCapacity(capacity);
+    }
+}
+
+void QRCode::clearEncodeCache()
+{
+    if (const auto m = module())
+    {
+        m->clearEncodeCache();
+    }
+}
+
+std::size_t QRCode::encodeCacheSize()
+{
+    const auto m = module();
+    return m ? m->encodeCacheSize() : 0U;
+}
+
+QRCodeSheet::QRCodeSheet(Executor *executor)
+    : QRCodeSheet(Layout(), executor)
+{
+}
+
+// same limits as the library, perPage() is answered without loading it
+QRCodeSheet::QRCodeSheet(const Layout &layout, Executor *executor)
+    : _layout(layout),
+      _executor(executor)
+{
+    this->_layout.columns = std::max(this->_layout.columns, 1);
+    this->_layout.rows = std::max(this->_layout.rows, 1);
+    this->_layout.scale = std::max(this->_layout.scale, 1);
+    this->_layout.border = std::max(this->_layout.border, 0);
+    this->_layout.margin = std::max(this->_layout.margin, 0);
+}
+
+bool QRCodeSheet::encodePage(const std::vector<std::string_view> &inputs, std::vector<std::uint8_t> &png) const
+{
+    const auto m = module();
+    return m && m->encodeSheetPage(this->_layout, this->_executor, inputs, png);
+}
@@ -1,11 +1,29 @@
 #include "QRCode.hpp"
 
+#include <Executor.hpp>
+#include <PerfStats.hpp>
+
+#include "Internal/Luminance.hpp"
+
 #include <ImageReaderSource.h>
+#include <lodepng.h>
+#include <jpgd.h>
+#include <nanosvg.h>
+#include <nanosvgrast.h>
 
 #include <iostream>
 #include <vector>
 #include <exception>
 #include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <zxing/common/Counted.h>
 #include <zxing/Binarizer.h>
@@ -31,91 +49,785 @@ using namespace zxing;
 using namespace zxing::multi;
 using namespace zxing::qrcode;
 
-static std::vector<Ref<Result>> decode(const Ref<BinaryBitmap> &image, const DecodeHints &hints)
+namespace {
+    /**
+     * Luminance over pixels in caller memory
+     *
+     * Rows are converted when zxing asks for them, the pixels are never
+     * copied. Encoded images keep their decoded pixels in the source.
+     *
+     */
+    class PixelSource : public LuminanceSource
+    {
+    public:
+        PixelSource(const std::uint8_t *pixels, int width, int height, int stride, QRCode::PixelFormat format)
+            : LuminanceSource(width, height),
+              _pixels(pixels),
+              _stride(stride),
+              _format(format)
+        {
+        }
+
+        PixelSource(std::vector<std::uint8_t> &&pixels, int width, int height)
+            : LuminanceSource(width, height),
+              _owned(std::move(pixels)),
+              _pixels(_owned.data()),
+              _stride(width * 4),
+              _format(QRCode::RGBA32)
+        {
+            OTPGEN_PERF_MEMORY_ADD(this->_memory, this->_owned.capacity());
+        }
+
+        ArrayRef<char> getRow(int y, ArrayRef<char> row) const override
+        {
+            if (!row || row->size() < getWidth())
+            {
+                row = ArrayRef<char>(getWidth());
+            }
+            convertRow(y, &row[0]);
+            return row;
+        }
+
+        ArrayRef<char> getMatrix() const override
+        {
+            ArrayRef<char> matrix(getWidth() * getHeight());
+            for (auto y = 0; y < getHeight(); ++y)
+            {
+                convertRow(y, &matrix[y * getWidth()]);
+            }
+            return matrix;
+        }
+
+    private:
+        void convertRow(int y, char *out) const
+        {
+            const auto row = this->_pixels + static_cast<std::ptrdiff_t>(y) * this->_stride;
+            const auto target = reinterpret_cast<std::uint8_t*>(out);
+            switch (this->_format)
+            {
+                case QRCode::Gray8:
+                    std::memcpy(out, row, static_cast<std::size_t>(getWidth()));
+                    break;
+                case QRCode::RGB24:
+                case QRCode::BGR24:
+                    Internal::lumaRow(row, target, getWidth(), 3, this->_format == QRCode::BGR24);
+                    break;
+                case QRCode::RGBA32:
+                case QRCode::BGRA32:
+                    Internal::lumaRow(row, target, getWidth(), 4, this->_format == QRCode::BGRA32);
+                    break;
+            }
+        }
+
+        std::vector<std::uint8_t> _owned;
+        const std::uint8_t *_pixels;
+        int _stride;
+        QRCode::PixelFormat _format;
+        PerfStats::Allocation _memory{PerfStats::QRCodeBitmaps};
+    };
+
+    static int bytesPerPixel(QRCode::PixelFormat format)
+    {
+        switch (format)
+        {
+            case QRCode::Gray8:  return 1;
+            case QRCode::RGB24:
+            case QRCode::BGR24:  return 3;
+            case QRCode::RGBA32:
+            case QRCode::BGRA32: return 4;
+        }
+        return 0;
+    }
+
+    // decodes a PNG, JPEG or SVG image into RGBA pixels, detected by its leading bytes
+    static Ref<LuminanceSource> decodeImage(const std::uint8_t *image, std::size_t size)
+    {
+        static const unsigned char PNG_MAGIC[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+        std::vector<std::uint8_t> pixels;
+        int width = 0;
+        int height = 0;
+
+        if (size >= sizeof(PNG_MAGIC) && std::memcmp(image, PNG_MAGIC, sizeof(PNG_MAGIC)) == 0)
+        {
+            unsigned w, h;
+            if (lodepng::decode(pixels, w, h, image, size) != 0)
+            {
+                return Ref<LuminanceSource>();
+            }
+            width = static_cast<int>(w);
+            height = static_cast<int>(h);
+        }
+        else if (size >= 3 && image[0] == 0xFF && image[1] == 0xD8 && image[2] == 0xFF)
+        {
+            if (size > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+            {
+                return Ref<LuminanceSource>();
+            }
+            int comps = 0;
+            auto buffer = jpgd::decompress_jpeg_image_from_memory(image, static_cast<int>(size), &width, &height, &comps, 4);
+            if (!buffer)
+            {
+                return Ref<LuminanceSource>();
+            }
+            pixels.assign(buffer, buffer + static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 4U);
+            std::free(buffer);
+        }
+        else
+        {
+            // nanosvg parses in place and needs a terminated copy
+            std::string svg(reinterpret_cast<const char*>(image), size);
+            if (svg.find("<svg") == std::string::npos)
+            {
+                return Ref<LuminanceSource>();
+            }
+            auto svgimage = nsvgParse(&svg[0], "px", 96);
+            if (!svgimage)
+            {
+                return Ref<LuminanceSource>();
+            }
+            width = static_cast<int>(svgimage->width);
+            height = static_cast<int>(svgimage->height);
+            if (width > 0 && height > 0)
+            {
+                auto rasterizer = nsvgCreateRasterizer();
+                pixels.resize(static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 4U);
+                nsvgRasterize(rasterizer, svgimage, 0, 0, 1, pixels.data(), width, height, width * 4);
+                nsvgDeleteRasterizer(rasterizer);
+            }
+            nsvgDelete(svgimage);
+        }
+
+        if (width <= 0 || height <= 0 || pixels.empty())
+        {
+            return Ref<LuminanceSource>();
+        }
+        return Ref<LuminanceSource>(new PixelSource(std::move(pixels), width, height));
+    }
+}
+
+namespace {
+    // images larger than this are first tried at a reduced size
+    static const constexpr int SCALED_DIMENSION = 640;
+
+    /**
+     * Luminance matrix shared by all decode attempts of one image
+     *
+     * The pixels are converted once, every binarizer and the downscaled copy
+     * read the same matrix.
+     *
+     */
+    class MatrixSource : public LuminanceSource
+    {
+    public:
+        MatrixSource(ArrayRef<char> matrix, int width, int height)
+            : LuminanceSource(width, height),
+              _matrix(matrix)
+        {
+        }
+
+        ArrayRef<char> getRow(int y, ArrayRef<char> row) const override
+        {
+            if (!row || row->size() < getWidth())
+            {
+                row = ArrayRef<char>(getWidth());
+            }
+            std::memcpy(&row[0], &this->_matrix[y * getWidth()], static_cast<std::size_t>(getWidth()));
+            return row;
+        }
+
+        // the binarizers only read the matrix
+        ArrayRef<char> getMatrix() const override
+        {
+            return this->_matrix;
+        }
+
+        // the multiple barcode reader searches cropped parts of the image
+        bool isCropSupported() const override
+        {
+            return true;
+        }
+
+        Ref<LuminanceSource> crop(int left, int top, int width, int height) const override
+        {
+            if (left < 0 || top < 0 || width <= 0 || height <= 0 ||
+                left + width > getWidth() || top + height > getHeight())
+            {
+                throw zxing::IllegalArgumentException("Crop rectangle does not fit within image data.");
+            }
+            ArrayRef<char> cropped(width * height);
+            for (auto y = 0; y < height; ++y)
+            {
+                std::memcpy(&cropped[y * width], &this->_matrix[(top + y) * getWidth() + left], static_cast<std::size_t>(width));
+            }
+            return Ref<LuminanceSource>(new MatrixSource(cropped, width, height));
+        }
+
+        // box filtered copy, every side divided by factor
+        Ref<MatrixSource> downscale(int factor) const
+        {
+            const auto width = getWidth() / factor;
+            const auto height = getHeight() / factor;
+            ArrayRef<char> scaled(width * height);
+            Internal::downscale(reinterpret_cast<const std::uint8_t*>(&this->_matrix[0]), getWidth(), getHeight(), factor,
+                                reinterpret_cast<std::uint8_t*>(&scaled[0]));
+            return Ref<MatrixSource>(new MatrixSource(scaled, width, height));
+        }
+
+    private:
+        ArrayRef<char> _matrix;
+    };
+
+    // reused by every decode on the same thread
+    static QRCodeReader &qrReader()
+    {
+        thread_local Ref<QRCodeReader> reader(new QRCodeReader);
+        return *reader;
+    }
+
+    static QRCodeMultiReader &qrMultiReader()
+    {
+        // counted through both of its bases, so it can't be held by a Ref
+        thread_local QRCodeMultiReader reader;
+        return reader;
+    }
+
+    static bool read_qr(const Ref<BinaryBitmap> &image, bool tryHarder, Ref<Result> &result)
+    {
+        try {
+            DecodeHints hints(DecodeHints::QR_CODE_HINT);
+            hints.setTryHarder(tryHarder);
+            result = qrReader().decode(image, hints);
+            return true;
+        } catch (const zxing::Exception&) {
+        } catch (const std::exception&) {
+        }
+        return false;
+    }
+
+    // any barcode format, the behaviour of the original decoder
+    static bool read_any(const Ref<BinaryBitmap> &image, Ref<Result> &result)
+    {
+        try {
+            DecodeHints hints(DecodeHints::DEFAULT_HINT);
+            hints.setTryHarder(true);
+            Ref<Reader> reader(new MultiFormatReader);
+            result = reader->decode(image, hints);
+            return true;
+        } catch (const zxing::Exception&) {
+        } catch (const std::exception&) {
+        }
+        return false;
+    }
+
+    // all codes found by the reader, texts already in the list are skipped
+    static bool read_multiple(MultipleBarcodeReader &reader, const Ref<BinaryBitmap> &image, bool tryHarder,
+                              std::vector<std::string> &data)
+    {
+        try {
+            DecodeHints hints(DecodeHints::QR_CODE_HINT);
+            hints.setTryHarder(tryHarder);
+            const auto before = data.size();
+            for (auto&& result : reader.decodeMultiple(image, hints))
+            {
+                auto text = result->getText()->getText();
+                if (std::find(data.begin(), data.end(), text) == data.end())
+                {
+                    data.emplace_back(std::move(text));
+                }
+            }
+            return data.size() != before;
+        } catch (const zxing::Exception&) {
+        } catch (const std::exception&) {
+        }
+        return false;
+    }
+}
+
+static bool decode_all_source(const Ref<LuminanceSource> &input, std::vector<std::string> &data, QRCode::Effort effort)
 {
-    Ref<Reader> reader(new MultiFormatReader);
-    return std::vector<Ref<Result>>(1, reader->decode(image, hints));
+    try {
+        Ref<MatrixSource> source(new MatrixSource(input->getMatrix(), input->getWidth(), input->getHeight()));
+
+        // the multi detector finds every set of finder patterns in one pass,
+        // lower levels stop at the first binarization with results
+        Ref<BinaryBitmap> global(new BinaryBitmap(Ref<Binarizer>(new GlobalHistogramBinarizer(source))));
+        auto found = read_multiple(qrMultiReader(), global, false, data);
+
+        Ref<BinaryBitmap> hybrid(new BinaryBitmap(Ref<Binarizer>(new HybridBinarizer(source))));
+        if (effort == QRCode::Normal && !found)
+        {
+            found = read_multiple(qrMultiReader(), hybrid, false, data);
+        }
+
+        // merges everything, codes the detector missed are searched in parts of the image
+        if (effort >= QRCode::TryHarder)
+        {
+            read_multiple(qrMultiReader(), hybrid, true, data);
+            GenericMultipleBarcodeReader generic(qrReader());
+            read_multiple(generic, hybrid, true, data);
+        }
+    } catch (const zxing::Exception&) {
+        return false;
+    } catch (const std::exception&) {
+        return false;
+    }
+
+    return !data.empty();
 }
 
-static int read_image(const Ref<LuminanceSource> &source, std::vector<Ref<Result>> &results, bool hybrid)
+static bool decode_source(const Ref<LuminanceSource> &input, std::string &data, QRCode::Effort effort,
+                          QRCode::Region *bounds = nullptr)
 {
-    int res = -1;
+    Ref<Result> result;
+    bool found = false;
+    // the points of codes found in the downscaled copy are scaled back
+    auto scale = 1;
 
     try {
-        Ref<Binarizer> binarizer;
+        const auto width = input->getWidth();
+        const auto height = input->getHeight();
+        Ref<MatrixSource> source(new MatrixSource(input->getMatrix(), width, height));
 
-        if (hybrid)
+        // cheap global threshold on a reduced copy first, most exports are clean and large
+        auto factor = 1;
+        while (std::max(width, height) / (factor * 2) >= SCALED_DIMENSION)
         {
-            binarizer = new HybridBinarizer(source);
+            factor *= 2;
         }
-        else
+        if (factor > 1)
         {
-            binarizer = new GlobalHistogramBinarizer(source);
+            Ref<BinaryBitmap> scaled(new BinaryBitmap(Ref<Binarizer>(new GlobalHistogramBinarizer(source->downscale(factor)))));
+            found = read_qr(scaled, false, result);
+            scale = found ? factor : 1;
         }
 
-        DecodeHints hints(DecodeHints::DEFAULT_HINT);
-        hints.setTryHarder(true);
-        Ref<BinaryBitmap> binary(new BinaryBitmap(binarizer));
-        results = decode(binary, hints);
-        res = 0;
-    } catch (const ReaderException&) {
-        res = -2;
-    } catch (const zxing::IllegalArgumentException&) {
-        res = -3;
+        // the bitmaps cache their binarization, escalating reuses it
+        Ref<BinaryBitmap> global(new BinaryBitmap(Ref<Binarizer>(new GlobalHistogramBinarizer(source))));
+        found = found || read_qr(global, false, result);
+
+        Ref<BinaryBitmap> hybrid(new BinaryBitmap(Ref<Binarizer>(new HybridBinarizer(source))));
+        if (effort >= QRCode::Normal)
+        {
+            found = found || read_qr(hybrid, false, result);
+        }
+
+        if (effort >= QRCode::TryHarder)
+        {
+            found = found || read_qr(hybrid, true, result);
+            found = found || read_qr(global, true, result);
+            found = found || read_any(hybrid, result);
+            found = found || read_any(global, result);
+        }
     } catch (const zxing::Exception&) {
-        res = -4;
+        return false;
     } catch (const std::exception&) {
-        res = -5;
+        return false;
+    }
+
+    if (!found)
+    {
+        return false;
     }
 
-    return res;
+    data = result->getText()->getText();
+
+    // bounding box of the finder patterns (and alignment pattern)
+    if (bounds)
+    {
+        *bounds = QRCode::Region();
+        const auto &points = result->getResultPoints();
+        if (points && points->size() > 0)
+        {
+            auto left = std::numeric_limits<float>::max();
+            auto top = std::numeric_limits<float>::max();
+            auto right = 0.0f;
+            auto bottom = 0.0f;
+            for (auto i = 0; i < points->size(); ++i)
+            {
+                left = std::min(left, points[i]->getX());
+                top = std::min(top, points[i]->getY());
+                right = std::max(right, points[i]->getX());
+                bottom = std::max(bottom, points[i]->getY());
+            }
+            bounds->left = static_cast<int>(left) * scale;
+            bounds->top = static_cast<int>(top) * scale;
+            bounds->width = (static_cast<int>(right) - static_cast<int>(left) + 1) * scale;
+            bounds->height = (static_cast<int>(bottom) - static_cast<int>(top) + 1) * scale;
+        }
+    }
+    return true;
 }
 
-bool QRCode::decode(const std::string &filename, std::string &data)
-{
-    if (filename.empty())
+namespace {
+    static Ref<LuminanceSource> loadFile(const std::string &filename)
     {
-        return false;
+        if (filename.empty())
+        {
+            return Ref<LuminanceSource>();
+        }
+
+        // detected from the contents and converted with the vectorized rows
+        std::ifstream file(filename, std::ios::in | std::ios::binary);
+        const std::vector<std::uint8_t> contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        if (!contents.empty())
+        {
+            const auto source = decodeImage(contents.data(), contents.size());
+            if (source)
+            {
+                return source;
+            }
+        }
+
+        try {
+            return ImageReaderSource::create(filename);
+        } catch (const zxing::IllegalArgumentException&) {
+            return Ref<LuminanceSource>();
+        }
+    }
+
+    static Ref<LuminanceSource> wrapPixels(const std::uint8_t *pixels, int width, int height, int stride,
+                                           QRCode::PixelFormat format)
+    {
+        const auto bpp = bytesPerPixel(format);
+        if (!pixels || width <= 0 || height <= 0 || bpp == 0 || stride < width * bpp)
+        {
+            return Ref<LuminanceSource>();
+        }
+        return Ref<LuminanceSource>(new PixelSource(pixels, width, height, stride, format));
     }
 
-    Ref<LuminanceSource> source;
+    static Ref<LuminanceSource> loadImage(const std::uint8_t *image, std::size_t size)
+    {
+        if (!image || size == 0)
+        {
+            return Ref<LuminanceSource>();
+        }
+        return decodeImage(image, size);
+    }
+}
+
+bool QRCode::available()
+{
+    return true;
+}
+
+bool QRCode::decode(const std::string &filename, std::string &data, Effort effort)
+{
     data.clear();
+    const auto source = loadFile(filename);
+    return source && decode_source(source, data, effort);
+}
 
-    try {
-        source = ImageReaderSource::create(filename);
-    } catch (const zxing::IllegalArgumentException&) {
+bool QRCode::decode(const std::uint8_t *pixels, int width, int height, int stride,
+                    PixelFormat format, std::string &data, Effort effort)
+{
+    data.clear();
+    const auto source = wrapPixels(pixels, width, height, stride, format);
+    return source && decode_source(source, data, effort);
+}
+
+bool QRCode::decode(const std::uint8_t *image, std::size_t size, std::string &data, Effort effort)
+{
+    data.clear();
+    const auto source = loadImage(image, size);
+    return source && decode_source(source, data, effort);
+}
+
+bool QRCode::decode(const std::uint8_t *pixels, int width, int height, int stride,
+                    PixelFormat format, const Region &region, std::string &data, Region *bounds, Effort effort)
+{
+    data.clear();
+    if (region.left < 0 || region.top < 0 || region.width <= 0 || region.height <= 0 ||
+        region.left + region.width > width || region.top + region.height > height)
+    {
         return false;
     }
 
-    std::vector<Ref<Result>> results;
+    // the region is a view into the same rows
+    const auto offset = static_cast<std::ptrdiff_t>(region.top) * stride + region.left * bytesPerPixel(format);
+    const auto source = wrapPixels(pixels ? pixels + offset : nullptr, region.width, region.height, stride, format);
+    if (!source || !decode_source(source, data, effort, bounds))
+    {
+        return false;
+    }
 
-    int gresult = 1;
-    int hresult = 1;
+    if (bounds && bounds->width > 0)
+    {
+        bounds->left += region.left;
+        bounds->top += region.top;
+    }
+    return true;
+}
 
-    // try hybrid mode first
-    hresult = read_image(source, results, true);
+bool QRCode::decodeAll(const std::string &filename, std::vector<std::string> &data, Effort effort)
+{
+    data.clear();
+    const auto source = loadFile(filename);
+    return source && decode_all_source(source, data, effort);
+}
 
-    // if that failed try without hybrid mode
-    if (hresult != 0)
+bool QRCode::decodeAll(const std::uint8_t *pixels, int width, int height, int stride,
+                       PixelFormat format, std::vector<std::string> &data, Effort effort)
+{
+    data.clear();
+    const auto source = wrapPixels(pixels, width, height, stride, format);
+    return source && decode_all_source(source, data, effort);
+}
+
+bool QRCode::decodeAll(const std::uint8_t *image, std::size_t size, std::vector<std::string> &data, Effort effort)
+{
+    data.clear();
+    const auto source = loadImage(image, size);
+    return source && decode_all_source(source, data, effort);
+}
+
+namespace {
+    static Ref<LuminanceSource> loadInput(const std::string &file)
     {
-        gresult = read_image(source, results, false);
-        if (gresult != 0)
+        return loadFile(file);
+    }
+
+    static Ref<LuminanceSource> loadInput(const QRCode::ImageBuffer &image)
+    {
+        return loadImage(image.first, image.second);
+    }
+
+    // the texts of all codes of an image, one per line
+    static bool decode_input(const Ref<LuminanceSource> &source, std::string &data, QRCode::Effort effort, bool all)
+    {
+        data.clear();
+        if (!source)
+        {
+            return false;
+        }
+        if (!all)
+        {
+            return decode_source(source, data, effort);
+        }
+
+        std::vector<std::string> texts;
+        if (!decode_all_source(source, texts, effort))
         {
             return false;
         }
+        for (auto&& text : texts)
+        {
+            data += data.empty() ? "" : "\n";
+            data += text;
+        }
+        return true;
     }
 
-    // read data
-    for (auto&& res : results)
+    template<typename Input>
+    static std::size_t decode_batch(const std::vector<Input> &inputs, const QRCode::BatchCallback &callback,
+                                    Executor *executor, QRCode::Effort effort, bool all)
     {
-//        for (auto&& val : res->getRawBytes()->values())
-//        {
-//            data += val;
-//        }
-        data += res->getText()->getText();
+        std::mutex mutex;
+        std::size_t decoded = 0U;
+        const Executor::Task task = [&](std::size_t begin, std::size_t end) {
+            std::string data;
+            for (auto i = begin; i < end; ++i)
+            {
+                const auto success = decode_input(loadInput(inputs[i]), data, effort, all);
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded += success ? 1U : 0U;
+                if (callback)
+                {
+                    callback(i, success, data);
+                }
+            }
+        };
+
+        // one image per chunk, decode times vary a lot between images
+        if (executor && inputs.size() > 1U)
+        {
+            executor->parallelFor(inputs.size(), 1U, task);
+        }
+        else
+        {
+            task(0U, inputs.size());
+        }
+        return decoded;
     }
+}
 
-    return true;
+std::size_t QRCode::decodeBatch(const std::vector<std::string> &files, const BatchCallback &callback,
+                                Executor *executor, Effort effort, bool all)
+{
+    return decode_batch(files, callback, executor, effort, all);
+}
+
+std::size_t QRCode::decodeBatch(const std::vector<ImageBuffer> &images, const BatchCallback &callback,
+                                Executor *executor, Effort effort, bool all)
+{
+    return decode_batch(images, callback, executor, effort, all);
+}
+
+namespace {
+    // the SVG export border, in modules
+    static const constexpr int SVG_BORDER = 3;
+
+    /**
+     * Recently encoded codes, most recent first
+     *
+     * Entries are found through the hash of the input and compared in full,
+     * the SVG and raster outputs are built the first time they are needed.
+     *
+     */
+    struct EncodeCache
+    {
+        struct Entry
+        {
+            std::string input;
+            int size = 0;
+            std::vector<bool> modules;
+
+            std::string svg;
+            std::vector<std::uint8_t> raster;
+            int scale = 0;
+            int border = -1;
+        };
+
+        std::mutex mutex;
+        std::size_t capacity = 32U;
+        std::list<Entry> entries;
+        std::unordered_multimap<std::size_t, std::list<Entry>::iterator> index;
+
+        // moves a hit to the front, encodes and inserts a miss
+        Entry *find(const std::string &input)
+        {
+            const auto hash = std::hash<std::string>()(input);
+            const auto range = this->index.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (it->second->input == input)
+                {
+                    this->entries.splice(this->entries.begin(), this->entries, it->second);
+                    return &this->entries.front();
+                }
+            }
+
+            const auto qr = qrcodegen::QrCode::encodeText(input.c_str(), qrcodegen::QrCode::Ecc::QUARTILE);
+            Entry entry;
+            entry.input = input;
+            entry.size = qr.getSize();
+            entry.modules.resize(static_cast<std::size_t>(entry.size * entry.size));
+            for (auto y = 0; y < entry.size; ++y)
+            {
+                for (auto x = 0; x < entry.size; ++x)
+                {
+                    entry.modules[static_cast<std::size_t>(y * entry.size + x)] = qr.getModule(x, y);
+                }
+            }
+            if (this->capacity == 0U)
+            {
+                this->uncached = std::move(entry);
+                return &this->uncached;
+            }
+
+            this->entries.emplace_front(std::move(entry));
+            this->index.emplace(hash, this->entries.begin());
+            while (this->entries.size() > this->capacity)
+            {
+                this->erase(std::prev(this->entries.end()));
+            }
+            return &this->entries.front();
+        }
+
+        void erase(std::list<Entry>::iterator entry)
+        {
+            const auto range = this->index.equal_range(std::hash<std::string>()(entry->input));
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (it->second == entry)
+                {
+                    this->index.erase(it);
+                    break;
+                }
+            }
+            this->entries.erase(entry);
+        }
+
+        void clear()
+        {
+            this->index.clear();
+            this->entries.clear();
+            this->uncached = Entry();
+        }
+
+        // result of the last call with caching disabled
+        Entry uncached;
+    };
+
+    static EncodeCache &encodeCache()
+    {
+        static EncodeCache cache;
+        return cache;
+    }
+
+    // same layout as qrcodegen::QrCode::toSvgString
+    static std::string toSvg(const EncodeCache::Entry &entry, int border)
+    {
+        const auto dimension = std::to_string(entry.size + border * 2);
+        std::string svg;
+        svg.reserve(static_cast<std::size_t>(entry.size * entry.size) * 4U + 512U);
+        svg += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        svg += "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n";
+        svg += "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" viewBox=\"0 0 ";
+        svg += dimension + " " + dimension;
+        svg += "\" stroke=\"none\">\n";
+        svg += "\t<rect width=\"100%\" height=\"100%\" fill=\"#FFFFFF\"/>\n";
+        svg += "\t<path d=\"";
+        auto first = true;
+        for (auto y = 0; y < entry.size; ++y)
+        {
+            for (auto x = 0; x < entry.size; ++x)
+            {
+                if (entry.modules[static_cast<std::size_t>(y * entry.size + x)])
+                {
+                    if (!first)
+                    {
+                        svg += ' ';
+                    }
+                    first = false;
+                    svg += 'M';
+                    svg += std::to_string(x + border);
+                    svg += ',';
+                    svg += std::to_string(y + border);
+                    svg += "h1v1h-1z";
+                }
+            }
+        }
+        svg += "\" fill=\"#000000\"/>\n";
+        svg += "</svg>\n";
+        return svg;
+    }
+
+    // one byte per pixel, every row is written once and copied for the module height
+    static void toRaster(EncodeCache::Entry &entry, int scale, int border)
+    {
+        const auto side = (entry.size + border * 2) * scale;
+        const auto width = static_cast<std::size_t>(side);
+        entry.raster.assign(width * width, 0xFF);
+        for (auto y = 0; y < entry.size; ++y)
+        {
+            auto row = &entry.raster[static_cast<std::size_t>((y + border) * scale) * width];
+            for (auto x = 0; x < entry.size; ++x)
+            {
+                if (entry.modules[static_cast<std::size_t>(y * entry.size + x)])
+                {
+                    std::memset(row + (x + border) * scale, 0x00, static_cast<std::size_t>(scale));
+                }
+            }
+            for (auto copy = 1; copy < scale; ++copy)
+            {
+                std::memcpy(row + static_cast<std::size_t>(copy) * width, row, width);
+            }
+        }
+        entry.scale = scale;
+        entry.border = border;
+    }
 }
 
 bool QRCode::encode(const std::string &input, std::string &out)
@@ -126,7 +838,68 @@ bool QRCode::encode(const std::string &input, std::string &out)
         return false;
     }
 
-    const auto qr = qrcodegen::QrCode::encodeText(input.c_str(), qrcodegen::QrCode::Ecc::QUARTILE);
-    out = qr.toSvgString(3);
+    auto &cache = encodeCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    try {
+        auto entry = cache.find(input);
+        if (entry->svg.empty())
+        {
+            entry->svg = toSvg(*entry, SVG_BORDER);
+        }
+        out = entry->svg;
+    } catch (const std::exception&) {
+        // too long for a QR code
+        return false;
+    }
+    return true;
+}
+
+bool QRCode::encodeRaster(const std::string &input, std::vector<std::uint8_t> &pixels, int &size, int scale, int border)
+{
+    pixels.clear();
+    size = 0;
+    if (input.empty() || scale <= 0 || border < 0)
+    {
+        return false;
+    }
+
+    auto &cache = encodeCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    try {
+        auto entry = cache.find(input);
+        if (entry->scale != scale || entry->border != border)
+        {
+            toRaster(*entry, scale, border);
+        }
+        pixels = entry->raster;
+        size = (entry->size + border * 2) * scale;
+    } catch (const std::exception&) {
+        return false;
+    }
     return true;
 }
+
+void QRCode::setEncodeCacheCapacity(std::size_t capacity)
+{
+    auto &cache = encodeCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.capacity = capacity;
+    while (cache.entries.size() > capacity)
+    {
+        cache.erase(std::prev(cache.entries.end()));
+    }
+}
+
+void QRCode::clearEncodeCache()
+{
+    auto &cache = encodeCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.clear();
+}
+
+std::size_t QRCode::encodeCacheSize()
+{
+    auto &cache = encodeCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    return cache.entries.size();
+}
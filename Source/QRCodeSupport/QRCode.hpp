@@ -1,18 +1,106 @@
 #ifndef QRCODE_HPP
 #define QRCODE_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
+
+class Executor;
 
 class QRCode
 {
     QRCode() = delete;
 
 public:
+    // layout of raw pixel buffers, 8 bits per channel
+    enum PixelFormat {
+        Gray8,
+        RGB24,
+        BGR24,
+        RGBA32,
+        BGRA32,
+    };
+
+    // how far decoding escalates before giving up, every level stops at the first hit
+    //  Fast: QR codes only, global threshold on a downscaled and on the full image
+    //  Normal: adds the local (hybrid) threshold
+    //  TryHarder: adds the exhaustive search and other barcode formats
+    enum Effort {
+        Fast,
+        Normal,
+        TryHarder,
+    };
+
+    // false if the QR code library can't be loaded, applications built with on-demand
+    // QR code support load it on first use (see QRCodeModule), all calls fail then
+    static bool available();
+
     // input from file, output to memory buffer
-    static bool decode(const std::string &filename, std::string &data);
+    static bool decode(const std::string &filename, std::string &data, Effort effort = TryHarder);
+
+    // input from raw pixels, the buffer is read in place and must stay valid during the call,
+    // stride is the distance between two rows in bytes
+    static bool decode(const std::uint8_t *pixels, int width, int height, int stride,
+                       PixelFormat format, std::string &data, Effort effort = TryHarder);
+
+    // rectangle in pixels
+    struct Region
+    {
+        int left = 0;
+        int top = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    // input from a region of raw pixels, read in place, bounds receives the box around
+    // the finder patterns of the code in image coordinates (see QRCodeScanner)
+    static bool decode(const std::uint8_t *pixels, int width, int height, int stride,
+                       PixelFormat format, const Region &region, std::string &data,
+                       Region *bounds = nullptr, Effort effort = TryHarder);
 
-    // input from memory buffer, output to memory buffer
+    // input from an encoded PNG, JPEG or SVG image in memory, output to memory buffer
+    static bool decode(const std::uint8_t *image, std::size_t size, std::string &data, Effort effort = TryHarder);
+
+    // every QR code in the image (for example a sheet of printed backup codes) in one pass,
+    // in the order they were found, codes with the same text are returned once
+    static bool decodeAll(const std::string &filename, std::vector<std::string> &data, Effort effort = TryHarder);
+    static bool decodeAll(const std::uint8_t *pixels, int width, int height, int stride,
+                          PixelFormat format, std::vector<std::string> &data, Effort effort = TryHarder);
+    static bool decodeAll(const std::uint8_t *image, std::size_t size, std::vector<std::string> &data,
+                          Effort effort = TryHarder);
+
+    // encoded image in memory, data and size
+    using ImageBuffer = std::pair<const std::uint8_t*, std::size_t>;
+
+    // receives every image as soon as it is decoded, index is its position in the input,
+    // calls are serialized and arrive in completion order
+    using BatchCallback = std::function<void(std::size_t index, bool success, const std::string &data)>;
+
+    // decodes many images concurrently on the executor, every worker thread loads,
+    // binarizes and decodes whole images, returns the amount of decoded images,
+    // with all every code of an image is decoded and the texts are passed one per line
+    static std::size_t decodeBatch(const std::vector<std::string> &files, const BatchCallback &callback,
+                                   Executor *executor = nullptr, Effort effort = TryHarder, bool all = false);
+    static std::size_t decodeBatch(const std::vector<ImageBuffer> &images, const BatchCallback &callback,
+                                   Executor *executor = nullptr, Effort effort = TryHarder, bool all = false);
+
+    // input from memory buffer, output to memory buffer (SVG)
     static bool encode(const std::string &input, std::string &out);
+
+    // input from memory buffer, output is a square 8-bit grayscale image (dark modules 0, light 255)
+    // of size * size pixels without row padding, scale pixels per module and border modules around
+    // the code, it can be used as QImage::Format_Grayscale8 directly
+    static bool encodeRaster(const std::string &input, std::vector<std::uint8_t> &pixels, int &size,
+                             int scale = 4, int border = 3);
+
+    // the most recently encoded inputs are kept with their outputs, repeated exports of the same
+    // token skip the encoding, the cache holds secrets and should be cleared when they are locked
+    static void setEncodeCacheCapacity(std::size_t capacity);
+    static void clearEncodeCache();
+    static std::size_t encodeCacheSize();
 };
 
 #endif // QRCODE_HPP
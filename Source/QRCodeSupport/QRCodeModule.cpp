@@ -0,0 +1,69 @@
+#include "QRCodeModule.hpp"
+
+namespace {
+    static const QRCodeModule module = {
+        QRCodeModule::VERSION,
+
+        [](const std::string &filename, std::string &data, QRCode::Effort effort) {
+            return QRCode::decode(filename, data, effort);
+        },
+        [](const std::uint8_t *pixels, int width, int height, int stride,
+           QRCode::PixelFormat format, std::string &data, QRCode::Effort effort) {
+            return QRCode::decode(pixels, width, height, stride, format, data, effort);
+        },
+        [](const std::uint8_t *pixels, int width, int height, int stride,
+           QRCode::PixelFormat format, const QRCode::Region &region, std::string &data,
+           QRCode::Region *bounds, QRCode::Effort effort) {
+            return QRCode::decode(pixels, width, height, stride, format, region, data, bounds, effort);
+        },
+        [](const std::uint8_t *image, std::size_t size, std::string &data, QRCode::Effort effort) {
+            return QRCode::decode(image, size, data, effort);
+        },
+
+        [](const std::string &filename, std::vector<std::string> &data, QRCode::Effort effort) {
+            return QRCode::decodeAll(filename, data, effort);
+        },
+        [](const std::uint8_t *pixels, int width, int height, int stride,
+           QRCode::PixelFormat format, std::vector<std::string> &data, QRCode::Effort effort) {
+            return QRCode::decodeAll(pixels, width, height, stride, format, data, effort);
+        },
+        [](const std::uint8_t *image, std::size_t size, std::vector<std::string> &data, QRCode::Effort effort) {
+            return QRCode::decodeAll(image, size, data, effort);
+        },
+
+        [](const std::vector<std::string> &files, const QRCode::BatchCallback &callback,
+           Executor *executor, QRCode::Effort effort, bool all) {
+            return QRCode::decodeBatch(files, callback, executor, effort, all);
+        },
+        [](const std::vector<QRCode::ImageBuffer> &images, const QRCode::BatchCallback &callback,
+           Executor *executor, QRCode::Effort effort, bool all) {
+            return QRCode::decodeBatch(images, callback, executor, effort, all);
+        },
+
+        [](const std::string &input, std::string &out) {
+            return QRCode::encode(input, out);
+        },
+        [](const std::string &input, std::vector<std::uint8_t> &pixels, int &size, int scale, int border) {
+            return QRCode::encodeRaster(input, pixels, size, scale, border);
+        },
+        [](std::size_t capacity) {
+            QRCode::setEncodeCacheCapacity(capacity);
+        },
+        []{
+            QRCode::clearEncodeCache();
+        },
+        []{
+            return QRCode::encodeCacheSize();
+        },
+
+        [](const QRCodeSheet::Layout &layout, Executor *executor,
+           const std::vector<std::string_view> &inputs, std::vector<std::uint8_t> &png) {
+            return QRCodeSheet(layout, executor).encodePage(inputs, png);
+        },
+    };
+}
+
+const QRCodeModule *otpgen_qrcode_module()
+{
+    return &module;
+}
@@ -0,0 +1,72 @@
+#ifndef QRCODEMODULE_HPP
+#define QRCODEMODULE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "QRCode.hpp"
+#include "QRCodeSheet.hpp"
+
+/**
+ * Entry points of the QR code support library when it is loaded at runtime
+ *
+ * Applications built with on-demand QR code support (QR_CODES_ON_DEMAND)
+ * don't link the library, the QRCode and QRCodeSheet functions of the
+ * loader open it on first use and call through this table. The table
+ * passes C++ types, the library must be built together with the
+ * application, the version guards against a stale library.
+ *
+ */
+struct QRCodeModule
+{
+    // incremented when the table or the types it passes change
+    static const constexpr int VERSION = 1;
+    static constexpr const char *const ENTRY_POINT = "otpgen_qrcode_module";
+
+    int version;
+
+    bool (*decodeFile)(const std::string &filename, std::string &data, QRCode::Effort effort);
+    bool (*decodePixels)(const std::uint8_t *pixels, int width, int height, int stride,
+                         QRCode::PixelFormat format, std::string &data, QRCode::Effort effort);
+    bool (*decodeRegion)(const std::uint8_t *pixels, int width, int height, int stride,
+                         QRCode::PixelFormat format, const QRCode::Region &region, std::string &data,
+                         QRCode::Region *bounds, QRCode::Effort effort);
+    bool (*decodeImage)(const std::uint8_t *image, std::size_t size, std::string &data, QRCode::Effort effort);
+
+    bool (*decodeAllFile)(const std::string &filename, std::vector<std::string> &data, QRCode::Effort effort);
+    bool (*decodeAllPixels)(const std::uint8_t *pixels, int width, int height, int stride,
+                            QRCode::PixelFormat format, std::vector<std::string> &data, QRCode::Effort effort);
+    bool (*decodeAllImage)(const std::uint8_t *image, std::size_t size, std::vector<std::string> &data,
+                           QRCode::Effort effort);
+
+    std::size_t (*decodeBatchFiles)(const std::vector<std::string> &files, const QRCode::BatchCallback &callback,
+                                    Executor *executor, QRCode::Effort effort, bool all);
+    std::size_t (*decodeBatchImages)(const std::vector<QRCode::ImageBuffer> &images, const QRCode::BatchCallback &callback,
+                                     Executor *executor, QRCode::Effort effort, bool all);
+
+    bool (*encode)(const std::string &input, std::string &out);
+    bool (*encodeRaster)(const std::string &input, std::vector<std::uint8_t> &pixels, int &size, int scale, int border);
+    void (*setEncodeCacheCapacity)(std::size_t capacity);
+    void (*clearEncodeCache)();
+    std::size_t (*encodeCacheSize)();
+
+    bool (*encodeSheetPage)(const QRCodeSheet::Layout &layout, Executor *executor,
+                            const std::vector<std::string_view> &inputs, std::vector<std::uint8_t> &png);
+};
+
+extern "C" {
+
+// the table of the library, exported as QRCodeModule::ENTRY_POINT
+#if defined(_WIN32)
+__declspec(dllexport)
+#else
+__attribute__((visibility("default")))
+#endif
+const QRCodeModule *otpgen_qrcode_module();
+
+}
+
+#endif // QRCODEMODULE_HPP
@@ -0,0 +1,212 @@
+#include "QRCodeScanner.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+    // the tracked region extends this fraction of the code size to every side
+    static const constexpr int ROI_MARGIN_DIVISOR = 2;
+
+    // box around the finder patterns grown by the margin and clamped to the frame
+    static QRCode::Region expand(const QRCode::Region &bounds, int width, int height)
+    {
+        const auto margin = std::max(bounds.width, bounds.height) / ROI_MARGIN_DIVISOR + 16;
+        QRCode::Region region;
+        region.left = std::max(bounds.left - margin, 0);
+        region.top = std::max(bounds.top - margin, 0);
+        region.width = std::min(bounds.left + bounds.width + margin, width) - region.left;
+        region.height = std::min(bounds.top + bounds.height + margin, height) - region.top;
+        return region;
+    }
+
+    static bool fits(const QRCode::Region &region, int width, int height)
+    {
+        return region.width > 0 && region.height > 0 &&
+               region.left + region.width <= width && region.top + region.height <= height;
+    }
+}
+
+QRCodeScanner::QRCodeScanner(std::size_t capacity)
+    : _capacity(std::max<std::size_t>(capacity, 1U))
+{
+}
+
+QRCodeScanner::~QRCodeScanner()
+{
+    this->stop();
+}
+
+void QRCodeScanner::start(const Callback &callback)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if (this->_thread.joinable())
+    {
+        return;
+    }
+
+    this->_callback = callback;
+    this->_stop = false;
+    this->_reset = true;
+    this->_thread = std::thread(&QRCodeScanner::worker, this);
+}
+
+void QRCodeScanner::stop()
+{
+    std::thread thread;
+    std::deque<Frame> frames;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+        thread.swap(this->_thread);
+        frames.swap(this->_frames);
+    }
+    this->_wakeup.notify_all();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+    for (auto&& frame : frames)
+    {
+        release(frame);
+    }
+}
+
+bool QRCodeScanner::running() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_thread.joinable();
+}
+
+bool QRCodeScanner::submit(Frame frame)
+{
+    Frame dropped;
+    auto drop = false;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if (this->_stop)
+        {
+            drop = true;
+            dropped = std::move(frame);
+        }
+        else
+        {
+            if (this->_frames.size() >= this->_capacity)
+            {
+                drop = true;
+                dropped = std::move(this->_frames.front());
+                this->_frames.pop_front();
+            }
+            this->_frames.emplace_back(std::move(frame));
+        }
+        this->_dropped += drop ? 1U : 0U;
+    }
+    this->_wakeup.notify_one();
+
+    // the owner may reuse the buffer, release outside of the lock
+    if (drop)
+    {
+        release(dropped);
+    }
+    return !drop;
+}
+
+void QRCodeScanner::reset()
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_reset = true;
+}
+
+std::size_t QRCodeScanner::decodedFrames() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_decoded;
+}
+
+std::size_t QRCodeScanner::droppedFrames() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_dropped;
+}
+
+void QRCodeScanner::release(Frame &frame)
+{
+    if (frame.release)
+    {
+        frame.release();
+        frame.release = nullptr;
+    }
+}
+
+void QRCodeScanner::worker()
+{
+    for (;;)
+    {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_wakeup.wait(lock, [&]{
+                return this->_stop || !this->_frames.empty();
+            });
+            if (this->_stop)
+            {
+                return;
+            }
+
+            frame = std::move(this->_frames.front());
+            this->_frames.pop_front();
+            if (this->_reset)
+            {
+                this->_roi = QRCode::Region();
+                this->_last.clear();
+                this->_reset = false;
+            }
+        }
+
+        std::string data;
+        const auto found = this->scan(frame, data);
+        release(frame);
+
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            ++this->_decoded;
+        }
+
+        if (found && data != this->_last)
+        {
+            this->_last = data;
+            if (this->_callback)
+            {
+                this->_callback(data);
+            }
+        }
+    }
+}
+
+bool QRCodeScanner::scan(const Frame &frame, std::string &data)
+{
+    QRCode::Region bounds;
+
+    // the code is most likely still where it was in the last frame
+    if (fits(this->_roi, frame.width, frame.height) &&
+        QRCode::decode(frame.pixels, frame.width, frame.height, frame.stride, frame.format,
+                       this->_roi, data, &bounds, QRCode::Fast))
+    {
+        this->_roi = bounds.width > 0 ? expand(bounds, frame.width, frame.height) : this->_roi;
+        return true;
+    }
+
+    // frames arrive continuously, an exhaustive search isn't worth the latency
+    QRCode::Region whole;
+    whole.width = frame.width;
+    whole.height = frame.height;
+    if (QRCode::decode(frame.pixels, frame.width, frame.height, frame.stride, frame.format,
+                       whole, data, &bounds, QRCode::Normal))
+    {
+        this->_roi = bounds.width > 0 ? expand(bounds, frame.width, frame.height) : QRCode::Region();
+        return true;
+    }
+
+    this->_roi = QRCode::Region();
+    return false;
+}
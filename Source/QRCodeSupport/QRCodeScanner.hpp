@@ -0,0 +1,104 @@
+#ifndef QRCODESCANNER_HPP
+#define QRCODESCANNER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "QRCode.hpp"
+
+/**
+ * Continuous QR code scanning of camera frames
+ *
+ * Frames are decoded in place on a worker thread, submit() never blocks the
+ * capture or UI thread. The queue holds a few frames only, when the worker
+ * falls behind the oldest queued frame is dropped, so the scanner always
+ * works on recent frames at the camera frame rate.
+ *
+ * After a hit the region around the finder patterns is tracked, the next
+ * frames are decoded in that region first with the cheapest effort and only
+ * fall back to the whole frame when the code moved out of it.
+ *
+ * The callback runs on the worker thread, GUI applications must forward the
+ * result to their UI thread. A code is reported once until another code
+ * was seen or reset() is called.
+ *
+ */
+class QRCodeScanner
+{
+public:
+    struct Frame
+    {
+        // read in place until release is called
+        const std::uint8_t *pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int stride = 0;
+        QRCode::PixelFormat format = QRCode::Gray8;
+
+        // called exactly once when the scanner is done with the pixels (also for dropped frames)
+        std::function<void()> release;
+    };
+
+    using Callback = std::function<void(const std::string &data)>;
+
+    /**
+     * queue the given amount of frames at most (at least one)
+     */
+    QRCodeScanner(std::size_t capacity = 2U);
+
+    /**
+     * stop the worker and release all queued frames
+     */
+    ~QRCodeScanner();
+
+    QRCodeScanner(const QRCodeScanner&) = delete;
+    QRCodeScanner &operator= (const QRCodeScanner&) = delete;
+
+    // run the callback on the worker thread for every newly found code
+    // the callback must not call start() or stop()
+    void start(const Callback &callback);
+    void stop();
+    bool running() const;
+
+    // queue a frame, returns false when an older frame had to be dropped for it,
+    // frames submitted while the scanner isn't running are released right away
+    bool submit(Frame frame);
+
+    // forget the tracked region and the last reported code
+    void reset();
+
+    // statistics
+    std::size_t decodedFrames() const;
+    std::size_t droppedFrames() const;
+
+private:
+    static void release(Frame &frame);
+
+    void worker();
+    bool scan(const Frame &frame, std::string &data);
+
+    const std::size_t _capacity;
+    std::deque<Frame> _frames;
+
+    // only used by the worker
+    QRCode::Region _roi;
+    std::string _last;
+
+    std::size_t _decoded = 0U;
+    std::size_t _dropped = 0U;
+    bool _reset = false;
+
+    Callback _callback;
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _wakeup;
+    bool _stop = true;
+};
+
+#endif // QRCODESCANNER_HPP
@@ -0,0 +1,142 @@
+#include "QRCodeSheet.hpp"
+
+#include <Executor.hpp>
+
+#include <lodepng.h>
+#include <QRCodeGenerator/QrCode.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <string>
+
+namespace {
+    struct Code
+    {
+        int size = 0;
+        std::vector<bool> modules;
+    };
+
+    static bool encodeCode(std::string_view input, Code &code)
+    {
+        if (input.empty())
+        {
+            return false;
+        }
+
+        try {
+            const auto qr = qrcodegen::QrCode::encodeText(std::string(input).c_str(), qrcodegen::QrCode::Ecc::QUARTILE);
+            code.size = qr.getSize();
+            code.modules.resize(static_cast<std::size_t>(code.size * code.size));
+            for (auto y = 0; y < code.size; ++y)
+            {
+                for (auto x = 0; x < code.size; ++x)
+                {
+                    code.modules[static_cast<std::size_t>(y * code.size + x)] = qr.getModule(x, y);
+                }
+            }
+        } catch (const std::exception&) {
+            // too long for a QR code
+            return false;
+        }
+        return true;
+    }
+
+    static void parallel(Executor *executor, std::size_t count, const std::function<void(std::size_t)> &task)
+    {
+        const auto run = [&](std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i)
+            {
+                task(i);
+            }
+        };
+        if (executor && count > 1U)
+        {
+            executor->parallelFor(count, 1U, run);
+        }
+        else
+        {
+            run(0U, count);
+        }
+    }
+}
+
+QRCodeSheet::QRCodeSheet(Executor *executor)
+    : QRCodeSheet(Layout(), executor)
+{
+}
+
+QRCodeSheet::QRCodeSheet(const Layout &layout, Executor *executor)
+    : _layout(layout),
+      _executor(executor)
+{
+    this->_layout.columns = std::max(this->_layout.columns, 1);
+    this->_layout.rows = std::max(this->_layout.rows, 1);
+    this->_layout.scale = std::max(this->_layout.scale, 1);
+    this->_layout.border = std::max(this->_layout.border, 0);
+    this->_layout.margin = std::max(this->_layout.margin, 0);
+}
+
+bool QRCodeSheet::encodePage(const std::vector<std::string_view> &inputs, std::vector<std::uint8_t> &png) const
+{
+    png.clear();
+    if (inputs.empty() || inputs.size() > this->perPage())
+    {
+        return false;
+    }
+
+    std::vector<Code> codes(inputs.size());
+    std::atomic<bool> valid{true};
+    parallel(this->_executor, inputs.size(), [&](std::size_t i) {
+        if (!encodeCode(inputs[i], codes[i]))
+        {
+            valid = false;
+        }
+    });
+    if (!valid)
+    {
+        return false;
+    }
+
+    // every cell fits the largest code of the page, smaller codes are centered
+    auto modules = 0;
+    for (auto&& code : codes)
+    {
+        modules = std::max(modules, code.size);
+    }
+    const auto &l = this->_layout;
+    const auto cell = (modules + l.border * 2) * l.scale;
+    const auto usedRows = static_cast<int>((inputs.size() + static_cast<std::size_t>(l.columns) - 1U) / static_cast<std::size_t>(l.columns));
+    const auto width = l.margin * 2 + cell * l.columns;
+    const auto height = l.margin * 2 + cell * usedRows;
+    const auto stride = static_cast<std::size_t>(width);
+
+    std::vector<std::uint8_t> page(stride * static_cast<std::size_t>(height), 0xFF);
+
+    // cells don't overlap, they are drawn concurrently
+    parallel(this->_executor, codes.size(), [&](std::size_t i) {
+        const auto &code = codes[i];
+        const auto offset = (modules - code.size) / 2;
+        const auto left = l.margin + static_cast<int>(i % static_cast<std::size_t>(l.columns)) * cell + (l.border + offset) * l.scale;
+        const auto top = l.margin + static_cast<int>(i / static_cast<std::size_t>(l.columns)) * cell + (l.border + offset) * l.scale;
+        for (auto y = 0; y < code.size; ++y)
+        {
+            auto row = &page[static_cast<std::size_t>(top + y * l.scale) * stride + static_cast<std::size_t>(left)];
+            for (auto x = 0; x < code.size; ++x)
+            {
+                if (code.modules[static_cast<std::size_t>(y * code.size + x)])
+                {
+                    std::memset(row + x * l.scale, 0x00, static_cast<std::size_t>(l.scale));
+                }
+            }
+            for (auto copy = 1; copy < l.scale; ++copy)
+            {
+                std::memcpy(row + static_cast<std::size_t>(copy) * stride, row, static_cast<std::size_t>(code.size * l.scale));
+            }
+        }
+    });
+
+    return lodepng::encode(png, page, static_cast<unsigned>(width), static_cast<unsigned>(height), LCT_GREY, 8U) == 0U;
+}
@@ -0,0 +1,49 @@
+#ifndef QRCODESHEET_HPP
+#define QRCODESHEET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class Executor;
+
+/**
+ * Printable pages of QR codes
+ *
+ * The inputs of a page are encoded concurrently on the executor and drawn
+ * into a grid of equally sized cells, the page is written as an 8-bit
+ * grayscale PNG image. Only one page is held in memory at a time, callers
+ * stream their inputs page by page (see perPage()).
+ *
+ */
+class QRCodeSheet
+{
+public:
+    struct Layout
+    {
+        int columns = 3;
+        int rows = 4;
+        // pixels per module and the quiet zone around every code in modules
+        int scale = 6;
+        int border = 4;
+        // white space around the grid in pixels
+        int margin = 48;
+    };
+
+    explicit QRCodeSheet(Executor *executor = nullptr);
+    QRCodeSheet(const Layout &layout, Executor *executor = nullptr);
+
+    inline std::size_t perPage() const
+    { return static_cast<std::size_t>(this->_layout.columns * this->_layout.rows); }
+
+    // encodes up to perPage() inputs into a PNG image, the codes are placed row by row,
+    // returns false if an input is empty or too long for a QR code
+    bool encodePage(const std::vector<std::string_view> &inputs, std::vector<std::uint8_t> &png) const;
+
+private:
+    Layout _layout;
+    Executor *_executor;
+};
+
+#endif // QRCODESHEET_HPP
@@ -0,0 +1,150 @@
+#include "QRCodeTileScan.hpp"
+
+#include <Executor.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <utility>
+
+namespace {
+    // start of every tile along one side, the last one ends at the edge
+    static std::vector<int> offsets(int length, int size)
+    {
+        std::vector<int> starts{0};
+        const auto step = std::max(size / 2, 1);
+        for (auto start = step; start + size < length; start += step)
+        {
+            starts.emplace_back(start);
+        }
+        if (size < length)
+        {
+            starts.emplace_back(length - size);
+        }
+        return starts;
+    }
+}
+
+QRCodeTileScan::QRCodeTileScan(Executor *executor)
+    : QRCodeTileScan(Layout(), executor)
+{
+}
+
+QRCodeTileScan::QRCodeTileScan(const Layout &layout, Executor *executor)
+    : _layout(layout),
+      _executor(executor)
+{
+    this->_layout.smallTile = std::max(this->_layout.smallTile, 64);
+    this->_layout.largeTile = std::max(this->_layout.largeTile, this->_layout.smallTile);
+}
+
+std::vector<QRCode::Region> QRCodeTileScan::tiles(int width, int height, int size)
+{
+    std::vector<QRCode::Region> regions;
+    if (width <= 0 || height <= 0 || size <= 0)
+    {
+        return regions;
+    }
+
+    const auto tileWidth = std::min(size, width);
+    const auto tileHeight = std::min(size, height);
+    const auto columns = offsets(width, tileWidth);
+    const auto rows = offsets(height, tileHeight);
+    regions.reserve(columns.size() * rows.size());
+    for (auto&& top : rows)
+    {
+        for (auto&& left : columns)
+        {
+            QRCode::Region region;
+            region.left = left;
+            region.top = top;
+            region.width = tileWidth;
+            region.height = tileHeight;
+            regions.emplace_back(region);
+        }
+    }
+    return regions;
+}
+
+bool QRCodeTileScan::decode(const std::uint8_t *pixels, int width, int height, int stride, QRCode::PixelFormat format,
+                            const Accept &accept, std::string &data, QRCode::Region *bounds)
+{
+    data.clear();
+    this->_decoded.store(0U, std::memory_order_relaxed);
+    if (!pixels || width <= 0 || height <= 0)
+    {
+        return false;
+    }
+
+    // an image which fits into a small tile is decoded once as a whole
+    std::vector<std::pair<std::vector<QRCode::Region>, QRCode::Effort>> passes;
+    if (std::max(width, height) <= this->_layout.smallTile)
+    {
+        passes.emplace_back(tiles(width, height, this->_layout.smallTile), this->_layout.smallEffort);
+    }
+    else
+    {
+        passes.emplace_back(tiles(width, height, this->_layout.largeTile), this->_layout.largeEffort);
+        passes.emplace_back(tiles(width, height, this->_layout.smallTile), this->_layout.smallEffort);
+    }
+
+    std::mutex mutex;
+    std::atomic<bool> found{false};
+    for (auto&& pass : passes)
+    {
+        const auto &regions = pass.first;
+        const auto effort = pass.second;
+        const Executor::Task task = [&](std::size_t begin, std::size_t end) {
+            std::string text;
+            QRCode::Region box;
+            for (auto i = begin; i < end; ++i)
+            {
+                if (found.load(std::memory_order_acquire) || this->_stop.load(std::memory_order_acquire))
+                {
+                    return;
+                }
+
+                const auto success = QRCode::decode(pixels, width, height, stride, format, regions[i], text, &box, effort);
+                this->_decoded.fetch_add(1U, std::memory_order_relaxed);
+                if (!success || (accept && !accept(text)))
+                {
+                    continue;
+                }
+
+                // tiles overlap, the same code may be accepted twice
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!found.load(std::memory_order_relaxed))
+                {
+                    data = std::move(text);
+                    if (bounds)
+                    {
+                        *bounds = box;
+                    }
+                    found.store(true, std::memory_order_release);
+                }
+                return;
+            }
+        };
+
+        // one tile per chunk, empty tiles are much faster than tiles with a code
+        if (this->_executor && regions.size() > 1U)
+        {
+            this->_executor->parallelFor(regions.size(), 1U, task);
+        }
+        else
+        {
+            task(0U, regions.size());
+        }
+
+        if (found.load(std::memory_order_acquire) || this->_stop.load(std::memory_order_acquire))
+        {
+            break;
+        }
+    }
+
+    return found.load(std::memory_order_acquire) && !this->_stop.load(std::memory_order_acquire);
+}
+
+void QRCodeTileScan::cancel()
+{
+    this->_stop.store(true, std::memory_order_release);
+}
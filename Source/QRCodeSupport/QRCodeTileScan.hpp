@@ -0,0 +1,78 @@
+#ifndef QRCODETILESCAN_HPP
+#define QRCODETILESCAN_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "QRCode.hpp"
+
+class Executor;
+
+/**
+ * QR code search in large images (screenshots)
+ *
+ * A screenshot of a 4K desktop is too large to decode as a whole, a code on
+ * an enrollment page covers a few hundred pixels of it. The image is split
+ * into overlapping square tiles at two scales and every tile is decoded in
+ * place as a region of the buffer (see QRCode::decode), concurrently on the
+ * executor. The tiles overlap by half, so every code up to half of the
+ * tile size lies completely in one of them.
+ *
+ * The large tiles come first, the decoder reads them downscaled, which
+ * finds big codes cheaply. The small tiles follow at full resolution with
+ * the local threshold, they find small codes on busy pages. The search
+ * stops at the first code the accept function takes (for example a valid
+ * otpauth URI), the tiles which were already running finish their current
+ * decode only.
+ *
+ */
+class QRCodeTileScan
+{
+public:
+    struct Layout
+    {
+        // side of the tiles in pixels, large tiles are skipped if the image isn't larger
+        int smallTile = 768;
+        int largeTile = 2048;
+        QRCode::Effort smallEffort = QRCode::Normal;
+        QRCode::Effort largeEffort = QRCode::Fast;
+    };
+
+    // decides whether a decoded text ends the search, called concurrently
+    using Accept = std::function<bool(const std::string &data)>;
+
+    explicit QRCodeTileScan(Executor *executor = nullptr);
+    QRCodeTileScan(const Layout &layout, Executor *executor = nullptr);
+
+    QRCodeTileScan(const QRCodeTileScan&) = delete;
+    QRCodeTileScan &operator= (const QRCodeTileScan&) = delete;
+
+    // the pixels are read in place, data receives the first accepted text and bounds
+    // the box around its finder patterns, false if no tile held an accepted code
+    bool decode(const std::uint8_t *pixels, int width, int height, int stride, QRCode::PixelFormat format,
+                const Accept &accept, std::string &data, QRCode::Region *bounds = nullptr);
+
+    // ends a running decode() from another thread, it and all later calls return false
+    void cancel();
+
+    // tiles of the given size covering the image, overlapping by half, the last
+    // row and column are aligned to the edges, one tile if the image is smaller
+    static std::vector<QRCode::Region> tiles(int width, int height, int size);
+
+    // tiles decoded by the last decode()
+    inline std::size_t decodedTiles() const
+    { return this->_decoded.load(std::memory_order_relaxed); }
+
+private:
+    Layout _layout;
+    Executor *_executor;
+
+    std::atomic<bool> _stop{false};
+    std::atomic<std::size_t> _decoded{0U};
+};
+
+#endif // QRCODETILESCAN_HPP
@@ -0,0 +1,119 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+// parsing and answering the request lines of the verification server, shared by
+// the request handlers
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <AuditLog.hpp>
+
+#include "RequestHandler.hpp"
+
+namespace {
+    // accepted clock skew of time-based tokens in periods
+    static const constexpr unsigned int DEFAULT_WINDOW = 1U;
+    static const constexpr unsigned int MAX_WINDOW = 10U;
+
+    // searched counters of HOTP tokens
+    static const constexpr unsigned int DEFAULT_VERIFY_LOOK_AHEAD = 10U;
+    static const constexpr unsigned int DEFAULT_RESYNC_LOOK_AHEAD = 100U;
+    static const constexpr unsigned int MAX_LOOK_AHEAD = 1000U;
+
+    static const std::vector<std::string_view> split(const std::string_view &line)
+    {
+        std::vector<std::string_view> words;
+        std::size_t begin = 0U;
+        while (begin <= line.size())
+        {
+            auto end = line.find('\t', begin);
+            if (end == std::string_view::npos)
+            {
+                end = line.size();
+            }
+            words.emplace_back(line.substr(begin, end - begin));
+            begin = end + 1U;
+        }
+        return words;
+    }
+
+    template<typename T>
+    static bool parse_number(const std::string_view &str, T &value)
+    {
+        const auto res = std::from_chars(str.data(), str.data() + str.size(), value);
+        return res.ec == std::errc() && res.ptr == str.data() + str.size();
+    }
+
+    // optional window argument at the given position
+    static bool parse_window(const std::vector<std::string_view> &words, const std::size_t &position,
+                             const unsigned int &fallback, const unsigned int &max, unsigned int &window)
+    {
+        window = fallback;
+        if (words.size() <= position)
+        {
+            return true;
+        }
+        return parse_number(words[position], window) && window <= max;
+    }
+
+    // compares the whole code to not leak the position of the first mismatch
+    static bool equal_codes(const char *lhs, const std::string &rhs) noexcept
+    {
+        unsigned char diff = 0U;
+        std::size_t i = 0U;
+        for (; i < rhs.size() && lhs[i] != '\0'; ++i)
+        {
+            diff |= static_cast<unsigned char>(lhs[i] ^ rhs[i]);
+        }
+        return diff == 0U && i == rhs.size() && lhs[i] == '\0';
+    }
+
+    static const std::string error(const char *message)
+    {
+        return std::string("error\t") + message + "\n";
+    }
+
+    // generate and lookup hand out codes, only the owner of the Unix domain socket gets them,
+    // TCP peers aren't authenticated and may only prove that they know a code
+    static bool refused(const std::string_view &command, const RequestHandler::Origin &origin)
+    {
+        return origin == RequestHandler::Remote && (command == "generate" || command == "lookup");
+    }
+
+    // records the outcome of a generate, verify or resync request to the audit log,
+    // attempts for ids without a usable token are recorded as rejected
+    static void audit(AuditLog *log, const std::vector<std::string_view> &words, const std::string &response)
+    {
+        OTPToken::sqliteTokenID id;
+        if (!log || words.size() < 2U || !parse_number(words[1], id) || response == error("unknown request"))
+        {
+            return;
+        }
+
+        const auto ok = response.compare(0U, 3U, "ok\t") == 0;
+        if (words[0] == "generate" && ok)
+        {
+            log->record(id, AuditLog::Generated);
+        }
+        else if (words[0] == "verify" || words[0] == "resync")
+        {
+            if (response == error("too many attempts"))
+            {
+                log->record(id, AuditLog::Limited);
+            }
+            else if (ok && response != "ok\tmismatch\n")
+            {
+                log->record(id, words[0] == "verify" ? AuditLog::Verified : AuditLog::Resynced);
+            }
+            else
+            {
+                log->record(id, AuditLog::Rejected);
+            }
+        }
+    }
+}
+
+#endif // PROTOCOL_HPP
@@ -0,0 +1,48 @@
+#ifndef REQUESTHANDLER_HPP
+#define REQUESTHANDLER_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Answers the request lines the Server received
+ *
+ * The server asks the handler how its tokens are split into shards, every
+ * shard gets a job queue and workers of its own. Handlers without shards
+ * keep the defaults and get a single queue.
+ *
+ * Requests received on a TCP listener are Remote: anyone who can reach the
+ * address may send them, handlers answer only verify and resync for them.
+ * The Unix domain socket is Local, only its owner can connect.
+ *
+ */
+class RequestHandler
+{
+public:
+    enum Origin {
+        Local = 0,
+        Remote,
+    };
+
+    virtual ~RequestHandler() = default;
+
+    // shards of the tokens and the NUMA node of each shard, fixed at construction
+    virtual std::size_t shardCount() const
+    { return 1U; }
+    virtual std::size_t shardNode(const std::size_t &) const
+    { return 0U; }
+    // workers are bound to the node of their shard
+    virtual bool numa() const
+    { return false; }
+
+    // shard owning the token of the request
+    virtual std::size_t shardOf(const std::string &) const
+    { return 0U; }
+
+    // answer a batch of requests, one response line per request in the same order,
+    // called from multiple workers at once
+    virtual void handle(const std::vector<std::string> &requests, const Origin &origin, std::string &out) = 0;
+};
+
+#endif // REQUESTHANDLER_HPP
@@ -0,0 +1,605 @@
+#include "Server.hpp"
+#include "RequestHandler.hpp"
+
+#include <NumaTopology.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    // limits of a single connection, reading pauses while one of them is exceeded
+    static const constexpr std::size_t MAX_INPUT = 1024U * 1024U;
+    static const constexpr std::size_t MAX_OUTPUT = 4U * 1024U * 1024U;
+    // requests handed to a worker at once
+    static const constexpr std::size_t MAX_BATCH = 256U;
+    static const constexpr std::size_t READ_SIZE = 16U * 1024U;
+
+    // event tags, connections are tagged with their id
+    static const constexpr std::uint64_t WAKEUP_TAG = 0U;
+    static const constexpr std::uint64_t LISTENER_TAG = 1ULL << 63;
+}
+
+struct Server::Connection
+{
+    int fd = -1;
+    std::uint64_t id = 0U;
+    std::uint32_t events = 0U;
+    RequestHandler::Origin origin = RequestHandler::Remote;
+
+    std::string input;
+    std::string output;
+    std::size_t written = 0U;
+
+    // a batch of this connection is handled by a worker
+    bool busy = false;
+    // parts of the batch still handled by the shards and the responses of the finished ones
+    std::size_t pending = 0U;
+    std::vector<std::string> responses;
+    // the peer closed its side, the pending requests are still answered
+    bool eof = false;
+};
+
+Server::Server(RequestHandler &service, std::size_t workers)
+    : _service(service),
+      _worker_count(workers != 0U ? workers : std::max(1U, std::thread::hardware_concurrency()))
+{
+    this->_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    this->_wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // one queue per shard, fixed so queueDepth() can be read while serving
+    const auto shards = std::max<std::size_t>(1U, this->_service.shardCount());
+    for (auto i = 0U; i < shards; ++i)
+    {
+        this->_queues.emplace_back(new Queue());
+    }
+}
+
+Server::~Server()
+{
+    for (auto&& listener : this->_listeners)
+    {
+        ::close(listener.fd);
+    }
+    if (!this->_unix_path.empty())
+    {
+        ::unlink(this->_unix_path.c_str());
+    }
+    if (this->_wakeup >= 0)
+    {
+        ::close(this->_wakeup);
+    }
+    if (this->_epoll >= 0)
+    {
+        ::close(this->_epoll);
+    }
+}
+
+bool Server::listenUnix(const std::string &path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        std::fprintf(stderr, "Socket path is too long: %s\n", path.c_str());
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1U);
+
+    const auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "Unable to create the socket: %s\n", std::strerror(errno));
+        return false;
+    }
+
+    // a socket which accepts connections belongs to a running server, others are stale
+    const auto probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0 && ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0)
+    {
+        ::close(probe);
+        ::close(fd);
+        std::fprintf(stderr, "A server is already running on %s\n", path.c_str());
+        return false;
+    }
+    if (probe >= 0)
+    {
+        ::close(probe);
+    }
+    ::unlink(path.c_str());
+
+    // the socket must never be accessible by other users, not even briefly
+    const auto mask = ::umask(0077);
+    const auto bound = ::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    ::umask(mask);
+    if (bound != 0 || ::listen(fd, SOMAXCONN) != 0)
+    {
+        std::fprintf(stderr, "Unable to listen on %s: %s\n", path.c_str(), std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    this->_unix_path = path;
+    return this->addListener({fd, RequestHandler::Local});
+}
+
+bool Server::listenTcp(const std::string &address, const std::uint16_t &port, bool reuse_port)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    {
+        std::fprintf(stderr, "Invalid IPv4 address: %s\n", address.c_str());
+        return false;
+    }
+
+    const auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "Unable to create the socket: %s\n", std::strerror(errno));
+        return false;
+    }
+
+    const int enable = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (reuse_port && ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0)
+    {
+        std::fprintf(stderr, "Unable to share %s:%u with other processes: %s\n", address.c_str(), port, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+    {
+        std::fprintf(stderr, "Unable to listen on %s:%u: %s\n", address.c_str(), port, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    return this->addListener({fd, RequestHandler::Remote});
+}
+
+bool Server::addListener(const Listener &listener)
+{
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = LISTENER_TAG | this->_listeners.size();
+    if (this->_epoll < 0 || ::epoll_ctl(this->_epoll, EPOLL_CTL_ADD, listener.fd, &event) != 0)
+    {
+        ::close(listener.fd);
+        return false;
+    }
+
+    this->_listeners.emplace_back(listener);
+    return true;
+}
+
+bool Server::run()
+{
+    if (this->_epoll < 0 || this->_wakeup < 0 || this->_listeners.empty())
+    {
+        return false;
+    }
+
+    epoll_event wakeup;
+    wakeup.events = EPOLLIN;
+    wakeup.data.u64 = WAKEUP_TAG;
+    if (::epoll_ctl(this->_epoll, EPOLL_CTL_ADD, this->_wakeup, &wakeup) != 0)
+    {
+        return false;
+    }
+
+    // the workers are spread over the shards
+    const auto shards = this->_queues.size();
+    for (auto i = 0U; i < std::max(this->_worker_count, shards); ++i)
+    {
+        this->_workers.emplace_back(&Server::worker, this, i % shards);
+    }
+
+    epoll_event events[256];
+    while (!this->_stop.load())
+    {
+        const auto count = ::epoll_wait(this->_epoll, events, 256, -1);
+        if (count < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        for (auto i = 0; i < count; ++i)
+        {
+            const auto tag = events[i].data.u64;
+            if (tag == WAKEUP_TAG)
+            {
+                std::uint64_t value;
+                (void) ::read(this->_wakeup, &value, sizeof(value));
+                this->complete();
+                continue;
+            }
+            if (tag & LISTENER_TAG)
+            {
+                this->accept(this->_listeners[tag & ~LISTENER_TAG]);
+                continue;
+            }
+
+            // the connection may have been closed by an earlier event of this round
+            const auto it = this->_connections.find(tag);
+            if (it == this->_connections.end())
+            {
+                continue;
+            }
+            auto &connection = *it->second;
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN))
+            {
+                this->close(connection);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                this->writable(connection);
+            }
+            if ((events[i].events & EPOLLIN) && this->_connections.count(tag))
+            {
+                this->readable(connection);
+            }
+        }
+    }
+
+    for (auto&& queue : this->_queues)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->stop = true;
+            queue->jobs.clear();
+            queue->depth.store(0U, std::memory_order_relaxed);
+        }
+        queue->wakeup.notify_all();
+    }
+    for (auto&& worker : this->_workers)
+    {
+        worker.join();
+    }
+    this->_workers.clear();
+
+    for (auto&& connection : this->_connections)
+    {
+        ::close(connection.second->fd);
+    }
+    this->_connections.clear();
+    this->_completions.clear();
+    return true;
+}
+
+void Server::stop()
+{
+    this->_stop.store(true);
+    const std::uint64_t value = 1U;
+    (void) ::write(this->_wakeup, &value, sizeof(value));
+}
+
+void Server::accept(const Listener &listener)
+{
+    for (;;)
+    {
+        const auto fd = ::accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        // responses are small, don't wait for more data to send
+        const int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->fd = fd;
+        connection->id = this->_next_connection++;
+        connection->events = EPOLLIN;
+        connection->origin = listener.origin;
+
+        epoll_event event;
+        event.events = connection->events;
+        event.data.u64 = connection->id;
+        if (::epoll_ctl(this->_epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            ::close(fd);
+            continue;
+        }
+        this->_connections.emplace(connection->id, std::move(connection));
+    }
+}
+
+void Server::readable(Connection &connection)
+{
+    char buffer[READ_SIZE];
+    while (connection.input.size() < MAX_INPUT)
+    {
+        const auto res = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (res > 0)
+        {
+            connection.input.append(buffer, static_cast<std::size_t>(res));
+            continue;
+        }
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        // orderly shutdown or error
+        connection.eof = true;
+        if (res < 0)
+        {
+            this->close(connection);
+            return;
+        }
+        break;
+    }
+
+    // a line which doesn't fit into the input buffer is never answered
+    if (connection.input.size() >= MAX_INPUT && connection.input.find('\n') == std::string::npos)
+    {
+        this->close(connection);
+        return;
+    }
+
+    this->dispatch(connection);
+    if (connection.eof && !connection.busy && connection.written == connection.output.size())
+    {
+        this->close(connection);
+        return;
+    }
+    this->updateEvents(connection);
+}
+
+void Server::writable(Connection &connection)
+{
+    while (connection.written < connection.output.size())
+    {
+        const auto res = ::send(connection.fd, connection.output.data() + connection.written,
+                                connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (res <= 0)
+        {
+            this->close(connection);
+            return;
+        }
+        connection.written += static_cast<std::size_t>(res);
+    }
+
+    if (connection.written == connection.output.size())
+    {
+        connection.output.clear();
+        connection.written = 0U;
+        if (connection.eof && !connection.busy)
+        {
+            this->close(connection);
+            return;
+        }
+    }
+    this->updateEvents(connection);
+}
+
+void Server::dispatch(Connection &connection)
+{
+    if (connection.busy)
+    {
+        return;
+    }
+
+    Job job{connection.id, connection.origin, {}, {}};
+    std::size_t begin = 0U;
+    while (job.requests.size() < MAX_BATCH)
+    {
+        const auto end = connection.input.find('\n', begin);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        auto length = end - begin;
+        if (length != 0U && connection.input[end - 1U] == '\r')
+        {
+            --length;
+        }
+        job.requests.emplace_back(connection.input, begin, length);
+        begin = end + 1U;
+    }
+    if (job.requests.empty())
+    {
+        return;
+    }
+    connection.input.erase(0U, begin);
+    connection.busy = true;
+
+    // a batch for a single shard is handed over as it is
+    std::vector<std::size_t> shards(job.requests.size());
+    for (auto i = 0U; i < job.requests.size(); ++i)
+    {
+        shards[i] = this->_service.shardOf(job.requests[i]);
+    }
+    if (std::all_of(shards.begin(), shards.end(), [&](const std::size_t &shard) { return shard == shards[0]; }))
+    {
+        connection.pending = 1U;
+        this->enqueue(shards[0], std::move(job));
+        return;
+    }
+
+    std::vector<Job> parts(this->_queues.size(), Job{connection.id, connection.origin, {}, {}});
+    for (auto i = 0U; i < job.requests.size(); ++i)
+    {
+        parts[shards[i]].requests.emplace_back(std::move(job.requests[i]));
+        parts[shards[i]].positions.emplace_back(i);
+    }
+    connection.responses.assign(job.requests.size(), {});
+    connection.pending = 0U;
+    for (auto i = 0U; i < parts.size(); ++i)
+    {
+        if (!parts[i].requests.empty())
+        {
+            ++connection.pending;
+            this->enqueue(i, std::move(parts[i]));
+        }
+    }
+}
+
+std::size_t Server::queueDepth() const
+{
+    std::size_t depth = 0U;
+    for (auto&& queue : this->_queues)
+    {
+        depth += queue->depth.load(std::memory_order_relaxed);
+    }
+    return depth;
+}
+
+void Server::enqueue(std::size_t shard, Job job)
+{
+    auto &queue = *this->_queues[shard];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.emplace_back(std::move(job));
+        queue.depth.store(queue.jobs.size(), std::memory_order_relaxed);
+    }
+    queue.wakeup.notify_one();
+}
+
+void Server::complete()
+{
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(this->_completions_mutex);
+        completions.swap(this->_completions);
+    }
+
+    for (auto&& completion : completions)
+    {
+        const auto it = this->_connections.find(completion.connection);
+        if (it == this->_connections.end())
+        {
+            continue;
+        }
+
+        auto &connection = *it->second;
+        if (completion.positions.empty())
+        {
+            connection.output += completion.responses;
+        }
+        else
+        {
+            // one response line per request of the part
+            std::size_t begin = 0U;
+            for (auto&& position : completion.positions)
+            {
+                const auto end = completion.responses.find('\n', begin) + 1U;
+                connection.responses[position].assign(completion.responses, begin, end - begin);
+                begin = end;
+            }
+        }
+        if (--connection.pending != 0U)
+        {
+            continue;
+        }
+        for (auto&& response : connection.responses)
+        {
+            connection.output += response;
+        }
+        connection.responses.clear();
+        connection.busy = false;
+
+        // the next batch is handled while the responses are sent
+        this->dispatch(connection);
+        this->writable(connection);
+    }
+}
+
+void Server::close(Connection &connection)
+{
+    ::epoll_ctl(this->_epoll, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+
+    // a batch in flight is dropped on completion
+    this->_connections.erase(connection.id);
+}
+
+void Server::updateEvents(Connection &connection)
+{
+    std::uint32_t events = 0U;
+    if (!connection.eof && connection.input.size() < MAX_INPUT &&
+        connection.output.size() - connection.written < MAX_OUTPUT)
+    {
+        events |= EPOLLIN;
+    }
+    if (connection.written < connection.output.size())
+    {
+        events |= EPOLLOUT;
+    }
+
+    if (events != connection.events)
+    {
+        epoll_event event;
+        event.events = events;
+        event.data.u64 = connection.id;
+        ::epoll_ctl(this->_epoll, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+void Server::worker(std::size_t shard)
+{
+    // the tokens of the shard are in the memory of its node
+    if (this->_service.numa())
+    {
+        NumaTopology::system().pinThread(this->_service.shardNode(shard));
+    }
+
+    auto &queue = *this->_queues[shard];
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.wakeup.wait(lock, [&]{
+                return queue.stop || !queue.jobs.empty();
+            });
+            if (queue.stop)
+            {
+                return;
+            }
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            queue.depth.store(queue.jobs.size(), std::memory_order_relaxed);
+        }
+
+        Completion completion{job.connection, {}, std::move(job.positions)};
+        this->_service.handle(job.requests, job.origin, completion.responses);
+
+        {
+            std::lock_guard<std::mutex> lock(this->_completions_mutex);
+            this->_completions.emplace_back(std::move(completion));
+        }
+        const std::uint64_t value = 1U;
+        (void) ::write(this->_wakeup, &value, sizeof(value));
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "RequestHandler.hpp"
+
+/**
+ * Event loop of the verification server
+ *
+ * One thread multiplexes all sockets with epoll, the requests are answered
+ * by a fixed pool of worker threads. Connections stay open for any number
+ * of requests, clients may send further requests before the responses
+ * arrived (pipelining). The complete lines received on a connection are
+ * handed to a worker as one batch, only one batch per connection is in
+ * flight, so the responses are sent in the order of the requests.
+ *
+ * Reading from a connection pauses while its unanswered input or its
+ * unsent output exceeds the buffer limits.
+ *
+ * Every shard of the service has a job queue and workers of its own, with
+ * NUMA placement the workers are bound to the node of their shard. The
+ * requests of a batch are routed to the shards owning their tokens and
+ * the responses are merged in the order of the requests.
+ *
+ * Several processes can serve the same TCP port when all of them listen
+ * with reuse_port, the kernel spreads the connections over the processes.
+ *
+ */
+class Server
+{
+public:
+    // 0 workers uses one thread per hardware thread, every shard gets at least one
+    Server(RequestHandler &service, std::size_t workers = 0U);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server &operator= (const Server&) = delete;
+
+    // listen on a Unix domain socket only the owner can connect to
+    bool listenUnix(const std::string &path);
+    // listen on an IPv4 address, with reuse_port other processes may listen on it too (SO_REUSEPORT),
+    // its requests are handled as Remote
+    bool listenTcp(const std::string &address, const std::uint16_t &port, bool reuse_port = false);
+
+    // serve requests until stop() is called, returns false when the loop couldn't start
+    bool run();
+
+    // ends run() and closes all connections, safe to call from a signal handler
+    void stop();
+
+    // batches waiting for a worker, read without locking the queues
+    std::size_t queueDepth() const;
+
+private:
+    struct Connection;
+
+    struct Job
+    {
+        std::uint64_t connection;
+        RequestHandler::Origin origin;
+        std::vector<std::string> requests;
+        // position of every request in the batch, empty for a whole batch
+        std::vector<std::size_t> positions;
+    };
+
+    struct Completion
+    {
+        std::uint64_t connection;
+        std::string responses;
+        std::vector<std::size_t> positions;
+    };
+
+    // jobs of the workers of one shard
+    struct Queue
+    {
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::deque<Job> jobs;
+        bool stop = false;
+        // size of jobs for readers without the mutex
+        std::atomic<std::size_t> depth{0U};
+    };
+
+    struct Listener
+    {
+        int fd;
+        RequestHandler::Origin origin;
+    };
+
+    bool addListener(const Listener &listener);
+    void accept(const Listener &listener);
+    void readable(Connection &connection);
+    void writable(Connection &connection);
+    void dispatch(Connection &connection);
+    void enqueue(std::size_t shard, Job job);
+    void complete();
+    void close(Connection &connection);
+    void updateEvents(Connection &connection);
+    void worker(std::size_t shard);
+
+    RequestHandler &_service;
+    std::size_t _worker_count;
+
+    int _epoll = -1;
+    int _wakeup = -1;
+    std::vector<Listener> _listeners;
+    std::string _unix_path;
+
+    std::unordered_map<std::uint64_t, std::unique_ptr<Connection>> _connections;
+    std::uint64_t _next_connection = 1U;
+    std::atomic<bool> _stop{false};
+
+    std::vector<std::thread> _workers;
+    std::vector<std::unique_ptr<Queue>> _queues;
+
+    std::mutex _completions_mutex;
+    std::vector<Completion> _completions;
+};
+
+#endif // SERVER_HPP
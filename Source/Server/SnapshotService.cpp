@@ -0,0 +1,213 @@
+#include "SnapshotService.hpp"
+#include "Protocol.hpp"
+#include "TokenSnapshot.hpp"
+
+#include <Clock.hpp>
+#include <OTPGen.hpp>
+#include <PerfStats.hpp>
+#include <RateLimiter.hpp>
+#include <UsedCodeStore.hpp>
+
+SnapshotService::SnapshotService(const TokenSnapshot &snapshot, UsedCodeStore &used, RateLimiter *limiter)
+    : _snapshot(snapshot),
+      _used(used),
+      _limiter(limiter)
+{
+}
+
+bool SnapshotService::attempt(const OTPToken::sqliteTokenID &id) const
+{
+    return !this->_limiter || this->_limiter->acquire(id) == RateLimiter::Allowed;
+}
+
+const std::string SnapshotService::refill(const OTPToken::sqliteTokenID &id, const std::string &response) const
+{
+    if (this->_limiter && response.compare(0U, 3U, "ok\t") == 0 && response != "ok\tmismatch\n")
+    {
+        this->_limiter->reset(id, RateLimiter::now());
+    }
+    return response;
+}
+
+void SnapshotService::handle(const std::vector<std::string> &requests, const Origin &origin, std::string &out)
+{
+    const auto now = Clock::current();
+    for (auto&& request : requests)
+    {
+        const auto words = split(request);
+        const auto &command = words[0];
+
+        std::string response;
+        if (refused(command, origin))
+        {
+            response = error("only answered on the Unix domain socket");
+        }
+        else if (command == "generate" && words.size() == 2U)
+        {
+            response = this->generate(words[1], now);
+        }
+        else if (command == "verify" && (words.size() == 3U || words.size() == 4U))
+        {
+            response = this->verify(words[1], std::string(words[2]), words, now);
+        }
+        else if (command == "resync" && (words.size() == 4U || words.size() == 5U))
+        {
+            response = this->resync(words[1], std::string(words[2]), std::string(words[3]), words);
+        }
+        else if (command == "lookup" && words.size() == 2U)
+        {
+            response = error("lookup is not available with worker processes");
+        }
+        else
+        {
+            response = error("unknown request");
+        }
+        audit(this->_audit, words, response);
+        out += response;
+    }
+}
+
+const std::string SnapshotService::generate(const std::string_view &id, const std::time_t &now) const
+{
+    OTPGEN_PERF_SCOPE("SnapshotService::generate", Generate);
+    OTPToken::sqliteTokenID value;
+    const auto record = parse_number(id, value) ? this->_snapshot.find(value) : nullptr;
+    if (!record)
+    {
+        return error("no usable token with this id");
+    }
+
+    const auto key = this->_snapshot.key(*record);
+    OTPGen::TokenBuffer code;
+    auto generated = false;
+    if (record->type == OTPToken::HOTP)
+    {
+        const auto counter = static_cast<OTPToken::CounterType>(this->_snapshot.state(*record).load(std::memory_order_acquire));
+        generated = OTPGen::computeHOTPInto(code, key, counter, record->digits);
+    }
+    else if (record->type == OTPToken::Steam)
+    {
+        generated = OTPGen::computeSteamInto(code, now, key);
+    }
+    else
+    {
+        generated = OTPGen::computeTOTPInto(code, now, key, record->digits, record->period);
+    }
+
+    if (!generated)
+    {
+        return error("unable to generate a code for this token");
+    }
+    return std::string("ok\t") + code + "\t" + std::to_string(OTPToken::secondsUntilRotation(record->period, now)) + "\n";
+}
+
+const std::string SnapshotService::verify(const std::string_view &id, const std::string &code,
+                                          const std::vector<std::string_view> &words, const std::time_t &now)
+{
+    OTPGEN_PERF_SCOPE("SnapshotService::verify", Verify);
+    OTPToken::sqliteTokenID value;
+    const auto record = parse_number(id, value) ? this->_snapshot.find(value) : nullptr;
+    if (!record)
+    {
+        return error("no usable token with this id");
+    }
+
+    const auto hotp = record->type == OTPToken::HOTP;
+    unsigned int window;
+    if (!parse_window(words, 3U, hotp ? DEFAULT_VERIFY_LOOK_AHEAD : DEFAULT_WINDOW,
+                      hotp ? MAX_LOOK_AHEAD : MAX_WINDOW, window))
+    {
+        return error("invalid window");
+    }
+    if (!this->attempt(record->id))
+    {
+        return error("too many attempts");
+    }
+
+    const auto key = this->_snapshot.key(*record);
+    auto &state = this->_snapshot.state(*record);
+    if (hotp)
+    {
+        // a counter taken by another worker in between is searched again from the new one
+        auto counter = state.load(std::memory_order_acquire);
+        for (;;)
+        {
+            OTPToken::CounterType next;
+            if (!OTPGen::resyncHOTP(key, static_cast<OTPToken::CounterType>(counter), record->digits, code, {}, window, next))
+            {
+                return "ok\tmismatch\n";
+            }
+            if (state.compare_exchange_weak(counter, next, std::memory_order_acq_rel))
+            {
+                return this->refill(record->id, "ok\tmatch\n");
+            }
+        }
+    }
+
+    if (record->type == OTPToken::Steam)
+    {
+        // all steps are compared, the time of the match is not leaked
+        auto match = false;
+        const auto window_seconds = static_cast<std::time_t>(window) * record->period;
+        for (auto time = now - window_seconds; time <= now + window_seconds; time += record->period)
+        {
+            OTPGen::TokenBuffer expected;
+            if (OTPGen::computeSteamInto(expected, time, key))
+            {
+                match |= equal_codes(expected, code);
+            }
+        }
+        return this->refill(record->id, match ? "ok\tmatch\n" : "ok\tmismatch\n");
+    }
+
+    // the drift is learned by the worker which accepted the code, a concurrent update wins
+    auto packed = state.load(std::memory_order_acquire);
+    auto drift = TokenSnapshot::drift(packed);
+    if (!OTPGen::verifyTOTP(key, code, now, window, record->digits, record->period, this->_used, record->id,
+                            nullptr, nullptr, &drift))
+    {
+        return "ok\tmismatch\n";
+    }
+    state.compare_exchange_strong(packed, drift.pack(), std::memory_order_acq_rel);
+    return this->refill(record->id, "ok\tmatch\n");
+}
+
+const std::string SnapshotService::resync(const std::string_view &id, const std::string &first, const std::string &second,
+                                          const std::vector<std::string_view> &words)
+{
+    OTPToken::sqliteTokenID value;
+    const auto record = parse_number(id, value) ? this->_snapshot.find(value) : nullptr;
+    unsigned int look_ahead;
+    if (!record)
+    {
+        return error("no usable token with this id");
+    }
+    else if (record->type != OTPToken::HOTP)
+    {
+        return error("only HOTP tokens can be resynchronized");
+    }
+    else if (!parse_window(words, 4U, DEFAULT_RESYNC_LOOK_AHEAD, MAX_LOOK_AHEAD, look_ahead))
+    {
+        return error("invalid look-ahead");
+    }
+    else if (!this->attempt(record->id))
+    {
+        return error("too many attempts");
+    }
+
+    const auto key = this->_snapshot.key(*record);
+    auto &state = this->_snapshot.state(*record);
+    auto counter = state.load(std::memory_order_acquire);
+    for (;;)
+    {
+        OTPToken::CounterType next;
+        if (!OTPGen::resyncHOTP(key, static_cast<OTPToken::CounterType>(counter), record->digits, first, second, look_ahead, next))
+        {
+            return error("the codes don't match any counter in the look-ahead window");
+        }
+        if (state.compare_exchange_weak(counter, next, std::memory_order_acq_rel))
+        {
+            return this->refill(record->id, "ok\t" + std::to_string(next) + "\n");
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SNAPSHOTSERVICE_HPP
+#define SNAPSHOTSERVICE_HPP
+
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <OTPToken.hpp>
+
+#include "RequestHandler.hpp"
+
+class AuditLog;
+class RateLimiter;
+class TokenSnapshot;
+class UsedCodeStore;
+
+/**
+ * Request handling of the worker processes of the verification server
+ *
+ * Answers the requests of TokenService from a TokenSnapshot shared by all
+ * workers, nothing is kept per token in the process: the record of the
+ * token is looked up in the snapshot and its key is restored for the
+ * request. The replay store is shared too, a code accepted by one worker
+ * is rejected by all others.
+ *
+ * HOTP counters and the learned clock drifts are the state words of the
+ * snapshot, a worker advances a counter with compare-and-swap, so two
+ * workers never accept the same counter. The process which built the
+ * snapshot writes them to the database.
+ *
+ * The rate limiter is shared like the replay store, the attempts of a token
+ * are taken before its key is restored. The audit log isn't shared, every
+ * worker writes its own file.
+ *
+ * lookup isn't answered, without code caches it would compute the codes of
+ * every token.
+ *
+ */
+class SnapshotService : public RequestHandler
+{
+public:
+    // the limiter isn't owned, nullptr doesn't limit the attempts
+    SnapshotService(const TokenSnapshot &snapshot, UsedCodeStore &used, RateLimiter *limiter = nullptr);
+
+    SnapshotService(const SnapshotService&) = delete;
+    SnapshotService &operator= (const SnapshotService&) = delete;
+
+    // log of the answered requests, not owned, must be set before requests are handled
+    inline void setAuditLog(AuditLog *log)
+    { this->_audit = log; }
+
+    // all requests of a batch are answered for the same time
+    void handle(const std::vector<std::string> &requests, const Origin &origin, std::string &out) override;
+
+private:
+    const std::string generate(const std::string_view &id, const std::time_t &now) const;
+    const std::string verify(const std::string_view &id, const std::string &code,
+                             const std::vector<std::string_view> &words, const std::time_t &now);
+    const std::string resync(const std::string_view &id, const std::string &first, const std::string &second,
+                             const std::vector<std::string_view> &words);
+
+    // takes an attempt of the token, a matched code refills them
+    bool attempt(const OTPToken::sqliteTokenID &id) const;
+    const std::string refill(const OTPToken::sqliteTokenID &id, const std::string &response) const;
+
+    const TokenSnapshot &_snapshot;
+    UsedCodeStore &_used;
+    RateLimiter *_limiter;
+    AuditLog *_audit = nullptr;
+};
+
+#endif // SNAPSHOTSERVICE_HPP
@@ -0,0 +1,645 @@
+#include "TokenService.hpp"
+#include "Protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <Clock.hpp>
+#include <CodeCoalescer.hpp>
+#include <OTPGen.hpp>
+#include <PerfStats.hpp>
+#include <RateLimiter.hpp>
+#include <TokenCodeCache.hpp>
+#include <UsedCodeStore.hpp>
+
+namespace {
+    // polling interval while the requests on replaced tokens finish
+    static const constexpr std::chrono::milliseconds GRACE_POLL(1);
+}
+
+struct TokenService::VerifyBatch
+{
+    OTPToken::DigitType digits;
+    OTPToken::PeriodType period;
+    unsigned int window;
+
+    std::vector<OTPKey> keys;
+    std::vector<OTPToken::TokenString> codes;
+    std::vector<OTPToken::sqliteTokenID> ids;
+    std::vector<ClockDrift> drifts;
+    // index of the request and the entry of every verification
+    std::vector<std::size_t> requests;
+    std::vector<Entry*> entries;
+};
+
+TokenService::Shard::Shard(const std::size_t &node, bool huge_pages)
+    : node(node),
+      entries(NodeAllocator<Entry>(node, huge_pages))
+{
+}
+
+TokenService::TokenService(bool numa, bool huge_pages)
+    : _numa(numa),
+      _huge_pages(huge_pages),
+      _state(std::make_shared<State>()),
+      _used(new UsedCodeStore())
+{
+    // one shard per node with CPUs, a single one without NUMA placement
+    const auto &topology = NumaTopology::system();
+    for (auto node = 0U; this->_numa && node < topology.nodeCount(); ++node)
+    {
+        if (!topology.cpus(node).empty())
+        {
+            this->_nodes.emplace_back(node);
+        }
+    }
+    if (this->_nodes.empty())
+    {
+        this->_nodes.emplace_back(0U);
+    }
+}
+
+TokenService::~TokenService()
+{
+}
+
+std::size_t TokenService::size() const
+{
+    return std::atomic_load(&this->_state)->index.size();
+}
+
+std::size_t TokenService::usedCodes() const
+{
+    return this->_used->occupancy(Clock::current());
+}
+
+std::size_t TokenService::usedCodeCapacity() const
+{
+    return this->_used->capacity();
+}
+
+TokenDatabase::Error TokenService::load()
+{
+    const auto &topology = NumaTopology::system();
+    const auto &nodes = this->_nodes;
+
+    // updates from here on may be missing in the tokens read below
+    {
+        std::lock_guard<std::mutex> lock(this->_counters);
+        this->_reloading = true;
+        this->_reload_counters.clear();
+        this->_reload_drifts.clear();
+    }
+
+    // tokens which can't generate codes are answered with an error
+    std::vector<std::vector<OTPToken>> tokens(nodes.size());
+    std::vector<std::vector<ClockDrift>> drifts(nodes.size());
+    const auto status = TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+        if (!token.isValid())
+        {
+            return;
+        }
+        const auto shard = static_cast<std::size_t>(token.id()) % nodes.size();
+        ClockDrift drift;
+        if (token.type() == OTPToken::TOTP)
+        {
+            TokenDatabase::getClockDrift(token.id(), drift);
+        }
+        tokens[shard].emplace_back(token);
+        drifts[shard].emplace_back(drift);
+    }, false);
+
+    if (status != TokenDatabase::Success)
+    {
+        std::lock_guard<std::mutex> lock(this->_counters);
+        this->_reloading = false;
+        return status;
+    }
+
+    // the secrets of the ids may have changed, the new tokens share no codes with the old ones
+    auto state = std::make_shared<State>();
+    state->shared.reset(new CodeCoalescer());
+    for (auto&& node : nodes)
+    {
+        state->shards.emplace_back(new Shard(node, this->_huge_pages));
+    }
+
+    // the memory of a shard is first touched by a thread of its node, so the pages
+    // (and the worker of the code cache, which inherits the binding) stay on the node
+    if (!this->_numa)
+    {
+        this->build(*state->shards[0], 0U, tokens[0], drifts[0]);
+    }
+    else
+    {
+        std::vector<std::thread> builders;
+        for (auto i = 0U; i < state->shards.size(); ++i)
+        {
+            builders.emplace_back([&, i]{
+                topology.pinThread(state->shards[i]->node);
+                this->build(*state->shards[i], i, tokens[i], drifts[i]);
+            });
+        }
+        for (auto&& builder : builders)
+        {
+            builder.join();
+        }
+    }
+
+    for (auto&& shard : state->shards)
+    {
+        for (auto&& entry : shard->entries)
+        {
+            state->index.emplace(entry.id, &entry);
+        }
+    }
+
+    // publish together with the updates stored meanwhile
+    std::shared_ptr<State> old;
+    {
+        std::lock_guard<std::mutex> lock(this->_counters);
+        for (auto&& counter : this->_reload_counters)
+        {
+            const auto it = state->index.find(counter.first);
+            if (it != state->index.end() && it->second->type == OTPToken::HOTP)
+            {
+                it->second->counter = counter.second;
+            }
+        }
+        for (auto&& drift : this->_reload_drifts)
+        {
+            const auto it = state->index.find(drift.first);
+            if (it != state->index.end() && it->second->type == OTPToken::TOTP)
+            {
+                it->second->drift = drift.second;
+            }
+        }
+        this->_reloading = false;
+        this->_reload_counters.clear();
+        this->_reload_drifts.clear();
+        old = std::atomic_exchange(&this->_state, state);
+    }
+
+    // grace period: the requests which started on the old tokens hold the only other references,
+    // the caches and keys are released here instead of at the end of one of these requests
+    state.reset();
+    while (old.use_count() > 1)
+    {
+        std::this_thread::sleep_for(GRACE_POLL);
+    }
+    old.reset();
+    return TokenDatabase::Success;
+}
+
+void TokenService::build(Shard &shard, const std::size_t &index, const std::vector<OTPToken> &tokens,
+                         const std::vector<ClockDrift> &drifts)
+{
+    std::vector<OTPToken> time_based;
+    shard.entries.reserve(tokens.size());
+    for (auto i = 0U; i < tokens.size(); ++i)
+    {
+        const auto &token = tokens[i];
+        Entry entry;
+        entry.id = token.id();
+        entry.type = token.type();
+        entry.digits = token.type() == OTPToken::Steam ? OTPToken::defaultDigitLength(OTPToken::Steam) : token.digitLength();
+        entry.period = token.rotationPeriod();
+        entry.counter = token.counter();
+        entry.drift = drifts[i];
+        entry.shard = index;
+
+        entry.key = OTPGen::prepareKey(token.secret(), token.type() == OTPToken::Steam ? OTPToken::SHA1 : token.algorithm());
+        if (!entry.key.isValid())
+        {
+            continue;
+        }
+
+        if (entry.type != OTPToken::HOTP)
+        {
+            entry.cache_index = time_based.size();
+            time_based.emplace_back(token);
+            shard.cached.emplace_back(shard.entries.size());
+        }
+        shard.entries.emplace_back(std::move(entry));
+    }
+
+    shard.cache.reset(new TokenCodeCache(time_based));
+    shard.cache->start();
+}
+
+std::size_t TokenService::shardOf(const std::string &request) const
+{
+    // the id is the second word of all requests addressing a token
+    const auto begin = request.find('\t');
+    if (this->_nodes.size() <= 1U || begin == std::string::npos || request.compare(0U, begin, "lookup") == 0)
+    {
+        return 0U;
+    }
+    const auto end = request.find('\t', begin + 1U);
+    OTPToken::sqliteTokenID id;
+    if (!parse_number(std::string_view(request).substr(begin + 1U, end == std::string::npos ? std::string::npos : end - begin - 1U), id))
+    {
+        return 0U;
+    }
+    return static_cast<std::size_t>(id) % this->_nodes.size();
+}
+
+TokenService::Entry *TokenService::entry(const State &state, const std::string_view &id)
+{
+    OTPToken::sqliteTokenID value;
+    if (!parse_number(id, value))
+    {
+        return nullptr;
+    }
+
+    const auto it = state.index.find(value);
+    return it == state.index.end() ? nullptr : it->second;
+}
+
+void TokenService::handle(const std::vector<std::string> &requests, const Origin &origin, std::string &out)
+{
+    const auto now = Clock::current();
+    // the whole batch is answered from the same tokens
+    const auto state = std::atomic_load(&this->_state);
+
+    std::vector<std::string> responses(requests.size());
+    std::vector<VerifyBatch> batches;
+    const auto attempt_time = this->_limiter ? RateLimiter::now() : 0U;
+
+    for (auto i = 0U; i < requests.size(); ++i)
+    {
+        const auto words = split(requests[i]);
+        const auto &command = words[0];
+        auto &response = responses[i];
+
+        if (refused(command, origin))
+        {
+            response = error("only answered on the Unix domain socket");
+        }
+        else if (command == "generate" && words.size() == 2U)
+        {
+            const auto token = entry(*state, words[1]);
+            response = token ? this->generate(*state, *token, now) : error("no usable token with this id");
+        }
+        else if (command == "verify" && (words.size() == 3U || words.size() == 4U))
+        {
+            const auto token = entry(*state, words[1]);
+            if (!token)
+            {
+                response = error("no usable token with this id");
+                continue;
+            }
+
+            const auto hotp = token->type == OTPToken::HOTP;
+            unsigned int window;
+            if (!parse_window(words, 3U, hotp ? DEFAULT_VERIFY_LOOK_AHEAD : DEFAULT_WINDOW,
+                              hotp ? MAX_LOOK_AHEAD : MAX_WINDOW, window))
+            {
+                response = error("invalid window");
+                continue;
+            }
+
+            // a pending code of the same token is verified first, a match refills the attempts
+            // this request takes
+            if (this->_limiter && token->type == OTPToken::TOTP && pending(batches, token->id))
+            {
+                this->verifyBatches(*state, now, attempt_time, batches, responses);
+            }
+
+            // refused before any code is computed
+            if (!this->attempt(token->id, attempt_time))
+            {
+                response = error("too many attempts");
+                continue;
+            }
+
+            const std::string code(words[2]);
+            if (hotp)
+            {
+                response = this->verifyHOTP(*token, code, window);
+                this->refill(token->id, attempt_time, response == "ok\tmatch\n");
+            }
+            else if (token->type == OTPToken::Steam)
+            {
+                response = this->verifySteam(*token, code, window, now);
+                this->refill(token->id, attempt_time, response == "ok\tmatch\n");
+            }
+            else
+            {
+                // TOTP codes are verified together after all requests were parsed
+                auto batch = batches.begin();
+                for (; batch != batches.end(); ++batch)
+                {
+                    if (batch->digits == token->digits && batch->period == token->period && batch->window == window)
+                    {
+                        break;
+                    }
+                }
+                if (batch == batches.end())
+                {
+                    batches.push_back({token->digits, token->period, window, {}, {}, {}, {}, {}, {}});
+                    batch = batches.end() - 1;
+                }
+                batch->keys.emplace_back(token->key);
+                batch->codes.emplace_back(code);
+                batch->ids.emplace_back(token->id);
+                batch->requests.emplace_back(i);
+                batch->entries.emplace_back(token);
+            }
+        }
+        else if (command == "resync" && (words.size() == 4U || words.size() == 5U))
+        {
+            const auto token = entry(*state, words[1]);
+            unsigned int look_ahead;
+            if (!token)
+            {
+                response = error("no usable token with this id");
+            }
+            else if (token->type != OTPToken::HOTP)
+            {
+                response = error("only HOTP tokens can be resynchronized");
+            }
+            else if (!parse_window(words, 4U, DEFAULT_RESYNC_LOOK_AHEAD, MAX_LOOK_AHEAD, look_ahead))
+            {
+                response = error("invalid look-ahead");
+            }
+            else if (!this->attempt(token->id, attempt_time))
+            {
+                response = error("too many attempts");
+            }
+            else
+            {
+                response = this->resync(*token, std::string(words[2]), std::string(words[3]), look_ahead);
+                this->refill(token->id, attempt_time, response.compare(0U, 3U, "ok\t") == 0);
+            }
+        }
+        else if (command == "lookup" && words.size() == 2U)
+        {
+            response = this->lookup(*state, words[1], now);
+        }
+        else
+        {
+            response = error("unknown request");
+        }
+    }
+
+    this->verifyBatches(*state, now, attempt_time, batches, responses);
+
+    for (auto i = 0U; i < responses.size(); ++i)
+    {
+        if (this->_audit)
+        {
+            audit(this->_audit, split(requests[i]), responses[i]);
+        }
+        out += responses[i];
+    }
+}
+
+bool TokenService::pending(const std::vector<VerifyBatch> &batches, const OTPToken::sqliteTokenID &id)
+{
+    for (auto&& batch : batches)
+    {
+        if (std::find(batch.ids.begin(), batch.ids.end(), id) != batch.ids.end())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TokenService::verifyBatches(const State &state, const std::time_t &now, const std::uint64_t &attempt_time,
+                                 std::vector<VerifyBatch> &batches, std::vector<std::string> &responses)
+{
+    std::vector<std::uint8_t> matched;
+    for (auto&& batch : batches)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->_counters);
+            for (auto&& entry : batch.entries)
+            {
+                batch.drifts.emplace_back(this->latest(*entry).drift);
+            }
+        }
+
+#ifdef OTPGEN_WITH_PERF_STATS
+        const auto start = std::chrono::steady_clock::now();
+#endif
+        OTPGen::verifyTOTPBatch(batch.keys, batch.codes, batch.ids, now, batch.window, batch.digits, batch.period,
+                                *this->_used, matched, nullptr, batch.drifts.data(), state.shared.get());
+        this->saveDrifts(batch);
+#ifdef OTPGEN_WITH_PERF_STATS
+        // every request of the batch waited for the whole batch
+        const auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        for (auto i = 0U; i < batch.requests.size(); ++i)
+        {
+            PerfStats::record(PerfStats::Verify, ns);
+        }
+#endif
+        for (auto i = 0U; i < batch.requests.size(); ++i)
+        {
+            responses[batch.requests[i]] = matched[i] ? "ok\tmatch\n" : "ok\tmismatch\n";
+            this->refill(batch.ids[i], attempt_time, matched[i] != 0U);
+        }
+    }
+    batches.clear();
+}
+
+const std::string TokenService::generate(const State &state, const Entry &entry, const std::time_t &now) const
+{
+    OTPGEN_PERF_SCOPE("TokenService::generate", Generate);
+    OTPGen::TokenBuffer code;
+    auto generated = false;
+
+    if (entry.type == OTPToken::HOTP)
+    {
+        OTPToken::CounterType counter;
+        {
+            std::lock_guard<std::mutex> lock(this->_counters);
+            counter = this->latest(entry).counter;
+        }
+        generated = OTPGen::computeHOTPInto(code, entry.key, counter, entry.digits);
+    }
+    else if (state.shards[entry.shard]->cache->code(entry.cache_index, now, code))
+    {
+        generated = true;
+    }
+    else if (entry.type == OTPToken::Steam)
+    {
+        generated = OTPGen::computeSteamInto(code, now, entry.key);
+    }
+    else
+    {
+        generated = OTPGen::computeTOTPInto(code, now, entry.key, entry.digits, entry.period);
+    }
+
+    if (!generated)
+    {
+        return error("unable to generate a code for this token");
+    }
+    return std::string("ok\t") + code + "\t" + std::to_string(OTPToken::secondsUntilRotation(entry.period, now)) + "\n";
+}
+
+const std::string TokenService::verifyHOTP(Entry &token, const std::string &code, const unsigned int &window)
+{
+    OTPGEN_PERF_SCOPE("TokenService::verifyHOTP", Verify);
+    std::lock_guard<std::mutex> lock(this->_counters);
+    auto &entry = this->latest(token);
+
+    OTPToken::CounterType next;
+    if (!OTPGen::resyncHOTP(entry.key, entry.counter, entry.digits, code, {}, window, next))
+    {
+        return "ok\tmismatch\n";
+    }
+
+    // a code may only be used once
+    if (!this->saveCounter(entry, next))
+    {
+        return error("unable to save the counter");
+    }
+    return "ok\tmatch\n";
+}
+
+const std::string TokenService::verifySteam(const Entry &entry, const std::string &code,
+                                            const unsigned int &window, const std::time_t &now)
+{
+    OTPGEN_PERF_SCOPE("TokenService::verifySteam", Verify);
+    // all steps are compared, the time of the match is not leaked
+    auto match = false;
+    std::time_t matched = 0;
+    const auto window_seconds = static_cast<std::time_t>(window) * entry.period;
+    for (auto time = now - window_seconds; time <= now + window_seconds; time += entry.period)
+    {
+        OTPGen::TokenBuffer expected;
+        if (OTPGen::computeSteamInto(expected, time, entry.key))
+        {
+            const auto equal = equal_codes(expected, code);
+            matched = equal && !match ? time : matched;
+            match |= equal;
+        }
+    }
+    if (!match)
+    {
+        return "ok\tmismatch\n";
+    }
+
+    // a code may only be used once, like the TOTP codes of verifyTOTPBatch()
+    const auto step = matched / entry.period;
+    const auto expiry = (step + static_cast<std::time_t>(window) + 1) * entry.period;
+    switch (this->_used->insert(entry.id, static_cast<std::uint64_t>(step), expiry, now))
+    {
+        case UsedCodeStore::Accepted:
+            return "ok\tmatch\n";
+        case UsedCodeStore::Reused:
+            OTPGEN_PERF_COUNT(CodesReused, 1U);
+            break;
+        case UsedCodeStore::Full:
+            break;
+    }
+    return "ok\tmismatch\n";
+}
+
+const std::string TokenService::resync(Entry &token, const std::string &first, const std::string &second,
+                                       const unsigned int &look_ahead)
+{
+    std::lock_guard<std::mutex> lock(this->_counters);
+    auto &entry = this->latest(token);
+
+    OTPToken::CounterType next;
+    if (!OTPGen::resyncHOTP(entry.key, entry.counter, entry.digits, first, second, look_ahead, next))
+    {
+        return error("the codes don't match any counter in the look-ahead window");
+    }
+    if (!this->saveCounter(entry, next))
+    {
+        return error("unable to save the counter");
+    }
+    return "ok\t" + std::to_string(next) + "\n";
+}
+
+bool TokenService::attempt(const OTPToken::sqliteTokenID &id, const std::uint64_t &now)
+{
+    return !this->_limiter || this->_limiter->acquire(id, now) == RateLimiter::Allowed;
+}
+
+void TokenService::refill(const OTPToken::sqliteTokenID &id, const std::uint64_t &now, bool matched)
+{
+    if (this->_limiter && matched)
+    {
+        this->_limiter->reset(id, now);
+    }
+}
+
+TokenService::Entry &TokenService::latest(const Entry &entry) const
+{
+    // entries are only published with the counter mutex held, so the entry stays while it is held
+    const auto &state = *std::atomic_load(&this->_state);
+    const auto it = state.index.find(entry.id);
+    if (it == state.index.end() || it->second->type != entry.type)
+    {
+        // removed by a reload, the requests in flight finish on the old entry
+        return const_cast<Entry&>(entry);
+    }
+    return *it->second;
+}
+
+bool TokenService::saveCounter(Entry &entry, const OTPToken::CounterType &counter)
+{
+    // a record in the counter journal, the database itself isn't written
+    if (TokenDatabase::setCounter(entry.id, counter) != TokenDatabase::Success)
+    {
+        return false;
+    }
+
+    entry.counter = counter;
+    if (this->_reloading)
+    {
+        this->_reload_counters[entry.id] = counter;
+    }
+    return true;
+}
+
+void TokenService::saveDrifts(const VerifyBatch &batch)
+{
+    std::lock_guard<std::mutex> lock(this->_counters);
+
+    // the drift settles after a few matches, so a steady token is not written again,
+    // a failed write only loses what was learned since the last start
+    for (auto i = 0U; i < batch.entries.size(); ++i)
+    {
+        auto &entry = this->latest(*batch.entries[i]);
+        if (entry.drift != batch.drifts[i])
+        {
+            entry.drift = batch.drifts[i];
+            TokenDatabase::setClockDrift(entry.id, entry.drift);
+            if (this->_reloading)
+            {
+                this->_reload_drifts[entry.id] = entry.drift;
+            }
+        }
+    }
+}
+
+const std::string TokenService::lookup(const State &state, const std::string_view &code, const std::time_t &now) const
+{
+    // every shard caches the codes of its own tokens
+    std::string response("ok");
+    std::vector<std::size_t> indices;
+    for (auto&& shard : state.shards)
+    {
+        if (!shard->cache->findCode(code, now, indices))
+        {
+            continue;
+        }
+        for (auto&& index : indices)
+        {
+            response += "\t" + std::to_string(shard->entries[shard->cached[index]].id);
+        }
+    }
+    if (response.size() == 2U)
+    {
+        return error("no token shows this code");
+    }
+    return response + "\n";
+}
@@ -0,0 +1,204 @@
+#ifndef TOKENSERVICE_HPP
+#define TOKENSERVICE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <ClockDrift.hpp>
+#include <NumaTopology.hpp>
+#include <OTPToken.hpp>
+#include <OTPKey.hpp>
+#include <TokenDatabase.hpp>
+
+#include "RequestHandler.hpp"
+
+class AuditLog;
+class CodeCoalescer;
+class RateLimiter;
+class TokenCodeCache;
+class UsedCodeStore;
+
+/**
+ * Request handling of the verification server
+ *
+ * All tokens of the open database are prepared once, the codes of the
+ * time-based tokens are served from a code cache. Requests are a single
+ * line of tab-separated words, tokens are addressed by their id:
+ *
+ *  -> generate<TAB>id: ok<TAB>code<TAB>remaining seconds
+ *  -> verify<TAB>id<TAB>code[<TAB>window]: ok<TAB>match or ok<TAB>mismatch
+ *  -> resync<TAB>id<TAB>code<TAB>next code[<TAB>look-ahead]: ok<TAB>new counter
+ *  -> lookup<TAB>code: ok<TAB>id[<TAB>id...] of the time-based tokens currently showing the code
+ *
+ * generate and lookup are refused for Remote requests (TCP), which aren't
+ * authenticated. Failed requests are answered with error<TAB>message. A matching HOTP code
+ * and a successful resync advance the counter, which is saved to the
+ * database. A TOTP code is accepted only once, a reused code is answered
+ * as mismatch. With a rate limiter every verify and resync takes an attempt
+ * of the token before any code is computed, a token without attempts left
+ * is answered with an error, a match refills its attempts before later
+ * requests of the same batch for the token take theirs. With an audit
+ * log the outcome of every generate, verify and resync request is recorded
+ * after the batch was answered. The clock drift of TOTP tokens is learned from accepted
+ * codes and stored in the database, verification starts at the learned
+ * step. handle() may be called from multiple threads at once, concurrent
+ * verifications of the same token share the computed codes.
+ *
+ * The tokens are split into shards by their id. With NUMA placement every
+ * node with CPUs owns a shard: its prepared keys and its code cache are
+ * built by a thread bound to the node in memory of the node, optionally
+ * backed by 2 MB pages. Requests for a token are best answered by a thread
+ * of the node owning it (see shardOf()), every thread can answer any
+ * request though.
+ *
+ * load() may run while requests are handled: the new tokens are prepared
+ * next to the current ones and published at once (read-copy-update), the
+ * requests in flight finish on the tokens they started with. The old tokens
+ * are released by load() after the last of these requests is answered.
+ * Counters and drifts learned during a reload are carried over.
+ *
+ */
+class TokenService : public RequestHandler
+{
+public:
+    // numa gives every NUMA node a shard, huge_pages backs the keys of the shards with 2 MB pages
+    TokenService(bool numa = false, bool huge_pages = false);
+    ~TokenService();
+
+    TokenService(const TokenService&) = delete;
+    TokenService &operator= (const TokenService&) = delete;
+
+    // prepare all tokens of the open database and start the code caches, replaces
+    // the loaded tokens without interrupting requests, only one load() at a time
+    TokenDatabase::Error load();
+
+    // amount of usable tokens
+    std::size_t size() const;
+
+    // attempt limits of verify and resync, not owned, nullptr (the default) doesn't limit them,
+    // must be set before requests are handled
+    inline void setRateLimiter(RateLimiter *limiter)
+    { this->_limiter = limiter; }
+
+    // log of the answered requests, not owned, nullptr (the default) doesn't record them,
+    // must be set before requests are handled
+    inline void setAuditLog(AuditLog *log)
+    { this->_audit = log; }
+
+    // codes in the replay store which are still valid, and the slots of the store
+    std::size_t usedCodes() const;
+    std::size_t usedCodeCapacity() const;
+
+    // shards of the tokens and the NUMA node of each shard, fixed at construction
+    std::size_t shardCount() const override
+    { return this->_nodes.size(); }
+    std::size_t shardNode(const std::size_t &shard) const override
+    { return this->_nodes[shard]; }
+    bool numa() const override
+    { return this->_numa; }
+
+    // shard owning the token of the request, requests without a token belong to shard 0
+    std::size_t shardOf(const std::string &request) const override;
+
+    // answer a batch of requests, one response line per request in the same order
+    // all requests of a batch are answered for the same time
+    void handle(const std::vector<std::string> &requests, const Origin &origin, std::string &out) override;
+
+private:
+    struct Entry
+    {
+        OTPToken::sqliteTokenID id = 0;
+        OTPToken::TokenType type = OTPToken::None;
+        OTPToken::DigitType digits = 0U;
+        OTPToken::PeriodType period = 0U;
+        OTPKey key;
+
+        // shard of the token and its index in the code cache of the shard, time-based tokens only
+        std::size_t shard = 0U;
+        std::size_t cache_index = 0U;
+
+        // HOTP counter, guarded by the counter mutex
+        OTPToken::CounterType counter = 0U;
+        // learned clock drift of TOTP tokens, guarded by the counter mutex
+        ClockDrift drift;
+    };
+
+    // the entries and the code cache of the tokens of one NUMA node
+    struct Shard
+    {
+        Shard(const std::size_t &node, bool huge_pages);
+
+        std::size_t node;
+        std::vector<Entry, NodeAllocator<Entry>> entries;
+        std::unique_ptr<TokenCodeCache> cache;
+        // entry of every token in the code cache
+        std::vector<std::size_t> cached;
+    };
+
+    // the loaded tokens, replaced as a whole by load() and accessed with the atomic shared_ptr functions
+    struct State
+    {
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::unordered_map<OTPToken::sqliteTokenID, Entry*> index;
+        // codes shared by concurrent verifications of the same token and step
+        std::unique_ptr<CodeCoalescer> shared;
+    };
+
+    // TOTP verifications of a batch which share their parameters
+    struct VerifyBatch;
+
+    // prepares the tokens of the shard and starts its code cache
+    void build(Shard &shard, const std::size_t &index, const std::vector<OTPToken> &tokens,
+               const std::vector<ClockDrift> &drifts);
+
+    static Entry *entry(const State &state, const std::string_view &id);
+
+    const std::string generate(const State &state, const Entry &entry, const std::time_t &now) const;
+    const std::string verifyHOTP(Entry &entry, const std::string &code, const unsigned int &window);
+    const std::string verifySteam(const Entry &entry, const std::string &code,
+                                  const unsigned int &window, const std::time_t &now);
+    const std::string resync(Entry &entry, const std::string &first, const std::string &second,
+                             const unsigned int &look_ahead);
+    const std::string lookup(const State &state, const std::string_view &code, const std::time_t &now) const;
+
+    // the entry of the token in the published tokens, which replaced the given one during a reload,
+    // the counter mutex must be held
+    Entry &latest(const Entry &entry) const;
+    // takes an attempt of the token from the rate limiter, true if there was one
+    bool attempt(const OTPToken::sqliteTokenID &id, const std::uint64_t &now);
+    // a matched code refills the attempts of the token
+    void refill(const OTPToken::sqliteTokenID &id, const std::uint64_t &now, bool matched);
+    // stores the new counter of a HOTP token, the counter mutex must be held
+    bool saveCounter(Entry &entry, const OTPToken::CounterType &counter);
+    // stores the learned drift of TOTP tokens after a batch, changes only
+    void saveDrifts(const VerifyBatch &batch);
+    // true if a code of the token waits in one of the batches
+    static bool pending(const std::vector<VerifyBatch> &batches, const OTPToken::sqliteTokenID &id);
+    // verifies the waiting TOTP codes, answers their requests and refills the attempts of matched
+    // tokens, the batches are empty afterwards
+    void verifyBatches(const State &state, const std::time_t &now, const std::uint64_t &attempt_time,
+                       std::vector<VerifyBatch> &batches, std::vector<std::string> &responses);
+
+    bool _numa;
+    bool _huge_pages;
+    std::vector<std::size_t> _nodes;
+
+    std::shared_ptr<State> _state;
+    // used codes stay used across reloads
+    std::unique_ptr<UsedCodeStore> _used;
+    RateLimiter *_limiter = nullptr;
+    AuditLog *_audit = nullptr;
+
+    mutable std::mutex _counters;
+    // counters and drifts stored while a reload prepares the new tokens, guarded by the counter mutex
+    bool _reloading = false;
+    std::unordered_map<OTPToken::sqliteTokenID, OTPToken::CounterType> _reload_counters;
+    std::unordered_map<OTPToken::sqliteTokenID, ClockDrift> _reload_drifts;
+};
+
+#endif // TOKENSERVICE_HPP
@@ -0,0 +1,226 @@
+#include "TokenSnapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include <OTPGen.hpp>
+#include <SecureMemory.hpp>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    // zeroed shared memory of the processes forked later on, nullptr on failure
+    static void *map_shared(std::size_t size)
+    {
+        const auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+        {
+            return nullptr;
+        }
+#ifdef MADV_DONTDUMP
+        (void) ::madvise(data, size, MADV_DONTDUMP);
+#endif
+        return data;
+    }
+}
+
+TokenSnapshot::TokenSnapshot()
+    : _owner(::getpid())
+{
+}
+
+TokenSnapshot::~TokenSnapshot()
+{
+    this->release();
+}
+
+void TokenSnapshot::release()
+{
+    // the forked processes only drop their mapping
+    const auto owner = this->_owner == ::getpid();
+    if (this->_data)
+    {
+        if (owner && ::mprotect(this->_data, this->_data_size, PROT_READ | PROT_WRITE) == 0)
+        {
+            SecureMemory::wipe(this->_data, this->_data_size);
+        }
+        (void) ::munmap(this->_data, this->_data_size);
+    }
+    if (this->_states)
+    {
+        (void) ::munmap(this->_states, this->_states_size);
+    }
+    this->_data = nullptr;
+    this->_states = nullptr;
+    this->_count = 0U;
+}
+
+TokenDatabase::Error TokenSnapshot::build()
+{
+    struct Prepared
+    {
+        Record record;
+        OTPKey key;
+        std::uint64_t state = 0U;
+    };
+
+    // tokens which can't generate codes are left out
+    std::vector<Prepared> tokens;
+    std::size_t key_bytes = 0U;
+    const auto status = TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken &token) {
+        if (!token.isValid())
+        {
+            return;
+        }
+
+        const auto steam = token.type() == OTPToken::Steam;
+        Prepared prepared;
+        prepared.key = OTPGen::prepareKey(token.secret(), steam ? OTPToken::SHA1 : token.algorithm());
+        if (!prepared.key.isValid() || prepared.key.key().size() > std::numeric_limits<std::uint16_t>::max())
+        {
+            return;
+        }
+
+        auto &record = prepared.record;
+        record.id = token.id();
+        record.type = token.type();
+        record.algorithm = prepared.key.algorithm();
+        record.digits = steam ? OTPToken::defaultDigitLength(OTPToken::Steam) : token.digitLength();
+        record.period = token.rotationPeriod();
+        record.key_size = static_cast<std::uint16_t>(prepared.key.key().size());
+        std::memcpy(record.inner, prepared.key.innerState(), OTPKey::HMAC_STATE_SIZE);
+        std::memcpy(record.outer, prepared.key.outerState(), OTPKey::HMAC_STATE_SIZE);
+
+        if (token.type() == OTPToken::HOTP)
+        {
+            prepared.state = token.counter();
+        }
+        else if (token.type() == OTPToken::TOTP)
+        {
+            ClockDrift drift;
+            TokenDatabase::getClockDrift(token.id(), drift);
+            prepared.state = drift.pack();
+        }
+
+        key_bytes += record.key_size;
+        tokens.emplace_back(std::move(prepared));
+    }, false);
+
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+    if (key_bytes > std::numeric_limits<std::uint32_t>::max())
+    {
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    std::sort(tokens.begin(), tokens.end(), [](const Prepared &lhs, const Prepared &rhs) {
+        return lhs.record.id < rhs.record.id;
+    });
+
+    // a snapshot without tokens still maps a page, so find() has something to search
+    this->_data_size = std::max<std::size_t>(1U, tokens.size() * sizeof(Record) + key_bytes);
+    this->_states_size = std::max<std::size_t>(1U, tokens.size()) * sizeof(std::atomic<std::uint64_t>);
+    this->_data = static_cast<unsigned char*>(map_shared(this->_data_size));
+    this->_states = static_cast<std::atomic<std::uint64_t>*>(map_shared(this->_states_size));
+    if (!this->_data || !this->_states)
+    {
+        this->release();
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    auto records = reinterpret_cast<Record*>(this->_data);
+    auto keys = this->_data + tokens.size() * sizeof(Record);
+    std::uint32_t offset = 0U;
+    this->_persisted.resize(tokens.size());
+    for (auto i = 0U; i < tokens.size(); ++i)
+    {
+        auto &record = *new (&records[i]) Record(tokens[i].record);
+        record.key_offset = offset;
+        std::memcpy(keys + offset, tokens[i].key.key().data(), record.key_size);
+        offset += record.key_size;
+
+        new (&this->_states[i]) std::atomic<std::uint64_t>(tokens[i].state);
+        this->_persisted[i] = tokens[i].state;
+        SecureMemory::wipe(&tokens[i].record, sizeof(Record));
+    }
+    this->_count = tokens.size();
+
+    // a stray write of a worker can't change the keys of the others
+    (void) ::mprotect(this->_data, this->_data_size, PROT_READ);
+    return TokenDatabase::Success;
+}
+
+const TokenSnapshot::Record *TokenSnapshot::find(const OTPToken::sqliteTokenID &id) const
+{
+    const auto records = reinterpret_cast<const Record*>(this->_data);
+    const auto end = records + this->_count;
+    const auto it = std::lower_bound(records, end, id, [](const Record &record, const OTPToken::sqliteTokenID &value) {
+        return record.id < value;
+    });
+    return it != end && it->id == id ? it : nullptr;
+}
+
+OTPKey TokenSnapshot::key(const Record &record) const
+{
+    const auto keys = this->_data + this->_count * sizeof(Record);
+    return OTPGen::restoreKey(keys + record.key_offset, record.key_size, record.algorithm, record.inner, record.outer);
+}
+
+std::atomic<std::uint64_t> &TokenSnapshot::state(const Record &record) const
+{
+    return this->_states[&record - reinterpret_cast<const Record*>(this->_data)];
+}
+
+std::size_t TokenSnapshot::persist()
+{
+    const auto records = reinterpret_cast<const Record*>(this->_data);
+    std::size_t written = 0U;
+    for (auto i = 0U; i < this->_count; ++i)
+    {
+        const auto value = this->_states[i].load(std::memory_order_acquire);
+        if (value == this->_persisted[i])
+        {
+            continue;
+        }
+
+        // a failed write is tried again by the next call
+        const auto &record = records[i];
+        const auto status = record.type == OTPToken::HOTP ?
+            TokenDatabase::setCounter(record.id, static_cast<OTPToken::CounterType>(value)) :
+            TokenDatabase::setClockDrift(record.id, drift(value));
+        if (status == TokenDatabase::Success)
+        {
+            this->_persisted[i] = value;
+            ++written;
+        }
+    }
+    return written;
+}
+
+void TokenSnapshot::merge(const TokenSnapshot &other)
+{
+    const auto records = reinterpret_cast<const Record*>(this->_data);
+    for (auto i = 0U; i < this->_count; ++i)
+    {
+        const auto &record = records[i];
+        const auto old = other.find(record.id);
+        if (!old || old->type != record.type || record.type == OTPToken::Steam)
+        {
+            continue;
+        }
+
+        // the counter only moves forward, the drift of the old workers is the latest one
+        const auto value = other.state(*old).load(std::memory_order_acquire);
+        const auto current = this->_states[i].load(std::memory_order_acquire);
+        if (record.type == OTPToken::HOTP && value <= current)
+        {
+            continue;
+        }
+        this->_states[i].store(value, std::memory_order_release);
+    }
+}
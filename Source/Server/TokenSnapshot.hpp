@@ -0,0 +1,98 @@
+#ifndef TOKENSNAPSHOT_HPP
+#define TOKENSNAPSHOT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <ClockDrift.hpp>
+#include <OTPKey.hpp>
+#include <OTPToken.hpp>
+#include <TokenDatabase.hpp>
+
+#include <sys/types.h>
+
+/**
+ * Prepared tokens of the open database for the worker processes
+ *
+ * build() writes the prepared keys of all usable tokens into a shared
+ * anonymous mapping as a flat array of records sorted by id, followed by
+ * the decoded key bytes, and seals it read-only. Processes forked after
+ * the build map the same pages, the tokens are held once per node instead
+ * of once per worker.
+ *
+ * Every record has a word in a second, writable shared mapping: the counter
+ * of HOTP tokens and the packed clock drift of TOTP tokens. The workers
+ * update the words with compare-and-swap, persist() is called by the
+ * process which built the snapshot and writes the changed ones to the
+ * database.
+ *
+ * Only the process which built the snapshot wipes the mappings, the forked
+ * processes leave them to the others.
+ *
+ */
+class TokenSnapshot
+{
+public:
+    struct Record
+    {
+        OTPToken::sqliteTokenID id = 0;
+        OTPToken::PeriodType period = 0U;
+        // position of the key bytes after the records
+        std::uint32_t key_offset = 0U;
+        std::uint16_t key_size = 0U;
+        OTPToken::TokenType type = OTPToken::None;
+        OTPToken::ShaAlgorithm algorithm = OTPToken::Invalid;
+        OTPToken::DigitType digits = 0U;
+        unsigned char inner[OTPKey::HMAC_STATE_SIZE] = {};
+        unsigned char outer[OTPKey::HMAC_STATE_SIZE] = {};
+    };
+
+    TokenSnapshot();
+    ~TokenSnapshot();
+
+    TokenSnapshot(const TokenSnapshot&) = delete;
+    TokenSnapshot &operator= (const TokenSnapshot&) = delete;
+
+    // prepares the tokens of the open database, can be called once
+    TokenDatabase::Error build();
+
+    inline std::size_t size() const
+    { return this->_count; }
+
+    // record of the token, nullptr if it isn't in the snapshot
+    const Record *find(const OTPToken::sqliteTokenID &id) const;
+
+    // the prepared key of the record, no key schedule is computed
+    OTPKey key(const Record &record) const;
+
+    // counter of HOTP tokens, packed drift of TOTP tokens
+    std::atomic<std::uint64_t> &state(const Record &record) const;
+
+    static inline ClockDrift drift(const std::uint64_t &state)
+    { return ClockDrift::unpack(static_cast<ClockDrift::Packed>(state)); }
+
+    // writes the counters and drifts changed since the last call to the database, returns the amount
+    std::size_t persist();
+
+    // takes the newer counters and the drifts of the tokens of an older snapshot,
+    // the processes using the other snapshot must have stopped
+    void merge(const TokenSnapshot &other);
+
+private:
+    void release();
+
+    pid_t _owner = 0;
+    std::size_t _count = 0U;
+
+    unsigned char *_data = nullptr;
+    std::size_t _data_size = 0U;
+    std::atomic<std::uint64_t> *_states = nullptr;
+    std::size_t _states_size = 0U;
+
+    // the state words the database holds
+    std::vector<std::uint64_t> _persisted;
+};
+
+#endif // TOKENSNAPSHOT_HPP
@@ -0,0 +1,664 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <AppConfig.hpp>
+#include <MetricsEndpoint.hpp>
+#include <StdinEchoMode.hpp>
+
+#include <Clock.hpp>
+#include <TokenDatabase.hpp>
+
+#include "Server.hpp"
+#include "SnapshotService.hpp"
+#include "TokenService.hpp"
+#include "TokenSnapshot.hpp"
+
+#include <AuditLog.hpp>
+#include <AutoTuner.hpp>
+#include <RateLimiter.hpp>
+#include <UsedCodeStore.hpp>
+
+#include <sago/platform_folders.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+static Server *active_server = nullptr;
+// SIGHUP wakes the reload thread through the pipe, a 1 ends it
+static int reload_pipe[2] = {-1, -1};
+
+// interval in which the supervisor of the worker processes writes the counters and reaps workers
+static const constexpr int SUPERVISOR_INTERVAL_MS = 1000;
+
+static void stop_server(int)
+{
+    if (active_server)
+    {
+        active_server->stop();
+    }
+}
+
+static void request_reload(int)
+{
+    const char byte = 0;
+    (void) ::write(reload_pipe[1], &byte, 1U);
+}
+
+static void request_stop(int)
+{
+    const char byte = 1;
+    (void) ::write(reload_pipe[1], &byte, 1U);
+}
+
+// applies the delta and reloads the database, true when the tokens have to be prepared again
+static bool reload_database(const std::string &delta_file)
+{
+    auto changed = false;
+    if (!delta_file.empty() && ::access(delta_file.c_str(), F_OK) == 0)
+    {
+        // a delta is applied once
+        const auto applied = TokenDatabase::applyDelta(delta_file);
+        if (applied != TokenDatabase::Success)
+        {
+            std::cerr << "Unable to apply the delta: " << TokenDatabase::getErrorMessage(applied) << std::endl;
+            return false;
+        }
+        std::remove(delta_file.c_str());
+        changed = true;
+    }
+
+    auto reloaded = false;
+    const auto status = TokenDatabase::reloadTokens(&reloaded);
+    if (status != TokenDatabase::Success)
+    {
+        std::cerr << "Unable to reload the token database: " << TokenDatabase::getErrorMessage(status) << std::endl;
+        return false;
+    }
+    return changed || reloaded;
+}
+
+// the tokens are replaced while the requests are answered, a failed reload keeps the loaded tokens
+static void reload_tokens(TokenService &service, const std::string &delta_file)
+{
+    if (!reload_database(delta_file))
+    {
+        return;
+    }
+
+    const auto loaded = service.load();
+    if (loaded != TokenDatabase::Success)
+    {
+        std::cerr << "Unable to prepare the tokens: " << TokenDatabase::getErrorMessage(loaded) << std::endl;
+        return;
+    }
+    std::cerr << "Reloaded, serving " << service.size() << " tokens" << std::endl;
+}
+
+// audit log of every worker and the password of the database, the path is empty without logging
+struct AuditSetup
+{
+    std::string path;
+    SecureString password;
+};
+
+// a worker process serving the snapshot on the shared port, never returns
+static void run_worker(const TokenSnapshot &snapshot, UsedCodeStore &used, RateLimiter *limiter,
+                       const std::size_t &workers, const std::string &address, const std::uint16_t &port,
+                       const AuditSetup &audit_setup, const std::size_t &slot)
+{
+#if defined(__linux__)
+    // the workers don't outlive the supervisor which writes their counters
+    ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+    for (auto&& sig : {SIGINT, SIGTERM})
+    {
+        std::signal(sig, &stop_server);
+    }
+    std::signal(SIGHUP, SIG_IGN);
+    std::signal(SIGPIPE, SIG_IGN);
+    ::close(reload_pipe[0]);
+    ::close(reload_pipe[1]);
+
+    // every slot appends to its own file, a replaced worker continues the file of its slot
+    AuditLog audit;
+    SnapshotService service(snapshot, used, limiter);
+    if (!audit_setup.path.empty())
+    {
+        const auto opened = audit.open(audit_setup.path + "." + std::to_string(slot), audit_setup.password);
+        if (opened != AuditLog::Success)
+        {
+            std::cerr << "Unable to open the audit log " << audit_setup.path << "." << slot << std::endl;
+            std::_Exit(1);
+        }
+        service.setAuditLog(&audit);
+    }
+
+    Server server(service, workers);
+    if (!server.listenTcp(address, port, true))
+    {
+        std::_Exit(1);
+    }
+    active_server = &server;
+
+    // a stop which arrived while the worker started up is delivered now
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    ::pthread_sigmask(SIG_UNBLOCK, &stop_signals, nullptr);
+
+    const auto served = server.run();
+    audit.close();
+
+    // the database and the snapshot belong to the supervisor, nothing is released here
+    std::_Exit(served ? 0 : 1);
+}
+
+// forks a worker process of the snapshot for every free slot (pid 0), false if one couldn't be started
+static bool spawn_workers(std::vector<pid_t> &pids, const std::size_t &count, const TokenSnapshot &snapshot,
+                          UsedCodeStore &used, RateLimiter *limiter, const std::size_t &workers,
+                          const std::string &address, const std::uint16_t &port, const AuditSetup &audit_setup)
+{
+    // the workers start with the stop signals blocked until their server can be stopped,
+    // a signal sent to the process group while a worker starts isn't lost
+    sigset_t stop_signals, previous;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+
+    pids.resize(count, 0);
+    for (auto slot = 0U; slot < count; ++slot)
+    {
+        if (pids[slot] != 0)
+        {
+            continue;
+        }
+        ::pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+        const auto pid = ::fork();
+        if (pid != 0)
+        {
+            ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        }
+        if (pid < 0)
+        {
+            std::cerr << "Unable to start a worker process: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (pid == 0)
+        {
+            run_worker(snapshot, used, limiter, workers, address, port, audit_setup, slot);
+        }
+        pids[slot] = pid;
+    }
+    return true;
+}
+
+static void stop_workers(std::vector<pid_t> &pids)
+{
+    for (auto&& pid : pids)
+    {
+        if (pid != 0)
+        {
+            ::kill(pid, SIGTERM);
+        }
+    }
+    for (auto&& pid : pids)
+    {
+        while (pid != 0 && ::waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+    pids.clear();
+}
+
+// serves the open database with worker processes which share one snapshot of the prepared tokens
+// and one replay store, the supervisor writes the counters and reloads on SIGHUP, returns the exit code
+static int run_processes(const std::size_t &processes, const std::size_t &workers,
+                         const std::string &address, const std::uint16_t &port, const std::string &delta_file,
+                         const std::string &metrics_address, const std::uint16_t &metrics_port,
+                         const RateLimiter::Limit *limit, const AuditSetup &audit_setup)
+{
+    UsedCodeStore used(UsedCodeStore::DEFAULT_CAPACITY, UsedCodeStore::Shared);
+    std::unique_ptr<RateLimiter> limiter;
+    if (limit)
+    {
+        limiter.reset(new RateLimiter(*limit, RateLimiter::DEFAULT_CAPACITY, RateLimiter::Shared));
+    }
+    auto snapshot = std::make_unique<TokenSnapshot>();
+    const auto built = snapshot->build();
+    if (built != TokenDatabase::Success)
+    {
+        std::cerr << "Unable to prepare the tokens: " << TokenDatabase::getErrorMessage(built) << std::endl;
+        return 1;
+    }
+
+    if (::pipe(reload_pipe) != 0)
+    {
+        return 1;
+    }
+    for (auto&& sig : {SIGINT, SIGTERM})
+    {
+        std::signal(sig, &request_stop);
+    }
+    std::signal(SIGHUP, &request_reload);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // forked before the metrics thread is started
+    std::vector<pid_t> pids;
+    if (!spawn_workers(pids, processes, *snapshot, used, limiter.get(), workers, address, port, audit_setup))
+    {
+        stop_workers(pids);
+        return 1;
+    }
+
+    MetricsEndpoint metrics([&](std::vector<PerfStats::Gauge> &gauges) {
+        gauges.push_back({"processes", "Worker processes", static_cast<double>(processes)});
+        gauges.push_back({"used_codes", "Codes in the replay store", static_cast<double>(used.occupancy(Clock::current()))});
+        gauges.push_back({"used_code_capacity", "Slots of the replay store", static_cast<double>(used.capacity())});
+        AutoTuner::appendGauges(AutoTuner::current(), gauges);
+    });
+    if (!metrics_address.empty() && !metrics.listen(metrics_address, metrics_port))
+    {
+        stop_workers(pids);
+        return 1;
+    }
+
+    std::cerr << "Serving " << snapshot->size() << " tokens from " << processes << " processes on "
+              << address << ":" << port << std::endl;
+
+    auto status = 0;
+    for (;;)
+    {
+        pollfd fd = {reload_pipe[0], POLLIN, 0};
+        char byte = 2;
+        if (::poll(&fd, 1U, SUPERVISOR_INTERVAL_MS) == 1 && ::read(reload_pipe[0], &byte, 1U) != 1)
+        {
+            byte = 2;
+        }
+
+        snapshot->persist();
+        if (byte == 1)
+        {
+            break;
+        }
+
+        if (byte == 0 && reload_database(delta_file))
+        {
+            // the old workers stop before the new ones start, so a counter is never advanced by both
+            auto reloaded = std::make_unique<TokenSnapshot>();
+            const auto rebuilt = reloaded->build();
+            if (rebuilt != TokenDatabase::Success)
+            {
+                std::cerr << "Unable to prepare the tokens: " << TokenDatabase::getErrorMessage(rebuilt) << std::endl;
+                continue;
+            }
+            stop_workers(pids);
+            snapshot->persist();
+            reloaded->merge(*snapshot);
+            snapshot = std::move(reloaded);
+            if (!spawn_workers(pids, processes, *snapshot, used, limiter.get(), workers, address, port, audit_setup))
+            {
+                status = 1;
+                break;
+            }
+            std::cerr << "Reloaded, serving " << snapshot->size() << " tokens" << std::endl;
+        }
+
+        // crashed workers are replaced, a worker which couldn't listen ends the server
+        auto failed = false;
+        for (auto&& pid : pids)
+        {
+            int exit_status = 0;
+            if (pid == 0 || ::waitpid(pid, &exit_status, WNOHANG) != pid)
+            {
+                continue;
+            }
+            failed |= WIFEXITED(exit_status) && WEXITSTATUS(exit_status) != 0;
+            std::cerr << "Worker process " << pid << " exited" << std::endl;
+            pid = 0;
+        }
+        if (failed || !spawn_workers(pids, processes, *snapshot, used, limiter.get(), workers, address, port, audit_setup))
+        {
+            status = 1;
+            break;
+        }
+    }
+
+    metrics.stop();
+    stop_workers(pids);
+    snapshot->persist();
+    ::close(reload_pipe[0]);
+    ::close(reload_pipe[1]);
+    return status;
+}
+
+static void print_usage()
+{
+    std::cerr << "Usage: otpgen-server [--socket <path>] [--listen <ipv4 address>:<port>] [--workers <count>]" << std::endl;
+    std::cerr << "                     [--numa <on|off>] [--huge-pages <on|off>] [--delta <file>]" << std::endl;
+    std::cerr << "                     [--metrics <ipv4 address>:<port>] [--processes <count>]" << std::endl;
+    std::cerr << "                     [--rate-limit <attempts>/<seconds>] [--audit-log <file>]" << std::endl;
+    std::cerr << "                     [--tuning <cached|calibrate|off>]" << std::endl;
+    std::cerr << "The database password is read from stdin." << std::endl;
+    std::cerr << "Connections to --listen can only verify and resync, generate and lookup are only" << std::endl;
+    std::cerr << "answered on the Unix domain socket." << std::endl;
+    std::cerr << "SIGHUP reloads the tokens if the database file changed or the delta file exists," << std::endl;
+    std::cerr << "the delta is removed once it was applied." << std::endl;
+    std::cerr << "With --processes the workers are separate processes sharing the TCP port of --listen," << std::endl;
+    std::cerr << "a reload restarts them." << std::endl;
+    std::cerr << "With --rate-limit every token has the given attempts to verify or resync, one more" << std::endl;
+    std::cerr << "every seconds / attempts, a matching code refills them." << std::endl;
+    std::cerr << "With --audit-log every generate, verify and resync is recorded in an encrypted log" << std::endl;
+    std::cerr << "with the database password, worker processes append .<n> to the file name." << std::endl;
+    std::cerr << "otpgen-cli --audit reads it." << std::endl;
+    std::cerr << "The code generators are calibrated for the machine at the first start, later starts" << std::endl;
+    std::cerr << "use the stored result, calibrate measures again. Without --workers the server uses" << std::endl;
+    std::cerr << "the threads which still added throughput in the calibration." << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    const std::vector<std::string> args(argv, argv + argc);
+
+    const auto config_home = sago::getConfigHome();
+    const auto app_cfg = config_home + "/" + cfg::Developer + "/" + cfg::Name;
+
+    std::string socket_path;
+    std::string listen_address;
+    std::uint16_t listen_port = 0U;
+    std::size_t workers = 0U;
+    auto numa = false;
+    auto huge_pages = false;
+    std::string delta_file;
+    std::string metrics_address;
+    std::uint16_t metrics_port = 0U;
+    std::size_t processes = 0U;
+    std::unique_ptr<RateLimiter::Limit> limit;
+    AuditSetup audit_setup;
+    std::string tuning_mode = "cached";
+
+    for (auto i = 1U; i < args.size(); i += 2U)
+    {
+        if (i + 1U >= args.size())
+        {
+            print_usage();
+            return 2;
+        }
+
+        const auto &option = args.at(i);
+        const auto &value = args.at(i + 1U);
+        try {
+            if (option == "--socket")
+            {
+                socket_path = value;
+            }
+            else if (option == "--listen" || option == "--metrics")
+            {
+                auto &address = option == "--listen" ? listen_address : metrics_address;
+                auto &port = option == "--listen" ? listen_port : metrics_port;
+                if (!MetricsEndpoint::parseAddress(value, address, port))
+                {
+                    print_usage();
+                    return 2;
+                }
+            }
+            else if (option == "--workers")
+            {
+                workers = std::stoul(value);
+            }
+            else if (option == "--processes")
+            {
+                processes = std::stoul(value);
+            }
+            else if (option == "--rate-limit")
+            {
+                // <attempts>/<seconds>: the burst and the time in which all of them are refilled
+                const auto slash = value.find('/');
+                const auto attempts = std::stoul(value.substr(0U, slash));
+                const auto seconds = slash == std::string::npos ? 0UL : std::stoul(value.substr(slash + 1U));
+                if (attempts == 0U || seconds == 0U)
+                {
+                    print_usage();
+                    return 2;
+                }
+                limit.reset(new RateLimiter::Limit());
+                limit->burst = static_cast<std::uint32_t>(attempts);
+                limit->interval = std::chrono::milliseconds(seconds * 1000U / attempts);
+            }
+            else if (option == "--delta")
+            {
+                delta_file = value;
+            }
+            else if (option == "--audit-log")
+            {
+                audit_setup.path = value;
+            }
+            else if (option == "--tuning" && (value == "cached" || value == "calibrate" || value == "off"))
+            {
+                tuning_mode = value;
+            }
+            else if ((option == "--numa" || option == "--huge-pages") && (value == "on" || value == "off"))
+            {
+                (option == "--numa" ? numa : huge_pages) = value == "on";
+            }
+            else
+            {
+                print_usage();
+                return 2;
+            }
+        } catch (...) {
+            print_usage();
+            return 2;
+        }
+    }
+
+    // worker processes share a TCP port, every one has a listener of its own
+    if (processes != 0U && (listen_address.empty() || !socket_path.empty() || numa))
+    {
+        print_usage();
+        return 2;
+    }
+
+    // serve on the Unix domain socket unless only a TCP address was given
+    if (processes == 0U && socket_path.empty() && listen_address.empty())
+    {
+        const auto runtime = std::getenv("XDG_RUNTIME_DIR");
+        socket_path = runtime && runtime[0] != '\0' ? std::string(runtime) + "/otpgen-server.sock"
+                                                    : app_cfg + "/server.sock";
+    }
+
+    std::string password;
+    const auto terminal = ::isatty(STDIN_FILENO) == 1;
+    if (terminal)
+    {
+        std::cerr << "Enter your token database password: " << std::flush;
+        SetStdinEcho(false);
+    }
+    std::getline(std::cin, password);
+    if (terminal)
+    {
+        SetStdinEcho(true);
+        std::cerr << std::endl;
+    }
+
+    if (!TokenDatabase::setPassword(password))
+    {
+        std::cerr << "Password may not be empty!" << std::endl;
+        return 1;
+    }
+    if (!audit_setup.path.empty())
+    {
+        audit_setup.password.assign(password.begin(), password.end());
+    }
+    password.clear();
+
+    TokenDatabase::setTokenDatabase(app_cfg + "/tokens.db");
+    TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+
+    // counter updates are saved in the background, closeDatabase() writes outstanding changes
+    TokenDatabase::setAutoSave(std::chrono::milliseconds(1000));
+
+    // sqlite settings shared by all frontends
+    cfg::applyDatabaseTuning();
+
+    const auto status = TokenDatabase::loadTokens();
+    if (status != TokenDatabase::Success)
+    {
+        std::cerr << "Unable to load the token database! Is the password correct?" << std::endl;
+        std::cerr << "Detailed error: " << TokenDatabase::getErrorMessage(status) << std::endl;
+        return 1;
+    }
+
+    // backends, batch grains and threads of this machine, worker processes inherit them
+    if (tuning_mode != "off")
+    {
+        const auto tuning_path = app_cfg + "/tuning";
+        if (tuning_mode == "calibrate")
+        {
+            std::remove(tuning_path.c_str());
+        }
+        const auto tuning = AutoTuner::load(tuning_path);
+        if (!tuning.cached)
+        {
+            std::cerr << "Calibrated the code generators in " << tuning.calibrationNs / 1000000U << " ms: "
+                      << tuning.shaBackend << ", " << tuning.multiBufferBackend << ", "
+                      << tuning.threads() << " threads." << std::endl;
+        }
+        if (workers == 0U)
+        {
+            workers = tuning.threads();
+        }
+    }
+
+    if (processes != 0U)
+    {
+        const auto served = run_processes(processes, workers, listen_address, listen_port, delta_file,
+                                          metrics_address, metrics_port, limit.get(), audit_setup);
+        TokenDatabase::closeDatabase();
+        return served;
+    }
+
+    std::unique_ptr<RateLimiter> limiter;
+    if (limit)
+    {
+        limiter.reset(new RateLimiter(*limit));
+    }
+
+    AuditLog audit;
+    if (!audit_setup.path.empty())
+    {
+        const auto opened = audit.open(audit_setup.path, audit_setup.password);
+        if (opened != AuditLog::Success)
+        {
+            std::cerr << "Unable to open the audit log! Is it written with another password?" << std::endl;
+            TokenDatabase::closeDatabase();
+            return 1;
+        }
+    }
+
+    TokenService service(numa, huge_pages);
+    service.setRateLimiter(limiter.get());
+    service.setAuditLog(audit.isOpen() ? &audit : nullptr);
+    const auto loaded = service.load();
+    if (loaded != TokenDatabase::Success)
+    {
+        std::cerr << "Unable to prepare the tokens: " << TokenDatabase::getErrorMessage(loaded) << std::endl;
+        TokenDatabase::closeDatabase();
+        return 1;
+    }
+
+    Server server(service, workers);
+    if ((!socket_path.empty() && !server.listenUnix(socket_path)) ||
+        (!listen_address.empty() && !server.listenTcp(listen_address, listen_port)))
+    {
+        TokenDatabase::closeDatabase();
+        return 1;
+    }
+
+    // scrapes only read the counters, the requests are not slowed down by them
+    MetricsEndpoint metrics([&](std::vector<PerfStats::Gauge> &gauges) {
+        gauges.push_back({"tokens", "Usable tokens", static_cast<double>(service.size())});
+        gauges.push_back({"shards", "Shards of the tokens", static_cast<double>(service.shardCount())});
+        gauges.push_back({"used_codes", "Codes in the replay store", static_cast<double>(service.usedCodes())});
+        gauges.push_back({"used_code_capacity", "Slots of the replay store", static_cast<double>(service.usedCodeCapacity())});
+        AutoTuner::appendGauges(AutoTuner::current(), gauges);
+        gauges.push_back({"queue_depth", "Batches waiting for a worker", static_cast<double>(server.queueDepth())});
+    });
+    if (!metrics_address.empty() && !metrics.listen(metrics_address, metrics_port))
+    {
+        TokenDatabase::closeDatabase();
+        return 1;
+    }
+
+    if (::pipe(reload_pipe) != 0)
+    {
+        TokenDatabase::closeDatabase();
+        return 1;
+    }
+    std::thread reloader([&]{
+        for (;;)
+        {
+            char byte = 1;
+            const auto size = ::read(reload_pipe[0], &byte, 1U);
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (size != 1 || byte != 0)
+            {
+                break;
+            }
+            reload_tokens(service, delta_file);
+        }
+    });
+
+    active_server = &server;
+    for (auto&& sig : {SIGINT, SIGTERM})
+    {
+        std::signal(sig, &stop_server);
+    }
+    std::signal(SIGHUP, &request_reload);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::cerr << "Serving " << service.size() << " tokens";
+    if (service.shardCount() > 1U)
+    {
+        std::cerr << " from " << service.shardCount() << " NUMA nodes";
+    }
+    if (!socket_path.empty())
+    {
+        std::cerr << " on " << socket_path;
+    }
+    if (!listen_address.empty())
+    {
+        std::cerr << (socket_path.empty() ? " on " : " and ") << listen_address << ":" << listen_port;
+    }
+    std::cerr << std::endl;
+
+    const auto served = server.run();
+    active_server = nullptr;
+    metrics.stop();
+
+    std::signal(SIGHUP, SIG_IGN);
+    const char stop = 1;
+    (void) ::write(reload_pipe[1], &stop, 1U);
+    reloader.join();
+    ::close(reload_pipe[0]);
+    ::close(reload_pipe[1]);
+
+    // write the pending records and the counter updates, wipe the password
+    audit.close();
+    TokenDatabase::closeDatabase();
+    return served ? 0 : 1;
+}
@@ -1,5 +1,7 @@
 #include "AppConfig.hpp"
 
+#include <TokenDatabase.hpp>
+
 #include <algorithm>
 
 const std::string AppConfig::Developer = "マギルゥーベルベット";
@@ -12,3 +14,14 @@ const std::string AppConfig::Version =
     std::to_string(AppConfig::VersionMajor) + '.' +
     std::to_string(AppConfig::VersionMinor) + '.' +
     std::to_string(AppConfig::PatchLevel);
+
+void AppConfig::applyDatabaseTuning()
+{
+    // the library defaults, with enforced references between the tokens and the display order
+    for (auto&& format : {TokenDatabase::EncryptedImage, TokenDatabase::EncryptedPages})
+    {
+        auto tuning = TokenDatabase::defaultTuning(format);
+        tuning.foreignKeys = true;
+        TokenDatabase::setTuning(format, tuning);
+    }
+}
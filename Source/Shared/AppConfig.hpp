@@ -14,6 +14,9 @@ public:
     static const std::uint16_t VersionMinor;
     static const std::uint32_t PatchLevel;
 
+    // sqlite tuning of the token database shared by all frontends, call before it is opened
+    static void applyDatabaseTuning();
+
 private:
     AppConfig() = delete;
 };
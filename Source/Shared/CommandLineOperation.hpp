@@ -22,7 +22,7 @@ void exec_commandline_operation(const std::vector<std::string> &args)
             if (res == TokenDatabase::Success)
             {
                 std::printf("Swapped \"%s\" with \"%s\".\n", args.at(2).c_str(), args.at(3).c_str());
-                TokenDatabase::saveTokens();
+                TokenDatabase::closeDatabase();
                 std::exit(0);
             }
             else
@@ -61,7 +61,7 @@ void exec_commandline_operation(const std::vector<std::string> &args)
             if (res == TokenDatabase::Success)
             {
                 std::cout << "Move operation successful." << std::endl;
-                TokenDatabase::saveTokens();
+                TokenDatabase::closeDatabase();
                 std::exit(0);
             }
             else
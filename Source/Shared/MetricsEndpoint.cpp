@@ -0,0 +1,279 @@
+#include "MetricsEndpoint.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#if !defined(OS_WINDOWS)
+#include <cerrno>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // requests are small, larger ones are not from a scraper
+    static const constexpr std::size_t MAX_REQUEST_SIZE = 8192U;
+    // a stalled client doesn't hold up the next scrape for long
+    static const constexpr int CLIENT_TIMEOUT_SECONDS = 2;
+
+    static const char *const PROMETHEUS_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+    static const char *const OPENMETRICS_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+#if !defined(OS_WINDOWS)
+    static void sendAll(int fd, const std::string &data)
+    {
+        std::size_t sent = 0U;
+        while (sent < data.size())
+        {
+            const auto size = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (size <= 0)
+            {
+                return;
+            }
+            sent += static_cast<std::size_t>(size);
+        }
+    }
+
+    static std::string response(const std::string &status, const char *type, const std::string &body)
+    {
+        std::string out = "HTTP/1.1 " + status + "\r\n";
+        out += "Content-Type: ";
+        out += type;
+        out += "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+        out += "Connection: close\r\n\r\n";
+        out += body;
+        return out;
+    }
+
+    // case-insensitive search of the accepted content types
+    static bool acceptsOpenMetrics(const std::string &request)
+    {
+        std::string lower(request);
+        for (auto&& c : lower)
+        {
+            if (c >= 'A' && c <= 'Z')
+            {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        const auto header = lower.find("\r\naccept:");
+        if (header == std::string::npos)
+        {
+            return false;
+        }
+        const auto end = lower.find("\r\n", header + 2U);
+        return lower.substr(header, end - header).find("application/openmetrics-text") != std::string::npos;
+    }
+#endif
+}
+
+MetricsEndpoint::MetricsEndpoint(const GaugeCallback &gauges)
+    : _gauges(gauges)
+{
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    this->stop();
+}
+
+bool MetricsEndpoint::parseAddress(const std::string &value, std::string &address, std::uint16_t &port)
+{
+    const auto separator = value.rfind(':');
+    if (separator == std::string::npos || separator + 1U >= value.size() ||
+        value.find_first_not_of("0123456789", separator + 1U) != std::string::npos ||
+        value.size() - separator > 6U)
+    {
+        return false;
+    }
+    const auto number = std::stoul(value.substr(separator + 1U));
+    if (number == 0UL || number > 65535UL)
+    {
+        return false;
+    }
+    address = value.substr(0U, separator);
+    port = static_cast<std::uint16_t>(number);
+    return true;
+}
+
+bool MetricsEndpoint::listen(const std::string &address, const std::uint16_t &port)
+{
+#if !defined(OS_WINDOWS)
+    if (this->_listener >= 0)
+    {
+        return false;
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    {
+        std::fprintf(stderr, "Invalid IPv4 address: %s\n", address.c_str());
+        return false;
+    }
+
+    const auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "Unable to create the socket: %s\n", std::strerror(errno));
+        return false;
+    }
+
+    const int enable = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 16) != 0)
+    {
+        std::fprintf(stderr, "Unable to listen on %s:%u: %s\n", address.c_str(), port, std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    if (::pipe(this->_wakeup) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    (void) ::fcntl(this->_wakeup[0], F_SETFD, FD_CLOEXEC);
+    (void) ::fcntl(this->_wakeup[1], F_SETFD, FD_CLOEXEC);
+
+    (void) ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    this->_listener = fd;
+    this->_thread = std::thread(&MetricsEndpoint::run, this);
+    return true;
+#else
+    (void) address;
+    (void) port;
+    std::fprintf(stderr, "The metrics endpoint is not available on this platform\n");
+    return false;
+#endif
+}
+
+void MetricsEndpoint::stop()
+{
+#if !defined(OS_WINDOWS)
+    if (this->_listener < 0)
+    {
+        return;
+    }
+
+    const char byte = 0;
+    (void) ::write(this->_wakeup[1], &byte, 1U);
+    if (this->_thread.joinable())
+    {
+        this->_thread.join();
+    }
+
+    ::close(this->_listener);
+    ::close(this->_wakeup[0]);
+    ::close(this->_wakeup[1]);
+    this->_listener = -1;
+    this->_wakeup[0] = this->_wakeup[1] = -1;
+#endif
+}
+
+void MetricsEndpoint::run()
+{
+#if !defined(OS_WINDOWS)
+    for (;;)
+    {
+        pollfd fds[2];
+        fds[0].fd = this->_listener;
+        fds[0].events = POLLIN;
+        fds[1].fd = this->_wakeup[0];
+        fds[1].events = POLLIN;
+        if (::poll(fds, 2U, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents != 0)
+        {
+            return;
+        }
+        if ((fds[0].revents & POLLIN) == 0)
+        {
+            continue;
+        }
+
+        const auto client = ::accept(this->_listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            continue;
+        }
+        this->answer(client);
+        ::close(client);
+    }
+#endif
+}
+
+void MetricsEndpoint::answer(int fd)
+{
+#if !defined(OS_WINDOWS)
+    timeval timeout;
+    timeout.tv_sec = CLIENT_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // only the request line and the headers matter
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos)
+    {
+        const auto size = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (size <= 0 || request.size() + static_cast<std::size_t>(size) > MAX_REQUEST_SIZE)
+        {
+            return;
+        }
+        request.append(buffer, static_cast<std::size_t>(size));
+    }
+
+    const auto line = request.substr(0U, request.find("\r\n"));
+    const auto target_begin = line.find(' ');
+    const auto target_end = target_begin == std::string::npos ? std::string::npos : line.find(' ', target_begin + 1U);
+    const auto method = line.substr(0U, target_begin);
+    auto target = target_end == std::string::npos ? std::string() : line.substr(target_begin + 1U, target_end - target_begin - 1U);
+    target = target.substr(0U, target.find('?'));
+
+    if (method != "GET")
+    {
+        sendAll(fd, response("405 Method Not Allowed", PROMETHEUS_TYPE, "Method not allowed\n"));
+        return;
+    }
+    if (target != "/metrics")
+    {
+        sendAll(fd, response("404 Not Found", PROMETHEUS_TYPE, "Not found\n"));
+        return;
+    }
+
+    std::vector<PerfStats::Gauge> gauges;
+    if (this->_gauges)
+    {
+        this->_gauges(gauges);
+    }
+
+    const auto openmetrics = acceptsOpenMetrics(request);
+    std::string body;
+    PerfStats::writeMetrics(PerfStats::snapshot(), gauges, body, openmetrics);
+    sendAll(fd, response("200 OK", openmetrics ? OPENMETRICS_TYPE : PROMETHEUS_TYPE, body));
+#else
+    (void) fd;
+#endif
+}
@@ -0,0 +1,55 @@
+#ifndef METRICSENDPOINT_HPP
+#define METRICSENDPOINT_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <PerfStats.hpp>
+
+/**
+ * HTTP endpoint for Prometheus scrapes of the performance counters
+ *
+ * A thread of its own answers GET /metrics on an IPv4 address with the
+ * snapshot of PerfStats and the gauges of the frontend, in the Prometheus
+ * text format or as OpenMetrics when the scraper accepts it. Every scrape
+ * reads the striped counters once, nothing is recorded on behalf of the
+ * endpoint, so the request handling doesn't notice the scrapes.
+ *
+ * Connections are answered one at a time and closed after the response.
+ * Not available on Windows.
+ *
+ */
+class MetricsEndpoint
+{
+public:
+    // fills the gauges of the frontend, called on the thread of the endpoint
+    using GaugeCallback = std::function<void(std::vector<PerfStats::Gauge> &gauges)>;
+
+    explicit MetricsEndpoint(const GaugeCallback &gauges = {});
+    ~MetricsEndpoint();
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint &operator= (const MetricsEndpoint&) = delete;
+
+    // listen on the address and start the thread, returns false if the address can't be used
+    bool listen(const std::string &address, const std::uint16_t &port);
+    // stop the thread and close the socket
+    void stop();
+
+    // splits address:port, returns false for invalid ports
+    static bool parseAddress(const std::string &value, std::string &address, std::uint16_t &port);
+
+private:
+    void run();
+    void answer(int fd);
+
+    GaugeCallback _gauges;
+    int _listener = -1;
+    int _wakeup[2] = {-1, -1};
+    std::thread _thread;
+};
+
+#endif // METRICSENDPOINT_HPP
@@ -0,0 +1,239 @@
+#include "StartupProfile.hpp"
+
+#include <PerfStats.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // taken during static initialization, before main()
+    static const auto process_start = std::chrono::steady_clock::now();
+
+    // the autosave keeps tracing after the first code, the profile stops at some point
+    static const constexpr std::size_t MAX_PHASES = 4096U;
+
+    struct Phase
+    {
+        std::string name;
+        std::uint64_t startNs = 0U;
+        std::uint64_t endNs = 0U;
+        unsigned depth = 0U;
+        unsigned thread = 0U;
+    };
+
+    static std::mutex mutex;
+    static std::vector<Phase> phases;
+    static std::string output_file;
+    static std::uint64_t last_mark = 0U;
+    static std::uint64_t first_code = 0U;
+    static std::atomic<bool> active{false};
+    static std::atomic<bool> written{false};
+    static std::atomic<unsigned> next_thread{0U};
+
+    static std::uint64_t now()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - process_start).count());
+    }
+
+    static unsigned thread_index()
+    {
+        thread_local const auto index = next_thread.fetch_add(1U, std::memory_order_relaxed);
+        return index;
+    }
+
+    // nesting of the library phases on this thread
+    static unsigned &thread_depth()
+    {
+        thread_local unsigned depth = 0U;
+        return depth;
+    }
+
+    static std::uint64_t trace_begin(const char *name)
+    {
+        const auto start = now();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!active || phases.size() >= MAX_PHASES)
+        {
+            return 0U;
+        }
+        phases.push_back({name, start, 0U, ++thread_depth(), thread_index()});
+        return phases.size();
+    }
+
+    static void trace_end(std::uint64_t context)
+    {
+        if (context == 0U)
+        {
+            return;
+        }
+        const auto end = now();
+        std::lock_guard<std::mutex> lock(mutex);
+        phases[context - 1U].endNs = end;
+        --thread_depth();
+    }
+
+    static const PerfStats::TraceHooks hooks = {&trace_begin, &trace_end};
+
+    static double ms(std::uint64_t ns)
+    {
+        return static_cast<double>(ns) / 1e6;
+    }
+
+    static void print_breakdown(const std::vector<Phase> &breakdown)
+    {
+        std::fprintf(stderr, "\nStartup profile (ms since the start of the process):\n");
+        std::fprintf(stderr, "%10s %10s  %s\n", "start", "duration", "phase");
+        for (auto&& phase : breakdown)
+        {
+            std::fprintf(stderr, "%10.3f %10.3f  %*s%s\n", ms(phase.startNs), ms(phase.endNs - phase.startNs),
+                         static_cast<int>(phase.depth * 2U), "", phase.name.c_str());
+        }
+        if (first_code)
+        {
+            std::fprintf(stderr, "Time to the first code: %.3f ms\n", ms(first_code));
+        }
+        else
+        {
+            std::fprintf(stderr, "No code was shown, exited after %.3f ms\n", ms(now()));
+        }
+    }
+
+    // the trace event format, every phase is a complete event in microseconds
+    static bool write_trace(const std::string &file, const std::vector<Phase> &breakdown)
+    {
+        std::string out = "{\"traceEvents\":[";
+        char buffer[128];
+        for (auto i = 0U; i < breakdown.size(); ++i)
+        {
+            const auto &phase = breakdown[i];
+            out += std::string(i ? "," : "") + "\n{\"name\":\"" + phase.name + "\",\"cat\":\"" +
+                   (phase.depth ? "library" : "startup") + "\",\"ph\":\"X\",";
+            std::snprintf(buffer, sizeof(buffer), "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                          static_cast<double>(phase.startNs) / 1e3,
+                          static_cast<double>(phase.endNs - phase.startNs) / 1e3, phase.thread);
+            out += buffer;
+        }
+        std::snprintf(buffer, sizeof(buffer), "\n],\"otherData\":{\"firstCodeMs\":%.3f}}\n", ms(first_code));
+        out += buffer;
+
+        std::ofstream stream(file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        return static_cast<bool>(stream.write(out.data(), static_cast<std::streamsize>(out.size())));
+    }
+
+    static void finish_at_exit()
+    {
+        StartupProfile::finish();
+    }
+}
+
+bool StartupProfile::enable(int &argc, char **argv)
+{
+    static const char flag[] = "--profile-startup";
+    auto found = false;
+    auto kept = 1;
+    for (auto i = 1; i < argc; ++i)
+    {
+        const auto arg = argv[i];
+        if (!found && std::strncmp(arg, flag, sizeof(flag) - 1U) == 0 &&
+            (arg[sizeof(flag) - 1U] == '\0' || arg[sizeof(flag) - 1U] == '='))
+        {
+            found = true;
+            output_file = arg[sizeof(flag) - 1U] == '=' ? std::string(arg + sizeof(flag)) : std::string();
+            continue;
+        }
+        argv[kept++] = arg;
+    }
+    if (!found)
+    {
+        return false;
+    }
+    argc = kept;
+    argv[argc] = nullptr;
+
+    active = true;
+    PerfStats::setTraceHooks(&hooks);
+    std::atexit(&finish_at_exit);
+    return true;
+}
+
+bool StartupProfile::enabled()
+{
+    return active;
+}
+
+void StartupProfile::mark(const char *phase)
+{
+    if (!active)
+    {
+        return;
+    }
+    const auto end = now();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (phases.size() < MAX_PHASES)
+    {
+        phases.push_back({phase, last_mark, end, 0U, thread_index()});
+    }
+    last_mark = end;
+}
+
+void StartupProfile::firstCode()
+{
+    if (!active || written)
+    {
+        return;
+    }
+    mark("first code");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        first_code = last_mark;
+    }
+    finish();
+}
+
+void StartupProfile::finish()
+{
+    if (!active || written.exchange(true))
+    {
+        return;
+    }
+
+    // library scopes which are still open keep the hooks, they are static
+    PerfStats::setTraceHooks(nullptr);
+
+    std::vector<Phase> breakdown;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active = false;
+        const auto end = now();
+        for (auto&& phase : phases)
+        {
+            breakdown.push_back(phase);
+            if (!breakdown.back().endNs)
+            {
+                breakdown.back().endNs = end;
+            }
+        }
+    }
+
+    // the phases of a level start in order, nested phases follow the phase they ran in
+    std::stable_sort(breakdown.begin(), breakdown.end(), [](const Phase &a, const Phase &b) {
+        return a.startNs < b.startNs || (a.startNs == b.startNs && a.depth < b.depth);
+    });
+
+    if (output_file.empty())
+    {
+        print_breakdown(breakdown);
+    }
+    else if (!write_trace(output_file, breakdown))
+    {
+        std::fprintf(stderr, "Unable to write the startup profile to %s\n", output_file.c_str());
+    }
+}
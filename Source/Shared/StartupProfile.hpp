@@ -0,0 +1,42 @@
+#ifndef STARTUPPROFILE_HPP
+#define STARTUPPROFILE_HPP
+
+#include <string>
+
+/**
+ * Startup phase profiler of the frontends
+ *
+ * Enabled with --profile-startup, the frontends mark the end of every phase
+ * of their startup (config directory, keychain, password, unlock) and the
+ * phases of the library (reading, decrypting and deserializing the database,
+ * schema validation) are taken from the PerfStats trace hooks, when built
+ * with OTPGEN_WITH_PERF_STATS. All timestamps are monotonic and relative to
+ * the start of the process.
+ *
+ * The breakdown is written once the first code is shown, or when the process
+ * exits without showing a code. --profile-startup=<file> writes it as a
+ * trace (chrome://tracing, Perfetto) instead of printing it to stderr.
+ *
+ */
+class StartupProfile
+{
+public:
+    // removes --profile-startup[=<file>] from the arguments and starts the profile,
+    // returns false if it wasn't given
+    static bool enable(int &argc, char **argv);
+    static bool enabled();
+
+    // ends the phase which started with the previous mark
+    static void mark(const char *phase);
+
+    // marks the time to the first code and writes the breakdown, later calls are ignored
+    static void firstCode();
+
+    // writes the breakdown unless it was written already
+    static void finish();
+
+private:
+    StartupProfile() = delete;
+};
+
+#endif // STARTUPPROFILE_HPP
@@ -0,0 +1,69 @@
+#include <OTPGen.hpp>
+
+#include <emscripten/bind.h>
+
+#include <ctime>
+#include <string>
+
+// JavaScript interface of the core module
+//
+//   const core = await OTPGenCore();
+//   core.totp("XYZA123456KDDK83D", Date.now() / 1000, 6, 30, core.SHA1);
+//   core.verifyTOTP(secret, code, Date.now() / 1000, 1, 6, 30, core.SHA1); // step or null
+//
+// invalid input gives an empty code, times are seconds since the epoch
+
+namespace {
+    static std::time_t toTime(double seconds)
+    {
+        return static_cast<std::time_t>(seconds);
+    }
+
+    static std::string totp(const std::string &secret, double time, unsigned digits, unsigned period, unsigned algorithm)
+    {
+        return OTPGen::computeTOTP(toTime(time), secret,
+                                   static_cast<OTPToken::DigitType>(digits),
+                                   static_cast<OTPToken::PeriodType>(period),
+                                   static_cast<OTPToken::ShaAlgorithm>(algorithm));
+    }
+
+    static std::string hotp(const std::string &secret, unsigned counter, unsigned digits, unsigned algorithm)
+    {
+        return OTPGen::computeHOTP(secret,
+                                   static_cast<OTPToken::CounterType>(counter),
+                                   static_cast<OTPToken::DigitType>(digits),
+                                   static_cast<OTPToken::ShaAlgorithm>(algorithm));
+    }
+
+    static std::string steam(const std::string &secret, double time)
+    {
+        return OTPGen::computeSteam(toTime(time), secret);
+    }
+
+    // the offset of the matching step or null
+    static emscripten::val verifyTOTP(const std::string &secret, const std::string &code, double time, unsigned window,
+                                      unsigned digits, unsigned period, unsigned algorithm)
+    {
+        int step = 0;
+        if (!OTPGen::verifyTOTP(secret, code, toTime(time), window,
+                                static_cast<OTPToken::DigitType>(digits),
+                                static_cast<OTPToken::PeriodType>(period),
+                                static_cast<OTPToken::ShaAlgorithm>(algorithm), &step))
+        {
+            return emscripten::val::null();
+        }
+        return emscripten::val(step);
+    }
+}
+
+EMSCRIPTEN_BINDINGS(otpgen_core)
+{
+    emscripten::function("totp", &totp);
+    emscripten::function("hotp", &hotp);
+    emscripten::function("steam", &steam);
+    emscripten::function("verifyTOTP", &verifyTOTP);
+
+    emscripten::constant("SHA1", static_cast<unsigned>(OTPToken::SHA1));
+    emscripten::constant("SHA256", static_cast<unsigned>(OTPToken::SHA256));
+    emscripten::constant("SHA512", static_cast<unsigned>(OTPToken::SHA512));
+}
@@ -0,0 +1,66 @@
+#include "alloc_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<bool> counting{false};
+    thread_local std::size_t allocations = 0U;
+
+    inline void *allocate(std::size_t size) noexcept
+    {
+        if (counting.load(std::memory_order_relaxed))
+        {
+            ++allocations;
+        }
+        return std::malloc(size ? size : 1U);
+    }
+}
+
+namespace AllocCounter {
+    void start()
+    {
+        counting = true;
+    }
+
+    void stop()
+    {
+        counting = false;
+    }
+
+    std::size_t count()
+    {
+        return allocations;
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    auto memory = allocate(size);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
@@ -0,0 +1,17 @@
+#ifndef ALLOC_COUNTER_HPP
+#define ALLOC_COUNTER_HPP
+
+#include <cstddef>
+
+// heap allocations of the test binary, counted by the global operator new
+// which alloc_counter.cpp replaces for the whole binary
+namespace AllocCounter {
+    // starts counting the allocations of all threads, each thread counts its own
+    void start();
+    // stops counting
+    void stop();
+    // allocations of the calling thread while counting was on
+    std::size_t count();
+}
+
+#endif // ALLOC_COUNTER_HPP
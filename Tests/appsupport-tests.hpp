@@ -0,0 +1,705 @@
+#ifndef APPSUPPORTTESTS_HPP
+#define APPSUPPORTTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <AppSupport.hpp>
+#include <Codec.hpp>
+#include <TokenDatabase.hpp>
+#include <ThreadPool.hpp>
+#include <Internal/BackupFile.hpp>
+#include <Internal/JsonArena.hpp>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/pwdbased.h>
+#include <cryptopp/sha.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+go_bandit([]{
+    describe("AppSupport Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-tests-import.json").string();
+
+        after_each([&]{
+            std::remove(file.c_str());
+        });
+
+        it("[andOTP]", [&]{
+            OTPToken totp(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D");
+            OTPToken steam(OTPToken::Steam, "b", {}, "ABCD123456KDDK83D");
+            steam.setIssuer("Valve");
+            steam.setTags({"steam", "games"});
+
+            for (auto&& type : {AppSupport::andOTP::PlainText, AppSupport::andOTP::Encrypted})
+            {
+                AssertThat(AppSupport::andOTP::exportTokens(file, {&totp, &steam}, type, "otpgen-tests"), Equals(true));
+
+                std::vector<OTPToken*> imported;
+                AssertThat(AppSupport::andOTP::importTokens(file, imported, type, "otpgen-tests"), Equals(true));
+                std::vector<std::unique_ptr<OTPToken>> owned(imported.begin(), imported.end());
+
+                AssertThat(owned.size(), Equals(2U));
+                AssertThat(owned.at(0)->label(), Equals("a"));
+                AssertThat(owned.at(0)->secret(), Equals("XYZA123456KDDK83D"));
+                AssertThat(owned.at(1)->type(), Equals(OTPToken::Steam));
+                AssertThat(owned.at(1)->secret(), Equals("ABCD123456KDDK83D"));
+                AssertThat(owned.at(1)->issuer(), Equals("Valve"));
+                AssertThat(owned.at(1)->tags(), Equals(OTPToken::Tags{"games", "steam"}));
+                AssertThat(owned.at(0)->tags().empty(), IsTrue());
+            }
+
+            // wrong password and missing files
+            std::vector<OTPToken*> imported;
+            AssertThat(AppSupport::andOTP::importTokens(file, imported, AppSupport::andOTP::Encrypted, "wrong"), Equals(false));
+            AssertThat(AppSupport::andOTP::importTokens(file + ".missing", imported), Equals(false));
+            AssertThat(imported.empty(), Equals(true));
+        });
+
+        it("[andOTP PBKDF2]", [&]{
+            OTPToken totp(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D");
+            const auto second = file + ".2";
+
+            // a series of exports derives the key once, the files differ in their IVs
+            AppSupport::KeyCache keys;
+            AssertThat(AppSupport::andOTP::exportTokens(file, {&totp}, AppSupport::andOTP::EncryptedPBKDF2, "otpgen-tests", &keys), Equals(true));
+            AssertThat(AppSupport::andOTP::exportTokens(second, {&totp}, AppSupport::andOTP::EncryptedPBKDF2, "otpgen-tests", &keys), Equals(true));
+            AssertThat(keys.size(), Equals(1U));
+
+            std::vector<OTPToken> imported;
+            AppSupport::VectorSink sink(imported);
+            AssertThat(AppSupport::andOTP::importTokens(file, sink, AppSupport::andOTP::EncryptedPBKDF2, "wrong", &keys), Equals(false));
+            AssertThat(imported.empty(), IsTrue());
+            AssertThat(AppSupport::andOTP::importTokens(file, sink, AppSupport::andOTP::EncryptedPBKDF2, "otpgen-tests", &keys), Equals(true));
+            AssertThat(AppSupport::andOTP::importEncrypted(second, sink, "otpgen-tests", &keys), Equals(true));
+            AssertThat(keys.size(), Equals(2U));
+            AssertThat(imported.size(), Equals(2U));
+            AssertThat(imported.at(1).secret(), Equals("XYZA123456KDDK83D"));
+
+            // backups of andOTP itself, [iterations][salt][IV][message][tag]
+            {
+                const std::string json = R"([{"secret": "ABCD123456KDDK83D", "label": "b", "digits": 6, "type": "TOTP", "algorithm": "SHA1", "period": 30}])";
+                const auto salt = Internal::randomBytes(12U);
+                const auto iv = Internal::randomBytes(12U);
+                const auto key = AppSupport::KeyCache::derive({AppSupport::KeyCache::PBKDF2_SHA1, 140000U, 0U, 0U, 32U}, "otpgen-tests", salt);
+                std::string ciphertext, tag;
+                AssertThat(Internal::gcmEncrypt(key, iv, json, ciphertext, tag), IsTrue());
+                std::ofstream stream(file, std::ios::out | std::ios::binary | std::ios::trunc);
+                stream << std::string("\x00\x02\x22\xE0", 4U) << salt << iv << ciphertext << tag;
+            }
+            imported.clear();
+            AssertThat(AppSupport::andOTP::importEncrypted(file, sink, "otpgen-tests", &keys), Equals(true));
+            AssertThat(imported.size(), Equals(1U));
+            AssertThat(imported.at(0).label(), Equals("b"));
+
+            // older backups are read as well
+            imported.clear();
+            AssertThat(AppSupport::andOTP::exportTokens(second, {&totp}, AppSupport::andOTP::Encrypted, "otpgen-tests"), Equals(true));
+            AssertThat(AppSupport::andOTP::importEncrypted(second, sink, "otpgen-tests", &keys), Equals(true));
+            AssertThat(imported.size(), Equals(1U));
+            std::vector<OTPToken> rejected;
+            AppSupport::VectorSink wrong(rejected);
+            AssertThat(AppSupport::andOTP::importEncrypted(second, wrong, "wrong", &keys), Equals(false));
+            AssertThat(rejected.empty(), IsTrue());
+            std::remove(second.c_str());
+        });
+
+        it("[andOTP streaming]", [&]{
+            // large enough to span several decrypted chunks
+            std::vector<OTPToken> tokens;
+            std::vector<OTPToken*> pointers;
+            const OTPToken::TokenType types[] = {OTPToken::TOTP, OTPToken::HOTP, OTPToken::Steam};
+            for (auto i = 0; i < 3000; ++i)
+            {
+                tokens.emplace_back(OTPToken(types[i % 3], "token " + std::to_string(i), {}, "XYZA123456KDDK83D"));
+                tokens.back().setCounter(static_cast<OTPToken::CounterType>(i));
+            }
+            for (auto&& token : tokens)
+            {
+                pointers.emplace_back(&token);
+            }
+
+            const auto database = (std::filesystem::temp_directory_path() / "otpgen-tests-import.db").string();
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(database);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+
+            for (auto&& type : {AppSupport::andOTP::PlainText, AppSupport::andOTP::Encrypted})
+            {
+                AssertThat(AppSupport::andOTP::exportTokens(file, pointers, type, "otpgen-tests"), Equals(true));
+
+                std::vector<OTPToken*> imported;
+                AssertThat(AppSupport::andOTP::importTokens(file, imported, type, "otpgen-tests"), Equals(true));
+                std::vector<std::unique_ptr<OTPToken>> owned(imported.begin(), imported.end());
+                AssertThat(owned.size(), Equals(3000U));
+                AssertThat(owned.at(2999)->label(), Equals("token 2999"));
+                AssertThat(owned.at(2999)->type(), Equals(OTPToken::Steam));
+                AssertThat(owned.at(2998)->type(), Equals(OTPToken::HOTP));
+                AssertThat(owned.at(2998)->counter(), Equals(2998U));
+
+                std::size_t inserted = 0U;
+                AssertThat(AppSupport::andOTP::importIntoDatabase(file, type, "otpgen-tests", &inserted), Equals(true));
+                AssertThat(inserted, Equals(3000U));
+                AssertThat(TokenDatabase::tokenCount(), Equals(3000));
+
+                // the database is streamed back into an equivalent backup
+                std::size_t exported = 0U;
+                AssertThat(AppSupport::andOTP::exportDatabase(file, type, "otpgen-tests", &exported), Equals(true));
+                AssertThat(exported, Equals(3000U));
+                std::vector<OTPToken> streamed;
+                AppSupport::VectorSink sink(streamed);
+                AssertThat(AppSupport::andOTP::importTokens(file, sink, type, "otpgen-tests"), Equals(true));
+                AssertThat(streamed.size(), Equals(3000U));
+                const auto hotp = std::find_if(streamed.begin(), streamed.end(), [](const OTPToken &token) {
+                    return token.label() == "token 1";
+                });
+                AssertThat(hotp == streamed.end(), Equals(false));
+                AssertThat(hotp->type(), Equals(OTPToken::HOTP));
+                AssertThat(hotp->counter(), Equals(1U));
+
+                // duplicate labels are skipped
+                AssertThat(AppSupport::andOTP::importIntoDatabase(file, type, "otpgen-tests", &inserted), Equals(true));
+                AssertThat(inserted, Equals(0U));
+                for (auto&& token : TokenDatabase::selectTokens(OTPToken::None, false))
+                {
+                    TokenDatabase::deleteToken(token.id());
+                }
+            }
+
+            // a modified tag fails to authenticate after all entries were parsed, nothing is inserted
+            {
+                std::fstream stream(file, std::ios::in | std::ios::out | std::ios::binary);
+                stream.seekp(-1, std::ios::end);
+                stream.put('\0');
+            }
+            std::vector<OTPToken*> imported;
+            AssertThat(AppSupport::andOTP::importTokens(file, imported, AppSupport::andOTP::Encrypted, "otpgen-tests"), Equals(false));
+            AssertThat(imported.empty(), Equals(true));
+            AssertThat(AppSupport::andOTP::importIntoDatabase(file, AppSupport::andOTP::Encrypted, "otpgen-tests"), Equals(false));
+            AssertThat(TokenDatabase::tokenCount(), Equals(0));
+
+            // the root element must be an array
+            {
+                std::ofstream stream(file, std::ios::out | std::ios::binary | std::ios::trunc);
+                stream << R"({"secret": "XYZA123456KDDK83D", "label": "a", "type": "STEAM"})";
+            }
+            AssertThat(AppSupport::andOTP::importTokens(file, imported), Equals(false));
+
+            TokenDatabase::closeDatabase();
+            std::remove(database.c_str());
+        });
+
+        it("[Authy]", [&]{
+            {
+                std::ofstream stream(file, std::ios::out | std::ios::binary);
+                stream << R"([{"decryptedSecret": "XYZA123456KDDK83D", "digits": 6, "name": "a"}])";
+            }
+
+            std::vector<OTPToken> imported;
+            AssertThat(AppSupport::Authy::importTOTP(file, imported, AppSupport::Authy::JSON), Equals(true));
+            AssertThat(imported.size(), Equals(1U));
+            AssertThat(imported.at(0).label(), Equals("a"));
+            AssertThat(imported.at(0).secret(), Equals("XYZA123456KDDK83D"));
+
+            // the JSON is embedded as escaped string in the XML format
+            {
+                std::ofstream stream(file, std::ios::out | std::ios::binary);
+                stream << R"(<map><string name="com.authy.storage.tokens.authenticator.key">)"
+                       << R"([{&quot;decryptedSecret&quot;: &quot;ABCD123456KDDK83D&quot;, &quot;digits&quot;: 8, &quot;name&quot;: &quot;b&quot;}])"
+                       << R"(</string></map>)";
+            }
+
+            imported.clear();
+            AssertThat(AppSupport::Authy::importTOTP(file, imported, AppSupport::Authy::XML), Equals(true));
+            AssertThat(imported.size(), Equals(1U));
+            AssertThat(imported.at(0).label(), Equals("b"));
+            AssertThat(imported.at(0).digitLength(), Equals(8U));
+
+            // the key is found among other preferences, numeric entities are unescaped as well
+            {
+                std::ofstream stream(file, std::ios::out | std::ios::binary);
+                stream << "<?xml version='1.0' encoding='utf-8' standalone='yes' ?>\n<map>\n"
+                       << R"(<string name="com.authy.storage.tokens.authenticator.key.other">[]</string>)"
+                       << R"(<boolean name="first_run" value="false" />)"
+                       << R"(<string name='com.authy.storage.tokens.authy.key'>)"
+                       << R"([{&quot;secretSeed&quot;: &quot;48656c6c6f21deadbeef&quot;, &quot;digits&quot;: 7, )"
+                       << R"(&quot;appid&quot;: {&quot;name&quot;: &quot;nested&quot;}, &quot;name&quot;: &quot;c &amp; &#x64;&#101;&quot;}])"
+                       << "</string>\n</map>\n";
+            }
+
+            imported.clear();
+            AssertThat(AppSupport::Authy::importTOTP(file, imported, AppSupport::Authy::XML), Equals(false));
+            AssertThat(AppSupport::Authy::importNative(file, imported, AppSupport::Authy::XML), Equals(true));
+            AssertThat(imported.size(), Equals(1U));
+            AssertThat(imported.at(0).label(), Equals("c & de"));
+            AssertThat(imported.at(0).digitLength(), Equals(7U));
+            AssertThat(imported.at(0).secret(), Equals("JBSWY3DPEHPK3PXP"));
+
+            // malformed JSON adds nothing
+            {
+                std::ofstream stream(file, std::ios::out | std::ios::binary);
+                stream << R"([{"decryptedSecret": "XYZA123456KDDK83D", "digits": 6, "name": "a"}, {)";
+            }
+            imported.clear();
+            AssertThat(AppSupport::Authy::importTOTP(file, imported, AppSupport::Authy::JSON), Equals(false));
+            AssertThat(imported.empty(), Equals(true));
+        });
+
+        it("[GoogleAuthenticator]", [&]{
+            // protobuf OtpParameters messages
+            const auto field = [](char tag, const std::string &value) {
+                return std::string(1, tag) + static_cast<char>(value.size()) + value;
+            };
+            const auto totp = field('\x0a', "Hello!\xde\xad\xbe\xef") + field('\x12', "Example:alice") + field('\x1a', "Example") +
+                              std::string("\x20\x01\x28\x01\x30\x02", 6);
+            const auto hotp = field('\x0a', "\x01\x02\x03\x04\x05") + field('\x12', "bob") + field('\x1a', "Bank") +
+                              std::string("\x20\x02\x28\x02\x30\x01\x38\xac\x02", 9);
+            const auto md5 = field('\x0a', "\x01\x02\x03\x04\x05") + field('\x12', "old") + std::string("\x20\x04", 2);
+            const auto payload = field('\x0a', totp) + field('\x0a', hotp) + field('\x0a', md5) + std::string("\x10\x01", 2);
+
+            std::string uri = "otpauth-migration://offline?data=";
+            for (auto&& c : Codec::base64Encode(payload))
+            {
+                uri += c == '+' ? "%2B" : c == '/' ? "%2F" : c == '=' ? "%3D" : std::string(1, c);
+            }
+
+            std::vector<OTPToken> imported;
+            AssertThat(AppSupport::GoogleAuthenticator::importMigration(uri, imported), Equals(true));
+            AssertThat(imported.size(), Equals(2U));
+            AssertThat(imported.at(0).type(), Equals(OTPToken::TOTP));
+            AssertThat(imported.at(0).label(), Equals("Example:alice"));
+            AssertThat(imported.at(0).secret(), Equals("JBSWY3DPEHPK3PXP"));
+            AssertThat(imported.at(0).digitLength(), Equals(6U));
+            AssertThat(imported.at(1).type(), Equals(OTPToken::HOTP));
+            AssertThat(imported.at(1).label(), Equals("Bank:bob"));
+            AssertThat(imported.at(1).algorithm(), Equals(OTPToken::SHA256));
+            AssertThat(imported.at(1).digitLength(), Equals(8U));
+            AssertThat(imported.at(1).counter(), Equals(300U));
+
+            // truncated payloads and other URIs add nothing
+            imported.clear();
+            AssertThat(AppSupport::GoogleAuthenticator::importMigration(uri.substr(0, uri.size() - 12U), imported), Equals(false));
+            AssertThat(AppSupport::GoogleAuthenticator::importMigration("otpauth://totp/a?secret=ABCD", imported), Equals(false));
+            AssertThat(imported.empty(), Equals(true));
+        });
+
+        it("[SteamGuard maFiles]", [&]{
+            const auto folder = std::filesystem::temp_directory_path() / "otpgen-tests-mafiles";
+            std::filesystem::remove_all(folder);
+            std::filesystem::create_directories(folder);
+            const auto write = [&](const std::string &name, const std::string &contents) {
+                std::ofstream stream(folder / name, std::ios::out | std::ios::binary | std::ios::trunc);
+                stream << contents;
+            };
+            const auto maFile = [](const std::string &account) {
+                return R"({"steamid": "76561198000000000", "shared_secret": "zvIayp3JPvtvX/QGHqsqKBk/44s=", )"
+                       R"("account_name": ")" + account + R"(", "status": 1})";
+            };
+
+            // Steam Desktop Authenticator encrypts every file with its own salt and IV
+            const auto encrypt = [](const std::string &plain, const std::string &salt, const std::string &iv) {
+                CryptoPP::byte key[32];
+                CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA1> kdf;
+                kdf.DeriveKey(key, sizeof(key), 0, reinterpret_cast<const CryptoPP::byte*>("otpgen-tests"), 12U,
+                              reinterpret_cast<const CryptoPP::byte*>(salt.data()), salt.size(), 50000U);
+                CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption cipher(key, sizeof(key), reinterpret_cast<const CryptoPP::byte*>(iv.data()));
+                std::string out;
+                CryptoPP::StringSource(plain, true, new CryptoPP::StreamTransformationFilter(cipher,
+                    new CryptoPP::Base64Encoder(new CryptoPP::StringSink(out), false)));
+                return out;
+            };
+
+            // plain folders without a manifest are imported in file name order
+            write("2.maFile", maFile("second"));
+            write("1.maFile", maFile("first"));
+            write("notes.txt", "not a maFile");
+            std::vector<OTPToken> imported;
+            AppSupport::VectorSink sink(imported);
+            AssertThat(AppSupport::Steam::importFromMaFiles(folder.string(), sink), Equals(true));
+            AssertThat(imported.size(), Equals(2U));
+            AssertThat(imported.at(0).label(), Equals(std::string("first")));
+            AssertThat(imported.at(1).type(), Equals(OTPToken::Steam));
+            AssertThat(std::string(imported.at(1).secret()), Equals(std::string("Z3ZBVSU5ZE7PW3276QDB5KZKFAMT7Y4L")));
+
+            // an encrypted folder, in manifest order
+            const std::string salts[] = {"saltsal1", "saltsal2", "saltsal3"};
+            const std::string ivs[] = {"0123456789abcdef", "fedcba9876543210", "0000000011111111"};
+            std::string manifest = R"({"encrypted": true, "first_run": false, "entries": [)";
+            for (auto i = 0U; i < 3U; ++i)
+            {
+                const auto name = "7656119800000000" + std::to_string(i) + ".maFile";
+                write(name, encrypt(maFile("account" + std::to_string(i)), salts[i], ivs[i]));
+                manifest += std::string(i ? ", " : "") + R"({"encryption_iv": ")" + Codec::base64Encode(ivs[2U - i]) +
+                            R"(", "encryption_salt": ")" + Codec::base64Encode(salts[2U - i]) + R"(", "filename": ")" +
+                            "7656119800000000" + std::to_string(2U - i) + R"(.maFile", "steamid": 0})";
+            }
+            write("manifest.json", manifest + "]}");
+
+            ThreadPool pool(2U);
+            imported.clear();
+            AssertThat(AppSupport::Steam::importFromMaFiles(folder.string(), sink, "otpgen-tests", &pool), Equals(true));
+            AssertThat(imported.size(), Equals(3U));
+            AssertThat(imported.at(0).label(), Equals(std::string("account2")));
+            AssertThat(imported.at(2).label(), Equals(std::string("account0")));
+            AssertThat(std::string(imported.at(2).secret()), Equals(std::string("Z3ZBVSU5ZE7PW3276QDB5KZKFAMT7Y4L")));
+
+            // a wrong passkey fails the whole folder
+            imported.clear();
+            AssertThat(AppSupport::Steam::importFromMaFiles((folder / "manifest.json").string(), sink, "wrong", &pool), Equals(false));
+            AssertThat(AppSupport::Steam::importFromMaFiles(folder.string(), sink), Equals(false));
+            AssertThat(imported.empty(), Equals(true));
+
+            AssertThat(AppSupport::ImportPipeline::detectFormat(folder.string()), Equals(AppSupport::ImportPipeline::SteamMaFiles));
+            AssertThat(AppSupport::ImportPipeline::detectFormat((folder / "manifest.json").string()), Equals(AppSupport::ImportPipeline::SteamMaFiles));
+            std::filesystem::remove_all(folder);
+        });
+
+        it("[JSON arena]", [&]{
+            // the strings of a document parsed in place point into the text
+            SecureString text = R"({"secret":"JBSWY3DPEHPK3PXP","digits":6})";
+            {
+                Internal::JsonArena arena;
+                auto json = arena.document();
+                AssertThat(Internal::JsonArena::parseInsitu(json, text), IsTrue());
+                const auto secret = json["secret"].GetString();
+                AssertThat(std::string(secret), Equals("JBSWY3DPEHPK3PXP"));
+                AssertThat(secret >= text.data() && secret < text.data() + text.size(), IsTrue());
+                AssertThat(json["digits"].GetUint(), Equals(6U));
+
+                // nested arenas have a buffer of their own
+                Internal::JsonArena nested;
+                auto other = nested.document();
+                other.Parse("[1,2,3]");
+                AssertThat(other.Size(), Equals(3U));
+                AssertThat(&nested.allocator() != &arena.allocator(), IsTrue());
+            }
+
+            SecureString invalid = "{\"secret\":";
+            {
+                Internal::JsonArena arena;
+                auto json = arena.document();
+                AssertThat(Internal::JsonArena::parseInsitu(json, invalid), IsFalse());
+            }
+
+            // a document which spilled grows the buffer of the thread
+            std::string large = "[";
+            for (auto i = 0; i < 20000; ++i)
+            {
+                large += i == 0 ? "\"entry\"" : ",\"entry\"";
+            }
+            large += "]";
+            std::size_t initial = 0U;
+            {
+                Internal::JsonArena arena;
+                initial = arena.allocator().Capacity();
+                auto json = arena.document();
+                json.Parse(large.data(), large.size());
+                AssertThat(json.Size(), Equals(20000U));
+                AssertThat(arena.allocator().Capacity() > initial, IsTrue());
+            }
+            {
+                Internal::JsonArena arena;
+                AssertThat(arena.allocator().Capacity() > initial, IsTrue());
+            }
+        });
+
+        it("[FileFormat]", [&]{
+            const auto directory = std::filesystem::temp_directory_path();
+            const auto aegis = (directory / "otpgen-tests-aegis.json").string();
+            const auto freeotp = (directory / "otpgen-tests-freeotp.json").string();
+            const auto twofas = (directory / "otpgen-tests-backup.2fas").string();
+            const auto database = (directory / "otpgen-tests-formats.db").string();
+
+            // FreeOTP+ stores the bytes, so the secrets must be canonical base-32
+            OTPToken totp(OTPToken::TOTP, "a", {}, "JBSWY3DPEHPK3PXP", 8, 60, 0, OTPToken::SHA256);
+            totp.setIssuer("Issuer");
+            OTPToken hotp(OTPToken::HOTP, "b", {}, "GEZDGNBVGY3TQOJQ", 6, 30, 7, OTPToken::SHA1);
+            OTPToken steam(OTPToken::Steam, "c", {}, "MFRGGZDFMZTWQ2LK");
+            const std::vector<OTPToken*> tokens = {&totp, &hotp, &steam};
+            const auto same = [](const OTPToken &a, const OTPToken &b) {
+                return a.type() == b.type() && a.label() == b.label() && a.issuer() == b.issuer() && a.secret() == b.secret() &&
+                       a.digitLength() == b.digitLength() && a.algorithm() == b.algorithm() &&
+                       (a.type() == OTPToken::HOTP ? a.counter() == b.counter() : a.period() == b.period());
+            };
+
+            // the vault and the import derive the key once
+            auto keys = std::make_shared<AppSupport::KeyCache>();
+            std::vector<OTPToken> imported;
+            AppSupport::VectorSink sink(imported);
+            AssertThat(AppSupport::Aegis::exportTokens(aegis, tokens, "otpgen-tests", keys.get()), Equals(true));
+            AssertThat(AppSupport::Aegis::importTokens(aegis, sink, "wrong"), Equals(false));
+            AssertThat(imported.empty(), Equals(true));
+            AssertThat(AppSupport::Aegis::importTokens(aegis, sink, "otpgen-tests", keys.get()), Equals(true));
+            AssertThat(keys->size(), Equals(1U));
+            AssertThat(imported.size(), Equals(3U));
+            for (auto i = 0U; i < tokens.size(); ++i)
+            {
+                AssertThat(same(*tokens[i], imported[i]), IsTrue());
+            }
+
+            // FreeOTP+ has no Steam tokens
+            imported.clear();
+            AssertThat(AppSupport::FreeOTPPlus::exportTokens(freeotp, tokens), Equals(true));
+            AssertThat(AppSupport::FreeOTPPlus::importTokens(freeotp, sink), Equals(true));
+            AssertThat(imported.size(), Equals(2U));
+            AssertThat(same(totp, imported[0]) && same(hotp, imported[1]), IsTrue());
+
+            imported.clear();
+            AssertThat(AppSupport::TwoFAS::exportTokens(twofas, tokens), Equals(true));
+            AssertThat(AppSupport::TwoFAS::importTokens(twofas, sink), Equals(true));
+            AssertThat(imported.size(), Equals(3U));
+            AssertThat(same(steam, imported[2]) && same(hotp, imported[1]), IsTrue());
+
+            // password protected 2FAS backups
+            {
+                const std::string services = R"([{"name": "Service", "secret": "XYZA123456KDDK83D", "otp": {"account": "d", "digits": 7}}])";
+                const auto salt = Internal::randomBytes(32U);
+                const auto iv = Internal::randomBytes(12U);
+                const auto key = AppSupport::KeyCache::derive({AppSupport::KeyCache::PBKDF2_SHA256, 10000U, 0U, 0U, 32U}, "otpgen-tests", salt);
+                std::string ciphertext, tag;
+                AssertThat(Internal::gcmEncrypt(key, iv, services, ciphertext, tag), IsTrue());
+                std::ofstream stream(twofas, std::ios::out | std::ios::binary | std::ios::trunc);
+                stream << R"({"services": [], "servicesEncrypted": ")" << Codec::base64Encode(ciphertext + tag) << ":"
+                       << Codec::base64Encode(salt) << ":" << Codec::base64Encode(iv) << R"(", "schemaVersion": 4})";
+            }
+            imported.clear();
+            AssertThat(AppSupport::TwoFAS::importTokens(twofas, sink, "wrong"), Equals(false));
+            AssertThat(AppSupport::TwoFAS::importTokens(twofas, sink, "otpgen-tests", keys.get()), Equals(true));
+            AssertThat(imported.size(), Equals(1U));
+            AssertThat(imported.at(0).label(), Equals(std::string("d")));
+            AssertThat(imported.at(0).issuer(), Equals(std::string("Service")));
+            AssertThat(imported.at(0).digitLength(), Equals(7U));
+
+            // formats are found by name and detected from the contents
+            AssertThat(AppSupport::FormatRegistry::find("2fas")->canWrite(), IsTrue());
+            AssertThat(AppSupport::FormatRegistry::find("missing") == nullptr, IsTrue());
+            AssertThat(std::string(AppSupport::FormatRegistry::detect("{\"tokenOrder\": [], \"tokens\": []}")->name()), Equals(std::string("freeotp+")));
+            AssertThat(std::string(AppSupport::FormatRegistry::detect("[]")->name()), Equals(std::string("andotp")));
+            AssertThat(AppSupport::ImportPipeline::detectFormat(aegis), Equals(AppSupport::ImportPipeline::Registered));
+
+            imported.clear();
+            AppSupport::FileFormat::Options options;
+            options.password = "otpgen-tests";
+            options.keys = keys.get();
+            AssertThat(AppSupport::FormatRegistry::importFile(aegis, sink, options), Equals(true));
+            AssertThat(imported.size(), Equals(3U));
+
+            // the pipeline shares the cache, the vault is committed like the built-in formats
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(database);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            ThreadPool pool(2U);
+            AppSupport::ImportPipeline pipeline(&pool);
+            pipeline.setPassword("otpgen-tests");
+            pipeline.setKeyCache(keys);
+            pipeline.addFile(aegis);
+            pipeline.addFile(freeotp, AppSupport::FormatRegistry::find("freeotp+"));
+            std::size_t inserted = 0U;
+            AssertThat(pipeline.run(&inserted), Equals(true));
+            AssertThat(inserted, Equals(3U));
+            AssertThat(pipeline.results().at(0).format, Equals(AppSupport::ImportPipeline::Registered));
+            AssertThat(pipeline.results().at(1).duplicates, Equals(2U));
+            AssertThat(keys->size(), Equals(2U));
+
+            TokenDatabase::closeDatabase();
+            for (auto&& path : {aegis, freeotp, twofas, database})
+            {
+                std::remove(path.c_str());
+            }
+        });
+
+        it("[KeyCache]", [&]{
+            AppSupport::KeyCache keys;
+            const AppSupport::KeyCache::Parameters scrypt = {AppSupport::KeyCache::Scrypt, 1024U, 8U, 1U, 32U};
+            std::vector<AppSupport::KeyCache::Request> requests(8U, {scrypt, "salt"});
+            requests.back().salt = "other salt";
+
+            // concurrent requests of the same key wait for a single derivation
+            ThreadPool pool(4U);
+            const auto derived = keys.keys(requests, "otpgen-tests", &pool);
+            AssertThat(derived.size(), Equals(8U));
+            AssertThat(keys.size(), Equals(2U));
+            AssertThat(derived[0] == derived[6], IsTrue());
+            AssertThat(derived[0] == derived[7], IsFalse());
+            AssertThat(derived[0] == AppSupport::KeyCache::derive(scrypt, "otpgen-tests", "salt"), IsTrue());
+            AssertThat(keys.key(scrypt, "wrong", "salt") == derived[0], IsFalse());
+
+            // invalid parameters derive nothing
+            AssertThat(AppSupport::KeyCache::derive({AppSupport::KeyCache::Scrypt, 1000U, 8U, 1U, 32U}, "otpgen-tests", "salt").empty(), IsTrue());
+            keys.clear();
+            AssertThat(keys.size(), Equals(0U));
+        });
+
+        it("[ImportPipeline]", [&]{
+            const auto directory = std::filesystem::temp_directory_path();
+            const auto backup = (directory / "otpgen-tests-pipeline-andotp.json").string();
+            const auto authy = (directory / "otpgen-tests-pipeline-authy.json").string();
+            const auto uris = (directory / "otpgen-tests-pipeline-uris.txt").string();
+            const auto database = (directory / "otpgen-tests-pipeline.db").string();
+
+            OTPToken totp(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D");
+            OTPToken steam(OTPToken::Steam, "b", {}, "ABCD123456KDDK83D");
+            AssertThat(AppSupport::andOTP::exportTokens(backup, {&totp, &steam}, AppSupport::andOTP::Encrypted, "otpgen-tests"), Equals(true));
+            {
+                std::ofstream stream(authy, std::ios::out | std::ios::binary);
+                stream << R"([{"decryptedSecret": "XYZA123456KDDK83D", "digits": 6, "name": "a"},)"
+                       << R"( {"decryptedSecret": "QRST123456KDDK83D", "digits": 6, "name": "c"}])";
+            }
+            {
+                std::ofstream stream(uris, std::ios::out | std::ios::binary);
+                stream << "otpauth://totp/d?secret=XYZA123456KDDK83D&digits=8\r\n\n"
+                       << "otpauth://hotp/e?secret=XYZA123456KDDK83D&counter=4\n";
+            }
+
+            AssertThat(AppSupport::ImportPipeline::detectFormat(backup), Equals(AppSupport::ImportPipeline::andOTPEncrypted));
+            AssertThat(AppSupport::ImportPipeline::detectFormat(authy), Equals(AppSupport::ImportPipeline::AuthyTOTPJSON));
+            AssertThat(AppSupport::ImportPipeline::detectFormat(uris), Equals(AppSupport::ImportPipeline::OtpauthURIs));
+            AssertThat(AppSupport::ImportPipeline::detectFormat(std::string_view("{\"shared_secret\": \"\"}")), Equals(AppSupport::ImportPipeline::SteamGuard));
+            AssertThat(AppSupport::ImportPipeline::detectFormat(file + ".missing"), Equals(AppSupport::ImportPipeline::Unknown));
+
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(database);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+
+            ThreadPool pool(2U);
+            AppSupport::ImportPipeline pipeline(&pool);
+            pipeline.setPassword("otpgen-tests");
+            pipeline.addFile(backup);
+            pipeline.addFile(authy);
+            pipeline.addFile(uris);
+            pipeline.addFile(file + ".missing");
+
+            // "a" is in the andOTP and the Authy file
+            std::size_t inserted = 0U;
+            AssertThat(pipeline.run(&inserted), Equals(true));
+            AssertThat(inserted, Equals(5U));
+            AssertThat(TokenDatabase::tokenCount(), Equals(5));
+
+            const auto &results = pipeline.results();
+            AssertThat(results.at(0).inserted, Equals(2U));
+            AssertThat(results.at(1).tokens, Equals(2U));
+            AssertThat(results.at(1).duplicates, Equals(1U));
+            AssertThat(results.at(2).inserted, Equals(2U));
+            AssertThat(results.at(3).success, Equals(false));
+
+            const auto hotp = TokenDatabase::selectTokens(OTPToken::HOTP, false);
+            AssertThat(hotp.size(), Equals(1U));
+            AssertThat(hotp.at(0).counter(), Equals(4U));
+
+            // a second run finds everything in the database
+            AssertThat(pipeline.run(&inserted), Equals(true));
+            AssertThat(inserted, Equals(0U));
+            AssertThat(results.at(0).duplicates, Equals(2U));
+
+            // URIs from memory, for example decoded QR codes
+            AppSupport::ImportPipeline decoded(&pool);
+            decoded.addURIs("first", "otpauth://totp/f?secret=XYZA123456KDDK83D");
+            decoded.addURIs("second", "otpauth://totp/d?secret=XYZA123456KDDK83D&digits=8");
+            decoded.addURIs("third", "not an uri");
+            AssertThat(decoded.run(&inserted), Equals(true));
+            AssertThat(inserted, Equals(1U));
+            AssertThat(decoded.results().at(0).file, Equals(std::string("first")));
+            AssertThat(decoded.results().at(1).duplicates, Equals(1U));
+            AssertThat(decoded.results().at(2).success, Equals(false));
+
+            // secrets which are already in the database, under any label
+            AppSupport::ImportPipeline renamed(&pool);
+            renamed.setSkipDuplicateSecrets(true);
+            renamed.addURIs("renamed", "otpauth://totp/g?secret=QRST123456KDDK83D\notpauth://totp/h?secret=MNOP123456KDDK83D");
+            AssertThat(renamed.run(&inserted), Equals(true));
+            AssertThat(inserted, Equals(1U));
+            AssertThat(renamed.results().at(0).duplicates, Equals(1U));
+
+            TokenDatabase::closeDatabase();
+            for (auto&& path : {backup, authy, uris, database})
+            {
+                std::remove(path.c_str());
+            }
+        });
+
+        it("[IconTranscoder]", [&]{
+            using Transcoder = AppSupport::IconTranscoder;
+            const auto bytes = [](const std::string &text) {
+                return OTPToken::Icon(text.begin(), text.end());
+            };
+
+            AssertThat(Transcoder::detect(bytes("\x89PNG\r\n\x1A\n....")), Equals(Transcoder::Png));
+            AssertThat(Transcoder::detect(bytes("RIFF....WEBPVP8 ")), Equals(Transcoder::WebP));
+            AssertThat(Transcoder::detect(bytes("\xEF\xBB\xBF <?xml version=\"1.0\"?>\n<svg/>")), Equals(Transcoder::Svg));
+            AssertThat(Transcoder::detect(bytes("<html></html>")), Equals(Transcoder::Unknown));
+            AssertThat(Transcoder::detect({}), Equals(Transcoder::Unknown));
+
+            // vectors are compressed, already compressed ones are kept
+            std::string svg = "<svg xmlns=\"http://www.w3.org/2000/svg\">";
+            for (auto i = 0; i < 100; ++i)
+            {
+                svg += "<rect x=\"" + std::to_string(i) + "\" y=\"0\" width=\"1\" height=\"1\"/>";
+            }
+            svg += "</svg>";
+            auto icon = bytes(svg);
+            AssertThat(Transcoder::transcode(icon), IsTrue());
+            AssertThat(Transcoder::detect(icon), Equals(Transcoder::Svgz));
+            AssertThat(icon.size() < svg.size(), IsTrue());
+            AssertThat(Transcoder::transcode(icon), IsFalse());
+
+            // rasters need the encoder of the frontend, larger results are dropped
+            const auto png = bytes("\x89PNG\r\n\x1A\n" + std::string(1024U, '\0'));
+            std::vector<OTPToken> tokens(4U, OTPToken(OTPToken::TOTP, "a", png, "XYZA123456KDDK83D"));
+            tokens[1].setIcon({});
+            tokens[2].setIcon(bytes(svg));
+            AssertThat(Transcoder::transcode(tokens), Equals(1U));
+            AssertThat(tokens[0].icon(), Equals(png));
+
+            std::atomic<unsigned> calls{0U};
+            Transcoder::setRasterEncoder([&](const OTPToken::Icon &, unsigned size, OTPToken::Icon &out) {
+                ++calls;
+                out = OTPToken::Icon(size == Transcoder::MAX_SIZE ? 64U : 4096U, 0x42);
+                return true;
+            });
+            ThreadPool pool(2U);
+            AssertThat(Transcoder::transcode(tokens, &pool), Equals(2U));
+            AssertThat(calls.load(), Equals(2U));
+            AssertThat(tokens[0].icon(), Equals(OTPToken::Icon(64U, 0x42)));
+            AssertThat(tokens[1].icon().empty(), IsTrue());
+            AssertThat(Transcoder::detect(tokens[2].icon()), Equals(Transcoder::Svgz));
+            Transcoder::setRasterEncoder(nullptr);
+        });
+
+        it("[ImportSink]", [&]{
+            {
+                std::ofstream stream(file, std::ios::out | std::ios::binary);
+                stream << R"([{"decryptedSecret": "XYZA123456KDDK83D", "digits": 6, "name": "a"},)"
+                       << R"( {"decryptedSecret": "ABCD123456KDDK83D", "digits": 8, "name": "b"}])";
+            }
+
+            std::vector<OTPToken::Label> labels;
+            AppSupport::CallbackSink sink([&](OTPToken &&token) {
+                labels.emplace_back(token.label());
+            });
+            AssertThat(AppSupport::Authy::importTOTP(file, sink, AppSupport::Authy::JSON), Equals(true));
+            AssertThat(labels.size(), Equals(2U));
+            AssertThat(labels.at(1), Equals("b"));
+
+            // an aborted import removes only the tokens it added
+            std::vector<OTPToken> imported;
+            imported.emplace_back(OTPToken::TOTP);
+            AppSupport::VectorSink vector(imported);
+            AssertThat(AppSupport::Authy::importTOTP(file, vector, AppSupport::Authy::JSON), Equals(true));
+            AssertThat(imported.size(), Equals(3U));
+            vector.abort();
+            AssertThat(imported.size(), Equals(1U));
+        });
+    });
+});
+
+#endif // APPSUPPORTTESTS_HPP
@@ -0,0 +1,104 @@
+// the coroutine API needs C++20, which the other tests can't be compiled as,
+// so these tests are a translation unit of their own
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <Async.hpp>
+
+#ifdef OTPGEN_HAS_COROUTINES
+
+#include <ThreadPool.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+namespace AsyncTests {
+    static Async::Task<std::string> copyFile(const std::string &from, const std::string &to, AsyncFileIO &io)
+    {
+        auto read = co_await Async::read(from, io);
+        if (read.status != TokenDatabase::Success)
+        {
+            co_return std::string();
+        }
+        co_await Async::write(to, read.data + "!", io);
+        co_return (co_await Async::read(to, io)).data;
+    }
+
+    static Async::Task<int> fails()
+    {
+        throw std::runtime_error("failed");
+        co_return 0;
+    }
+
+    static Async::Task<int> sum(int depth)
+    {
+        // nested tasks resume their awaiter when they finished
+        if (depth == 0)
+        {
+            co_return 0;
+        }
+        co_return 1 + co_await sum(depth - 1);
+    }
+}
+
+go_bandit([]{
+    describe("Async Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-async-tests.bin").string();
+
+        after_each([&]{
+            std::remove(file.c_str());
+            std::remove((file + ".copy").c_str());
+        });
+
+        it("[files]", [&]{
+            AsyncFileIO io;
+            AssertThat(io.write(file, "data").get(), Equals(TokenDatabase::Success));
+            AssertThat(Async::wait(AsyncTests::copyFile(file, file + ".copy", io)), Equals("data!"));
+            AssertThat(Async::wait(AsyncTests::copyFile(file + ".missing", file + ".copy", io)), Equals(""));
+        });
+
+        it("[run]", [&]{
+            // many operations in flight on two workers
+            AsyncFileIO io(AsyncFileIO::Threads, 2U);
+            std::atomic<int> done{0};
+            for (auto i = 0; i < 1000; ++i)
+            {
+                Async::spawn([](AsyncFileIO &io, std::atomic<int> &done, int i) -> Async::Task<> {
+                    const auto value = co_await Async::run([i]{ return i * 2; }, io);
+                    done += value == i * 2;
+                }(io, done, i));
+            }
+            AssertThat(Async::wait(AsyncTests::sum(1000)), Equals(1000));
+            AssertThat(Async::wait([](AsyncFileIO &io) -> Async::Task<bool> {
+                co_await Async::run([]{}, io);
+                co_return true;
+            }(io)), Equals(true));
+
+            // exceptions reach the awaiter
+            AssertThrows(std::runtime_error, Async::wait(AsyncTests::fails()));
+
+            while (done.load() != 1000)
+            {
+                std::this_thread::yield();
+            }
+        });
+
+        it("[verifyTOTPBatch]", [&]{
+            // code of the [computeTOTP 1] test
+            ThreadPool pool(2U);
+            const std::vector<OTPKey> keys(3U, OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1));
+            const std::vector<OTPToken::TokenString> codes{"122810", "122811", "122810"};
+            const auto matched = Async::wait([&]() -> Async::Task<std::vector<std::uint8_t>> {
+                co_return co_await Async::verifyTOTPBatch(keys, codes, 1536573862, 1, 6, 30, &pool);
+            }());
+            AssertThat(matched, Equals(std::vector<std::uint8_t>{1, 0, 1}));
+        });
+    });
+});
+
+#endif // OTPGEN_HAS_COROUTINES
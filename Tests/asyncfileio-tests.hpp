@@ -0,0 +1,91 @@
+#ifndef ASYNCFILEIOTESTS_HPP
+#define ASYNCFILEIOTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <AsyncFileIO.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+go_bandit([]{
+    describe("AsyncFileIO Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-asyncio-tests.bin").string();
+
+        after_each([&]{
+            std::remove(file.c_str());
+        });
+
+        for (auto backend : {AsyncFileIO::Threads, AsyncFileIO::IoUring})
+        {
+            const std::string name = backend == AsyncFileIO::Threads ? "threads" : "io_uring";
+
+            it("[read and write] " + name, [&, backend]{
+                // io_uring may be unavailable, the worker backend is used then
+                AsyncFileIO io(backend);
+                AssertThat(backend == AsyncFileIO::IoUring || io.backend() == AsyncFileIO::Threads, Equals(true));
+
+                std::string data(3U * 1024U * 1024U + 17U, '\0');
+                for (auto i = 0U; i < data.size(); ++i)
+                {
+                    data[i] = static_cast<char>(i * 31U + (i >> 9));
+                }
+
+                AssertThat(io.write(file, data).get(), Equals(TokenDatabase::Success));
+                AssertThat(std::filesystem::exists(file + ".tmp"), Equals(false));
+                AssertThat(std::filesystem::file_size(file), Equals(data.size()));
+
+                auto read = io.read(file).get();
+                AssertThat(read.status, Equals(TokenDatabase::Success));
+                AssertThat(read.data == data, Equals(true));
+
+                // replaced atomically by a shorter file
+                AssertThat(io.write(file, "short").get(), Equals(TokenDatabase::Success));
+                read = io.read(file).get();
+                AssertThat(read.data, Equals("short"));
+
+                // errors match the blocking functions
+                AssertThat(io.write(file, "").get(), Equals(TokenDatabase::Success));
+                AssertThat(io.read(file).get().status, Equals(TokenDatabase::FileEmpty));
+                AssertThat(io.read(file + ".missing").get().status, Equals(TokenDatabase::FileReadFailure));
+                AssertThat(io.write(file + ".missing/file", "x").get(), Equals(TokenDatabase::FileWriteFailure));
+            });
+
+            it("[callbacks] " + name, [&, backend]{
+                std::atomic<int> reads{0};
+                std::atomic<int> writes{0};
+                {
+                    AsyncFileIO io(backend, 3U);
+                    for (auto i = 0; i < 100; ++i)
+                    {
+                        const auto target = file + "." + std::to_string(i);
+                        io.write(target, "data " + std::to_string(i), [&, io = &io, target, i](const TokenDatabase::Error &status) {
+                            if (status == TokenDatabase::Success)
+                            {
+                                ++writes;
+                            }
+                            io->read(target, [&, target, i](const TokenDatabase::Error &status, std::string &&data) {
+                                if (status == TokenDatabase::Success && data == "data " + std::to_string(i))
+                                {
+                                    ++reads;
+                                }
+                                std::remove(target.c_str());
+                            });
+                        });
+                    }
+                    io.run([&]{ ++reads; });
+                    // the destructor finishes all queued operations
+                }
+                AssertThat(writes.load(), Equals(100));
+                AssertThat(reads.load(), Equals(101));
+            });
+        }
+    });
+});
+
+#endif // ASYNCFILEIOTESTS_HPP
@@ -0,0 +1,131 @@
+#ifndef AUDITLOGTESTS_HPP
+#define AUDITLOGTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <AuditLog.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+go_bandit([]{
+    describe("AuditLog Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-tests-audit.log").string();
+        const auto all_times = std::numeric_limits<std::int64_t>::min();
+        const auto no_end = std::numeric_limits<std::int64_t>::max();
+
+        const auto make_record = [](std::int64_t time, OTPToken::sqliteTokenID token, AuditLog::Action action) {
+            AuditLog::Record record;
+            record.time = time;
+            record.token = token;
+            record.action = action;
+            return record;
+        };
+
+        it("[record and scan]", [&]{
+            std::filesystem::remove(file);
+
+            // rings much smaller than the records of a thread, the threads wait for the writer
+            AuditLog::Options options;
+            options.ringSize = 64U;
+            options.flushInterval = std::chrono::milliseconds(5);
+            AuditLog log;
+            AssertThat(log.open(file, "audit", options) == AuditLog::Success, Equals(true));
+
+            std::vector<std::thread> threads;
+            for (auto t = 0U; t < 4U; ++t)
+            {
+                threads.emplace_back([&, t]{
+                    for (auto i = 0U; i < 5000U; ++i)
+                    {
+                        log.record(make_record(1000 + i, t + 1, i % 2U ? AuditLog::Verified : AuditLog::Rejected));
+                    }
+                    AssertThat(log.flush(), Equals(true));
+                });
+            }
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            AssertThat(log.written(), Equals(20000U));
+            AssertThat(log.healthy(), Equals(true));
+            log.close();
+
+            std::vector<AuditLog::Record> records;
+            AssertThat(AuditLog::scan(file, "audit", 0, all_times, no_end, records) == AuditLog::Success, Equals(true));
+            AssertThat(records.size(), Equals(20000U));
+
+            records.clear();
+            AssertThat(AuditLog::scan(file, "audit", 3, 2000, 2010, records) == AuditLog::Success, Equals(true));
+            AssertThat(records.size(), Equals(10U));
+            AssertThat(records[0].time, Equals(2000));
+            AssertThat(records[0].token, Equals(3));
+            AssertThat(records[0].action == AuditLog::Rejected, Equals(true));
+            AssertThat(records[1].action == AuditLog::Verified, Equals(true));
+
+            // the records after flush() are in the file, close() writes the rest
+            AssertThat(log.open(file, "audit") == AuditLog::Success, Equals(true));
+            log.record(7, AuditLog::Generated);
+            AssertThat(log.flush(), Equals(true));
+            records.clear();
+            AssertThat(AuditLog::scan(file, "audit", 7, all_times, no_end, records) == AuditLog::Success, Equals(true));
+            AssertThat(records.size(), Equals(1U));
+            log.record(7, AuditLog::Limited);
+            log.close();
+            records.clear();
+            AssertThat(AuditLog::scan(file, "audit", 7, all_times, no_end, records) == AuditLog::Success, Equals(true));
+            AssertThat(records.size(), Equals(2U));
+            AssertThat(records[1].action == AuditLog::Limited, Equals(true));
+            AssertThat(records[1].time >= records[0].time, Equals(true));
+        });
+
+        it("[password, torn and modified blocks]", [&]{
+            std::filesystem::remove(file);
+            AuditLog log;
+            AssertThat(log.open(file, "audit") == AuditLog::Success, Equals(true));
+            log.record(make_record(1000, 1, AuditLog::Verified));
+            AssertThat(log.flush(), Equals(true));
+            log.record(make_record(2000, 2, AuditLog::Rejected));
+            log.close();
+
+            std::vector<AuditLog::Record> records;
+            AssertThat(log.open(file, "wrong") == AuditLog::AuthenticationFailed, Equals(true));
+            AssertThat(AuditLog::scan(file, "wrong", 0, all_times, no_end, records) == AuditLog::AuthenticationFailed, Equals(true));
+
+            // a partially written block is dropped, the next block takes its place
+            const auto size = std::filesystem::file_size(file);
+            std::filesystem::resize_file(file, size - 5U);
+            AssertThat(AuditLog::scan(file, "audit", 0, all_times, no_end, records) == AuditLog::Success, Equals(true));
+            AssertThat(records.size(), Equals(1U));
+            AssertThat(log.open(file, "audit") == AuditLog::Success, Equals(true));
+            log.record(make_record(3000, 3, AuditLog::Resynced));
+            log.close();
+            records.clear();
+            AssertThat(AuditLog::scan(file, "audit", 0, all_times, no_end, records) == AuditLog::Success, Equals(true));
+            AssertThat(records.size(), Equals(2U));
+            AssertThat(records[1].token, Equals(3));
+
+            // blocks outside of the range aren't decrypted, the whole range finds the modification
+            {
+                std::fstream stream(file, std::ios::in | std::ios::out | std::ios::binary);
+                stream.seekg(-1, std::ios::end);
+                const auto byte = static_cast<char>(stream.get() ^ 0x01);
+                stream.seekp(-1, std::ios::end);
+                stream.put(byte);
+            }
+            records.clear();
+            AssertThat(AuditLog::scan(file, "audit", 0, 0, 2000, records) == AuditLog::Success, Equals(true));
+            AssertThat(records.size(), Equals(1U));
+            AssertThat(AuditLog::scan(file, "audit", 0, all_times, no_end, records) == AuditLog::AuthenticationFailed, Equals(true));
+
+            std::filesystem::remove(file);
+        });
+    });
+});
+
+#endif // AUDITLOGTESTS_HPP
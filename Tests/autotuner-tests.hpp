@@ -0,0 +1,126 @@
+#ifndef AUTOTUNERTESTS_HPP
+#define AUTOTUNERTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <AutoTuner.hpp>
+#include <OTPGen.hpp>
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+namespace {
+    // short runs, the decisions don't matter here
+    static AutoTuner::Options small_calibration()
+    {
+        AutoTuner::Options options;
+        options.maxThreads = 2U;
+        options.batchKeys = 1024U;
+        options.offload = false;
+        return options;
+    }
+
+    static void reset_tuning()
+    {
+        for (auto&& algo : {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512})
+        {
+            OTPGen::setBatchGrain(algo, 0U);
+        }
+        OTPGen::setOffloadMinimumWork(0U);
+    }
+}
+
+go_bandit([]{
+    describe("AutoTuner Test", []{
+        it("[calibrate]", [&]{
+            const auto grain = OTPGen::batchGrain(OTPToken::SHA256);
+            const auto result = AutoTuner::calibrate(small_calibration());
+            AssertThat(result.valid(), Equals(true));
+            AssertThat(result.choices.size(), Equals(3U));
+            AssertThat(result.machine, Equals(AutoTuner::machine()));
+            AssertThat(result.cached, Equals(false));
+            AssertThat(result.threads() >= 1U && result.threads() <= 2U, Equals(true));
+            for (auto&& algo : {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512})
+            {
+                AssertThat(result.choice(algo) != nullptr, Equals(true));
+                AssertThat(result.choice(algo)->codesPerSecond > 0.0, Equals(true));
+            }
+
+            // the process keeps its settings
+            AssertThat(OTPGen::batchGrain(OTPToken::SHA256), Equals(grain));
+        });
+
+        it("[serialize and parse]", [&]{
+            AutoTuner::Result result;
+            result.machine = "test cpu / 8 threads / v1";
+            result.shaBackend = "portable";
+            result.multiBufferBackend = "scalar";
+            result.lanes = 1U;
+            result.offloadMinimumWork = SIZE_MAX;
+            result.calibrationNs = 123456789U;
+            result.choices.push_back({OTPToken::SHA1, 512U, 4U, 1000000.0});
+            result.choices.push_back({OTPToken::SHA512, 2048U, 2U, 250000.0});
+
+            AutoTuner::Result parsed;
+            AssertThat(AutoTuner::parse(AutoTuner::serialize(result), parsed), Equals(true));
+            AssertThat(parsed.machine, Equals(result.machine));
+            AssertThat(parsed.shaBackend, Equals(result.shaBackend));
+            AssertThat(parsed.multiBufferBackend, Equals(result.multiBufferBackend));
+            AssertThat(parsed.lanes, Equals(result.lanes));
+            AssertThat(parsed.offloadMinimumWork, Equals(result.offloadMinimumWork));
+            AssertThat(parsed.calibrationNs, Equals(result.calibrationNs));
+            AssertThat(parsed.choices.size(), Equals(2U));
+            AssertThat(parsed.choice(OTPToken::SHA512)->grain, Equals(2048U));
+            AssertThat(parsed.choice(OTPToken::SHA512)->threads, Equals(2U));
+            AssertThat(parsed.choice(OTPToken::SHA256) == nullptr, Equals(true));
+            AssertThat(parsed.threads(), Equals(4U));
+
+            // other format versions and broken files are measured again
+            auto text = AutoTuner::serialize(result);
+            text.replace(text.find("version\t1"), 9U, "version\t0");
+            AssertThat(AutoTuner::parse(text, parsed), Equals(false));
+            AssertThat(AutoTuner::parse("choice\tsha1\tmany\n", parsed), Equals(false));
+            AssertThat(AutoTuner::parse("", parsed), Equals(false));
+        });
+
+        it("[load and apply]", [&]{
+            const auto path = (std::filesystem::temp_directory_path() / "otpgen-tests-tuning").string();
+            std::remove(path.c_str());
+
+            const auto measured = AutoTuner::load(path, small_calibration());
+            AssertThat(measured.valid(), Equals(true));
+            AssertThat(measured.cached, Equals(false));
+            AssertThat(AutoTuner::current().valid(), Equals(true));
+            AssertThat(OTPGen::batchGrain(OTPToken::SHA1), Equals(measured.choice(OTPToken::SHA1)->grain));
+
+            const auto cached = AutoTuner::load(path, small_calibration());
+            AssertThat(cached.cached, Equals(true));
+            AssertThat(cached.calibrationNs, Equals(measured.calibrationNs));
+            AssertThat(cached.threads(), Equals(measured.threads()));
+
+            std::vector<PerfStats::Gauge> gauges;
+            AutoTuner::appendGauges(cached, gauges);
+            AssertThat(gauges.empty(), Equals(false));
+            AssertThat(gauges.front().name.rfind("tuning_", 0), Equals(0U));
+
+            // the grains of another result replace the measured ones
+            AutoTuner::Result coarse = cached;
+            for (auto&& choice : coarse.choices)
+            {
+                choice.grain = 4096U;
+            }
+            AutoTuner::apply(coarse);
+            AssertThat(OTPGen::batchGrain(OTPToken::SHA256), Equals(4096U));
+
+            reset_tuning();
+            AssertThat(OTPGen::batchGrain(OTPToken::SHA256), Equals(OTPGen::DEFAULT_BATCH_GRAIN));
+            std::remove(path.c_str());
+        });
+    });
+});
+
+#endif // AUTOTUNERTESTS_HPP
@@ -0,0 +1,193 @@
+#ifndef CAPITESTS_HPP
+#define CAPITESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <OTPGenC.h>
+#include <OTPGen.hpp>
+#include <TokenDatabase.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+go_bandit([]{
+    describe("C Interface Test", []{
+        const std::string secret = "XYZA123456KDDK83D";
+
+        it("[prepareKey]", [&]{
+            otpgen_key *key = nullptr;
+            AssertThat(otpgen_prepare_key(secret.data(), secret.size(), OTPGEN_SHA1, &key), Equals(OTPGEN_OK));
+            AssertThat(key == nullptr, IsFalse());
+
+            char code[OTPGEN_CODE_SIZE];
+            AssertThat(otpgen_totp(key, 1536573862, 6, 30, code), Equals(OTPGEN_OK));
+            AssertThat(std::string(code), Equals(OTPGen::computeTOTP(1536573862, secret, 6, 30, OTPToken::SHA1)));
+            AssertThat(otpgen_hotp(key, 12, 8, code), Equals(OTPGEN_OK));
+            AssertThat(std::string(code), Equals(OTPGen::computeHOTP(secret, 12, 8, OTPToken::SHA1)));
+            AssertThat(otpgen_steam(key, 1536573862, code), Equals(OTPGEN_OK));
+            AssertThat(std::string(code), Equals(OTPGen::computeSteam(1536573862, secret)));
+
+            AssertThat(otpgen_totp(key, 1536573862, 11, 30, code), Equals(OTPGEN_INVALID_DIGITS));
+            AssertThat(std::string(code).empty(), IsTrue());
+            AssertThat(otpgen_totp(nullptr, 1536573862, 6, 30, code), Equals(OTPGEN_INVALID_ARGUMENT));
+            otpgen_free_key(key);
+
+            // invalid secrets don't give a key
+            otpgen_key *invalid = nullptr;
+            AssertThat(otpgen_prepare_key("!!", 2, OTPGEN_SHA1, &invalid), Equals(OTPGEN_INVALID_BASE32));
+            AssertThat(invalid == nullptr, IsTrue());
+            AssertThat(otpgen_prepare_key(secret.data(), secret.size(), 9, &invalid), Equals(OTPGEN_INVALID_ALGORITHM));
+            AssertThat(std::string(otpgen_status_message(OTPGEN_INVALID_ALGORITHM)).empty(), IsFalse());
+            AssertThat(otpgen_abi_version(), Equals(static_cast<unsigned>(OTPGEN_ABI_VERSION)));
+        });
+
+        it("[span]", [&]{
+            otpgen_key *key = nullptr;
+            AssertThat(otpgen_prepare_key(secret.data(), secret.size(), OTPGEN_SHA256, &key), Equals(OTPGEN_OK));
+
+            const std::vector<std::int64_t> times = {0, 59, 1536573862, 2000000000};
+            std::vector<char> codes(times.size() * OTPGEN_CODE_SIZE, 'x');
+            AssertThat(otpgen_totp_span(key, times.data(), times.size(), 8, 60, codes.data(), codes.size()), Equals(OTPGEN_OK));
+            for (auto i = 0U; i < times.size(); ++i)
+            {
+                AssertThat(std::string(codes.data() + i * OTPGEN_CODE_SIZE),
+                           Equals(OTPGen::computeTOTP(static_cast<std::time_t>(times[i]), secret, 8, 60, OTPToken::SHA256)));
+                // slots are padded like fixed size strings
+                AssertThat(codes[(i + 1U) * OTPGEN_CODE_SIZE - 1U], Equals('\0'));
+            }
+
+            // buffers must hold every code
+            AssertThat(otpgen_totp_span(key, times.data(), times.size(), 8, 60, codes.data(), codes.size() - 1U), Equals(OTPGEN_INVALID_ARGUMENT));
+            AssertThat(otpgen_totp_span(key, times.data(), times.size(), 8, 0, codes.data(), codes.size()), Equals(OTPGEN_INVALID_PERIOD));
+            otpgen_free_key(key);
+        });
+
+        it("[verify]", [&]{
+            otpgen_key *key = nullptr;
+            AssertThat(otpgen_prepare_key(secret.data(), secret.size(), OTPGEN_SHA1, &key), Equals(OTPGEN_OK));
+
+            const auto code = OTPGen::computeTOTP(1536573862 - 30, secret, 6, 30, OTPToken::SHA1);
+            int step = 0;
+            AssertThat(otpgen_verify(key, code.data(), code.size(), 1536573862, 1, 6, 30, &step), Equals(OTPGEN_OK));
+            AssertThat(step, Equals(-1));
+            AssertThat(otpgen_verify(key, code.data(), code.size(), 1536573862, 0, 6, 30, nullptr), Equals(OTPGEN_NO_MATCH));
+            AssertThat(otpgen_verify(key, "12", 2, 1536573862, 1, 6, 30, nullptr), Equals(OTPGEN_NO_MATCH));
+            otpgen_free_key(key);
+        });
+
+        it("[batch]", [&]{
+            const std::vector<std::string> secrets = {"XYZA123456KDDK83D", "ABCD123456KDDK83D", "EFGH123456KDDK83D"};
+            auto list = otpgen_key_list_new();
+            for (auto&& s : secrets)
+            {
+                otpgen_key *key = nullptr;
+                AssertThat(otpgen_prepare_key(s.data(), s.size(), OTPGEN_SHA1, &key), Equals(OTPGEN_OK));
+                std::size_t index = 0U;
+                AssertThat(otpgen_key_list_add(list, key, &index), Equals(OTPGEN_OK));
+                AssertThat(index, Equals(otpgen_key_list_size(list) - 1U));
+                otpgen_free_key(key);
+            }
+            AssertThat(otpgen_key_list_size(list), Equals(3U));
+
+            // same codes with and without a pool
+            auto pool = otpgen_pool_new(2);
+            std::vector<char> codes(secrets.size() * OTPGEN_CODE_SIZE);
+            std::vector<int> statuses(secrets.size(), -1);
+            for (auto&& executor : {static_cast<otpgen_pool*>(nullptr), pool})
+            {
+                AssertThat(otpgen_totp_batch(list, 1536573862, 6, 30, codes.data(), codes.size(), statuses.data(), executor), Equals(OTPGEN_OK));
+                for (auto i = 0U; i < secrets.size(); ++i)
+                {
+                    AssertThat(std::string(codes.data() + i * OTPGEN_CODE_SIZE),
+                               Equals(OTPGen::computeTOTP(1536573862, secrets[i], 6, 30, OTPToken::SHA1)));
+                    AssertThat(statuses[i], Equals(OTPGEN_OK));
+                }
+            }
+
+            AssertThat(otpgen_steam_batch(list, 1536573862, codes.data(), codes.size(), nullptr, pool), Equals(OTPGEN_OK));
+            AssertThat(std::string(codes.data() + OTPGEN_CODE_SIZE), Equals(OTPGen::computeSteam(1536573862, secrets[1])));
+
+            // the codes of the batch verify, a changed one doesn't
+            AssertThat(otpgen_totp_batch(list, 1536573862, 7, 10, codes.data(), codes.size(), nullptr, nullptr), Equals(OTPGEN_OK));
+            codes[2 * OTPGEN_CODE_SIZE] = codes[2 * OTPGEN_CODE_SIZE] == '0' ? '1' : '0';
+            std::vector<std::uint8_t> matched(secrets.size());
+            AssertThat(otpgen_verify_batch(list, codes.data(), codes.size(), 1536573862, 0, 7, 10, matched.data(), pool), Equals(OTPGEN_OK));
+            AssertThat(matched, Equals(std::vector<std::uint8_t>{1U, 1U, 0U}));
+
+            AssertThat(otpgen_totp_batch(list, 1536573862, 2, 30, codes.data(), codes.size(), statuses.data(), nullptr), Equals(OTPGEN_INVALID_DIGITS));
+            AssertThat(statuses[0], Equals(OTPGEN_INVALID_DIGITS));
+            AssertThat(otpgen_totp_batch(list, 1536573862, 6, 30, codes.data(), 2U, nullptr, nullptr), Equals(OTPGEN_INVALID_ARGUMENT));
+
+            otpgen_free_pool(pool);
+            otpgen_free_key_list(list);
+        });
+
+        it("[cursor]", [&]{
+            const auto file = (std::filesystem::temp_directory_path() / "otpgen-capi-tests.db").string();
+            const std::string password = "otpgen-tests";
+            AssertThat(otpgen_db_open(file.c_str(), password.data(), password.size()), Equals(OTPGEN_OK));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "bank account", {}, "ABCD123456KDDK83D", 6, 0, 4, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "c", {}, "EFGH123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(otpgen_db_save(), Equals(OTPGEN_OK));
+
+            // tokens in display order, labels are truncated to the buffer
+            otpgen_cursor *cursor = nullptr;
+            AssertThat(otpgen_db_cursor_open(0, &cursor), Equals(OTPGEN_OK));
+            char label[5];
+            otpgen_token_info info = {};
+            info.label = label;
+            info.label_capacity = sizeof(label);
+            std::vector<std::string> labels;
+            std::vector<std::string> codes;
+            while (otpgen_db_cursor_next(cursor, &info) == OTPGEN_OK)
+            {
+                labels.emplace_back(label);
+                otpgen_key *key = nullptr;
+                AssertThat(otpgen_db_cursor_key(cursor, &key), Equals(OTPGEN_OK));
+                char code[OTPGEN_CODE_SIZE];
+                if (info.type == OTPGEN_HOTP)
+                {
+                    AssertThat(info.counter, Equals(4U));
+                    AssertThat(info.label_size, Equals(12U));
+                    AssertThat(otpgen_hotp(key, info.counter, info.digits, code), Equals(OTPGEN_OK));
+                }
+                else
+                {
+                    AssertThat(otpgen_totp(key, 1536573862, info.digits, info.period, code), Equals(OTPGEN_OK));
+                }
+                codes.emplace_back(code);
+                otpgen_free_key(key);
+            }
+            AssertThat(otpgen_db_cursor_next(cursor, &info), Equals(OTPGEN_END));
+            otpgen_free_cursor(cursor);
+            AssertThat(labels, Equals(std::vector<std::string>{"a", "bank", "c"}));
+            AssertThat(codes[0], Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+            AssertThat(codes[1], Equals(OTPGen::computeHOTP("ABCD123456KDDK83D", 4, 6, OTPToken::SHA1)));
+
+            // only the tokens of the type
+            AssertThat(otpgen_db_cursor_open(OTPGEN_HOTP, &cursor), Equals(OTPGEN_OK));
+            info.label_capacity = 0U;
+            AssertThat(otpgen_db_cursor_next(cursor, &info), Equals(OTPGEN_OK));
+            AssertThat(otpgen_db_cursor_next(cursor, &info), Equals(OTPGEN_END));
+            otpgen_free_cursor(cursor);
+
+            // database errors keep the error of the database
+            otpgen_db_close();
+            AssertThat(otpgen_db_cursor_open(0, &cursor), Equals(OTPGEN_DATABASE_ERROR + TokenDatabase::SqlDatabaseNotOpen));
+            AssertThat(otpgen_db_open(file.c_str(), "wrong", 5), Equals(OTPGEN_DATABASE_ERROR + TokenDatabase::InvalidCiphertext));
+            AssertThat(std::string(otpgen_status_message(OTPGEN_DATABASE_ERROR + TokenDatabase::InvalidCiphertext)),
+                       Equals(TokenDatabase::getErrorMessage(TokenDatabase::InvalidCiphertext)));
+            otpgen_db_close();
+            std::remove(file.c_str());
+        });
+    });
+});
+
+#endif // CAPITESTS_HPP
@@ -0,0 +1,75 @@
+#ifndef CLOCKTESTS_HPP
+#define CLOCKTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <Clock.hpp>
+#include <OTPGen.hpp>
+#include <TokenCodeCache.hpp>
+
+go_bandit([]{
+    describe("Clock Test", []{
+        after_each([&]{
+            Clock::setDefaultClock(nullptr);
+        });
+
+        it("[system]", [&]{
+            // the coarse clock agrees with time() up to the tick
+            const auto before = std::time(nullptr);
+            const auto now = SystemClock::instance().now();
+            const auto after = std::time(nullptr);
+            AssertThat(now >= before - 1 && now <= after, Equals(true));
+            AssertThat(&Clock::defaultClock() == &SystemClock::instance(), Equals(true));
+        });
+
+        it("[fixed and offset]", [&]{
+            FixedClock fixed(1536573862);
+            AssertThat(fixed.now(), Equals(1536573862));
+            fixed.advance(30);
+            AssertThat(fixed.now(), Equals(1536573892));
+            fixed.set(100);
+            AssertThat(fixed.now(), Equals(100));
+
+            OffsetClock offset(fixed, -40);
+            AssertThat(offset.now(), Equals(60));
+            offset.setOffset(5);
+            AssertThat(offset.offset(), Equals(5));
+            AssertThat(offset.now(), Equals(105));
+        });
+
+        it("[default clock]", [&]{
+            // the APIs without a time read the installed clock
+            FixedClock fixed(1536573862);
+            Clock::setDefaultClock(&fixed);
+            AssertThat(Clock::current(), Equals(1536573862));
+            AssertThat(OTPGen::computeTOTP("XYZA123456KDDK83D", 6, 30, OTPToken::SHA1), Equals(std::string("122810")));
+            AssertThat(OTPGen::computeSteam("ABC30WAY33X57CCBU3EAXGDDMX35S39M"), Equals(std::string("GQTTM")));
+
+            const auto token = OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1);
+            AssertThat(token.generateToken(), Equals(std::string("122810")));
+            AssertThat(token.generateToken(1536573862 + 30), Equals(OTPGen::computeTOTP(1536573892, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+            AssertThat(token.remainingTokenValidity(), Equals(8U));
+            AssertThat(token.nextRotationTime(), Equals(1536573870));
+
+            Clock::setDefaultClock(nullptr);
+            AssertThat(&Clock::defaultClock() == &SystemClock::instance(), Equals(true));
+        });
+
+        it("[code cache]", [&]{
+            // the cache computes the codes for the time of its clock
+            FixedClock fixed(1536573862);
+            const std::vector<OTPToken> tokens = {
+                OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            };
+            TokenCodeCache cache(tokens, &fixed);
+            OTPGen::TokenBuffer buffer;
+            AssertThat(cache.code(0, 1536573862, buffer), Equals(true));
+            AssertThat(std::string(buffer), Equals(std::string("122810")));
+        });
+    });
+});
+
+#endif // CLOCKTESTS_HPP
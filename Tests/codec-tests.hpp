@@ -0,0 +1,104 @@
+#ifndef CODECTESTS_HPP
+#define CODECTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <Codec.hpp>
+
+go_bandit([]{
+    describe("Codec Test", []{
+        it("[base-32 RFC 4648 vectors]", [&]{
+            // padding is omitted
+            AssertThat(Codec::base32Encode(""), Equals(std::string("")));
+            AssertThat(Codec::base32Encode("f"), Equals(std::string("MY")));
+            AssertThat(Codec::base32Encode("fo"), Equals(std::string("MZXQ")));
+            AssertThat(Codec::base32Encode("foo"), Equals(std::string("MZXW6")));
+            AssertThat(Codec::base32Encode("foob"), Equals(std::string("MZXW6YQ")));
+            AssertThat(Codec::base32Encode("fooba"), Equals(std::string("MZXW6YTB")));
+            AssertThat(Codec::base32Encode("foobar"), Equals(std::string("MZXW6YTBOI")));
+
+            AssertThat(Codec::base32Decode("MZXW6YTBOI======"), Equals(std::string("foobar")));
+            AssertThat(Codec::base32Decode("mzxw 6ytb oi"), Equals(std::string("foobar")));
+            AssertThat(Codec::base32Decode("MZXW6YQ"), Equals(std::string("foob")));
+        });
+
+        it("[base-64 RFC 4648 vectors]", [&]{
+            AssertThat(Codec::base64Encode(""), Equals(std::string("")));
+            AssertThat(Codec::base64Encode("f"), Equals(std::string("Zg==")));
+            AssertThat(Codec::base64Encode("fo"), Equals(std::string("Zm8=")));
+            AssertThat(Codec::base64Encode("foo"), Equals(std::string("Zm9v")));
+            AssertThat(Codec::base64Encode("foob"), Equals(std::string("Zm9vYg==")));
+            AssertThat(Codec::base64Encode("fooba"), Equals(std::string("Zm9vYmE=")));
+            AssertThat(Codec::base64Encode("foobar"), Equals(std::string("Zm9vYmFy")));
+
+            AssertThat(Codec::base64Decode("Zm9vYg=="), Equals(std::string("foob")));
+            AssertThat(Codec::base64Decode("Zm9v\nYmFy"), Equals(std::string("foobar")));
+        });
+
+        it("[hex]", [&]{
+            AssertThat(Codec::hexEncode("\x01\xab\xff"), Equals(std::string("01abff")));
+            AssertThat(Codec::hexDecode("01ABff"), Equals(std::string("\x01\xab\xff")));
+
+            // incomplete trailing nibble is dropped
+            AssertThat(Codec::hexDecode("0aB"), Equals(std::string("\x0a")));
+        });
+
+        it("[hex to base-32]", [&]{
+            for (auto&& hex : {"", "4", "48", "48656c6c6f21deadbeef", "48 65:6C6c6f2", "00ff10ee20dd"})
+            {
+                const std::string str(hex);
+                std::string out(Codec::base32EncodedSize(Codec::hexDecodedSize(str.size())), '\0');
+                out.resize(Codec::hexToBase32(str.data(), str.size(), &out[0]));
+                AssertThat(out, Equals(Codec::base32Encode(Codec::hexDecode(str))));
+            }
+
+            // strings back to back
+            const std::string seeds = "48656c6c6f21deadbeef" "ff" "0" "00ff10ee20dd";
+            std::size_t lengths[] = {20U, 2U, 1U, 12U};
+            std::string out(64U, '\0');
+            out.resize(Codec::hexToBase32(seeds.data(), lengths, 4U, &out[0]));
+            AssertThat(out, Equals(std::string("JBSWY3DPEHPK3PXP" "74" "" "AD7RB3RA3U")));
+            AssertThat(lengths[0], Equals(16U));
+            AssertThat(lengths[1], Equals(2U));
+            AssertThat(lengths[2], Equals(0U));
+            AssertThat(lengths[3], Equals(10U));
+        });
+
+        it("[buffer interface]", [&]{
+            const unsigned char data[] = {0xde, 0xad, 0xbe, 0xef, 0x00};
+            char encoded[Codec::base32EncodedSize(sizeof(data))];
+            const auto length = Codec::base32Encode(data, sizeof(data), encoded);
+            AssertThat(length, Equals(sizeof(encoded)));
+
+            unsigned char decoded[Codec::base32DecodedSize(sizeof(encoded))];
+            AssertThat(Codec::base32Decode(encoded, length, decoded), Equals(sizeof(data)));
+            AssertThat(std::string(decoded, decoded + sizeof(data)), Equals(std::string(data, data + sizeof(data))));
+        });
+
+        it("[base32Characters]", [&]{
+            // the classifier counts what the decoder uses, on every alignment
+            for (auto c = 1; c < 256; ++c)
+            {
+                const std::string str(40, static_cast<char>(c));
+                const auto valid = Codec::base32Decode(std::string(1, static_cast<char>(c)) + "AAAAAAA").size() == 5U;
+                AssertThat(Codec::base32Characters(str.data(), str.size()), Equals(valid ? 40U : 0U));
+            }
+
+            const std::string secret = "JBSW Y3DP-EHPK 3PXP jbsw y3dp ehpk 3pxp 0189 ====";
+            for (auto length = 0U; length <= secret.size(); ++length)
+            {
+                AssertThat(Codec::base32Characters(secret.data(), length) * 5U / 8U,
+                           Equals(Codec::base32Decode(secret.substr(0, length)).size()));
+            }
+
+            // counting stops at the first '\0'
+            const std::string terminated("ABCDEFGHIJKLMNOPQRST\0UVWXYZ234567", 34);
+            AssertThat(Codec::base32Characters(terminated.data(), terminated.size()), Equals(20U));
+        });
+    });
+});
+
+#endif // CODECTESTS_HPP
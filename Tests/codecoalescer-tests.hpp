@@ -0,0 +1,89 @@
+#ifndef CODECOALESCERTESTS_HPP
+#define CODECOALESCERTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <CodeCoalescer.hpp>
+#include <UsedCodeStore.hpp>
+#include <OTPGen.hpp>
+
+#include <atomic>
+#include <thread>
+
+go_bandit([]{
+    describe("CodeCoalescer Test", []{
+        it("[code]", [&]{
+            CodeCoalescer shared(1000);
+            AssertThat(shared.capacity(), Equals(1024U));
+
+            // a pair is computed once, other pairs on their own
+            auto computed = 0U;
+            const auto compute = [&](std::uint32_t value) {
+                return [&computed, value]{ ++computed; return value; };
+            };
+            AssertThat(shared.code(1, 100, compute(0x12345678U)), Equals(0x12345678U));
+            AssertThat(shared.code(1, 100, compute(0U)), Equals(0x12345678U));
+            AssertThat(computed, Equals(1U));
+            AssertThat(shared.code(1, 101, compute(7U)), Equals(7U));
+            AssertThat(shared.code(2, 100, compute(8U)), Equals(8U));
+            AssertThat(computed, Equals(3U));
+
+            // binary codes have 31 bits
+            AssertThat(shared.code(3, 100, compute(0xffffffffU)), Equals(0x7fffffffU));
+            AssertThat(shared.code(3, 100, compute(0U)), Equals(0x7fffffffU));
+
+            shared.clear();
+            AssertThat(shared.code(1, 100, compute(9U)), Equals(9U));
+        });
+
+        it("[concurrent]", [&]{
+            // all threads get the same code, most of them without computing it
+            CodeCoalescer shared;
+            std::atomic<std::size_t> computed{0U};
+            std::atomic<std::size_t> wrong{0U};
+            std::vector<std::thread> threads;
+            for (auto t = 0U; t < 4U; ++t)
+            {
+                threads.emplace_back([&]{
+                    for (auto i = 0U; i < 1000U; ++i)
+                    {
+                        const auto code = shared.code(i % 10U, i / 10U, [&]{
+                            ++computed;
+                            return (i % 10U) * 1000U + i / 10U;
+                        });
+                        wrong += code != (i % 10U) * 1000U + i / 10U;
+                    }
+                });
+            }
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            AssertThat(wrong.load(), Equals(0U));
+            AssertThat(computed.load() < 4000U, Equals(true));
+        });
+
+        it("[verifyTOTP]", [&]{
+            // code of the [computeTOTP 1] test, the shared codes give the same results
+            CodeCoalescer shared;
+            UsedCodeStore store;
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1);
+            int step = 0;
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862 + 30, 1, 6, 30, store, 4, &step, nullptr, nullptr, &shared), Equals(true));
+            AssertThat(step, Equals(-1));
+            AssertThat(OTPGen::verifyTOTP(key, "122811", 1536573862, 1, 6, 30, store, 5, nullptr, nullptr, nullptr, &shared), Equals(false));
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862, 1, 6, 30, store, 5, &step, nullptr, nullptr, &shared), Equals(true));
+            AssertThat(step, Equals(0));
+
+            std::vector<std::uint8_t> matched;
+            OTPGen::verifyTOTPBatch({key, key, key}, {"122810", "122811", "122810"}, {6, 6, 7},
+                                    1536573862, 1, 6, 30, store, matched, nullptr, nullptr, &shared);
+            AssertThat(matched, Equals(std::vector<std::uint8_t>{1, 0, 1}));
+        });
+    });
+});
+
+#endif // CODECOALESCERTESTS_HPP
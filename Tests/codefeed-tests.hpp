@@ -0,0 +1,106 @@
+#ifndef CODEFEEDTESTS_HPP
+#define CODEFEEDTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <CodeFeed.hpp>
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+
+go_bandit([]{
+    describe("CodeFeed Test", []{
+#if defined(__unix__) || defined(__APPLE__)
+        const auto path = (std::filesystem::temp_directory_path() / "otpgen-tests.feed").string();
+
+        it("[publish and find]", [&]{
+            CodeFeed writer;
+            AssertThat(writer.create(path, 2U), IsTrue());
+            AssertThat(std::filesystem::status(path).permissions() & std::filesystem::perms::all,
+                       Equals(std::filesystem::perms::owner_read | std::filesystem::perms::owner_write));
+
+            // the third code doesn't fit, the too long one is skipped
+            AssertThat(writer.publish({
+                {CodeFeed::labelHash("GitHub"), "123456", 1020},
+                {CodeFeed::labelHash("long"), std::string(CodeFeed::MAX_CODE_LENGTH + 1U, '1'), 1020},
+                {CodeFeed::labelHash("steam"), std::string(CodeFeed::MAX_CODE_LENGTH, '7'), 1030},
+                {CodeFeed::labelHash("mail"), "654321", 1020},
+            }), Equals(2U));
+
+            CodeFeed reader;
+            AssertThat(reader.open(path), IsTrue());
+            AssertThat(reader.generation(), Equals(1U));
+
+            // labels are case insensitive
+            CodeFeed::Code code;
+            AssertThat(reader.find("github", code), IsTrue());
+            AssertThat(code.code, Equals("123456"));
+            AssertThat(code.expiry, Equals(1020));
+            AssertThat(reader.find("steam", code), IsTrue());
+            AssertThat(code.code, Equals(std::string(CodeFeed::MAX_CODE_LENGTH, '7')));
+            AssertThat(reader.find("mail", code), IsFalse());
+
+            std::vector<CodeFeed::Code> codes;
+            AssertThat(reader.read(codes), IsTrue());
+            AssertThat(codes.size(), Equals(2U));
+            AssertThat(codes[1].expiry, Equals(1030));
+
+            // a closed writer leaves an empty table to the readers and removes the file
+            writer.close();
+            AssertThat(std::filesystem::exists(path), IsFalse());
+            AssertThat(reader.find("github", code), IsFalse());
+            AssertThat(reader.read(codes), IsTrue());
+            AssertThat(codes.empty(), IsTrue());
+            AssertThat(reader.open(path), IsFalse());
+        });
+
+        it("[concurrent readers]", [&]{
+            CodeFeed writer;
+            AssertThat(writer.create(path, 8U), IsTrue());
+
+            // every code of a table is its expiry, a torn read would mix two tables
+            std::atomic<bool> stop{false};
+            std::thread publisher([&]{
+                for (std::time_t expiry = 100000; !stop.load(); ++expiry)
+                {
+                    std::vector<CodeFeed::Code> codes;
+                    for (auto i = 0U; i < 8U; ++i)
+                    {
+                        codes.push_back({CodeFeed::labelHash("token" + std::to_string(i)), std::to_string(expiry), expiry});
+                    }
+                    writer.publish(codes);
+                }
+            });
+
+            CodeFeed reader;
+            AssertThat(reader.open(path), IsTrue());
+            auto consistent = true;
+            std::vector<CodeFeed::Code> codes;
+            for (auto reads = 0U; reads < 20000U && consistent;)
+            {
+                if (!reader.read(codes) || codes.empty())
+                {
+                    continue;
+                }
+                ++reads;
+                for (auto&& code : codes)
+                {
+                    consistent = consistent && code.code == std::to_string(code.expiry) && code.expiry == codes[0].expiry;
+                }
+            }
+            stop.store(true);
+            publisher.join();
+
+            AssertThat(consistent, IsTrue());
+            AssertThat(reader.generation() > 0U, IsTrue());
+        });
+#endif
+    });
+});
+
+#endif // CODEFEEDTESTS_HPP
@@ -0,0 +1,96 @@
+#ifndef CODETABLETESTS_HPP
+#define CODETABLETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <CodeTable.hpp>
+#include <OTPGen.hpp>
+#include <ThreadPool.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+go_bandit([]{
+    describe("CodeTable Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-tests-codes.table").string();
+        const std::vector<OTPToken> tokens = {
+            OTPToken(OTPToken::TOTP, "totp", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::HOTP, "hotp", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+            OTPToken(OTPToken::Steam, "steam", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"),
+            OTPToken(OTPToken::TOTP, "sha256", {}, "XYZA123456KDDK83D", 8, 60, 0, OTPToken::SHA256),
+        };
+        const std::time_t begin = 1536573862;
+
+        it("[write and verify]", [&]{
+            // two days are more periods than one chunk, so the codes come from several tasks
+            const auto end = begin + 2 * 86400;
+            ThreadPool pool(4);
+            std::size_t written = 0U;
+            AssertThat(CodeTable::write(file, tokens, begin, end, "table", &pool, &written) == CodeTable::Success, Equals(true));
+            AssertThat(written, Equals(3U));
+
+            CodeTable table;
+            AssertThat(table.open(file, "table") == CodeTable::Success, Equals(true));
+            AssertThat(table.tokenCount(), Equals(3U));
+            AssertThat(table.begin(), Equals(begin));
+            AssertThat(table.end(), Equals(end));
+
+            for (auto time : {begin, begin + 4000 * 30, end - 1})
+            {
+                AssertThat(table.verify("totp", OTPGen::computeTOTP(time, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1), time) == CodeTable::Match, Equals(true));
+                AssertThat(table.verify("sha256", OTPGen::computeTOTP(time, "XYZA123456KDDK83D", 8, 60, OTPToken::SHA256), time) == CodeTable::Match, Equals(true));
+                AssertThat(table.verify("steam", tokens[2].generateToken(time), time) == CodeTable::Match, Equals(true));
+            }
+            AssertThat(table.verify("totp", "122810", begin) == CodeTable::Match, Equals(true));
+            AssertThat(table.verify("steam", "GQTTM", begin) == CodeTable::Match, Equals(true));
+
+            // the code of the next period only matches within the window
+            const auto next = OTPGen::computeTOTP(begin + 30, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1);
+            AssertThat(table.verify("totp", next, begin) == CodeTable::NoMatch, Equals(true));
+            AssertThat(table.verify("totp", next, begin, 1U) == CodeTable::Match, Equals(true));
+            AssertThat(table.verify("totp", "12281", begin) == CodeTable::NoMatch, Equals(true));
+
+            AssertThat(table.verify("hotp", "000000", begin) == CodeTable::UnknownToken, Equals(true));
+            AssertThat(table.verify("totp", "122810", begin - 3600) == CodeTable::OutOfRange, Equals(true));
+            AssertThat(table.verify("totp", "122810", end + 3600) == CodeTable::OutOfRange, Equals(true));
+
+            table.close();
+            AssertThat(table.isOpen(), Equals(false));
+            AssertThat(table.verify("totp", "122810", begin) == CodeTable::UnknownToken, Equals(true));
+        });
+
+        it("[rejected tables]", [&]{
+            AssertThat(CodeTable::write(file, tokens, begin, begin, "table") == CodeTable::InvalidRange, Equals(true));
+            AssertThat(CodeTable::write(file, {tokens[1]}, begin, begin + 60, "table") == CodeTable::NoTokens, Equals(true));
+            AssertThat(CodeTable::write(file, tokens, begin, begin + 3600, "table") == CodeTable::Success, Equals(true));
+
+            CodeTable table;
+            AssertThat(table.open(file, "wrong") == CodeTable::AuthenticationFailed, Equals(true));
+            AssertThat(table.isOpen(), Equals(false));
+
+            // a single modified code fails the whole table
+            {
+                std::fstream stream(file, std::ios::in | std::ios::out | std::ios::binary);
+                const auto offset = -static_cast<std::streamoff>(CodeTable::MAC_SIZE) - 1;
+                stream.seekg(offset, std::ios::end);
+                const auto byte = static_cast<char>(stream.get() ^ 1);
+                stream.seekp(offset, std::ios::end);
+                stream.put(byte);
+            }
+            AssertThat(table.open(file, "table") == CodeTable::AuthenticationFailed, Equals(true));
+
+            {
+                std::ofstream stream(file, std::ios::binary | std::ios::trunc);
+                stream << "OTPT";
+            }
+            AssertThat(table.open(file, "table") == CodeTable::Malformed, Equals(true));
+            std::filesystem::remove(file);
+            AssertThat(table.open(file, "table") == CodeTable::FileReadFailure, Equals(true));
+        });
+    });
+});
+
+#endif // CODETABLETESTS_HPP
@@ -0,0 +1,166 @@
+#ifndef EMBEDDEDTESTS_HPP
+#define EMBEDDEDTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <OTPGen.hpp>
+#include <Codec.hpp>
+#include <Embedded/TokenTable.hpp>
+
+#include <cryptopp/sha.h>
+
+#include <cstring>
+#include <string>
+
+// the kernels of the freestanding profile must produce the same results as the desktop core
+
+namespace {
+    static Embedded::Key embedded_key(const std::string &base32, Embedded::Algorithm algorithm)
+    {
+        unsigned char secret[128] = {};
+        const auto size = Embedded::base32Decode(base32.data(), base32.size(), secret, sizeof(secret));
+        return Embedded::Key(secret, size, algorithm);
+    }
+
+    template<class Hash, class CryptoPPHash>
+    static bool same_digest(const std::string &message)
+    {
+        unsigned char expected[CryptoPPHash::DIGESTSIZE], digest[Hash::DIGEST_SIZE];
+        CryptoPPHash().CalculateDigest(expected, reinterpret_cast<const unsigned char*>(message.data()), message.size());
+
+        // split updates cross the block boundaries at different offsets
+        Hash hash;
+        const auto half = message.size() / 3U;
+        hash.update(reinterpret_cast<const unsigned char*>(message.data()), half);
+        hash.update(reinterpret_cast<const unsigned char*>(message.data()) + half, message.size() - half);
+        hash.finish(digest);
+        return std::memcmp(expected, digest, sizeof(digest)) == 0;
+    }
+}
+
+go_bandit([]{
+    describe("Embedded Profile Test", []{
+        it("[sha parity]", [&]{
+            std::string message;
+            for (auto length = 0U; length < 300U; ++length)
+            {
+                AssertThat((same_digest<Embedded::Sha1, CryptoPP::SHA1>(message)), Equals(true));
+                AssertThat((same_digest<Embedded::Sha256, CryptoPP::SHA256>(message)), Equals(true));
+                AssertThat((same_digest<Embedded::Sha512, CryptoPP::SHA512>(message)), Equals(true));
+                message.push_back(static_cast<char>('a' + length % 26U));
+            }
+        });
+
+        it("[base32 parity]", [&]{
+            for (const std::string str : {"XYZA123456KDDK83D", "xyza 1234-56kd dk83d28273", "GEZDGNBVGY3TQOJQ======", ""})
+            {
+                unsigned char decoded[64] = {};
+                const auto size = Embedded::base32Decode(str.data(), str.size(), decoded, sizeof(decoded));
+                AssertThat(std::string(reinterpret_cast<const char*>(decoded), size), Equals(Codec::base32Decode(str)));
+
+                char encoded[128] = {};
+                const auto length = Embedded::base32Encode(decoded, size, encoded);
+                AssertThat(length, Equals(Embedded::base32EncodedSize(size)));
+                AssertThat(std::string(encoded, length), Equals(Codec::base32Encode(Codec::base32Decode(str))));
+            }
+
+            // too small output
+            unsigned char decoded[4] = {};
+            AssertThat(Embedded::base32Decode("GEZDGNBVGY3TQOJQ", 16U, decoded, sizeof(decoded)), Equals(0U));
+        });
+
+        it("[code parity]", [&]{
+            const std::string secret = "XYZA123456KDDK83D28273";
+            for (const auto algorithm : {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512})
+            {
+                const auto key = embedded_key(secret, static_cast<Embedded::Algorithm>(algorithm));
+                for (auto digits = 3U; digits <= 10U; ++digits)
+                {
+                    for (auto step = 0U; step < 20U; ++step)
+                    {
+                        const std::time_t time = 1536573862 + step * 17;
+                        char code[Embedded::CODE_BUFFER] = {};
+
+                        AssertThat(Embedded::totp(key, time, 30U, static_cast<std::uint8_t>(digits), code) == Embedded::Status::Ok, Equals(true));
+                        AssertThat(std::string(code), Equals(OTPGen::computeTOTP(time, secret, digits, 30, algorithm)));
+
+                        AssertThat(Embedded::hotp(key, step, static_cast<std::uint8_t>(digits), code) == Embedded::Status::Ok, Equals(true));
+                        AssertThat(std::string(code), Equals(OTPGen::computeHOTP(secret, step, digits, algorithm)));
+
+                        if (algorithm == OTPToken::SHA1)
+                        {
+                            AssertThat(Embedded::steam(key, time, code) == Embedded::Status::Ok, Equals(true));
+                            AssertThat(std::string(code), Equals(OTPGen::computeSteam(time, secret)));
+                        }
+                    }
+                }
+            }
+
+            // keys longer than the block size are hashed first
+            const std::string long_secret(200U, 'A');
+            char code[Embedded::CODE_BUFFER] = {};
+            (void) Embedded::totp(embedded_key(long_secret, Embedded::Algorithm::SHA256), 1536573862, 30U, 8U, code);
+            AssertThat(std::string(code), Equals(OTPGen::computeTOTP(1536573862, long_secret, 8, 30, OTPToken::SHA256)));
+        });
+
+        it("[token table]", [&]{
+            Embedded::TokenTable<2> table;
+            using Token = Embedded::TokenTable<2>::Token;
+            using Embedded::Status;
+
+            Token totp;
+            totp.id = 1U;
+            Token hotp;
+            hotp.id = 2U;
+            hotp.type = Embedded::TokenType::HOTP;
+            hotp.counter = 5U;
+            Token steam;
+            steam.id = 3U;
+            steam.type = Embedded::TokenType::Steam;
+
+            AssertThat(table.addBase32(totp, "XYZA123456KDDK83D", 17U) == Status::Ok, Equals(true));
+            AssertThat(table.addBase32(totp, "XYZA123456KDDK83D", 17U) == Status::InvalidArgument, Equals(true));
+            AssertThat(table.addBase32(hotp, "XYZA123456KDDK83D", 17U) == Status::Ok, Equals(true));
+            AssertThat(table.addBase32(steam, "XYZA123456KDDK83D", 17U) == Status::Full, Equals(true));
+            AssertThat(table.size(), Equals(2U));
+
+            char code[Embedded::CODE_BUFFER] = {};
+            AssertThat(table.generate(1U, 1536573862, code) == Status::Ok, Equals(true));
+            AssertThat(std::string(code), Equals(std::string("122810")));
+
+            // a code of the previous period is accepted within the window
+            const auto previous = OTPGen::computeTOTP(1536573862 - 30, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1);
+            AssertThat(table.verify(1U, previous.c_str(), 1536573862, 1U) == Status::Ok, Equals(true));
+            AssertThat(table.verify(1U, previous.c_str(), 1536573862, 0U) == Status::Mismatch, Equals(true));
+            AssertThat(table.verify(1U, "12281", 1536573862, 0U) == Status::Mismatch, Equals(true));
+
+            // counter-based codes move the counter past the accepted one and aren't accepted twice
+            const auto ahead = OTPGen::computeHOTP("XYZA123456KDDK83D", 7, 6, OTPToken::SHA1);
+            AssertThat(table.verify(2U, ahead.c_str(), 0, 1U) == Status::Mismatch, Equals(true));
+            AssertThat(table.verify(2U, ahead.c_str(), 0, 2U) == Status::Ok, Equals(true));
+            AssertThat(table.verify(2U, ahead.c_str(), 0, 2U) == Status::Mismatch, Equals(true));
+            Token stored;
+            AssertThat(table.token(2U, stored) == Status::Ok, Equals(true));
+            AssertThat(stored.counter, Equals(8U));
+
+            AssertThat(table.remove(1U) == Status::Ok, Equals(true));
+            AssertThat(table.remove(1U) == Status::NotFound, Equals(true));
+            AssertThat(table.generate(1U, 1536573862, code) == Status::NotFound, Equals(true));
+            AssertThat(table.addBase32(steam, "XYZA123456KDDK83D", 17U) == Status::Ok, Equals(true));
+            AssertThat(table.generate(3U, 1536573862, code) == Status::Ok, Equals(true));
+            AssertThat(std::string(code), Equals(OTPGen::computeSteam(1536573862, "XYZA123456KDDK83D")));
+
+            // invalid parameters
+            Token invalid;
+            invalid.id = 4U;
+            invalid.digits = 11U;
+            AssertThat(table.addBase32(invalid, "XYZA123456KDDK83D", 17U) == Status::InvalidArgument, Equals(true));
+            AssertThat(table.addBase32(totp, "----", 4U) == Status::InvalidArgument, Equals(true));
+        });
+    });
+});
+
+#endif // EMBEDDEDTESTS_HPP
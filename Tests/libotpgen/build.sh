@@ -1,3 +1,4 @@
 #!/usr/bin/env bash
 
-clang -std=c++1z -I/usr/include/otpgen test.cpp -o libotpgen_test -lstdc++ -lotpgen
+# builds against the installed library, set CMAKE_PREFIX_PATH for other prefixes
+cmake -S "$(dirname "$0")" -B build && cmake --build build
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <string.h>
+
+/* library must be installed already for this test to compile and work */
+
+#include <OTPGenC.h>
+
+/* minimal libotpgen test, uses the stable C interface only */
+
+int main(void)
+{
+    const char *secret = "aabbcc";
+    otpgen_key *key = NULL;
+    char code[OTPGEN_CODE_SIZE];
+    int status;
+
+    if (otpgen_abi_version() != OTPGEN_ABI_VERSION)
+    {
+        fprintf(stderr, "libotpgen ABI version %u, expected %u\n", otpgen_abi_version(), OTPGEN_ABI_VERSION);
+        return 1;
+    }
+
+    status = otpgen_prepare_key(secret, strlen(secret), OTPGEN_SHA1, &key);
+    if (status != OTPGEN_OK)
+    {
+        fprintf(stderr, "%s\n", otpgen_status_message(status));
+        return 1;
+    }
+
+    otpgen_totp(key, 1536573862, 6, 30, code);
+    printf("test: %s\n", code);
+
+    otpgen_free_key(key);
+    return 0;
+}
@@ -13,7 +13,36 @@ using namespace bandit;
 
 #include "otpauth-tests.hpp"
 #include "steam-base-test.hpp"
+#include "codec-tests.hpp"
+#include "clock-tests.hpp"
+#include "securememory-tests.hpp"
 #include "otpgen-tests.hpp"
+#include "tokencodecache-tests.hpp"
+#include "usedcodestore-tests.hpp"
+#include "codefeed-tests.hpp"
+#include "ratelimiter-tests.hpp"
+#include "auditlog-tests.hpp"
+#include "codetable-tests.hpp"
+#include "codecoalescer-tests.hpp"
+#include "rotationscheduler-tests.hpp"
+#include "tokenset-tests.hpp"
+#include "tokensetview-tests.hpp"
+#include "tokensearch-tests.hpp"
+#include "threadpool-tests.hpp"
+#include "numatopology-tests.hpp"
+#include "perfstats-tests.hpp"
+#include "asyncfileio-tests.hpp"
+#include "tokendatabase-tests.hpp"
+#include "preparedkeycache-tests.hpp"
+#include "appsupport-tests.hpp"
+#include "capi-tests.hpp"
+#include "perfbudget-tests.hpp"
+#include "embedded-tests.hpp"
+#include "autotuner-tests.hpp"
+
+#ifdef OTPGEN_WITH_SERVER
+#include "tokenservice-tests.hpp"
+#endif
 
 int main(int argc, char **argv)
 {
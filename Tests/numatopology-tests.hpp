@@ -0,0 +1,97 @@
+#ifndef NUMATOPOLOGYTESTS_HPP
+#define NUMATOPOLOGYTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <NumaTopology.hpp>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+go_bandit([]{
+    describe("NumaTopology Test", []{
+        it("[parseCpuList]", [&]{
+            std::vector<std::size_t> cpus;
+            AssertThat(NumaTopology::parseCpuList("0-3,8,10-11\n", cpus), IsTrue());
+            AssertThat(cpus, Equals(std::vector<std::size_t>{0U, 1U, 2U, 3U, 8U, 10U, 11U}));
+            AssertThat(NumaTopology::parseCpuList("\n", cpus), IsTrue());
+            AssertThat(cpus.empty(), IsTrue());
+
+            for (auto&& malformed : {"0-", "-3", "1,,2", "3-1", "0-2-4", "a", "1,"})
+            {
+                AssertThat(NumaTopology::parseCpuList(malformed, cpus), IsFalse());
+                AssertThat(cpus.empty(), IsTrue());
+            }
+        });
+
+        it("[system]", [&]{
+            // every hardware thread is on some node
+            const auto &topology = NumaTopology::system();
+            AssertThat(topology.nodeCount(), IsGreaterThan(0U));
+            std::size_t cpus = 0U;
+            for (auto node = 0U; node < topology.nodeCount(); ++node)
+            {
+                cpus += topology.cpus(node).size();
+                for (auto&& cpu : topology.cpus(node))
+                {
+                    AssertThat(topology.nodeOf(cpu), Equals(node));
+                }
+            }
+            AssertThat(cpus, IsGreaterThan(0U));
+
+            const NumaTopology nodes({{0U, 1U}, {}, {2U, 3U}});
+            AssertThat(nodes.nodeOf(3U), Equals(2U));
+            AssertThat(nodes.pinThread(1U), IsFalse());
+            AssertThat(nodes.pinThread(7U), IsFalse());
+        });
+
+        it("[pinThread]", [&]{
+            // pinned on a thread of its own, the test runner keeps its affinity
+            const auto &topology = NumaTopology::system();
+            auto node = 0U;
+            while (topology.cpus(node).empty())
+            {
+                ++node;
+            }
+            auto pinned = false;
+            std::thread thread([&]{
+                pinned = topology.pinThread(node);
+            });
+            thread.join();
+#if defined(__linux__)
+            AssertThat(pinned, IsTrue());
+#else
+            AssertThat(pinned, IsFalse());
+#endif
+        });
+
+        it("[allocate]", [&]{
+            for (auto&& huge_pages : {false, true})
+            for (auto&& size : {std::size_t(1U), std::size_t(5000U), NumaTopology::HUGE_PAGE_SIZE + 1U})
+            {
+                auto data = static_cast<unsigned char*>(NumaTopology::allocate(size, 0U, huge_pages));
+                AssertThat(std::all_of(data, data + size, [](unsigned char c) { return c == 0U; }), IsTrue());
+                std::fill(data, data + size, 0xa5U);
+                if (huge_pages && size > NumaTopology::HUGE_PAGE_SIZE)
+                {
+                    AssertThat(reinterpret_cast<std::uintptr_t>(data) % NumaTopology::HUGE_PAGE_SIZE, Equals(0U));
+                }
+                NumaTopology::deallocate(data, size, huge_pages);
+            }
+
+            // node memory behind a container
+            std::vector<std::uint64_t, NodeAllocator<std::uint64_t>> values(NodeAllocator<std::uint64_t>(0U, true));
+            for (auto i = 0U; i < 500000U; ++i)
+            {
+                values.emplace_back(i);
+            }
+            AssertThat(values[499999U], Equals(499999U));
+        });
+    });
+});
+
+#endif // NUMATOPOLOGYTESTS_HPP
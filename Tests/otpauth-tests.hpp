@@ -35,6 +35,26 @@ go_bandit([]{
             AssertThat(uri.valid(), Equals(false));
         });
 
+        it("[parse parameters]", [&]{
+            otpauthURI uri("otpauth://hotp/a+b%2Fc?image=x&secret=ABCD&issuer=A%26B&secret=EFGH&counter=42&digits=8&flag");
+            AssertThat(uri.valid(), Equals(true));
+            AssertThat(uri.type(), Equals(otpauthURI::HOTP));
+            AssertThat(uri.label(), Equals(std::string("a b/c")));
+            AssertThat(uri.secret(), Equals(std::string("ABCD")));
+            AssertThat(uri.issuer(), Equals(std::string("A&B")));
+            AssertThat(uri.counterNumber(), Equals(42U));
+            AssertThat(uri.digitsNumber(), Equals(8U));
+            AssertThat(uri.algorithm(), Equals(std::string("SHA1")));
+            AssertThat(uri.hasParam(otpauthURI::Period), Equals(false));
+            AssertThat(uri.params().size(), Equals(5U));
+
+            AssertThat(otpauthURI("otpauth://hotp/a?secret=ABCD").valid(), Equals(false));
+            AssertThat(otpauthURI("otpauth://totp/a").valid(), Equals(false));
+            AssertThat(otpauthURI("otpauth://motp/a?secret=ABCD").valid(), Equals(false));
+            AssertThat(otpauthURI("otpauth:/totp/a?secret=ABCD").valid(), Equals(false));
+            AssertThat(otpauthURI("otpauth://totp/50%?secret=ABCD").label(), Equals(std::string("50%")));
+        });
+
         it("[write totp]", [&]{
             OTPToken totp(OTPToken::TOTP, "Label with space");
             totp.setSecret("HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ");
@@ -43,6 +63,43 @@ go_bandit([]{
             AssertThat(uri.to_s(), Equals(std::string("otpauth://totp/Label%20with%20space?secret=HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ&digits=6&period=30&algorithm=SHA1")));
         });
 
+        it("[append uri]", [&]{
+            OTPToken steam(OTPToken::Steam, "ü a/b");
+            steam.setSecret("ABCD");
+            SecureString out = "x\n";
+            AssertThat(otpauthURI::appendURI(steam, out), Equals(true));
+            AssertThat(std::string(out), Equals(std::string("x\notpauth://totp/%C3%BC%20a%2Fb?secret=ABCD")));
+
+            OTPToken none(OTPToken::None, "a");
+            AssertThat(otpauthURI::appendURI(none, out), Equals(false));
+            AssertThat(out.size(), Equals(std::string("x\notpauth://totp/%C3%BC%20a%2Fb?secret=ABCD").size()));
+        });
+
+        it("[percent encoding of long labels]", [&]{
+            // runs of unreserved characters longer than a block, mixed with reserved ones
+            const std::string label = "abcdefghijklmnopqrstuvwxyz0123456789-_.~ ünïcode & more: ABCDEFGHIJKLMNOPQRSTUVWXYZ+%/?";
+            OTPToken totp(OTPToken::TOTP, label);
+            totp.setSecret("ABCD");
+
+            std::string out;
+            AssertThat(otpauthURI::appendURI(totp, out), Equals(true));
+            AssertThat(out.find("abcdefghijklmnopqrstuvwxyz0123456789-_.~%20%C3%BCn%C3%AFcode%20%26%20more%3A%20ABCDEFGHIJKLMNOPQRSTUVWXYZ%2B%25%2F%3F?"),
+                       Equals(std::string("otpauth://totp/").size()));
+
+            otpauthURI uri(out);
+            AssertThat(uri.valid(), Equals(true));
+            AssertThat(uri.label(), Equals(label));
+        });
+
+        it("[write issuer]", [&]{
+            OTPToken totp(OTPToken::TOTP, "ACME Co:john");
+            totp.setSecret("ABCD");
+            totp.setIssuer("ACME Co");
+            const auto uri = otpauthURI::fromOtpToken(&totp);
+            AssertThat(uri.issuer(), Equals(std::string("ACME Co")));
+            AssertThat(uri.to_s(), Equals(std::string("otpauth://totp/ACME%20Co%3Ajohn?secret=ABCD&issuer=ACME%20Co&digits=6&period=30&algorithm=SHA1")));
+        });
+
         it("[write hotp]", [&]{
             OTPToken hotp(OTPToken::HOTP, "Label with space");
             hotp.setSecret("HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ");
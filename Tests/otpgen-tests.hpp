@@ -7,6 +7,14 @@ using namespace snowhouse;
 using namespace bandit;
 
 #include <OTPGen.hpp>
+#include <ClockDrift.hpp>
+#include <atomic>
+#include <thread>
+#include <Internal/Sha1MultiBuffer.hpp>
+#include <Internal/ShaCompress.hpp>
+#include <BatchEngine.hpp>
+#include <OpenCLEngine.hpp>
+#include <ThreadPool.hpp>
 
 // NOTICE:
 //   code was tested with real token secrets for TOTP and Steam
@@ -26,17 +34,644 @@ go_bandit([]{
             AssertThat(res, Equals(std::string("8578249")));
         });
 
+        it("[computeTOTPBatch]", [&]{
+            // batch results must be identical to the single token api
+            const std::vector<OTPToken> tokens = {
+                OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::TOTP, "2", {}, "XYZA123456KDDK83D28273", 7, 10, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::HOTP, "3", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+                OTPToken(OTPToken::TOTP, "4", {}, "XYZA123456KDDK83D", 8, 30, 0, OTPToken::SHA512),
+            };
+            std::vector<OTPToken::TokenString> res;
+            std::vector<OTPGenErrorCode> errors;
+            OTPGen::computeTOTPBatch(1536573862, tokens, res, &errors);
+            AssertThat(res.size(), Equals(4U));
+            AssertThat(res.at(0), Equals(std::string("122810")));
+            AssertThat(res.at(1), Equals(std::string("8578249")));
+            AssertThat(res.at(2), Equals(std::string()));
+            AssertThat(errors.at(2) == OTPGenErrorCode::InvalidType, Equals(true));
+            AssertThat(res.at(3), Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 8, 30, OTPToken::SHA512)));
+        });
+
+        it("[digit formatting]", [&]{
+            // every digit length is the zero-padded tail of the 10 digit code
+            for (auto counter = 0U; counter < 50U; ++counter)
+            {
+                const auto full = OTPGen::computeHOTP("XYZA123456KDDK83D", counter, 10, OTPToken::SHA1);
+                AssertThat(full.size(), Equals(10U));
+                for (auto digits = OTPGen::minDigitLength(); digits < 10U; ++digits)
+                {
+                    const auto code = OTPGen::computeHOTP("XYZA123456KDDK83D", counter, digits, OTPToken::SHA1);
+                    AssertThat(code, Equals(full.substr(10U - digits)));
+                }
+            }
+        });
+
+        it("[base32 decoding]", [&]{
+            // lower case, spaces, padding and invalid characters are accepted like before
+            AssertThat(OTPGen::computeTOTP(1536573862, "xyza 1234 56kd dk83d", 6, 30, OTPToken::SHA1), Equals(std::string("122810")));
+            AssertThat(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D===", 6, 30, OTPToken::SHA1), Equals(std::string("122810")));
+            AssertThat(OTPGen::computeTOTP(1536573862, std::string("XYZA123456KDDK83D\0ABC", 21), 6, 30, OTPToken::SHA1), Equals(std::string("122810")));
+            AssertThat(OTPGen::computeTOTP(1536573862, "0189", 6, 30, OTPToken::SHA1), Equals(std::string()));
+        });
+
+        it("[concurrent use]", [&]{
+            // OTPGen must be safe to call from many threads without external locking
+            std::atomic<int> failures{0};
+            std::vector<std::thread> threads;
+            for (auto t = 0; t < 4; ++t)
+            {
+                threads.emplace_back([&]{
+                    for (auto i = 0; i < 500; ++i)
+                    {
+                        if (OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1) != "122810" ||
+                            OTPGen::computeSteam(1536573862, "ABC30WAY33X57CCBU3EAXGDDMX35S39M") != "GQTTM")
+                        {
+                            ++failures;
+                        }
+                    }
+                });
+            }
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            AssertThat(failures.load(), Equals(0));
+        });
+
         it("[computeHOTP]", [&]{
             // test hotp token with a fixed counter at 12
             const auto res = OTPGen::computeHOTP("XYZA123456KDDK83D", 12, 6, OTPToken::SHA1);
             AssertThat(res, Equals(std::string("534003")));
         });
 
+        it("[prepareKey]", [&]{
+            // prepared keys must produce the same codes as the base-32 secret
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1);
+            AssertThat(key.isValid(), Equals(true));
+            AssertThat(OTPGen::computeTOTP(1536573862, key, 6, 30), Equals(std::string("122810")));
+            AssertThat(OTPGen::computeHOTP(key, 12, 6), Equals(std::string("534003")));
+
+            const auto steam = OTPGen::prepareKey("ABC30WAY33X57CCBU3EAXGDDMX35S39M", OTPToken::SHA1);
+            AssertThat(OTPGen::computeSteam(1536573862, steam), Equals(std::string("GQTTM")));
+
+            // cached HMAC key schedule must match crypto++ for all algorithms and key sizes
+            for (auto&& secret : {"XYZA123456KDDK83D", "HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZHXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZHXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZHXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZHXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ"})
+            {
+                for (auto&& algo : {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512})
+                {
+                    const auto k = OTPGen::prepareKey(secret, algo);
+                    AssertThat(OTPGen::computeTOTP(1536573862, k, 8, 30), Equals(OTPGen::computeTOTP(1536573862, secret, 8, 30, algo)));
+                    AssertThat(OTPGen::computeHOTP(k, 7, 6), Equals(OTPGen::computeHOTP(secret, 7, 6, algo)));
+                }
+            }
+
+            const auto invalid = OTPGen::prepareKey("", OTPToken::SHA1);
+            AssertThat(invalid.isValid(), Equals(false));
+        });
+
+        it("[compute*Into]", [&]{
+            // allocation-free api writes into the given buffer
+            OTPGen::TokenBuffer buffer;
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1);
+            AssertThat(OTPGen::computeTOTPInto(buffer, 1536573862, key, 6, 30), Equals(true));
+            AssertThat(std::string(buffer), Equals(std::string("122810")));
+            AssertThat(OTPGen::computeHOTPInto(buffer, key, 12, 6), Equals(true));
+            AssertThat(std::string(buffer), Equals(std::string("534003")));
+            AssertThat(OTPGen::computeHOTPInto(buffer, key, 12, 11), Equals(false));
+            AssertThat(std::string(buffer), Equals(std::string()));
+
+            const auto steam = OTPGen::prepareKey("ABC30WAY33X57CCBU3EAXGDDMX35S39M", OTPToken::SHA1);
+            AssertThat(OTPGen::computeSteamInto(buffer, 1536573862, steam), Equals(true));
+            AssertThat(std::string(buffer), Equals(std::string("GQTTM")));
+        });
+
+        it("[computeTOTPBatch keys]", [&]{
+            // every multi-buffer backend must match the single key api, 37 keys
+            // cover full vector groups and the scalar remainder
+            std::vector<OTPKey> keys;
+            std::vector<OTPToken::TokenString> expected;
+            for (auto i = 0U; i < 37U; ++i)
+            {
+                const auto secret = "XYZA123456KDDK83D" + std::string(i % 9, 'Q') + std::to_string(i);
+                const auto algo = i % 7 == 3 ? OTPToken::SHA256 : OTPToken::SHA1;
+                keys.emplace_back(OTPGen::prepareKey(secret, algo));
+                expected.emplace_back(OTPGen::computeTOTP(1536573862, secret, 8, 30, algo));
+            }
+            keys.emplace_back(OTPKey());
+            expected.emplace_back();
+
+            const auto detected = Internal::sha1MultiBufferBackend();
+            for (auto&& backend : {Internal::Sha1MultiBufferBackend::Scalar,
+                                   Internal::Sha1MultiBufferBackend::SSE2,
+                                   Internal::Sha1MultiBufferBackend::AVX2,
+                                   Internal::Sha1MultiBufferBackend::AVX512,
+                                   Internal::Sha1MultiBufferBackend::NEON,
+                                   Internal::Sha1MultiBufferBackend::WasmSIMD128})
+            {
+                if (!Internal::setSha1MultiBufferBackend(backend))
+                {
+                    continue;
+                }
+
+                std::vector<OTPToken::TokenString> res;
+                std::vector<OTPGenErrorCode> errors;
+                OTPGen::computeTOTPBatch(1536573862, keys, 8, 30, res, &errors);
+                AssertThat(res, Equals(expected));
+                AssertThat(errors.back() == OTPGenErrorCode::InvalidBase32Input, Equals(true));
+            }
+            Internal::setSha1MultiBufferBackend(detected);
+        });
+
+        it("[computeTOTPBatch mixed]", [&]{
+            // every multi-buffer backend must match the single key api for all algorithms,
+            // 150 keys fill complete lane chunks of every algorithm and leave remainders
+            std::vector<OTPToken> tokens;
+            std::vector<OTPKey> keys;
+            std::vector<OTPToken::TokenString> expected, expected_tokens;
+            for (auto i = 0U; i < 150U; ++i)
+            {
+                const auto secret = "XYZA123456KDDK83D" + std::string(i % 11, 'Q') + std::to_string(i);
+                const auto algo = i % 3 == 0 ? OTPToken::SHA1 : i % 3 == 1 ? OTPToken::SHA256 : OTPToken::SHA512;
+                const auto period = i % 5 == 4 ? 60U : 30U;
+                keys.emplace_back(OTPGen::prepareKey(secret, algo));
+                expected.emplace_back(OTPGen::computeTOTP(1536573862, secret, 7, 45, algo));
+
+                OTPToken token(OTPToken::TOTP);
+                token.setSecret(secret);
+                token.setAlgorithm(algo);
+                token.setDigitLength(static_cast<OTPToken::DigitType>(6U + i % 3));
+                token.setPeriod(period);
+                tokens.emplace_back(token);
+                expected_tokens.emplace_back(OTPGen::computeTOTP(1536573862, secret, token.digitLength(), period, algo));
+            }
+
+            const auto detected = Internal::sha1MultiBufferBackend();
+            for (auto&& backend : {Internal::Sha1MultiBufferBackend::Scalar,
+                                   Internal::Sha1MultiBufferBackend::SSE2,
+                                   Internal::Sha1MultiBufferBackend::AVX2,
+                                   Internal::Sha1MultiBufferBackend::AVX512,
+                                   Internal::Sha1MultiBufferBackend::NEON,
+                                   Internal::Sha1MultiBufferBackend::WasmSIMD128})
+            {
+                if (!Internal::setSha1MultiBufferBackend(backend))
+                {
+                    continue;
+                }
+
+                std::vector<OTPToken::TokenString> res;
+                OTPGen::computeTOTPBatch(1536573862, keys, 7, 45, res);
+                AssertThat(res, Equals(expected));
+                OTPGen::computeTOTPBatch(1536573862, tokens, res);
+                AssertThat(res, Equals(expected_tokens));
+
+                // the look-ahead window of the hotp resync hashes consecutive counters in lanes
+                OTPToken::CounterType new_counter = 0;
+                const auto code = OTPGen::computeHOTP(keys[2], 40, 6);
+                AssertThat(OTPGen::resyncHOTP(keys[2], 3, 6, code, {}, 50, new_counter), Equals(true));
+                AssertThat(new_counter, Equals(41U));
+            }
+            Internal::setSha1MultiBufferBackend(detected);
+        });
+
+        it("[computeTOTPBatch profiles]", [&]{
+            AssertThat(OTPGen::isProfile(OTPToken::SHA1, 6, 30), Equals(true));
+            AssertThat(OTPGen::isProfile(OTPToken::SHA1, 7, 10), Equals(true));
+            AssertThat(OTPGen::isProfile(OTPToken::SHA512, 8, 30), Equals(true));
+            AssertThat(OTPGen::isProfile(OTPToken::SHA1, 9, 30), Equals(false));
+            AssertThat(OTPGen::isProfile(OTPToken::SHA256, 6, 45), Equals(false));
+
+            // the specialized kernels and the generic fallback must match the single key api,
+            // batches mixing algorithms fall back to the generic generator for the other keys
+            for (auto&& algo : {OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512})
+            {
+                for (auto&& digits : {6U, 7U, 8U, 9U})
+                {
+                    for (auto&& period : {10U, 30U, 45U, 60U})
+                    {
+                        std::vector<OTPKey> keys;
+                        std::vector<OTPToken::TokenString> expected;
+                        for (auto i = 0U; i < 11U; ++i)
+                        {
+                            const auto secret = "XYZA123456KDDK83D" + std::to_string(i);
+                            const auto key_algo = i % 4 == 3 ? OTPToken::SHA256 : algo;
+                            keys.emplace_back(OTPGen::prepareKey(secret, key_algo));
+                            expected.emplace_back(OTPGen::computeTOTP(1536573862, secret, digits, period, key_algo));
+                        }
+                        keys.insert(keys.begin(), OTPKey());
+                        expected.insert(expected.begin(), OTPToken::TokenString());
+
+                        std::vector<OTPToken::TokenString> res;
+                        std::vector<OTPGenErrorCode> errors;
+                        OTPGen::computeTOTPBatch(1536573862, keys, digits, period, res, &errors);
+                        AssertThat(res, Equals(expected));
+                        AssertThat(errors.front() == OTPGenErrorCode::InvalidBase32Input, Equals(true));
+                        AssertThat(errors.back() == OTPGenErrorCode::Valid, Equals(true));
+                    }
+                }
+            }
+        });
+
+        it("[verifyTOTP]", [&]{
+            // code of the [computeTOTP 1] test submitted with clock skew
+            int step = 0;
+            AssertThat(OTPGen::verifyTOTP("XYZA123456KDDK83D", "122810", 1536573862, 0, 6, 30, OTPToken::SHA1, &step), Equals(true));
+            AssertThat(step, Equals(0));
+            AssertThat(OTPGen::verifyTOTP("XYZA123456KDDK83D", "122810", 1536573862 + 30, 1, 6, 30, OTPToken::SHA1, &step), Equals(true));
+            AssertThat(step, Equals(-1));
+            AssertThat(OTPGen::verifyTOTP("XYZA123456KDDK83D", "122810", 1536573862 - 90, 3, 6, 30, OTPToken::SHA1, &step), Equals(true));
+            AssertThat(step, Equals(3));
+            AssertThat(OTPGen::verifyTOTP("XYZA123456KDDK83D", "122810", 1536573862 + 90, 2, 6, 30, OTPToken::SHA1), Equals(false));
+
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1);
+            AssertThat(OTPGen::verifyTOTP(key, "122811", 1536573862, 1, 6, 30), Equals(false));
+            AssertThat(OTPGen::verifyTOTP(key, "12281", 1536573862, 1, 6, 30), Equals(false));
+            AssertThat(OTPGen::verifyTOTP(key, "12a810", 1536573862, 1, 6, 30), Equals(false));
+
+            // 10-digit codes don't fit into 32 bits, the real code plus 2^32 must not wrap around to it
+            const auto real = OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 10, 30, OTPToken::SHA1);
+            const auto forged = std::to_string(std::stoull(real) + (1ULL << 32));
+            AssertThat(forged.size(), Equals(10U));
+            AssertThat(OTPGen::verifyTOTP(key, real, 1536573862, 0, 10, 30), Equals(true));
+            AssertThat(OTPGen::verifyTOTP(key, forged, 1536573862, 0, 10, 30), Equals(false));
+
+            OTPGenErrorCode error = OTPGenErrorCode::Valid;
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862, 1, 6, 0, nullptr, &error), Equals(false));
+            AssertThat(error == OTPGenErrorCode::InvalidPeriod, Equals(true));
+        });
+
+        it("[verifyTOTP drift]", [&]{
+            // the probe sequence covers the whole window once, starting at the learned offset
+            ClockDrift drift;
+            std::vector<int> probes;
+            for (auto n = 0U; n <= 4U; ++n)
+            {
+                probes.emplace_back(drift.probe(n, 2U));
+            }
+            AssertThat(probes, Equals(std::vector<int>{0, 1, -1, 2, -2}));
+
+            drift.learn(2);
+            probes.clear();
+            for (auto n = 0U; n <= 4U; ++n)
+            {
+                probes.emplace_back(drift.probe(n, 2U));
+            }
+            AssertThat(probes, Equals(std::vector<int>{2, 1, 0, -1, -2}));
+            AssertThat(drift.probe(0U, 1U), Equals(1));
+
+            // a single match elsewhere doesn't move a settled offset
+            drift.learn(2);
+            drift.learn(2);
+            drift.learn(-1);
+            AssertThat(drift.offset(), Equals(2));
+            drift.learn(-1);
+            AssertThat(drift.offset(), Equals(-1));
+            AssertThat(ClockDrift::unpack(drift.pack()) == drift, IsTrue());
+
+            // the code of the [computeTOTP 1] test 2 steps late, the drift is learned
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1);
+            ClockDrift learned;
+            int step = 0;
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862 + 60, 2, 6, 30, learned, &step), Equals(true));
+            AssertThat(step, Equals(-2));
+            AssertThat(learned.offset(), Equals(-2));
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862, 2, 6, 30, learned, &step), Equals(true));
+            AssertThat(step, Equals(0));
+            AssertThat(learned.offset(), Equals(0));
+            AssertThat(OTPGen::verifyTOTP(key, "122811", 1536573862, 2, 6, 30, learned), Equals(false));
+        });
+
+        it("[resyncHOTP]", [&]{
+            // the token drifted from counter 10 to 500
+            const auto code1 = OTPGen::computeHOTP("XYZA123456KDDK83D", 500, 6, OTPToken::SHA1);
+            const auto code2 = OTPGen::computeHOTP("XYZA123456KDDK83D", 501, 6, OTPToken::SHA1);
+
+            OTPToken::CounterType counter = 0U;
+            AssertThat(OTPGen::resyncHOTP("XYZA123456KDDK83D", 10, 6, OTPToken::SHA1, code1, {}, 1000, counter), Equals(true));
+            AssertThat(counter, Equals(501U));
+            AssertThat(OTPGen::resyncHOTP("XYZA123456KDDK83D", 10, 6, OTPToken::SHA1, code1, code2, 1000, counter), Equals(true));
+            AssertThat(counter, Equals(502U));
+            AssertThat(OTPGen::resyncHOTP("XYZA123456KDDK83D", 10, 6, OTPToken::SHA1, code2, code1, 1000, counter), Equals(false));
+            AssertThat(OTPGen::resyncHOTP("XYZA123456KDDK83D", 10, 6, OTPToken::SHA1, code1, code2, 100, counter), Equals(false));
+
+            // match at the very end of the window
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA256);
+            const auto code3 = OTPGen::computeHOTP(key, 163, 8);
+            const auto code4 = OTPGen::computeHOTP(key, 164, 8);
+            AssertThat(OTPGen::resyncHOTP(key, 35, 8, code3, code4, 128, counter), Equals(true));
+            AssertThat(counter, Equals(165U));
+            AssertThat(OTPGen::resyncHOTP(key, 35, 8, code3, code4, 127, counter), Equals(false));
+
+            // a 10-digit code plus 2^32 must not wrap around to the real code and move the counter
+            const auto real = OTPGen::computeHOTP(key, 40, 10);
+            const auto forged = std::to_string(std::stoull(real) + (1ULL << 32));
+            AssertThat(forged.size(), Equals(10U));
+            AssertThat(OTPGen::resyncHOTP(key, 3, 10, real, {}, 50, counter), Equals(true));
+            counter = 0U;
+            AssertThat(OTPGen::resyncHOTP(key, 3, 10, forged, {}, 50, counter), Equals(false));
+            AssertThat(counter, Equals(0U));
+
+            std::vector<OTPToken::CounterType> new_counters;
+            std::vector<std::uint8_t> matched;
+            OTPGen::resyncHOTPBatch({key}, {3U}, 10, {forged}, {}, 50U, new_counters, matched);
+            AssertThat(matched, Equals(std::vector<std::uint8_t>{0U}));
+            AssertThat(new_counters, Equals(std::vector<OTPToken::CounterType>{3U}));
+        });
+
+        it("[TOTPSeries]", [&]{
+            // the series must match computeTOTP for every period
+            const OTPToken token(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 7, 10, 0, OTPToken::SHA256);
+            OTPGen::TOTPSeries series(token, 1536573862, 1536573862 + 1000);
+            AssertThat(series.isValid(), Equals(true));
+            AssertThat(series.remaining(), Equals(101U));
+
+            OTPGen::TokenBuffer code;
+            std::time_t time = 0;
+            auto count = 0U;
+            auto all_equal = true;
+            while (series.next(code, &time))
+            {
+                all_equal = all_equal && std::string(code) == OTPGen::computeTOTP(time, "XYZA123456KDDK83D", 7, 10, OTPToken::SHA256);
+                ++count;
+            }
+            AssertThat(count, Equals(101U));
+            AssertThat(all_equal, Equals(true));
+            AssertThat(time, Equals(1536573862 / 10 * 10 + 1000));
+
+            const OTPToken steam(OTPToken::Steam, "2", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M");
+            OTPGen::TOTPSeries steam_series(steam, 1536573862, 1536573863);
+            AssertThat(steam_series.next(code), Equals(true));
+            AssertThat(std::string(code), Equals(std::string("GQTTM")));
+            AssertThat(steam_series.next(code), Equals(false));
+
+            const OTPToken hotp(OTPToken::HOTP, "3", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1);
+            AssertThat(OTPGen::TOTPSeries(hotp, 0, 100).isValid(), Equals(false));
+        });
+
+        it("[SHA backends]", [&]{
+            // test vectors of RFC 6238 and the existing vectors on every hardware backend
+            const auto detected = Internal::shaBackend();
+            for (auto&& backend : {Internal::ShaBackend::Portable,
+                                   Internal::ShaBackend::SHANI,
+                                   Internal::ShaBackend::ARMv8})
+            {
+                if (!Internal::setShaBackend(backend))
+                {
+                    continue;
+                }
+
+                AssertThat(OTPGen::computeTOTP(59, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ", 8, 30, OTPToken::SHA1), Equals(std::string("94287082")));
+                AssertThat(OTPGen::computeTOTP(59, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZA", 8, 30, OTPToken::SHA256), Equals(std::string("46119246")));
+                AssertThat(OTPGen::computeTOTP(1111111109, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZA", 8, 30, OTPToken::SHA256), Equals(std::string("68084774")));
+                AssertThat(OTPGen::computeTOTP(59, "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNA", 8, 30, OTPToken::SHA512), Equals(std::string("90693936")));
+                AssertThat(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1), Equals(std::string("122810")));
+                AssertThat(OTPGen::computeHOTP("XYZA123456KDDK83D", 12, 6, OTPToken::SHA1), Equals(std::string("534003")));
+                AssertThat(OTPGen::computeSteam(1536573862, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"), Equals(std::string("GQTTM")));
+            }
+            Internal::setShaBackend(detected);
+        });
+
+        it("[computeSteamBatch]", [&]{
+            // batch results must be identical to computeSteam
+            std::vector<OTPKey> keys;
+            std::vector<OTPToken::TokenString> expected;
+            for (auto i = 0U; i < 70U; ++i)
+            {
+                const auto secret = "ABC30WAY33X57CCBU3EAXGDDMX35S39M" + std::string(i % 5, 'A') + std::to_string(i);
+                keys.emplace_back(OTPGen::prepareKey(secret, OTPToken::SHA1));
+                expected.emplace_back(OTPGen::computeSteam(1536573862, secret));
+            }
+            keys.emplace_back(OTPGen::prepareKey("ABC30WAY33X57CCBU3EAXGDDMX35S39M", OTPToken::SHA256));
+            expected.emplace_back();
+
+            std::vector<OTPToken::TokenString> res;
+            std::vector<OTPGenErrorCode> errors;
+            OTPGen::computeSteamBatch(1536573862, keys, res, &errors);
+            AssertThat(res, Equals(expected));
+            AssertThat(errors.back() == OTPGenErrorCode::InvalidAlgorithm, Equals(true));
+        });
+
         it("[computeSteam]", [&]{
             // test steam token at a fixed time, result must be always the same
             const auto res = OTPGen::computeSteam(1536573862, "ABC30WAY33X57CCBU3EAXGDDMX35S39M");
             AssertThat(res, Equals(std::string("GQTTM")));
         });
+
+        it("[rotation]", [&]{
+            // rotations follow the epoch, also for periods which don't divide a minute
+            AssertThat(OTPToken::secondsUntilRotation(30, 1536573862), Equals(8U));
+            AssertThat(OTPToken::nextRotationTime(30, 1536573862), Equals(1536573870));
+            AssertThat(OTPToken::secondsUntilRotation(30, 1536573870), Equals(30U));
+            AssertThat(OTPToken::secondsUntilRotation(7, 1536573862), Equals(7U - 1536573862U % 7U));
+            AssertThat(OTPToken::secondsUntilRotation(0, 1536573862), Equals(0U));
+            AssertThat(OTPToken::nextRotationTime(0, 1536573862), Equals(1536573862));
+
+            // the next rotation is the first second with a different code
+            const auto totp = OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 45, 0, OTPToken::SHA1);
+            const auto next = totp.nextRotationTime(1536573862);
+            AssertThat(OTPGen::computeTOTP(next - 1, "XYZA123456KDDK83D", 6, 45, OTPToken::SHA1),
+                       Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 45, OTPToken::SHA1)));
+            AssertThat(OTPGen::computeTOTP(next, "XYZA123456KDDK83D", 6, 45, OTPToken::SHA1),
+                       Equals(OTPGen::computeTOTP(next + 44, "XYZA123456KDDK83D", 6, 45, OTPToken::SHA1)));
+
+            AssertThat(OTPToken(OTPToken::Steam).rotationPeriod(), Equals(30U));
+            AssertThat(OTPToken(OTPToken::HOTP, "2", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1).secondsUntilRotation(1536573862), Equals(0U));
+            const auto remaining = totp.remainingTokenValidity();
+            AssertThat(remaining >= 1U && remaining <= 45U, Equals(true));
+        });
+
+        it("[isValid]", [&]{
+            // the structural check agrees with code generation
+            const std::vector<std::string> secrets = {"", "A", "AB", "!!A!", "XYZA123456KDDK83D", "ABC30WAY33X57CCBU3EAXGDDMX35S39M"};
+            for (auto type : {0, 1, 2, 3, 7})
+            for (auto&& secret : secrets)
+            for (auto digits : {0, 2, 3, 6, 10, 11})
+            for (auto period : {0, 1, 2, 30, 120, 121})
+            for (auto algorithm : {0, 1, 3, 4})
+            {
+                const auto token = OTPToken(static_cast<OTPToken::TokenType>(type), "label", {}, secret,
+                                            static_cast<OTPToken::DigitType>(digits), static_cast<OTPToken::PeriodType>(period),
+                                            0, static_cast<OTPToken::ShaAlgorithm>(algorithm));
+                auto generated = OTPGenErrorCode::Valid;
+                const auto code = token.generateToken(&generated);
+                auto validated = OTPGenErrorCode::Valid;
+                AssertThat(token.validate(&validated), Equals(!code.empty()));
+                AssertThat(token.isValid(), Equals(!code.empty()));
+                if (code.empty())
+                {
+                    AssertThat(validated == generated, Equals(true));
+                }
+            }
+
+            // the cached verdict follows the setters
+            auto token = OTPToken(OTPToken::TOTP, "label", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1);
+            AssertThat(token.isValid(), Equals(true));
+            token.setDigitLength(42);
+            AssertThat(token.isValid(), Equals(false));
+            token.setDigitLength(6);
+            token.setAlgorithm(std::string("md5"));
+            AssertThat(token.isValid(), Equals(false));
+            token.setAlgorithm(std::string("sha-256"));
+            AssertThat(token.isValid(), Equals(true));
+            token.setLabel(OTPToken::Label());
+            AssertThat(token.isValid(), Equals(false));
+        });
+
+        it("[computeHOTPValues]", [&]{
+            const std::vector<OTPKey> keys = {
+                OTPGen::prepareRawKey(reinterpret_cast<const unsigned char*>("12345678901234567890"), 20U, OTPToken::SHA1),
+                OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA256),
+                OTPGen::prepareKey("!!A!", OTPToken::SHA1),
+                OTPGen::prepareKey("ABC30WAY33X57CCBU3EAXGDDMX35S39M", OTPToken::SHA1),
+            };
+            const std::vector<std::uint64_t> first = {0U, 7U, 3U, 1000U};
+            const std::size_t count = 150U;
+
+            ThreadPool pool(3U);
+            for (auto&& executor : {static_cast<Executor*>(nullptr), static_cast<Executor*>(&pool)})
+            {
+                std::vector<std::uint32_t> values;
+                std::vector<OTPGenErrorCode> errors;
+                OTPGen::computeHOTPValues(keys, first, count, 8U, values, &errors, executor);
+                AssertThat(values.size(), Equals(keys.size() * count));
+                AssertThat(errors[2] == OTPGenErrorCode::Valid, IsFalse());
+                for (auto k = 0U; k < keys.size(); ++k)
+                {
+                    if (k != 2U)
+                    {
+                        AssertThat(errors[k] == OTPGenErrorCode::Valid, IsTrue());
+                    }
+                    for (auto i = 0U; i < count; ++i)
+                    {
+                        const auto expected = k == 2U ? 0UL : std::stoul(OTPGen::computeHOTP(keys[k], first[k] + i, 8U));
+                        AssertThat(values[k * count + i], Equals(expected));
+                    }
+                }
+            }
+
+            // RFC 4226 values
+            std::vector<std::uint32_t> values;
+            OTPGen::computeHOTPValues({keys[0]}, {0U}, 10U, 6U, values);
+            AssertThat(values, Equals(std::vector<std::uint32_t>{755224U, 287082U, 359152U, 969429U, 338314U,
+                                                                 254676U, 287922U, 162583U, 399871U, 520489U}));
+        });
+
+        it("[batchEngine]", [&]{
+            // computes on the CPU, but counts what was handed over
+            struct CountingEngine : public BatchEngine
+            {
+                bool supports(const OTPToken::ShaAlgorithm &algorithm) const override
+                { return algorithm == OTPToken::SHA1; }
+                std::size_t minimumWork() const override
+                { return 100U; }
+                bool computeHOTPValues(const OTPKey *keys, std::size_t key_count,
+                                       const std::uint64_t *first, std::size_t count,
+                                       const OTPToken::DigitType &digits,
+                                       std::uint32_t *out) override
+                {
+                    ++this->calls;
+                    if (this->fail)
+                    {
+                        return false;
+                    }
+                    for (auto k = 0U; k < key_count; ++k)
+                    for (auto i = 0U; i < count; ++i)
+                    {
+                        out[k * count + i] = static_cast<std::uint32_t>(std::stoul(OTPGen::computeHOTP(keys[k], first[k] + i, digits)));
+                    }
+                    return true;
+                }
+                int calls = 0;
+                bool fail = false;
+            } engine;
+
+            const std::vector<OTPKey> keys = {
+                OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1),
+                OTPGen::prepareKey("ABC30WAY33X57CCBU3EAXGDDMX35S39M", OTPToken::SHA1),
+            };
+            std::vector<std::uint32_t> expected, values;
+            OTPGen::computeHOTPValues(keys, {5U, 9U}, 64U, 6U, expected);
+
+            OTPGen::setBatchEngine(&engine);
+            AssertThat(OTPGen::batchEngine() == &engine, IsTrue());
+            OTPGen::computeHOTPValues(keys, {5U, 9U}, 64U, 6U, values);
+            AssertThat(engine.calls, Equals(1));
+            AssertThat(values, Equals(expected));
+
+            // too small, unsupported keys and failed jobs stay on the CPU
+            OTPGen::computeHOTPValues(keys, {5U, 9U}, 10U, 6U, values);
+            OTPGen::computeHOTPValues({keys[0], OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA256)}, {5U, 9U}, 64U, 6U, values);
+            AssertThat(engine.calls, Equals(1));
+            engine.fail = true;
+            OTPGen::computeHOTPValues(keys, {5U, 9U}, 64U, 6U, values);
+            AssertThat(engine.calls, Equals(2));
+            AssertThat(values, Equals(expected));
+
+            OTPGen::setBatchEngine(nullptr);
+            AssertThat(OTPGen::batchEngine() == nullptr, IsTrue());
+        });
+
+        it("[resyncHOTPBatch]", [&]{
+            const std::vector<OTPKey> keys = {
+                OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1),
+                OTPGen::prepareKey("ABC30WAY33X57CCBU3EAXGDDMX35S39M", OTPToken::SHA256),
+                OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1),
+                OTPGen::prepareKey("!!A!", OTPToken::SHA1),
+            };
+            const std::vector<OTPToken::CounterType> counters = {10U, 35U, 0U, 0U};
+            const std::vector<OTPToken::TokenString> first_codes = {
+                OTPGen::computeHOTP(keys[0], 220U, 6U),
+                OTPGen::computeHOTP(keys[1], 90U, 6U),
+                OTPGen::computeHOTP(keys[2], 900U, 6U),
+                "123456",
+            };
+            const std::vector<OTPToken::TokenString> second_codes = {
+                OTPGen::computeHOTP(keys[0], 221U, 6U),
+                {},
+            };
+
+            ThreadPool pool(2U);
+            for (auto&& executor : {static_cast<Executor*>(nullptr), static_cast<Executor*>(&pool)})
+            {
+                std::vector<OTPToken::CounterType> new_counters;
+                std::vector<std::uint8_t> matched;
+                OTPGen::resyncHOTPBatch(keys, counters, 6U, first_codes, second_codes, 300U, new_counters, matched, executor);
+                AssertThat(matched, Equals(std::vector<std::uint8_t>{1U, 1U, 0U, 0U}));
+                AssertThat(new_counters, Equals(std::vector<OTPToken::CounterType>{222U, 91U, 0U, 0U}));
+
+                // same as one by one
+                for (auto k = 0U; k < 2U; ++k)
+                {
+                    OTPToken::CounterType counter = 0U;
+                    AssertThat(OTPGen::resyncHOTP(keys[k], counters[k], 6U, first_codes[k],
+                                                  k < second_codes.size() ? second_codes[k] : OTPToken::TokenString(),
+                                                  300U, counter), IsTrue());
+                    AssertThat(new_counters[k], Equals(counter));
+                }
+            }
+        });
+
+        it("[OpenCLEngine]", [&]{
+            OpenCLEngine engine;
+            AssertThat(engine.supports(OTPToken::SHA256), IsFalse());
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1);
+            const std::uint64_t first = 1000U;
+            std::vector<std::uint32_t> values(300U);
+            if (!engine.isAvailable())
+            {
+                // no device, every job is refused
+                AssertThat(engine.deviceName().empty(), IsTrue());
+                AssertThat(engine.computeHOTPValues(&key, 1U, &first, values.size(), 6U, values.data()), IsFalse());
+                return;
+            }
+
+            AssertThat(engine.supports(OTPToken::SHA1), IsTrue());
+            AssertThat(engine.computeHOTPValues(&key, 1U, &first, values.size(), 7U, values.data()), IsTrue());
+            for (auto i = 0U; i < values.size(); ++i)
+            {
+                AssertThat(values[i], Equals(std::stoul(OTPGen::computeHOTP(key, first + i, 7U))));
+            }
+        });
     });
 });
 
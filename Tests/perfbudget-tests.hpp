@@ -0,0 +1,155 @@
+#ifndef PERFBUDGETTESTS_HPP
+#define PERFBUDGETTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <OTPGen.hpp>
+#include <PerfStats.hpp>
+#include <TokenDatabase.hpp>
+
+#include <filesystem>
+#include <string>
+
+#include "alloc_counter.hpp"
+
+// the budgets count work instead of timing it, so they hold on loaded CI machines
+namespace PerfBudget {
+    // heap allocations of the calling thread while the function runs
+    template<typename Function>
+    std::size_t countAllocations(Function &&function)
+    {
+        const auto before = AllocCounter::count();
+        AllocCounter::start();
+        function();
+        AllocCounter::stop();
+        return AllocCounter::count() - before;
+    }
+
+    // executions of prepared statements of the token database
+    inline std::uint64_t statementCount()
+    {
+        std::uint64_t count = 0U;
+        for (auto&& statement : TokenDatabase::stats().statements)
+        {
+            count += statement.count;
+        }
+        return count;
+    }
+}
+
+go_bandit([]{
+    describe("Performance Budget Test", []{
+#ifdef OTPGEN_WITH_PERF_STATS
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-tests-budget.db").string();
+
+        const auto createTokens = [&](std::size_t count) {
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            for (auto i = 0U; i < count; ++i)
+            {
+                AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token" + std::to_string(i), {},
+                           "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+            }
+        };
+
+        after_each([&]{
+            TokenDatabase::closeDatabase();
+            std::filesystem::remove(file);
+        });
+#endif
+
+        it("[allocations per code]", [&]{
+            OTPGenErrorCode error;
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1, &error);
+            AssertThat(error == OTPGenErrorCode::Valid, Equals(true));
+
+            // the replaced operator new of alloc_counter.cpp is the one in use
+            AssertThat(PerfBudget::countAllocations([]{
+                ::operator delete(::operator new(16U));
+            }), Equals(1U));
+
+            // the prepared key generators never touch the heap
+            OTPGen::TokenBuffer buffer;
+            AssertThat(PerfBudget::countAllocations([&]{
+                for (auto i = 0; i < 100; ++i)
+                {
+                    OTPGen::computeTOTPInto(buffer, 1536573862 + i * 30, key, 6, 30);
+                }
+            }), Equals(0U));
+
+            // codes up to 10 digits fit into the small string buffer
+            AssertThat(PerfBudget::countAllocations([&]{
+                for (auto i = 0; i < 100; ++i)
+                {
+                    const auto code = OTPGen::computeTOTP(1536573862 + i * 30, key, 10, 30);
+                    AssertThat(code.size(), Equals(10U));
+                }
+            }), Equals(0U));
+
+            // decoding the secret costs at most a few allocations per code
+            AssertThat(PerfBudget::countAllocations([&]{
+                for (auto i = 0; i < 100; ++i)
+                {
+                    OTPGen::computeTOTP(1536573862 + i * 30, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1);
+                }
+            }), IsLessThanOrEqualTo(300U));
+        });
+
+#ifdef OTPGEN_WITH_PERF_STATS
+        it("[statements per selectTokens]", [&]{
+            // a listing is a fixed amount of statements, not one per token
+            std::uint64_t statements[2] = {};
+            std::size_t counts[2] = {10U, 250U};
+            for (auto i = 0U; i < 2U; ++i)
+            {
+                createTokens(counts[i]);
+                (void) TokenDatabase::selectTokens();
+
+                TokenDatabase::resetStats();
+                const auto tokens = TokenDatabase::selectTokens();
+                AssertThat(tokens.size(), Equals(counts[i]));
+                statements[i] = PerfBudget::statementCount();
+                AssertThat(TokenDatabase::stats().perf.counters[PerfStats::StatementCacheMisses], Equals(0U));
+            }
+            AssertThat(statements[0], IsGreaterThan(0U));
+            AssertThat(statements[0], IsLessThanOrEqualTo(2U));
+            AssertThat(statements[1], Equals(statements[0]));
+        });
+
+        it("[bytes copied per loadTokens]", [&]{
+            const auto compression = TokenDatabase::compression();
+            createTokens(500U);
+
+            // the decrypted image is written once into the memory of sqlite
+            TokenDatabase::setCompression(TokenDatabase::Uncompressed);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto imageFile = std::filesystem::file_size(file);
+            TokenDatabase::resetStats();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            const auto uncompressed = TokenDatabase::stats().perf;
+            AssertThat(uncompressed.counters[PerfStats::ImageBytesCopied], IsGreaterThan(0U));
+            AssertThat(uncompressed.counters[PerfStats::ImageBytesCopied], IsLessThanOrEqualTo(imageFile));
+
+            // compressed images add a single copy of the image
+            TokenDatabase::setCompression(TokenDatabase::Zlib);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto compressedFile = std::filesystem::file_size(file);
+            TokenDatabase::resetStats();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::stats().perf.counters[PerfStats::ImageBytesCopied],
+                       IsLessThanOrEqualTo(compressedFile + imageFile));
+            TokenDatabase::setCompression(compression);
+
+            // the time budget is coarse, it only catches loads which went quadratic
+            AssertThat(uncompressed.timers[PerfStats::Load].count, Equals(1U));
+            AssertThat(uncompressed.timers[PerfStats::Load].maxNs, IsLessThan(2000000000U));
+        });
+#endif
+    });
+});
+
+#endif // PERFBUDGETTESTS_HPP
@@ -0,0 +1,109 @@
+#ifndef PERFSTATSTESTS_HPP
+#define PERFSTATSTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <PerfStats.hpp>
+
+#include <thread>
+#include <vector>
+
+go_bandit([]{
+    describe("PerfStats Test", []{
+        it("[striped counters]", [&]{
+            // the records of all threads are in the snapshot
+            const auto before = PerfStats::snapshot();
+            std::vector<std::thread> threads;
+            for (auto t = 0U; t < 24U; ++t)
+            {
+                threads.emplace_back([]{
+                    for (auto i = 0U; i < 1000U; ++i)
+                    {
+                        PerfStats::add(PerfStats::KeyCacheHits);
+                        PerfStats::record(PerfStats::Verify, 3000U);
+                    }
+                });
+            }
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            PerfStats::record(PerfStats::Verify, 9000000U);
+
+            const auto after = PerfStats::snapshot();
+            AssertThat(after.counters[PerfStats::KeyCacheHits] - before.counters[PerfStats::KeyCacheHits], Equals(24000U));
+            AssertThat(after.timers[PerfStats::Verify].count - before.timers[PerfStats::Verify].count, Equals(24001U));
+            AssertThat(after.timers[PerfStats::Verify].buckets[0] - before.timers[PerfStats::Verify].buckets[0], Equals(0U));
+            AssertThat(after.timers[PerfStats::Verify].buckets[1] - before.timers[PerfStats::Verify].buckets[1], Equals(24000U));
+            AssertThat(after.timers[PerfStats::Verify].maxNs, IsGreaterThanOrEqualTo(9000000U));
+        });
+
+#ifdef OTPGEN_WITH_PERF_STATS
+        it("[memory accounting]", [&]{
+            const auto current = [] { return PerfStats::snapshot().memory[PerfStats::QRCodeBitmaps].currentBytes; };
+            const auto before = current();
+            {
+                PerfStats::Allocation allocation(PerfStats::QRCodeBitmaps, 1000U);
+                AssertThat(current() - before, Equals(1000U));
+
+                // copies are accounted again, moves take the bytes along
+                auto copy = allocation;
+                AssertThat(current() - before, Equals(2000U));
+                auto moved = std::move(copy);
+                AssertThat(copy.bytes(), Equals(0U));
+                AssertThat(moved.bytes(), Equals(1000U));
+                AssertThat(current() - before, Equals(2000U));
+
+                moved.resize(100U);
+                allocation.add(24U);
+                AssertThat(current() - before, Equals(1124U));
+                AssertThat(PerfStats::snapshot().memory[PerfStats::QRCodeBitmaps].peakBytes,
+                           IsGreaterThanOrEqualTo(before + 2000U));
+            }
+            AssertThat(current(), Equals(before));
+        });
+#endif
+
+        it("[writeMetrics]", [&]{
+            PerfStats::Snapshot snapshot;
+            snapshot.timers[PerfStats::Load].count = 3U;
+            snapshot.timers[PerfStats::Load].totalNs = 1500000000U;
+            snapshot.timers[PerfStats::Load].buckets[0] = 1U;
+            snapshot.timers[PerfStats::Load].buckets[2] = 1U;
+            snapshot.timers[PerfStats::Load].buckets[PerfStats::HISTOGRAM_BUCKETS - 1U] = 1U;
+            snapshot.counters[PerfStats::CodesGenerated] = 42U;
+                snapshot.memory[PerfStats::TokenStorage] = {2048U, 4096U};
+
+            std::string text;
+            PerfStats::writeMetrics(snapshot, {{"used_codes", "Live slots of the replay store.", 12.5}}, text);
+            const auto has = [&](const std::string &line) { return text.find(line + "\n") != std::string::npos; };
+            AssertThat(has("# TYPE otpgen_load_seconds histogram"), IsTrue());
+            AssertThat(has("otpgen_load_seconds_bucket{le=\"2e-06\"} 1"), IsTrue());
+            AssertThat(has("otpgen_load_seconds_bucket{le=\"4e-06\"} 1"), IsTrue());
+            AssertThat(has("otpgen_load_seconds_bucket{le=\"8e-06\"} 2"), IsTrue());
+            AssertThat(has("otpgen_load_seconds_bucket{le=\"+Inf\"} 3"), IsTrue());
+            AssertThat(has("otpgen_load_seconds_sum 1.5"), IsTrue());
+            AssertThat(has("otpgen_load_seconds_count 3"), IsTrue());
+            AssertThat(has("# TYPE otpgen_codes_generated_total counter"), IsTrue());
+            AssertThat(has("otpgen_codes_generated_total 42"), IsTrue());
+            AssertThat(has("# TYPE otpgen_used_codes gauge"), IsTrue());
+            AssertThat(has("otpgen_used_codes 12.5"), IsTrue());
+            AssertThat(has("# TYPE otpgen_memory_bytes gauge"), IsTrue());
+            AssertThat(has("otpgen_memory_bytes{subsystem=\"tokens\"} 2048"), IsTrue());
+            AssertThat(has("otpgen_memory_peak_bytes{subsystem=\"tokens\"} 4096"), IsTrue());
+            AssertThat(text.find("# EOF"), Equals(std::string::npos));
+
+            // OpenMetrics names the counter family without the suffix and ends with EOF
+            std::string open;
+            PerfStats::writeMetrics(snapshot, {}, open, true);
+            AssertThat(open.find("# TYPE otpgen_codes_generated counter\n"), Is().Not().EqualTo(std::string::npos));
+            AssertThat(open.find("otpgen_codes_generated_total 42\n"), Is().Not().EqualTo(std::string::npos));
+            AssertThat(open.size() >= 6U && open.compare(open.size() - 6U, 6U, "# EOF\n") == 0, IsTrue());
+        });
+    });
+});
+
+#endif // PERFSTATSTESTS_HPP
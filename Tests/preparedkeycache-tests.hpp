@@ -0,0 +1,140 @@
+#ifndef PREPAREDKEYCACHETESTS_HPP
+#define PREPAREDKEYCACHETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <PreparedKeyCache.hpp>
+#include <TokenDatabase.hpp>
+#include <TokenSet.hpp>
+
+#include <cstdio>
+#include <filesystem>
+
+go_bandit([]{
+    describe("PreparedKeyCache Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-tests-keycache.db").string();
+        const std::time_t time = 1536573862;
+
+        // the tokens need ids, they are read back from a database
+        before_each([&]{
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            for (auto i = 0; i < 32; ++i)
+            {
+                AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token" + std::to_string(i), {}, "XYZA123456KDDK83D")),
+                           Equals(TokenDatabase::Success));
+            }
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "hotp", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::Steam, "steam", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M")), Equals(TokenDatabase::Success));
+        });
+
+        after_each([&]{
+            TokenDatabase::closeDatabase();
+            std::remove(file.c_str());
+        });
+
+        it("[hits and misses]", [&]{
+            PreparedKeyCache cache;
+            const auto token = TokenDatabase::selectToken(OTPToken::Label("token0"));
+            AssertThat(cache.generateToken(token, time), Equals(std::string("122810")));
+            AssertThat(cache.generateToken(token, time), Equals(std::string("122810")));
+            AssertThat(cache.generateToken(token, time), Equals(token.generateToken(time)));
+
+            const auto stats = cache.stats();
+            AssertThat(stats.misses, Equals(1U));
+            AssertThat(stats.hits, Equals(2U));
+            AssertThat(stats.entries, Equals(1U));
+            AssertThat(stats.bytes > 0U, Equals(true));
+
+            // HOTP uses the counter of the token, Steam the Steam alphabet
+            const auto hotp = TokenDatabase::selectToken(OTPToken::Label("hotp"));
+            const auto steam = TokenDatabase::selectToken(OTPToken::Label("steam"));
+            AssertThat(cache.generateToken(hotp, time), Equals(hotp.generateToken(time)));
+            AssertThat(cache.generateToken(steam, time), Equals(std::string("GQTTM")));
+
+            cache.erase(token.id());
+            AssertThat(cache.stats().entries, Equals(2U));
+            cache.clear();
+            AssertThat(cache.stats().entries, Equals(0U));
+            AssertThat(cache.stats().bytes, Equals(0U));
+        });
+
+        it("[changed secret]", [&]{
+            PreparedKeyCache cache;
+            auto token = TokenDatabase::selectToken(OTPToken::Label("token1"));
+            const auto before = cache.generateToken(token, time);
+            token.setSecret("ABCD123456KDDK83D");
+            AssertThat(cache.generateToken(token, time), Equals(token.generateToken(time)));
+            AssertThat(cache.generateToken(token, time) != before, Equals(true));
+            AssertThat(cache.stats().misses, Equals(2U));
+            AssertThat(cache.stats().entries, Equals(1U));
+        });
+
+        it("[unstored and invalid tokens]", [&]{
+            PreparedKeyCache cache;
+            const OTPToken unstored(OTPToken::TOTP, "unstored", {}, "XYZA123456KDDK83D");
+            AssertThat(cache.generateToken(unstored, time), Equals(std::string("122810")));
+            AssertThat(cache.stats().entries, Equals(0U));
+
+            auto invalid = TokenDatabase::selectToken(OTPToken::Label("token2"));
+            invalid.setSecret("1");
+            auto error = OTPGenErrorCode::Valid;
+            AssertThat(cache.key(invalid, &error) == nullptr, Equals(true));
+            AssertThat(error == OTPGenErrorCode::Valid, Equals(false));
+            AssertThat(cache.stats().entries, Equals(0U));
+        });
+
+        it("[budget]", [&]{
+            const auto token = TokenDatabase::selectToken(OTPToken::Label("token0"));
+            const auto cost = PreparedKeyCache::cost(*PreparedKeyCache().key(token));
+
+            // one shard with room for four keys
+            PreparedKeyCache cache(4U * cost, 1U);
+            const auto tokens = TokenDatabase::selectTokens(OTPToken::TOTP, false);
+            for (auto&& t : tokens)
+            {
+                AssertThat(cache.generateToken(t, time), Equals(std::string("122810")));
+            }
+            auto stats = cache.stats();
+            AssertThat(stats.entries, Equals(4U));
+            AssertThat(stats.bytes <= cache.budget(), Equals(true));
+            AssertThat(stats.evictions, Equals(static_cast<std::uint64_t>(tokens.size() - 4U)));
+
+            // the hot key gets a second chance and survives the next round of cold ones
+            const auto &hot = tokens.back();
+            cache.generateToken(hot, time);
+            for (auto i = 0U; i < 3U; ++i)
+            {
+                cache.generateToken(tokens[i], time);
+            }
+            const auto hits = cache.stats().hits;
+            cache.generateToken(hot, time);
+            AssertThat(cache.stats().hits, Equals(hits + 1U));
+        });
+
+        it("[token set]", [&]{
+            TokenDatabase::setKeyCacheBudget(PreparedKeyCache::DEFAULT_BUDGET);
+            const auto cache = TokenDatabase::preparedKeys();
+
+            TokenSet set;
+            AssertThat(TokenDatabase::selectTokenSet(set, OTPToken::None, false), Equals(TokenDatabase::Success));
+            AssertThat(cache->stats().misses, Equals(34U));
+            AssertThat(cache->stats().entries, Equals(34U));
+            AssertThat(TokenDatabase::selectTokenSet(set, OTPToken::None, false), Equals(TokenDatabase::Success));
+            AssertThat(cache->stats().hits, Equals(34U));
+
+            std::vector<OTPToken::TokenString> codes;
+            set.computeCodes(time, codes);
+            AssertThat(codes.front(), Equals(std::string("122810")));
+
+            TokenDatabase::closeDatabase();
+            AssertThat(cache->stats().entries, Equals(0U));
+        });
+    });
+});
+
+#endif // PREPAREDKEYCACHETESTS_HPP
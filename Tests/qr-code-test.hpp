@@ -7,6 +7,29 @@ using namespace snowhouse;
 using namespace bandit;
 
 #include <QRCode.hpp>
+#include <QRCodeModule.hpp>
+#include <QRCodeScanner.hpp>
+#include <QRCodeSheet.hpp>
+#include <QRCodeTileScan.hpp>
+#include <Internal/Luminance.hpp>
+#include <ThreadPool.hpp>
+#include <lodepng.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+static std::vector<std::uint8_t> read_qr_image(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
 
 go_bandit([]{
     describe("QRCode Test", []{
@@ -37,6 +60,447 @@ go_bandit([]{
             AssertThat(res, Equals(false));
             AssertThat(data, Equals(std::string()));
         });
+
+        it("[encoded image in memory]", [&]{
+            std::string data;
+            auto png = read_qr_image("QRCodes/valid.png");
+            AssertThat(QRCode::decode(png.data(), png.size(), data), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+
+            auto jpg = read_qr_image("QRCodes/valid.jpg");
+            AssertThat(QRCode::decode(jpg.data(), jpg.size(), data), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+
+            // encoder output is an SVG image
+            std::string svg;
+            AssertThat(QRCode::encode("otpauth://totp/svg?secret=JBSWY3DPEHPK3PXP", svg), Equals(true));
+            AssertThat(QRCode::decode(reinterpret_cast<const std::uint8_t*>(svg.data()), svg.size(), data), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/svg?secret=JBSWY3DPEHPK3PXP")));
+
+            const std::string garbage = "not an image";
+            AssertThat(QRCode::decode(reinterpret_cast<const std::uint8_t*>(garbage.data()), garbage.size(), data), Equals(false));
+            AssertThat(data, Equals(std::string()));
+        });
+
+        it("[raw pixels in memory]", [&]{
+            std::vector<unsigned char> rgba;
+            unsigned width, height;
+            AssertThat(lodepng::decode(rgba, width, height, "QRCodes/valid.png"), Equals(0U));
+
+            std::string data;
+            AssertThat(QRCode::decode(rgba.data(), width, height, width * 4, QRCode::RGBA32, data), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+
+            // padded grayscale rows
+            const auto stride = width + 13;
+            std::vector<std::uint8_t> gray(stride * height, 0xFF);
+            for (auto y = 0U; y < height; ++y)
+            {
+                for (auto x = 0U; x < width; ++x)
+                {
+                    gray[y * stride + x] = rgba[(y * width + x) * 4];
+                }
+            }
+            AssertThat(QRCode::decode(gray.data(), width, height, stride, QRCode::Gray8, data), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+
+            // stride shorter than a row
+            AssertThat(QRCode::decode(gray.data(), width, height, width - 1, QRCode::Gray8, data), Equals(false));
+            AssertThat(data, Equals(std::string()));
+        });
+
+        it("[decode effort levels]", [&]{
+            std::string data;
+            AssertThat(QRCode::decode("QRCodes/valid.png", data, QRCode::Fast), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+            AssertThat(QRCode::decode("QRCodes/valid.jpg", data, QRCode::Normal), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+
+            // large enough to be tried downscaled first
+            std::vector<unsigned char> rgba;
+            unsigned width, height;
+            AssertThat(lodepng::decode(rgba, width, height, "QRCodes/valid.png"), Equals(0U));
+            const auto scale = 2048U / width + 1U;
+            const auto large = width * scale;
+            std::vector<std::uint8_t> gray(large * height * scale);
+            for (auto y = 0U; y < height * scale; ++y)
+            {
+                for (auto x = 0U; x < large; ++x)
+                {
+                    gray[y * large + x] = rgba[((y / scale) * width + x / scale) * 4];
+                }
+            }
+            AssertThat(QRCode::decode(gray.data(), large, height * scale, large, QRCode::Gray8, data, QRCode::Fast), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+
+            // a blank image fails at every level
+            std::vector<std::uint8_t> blank(256 * 256, 0xFF);
+            AssertThat(QRCode::decode(blank.data(), 256, 256, 256, QRCode::Gray8, data, QRCode::TryHarder), Equals(false));
+            AssertThat(data, Equals(std::string()));
+        });
+
+        it("[every code of an image]", [&]{
+            const std::string uri = "otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example";
+
+            // both test codes on one white sheet, the first one twice
+            const auto width = 560U;
+            const auto height = 220U;
+            std::vector<std::uint8_t> sheet(width * height, 0xFF);
+            const auto paste = [&](const std::string &file, unsigned left, unsigned top) {
+                std::vector<unsigned char> rgba;
+                unsigned w, h;
+                AssertThat(lodepng::decode(rgba, w, h, file), Equals(0U));
+                for (auto y = 0U; y < h; ++y)
+                {
+                    for (auto x = 0U; x < w; ++x)
+                    {
+                        sheet[(top + y) * width + left + x] = rgba[(y * w + x) * 4];
+                    }
+                }
+            };
+            paste("QRCodes/valid.png", 20, 20);
+            paste("QRCodes/invalid.png", 220, 50);
+            paste("QRCodes/valid.png", 360, 20);
+
+            std::vector<std::string> data;
+            AssertThat(QRCode::decodeAll(sheet.data(), width, height, width, QRCode::Gray8, data), Equals(true));
+            AssertThat(data.size(), Equals(2U));
+            AssertThat(std::find(data.begin(), data.end(), uri) != data.end(), Equals(true));
+            AssertThat(std::find(data.begin(), data.end(), "test") != data.end(), Equals(true));
+
+            // a single code
+            AssertThat(QRCode::decodeAll("QRCodes/valid.png", data), Equals(true));
+            AssertThat(data, Equals(std::vector<std::string>{uri}));
+
+            AssertThat(QRCode::decodeAll("QRCodes/nosuchfile", data), Equals(false));
+            AssertThat(data.empty(), Equals(true));
+        });
+
+        it("[decode region]", [&]{
+            std::vector<unsigned char> rgba;
+            unsigned width, height;
+            AssertThat(lodepng::decode(rgba, width, height, "QRCodes/valid.png"), Equals(0U));
+
+            // the code in the lower right corner of a larger frame
+            const auto frame = 400U;
+            std::vector<std::uint8_t> gray(frame * frame, 0xFF);
+            for (auto y = 0U; y < height; ++y)
+            {
+                for (auto x = 0U; x < width; ++x)
+                {
+                    gray[(frame - height + y) * frame + frame - width + x] = rgba[(y * width + x) * 4];
+                }
+            }
+
+            std::string data;
+            QRCode::Region bounds;
+            QRCode::Region region;
+            region.left = frame / 2U;
+            region.top = frame / 2U;
+            region.width = frame / 2U;
+            region.height = frame / 2U;
+            AssertThat(QRCode::decode(gray.data(), frame, frame, frame, QRCode::Gray8, region, data, &bounds, QRCode::Fast), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+            AssertThat(bounds.left >= int(frame - width), Equals(true));
+            AssertThat(bounds.top >= int(frame - height), Equals(true));
+            AssertThat(bounds.left + bounds.width <= int(frame), Equals(true));
+            AssertThat(bounds.width > int(width / 2U), Equals(true));
+
+            // nothing in the upper left quarter, regions must be in the frame
+            region.left = 0;
+            region.top = 0;
+            AssertThat(QRCode::decode(gray.data(), frame, frame, frame, QRCode::Gray8, region, data, &bounds, QRCode::Normal), Equals(false));
+            region.left = frame / 2U + 1U;
+            AssertThat(QRCode::decode(gray.data(), frame, frame, frame, QRCode::Gray8, region, data, &bounds), Equals(false));
+        });
+
+        it("[camera scanner]", [&]{
+            std::vector<unsigned char> rgba;
+            unsigned width, height;
+            AssertThat(lodepng::decode(rgba, width, height, "QRCodes/valid.png"), Equals(0U));
+
+            std::mutex mutex;
+            std::condition_variable found;
+            std::vector<std::string> results;
+            std::atomic<int> released{0};
+
+            QRCodeScanner::Frame frame;
+            frame.pixels = rgba.data();
+            frame.width = int(width);
+            frame.height = int(height);
+            frame.stride = int(width * 4U);
+            frame.format = QRCode::RGBA32;
+            frame.release = [&]{ ++released; };
+
+            QRCodeScanner scanner(1U);
+            // not running yet
+            AssertThat(scanner.submit(frame), Equals(false));
+            AssertThat(released.load(), Equals(1));
+
+            scanner.start([&](const std::string &data) {
+                std::lock_guard<std::mutex> lock(mutex);
+                results.emplace_back(data);
+                found.notify_all();
+            });
+            for (auto i = 0; i < 20; ++i)
+            {
+                scanner.submit(frame);
+            }
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                found.wait_for(lock, std::chrono::seconds(10), [&]{ return !results.empty(); });
+            }
+            scanner.stop();
+
+            // the same code is reported once, every frame is released once
+            AssertThat(results, Equals(std::vector<std::string>{"otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example"}));
+            AssertThat(released.load(), Equals(21));
+            AssertThat(scanner.decodedFrames() + scanner.droppedFrames() <= 21U, Equals(true));
+            AssertThat(scanner.decodedFrames() >= 1U, Equals(true));
+        });
+
+        it("[screenshot tiles]", [&]{
+            // tiles overlap by half and end at the edges
+            const auto regions = QRCodeTileScan::tiles(1000, 300, 400);
+            AssertThat(regions.size(), Equals(4U * 1U));
+            AssertThat(regions[1].left, Equals(200));
+            AssertThat(regions[3].left, Equals(600));
+            AssertThat(regions[3].width, Equals(400));
+            AssertThat(regions[3].height, Equals(300));
+            AssertThat(QRCodeTileScan::tiles(100, 100, 400).size(), Equals(1U));
+
+            // a small code which isn't an otpauth URI and one which is, on a large desktop
+            const std::string uri = "otpauth://totp/screen?secret=JBSWY3DPEHPK3PXP";
+            const auto width = 3000;
+            const auto height = 1800;
+            std::vector<std::uint8_t> screen(std::size_t(width) * std::size_t(height), 0xC0);
+            const auto paste = [&](const std::string &text, int left, int top) {
+                std::vector<std::uint8_t> pixels;
+                int size = 0;
+                AssertThat(QRCode::encodeRaster(text, pixels, size, 3, 4), Equals(true));
+                for (auto y = 0; y < size; ++y)
+                {
+                    std::copy_n(&pixels[std::size_t(y * size)], size, &screen[std::size_t((top + y) * width + left)]);
+                }
+                return size;
+            };
+            paste("not a token", 400, 300);
+            const auto size = paste(uri, 2500, 1400);
+
+            ThreadPool pool(4U);
+            QRCodeTileScan scan(&pool);
+            const auto accept = [](const std::string &data) {
+                return data.compare(0, 10, "otpauth://") == 0;
+            };
+            std::string data;
+            QRCode::Region bounds;
+            AssertThat(scan.decode(screen.data(), width, height, width, QRCode::Gray8, accept, data, &bounds), Equals(true));
+            AssertThat(data, Equals(uri));
+            AssertThat(bounds.left >= 2500 && bounds.left + bounds.width <= 2500 + size, Equals(true));
+            AssertThat(bounds.top >= 1400 && bounds.top + bounds.height <= 1400 + size, Equals(true));
+            AssertThat(scan.decodedTiles() >= 1U, Equals(true));
+
+            // nothing is accepted, every tile of both scales is decoded
+            AssertThat(scan.decode(screen.data(), width, height, width, QRCode::Gray8,
+                                   [](const std::string&) { return false; }, data), Equals(false));
+            AssertThat(data.empty(), Equals(true));
+            AssertThat(scan.decodedTiles(), Equals(QRCodeTileScan::tiles(width, height, 2048).size() +
+                                                   QRCodeTileScan::tiles(width, height, 768).size()));
+
+            // a cancelled scan stays cancelled
+            scan.cancel();
+            AssertThat(scan.decode(screen.data(), width, height, width, QRCode::Gray8, accept, data), Equals(false));
+        });
+
+        it("[cached encoding]", [&]{
+            const std::string uri = "otpauth://totp/cached?secret=JBSWY3DPEHPK3PXP";
+            QRCode::clearEncodeCache();
+
+            std::string first, second, data;
+            AssertThat(QRCode::encode(uri, first), Equals(true));
+            AssertThat(QRCode::encode(uri, second), Equals(true));
+            AssertThat(second, Equals(first));
+            AssertThat(QRCode::encodeCacheSize(), Equals(1U));
+            AssertThat(QRCode::decode(reinterpret_cast<const std::uint8_t*>(first.data()), first.size(), data), Equals(true));
+            AssertThat(data, Equals(uri));
+
+            // the raster uses the cached modules
+            std::vector<std::uint8_t> pixels;
+            int size = 0;
+            AssertThat(QRCode::encodeRaster(uri, pixels, size, 3, 2), Equals(true));
+            AssertThat(QRCode::encodeCacheSize(), Equals(1U));
+            AssertThat(pixels.size(), Equals(std::size_t(size) * std::size_t(size)));
+            AssertThat((size / 3 - 4 - 21) % 4, Equals(0));
+            AssertThat(int(pixels[0]), Equals(0xFF));
+            AssertThat(int(pixels[std::size_t(2 * 3 * size + 2 * 3)]), Equals(0x00));
+            AssertThat(QRCode::decode(pixels.data(), size, size, size, QRCode::Gray8, data), Equals(true));
+            AssertThat(data, Equals(uri));
+
+            // least recently used entries are evicted
+            QRCode::setEncodeCacheCapacity(2U);
+            AssertThat(QRCode::encode("otpauth://totp/a?secret=JBSWY3DPEHPK3PXP", second), Equals(true));
+            AssertThat(QRCode::encode(uri, second), Equals(true));
+            AssertThat(QRCode::encode("otpauth://totp/b?secret=JBSWY3DPEHPK3PXP", second), Equals(true));
+            AssertThat(QRCode::encodeCacheSize(), Equals(2U));
+            AssertThat(QRCode::encode(uri, second), Equals(true));
+            AssertThat(second, Equals(first));
+
+            QRCode::setEncodeCacheCapacity(0U);
+            AssertThat(QRCode::encodeCacheSize(), Equals(0U));
+            AssertThat(QRCode::encode(uri, second), Equals(true));
+            AssertThat(second, Equals(first));
+            AssertThat(QRCode::encodeCacheSize(), Equals(0U));
+
+            QRCode::setEncodeCacheCapacity(32U);
+            QRCode::clearEncodeCache();
+            AssertThat(QRCode::encodeRaster(std::string(), pixels, size), Equals(false));
+            AssertThat(QRCode::encodeRaster(uri, pixels, size, 0), Equals(false));
+        });
+
+        it("[backup sheet]", [&]{
+            QRCodeSheet::Layout layout;
+            layout.columns = 3;
+            layout.rows = 2;
+            layout.scale = 3;
+            ThreadPool pool(3U);
+            const QRCodeSheet sheet(layout, &pool);
+            AssertThat(sheet.perPage(), Equals(6U));
+
+            std::vector<std::string> uris;
+            for (auto i = 0; i < 5; ++i)
+            {
+                uris.emplace_back("otpauth://totp/sheet" + std::to_string(i) + "?secret=JBSWY3DPEHPK3PXP");
+            }
+            // a longer URI needs a larger code version
+            uris.back() += "&issuer=A%20much%20longer%20issuer%20name";
+            std::vector<std::string_view> page(uris.begin(), uris.end());
+
+            std::vector<std::uint8_t> png;
+            AssertThat(sheet.encodePage(page, png), Equals(true));
+
+            std::vector<std::string> data;
+            AssertThat(QRCode::decodeAll(png.data(), png.size(), data), Equals(true));
+            std::sort(data.begin(), data.end());
+            AssertThat(data, Equals(uris));
+
+            page.resize(7U, page.front());
+            AssertThat(sheet.encodePage(page, png), Equals(false));
+            AssertThat(sheet.encodePage({std::string_view()}, png), Equals(false));
+            AssertThat(png.empty(), Equals(true));
+        });
+
+        it("[luminance backends]", [&]{
+            std::mt19937 random(68);
+            std::vector<std::uint8_t> pixels(4U * 203U);
+            for (auto&& value : pixels)
+            {
+                value = static_cast<std::uint8_t>(random());
+            }
+            // extremes of the rounding and saturation
+            std::fill(pixels.begin(), pixels.begin() + 4, 0xFF);
+            std::fill(pixels.begin() + 4, pixels.begin() + 8, 0x00);
+
+            const auto original = Internal::lumaBackend();
+            for (auto&& bytes : {3, 4})
+            {
+                for (auto&& bgr : {false, true})
+                {
+                    const auto width = bytes == 4 ? 203 : 270;
+                    std::vector<std::uint8_t> expected(static_cast<std::size_t>(width));
+                    for (auto x = 0; x < width; ++x)
+                    {
+                        const auto p = &pixels[static_cast<std::size_t>(x * bytes)];
+                        const unsigned r = bgr ? p[2] : p[0];
+                        const unsigned b = bgr ? p[0] : p[2];
+                        expected[static_cast<std::size_t>(x)] = static_cast<std::uint8_t>((306U * r + 601U * p[1] + 117U * b + 0x200U) >> 10);
+                    }
+
+                    for (auto&& backend : {Internal::LumaBackend::Portable, Internal::LumaBackend::SSE2,
+                                           Internal::LumaBackend::AVX2, Internal::LumaBackend::NEON})
+                    {
+                        if (!Internal::setLumaBackend(backend))
+                        {
+                            continue;
+                        }
+                        std::vector<std::uint8_t> out(static_cast<std::size_t>(width));
+                        Internal::lumaRow(pixels.data(), out.data(), width, bytes, bgr);
+                        AssertThat(out, Equals(expected));
+                    }
+                }
+            }
+            Internal::setLumaBackend(original);
+
+            // 2x2 and 3x3 boxes, the remainder is cut off
+            std::vector<std::uint8_t> image(7U * 5U);
+            for (auto i = 0U; i < image.size(); ++i)
+            {
+                image[i] = static_cast<std::uint8_t>(i * 7U);
+            }
+            std::vector<std::uint8_t> scaled(3U * 2U);
+            Internal::downscale(image.data(), 7, 5, 2, scaled.data());
+            AssertThat(int(scaled[0]), Equals((0 + 7 + 49 + 56 + 2) / 4));
+            AssertThat(int(scaled[5]), Equals((7 * (18 + 19 + 25 + 26) + 2) / 4));
+            scaled.resize(2U);
+            Internal::downscale(image.data(), 7, 5, 3, scaled.data());
+            AssertThat(int(scaled[1]), Equals((7 * (3 + 4 + 5 + 10 + 11 + 12 + 17 + 18 + 19) + 4) / 9));
+        });
+
+        it("[batch decoding]", [&]{
+            const std::string uri = "otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example";
+            std::vector<std::string> files;
+            for (auto i = 0U; i < 8U; ++i)
+            {
+                files.emplace_back(i % 2U ? "QRCodes/valid.jpg" : "QRCodes/valid.png");
+            }
+            files.emplace_back("QRCodes/nosuchfile");
+
+            ThreadPool pool(4U);
+            std::vector<std::string> data(files.size());
+            std::vector<int> calls(files.size(), 0);
+            const auto decoded = QRCode::decodeBatch(files, [&](std::size_t index, bool success, const std::string &text) {
+                ++calls[index];
+                data[index] = success ? text : "failed";
+            }, &pool);
+            AssertThat(decoded, Equals(8U));
+            AssertThat(calls, Equals(std::vector<int>(files.size(), 1)));
+            for (auto i = 0U; i < 8U; ++i)
+            {
+                AssertThat(data[i], Equals(uri));
+            }
+            AssertThat(data[8], Equals(std::string("failed")));
+
+            // encoded images in memory without an executor
+            const auto png = read_qr_image("QRCodes/valid.png");
+            const auto jpg = read_qr_image("QRCodes/valid.jpg");
+            std::vector<QRCode::ImageBuffer> images{{png.data(), png.size()}, {jpg.data(), jpg.size()}};
+            std::vector<std::size_t> order;
+            AssertThat(QRCode::decodeBatch(images, [&](std::size_t index, bool success, const std::string &text) {
+                AssertThat(success, Equals(true));
+                AssertThat(text, Equals(uri));
+                order.emplace_back(index);
+            }), Equals(2U));
+            AssertThat(order, Equals(std::vector<std::size_t>{0U, 1U}));
+        });
+
+        it("[module table]", [&]{
+            // the table the loader calls through when the library is loaded on demand
+            const auto module = otpgen_qrcode_module();
+            AssertThat(QRCode::available(), Equals(true));
+            AssertThat(module != nullptr, Equals(true));
+            AssertThat(module->version, Equals(QRCodeModule::VERSION));
+
+            std::string data;
+            AssertThat(module->decodeFile("QRCodes/valid.png", data, QRCode::TryHarder), Equals(true));
+            AssertThat(data, Equals(std::string("otpauth://totp/Example:alice@google.com?secret=JBSWY3DPEHPK3PXP&issuer=Example")));
+
+            std::string svg;
+            AssertThat(module->encode("otpgen", svg), Equals(true));
+            AssertThat(svg.find("<svg") != std::string::npos, Equals(true));
+
+            std::vector<std::uint8_t> png;
+            AssertThat(module->encodeSheetPage(QRCodeSheet::Layout(), nullptr, {"otpgen"}, png), Equals(true));
+            AssertThat(png.empty(), Equals(false));
+        });
     });
 });
 
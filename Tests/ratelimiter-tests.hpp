@@ -0,0 +1,138 @@
+#ifndef RATELIMITERTESTS_HPP
+#define RATELIMITERTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <RateLimiter.hpp>
+
+#include <atomic>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+go_bandit([]{
+    describe("RateLimiter Test", []{
+        RateLimiter::Limit limit;
+        limit.burst = 3U;
+        limit.interval = std::chrono::milliseconds(1000);
+
+        it("[burst and refill]", [&]{
+            RateLimiter limiter(limit, 1000);
+            AssertThat(limiter.capacity(), Equals(1024U));
+
+            for (auto i = 0U; i < 3U; ++i)
+            {
+                AssertThat(limiter.acquire(1, 10000) == RateLimiter::Allowed, Equals(true));
+            }
+            AssertThat(limiter.acquire(1, 10000) == RateLimiter::Limited, Equals(true));
+            AssertThat(limiter.retryAfter(1, 10000), Equals(1000U));
+            AssertThat(limiter.retryAfter(1, 10400), Equals(600U));
+
+            // other tokens have their own bucket
+            AssertThat(limiter.acquire(2, 10000) == RateLimiter::Allowed, Equals(true));
+            AssertThat(limiter.retryAfter(2, 10000), Equals(0U));
+
+            // one attempt per interval comes back
+            AssertThat(limiter.acquire(1, 10999) == RateLimiter::Limited, Equals(true));
+            AssertThat(limiter.acquire(1, 11000) == RateLimiter::Allowed, Equals(true));
+            AssertThat(limiter.acquire(1, 11000) == RateLimiter::Limited, Equals(true));
+            // the bucket of token 2 is full again
+            AssertThat(limiter.occupancy(11000), Equals(1U));
+
+            // the bucket is full again and its slot free after burst * interval
+            AssertThat(limiter.occupancy(14000), Equals(0U));
+            for (auto i = 0U; i < 3U; ++i)
+            {
+                AssertThat(limiter.acquire(1, 14000) == RateLimiter::Allowed, Equals(true));
+            }
+            AssertThat(limiter.acquire(1, 14000) == RateLimiter::Limited, Equals(true));
+        });
+
+        it("[reset]", [&]{
+            RateLimiter limiter(limit, 1000);
+            for (auto i = 0U; i < 3U; ++i)
+            {
+                AssertThat(limiter.acquire(7, 5000) == RateLimiter::Allowed, Equals(true));
+            }
+            AssertThat(limiter.acquire(7, 5000) == RateLimiter::Limited, Equals(true));
+            limiter.reset(7, 5000);
+            AssertThat(limiter.retryAfter(7, 5000), Equals(0U));
+            AssertThat(limiter.occupancy(5000), Equals(0U));
+            AssertThat(limiter.acquire(7, 5000) == RateLimiter::Allowed, Equals(true));
+
+            limiter.clear();
+            AssertThat(limiter.occupancy(5000), Equals(0U));
+        });
+
+        it("[full]", [&]{
+            // a limiter of one shard is full once its probe sequences hold used buckets,
+            // full buckets are reused without a cleanup
+            RateLimiter limiter(limit, 1);
+            std::size_t allowed = 0U, full = 0U;
+            for (auto i = 0U; i < 1000U; ++i)
+            {
+                const auto result = limiter.acquire(i, 1000);
+                allowed += result == RateLimiter::Allowed;
+                full += result == RateLimiter::Full;
+            }
+            AssertThat(allowed <= limiter.capacity(), Equals(true));
+            AssertThat(allowed + full, Equals(1000U));
+            AssertThat(full > 0U, Equals(true));
+            AssertThat(limiter.acquire(5000, 4000) == RateLimiter::Allowed, Equals(true));
+        });
+
+        it("[concurrent attempts]", [&]{
+            // no matter how many threads try, a token gets exactly its burst
+            RateLimiter limiter(limit, 1U << 12);
+            std::atomic<std::size_t> allowed{0U};
+            std::vector<std::thread> threads;
+            for (auto t = 0U; t < 4U; ++t)
+            {
+                threads.emplace_back([&]{
+                    for (auto i = 0U; i < 1000U; ++i)
+                    {
+                        if (limiter.acquire(i % 100U, 1000) == RateLimiter::Allowed)
+                        {
+                            ++allowed;
+                        }
+                    }
+                });
+            }
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            AssertThat(allowed.load(), Equals(300U));
+        });
+
+#if defined(__unix__) || defined(__APPLE__)
+        it("[shared between processes]", [&]{
+            RateLimiter limiter(limit, 1000, RateLimiter::Shared);
+            AssertThat(limiter.shared(), Equals(true));
+            AssertThat(limiter.acquire(1, 1000) == RateLimiter::Allowed, Equals(true));
+
+            // the child takes the remaining attempts of the parent's bucket
+            const auto pid = ::fork();
+            if (pid == 0)
+            {
+                const auto first = limiter.acquire(1, 1000) == RateLimiter::Allowed;
+                const auto second = limiter.acquire(1, 1000) == RateLimiter::Allowed;
+                std::_Exit(first && second ? 0 : 1);
+            }
+            AssertThat(pid > 0, Equals(true));
+            int status = 0;
+            AssertThat(::waitpid(pid, &status, 0), Equals(pid));
+            AssertThat(WIFEXITED(status) && WEXITSTATUS(status) == 0, Equals(true));
+            AssertThat(limiter.acquire(1, 1000) == RateLimiter::Limited, Equals(true));
+        });
+#endif
+    });
+});
+
+#endif // RATELIMITERTESTS_HPP
@@ -0,0 +1,87 @@
+#ifndef ROTATIONSCHEDULERTESTS_HPP
+#define ROTATIONSCHEDULERTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <RotationScheduler.hpp>
+#include <Clock.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+go_bandit([]{
+    describe("RotationScheduler Test", []{
+        const std::vector<OTPToken> tokens = {
+            OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::HOTP, "2", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::TOTP, "3", {}, "XYZA123456KDDK83D", 6, 10, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::Steam, "4", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"),
+            OTPToken(OTPToken::TOTP, "5", {}, "XYZA123456KDDK83D", 6, 50, 0, OTPToken::SHA1),
+        };
+
+        it("[grouping]", [&]{
+            // one group per distinct period, counter-based tokens are left out
+            RotationScheduler scheduler;
+            scheduler.setTokens(tokens);
+            AssertThat(scheduler.periodCount(), Equals(3U));
+
+            // 1536573862 is 8 seconds before a 30 second boundary and 8 before a 10 second one
+            auto event = scheduler.nextRotation(1536573862);
+            AssertThat(event.time, Equals(1536573870));
+            AssertThat(event.indices, Equals(std::vector<std::size_t>{0, 2, 3}));
+            AssertThat(event.periods.size(), Equals(2U));
+
+            event = scheduler.nextRotation(1536573870);
+            AssertThat(event.time, Equals(1536573880));
+            AssertThat(event.indices, Equals(std::vector<std::size_t>{2}));
+
+            scheduler.clear();
+            AssertThat(scheduler.periodCount(), Equals(0U));
+            AssertThat(scheduler.nextRotation(1536573862).time, Equals(0));
+        });
+
+        it("[events]", [&]{
+            // the worker reports the rotations of the shortest period
+            const std::vector<OTPToken> fast = {
+                OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 2, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::TOTP, "2", {}, "XYZA123456KDDK83D", 6, 120, 0, OTPToken::SHA1),
+            };
+
+            std::mutex mutex;
+            std::condition_variable done;
+            std::vector<RotationScheduler::Event> events;
+
+            RotationScheduler scheduler;
+            scheduler.setTokens(fast);
+            scheduler.start([&](const RotationScheduler::Event &event) {
+                std::lock_guard<std::mutex> lock(mutex);
+                events.emplace_back(event);
+                done.notify_all();
+            });
+            AssertThat(scheduler.running(), Equals(true));
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait_for(lock, std::chrono::seconds(5), [&]{
+                    return events.size() >= 2U;
+                });
+            }
+            scheduler.stop();
+            AssertThat(scheduler.running(), Equals(false));
+
+            AssertThat(events.size() >= 2U, Equals(true));
+            for (auto&& event : events)
+            {
+                AssertThat(event.time % 2, Equals(0));
+                AssertThat(event.indices.front(), Equals(0U));
+            }
+            AssertThat(events.at(1).time > events.at(0).time, Equals(true));
+        });
+    });
+});
+
+#endif // ROTATIONSCHEDULERTESTS_HPP
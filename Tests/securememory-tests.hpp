@@ -0,0 +1,51 @@
+#ifndef SECUREMEMORYTESTS_HPP
+#define SECUREMEMORYTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <SecureMemory.hpp>
+#include <OTPToken.hpp>
+
+go_bandit([]{
+    describe("SecureMemory Test", []{
+        it("[allocate]", [&]{
+            const auto before = SecureMemory::allocatedBytes();
+            {
+                // small blocks share slabs, large buffers get pages of their own
+                SecureString secret(64, 'x');
+                SecureBuffer buffer(64 * 1024, 0x5a);
+                AssertThat(SecureMemory::allocatedBytes() >= before + 64 * 1024 + 64, Equals(true));
+                AssertThat(secret == std::string(64, 'x'), Equals(true));
+                AssertThat(buffer.back(), Equals(0x5a));
+            }
+            AssertThat(SecureMemory::allocatedBytes(), Equals(before));
+        });
+
+        it("[reuse]", [&]{
+            // a released block is wiped before it is handed out again
+            const char *first = nullptr;
+            {
+                SecureString secret(40, 's');
+                first = secret.data();
+            }
+            SecureString next;
+            next.reserve(40);
+            if (next.data() == first)
+            {
+                AssertThat(std::string(next.data(), 40), Equals(std::string(40, '\0')));
+            }
+        });
+
+        it("[tokenSecret]", [&]{
+            OTPToken token(OTPToken::TOTP, "a", {}, std::string("XYZA123456KDDK83DXYZA123456KDDK83D"));
+            AssertThat(token.secret(), Equals("XYZA123456KDDK83DXYZA123456KDDK83D"));
+            AssertThat(token.secret() == std::string("XYZA123456KDDK83DXYZA123456KDDK83D"), Equals(true));
+            AssertThat(SecureMemory::allocatedBytes() > 0U, Equals(true));
+        });
+    });
+});
+
+#endif // SECUREMEMORYTESTS_HPP
@@ -0,0 +1,76 @@
+#ifndef THREADPOOLTESTS_HPP
+#define THREADPOOLTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <ThreadPool.hpp>
+#include <OTPGen.hpp>
+
+#include <stdexcept>
+
+go_bandit([]{
+    describe("ThreadPool Test", []{
+        it("[parallelFor]", [&]{
+            // every index must be visited exactly once
+            ThreadPool pool(4);
+            AssertThat(pool.concurrency(), Equals(4U));
+
+            std::vector<std::atomic<int>> visited(10007);
+            pool.parallelFor(visited.size(), 13, [&](std::size_t begin, std::size_t end){
+                for (auto i = begin; i < end; ++i)
+                {
+                    ++visited[i];
+                }
+            });
+
+            auto all_once = true;
+            for (auto&& v : visited)
+            {
+                all_once = all_once && v == 1;
+            }
+            AssertThat(all_once, Equals(true));
+        });
+
+        it("[nested and exceptions]", [&]{
+            ThreadPool pool(3, true);
+
+            std::atomic<std::size_t> sum{0U};
+            pool.parallelFor(8, 1, [&](std::size_t, std::size_t){
+                pool.parallelFor(10, 2, [&](std::size_t begin, std::size_t end){
+                    sum += end - begin;
+                });
+            });
+            AssertThat(sum.load(), Equals(80U));
+
+            AssertThrows(std::runtime_error, pool.parallelFor(100, 1, [&](std::size_t begin, std::size_t){
+                if (begin == 42) throw std::runtime_error("task failed");
+            }));
+        });
+
+        it("[OTPGen batch]", [&]{
+            // results with an executor must be identical to the serial batch
+            std::vector<OTPKey> keys;
+            std::vector<OTPToken::TokenString> codes;
+            for (auto i = 0U; i < 3000U; ++i)
+            {
+                keys.emplace_back(OTPGen::prepareKey("XYZA123456KDDK83D" + std::to_string(i), i % 3 ? OTPToken::SHA1 : OTPToken::SHA512));
+            }
+
+            std::vector<OTPToken::TokenString> serial, parallel;
+            OTPGen::computeTOTPBatch(1536573862, keys, 6, 30, serial);
+
+            ThreadPool pool(4);
+            OTPGen::computeTOTPBatch(1536573862, keys, 6, 30, parallel, nullptr, &pool);
+            AssertThat(parallel, Equals(serial));
+
+            std::vector<std::uint8_t> matched;
+            OTPGen::verifyTOTPBatch(keys, serial, 1536573862 + 30, 1, 6, 30, matched, &pool);
+            AssertThat(std::count(matched.begin(), matched.end(), 1U), Equals(3000));
+        });
+    });
+});
+
+#endif // THREADPOOLTESTS_HPP
@@ -0,0 +1,98 @@
+#ifndef TOKENCODECACHETESTS_HPP
+#define TOKENCODECACHETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <TokenCodeCache.hpp>
+
+go_bandit([]{
+    describe("TokenCodeCache Test", []{
+        it("[lookup]", [&]{
+            // codes of the current and next period must match OTPGen
+            const std::vector<OTPToken> tokens = {
+                OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::HOTP, "2", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+                OTPToken(OTPToken::Steam, "3", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"),
+            };
+            TokenCodeCache cache(tokens);
+            AssertThat(cache.size(), Equals(3U));
+
+            // nothing is cached for a time far away from now
+            OTPGen::TokenBuffer buffer;
+            AssertThat(cache.code(0, 1536573862, buffer), Equals(false));
+
+            cache.refresh(1536573862);
+            AssertThat(cache.code(0, 1536573862, buffer), Equals(true));
+            AssertThat(std::string(buffer), Equals(std::string("122810")));
+            AssertThat(cache.nextCode(0, 1536573862, buffer), Equals(true));
+            AssertThat(std::string(buffer), Equals(OTPGen::computeTOTP(1536573862 + 30, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+            AssertThat(cache.code(0, 1536573862 + 60, buffer), Equals(false));
+
+            AssertThat(cache.code(1, 1536573862, buffer), Equals(false));
+            AssertThat(cache.code(2, 1536573862, buffer), Equals(true));
+            AssertThat(std::string(buffer), Equals(std::string("GQTTM")));
+            AssertThat(cache.code(3, 1536573862, buffer), Equals(false));
+
+            // rotation into the next period keeps the precomputed code
+            cache.refresh(1536573862 + 30);
+            AssertThat(cache.code(0, 1536573862 + 30, buffer), Equals(true));
+            AssertThat(std::string(buffer), Equals(OTPGen::computeTOTP(1536573862 + 30, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+        });
+
+        it("[findCode]", [&]{
+            // tokens of both periods and both types, the two SHA1/6/30 tokens share the secret
+            const std::vector<OTPToken> tokens = {
+                OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::HOTP, "2", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+                OTPToken(OTPToken::Steam, "3", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"),
+                OTPToken(OTPToken::TOTP, "4", {}, "XYZA123456KDDK83D", 8, 60, 0, OTPToken::SHA256),
+                OTPToken(OTPToken::TOTP, "5", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            };
+            TokenCodeCache cache(tokens);
+            cache.refresh(1536573862);
+
+            std::vector<std::size_t> indices;
+            AssertThat(cache.findCode("122810", 1536573862, indices), Equals(true));
+            AssertThat(indices, Equals(std::vector<std::size_t>{0, 4}));
+            AssertThat(cache.findCode("GQTTM", 1536573862, indices), Equals(true));
+            AssertThat(indices, Equals(std::vector<std::size_t>{2}));
+            const auto code = OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 8, 60, OTPToken::SHA256);
+            AssertThat(cache.findCode(code, 1536573862, indices), Equals(true));
+            AssertThat(indices, Equals(std::vector<std::size_t>{3}));
+
+            AssertThat(cache.findCode("122811", 1536573862, indices), Equals(false));
+            AssertThat(indices.empty(), Equals(true));
+            AssertThat(cache.findCode(OTPGen::computeHOTP("XYZA123456KDDK83D", 12, 6, OTPToken::SHA1), 1536573862, indices), Equals(false));
+
+            // the index only covers the current period, it moves with the rotation
+            const auto next = OTPGen::computeTOTP(1536573862 + 30, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1);
+            AssertThat(cache.findCode(next, 1536573862 + 30, indices), Equals(false));
+            cache.refresh(1536573862 + 30);
+            AssertThat(cache.findCode(next, 1536573862 + 30, indices), Equals(true));
+            AssertThat(indices, Equals(std::vector<std::size_t>{0, 4}));
+            AssertThat(cache.findCode("122810", 1536573862 + 30, indices), Equals(false));
+        });
+
+        it("[worker]", [&]{
+            const std::vector<OTPToken> tokens = {
+                OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            };
+            TokenCodeCache cache(tokens);
+            cache.start();
+            AssertThat(cache.running(), Equals(true));
+
+            const auto now = std::time(nullptr);
+            OTPGen::TokenBuffer buffer;
+            AssertThat(cache.code(0, now, buffer), Equals(true));
+            AssertThat(std::string(buffer), Equals(OTPGen::computeTOTP(now, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+
+            cache.stop();
+            AssertThat(cache.running(), Equals(false));
+        });
+    });
+});
+
+#endif // TOKENCODECACHETESTS_HPP
@@ -0,0 +1,2126 @@
+#ifndef TOKENDATABASETESTS_HPP
+#define TOKENDATABASETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <TokenDatabase.hpp>
+#include <Provisioning.hpp>
+#include <SteamTimeService.hpp>
+#include <Clock.hpp>
+#include <OTPGen.hpp>
+#include <ThreadPool.hpp>
+#include <otpauthURI.hpp>
+#include <TokenSet.hpp>
+#include <TokenSetView.hpp>
+#include <Internal/ChunkedContainer.hpp>
+#include <Internal/CounterJournal.hpp>
+
+#include <sqlite/sqlite3.h>
+
+#include <cryptopp/sha.h>
+#include <cryptopp/base64.h>
+#include <cryptopp/filters.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <thread>
+
+go_bandit([]{
+    describe("TokenDatabase Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-tests.db").string();
+        const auto vaultFile = (std::filesystem::temp_directory_path() / "otpgen-tests-vault.db").string();
+
+        before_each([&]{
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "b", {}, "ABCD123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "c", {}, "EFGH123456KDDK83D")), Equals(TokenDatabase::Success));
+        });
+
+        // same key as TokenDatabase::setPassword()
+        const auto imageKey = [] {
+            SecureString password;
+            CryptoPP::SHA256 hash;
+            CryptoPP::StringSource src(std::string("otpgen-tests"), true,
+                new CryptoPP::HashFilter(hash,
+                    new CryptoPP::Base64Encoder(
+                        new CryptoPP::StringSinkTemplate<SecureString>(password))));
+            return password;
+        };
+
+        // replaces the database file with the encrypted image of a database written by sqlite3 directly
+        const auto writeImage = [&](sqlite3 *database) {
+            sqlite3_int64 size = 0;
+            auto image = sqlite3_serialize(database, "main", &size, 0);
+            sqlite3_close(database);
+            AssertThat(image != nullptr, IsTrue());
+
+            const auto password = imageKey();
+            std::string encrypted;
+            AssertThat(Internal::encryptContainer(password, image, static_cast<std::size_t>(size), encrypted) ==
+                       Internal::ContainerStatus::Success, IsTrue());
+            sqlite3_free(image);
+
+            TokenDatabase::closeDatabase();
+            std::ofstream stream(file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+            stream.write(encrypted.data(), static_cast<std::streamsize>(encrypted.size()));
+        };
+
+        // opens the saved database file with sqlite3 directly
+        const auto readImage = [&] {
+            std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+            std::string encrypted((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+            auto size = encrypted.size();
+            auto image = static_cast<unsigned char*>(sqlite3_malloc64(size));
+            const auto data = reinterpret_cast<const unsigned char*>(encrypted.data());
+            AssertThat(Internal::decryptContainer(imageKey(), data, size, image) ==
+                       Internal::ContainerStatus::Success, IsTrue());
+
+            sqlite3 *database = nullptr;
+            AssertThat(sqlite3_open(":memory:", &database), Equals(SQLITE_OK));
+            AssertThat(sqlite3_deserialize(database, "main", image, static_cast<sqlite3_int64>(size),
+                static_cast<sqlite3_int64>(encrypted.size()), SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE), Equals(SQLITE_OK));
+            return database;
+        };
+
+        after_each([&]{
+            TokenDatabase::setIconScaler({}, {});
+            (void) TokenDatabase::closeVault("ops");
+            std::remove(vaultFile.c_str());
+            std::remove((vaultFile + "-journal").c_str());
+            std::remove((vaultFile + "-counters").c_str());
+            std::remove((file + "-counters").c_str());
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedImage);
+            TokenDatabase::setDurability(TokenDatabase::Immediate);
+            TokenDatabase::setAutoSave(std::chrono::milliseconds(0));
+            TokenDatabase::setKeyDerivation(TokenDatabase::PasswordHash);
+            TokenDatabase::setCompression(TokenDatabase::Uncompressed);
+            TokenDatabase::setProgressiveOpen(false);
+            TokenDatabase::setCompactionThreshold(0.25);
+            TokenDatabase::setPageSize(0);
+            TokenDatabase::setTuning(TokenDatabase::EncryptedImage, TokenDatabase::defaultTuning(TokenDatabase::EncryptedImage));
+            TokenDatabase::setTuning(TokenDatabase::EncryptedPages, TokenDatabase::defaultTuning(TokenDatabase::EncryptedPages));
+            TokenDatabase::closeDatabase();
+            std::remove(file.c_str());
+            std::remove((file + "-journal").c_str());
+        });
+
+        it("[selectTokens]", [&]{
+            // listing follows the display order
+            AssertThat(TokenDatabase::moveToken("c", 0), Equals(TokenDatabase::Success));
+
+            const auto tokens = TokenDatabase::selectTokens();
+            AssertThat(tokens.size(), Equals(3U));
+            AssertThat(tokens.at(0).label(), Equals("c"));
+            AssertThat(tokens.at(1).label(), Equals("a"));
+            AssertThat(tokens.at(2).label(), Equals("b"));
+            AssertThat(tokens.at(1).secret(), Equals("XYZA123456KDDK83D"));
+            AssertThat(tokens.at(2).type(), Equals(OTPToken::HOTP));
+
+            const auto totp = TokenDatabase::selectTokens(OTPToken::TOTP);
+            AssertThat(totp.size(), Equals(2U));
+            AssertThat(totp.at(0).label(), Equals("c"));
+            AssertThat(totp.at(1).label(), Equals("a"));
+
+            AssertThat(TokenDatabase::selectTokens(OTPToken::Steam).empty(), Equals(true));
+        });
+
+        it("[selectToken]", [&]{
+            const auto by_label = TokenDatabase::selectToken(OTPToken::Label("b"));
+            AssertThat(by_label.id(), Is().GreaterThan(0));
+            AssertThat(by_label.secret(), Equals("ABCD123456KDDK83D"));
+
+            const auto by_id = TokenDatabase::selectToken(by_label.id());
+            AssertThat(by_id.label(), Equals("b"));
+            AssertThat(by_id.type(), Equals(OTPToken::HOTP));
+
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("x")).id(), Equals(0));
+
+            // exact and case insensitive, LIKE wildcards are no wildcards
+            AssertThat(TokenDatabase::tokenId("B"), Equals(by_label.id()));
+            AssertThat(TokenDatabase::tokenId("_"), Equals(0));
+
+            // the label map follows renames, inserts and deletes
+            AssertThat(TokenDatabase::renameToken(by_label.id(), "renamed"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenId("b"), Equals(0));
+            AssertThat(TokenDatabase::tokenId("Renamed"), Equals(by_label.id()));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "b", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("b")).secret(), Equals("IJKL123456KDDK83D"));
+            AssertThat(TokenDatabase::deleteToken(by_label.id()), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenId("renamed"), Equals(0));
+        });
+
+        it("[tokenColumns]", [&]{
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "d", {}, "IJKL123456KDDK83D",
+                                                           8U, 60U, 4000000000U, OTPToken::SHA512)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            const auto token = TokenDatabase::selectToken(OTPToken::Label("d"));
+            AssertThat(token.digitLength(), Equals(8U));
+            AssertThat(token.period(), Equals(60U));
+            AssertThat(token.counter(), Equals(4000000000U));
+            AssertThat(token.algorithm(), Equals(OTPToken::SHA512));
+        });
+
+        it("[displayOrder]", [&]{
+            const auto labels = [] {
+                std::vector<OTPToken::Label> list;
+                for (auto&& token : TokenDatabase::selectTokens())
+                {
+                    list.emplace_back(token.label());
+                }
+                return list;
+            };
+
+            AssertThat(TokenDatabase::swapTokens("a", "c"), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"c", "b", "a"}));
+
+            AssertThat(TokenDatabase::deleteToken(TokenDatabase::selectToken(OTPToken::Label("b")).id()), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"c", "a", "d"}));
+            AssertThat(TokenDatabase::displayOrder().size(), Equals(3U));
+
+            // order survives a save and load
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"c", "a", "d"}));
+        });
+
+        it("[moveToken]", [&]{
+            const auto labels = [] {
+                std::vector<OTPToken::Label> list;
+                for (auto&& token : TokenDatabase::selectTokens())
+                {
+                    list.emplace_back(token.label());
+                }
+                return list;
+            };
+
+            AssertThat(TokenDatabase::moveToken("a", 2), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"b", "a", "c"}));
+            AssertThat(TokenDatabase::moveToken("b", 10), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"a", "c", "b"}));
+            AssertThat(TokenDatabase::moveTokenAbove("b", "a"), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"b", "a", "c"}));
+
+            // repeated moves into the same gap force a renumbering
+            for (auto i = 0; i < 40; ++i)
+            {
+                AssertThat(TokenDatabase::moveTokenBelow(i % 2 ? "c" : "b", "a"), Equals(TokenDatabase::Success));
+            }
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"a", "c", "b"}));
+
+            AssertThat(TokenDatabase::moveTokenBelow("a", "x"), Equals(TokenDatabase::SqlEmptyResults));
+        });
+
+        it("[applyOrder]", [&]{
+            const auto labels = [] {
+                std::vector<OTPToken::Label> list;
+                for (auto&& token : TokenDatabase::selectTokens())
+                {
+                    list.emplace_back(token.label());
+                }
+                return list;
+            };
+            const auto a = TokenDatabase::tokenId(OTPToken::Label("a"));
+            const auto b = TokenDatabase::tokenId(OTPToken::Label("b"));
+            const auto c = TokenDatabase::tokenId(OTPToken::Label("c"));
+
+            const auto sequence = TokenDatabase::changeSequence();
+            AssertThat(TokenDatabase::applyOrder({c, a, b}), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"c", "a", "b"}));
+            AssertThat(TokenDatabase::changeSequence(), IsGreaterThan(sequence));
+
+            // only permutations of all tokens
+            AssertThat(TokenDatabase::applyOrder({c, a}), Equals(TokenDatabase::SqlDisplayOrderIncomplete));
+            AssertThat(TokenDatabase::applyOrder({c, a, a}), Equals(TokenDatabase::SqlDisplayOrderIncomplete));
+            AssertThat(TokenDatabase::applyOrder({c, a, b, 99}), Equals(TokenDatabase::SqlDisplayOrderIncomplete));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"c", "a", "b"}));
+
+            // moves keep working in the new gaps
+            AssertThat(TokenDatabase::moveTokenBelow("b", "c"), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"c", "b", "a"}));
+
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::Steam, "B", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::SqlConstraintViolation));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::Steam, "A steam", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::sortTokens(TokenDatabase::SortByLabel), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"a", "A steam", "b", "c"}));
+            AssertThat(TokenDatabase::sortTokens(TokenDatabase::SortByType), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"a", "c", "b", "A steam"}));
+            AssertThat(TokenDatabase::sortTokens(TokenDatabase::SortByCreation), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"a", "b", "c", "A steam"}));
+
+            // the order survives a save and load
+            AssertThat(TokenDatabase::applyOrder({c, b, a, TokenDatabase::tokenId("a steam")}), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"c", "b", "a", "A steam"}));
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::sortTokens(TokenDatabase::SortByLabel), Equals(TokenDatabase::SqlDatabaseNotOpen));
+        });
+
+        it("[insertTokens]", [&]{
+            std::vector<TokenDatabase::Error> results;
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "A", {}, "MNOP123456KDDK83D"),
+                OTPToken(OTPToken::HOTP, "e", {}, "QRST123456KDDK83D"),
+            }, &results), Equals(TokenDatabase::Success));
+
+            // labels are case insensitive, the duplicate is skipped
+            AssertThat(results, Equals(std::vector<TokenDatabase::Error>{
+                TokenDatabase::Success, TokenDatabase::SqlConstraintViolation, TokenDatabase::Success}));
+
+            std::vector<OTPToken::Label> labels;
+            for (auto&& token : TokenDatabase::selectTokens())
+            {
+                labels.emplace_back(token.label());
+            }
+            AssertThat(labels, Equals(std::vector<OTPToken::Label>{"a", "b", "c", "d", "e"}));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("a")).secret(), Equals("XYZA123456KDDK83D"));
+        });
+
+        it("[duplicateSecrets]", [&]{
+            // rows of migrated databases get their hashes on the first lookup
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            auto image = readImage();
+            AssertThat(sqlite3_exec(image, "update tokens set secret_hash = null;", nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+            writeImage(image);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            // secrets are compared decoded, case, spacing and padding don't matter
+            AssertThat(TokenDatabase::tokensWithSecret("abcd 1234 56kd dk83d=="), Equals(std::vector<OTPToken::sqliteTokenID>{
+                TokenDatabase::tokenId(OTPToken::Label("b"))}));
+            AssertThat(TokenDatabase::tokensWithSecret("MNOP123456KDDK83D").empty(), IsTrue());
+            AssertThat(TokenDatabase::tokensWithSecret("").empty(), IsTrue());
+
+            // duplicates within the same call are found as well
+            std::vector<TokenDatabase::Error> results;
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "b2", {}, "ABCD123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "d", {}, "MNOP123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "d2", {}, "mnop123456kddk83d"),
+            }, &results, TokenDatabase::SkipDuplicates), Equals(TokenDatabase::Success));
+            AssertThat(results, Equals(std::vector<TokenDatabase::Error>{
+                TokenDatabase::DuplicateSecret, TokenDatabase::Success, TokenDatabase::DuplicateSecret}));
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+
+            // replacing updates the oldest token with the secret in place
+            const auto order = TokenDatabase::displayOrder();
+            const auto id = TokenDatabase::tokenId(OTPToken::Label("c"));
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::HOTP, "c2", {}, "EFGH123456KDDK83D"),
+            }, &results, TokenDatabase::ReplaceDuplicates), Equals(TokenDatabase::Success));
+            AssertThat(results, Equals(std::vector<TokenDatabase::Error>{TokenDatabase::Success}));
+            AssertThat(TokenDatabase::tokenId(OTPToken::Label("c2")), Equals(id));
+            AssertThat(TokenDatabase::selectToken(id).type(), Equals(OTPToken::HOTP));
+            AssertThat(TokenDatabase::displayOrder(), Equals(order));
+
+            // duplicates are kept by default, the hashes follow a new password
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "e", {}, "ABCD123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::changePassword("otpgen-tests-2"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokensWithSecret("ABCD123456KDDK83D"), Equals(std::vector<OTPToken::sqliteTokenID>{
+                TokenDatabase::tokenId(OTPToken::Label("b")), TokenDatabase::tokenId(OTPToken::Label("e"))}));
+        });
+
+        it("[constraint results]", [&]{
+            // taken labels fail row by row, the statement is reused for the rows after them
+            std::vector<TokenDatabase::Error> results;
+            TokenDatabase::OTPTokenList tokens;
+            for (auto i = 0; i < 20; ++i)
+            {
+                tokens.emplace_back(OTPToken(OTPToken::TOTP, i % 2 ? "B" : "x" + std::to_string(i), {}, "IJKL123456KDDK83D"));
+            }
+            AssertThat(TokenDatabase::insertTokens(tokens, &results), Equals(TokenDatabase::Success));
+            AssertThat(std::count(results.begin(), results.end(), TokenDatabase::SqlConstraintViolation), Equals(10));
+            AssertThat(std::count(results.begin(), results.end(), TokenDatabase::Success), Equals(10));
+            AssertThat(TokenDatabase::tokenCount(), Equals(13));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("x18")).secret(), Equals("IJKL123456KDDK83D"));
+            AssertThat(TokenDatabase::tokensWithSecret("IJKL123456KDDK83D").size(), Equals(10U));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("x19")).label().empty(), IsTrue());
+        });
+
+        it("[provisioning]", [&]{
+            // 20 bytes are 32 base-32 characters without padding
+            ThreadPool pool(2U);
+            std::vector<SecureString> secrets;
+            Provisioning::generateSecrets(600U, 20U, secrets, &pool);
+            AssertThat(secrets.size(), Equals(600U));
+            for (auto&& secret : secrets)
+            {
+                AssertThat(secret.size(), Equals(32U));
+            }
+            std::sort(secrets.begin(), secrets.end());
+            AssertThat(std::adjacent_find(secrets.begin(), secrets.end()) == secrets.end(), IsTrue());
+
+            Provisioning::Request request(OTPToken(OTPToken::HOTP));
+            request.labels = {"p1", "b", "p2"};
+            std::vector<SecureString> uris;
+            std::vector<TokenDatabase::Error> results;
+            AssertThat(Provisioning::provision(request, uris, &results, &pool), Equals(TokenDatabase::Success));
+            AssertThat(results, Equals(std::vector<TokenDatabase::Error>{
+                TokenDatabase::Success, TokenDatabase::SqlConstraintViolation, TokenDatabase::Success}));
+            AssertThat(uris.size(), Equals(3U));
+            AssertThat(uris[1].empty(), IsTrue());
+
+            const otpauthURI uri(uris[2]);
+            AssertThat(uri.valid(), IsTrue());
+            const auto token = TokenDatabase::selectToken(OTPToken::Label("p2"));
+            AssertThat(token.type(), Equals(OTPToken::HOTP));
+            AssertThat(token.secret(), Equals(uri.secret()));
+            AssertThat(TokenDatabase::tokenCount(), Equals(5));
+
+            request.secretSize = 5U;
+            AssertThat(Provisioning::provision(request, uris), Equals(TokenDatabase::InvalidArgument));
+        });
+
+        it("[steam time offset]", [&]{
+            // the request takes 4 seconds, the offset is measured against its middle
+            FixedClock clock(1536573860);
+            SteamTimeService service([&](std::time_t &serverTime) {
+                clock.advance(4);
+                serverTime = 1536573900;
+                return true;
+            }, &clock);
+            std::time_t offset = 0, measured = 0;
+            AssertThat(TokenDatabase::selectSteamTimeOffset(offset, measured), Equals(TokenDatabase::SqlEmptyResults));
+            AssertThat(service.load(), IsFalse());
+            AssertThat(service.query(), IsTrue());
+            AssertThat(service.offset(), Equals(38));
+            AssertThat(service.measured(), Equals(1536573864));
+            AssertThat(Clock::steamOffset(), Equals(38));
+
+            // steam codes of tokens follow the offset, the prepared key computes at the given time
+            const auto token = OTPToken(OTPToken::Steam, "s", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M");
+            AssertThat(token.generateToken(1536573862), Equals(OTPGen::computeSteam(1536573900, "ABC30WAY33X57CCBU3EAXGDDMX35S39M")));
+            AssertThat(token.secondsUntilRotation(1536573862), Equals(30U));
+
+            // cached across restarts of the vault
+            Clock::setSteamOffset(0);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            SteamTimeService cached([](std::time_t&) { return false; }, &clock);
+            AssertThat(cached.load(), IsTrue());
+            AssertThat(cached.offset(), Equals(38));
+            AssertThat(Clock::steamOffset(), Equals(38));
+            AssertThat(cached.query(), IsFalse());
+            AssertThat(Clock::steamOffset(), Equals(38));
+            Clock::setSteamOffset(0);
+        });
+
+        it("[tokenCount]", [&]{
+            // counts per type follow inserts, type changes and deletes
+            const auto totp = TokenDatabase::tokenCount(OTPToken::TOTP);
+            const auto hotp = TokenDatabase::tokenCount(OTPToken::HOTP);
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+            AssertThat(totp + hotp + TokenDatabase::tokenCount(OTPToken::Steam), Equals(3));
+
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "A", {}, "MNOP123456KDDK83D"),
+            }), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(OTPToken::TOTP), Equals(totp + 1));
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+
+            auto token = TokenDatabase::selectToken(OTPToken::Label("d"));
+            token.setType(OTPToken::HOTP);
+            AssertThat(TokenDatabase::updateToken(token.id(), token), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(OTPToken::TOTP), Equals(totp));
+            AssertThat(TokenDatabase::tokenCount(OTPToken::HOTP), Equals(hotp + 1));
+
+            AssertThat(TokenDatabase::deleteToken(token.id()), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::deleteToken(token.id()), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(OTPToken::HOTP), Equals(hotp));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+
+            // counted again on load, nothing to count while closed
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::Steam, "s", {}, "UVWX123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::tokenCount(), Equals(0));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+            AssertThat(TokenDatabase::tokenCount(OTPToken::HOTP), Equals(hotp));
+        });
+
+        it("[searchTokens]", [&]{
+            const auto search = [](const std::string &text) {
+                TokenDatabase::OTPTokenList tokens;
+                AssertThat(TokenDatabase::searchTokens(text, 10, tokens), Equals(TokenDatabase::Success));
+                std::vector<OTPToken::Label> labels;
+                for (auto&& token : tokens)
+                {
+                    labels.emplace_back(token.label());
+                }
+                return labels;
+            };
+
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "GitHub: alice", {}, "IJKL123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "Google Mail", {}, "MNOP123456KDDK83D"),
+                OTPToken(OTPToken::HOTP, "gitlab (work)", {}, "QRST123456KDDK83D"),
+            }), Equals(TokenDatabase::Success));
+
+            // words match by prefix and case insensitive, query syntax is plain text
+            AssertThat(search("git"), Equals(std::vector<OTPToken::Label>{"GitHub: alice", "gitlab (work)"}));
+            AssertThat(search("ma goo"), Equals(std::vector<OTPToken::Label>{"Google Mail"}));
+            AssertThat(search("WORK"), Equals(std::vector<OTPToken::Label>{"gitlab (work)"}));
+            AssertThat(search("\"git* OR"), Equals(std::vector<OTPToken::Label>{}));
+            AssertThat(search(" : "), Equals(std::vector<OTPToken::Label>{}));
+
+            // renames and deletes update the index
+            AssertThat(TokenDatabase::renameToken(TokenDatabase::tokenId(OTPToken::Label("Google Mail")), "Gmail"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::deleteToken(TokenDatabase::tokenId(OTPToken::Label("gitlab (work)"))), Equals(TokenDatabase::Success));
+            // shorter labels rank higher
+            AssertThat(search("g"), Equals(std::vector<OTPToken::Label>{"Gmail", "GitHub: alice"}));
+            AssertThat(search("mail"), Equals(std::vector<OTPToken::Label>{}));
+
+            // the index is saved with the database and copied into page encrypted files
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(search("alice"), Equals(std::vector<OTPToken::Label>{"GitHub: alice"}));
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(search("gmail"), Equals(std::vector<OTPToken::Label>{"Gmail"}));
+        });
+
+        it("[secretColumn]", [&]{
+            const auto secret = [](const char *label) {
+                return std::string(TokenDatabase::selectToken(OTPToken::Label(label)).secret().c_str());
+            };
+
+            // the image holds neither the secrets nor their mangled form, the same secret is stored differently
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {}, "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            auto image = readImage();
+            std::vector<std::string> values;
+            sqlite3_stmt *select = nullptr;
+            sqlite3_prepare_v2(image, "select typeof(secret), secret from tokens where label in ('a', 'd');", -1, &select, nullptr);
+            while (sqlite3_step(select) == SQLITE_ROW)
+            {
+                AssertThat(std::string(reinterpret_cast<const char*>(sqlite3_column_text(select, 0))), Equals("blob"));
+                values.emplace_back(static_cast<const char*>(sqlite3_column_blob(select, 1)), static_cast<std::size_t>(sqlite3_column_bytes(select, 1)));
+                AssertThat(values.back().find("123456KDDK83D"), Equals(std::string::npos));
+                AssertThat(values.back().find("D38KDDK654321"), Equals(std::string::npos));
+            }
+            sqlite3_finalize(select);
+            sqlite3_close(image);
+            AssertThat(values.size(), Equals(2U));
+            AssertThat(values.at(0) == values.at(1), IsFalse());
+
+            // a new password re-encrypts the secrets, readers keep the key of their image
+            auto reader = TokenDatabase::reader();
+            AssertThat(TokenDatabase::changePassword("otpgen-tests-2"), Equals(TokenDatabase::Success));
+            AssertThat(std::string(reader.selectToken(OTPToken::Label("a")).secret().c_str()), Equals("XYZA123456KDDK83D"));
+            AssertThat(secret("b"), Equals("ABCD123456KDDK83D"));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(secret("b"), Equals("ABCD123456KDDK83D"));
+
+            // the open database keeps its key until it is written with the new password
+            TokenDatabase::setPassword("otpgen-tests");
+            AssertThat(secret("c"), Equals("EFGH123456KDDK83D"));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(secret("c"), Equals("EFGH123456KDDK83D"));
+
+            // page encrypted files are copied with the key of the new password
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::changePassword("otpgen-tests-2"), Equals(TokenDatabase::Success));
+            AssertThat(secret("a"), Equals("XYZA123456KDDK83D"));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(secret("a"), Equals("XYZA123456KDDK83D"));
+            AssertThat(secret("d"), Equals("XYZA123456KDDK83D"));
+        });
+
+        it("[changePasswordAsync]", [&]{
+            const auto secret = [](const char *label) {
+                return std::string(TokenDatabase::selectToken(OTPToken::Label(label)).secret().c_str());
+            };
+            const auto change = [](const std::string &password, const TokenDatabase::ProgressCallback &progress,
+                                   const std::atomic<bool> *cancel) {
+                std::promise<TokenDatabase::Error> result;
+                TokenDatabase::changePasswordAsync(password, [&](const TokenDatabase::Error &status) {
+                    result.set_value(status);
+                }, progress, cancel);
+                return result.get_future().get();
+            };
+
+            // a cancelled change leaves the file and the password alone
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            std::atomic<bool> cancel{true};
+            AssertThat(change("otpgen-tests-2", {}, &cancel), Equals(TokenDatabase::OperationCancelled));
+            AssertThat(change("", {}, nullptr), Equals(TokenDatabase::PasswordEmpty));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(secret("a"), Equals("XYZA123456KDDK83D"));
+
+            // the chunks are reported while they are encrypted, changes meanwhile restart the pass
+            std::atomic<bool> inserted{false};
+            std::size_t done = 0, total = 0;
+            AssertThat(change("otpgen-tests-2", [&](std::size_t chunk, std::size_t chunks) {
+                if (!inserted.exchange(true))
+                {
+                    AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {}, "MNOP123456KDDK83D")), Equals(TokenDatabase::Success));
+                }
+                done = chunk;
+                total = chunks;
+            }, nullptr), Equals(TokenDatabase::Success));
+            AssertThat(total, IsGreaterThan(0U));
+            AssertThat(done, Equals(total));
+            AssertThat(secret("d"), Equals("MNOP123456KDDK83D"));
+
+            // the file is encrypted with the new password only
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setPassword("otpgen-tests");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+            TokenDatabase::setPassword("otpgen-tests-2");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(secret("b"), Equals("ABCD123456KDDK83D"));
+            AssertThat(secret("d"), Equals("MNOP123456KDDK83D"));
+            AssertThat(TokenDatabase::tokensWithSecret("EFGH123456KDDK83D"), Equals(std::vector<OTPToken::sqliteTokenID>{
+                TokenDatabase::tokenId(OTPToken::Label("c"))}));
+        });
+
+        it("[tokenGroups]", [&]{
+            const auto labels = [](const TokenDatabase::OTPTokenList &tokens) {
+                std::vector<OTPToken::Label> list;
+                for (auto&& token : tokens)
+                {
+                    list.emplace_back(token.label());
+                }
+                return list;
+            };
+            const auto group = [&](const TokenDatabase::TokenFilter &filter) {
+                TokenDatabase::OTPTokenList tokens;
+                AssertThat(TokenDatabase::selectGroup(filter, tokens), Equals(TokenDatabase::Success));
+                return labels(tokens);
+            };
+            TokenDatabase::TokenFilter github, work;
+            github.issuer = "github";
+            work.tag = "Work";
+
+            OTPToken d(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D");
+            d.setIssuer("GitHub");
+            d.setTags({"work", "code"});
+            OTPToken e(OTPToken::HOTP, "e", {}, "MNOP123456KDDK83D");
+            e.setIssuer("GitHub");
+            OTPToken f(OTPToken::TOTP, "f", {}, "QRST123456KDDK83D");
+            f.setTags({"work"});
+            AssertThat(TokenDatabase::insertTokens({d, e, f}), Equals(TokenDatabase::Success));
+
+            // issuer and tags are stored with the token and compare case insensitive
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("d")) == d, IsTrue());
+            AssertThat(group(github), Equals(std::vector<OTPToken::Label>{"d", "e"}));
+            AssertThat(group(work), Equals(std::vector<OTPToken::Label>{"d", "f"}));
+            AssertThat(TokenDatabase::issuers(), Equals(std::vector<OTPToken::Issuer>{"GitHub"}));
+            AssertThat(TokenDatabase::tags(), Equals(std::vector<std::string>{"code", "work"}));
+
+            // codes of one group in a single batch
+            TokenSet set;
+            AssertThat(TokenDatabase::selectGroupSet(github, set), Equals(TokenDatabase::Success));
+            AssertThat(set.size(), Equals(2U));
+            std::vector<OTPToken::TokenString> codes;
+            set.computeCodes(1536573862, codes);
+            AssertThat(codes.at(0), Equals(OTPGen::computeTOTP(1536573862, "IJKL123456KDDK83D", 6, 30, OTPToken::SHA1)));
+
+            // updates replace the tags, pages select them on request
+            auto updated = TokenDatabase::selectToken(OTPToken::Label("f"));
+            updated.setTags({"home"});
+            AssertThat(TokenDatabase::updateToken(updated.id(), updated), Equals(TokenDatabase::Success));
+            AssertThat(group(work), Equals(std::vector<OTPToken::Label>{"d"}));
+            TokenDatabase::TokenPage page;
+            AssertThat(TokenDatabase::selectTokens({}, TokenDatabase::TagColumn, TokenDatabase::FirstPage, 10U, page), Equals(TokenDatabase::Success));
+            AssertThat(page.tokens.back().tags(), Equals(OTPToken::Tags{"home"}));
+            AssertThat(page.tokens.back().label().empty(), IsTrue());
+
+            // moves keep the order within the group
+            AssertThat(TokenDatabase::moveGroup(github, 0), Equals(TokenDatabase::Success));
+            AssertThat(labels(TokenDatabase::selectTokens()), Equals(std::vector<OTPToken::Label>{"d", "e", "a", "b", "c", "f"}));
+            AssertThat(TokenDatabase::moveGroup(github, 10), Equals(TokenDatabase::Success));
+            AssertThat(labels(TokenDatabase::selectTokens()), Equals(std::vector<OTPToken::Label>{"a", "b", "c", "f", "d", "e"}));
+
+            // groups are saved, deletes take the tags along and refuse empty filters
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(group(github), Equals(std::vector<OTPToken::Label>{"d", "e"}));
+            std::size_t deleted = 0U;
+            AssertThat(TokenDatabase::deleteGroup({}, &deleted), Equals(TokenDatabase::EmptyFilter));
+            AssertThat(TokenDatabase::moveGroup({}, 0), Equals(TokenDatabase::EmptyFilter));
+            AssertThat(TokenDatabase::deleteGroup(github, &deleted), Equals(TokenDatabase::Success));
+            AssertThat(deleted, Equals(2U));
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+            AssertThat(TokenDatabase::tags(), Equals(std::vector<std::string>{"home"}));
+            AssertThat(TokenDatabase::moveGroup(github, 0), Equals(TokenDatabase::SqlEmptyResults));
+        });
+
+        it("[selectIcon]", [&]{
+            auto token = TokenDatabase::selectToken(OTPToken::Label("a"));
+            token.setIcon({0x89, 0x50, 0x4e, 0x47});
+            AssertThat(TokenDatabase::updateToken(token.id(), token), Equals(TokenDatabase::Success));
+
+            const auto with_icons = TokenDatabase::selectTokens();
+            AssertThat(with_icons.at(0).icon(), Equals(OTPToken::Icon{0x89, 0x50, 0x4e, 0x47}));
+
+            const auto without_icons = TokenDatabase::selectTokens(OTPToken::None, false);
+            AssertThat(without_icons.size(), Equals(3U));
+            AssertThat(without_icons.at(0).icon().empty(), Equals(true));
+            AssertThat(without_icons.at(0).secret(), Equals("XYZA123456KDDK83D"));
+
+            AssertThat(TokenDatabase::selectIcon(token.id()), Equals(OTPToken::Icon{0x89, 0x50, 0x4e, 0x47}));
+
+            // cached icons follow updates
+            token.setIcon({0x01});
+            AssertThat(TokenDatabase::updateToken(token.id(), token), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectIcon(token.id()), Equals(OTPToken::Icon{0x01}));
+            AssertThat(TokenDatabase::selectIcon(without_icons.at(1).id()).empty(), Equals(true));
+        });
+
+        it("[iconThumbnails]", [&]{
+            // the fake thumbnail is the size followed by the first byte of the icon
+            auto scaled = 0U;
+            TokenDatabase::setIconScaler([&](const OTPToken::Icon &icon, unsigned size) {
+                ++scaled;
+                return size == 48U ? OTPToken::Icon() : OTPToken::Icon{static_cast<unsigned char>(size), icon.at(0)};
+            }, {32U, 16U, 48U, 16U});
+
+            const OTPToken::Icon icon(4096U, 0x42);
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "d", icon, "IJKL123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "e", icon, "MNOP123456KDDK83D"),
+            }), Equals(TokenDatabase::Success));
+            const auto d = TokenDatabase::tokenId(OTPToken::Label("d"));
+            const auto e = TokenDatabase::tokenId(OTPToken::Label("e"));
+
+            // every size once per stored icon, empty thumbnails are left out
+            AssertThat(scaled, Equals(3U));
+            AssertThat(TokenDatabase::selectIconThumbnail(d, 16U), Equals(OTPToken::Icon{16, 0x42}));
+            AssertThat(TokenDatabase::selectIconThumbnail(e, 32U), Equals(OTPToken::Icon{32, 0x42}));
+            AssertThat(TokenDatabase::selectIconThumbnail(e, 48U).empty(), IsTrue());
+
+            // icons stored without the scaler get their thumbnails from the frontend
+            const auto a = TokenDatabase::tokenId(OTPToken::Label("a"));
+            AssertThat(TokenDatabase::storeIconThumbnail(a, 16U, {1}), Equals(TokenDatabase::SqlEmptyResults));
+            TokenDatabase::setIconScaler({}, {});
+            auto token = TokenDatabase::selectToken(a);
+            token.setIcon({0x89, 0x50, 0x4e, 0x47});
+            AssertThat(TokenDatabase::updateToken(a, token), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectIconThumbnail(a, 16U).empty(), IsTrue());
+            AssertThat(TokenDatabase::storeIconThumbnail(a, 16U, {16, 0x89}), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectIconThumbnail(a, 16U), Equals(OTPToken::Icon{16, 0x89}));
+
+            // saved with the icons, thumbnails of removed icons are removed with them
+            AssertThat(TokenDatabase::deleteToken(d), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::deleteToken(e), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectIconThumbnail(a, 16U), Equals(OTPToken::Icon{16, 0x89}));
+            auto image = readImage();
+            sqlite3_stmt *count = nullptr;
+            sqlite3_prepare_v2(image, "select count(*) from icon_thumbnails;", -1, &count, nullptr);
+            AssertThat(sqlite3_step(count), Equals(SQLITE_ROW));
+            AssertThat(sqlite3_column_int(count, 0), Equals(1));
+            sqlite3_finalize(count);
+            sqlite3_close(image);
+        });
+
+        it("[iconStore]", [&]{
+            // tokens share the stored icon
+            const OTPToken::Icon icon(4096U, 0x42);
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "d", icon, "IJKL123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "e", icon, "MNOP123456KDDK83D"),
+            }), Equals(TokenDatabase::Success));
+
+            auto d = TokenDatabase::selectToken(OTPToken::Label("d"));
+            AssertThat(d.icon(), Equals(icon));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("e")).icon(), Equals(icon));
+
+            // tokens of one select share the buffer of the same icon, copies share it as well
+            const auto tokens = TokenDatabase::selectTokens();
+            AssertThat(tokens.at(3).sharedIcon().shares(tokens.at(4).sharedIcon()), IsTrue());
+            const auto copy = tokens.at(3);
+            AssertThat(copy.sharedIcon().shares(tokens.at(3).sharedIcon()), IsTrue());
+            AssertThat(copy == tokens.at(3), IsTrue());
+            AssertThat(d.sharedIcon() == tokens.at(3).sharedIcon(), IsTrue());
+            AssertThat(d.sharedIcon() == OTPToken::SharedIcon(OTPToken::Icon(4096U, 0x43)), IsFalse());
+            AssertThat(TokenDatabase::selectSharedIcon(d.id()).shares(TokenDatabase::selectSharedIcon(d.id())), IsTrue());
+            AssertThat(TokenDatabase::selectIcon(d.id()), Equals(icon));
+
+            // changing one token keeps the icon of the other
+            d.setIcon({});
+            AssertThat(TokenDatabase::updateToken(d.id(), d), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("d")).icon().empty(), Equals(true));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("e")).icon(), Equals(icon));
+            AssertThat(TokenDatabase::selectTokens().at(4).icon(), Equals(icon));
+        });
+
+        it("[encryptedPages]", [&]{
+            const auto labels = [] {
+                std::vector<OTPToken::Label> list;
+                for (auto&& token : TokenDatabase::selectTokens())
+                {
+                    list.emplace_back(token.label());
+                }
+                return list;
+            };
+
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedImage);
+
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "paged-label", {}, "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "b", {}, "ABCD123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+
+            // unsaved changes are discarded
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "c", {}, "EFGH123456KDDK83D")), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"paged-label", "b"}));
+
+            AssertThat(TokenDatabase::moveToken("b", 0), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"b", "paged-label"}));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("paged-label")).secret(), Equals("XYZA123456KDDK83D"));
+
+            // nothing is stored in plain text
+            {
+                std::ifstream stream(file, std::ios::in | std::ios::binary);
+                const std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+                AssertThat(content.size() % 4096, Equals(0U));
+                AssertThat(content.find("paged-label"), Equals(std::string::npos));
+                AssertThat(content.find("SQLite format 3"), Equals(std::string::npos));
+            }
+
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setPassword("wrong");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+
+            // the file is rewritten with the key of the new password
+            TokenDatabase::setPassword("otpgen-tests");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::changePassword("otpgen-tests-2"), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setPassword("otpgen-tests");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+            TokenDatabase::setPassword("otpgen-tests-2");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"b", "paged-label"}));
+        });
+
+        it("[convertToPages]", [&]{
+            auto token = TokenDatabase::selectToken(OTPToken::Label("a"));
+            token.setIcon({0x89, 0x50, 0x4e, 0x47});
+            AssertThat(TokenDatabase::updateToken(token.id(), token), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveToken("c", 0), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+
+            // the image is loaded as before and converted on save
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(std::filesystem::file_size(file) % 4096, Equals(0U));
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedImage);
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            std::vector<OTPToken::Label> labels;
+            for (auto&& t : TokenDatabase::selectTokens())
+            {
+                labels.emplace_back(t.label());
+            }
+            AssertThat(labels, Equals(std::vector<OTPToken::Label>{"c", "a", "b"}));
+            AssertThat(TokenDatabase::selectIcon(token.id()), Equals(OTPToken::Icon{0x89, 0x50, 0x4e, 0x47}));
+
+            // paged databases stay paged
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "D", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::SqlConstraintViolation));
+        });
+
+        it("[durability]", [&]{
+            const auto contents = [&]{
+                std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+                return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+            };
+
+            // saves are only written on flush
+            TokenDatabase::setDurability(TokenDatabase::OnExit);
+            const auto initial = contents();
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(contents() == initial, Equals(true));
+            AssertThat(TokenDatabase::flushTokens(), Equals(TokenDatabase::Success));
+            AssertThat(contents() == initial, Equals(false));
+
+            // the first save after a write goes to disk, the ones within the window after it are deferred
+            TokenDatabase::setDurability(TokenDatabase::GroupCommit, std::chrono::hours(1));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto grouped = contents();
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "e", {}, "MNOP123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(contents() == grouped, Equals(true));
+
+            // closing writes deferred saves, no temporary file is left behind
+            TokenDatabase::closeDatabase();
+            AssertThat(std::filesystem::exists(file + ".tmp"), Equals(false));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(5));
+        });
+
+        it("[autoSave]", [&]{
+            const auto contents = [&]{
+                std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+                return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+            };
+
+            // changes are tracked without auto save as well
+            AssertThat(TokenDatabase::hasUnsavedChanges(), Equals(true));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::hasUnsavedChanges(), Equals(false));
+
+            // a series of changes is written once by the background thread
+            TokenDatabase::setAutoSave(std::chrono::milliseconds(50));
+            const auto initial = contents();
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveToken("d", 0), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::hasUnsavedChanges(), Equals(true));
+            for (auto i = 0; i < 100 && TokenDatabase::hasUnsavedChanges(); ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            AssertThat(TokenDatabase::hasUnsavedChanges(), Equals(false));
+            AssertThat(contents() == initial, Equals(false));
+
+            // closing writes the scheduled save right away
+            TokenDatabase::setAutoSave(std::chrono::hours(1));
+            AssertThat(TokenDatabase::deleteToken(TokenDatabase::tokenId("a")), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::hasUnsavedChanges(), Equals(false));
+
+            std::vector<OTPToken::Label> labels;
+            for (auto&& t : TokenDatabase::selectTokens())
+            {
+                labels.emplace_back(t.label());
+            }
+            AssertThat(labels, Equals(std::vector<OTPToken::Label>{"d", "b", "c"}));
+
+            // the signal handlers close without writing the scheduled save
+            AssertThat(TokenDatabase::deleteToken(TokenDatabase::tokenId("d")), Equals(TokenDatabase::Success));
+            TokenDatabase::discardDatabase();
+            AssertThat(TokenDatabase::databaseConnected(), Equals(false));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenId("d") != 0, Equals(true));
+        });
+
+        it("[imageContainer]", [&]{
+            // icons larger than a chunk, the image is split into several chunks
+            const OTPToken::Icon icon(1536 * 1024, 0x42);
+            auto token = TokenDatabase::selectToken(OTPToken::Label("a"));
+            token.setIcon(icon);
+            AssertThat(TokenDatabase::updateToken(token.id(), token), Equals(TokenDatabase::Success));
+            token = TokenDatabase::selectToken(OTPToken::Label("b"));
+            token.setIcon(OTPToken::Icon(icon.size(), 0x43));
+            AssertThat(TokenDatabase::updateToken(token.id(), token), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+
+            std::string contents;
+            {
+                std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+                contents.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+            }
+            AssertThat(contents.substr(0, 4), Equals("OTPC"));
+            AssertThat(contents.size(), IsGreaterThan(2U * icon.size()));
+
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectIcon(TokenDatabase::tokenId("a")), Equals(icon));
+            AssertThat(TokenDatabase::selectIcon(TokenDatabase::tokenId("b")), Equals(OTPToken::Icon(icon.size(), 0x43)));
+            TokenDatabase::closeDatabase();
+
+            // every chunk is authenticated
+            const auto modify = [&](std::size_t offset) {
+                auto modified = contents;
+                modified[offset] ^= 0x01;
+                std::ofstream stream(file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+                stream.write(modified.data(), static_cast<std::streamsize>(modified.size()));
+            };
+            for (auto&& offset : {std::size_t(20), contents.size() / 2, contents.size() - 1})
+            {
+                modify(offset);
+                AssertThat(TokenDatabase::loadTokens(), !Equals(TokenDatabase::Success));
+            }
+
+            // without the magic the file is read as former image and rejected
+            modify(0U);
+            AssertThat(TokenDatabase::loadTokens(), !Equals(TokenDatabase::Success));
+
+            // wrong password
+            {
+                std::ofstream stream(file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+                stream.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+            }
+            TokenDatabase::setPassword("wrong");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+            TokenDatabase::setPassword("otpgen-tests");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+        });
+
+        it("[keyDerivation]", [&]{
+            const auto header = [&]{
+                std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+                std::string bytes(48, '\0');
+                stream.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+                return bytes;
+            };
+
+            // the stretched key is cached, further saves keep the salt and use a new nonce prefix
+            TokenDatabase::setKeyDerivation(TokenDatabase::Scrypt, 10);
+            AssertThat(TokenDatabase::keyDerivation(), Equals(TokenDatabase::Scrypt));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto first = header();
+            AssertThat(static_cast<int>(first[6]), Equals(1));
+            AssertThat(static_cast<int>(first[7]), Equals(10));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto second = header();
+            AssertThat(second.substr(24, 16), Equals(first.substr(24, 16)));
+            AssertThat(second.substr(40, 8) == first.substr(40, 8), Equals(false));
+
+            // the parameters are read from the file
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setKeyDerivation(TokenDatabase::PasswordHash);
+            TokenDatabase::setPassword("otpgen-tests");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setPassword("wrong");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+
+            // a new password gets a new salt
+            TokenDatabase::setPassword("otpgen-tests");
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::setKeyDerivation(TokenDatabase::Scrypt, 10);
+            AssertThat(TokenDatabase::changePassword("otpgen-tests-2"), Equals(TokenDatabase::Success));
+            AssertThat(header().substr(24, 16) == first.substr(24, 16), Equals(false));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+        });
+
+        it("[sessionKey]", [&]{
+            // the session key holds neither the password nor the secrets and replaces the password
+            TokenDatabase::setKeyDerivation(TokenDatabase::Scrypt, 10);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto wrapping = TokenDatabase::sessionWrappingKey();
+            AssertThat(wrapping.size(), Equals(TokenDatabase::SessionWrappingKeySize));
+            SecureString session;
+            AssertThat(TokenDatabase::sessionKey(std::chrono::hours(1), wrapping, session), Equals(TokenDatabase::Success));
+            AssertThat(std::string(session.c_str()).find("otpgen-tests"), Equals(std::string::npos));
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setPassword("wrong");
+            AssertThat(TokenDatabase::unlockWithSessionKey(session, wrapping), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(std::string(TokenDatabase::selectToken(OTPToken::Label("a")).secret().c_str()), Equals("XYZA123456KDDK83D"));
+
+            // saves keep the salt, modified, expired and outdated keys are rejected without changing the password
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::unlockWithSessionKey(session, wrapping), Equals(TokenDatabase::Success));
+            auto modified = session;
+            modified[10] = modified[10] == 'A' ? 'B' : 'A';
+            AssertThat(TokenDatabase::unlockWithSessionKey(modified, wrapping), Equals(TokenDatabase::SessionKeyInvalid));
+            AssertThat(TokenDatabase::unlockWithSessionKey(SecureString("b3RwZ2Vu"), wrapping), Equals(TokenDatabase::SessionKeyInvalid));
+            SecureString expired;
+            AssertThat(TokenDatabase::sessionKey(std::chrono::seconds(0), wrapping, expired), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::unlockWithSessionKey(expired, wrapping), Equals(TokenDatabase::SessionKeyExpired));
+
+            // without the wrapping key neither the keys nor the expiry can be used or rewritten
+            AssertThat(TokenDatabase::unlockWithSessionKey(session, TokenDatabase::sessionWrappingKey()), Equals(TokenDatabase::SessionKeyInvalid));
+            AssertThat(TokenDatabase::unlockWithSessionKey(expired, TokenDatabase::sessionWrappingKey()), Equals(TokenDatabase::SessionKeyInvalid));
+            AssertThat(TokenDatabase::unlockWithSessionKey(session, SecureBuffer()), Equals(TokenDatabase::SessionKeyInvalid));
+
+            AssertThat(TokenDatabase::changePassword("otpgen-tests-2"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::unlockWithSessionKey(session, wrapping), Equals(TokenDatabase::SessionKeyInvalid));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            // page encrypted files are bound to the salt of the file
+            TokenDatabase::setKeyDerivation(TokenDatabase::PasswordHash);
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::sessionKey(std::chrono::hours(1), wrapping, session), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setPassword("wrong");
+            AssertThat(TokenDatabase::unlockWithSessionKey(session, wrapping), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+        });
+
+        it("[compression]", [&]{
+            // an icon spanning several frames
+            OTPToken::Icon icon(3 * 1024 * 1024);
+            for (auto i = 0U; i < icon.size(); ++i)
+            {
+                icon[i] = static_cast<unsigned char>((i / 64) % 7);
+            }
+            auto token = OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D");
+            token.setIcon(icon);
+            AssertThat(TokenDatabase::insertToken(token), Equals(TokenDatabase::Success));
+
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto uncompressed = std::filesystem::file_size(file);
+            TokenDatabase::setCompression(TokenDatabase::Zlib);
+            AssertThat(TokenDatabase::compression(), Equals(TokenDatabase::Zlib));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(std::filesystem::file_size(file) * 10 < uncompressed, Equals(true));
+
+            std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+            std::string header(48, '\0');
+            stream.read(&header[0], static_cast<std::streamsize>(header.size()));
+            stream.close();
+            AssertThat(static_cast<int>(header[10]), Equals(1));
+
+            // compressed images are loaded regardless of the setting
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setCompression(TokenDatabase::Uncompressed);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("d")).icon(), Equals(icon));
+        });
+
+        it("[compaction]", [&]{
+            // free pages of deleted tokens are not written
+            TokenDatabase::setCompactionThreshold(0.0);
+            for (auto i = 0; i < 16; ++i)
+            {
+                auto token = OTPToken(OTPToken::TOTP, "icon" + std::to_string(i), {}, "IJKL123456KDDK83D");
+                token.setIcon(OTPToken::Icon(64 * 1024, static_cast<unsigned char>(i)));
+                AssertThat(TokenDatabase::insertToken(token), Equals(TokenDatabase::Success));
+            }
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto full = std::filesystem::file_size(file);
+            for (auto i = 0; i < 16; ++i)
+            {
+                const auto id = TokenDatabase::tokenId(OTPToken::Label("icon" + std::to_string(i)));
+                AssertThat(TokenDatabase::deleteToken(id), Equals(TokenDatabase::Success));
+            }
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(std::filesystem::file_size(file), Equals(full));
+            TokenDatabase::Inspection inspection;
+            AssertThat(TokenDatabase::inspect(inspection), Equals(TokenDatabase::Success));
+            AssertThat(inspection.compactionSavings(), IsGreaterThanOrEqualTo(inspection.freePages * inspection.pageSize));
+            AssertThat(inspection.compactionSavings() * 10 > full * 9, Equals(true));
+            TokenDatabase::setCompactionThreshold(0.25);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto compacted = std::filesystem::file_size(file);
+            AssertThat(compacted * 10 < full, Equals(true));
+
+            // the slack in the pages of a freshly vacuumed database isn't counted as savings
+            AssertThat(TokenDatabase::inspect(inspection), Equals(TokenDatabase::Success));
+            AssertThat(inspection.freePages, Equals(0U));
+            AssertThat(inspection.compactionSavings(), Equals(0U));
+
+            // the page size is changed by the next write
+            AssertThat(TokenDatabase::setPageSize(1000), Equals(false));
+            AssertThat(TokenDatabase::setPageSize(65536), Equals(true));
+            AssertThat(TokenDatabase::pageSize(), Equals(65536U));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(std::filesystem::file_size(file) > compacted * 4, Equals(true));
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("a")).secret(), Equals("XYZA123456KDDK83D"));
+        });
+
+        it("[forEachToken]", [&]{
+            std::vector<OTPToken::Label> labels;
+            AssertThat(TokenDatabase::forEachToken(OTPToken::TOTP, [&](const OTPToken &token) {
+                labels.emplace_back(token.label());
+            }), Equals(TokenDatabase::Success));
+            AssertThat(labels, Equals(std::vector<OTPToken::Label>{"a", "c"}));
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::forEachToken(OTPToken::None, [&](const OTPToken&) {}),
+                       Equals(TokenDatabase::SqlDatabaseNotOpen));
+        });
+
+        it("[selectTokenRange]", [&]{
+            // windows of the display order, icons are only selected on request
+            std::vector<OTPToken::Label> labels;
+            const auto collect = [&](const OTPToken &token) {
+                labels.emplace_back(token.label());
+            };
+            AssertThat(TokenDatabase::selectTokenRange(1, 5, collect), Equals(TokenDatabase::Success));
+            AssertThat(labels, Equals(std::vector<OTPToken::Label>{"b", "c"}));
+
+            labels.clear();
+            AssertThat(TokenDatabase::selectTokenRange(0, 1, collect), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokenRange(3, 1, collect), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokenRange(0, 0, collect), Equals(TokenDatabase::Success));
+            AssertThat(labels, Equals(std::vector<OTPToken::Label>{"a"}));
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::selectTokenRange(0, 1, collect), Equals(TokenDatabase::SqlDatabaseNotOpen));
+        });
+
+        it("[selectTokenPages]", [&]{
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D", 8U, 60U, 0U, OTPToken::SHA256),
+                OTPToken(OTPToken::TOTP, "e", {}, "MNOP123456KDDK83D", 8U, 30U, 0U, OTPToken::SHA256),
+                OTPToken(OTPToken::HOTP, "f", {}, "QRST123456KDDK83D", 8U, 0U, 7U, OTPToken::SHA256),
+            }), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveToken("f", 0), Equals(TokenDatabase::Success));
+
+            const auto walk = [](const TokenDatabase::TokenFilter &filter, std::size_t limit, std::size_t *pages = nullptr) {
+                std::vector<OTPToken::Label> labels;
+                TokenDatabase::TokenPage page;
+                auto after = TokenDatabase::FirstPage;
+                do {
+                    AssertThat(TokenDatabase::selectTokens(filter, TokenDatabase::LabelColumn, after, limit, page), Equals(TokenDatabase::Success));
+                    for (auto&& token : page.tokens)
+                    {
+                        labels.emplace_back(token.label());
+                    }
+                    after = page.next;
+                    if (pages)
+                    {
+                        ++*pages;
+                    }
+                } while (!page.last);
+                return labels;
+            };
+
+            // pages follow the display order, the last page is known without an empty one
+            std::size_t pages = 0;
+            AssertThat(walk({}, 2, &pages), Equals(std::vector<OTPToken::Label>{"f", "a", "b", "c", "d", "e"}));
+            AssertThat(pages, Equals(3U));
+            AssertThat(walk({}, 100), Equals(std::vector<OTPToken::Label>{"f", "a", "b", "c", "d", "e"}));
+
+            TokenDatabase::TokenFilter filter;
+            filter.type = OTPToken::TOTP;
+            filter.digits = 8U;
+            AssertThat(walk(filter, 1), Equals(std::vector<OTPToken::Label>{"d", "e"}));
+            filter.period = 60U;
+            AssertThat(walk(filter, 1), Equals(std::vector<OTPToken::Label>{"d"}));
+            filter = {};
+            filter.algorithm = OTPToken::SHA256;
+            AssertThat(walk(filter, 5), Equals(std::vector<OTPToken::Label>{"f", "d", "e"}));
+
+            // deleting tokens of earlier pages doesn't shift the next page
+            TokenDatabase::TokenPage page;
+            AssertThat(TokenDatabase::selectTokens({}, TokenDatabase::AllColumns, TokenDatabase::FirstPage, 3, page), Equals(TokenDatabase::Success));
+            AssertThat(page.tokens.at(0).counter(), Equals(7U));
+            AssertThat(page.tokens.at(0).secret(), Equals("QRST123456KDDK83D"));
+            AssertThat(TokenDatabase::deleteToken(page.tokens.at(1).id()), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokens({}, TokenDatabase::TypeColumn, page.next, 3, page), Equals(TokenDatabase::Success));
+            AssertThat(page.last, IsTrue());
+            AssertThat(page.tokens.size(), Equals(3U));
+            AssertThat(page.tokens.at(0).id(), Equals(TokenDatabase::tokenId("c")));
+            AssertThat(page.tokens.at(0).type(), Equals(OTPToken::TOTP));
+            AssertThat(page.tokens.at(0).label(), Equals(""));
+            AssertThat(page.tokens.at(0).secret().empty(), IsTrue());
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::selectTokens({}, TokenDatabase::AllColumns, TokenDatabase::FirstPage, 3, page), Equals(TokenDatabase::SqlDatabaseNotOpen));
+        });
+
+        it("[reloadTokens]", [&]{
+            // unchanged files are not loaded again
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::databaseFileChanged(), Equals(false));
+            auto changed = true;
+            AssertThat(TokenDatabase::reloadTokens(&changed), Equals(TokenDatabase::Success));
+            AssertThat(changed, Equals(false));
+
+            const auto copy = file + ".copy";
+            std::filesystem::copy_file(file, copy, std::filesystem::copy_options::overwrite_existing);
+            AssertThat(TokenDatabase::deleteToken(TokenDatabase::tokenId("a")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::databaseFileChanged(), Equals(false));
+
+            // a new modification time alone isn't a change
+            std::filesystem::last_write_time(file, std::filesystem::last_write_time(file) + std::chrono::seconds(10));
+            AssertThat(TokenDatabase::databaseFileChanged(), Equals(false));
+
+            // another process replaced the file
+            std::filesystem::copy_file(copy, file, std::filesystem::copy_options::overwrite_existing);
+            std::remove(copy.c_str());
+            AssertThat(TokenDatabase::databaseFileChanged(), Equals(true));
+            AssertThat(TokenDatabase::reloadTokens(&changed), Equals(TokenDatabase::Success));
+            AssertThat(changed, Equals(true));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+            AssertThat(TokenDatabase::databaseFileChanged(), Equals(false));
+        });
+
+        it("[snapshot]", [&]{
+            const auto snapshot = (std::filesystem::temp_directory_path() / "otpgen-tests.snapshot").string();
+            const auto a = TokenDatabase::tokenId(OTPToken::Label("a"));
+            const auto c = TokenDatabase::tokenId(OTPToken::Label("c"));
+
+            // the given order is kept, unknown ids are skipped
+            AssertThat(TokenDatabase::writeSnapshot(snapshot, {c, 9999, a}), Equals(TokenDatabase::Success));
+
+            // read without an open database
+            TokenDatabase::closeDatabase();
+            TokenDatabase::Snapshot entries;
+            AssertThat(TokenDatabase::readSnapshot(snapshot, entries), Equals(TokenDatabase::Success));
+            AssertThat(entries.size(), Equals(2U));
+            AssertThat(entries.at(0).id, Equals(c));
+            AssertThat(entries.at(0).label, Equals(std::string("c")));
+            AssertThat(entries.at(0).type, Equals(static_cast<OTPToken::TokenType>(OTPToken::TOTP)));
+            AssertThat(entries.at(1).label, Equals(std::string("a")));
+
+            // the snapshot is no database and the database is no snapshot
+            TokenDatabase::setTokenDatabase(snapshot);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidTokenFile));
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::readSnapshot(file, entries), Equals(TokenDatabase::InvalidTokenFile));
+            AssertThat(entries.empty(), Equals(true));
+
+            TokenDatabase::setPassword("wrong");
+            AssertThat(TokenDatabase::readSnapshot(snapshot, entries), Equals(TokenDatabase::InvalidCiphertext));
+            std::remove(snapshot.c_str());
+        });
+
+        it("[writeTokenSet]", [&]{
+            const auto exported = (std::filesystem::temp_directory_path() / "otpgen-tests.tokens").string();
+            AssertThat(TokenDatabase::writeTokenSet(exported), Equals(TokenDatabase::Success));
+
+            // read without an open database
+            TokenDatabase::closeDatabase();
+            TokenSetView view;
+            AssertThat(TokenDatabase::readTokenSet(exported, view), Equals(TokenDatabase::Success));
+            AssertThat(view.size(), Equals(3U));
+            AssertThat(view.type(view.find("b")), Equals(static_cast<OTPToken::TokenType>(OTPToken::HOTP)));
+
+            OTPGen::TokenBuffer code;
+            AssertThat(view.computeCode(view.find("a"), 1536573862, code), IsTrue());
+            AssertThat(std::string(code), Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+
+            // the token set is no database and the database is no token set
+            TokenDatabase::setTokenDatabase(exported);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidTokenFile));
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::readTokenSet(file, view), Equals(TokenDatabase::InvalidTokenFile));
+            AssertThat(view.isOpen(), IsFalse());
+
+            TokenDatabase::setPassword("wrong");
+            AssertThat(TokenDatabase::readTokenSet(exported, view), Equals(TokenDatabase::InvalidCiphertext));
+            std::remove(exported.c_str());
+        });
+
+        it("[progressiveOpen]", [&]{
+            const auto open = [](TokenSetView &view, TokenDatabase::DisplayOrder &order) {
+                std::promise<TokenDatabase::Error> loaded;
+                const auto status = TokenDatabase::openTokensProgressive(view, order, [&](const TokenDatabase::Error &status) {
+                    loaded.set_value(status);
+                });
+                AssertThat(loaded.get_future().get(), Equals(TokenDatabase::Success));
+                return status;
+            };
+
+            // icons take several chunks behind the token set
+            OTPToken::Icon icon(3 * 1024 * 1024);
+            for (auto i = 0U; i < icon.size(); ++i)
+            {
+                icon[i] = static_cast<unsigned char>(i * 7);
+            }
+            auto token = OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D");
+            token.setIcon(icon);
+            AssertThat(TokenDatabase::insertToken(token), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveToken("c", 0), Equals(TokenDatabase::Success));
+            TokenDatabase::setProgressiveOpen(true);
+            AssertThat(TokenDatabase::progressiveOpen(), IsTrue());
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto order = TokenDatabase::displayOrder();
+            TokenDatabase::closeDatabase();
+
+            // codes are generated from the token set, the database is loaded meanwhile
+            TokenSetView view;
+            TokenDatabase::DisplayOrder listed;
+            AssertThat(open(view, listed), Equals(TokenDatabase::Success));
+            AssertThat(view.size(), Equals(4U));
+            AssertThat(listed, Equals(order));
+            OTPGen::TokenBuffer code;
+            AssertThat(view.computeCode(view.find("a"), 1536573862, code), IsTrue());
+            AssertThat(std::string(code), Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("d")).icon() == icon, IsTrue());
+            AssertThat(TokenDatabase::displayOrder(), Equals(order));
+
+            // compressed images and re-keyed copies keep the token set
+            TokenDatabase::setCompression(TokenDatabase::Zlib);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(open(view, listed), Equals(TokenDatabase::Success));
+            AssertThat(view.find("d") == TokenSetView::npos, IsFalse());
+            std::promise<TokenDatabase::Error> changed;
+            TokenDatabase::changePasswordAsync("otpgen-tests-2", [&](const TokenDatabase::Error &status) {
+                changed.set_value(status);
+            });
+            AssertThat(changed.get_future().get(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(open(view, listed), Equals(TokenDatabase::Success));
+            AssertThat(view.size(), Equals(4U));
+
+            // other files are only loaded
+            TokenDatabase::setProgressiveOpen(false);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(open(view, listed), Equals(TokenDatabase::InvalidTokenFile));
+            AssertThat(view.isOpen(), IsFalse());
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+        });
+
+        it("[delta]", [&]{
+            const auto delta = (std::filesystem::temp_directory_path() / "otpgen-tests.delta").string();
+            const auto since = TokenDatabase::changeSequence();
+            AssertThat(since, Equals(3U));
+
+            // the replica is a copy of the database in another vault
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            std::filesystem::copy_file(file, vaultFile, std::filesystem::copy_options::overwrite_existing);
+            AssertThat(TokenDatabase::selectVault("ops", true), IsTrue());
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(vaultFile);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectVault(""), IsTrue());
+
+            // b and c exchange their labels, a is gone, d is new and moved to the top
+            const auto b = TokenDatabase::tokenId(OTPToken::Label("b"));
+            const auto c = TokenDatabase::tokenId(OTPToken::Label("c"));
+            AssertThat(TokenDatabase::renameToken(b, "tmp"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::renameToken(c, "b"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::renameToken(b, "c"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::deleteToken(TokenDatabase::tokenId(OTPToken::Label("a"))), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {0x89, 0x50}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveToken(OTPToken::Label("d"), 0), Equals(TokenDatabase::Success));
+
+            // the changes of b are merged into one record
+            TokenDatabase::ChangeSequence last = 0;
+            AssertThat(TokenDatabase::writeDelta(delta, since, &last), Equals(TokenDatabase::Success));
+            AssertThat(last, Equals(TokenDatabase::changeSequence()));
+            AssertThat(std::filesystem::file_size(delta) < std::filesystem::file_size(file), IsTrue());
+            const auto order = TokenDatabase::displayOrder();
+
+            // applying twice changes nothing
+            AssertThat(TokenDatabase::selectVault("ops"), IsTrue());
+            for (auto i = 0; i < 2; ++i)
+            {
+                TokenDatabase::ChangeSequence applied = 0;
+                AssertThat(TokenDatabase::applyDelta(delta, &applied), Equals(TokenDatabase::Success));
+                AssertThat(applied, Equals(last));
+                AssertThat(TokenDatabase::tokenCount(), Equals(3));
+                AssertThat(TokenDatabase::displayOrder() == order, IsTrue());
+                AssertThat(TokenDatabase::tokenId(OTPToken::Label("a")), Equals(0));
+                AssertThat(TokenDatabase::selectToken(OTPToken::Label("b")).secret(), Equals("EFGH123456KDDK83D"));
+                AssertThat(TokenDatabase::selectToken(OTPToken::Label("c")).type(), Equals(OTPToken::HOTP));
+                AssertThat(TokenDatabase::selectToken(OTPToken::Label("d")).icon() == OTPToken::Icon({0x89, 0x50}), IsTrue());
+            }
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+
+            // a delta is no database, the database is no delta
+            TokenDatabase::setTokenDatabase(delta);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidTokenFile));
+            TokenDatabase::setTokenDatabase(vaultFile);
+            AssertThat(TokenDatabase::applyDelta(vaultFile), Equals(TokenDatabase::InvalidTokenFile));
+            AssertThat(TokenDatabase::selectVault(""), IsTrue());
+
+            // nothing changed since the last delta, older ones are gone after pruning
+            AssertThat(TokenDatabase::writeDelta(delta, last), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::pruneChangeLog(last), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::writeDelta(delta, since), Equals(TokenDatabase::ChangeLogPruned));
+            AssertThat(TokenDatabase::writeDelta(delta, last), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::changeSequence(), Equals(last));
+            std::remove(delta.c_str());
+        });
+
+        it("[counterJournal]", [&]{
+            const auto journal = file + "-counters";
+            const auto b = TokenDatabase::tokenId(OTPToken::Label("b"));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+
+            // one fixed size record per counter, the database isn't written
+            OTPToken::CounterType counter = 0;
+            for (auto i = 1U; i <= 3U; ++i)
+            {
+                AssertThat(TokenDatabase::incrementCounter(b, &counter), Equals(TokenDatabase::Success));
+                AssertThat(counter, Equals(i));
+            }
+            AssertThat(TokenDatabase::hasUnsavedChanges(), IsFalse());
+            AssertThat(TokenDatabase::selectToken(b).counter(), Equals(3U));
+            AssertThat(std::filesystem::file_size(journal), Equals(Internal::CounterJournal::HEADER_SIZE + 3 * Internal::CounterJournal::RECORD_SIZE));
+            AssertThat(TokenDatabase::setCounter(99, 1), Equals(TokenDatabase::SqlEmptyResults));
+
+            // the journal is applied on load, a torn record at the end is dropped
+            {
+                std::ofstream torn(journal, std::ios_base::app | std::ios_base::binary);
+                torn << "torn";
+            }
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(b).counter(), Equals(3U));
+            AssertThat(TokenDatabase::setCounter(b, 7), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(b).counter(), Equals(7U));
+
+            // saving merges the journal into the database
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(std::filesystem::exists(journal), IsFalse());
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(b).counter(), Equals(7U));
+
+            // modified records are rejected
+            AssertThat(TokenDatabase::incrementCounter(b), Equals(TokenDatabase::Success));
+            {
+                std::fstream modified(journal, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+                modified.seekp(Internal::CounterJournal::HEADER_SIZE + 20);
+                modified.put('x');
+            }
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+            std::remove(journal.c_str());
+
+            // and so does closing
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::incrementCounter(b, &counter), Equals(TokenDatabase::Success));
+            AssertThat(counter, Equals(8U));
+            TokenDatabase::closeDatabase();
+            AssertThat(std::filesystem::exists(journal), IsFalse());
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(b).counter(), Equals(8U));
+        });
+
+        it("[clockDrift]", [&]{
+            const auto a = TokenDatabase::tokenId(OTPToken::Label("a"));
+
+            // tokens start without a drift
+            ClockDrift drift;
+            drift.learn(3);
+            AssertThat(TokenDatabase::getClockDrift(a, drift), Equals(TokenDatabase::Success));
+            AssertThat(drift == ClockDrift(), IsTrue());
+
+            drift.learn(-2);
+            drift.learn(-2);
+            AssertThat(TokenDatabase::setClockDrift(a, drift), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::setClockDrift(99, drift), Equals(TokenDatabase::SqlEmptyResults));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            ClockDrift loaded;
+            AssertThat(TokenDatabase::getClockDrift(a, loaded), Equals(TokenDatabase::Success));
+            AssertThat(loaded.offset(), Equals(-2));
+            AssertThat(loaded.confidence(), Equals(2U));
+
+            // and is removed with the token
+            AssertThat(TokenDatabase::deleteToken(a), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::getClockDrift(a, loaded), Equals(TokenDatabase::Success));
+            AssertThat(loaded == ClockDrift(), IsTrue());
+        });
+
+        it("[observer]", [&]{
+            using Event = TokenDatabase::ChangeEvent;
+            std::vector<std::pair<std::string, TokenDatabase::ChangeEvents>> delivered;
+            const auto id = TokenDatabase::addObserver([&](const std::string &vault, const TokenDatabase::ChangeEvents &events) {
+                delivered.emplace_back(vault, events);
+            });
+            const auto kinds = [&](std::size_t delivery) {
+                std::vector<std::pair<Event::Kind, OTPToken::sqliteTokenID>> list;
+                for (auto&& event : delivered.at(delivery).second)
+                {
+                    list.emplace_back(event.kind, event.id);
+                }
+                return list;
+            };
+            using Kinds = std::vector<std::pair<Event::Kind, OTPToken::sqliteTokenID>>;
+
+            const auto a = TokenDatabase::tokenId(OTPToken::Label("a"));
+            const auto b = TokenDatabase::tokenId(OTPToken::Label("b"));
+            AssertThat(TokenDatabase::renameToken(a, "x"), Equals(TokenDatabase::Success));
+            auto token = TokenDatabase::selectToken(b);
+            token.setSecret("MNOP123456KDDK83D");
+            AssertThat(TokenDatabase::updateToken(b, token), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::setCounter(b, 5), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::swapTokens("x", "b"), Equals(TokenDatabase::Success));
+            AssertThat(delivered.size(), Equals(4U));
+            AssertThat(delivered[0].first, Equals(""));
+            AssertThat(kinds(0), Equals(Kinds{{Event::Renamed, a}}));
+            AssertThat(kinds(1), Equals(Kinds{{Event::Updated, b}}));
+            AssertThat(kinds(2), Equals(Kinds{{Event::CounterChanged, b}}));
+            // one delivery per call
+            AssertThat(kinds(3), Equals(Kinds{{Event::Moved, a}, {Event::Moved, b}}));
+
+            // rows which failed or were rolled back aren't delivered
+            delivered.clear();
+            AssertThat(TokenDatabase::insertTokens({
+                OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "X", {}, "MNOP123456KDDK83D"),
+                OTPToken(OTPToken::TOTP, "e", {}, "QRST123456KDDK83D"),
+            }), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertTokens([](const TokenDatabase::TokenCallback &insert) {
+                insert(OTPToken(OTPToken::TOTP, "f", {}, "IJKL123456KDDK83D"));
+                return TokenDatabase::UnknownFailure;
+            }), Equals(TokenDatabase::UnknownFailure));
+            AssertThat(TokenDatabase::deleteToken(a), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::deleteToken(a), Equals(TokenDatabase::Success));
+            AssertThat(delivered.size(), Equals(2U));
+            const auto d = TokenDatabase::tokenId(OTPToken::Label("d"));
+            const auto e = TokenDatabase::tokenId(OTPToken::Label("e"));
+            AssertThat(kinds(0), Equals(Kinds{{Event::Inserted, d}, {Event::Inserted, e}}));
+            AssertThat(kinds(1), Equals(Kinds{{Event::Deleted, a}}));
+
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(kinds(2), Equals(Kinds{{Event::Reloaded, 0}}));
+
+            // observers with a dispatcher are delivered wherever the dispatcher runs them
+            std::vector<std::function<void()>> queue;
+            std::size_t queued = 0;
+            const auto deferred = TokenDatabase::addObserver([&](const std::string&, const TokenDatabase::ChangeEvents &events) {
+                queued += events.size();
+            }, [&](const std::function<void()> &delivery) {
+                queue.emplace_back(delivery);
+            });
+            AssertThat(TokenDatabase::deleteToken(d), Equals(TokenDatabase::Success));
+            AssertThat(queue.size(), Equals(1U));
+            AssertThat(queued, Equals(0U));
+            TokenDatabase::removeObserver(deferred);
+            std::thread([&]{ queue.front()(); }).join();
+            AssertThat(queued, Equals(1U));
+
+            TokenDatabase::removeObserver(id);
+            const auto count = delivered.size();
+            AssertThat(TokenDatabase::deleteToken(e), Equals(TokenDatabase::Success));
+            AssertThat(delivered.size(), Equals(count));
+            AssertThat(queue.size(), Equals(1U));
+        });
+
+        it("[staticNames]", [&]{
+            // names come from the mapping the static tables are created from
+            AssertThat(TokenDatabase::selectTokenTypeName(OTPToken::Steam), Equals("Steam"));
+            AssertThat(TokenDatabase::selectAlgorithmName(OTPToken::SHA256), Equals("SHA256"));
+            AssertThat(TokenDatabase::selectTokenTypeName(9), Equals(""));
+            AssertThat(TokenDatabase::selectAlgorithmName(-1), Equals(""));
+
+            // tokens don't need an open database
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::selectTokenTypeName(OTPToken::TOTP), Equals(""));
+            const auto token = OTPToken(OTPToken::HOTP, "x", {}, "XYZA123456KDDK83D", 6, 0, 0, OTPToken::SHA512);
+            AssertThat(token.typeName(), Equals("HOTP"));
+            AssertThat(token.algorithmName(), Equals("SHA512"));
+            AssertThat(OTPToken(OTPToken::None).typeName(), Equals(""));
+        });
+
+        it("[schemaMigration]", [&]{
+            // database of version 0x0f000005, the display order is a blob in the config table,
+            // icons are stored in the tokens and digits, period and counter are vector BLOBs
+            static const constexpr auto TOKENS = 100000;
+            sqlite3 *legacy = nullptr;
+            AssertThat(sqlite3_open(":memory:", &legacy), Equals(SQLITE_OK));
+            AssertThat(sqlite3_exec(legacy,
+                "create table types (id int(1) PRIMARY KEY NOT NULL, name text UNIQUE);"
+                "create table algorithms (id int(1) PRIMARY KEY NOT NULL, name text UNIQUE);"
+                "insert into types values (1, 'TOTP'), (2, 'HOTP'), (3, 'Steam');"
+                "insert into algorithms values (1, 'SHA1'), (2, 'SHA256'), (3, 'SHA512');"
+                "create table config (id text PRIMARY KEY NOT NULL, data blob);"
+                "create table tokens (id INTEGER PRIMARY KEY NOT NULL, type int(1) NOT NULL, "
+                "label text NOT NULL UNIQUE COLLATE NOCASE, icon blob, secret text NOT NULL, "
+                "digits blob, period blob, counter blob, algorithm int(1) NOT NULL, "
+                "FOREIGN KEY(type) REFERENCES types(id), FOREIGN KEY(algorithm) REFERENCES algorithms(id));"
+                "begin;", nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+
+            const auto bindVector = [](sqlite3_stmt *statement, int column, const auto &values) {
+                sqlite3_bind_blob(statement, column, values.data(), static_cast<int>(values.size() * sizeof(values[0])), SQLITE_TRANSIENT);
+            };
+
+            sqlite3_stmt *insert = nullptr;
+            sqlite3_prepare_v2(legacy, "insert into tokens values (?, 1, ?, ?, 'SECRETSECRETSECR', ?, ?, ?, 1);", -1, &insert, nullptr);
+            const OTPToken::Icon icon{0x89, 'P', 'N', 'G'};
+            std::vector<OTPToken::sqliteSortOrder> order;
+            for (auto i = 1; i <= TOKENS; ++i)
+            {
+                const auto label = "token" + std::to_string(i);
+                sqlite3_bind_int64(insert, 1, i);
+                sqlite3_bind_text(insert, 2, label.c_str(), -1, SQLITE_TRANSIENT);
+                if (i % 2 == 0)
+                {
+                    bindVector(insert, 3, icon);
+                }
+                else
+                {
+                    sqlite3_bind_null(insert, 3);
+                }
+                bindVector(insert, 4, std::vector<OTPToken::DigitType>{8});
+                bindVector(insert, 5, std::vector<OTPToken::PeriodType>{60});
+                bindVector(insert, 6, std::vector<OTPToken::CounterType>{0});
+                AssertThat(sqlite3_step(insert), Equals(SQLITE_DONE));
+                sqlite3_reset(insert);
+                order.emplace_back(i);
+            }
+            sqlite3_finalize(insert);
+            // the old display order is kept, newest token first
+            std::reverse(order.begin(), order.end());
+
+            sqlite3_prepare_v2(legacy, "insert into config values (?, ?);", -1, &insert, nullptr);
+            sqlite3_bind_text(insert, 1, "database", -1, SQLITE_STATIC);
+            bindVector(insert, 2, std::vector<std::uint32_t>{0x0f000005});
+            AssertThat(sqlite3_step(insert), Equals(SQLITE_DONE));
+            sqlite3_reset(insert);
+            sqlite3_bind_text(insert, 1, "order", -1, SQLITE_STATIC);
+            bindVector(insert, 2, order);
+            AssertThat(sqlite3_step(insert), Equals(SQLITE_DONE));
+            sqlite3_finalize(insert);
+            AssertThat(sqlite3_exec(legacy, "commit;", nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+
+            writeImage(legacy);
+
+            // upper bound of the upgrade, all steps run on load
+            const auto start = std::chrono::steady_clock::now();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            AssertThat(elapsed < std::chrono::seconds(10), IsTrue());
+
+            AssertThat(TokenDatabase::tokenCount(), Equals(TOKENS));
+            const auto display = TokenDatabase::displayOrder();
+            AssertThat(display.size(), Equals(static_cast<std::size_t>(TOKENS)));
+            AssertThat(display.front(), Equals(static_cast<OTPToken::sqliteSortOrder>(TOKENS)));
+
+            const auto token = TokenDatabase::selectToken(OTPToken::Label("token2"));
+            AssertThat(token.digitLength(), Equals(8U));
+            AssertThat(std::string(token.secret().c_str()), Equals("RCESTERCESTERCES"));
+            AssertThat(token.period(), Equals(60U));
+            AssertThat(token.icon() == icon, IsTrue());
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("token1")).icon().empty(), IsTrue());
+
+            // the change log starts with the migration
+            AssertThat(TokenDatabase::changeSequence(), Equals(0U));
+            AssertThat(TokenDatabase::deleteToken(token.id()), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::changeSequence(), Equals(1U));
+
+            // the drift table is created empty
+            ClockDrift drift;
+            drift.learn(1);
+            AssertThat(TokenDatabase::setClockDrift(TokenDatabase::tokenId(OTPToken::Label("token1")), drift), Equals(TokenDatabase::Success));
+
+            // the upgraded database is saved and loaded without migrating again
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(TOKENS - 1));
+        });
+
+        it("[schemaFingerprint]", [&]{
+            // a changed schema doesn't match the stored fingerprint and is validated in detail
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            sqlite3 *changed = nullptr;
+            AssertThat(sqlite3_open(":memory:", &changed), Equals(SQLITE_OK));
+            AssertThat(sqlite3_exec(changed,
+                "create table types (id int(1) PRIMARY KEY NOT NULL, name text UNIQUE);"
+                "create table algorithms (id int(1) PRIMARY KEY NOT NULL, name text UNIQUE);"
+                "create table config (id text PRIMARY KEY NOT NULL, data blob);"
+                "create table tokens (id INTEGER PRIMARY KEY NOT NULL, label text);"
+                "create table token_order (id INTEGER PRIMARY KEY NOT NULL, position INTEGER NOT NULL);"
+                "create table icons (hash blob PRIMARY KEY NOT NULL, data blob NOT NULL);"
+                "insert into config values ('database', x'0800000f'), ('schema', zeroblob(32));",
+                nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+            writeImage(changed);
+
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::SqlSchemaValidationFailed));
+        });
+
+        it("[checkDisplayOrder]", [&]{
+            const auto labels = [] {
+                std::vector<OTPToken::Label> list;
+                for (auto&& token : TokenDatabase::selectTokens())
+                {
+                    list.emplace_back(token.label());
+                }
+                return list;
+            };
+            const auto a = TokenDatabase::tokenId(OTPToken::Label("a"));
+            AssertThat(TokenDatabase::checkDisplayOrder(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+
+            // an entry without token and a token without entry
+            auto damaged = readImage();
+            const auto sql = "delete from token_order where id = " + std::to_string(a) + ";"
+                             "insert into token_order values (999, 100000);";
+            AssertThat(sqlite3_exec(damaged, sql.c_str(), nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+            writeImage(damaged);
+
+            // the token is listed again after loading, at the end
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::checkDisplayOrder(), Equals(TokenDatabase::Success));
+            AssertThat(labels(), Equals(std::vector<OTPToken::Label>{"b", "c", "a"}));
+            AssertThat(TokenDatabase::displayOrder().size(), Equals(3U));
+        });
+
+        it("[selectTokenSet]", [&]{
+            // the set follows the display order and generates the same codes
+            TokenSet set;
+            AssertThat(TokenDatabase::selectTokenSet(set), Equals(TokenDatabase::Success));
+            AssertThat(set.size(), Equals(3U));
+            AssertThat(set.label(1), Equals(std::string("b")));
+            AssertThat(set.id(2), Equals(TokenDatabase::tokenId(OTPToken::Label("c"))));
+
+            std::vector<OTPToken::TokenString> codes;
+            set.computeCodes(1536573862, codes);
+            AssertThat(codes.at(0), Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1)));
+            AssertThat(codes.at(1), Equals(OTPGen::computeHOTP("ABCD123456KDDK83D", 0, 6, OTPToken::SHA1)));
+
+            AssertThat(TokenDatabase::selectTokenSet(set, OTPToken::HOTP), Equals(TokenDatabase::Success));
+            AssertThat(set.size(), Equals(1U));
+        });
+
+#ifdef OTPGEN_WITH_PERF_STATS
+        it("[stats]", [&]{
+            // save and load are timed and reported to the trace hooks
+            static std::size_t begins = 0U, ends = 0U;
+            PerfStats::TraceHooks hooks;
+            hooks.begin = [](const char*) -> std::uint64_t { return ++begins; };
+            hooks.end = [](std::uint64_t context) { AssertThat(context, IsGreaterThan(0U)); ++ends; };
+            PerfStats::setTraceHooks(&hooks);
+
+            TokenDatabase::resetStats();
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenId(OTPToken::Label("a")), IsGreaterThan(0));
+            PerfStats::setTraceHooks(nullptr);
+
+            AssertThat(begins, IsGreaterThan(0U));
+            AssertThat(ends, Equals(begins));
+
+            const auto stats = TokenDatabase::stats();
+            AssertThat(stats.perf.timers[PerfStats::Save].count, Equals(1U));
+            AssertThat(stats.perf.timers[PerfStats::Load].count, Equals(1U));
+            AssertThat(stats.perf.timers[PerfStats::Encrypt].count, Equals(1U));
+            AssertThat(stats.perf.timers[PerfStats::Decrypt].count, Equals(1U));
+            AssertThat(stats.perf.timers[PerfStats::Load].maxNs, IsGreaterThan(0U));
+            AssertThat(stats.perf.counters[PerfStats::LabelCacheMisses] +
+                       stats.perf.counters[PerfStats::LabelCacheHits], IsGreaterThan(0U));
+            AssertThat(stats.statements.empty(), IsFalse());
+
+            // every generated code is counted
+            const auto generated = PerfStats::snapshot().counters[PerfStats::CodesGenerated];
+            OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1);
+            AssertThat(PerfStats::snapshot().counters[PerfStats::CodesGenerated], Equals(generated + 1U));
+
+            TokenDatabase::resetStats();
+            AssertThat(TokenDatabase::stats().perf.timers[PerfStats::Load].count, Equals(0U));
+            AssertThat(TokenDatabase::stats().statements.empty(), IsTrue());
+        });
+#endif
+
+        it("[inspect]", [&]{
+            const OTPToken::Icon icon(3000U, 0x42);
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::Steam, "d", icon, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "e", icon, "MNOP123456KDDK83D")), Equals(TokenDatabase::Success));
+
+            TokenDatabase::Inspection inspection;
+            AssertThat(TokenDatabase::inspect(inspection), Equals(TokenDatabase::Success));
+            AssertThat(inspection.tokens[OTPToken::TOTP], Equals(3U));
+            AssertThat(inspection.tokens[OTPToken::HOTP], Equals(1U));
+            AssertThat(inspection.tokens[OTPToken::Steam], Equals(1U));
+            AssertThat(inspection.labelBytes, Equals(5U));
+            AssertThat(inspection.secretBytes, IsGreaterThan(0U));
+            AssertThat(inspection.icons, Equals(1U));
+            AssertThat(inspection.iconBytes, Equals(3000U));
+            AssertThat(inspection.sharedIconBytes, Equals(3000U));
+            AssertThat(inspection.orphanedIcons, Equals(0U));
+            AssertThat(inspection.orderEntries, Equals(5U));
+            AssertThat(inspection.deadOrderEntries, Equals(0U));
+            AssertThat(inspection.unorderedTokens, Equals(0U));
+            AssertThat(inspection.pageSize, IsGreaterThan(0U));
+            AssertThat(inspection.pageCount, IsGreaterThan(inspection.freePages));
+            AssertThat(inspection.tables.empty(), IsFalse());
+            AssertThat(inspection.tables.front().pages >= inspection.tables.back().pages, IsTrue());
+
+            // the table pages add up to the database without the free pages
+            std::uint64_t pages = 0U;
+            for (auto&& table : inspection.tables)
+            {
+                pages += table.pages;
+            }
+            AssertThat(pages + inspection.freePages, Equals(inspection.pageCount));
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::inspect(inspection), Equals(TokenDatabase::SqlDatabaseNotOpen));
+        });
+
+        it("[reader]", [&]{
+            // the reader keeps the state it was acquired with
+            auto reader = TokenDatabase::reader();
+            AssertThat(reader.isValid(), IsTrue());
+            AssertThat(reader.isCurrent(), IsTrue());
+            AssertThat(reader.tokenCount(), Equals(3));
+
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "d", {}, "IJKL123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(reader.isCurrent(), IsFalse());
+            AssertThat(reader.tokenCount(), Equals(3));
+            AssertThat(reader.selectToken(OTPToken::Label("d")).id(), Equals(0));
+            AssertThat(reader.selectToken(OTPToken::Label("B")).secret(), Equals("ABCD123456KDDK83D"));
+            AssertThat(reader.selectTokens(OTPToken::TOTP).size(), Equals(2U));
+
+            // unsaved changes are part of new readers
+            auto current = TokenDatabase::reader();
+            AssertThat(current.tokenCount(), Equals(4));
+            AssertThat(current.selectToken(TokenDatabase::tokenId(OTPToken::Label("d"))).label(), Equals(std::string("d")));
+
+            TokenSet set;
+            AssertThat(current.selectTokenSet(set), Equals(TokenDatabase::Success));
+            AssertThat(set.size(), Equals(4U));
+            AssertThat(set.label(3), Equals(std::string("d")));
+
+            // readers outlive the database and are invalid while it is closed
+            TokenDatabase::closeDatabase();
+            AssertThat(current.tokenCount(), Equals(4));
+            AssertThat(TokenDatabase::reader().isValid(), IsFalse());
+            AssertThat(TokenDatabase::Reader().selectTokens().empty(), IsTrue());
+        });
+
+        it("[readerThreads]", [&]{
+            // readers on other threads always see a complete state while the database changes
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+
+            std::atomic<bool> stop{false};
+            std::atomic<std::size_t> reads{0U}, inconsistent{0U};
+            std::vector<std::thread> threads;
+            for (auto t = 0U; t < 4U; ++t)
+            {
+                threads.emplace_back([&]{
+                    while (!stop || reads < 8U)
+                    {
+                        auto reader = TokenDatabase::reader();
+                        const auto count = reader.tokenCount();
+                        if (static_cast<std::size_t>(count) != reader.selectTokens().size())
+                        {
+                            ++inconsistent;
+                        }
+                        ++reads;
+                    }
+                });
+            }
+
+            for (auto i = 0U; i < 50U; ++i)
+            {
+                AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "t" + std::to_string(i), {}, "XYZA123456KDDK83D")),
+                           Equals(TokenDatabase::Success));
+                if (i % 10U == 0U)
+                {
+                    AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+                }
+            }
+            stop = true;
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+
+            AssertThat(inconsistent.load(), Equals(0U));
+            AssertThat(TokenDatabase::reader().tokenCount(), Equals(51));
+        });
+
+        it("[exportReader]", [&]{
+            // the copy takes several steps, tokens inserted meanwhile are either all in it or not
+            const OTPToken::Icon icon(16U * 1024U, 0x5A);
+            for (auto&& format : {TokenDatabase::EncryptedImage, TokenDatabase::EncryptedPages})
+            {
+                TokenDatabase::setStorageFormat(format);
+                AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+                for (auto i = 0U; i < 100U; ++i)
+                {
+                    AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "w" + std::to_string(i), icon, "XYZA123456KDDK83D")),
+                               Equals(TokenDatabase::Success));
+                }
+                AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+
+                std::atomic<bool> stop{false};
+                std::thread writer([&]{
+                    for (auto i = 100U; !stop && i < 400U; ++i)
+                    {
+                        (void) TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "w" + std::to_string(i), icon, "XYZA123456KDDK83D"));
+                    }
+                });
+
+                std::size_t torn = 0U;
+                for (auto e = 0U; e < 4U; ++e)
+                {
+                    auto reader = TokenDatabase::exportReader();
+                    AssertThat(reader.isValid(), IsTrue());
+                    std::size_t rows = 0U;
+                    AssertThat(reader.forEachToken(OTPToken::None, [&](const OTPToken &token) {
+                        if (token.label() != "w" + std::to_string(rows) || token.secret() != "XYZA123456KDDK83D")
+                        {
+                            ++torn;
+                        }
+                        ++rows;
+                    }, false), Equals(TokenDatabase::Success));
+                    AssertThat(static_cast<OTPToken::sqliteTokenID>(rows), Equals(reader.tokenCount()));
+                    AssertThat(rows >= 100U, IsTrue());
+                }
+                stop = true;
+                writer.join();
+                AssertThat(torn, Equals(0U));
+            }
+
+            // formats stream from such a copy
+            const auto exported = file + ".andotp.json";
+            AssertThat(AppSupport::FormatRegistry::exportDatabase(exported, *AppSupport::FormatRegistry::find("andotp")), IsTrue());
+            std::vector<OTPToken> imported;
+            AppSupport::VectorSink sink(imported);
+            AssertThat(AppSupport::FormatRegistry::importFile(exported, sink), IsTrue());
+            AssertThat(static_cast<OTPToken::sqliteTokenID>(imported.size()), Equals(TokenDatabase::tokenCount()));
+            std::remove(exported.c_str());
+
+            // the snapshot file is read from a copy as well
+            const auto snapshot = file + ".snapshot";
+            AssertThat(TokenDatabase::writeSnapshot(snapshot, {TokenDatabase::tokenId(OTPToken::Label("w1")), 999999}),
+                       Equals(TokenDatabase::Success));
+            TokenDatabase::Snapshot entries;
+            AssertThat(TokenDatabase::readSnapshot(snapshot, entries), Equals(TokenDatabase::Success));
+            AssertThat(entries.size(), Equals(1U));
+            AssertThat(entries.at(0).label, Equals(std::string("w1")));
+            std::remove(snapshot.c_str());
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::exportReader().isValid(), IsFalse());
+        });
+
+        it("[tuning]", [&]{
+            AssertThat(TokenDatabase::tuning(TokenDatabase::EncryptedPages).journalMode, Equals(TokenDatabase::JournalTruncate));
+            AssertThat(TokenDatabase::tuning(TokenDatabase::EncryptedImage).journalMode, Equals(TokenDatabase::JournalMemory));
+
+            // deleted tokens leave no dangling display order behind with enforced references
+            auto tuning = TokenDatabase::defaultTuning(TokenDatabase::EncryptedPages);
+            tuning.foreignKeys = true;
+            tuning.cacheSizeKb = 512U;
+            TokenDatabase::setTuning(TokenDatabase::EncryptedPages, tuning);
+            AssertThat(TokenDatabase::tuning(TokenDatabase::EncryptedPages).cacheSizeKb, Equals(512U));
+
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "b", {}, "ABCD123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::deleteToken(TokenDatabase::tokenId(OTPToken::Label("a"))), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+
+            // the truncated journal is kept for the next commit
+            AssertThat(std::filesystem::exists(file + "-journal"), IsTrue());
+            AssertThat(std::filesystem::file_size(file + "-journal"), Equals(0U));
+
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(1));
+            AssertThat(TokenDatabase::displayOrder().size(), Equals(1U));
+        });
+
+        it("[vaults]", [&]{
+            AssertThat(TokenDatabase::selectedVault(), Equals(""));
+            AssertThat(TokenDatabase::selectVault("ops"), IsFalse());
+
+            // new vaults start closed and have their own file, password and format
+            AssertThat(TokenDatabase::selectVault("ops", true), IsTrue());
+            AssertThat(TokenDatabase::databaseConnected(), IsFalse());
+            TokenDatabase::setPassword("otpgen-tests-ops");
+            TokenDatabase::setTokenDatabase(vaultFile);
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "c", {}, "JKLM123456KDDK83D")), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::Steam, "x", {}, "NOPQ123456KDDK83D")), Equals(TokenDatabase::Success));
+
+            std::vector<std::string> names = {"", "ops"};
+            AssertThat(TokenDatabase::vaults(), Equals(names));
+
+            // the vaults are independent, unsaved changes survive switching
+            AssertThat(TokenDatabase::selectVault(""), IsTrue());
+            AssertThat(TokenDatabase::storageFormat(), Equals(TokenDatabase::EncryptedImage));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+            AssertThat(TokenDatabase::tokenId(OTPToken::Label("x")), Equals(0));
+            AssertThat(TokenDatabase::selectVault("ops"), IsTrue());
+            AssertThat(TokenDatabase::hasUnsavedChanges(), IsTrue());
+            AssertThat(TokenDatabase::tokenCount(), Equals(2));
+            AssertThat(TokenDatabase::selectToken(OTPToken::Label("c")).secret(), Equals("JKLM123456KDDK83D"));
+
+            const auto found = TokenDatabase::searchVaults("c");
+            AssertThat(found.size(), Equals(2U));
+            AssertThat(found[0].vault, Equals(""));
+            AssertThat(found[0].token.secret(), Equals("EFGH123456KDDK83D"));
+            AssertThat(found[1].vault, Equals("ops"));
+            AssertThat(TokenDatabase::selectedVault(), Equals("ops"));
+
+            std::vector<TokenDatabase::VaultCode> codes;
+            AssertThat(TokenDatabase::computeVaultCodes(std::time(nullptr), codes), Equals(TokenDatabase::Success));
+            AssertThat(codes.size(), Equals(5U));
+            for (auto&& code : codes)
+            {
+                AssertThat(code.error == OTPGenErrorCode::Valid, IsTrue());
+                AssertThat(code.code.empty(), IsFalse());
+            }
+            AssertThat(codes[0].vault, Equals(""));
+            AssertThat(codes[4].vault, Equals("ops"));
+            AssertThat(codes[4].label, Equals("x"));
+            AssertThat(codes[4].code.size(), Equals(5U));
+
+            // closing removes the vault, unsaved changes are discarded
+            AssertThat(TokenDatabase::closeVault("ops"), IsTrue());
+            AssertThat(TokenDatabase::closeVault("ops"), IsFalse());
+            AssertThat(TokenDatabase::selectedVault(), Equals(""));
+            AssertThat(TokenDatabase::vaults().size(), Equals(1U));
+            AssertThat(TokenDatabase::tokenCount(), Equals(3));
+
+            AssertThat(TokenDatabase::selectVault("ops", true), IsTrue());
+            TokenDatabase::setPassword("otpgen-tests-ops");
+            TokenDatabase::setTokenDatabase(vaultFile);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(1));
+
+            // closing the default vault keeps it
+            AssertThat(TokenDatabase::closeVault(""), IsTrue());
+            AssertThat(TokenDatabase::selectedVault(), Equals("ops"));
+            AssertThat(TokenDatabase::selectVault(""), IsTrue());
+            AssertThat(TokenDatabase::databaseConnected(), IsFalse());
+            AssertThat(TokenDatabase::searchVaults("c").size(), Equals(1U));
+        });
+    });
+});
+
+#endif // TOKENDATABASETESTS_HPP
@@ -0,0 +1,214 @@
+#ifndef TOKENSEARCHTESTS_HPP
+#define TOKENSEARCHTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <TokenSearchIndex.hpp>
+#include <TokenSearch.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+go_bandit([]{
+    describe("TokenSearch Test", []{
+        using Ids = std::vector<TokenSearchIndex::TokenId>;
+
+        it("[literals]", [&]{
+            // only literals every match must contain
+            using Literals = std::vector<std::string>;
+            AssertThat(TokenSearchIndex::requiredLiterals("GitHub"), Equals(Literals{"github"}));
+            AssertThat(TokenSearchIndex::requiredLiterals("^mail.*google$"), Equals(Literals{"mail", "google"}));
+            AssertThat(TokenSearchIndex::requiredLiterals("steams?tore"), Equals(Literals{"steam", "tore"}));
+            AssertThat(TokenSearchIndex::requiredLiterals("ab+c"), Equals(Literals{"ab", "c"}));
+            AssertThat(TokenSearchIndex::requiredLiterals("a\\.b[xyz]cde"), Equals(Literals{"a.b", "cde"}));
+            AssertThat(TokenSearchIndex::requiredLiterals("abc\\x41def"), Equals(Literals{"abc", "def"}));
+            AssertThat(TokenSearchIndex::requiredLiterals("pre(opt)?post"), Equals(Literals{"pre", "post"}));
+            AssertThat(TokenSearchIndex::requiredLiterals("work|home"), Equals(Literals{}));
+            AssertThat(TokenSearchIndex::requiredLiterals("\\d+"), Equals(Literals{}));
+        });
+
+        it("[search]", [&]{
+            TokenSearchIndex index;
+            index.insert(1, "GitHub");
+            index.insert(2, "GitLab");
+            index.insert(3, "Google Mail");
+            index.insert(4, "Steam Store");
+            index.insert(5, "git");
+            AssertThat(index.size(), Equals(5U));
+
+            Ids ids;
+            AssertThat(index.search("git", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{1, 2, 5}));
+            AssertThat(index.search("^git(hub|lab)$", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{1, 2}));
+            AssertThat(index.search("MAIL", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{3}));
+            AssertThat(index.search("", ids), Equals(true));
+            AssertThat(ids.size(), Equals(5U));
+            AssertThat(index.search("nothing", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{}));
+
+            // invalid expressions fail
+            AssertThat(index.search("git(", ids), Equals(false));
+            AssertThat(ids, Equals(Ids{}));
+
+            // the trigrams narrow the labels down before the expression is evaluated
+            index.candidates("hub", ids);
+            AssertThat(ids, Equals(Ids{1}));
+            index.candidates("g.t", ids);
+            AssertThat(ids.size(), Equals(5U));
+
+            // a set flag cancels the search
+            std::atomic<bool> cancel{true};
+            AssertThat(index.search("git", ids, &cancel), Equals(false));
+        });
+
+        it("[updates]", [&]{
+            TokenSearchIndex index;
+            index.insert(1, "GitHub");
+            index.insert(2, "GitLab");
+            index.insert(3, "Steam");
+
+            // renamed tokens keep their place
+            Ids ids;
+            index.rename(1, "Codeberg");
+            AssertThat(index.search("git", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{2}));
+            index.rename(3, "GitTea");
+            AssertThat(index.search("git", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{2, 3}));
+            index.insert(1, "Gitee");
+            AssertThat(index.search("git", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{1, 2, 3}));
+
+            index.remove(2);
+            index.remove(9);
+            AssertThat(index.contains(2), Equals(false));
+            AssertThat(index.ids(), Equals(Ids{1, 3}));
+            AssertThat(index.search("git", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{1, 3}));
+
+            // compaction after many removals keeps the order
+            for (auto i = 100U; i < 3100U; ++i)
+            {
+                index.insert(i, "bulk " + std::to_string(i));
+            }
+            for (auto i = 100U; i < 3100U; ++i)
+            {
+                index.remove(i);
+            }
+            index.insert(4, "GitBucket");
+            AssertThat(index.size(), Equals(3U));
+            AssertThat(index.search("git", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{1, 3, 4}));
+            index.candidates("bulk", ids);
+            AssertThat(ids, Equals(Ids{}));
+
+            index.clear();
+            AssertThat(index.size(), Equals(0U));
+        });
+
+        it("[label arena]", [&]{
+            // one copy per text, labels differing in case share the key and the folded text
+            const auto arena = std::make_shared<LabelArena>();
+            const auto github = arena->intern("GitHub");
+            AssertThat(github.valid(), IsTrue());
+            AssertThat(std::string(github.text), Equals("GitHub"));
+            AssertThat(std::string(github.folded), Equals("github"));
+            AssertThat(arena->intern(std::string("GitHub")) == github, IsTrue());
+            AssertThat(arena->intern("GitHub").text.data() == github.text.data(), IsTrue());
+
+            const auto lower = arena->intern("github");
+            AssertThat(lower == github, IsFalse());
+            AssertThat(lower.key, Equals(github.key));
+            AssertThat(lower.hash, Equals(github.hash));
+            AssertThat(lower.folded.data() == github.folded.data(), IsTrue());
+
+            LabelArena::Label found;
+            AssertThat(arena->findFolded("GITHUB", found), IsTrue());
+            AssertThat(found == github, IsTrue());
+            AssertThat(arena->find("GITHUB", found), IsFalse());
+            AssertThat(arena->get(lower.id) == lower, IsTrue());
+            AssertThat(arena->get(99U).valid(), IsFalse());
+            AssertThat(arena->size(), Equals(2U));
+            AssertThat(arena->bytes(), Equals(18U));
+
+            // labels larger than a block
+            const std::string large(40000U, 'x');
+            AssertThat(std::string(arena->intern(large).text), Equals(large));
+            AssertThat(std::string(arena->get(github.id).text), Equals("GitHub"));
+
+            // an index moved to a shared arena keeps its results
+            TokenSearchIndex index;
+            index.insert(1, "GitHub");
+            index.insert(2, "Steam");
+            index.setArena(arena);
+            AssertThat(index.arena() == arena, IsTrue());
+            AssertThat(arena->size(), Equals(4U));
+            Ids ids;
+            AssertThat(index.search("HUB", ids), Equals(true));
+            AssertThat(ids, Equals(Ids{1}));
+            index.clear();
+            AssertThat(index.arena() == arena, IsTrue());
+        });
+
+        it("[debounce]", [&]{
+            // only the latest of quickly following queries is searched
+            TokenSearchIndex index;
+            for (auto i = 1U; i <= 1000U; ++i)
+            {
+                index.insert(i, "token " + std::to_string(i));
+            }
+
+            std::mutex mutex;
+            std::condition_variable done;
+            std::vector<TokenSearch::Result> results;
+
+            TokenSearch search(index, std::chrono::milliseconds(50));
+            search.start([&](const TokenSearch::Result &result) {
+                std::lock_guard<std::mutex> lock(mutex);
+                results.emplace_back(result);
+                done.notify_all();
+            });
+            AssertThat(search.running(), Equals(true));
+
+            search.query("1");
+            search.query("12");
+            const auto generation = search.query("123");
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait_for(lock, std::chrono::seconds(5), [&]{ return !results.empty(); });
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                AssertThat(results.size(), Equals(1U));
+                AssertThat(results[0].generation, Equals(generation));
+                AssertThat(results[0].pattern, Equals("123"));
+                AssertThat(results[0].valid, Equals(true));
+                AssertThat(results[0].ids, Equals(Ids{123}));
+                results.clear();
+            }
+
+            // cancelled queries are never reported
+            search.query("4");
+            search.cancel();
+            std::this_thread::sleep_for(std::chrono::milliseconds(150));
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                AssertThat(results.size(), Equals(0U));
+            }
+
+            search.stop();
+            AssertThat(search.running(), Equals(false));
+        });
+    });
+});
+
+#endif // TOKENSEARCHTESTS_HPP
@@ -0,0 +1,61 @@
+#ifndef TOKENSERVICETESTS_HPP
+#define TOKENSERVICETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <Clock.hpp>
+#include <OTPGen.hpp>
+#include <RateLimiter.hpp>
+#include <TokenDatabase.hpp>
+
+#include <TokenService.hpp>
+
+#include <filesystem>
+#include <string>
+
+go_bandit([]{
+    describe("TokenService Test", []{
+        const auto file = (std::filesystem::temp_directory_path() / "otpgen-tests-service.db").string();
+        FixedClock clock(1536573862);
+
+        before_each([&]{
+            Clock::setDefaultClock(&clock);
+            TokenDatabase::setPassword("otpgen-tests");
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D")), Equals(TokenDatabase::Success));
+        });
+
+        after_each([&]{
+            Clock::setDefaultClock(nullptr);
+            TokenDatabase::closeDatabase();
+            std::filesystem::remove(file);
+        });
+
+        it("[rate limit in pipelined batches]", [&]{
+            RateLimiter::Limit limit;
+            limit.burst = 1U;
+            limit.interval = std::chrono::hours(1);
+            RateLimiter limiter(limit, 64U);
+
+            TokenService service;
+            service.setRateLimiter(&limiter);
+            AssertThat(service.load(), Equals(TokenDatabase::Success));
+
+            const auto id = std::to_string(TokenDatabase::tokenId(OTPToken::Label("a")));
+            const auto code = OTPGen::computeTOTP(clock.now(), "XYZA123456KDDK83D", 6, 30, OTPToken::SHA1);
+            const auto wrong = code == "000000" ? "111111" : "000000";
+
+            // the match refills the attempts before the next request of the batch takes one
+            std::string out;
+            service.handle({"verify\t" + id + "\t" + code, "verify\t" + id + "\t" + wrong, "verify\t" + id + "\t" + wrong},
+                           TokenService::Local, out);
+            AssertThat(out, Equals("ok\tmatch\nok\tmismatch\nerror\ttoo many attempts\n"));
+        });
+    });
+});
+
+#endif // TOKENSERVICETESTS_HPP
@@ -0,0 +1,74 @@
+#ifndef TOKENSETTESTS_HPP
+#define TOKENSETTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <TokenSet.hpp>
+#include <ThreadPool.hpp>
+
+go_bandit([]{
+    describe("TokenSet Test", []{
+        const std::vector<OTPToken> tokens = {
+            OTPToken(OTPToken::TOTP, "1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::HOTP, "2", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+            OTPToken(OTPToken::Steam, "3", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"),
+            OTPToken(OTPToken::TOTP, "4", {}, "XYZA123456KDDK83D28273", 7, 10, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::None, "5", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::TOTP, "6", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::TOTP, "7", {}, "XYZA123456KDDK83D", 8, 30, 0, OTPToken::SHA512),
+        };
+
+        it("[grouping]", [&]{
+            // tokens with the same parameters share a group, invalid tokens are in none
+            TokenSet set(tokens);
+            AssertThat(set.size(), Equals(7U));
+            AssertThat(set.groups().size(), Equals(5U));
+            AssertThat(set.groups().at(0).indices, Equals(std::vector<std::size_t>{0, 5}));
+            AssertThat(set.label(2), Equals(std::string("3")));
+            AssertThat(set.type(4) == OTPToken::None, Equals(true));
+            AssertThat(set.rotationPeriod(3), Equals(10U));
+            AssertThat(set.rotationPeriod(1), Equals(0U));
+        });
+
+        it("[computeCodes]", [&]{
+            // codes must be identical to the single token api
+            TokenSet set(tokens);
+            std::vector<OTPToken::TokenString> res;
+            std::vector<OTPGenErrorCode> errors;
+            set.computeCodes(1536573862, res, &errors);
+            AssertThat(res.size(), Equals(7U));
+            AssertThat(res.at(0), Equals(std::string("122810")));
+            AssertThat(res.at(1), Equals(OTPGen::computeHOTP("XYZA123456KDDK83D", 12, 6, OTPToken::SHA1)));
+            AssertThat(res.at(2), Equals(std::string("GQTTM")));
+            AssertThat(res.at(3), Equals(std::string("8578249")));
+            AssertThat(res.at(4), Equals(std::string()));
+            AssertThat(errors.at(4) == OTPGenErrorCode::InvalidType, Equals(true));
+            AssertThat(res.at(5), Equals(std::string("122810")));
+            AssertThat(res.at(6), Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 8, 30, OTPToken::SHA512)));
+
+            // the executor doesn't change the results
+            ThreadPool pool(2);
+            std::vector<OTPToken::TokenString> parallel;
+            set.computeCodes(1536573862, parallel, nullptr, &pool);
+            AssertThat(parallel, Equals(res));
+        });
+
+        it("[move]", [&]{
+            // moved tokens hand over their labels and icons
+            auto token = OTPToken(OTPToken::TOTP, "moved", OTPToken::Icon(128, 7), "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1);
+            TokenSet set;
+            AssertThat(set.insert(std::move(token)), Equals(0U));
+            AssertThat(set.label(0), Equals(std::string("moved")));
+            AssertThat(set.icon(0).size(), Equals(128U));
+
+            set.clear();
+            AssertThat(set.empty(), Equals(true));
+            AssertThat(set.groups().empty(), Equals(true));
+        });
+    });
+});
+
+#endif // TOKENSETTESTS_HPP
@@ -0,0 +1,119 @@
+#ifndef TOKENSETVIEWTESTS_HPP
+#define TOKENSETVIEWTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <TokenSet.hpp>
+#include <TokenSetView.hpp>
+
+go_bandit([]{
+    describe("TokenSetView Test", []{
+        const std::vector<OTPToken> tokens = {
+            OTPToken(OTPToken::TOTP, "Github", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::HOTP, "bank", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+            OTPToken(OTPToken::Steam, "steam", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"),
+            OTPToken(OTPToken::TOTP, "short", {}, "XYZA123456KDDK83D28273", 7, 10, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::None, "invalid", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::TOTP, "aws", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::TOTP, "mail", {}, "XYZA123456KDDK83D", 8, 30, 0, OTPToken::SHA512),
+        };
+
+        it("[layout]", [&]{
+            // invalid tokens are left out, the tokens of a group are sorted by label
+            TokenSet set(tokens);
+            SecureBuffer buffer;
+            AssertThat(TokenSetView::serialize(set, buffer), IsTrue());
+
+            TokenSetView view;
+            AssertThat(view.open(std::move(buffer)), IsTrue());
+            AssertThat(view.size(), Equals(6U));
+            AssertThat(view.label(0), Equals("Github"));
+            AssertThat(view.label(1), Equals("aws"));
+            AssertThat(view.type(2), Equals(static_cast<OTPToken::TokenType>(OTPToken::HOTP)));
+            AssertThat(view.counter(2), Equals(12U));
+            AssertThat(view.period(3), Equals(30U));
+            AssertThat(view.digitLength(3), Equals(5U));
+            AssertThat(view.algorithm(5), Equals(static_cast<OTPToken::ShaAlgorithm>(OTPToken::SHA512)));
+            AssertThat(view.label(view.size()).empty(), IsTrue());
+
+            // labels are found case insensitive like in the database
+            AssertThat(view.find("github"), Equals(0U));
+            AssertThat(view.find("MAIL"), Equals(5U));
+            AssertThat(view.find("invalid"), Equals(TokenSetView::npos));
+            AssertThat(view.find(""), Equals(TokenSetView::npos));
+
+            // a moved view keeps the buffer
+            auto moved = std::move(view);
+            AssertThat(view.isOpen(), IsFalse());
+            AssertThat(moved.find("steam"), Equals(3U));
+        });
+
+        it("[computeCode]", [&]{
+            // the codes match the ones of the token set
+            TokenSet set(tokens);
+            std::vector<OTPToken::TokenString> codes;
+            set.computeCodes(1536573862, codes);
+
+            SecureBuffer buffer;
+            AssertThat(TokenSetView::serialize(set, buffer), IsTrue());
+            TokenSetView view;
+            AssertThat(view.open(buffer.data(), buffer.size()), IsTrue());
+            for (auto i = 0U; i < tokens.size(); ++i)
+            {
+                if (i == 4U)
+                {
+                    continue;
+                }
+                OTPGen::TokenBuffer code;
+                const auto index = view.find(tokens[i].label());
+                AssertThat(view.computeCode(index, 1536573862, code), IsTrue());
+                AssertThat(std::string(code), Equals(codes[i]));
+            }
+
+            OTPGen::TokenBuffer code;
+            AssertThat(view.computeCode(view.size(), 1536573862, code), IsFalse());
+            AssertThat(std::string(code).empty(), IsTrue());
+
+            // only TOTP tokens are verified
+            int step = 0;
+            AssertThat(view.verifyCode(view.find("aws"), "122810", 1536573862 + 30, 1, &step), IsTrue());
+            AssertThat(step, Equals(-1));
+            AssertThat(view.verifyCode(view.find("aws"), "122811", 1536573862, 1), IsFalse());
+            AssertThat(view.verifyCode(view.find("steam"), codes[2], 1536573862, 1), IsFalse());
+        });
+
+        it("[validation]", [&]{
+            TokenSet set(tokens);
+            SecureBuffer buffer;
+            AssertThat(TokenSetView::serialize(set, buffer), IsTrue());
+
+            TokenSetView view;
+            AssertThat(view.open(buffer.data(), buffer.size() - 1U), IsFalse());
+            AssertThat(view.open(nullptr, 0U), IsFalse());
+
+            // a token count beyond the index is rejected
+            auto corrupt = buffer;
+            corrupt[8] = 0xFF;
+            AssertThat(view.open(corrupt.data(), corrupt.size()), IsFalse());
+
+            // a label reaching into the keys
+            corrupt = buffer;
+            const auto tokens_offset = corrupt[28] | (corrupt[29] << 8U);
+            corrupt[tokens_offset + 20U] = 0xFF;
+            AssertThat(view.open(corrupt.data(), corrupt.size()), IsFalse());
+            AssertThat(view.isOpen(), IsFalse());
+
+            // empty sets are valid
+            SecureBuffer empty;
+            AssertThat(TokenSetView::serialize(TokenSet(), empty), IsTrue());
+            AssertThat(view.open(std::move(empty)), IsTrue());
+            AssertThat(view.empty(), IsTrue());
+            AssertThat(view.find("aws"), Equals(TokenSetView::npos));
+        });
+    });
+});
+
+#endif // TOKENSETVIEWTESTS_HPP
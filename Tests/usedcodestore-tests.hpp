@@ -0,0 +1,138 @@
+#ifndef USEDCODESTORETESTS_HPP
+#define USEDCODESTORETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <UsedCodeStore.hpp>
+#include <OTPGen.hpp>
+
+#include <atomic>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+go_bandit([]{
+    describe("UsedCodeStore Test", []{
+        it("[insert and expiry]", [&]{
+            UsedCodeStore store(1000);
+            AssertThat(store.capacity(), Equals(1024U));
+
+            AssertThat(store.insert(1, 100, 3030, 3000) == UsedCodeStore::Accepted, Equals(true));
+            AssertThat(store.insert(1, 100, 3030, 3010) == UsedCodeStore::Reused, Equals(true));
+            AssertThat(store.contains(1, 100, 3029), Equals(true));
+            AssertThat(store.insert(1, 101, 3060, 3010) == UsedCodeStore::Accepted, Equals(true));
+            AssertThat(store.insert(2, 100, 3030, 3010) == UsedCodeStore::Accepted, Equals(true));
+
+            AssertThat(store.occupancy(3010), Equals(3U));
+            AssertThat(store.occupancy(3030), Equals(1U));
+
+            // the slot is free again once the step expired
+            AssertThat(store.contains(1, 100, 3030), Equals(false));
+            AssertThat(store.insert(1, 100, 3060, 3030) == UsedCodeStore::Accepted, Equals(true));
+
+            store.clear();
+            AssertThat(store.contains(1, 101, 3010), Equals(false));
+            AssertThat(store.occupancy(3010), Equals(0U));
+        });
+
+        it("[full]", [&]{
+            // a store of one shard is full after its probe sequences are taken,
+            // expired slots are reused without a cleanup
+            UsedCodeStore store(1);
+            std::size_t accepted = 0U, full = 0U;
+            for (auto i = 0U; i < 1000U; ++i)
+            {
+                const auto result = store.insert(i, 7, 1000, 900);
+                accepted += result == UsedCodeStore::Accepted;
+                full += result == UsedCodeStore::Full;
+            }
+            AssertThat(accepted <= store.capacity(), Equals(true));
+            AssertThat(accepted + full, Equals(1000U));
+            AssertThat(full > 0U, Equals(true));
+            AssertThat(store.insert(5000, 7, 1100, 1000) == UsedCodeStore::Accepted, Equals(true));
+        });
+
+        it("[concurrent inserts]", [&]{
+            // every pair is accepted at most once and stays marked, no matter how many threads submit it
+            UsedCodeStore store(1U << 14);
+            std::atomic<std::size_t> accepted{0U};
+            std::vector<std::thread> threads;
+            for (auto t = 0U; t < 4U; ++t)
+            {
+                threads.emplace_back([&]{
+                    for (auto i = 0U; i < 2000U; ++i)
+                    {
+                        if (store.insert(i % 500U, i / 500U, 2000, 1000) == UsedCodeStore::Accepted)
+                        {
+                            ++accepted;
+                        }
+                    }
+                });
+            }
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            AssertThat(accepted.load() <= 2000U, Equals(true));
+            for (auto i = 0U; i < 2000U; ++i)
+            {
+                AssertThat(store.contains(i % 500U, i / 500U, 1000), Equals(true));
+            }
+        });
+
+        it("[verifyTOTP]", [&]{
+            // code of the [computeTOTP 1] test, it can't be used twice for the same token
+            UsedCodeStore store;
+            const auto key = OTPGen::prepareKey("XYZA123456KDDK83D", OTPToken::SHA1);
+            auto error = OTPGenErrorCode::Valid;
+            int step = 0;
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862, 1, 6, 30, store, 4, &step, &error), Equals(true));
+            AssertThat(step, Equals(0));
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862 + 30, 1, 6, 30, store, 4, &step, &error), Equals(false));
+            AssertThat(error == OTPGenErrorCode::CodeReused, Equals(true));
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862, 1, 6, 30, store, 5), Equals(true));
+
+            // a wrong code doesn't consume anything
+            error = OTPGenErrorCode::Valid;
+            AssertThat(OTPGen::verifyTOTP(key, "122811", 1536573862, 1, 6, 30, store, 6, nullptr, &error), Equals(false));
+            AssertThat(error == OTPGenErrorCode::Valid, Equals(true));
+            AssertThat(OTPGen::verifyTOTP(key, "122810", 1536573862, 1, 6, 30, store, 6), Equals(true));
+
+            std::vector<std::uint8_t> matched;
+            OTPGen::verifyTOTPBatch({key, key, key}, {"122810", "122810", "122810"}, {6, 7, 7},
+                                    1536573862, 1, 6, 30, store, matched);
+            AssertThat(matched, Equals(std::vector<std::uint8_t>{0, 1, 0}));
+        });
+
+#if defined(__unix__) || defined(__APPLE__)
+        it("[shared between processes]", [&]{
+            UsedCodeStore store(1000, UsedCodeStore::Shared);
+            AssertThat(store.shared(), Equals(true));
+            AssertThat(store.insert(1, 100, 3030, 3000) == UsedCodeStore::Accepted, Equals(true));
+
+            // the child sees the use of the parent and the parent the one of the child
+            const auto pid = ::fork();
+            if (pid == 0)
+            {
+                const auto reused = store.insert(1, 100, 3030, 3010) == UsedCodeStore::Reused;
+                const auto accepted = store.insert(2, 100, 3030, 3010) == UsedCodeStore::Accepted;
+                std::_Exit(reused && accepted ? 0 : 1);
+            }
+            AssertThat(pid > 0, Equals(true));
+            int status = 0;
+            AssertThat(::waitpid(pid, &status, 0), Equals(pid));
+            AssertThat(WIFEXITED(status) && WEXITSTATUS(status) == 0, Equals(true));
+            AssertThat(store.insert(2, 100, 3030, 3020) == UsedCodeStore::Reused, Equals(true));
+            AssertThat(store.occupancy(3020), Equals(2U));
+        });
+#endif
+    });
+});
+
+#endif // USEDCODESTORETESTS_HPP
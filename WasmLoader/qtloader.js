@@ -325,6 +325,10 @@ function QtLoader(config)
             return config.path + filename;
         };
 
+        // Builds with pthreads start their Web Workers from the application script,
+        // which is evaluated from source here and has no URL of its own.
+        Module.mainScriptUrlOrBlob = Module.mainScriptUrlOrBlob || config.path + applicationName + ".js";
+
         // Attach status callbacks
         Module.setStatus = Module.setStatus || function(text) {
             // Currently the only usable status update from this function